@@ -4,6 +4,9 @@
 #include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <pthread.h>
 #include <android/log.h>
 #include "librats_c.h"
 
@@ -41,15 +44,29 @@ static std::unordered_map<rats_client_t, CallbackData> g_file_request_callbacks;
 static std::unordered_map<rats_client_t, CallbackData> g_directory_request_callbacks;
 static std::unordered_map<rats_client_t, CallbackData> g_directory_progress_callbacks;
 
-// Helper to get JNI env
+// Threads we attached are detached when they exit; the key's destructor runs on thread exit
+static pthread_key_t g_detach_key;
+static thread_local JNIEnv* t_env = nullptr;
+
+static void detach_thread(void* value) {
+    if (g_jvm) {
+        g_jvm->DetachCurrentThread();
+    }
+}
+
+// Helper to get JNI env, attaching librats threads once and caching the env per thread
 JNIEnv* getJNIEnv() {
+    if (t_env) return t_env;
+    
     JNIEnv* env = nullptr;
     if (g_jvm->GetEnv((void**)&env, JNI_VERSION_1_6) != JNI_OK) {
         if (g_jvm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
             LOGE("Failed to attach thread to JVM");
             return nullptr;
         }
+        pthread_setspecific(g_detach_key, env);
     }
+    t_env = env;
     return env;
 }
 
@@ -178,11 +195,214 @@ void file_progress_callback_bridge(void* user_data, const char* transfer_id, int
     }
 }
 
+// Batched event delivery. One native thread per client drains the C API event queue and hands
+// each batch to EventBatchCallback.onEvents() in a single call. Payloads are direct ByteBuffers
+// over the lent rats_buffer memory, so nothing is copied into the Java heap; the buffers are
+// released once onEvents() returns.
+static const int EVENT_BATCH_SIZE = 256;
+static const size_t MAX_CACHED_PEER_IDS = 1024;
+
+static jclass g_event_class = nullptr;
+static jfieldID g_event_type_field = nullptr;
+static jfieldID g_event_peer_id_field = nullptr;
+static jfieldID g_event_data_field = nullptr;
+
+struct EventPump {
+    rats_client_t client = nullptr;
+    jobject callback = nullptr;          // Global ref to the EventBatchCallback
+    jmethodID on_events = nullptr;
+    jobjectArray events = nullptr;       // Global ref, RatsEvent objects reused for every batch
+    std::unordered_map<std::string, jstring> peer_ids;  // Global refs, so hot peers don't allocate a String per event
+    std::atomic<bool> running{true};
+    std::thread thread;
+};
+
+static std::mutex g_event_pump_mutex;
+static std::unordered_map<rats_client_t, std::shared_ptr<EventPump>> g_event_pumps;
+
+static jstring pump_peer_id(JNIEnv* env, EventPump& pump, const char* peer_id) {
+    auto it = pump.peer_ids.find(peer_id);
+    if (it != pump.peer_ids.end()) {
+        return it->second;
+    }
+    if (pump.peer_ids.size() >= MAX_CACHED_PEER_IDS) {
+        for (auto& entry : pump.peer_ids) {
+            env->DeleteGlobalRef(entry.second);
+        }
+        pump.peer_ids.clear();
+    }
+    jstring local = createJavaString(env, peer_id);
+    jstring global = static_cast<jstring>(env->NewGlobalRef(local));
+    env->DeleteLocalRef(local);
+    pump.peer_ids[peer_id] = global;
+    return global;
+}
+
+static void pump_forget_peer(JNIEnv* env, EventPump& pump, const char* peer_id) {
+    auto it = pump.peer_ids.find(peer_id);
+    if (it != pump.peer_ids.end()) {
+        env->DeleteGlobalRef(it->second);
+        pump.peer_ids.erase(it);
+    }
+}
+
+static void deliver_event_batch(JNIEnv* env, EventPump& pump, rats_event_t* events, int count) {
+    // Local refs are never popped on a native thread, so scope them to the batch
+    if (env->PushLocalFrame(count + 16) != JNI_OK) {
+        env->ExceptionClear();
+        LOGE("Failed to reserve local references for event batch");
+        return;
+    }
+    
+    static jbyte empty_payload = 0;
+    for (int i = 0; i < count; i++) {
+        jobject event = env->GetObjectArrayElement(pump.events, i);
+        jobject data = nullptr;
+        if (events[i].type != RATS_EVENT_CONNECTED && events[i].type != RATS_EVENT_DISCONNECTED) {
+            void* address = events[i].size > 0 ? const_cast<void*>(events[i].data) : &empty_payload;
+            data = env->NewDirectByteBuffer(address, static_cast<jlong>(events[i].size));
+        }
+        env->SetIntField(event, g_event_type_field, events[i].type);
+        env->SetObjectField(event, g_event_peer_id_field, pump_peer_id(env, pump, events[i].peer_id));
+        env->SetObjectField(event, g_event_data_field, data);
+        env->DeleteLocalRef(event);
+    }
+    
+    env->CallVoidMethod(pump.callback, pump.on_events, pump.events, count);
+    if (env->ExceptionCheck()) {
+        LOGE("EventBatchCallback.onEvents threw an exception");
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+    }
+    
+    // The buffers are about to be released; don't leave pooled events pointing at them
+    for (int i = 0; i < count; i++) {
+        jobject event = env->GetObjectArrayElement(pump.events, i);
+        env->SetObjectField(event, g_event_data_field, nullptr);
+        env->DeleteLocalRef(event);
+        if (events[i].type == RATS_EVENT_DISCONNECTED) {
+            pump_forget_peer(env, pump, events[i].peer_id);
+        }
+    }
+    
+    env->PopLocalFrame(nullptr);
+}
+
+static void run_event_pump(std::shared_ptr<EventPump> pump) {
+    JNIEnv* env = getJNIEnv();
+    rats_event_t events[EVENT_BATCH_SIZE];
+    
+    while (env && pump->running.load()) {
+        int count = rats_poll_events(pump->client, events, EVENT_BATCH_SIZE, -1);
+        if (count <= 0) {
+            if (count < 0) {
+                LOGE("rats_poll_events failed: %d", count);
+            }
+            if (!pump->running.load()) break;
+            continue;
+        }
+        if (pump->running.load()) {
+            deliver_event_batch(env, *pump, events, count);
+        }
+        for (int i = 0; i < count; i++) {
+            rats_buffer_release(events[i].buffer);
+        }
+    }
+    
+    // The pump owns its global refs, so release them here, after the last batch
+    if (env) {
+        for (auto& entry : pump->peer_ids) {
+            env->DeleteGlobalRef(entry.second);
+        }
+        pump->peer_ids.clear();
+        env->DeleteGlobalRef(pump->events);
+        env->DeleteGlobalRef(pump->callback);
+    }
+}
+
+static void stop_event_pump(rats_client_t client) {
+    std::shared_ptr<EventPump> pump;
+    {
+        std::lock_guard<std::mutex> lock(g_event_pump_mutex);
+        auto it = g_event_pumps.find(client);
+        if (it == g_event_pumps.end()) return;
+        pump = it->second;
+        g_event_pumps.erase(it);
+    }
+    
+    pump->running.store(false);
+    rats_enable_event_polling(client, 0, 0);    // Wakes the blocked poller
+    if (pump->thread.get_id() == std::this_thread::get_id()) {
+        // Stopped from inside onEvents(): the thread exits once the callback returns
+        pump->thread.detach();
+    } else {
+        pump->thread.join();
+    }
+}
+
+static bool start_event_pump(JNIEnv* env, rats_client_t client, jobject callback, int event_mask) {
+    if (!g_event_class) {
+        LOGE("RatsEvent class is not available");
+        return false;
+    }
+    
+    jclass callback_class = env->GetObjectClass(callback);
+    jmethodID on_events = env->GetMethodID(callback_class, "onEvents", "([Lcom/librats/RatsEvent;I)V");
+    env->DeleteLocalRef(callback_class);
+    jmethodID event_constructor = env->GetMethodID(g_event_class, "<init>", "()V");
+    if (!on_events || !event_constructor) {
+        env->ExceptionClear();
+        LOGE("EventBatchCallback.onEvents not found");
+        return false;
+    }
+    
+    jobjectArray events = env->NewObjectArray(EVENT_BATCH_SIZE, g_event_class, nullptr);
+    if (!events) return false;
+    for (int i = 0; i < EVENT_BATCH_SIZE; i++) {
+        jobject event = env->NewObject(g_event_class, event_constructor);
+        env->SetObjectArrayElement(events, i, event);
+        env->DeleteLocalRef(event);
+    }
+    
+    if (rats_enable_event_polling(client, event_mask, 0) != RATS_SUCCESS) {
+        env->DeleteLocalRef(events);
+        return false;
+    }
+    
+    auto pump = std::make_shared<EventPump>();
+    pump->client = client;
+    pump->callback = env->NewGlobalRef(callback);
+    pump->on_events = on_events;
+    pump->events = static_cast<jobjectArray>(env->NewGlobalRef(events));
+    env->DeleteLocalRef(events);
+    pump->thread = std::thread(run_event_pump, pump);
+    
+    std::lock_guard<std::mutex> lock(g_event_pump_mutex);
+    g_event_pumps[client] = pump;
+    return true;
+}
+
 // JNI function implementations
 extern "C" {
 
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
     g_jvm = vm;
+    pthread_key_create(&g_detach_key, detach_thread);
+    
+    // Cached here: FindClass on a native thread only sees system classes
+    JNIEnv* env = nullptr;
+    if (vm->GetEnv((void**)&env, JNI_VERSION_1_6) == JNI_OK) {
+        jclass event_class = env->FindClass("com/librats/RatsEvent");
+        if (event_class) {
+            g_event_class = static_cast<jclass>(env->NewGlobalRef(event_class));
+            g_event_type_field = env->GetFieldID(event_class, "type", "I");
+            g_event_peer_id_field = env->GetFieldID(event_class, "peerId", "Ljava/lang/String;");
+            g_event_data_field = env->GetFieldID(event_class, "data", "Ljava/nio/ByteBuffer;");
+            env->DeleteLocalRef(event_class);
+        } else {
+            env->ExceptionClear();
+        }
+    }
     LOGD("LibRats JNI loaded");
     return JNI_VERSION_1_6;
 }
@@ -230,6 +450,8 @@ JNIEXPORT void JNICALL
 Java_com_librats_RatsClient_nativeDestroy(JNIEnv* env, jobject thiz, jlong client_ptr) {
     rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
     if (client) {
+        stop_event_pump(client);
+        
         // Clean up callbacks
         std::lock_guard<std::mutex> lock(g_callback_mutex);
         g_connection_callbacks.erase(client);
@@ -346,6 +568,21 @@ Java_com_librats_RatsClient_nativeSendBinary(JNIEnv* env, jobject thiz, jlong cl
     return result;
 }
 
+JNIEXPORT jint JNICALL
+Java_com_librats_RatsClient_nativeSendBinaryDirect(JNIEnv* env, jobject thiz, jlong client_ptr, jstring peer_id, jobject buffer, jint offset, jint length) {
+    rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
+    std::string peer_id_str = javaStringToCString(env, peer_id);
+    
+    // Direct buffers are read in place: no array pinning and no copy on the Java side
+    const uint8_t* address = static_cast<const uint8_t*>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (!address || offset < 0 || length < 0 || static_cast<jlong>(offset) + length > capacity) {
+        return RATS_ERROR_INVALID_PARAMETER;
+    }
+    
+    return rats_send_binary(client, peer_id_str.c_str(), address + offset, static_cast<size_t>(length));
+}
+
 JNIEXPORT jint JNICALL
 Java_com_librats_RatsClient_nativeBroadcastBinary(JNIEnv* env, jobject thiz, jlong client_ptr, jbyteArray data) {
     rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
@@ -410,16 +647,16 @@ JNIEXPORT jobjectArray JNICALL
 Java_com_librats_RatsClient_nativeGetPeerIds(JNIEnv* env, jobject thiz, jlong client_ptr) {
     rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
     int count = 0;
-    char** peer_ids = rats_get_peer_ids(client, &count);
+    rats_buffer_t lent = rats_get_peer_ids_lent(client, &count);
+    const char* const* peer_ids = lent ? static_cast<const char* const*>(rats_buffer_data(lent)) : nullptr;
     
     jobjectArray result = env->NewObjectArray(count, env->FindClass("java/lang/String"), nullptr);
     for (int i = 0; i < count; i++) {
         jstring jstr = createJavaString(env, peer_ids[i]);
         env->SetObjectArrayElement(result, i, jstr);
         env->DeleteLocalRef(jstr);
-        rats_string_free(peer_ids[i]);
     }
-    if (peer_ids) free(peer_ids);
+    if (lent) rats_buffer_release(lent);
     
     return result;
 }
@@ -503,6 +740,23 @@ Java_com_librats_RatsClient_nativeSetBinaryCallback(JNIEnv* env, jobject thiz, j
     }
 }
 
+JNIEXPORT jboolean JNICALL
+Java_com_librats_RatsClient_nativeSetEventBatchCallback(JNIEnv* env, jobject thiz, jlong client_ptr, jobject callback, jint event_mask) {
+    rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
+    
+    stop_event_pump(client);
+    if (!callback || event_mask == 0) {
+        return JNI_TRUE;
+    }
+    return start_event_pump(env, client, callback, event_mask) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_librats_RatsClient_nativeGetDroppedEventCount(JNIEnv* env, jobject thiz, jlong client_ptr) {
+    rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
+    return static_cast<jlong>(rats_get_dropped_event_count(client));
+}
+
 JNIEXPORT void JNICALL
 Java_com_librats_RatsClient_nativeSetJsonCallback(JNIEnv* env, jobject thiz, jlong client_ptr, jobject callback) {
     rats_client_t client = reinterpret_cast<rats_client_t>(client_ptr);
@@ -0,0 +1,18 @@
+package com.librats;
+
+/**
+ * Callback interface for batched event delivery.
+ */
+public interface EventBatchCallback {
+    /**
+     * Called on the client's event thread with the events received since the
+     * previous call, in arrival order.
+     * 
+     * The array and its events are reused for the next batch, and payload
+     * buffers are released when this method returns. Copy anything you keep.
+     * 
+     * @param events Event array; only the first count entries are valid
+     * @param count Number of events in this batch
+     */
+    void onEvents(RatsEvent[] events, int count);
+}
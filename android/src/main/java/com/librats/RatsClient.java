@@ -2,6 +2,8 @@ package com.librats;
 
 import android.util.Log;
 
+import java.nio.ByteBuffer;
+
 /**
  * LibRats Android client wrapper providing peer-to-peer networking capabilities.
  * 
@@ -143,6 +145,26 @@ public class RatsClient {
         return nativeSendBinary(nativeClientPtr, peerId, data);
     }
     
+    /**
+     * Sends the remaining bytes of a buffer to a specific peer.
+     * 
+     * Direct buffers are read in place by the native layer without a copy into
+     * a Java array; heap buffers fall back to {@link #sendBinary(String, byte[])}.
+     * The buffer's position is not changed.
+     * 
+     * @param peerId The ID of the target peer
+     * @param data The buffer to send
+     * @return SUCCESS on success, error code on failure
+     */
+    public int sendBinary(String peerId, ByteBuffer data) {
+        if (data.isDirect()) {
+            return nativeSendBinaryDirect(nativeClientPtr, peerId, data, data.position(), data.remaining());
+        }
+        byte[] bytes = new byte[data.remaining()];
+        data.duplicate().get(bytes);
+        return nativeSendBinary(nativeClientPtr, peerId, bytes);
+    }
+    
     /**
      * Broadcasts binary data to all connected peers.
      * 
@@ -882,6 +904,42 @@ public class RatsClient {
         nativeSetDisconnectCallback(nativeClientPtr, callback);
     }
     
+    /**
+     * Delivers events in batches on a dedicated native thread.
+     * 
+     * Unlike the per-message callbacks, which are invoked once per message and
+     * copy binary payloads into a new byte[], this hands every event received
+     * since the previous batch to a single onEvents() call, with payloads as
+     * direct ByteBuffers over native memory. The per-message callbacks keep
+     * working alongside it. Pass null to stop batched delivery.
+     * 
+     * @param callback Batch callback, or null to stop
+     * @param eventMask Bitwise OR of RatsEvent types to deliver
+     * @return true on success, false if the event thread could not be started
+     */
+    public boolean setEventBatchCallback(EventBatchCallback callback, int eventMask) {
+        return nativeSetEventBatchCallback(nativeClientPtr, callback, eventMask);
+    }
+    
+    /**
+     * Delivers all event types in batches.
+     * 
+     * @param callback Batch callback, or null to stop
+     * @return true on success, false if the event thread could not be started
+     */
+    public boolean setEventBatchCallback(EventBatchCallback callback) {
+        return setEventBatchCallback(callback, RatsEvent.ALL);
+    }
+    
+    /**
+     * Gets the number of payload events dropped because the callback fell behind.
+     * 
+     * @return Dropped event count
+     */
+    public long getDroppedEventCount() {
+        return nativeGetDroppedEventCount(nativeClientPtr);
+    }
+    
     // GossipSub callback setters
     public void setTopicMessageCallback(String topic, TopicMessageCallback callback) {
         nativeSetTopicMessageCallback(nativeClientPtr, topic, callback);
@@ -959,6 +1017,7 @@ public class RatsClient {
     private native int nativeSendString(long clientPtr, String peerId, String message);
     private native int nativeBroadcastString(long clientPtr, String message);
     private native int nativeSendBinary(long clientPtr, String peerId, byte[] data);
+    private native int nativeSendBinaryDirect(long clientPtr, String peerId, ByteBuffer data, int offset, int length);
     private native int nativeBroadcastBinary(long clientPtr, byte[] data);
     private native int nativeSendJson(long clientPtr, String peerId, String jsonStr);
     private native int nativeBroadcastJson(long clientPtr, String jsonStr);
@@ -991,6 +1050,8 @@ public class RatsClient {
     private native void nativeSetBinaryCallback(long clientPtr, BinaryMessageCallback callback);
     private native void nativeSetJsonCallback(long clientPtr, JsonMessageCallback callback);
     private native void nativeSetDisconnectCallback(long clientPtr, DisconnectCallback callback);
+    private native boolean nativeSetEventBatchCallback(long clientPtr, EventBatchCallback callback, int eventMask);
+    private native long nativeGetDroppedEventCount(long clientPtr);
     
     // GossipSub native methods
     private native boolean nativeIsGossipsubAvailable(long clientPtr);
@@ -0,0 +1,78 @@
+package com.librats;
+
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+
+/**
+ * An event delivered in a batch to {@link EventBatchCallback}.
+ * 
+ * Event objects are reused for every batch and their payload points at native
+ * memory that is released when {@link EventBatchCallback#onEvents} returns.
+ * Copy whatever you need to keep before returning.
+ */
+public final class RatsEvent {
+    public static final int CONNECTED = 1;
+    public static final int DISCONNECTED = 2;
+    public static final int BINARY = 4;
+    public static final int STRING = 8;
+    public static final int JSON = 16;
+    public static final int ALL = 31;
+    
+    // Filled in by the native layer
+    int type;
+    String peerId;
+    ByteBuffer data;
+    
+    RatsEvent() {
+    }
+    
+    /**
+     * Gets the event type.
+     * 
+     * @return One of CONNECTED, DISCONNECTED, BINARY, STRING or JSON
+     */
+    public int getType() {
+        return type;
+    }
+    
+    /**
+     * Gets the ID of the peer the event is about.
+     * 
+     * @return Peer ID
+     */
+    public String getPeerId() {
+        return peerId;
+    }
+    
+    /**
+     * Gets the payload as a direct buffer over native memory, valid only until
+     * onEvents() returns. Treat it as read-only.
+     * 
+     * @return Payload, or null for connection events
+     */
+    public ByteBuffer getData() {
+        return data;
+    }
+    
+    /**
+     * Copies the payload into a new byte array.
+     * 
+     * @return Payload bytes, or null for connection events
+     */
+    public byte[] copyData() {
+        if (data == null) return null;
+        byte[] bytes = new byte[data.remaining()];
+        data.duplicate().get(bytes);
+        return bytes;
+    }
+    
+    /**
+     * Decodes a STRING or JSON payload as UTF-8.
+     * 
+     * @return Payload text, or null for connection events
+     */
+    public String getText() {
+        if (data == null) return null;
+        return StandardCharsets.UTF_8.decode(data.duplicate()).toString();
+    }
+}
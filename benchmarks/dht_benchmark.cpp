@@ -0,0 +1,483 @@
+// DHT benchmark and load generator.
+//
+// Floods a DhtClient over loopback with ping, find_node, announce_peer and
+// get_peers queries from one UDP socket, keeping a window of queries in
+// flight, and measures DhtRoutingTable insert and lookup cost at several
+// table sizes. Prints a table, and with --json writes the same numbers as
+// JSON so runs can be compared over time.
+//
+// Latencies are query-to-response times seen by the generator, so they
+// include both loopback hops. Allocations are counted process wide over a
+// flood (the generator itself does not allocate while it runs) and divided
+// by the number of queries answered.
+
+#include "dht.h"
+#include "krpc.h"
+#include "socket.h"
+#include "reactor.h"
+#include "logger.h"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+using namespace librats;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int port = 46881;
+    size_t queries = 50000;
+    size_t window = 64;
+    size_t workers = 0;
+    std::string json_path;
+};
+
+struct FloodResult {
+    std::string name;
+    size_t sent = 0;
+    size_t answered = 0;
+    size_t lost = 0;
+    double seconds = 0;
+    double queries_per_second = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    double allocations_per_message = 0;
+};
+
+struct RoutingTableResult {
+    size_t offered = 0;
+    size_t size = 0;
+    double insert_ns = 0;
+    double lookup_ns = 0;
+};
+
+std::mt19937_64 rng(0x5eed);
+
+NodeId random_id() {
+    NodeId id;
+    for (auto& byte : id) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return id;
+}
+
+// Transaction ids are the query index, so responses map straight back to their query
+std::string transaction_id_for(size_t index) {
+    std::string id(4, '\0');
+    for (int i = 0; i < 4; ++i) {
+        id[i] = static_cast<char>((index >> (24 - 8 * i)) & 0xFF);
+    }
+    return id;
+}
+
+// Finds "1:t4:<id>" in a response and returns the query index, or SIZE_MAX
+size_t response_index(const uint8_t* data, size_t size) {
+    static const char marker[] = "1:t4:";
+    const size_t marker_size = sizeof(marker) - 1;
+    for (size_t i = 0; i + marker_size + 4 <= size; ++i) {
+        if (std::memcmp(data + i, marker, marker_size) == 0) {
+            const uint8_t* id = data + i + marker_size;
+            return (size_t(id[0]) << 24) | (size_t(id[1]) << 16) | (size_t(id[2]) << 8) | size_t(id[3]);
+        }
+    }
+    return SIZE_MAX;
+}
+
+double percentile_us(std::vector<Clock::duration>& latencies, double fraction) {
+    if (latencies.empty()) {
+        return 0;
+    }
+    size_t index = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return std::chrono::duration<double, std::micro>(latencies[index]).count();
+}
+
+class LoadGenerator {
+public:
+    LoadGenerator(int dht_port) {
+        socket_ = create_udp_socket_v4(0);
+        if (is_valid_socket(socket_)) {
+            set_socket_nonblocking(socket_);
+            poller_.add(socket_);
+        }
+        make_udp_address(AF_INET, "127.0.0.1", dht_port, target_, target_length_);
+    }
+
+    ~LoadGenerator() {
+        if (is_valid_socket(socket_)) {
+            poller_.remove(socket_);
+            close_socket(socket_);
+        }
+    }
+
+    bool is_valid() const { return is_valid_socket(socket_); }
+
+    // Sends one query and waits for its response, for setup steps
+    std::unique_ptr<KrpcMessage> request(const KrpcMessage& query) {
+        auto data = KrpcProtocol::encode_message(query);
+        send_udp_nonblocking(socket_, target_, target_length_, data.data(), data.size());
+        auto deadline = Clock::now() + std::chrono::seconds(2);
+        while (Clock::now() < deadline) {
+            poller_.wait(events_, 50);
+            int size;
+            while ((size = receive(buffer_, sizeof(buffer_))) > 0) {
+                auto message = KrpcProtocol::decode_message(buffer_, size);
+                if (message && message->type == KrpcMessageType::Response &&
+                    message->transaction_id == query.transaction_id) {
+                    return message;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    FloodResult flood(const std::string& name, const std::vector<std::vector<uint8_t>>& datagrams, size_t window) {
+        enum : uint8_t { UNSENT, IN_FLIGHT, ANSWERED, LOST };
+        const size_t count = datagrams.size();
+        std::vector<uint8_t> state(count, UNSENT);
+        std::vector<Clock::time_point> sent_at(count);
+        std::vector<Clock::duration> latencies;
+        latencies.reserve(count);
+        events_.reserve(4);
+
+        FloodResult result;
+        result.name = name;
+        size_t next = 0;
+        size_t in_flight = 0;
+
+        uint64_t allocations_before = g_allocations.load();
+        auto start = Clock::now();
+        auto last_progress = start;
+
+        while (result.answered + result.lost < count) {
+            while (in_flight < window && next < count) {
+                const auto& data = datagrams[next];
+                if (send_udp_nonblocking(socket_, target_, target_length_, data.data(), data.size()) <= 0) {
+                    break;
+                }
+                sent_at[next] = Clock::now();
+                state[next++] = IN_FLIGHT;
+                ++in_flight;
+            }
+
+            poller_.wait(events_, 10);
+
+            int size;
+            while ((size = receive(buffer_, sizeof(buffer_))) > 0) {
+                size_t index = response_index(buffer_, size);
+                if (index >= next || state[index] != IN_FLIGHT) {
+                    continue;  // Not one of ours, e.g. a ping the DHT sends to check us
+                }
+                auto now = Clock::now();
+                latencies.push_back(now - sent_at[index]);
+                state[index] = ANSWERED;
+                --in_flight;
+                ++result.answered;
+                last_progress = now;
+            }
+
+            // Queries unanswered for a second are dropped so the flood keeps going
+            auto now = Clock::now();
+            if (in_flight > 0 && now - last_progress > std::chrono::seconds(1)) {
+                for (size_t i = 0; i < next; ++i) {
+                    if (state[i] == IN_FLIGHT) {
+                        state[i] = LOST;
+                        --in_flight;
+                        ++result.lost;
+                    }
+                }
+                last_progress = now;
+            }
+        }
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        uint64_t allocations = g_allocations.load() - allocations_before;
+
+        result.sent = next;
+        result.queries_per_second = result.seconds > 0 ? result.answered / result.seconds : 0;
+        result.p50_us = percentile_us(latencies, 0.50);
+        result.p99_us = percentile_us(latencies, 0.99);
+        result.allocations_per_message = result.answered ? double(allocations) / result.answered : 0;
+        return result;
+    }
+
+private:
+    socket_t socket_;
+    sockaddr_storage target_{};
+    socklen_t target_length_ = 0;
+    IoPoller poller_;
+    std::vector<IoPoller::Event> events_;
+    uint8_t buffer_[DHT_MAX_DATAGRAM_SIZE];
+
+    int receive(uint8_t* buffer, size_t size) {
+        sockaddr_storage sender;
+        socklen_t sender_length = sizeof(sender);
+        return receive_udp_nonblocking(socket_, buffer, size, sender, sender_length);
+    }
+};
+
+std::vector<std::vector<uint8_t>> encode_all(size_t count, const std::function<KrpcMessage(const std::string&)>& make) {
+    std::vector<std::vector<uint8_t>> datagrams;
+    datagrams.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        datagrams.push_back(KrpcProtocol::encode_message(make(transaction_id_for(i))));
+    }
+    return datagrams;
+}
+
+std::vector<FloodResult> run_krpc_floods(const Options& options) {
+    std::vector<FloodResult> results;
+
+    DhtClient client(options.port, options.workers);
+    if (!client.start()) {
+        std::cerr << "Failed to start the DHT client on port " << options.port << std::endl;
+        return results;
+    }
+
+    LoadGenerator generator(options.port);
+    if (!generator.is_valid()) {
+        std::cerr << "Failed to create the load generator socket" << std::endl;
+        client.stop();
+        return results;
+    }
+
+    // Queries come from a pool of node ids, like traffic from many remote nodes would
+    std::vector<NodeId> senders(1024);
+    for (auto& id : senders) {
+        id = random_id();
+    }
+    auto sender = [&senders](size_t index) -> const NodeId& { return senders[index % senders.size()]; };
+
+    size_t n = options.queries;
+    size_t i = 0;
+    results.push_back(generator.flood("ping", encode_all(n, [&](const std::string& tid) {
+        return KrpcProtocol::create_ping_query(tid, sender(i++));
+    }), options.window));
+
+    i = 0;
+    results.push_back(generator.flood("find_node", encode_all(n, [&](const std::string& tid) {
+        return KrpcProtocol::create_find_node_query(tid, sender(i++), random_id());
+    }), options.window));
+
+    // Announces need a token, which is tied to our address rather than the info hash
+    std::vector<InfoHash> info_hashes(n);
+    for (auto& hash : info_hashes) {
+        hash = random_id();
+    }
+    auto token_reply = generator.request(KrpcProtocol::create_get_peers_query("tok!", senders[0], info_hashes[0]));
+    if (!token_reply || token_reply->token.empty()) {
+        std::cerr << "No announce token from the DHT client, skipping announce_peer and get_peers" << std::endl;
+        client.stop();
+        return results;
+    }
+    std::string token = token_reply->token;
+
+    i = 0;
+    results.push_back(generator.flood("announce_peer", encode_all(n, [&](const std::string& tid) {
+        size_t index = i++;
+        return KrpcProtocol::create_announce_peer_query(tid, sender(index), info_hashes[index],
+                                                        static_cast<uint16_t>(10000 + index % 50000), token);
+    }), options.window));
+
+    // Half of the lookups hit announced info hashes and get peers, half get nodes
+    i = 0;
+    results.push_back(generator.flood("get_peers", encode_all(n, [&](const std::string& tid) {
+        size_t index = i++;
+        return KrpcProtocol::create_get_peers_query(tid, sender(index),
+                                                    index % 2 ? info_hashes[index] : random_id());
+    }), options.window));
+
+    client.stop();
+    return results;
+}
+
+std::vector<RoutingTableResult> run_routing_table(const std::vector<size_t>& sizes) {
+    std::vector<RoutingTableResult> results;
+    const size_t lookups = 100000;
+
+    for (size_t offered : sizes) {
+        NodeId own_id = random_id();
+        DhtRoutingTable table(own_id);
+
+        // Spread the ids over every prefix length, or nearly all would land in
+        // the first few buckets and be turned away
+        std::vector<DhtNode> nodes;
+        nodes.reserve(offered);
+        for (size_t i = 0; i < offered; ++i) {
+            NodeId id = random_id();
+            size_t shared_bits = i % DhtRoutingTable::BUCKET_COUNT;
+            for (size_t bit = 0; bit < shared_bits; ++bit) {
+                uint8_t mask = static_cast<uint8_t>(0x80 >> (bit % 8));
+                id[bit / 8] = static_cast<uint8_t>((id[bit / 8] & ~mask) | (own_id[bit / 8] & mask));
+            }
+            nodes.emplace_back(id, NetEndpoint("10.0.0.1", 6881));
+        }
+
+        auto start = Clock::now();
+        for (const auto& node : nodes) {
+            table.insert(node);
+        }
+        double insert_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / offered;
+
+        std::vector<NodeId> targets(1024);
+        for (auto& target : targets) {
+            target = random_id();
+        }
+        size_t checksum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < lookups; ++i) {
+            checksum += table.find_closest(targets[i % targets.size()], K_BUCKET_SIZE).size();
+        }
+        double lookup_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / lookups;
+        if (checksum == 0) {
+            std::cerr << "Routing table lookups returned nothing" << std::endl;
+        }
+
+        RoutingTableResult result;
+        result.offered = offered;
+        result.size = table.size();
+        result.insert_ns = insert_ns;
+        result.lookup_ns = lookup_ns;
+        results.push_back(result);
+    }
+    return results;
+}
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [options]\n";
+    std::cout << "  --port <port>      DHT port on loopback (default: 46881)\n";
+    std::cout << "  --queries <count>  Queries per flood (default: 50000)\n";
+    std::cout << "  --window <count>   Queries in flight (default: 64)\n";
+    std::cout << "  --workers <count>  KRPC worker threads in the DHT client (default: 0)\n";
+    std::cout << "  --json <path>      Also write the results as JSON ('-' for stdout)\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--port") {
+            options.port = std::atoi(value.c_str());
+        } else if (arg == "--queries") {
+            options.queries = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--window") {
+            options.window = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+        } else if (arg == "--workers") {
+            options.workers = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--json") {
+            options.json_path = value;
+        } else {
+            return false;
+        }
+    }
+    // Transaction ids carry the query index in four bytes
+    options.queries = std::min<size_t>(options.queries, 0xFFFFFFFF);
+    return options.queries > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Logger::getInstance().set_log_level(LogLevel::ERROR);
+    init_socket_library();
+
+    auto floods = run_krpc_floods(options);
+    auto tables = run_routing_table({1000, 10000, 100000});
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "KRPC floods (" << options.queries << " queries, window " << options.window
+              << ", workers " << options.workers << ")\n";
+    std::cout << std::left << std::setw(15) << "query" << std::right << std::setw(12) << "queries/s"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(12) << "allocs/msg"
+              << std::setw(8) << "lost" << "\n";
+    for (const auto& r : floods) {
+        std::cout << std::left << std::setw(15) << r.name << std::right << std::setw(12) << r.queries_per_second
+                  << std::setw(10) << r.p50_us << std::setw(10) << r.p99_us << std::setw(12)
+                  << r.allocations_per_message << std::setw(8) << r.lost << "\n";
+    }
+
+    std::cout << "\nRouting table (find_closest of " << K_BUCKET_SIZE << ")\n";
+    std::cout << std::setw(10) << "offered" << std::setw(10) << "size" << std::setw(14) << "insert ns"
+              << std::setw(14) << "lookup ns" << "\n";
+    for (const auto& r : tables) {
+        std::cout << std::setw(10) << r.offered << std::setw(10) << r.size << std::setw(14) << r.insert_ns
+                  << std::setw(14) << r.lookup_ns << "\n";
+    }
+
+    if (!options.json_path.empty()) {
+        nlohmann::json report;
+        report["benchmark"] = "dht";
+        report["config"] = {{"queries", options.queries}, {"window", options.window}, {"workers", options.workers}};
+        report["krpc"] = nlohmann::json::array();
+        for (const auto& r : floods) {
+            report["krpc"].push_back({{"query", r.name}, {"sent", r.sent}, {"answered", r.answered},
+                                      {"lost", r.lost}, {"seconds", r.seconds},
+                                      {"queries_per_second", r.queries_per_second}, {"p50_us", r.p50_us},
+                                      {"p99_us", r.p99_us}, {"allocations_per_message", r.allocations_per_message}});
+        }
+        report["routing_table"] = nlohmann::json::array();
+        for (const auto& r : tables) {
+            report["routing_table"].push_back({{"offered", r.offered}, {"size", r.size},
+                                               {"insert_ns", r.insert_ns}, {"lookup_ns", r.lookup_ns}});
+        }
+
+        if (options.json_path == "-") {
+            std::cout << report.dump(2) << std::endl;
+        } else {
+            std::ofstream out(options.json_path);
+            out << report.dump(2) << std::endl;
+            if (!out) {
+                std::cerr << "Failed to write " << options.json_path << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    cleanup_socket_library();
+    return floods.size() == 4 ? 0 : 1;
+}
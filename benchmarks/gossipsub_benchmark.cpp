@@ -0,0 +1,375 @@
+// GossipSub benchmark.
+//
+// Starts N RatsClient instances in this process, connects them over
+// loopback into a sparse random graph, subscribes every node to one topic
+// and publishes messages from all nodes in turn. Runs once per mesh degree
+// and prints publish throughput, end-to-end propagation p50/p99, duplicate
+// ratio and received frame bytes per delivered message. With --json writes
+// the same numbers as JSON so GossipSubConfig changes can be compared.
+//
+// Messages carry their publish time, so latencies are publish-to-handler
+// times on the receiving node. Duplicates are publish records a node drops
+// as already seen; bytes are binary codec frames received by all nodes,
+// control traffic included, divided by the deliveries.
+
+#include "librats.h"
+#include "gossipsub.h"
+#include "logger.h"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* const TOPIC = "benchmark";
+
+struct Options {
+    int base_port = 47000;
+    size_t nodes = 10;
+    size_t messages = 2000;
+    size_t message_size = 256;
+    size_t rate = 0;                    // Messages per second over all publishers, 0 = unpaced
+    size_t connections = 3;             // Outgoing connections per node
+    std::vector<int> degrees = {4, 6, 8};
+    std::string json_path;
+};
+
+struct RunResult {
+    int degree = 0;
+    size_t published = 0;
+    size_t expected = 0;
+    size_t delivered = 0;
+    double publish_seconds = 0;
+    double seconds = 0;
+    double published_per_second = 0;
+    double delivered_per_second = 0;
+    double p50_ms = 0;
+    double p99_ms = 0;
+    double duplicate_ratio = 0;
+    double bytes_per_delivery = 0;
+};
+
+double percentile_ms(std::vector<Clock::duration>& latencies, double fraction) {
+    if (latencies.empty()) {
+        return 0;
+    }
+    size_t index = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return std::chrono::duration<double, std::milli>(latencies[index]).count();
+}
+
+// Payload: "<publish time in ns>:<publisher>:<sequence>:" padded to the message size
+std::string make_message(size_t publisher, size_t sequence, size_t size) {
+    std::string message = std::to_string(Clock::now().time_since_epoch().count()) + ":" +
+                          std::to_string(publisher) + ":" + std::to_string(sequence) + ":";
+    if (message.size() < size) {
+        message.append(size - message.size(), 'x');
+    }
+    return message;
+}
+
+Clock::time_point published_at(const std::string& message) {
+    return Clock::time_point(Clock::duration(std::strtoll(message.c_str(), nullptr, 10)));
+}
+
+GossipSubConfig config_for_degree(int degree) {
+    GossipSubConfig config;
+    config.mesh_optimal = degree;
+    config.mesh_low = std::max(1, degree - degree / 3);
+    config.mesh_high = degree + degree / 3;
+    config.fanout_size = degree;
+    config.heartbeat_interval = std::chrono::milliseconds(200);
+    return config;
+}
+
+class Network {
+public:
+    Network(const Options& options, int degree, int base_port) : options_(options) {
+        std::mt19937 rng(0x5eed + degree);
+        for (size_t i = 0; i < options.nodes; ++i) {
+            auto client = std::make_unique<RatsClient>(base_port + static_cast<int>(i),
+                                                       static_cast<int>(options.nodes));
+            client->get_gossipsub().set_config(config_for_degree(degree));
+            if (!client->start()) {
+                std::cerr << "Failed to start node on port " << base_port + static_cast<int>(i) << std::endl;
+                return;
+            }
+            clients_.push_back(std::move(client));
+        }
+
+        // Peer IDs come from per-port config files only in TESTING builds; elsewhere every
+        // node in the process would load the same ID and refuse each other's handshakes
+        std::set<std::string> peer_ids;
+        for (const auto& client : clients_) {
+            if (!peer_ids.insert(client->get_our_peer_id()).second) {
+                std::cerr << "Nodes share a peer ID, build with RATS_BUILD_TESTS=ON for per-port config files" << std::endl;
+                clients_.clear();
+                return;
+            }
+        }
+
+        // Each node dials its predecessor, so the graph is connected, plus random earlier nodes
+        for (size_t i = 1; i < clients_.size(); ++i) {
+            std::vector<size_t> targets = {i - 1};
+            for (size_t attempt = 0; targets.size() < std::min(options.connections, i) && attempt < 4 * i; ++attempt) {
+                size_t target = rng() % i;
+                if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+                    targets.push_back(target);
+                }
+            }
+            for (size_t target : targets) {
+                clients_[i]->connect_to_peer("127.0.0.1", base_port + static_cast<int>(target));
+            }
+        }
+
+        for (auto& client : clients_) {
+            client->get_gossipsub().subscribe(TOPIC);
+            client->get_gossipsub().set_message_handler(TOPIC,
+                [this](const std::string&, const std::string& message, const std::string&) {
+                    auto latency = Clock::now() - published_at(message);
+                    std::lock_guard<std::mutex> lock(latencies_mutex_);
+                    latencies_.push_back(latency);
+                });
+        }
+    }
+
+    ~Network() {
+        for (auto& client : clients_) {
+            client->stop();
+        }
+    }
+
+    bool is_valid() const { return clients_.size() == options_.nodes; }
+
+    // Waits until every node has a mesh (heartbeats graft peers after the connections are up)
+    bool wait_for_mesh(std::chrono::seconds timeout) {
+        auto deadline = Clock::now() + timeout;
+        while (Clock::now() < deadline) {
+            bool ready = true;
+            for (auto& client : clients_) {
+                if (client->get_gossipsub().get_mesh_peers(TOPIC).empty()) {
+                    ready = false;
+                    break;
+                }
+            }
+            if (ready) {
+                // One more heartbeat for the meshes to fill up to the target degree
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return false;
+    }
+
+    RunResult run(int degree) {
+        RunResult result;
+        result.degree = degree;
+        result.expected = options_.messages * (clients_.size() - 1);
+        auto before = totals();
+
+        auto start = Clock::now();
+        for (size_t i = 0; i < options_.messages; ++i) {
+            if (options_.rate > 0) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(1000000000ull * i / options_.rate));
+            }
+            size_t publisher = i % clients_.size();
+            if (clients_[publisher]->get_gossipsub().publish(TOPIC, make_message(publisher, i, options_.message_size))) {
+                ++result.published;
+            }
+        }
+        result.publish_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        // Drain until everything arrived or nothing has arrived for two seconds
+        size_t delivered = 0;
+        auto last_progress = Clock::now();
+        auto last_delivery = last_progress;
+        while (delivered < result.expected && Clock::now() - last_progress < std::chrono::seconds(2)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            std::lock_guard<std::mutex> lock(latencies_mutex_);
+            if (latencies_.size() != delivered) {
+                delivered = latencies_.size();
+                last_progress = Clock::now();
+                last_delivery = last_progress;
+            }
+        }
+        result.seconds = std::chrono::duration<double>(last_delivery - start).count();
+
+        auto after = totals();
+        std::vector<Clock::duration> latencies;
+        {
+            std::lock_guard<std::mutex> lock(latencies_mutex_);
+            latencies.swap(latencies_);
+        }
+        result.delivered = latencies.size();
+        result.published_per_second = result.publish_seconds > 0 ? result.published / result.publish_seconds : 0;
+        result.delivered_per_second = result.seconds > 0 ? result.delivered / result.seconds : 0;
+        result.p50_ms = percentile_ms(latencies, 0.50);
+        result.p99_ms = percentile_ms(latencies, 0.99);
+        uint64_t deliveries = after.delivered - before.delivered;
+        result.duplicate_ratio = deliveries ? double(after.duplicates - before.duplicates) / deliveries : 0;
+        result.bytes_per_delivery = deliveries ? double(after.bytes - before.bytes) / deliveries : 0;
+        return result;
+    }
+
+private:
+    struct Totals {
+        uint64_t delivered = 0;
+        uint64_t duplicates = 0;
+        uint64_t bytes = 0;
+    };
+
+    Totals totals() const {
+        Totals sum;
+        for (const auto& client : clients_) {
+            auto stats = client->get_gossipsub().get_statistics();
+            sum.delivered += stats.value("messages_delivered", uint64_t(0));
+            sum.duplicates += stats.value("duplicate_publish_received", uint64_t(0));
+            sum.bytes += stats.value("frame_bytes_received", uint64_t(0));
+        }
+        return sum;
+    }
+
+    const Options& options_;
+    std::vector<std::unique_ptr<RatsClient>> clients_;
+    std::mutex latencies_mutex_;
+    std::vector<Clock::duration> latencies_;
+};
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [options]\n";
+    std::cout << "  --port <port>         First listen port, nodes and runs use consecutive ports (default: 47000)\n";
+    std::cout << "  --nodes <count>       Nodes in the network (default: 10)\n";
+    std::cout << "  --messages <count>    Messages published per run (default: 2000)\n";
+    std::cout << "  --size <bytes>        Message size (default: 256)\n";
+    std::cout << "  --rate <count>        Messages per second over all publishers, 0 = unpaced (default: 0)\n";
+    std::cout << "  --connections <count> Connections each node opens (default: 3)\n";
+    std::cout << "  --degrees <list>      Comma separated mesh degrees to run (default: 4,6,8)\n";
+    std::cout << "  --json <path>         Also write the results as JSON ('-' for stdout)\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--port") {
+            options.base_port = std::atoi(value.c_str());
+        } else if (arg == "--nodes") {
+            options.nodes = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--messages") {
+            options.messages = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--size") {
+            options.message_size = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--rate") {
+            options.rate = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--connections") {
+            options.connections = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+        } else if (arg == "--degrees") {
+            options.degrees.clear();
+            std::stringstream list(value);
+            std::string degree;
+            while (std::getline(list, degree, ',')) {
+                int d = std::atoi(degree.c_str());
+                if (d > 0) {
+                    options.degrees.push_back(d);
+                }
+            }
+        } else if (arg == "--json") {
+            options.json_path = value;
+        } else {
+            return false;
+        }
+    }
+    return options.nodes >= 2 && options.messages > 0 && !options.degrees.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Logger::getInstance().set_log_level(LogLevel::ERROR);
+
+    // Every run gets fresh ports, so sockets of the previous run cannot interfere
+    std::vector<RunResult> results;
+    for (size_t run = 0; run < options.degrees.size(); ++run) {
+        int degree = options.degrees[run];
+        Network network(options, degree, options.base_port + static_cast<int>(run * options.nodes));
+        if (!network.is_valid()) {
+            return 1;
+        }
+        if (!network.wait_for_mesh(std::chrono::seconds(10))) {
+            std::cerr << "Mesh did not form for degree " << degree << std::endl;
+            return 1;
+        }
+        results.push_back(network.run(degree));
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "GossipSub (" << options.nodes << " nodes, " << options.messages << " messages of "
+              << options.message_size << " bytes, rate " << options.rate << ")\n";
+    std::cout << std::setw(8) << "degree" << std::setw(12) << "publish/s" << std::setw(12) << "deliver/s"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "dup/msg"
+              << std::setw(13) << "bytes/msg" << std::setw(11) << "delivered" << "\n";
+    for (const auto& r : results) {
+        std::cout << std::setw(8) << r.degree << std::setw(12) << r.published_per_second << std::setw(12)
+                  << r.delivered_per_second << std::setw(10) << r.p50_ms << std::setw(10) << r.p99_ms
+                  << std::setw(10) << std::setprecision(2) << r.duplicate_ratio << std::setprecision(1)
+                  << std::setw(13) << r.bytes_per_delivery << std::setw(10)
+                  << (r.expected ? 100.0 * r.delivered / r.expected : 0) << "%\n";
+    }
+
+    if (!options.json_path.empty()) {
+        nlohmann::json report;
+        report["benchmark"] = "gossipsub";
+        report["config"] = {{"nodes", options.nodes}, {"messages", options.messages},
+                            {"message_size", options.message_size}, {"rate", options.rate},
+                            {"connections", options.connections}};
+        report["runs"] = nlohmann::json::array();
+        for (const auto& r : results) {
+            report["runs"].push_back({{"degree", r.degree}, {"published", r.published}, {"expected", r.expected},
+                                      {"delivered", r.delivered}, {"publish_seconds", r.publish_seconds},
+                                      {"seconds", r.seconds}, {"published_per_second", r.published_per_second},
+                                      {"delivered_per_second", r.delivered_per_second}, {"p50_ms", r.p50_ms},
+                                      {"p99_ms", r.p99_ms}, {"duplicate_ratio", r.duplicate_ratio},
+                                      {"bytes_per_delivery", r.bytes_per_delivery}});
+        }
+
+        if (options.json_path == "-") {
+            std::cout << report.dump(2) << std::endl;
+        } else {
+            std::ofstream out(options.json_path);
+            out << report.dump(2) << std::endl;
+            if (!out) {
+                std::cerr << "Failed to write " << options.json_path << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
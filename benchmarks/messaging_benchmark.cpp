@@ -0,0 +1,540 @@
+// RatsClient messaging benchmark.
+//
+// Starts RatsClient instances in this process, connects them over loopback
+// and measures, once with encryption off and once with it on:
+//   - string, binary and JSON send throughput between a pair of nodes
+//   - ping-pong round trip time percentiles
+//   - broadcast fan-out from one node to a star of peers
+//   - connection setup rate (dial to completed handshake)
+//   - file transfer throughput
+// Prints a table and with --json writes the same numbers as JSON, so runs
+// before and after an upgrade can be compared.
+//
+// Every node keeps its configuration in its own directory under --data-dir,
+// so nodes get distinct peer IDs in any build. Each scenario uses fresh
+// ports so sockets of the previous one cannot interfere.
+
+#include "librats.h"
+#include "logger.h"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int base_port = 48000;
+    size_t messages = 20000;
+    size_t message_size = 1024;
+    size_t pings = 2000;
+    size_t fanout = 8;
+    size_t broadcasts = 2000;
+    size_t connections = 20;
+    size_t file_size_mb = 32;
+    std::vector<bool> encryption = {false, true};
+    std::string data_dir = "rats-benchmark-data";
+    std::string json_path;
+};
+
+struct Result {
+    std::string name;
+    bool encryption = false;
+    nlohmann::json metrics;
+    std::string summary;
+};
+
+double seconds_between(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+double percentile_us(std::vector<Clock::duration>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return std::chrono::duration<double, std::micro>(samples[index]).count();
+}
+
+bool wait_for(const std::function<bool()>& condition, std::chrono::milliseconds timeout) {
+    auto deadline = Clock::now() + timeout;
+    while (!condition()) {
+        if (Clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+// Waits until count reaches expected or stops moving for two seconds; returns the time of the last change
+Clock::time_point drain(const std::atomic<size_t>& count, size_t expected, Clock::time_point start) {
+    size_t seen = count.load();
+    auto last_progress = seen > 0 ? Clock::now() : start;
+    while (seen < expected && Clock::now() - last_progress < std::chrono::seconds(2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        size_t now_seen = count.load();
+        if (now_seen != seen) {
+            seen = now_seen;
+            last_progress = Clock::now();
+        }
+    }
+    return last_progress;
+}
+
+class Bench {
+public:
+    explicit Bench(const Options& options) : options_(options), next_port_(options.base_port) {}
+
+    bool run(bool encryption, std::vector<Result>& results) {
+        encryption_ = encryption;
+        return run_throughput("string_throughput", results) &&
+               run_throughput("binary_throughput", results) &&
+               run_throughput("json_throughput", results) &&
+               run_ping_pong(results) &&
+               run_broadcast(results) &&
+               run_connection_setup(results) &&
+               run_file_transfer(results);
+    }
+
+private:
+    using Nodes = std::vector<std::unique_ptr<RatsClient>>;
+
+    std::unique_ptr<RatsClient> make_node() {
+        int port = next_port_++;
+        auto node = std::make_unique<RatsClient>(port, static_cast<int>(options_.connections + options_.fanout + 4));
+        node->set_data_directory(options_.data_dir + "/" + std::to_string(port));
+        node->load_configuration();
+        node->set_encryption_enabled(encryption_);
+        if (!node->start()) {
+            std::cerr << "Failed to start node on port " << port << std::endl;
+            return nullptr;
+        }
+        return node;
+    }
+
+    // Starts count nodes; the first is the one the others dial
+    bool make_nodes(size_t count, Nodes& nodes) {
+        std::set<std::string> peer_ids;
+        for (size_t i = 0; i < count; ++i) {
+            auto node = make_node();
+            if (!node) {
+                return false;
+            }
+            if (!peer_ids.insert(node->get_our_peer_id()).second) {
+                std::cerr << "Nodes share a peer ID, check that --data-dir is writable" << std::endl;
+                return false;
+            }
+            nodes.push_back(std::move(node));
+        }
+        return true;
+    }
+
+    bool connect_star(Nodes& nodes) {
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            nodes[i]->connect_to_peer("127.0.0.1", nodes[0]->get_listen_port());
+        }
+        bool connected = wait_for([&] {
+            if (nodes[0]->get_peer_count() < static_cast<int>(nodes.size() - 1)) {
+                return false;
+            }
+            for (size_t i = 1; i < nodes.size(); ++i) {
+                if (nodes[i]->get_peer_count() < 1) {
+                    return false;
+                }
+            }
+            return true;
+        }, std::chrono::seconds(10));
+        if (!connected) {
+            std::cerr << "Nodes did not connect" << std::endl;
+        }
+        return connected;
+    }
+
+    static void stop_all(Nodes& nodes) {
+        for (auto& node : nodes) {
+            node->stop();
+        }
+    }
+
+    void add(std::vector<Result>& results, const std::string& name, nlohmann::json metrics, const std::string& summary) {
+        Result result;
+        result.name = name;
+        result.encryption = encryption_;
+        result.metrics = std::move(metrics);
+        result.summary = summary;
+        results.push_back(std::move(result));
+    }
+
+    static std::string format(double value, int precision = 1) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(precision) << value;
+        return out.str();
+    }
+
+    // One node sends messages to another as fast as the send path accepts them
+    bool run_throughput(const std::string& name, std::vector<Result>& results) {
+        Nodes nodes;
+        if (!make_nodes(2, nodes) || !connect_star(nodes)) {
+            return false;
+        }
+        RatsClient& receiver = *nodes[0];
+        RatsClient& sender = *nodes[1];
+        const std::string target = receiver.get_our_peer_id();
+
+        std::atomic<size_t> received(0);
+        receiver.set_string_data_callback([&](socket_t, const std::string&, const std::string&) { ++received; });
+        receiver.set_binary_data_view_callback([&](socket_t, const std::string&, const SharedBuffer&) { ++received; });
+        receiver.set_json_data_callback([&](socket_t, const std::string&, const nlohmann::json&) { ++received; });
+
+        const std::string text(options_.message_size, 'x');
+        const std::vector<uint8_t> bytes(options_.message_size, 0x5a);
+        const nlohmann::json json = {{"type", "benchmark"}, {"data", text}};
+        const size_t wire_size = name == "json_throughput" ? json.dump().size() : options_.message_size;
+
+        size_t failed = 0;
+        auto start = Clock::now();
+        for (size_t i = 0; i < options_.messages; ++i) {
+            bool sent;
+            if (name == "string_throughput") {
+                sent = sender.send_string_to_peer_id(target, text);
+            } else if (name == "binary_throughput") {
+                sent = sender.send_binary_to_peer_id(target, bytes);
+            } else {
+                sent = sender.send_json_to_peer_id(target, json);
+            }
+            if (!sent) {
+                ++failed;
+            }
+        }
+        auto sent_at = Clock::now();
+        auto end = drain(received, options_.messages - failed, start);
+        stop_all(nodes);
+
+        double seconds = seconds_between(start, end);
+        size_t delivered = received.load();
+        double per_second = seconds > 0 ? delivered / seconds : 0;
+        double mb_per_second = per_second * wire_size / (1024.0 * 1024.0);
+        add(results, name,
+            {{"messages", options_.messages}, {"message_size", wire_size}, {"send_failures", failed},
+             {"delivered", delivered}, {"send_seconds", seconds_between(start, sent_at)}, {"seconds", seconds},
+             {"messages_per_second", per_second}, {"mb_per_second", mb_per_second}},
+            format(per_second, 0) + " msg/s, " + format(mb_per_second) + " MB/s, " +
+                std::to_string(delivered) + "/" + std::to_string(options_.messages) + " delivered");
+        return true;
+    }
+
+    // One ping in flight at a time; the receiver echoes every binary message back
+    bool run_ping_pong(std::vector<Result>& results) {
+        Nodes nodes;
+        if (!make_nodes(2, nodes) || !connect_star(nodes)) {
+            return false;
+        }
+        RatsClient& echo = *nodes[0];
+        RatsClient& pinger = *nodes[1];
+        const std::string target = echo.get_our_peer_id();
+
+        echo.set_binary_data_view_callback([&](socket_t, const std::string& peer_id, const SharedBuffer& data) {
+            echo.send_binary_to_peer_ids({peer_id}, SharedBuffer::copy_of(data.data(), data.size()));
+        });
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t pongs = 0;
+        pinger.set_binary_data_view_callback([&](socket_t, const std::string&, const SharedBuffer&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pongs;
+            cv.notify_one();
+        });
+
+        const std::vector<uint8_t> ping(64, 0x01);
+        std::vector<Clock::duration> rtts;
+        rtts.reserve(options_.pings);
+        size_t lost = 0;
+        for (size_t i = 0; i < options_.pings; ++i) {
+            std::unique_lock<std::mutex> lock(mutex);
+            size_t expected = pongs + 1;
+            auto sent_at = Clock::now();
+            if (!pinger.send_binary_to_peer_id(target, ping) ||
+                !cv.wait_for(lock, std::chrono::seconds(1), [&] { return pongs >= expected; })) {
+                ++lost;
+                // Don't let a late pong count for the next ping
+                pongs = expected;
+                continue;
+            }
+            rtts.push_back(Clock::now() - sent_at);
+        }
+        stop_all(nodes);
+
+        double p50 = percentile_us(rtts, 0.50);
+        double p90 = percentile_us(rtts, 0.90);
+        double p99 = percentile_us(rtts, 0.99);
+        double max = percentile_us(rtts, 1.0);
+        add(results, "ping_pong",
+            {{"pings", options_.pings}, {"lost", lost}, {"p50_us", p50}, {"p90_us", p90}, {"p99_us", p99},
+             {"max_us", max}},
+            "p50 " + format(p50) + " us, p99 " + format(p99) + " us, max " + format(max) + " us");
+        return true;
+    }
+
+    // One hub broadcasts to a star of peers; measures the cost of the call and the delivery rate
+    bool run_broadcast(std::vector<Result>& results) {
+        Nodes nodes;
+        if (!make_nodes(options_.fanout + 1, nodes) || !connect_star(nodes)) {
+            return false;
+        }
+        std::atomic<size_t> received(0);
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            nodes[i]->set_binary_data_view_callback([&](socket_t, const std::string&, const SharedBuffer&) { ++received; });
+        }
+
+        const std::vector<uint8_t> bytes(options_.message_size, 0x5a);
+        size_t recipients = 0;
+        auto start = Clock::now();
+        for (size_t i = 0; i < options_.broadcasts; ++i) {
+            recipients += nodes[0]->broadcast_binary_to_peers(bytes);
+        }
+        auto sent_at = Clock::now();
+        auto end = drain(received, recipients, start);
+        stop_all(nodes);
+
+        double call_us = options_.broadcasts ? seconds_between(start, sent_at) * 1e6 / options_.broadcasts : 0;
+        double seconds = seconds_between(start, end);
+        size_t delivered = received.load();
+        double per_second = seconds > 0 ? delivered / seconds : 0;
+        add(results, "broadcast",
+            {{"fanout", options_.fanout}, {"broadcasts", options_.broadcasts}, {"message_size", options_.message_size},
+             {"expected", recipients}, {"delivered", delivered}, {"us_per_broadcast_call", call_us},
+             {"seconds", seconds}, {"deliveries_per_second", per_second}},
+            format(call_us) + " us/call to " + std::to_string(options_.fanout) + " peers, " +
+                format(per_second, 0) + " deliveries/s");
+        return true;
+    }
+
+    // Nodes dial one listener at once; the clock runs from the first dial to the last completed handshake
+    bool run_connection_setup(std::vector<Result>& results) {
+        Nodes nodes;
+        if (!make_nodes(options_.connections + 1, nodes)) {
+            return false;
+        }
+        std::atomic<size_t> connected(0);
+        nodes[0]->set_connection_callback([&](socket_t, const std::string&) { ++connected; });
+
+        auto start = Clock::now();
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            nodes[i]->connect_to_peer("127.0.0.1", nodes[0]->get_listen_port());
+        }
+        auto end = drain(connected, options_.connections, start);
+        stop_all(nodes);
+
+        double seconds = seconds_between(start, end);
+        size_t completed = connected.load();
+        double per_second = seconds > 0 ? completed / seconds : 0;
+        add(results, "connection_setup",
+            {{"connections", options_.connections}, {"completed", completed}, {"seconds", seconds},
+             {"connections_per_second", per_second}},
+            format(per_second) + " conn/s, " + std::to_string(completed) + "/" +
+                std::to_string(options_.connections) + " completed");
+        return true;
+    }
+
+    bool run_file_transfer(std::vector<Result>& results) {
+        const std::string source_path = options_.data_dir + "/file-transfer-source.bin";
+        const std::string received_name = "rats-benchmark-received.bin";
+        Nodes nodes;
+        if (!make_nodes(2, nodes)) {
+            return false;
+        }
+
+        const uint64_t size = static_cast<uint64_t>(options_.file_size_mb) * 1024 * 1024;
+        {
+            // Random content, so compression (when built in) can't shortcut the transfer
+            std::ofstream out(source_path, std::ios::binary | std::ios::trunc);
+            std::mt19937_64 rng(0x5eed);
+            std::vector<uint64_t> block(8192);
+            for (uint64_t written = 0; written < size; written += block.size() * sizeof(uint64_t)) {
+                for (auto& word : block) {
+                    word = rng();
+                }
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(block.size() * sizeof(uint64_t), size - written));
+                out.write(reinterpret_cast<const char*>(block.data()), chunk);
+            }
+            if (!out) {
+                std::cerr << "Failed to write " << source_path << std::endl;
+                return false;
+            }
+        }
+
+        RatsClient& receiver = *nodes[0];
+        RatsClient& sender = *nodes[1];
+        std::atomic<bool> done(false);
+        std::atomic<bool> succeeded(false);
+        receiver.on_file_transfer_request([](const std::string&, const FileMetadata&, const std::string&) { return true; });
+        receiver.on_file_transfer_completed([&](const std::string&, bool success, const std::string&) {
+            succeeded = success;
+            done = true;
+        });
+        if (!connect_star(nodes)) {
+            return false;
+        }
+
+        auto start = Clock::now();
+        std::string transfer_id = sender.send_file(receiver.get_our_peer_id(), source_path, received_name);
+        if (!transfer_id.empty()) {
+            wait_for([&] { return done.load(); }, std::chrono::seconds(120));
+        }
+        auto end = Clock::now();
+        stop_all(nodes);
+        std::remove(source_path.c_str());
+        std::remove(received_name.c_str());
+
+        double seconds = seconds_between(start, end);
+        double mb_per_second = succeeded && seconds > 0 ? options_.file_size_mb / seconds : 0;
+        add(results, "file_transfer",
+            {{"file_size_mb", options_.file_size_mb}, {"succeeded", succeeded.load()}, {"seconds", seconds},
+             {"mb_per_second", mb_per_second}},
+            succeeded ? format(mb_per_second) + " MB/s" : std::string("failed"));
+        return true;
+    }
+
+    const Options& options_;
+    int next_port_;
+    bool encryption_ = false;
+};
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [options]\n";
+    std::cout << "  --port <port>           First listen port, every node uses the next free one (default: 48000)\n";
+    std::cout << "  --messages <count>      Messages per throughput run (default: 20000)\n";
+    std::cout << "  --size <bytes>          Message size for throughput and broadcast runs (default: 1024)\n";
+    std::cout << "  --pings <count>         Ping-pong round trips (default: 2000)\n";
+    std::cout << "  --fanout <count>        Peers a broadcast reaches (default: 8)\n";
+    std::cout << "  --broadcasts <count>    Broadcasts per run (default: 2000)\n";
+    std::cout << "  --connections <count>   Nodes dialing at once in the connection setup run (default: 20)\n";
+    std::cout << "  --file-size <MB>        File transfer size (default: 32)\n";
+    std::cout << "  --encryption <mode>     off, on or both (default: both)\n";
+    std::cout << "  --data-dir <path>       Directory for node configuration and the transfer file (default: rats-benchmark-data)\n";
+    std::cout << "  --json <path>           Also write the results as JSON ('-' for stdout)\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--port") {
+            options.base_port = std::atoi(value.c_str());
+        } else if (arg == "--messages") {
+            options.messages = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--size") {
+            options.message_size = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--pings") {
+            options.pings = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--fanout") {
+            options.fanout = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--broadcasts") {
+            options.broadcasts = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--connections") {
+            options.connections = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--file-size") {
+            options.file_size_mb = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--encryption") {
+            if (value == "off") {
+                options.encryption = {false};
+            } else if (value == "on") {
+                options.encryption = {true};
+            } else if (value == "both") {
+                options.encryption = {false, true};
+            } else {
+                return false;
+            }
+        } else if (arg == "--data-dir") {
+            options.data_dir = value;
+        } else if (arg == "--json") {
+            options.json_path = value;
+        } else {
+            return false;
+        }
+    }
+    return options.messages > 0 && options.message_size > 0 && options.pings > 0 && options.fanout > 0 &&
+           options.broadcasts > 0 && options.connections > 0 && options.file_size_mb > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Logger::getInstance().set_log_level(LogLevel::ERROR);
+
+    std::vector<Result> results;
+    Bench bench(options);
+    for (bool encryption : options.encryption) {
+        if (!bench.run(encryption, results)) {
+            return 1;
+        }
+    }
+
+    std::cout << "RatsClient messaging (" << options.messages << " messages of " << options.message_size
+              << " bytes, " << options.pings << " pings, fan-out " << options.fanout << ", "
+              << options.connections << " connections, " << options.file_size_mb << " MB file)\n";
+    std::cout << std::left << std::setw(20) << "scenario" << std::setw(12) << "encryption" << "result\n";
+    for (const auto& r : results) {
+        std::cout << std::setw(20) << r.name << std::setw(12) << (r.encryption ? "on" : "off") << r.summary << "\n";
+    }
+
+    if (!options.json_path.empty()) {
+        nlohmann::json report;
+        report["benchmark"] = "messaging";
+        report["config"] = {{"messages", options.messages}, {"message_size", options.message_size},
+                            {"pings", options.pings}, {"fanout", options.fanout},
+                            {"broadcasts", options.broadcasts}, {"connections", options.connections},
+                            {"file_size_mb", options.file_size_mb}};
+        report["runs"] = nlohmann::json::array();
+        for (const auto& r : results) {
+            nlohmann::json run = r.metrics;
+            run["scenario"] = r.name;
+            run["encryption"] = r.encryption;
+            report["runs"].push_back(run);
+        }
+
+        if (options.json_path == "-") {
+            std::cout << report.dump(2) << std::endl;
+        } else {
+            std::ofstream out(options.json_path);
+            out << report.dump(2) << std::endl;
+            if (!out) {
+                std::cerr << "Failed to write " << options.json_path << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -1,8 +1,13 @@
 #include <napi.h>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <memory>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 #include "librats_c.h"
 
 using namespace Napi;
@@ -18,70 +23,33 @@ struct CallbackData {
     CallbackData(Napi::Env environment) : env(environment) {}
 };
 
-std::unordered_map<rats_client_t, std::shared_ptr<CallbackData>> connection_callbacks;
-std::unordered_map<rats_client_t, std::shared_ptr<CallbackData>> string_callbacks;
-std::unordered_map<rats_client_t, std::shared_ptr<CallbackData>> binary_callbacks;
-std::unordered_map<rats_client_t, std::shared_ptr<CallbackData>> json_callbacks;
-std::unordered_map<rats_client_t, std::shared_ptr<CallbackData>> disconnect_callbacks;
 std::unordered_map<rats_client_t, std::shared_ptr<CallbackData>> file_progress_callbacks;
 
-// C callback wrappers
-void connection_callback_wrapper(void* user_data, const char* peer_id) {
-    rats_client_t client = static_cast<rats_client_t>(user_data);
-    auto it = connection_callbacks.find(client);
-    if (it != connection_callbacks.end() && it->second) {
-        auto callback_data = it->second;
-        callback_data->callback.Call({Napi::String::New(callback_data->env, peer_id)});
-    }
-}
-
-void string_callback_wrapper(void* user_data, const char* peer_id, const char* message) {
-    rats_client_t client = static_cast<rats_client_t>(user_data);
-    auto it = string_callbacks.find(client);
-    if (it != string_callbacks.end() && it->second) {
-        auto callback_data = it->second;
-        callback_data->callback.Call({
-            Napi::String::New(callback_data->env, peer_id),
-            Napi::String::New(callback_data->env, message)
-        });
-    }
-}
-
-void binary_callback_wrapper(void* user_data, const char* peer_id, const void* data, size_t size) {
-    rats_client_t client = static_cast<rats_client_t>(user_data);
-    auto it = binary_callbacks.find(client);
-    if (it != binary_callbacks.end() && it->second) {
-        auto callback_data = it->second;
-        auto buffer = Napi::Buffer<uint8_t>::New(callback_data->env, size);
-        memcpy(buffer.Data(), data, size);
-        callback_data->callback.Call({
-            Napi::String::New(callback_data->env, peer_id),
-            buffer
-        });
-    }
-}
-
-void json_callback_wrapper(void* user_data, const char* peer_id, const char* json_str) {
-    rats_client_t client = static_cast<rats_client_t>(user_data);
-    auto it = json_callbacks.find(client);
-    if (it != json_callbacks.end() && it->second) {
-        auto callback_data = it->second;
-        callback_data->callback.Call({
-            Napi::String::New(callback_data->env, peer_id),
-            Napi::String::New(callback_data->env, json_str)
-        });
-    }
-}
-
-void disconnect_callback_wrapper(void* user_data, const char* peer_id) {
-    rats_client_t client = static_cast<rats_client_t>(user_data);
-    auto it = disconnect_callbacks.find(client);
-    if (it != disconnect_callbacks.end() && it->second) {
-        auto callback_data = it->second;
-        callback_data->callback.Call({Napi::String::New(callback_data->env, peer_id)});
+// Events taken from librats by the poller thread and waiting for the JS thread
+struct EventPump {
+    static constexpr int POLL_BATCH = 256;
+    static constexpr size_t MAX_PENDING_EVENTS = 65536;   // Beyond this the poller waits and librats' own queue absorbs (and drops) the excess
+    
+    rats_client_t client = nullptr;
+    RatsClient* owner = nullptr;            // Cleared when the JS object goes away; only touched on the JS thread
+    Napi::ThreadSafeFunction wakeup;
+    std::thread poller;
+    std::atomic<bool> running{false};
+    std::atomic<bool> wakeup_pending{false};
+    
+    std::mutex mutex;
+    std::condition_variable drained;
+    std::vector<rats_event_t> pending;
+    
+    static void release_events(std::vector<rats_event_t>& events) {
+        for (const auto& event : events) {
+            rats_buffer_release(event.buffer);
+        }
+        events.clear();
     }
-}
+};
 
+// C callback wrappers
 void file_progress_callback_wrapper(void* user_data, const char* transfer_id, int progress_percent, const char* status) {
     rats_client_t client = static_cast<rats_client_t>(user_data);
     auto it = file_progress_callbacks.find(client);
@@ -108,6 +76,7 @@ public:
             InstanceMethod("sendString", &RatsClient::SendString),
             InstanceMethod("broadcastBinary", &RatsClient::BroadcastBinary),
             InstanceMethod("sendBinary", &RatsClient::SendBinary),
+            InstanceMethod("sendBinaryMany", &RatsClient::SendBinaryMany),
             InstanceMethod("broadcastJson", &RatsClient::BroadcastJson),
             InstanceMethod("sendJson", &RatsClient::SendJson),
             InstanceMethod("getPeerCount", &RatsClient::GetPeerCount),
@@ -178,6 +147,7 @@ public:
             InstanceMethod("onJson", &RatsClient::OnJson),
             InstanceMethod("onDisconnect", &RatsClient::OnDisconnect),
             InstanceMethod("onFileProgress", &RatsClient::OnFileProgress),
+            InstanceMethod("onEvents", &RatsClient::OnEvents),
             
             // Configuration persistence
             InstanceMethod("loadConfiguration", &RatsClient::LoadConfiguration),
@@ -210,11 +180,7 @@ public:
     ~RatsClient() {
         if (client_) {
             // Clean up callbacks
-            connection_callbacks.erase(client_);
-            string_callbacks.erase(client_);
-            binary_callbacks.erase(client_);
-            json_callbacks.erase(client_);
-            disconnect_callbacks.erase(client_);
+            StopEventPump();
             file_progress_callbacks.erase(client_);
             
             rats_destroy(client_);
@@ -224,6 +190,183 @@ public:
 private:
     rats_client_t client_;
     
+    // Message and connection events reach JS in batches through the pump
+    std::shared_ptr<EventPump> pump_;
+    int event_mask_ = 0;
+    Napi::FunctionReference connection_callback_;
+    Napi::FunctionReference string_callback_;
+    Napi::FunctionReference binary_callback_;
+    Napi::FunctionReference json_callback_;
+    Napi::FunctionReference disconnect_callback_;
+    Napi::FunctionReference events_callback_;
+    
+    // Subscribe to an event type, starting the pump on first use
+    void EnableEvents(Napi::Env env, int event_type) {
+        event_mask_ |= event_type;
+        rats_enable_event_polling(client_, event_mask_, 0);
+        if (!pump_) {
+            StartEventPump(env);
+        }
+    }
+    
+    void StartEventPump(Napi::Env env) {
+        auto pump = std::make_shared<EventPump>();
+        pump->client = client_;
+        pump->owner = this;
+        pump->wakeup = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}),
+                                                     "librats-events", 0, 1);
+        // A pending delivery must not keep the process alive by itself
+        pump->wakeup.Unref(env);
+        pump->running = true;
+        pump->poller = std::thread(&RatsClient::PollEvents, pump);
+        pump_ = pump;
+    }
+    
+    void StopEventPump() {
+        if (!pump_) return;
+        
+        pump_->running = false;
+        rats_enable_event_polling(client_, 0, 0);   // Wakes a poller blocked in rats_poll_events
+        {
+            std::lock_guard<std::mutex> lock(pump_->mutex);
+            pump_->drained.notify_all();
+        }
+        if (pump_->poller.joinable()) {
+            pump_->poller.join();
+        }
+        
+        pump_->owner = nullptr;
+        pump_->wakeup.Release();
+        {
+            std::lock_guard<std::mutex> lock(pump_->mutex);
+            EventPump::release_events(pump_->pending);
+        }
+        pump_.reset();
+    }
+    
+    // Poller thread: moves batches out of librats and asks for one JS wakeup per batch
+    static void PollEvents(std::shared_ptr<EventPump> pump) {
+        rats_event_t events[EventPump::POLL_BATCH];
+        while (pump->running.load()) {
+            int count = rats_poll_events(pump->client, events, EventPump::POLL_BATCH, -1);
+            if (count <= 0) continue;
+            
+            {
+                std::lock_guard<std::mutex> lock(pump->mutex);
+                pump->pending.insert(pump->pending.end(), events, events + count);
+            }
+            
+            // Events that arrive before the JS thread runs join the batch already scheduled
+            if (!pump->wakeup_pending.exchange(true)) {
+                auto* ref = new std::shared_ptr<EventPump>(pump);
+                if (pump->wakeup.NonBlockingCall(ref, &RatsClient::DeliverEvents) != napi_ok) {
+                    delete ref;
+                    pump->wakeup_pending = false;
+                }
+            }
+            
+            std::unique_lock<std::mutex> lock(pump->mutex);
+            pump->drained.wait(lock, [&pump]() {
+                return pump->pending.size() < EventPump::MAX_PENDING_EVENTS || !pump->running.load();
+            });
+        }
+    }
+    
+    // JS thread: takes everything pending in one swap
+    static void DeliverEvents(Napi::Env env, Napi::Function, std::shared_ptr<EventPump>* ref) {
+        std::shared_ptr<EventPump> pump = *ref;
+        delete ref;
+        
+        std::vector<rats_event_t> batch;
+        {
+            std::lock_guard<std::mutex> lock(pump->mutex);
+            batch.swap(pump->pending);
+            pump->wakeup_pending = false;
+            pump->drained.notify_one();
+        }
+        
+        if (static_cast<napi_env>(env) == nullptr || !pump->owner) {
+            EventPump::release_events(batch);
+            return;
+        }
+        pump->owner->DispatchEvents(env, batch);
+    }
+    
+    void DispatchEvents(Napi::Env env, std::vector<rats_event_t>& batch) {
+        Napi::HandleScope scope(env);
+        Napi::Array all;
+        if (!events_callback_.IsEmpty()) {
+            all = Napi::Array::New(env, batch.size());
+        }
+        
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const rats_event_t& event = batch[i];
+            
+            // Once a handler has thrown, the rest of the batch is only released
+            if (env.IsExceptionPending()) {
+                rats_buffer_release(event.buffer);
+                continue;
+            }
+            
+            Napi::String peer_id = Napi::String::New(env, event.peer_id);
+            Napi::Value data = env.Undefined();
+            if (event.type == RATS_EVENT_BINARY) {
+                if (event.size == 0) {
+                    data = Napi::Buffer<uint8_t>::New(env, 0);
+                    rats_buffer_release(event.buffer);
+                } else {
+                    // The Buffer wraps librats' receive buffer; it is released when the Buffer is collected
+                    data = Napi::Buffer<uint8_t>::NewOrCopy(env, static_cast<uint8_t*>(const_cast<void*>(event.data)), event.size,
+                                                            [](Napi::Env, uint8_t*, rats_buffer* buffer) { rats_buffer_release(buffer); },
+                                                            event.buffer);
+                }
+            } else {
+                if (event.data) {
+                    data = Napi::String::New(env, static_cast<const char*>(event.data), event.size);
+                }
+                rats_buffer_release(event.buffer);
+            }
+            
+            const char* type_name = "";
+            switch (event.type) {
+                case RATS_EVENT_CONNECTED:
+                    type_name = "connection";
+                    if (!connection_callback_.IsEmpty()) connection_callback_.Call({peer_id});
+                    break;
+                case RATS_EVENT_DISCONNECTED:
+                    type_name = "disconnect";
+                    if (!disconnect_callback_.IsEmpty()) disconnect_callback_.Call({peer_id});
+                    break;
+                case RATS_EVENT_BINARY:
+                    type_name = "binary";
+                    if (!binary_callback_.IsEmpty()) binary_callback_.Call({peer_id, data});
+                    break;
+                case RATS_EVENT_STRING:
+                    type_name = "string";
+                    if (!string_callback_.IsEmpty()) string_callback_.Call({peer_id, data});
+                    break;
+                case RATS_EVENT_JSON:
+                    type_name = "json";
+                    if (!json_callback_.IsEmpty()) json_callback_.Call({peer_id, data});
+                    break;
+                default:
+                    break;
+            }
+            
+            if (!all.IsEmpty()) {
+                Napi::Object entry = Napi::Object::New(env);
+                entry.Set("type", Napi::String::New(env, type_name));
+                entry.Set("peerId", peer_id);
+                entry.Set("data", data);
+                all[static_cast<uint32_t>(i)] = entry;
+            }
+        }
+        
+        if (!all.IsEmpty() && !env.IsExceptionPending()) {
+            events_callback_.Call({all});
+        }
+    }
+    
     // Basic operations
     Napi::Value Start(const Napi::CallbackInfo& info) {
         Napi::Env env = info.Env();
@@ -332,6 +475,45 @@ private:
         return Napi::Boolean::New(env, result == RATS_SUCCESS);
     }
     
+    Napi::Value SendBinaryMany(const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        
+        if (info.Length() < 1 || !info[0].IsArray()) {
+            Napi::TypeError::New(env, "Expected array of [peer_id (string), data (Buffer)] pairs").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        
+        // Buffer contents are read in place; the same Buffer sent to several peers is copied once
+        Napi::Array list = info[0].As<Napi::Array>();
+        uint32_t length = list.Length();
+        std::vector<std::string> peer_ids(length);
+        std::vector<rats_send_item_t> items(length);
+        for (uint32_t i = 0; i < length; i++) {
+            Napi::Value entry = list[i];
+            if (!entry.IsArray() || entry.As<Napi::Array>().Length() < 2) {
+                Napi::TypeError::New(env, "Expected array of [peer_id (string), data (Buffer)] pairs").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            Napi::Array pair = entry.As<Napi::Array>();
+            Napi::Value peer_id = pair[0u];
+            Napi::Value data = pair[1u];
+            if (!peer_id.IsString() || !data.IsBuffer()) {
+                Napi::TypeError::New(env, "Expected array of [peer_id (string), data (Buffer)] pairs").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            Napi::Buffer<uint8_t> buffer = data.As<Napi::Buffer<uint8_t>>();
+            peer_ids[i] = peer_id.As<Napi::String>().Utf8Value();
+            items[i].data = buffer.Data();
+            items[i].size = buffer.Length();
+        }
+        for (uint32_t i = 0; i < length; i++) {
+            items[i].peer_id = peer_ids[i].c_str();
+        }
+        
+        int result = rats_send_binary_many(client_, items.data(), static_cast<int>(length));
+        return Napi::Number::New(env, result);
+    }
+    
     Napi::Value BroadcastJson(const Napi::CallbackInfo& info) {
         Napi::Env env = info.Env();
         
@@ -386,18 +568,18 @@ private:
     Napi::Value GetPeerIds(const Napi::CallbackInfo& info) {
         Napi::Env env = info.Env();
         int count = 0;
-        char** peer_ids = rats_get_peer_ids(client_, &count);
+        rats_buffer_t buffer = rats_get_peer_ids_lent(client_, &count);
         
-        if (!peer_ids || count == 0) {
+        if (!buffer) {
             return Napi::Array::New(env, 0);
         }
         
+        const char* const* peer_ids = static_cast<const char* const*>(rats_buffer_data(buffer));
         Napi::Array result = Napi::Array::New(env, count);
         for (int i = 0; i < count; i++) {
             result[i] = Napi::String::New(env, peer_ids[i]);
-            rats_string_free(peer_ids[i]);
         }
-        free(peer_ids);
+        rats_buffer_release(buffer);
         
         return result;
     }
@@ -974,11 +1156,8 @@ private:
             return;
         }
         
-        auto callback_data = std::make_shared<CallbackData>(env);
-        callback_data->callback = Napi::Persistent(info[0].As<Napi::Function>());
-        
-        connection_callbacks[client_] = callback_data;
-        rats_set_connection_callback(client_, connection_callback_wrapper, client_);
+        connection_callback_ = Napi::Persistent(info[0].As<Napi::Function>());
+        EnableEvents(env, RATS_EVENT_CONNECTED);
     }
     
     void OnString(const Napi::CallbackInfo& info) {
@@ -989,11 +1168,8 @@ private:
             return;
         }
         
-        auto callback_data = std::make_shared<CallbackData>(env);
-        callback_data->callback = Napi::Persistent(info[0].As<Napi::Function>());
-        
-        string_callbacks[client_] = callback_data;
-        rats_set_string_callback(client_, string_callback_wrapper, client_);
+        string_callback_ = Napi::Persistent(info[0].As<Napi::Function>());
+        EnableEvents(env, RATS_EVENT_STRING);
     }
     
     void OnBinary(const Napi::CallbackInfo& info) {
@@ -1004,11 +1180,8 @@ private:
             return;
         }
         
-        auto callback_data = std::make_shared<CallbackData>(env);
-        callback_data->callback = Napi::Persistent(info[0].As<Napi::Function>());
-        
-        binary_callbacks[client_] = callback_data;
-        rats_set_binary_callback(client_, binary_callback_wrapper, client_);
+        binary_callback_ = Napi::Persistent(info[0].As<Napi::Function>());
+        EnableEvents(env, RATS_EVENT_BINARY);
     }
     
     void OnJson(const Napi::CallbackInfo& info) {
@@ -1019,11 +1192,8 @@ private:
             return;
         }
         
-        auto callback_data = std::make_shared<CallbackData>(env);
-        callback_data->callback = Napi::Persistent(info[0].As<Napi::Function>());
-        
-        json_callbacks[client_] = callback_data;
-        rats_set_json_callback(client_, json_callback_wrapper, client_);
+        json_callback_ = Napi::Persistent(info[0].As<Napi::Function>());
+        EnableEvents(env, RATS_EVENT_JSON);
     }
     
     void OnDisconnect(const Napi::CallbackInfo& info) {
@@ -1034,11 +1204,8 @@ private:
             return;
         }
         
-        auto callback_data = std::make_shared<CallbackData>(env);
-        callback_data->callback = Napi::Persistent(info[0].As<Napi::Function>());
-        
-        disconnect_callbacks[client_] = callback_data;
-        rats_set_disconnect_callback(client_, disconnect_callback_wrapper, client_);
+        disconnect_callback_ = Napi::Persistent(info[0].As<Napi::Function>());
+        EnableEvents(env, RATS_EVENT_DISCONNECTED);
     }
     
     void OnFileProgress(const Napi::CallbackInfo& info) {
@@ -1056,6 +1223,19 @@ private:
         rats_set_file_progress_callback(client_, file_progress_callback_wrapper, client_);
     }
     
+    // Receives every event of a batch at once: [{type, peerId, data}, ...]
+    void OnEvents(const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        
+        if (info.Length() < 1 || !info[0].IsFunction()) {
+            Napi::TypeError::New(env, "Expected callback function").ThrowAsJavaScriptException();
+            return;
+        }
+        
+        events_callback_ = Napi::Persistent(info[0].As<Napi::Function>());
+        EnableEvents(env, RATS_EVENT_ALL);
+    }
+    
     // Configuration persistence
     Napi::Value LoadConfiguration(const Napi::CallbackInfo& info) {
         Napi::Env env = info.Env();
@@ -289,6 +289,41 @@ describe('LibRats Node.js Bindings', function() {
         client1.connect('127.0.0.1', 18081);
       }, 100);
     });
+
+    it('should deliver events in batches', function(done) {
+      client1.start();
+      client2.start();
+      
+      const payload = Buffer.from([0x00, 0x01, 0x02, 0xff]);
+      const received = [];
+      
+      // client1 collects binary payloads from whole batches
+      client1.onEvents((events) => {
+        assert(Array.isArray(events), 'Events should arrive as an array');
+        for (const event of events) {
+          if (event.type === 'binary') {
+            assert(Buffer.isBuffer(event.data), 'Binary payload should be a Buffer');
+            received.push(event.data);
+          }
+        }
+        if (received.length === 2) {
+          assert(received.every((data) => data.equals(payload)), 'Payloads should match');
+          done();
+        }
+      });
+      
+      // client2 sends the same Buffer twice in one call once connected
+      client2.onConnection((peerId) => {
+        setTimeout(() => {
+          const queued = client2.sendBinaryMany([[peerId, payload], [peerId, payload]]);
+          console.log(`Batched send queued: ${queued}`);
+        }, 100);
+      });
+      
+      setTimeout(() => {
+        client1.connect('127.0.0.1', 18081);
+      }, 100);
+    });
   });
 
   describe('Error Handling', function() {
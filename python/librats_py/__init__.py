@@ -11,6 +11,7 @@ from .enums import (
     RatsError as ErrorCode,
     ConnectionStrategy,
     MessageDataType,
+    EventType,
     FileTransferStatus,
     LogLevel,
     NatType,
@@ -28,6 +29,7 @@ __all__ = [
     'ErrorCode',
     'ConnectionStrategy',
     'MessageDataType', 
+    'EventType',
     'FileTransferStatus',
     'LogLevel',
     'NatType',
@@ -5,11 +5,11 @@ Core RatsClient implementation for Python bindings.
 import json
 import threading
 import weakref
-from typing import Optional, List, Dict, Any, Callable
-from ctypes import c_void_p, c_char_p, create_string_buffer, byref, cast, c_int, string_at
+from typing import Optional, List, Dict, Any, Callable, Tuple
+from ctypes import c_void_p, c_char_p, create_string_buffer, byref, cast, c_int, string_at, POINTER
 
-from .ctypes_wrapper import get_librats
-from .enums import RatsError as ErrorCode, ConnectionStrategy, LogLevel, VersionInfo
+from .ctypes_wrapper import get_librats, RatsEvent, RatsSendItem
+from .enums import RatsError as ErrorCode, ConnectionStrategy, EventType, LogLevel, VersionInfo
 from .exceptions import RatsError, check_error
 from .callbacks import *
 
@@ -147,6 +147,33 @@ class RatsClient:
         )
         check_error(result, f"Sending binary data to peer {peer_id}")
     
+    def send_binary_many(self, items: List[Tuple[str, bytes]]) -> int:
+        """
+        Send several binary messages in one call.
+        
+        Consecutive items carrying the same bytes object are sent from a single copy.
+        
+        Args:
+            items: (peer_id, data) pairs
+            
+        Returns:
+            Number of messages queued
+        """
+        if not items:
+            return 0
+        peer_ids = [peer_id.encode('utf-8') for peer_id, _ in items]
+        payloads = {}
+        send_items = (RatsSendItem * len(items))()
+        for i, (_, data) in enumerate(items):
+            buffer = payloads.get(id(data))
+            if buffer is None:
+                buffer = create_string_buffer(bytes(data), len(data))
+                payloads[id(data)] = buffer
+            send_items[i].peer_id = peer_ids[i]
+            send_items[i].data = cast(buffer, c_void_p)
+            send_items[i].size = len(data)
+        return self._lib.lib.rats_send_binary_many(self._handle, send_items, len(items))
+    
     def send_json(self, peer_id: str, data: Dict[str, Any]) -> None:
         """
         Send JSON data to a specific peer.
@@ -253,20 +280,66 @@ class RatsClient:
     def get_peer_ids(self) -> List[str]:
         """Get list of all peer IDs."""
         count = c_int()
-        result = self._lib.lib.rats_get_peer_ids(self._handle, byref(count))
-        if not result or count.value == 0:
+        buffer = self._lib.lib.rats_get_peer_ids_lent(self._handle, byref(count))
+        if not buffer:
             return []
         
-        peer_ids = []
-        for i in range(count.value):
-            if result[i]:
-                peer_id = string_at(result[i]).decode('utf-8')
-                peer_ids.append(peer_id)
-                self._lib.lib.rats_string_free(result[i])
+        try:
+            ids = cast(self._lib.lib.rats_buffer_data(buffer), POINTER(c_char_p))
+            return [ids[i].decode('utf-8') for i in range(count.value)]
+        finally:
+            self._lib.lib.rats_buffer_release(buffer)
+    
+    def enable_event_polling(self, event_mask: int = EventType.ALL, max_queued_events: int = 0) -> None:
+        """
+        Queue events for poll_events instead of (or in addition to) callbacks.
         
-        # Free the array itself
-        self._lib.lib.rats_string_free(cast(result, c_void_p))
-        return peer_ids
+        Args:
+            event_mask: EventType values or'ed together, 0 disables polling
+            max_queued_events: Payload events kept before new ones are dropped (0 for the default)
+        """
+        result = self._lib.lib.rats_enable_event_polling(self._handle, int(event_mask), max_queued_events)
+        check_error(result, "Enabling event polling")
+    
+    def poll_events(self, max_events: int = 64, timeout_ms: int = 0) -> List[Tuple[EventType, str, Any]]:
+        """
+        Take queued events in one batch.
+        
+        Args:
+            max_events: Maximum number of events to return
+            timeout_ms: Time to wait when no event is queued (negative waits indefinitely)
+            
+        Returns:
+            (type, peer_id, payload) tuples; payload is bytes, str, dict or None
+        """
+        events = (RatsEvent * max_events)()
+        count = self._lib.lib.rats_poll_events(self._handle, events, max_events, timeout_ms)
+        if count < 0:
+            check_error(count, "Polling events")
+        
+        result = []
+        for i in range(count):
+            event = events[i]
+            try:
+                event_type = EventType(event.type)
+                peer_id = event.peer_id.decode('utf-8')
+                payload = None
+                if event.data:
+                    raw = string_at(event.data, event.size)
+                    if event_type == EventType.STRING:
+                        payload = raw.decode('utf-8')
+                    elif event_type == EventType.JSON:
+                        payload = json.loads(raw)
+                    else:
+                        payload = raw
+                result.append((event_type, peer_id, payload))
+            finally:
+                self._lib.lib.rats_buffer_release(event.buffer)
+        return result
+    
+    def get_dropped_event_count(self) -> int:
+        """Get the number of payload events dropped while the event queue was full."""
+        return self._lib.lib.rats_get_dropped_event_count(self._handle)
     
     def get_peer_info(self, peer_id: str) -> Dict[str, Any]:
         """Get detailed information about a specific peer."""
@@ -8,7 +8,7 @@ import platform
 import sys
 from ctypes import (
     CDLL, POINTER, Structure, c_void_p, c_char_p, c_int, c_size_t,
-    c_uint32, c_uint16, c_uint8, byref, create_string_buffer
+    c_uint32, c_uint16, c_uint8, c_uint64, byref, create_string_buffer
 )
 from typing import Optional
 
@@ -73,6 +73,26 @@ def find_librats_library() -> str:
     )
 
 
+class RatsEvent(Structure):
+    """Mirror of rats_event_t."""
+    _fields_ = [
+        ('type', c_int),
+        ('peer_id', c_char_p),
+        ('data', c_void_p),
+        ('size', c_size_t),
+        ('buffer', c_void_p),
+    ]
+
+
+class RatsSendItem(Structure):
+    """Mirror of rats_send_item_t."""
+    _fields_ = [
+        ('peer_id', c_char_p),
+        ('data', c_void_p),
+        ('size', c_size_t),
+    ]
+
+
 class LibratsCtypes:
     """Low-level ctypes wrapper for librats C API."""
     
@@ -250,6 +270,31 @@ class LibratsCtypes:
         self.lib.rats_get_peer_info_json.argtypes = [c_void_p, c_char_p]
         self.lib.rats_get_peer_info_json.restype = c_void_p
         
+        # Lent buffers and event polling
+        self.lib.rats_buffer_data.argtypes = [c_void_p]
+        self.lib.rats_buffer_data.restype = c_void_p
+        
+        self.lib.rats_buffer_size.argtypes = [c_void_p]
+        self.lib.rats_buffer_size.restype = c_size_t
+        
+        self.lib.rats_buffer_release.argtypes = [c_void_p]
+        self.lib.rats_buffer_release.restype = None
+        
+        self.lib.rats_get_peer_ids_lent.argtypes = [c_void_p, POINTER(c_int)]
+        self.lib.rats_get_peer_ids_lent.restype = c_void_p
+        
+        self.lib.rats_enable_event_polling.argtypes = [c_void_p, c_int, c_size_t]
+        self.lib.rats_enable_event_polling.restype = c_int
+        
+        self.lib.rats_poll_events.argtypes = [c_void_p, POINTER(RatsEvent), c_int, c_int]
+        self.lib.rats_poll_events.restype = c_int
+        
+        self.lib.rats_get_dropped_event_count.argtypes = [c_void_p]
+        self.lib.rats_get_dropped_event_count.restype = c_uint64
+        
+        self.lib.rats_send_binary_many.argtypes = [c_void_p, POINTER(RatsSendItem), c_int]
+        self.lib.rats_send_binary_many.restype = c_int
+        
         # Enhanced DHT Discovery
         self.lib.rats_announce_for_hash.argtypes = [c_void_p, c_char_p, c_int]
         self.lib.rats_announce_for_hash.restype = c_int
@@ -33,6 +33,16 @@ class MessageDataType(IntEnum):
     JSON = 3
 
 
+class EventType(IntEnum):
+    """Event types returned by RatsClient.poll_events (usable as a bit mask)."""
+    CONNECTED = 1
+    DISCONNECTED = 2
+    BINARY = 4
+    STRING = 8
+    JSON = 16
+    ALL = 31
+
+
 class FileTransferStatus(IntEnum):
     """File transfer status values."""
     PENDING = 0
@@ -324,6 +324,13 @@ BencodeValue BencodeDecoder::decode(const uint8_t* data, size_t size) {
     return decoder.decode_value();
 }
 
+BencodeValue BencodeDecoder::decode(const uint8_t* data, size_t size, size_t& consumed) {
+    BencodeDecoder decoder(data, size);
+    BencodeValue value = decoder.decode_value();
+    consumed = decoder.pos_;
+    return value;
+}
+
 BencodeValue BencodeDecoder::decode_value() {
     if (!has_more()) {
         throw std::runtime_error("Unexpected end of data");
@@ -463,6 +470,404 @@ std::string BencodeDecoder::consume_string(size_t length) {
     return str;
 }
 
+// BencodeWriter implementation
+void BencodeWriter::write_integer(int64_t value) {
+    buffer_.push_back('i');
+    if (value < 0) {
+        buffer_.push_back('-');
+        write_decimal(0 - static_cast<uint64_t>(value));
+    } else {
+        write_decimal(static_cast<uint64_t>(value));
+    }
+    buffer_.push_back('e');
+}
+
+void BencodeWriter::write_string(std::string_view value) {
+    uint8_t* out = write_string_header(value.size());
+    std::copy(value.begin(), value.end(), out);
+}
+
+uint8_t* BencodeWriter::write_string_header(size_t size) {
+    write_decimal(size);
+    buffer_.push_back(':');
+    size_t offset = buffer_.size();
+    buffer_.resize(offset + size);
+    return buffer_.data() + offset;
+}
+
+void BencodeWriter::write_decimal(uint64_t value) {
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        buffer_.push_back(static_cast<uint8_t>(digits[--count]));
+    }
+}
+
+// Lexing shared by BencodeDocument and bencode::parse_events
+namespace {
+
+// Reads "i<digits>e" at pos
+bool read_integer(const uint8_t* data, size_t size, size_t& pos, int64_t& value) {
+    size_t p = pos + 1;
+    bool negative = p < size && data[p] == '-';
+    if (negative) {
+        ++p;
+    }
+    
+    size_t digits_begin = p;
+    uint64_t magnitude = 0;
+    while (p < size && data[p] >= '0' && data[p] <= '9') {
+        uint64_t digit = data[p] - '0';
+        if (magnitude > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        magnitude = magnitude * 10 + digit;
+        ++p;
+    }
+    
+    if (p == digits_begin || p >= size || data[p] != 'e') {
+        return false;
+    }
+    if (negative ? magnitude > static_cast<uint64_t>(INT64_MAX) + 1 : magnitude > static_cast<uint64_t>(INT64_MAX)) {
+        return false;
+    }
+    
+    value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    pos = p + 1;
+    return true;
+}
+
+// Reads "<length>:<bytes>" at pos
+bool read_string(const uint8_t* data, size_t size, size_t& pos, size_t& payload, size_t& length) {
+    size_t p = pos;
+    size_t n = 0;
+    while (p < size && data[p] >= '0' && data[p] <= '9') {
+        n = n * 10 + (data[p] - '0');
+        if (n > size) {
+            return false;
+        }
+        ++p;
+    }
+    
+    if (p == pos || p >= size || data[p] != ':' || n > size - p - 1) {
+        return false;
+    }
+    
+    payload = p + 1;
+    length = n;
+    pos = payload + n;
+    return true;
+}
+
+std::string_view view_at(const uint8_t* data, size_t offset, size_t length) {
+    return std::string_view(reinterpret_cast<const char*>(data) + offset, length);
+}
+
+bool parse_events_value(const uint8_t* data, size_t size, size_t& pos, BencodeHandler& handler, int depth) {
+    if (pos >= size || depth > BencodeDocument::MAX_DEPTH) {
+        return false;
+    }
+    
+    uint8_t first = data[pos];
+    if (first == 'i') {
+        int64_t value;
+        return read_integer(data, size, pos, value) && handler.on_integer(value);
+    }
+    if (first >= '0' && first <= '9') {
+        size_t payload, length;
+        return read_string(data, size, pos, payload, length) && handler.on_string(view_at(data, payload, length));
+    }
+    if (first == 'l') {
+        if (!handler.on_list_begin()) {
+            return false;
+        }
+        ++pos;
+        while (pos < size && data[pos] != 'e') {
+            if (!parse_events_value(data, size, pos, handler, depth + 1)) {
+                return false;
+            }
+        }
+        if (pos >= size) {
+            return false;
+        }
+        ++pos;
+        return handler.on_list_end();
+    }
+    if (first == 'd') {
+        if (!handler.on_dict_begin()) {
+            return false;
+        }
+        ++pos;
+        while (pos < size && data[pos] != 'e') {
+            size_t payload, length;
+            if (!read_string(data, size, pos, payload, length) || !handler.on_dict_key(view_at(data, payload, length)) ||
+                !parse_events_value(data, size, pos, handler, depth + 1)) {
+                return false;
+            }
+        }
+        if (pos >= size) {
+            return false;
+        }
+        ++pos;
+        return handler.on_dict_end();
+    }
+    return false;
+}
+
+} // namespace
+
+// BencodeView implementation
+BencodeView::Type BencodeView::get_type() const {
+    if (!document_) {
+        throw std::runtime_error("Invalid BencodeView");
+    }
+    return document_->nodes_[index_].type;
+}
+
+int64_t BencodeView::as_integer() const {
+    if (!is_integer()) {
+        throw std::runtime_error("BencodeValue is not an integer");
+    }
+    return document_->nodes_[index_].integer;
+}
+
+std::string_view BencodeView::as_string() const {
+    if (!is_string()) {
+        throw std::runtime_error("BencodeValue is not a string");
+    }
+    return document_->string_at(index_);
+}
+
+size_t BencodeView::size() const {
+    if (!document_ || get_type() == Type::Integer) {
+        return 0;
+    }
+    return document_->nodes_[index_].count;
+}
+
+BencodeView BencodeView::find(std::string_view key) const {
+    if (!is_dict()) {
+        return BencodeView();
+    }
+    
+    const auto& node = document_->nodes_[index_];
+    const uint32_t* entries = document_->children_.data() + node.first;
+    size_t low = 0;
+    size_t high = node.count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int order = document_->string_at(entries[mid * 2]).compare(key);
+        if (order == 0) {
+            return BencodeView(document_, entries[mid * 2 + 1]);
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return BencodeView();
+}
+
+BencodeView BencodeView::operator[](std::string_view key) const {
+    if (!is_dict()) {
+        throw std::runtime_error("BencodeValue is not a dictionary");
+    }
+    BencodeView value = find(key);
+    if (!value.is_valid()) {
+        throw std::runtime_error("Key not found in dictionary: " + std::string(key));
+    }
+    return value;
+}
+
+std::string_view BencodeView::key_at(size_t index) const {
+    if (!is_dict()) {
+        throw std::runtime_error("BencodeValue is not a dictionary");
+    }
+    const auto& node = document_->nodes_[index_];
+    if (index >= node.count) {
+        throw std::runtime_error("Index out of bounds");
+    }
+    return document_->string_at(document_->children_[node.first + index * 2]);
+}
+
+BencodeView BencodeView::value_at(size_t index) const {
+    if (!is_dict()) {
+        throw std::runtime_error("BencodeValue is not a dictionary");
+    }
+    const auto& node = document_->nodes_[index_];
+    if (index >= node.count) {
+        throw std::runtime_error("Index out of bounds");
+    }
+    return BencodeView(document_, document_->children_[node.first + index * 2 + 1]);
+}
+
+BencodeView BencodeView::operator[](size_t index) const {
+    if (!is_list()) {
+        throw std::runtime_error("BencodeValue is not a list");
+    }
+    const auto& node = document_->nodes_[index_];
+    if (index >= node.count) {
+        throw std::runtime_error("Index out of bounds");
+    }
+    return BencodeView(document_, document_->children_[node.first + index]);
+}
+
+std::string_view BencodeView::raw() const {
+    if (!document_) {
+        throw std::runtime_error("Invalid BencodeView");
+    }
+    const auto& node = document_->nodes_[index_];
+    return view_at(document_->data_, node.begin, node.end - node.begin);
+}
+
+BencodeValue BencodeView::to_value() const {
+    switch (get_type()) {
+        case Type::Integer:
+            return BencodeValue(as_integer());
+        case Type::String:
+            return BencodeValue(std::string(as_string()));
+        case Type::List: {
+            BencodeValue list = BencodeValue::create_list();
+            for (size_t i = 0; i < size(); ++i) {
+                list.push_back((*this)[i].to_value());
+            }
+            return list;
+        }
+        case Type::Dictionary:
+        default: {
+            BencodeValue dict = BencodeValue::create_dict();
+            for (size_t i = 0; i < size(); ++i) {
+                dict[std::string(key_at(i))] = value_at(i).to_value();
+            }
+            return dict;
+        }
+    }
+}
+
+// BencodeDocument implementation
+bool BencodeDocument::parse(const uint8_t* data, size_t size, size_t* consumed) {
+    data_ = data;
+    nodes_.clear();
+    children_.clear();
+    pending_.clear();
+    
+    size_t pos = 0;
+    if (size > UINT32_MAX || !parse_value(size, pos, 0)) {
+        nodes_.clear();
+        return false;
+    }
+    
+    if (consumed) {
+        *consumed = pos;
+    }
+    return true;
+}
+
+BencodeView BencodeDocument::root() const {
+    return nodes_.empty() ? BencodeView() : BencodeView(this, 0);
+}
+
+bool BencodeDocument::parse_value(size_t size, size_t& pos, int depth) {
+    if (pos >= size || depth > MAX_DEPTH) {
+        return false;
+    }
+    
+    uint32_t index = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(Node{BencodeValue::Type::Integer, static_cast<uint32_t>(pos), 0, 0, 0, 0});
+    
+    uint8_t first = data_[pos];
+    if (first == 'i') {
+        int64_t value;
+        if (!read_integer(data_, size, pos, value)) {
+            return false;
+        }
+        nodes_[index].integer = value;
+    } else if (first >= '0' && first <= '9') {
+        size_t payload, length;
+        if (!read_string(data_, size, pos, payload, length)) {
+            return false;
+        }
+        nodes_[index].type = BencodeValue::Type::String;
+        nodes_[index].first = static_cast<uint32_t>(payload);
+        nodes_[index].count = static_cast<uint32_t>(length);
+    } else if (first == 'l' || first == 'd') {
+        bool is_dict = first == 'd';
+        size_t pending_base = pending_.size();
+        ++pos;
+        while (pos < size && data_[pos] != 'e') {
+            if (is_dict) {
+                // Keys are always strings
+                if (data_[pos] < '0' || data_[pos] > '9') {
+                    return false;
+                }
+                pending_.push_back(static_cast<uint32_t>(nodes_.size()));
+                if (!parse_value(size, pos, depth + 1)) {
+                    return false;
+                }
+            }
+            // Index is taken first: the value's own children come after it in nodes_
+            uint32_t child = static_cast<uint32_t>(nodes_.size());
+            if (!parse_value(size, pos, depth + 1)) {
+                return false;
+            }
+            pending_.push_back(child);
+        }
+        if (pos >= size) {
+            return false;
+        }
+        ++pos;
+        
+        Node& node = nodes_[index];
+        node.type = is_dict ? BencodeValue::Type::Dictionary : BencodeValue::Type::List;
+        node.first = static_cast<uint32_t>(children_.size());
+        node.count = static_cast<uint32_t>((pending_.size() - pending_base) / (is_dict ? 2 : 1));
+        children_.insert(children_.end(), pending_.begin() + pending_base, pending_.end());
+        pending_.resize(pending_base);
+        if (is_dict) {
+            sort_dict(node);
+        }
+    } else {
+        return false;
+    }
+    
+    nodes_[index].end = static_cast<uint32_t>(pos);
+    return true;
+}
+
+std::string_view BencodeDocument::string_at(uint32_t node) const {
+    return view_at(data_, nodes_[node].first, nodes_[node].count);
+}
+
+void BencodeDocument::sort_dict(Node& dict) {
+    // Canonical bencode is already sorted; only reorder what is not
+    uint32_t* entries = children_.data() + dict.first;
+    bool sorted = true;
+    for (uint32_t i = 1; i < dict.count && sorted; ++i) {
+        sorted = string_at(entries[(i - 1) * 2]) <= string_at(entries[i * 2]);
+    }
+    if (sorted) {
+        return;
+    }
+    
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(dict.count);
+    for (uint32_t i = 0; i < dict.count; ++i) {
+        pairs.emplace_back(entries[i * 2], entries[i * 2 + 1]);
+    }
+    std::stable_sort(pairs.begin(), pairs.end(), [this](const auto& a, const auto& b) {
+        return string_at(a.first) < string_at(b.first);
+    });
+    for (uint32_t i = 0; i < dict.count; ++i) {
+        entries[i * 2] = pairs[i].first;
+        entries[i * 2 + 1] = pairs[i].second;
+    }
+}
+
 // Utility functions
 namespace bencode {
     BencodeValue decode(const std::vector<uint8_t>& data) {
@@ -480,6 +885,17 @@ namespace bencode {
     std::string encode_string(const BencodeValue& value) {
         return value.encode_string();
     }
+    
+    bool parse_events(const uint8_t* data, size_t size, BencodeHandler& handler, size_t* consumed) {
+        size_t pos = 0;
+        if (!parse_events_value(data, size, pos, handler, 0)) {
+            return false;
+        }
+        if (consumed) {
+            *consumed = pos;
+        }
+        return true;
+    }
 }
 
 } // namespace librats 
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <memory>
 #include <variant>
 #include <cstdint>
+#include <string_view>
 
 // Use shared_ptr variant for GCC 11 and lower compatibility
 #ifndef LIBRATS_USE_SHARED_PTR_VARIANT
@@ -112,6 +113,8 @@ public:
     static BencodeValue decode(const std::vector<uint8_t>& data);
     static BencodeValue decode(const std::string& data);
     static BencodeValue decode(const uint8_t* data, size_t size);
+    // Decodes the value at the start of data; consumed receives its encoded length, e.g. to reach data appended after it
+    static BencodeValue decode(const uint8_t* data, size_t size, size_t& consumed);
 
 private:
     const uint8_t* data_;
@@ -132,6 +135,143 @@ private:
     std::string consume_string(size_t length);
 };
 
+/**
+ * Writes bencode straight into a byte buffer, without building BencodeValues.
+ * Nothing is checked: dictionary keys go out in the order they are written, so
+ * callers write them sorted, and every begin_*() needs its end().
+ */
+class BencodeWriter {
+public:
+    explicit BencodeWriter(std::vector<uint8_t>& buffer) : buffer_(buffer) {}
+
+    void begin_dict() { buffer_.push_back('d'); }
+    void begin_list() { buffer_.push_back('l'); }
+    void end() { buffer_.push_back('e'); }
+    void write_integer(int64_t value);
+    void write_string(std::string_view value);
+
+    // Writes the header of a size-byte string and returns where its bytes go, to fill in place
+    uint8_t* write_string_header(size_t size);
+
+private:
+    std::vector<uint8_t>& buffer_;
+
+    void write_decimal(uint64_t value);
+};
+
+class BencodeDocument;
+
+/**
+ * Read-only view of one value in a BencodeDocument. Strings are views into the
+ * parsed buffer. Accessors throw std::runtime_error on type mismatch, like
+ * BencodeValue's; a default-constructed view (or a failed find()) is invalid.
+ */
+class BencodeView {
+public:
+    using Type = BencodeValue::Type;
+
+    BencodeView() : document_(nullptr), index_(0) {}
+
+    bool is_valid() const { return document_ != nullptr; }
+
+    // Type checking
+    Type get_type() const;
+    bool is_integer() const { return is_valid() && get_type() == Type::Integer; }
+    bool is_string() const { return is_valid() && get_type() == Type::String; }
+    bool is_list() const { return is_valid() && get_type() == Type::List; }
+    bool is_dict() const { return is_valid() && get_type() == Type::Dictionary; }
+
+    // Value access
+    int64_t as_integer() const;
+    std::string_view as_string() const;
+
+    // String length, list items or dictionary entries
+    size_t size() const;
+
+    // Dictionary operations; keys are kept sorted, lookups are binary searches
+    bool has_key(std::string_view key) const { return find(key).is_valid(); }
+    BencodeView find(std::string_view key) const;
+    BencodeView operator[](std::string_view key) const;
+    std::string_view key_at(size_t index) const;
+    BencodeView value_at(size_t index) const;
+
+    // List operations
+    BencodeView operator[](size_t index) const;
+
+    // This value's own encoding in the parsed buffer, e.g. to hash an info dictionary as received
+    std::string_view raw() const;
+
+    // Deep copy into an owning value
+    BencodeValue to_value() const;
+
+private:
+    friend class BencodeDocument;
+
+    const BencodeDocument* document_;
+    uint32_t index_;
+
+    BencodeView(const BencodeDocument* document, uint32_t index) : document_(document), index_(index) {}
+};
+
+/**
+ * Bencode parsed in place into a flat arena of nodes. Strings stay in the caller's
+ * buffer and every dictionary is a key-sorted array, so nothing is allocated per
+ * value; a document reused across parses keeps its arena and stops allocating
+ * once it has seen its largest input.
+ *
+ * The parsed buffer must outlive the document's views. Not thread safe.
+ */
+class BencodeDocument {
+public:
+    static constexpr int MAX_DEPTH = 256;    // Deeper nesting is rejected instead of recursing on
+
+    // Parses the value at the start of data; false if it is malformed. consumed receives its encoded length.
+    bool parse(const uint8_t* data, size_t size, size_t* consumed = nullptr);
+    bool parse(const std::vector<uint8_t>& data) { return parse(data.data(), data.size()); }
+    bool parse(std::string_view data) { return parse(reinterpret_cast<const uint8_t*>(data.data()), data.size()); }
+
+    // Root of the last successful parse (invalid view otherwise)
+    BencodeView root() const;
+
+private:
+    friend class BencodeView;
+
+    struct Node {
+        BencodeValue::Type type;
+        uint32_t begin;      // Encoded value: [begin, end) in the buffer
+        uint32_t end;
+        uint32_t first;      // String: payload offset; list/dict: start in children_
+        uint32_t count;      // String: payload length; list: items; dict: entries
+        int64_t integer;
+    };
+
+    const uint8_t* data_ = nullptr;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> children_;    // Per container: item nodes, or key/value node pairs sorted by key
+    std::vector<uint32_t> pending_;     // Children of the containers still being parsed
+
+    bool parse_value(size_t size, size_t& pos, int depth);
+    std::string_view string_at(uint32_t node) const;
+    void sort_dict(Node& dict);
+};
+
+/**
+ * Receives values from bencode::parse_events() as they are read, without
+ * building anything. Returning false from a callback stops parsing.
+ */
+class BencodeHandler {
+public:
+    virtual ~BencodeHandler() = default;
+
+    virtual bool on_integer(int64_t value) { (void)value; return true; }
+    virtual bool on_string(std::string_view value) { (void)value; return true; }
+    virtual bool on_list_begin() { return true; }
+    virtual bool on_list_end() { return true; }
+    virtual bool on_dict_begin() { return true; }
+    virtual bool on_dict_key(std::string_view key) { (void)key; return true; }
+    virtual bool on_dict_end() { return true; }
+};
+
 /**
  * Utility functions
  */
@@ -140,6 +280,9 @@ namespace bencode {
     BencodeValue decode(const std::string& data);
     std::vector<uint8_t> encode(const BencodeValue& value);
     std::string encode_string(const BencodeValue& value);
+    
+    // Streams the value at the start of data to handler; false if malformed or stopped by the handler
+    bool parse_events(const uint8_t* data, size_t size, BencodeHandler& handler, size_t* consumed = nullptr);
 }
 
 } // namespace librats 
\ No newline at end of file
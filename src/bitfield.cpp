@@ -0,0 +1,139 @@
+#include "bitfield.h"
+#include <algorithm>
+
+namespace librats {
+
+namespace {
+
+inline size_t popcount64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_popcountll(word));
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<size_t>((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+} // namespace
+
+Bitfield Bitfield::from_bytes(const uint8_t* data, size_t length, size_t size) {
+    Bitfield result(size);
+    size_t bytes = (std::min)(length, (size + 7) / 8);
+    for (size_t i = 0; i < bytes; ++i) {
+        result.words_[i / 8] |= static_cast<uint64_t>(data[i]) << (56 - (i % 8) * 8);
+    }
+    result.clear_tail();
+    return result;
+}
+
+std::vector<uint8_t> Bitfield::to_bytes() const {
+    std::vector<uint8_t> bytes((size_ + 7) / 8);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = static_cast<uint8_t>(words_[i / 8] >> (56 - (i % 8) * 8));
+    }
+    return bytes;
+}
+
+void Bitfield::resize(size_t size, bool value) {
+    size_t old_size = size_;
+    words_.resize((size + 63) / 64, value ? ~uint64_t(0) : 0);
+    size_ = size;
+
+    // Bits of the old last word beyond its size were zero
+    if (value && size > old_size && old_size % 64 != 0) {
+        words_[old_size / 64] |= ~uint64_t(0) >> (old_size % 64);
+    }
+    clear_tail();
+}
+
+void Bitfield::set_all() {
+    std::fill(words_.begin(), words_.end(), ~uint64_t(0));
+    clear_tail();
+}
+
+void Bitfield::clear_all() {
+    std::fill(words_.begin(), words_.end(), 0);
+}
+
+size_t Bitfield::count() const {
+    size_t total = 0;
+    for (uint64_t word : words_) {
+        total += popcount64(word);
+    }
+    return total;
+}
+
+bool Bitfield::all() const {
+    return find_first_clear() == npos;
+}
+
+bool Bitfield::any() const {
+    return std::any_of(words_.begin(), words_.end(), [](uint64_t word) { return word != 0; });
+}
+
+size_t Bitfield::find_first_set(size_t from) const {
+    if (from >= size_) {
+        return npos;
+    }
+    size_t word = from / 64;
+    uint64_t bits = words_[word] & (~uint64_t(0) >> (from % 64));
+    while (bits == 0) {
+        if (++word == words_.size()) {
+            return npos;
+        }
+        bits = words_[word];
+    }
+    return word * 64 + leading_zeros(bits);
+}
+
+size_t Bitfield::find_first_clear(size_t from) const {
+    if (from >= size_) {
+        return npos;
+    }
+    size_t word = from / 64;
+    uint64_t bits = ~words_[word] & (~uint64_t(0) >> (from % 64));
+    while (bits == 0) {
+        if (++word == words_.size()) {
+            return npos;
+        }
+        bits = ~words_[word];
+    }
+    size_t index = word * 64 + leading_zeros(bits);
+    return index < size_ ? index : npos;
+}
+
+Bitfield& Bitfield::operator&=(const Bitfield& other) {
+    size_t common = (std::min)(words_.size(), other.words_.size());
+    for (size_t i = 0; i < common; ++i) {
+        words_[i] &= other.words_[i];
+    }
+    std::fill(words_.begin() + common, words_.end(), 0);
+    return *this;
+}
+
+Bitfield& Bitfield::operator|=(const Bitfield& other) {
+    size_t common = (std::min)(words_.size(), other.words_.size());
+    for (size_t i = 0; i < common; ++i) {
+        words_[i] |= other.words_[i];
+    }
+    clear_tail();
+    return *this;
+}
+
+Bitfield& Bitfield::and_not(const Bitfield& other) {
+    size_t common = (std::min)(words_.size(), other.words_.size());
+    for (size_t i = 0; i < common; ++i) {
+        words_[i] &= ~other.words_[i];
+    }
+    return *this;
+}
+
+void Bitfield::clear_tail() {
+    if (size_ % 64 != 0) {
+        words_.back() &= ~(~uint64_t(0) >> (size_ % 64));
+    }
+}
+
+} // namespace librats
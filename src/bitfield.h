@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+#endif
+
+namespace librats {
+
+// Fixed-size bitset packed into 64-bit words, for piece and block availability.
+// Bit i lives in word i / 64 at position 63 - i % 64, so the words are the
+// BitTorrent wire bitfield (MSB of the first byte is index 0) read as big-endian
+// integers. Bits past size() are always zero, whole-word operations rely on it.
+class Bitfield {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    Bitfield() : size_(0) {}
+    explicit Bitfield(size_t size, bool value = false) : size_(0) { resize(size, value); }
+
+    // Wire format conversion; bytes beyond `size` bits are ignored, missing bytes read as zero
+    static Bitfield from_bytes(const uint8_t* data, size_t length, size_t size);
+    std::vector<uint8_t> to_bytes() const;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void resize(size_t size, bool value = false);
+
+    bool get(size_t index) const {
+        return index < size_ && (words_[index / 64] & mask(index)) != 0;
+    }
+    bool operator[](size_t index) const { return get(index); }
+
+    void set(size_t index) { words_[index / 64] |= mask(index); }
+    void clear(size_t index) { words_[index / 64] &= ~mask(index); }
+    void set(size_t index, bool value) { value ? set(index) : clear(index); }
+    void set_all();
+    void clear_all();
+
+    // Population count and its shortcuts
+    size_t count() const;
+    bool all() const;
+    bool any() const;
+    bool none() const { return !any(); }
+
+    // First set/clear bit at or after `from`, npos if there is none
+    size_t find_first_set(size_t from = 0) const;
+    size_t find_first_clear(size_t from = 0) const;
+
+    // Word-wise combination; the result has the size of *this, missing bits of `other` read as zero
+    Bitfield& operator&=(const Bitfield& other);
+    Bitfield& operator|=(const Bitfield& other);
+    Bitfield& and_not(const Bitfield& other);  // this &= ~other
+
+    bool operator==(const Bitfield& other) const { return size_ == other.size_ && words_ == other.words_; }
+    bool operator!=(const Bitfield& other) const { return !(*this == other); }
+
+    // Calls f(index) for every set bit, in increasing order
+    template <typename F>
+    void for_each_set(F f) const {
+        for (size_t word = 0; word < words_.size(); ++word) {
+            for (uint64_t bits = words_[word]; bits != 0;) {
+                size_t offset = leading_zeros(bits);
+                f(word * 64 + offset);
+                bits &= ~(uint64_t(1) << (63 - offset));
+            }
+        }
+    }
+
+    const std::vector<uint64_t>& words() const { return words_; }
+
+private:
+    std::vector<uint64_t> words_;
+    size_t size_;
+
+    static uint64_t mask(size_t index) { return uint64_t(1) << (63 - index % 64); }
+    static size_t leading_zeros(uint64_t word) {  // word != 0
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanReverse64(&index, word);
+        return 63 - index;
+#else
+        return static_cast<size_t>(__builtin_clzll(word));
+#endif
+    }
+    void clear_tail();
+};
+
+} // namespace librats
@@ -1,4 +1,5 @@
 #include "bittorrent.h"
+#include "metadata_fetcher.h"
 #include "fs.h"
 #include "network_utils.h"
 #include "socket.h"
@@ -10,6 +11,8 @@
 #include <filesystem>
 #include <cstring>
 #include <climits>
+#include <cmath>
+#include <cctype>
 
 #define LOG_BT_DEBUG(message) LOG_DEBUG("bittorrent", message)
 #define LOG_BT_INFO(message)  LOG_INFO("bittorrent", message)
@@ -45,16 +48,43 @@ bool TorrentInfo::load_from_file(const std::string& torrent_file) {
 bool TorrentInfo::load_from_data(const std::vector<uint8_t>& data) {
     LOG_BT_DEBUG("Parsing torrent data (" << data.size() << " bytes)");
     
+    // Parsed in place: piece hashes and paths are read straight from data
+    BencodeDocument document;
+    if (!document.parse(data)) {
+        LOG_BT_ERROR("Failed to decode torrent bencode");
+        return false;
+    }
+    return load_from_dict(document.root());
+}
+
+bool TorrentInfo::load_from_metadata(const std::vector<uint8_t>& metadata) {
+    BencodeValue torrent = BencodeValue::create_dict();
     try {
-        BencodeValue torrent = bencode::decode(data);
-        return load_from_bencode(torrent);
+        torrent["info"] = bencode::decode(metadata);
     } catch (const std::exception& e) {
-        LOG_BT_ERROR("Failed to decode torrent bencode: " << e.what());
+        LOG_BT_ERROR("Failed to decode torrent metadata: " << e.what());
         return false;
     }
+    if (!load_from_bencode(torrent)) {
+        return false;
+    }
+    
+    // Hash the bytes as received, a non-canonical encoding would not survive re-encoding
+    uint8_t digest[20];
+    SHA1 sha1;
+    sha1.update(metadata.data(), metadata.size());
+    sha1.finalize(digest);
+    std::copy(digest, digest + 20, info_hash_.begin());
+    metadata_ = metadata;
+    return true;
 }
 
 bool TorrentInfo::load_from_bencode(const BencodeValue& torrent_data) {
+    return load_from_dict(torrent_data);
+}
+
+template<typename Bencode>
+bool TorrentInfo::load_from_dict(const Bencode& torrent_data) {
     try {
         if (!torrent_data.is_dict()) {
             LOG_BT_ERROR("Torrent data is not a dictionary");
@@ -73,7 +103,7 @@ bool TorrentInfo::load_from_bencode(const BencodeValue& torrent_data) {
                 for (size_t i = 0; i < announce_list.size(); ++i) {
                     const auto& tier = announce_list[i];
                     if (tier.is_list() && tier.size() > 0) {
-                        announce_list_.push_back(tier[0].as_string());
+                        announce_list_.emplace_back(tier[0].as_string());
                     }
                 }
             }
@@ -108,7 +138,8 @@ bool TorrentInfo::load_from_bencode(const BencodeValue& torrent_data) {
     }
 }
 
-bool TorrentInfo::parse_info_dict(const BencodeValue& info_dict) {
+template<typename Bencode>
+bool TorrentInfo::parse_info_dict(const Bencode& info_dict) {
     if (!info_dict.is_dict()) {
         LOG_BT_ERROR("Info is not a dictionary");
         return false;
@@ -134,7 +165,7 @@ bool TorrentInfo::parse_info_dict(const BencodeValue& info_dict) {
         return false;
     }
     
-    const std::string& pieces_data = info_dict["pieces"].as_string();
+    const auto& pieces_data = info_dict["pieces"].as_string();
     if (pieces_data.length() % 20 != 0) {
         LOG_BT_ERROR("Invalid pieces length: " << pieces_data.length());
         return false;
@@ -164,6 +195,7 @@ void TorrentInfo::calculate_info_hash(const BencodeValue& info_dict) {
     // Encode the info dictionary and calculate SHA1 hash
     std::vector<uint8_t> encoded = info_dict.encode();
     std::string hash_string = SHA1::hash_bytes(encoded);
+    metadata_ = std::move(encoded);
     
     // Convert hex string to bytes
     for (size_t i = 0; i < 20; ++i) {
@@ -172,7 +204,19 @@ void TorrentInfo::calculate_info_hash(const BencodeValue& info_dict) {
     }
 }
 
-void TorrentInfo::build_file_list(const BencodeValue& info_dict) {
+void TorrentInfo::calculate_info_hash(const BencodeView& info_dict) {
+    // The info dictionary's bytes as they appear in the torrent, no re-encoding needed
+    std::string_view encoded = info_dict.raw();
+    uint8_t digest[20];
+    SHA1 sha1;
+    sha1.update(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
+    sha1.finalize(digest);
+    std::copy(digest, digest + 20, info_hash_.begin());
+    metadata_.assign(encoded.begin(), encoded.end());
+}
+
+template<typename Bencode>
+void TorrentInfo::build_file_list(const Bencode& info_dict) {
     files_.clear();
     total_length_ = 0;
     
@@ -293,18 +337,8 @@ PeerMessage PeerMessage::create_have(PieceIndex piece_index) {
     return PeerMessage(MessageType::HAVE, payload);
 }
 
-PeerMessage PeerMessage::create_bitfield(const std::vector<bool>& bitfield) {
-    std::vector<uint8_t> payload((bitfield.size() + 7) / 8, 0);
-    
-    for (size_t i = 0; i < bitfield.size(); ++i) {
-        if (bitfield[i]) {
-            size_t byte_index = i / 8;
-            size_t bit_index = 7 - (i % 8);
-            payload[byte_index] |= (1 << bit_index);
-        }
-    }
-    
-    return PeerMessage(MessageType::BITFIELD, payload);
+PeerMessage PeerMessage::create_bitfield(const Bitfield& bitfield) {
+    return PeerMessage(MessageType::BITFIELD, bitfield.to_bytes());
 }
 
 PeerMessage PeerMessage::create_request(PieceIndex piece_index, uint32_t offset, uint32_t length) {
@@ -383,110 +417,511 @@ PeerMessage PeerMessage::create_port(uint16_t port) {
     return PeerMessage(MessageType::PORT, payload);
 }
 
+PeerMessage PeerMessage::create_extended(uint8_t extended_id, const BencodeValue& message, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> payload;
+    payload.push_back(extended_id);
+    std::vector<uint8_t> encoded = message.encode();
+    payload.insert(payload.end(), encoded.begin(), encoded.end());
+    payload.insert(payload.end(), data.begin(), data.end());
+    return PeerMessage(MessageType::EXTENDED, payload);
+}
+
+//=============================================================================
+// RequestQueueDepth Implementation
+//=============================================================================
+
+namespace {
+constexpr auto REQUEST_RATE_WINDOW = std::chrono::seconds(1);
+constexpr auto REQUEST_RTT_VALIDITY = std::chrono::seconds(10);
+}
+
+RequestQueueDepth::RequestQueueDepth()
+    : depth_(MAX_REQUESTS_PER_PEER), download_rate_(0), rtt_ms_(0),
+      rtt_updated_at_(std::chrono::steady_clock::now()), window_start_(rtt_updated_at_),
+      window_bytes_(0), window_min_latency_ms_(0) {}
+
+void RequestQueueDepth::on_block_received(size_t bytes, std::chrono::steady_clock::duration latency,
+                                          std::chrono::steady_clock::time_point now) {
+    double latency_ms = std::chrono::duration<double, std::milli>(latency).count();
+    if (window_bytes_ == 0 || latency_ms < window_min_latency_ms_) {
+        window_min_latency_ms_ = latency_ms;
+    }
+    window_bytes_ += bytes;
+    
+    if (rtt_ms_ == 0 || latency_ms < rtt_ms_) {
+        rtt_ms_ = latency_ms;
+        rtt_updated_at_ = now;
+    }
+    
+    auto elapsed = now - window_start_;
+    if (elapsed < REQUEST_RATE_WINDOW) {
+        return;
+    }
+    
+    double rate = window_bytes_ / std::chrono::duration<double>(elapsed).count();
+    download_rate_ = download_rate_ == 0 ? rate : download_rate_ * 0.75 + rate * 0.25;
+    
+    // Let the round-trip estimate rise again once the path got slower
+    if (now - rtt_updated_at_ > REQUEST_RTT_VALIDITY) {
+        rtt_ms_ = window_min_latency_ms_;
+        rtt_updated_at_ = now;
+    }
+    
+    window_start_ = now;
+    window_bytes_ = 0;
+    update_depth();
+}
+
+void RequestQueueDepth::on_pipeline_started(std::chrono::steady_clock::time_point now) {
+    // Idle time before the first request would otherwise count against the rate
+    if (window_bytes_ == 0) {
+        window_start_ = now;
+    }
+}
+
+void RequestQueueDepth::update_depth() {
+    // Twice the bandwidth-delay product, so a depth-limited rate can still grow
+    double in_flight_bytes = download_rate_ * rtt_ms_ / 1000.0 * 2.0;
+    size_t depth = static_cast<size_t>(std::ceil(in_flight_bytes / BLOCK_SIZE)) + REQUEST_QUEUE_SLACK;
+    depth_ = (std::max)(MIN_REQUEST_QUEUE_DEPTH, (std::min)(depth, MAX_REQUEST_QUEUE_DEPTH));
+}
+
+//=============================================================================
+// Choker Implementation
+//=============================================================================
+
+Choker::Choker(size_t unchoke_slots, size_t optimistic_rounds)
+    : unchoke_slots_(unchoke_slots), optimistic_rounds_((std::max)(optimistic_rounds, static_cast<size_t>(1))),
+      round_(0), optimistic_id_(0), rng_(std::random_device{}()) {
+}
+
+std::vector<uint64_t> Choker::run_round(const std::vector<Candidate>& candidates, bool seeding) {
+    ++round_;
+    
+    // Transfer rates over the last round; peers that left are forgotten
+    std::unordered_map<uint64_t, PeerStats> stats;
+    for (const auto& candidate : candidates) {
+        PeerStats peer_stats;
+        auto it = stats_.find(candidate.id);
+        if (it != stats_.end()) {
+            peer_stats = it->second;
+        }
+        peer_stats.download_rate = candidate.downloaded >= peer_stats.downloaded ? candidate.downloaded - peer_stats.downloaded : 0;
+        peer_stats.upload_rate = candidate.uploaded >= peer_stats.uploaded ? candidate.uploaded - peer_stats.uploaded : 0;
+        peer_stats.downloaded = candidate.downloaded;
+        peer_stats.uploaded = candidate.uploaded;
+        stats[candidate.id] = peer_stats;
+    }
+    stats_.swap(stats);
+    
+    std::vector<uint64_t> interested;
+    for (const auto& candidate : candidates) {
+        if (candidate.interested) {
+            interested.push_back(candidate.id);
+        }
+    }
+    
+    if (!seeding) {
+        // Reciprocate: the best sources get the slots
+        std::stable_sort(interested.begin(), interested.end(), [this](uint64_t a, uint64_t b) {
+            const PeerStats& stats_a = stats_[a];
+            const PeerStats& stats_b = stats_[b];
+            if (stats_a.download_rate != stats_b.download_rate) {
+                return stats_a.download_rate > stats_b.download_rate;
+            }
+            return stats_a.upload_rate > stats_b.upload_rate;
+        });
+    } else {
+        // Round robin: peers keep their slot for a few rounds, then those waiting longest get a turn
+        std::stable_sort(interested.begin(), interested.end(), [this](uint64_t a, uint64_t b) {
+            const PeerStats& stats_a = stats_[a];
+            const PeerStats& stats_b = stats_[b];
+            bool keep_a = stats_a.unchoked && stats_a.unchoked_rounds < SEED_UNCHOKE_ROUNDS;
+            bool keep_b = stats_b.unchoked && stats_b.unchoked_rounds < SEED_UNCHOKE_ROUNDS;
+            if (keep_a != keep_b) {
+                return keep_a;
+            }
+            if (keep_a) {
+                return stats_a.upload_rate > stats_b.upload_rate;
+            }
+            return stats_a.last_unchoked_round < stats_b.last_unchoked_round;
+        });
+    }
+    
+    std::vector<uint64_t> unchoked(interested.begin(), interested.begin() + (std::min)(unchoke_slots_, interested.size()));
+    std::unordered_set<uint64_t> regular(unchoked.begin(), unchoked.end());
+    for (auto& pair : stats_) {
+        PeerStats& peer_stats = pair.second;
+        bool is_unchoked = regular.count(pair.first) > 0;
+        if (is_unchoked) {
+            peer_stats.unchoked_rounds = peer_stats.unchoked ? peer_stats.unchoked_rounds + 1 : 1;
+            peer_stats.last_unchoked_round = round_;
+        } else {
+            peer_stats.unchoked_rounds = 0;
+        }
+        peer_stats.unchoked = is_unchoked;
+    }
+    
+    // The optimistic unchoke rotates every few rounds, or as soon as it no longer qualifies
+    bool keep_optimistic = optimistic_id_ != 0 && (round_ - 1) % optimistic_rounds_ != 0 &&
+                           regular.count(optimistic_id_) == 0 &&
+                           std::find(interested.begin(), interested.end(), optimistic_id_) != interested.end();
+    if (!keep_optimistic) {
+        optimistic_id_ = 0;
+        std::vector<uint64_t> choices;
+        for (uint64_t id : interested) {
+            if (regular.count(id) == 0) {
+                choices.push_back(id);
+            }
+        }
+        if (!choices.empty()) {
+            std::uniform_int_distribution<size_t> pick(0, choices.size() - 1);
+            optimistic_id_ = choices[pick(rng_)];
+        }
+    }
+    if (optimistic_id_ != 0) {
+        unchoked.push_back(optimistic_id_);
+    }
+    
+    return unchoked;
+}
+
 //=============================================================================
 // PeerConnection Implementation
 //=============================================================================
 
+namespace {
+constexpr size_t PEER_RECEIVE_BUFFER_SIZE = 32 * 1024;
+constexpr size_t PEER_MIN_READ_SIZE = 16 * 1024;
+constexpr size_t UPLOAD_LOW_WATERMARK = 2 * BLOCK_SIZE;  // Queued uploads are read while less is buffered
+
+uint32_t read_uint32_be(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+void write_uint32_be(uint8_t* data, uint32_t value) {
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >> 8);
+    data[3] = static_cast<uint8_t>(value);
+}
+}
+
 PeerConnection::PeerConnection(TorrentDownload* torrent, const Peer& peer_info, socket_t socket)
-    : torrent_(torrent), peer_info_(peer_info), socket_(socket), 
-      state_(PeerState::CONNECTING), should_disconnect_(false),
+    : PeerConnection(torrent, peer_info, socket, nullptr) {}
+
+PeerConnection::PeerConnection(TorrentDownload* torrent, const Peer& peer_info, std::shared_ptr<UtpSocket> utp_socket)
+    : PeerConnection(torrent, peer_info, INVALID_SOCKET_VALUE, std::move(utp_socket)) {}
+
+PeerConnection::PeerConnection(TorrentDownload* torrent, const Peer& peer_info, socket_t socket,
+                               std::shared_ptr<UtpSocket> utp_socket)
+    : torrent_(torrent), peer_info_(peer_info), socket_(socket), utp_socket_(std::move(utp_socket)),
+      utp_(utp_socket_ != nullptr), state_(PeerState::CONNECTING), state_changed_at_(std::chrono::steady_clock::now()), closed_(false),
+      receive_buffer_(PEER_RECEIVE_BUFFER_SIZE), socket_events_(0),
+      read_throttled_(false), write_throttled_(false),
       peer_choked_(true), am_choked_(true), peer_interested_(false), 
       am_interested_(false), am_choking_(true),
-      downloaded_bytes_(0), uploaded_bytes_(0), expected_message_length_(0) {
+      peer_bitfield_(torrent->get_torrent_info().get_num_pieces()),
+      peer_supports_extensions_(false), extended_handshake_sent_(false), peer_ut_metadata_id_(0),
+      downloaded_bytes_(0), uploaded_bytes_(0) {
     
     peer_id_.fill(0);
-    LOG_BT_DEBUG("Created peer connection to " << peer_info_.ip << ":" << peer_info_.port);
+    LOG_BT_DEBUG("Created " << (utp_ ? "uTP" : "TCP") << " peer connection to " << peer_info_.ip << ":" << peer_info_.port);
 }
 
 PeerConnection::~PeerConnection() {
-    disconnect();
+    // Normally a no-op: the reactor handler keeps the connection alive until it was closed
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    close_locked(PeerState::DISCONNECTED);
 }
 
 bool PeerConnection::connect() {
+    std::lock_guard<std::mutex> lock(io_mutex_);
     if (state_ != PeerState::CONNECTING) {
         return false;
     }
     
     LOG_BT_INFO("Connecting to peer " << peer_info_.ip << ":" << peer_info_.port);
     
-    if (!is_valid_socket(socket_)) {
-        socket_ = create_tcp_client(peer_info_.ip, peer_info_.port, 10000); // 10-second timeout
-        if (!is_valid_socket(socket_)) {
+    if (!has_transport()) {
+        socket_t socket = start_tcp_connect(peer_info_.ip, peer_info_.port);
+        if (!is_valid_socket(socket)) {
             LOG_BT_ERROR("Failed to create connection to " << peer_info_.ip << ":" << peer_info_.port);
-            state_ = PeerState::ERROR;
+            close_locked(PeerState::ERROR);
             return false;
         }
+        std::lock_guard<std::mutex> send_lock(send_mutex_);
+        socket_ = socket;
+    }
+    set_state(PeerState::CONNECTING);
+    
+    // The handshake waits in the send buffer until the connection is established
+    if (!send_handshake() || !register_with_reactor(IO_EVENT_WRITE)) {
+        close_locked(PeerState::ERROR);
+        return false;
     }
     
-    // Start connection thread
-    connection_thread_ = std::thread(&PeerConnection::connection_loop, this);
+    return true;
+}
+
+bool PeerConnection::accept(const PeerID& peer_id) {
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    if (state_ != PeerState::CONNECTING || !has_transport()) {
+        return false;
+    }
+    
+    peer_id_ = peer_id;
+    if ((!utp_socket_ && !set_socket_nonblocking(socket_)) || !register_with_reactor(IO_EVENT_READ)) {
+        LOG_BT_ERROR("Failed to accept connection from peer " << peer_info_.ip << ":" << peer_info_.port);
+        close_locked(PeerState::ERROR);
+        return false;
+    }
     
+    on_handshake_complete();
+    
+    // uTP reports data once when it arrives, and what followed the handshake may already be buffered
+    if (utp_socket_ && !on_readable(false)) {
+        close_locked(PeerState::DISCONNECTED);
+        return false;
+    }
     return true;
 }
 
 void PeerConnection::disconnect() {
-    should_disconnect_ = true;
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    close_locked(PeerState::DISCONNECTED);
+}
+
+void PeerConnection::on_tick() {
+    {
+        std::lock_guard<std::mutex> lock(io_mutex_);
+        PeerState state = state_;
+        if ((state == PeerState::CONNECTING || state == PeerState::HANDSHAKING) &&
+            std::chrono::steady_clock::now() - state_changed_at_ > std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS)) {
+            LOG_BT_WARN("Handshake with peer " << peer_info_.ip << ":" << peer_info_.port << " timed out");
+            close_locked(PeerState::ERROR);
+            return;
+        }
+    }
+    
+    if (is_connected()) {
+        cleanup_expired_requests();
+    }
+}
+
+void PeerConnection::on_bandwidth_tick() {
+    uint32_t resumed = 0;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (!has_transport() || (!read_throttled_ && !write_throttled_)) {
+            return;
+        }
+        
+        if (read_throttled_ && torrent_->get_download_quota(download_limiter_, 1) > 0) {
+            read_throttled_ = false;
+            resumed |= IO_EVENT_READ;
+        }
+        if (write_throttled_ && torrent_->get_upload_quota(upload_limiter_, 1) > 0) {
+            write_throttled_ = false;  // The next write event drains the send buffer
+            resumed |= IO_EVENT_WRITE;
+        }
+        update_socket_events_locked();
+        if (!utp_socket_) {
+            return;
+        }
+    }
     
-    if (is_valid_socket(socket_)) {
-        close_socket(socket_);
-        socket_ = INVALID_SOCKET_VALUE;
+    // uTP has no level-triggered readiness to re-arm; pick up where the limit stopped us
+    if (resumed != 0) {
+        on_socket_event(resumed);
     }
+}
+
+void PeerConnection::set_rate_limits(uint64_t download_rate, uint64_t upload_rate) {
+    download_limiter_.set_rate(download_rate);
+    upload_limiter_.set_rate(upload_rate);
+}
+
+bool PeerConnection::register_with_reactor(uint32_t events) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    socket_events_ = events;
     
-    if (connection_thread_.joinable()) {
-        connection_thread_.join();
+    // The handler owns a reference, so the connection outlives any event being dispatched
+    auto self = shared_from_this();
+    if (utp_socket_) {
+        // uTP sockets deliver their events themselves; close_locked() breaks the reference cycle
+        utp_socket_->set_event_handler([self](uint32_t events) { self->on_socket_event(events); });
+        return true;
     }
     
-    state_ = PeerState::DISCONNECTED;
+    IoReactor* reactor = torrent_->get_reactor();
+    if (!reactor) {
+        return false;
+    }
+    return reactor->add_socket(socket_, [self](socket_t, uint32_t events) {
+        self->on_socket_event(events);
+    }, events);
+}
+
+int PeerConnection::transport_receive(uint8_t* buffer, size_t size) {
+    return utp_socket_ ? utp_socket_->read(buffer, size) : receive_tcp_nonblocking(socket_, buffer, size);
 }
 
-void PeerConnection::connection_loop() {
-    LOG_BT_DEBUG("Starting connection loop for peer " << peer_info_.ip << ":" << peer_info_.port);
+int PeerConnection::transport_send(const uint8_t* data, size_t size) {
+    return utp_socket_ ? utp_socket_->write(data, size) : send_tcp_nonblocking(socket_, data, size);
+}
+
+void PeerConnection::on_socket_event(uint32_t events) {
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    if (!has_transport()) {
+        return;  // Closed while the event was being dispatched
+    }
     
-    // Perform handshake
-    if (!perform_handshake()) {
-        LOG_BT_ERROR("Handshake failed with peer " << peer_info_.ip << ":" << peer_info_.port);
-        state_ = PeerState::ERROR;
-        return;
+    bool ok = true;
+    if (state_ == PeerState::CONNECTING) {
+        ok = on_connect_complete();
+    } else {
+        if (events & IO_EVENT_WRITE) {
+            std::lock_guard<std::mutex> send_lock(send_mutex_);
+            ok = flush_send_buffer_locked();
+        }
+        if (ok && (events & (IO_EVENT_READ | IO_EVENT_ERROR))) {
+            ok = on_readable((events & IO_EVENT_ERROR) != 0);
+        }
     }
     
-    state_ = PeerState::CONNECTED;
-    LOG_BT_INFO("Successfully connected to peer " << peer_info_.ip << ":" << peer_info_.port);
+    if (!ok) {
+        close_locked(state_ == PeerState::CONNECTED ? PeerState::DISCONNECTED : PeerState::ERROR);
+    }
+}
+
+bool PeerConnection::on_connect_complete() {
+    if (utp_socket_) {
+        UtpSocket::State utp_state = utp_socket_->get_state();
+        if (utp_state == UtpSocket::State::SYN_SENT) {
+            return true;  // Not for us yet
+        }
+        if (utp_state != UtpSocket::State::CONNECTED) {
+            LOG_BT_WARN("Failed to connect to peer " << peer_info_.ip << ":" << peer_info_.port << " over uTP");
+            return false;
+        }
+    } else {
+        int error = get_socket_error(socket_);
+        if (error != 0) {
+            LOG_BT_WARN("Failed to connect to peer " << peer_info_.ip << ":" << peer_info_.port << " (error " << error << ")");
+            return false;
+        }
+    }
     
-    // Initialize peer bitfield
-    const auto& torrent_info = torrent_->get_torrent_info();
-    peer_bitfield_.resize(torrent_info.get_num_pieces(), false);
+    LOG_BT_DEBUG((utp_ ? "uTP" : "TCP") << " connection established with peer " << peer_info_.ip << ":" << peer_info_.port);
+    set_state(PeerState::HANDSHAKING);
     
-    // Main message processing loop
-    while (!should_disconnect_ && state_ == PeerState::CONNECTED) {
-        process_messages();
+    // Sends the queued handshake and switches the interest set over to reading
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return flush_send_buffer_locked();
+}
+
+bool PeerConnection::on_readable(bool force) {
+    // TCP readiness is level-triggered, so one read per event will do; uTP only reports
+    // new data once, so its buffer is drained
+    do {
+        // Read at least the rest of the message being received, so a large PIECE arrives in one pass
+        size_t wanted = PEER_MIN_READ_SIZE;
+        if (state_ == PeerState::CONNECTED && receive_buffer_.size() >= 4) {
+            uint8_t header[4];
+            receive_buffer_.peek(0, header, sizeof(header));
+            size_t message_size = 4 + static_cast<size_t>(read_uint32_be(header));
+            if (message_size > receive_buffer_.size() && message_size <= 4 + MAX_PEER_MESSAGE_SIZE) {
+                wanted = (std::max)(wanted, message_size - receive_buffer_.size());
+            }
+        }
         
-        // Cleanup expired requests
-        cleanup_expired_requests();
+        size_t available = 0;
+        uint8_t* space = receive_buffer_.prepare(wanted, available);
         
-        // Use conditional variable for responsive shutdown
-        {
-            std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(10), [this] { return should_disconnect_.load(); })) {
-                break;
+        // Out of download bandwidth: stop reading until on_bandwidth_tick(). An error
+        // or hang-up is still read, or the reactor would keep reporting it.
+        size_t quota = torrent_->get_download_quota(download_limiter_, available);
+        if (quota == 0) {
+            if (!force) {
+                std::lock_guard<std::mutex> lock(send_mutex_);
+                read_throttled_ = true;
+                update_socket_events_locked();
+                return true;
             }
+            quota = available;
         }
-    }
-    
-    LOG_BT_DEBUG("Connection loop ended for peer " << peer_info_.ip << ":" << peer_info_.port);
+        
+        int received = transport_receive(space, quota);
+        if (received < 0) {
+            LOG_BT_DEBUG("Peer " << peer_info_.ip << ":" << peer_info_.port << " closed the connection");
+            return false;
+        }
+        if (received == 0) {
+            return true;  // Spurious wakeup, or the uTP buffer is drained
+        }
+        torrent_->consume_download_quota(download_limiter_, static_cast<size_t>(received));
+        receive_buffer_.commit(static_cast<size_t>(received));
+        
+        bool parsed = true;
+        while (parsed) {
+            if (!parse_message(parsed)) {
+                return false;
+            }
+        }
+    } while (utp_socket_);
+    return true;
 }
 
-bool PeerConnection::perform_handshake() {
-    state_ = PeerState::HANDSHAKING;
+void PeerConnection::close_locked(PeerState state) {
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (is_valid_socket(socket_)) {
+            if (IoReactor* reactor = torrent_->get_reactor()) {
+                reactor->remove_socket(socket_);
+            }
+            close_socket(socket_);
+            socket_ = INVALID_SOCKET_VALUE;
+        }
+        if (utp_socket_) {
+            utp_socket_->set_event_handler(nullptr);
+            utp_socket_->close();
+            utp_socket_.reset();
+        }
+        send_buffer_.clear();
+        upload_requests_.clear();
+    }
     
-    if (!send_handshake()) {
-        return false;
+    if (!is_closed()) {
+        set_state(state);
+    }
+    if (closed_) {
+        return;
     }
     
-    if (!receive_handshake()) {
-        return false;
+    // Outstanding requests go back to the torrent, and the pieces of this peer are no longer available from it
+    std::vector<PeerRequest> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        cancelled.swap(pending_requests_);
+    }
+    Bitfield bitfield;
+    {
+        std::lock_guard<std::mutex> lock(bitfield_mutex_);
+        closed_ = true;  // Written under io_mutex_ and bitfield_mutex_, read under either
+        bitfield = std::move(peer_bitfield_);
+        peer_bitfield_ = Bitfield();
     }
+    torrent_->on_block_requests_cancelled(cancelled);
+    torrent_->on_peer_bitfield(bitfield, Bitfield());
     
-    return true;
+    LOG_BT_DEBUG("Closed connection to peer " << peer_info_.ip << ":" << peer_info_.port);
+}
+
+void PeerConnection::set_state(PeerState state) {
+    state_ = state;
+    state_changed_at_ = std::chrono::steady_clock::now();
 }
 
 bool PeerConnection::send_handshake() {
@@ -497,19 +932,15 @@ bool PeerConnection::send_handshake() {
     return write_data(handshake_data);
 }
 
-bool PeerConnection::receive_handshake() {
-    std::vector<uint8_t> handshake_data(68);  // Fixed handshake size
-    
-    if (!read_data(handshake_data, 68)) {
-        LOG_BT_ERROR("Failed to read handshake from peer");
-        return false;
-    }
+bool PeerConnection::receive_handshake(const uint8_t* data) {
+    std::vector<uint8_t> handshake_data(data, data + HANDSHAKE_SIZE);
     
     InfoHash received_info_hash;
     if (!parse_handshake_message(handshake_data, received_info_hash, peer_id_)) {
         LOG_BT_ERROR("Failed to parse handshake from peer");
         return false;
     }
+    peer_supports_extensions_ = handshake_supports_extensions(handshake_data);
     
     // Verify info hash matches
     const auto& expected_info_hash = torrent_->get_torrent_info().get_info_hash();
@@ -522,72 +953,70 @@ bool PeerConnection::receive_handshake() {
     return true;
 }
 
-bool PeerConnection::send_message(const PeerMessage& message) {
-    auto data = message.serialize();
-    return write_data(data);
-}
-
-void PeerConnection::process_messages() {
-    // Try to read message length first
-    if (expected_message_length_ == 0) {
-        std::vector<uint8_t> length_buffer(4);
-        if (read_data(length_buffer, 4)) {
-            expected_message_length_ = (length_buffer[0] << 24) | 
-                                     (length_buffer[1] << 16) | 
-                                     (length_buffer[2] << 8) | 
-                                     length_buffer[3];
-            
-            if (expected_message_length_ == 0) {
-                // Keep-alive message
-                expected_message_length_ = 0;
-                return;
-            }
-            
-            message_buffer_.clear();
-            message_buffer_.reserve(expected_message_length_);
-        } else {
-            return;  // No data available yet
-        }
-    }
+void PeerConnection::on_handshake_complete() {
+    set_state(PeerState::CONNECTED);
+    LOG_BT_INFO("Successfully connected to peer " << peer_info_.ip << ":" << peer_info_.port);
     
-    // Try to read the message payload
-    if (expected_message_length_ > 0 && message_buffer_.size() < expected_message_length_) {
-        size_t remaining = expected_message_length_ - message_buffer_.size();
-        std::vector<uint8_t> temp_buffer(remaining);
-        
-        if (read_data(temp_buffer, remaining)) {
-            message_buffer_.insert(message_buffer_.end(), temp_buffer.begin(), temp_buffer.end());
-        }
+    Bitfield our_bitfield = torrent_->get_piece_bitfield();
+    if (our_bitfield.any()) {
+        send_message(PeerMessage::create_bitfield(our_bitfield));
     }
     
-    // Process complete message
-    if (message_buffer_.size() >= expected_message_length_) {
-        auto message = parse_message(message_buffer_);
-        if (message) {
-            handle_message(*message);
-        }
-        
-        // Reset for next message
-        expected_message_length_ = 0;
-        message_buffer_.clear();
+    // Accepted peers get ours in reply to theirs, their handshake was not seen here
+    if (peer_supports_extensions_) {
+        send_extended_handshake();
     }
 }
 
-std::unique_ptr<PeerMessage> PeerConnection::parse_message(const std::vector<uint8_t>& data) {
-    if (data.empty()) {
-        return nullptr;
+bool PeerConnection::send_message(const PeerMessage& message) {
+    return write_data(message.serialize());
+}
+
+bool PeerConnection::parse_message(bool& parsed) {
+    parsed = false;
+    
+    if (state_ == PeerState::HANDSHAKING) {
+        if (receive_buffer_.size() < HANDSHAKE_SIZE) {
+            return true;
+        }
+        if (!receive_handshake(receive_buffer_.linearize(HANDSHAKE_SIZE))) {
+            return false;
+        }
+        receive_buffer_.consume(HANDSHAKE_SIZE);
+        on_handshake_complete();
+        parsed = true;
+        return true;
+    }
+    
+    if (state_ != PeerState::CONNECTED || receive_buffer_.size() < 4) {
+        return true;
     }
     
-    MessageType type = static_cast<MessageType>(data[0]);
-    std::vector<uint8_t> payload(data.begin() + 1, data.end());
+    uint8_t header[4];
+    receive_buffer_.peek(0, header, sizeof(header));
+    uint32_t length = read_uint32_be(header);
+    if (length > MAX_PEER_MESSAGE_SIZE) {
+        LOG_BT_WARN("Message of " << length << " bytes from peer " << peer_info_.ip << ":" << peer_info_.port << " exceeds the limit");
+        return false;
+    }
+    if (receive_buffer_.size() < 4 + static_cast<size_t>(length)) {
+        return true;  // Wait for the rest of the message
+    }
     
-    return std::make_unique<PeerMessage>(type, payload);
+    // A zero length message is a keep-alive
+    if (length > 0) {
+        const uint8_t* message = receive_buffer_.linearize(4 + static_cast<size_t>(length)) + 4;
+        handle_message(static_cast<MessageType>(message[0]), message + 1, length - 1);
+    }
+    receive_buffer_.consume(4 + static_cast<size_t>(length));
+    parsed = true;
+    return true;
 }
 
-void PeerConnection::handle_message(const PeerMessage& message) {
-    LOG_BT_DEBUG("Received message type " << static_cast<int>(message.type) << " from peer " << peer_info_.ip << ":" << peer_info_.port);
+void PeerConnection::handle_message(MessageType type, const uint8_t* payload, size_t size) {
+    LOG_BT_DEBUG("Received message type " << static_cast<int>(type) << " from peer " << peer_info_.ip << ":" << peer_info_.port);
     
-    switch (message.type) {
+    switch (type) {
         case MessageType::CHOKE:
             handle_choke();
             break;
@@ -601,22 +1030,25 @@ void PeerConnection::handle_message(const PeerMessage& message) {
             handle_not_interested();
             break;
         case MessageType::HAVE:
-            handle_have(message.payload);
+            handle_have(payload, size);
             break;
         case MessageType::BITFIELD:
-            handle_bitfield(message.payload);
+            handle_bitfield(payload, size);
             break;
         case MessageType::REQUEST:
-            handle_request(message.payload);
+            handle_request(payload, size);
             break;
         case MessageType::PIECE:
-            handle_piece(message.payload);
+            handle_piece(payload, size);
             break;
         case MessageType::CANCEL:
-            handle_cancel(message.payload);
+            handle_cancel(payload, size);
+            break;
+        case MessageType::EXTENDED:
+            handle_extended(payload, size);
             break;
         default:
-            LOG_BT_WARN("Unknown message type: " << static_cast<int>(message.type));
+            LOG_BT_WARN("Unknown message type: " << static_cast<int>(type));
             break;
     }
 }
@@ -642,209 +1074,425 @@ void PeerConnection::handle_not_interested() {
     LOG_BT_DEBUG("Peer " << peer_info_.ip << ":" << peer_info_.port << " is not interested");
 }
 
-void PeerConnection::handle_have(const std::vector<uint8_t>& payload) {
-    if (payload.size() != 4) {
-        LOG_BT_WARN("Invalid HAVE message size: " << payload.size());
+void PeerConnection::handle_have(const uint8_t* payload, size_t size) {
+    if (size != 4) {
+        LOG_BT_WARN("Invalid HAVE message size: " << size);
         return;
     }
     
-    PieceIndex piece_index = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
-    
-    if (piece_index < peer_bitfield_.size()) {
-        peer_bitfield_[piece_index] = true;
-        LOG_BT_DEBUG("Peer " << peer_info_.ip << ":" << peer_info_.port << " has piece " << piece_index);
+    PieceIndex piece_index = read_uint32_be(payload);
+    {
+        std::lock_guard<std::mutex> lock(bitfield_mutex_);
+        if (piece_index >= peer_bitfield_.size() || peer_bitfield_.get(piece_index)) {
+            return;
+        }
+        peer_bitfield_.set(piece_index);
     }
+    
+    torrent_->on_peer_have(piece_index);
+    LOG_BT_DEBUG("Peer " << peer_info_.ip << ":" << peer_info_.port << " has piece " << piece_index);
 }
 
-void PeerConnection::handle_bitfield(const std::vector<uint8_t>& payload) {
+void PeerConnection::handle_bitfield(const uint8_t* payload, size_t size) {
     const auto& torrent_info = torrent_->get_torrent_info();
     uint32_t num_pieces = torrent_info.get_num_pieces();
     
-    peer_bitfield_.clear();
-    peer_bitfield_.resize(num_pieces, false);
-    
-    for (uint32_t i = 0; i < num_pieces && i / 8 < payload.size(); ++i) {
-        size_t byte_index = i / 8;
-        size_t bit_index = 7 - (i % 8);
-        peer_bitfield_[i] = (payload[byte_index] & (1 << bit_index)) != 0;
-    }
-    
+    update_bitfield(Bitfield::from_bytes(payload, size, num_pieces));
     LOG_BT_DEBUG("Received bitfield from peer " << peer_info_.ip << ":" << peer_info_.port);
 }
 
-void PeerConnection::handle_request(const std::vector<uint8_t>& payload) {
-    if (payload.size() != 12) {
-        LOG_BT_WARN("Invalid REQUEST message size: " << payload.size());
+void PeerConnection::handle_request(const uint8_t* payload, size_t size) {
+    if (size != 12) {
+        LOG_BT_WARN("Invalid REQUEST message size: " << size);
         return;
     }
     
-    PieceIndex piece_index = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
-    uint32_t offset = (payload[4] << 24) | (payload[5] << 16) | (payload[6] << 8) | payload[7];
-    uint32_t length = (payload[8] << 24) | (payload[9] << 16) | (payload[10] << 8) | payload[11];
+    PieceIndex piece_index = read_uint32_be(payload);
+    uint32_t offset = read_uint32_be(payload + 4);
+    uint32_t length = read_uint32_be(payload + 8);
     
     LOG_BT_DEBUG("Peer " << peer_info_.ip << ":" << peer_info_.port << " requested piece " << piece_index << " offset " << offset << " length " << length);
     
-    // TODO: Handle piece requests (seeding functionality)
-    // For now, we're just downloading, not seeding
+    // Requests while choked are dropped, the peer has to ask again once unchoked
+    const auto& torrent_info = torrent_->get_torrent_info();
+    if (am_choking_ || piece_index >= torrent_info.get_num_pieces() || length == 0 || length > BLOCK_SIZE ||
+        static_cast<uint64_t>(offset) + length > torrent_info.get_piece_length(piece_index) ||
+        !torrent_->is_piece_complete(piece_index)) {
+        LOG_BT_DEBUG("Ignoring request for piece " << piece_index << " from peer " << peer_info_.ip << ":" << peer_info_.port);
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (upload_requests_.size() >= MAX_UPLOAD_REQUESTS) {
+        LOG_BT_WARN("Too many queued requests from peer " << peer_info_.ip << ":" << peer_info_.port);
+        return;
+    }
+    upload_requests_.emplace_back(piece_index, offset, length);
+    flush_send_buffer_locked();
 }
 
-void PeerConnection::handle_piece(const std::vector<uint8_t>& payload) {
-    if (payload.size() < 8) {
-        LOG_BT_WARN("Invalid PIECE message size: " << payload.size());
+void PeerConnection::handle_piece(const uint8_t* payload, size_t size) {
+    if (size < 8) {
+        LOG_BT_WARN("Invalid PIECE message size: " << size);
         return;
     }
     
-    PieceIndex piece_index = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
-    uint32_t offset = (payload[4] << 24) | (payload[5] << 16) | (payload[6] << 8) | payload[7];
+    PieceIndex piece_index = read_uint32_be(payload);
+    uint32_t offset = read_uint32_be(payload + 4);
     
-    std::vector<uint8_t> block_data(payload.begin() + 8, payload.end());
-    downloaded_bytes_ += block_data.size();
+    const uint8_t* block_data = payload + 8;
+    size_t block_size = size - 8;
+    downloaded_bytes_ += block_size;
     
-    LOG_BT_DEBUG("Received piece " << piece_index << " offset " << offset << " length " << block_data.size() << " from peer " << peer_info_.ip << ":" << peer_info_.port);
+    LOG_BT_DEBUG("Received piece " << piece_index << " offset " << offset << " length " << block_size << " from peer " << peer_info_.ip << ":" << peer_info_.port);
     
-    // Store the piece block
-    if (torrent_->store_piece_block(piece_index, offset, block_data)) {
-        // Remove corresponding request
+    // Remove the corresponding request and feed its latency to the queue depth estimate
+    {
         std::lock_guard<std::mutex> lock(requests_mutex_);
-        pending_requests_.erase(
-            std::remove_if(pending_requests_.begin(), pending_requests_.end(),
-                [piece_index, offset](const PeerRequest& req) {
-                    return req.piece_index == piece_index && req.offset == offset;
-                }),
-            pending_requests_.end());
+        auto request = std::find_if(pending_requests_.begin(), pending_requests_.end(),
+            [piece_index, offset](const PeerRequest& req) {
+                return req.piece_index == piece_index && req.offset == offset;
+            });
+        if (request != pending_requests_.end()) {
+            request_queue_.on_block_received(block_size, std::chrono::steady_clock::now() - request->requested_at);
+            pending_requests_.erase(request);
+        }
     }
+    
+    // Stored straight from the receive buffer; the storage cache keeps it in a pooled block buffer
+    torrent_->store_piece_block(piece_index, offset, block_data, block_size);
 }
 
-void PeerConnection::handle_cancel(const std::vector<uint8_t>& payload) {
-    if (payload.size() != 12) {
-        LOG_BT_WARN("Invalid CANCEL message size: " << payload.size());
+void PeerConnection::handle_cancel(const uint8_t* payload, size_t size) {
+    if (size != 12) {
+        LOG_BT_WARN("Invalid CANCEL message size: " << size);
         return;
     }
     
-    PieceIndex piece_index = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
-    uint32_t offset = (payload[4] << 24) | (payload[5] << 16) | (payload[6] << 8) | payload[7];
-    uint32_t length = (payload[8] << 24) | (payload[9] << 16) | (payload[10] << 8) | payload[11];
+    PieceIndex piece_index = read_uint32_be(payload);
+    uint32_t offset = read_uint32_be(payload + 4);
+    uint32_t length = read_uint32_be(payload + 8);
     
     LOG_BT_DEBUG("Peer " << peer_info_.ip << ":" << peer_info_.port << " cancelled request for piece " << piece_index << " offset " << offset << " length " << length);
     
-    // TODO: Handle cancel requests (seeding functionality)
+    // Only blocks not yet read into the send buffer can still be dropped
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    upload_requests_.erase(
+        std::remove_if(upload_requests_.begin(), upload_requests_.end(),
+            [piece_index, offset, length](const PeerRequest& req) {
+                return req.piece_index == piece_index && req.offset == offset && req.length == length;
+            }),
+        upload_requests_.end());
 }
 
-bool PeerConnection::request_piece_block(PieceIndex piece_index, uint32_t offset, uint32_t length) {
-    if (peer_choked_ || state_ != PeerState::CONNECTED) {
-        return false;
+void PeerConnection::handle_extended(const uint8_t* payload, size_t size) {
+    if (size < 2) {
+        LOG_BT_WARN("Invalid EXTENDED message size: " << size);
+        return;
     }
     
-    std::lock_guard<std::mutex> lock(requests_mutex_);
+    BencodeValue message;
+    try {
+        size_t consumed = 0;
+        message = BencodeDecoder::decode(payload + 1, size - 1, consumed);
+    } catch (const std::exception& e) {
+        LOG_BT_WARN("Invalid extended message from peer " << peer_info_.ip << ":" << peer_info_.port << ": " << e.what());
+        return;
+    }
+    if (!message.is_dict()) {
+        return;
+    }
     
-    if (pending_requests_.size() >= MAX_REQUESTS_PER_PEER) {
-        return false;  // Too many pending requests
+    if (payload[0] == EXTENDED_HANDSHAKE_ID) {
+        peer_ut_metadata_id_ = 0;
+        if (message.has_key("m") && message["m"].is_dict() && message["m"].has_key("ut_metadata") &&
+            message["m"]["ut_metadata"].is_integer()) {
+            int64_t id = message["m"]["ut_metadata"].as_integer();
+            peer_ut_metadata_id_ = (id > 0 && id <= 255) ? static_cast<uint8_t>(id) : 0;
+        }
+        LOG_BT_DEBUG("Extended handshake from peer " << peer_info_.ip << ":" << peer_info_.port
+                     << (peer_ut_metadata_id_ ? " with" : " without") << " ut_metadata");
+        if (!extended_handshake_sent_) {
+            send_extended_handshake();
+        }
+    } else if (payload[0] == UT_METADATA_ID) {
+        handle_metadata_request(message);
+    }
+}
+
+void PeerConnection::handle_metadata_request(const BencodeValue& message) {
+    // We have the metadata already, so only requests matter
+    if (peer_ut_metadata_id_ == 0 || !message.has_key("msg_type") || !message["msg_type"].is_integer() ||
+        message["msg_type"].as_integer() != 0 || !message.has_key("piece") || !message["piece"].is_integer()) {
+        return;
     }
     
-    auto request_msg = PeerMessage::create_request(piece_index, offset, length);
-    if (send_message(request_msg)) {
-        pending_requests_.emplace_back(piece_index, offset, length);
-        LOG_BT_DEBUG("Requested piece " << piece_index << " offset " << offset << " length " << length << " from peer " << peer_info_.ip << ":" << peer_info_.port);
-        return true;
+    const auto& metadata = torrent_->get_torrent_info().get_metadata();
+    int64_t piece = message["piece"].as_integer();
+    
+    auto reply = BencodeValue::create_dict();
+    reply["piece"] = BencodeValue(piece);
+    if (piece < 0 || static_cast<uint64_t>(piece) * METADATA_PIECE_SIZE >= metadata.size()) {
+        reply["msg_type"] = BencodeValue(static_cast<int64_t>(2));  // Reject
+        send_message(PeerMessage::create_extended(peer_ut_metadata_id_, reply));
+        return;
     }
     
-    return false;
+    size_t offset = static_cast<size_t>(piece) * METADATA_PIECE_SIZE;
+    size_t length = (std::min)(METADATA_PIECE_SIZE, metadata.size() - offset);
+    reply["msg_type"] = BencodeValue(static_cast<int64_t>(1));
+    reply["total_size"] = BencodeValue(static_cast<int64_t>(metadata.size()));
+    std::vector<uint8_t> data(metadata.begin() + offset, metadata.begin() + offset + length);
+    send_message(PeerMessage::create_extended(peer_ut_metadata_id_, reply, data));
+    
+    LOG_BT_DEBUG("Sent metadata piece " << piece << " to peer " << peer_info_.ip << ":" << peer_info_.port);
+}
+
+void PeerConnection::send_extended_handshake() {
+    auto extensions = BencodeValue::create_dict();
+    extensions["ut_metadata"] = BencodeValue(static_cast<int64_t>(UT_METADATA_ID));
+    
+    auto handshake = BencodeValue::create_dict();
+    handshake["m"] = extensions;
+    handshake["v"] = BencodeValue(std::string("librats"));
+    const auto& metadata = torrent_->get_torrent_info().get_metadata();
+    if (!metadata.empty()) {
+        handshake["metadata_size"] = BencodeValue(static_cast<int64_t>(metadata.size()));
+    }
+    
+    extended_handshake_sent_ = true;
+    send_message(PeerMessage::create_extended(EXTENDED_HANDSHAKE_ID, handshake));
+}
+
+bool PeerConnection::request_piece_block(PieceIndex piece_index, uint32_t offset, uint32_t length) {
+    if (peer_choked_ || state_ != PeerState::CONNECTED) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    
+    if (pending_requests_.size() >= request_queue_.get_depth()) {
+        return false;  // Request queue is full
+    }
+    
+    auto request_msg = PeerMessage::create_request(piece_index, offset, length);
+    if (send_message(request_msg)) {
+        if (pending_requests_.empty()) {
+            request_queue_.on_pipeline_started();
+        }
+        pending_requests_.emplace_back(piece_index, offset, length);
+        LOG_BT_DEBUG("Requested piece " << piece_index << " offset " << offset << " length " << length << " from peer " << peer_info_.ip << ":" << peer_info_.port);
+        return true;
+    }
+    
+    return false;
 }
 
 void PeerConnection::cancel_request(PieceIndex piece_index, uint32_t offset, uint32_t length) {
     auto cancel_msg = PeerMessage::create_cancel(piece_index, offset, length);
     send_message(cancel_msg);
     
-    std::lock_guard<std::mutex> lock(requests_mutex_);
-    pending_requests_.erase(
-        std::remove_if(pending_requests_.begin(), pending_requests_.end(),
+    std::vector<PeerRequest> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        auto first = std::stable_partition(pending_requests_.begin(), pending_requests_.end(),
             [piece_index, offset, length](const PeerRequest& req) {
-                return req.piece_index == piece_index && req.offset == offset && req.length == length;
-            }),
-        pending_requests_.end());
+                return !(req.piece_index == piece_index && req.offset == offset && req.length == length);
+            });
+        cancelled.assign(first, pending_requests_.end());
+        pending_requests_.erase(first, pending_requests_.end());
+    }
+    torrent_->on_block_requests_cancelled(cancelled);
 }
 
 void PeerConnection::cancel_all_requests() {
-    std::lock_guard<std::mutex> lock(requests_mutex_);
-    
-    for (const auto& request : pending_requests_) {
-        auto cancel_msg = PeerMessage::create_cancel(request.piece_index, request.offset, request.length);
-        send_message(cancel_msg);
+    std::vector<PeerRequest> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        
+        for (const auto& request : pending_requests_) {
+            auto cancel_msg = PeerMessage::create_cancel(request.piece_index, request.offset, request.length);
+            send_message(cancel_msg);
+        }
+        
+        cancelled.swap(pending_requests_);
     }
-    
-    pending_requests_.clear();
+    torrent_->on_block_requests_cancelled(cancelled);
+}
+
+bool PeerConnection::has_pending_request(PieceIndex piece_index, uint32_t offset) {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    return std::any_of(pending_requests_.begin(), pending_requests_.end(),
+        [piece_index, offset](const PeerRequest& req) {
+            return req.piece_index == piece_index && req.offset == offset;
+        });
 }
 
 void PeerConnection::set_interested(bool interested) {
-    if (am_interested_ != interested) {
-        am_interested_ = interested;
+    if (am_interested_.exchange(interested) != interested) {
         auto msg = interested ? PeerMessage::create_interested() : PeerMessage::create_not_interested();
         send_message(msg);
     }
 }
 
 void PeerConnection::set_choke(bool choke) {
-    if (am_choking_ != choke) {
-        am_choking_ = choke;
+    if (am_choking_.exchange(choke) != choke) {
+        if (choke) {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            upload_requests_.clear();  // Choking discards the peer's outstanding requests
+        }
         auto msg = choke ? PeerMessage::create_choke() : PeerMessage::create_unchoke();
         send_message(msg);
     }
 }
 
 bool PeerConnection::has_piece(PieceIndex piece_index) const {
-    return piece_index < peer_bitfield_.size() && peer_bitfield_[piece_index];
+    std::lock_guard<std::mutex> lock(bitfield_mutex_);
+    return peer_bitfield_.get(piece_index);
+}
+
+Bitfield PeerConnection::get_bitfield() const {
+    std::lock_guard<std::mutex> lock(bitfield_mutex_);
+    return peer_bitfield_;
 }
 
-void PeerConnection::update_bitfield(const std::vector<bool>& bitfield) {
-    peer_bitfield_ = bitfield;
+void PeerConnection::update_bitfield(const Bitfield& bitfield) {
+    Bitfield old_bitfield;
+    {
+        std::lock_guard<std::mutex> lock(bitfield_mutex_);
+        if (closed_) {
+            return;
+        }
+        old_bitfield = std::move(peer_bitfield_);
+        peer_bitfield_ = bitfield;
+    }
+    torrent_->on_peer_bitfield(old_bitfield, bitfield);
 }
 
 void PeerConnection::cleanup_expired_requests() {
-    std::lock_guard<std::mutex> lock(requests_mutex_);
+    std::vector<PeerRequest> expired;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        
+        auto now = std::chrono::steady_clock::now();
+        auto timeout = std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+        
+        auto first = std::stable_partition(pending_requests_.begin(), pending_requests_.end(),
+            [now, timeout](const PeerRequest& req) {
+                return now - req.requested_at <= timeout;
+            });
+        if (first == pending_requests_.end()) {
+            return;
+        }
+        expired.assign(first, pending_requests_.end());
+        pending_requests_.erase(first, pending_requests_.end());
+    }
     
-    auto now = std::chrono::steady_clock::now();
-    auto timeout = std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+    // Let other peers pick up the blocks this one did not deliver
+    torrent_->on_block_requests_cancelled(expired);
+}
+
+bool PeerConnection::write_data(const std::vector<uint8_t>& data) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!has_transport()) {
+        return false;
+    }
     
-    pending_requests_.erase(
-        std::remove_if(pending_requests_.begin(), pending_requests_.end(),
-            [now, timeout](const PeerRequest& req) {
-                return now - req.requested_at > timeout;
-            }),
-        pending_requests_.end());
+    send_buffer_.append(data.data(), data.size());
+    return flush_send_buffer_locked();
 }
 
-bool PeerConnection::read_data(std::vector<uint8_t>& buffer, size_t length) {
-    if (!is_valid_socket(socket_)) {
+bool PeerConnection::flush_send_buffer_locked() {
+    if (!has_transport()) {
         return false;
     }
+    if (state_ == PeerState::CONNECTING) {
+        return true;  // Sent once the connection is established
+    }
     
-    // Use existing network utilities
-    std::string data = receive_tcp_string(socket_);
-    if (data.length() >= length) {
-        std::copy(data.begin(), data.begin() + length, buffer.begin());
-        return true;
+    fill_send_buffer_locked();
+    while (!send_buffer_.empty()) {
+        size_t available = 0;
+        const uint8_t* data = send_buffer_.front(available);
+        size_t quota = torrent_->get_upload_quota(upload_limiter_, available);
+        if (quota == 0) {
+            write_throttled_ = true;  // Resumed by on_bandwidth_tick()
+            break;
+        }
+        int sent = transport_send(data, quota);
+        if (sent < 0) {
+            return false;
+        }
+        if (sent == 0) {
+            break;  // Socket buffer full, the reactor (or uTP) reports when it drains
+        }
+        torrent_->consume_upload_quota(upload_limiter_, static_cast<size_t>(sent));
+        send_buffer_.consume(static_cast<size_t>(sent));
+        fill_send_buffer_locked();
     }
     
-    return false;
+    update_socket_events_locked();
+    return true;
 }
 
-bool PeerConnection::write_data(const std::vector<uint8_t>& data) {
-    if (!is_valid_socket(socket_)) {
-        return false;
+void PeerConnection::fill_send_buffer_locked() {
+    // PIECE messages are built in the send buffer, the block read straight behind the header
+    while (!upload_requests_.empty() && send_buffer_.size() < UPLOAD_LOW_WATERMARK) {
+        PeerRequest request = upload_requests_.front();
+        upload_requests_.pop_front();
+        
+        const size_t header_size = 13;
+        size_t available = 0;
+        uint8_t* space = send_buffer_.prepare(header_size + request.length, available);
+        if (!torrent_->read_block_for_upload(request.piece_index, request.offset, space + header_size, request.length)) {
+            LOG_BT_WARN("Failed to read piece " << request.piece_index << " offset " << request.offset << " for upload");
+            continue;
+        }
+        write_uint32_be(space, static_cast<uint32_t>(9 + request.length));
+        space[4] = static_cast<uint8_t>(MessageType::PIECE);
+        write_uint32_be(space + 5, request.piece_index);
+        write_uint32_be(space + 9, request.offset);
+        send_buffer_.commit(header_size + request.length);
+        uploaded_bytes_ += request.length;
+    }
+}
+
+void PeerConnection::update_socket_events_locked() {
+    if (state_ == PeerState::CONNECTING || utp_socket_) {
+        return;  // Only write readiness matters until the connection is established; uTP has no interest set
     }
     
-    std::string data_str(data.begin(), data.end());
-    int sent = send_tcp_string(socket_, data_str);
-    return sent > 0;
+    // Ask for write readiness only while something is left to send and the rate limit allows it
+    uint32_t events = (read_throttled_ ? 0 : IO_EVENT_READ) |
+                      (send_buffer_.empty() || write_throttled_ ? 0 : IO_EVENT_WRITE);
+    if (events != socket_events_) {
+        IoReactor* reactor = torrent_->get_reactor();
+        if (reactor && reactor->set_socket_events(socket_, events)) {
+            socket_events_ = events;
+        }
+    }
 }
 
 //=============================================================================
 // TorrentDownload Implementation
 //=============================================================================
 
-TorrentDownload::TorrentDownload(const TorrentInfo& torrent_info, const std::string& download_path)
+TorrentDownload::TorrentDownload(const TorrentInfo& torrent_info, const std::string& download_path,
+                                 std::shared_ptr<BlockCacheBudget> cache_budget,
+                                 std::shared_ptr<PieceHashPool> hash_pool,
+                                 std::shared_ptr<IoReactor> reactor)
     : torrent_info_(torrent_info), download_path_(download_path), 
-      running_(false), paused_(false), total_downloaded_(0), total_uploaded_(0) {
+      running_(false), paused_(false), checking_(false),
+      reactor_(reactor ? std::move(reactor) : std::make_shared<IoReactor>("bittorrent", 1)),
+      picker_(torrent_info.get_num_pieces()), peer_download_limit_(0), peer_upload_limit_(0),
+      hash_pool_(std::move(hash_pool)), pending_hash_jobs_(0),
+      recheck_on_start_(false), total_downloaded_(0), total_uploaded_(0) {
+    
+    if (!cache_budget) {
+        cache_budget = std::make_shared<BlockCacheBudget>(DEFAULT_DISK_CACHE_SIZE);
+    }
+    storage_ = std::make_unique<DiskTorrentStorage>(download_path_, torrent_info_.get_files(),
+                                                    torrent_info_.get_piece_length(), std::move(cache_budget));
     
     // Initialize pieces
     uint32_t num_pieces = torrent_info_.get_num_pieces();
@@ -866,6 +1514,16 @@ TorrentDownload::TorrentDownload(const TorrentInfo& torrent_info, const std::str
 
 TorrentDownload::~TorrentDownload() {
     stop();
+    disconnect_all_peers();  // Peers added without start()
+    wait_for_verification();
+}
+
+void TorrentDownload::set_storage(std::unique_ptr<TorrentStorage> storage) {
+    if (running_) {
+        LOG_BT_ERROR("Cannot replace the storage of a running torrent: " << torrent_info_.get_name());
+        return;
+    }
+    storage_ = std::move(storage);
 }
 
 bool TorrentDownload::start() {
@@ -881,15 +1539,30 @@ bool TorrentDownload::start() {
         return false;
     }
     
+    // Data left by an earlier run survives open_files(), fresh files are created empty
+    bool existing_files = has_existing_files();
+    
     // Open files
     if (!open_files()) {
         LOG_BT_ERROR("Failed to open files");
         return false;
     }
     
+    // Without valid resume data, whatever is on disk has to be hashed before downloading
+    recheck_on_start_ = !load_resume_data() && existing_files;
+    checking_ = recheck_on_start_;
+    last_resume_save_ = std::chrono::steady_clock::now();
+    
     running_ = true;
     paused_ = false;
     
+    if (!reactor_->start()) {
+        LOG_BT_ERROR("Failed to start the I/O reactor");
+        running_ = false;
+        close_files();
+        return false;
+    }
+    
     // Start download threads
     download_thread_ = std::thread(&TorrentDownload::download_loop, this);
     peer_management_thread_ = std::thread(&TorrentDownload::peer_management_loop, this);
@@ -908,13 +1581,7 @@ void TorrentDownload::stop() {
     running_ = false;
     
     // Stop all peer connections
-    {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
-        for (auto& peer : peer_connections_) {
-            peer->disconnect();
-        }
-        peer_connections_.clear();
-    }
+    disconnect_all_peers();
     
     // Wait for threads to finish
     if (download_thread_.joinable()) {
@@ -924,9 +1591,18 @@ void TorrentDownload::stop() {
         peer_management_thread_.join();
     }
     
+    // Let queued verifications finish before the storage is closed
+    wait_for_verification();
+    
     // Close files
     close_files();
     
+    // Files are final now, so their mtimes match the resume data. An interrupted
+    // recheck saves nothing and runs again on the next start.
+    if (!checking_) {
+        save_resume_data();
+    }
+    
     LOG_BT_INFO("Torrent download stopped: " << torrent_info_.get_name());
 }
 
@@ -942,50 +1618,113 @@ void TorrentDownload::resume() {
 
 bool TorrentDownload::is_complete() const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
-    return std::all_of(piece_completed_.begin(), piece_completed_.end(), [](bool completed) { return completed; });
+    return piece_completed_.all();
 }
 
 bool TorrentDownload::add_peer(const Peer& peer) {
     std::lock_guard<std::mutex> lock(peers_mutex_);
+    if (!can_add_peer_locked(peer)) {
+        return false;
+    }
+    return add_connection_locked(std::make_shared<PeerConnection>(this, peer), nullptr);
+}
+
+bool TorrentDownload::add_incoming_peer(socket_t socket, const Peer& peer, const PeerID& peer_id) {
+    std::lock_guard<std::mutex> lock(peers_mutex_);
     
-    // Check if peer already exists
+    // The connection owns the socket from here on and closes it if it is not kept
+    auto peer_conn = std::make_shared<PeerConnection>(this, peer, socket);
+    if (!can_add_peer_locked(peer)) {
+        return false;
+    }
+    return add_connection_locked(std::move(peer_conn), &peer_id);
+}
+
+void TorrentDownload::set_utp_manager(std::shared_ptr<UtpManager> utp_manager) {
+    std::lock_guard<std::mutex> lock(peers_mutex_);
+    utp_manager_ = std::move(utp_manager);
+}
+
+bool TorrentDownload::add_utp_peer(const Peer& peer) {
+    std::lock_guard<std::mutex> lock(peers_mutex_);
+    if (!can_add_peer_locked(peer)) {
+        return false;
+    }
+    
+    if (!utp_manager_) {
+        auto utp_manager = std::make_shared<UtpManager>(reactor_);
+        if (!reactor_->start() || !utp_manager->start(0)) {
+            LOG_BT_ERROR("Failed to start uTP for torrent " << torrent_info_.get_name());
+            return false;
+        }
+        utp_manager_ = std::move(utp_manager);
+    }
+    
+    auto utp_socket = utp_manager_->connect(peer.ip, peer.port);
+    if (!utp_socket) {
+        LOG_BT_ERROR("Failed to create uTP connection to " << peer.ip << ":" << peer.port);
+        return false;
+    }
+    return add_connection_locked(std::make_shared<PeerConnection>(this, peer, utp_socket), nullptr);
+}
+
+bool TorrentDownload::add_incoming_utp_peer(std::shared_ptr<UtpSocket> utp_socket, const Peer& peer, const PeerID& peer_id) {
+    std::lock_guard<std::mutex> lock(peers_mutex_);
+    auto peer_conn = std::make_shared<PeerConnection>(this, peer, std::move(utp_socket));
+    if (!can_add_peer_locked(peer)) {
+        return false;
+    }
+    return add_connection_locked(std::move(peer_conn), &peer_id);
+}
+
+bool TorrentDownload::can_add_peer_locked(const Peer& peer) const {
     for (const auto& conn : peer_connections_) {
         if (conn->get_peer_info().ip == peer.ip && conn->get_peer_info().port == peer.port) {
             return false;  // Peer already exists
         }
     }
     
-    // Check peer limit
     if (peer_connections_.size() >= MAX_PEERS_PER_TORRENT) {
         LOG_BT_DEBUG("Peer limit reached for torrent " << torrent_info_.get_name());
         return false;
     }
+    return true;
+}
+
+bool TorrentDownload::add_connection_locked(std::shared_ptr<PeerConnection> peer_conn, const PeerID* incoming_peer_id) {
+    // connect() only starts an outgoing connection, the reactor completes it
+    peer_conn->set_rate_limits(peer_download_limit_, peer_upload_limit_);
+    if (!reactor_->start()) {
+        return false;
+    }
+    if (incoming_peer_id ? !peer_conn->accept(*incoming_peer_id) : !peer_conn->connect()) {
+        return false;
+    }
     
-    // Create new peer connection
-    auto peer_conn = std::make_unique<PeerConnection>(this, peer);
-    if (peer_conn->connect()) {
-        peer_connections_.push_back(std::move(peer_conn));
-        
-        if (peer_connected_callback_) {
-            peer_connected_callback_(peer);
-        }
-        
-        LOG_BT_INFO("Added peer " << peer.ip << ":" << peer.port << " to torrent " << torrent_info_.get_name());
-        return true;
+    Peer peer = peer_conn->get_peer_info();
+    bool utp = peer_conn->is_utp();
+    peer_connections_.push_back(std::move(peer_conn));
+    
+    if (peer_connected_callback_) {
+        peer_connected_callback_(peer);
     }
     
-    return false;
+    LOG_BT_INFO((incoming_peer_id ? "Accepted " : "Added ") << (utp ? "uTP " : "") << "peer " << peer.ip << ":" << peer.port
+                << (incoming_peer_id ? " for" : " to") << " torrent " << torrent_info_.get_name());
+    return true;
 }
 
 void TorrentDownload::remove_peer(const Peer& peer) {
     std::lock_guard<std::mutex> lock(peers_mutex_);
     
-    peer_connections_.erase(
-        std::remove_if(peer_connections_.begin(), peer_connections_.end(),
-            [&peer](const std::unique_ptr<PeerConnection>& conn) {
-                return conn->get_peer_info().ip == peer.ip && conn->get_peer_info().port == peer.port;
-            }),
-        peer_connections_.end());
+    auto first = std::remove_if(peer_connections_.begin(), peer_connections_.end(),
+        [&peer](const std::shared_ptr<PeerConnection>& conn) {
+            return conn->get_peer_info().ip == peer.ip && conn->get_peer_info().port == peer.port;
+        });
+    for (auto it = first; it != peer_connections_.end(); ++it) {
+        (*it)->disconnect();
+    }
+    peer_connections_.erase(first, peer_connections_.end());
     
     if (peer_disconnected_callback_) {
         peer_disconnected_callback_(peer);
@@ -1014,16 +1753,72 @@ std::vector<Peer> TorrentDownload::get_connected_peers() const {
 
 bool TorrentDownload::is_piece_complete(PieceIndex piece_index) const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
-    return piece_index < piece_completed_.size() && piece_completed_[piece_index];
+    return piece_completed_.get(piece_index);
 }
 
 bool TorrentDownload::is_piece_downloading(PieceIndex piece_index) const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
-    return piece_index < piece_downloading_.size() && piece_downloading_[piece_index];
+    return piece_downloading_.get(piece_index);
 }
 
-bool TorrentDownload::store_piece_block(PieceIndex piece_index, uint32_t offset, const std::vector<uint8_t>& data) {
-    std::lock_guard<std::mutex> lock(pieces_mutex_);
+void TorrentDownload::set_global_rate_limiters(std::shared_ptr<TokenBucket> download, std::shared_ptr<TokenBucket> upload) {
+    if (running_) {
+        LOG_BT_ERROR("Cannot replace the rate limiters of a running torrent: " << torrent_info_.get_name());
+        return;
+    }
+    global_download_limiter_ = std::move(download);
+    global_upload_limiter_ = std::move(upload);
+}
+
+void TorrentDownload::set_peer_rate_limits(uint64_t download_rate, uint64_t upload_rate) {
+    peer_download_limit_ = download_rate;
+    peer_upload_limit_ = upload_rate;
+    
+    std::lock_guard<std::mutex> lock(peers_mutex_);
+    for (auto& peer : peer_connections_) {
+        peer->set_rate_limits(download_rate, upload_rate);
+    }
+}
+
+size_t TorrentDownload::get_download_quota(TokenBucket& peer_limiter, size_t max_bytes) {
+    size_t quota = peer_limiter.available(max_bytes);
+    quota = download_limiter_.available(quota);
+    return global_download_limiter_ ? global_download_limiter_->available(quota) : quota;
+}
+
+size_t TorrentDownload::get_upload_quota(TokenBucket& peer_limiter, size_t max_bytes) {
+    size_t quota = peer_limiter.available(max_bytes);
+    quota = upload_limiter_.available(quota);
+    return global_upload_limiter_ ? global_upload_limiter_->available(quota) : quota;
+}
+
+void TorrentDownload::consume_download_quota(TokenBucket& peer_limiter, size_t bytes) {
+    peer_limiter.consume(bytes);
+    download_limiter_.consume(bytes);
+    if (global_download_limiter_) {
+        global_download_limiter_->consume(bytes);
+    }
+}
+
+void TorrentDownload::consume_upload_quota(TokenBucket& peer_limiter, size_t bytes) {
+    peer_limiter.consume(bytes);
+    upload_limiter_.consume(bytes);
+    if (global_upload_limiter_) {
+        global_upload_limiter_->consume(bytes);
+    }
+}
+
+bool TorrentDownload::read_block_for_upload(PieceIndex piece_index, uint32_t offset, uint8_t* buffer, size_t size) {
+    // The caller checked that the piece is complete; the storage has its own lock
+    if (!storage_ || !storage_->read_block(piece_index, offset, buffer, size)) {
+        return false;
+    }
+    total_uploaded_ += size;
+    return true;
+}
+
+bool TorrentDownload::store_piece_block(PieceIndex piece_index, uint32_t offset, const uint8_t* data, size_t size) {
+    std::unique_lock<std::mutex> lock(pieces_mutex_);
     
     if (piece_index >= pieces_.size()) {
         LOG_BT_ERROR("Invalid piece index: " << piece_index);
@@ -1033,7 +1828,7 @@ bool TorrentDownload::store_piece_block(PieceIndex piece_index, uint32_t offset,
     auto& piece = pieces_[piece_index];
     
     // Validate offset and data size
-    if (offset + data.size() > piece->length) {
+    if (offset + size > piece->length) {
         LOG_BT_ERROR("Block data exceeds piece length for piece " << piece_index);
         return false;
     }
@@ -1044,42 +1839,108 @@ bool TorrentDownload::store_piece_block(PieceIndex piece_index, uint32_t offset,
         LOG_BT_ERROR("Invalid block index: " << block_index << " for piece " << piece_index);
         return false;
     }
+    piece->blocks_requested.clear(block_index);
+    
+    // The piece is being hashed, keep its blocks stable
+    if (piece->hashing) {
+        LOG_BT_DEBUG("Ignoring block " << block_index << " for piece " << piece_index << " under verification");
+        return true;
+    }
     
     // Store the block data
-    std::copy(data.begin(), data.end(), piece->data.begin() + offset);
-    piece->blocks_downloaded[block_index] = true;
+    if (!storage_->write_block(piece_index, offset, data, size)) {
+        LOG_BT_ERROR("Failed to store block " << block_index << " for piece " << piece_index);
+        return false;
+    }
+    piece->blocks_downloaded.set(block_index);
     
     LOG_BT_DEBUG("Stored block " << block_index << " for piece " << piece_index 
-                 << " (offset: " << offset << ", size: " << data.size() << ")");
+                 << " (offset: " << offset << ", size: " << size << ")");
     
     // Check if piece is complete
-    if (piece->is_complete() && !piece->verified) {
-        LOG_BT_INFO("Piece " << piece_index << " downloaded, verifying...");
-        if (verify_piece(piece_index)) {
-            piece_completed_[piece_index] = true;
-            piece_downloading_[piece_index] = false;
+    if (!piece->is_complete() || piece->verified) {
+        return true;
+    }
+    
+    LOG_BT_INFO("Piece " << piece_index << " downloaded, verifying...");
+    piece->hashing = true;
+    ++pending_hash_jobs_;
+    
+    if (hash_pool_) {
+        hash_pool_->submit([this, piece_index]() {
+            on_piece_verified(piece_index, verify_piece(piece_index));
+        });
+        return true;
+    }
+    
+    lock.unlock();
+    bool verified = verify_piece(piece_index);
+    on_piece_verified(piece_index, verified);
+    return verified;
+}
+
+void TorrentDownload::on_block_requests_cancelled(const std::vector<PeerRequest>& requests) {
+    if (requests.empty()) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    for (const auto& request : requests) {
+        if (request.piece_index >= pieces_.size() || piece_completed_.get(request.piece_index)) {
+            continue;
+        }
+        auto& piece = pieces_[request.piece_index];
+        piece->blocks_requested.clear(request.offset / BLOCK_SIZE);
+        
+        // Nothing of the piece received or on its way: it is up for picking again
+        if (!piece->hashing && piece->blocks_requested.none() && piece->blocks_downloaded.none()) {
+            piece_downloading_.clear(request.piece_index);
+            picker_.mark_missing(request.piece_index);
+        }
+    }
+}
+
+void TorrentDownload::on_piece_verified(PieceIndex piece_index, bool verified) {
+    {
+        std::lock_guard<std::mutex> lock(pieces_mutex_);
+        auto& piece = pieces_[piece_index];
+        piece->hashing = false;
+        piece_downloading_.clear(piece_index);
+        
+        if (verified) {
+            piece->verified = true;
+            piece_completed_.set(piece_index);
+            picker_.mark_have(piece_index);
             
             // Write piece to disk
             write_piece_to_disk(piece_index);
             
             // Update statistics
             total_downloaded_ += piece->length;
-            
-            // Notify completion
-            on_piece_completed(piece_index);
-            
-            LOG_BT_INFO("Piece " << piece_index << " verified and saved");
-            return true;
         } else {
             LOG_BT_ERROR("Piece " << piece_index << " verification failed, requesting re-download");
             // Reset piece for re-download
-            std::fill(piece->blocks_downloaded.begin(), piece->blocks_downloaded.end(), false);
-            piece_downloading_[piece_index] = false;
-            return false;
+            storage_->discard_piece(piece_index);
+            piece->blocks_downloaded.clear_all();
+            piece->blocks_requested.clear_all();
+            picker_.mark_missing(piece_index);
         }
     }
     
-    return true;
+    if (verified) {
+        // Notify completion
+        on_piece_completed(piece_index);
+        LOG_BT_INFO("Piece " << piece_index << " verified and saved");
+    }
+    
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    --pending_hash_jobs_;
+    hash_jobs_cv_.notify_all();
+}
+
+void TorrentDownload::wait_for_verification() {
+    std::unique_lock<std::mutex> lock(pieces_mutex_);
+    hash_jobs_cv_.wait(lock, [this]() { return pending_hash_jobs_ == 0; });
 }
 
 bool TorrentDownload::verify_piece(PieceIndex piece_index) {
@@ -1089,25 +1950,16 @@ bool TorrentDownload::verify_piece(PieceIndex piece_index) {
     
     auto& piece = pieces_[piece_index];
     
-    // Calculate SHA1 hash of piece data
-    std::string calculated_hash = SHA1::hash_bytes(piece->data);
-    
-    // Convert stored hash to hex string for comparison
-    std::ostringstream stored_hash_hex;
-    for (size_t i = 0; i < piece->hash.size(); ++i) {
-        stored_hash_hex << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(piece->hash[i]);
-    }
-    
-    bool verified = (calculated_hash == stored_hash_hex.str());
-    piece->verified = verified;
+    // Calculate SHA1 hash of the stored piece data (index, length and hash never change)
+    uint8_t calculated_hash[20];
+    bool verified = storage_->hash_piece(piece_index, piece->length, calculated_hash) &&
+                    std::memcmp(calculated_hash, piece->hash.data(), piece->hash.size()) == 0;
     
     LOG_BT_DEBUG("Piece " << piece_index << " verification: " << (verified ? "PASSED" : "FAILED"));
     return verified;
 }
 
 void TorrentDownload::write_piece_to_disk(PieceIndex piece_index) {
-    std::lock_guard<std::mutex> lock(files_mutex_);
-    
     if (piece_index >= pieces_.size()) {
         LOG_BT_ERROR("Invalid piece index for disk write: " << piece_index);
         return;
@@ -1119,59 +1971,9 @@ void TorrentDownload::write_piece_to_disk(PieceIndex piece_index) {
         return;
     }
     
-    // Calculate piece offset in the torrent
-    uint64_t piece_offset = static_cast<uint64_t>(piece_index) * torrent_info_.get_piece_length();
-    uint64_t remaining_data = piece->length;
-    uint64_t data_offset = 0;
-    
-    // Write piece data to the appropriate files
-    for (const auto& file_info : torrent_info_.get_files()) {
-        if (piece_offset >= file_info.offset + file_info.length) {
-            continue; // This piece doesn't overlap with this file
-        }
-        
-        if (piece_offset + piece->length <= file_info.offset) {
-            break; // No more files will be affected by this piece
-        }
-        
-        // Calculate overlap
-        uint64_t file_start_in_piece = (file_info.offset > piece_offset) ? 
-                                      file_info.offset - piece_offset : 0;
-        uint64_t piece_end = piece_offset + piece->length;
-        uint64_t file_end = file_info.offset + file_info.length;
-        uint64_t write_end = (std::min)(piece_end, file_end);
-        uint64_t write_length = write_end - (piece_offset + file_start_in_piece);
-        
-        if (write_length == 0) {
-            continue;
-        }
-        
-        // Open file for writing
-        std::string file_path = download_path_ + "/" + file_info.path;
-        std::fstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
-        
-        if (!file.is_open()) {
-            LOG_BT_ERROR("Failed to open file for writing: " << file_path);
-            continue;
-        }
-        
-        // Seek to correct position in file
-        uint64_t file_offset = (piece_offset > file_info.offset) ? 
-                              piece_offset - file_info.offset : 0;
-        file.seekp(file_offset);
-        
-        // Write data
-        file.write(reinterpret_cast<const char*>(piece->data.data() + file_start_in_piece), 
-                  write_length);
-        
-        if (!file.good()) {
-            LOG_BT_ERROR("Failed to write data to file: " << file_path);
-        }
-        
-        file.close();
-        
-        LOG_BT_DEBUG("Wrote " << write_length << " bytes to file " << file_info.path 
-                     << " at offset " << file_offset);
+    // Blocks already written out under cache pressure are on disk; flush the rest
+    if (!storage_->flush_piece(piece_index)) {
+        LOG_BT_ERROR("Failed to write piece " << piece_index << " to disk");
     }
 }
 
@@ -1179,26 +1981,23 @@ std::vector<PieceIndex> TorrentDownload::get_available_pieces() const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
     std::vector<PieceIndex> available_pieces;
     
-    for (PieceIndex i = 0; i < piece_completed_.size(); ++i) {
-        if (piece_completed_[i]) {
-            available_pieces.push_back(i);
-        }
-    }
+    available_pieces.reserve(piece_completed_.count());
+    piece_completed_.for_each_set([&](size_t i) { available_pieces.push_back(static_cast<PieceIndex>(i)); });
     
     return available_pieces;
 }
 
-std::vector<PieceIndex> TorrentDownload::get_needed_pieces(const std::vector<bool>& peer_bitfield) const {
+std::vector<PieceIndex> TorrentDownload::get_needed_pieces(const Bitfield& peer_bitfield) const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
-    std::vector<PieceIndex> needed_pieces;
     
-    size_t min_size = (std::min)(peer_bitfield.size(), piece_completed_.size());
-    for (size_t i = 0; i < min_size; ++i) {
-        if (peer_bitfield[i] && !piece_completed_[i] && !piece_downloading_[i]) {
-            needed_pieces.push_back(static_cast<PieceIndex>(i));
-        }
-    }
+    // peer & ~completed & ~downloading, a word at a time
+    Bitfield needed(piece_completed_.size());
+    needed |= peer_bitfield;
+    needed.and_not(piece_completed_).and_not(piece_downloading_);
     
+    std::vector<PieceIndex> needed_pieces;
+    needed_pieces.reserve(needed.count());
+    needed.for_each_set([&](size_t i) { needed_pieces.push_back(static_cast<PieceIndex>(i)); });
     return needed_pieces;
 }
 
@@ -1221,10 +2020,10 @@ double TorrentDownload::get_progress_percentage() const {
 
 uint32_t TorrentDownload::get_completed_pieces() const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
-    return static_cast<uint32_t>(std::count(piece_completed_.begin(), piece_completed_.end(), true));
+    return static_cast<uint32_t>(piece_completed_.count());
 }
 
-std::vector<bool> TorrentDownload::get_piece_bitfield() const {
+Bitfield TorrentDownload::get_piece_bitfield() const {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
     return piece_completed_;
 }
@@ -1232,6 +2031,13 @@ std::vector<bool> TorrentDownload::get_piece_bitfield() const {
 void TorrentDownload::download_loop() {
     LOG_BT_INFO("Download loop started for torrent: " << torrent_info_.get_name());
     
+    if (recheck_on_start_) {
+        recheck();
+        if (!running_) {
+            return;
+        }
+    }
+    
     while (running_ && !is_complete()) {
         if (paused_) {
             // Use conditional variable for responsive shutdown
@@ -1268,14 +2074,40 @@ void TorrentDownload::download_loop() {
 void TorrentDownload::peer_management_loop() {
     LOG_BT_INFO("Peer management loop started for torrent: " << torrent_info_.get_name());
     
+    auto next_housekeeping = std::chrono::steady_clock::now();
+    auto next_choke_round = next_housekeeping;
+    
     while (running_) {
-        // Clean up disconnected peers
-        cleanup_disconnected_peers();
+        std::vector<std::shared_ptr<PeerConnection>> peers;
+        {
+            std::lock_guard<std::mutex> lock(peers_mutex_);
+            peers = peer_connections_;
+        }
+        
+        // Peers paused by a rate limit resume as the buckets refill
+        for (auto& peer : peers) {
+            peer->on_bandwidth_tick();
+        }
+        
+        // Connect/handshake and request timeouts, then drop the closed connections
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_housekeeping) {
+            next_housekeeping = now + std::chrono::seconds(1);
+            for (auto& peer : peers) {
+                peer->on_tick();
+            }
+            cleanup_disconnected_peers();
+        }
+        
+        if (now >= next_choke_round) {
+            next_choke_round = now + std::chrono::milliseconds(CHOKE_INTERVAL_MS);
+            run_choker();
+        }
         
         // Use conditional variable for responsive shutdown
         {
             std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::seconds(1), [this] { return !running_.load(); })) {
+            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(BANDWIDTH_TICK_MS), [this] { return !running_.load(); })) {
                 break;
             }
         }
@@ -1292,56 +2124,31 @@ void TorrentDownload::schedule_piece_requests() {
             continue;
         }
         
-        // Get pieces we need that this peer has
-        std::vector<PieceIndex> needed_pieces = get_needed_pieces(peer->get_bitfield());
-        
-        if (needed_pieces.empty()) {
+        // Top the request queue up to the depth this peer's rate and round-trip time call for
+        size_t depth = peer->get_request_queue_depth();
+        size_t pending = peer->get_pending_requests();
+        if (pending >= depth) {
             continue;
         }
         
-        // Select pieces to download using our piece selection strategy
-        std::vector<PieceIndex> selected_pieces = select_pieces_for_download();
+        std::vector<PeerRequest> blocks = select_blocks_for_download(*peer, depth - pending);
+        if (blocks.empty()) {
+            continue;
+        }
         
-        // Request blocks from selected pieces
-        for (PieceIndex piece_index : selected_pieces) {
-            if (peer->get_pending_requests() >= MAX_REQUESTS_PER_PEER) {
-                break; // Don't overwhelm this peer
-            }
-            
-            if (!peer->has_piece(piece_index)) {
-                continue;
-            }
-            
-            // Find blocks we need for this piece
-            {
-                std::lock_guard<std::mutex> pieces_lock(pieces_mutex_);
-                if (piece_index >= pieces_.size() || piece_completed_[piece_index]) {
-                    continue;
-                }
-                
-                auto& piece = pieces_[piece_index];
-                uint32_t block_size = BLOCK_SIZE;
-                
-                for (uint32_t block_index = 0; block_index < piece->get_num_blocks(); ++block_index) {
-                    if (piece->blocks_downloaded[block_index]) {
-                        continue; // Already have this block
-                    }
-                    
-                    uint32_t offset = block_index * BLOCK_SIZE;
-                    uint32_t length = (std::min)(block_size, piece->length - offset);
-                    
-                    if (peer->request_piece_block(piece_index, offset, length)) {
-                        piece_downloading_[piece_index] = true;
-                        LOG_BT_DEBUG("Requested block " << block_index << " of piece " << piece_index 
-                                     << " from peer " << peer->get_peer_info().ip);
-                        break; // Request one block at a time per piece per peer
-                    }
-                }
+        std::vector<PeerRequest> unsent;
+        for (const auto& block : blocks) {
+            if (peer->request_piece_block(block.piece_index, block.offset, block.length)) {
+                LOG_BT_DEBUG("Requested block " << block.offset / BLOCK_SIZE << " of piece " << block.piece_index
+                             << " from peer " << peer->get_peer_info().ip);
+            } else {
+                unsent.push_back(block);
             }
         }
+        on_block_requests_cancelled(unsent);
         
         // Express interest if we need pieces from this peer
-        if (!needed_pieces.empty() && !peer->is_interested()) {
+        if (!peer->is_interested()) {
             peer->set_interested(true);
         }
     }
@@ -1352,61 +2159,68 @@ void TorrentDownload::cleanup_disconnected_peers() {
     
     peer_connections_.erase(
         std::remove_if(peer_connections_.begin(), peer_connections_.end(),
-            [](const std::unique_ptr<PeerConnection>& peer) {
-                return !peer->is_connected();
+            [](const std::shared_ptr<PeerConnection>& peer) {
+                return peer->is_closed();
             }),
         peer_connections_.end());
 }
 
-bool TorrentDownload::open_files() {
-    std::lock_guard<std::mutex> lock(files_mutex_);
-    
-    const auto& files = torrent_info_.get_files();
-    file_handles_.clear();
-    file_handles_.reserve(files.size());
-    
-    for (const auto& file_info : files) {
-        std::string file_path = download_path_ + "/" + file_info.path;
-        
-        // Create file with correct size
-        std::fstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
-        if (!file.is_open()) {
-            // Try to create the file
-            file.open(file_path, std::ios::binary | std::ios::out);
-            if (!file.is_open()) {
-                LOG_BT_ERROR("Failed to create file: " << file_path);
-                return false;
-            }
-            file.close();
-            
-            // Reopen for reading and writing
-            file.open(file_path, std::ios::binary | std::ios::in | std::ios::out);
-            if (!file.is_open()) {
-                LOG_BT_ERROR("Failed to reopen file: " << file_path);
-                return false;
+void TorrentDownload::run_choker() {
+    std::vector<std::shared_ptr<PeerConnection>> peers;
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex_);
+        for (const auto& peer : peer_connections_) {
+            if (peer->is_connected()) {
+                peers.push_back(peer);
             }
         }
-        
-        // Resize file to correct length
-        file.seekp(file_info.length - 1);
-        file.write("\0", 1);
-        
-        file_handles_.emplace_back(std::move(file));
-        LOG_BT_DEBUG("Opened file: " << file_path << " (size: " << file_info.length << ")");
     }
     
-    return true;
+    std::vector<Choker::Candidate> candidates;
+    candidates.reserve(peers.size());
+    for (const auto& peer : peers) {
+        candidates.push_back({reinterpret_cast<uintptr_t>(peer.get()), peer->peer_is_interested(),
+                              peer->get_downloaded(), peer->get_uploaded()});
+    }
+    
+    std::vector<uint64_t> unchoked = choker_.run_round(candidates, is_complete());
+    std::unordered_set<uint64_t> unchoked_ids(unchoked.begin(), unchoked.end());
+    for (auto& peer : peers) {
+        peer->set_choke(unchoked_ids.count(reinterpret_cast<uintptr_t>(peer.get())) == 0);
+    }
+    
+    LOG_BT_DEBUG("Choker round for " << torrent_info_.get_name() << ": " << unchoked.size() << " of "
+                 << peers.size() << " peers unchoked");
+}
+
+void TorrentDownload::disconnect_all_peers() {
+    std::vector<std::shared_ptr<PeerConnection>> peers;
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex_);
+        peers.swap(peer_connections_);
+    }
+    for (auto& peer : peers) {
+        peer->disconnect();
+    }
+}
+
+bool TorrentDownload::open_files() {
+    return storage_ && storage_->open();
 }
 
 void TorrentDownload::close_files() {
-    std::lock_guard<std::mutex> lock(files_mutex_);
-    
-    for (auto& file : file_handles_) {
-        if (file.is_open()) {
-            file.close();
+    if (storage_) {
+        storage_->close();
+    }
+}
+
+bool TorrentDownload::has_existing_files() const {
+    for (const auto& file_info : torrent_info_.get_files()) {
+        if (get_file_size((download_path_ + "/" + file_info.path).c_str()) > 0) {
+            return true;
         }
     }
-    file_handles_.clear();
+    return false;
 }
 
 bool TorrentDownload::create_directory_structure() {
@@ -1431,68 +2245,141 @@ bool TorrentDownload::create_directory_structure() {
     return true;
 }
 
-std::vector<PieceIndex> TorrentDownload::select_pieces_for_download() {
+std::vector<PieceIndex> TorrentDownload::select_pieces_for_download(const Bitfield& peer_bitfield) {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    return picker_.pick_pieces(peer_bitfield, MAX_REQUESTS_PER_PEER);
+}
+
+std::vector<PeerRequest> TorrentDownload::select_blocks_for_download(PeerConnection& peer, size_t max_blocks) {
     std::lock_guard<std::mutex> lock(pieces_mutex_);
     
-    std::vector<PieceIndex> needed_pieces;
+    Bitfield peer_bitfield = peer.get_bitfield();
+    std::vector<PeerRequest> blocks;
     
-    // Find pieces we need
-    for (PieceIndex i = 0; i < piece_completed_.size(); ++i) {
-        if (!piece_completed_[i] && !piece_downloading_[i]) {
-            needed_pieces.push_back(i);
+    // Take the blocks of a piece nobody has been asked for yet
+    auto take_unrequested = [&](PieceIndex piece_index) {
+        auto& piece = pieces_[piece_index];
+        if (piece->hashing || piece->verified) {
+            return;
+        }
+        Bitfield busy = piece->blocks_downloaded;
+        busy |= piece->blocks_requested;
+        for (size_t block = busy.find_first_clear(); block != Bitfield::npos && blocks.size() < max_blocks;
+             block = busy.find_first_clear(block + 1)) {
+            uint32_t offset = static_cast<uint32_t>(block * BLOCK_SIZE);
+            blocks.emplace_back(piece_index, offset, (std::min)(static_cast<uint32_t>(BLOCK_SIZE), piece->length - offset));
+            piece->blocks_requested.set(block);
+        }
+        piece_downloading_.set(piece_index);
+        picker_.mark_downloading(piece_index);
+    };
+    
+    // Finish the pieces already in progress before starting new ones
+    for (size_t i = piece_downloading_.find_first_set(); i != Bitfield::npos && blocks.size() < max_blocks;
+         i = piece_downloading_.find_first_set(i + 1)) {
+        if (peer_bitfield.get(i)) {
+            take_unrequested(static_cast<PieceIndex>(i));
         }
     }
     
-    // Implement rarest-first strategy (simplified)
-    std::vector<PieceIndex> selected_pieces;
-    
-    // For now, just select the first few needed pieces
-    // In a more sophisticated implementation, we would count how many peers have each piece
-    // and prioritize rarer pieces
-    size_t max_pieces = (std::min)(needed_pieces.size(), static_cast<size_t>(10));
-    for (size_t i = 0; i < max_pieces; ++i) {
-        selected_pieces.push_back(needed_pieces[i]);
+    if (blocks.size() < max_blocks && !picker_.is_endgame()) {
+        uint32_t blocks_per_piece = static_cast<uint32_t>((torrent_info_.get_piece_length() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        size_t max_pieces = (max_blocks - blocks.size() + blocks_per_piece - 1) / blocks_per_piece;
+        for (PieceIndex piece_index : picker_.pick_pieces(peer_bitfield, max_pieces)) {
+            take_unrequested(piece_index);
+        }
     }
     
-    return selected_pieces;
-}
-
-PieceIndex TorrentDownload::select_rarest_piece(const std::vector<bool>& available_pieces) {
-    std::lock_guard<std::mutex> lock(pieces_mutex_);
-    
-    // Count how many peers have each piece
-    std::vector<int> piece_counts(piece_completed_.size(), 0);
-    
-    {
-        std::lock_guard<std::mutex> peers_lock(peers_mutex_);
-        for (const auto& peer : peer_connections_) {
-            if (!peer->is_connected()) {
+    // Endgame: ask for blocks already requested from other peers as well
+    if (blocks.size() < max_blocks && picker_.is_endgame()) {
+        for (PieceIndex piece_index : picker_.pick_pieces(peer_bitfield, max_blocks)) {
+            auto& piece = pieces_[piece_index];
+            if (piece->hashing) {
                 continue;
             }
-            
-            const auto& peer_bitfield = peer->get_bitfield();
-            for (size_t i = 0; i < peer_bitfield.size() && i < piece_counts.size(); ++i) {
-                if (peer_bitfield[i]) {
-                    piece_counts[i]++;
+            Bitfield outstanding = piece->blocks_requested;
+            outstanding.and_not(piece->blocks_downloaded);
+            for (size_t block = outstanding.find_first_set(); block != Bitfield::npos && blocks.size() < max_blocks;
+                 block = outstanding.find_first_set(block + 1)) {
+                uint32_t offset = static_cast<uint32_t>(block * BLOCK_SIZE);
+                if (!peer.has_pending_request(piece_index, offset)) {
+                    blocks.emplace_back(piece_index, offset, (std::min)(static_cast<uint32_t>(BLOCK_SIZE), piece->length - offset));
                 }
             }
+            if (blocks.size() >= max_blocks) {
+                break;
+            }
         }
     }
     
-    // Find the rarest piece we need and is available
-    int min_count = INT_MAX;
-    PieceIndex rarest_piece = static_cast<PieceIndex>(-1);
+    return blocks;
+}
+
+PieceIndex TorrentDownload::select_rarest_piece(const Bitfield& available_pieces) {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    std::vector<PieceIndex> picked = picker_.pick_pieces(available_pieces, 1);
+    return picked.empty() ? static_cast<PieceIndex>(-1) : picked.front();
+}
+
+void TorrentDownload::set_piece_priority(PieceIndex piece_index, uint8_t priority) {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    if (piece_index < pieces_.size()) {
+        picker_.set_piece_priority(piece_index, priority);
+    }
+}
+
+void TorrentDownload::set_file_priority(size_t file_index, uint8_t priority) {
+    const auto& files = torrent_info_.get_files();
+    if (file_index >= files.size() || files[file_index].length == 0) {
+        return;
+    }
     
-    for (size_t i = 0; i < available_pieces.size() && i < piece_completed_.size(); ++i) {
-        if (available_pieces[i] && !piece_completed_[i] && !piece_downloading_[i]) {
-            if (piece_counts[i] < min_count) {
-                min_count = piece_counts[i];
-                rarest_piece = static_cast<PieceIndex>(i);
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    if (file_priorities_.empty()) {
+        file_priorities_.assign(files.size(), PiecePicker::PRIORITY_NORMAL);
+    }
+    file_priorities_[file_index] = priority;
+    
+    // Re-derive the pieces of this file; edge pieces also cover neighbouring files
+    uint64_t piece_length = torrent_info_.get_piece_length();
+    PieceIndex first_piece = static_cast<PieceIndex>(files[file_index].offset / piece_length);
+    PieceIndex last_piece = static_cast<PieceIndex>((files[file_index].offset + files[file_index].length - 1) / piece_length);
+    for (PieceIndex piece_index = first_piece; piece_index <= last_piece; ++piece_index) {
+        uint8_t piece_priority = priority;
+        if (piece_index == first_piece || piece_index == last_piece) {
+            uint64_t piece_start = piece_index * piece_length;
+            uint64_t piece_end = piece_start + pieces_[piece_index]->length;
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (files[i].length > 0 && files[i].offset < piece_end && files[i].offset + files[i].length > piece_start) {
+                    piece_priority = (std::max)(piece_priority, file_priorities_[i]);
+                }
             }
         }
+        picker_.set_piece_priority(piece_index, piece_priority);
+    }
+}
+
+void TorrentDownload::set_sequential_download(bool sequential) {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    picker_.set_sequential(sequential);
+}
+
+bool TorrentDownload::is_endgame() const {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    return picker_.is_endgame();
+}
+
+void TorrentDownload::on_peer_have(PieceIndex piece_index) {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    if (piece_index < pieces_.size()) {
+        picker_.inc_availability(piece_index);
     }
-    
-    return rarest_piece;
+}
+
+void TorrentDownload::on_peer_bitfield(const Bitfield& old_bitfield, const Bitfield& new_bitfield) {
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    picker_.dec_availability(old_bitfield);
+    picker_.inc_availability(new_bitfield);
 }
 
 void TorrentDownload::update_progress() {
@@ -1510,9 +2397,251 @@ void TorrentDownload::on_piece_completed(PieceIndex piece_index) {
         piece_complete_callback_(piece_index);
     }
     
-    LOG_BT_INFO("Piece " << piece_index << " completed. Progress: " 
-                << get_progress_percentage() << "% (" 
-                << get_completed_pieces() << "/" << torrent_info_.get_num_pieces() << " pieces)");
+    LOG_BT_INFO("Piece " << piece_index << " completed. Progress: " 
+                << get_progress_percentage() << "% (" 
+                << get_completed_pieces() << "/" << torrent_info_.get_num_pieces() << " pieces)");
+    
+    // Incremental resume data, rate limited; stop() writes the final state
+    if (running_ && !checking_) {
+        auto now = std::chrono::steady_clock::now();
+        bool save_due;
+        {
+            std::lock_guard<std::mutex> lock(resume_mutex_);
+            save_due = now - last_resume_save_ >= std::chrono::milliseconds(RESUME_SAVE_INTERVAL_MS);
+            if (save_due) {
+                last_resume_save_ = now;  // Claimed by this thread
+            }
+        }
+        if (save_due) {
+            save_resume_data();
+        }
+    }
+}
+
+//=============================================================================
+// Fast resume and recheck
+//=============================================================================
+
+std::string TorrentDownload::get_resume_file_path() const {
+    const std::string& directory = resume_directory_.empty() ? download_path_ : resume_directory_;
+    return directory + "/" + info_hash_to_hex(torrent_info_.get_info_hash()) + ".resume";
+}
+
+bool TorrentDownload::save_resume_data() {
+    BencodeValue resume = BencodeValue::create_dict();
+    resume["file-format"] = BencodeValue("librats resume file");
+    resume["info-hash"] = BencodeValue(std::string(torrent_info_.get_info_hash().begin(),
+                                                   torrent_info_.get_info_hash().end()));
+    
+    // Snapshot of the piece state
+    {
+        std::lock_guard<std::mutex> lock(pieces_mutex_);
+        std::vector<uint8_t> pieces = piece_completed_.to_bytes();
+        resume["pieces"] = BencodeValue(std::string(pieces.begin(), pieces.end()));
+        
+        BencodeValue unfinished = BencodeValue::create_list();
+        for (const auto& piece : pieces_) {
+            if (piece_completed_.get(piece->index) || piece->hashing || piece->blocks_downloaded.none()) {
+                continue;
+            }
+            BencodeValue entry = BencodeValue::create_dict();
+            entry["piece"] = BencodeValue(static_cast<int64_t>(piece->index));
+            std::vector<uint8_t> blocks = piece->blocks_downloaded.to_bytes();
+            entry["blocks"] = BencodeValue(std::string(blocks.begin(), blocks.end()));
+            unfinished.push_back(entry);
+        }
+        resume["unfinished"] = unfinished;
+    }
+    
+    std::lock_guard<std::mutex> lock(resume_mutex_);
+    last_resume_save_ = std::chrono::steady_clock::now();
+    
+    BencodeValue files = BencodeValue::create_list();
+    for (const auto& file_info : torrent_info_.get_files()) {
+        std::string file_path = download_path_ + "/" + file_info.path;
+        BencodeValue entry = BencodeValue::create_dict();
+        entry["size"] = BencodeValue(get_file_size(file_path.c_str()));
+        entry["mtime"] = BencodeValue(static_cast<int64_t>(get_file_modified_time(file_path)));
+        files.push_back(entry);
+    }
+    resume["files"] = files;
+    
+    // Write and rename so a crash never leaves a truncated resume file
+    std::string resume_path = get_resume_file_path();
+    std::string temp_path = resume_path + ".tmp";
+    std::vector<uint8_t> encoded = resume.encode();
+    if (!create_directories(get_parent_directory(resume_path).c_str()) ||
+        !create_file_binary(temp_path.c_str(), encoded.data(), encoded.size()) ||
+        !move_file(temp_path.c_str(), resume_path.c_str())) {
+        LOG_BT_ERROR("Failed to write resume data: " << resume_path);
+        return false;
+    }
+    
+    LOG_BT_DEBUG("Saved resume data for " << torrent_info_.get_name() << " (" << encoded.size() << " bytes)");
+    return true;
+}
+
+bool TorrentDownload::load_resume_data() {
+    std::string resume_path = get_resume_file_path();
+    if (!file_exists(resume_path)) {
+        LOG_BT_DEBUG("No resume data for " << torrent_info_.get_name());
+        return false;
+    }
+    
+    size_t size = 0;
+    void* data = read_file_binary(resume_path.c_str(), &size);
+    if (!data) {
+        LOG_BT_WARN("Failed to read resume data: " << resume_path);
+        return false;
+    }
+    
+    BencodeValue resume;
+    try {
+        resume = BencodeDecoder::decode(static_cast<const uint8_t*>(data), size);
+    } catch (const std::exception& e) {
+        LOG_BT_WARN("Failed to decode resume data " << resume_path << ": " << e.what());
+        free_file_buffer(data);
+        return false;
+    }
+    free_file_buffer(data);
+    
+    const InfoHash& info_hash = torrent_info_.get_info_hash();
+    const auto& torrent_files = torrent_info_.get_files();
+    if (!resume.is_dict() || !resume.has_key("info-hash") || !resume.has_key("pieces") ||
+        !resume.has_key("files") || !resume["info-hash"].is_string() ||
+        resume["info-hash"].as_string() != std::string(info_hash.begin(), info_hash.end()) ||
+        !resume["files"].is_list() || resume["files"].size() != torrent_files.size()) {
+        LOG_BT_WARN("Resume data does not match torrent: " << torrent_info_.get_name());
+        return false;
+    }
+    
+    // Files changed since the resume data was written invalidate it
+    for (size_t i = 0; i < torrent_files.size(); ++i) {
+        const BencodeValue& entry = resume["files"][i];
+        std::string file_path = download_path_ + "/" + torrent_files[i].path;
+        if (!entry.is_dict() || !entry.has_key("size") || !entry.has_key("mtime") ||
+            entry["size"].as_integer() != get_file_size(file_path.c_str()) ||
+            static_cast<uint64_t>(entry["mtime"].as_integer()) != get_file_modified_time(file_path)) {
+            LOG_BT_INFO("File changed since resume data was saved: " << file_path);
+            return false;
+        }
+    }
+    
+    // Bitfields are stored in wire format and must match the torrent exactly
+    auto read_bitfield = [](const BencodeValue& value, size_t size, Bitfield& bitfield) {
+        if (!value.is_string() || value.as_string().size() != (size + 7) / 8) {
+            return false;
+        }
+        const std::string& packed = value.as_string();
+        bitfield = Bitfield::from_bytes(reinterpret_cast<const uint8_t*>(packed.data()), packed.size(), size);
+        return true;
+    };
+    
+    Bitfield completed;
+    if (!read_bitfield(resume["pieces"], pieces_.size(), completed)) {
+        LOG_BT_WARN("Invalid piece bitfield in resume data: " << resume_path);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(pieces_mutex_);
+    uint64_t completed_bytes = 0;
+    completed.for_each_set([&](size_t index) {
+        auto& piece = pieces_[index];
+        piece->verified = true;
+        piece->blocks_downloaded.set_all();
+        picker_.mark_have(static_cast<PieceIndex>(index));
+        completed_bytes += piece->length;
+    });
+    piece_completed_ |= completed;
+    
+    if (resume.has_key("unfinished") && resume["unfinished"].is_list()) {
+        for (const auto& entry : resume["unfinished"].as_list()) {
+            if (!entry.is_dict() || !entry.has_key("piece") || !entry.has_key("blocks")) {
+                continue;
+            }
+            int64_t index = entry["piece"].as_integer();
+            if (index < 0 || static_cast<size_t>(index) >= pieces_.size() || piece_completed_.get(index)) {
+                continue;
+            }
+            auto& piece = pieces_[index];
+            Bitfield blocks;
+            if (read_bitfield(entry["blocks"], piece->get_num_blocks(), blocks)) {
+                piece->blocks_downloaded = blocks;
+            }
+        }
+    }
+    total_downloaded_ += completed_bytes;
+    
+    LOG_BT_INFO("Loaded resume data for " << torrent_info_.get_name() << ": "
+                << piece_completed_.count() << "/"
+                << pieces_.size() << " pieces complete");
+    return true;
+}
+
+uint32_t TorrentDownload::recheck() {
+    checking_ = true;
+    bool was_running = running_;
+    uint32_t num_pieces = static_cast<uint32_t>(pieces_.size());
+    LOG_BT_INFO("Rechecking " << num_pieces << " pieces of " << torrent_info_.get_name());
+    
+    // Workers pull piece indices from a shared counter until all are hashed
+    std::atomic<uint32_t> next_piece(0);
+    std::atomic<uint32_t> valid_pieces(0);
+    std::atomic<uint64_t> valid_bytes(0);
+    auto check_pieces = [&]() {
+        for (PieceIndex index = next_piece++; index < num_pieces; index = next_piece++) {
+            if (was_running && !running_) {
+                return;
+            }
+            auto& piece = pieces_[index];
+            uint8_t digest[20];
+            if (!storage_->hash_piece(index, piece->length, digest) ||
+                std::memcmp(digest, piece->hash.data(), piece->hash.size()) != 0) {
+                continue;
+            }
+            
+            std::lock_guard<std::mutex> lock(pieces_mutex_);
+            if (!piece_completed_.get(index) && !piece->hashing) {
+                piece->verified = true;
+                piece->blocks_downloaded.set_all();
+                piece_completed_.set(index);
+                piece_downloading_.clear(index);
+                picker_.mark_have(index);
+                valid_bytes += piece->length;
+            }
+            ++valid_pieces;
+        }
+    };
+    
+    std::shared_ptr<PieceHashPool> pool = hash_pool_ ? hash_pool_ : std::make_shared<PieceHashPool>();
+    size_t workers = (std::min)(pool->get_thread_count(), static_cast<size_t>(num_pieces));
+    size_t finished_workers = 0;
+    std::mutex finished_mutex;
+    std::condition_variable finished_cv;
+    for (size_t i = 0; i < workers; ++i) {
+        pool->submit([&]() {
+            check_pieces();
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            ++finished_workers;
+            finished_cv.notify_all();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(finished_mutex);
+        finished_cv.wait(lock, [&]() { return finished_workers == workers; });
+    }
+    total_downloaded_ += valid_bytes.load();
+    
+    if (was_running && !running_) {
+        LOG_BT_INFO("Recheck of " << torrent_info_.get_name() << " interrupted");
+        return valid_pieces.load();
+    }
+    
+    checking_ = false;
+    LOG_BT_INFO("Recheck of " << torrent_info_.get_name() << " found " << valid_pieces.load()
+                << "/" << num_pieces << " valid pieces");
+    save_resume_data();
+    return valid_pieces.load();
 }
 
 void TorrentDownload::check_torrent_completion() {
@@ -1575,9 +2704,15 @@ void TorrentDownload::request_peers_from_dht(DhtClient* dht_client) {
 
 BitTorrentClient::BitTorrentClient()
     : running_(false), listen_port_(0), listen_socket_(INVALID_SOCKET_VALUE),
-      dht_client_(nullptr), max_connections_per_torrent_(MAX_PEERS_PER_TORRENT),
-      download_rate_limit_(0), upload_rate_limit_(0) {
-    
+      dht_client_(nullptr), cache_budget_(std::make_shared<BlockCacheBudget>(DEFAULT_DISK_CACHE_SIZE)),
+      hash_pool_(std::make_shared<PieceHashPool>()), reactor_(std::make_shared<IoReactor>("bittorrent")),
+      max_connections_per_torrent_(MAX_PEERS_PER_TORRENT),
+      download_limiter_(std::make_shared<TokenBucket>()), upload_limiter_(std::make_shared<TokenBucket>()) {
+    
+    reactor_->set_tick_callback([this]() {
+        check_incoming_handshake_timeouts();
+        check_metadata_fetches();
+    }, std::chrono::seconds(1));
     LOG_BT_INFO("BitTorrent client created");
 }
 
@@ -1604,17 +2739,40 @@ bool BitTorrentClient::start(int listen_port) {
         return false;
     }
     
+    if (!reactor_->start()) {
+        LOG_BT_ERROR("Failed to start the BitTorrent I/O reactor");
+        return false;
+    }
+    
     // Create listen socket
     listen_socket_ = create_tcp_server(listen_port_);
     if (!is_valid_socket(listen_socket_)) {
         LOG_BT_ERROR("Failed to create BitTorrent listen socket on port " << listen_port_);
+        reactor_->stop();
         return false;
     }
     
     running_.store(true);
     
-    // Start incoming connections handler
-    incoming_connections_thread_ = std::thread(&BitTorrentClient::handle_incoming_connections, this);
+    // Incoming connections are accepted on the reactor
+    if (!reactor_->add_socket(listen_socket_, [this](socket_t, uint32_t) { handle_incoming_connections(); })) {
+        LOG_BT_ERROR("Failed to register the BitTorrent listen socket");
+        running_.store(false);
+        close_socket(listen_socket_);
+        listen_socket_ = INVALID_SOCKET_VALUE;
+        reactor_->stop();
+        return false;
+    }
+    
+    // uTP shares the port number over UDP; TCP keeps working without it
+    utp_manager_ = std::make_shared<UtpManager>(reactor_);
+    utp_manager_->set_accept_callback([this](std::shared_ptr<UtpSocket> utp_socket) {
+        handle_incoming_utp_connection(std::move(utp_socket));
+    });
+    if (!utp_manager_->start(listen_port_)) {
+        LOG_BT_WARN("Failed to start uTP on port " << listen_port_ << ", continuing with TCP only");
+        utp_manager_.reset();
+    }
     
     LOG_BT_INFO("BitTorrent client started successfully");
     return true;
@@ -1639,15 +2797,54 @@ void BitTorrentClient::stop() {
     
     // Close listen socket
     if (is_valid_socket(listen_socket_)) {
+        reactor_->remove_socket(listen_socket_);
         close_socket(listen_socket_);
         listen_socket_ = INVALID_SOCKET_VALUE;
     }
     
-    // Wait for threads
-    if (incoming_connections_thread_.joinable()) {
-        incoming_connections_thread_.join();
+    // Drop connections still handshaking
+    std::vector<socket_t> pending;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        for (const auto& pair : incoming_handshakes_) {
+            pending.push_back(pair.first);
+        }
+    }
+    for (socket_t socket : pending) {
+        close_incoming_handshake(socket);
+    }
+    
+    std::vector<UtpSocket*> pending_utp;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        for (const auto& pair : incoming_utp_handshakes_) {
+            pending_utp.push_back(pair.first);
+        }
+    }
+    for (UtpSocket* utp_socket : pending_utp) {
+        close_incoming_utp_handshake(utp_socket);
     }
     
+    if (utp_manager_) {
+        utp_manager_->stop();
+        utp_manager_.reset();
+    }
+    
+    // Metadata fetches still running fail
+    std::map<InfoHash, MetadataFetch> fetches;
+    {
+        std::lock_guard<std::mutex> lock(metadata_mutex_);
+        fetches.swap(metadata_fetches_);
+    }
+    for (auto& pair : fetches) {
+        pair.second.fetcher->cancel();
+        for (const auto& callback : pair.second.callbacks) {
+            callback(TorrentInfo(), false);
+        }
+    }
+    
+    reactor_->stop();
+    
     LOG_BT_INFO("BitTorrent client stopped");
 }
 
@@ -1681,7 +2878,10 @@ std::shared_ptr<TorrentDownload> BitTorrentClient::add_torrent(const TorrentInfo
         }
         
         // Create new torrent download
-        auto torrent_download = std::make_shared<TorrentDownload>(torrent_info, download_path);
+        auto torrent_download = std::make_shared<TorrentDownload>(torrent_info, download_path, cache_budget_, hash_pool_, reactor_);
+        torrent_download->set_resume_directory(resume_directory_);
+        torrent_download->set_global_rate_limiters(download_limiter_, upload_limiter_);
+        torrent_download->set_utp_manager(utp_manager_);
         
         // Set up callbacks
         torrent_download->set_progress_callback([this, info_hash](uint64_t downloaded, uint64_t total, double percentage) {
@@ -1768,6 +2968,12 @@ void BitTorrentClient::discover_peers_for_torrent(const InfoHash& info_hash) {
     
     auto torrent = get_torrent(info_hash);
     if (!torrent) {
+        std::unique_lock<std::mutex> lock(metadata_mutex_);
+        if (metadata_fetches_.count(info_hash)) {
+            lock.unlock();
+            request_metadata_peers_from_dht(info_hash);
+            return;
+        }
         LOG_BT_WARN("Torrent not found for peer discovery");
         return;
     }
@@ -1790,6 +2996,163 @@ void BitTorrentClient::announce_torrent_to_dht(const InfoHash& info_hash) {
     torrent->announce_to_dht(dht_client_);
 }
 
+bool BitTorrentClient::fetch_metadata(const InfoHash& info_hash, MetadataCallback callback, const std::vector<Peer>& peers) {
+    if (!running_.load()) {
+        LOG_BT_ERROR("BitTorrent client is not running");
+        return false;
+    }
+    
+    std::shared_ptr<MetadataFetcher> fetcher;
+    bool started = false;
+    {
+        std::unique_lock<std::mutex> lock(metadata_mutex_);
+        TorrentInfo torrent_info;
+        if (find_metadata_locked(info_hash, torrent_info)) {
+            lock.unlock();
+            if (callback) {
+                callback(torrent_info, true);
+            }
+            return true;
+        }
+        
+        // A second lookup of the same hash joins the fetch in progress
+        auto it = metadata_fetches_.find(info_hash);
+        if (it == metadata_fetches_.end()) {
+            MetadataFetch fetch;
+            fetch.fetcher = std::make_shared<MetadataFetcher>(info_hash, reactor_,
+                [this, info_hash](const TorrentInfo& torrent_info, bool success) {
+                    on_metadata_fetched(info_hash, torrent_info, success);
+                });
+            it = metadata_fetches_.emplace(info_hash, std::move(fetch)).first;
+            started = true;
+        }
+        if (callback) {
+            it->second.callbacks.push_back(std::move(callback));
+        }
+        fetcher = it->second.fetcher;
+    }
+    
+    if (started) {
+        LOG_BT_INFO("Fetching metadata for " << info_hash_to_hex(info_hash));
+    }
+    fetcher->add_peers(peers);
+    if (started) {
+        request_metadata_peers_from_dht(info_hash);
+    }
+    return true;
+}
+
+bool BitTorrentClient::get_cached_metadata(const InfoHash& info_hash, TorrentInfo& torrent_info) {
+    std::lock_guard<std::mutex> lock(metadata_mutex_);
+    return find_metadata_locked(info_hash, torrent_info);
+}
+
+size_t BitTorrentClient::get_metadata_fetch_count() const {
+    std::lock_guard<std::mutex> lock(metadata_mutex_);
+    return metadata_fetches_.size();
+}
+
+bool BitTorrentClient::add_magnet(const std::string& magnet_uri, const std::string& download_path,
+                                  std::function<void(std::shared_ptr<TorrentDownload>)> callback) {
+    MagnetLink magnet;
+    if (!parse_magnet_link(magnet_uri, magnet)) {
+        LOG_BT_ERROR("Invalid magnet link: " << magnet_uri);
+        return false;
+    }
+    
+    return fetch_metadata(magnet.info_hash, [this, download_path, callback](const TorrentInfo& torrent_info, bool success) {
+        std::shared_ptr<TorrentDownload> torrent;
+        if (success && running_.load()) {
+            torrent = add_torrent(torrent_info, download_path);
+        }
+        if (callback) {
+            callback(torrent);
+        }
+    }, magnet.peers);
+}
+
+bool BitTorrentClient::find_metadata_locked(const InfoHash& info_hash, TorrentInfo& torrent_info) {
+    auto cached = metadata_cache_index_.find(info_hash);
+    if (cached != metadata_cache_index_.end()) {
+        metadata_cache_.splice(metadata_cache_.begin(), metadata_cache_, cached->second);
+        torrent_info = cached->second->second;
+        return true;
+    }
+    
+    // Torrents we already have need no fetch either
+    std::lock_guard<std::mutex> lock(torrents_mutex_);
+    auto it = torrents_.find(info_hash);
+    if (it == torrents_.end()) {
+        return false;
+    }
+    torrent_info = it->second->get_torrent_info();
+    return true;
+}
+
+void BitTorrentClient::request_metadata_peers_from_dht(const InfoHash& info_hash) {
+    if (!dht_client_ || !dht_client_->is_running()) {
+        return;
+    }
+    
+    dht_client_->find_peers(info_hash, [this](const std::vector<Peer>& peers, const InfoHash& info_hash) {
+        std::shared_ptr<MetadataFetcher> fetcher;
+        {
+            std::lock_guard<std::mutex> lock(metadata_mutex_);
+            auto it = metadata_fetches_.find(info_hash);
+            if (it == metadata_fetches_.end()) {
+                return;  // Finished meanwhile
+            }
+            fetcher = it->second.fetcher;
+        }
+        LOG_BT_DEBUG("DHT discovered " << peers.size() << " metadata peers for " << info_hash_to_hex(info_hash));
+        fetcher->add_peers(peers);
+    });
+}
+
+void BitTorrentClient::on_metadata_fetched(const InfoHash& info_hash, const TorrentInfo& torrent_info, bool success) {
+    std::vector<MetadataCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(metadata_mutex_);
+        auto it = metadata_fetches_.find(info_hash);
+        if (it == metadata_fetches_.end()) {
+            return;
+        }
+        callbacks = std::move(it->second.callbacks);
+        metadata_fetches_.erase(it);
+        
+        if (success && !metadata_cache_index_.count(info_hash)) {
+            metadata_cache_.emplace_front(info_hash, torrent_info);
+            metadata_cache_index_[info_hash] = metadata_cache_.begin();
+            while (metadata_cache_.size() > METADATA_CACHE_SIZE) {
+                metadata_cache_index_.erase(metadata_cache_.back().first);
+                metadata_cache_.pop_back();
+            }
+        }
+    }
+    
+    if (!success) {
+        LOG_BT_WARN("Failed to fetch metadata for " << info_hash_to_hex(info_hash));
+    }
+    for (const auto& callback : callbacks) {
+        callback(torrent_info, success);
+    }
+}
+
+void BitTorrentClient::check_metadata_fetches() {
+    std::vector<std::shared_ptr<MetadataFetcher>> fetchers;
+    {
+        std::lock_guard<std::mutex> lock(metadata_mutex_);
+        for (const auto& pair : metadata_fetches_) {
+            fetchers.push_back(pair.second.fetcher);
+        }
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& fetcher : fetchers) {
+        fetcher->on_tick(now);
+    }
+}
+
 size_t BitTorrentClient::get_active_torrents_count() const {
     std::lock_guard<std::mutex> lock(torrents_mutex_);
     return torrents_.size();
@@ -1818,48 +3181,82 @@ uint64_t BitTorrentClient::get_total_uploaded() const {
 }
 
 void BitTorrentClient::handle_incoming_connections() {
-    LOG_BT_INFO("BitTorrent incoming connections handler started");
-    
-    while (running_.load()) {
-        socket_t client_socket = accept_client(listen_socket_);
-        if (!is_valid_socket(client_socket)) {
-            if (running_.load()) {
-                LOG_BT_ERROR("Failed to accept BitTorrent client connection");
-            }
-            continue;
+    socket_t client_socket = accept_client(listen_socket_);
+    if (!is_valid_socket(client_socket)) {
+        if (running_.load()) {
+            LOG_BT_ERROR("Failed to accept BitTorrent client connection");
         }
-        
-        // Handle the connection in a separate thread
-        std::thread([this, client_socket]() {
-            handle_incoming_connection(client_socket);
-        }).detach();
+        return;
     }
     
-    LOG_BT_INFO("BitTorrent incoming connections handler stopped");
+    handle_incoming_connection(client_socket);
 }
 
 void BitTorrentClient::handle_incoming_connection(socket_t client_socket) {
     LOG_BT_DEBUG("Handling incoming BitTorrent connection");
     
-    InfoHash info_hash;
-    PeerID peer_id;
-    
-    if (!perform_incoming_handshake(client_socket, info_hash, peer_id)) {
-        LOG_BT_WARN("Failed to perform incoming handshake");
+    if (!set_socket_nonblocking(client_socket)) {
+        LOG_BT_WARN("Failed to make incoming BitTorrent connection non-blocking");
         close_socket(client_socket);
         return;
     }
     
-    // Find the torrent for this info hash
-    auto torrent = get_torrent(info_hash);
+    auto handshake = std::make_shared<IncomingHandshake>();
+    handshake->socket = client_socket;
+    handshake->accepted_at = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        incoming_handshakes_[client_socket] = handshake;
+    }
+    
+    if (!reactor_->add_socket(client_socket, [this, handshake](socket_t, uint32_t) { handle_incoming_handshake(handshake); })) {
+        LOG_BT_WARN("Failed to register incoming BitTorrent connection");
+        close_incoming_handshake(client_socket);
+    }
+}
+
+void BitTorrentClient::handle_incoming_handshake(const std::shared_ptr<IncomingHandshake>& handshake) {
+    socket_t socket = handshake->socket;
+    
+    // Read no further than the handshake; what follows belongs to the peer connection
+    uint8_t buffer[HANDSHAKE_SIZE];
+    int received = receive_tcp_nonblocking(socket, buffer, HANDSHAKE_SIZE - handshake->data.size());
+    if (received < 0) {
+        LOG_BT_DEBUG("Incoming BitTorrent connection closed during the handshake");
+        close_incoming_handshake(socket);
+        return;
+    }
+    handshake->data.insert(handshake->data.end(), buffer, buffer + received);
+    if (handshake->data.size() < HANDSHAKE_SIZE) {
+        return;
+    }
+    
+    // The torrent takes the socket over, so this registration ends here either way
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (incoming_handshakes_.erase(socket) == 0) {
+            return;  // Timed out meanwhile
+        }
+    }
+    reactor_->remove_socket(socket);
+    
+    PeerID peer_id;
+    std::vector<uint8_t> response;
+    auto torrent = perform_incoming_handshake(handshake->data, peer_id, response);
     if (!torrent) {
-        LOG_BT_WARN("Received connection for unknown torrent");
-        close_socket(client_socket);
+        close_socket(socket);
+        return;
+    }
+    
+    // The response fits in any fresh socket send buffer
+    if (send_tcp_nonblocking(socket, response.data(), response.size()) != static_cast<int>(response.size())) {
+        LOG_BT_ERROR("Failed to send handshake response");
+        close_socket(socket);
         return;
     }
     
     // Get peer address
-    std::string peer_address = get_peer_address(client_socket);
+    std::string peer_address = get_peer_address(socket);
     
     // Parse peer address to get IP and port
     std::string ip;
@@ -1876,49 +3273,161 @@ void BitTorrentClient::handle_incoming_connection(socket_t client_socket) {
     
     if (ip.empty() || port == 0) {
         LOG_BT_WARN("Failed to parse peer address: " << peer_address);
-        close_socket(client_socket);
+        close_socket(socket);
         return;
     }
     
-    // Create peer object and add to torrent
+    // The connection is handed over as is; the torrent closes it if it is not kept
     Peer peer_info{ip, static_cast<uint16_t>(port)};
-    if (torrent->add_peer(peer_info)) {
+    if (torrent->add_incoming_peer(socket, peer_info, peer_id)) {
         LOG_BT_INFO("Added incoming peer: " << peer_address);
     } else {
         LOG_BT_WARN("Failed to add incoming peer: " << peer_address);
-        close_socket(client_socket);
     }
 }
 
-bool BitTorrentClient::perform_incoming_handshake(socket_t socket, InfoHash& info_hash, PeerID& peer_id) {
-    // Receive handshake
-    std::vector<uint8_t> handshake_data(68); // Fixed handshake size
-    std::string received_data = receive_tcp_string(socket, 68);
+std::shared_ptr<TorrentDownload> BitTorrentClient::perform_incoming_handshake(const std::vector<uint8_t>& handshake_data,
+                                                                              PeerID& peer_id, std::vector<uint8_t>& response) {
+    InfoHash info_hash;
+    if (!parse_handshake_message(handshake_data, info_hash, peer_id)) {
+        LOG_BT_ERROR("Failed to parse incoming handshake");
+        return nullptr;
+    }
     
-    if (received_data.length() != 68) {
-        LOG_BT_ERROR("Invalid handshake size received: " << received_data.length());
-        return false;
+    // Find the torrent for this info hash
+    auto torrent = get_torrent(info_hash);
+    if (!torrent) {
+        LOG_BT_WARN("Received connection for unknown torrent");
+        return nullptr;
     }
     
-    std::copy(received_data.begin(), received_data.end(), handshake_data.begin());
+    PeerID our_peer_id = generate_peer_id();
+    response = create_handshake_message(info_hash, our_peer_id);
     
-    if (!parse_handshake_message(handshake_data, info_hash, peer_id)) {
-        LOG_BT_ERROR("Failed to parse incoming handshake");
-        return false;
+    LOG_BT_DEBUG("Incoming handshake completed successfully");
+    return torrent;
+}
+
+void BitTorrentClient::close_incoming_handshake(socket_t socket) {
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (incoming_handshakes_.erase(socket) == 0) {
+            return;  // Already handed over or closed
+        }
+    }
+    reactor_->remove_socket(socket);
+    close_socket(socket);
+}
+
+void BitTorrentClient::check_incoming_handshake_timeouts() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<socket_t> expired;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        for (const auto& pair : incoming_handshakes_) {
+            if (now - pair.second->accepted_at > std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS)) {
+                expired.push_back(pair.first);
+            }
+        }
     }
     
-    // Send our handshake response
-    PeerID our_peer_id = generate_peer_id();
-    auto response_data = create_handshake_message(info_hash, our_peer_id);
+    for (socket_t socket : expired) {
+        LOG_BT_DEBUG("Incoming BitTorrent handshake timed out");
+        close_incoming_handshake(socket);
+    }
     
-    std::string response_str(response_data.begin(), response_data.end());
-    if (send_tcp_string(socket, response_str) <= 0) {
-        LOG_BT_ERROR("Failed to send handshake response");
-        return false;
+    std::vector<UtpSocket*> expired_utp;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        for (const auto& pair : incoming_utp_handshakes_) {
+            if (now - pair.second->accepted_at > std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS)) {
+                expired_utp.push_back(pair.first);
+            }
+        }
     }
     
-    LOG_BT_DEBUG("Incoming handshake completed successfully");
-    return true;
+    for (UtpSocket* utp_socket : expired_utp) {
+        LOG_BT_DEBUG("Incoming uTP handshake timed out");
+        close_incoming_utp_handshake(utp_socket);
+    }
+}
+
+void BitTorrentClient::handle_incoming_utp_connection(std::shared_ptr<UtpSocket> utp_socket) {
+    LOG_BT_DEBUG("Handling incoming uTP connection from " << utp_socket->get_remote_peer().ip);
+    
+    auto handshake = std::make_shared<IncomingUtpHandshake>();
+    handshake->socket = utp_socket;
+    handshake->accepted_at = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        incoming_utp_handshakes_[utp_socket.get()] = handshake;
+    }
+    
+    // The handler holds the handshake, which the map entry or the handover releases
+    utp_socket->set_event_handler([this, handshake](uint32_t) { handle_incoming_utp_handshake(handshake); });
+}
+
+void BitTorrentClient::handle_incoming_utp_handshake(const std::shared_ptr<IncomingUtpHandshake>& handshake) {
+    UtpSocket* utp_socket = handshake->socket.get();
+    
+    // Read no further than the handshake; what follows belongs to the peer connection
+    uint8_t buffer[HANDSHAKE_SIZE];
+    int received = utp_socket->read(buffer, HANDSHAKE_SIZE - handshake->data.size());
+    if (received < 0) {
+        LOG_BT_DEBUG("Incoming uTP connection closed during the handshake");
+        close_incoming_utp_handshake(utp_socket);
+        return;
+    }
+    handshake->data.insert(handshake->data.end(), buffer, buffer + received);
+    if (handshake->data.size() < HANDSHAKE_SIZE) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        if (incoming_utp_handshakes_.erase(utp_socket) == 0) {
+            return;  // Timed out meanwhile
+        }
+    }
+    std::shared_ptr<UtpSocket> socket = handshake->socket;
+    socket->set_event_handler(nullptr);
+    
+    PeerID peer_id;
+    std::vector<uint8_t> response;
+    auto torrent = perform_incoming_handshake(handshake->data, peer_id, response);
+    if (!torrent) {
+        socket->close();
+        return;
+    }
+    
+    // A fresh connection has the whole send buffer free
+    if (socket->write(response.data(), response.size()) != static_cast<int>(response.size())) {
+        LOG_BT_ERROR("Failed to send uTP handshake response");
+        socket->close();
+        return;
+    }
+    
+    Peer peer_info = socket->get_remote_peer();
+    if (torrent->add_incoming_utp_peer(socket, peer_info, peer_id)) {
+        LOG_BT_INFO("Added incoming uTP peer: " << peer_info.ip << ":" << peer_info.port);
+    } else {
+        LOG_BT_WARN("Failed to add incoming uTP peer: " << peer_info.ip << ":" << peer_info.port);
+    }
+}
+
+void BitTorrentClient::close_incoming_utp_handshake(UtpSocket* utp_socket) {
+    std::shared_ptr<IncomingUtpHandshake> handshake;
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex_);
+        auto it = incoming_utp_handshakes_.find(utp_socket);
+        if (it == incoming_utp_handshakes_.end()) {
+            return;  // Already handed over or closed
+        }
+        handshake = it->second;
+        incoming_utp_handshakes_.erase(it);
+    }
+    handshake->socket->set_event_handler(nullptr);
+    handshake->socket->close();
 }
 
 //=============================================================================
@@ -1997,8 +3506,9 @@ std::vector<uint8_t> create_handshake_message(const InfoHash& info_hash, const P
     // Protocol identifier
     std::copy_n(BITTORRENT_PROTOCOL_ID, BITTORRENT_PROTOCOL_ID_LENGTH, handshake.begin() + 1);
     
-    // Reserved bytes (8 bytes of zeros)
+    // Reserved bytes, only the extension protocol bit set
     std::fill_n(handshake.begin() + 20, 8, 0);
+    handshake[20 + EXTENSION_PROTOCOL_BYTE] |= EXTENSION_PROTOCOL_BIT;
     
     // Info hash (20 bytes)
     std::copy(info_hash.begin(), info_hash.end(), handshake.begin() + 28);
@@ -2034,4 +3544,130 @@ bool parse_handshake_message(const std::vector<uint8_t>& data, InfoHash& info_ha
     return true;
 }
 
+bool handshake_supports_extensions(const std::vector<uint8_t>& handshake) {
+    return handshake.size() >= 28 && (handshake[20 + EXTENSION_PROTOCOL_BYTE] & EXTENSION_PROTOCOL_BIT) != 0;
+}
+
+namespace {
+
+std::string decode_uri_component(const std::string& value) {
+    std::string result;
+    result.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '%' && i + 2 < value.size() && std::isxdigit(static_cast<unsigned char>(value[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+            result.push_back(static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        } else if (value[i] == '+') {
+            result.push_back(' ');
+        } else {
+            result.push_back(value[i]);
+        }
+    }
+    return result;
+}
+
+// RFC 4648 base32, as used by older magnet links for the info hash
+bool decode_base32_info_hash(const std::string& text, InfoHash& info_hash) {
+    if (text.size() != 32) {
+        return false;
+    }
+    uint64_t buffer = 0;
+    int bits = 0;
+    size_t out = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a';
+        } else if (c >= '2' && c <= '7') {
+            value = c - '2' + 26;
+        } else {
+            return false;
+        }
+        buffer = (buffer << 5) | static_cast<uint64_t>(value);
+        bits += 5;
+        if (bits >= 8) {
+            bits -= 8;
+            info_hash[out++] = static_cast<uint8_t>((buffer >> bits) & 0xFF);
+        }
+    }
+    return out == info_hash.size();
+}
+
+bool parse_peer_address(const std::string& address, Peer& peer) {
+    size_t colon = address.find_last_of(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
+    }
+    std::string host = address.substr(0, colon);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    int port = 0;
+    try {
+        port = std::stoi(address.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (port <= 0 || port > 65535) {
+        return false;
+    }
+    peer = Peer(host, static_cast<uint16_t>(port));
+    return true;
+}
+
+} // anonymous namespace
+
+bool parse_magnet_link(const std::string& uri, MagnetLink& magnet) {
+    const std::string scheme = "magnet:?";
+    if (uri.compare(0, scheme.size(), scheme) != 0) {
+        return false;
+    }
+    
+    magnet = MagnetLink();
+    bool has_info_hash = false;
+    size_t position = scheme.size();
+    while (position < uri.size()) {
+        size_t end = uri.find('&', position);
+        if (end == std::string::npos) {
+            end = uri.size();
+        }
+        std::string parameter = uri.substr(position, end - position);
+        position = end + 1;
+        
+        size_t equals = parameter.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = parameter.substr(0, equals);
+        std::string value = decode_uri_component(parameter.substr(equals + 1));
+        
+        if (key == "xt" || key.compare(0, 3, "xt.") == 0) {
+            const std::string btih = "urn:btih:";
+            if (has_info_hash || value.compare(0, btih.size(), btih) != 0) {
+                continue;  // Only the first BitTorrent v1 hash is used
+            }
+            std::string hash = value.substr(btih.size());
+            if (hash.size() == 40 && std::all_of(hash.begin(), hash.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; })) {
+                magnet.info_hash = hex_to_info_hash(hash);
+                has_info_hash = true;
+            } else {
+                has_info_hash = decode_base32_info_hash(hash, magnet.info_hash);
+            }
+        } else if (key == "dn") {
+            magnet.name = value;
+        } else if (key == "tr" || key.compare(0, 3, "tr.") == 0) {
+            magnet.trackers.push_back(value);
+        } else if (key == "x.pe") {
+            Peer peer;
+            if (parse_peer_address(value, peer)) {
+                magnet.peers.push_back(peer);
+            }
+        }
+    }
+    return has_info_hash;
+}
+
 } // namespace librats
@@ -5,6 +5,13 @@
 #include "socket.h"
 #include "dht.h"
 #include "logger.h"
+#include "torrent_storage.h"
+#include "bitfield.h"
+#include "piece_picker.h"
+#include "ring_buffer.h"
+#include "reactor.h"
+#include "rate_limiter.h"
+#include "utp.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -20,6 +27,9 @@
 #include <array>
 #include <algorithm>  // Add this for std::all_of
 #include <condition_variable>
+#include <random>
+#include <deque>
+#include <list>
 
 namespace librats {
 
@@ -27,6 +37,7 @@ namespace librats {
 class BitTorrentClient;
 class TorrentDownload;
 class PeerConnection;
+class MetadataFetcher;
 
 // Type aliases
 using InfoHash = std::array<uint8_t, 20>;
@@ -37,15 +48,38 @@ using PeerID = std::array<uint8_t, 20>;
 // Constants
 constexpr size_t BLOCK_SIZE = 16384;  // 16KB standard block size
 constexpr size_t MAX_PIECE_SIZE = 2 * 1024 * 1024;  // 2MB max piece size
-constexpr size_t HANDSHAKE_TIMEOUT_MS = 30000;  // 30 seconds
+constexpr size_t HANDSHAKE_TIMEOUT_MS = 30000;  // 30 seconds, connecting included
+constexpr size_t HANDSHAKE_SIZE = 68;
+constexpr size_t MAX_PEER_MESSAGE_SIZE = 1024 * 1024;  // Larger messages drop the connection
 constexpr size_t REQUEST_TIMEOUT_MS = 60000;    // 60 seconds
-constexpr size_t MAX_REQUESTS_PER_PEER = 10;    // Maximum concurrent requests per peer
+constexpr size_t MAX_REQUESTS_PER_PEER = 10;    // Initial request queue depth per peer
+constexpr size_t MIN_REQUEST_QUEUE_DEPTH = 2;   // Bounds of the adaptive request queue depth
+constexpr size_t MAX_REQUEST_QUEUE_DEPTH = 250;
+constexpr size_t REQUEST_QUEUE_SLACK = 4;       // Requests queued beyond the bandwidth-delay product
+constexpr size_t BLOCK_BUFFER_POOL_SIZE = 64;   // Recycled block buffers kept per torrent
 constexpr size_t MAX_PEERS_PER_TORRENT = 50;    // Maximum peers per torrent
+constexpr size_t DEFAULT_DISK_CACHE_SIZE = 64 * 1024 * 1024;  // Block cache budget shared by all torrents
+constexpr size_t RESUME_SAVE_INTERVAL_MS = 30000;  // Minimum interval between incremental resume file writes
+constexpr size_t UNCHOKE_SLOTS = 4;             // Regular unchokes per torrent, plus one optimistic
+constexpr size_t CHOKE_INTERVAL_MS = 10000;     // Choker round length
+constexpr size_t OPTIMISTIC_UNCHOKE_ROUNDS = 3; // Choker rounds between optimistic unchoke rotations
+constexpr size_t SEED_UNCHOKE_ROUNDS = 3;       // Rounds a peer keeps its slot while we seed
+constexpr size_t BANDWIDTH_TICK_MS = 100;       // Interval at which rate limited peers resume
+constexpr size_t MAX_UPLOAD_REQUESTS = 250;     // Requests queued for upload per peer
 
 // BitTorrent protocol constants
 constexpr uint8_t BITTORRENT_PROTOCOL_ID[] = "BitTorrent protocol";
 constexpr size_t BITTORRENT_PROTOCOL_ID_LENGTH = 19;
 
+// Extension protocol (BEP 10) and metadata exchange (BEP 9)
+constexpr size_t EXTENSION_PROTOCOL_BYTE = 5;       // Reserved handshake byte and bit announcing BEP 10
+constexpr uint8_t EXTENSION_PROTOCOL_BIT = 0x10;
+constexpr uint8_t EXTENDED_HANDSHAKE_ID = 0;
+constexpr uint8_t UT_METADATA_ID = 1;               // Extended message id we assign to ut_metadata
+constexpr size_t METADATA_PIECE_SIZE = 16384;
+constexpr size_t MAX_METADATA_SIZE = 8 * 1024 * 1024;
+constexpr size_t METADATA_CACHE_SIZE = 256;         // Fetched info dictionaries kept by BitTorrentClient
+
 // File information structure
 struct FileInfo {
     std::string path;
@@ -56,24 +90,25 @@ struct FileInfo {
         : path(p), length(len), offset(off) {}
 };
 
-// Piece information
+// Piece information (block data lives in the torrent's TorrentStorage)
 struct PieceInfo {
     PieceIndex index;
     std::array<uint8_t, 20> hash;
     uint32_t length;
     bool verified;
-    std::vector<bool> blocks_downloaded;  // Track which blocks are downloaded
-    std::vector<uint8_t> data;
+    bool hashing;                         // Verification job queued or running
+    Bitfield blocks_downloaded;           // Track which blocks are downloaded
+    Bitfield blocks_requested;            // Blocks requested from some peer and not yet received
     
     PieceInfo(PieceIndex idx, const std::array<uint8_t, 20>& h, uint32_t len)
-        : index(idx), hash(h), length(len), verified(false) {
+        : index(idx), hash(h), length(len), verified(false), hashing(false) {
         uint32_t num_blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
         blocks_downloaded.resize(num_blocks, false);
-        data.resize(length);
+        blocks_requested.resize(num_blocks, false);
     }
     
     bool is_complete() const {
-        return std::all_of(blocks_downloaded.begin(), blocks_downloaded.end(), [](bool b) { return b; });
+        return blocks_downloaded.all();
     }
     
     uint32_t get_num_blocks() const {
@@ -96,6 +131,9 @@ public:
     // Parse torrent from raw data
     bool load_from_data(const std::vector<uint8_t>& data);
     
+    // Parse a bare bencoded info dictionary, e.g. fetched from peers; the info hash is that of these bytes
+    bool load_from_metadata(const std::vector<uint8_t>& metadata);
+    
     // Getters
     const InfoHash& get_info_hash() const { return info_hash_; }
     const std::string& get_name() const { return name_; }
@@ -108,6 +146,7 @@ public:
     const std::vector<std::string>& get_announce_list() const { return announce_list_; }
     bool is_single_file() const { return files_.size() == 1; }
     bool is_private() const { return private_; }
+    const std::vector<uint8_t>& get_metadata() const { return metadata_; }  // Bencoded info dictionary
     
     // Calculate piece length for specific piece
     uint32_t get_piece_length(PieceIndex piece_index) const;
@@ -125,10 +164,14 @@ private:
     std::string announce_;
     std::vector<std::string> announce_list_;
     bool private_;
+    std::vector<uint8_t> metadata_;
     
-    bool parse_info_dict(const BencodeValue& info_dict);
+    // Shared by owning BencodeValue trees and in-place BencodeView documents
+    template<typename Bencode> bool load_from_dict(const Bencode& torrent_data);
+    template<typename Bencode> bool parse_info_dict(const Bencode& info_dict);
+    template<typename Bencode> void build_file_list(const Bencode& info_dict);
     void calculate_info_hash(const BencodeValue& info_dict);
-    void build_file_list(const BencodeValue& info_dict);
+    void calculate_info_hash(const BencodeView& info_dict);
 };
 
 // BitTorrent peer wire protocol message types
@@ -163,11 +206,12 @@ struct PeerMessage {
     static PeerMessage create_interested();
     static PeerMessage create_not_interested();
     static PeerMessage create_have(PieceIndex piece_index);
-    static PeerMessage create_bitfield(const std::vector<bool>& bitfield);
+    static PeerMessage create_bitfield(const Bitfield& bitfield);
     static PeerMessage create_request(PieceIndex piece_index, uint32_t offset, uint32_t length);
     static PeerMessage create_piece(PieceIndex piece_index, uint32_t offset, const std::vector<uint8_t>& data);
     static PeerMessage create_cancel(PieceIndex piece_index, uint32_t offset, uint32_t length);
     static PeerMessage create_port(uint16_t port);
+    static PeerMessage create_extended(uint8_t extended_id, const BencodeValue& message, const std::vector<uint8_t>& data = {});
 };
 
 // Peer request tracking
@@ -182,6 +226,83 @@ struct PeerRequest {
           requested_at(std::chrono::steady_clock::now()) {}
 };
 
+// Adaptive request queue depth of one peer: keeps the bandwidth-delay product
+// (download rate x round-trip time) in flight, plus some slack so the peer never
+// waits for our next request. The rate is sampled over one second windows and
+// the round-trip time is the lowest block latency seen recently, since later
+// blocks of a full pipeline also wait behind the ones queued before them.
+// Not thread safe apart from get_depth(); PeerConnection guards it with its requests mutex.
+class RequestQueueDepth {
+public:
+    RequestQueueDepth();
+    
+    // A requested block of `bytes` arrived `latency` after it was requested
+    void on_block_received(size_t bytes, std::chrono::steady_clock::duration latency,
+                           std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+    
+    // Restart the rate window, e.g. when requests start after the pipeline was idle
+    void on_pipeline_started(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+    
+    size_t get_depth() const { return depth_.load(); }
+    double get_download_rate() const { return download_rate_; }  // Bytes per second
+    double get_rtt_ms() const { return rtt_ms_; }
+    
+private:
+    std::atomic<size_t> depth_;
+    double download_rate_;
+    double rtt_ms_;
+    std::chrono::steady_clock::time_point rtt_updated_at_;
+    
+    // Current rate sampling window
+    std::chrono::steady_clock::time_point window_start_;
+    uint64_t window_bytes_;
+    double window_min_latency_ms_;
+    
+    void update_depth();
+};
+
+// Tit-for-tat choker (BEP 3), run once per round. While downloading, the
+// interested peers that sent us the most over the last round get the regular
+// slots; while seeding, slots rotate round robin so every interested peer is
+// served in turn, keeping its slot for SEED_UNCHOKE_ROUNDS. One more slot goes
+// to an optimistic unchoke, rotated every OPTIMISTIC_UNCHOKE_ROUNDS rounds, so
+// new peers get a chance to prove themselves.
+// Not thread safe; TorrentDownload only runs it from its peer management thread.
+class Choker {
+public:
+    struct Candidate {
+        uint64_t id;              // Stable for the lifetime of the peer
+        bool interested;          // Peer is interested in our pieces
+        uint64_t downloaded;      // Cumulative bytes received from the peer
+        uint64_t uploaded;        // Cumulative bytes sent to the peer
+    };
+    
+    explicit Choker(size_t unchoke_slots = UNCHOKE_SLOTS, size_t optimistic_rounds = OPTIMISTIC_UNCHOKE_ROUNDS);
+    
+    // Ids of the candidates to unchoke this round; all others are choked
+    std::vector<uint64_t> run_round(const std::vector<Candidate>& candidates, bool seeding);
+    
+    uint64_t get_optimistic_unchoke() const { return optimistic_id_; }  // 0 if none
+    
+private:
+    struct PeerStats {
+        uint64_t downloaded = 0;
+        uint64_t uploaded = 0;
+        uint64_t download_rate = 0;   // Bytes over the last round
+        uint64_t upload_rate = 0;
+        bool unchoked = false;        // Regular slot in the last round
+        size_t unchoked_rounds = 0;   // Consecutive rounds in a regular slot
+        size_t last_unchoked_round = 0;
+    };
+    
+    size_t unchoke_slots_;
+    size_t optimistic_rounds_;
+    size_t round_;
+    uint64_t optimistic_id_;
+    std::unordered_map<uint64_t, PeerStats> stats_;
+    std::mt19937 rng_;
+};
+
 // Peer connection state
 enum class PeerState {
     CONNECTING,
@@ -191,21 +312,33 @@ enum class PeerState {
     ERROR
 };
 
-// Individual peer connection for BitTorrent protocol
-class PeerConnection {
+// Individual peer connection for BitTorrent protocol. The socket is non-blocking
+// and driven by the torrent's IoReactor: received bytes collect in a ring buffer
+// that complete messages are parsed from in place, and outgoing messages queue
+// in a send buffer drained whenever the socket is writable.
+class PeerConnection : public std::enable_shared_from_this<PeerConnection> {
 public:
     PeerConnection(TorrentDownload* torrent, const Peer& peer_info, socket_t socket = INVALID_SOCKET_VALUE);
+    PeerConnection(TorrentDownload* torrent, const Peer& peer_info, std::shared_ptr<UtpSocket> utp_socket);  // uTP transport
     ~PeerConnection();
     
     // Connection management
-    bool connect();
+    bool connect();                          // Outgoing: non-blocking connect, then handshake
+    bool accept(const PeerID& peer_id);     // Incoming: socket whose handshake was already exchanged
     void disconnect();
     bool is_connected() const { return state_ == PeerState::CONNECTED; }
+    bool is_closed() const { return state_ == PeerState::DISCONNECTED || state_ == PeerState::ERROR; }
     PeerState get_state() const { return state_; }
     
+    // Periodic housekeeping: connect/handshake and request timeouts
+    void on_tick();
+    
+    // Resume reading or writing paused by a rate limit once bandwidth is available again
+    void on_bandwidth_tick();
+    void set_rate_limits(uint64_t download_rate, uint64_t upload_rate);  // Bytes per second, 0 = unlimited
+    
     // Message handling
     bool send_message(const PeerMessage& message);
-    void process_messages();
     
     // Piece requests
     bool request_piece_block(PieceIndex piece_index, uint32_t offset, uint32_t length);
@@ -221,77 +354,112 @@ public:
     void set_interested(bool interested);
     void set_choke(bool choke);
     
-    // Bitfield management
+    // Bitfield management (updated on the reactor thread, so read a copy)
     bool has_piece(PieceIndex piece_index) const;
-    const std::vector<bool>& get_bitfield() const { return peer_bitfield_; }
-    void update_bitfield(const std::vector<bool>& bitfield);
+    Bitfield get_bitfield() const;
+    void update_bitfield(const Bitfield& bitfield);
     
     // Statistics
     uint64_t get_downloaded() const { return downloaded_bytes_; }
     uint64_t get_uploaded() const { return uploaded_bytes_; }
     size_t get_pending_requests() const { return pending_requests_.size(); }
+    size_t get_request_queue_depth() const { return request_queue_.get_depth(); }
+    bool has_pending_request(PieceIndex piece_index, uint32_t offset);
     
     // Peer info
     const Peer& get_peer_info() const { return peer_info_; }
     const PeerID& get_peer_id() const { return peer_id_; }
+    bool is_utp() const { return utp_; }
     
 private:
     TorrentDownload* torrent_;
     Peer peer_info_;
     socket_t socket_;
-    PeerState state_;
-    std::thread connection_thread_;
-    std::atomic<bool> should_disconnect_;
-    
-    // Conditional variables for immediate shutdown
-    std::condition_variable shutdown_cv_;
-    std::mutex shutdown_mutex_;
+    std::shared_ptr<UtpSocket> utp_socket_;  // Used instead of socket_ for uTP peers, guarded the same way
+    const bool utp_;
+    std::atomic<PeerState> state_;
+    std::chrono::steady_clock::time_point state_changed_at_;  // Guarded by io_mutex_
+    bool closed_;                            // Torrent notified of the disconnect
+    
+    // Socket I/O: io_mutex_ serializes reactor events with disconnect(),
+    // send_mutex_ guards the send buffer and the socket handle for writers
+    std::mutex io_mutex_;
+    std::mutex send_mutex_;
+    RingBuffer receive_buffer_;
+    RingBuffer send_buffer_;
+    uint32_t socket_events_;                 // Interest set registered with the reactor
+    
+    // Rate limiting and uploads; the flags and the upload queue are guarded by send_mutex_
+    TokenBucket download_limiter_;
+    TokenBucket upload_limiter_;
+    bool read_throttled_;
+    bool write_throttled_;
+    std::deque<PeerRequest> upload_requests_;  // Blocks the peer asked for, read as the send buffer drains
     
     // Peer state
     PeerID peer_id_;
-    bool peer_choked_;
+    std::atomic<bool> peer_choked_;
     bool am_choked_;
-    bool peer_interested_;
-    bool am_interested_;
-    bool am_choking_;
-    std::vector<bool> peer_bitfield_;
+    std::atomic<bool> peer_interested_;
+    std::atomic<bool> am_interested_;
+    std::atomic<bool> am_choking_;
+    Bitfield peer_bitfield_;
+    mutable std::mutex bitfield_mutex_;
+    
+    // Extension protocol, guarded by io_mutex_
+    bool peer_supports_extensions_;          // Reserved bit of the peer's handshake
+    bool extended_handshake_sent_;
+    uint8_t peer_ut_metadata_id_;            // 0 if the peer does not take ut_metadata messages
     
     // Request tracking
     std::vector<PeerRequest> pending_requests_;
+    RequestQueueDepth request_queue_;
     std::mutex requests_mutex_;
     
     // Statistics
     std::atomic<uint64_t> downloaded_bytes_;
     std::atomic<uint64_t> uploaded_bytes_;
     
-    // Message buffer
-    std::vector<uint8_t> message_buffer_;
-    size_t expected_message_length_;
-    
-    void connection_loop();
-    bool perform_handshake();
+    PeerConnection(TorrentDownload* torrent, const Peer& peer_info, socket_t socket, std::shared_ptr<UtpSocket> utp_socket);
+    bool register_with_reactor(uint32_t events);
+    bool has_transport() const { return is_valid_socket(socket_) || utp_socket_ != nullptr; }
+    int transport_receive(uint8_t* buffer, size_t size);
+    int transport_send(const uint8_t* data, size_t size);
+    void on_socket_event(uint32_t events);
+    bool on_connect_complete();
+    bool on_readable(bool force);
+    void close_locked(PeerState state);
+    void set_state(PeerState state);
+    
+    // Handshake
     bool send_handshake();
-    bool receive_handshake();
+    bool receive_handshake(const uint8_t* data);
+    void on_handshake_complete();
     
-    // Message parsing
-    std::unique_ptr<PeerMessage> parse_message(const std::vector<uint8_t>& data);
-    void handle_message(const PeerMessage& message);
+    // Message parsing, straight from the receive buffer
+    bool parse_message(bool& parsed);
+    void handle_message(MessageType type, const uint8_t* payload, size_t size);
     
     // Specific message handlers
     void handle_choke();
     void handle_unchoke();
     void handle_interested();
     void handle_not_interested();
-    void handle_have(const std::vector<uint8_t>& payload);
-    void handle_bitfield(const std::vector<uint8_t>& payload);
-    void handle_request(const std::vector<uint8_t>& payload);
-    void handle_piece(const std::vector<uint8_t>& payload);
-    void handle_cancel(const std::vector<uint8_t>& payload);
+    void handle_have(const uint8_t* payload, size_t size);
+    void handle_bitfield(const uint8_t* payload, size_t size);
+    void handle_request(const uint8_t* payload, size_t size);
+    void handle_piece(const uint8_t* payload, size_t size);
+    void handle_cancel(const uint8_t* payload, size_t size);
+    void handle_extended(const uint8_t* payload, size_t size);
+    void handle_metadata_request(const BencodeValue& message);
+    void send_extended_handshake();
     
     // Utility
     void cleanup_expired_requests();
-    bool read_data(std::vector<uint8_t>& buffer, size_t length);
     bool write_data(const std::vector<uint8_t>& data);
+    bool flush_send_buffer_locked();
+    void fill_send_buffer_locked();
+    void update_socket_events_locked();
 };
 
 // Download progress callback types
@@ -304,9 +472,16 @@ using PeerDisconnectedCallback = std::function<void(const Peer& peer)>;
 // Individual torrent download
 class TorrentDownload {
 public:
-    TorrentDownload(const TorrentInfo& torrent_info, const std::string& download_path);
+    TorrentDownload(const TorrentInfo& torrent_info, const std::string& download_path,
+                    std::shared_ptr<BlockCacheBudget> cache_budget = nullptr,
+                    std::shared_ptr<PieceHashPool> hash_pool = nullptr,
+                    std::shared_ptr<IoReactor> reactor = nullptr);
     ~TorrentDownload();
     
+    // Storage backend (defaults to DiskTorrentStorage); replace before start()
+    void set_storage(std::unique_ptr<TorrentStorage> storage);
+    TorrentStorage* get_storage() const { return storage_.get(); }
+    
     // Control
     bool start();
     void stop();
@@ -314,10 +489,28 @@ public:
     void resume();
     bool is_running() const { return running_; }
     bool is_paused() const { return paused_; }
+    bool is_checking() const { return checking_; }
     bool is_complete() const;
     
-    // Peer management
+    // Fast resume: completed pieces, file sizes/mtimes and partial pieces, one file per info hash.
+    // start() loads it; without valid resume data, existing files are rechecked instead.
+    void set_resume_directory(const std::string& directory) { resume_directory_ = directory; }
+    std::string get_resume_file_path() const;
+    bool save_resume_data();
+    bool load_resume_data();
+    
+    // Hash every piece of the opened storage in parallel; returns the number of valid pieces
+    uint32_t recheck();
+    
+    // Peer management; peer sockets are driven by the reactor (a private one unless the client shares its own)
     bool add_peer(const Peer& peer);
+    bool add_incoming_peer(socket_t socket, const Peer& peer, const PeerID& peer_id);
+    
+    // uTP peers run over a UtpManager (the client's on its listen port; set before adding
+    // peers, otherwise the torrent starts one of its own on an ephemeral port)
+    void set_utp_manager(std::shared_ptr<UtpManager> utp_manager);
+    bool add_utp_peer(const Peer& peer);
+    bool add_incoming_utp_peer(std::shared_ptr<UtpSocket> utp_socket, const Peer& peer, const PeerID& peer_id);
     void remove_peer(const Peer& peer);
     size_t get_peer_count() const;
     std::vector<Peer> get_connected_peers() const;
@@ -326,11 +519,47 @@ public:
     bool is_piece_complete(PieceIndex piece_index) const;
     bool is_piece_downloading(PieceIndex piece_index) const;
     std::vector<PieceIndex> get_available_pieces() const;
-    std::vector<PieceIndex> get_needed_pieces(const std::vector<bool>& peer_bitfield) const;
-    
-    // Piece data handling
-    bool store_piece_block(PieceIndex piece_index, uint32_t offset, const std::vector<uint8_t>& data);
+    std::vector<PieceIndex> get_needed_pieces(const Bitfield& peer_bitfield) const;
+    
+    // Piece selection: rarest first within priority, optionally sequential for streaming.
+    // A piece shared by several files gets the highest of their priorities.
+    void set_piece_priority(PieceIndex piece_index, uint8_t priority);
+    void set_file_priority(size_t file_index, uint8_t priority);
+    void set_sequential_download(bool sequential);
+    bool is_endgame() const;
+    
+    // Piece availability, reported by peer connections
+    void on_peer_have(PieceIndex piece_index);
+    void on_peer_bitfield(const Bitfield& old_bitfield, const Bitfield& new_bitfield);
+    
+    // Block requests of a peer that will not be answered (timeout, choke, disconnect)
+    void on_block_requests_cancelled(const std::vector<PeerRequest>& requests);
+    
+    // Rate limits in bytes per second (0 = unlimited). Peer traffic has to pass the
+    // client-wide buckets (set before start()), the torrent's and its own together.
+    void set_global_rate_limiters(std::shared_ptr<TokenBucket> download, std::shared_ptr<TokenBucket> upload);
+    void set_download_rate_limit(uint64_t bytes_per_second) { download_limiter_.set_rate(bytes_per_second); }
+    void set_upload_rate_limit(uint64_t bytes_per_second) { upload_limiter_.set_rate(bytes_per_second); }
+    uint64_t get_download_rate_limit() const { return download_limiter_.get_rate(); }
+    uint64_t get_upload_rate_limit() const { return upload_limiter_.get_rate(); }
+    void set_peer_rate_limits(uint64_t download_rate, uint64_t upload_rate);
+    
+    // Bandwidth available to a peer right now, and accounting for what it transferred
+    size_t get_download_quota(TokenBucket& peer_limiter, size_t max_bytes);
+    size_t get_upload_quota(TokenBucket& peer_limiter, size_t max_bytes);
+    void consume_download_quota(TokenBucket& peer_limiter, size_t bytes);
+    void consume_upload_quota(TokenBucket& peer_limiter, size_t bytes);
+    
+    // Read a block of a verified piece to send to a peer
+    bool read_block_for_upload(PieceIndex piece_index, uint32_t offset, uint8_t* buffer, size_t size);
+    
+    // Piece data handling; with a hash pool, completed pieces are verified asynchronously
+    bool store_piece_block(PieceIndex piece_index, uint32_t offset, const uint8_t* data, size_t size);
+    bool store_piece_block(PieceIndex piece_index, uint32_t offset, const std::vector<uint8_t>& data) {
+        return store_piece_block(piece_index, offset, data.data(), data.size());
+    }
     bool verify_piece(PieceIndex piece_index);
+    void wait_for_verification();
     void write_piece_to_disk(PieceIndex piece_index);
     
     // Statistics and progress
@@ -338,7 +567,7 @@ public:
     uint64_t get_uploaded_bytes() const;
     double get_progress_percentage() const;
     uint32_t get_completed_pieces() const;
-    std::vector<bool> get_piece_bitfield() const;
+    Bitfield get_piece_bitfield() const;
     
     // Callbacks
     void set_progress_callback(ProgressCallback callback) { progress_callback_ = callback; }
@@ -350,6 +579,7 @@ public:
     // Torrent info access
     const TorrentInfo& get_torrent_info() const { return torrent_info_; }
     const std::string& get_download_path() const { return download_path_; }
+    IoReactor* get_reactor() const { return reactor_.get(); }
     
     // DHT integration
     void announce_to_dht(DhtClient* dht_client);
@@ -360,16 +590,30 @@ private:
     std::string download_path_;
     std::atomic<bool> running_;
     std::atomic<bool> paused_;
+    std::atomic<bool> checking_;
+    std::shared_ptr<IoReactor> reactor_;
     
     // Piece management
     std::vector<std::unique_ptr<PieceInfo>> pieces_;
-    std::vector<bool> piece_completed_;
-    std::vector<bool> piece_downloading_;
+    Bitfield piece_completed_;
+    Bitfield piece_downloading_;
+    PiecePicker picker_;
+    std::vector<uint8_t> file_priorities_;
     mutable std::mutex pieces_mutex_;
     
     // Peer connections
-    std::vector<std::unique_ptr<PeerConnection>> peer_connections_;
+    std::vector<std::shared_ptr<PeerConnection>> peer_connections_;
     mutable std::mutex peers_mutex_;
+    Choker choker_;
+    std::shared_ptr<UtpManager> utp_manager_;      // Guarded by peers_mutex_
+    
+    // Rate limiting
+    std::shared_ptr<TokenBucket> global_download_limiter_;
+    std::shared_ptr<TokenBucket> global_upload_limiter_;
+    TokenBucket download_limiter_;
+    TokenBucket upload_limiter_;
+    std::atomic<uint64_t> peer_download_limit_;
+    std::atomic<uint64_t> peer_upload_limit_;
     
     // Download management
     std::thread download_thread_;
@@ -380,8 +624,18 @@ private:
     std::mutex shutdown_mutex_;
     
     // File handling
-    std::vector<std::fstream> file_handles_;
-    mutable std::mutex files_mutex_;
+    std::unique_ptr<TorrentStorage> storage_;
+    
+    // Piece verification (pending_hash_jobs_ guarded by pieces_mutex_)
+    std::shared_ptr<PieceHashPool> hash_pool_;
+    size_t pending_hash_jobs_;
+    std::condition_variable hash_jobs_cv_;
+    
+    // Resume data
+    std::string resume_directory_;
+    std::mutex resume_mutex_;
+    std::chrono::steady_clock::time_point last_resume_save_;
+    bool recheck_on_start_;
     
     // Callbacks
     ProgressCallback progress_callback_;
@@ -398,19 +652,26 @@ private:
     void peer_management_loop();
     void schedule_piece_requests();
     void cleanup_disconnected_peers();
+    void disconnect_all_peers();
+    bool can_add_peer_locked(const Peer& peer) const;
+    bool add_connection_locked(std::shared_ptr<PeerConnection> peer_conn, const PeerID* incoming_peer_id);
+    void run_choker();
     
     // File operations
     bool open_files();
     void close_files();
     bool create_directory_structure();
+    bool has_existing_files() const;
     
     // Piece selection strategy
-    std::vector<PieceIndex> select_pieces_for_download();
-    PieceIndex select_rarest_piece(const std::vector<bool>& available_pieces);
+    std::vector<PieceIndex> select_pieces_for_download(const Bitfield& peer_bitfield);
+    std::vector<PeerRequest> select_blocks_for_download(PeerConnection& peer, size_t max_blocks);
+    PieceIndex select_rarest_piece(const Bitfield& available_pieces);
     
     // Progress tracking
     void update_progress();
     void on_piece_completed(PieceIndex piece_index);
+    void on_piece_verified(PieceIndex piece_index, bool verified);
     void check_torrent_completion();
 };
 
@@ -437,18 +698,36 @@ public:
     DhtClient* get_dht_client() const { return dht_client_; }
     
     // Peer discovery from DHT
-    void discover_peers_for_torrent(const InfoHash& info_hash);
+    void discover_peers_for_torrent(const InfoHash& info_hash);  // Also feeds a metadata fetch in progress
     void announce_torrent_to_dht(const InfoHash& info_hash);
     
+    // Metadata (BEP 9) for torrents known only by info hash. Pieces are fetched in
+    // parallel from the given peers plus any the DHT finds; results are cached, so
+    // a repeated lookup calls back right away. The callback runs on a reactor thread,
+    // or inline on a cache hit; stop() fails the fetches still running.
+    using MetadataCallback = std::function<void(const TorrentInfo& torrent_info, bool success)>;
+    bool fetch_metadata(const InfoHash& info_hash, MetadataCallback callback, const std::vector<Peer>& peers = {});
+    bool get_cached_metadata(const InfoHash& info_hash, TorrentInfo& torrent_info);
+    size_t get_metadata_fetch_count() const;
+    
+    // Fetch the metadata of a magnet link, then add the torrent (nullptr on failure)
+    bool add_magnet(const std::string& magnet_uri, const std::string& download_path,
+                    std::function<void(std::shared_ptr<TorrentDownload>)> callback = nullptr);
+    
     // Statistics
     size_t get_active_torrents_count() const;
     uint64_t get_total_downloaded() const;
     uint64_t get_total_uploaded() const;
     
     // Configuration
+    void set_disk_cache_size(size_t bytes) { cache_budget_->set_limit(bytes); }
+    size_t get_disk_cache_size() const { return cache_budget_->get_limit(); }
+    void set_resume_directory(const std::string& directory) { resume_directory_ = directory; }  // Default: download path
     void set_max_connections_per_torrent(size_t max_connections) { max_connections_per_torrent_ = max_connections; }
-    void set_download_rate_limit(uint64_t bytes_per_second) { download_rate_limit_ = bytes_per_second; }
-    void set_upload_rate_limit(uint64_t bytes_per_second) { upload_rate_limit_ = bytes_per_second; }
+    void set_download_rate_limit(uint64_t bytes_per_second) { download_limiter_->set_rate(bytes_per_second); }
+    void set_upload_rate_limit(uint64_t bytes_per_second) { upload_limiter_->set_rate(bytes_per_second); }
+    uint64_t get_download_rate_limit() const { return download_limiter_->get_rate(); }
+    uint64_t get_upload_rate_limit() const { return upload_limiter_->get_rate(); }
     
     // Callbacks for torrent events
     void set_torrent_added_callback(std::function<void(const InfoHash&)> callback) { torrent_added_callback_ = callback; }
@@ -467,17 +746,46 @@ private:
     // DHT integration
     DhtClient* dht_client_;
     
-    // Networking
-    std::thread incoming_connections_thread_;
-    
-    // Conditional variables for immediate shutdown
-    std::condition_variable shutdown_cv_;
-    std::mutex shutdown_mutex_;
+    // Block cache budget and piece hashing threads shared by all torrents
+    std::shared_ptr<BlockCacheBudget> cache_budget_;
+    std::shared_ptr<PieceHashPool> hash_pool_;
+    std::string resume_directory_;
+    
+    // Networking: the listen socket, incoming handshakes and every peer connection share one reactor
+    std::shared_ptr<IoReactor> reactor_;
+    
+    // Accepted connections until their handshake names the torrent they are for
+    struct IncomingHandshake {
+        socket_t socket;
+        std::vector<uint8_t> data;
+        std::chrono::steady_clock::time_point accepted_at;
+    };
+    std::unordered_map<socket_t, std::shared_ptr<IncomingHandshake>> incoming_handshakes_;
+    std::mutex incoming_mutex_;
+    
+    // uTP on the listen port (UDP), with its own handshakes in progress
+    std::shared_ptr<UtpManager> utp_manager_;
+    struct IncomingUtpHandshake {
+        std::shared_ptr<UtpSocket> socket;
+        std::vector<uint8_t> data;
+        std::chrono::steady_clock::time_point accepted_at;
+    };
+    std::unordered_map<UtpSocket*, std::shared_ptr<IncomingUtpHandshake>> incoming_utp_handshakes_;  // Guarded by incoming_mutex_
+    
+    // Metadata fetches in progress and the least recently used results, newest first
+    struct MetadataFetch {
+        std::shared_ptr<MetadataFetcher> fetcher;
+        std::vector<MetadataCallback> callbacks;
+    };
+    std::map<InfoHash, MetadataFetch> metadata_fetches_;
+    std::list<std::pair<InfoHash, TorrentInfo>> metadata_cache_;
+    std::map<InfoHash, std::list<std::pair<InfoHash, TorrentInfo>>::iterator> metadata_cache_index_;
+    mutable std::mutex metadata_mutex_;
     
     // Configuration
     size_t max_connections_per_torrent_;
-    uint64_t download_rate_limit_;
-    uint64_t upload_rate_limit_;
+    std::shared_ptr<TokenBucket> download_limiter_;  // Shared by all torrents
+    std::shared_ptr<TokenBucket> upload_limiter_;
     
     // Callbacks
     std::function<void(const InfoHash&)> torrent_added_callback_;
@@ -486,7 +794,18 @@ private:
     
     void handle_incoming_connections();
     void handle_incoming_connection(socket_t client_socket);
-    bool perform_incoming_handshake(socket_t socket, InfoHash& info_hash, PeerID& peer_id);
+    void handle_incoming_handshake(const std::shared_ptr<IncomingHandshake>& handshake);
+    std::shared_ptr<TorrentDownload> perform_incoming_handshake(const std::vector<uint8_t>& handshake_data, PeerID& peer_id,
+                                                                std::vector<uint8_t>& response);
+    void close_incoming_handshake(socket_t socket);
+    void handle_incoming_utp_connection(std::shared_ptr<UtpSocket> utp_socket);
+    void handle_incoming_utp_handshake(const std::shared_ptr<IncomingUtpHandshake>& handshake);
+    void close_incoming_utp_handshake(UtpSocket* utp_socket);
+    void check_incoming_handshake_timeouts();
+    void check_metadata_fetches();
+    void request_metadata_peers_from_dht(const InfoHash& info_hash);
+    void on_metadata_fetched(const InfoHash& info_hash, const TorrentInfo& torrent_info, bool success);
+    bool find_metadata_locked(const InfoHash& info_hash, TorrentInfo& torrent_info);
     
     // DHT callbacks
     void on_dht_peers_discovered(const std::vector<Peer>& peers, const InfoHash& info_hash);
@@ -499,5 +818,15 @@ InfoHash hex_to_info_hash(const std::string& hex);
 PeerID generate_peer_id();
 std::vector<uint8_t> create_handshake_message(const InfoHash& info_hash, const PeerID& peer_id);
 bool parse_handshake_message(const std::vector<uint8_t>& data, InfoHash& info_hash, PeerID& peer_id);
+bool handshake_supports_extensions(const std::vector<uint8_t>& handshake);
+
+// Parsed magnet URI (BEP 9): xt=urn:btih:<hex or base32>, dn, tr and x.pe
+struct MagnetLink {
+    InfoHash info_hash{};
+    std::string name;
+    std::vector<std::string> trackers;
+    std::vector<Peer> peers;
+};
+bool parse_magnet_link(const std::string& uri, MagnetLink& magnet);
 
 } // namespace librats 
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace librats {
+
+/**
+ * SharedBuffer - immutable, reference-counted view into a byte buffer.
+ *
+ * Copies share the underlying storage and slicing never copies bytes, so a single
+ * receive buffer can be framed, header-stripped and handed to user callbacks.
+ * Holding a SharedBuffer keeps the bytes alive.
+ */
+class SharedBuffer {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    SharedBuffer() : offset_(0), size_(0) {}
+
+    /**
+     * Take ownership of a vector without copying it
+     * @param data Bytes to wrap
+     */
+    explicit SharedBuffer(std::vector<uint8_t>&& data)
+        : storage_(std::make_shared<const std::vector<uint8_t>>(std::move(data))),
+          offset_(0),
+          size_(storage_->size()) {}
+
+    /**
+     * Create a view into existing shared storage
+     * @param storage Underlying storage
+     * @param offset Start of the view within storage
+     * @param size Length of the view
+     */
+    SharedBuffer(std::shared_ptr<const std::vector<uint8_t>> storage, size_t offset, size_t size)
+        : storage_(std::move(storage)), offset_(offset), size_(size) {}
+
+    /**
+     * Create a buffer holding a copy of the given bytes
+     * @param data Bytes to copy
+     * @param size Number of bytes
+     * @return New buffer owning the copy
+     */
+    static SharedBuffer copy_of(const uint8_t* data, size_t size) {
+        return SharedBuffer(std::vector<uint8_t>(data, data + size));
+    }
+
+    const uint8_t* data() const { return storage_ ? storage_->data() + offset_ : nullptr; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const uint8_t* begin() const { return data(); }
+    const uint8_t* end() const { return data() + size_; }
+
+    uint8_t operator[](size_t index) const { return data()[index]; }
+
+    /**
+     * Get a sub-view sharing the same storage
+     * @param offset Start of the sub-view relative to this view (clamped to size)
+     * @param length Length of the sub-view (npos = up to the end)
+     * @return Sub-view
+     */
+    SharedBuffer slice(size_t offset, size_t length = npos) const {
+        if (offset > size_) {
+            offset = size_;
+        }
+        if (length == npos || length > size_ - offset) {
+            length = size_ - offset;
+        }
+        return SharedBuffer(storage_, offset_ + offset, length);
+    }
+
+    /**
+     * Copy the viewed bytes into a vector
+     * @return Copy of the bytes
+     */
+    std::vector<uint8_t> to_vector() const {
+        return std::vector<uint8_t>(begin(), end());
+    }
+
+    /**
+     * Copy the viewed bytes into a string
+     * @return Copy of the bytes
+     */
+    std::string to_string() const {
+        return size_ == 0 ? std::string() : std::string(reinterpret_cast<const char*>(data()), size_);
+    }
+
+    /**
+     * Check if the view starts with the given bytes
+     * @param prefix Bytes to compare
+     * @param length Number of bytes
+     * @return true if the view starts with prefix
+     */
+    bool starts_with(const void* prefix, size_t length) const {
+        return size_ >= length && std::memcmp(data(), prefix, length) == 0;
+    }
+
+    /**
+     * Get the storage shared by this view
+     * @return Underlying storage (may be null for an empty buffer)
+     */
+    const std::shared_ptr<const std::vector<uint8_t>>& storage() const { return storage_; }
+
+private:
+    std::shared_ptr<const std::vector<uint8_t>> storage_;
+    size_t offset_;
+    size_t size_;
+};
+
+} // namespace librats
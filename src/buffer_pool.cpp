@@ -0,0 +1,163 @@
+#include "buffer_pool.h"
+#include <cstring>
+
+namespace librats {
+
+BufferPool& BufferPool::getInstance() {
+    // Intentionally leaked: pooled buffers may outlive other statics
+    static BufferPool* instance = new BufferPool();
+    return *instance;
+}
+
+BufferPool::BufferPool()
+    : reserved_count_(0),
+      max_cached_bytes_(DEFAULT_MAX_CACHED_BYTES),
+      cached_bytes_(0),
+      cached_buffers_(0),
+      hits_(0),
+      misses_(0) {
+    for (size_t i = 0; i < POWER_CLASS_COUNT; ++i) {
+        classes_[i].size = MIN_CLASS_SIZE << i;
+    }
+}
+
+int BufferPool::find_class(size_t size) const {
+    if (size > MAX_CLASS_SIZE) {
+        return -1;
+    }
+
+    int best = -1;
+    size_t power_size = MIN_CLASS_SIZE;
+    for (size_t i = 0; i < POWER_CLASS_COUNT; ++i, power_size <<= 1) {
+        if (size <= power_size) {
+            best = static_cast<int>(i);
+            break;
+        }
+    }
+
+    // A reserved class wins if it is a tighter fit
+    size_t reserved = reserved_count_.load(std::memory_order_acquire);
+    for (size_t i = POWER_CLASS_COUNT; i < POWER_CLASS_COUNT + reserved; ++i) {
+        size_t class_size = classes_[i].size;
+        if (size <= class_size && (best < 0 || class_size < classes_[best].size)) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+std::shared_ptr<std::vector<uint8_t>> BufferPool::acquire(size_t size) {
+    int index = find_class(size);
+    if (index < 0) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::make_shared<std::vector<uint8_t>>(size);
+    }
+
+    SizeClass& size_class = classes_[index];
+    std::vector<uint8_t>* buffer = nullptr;
+    size_t first = thread_shard();
+    for (size_t i = 0; i < FREE_LIST_SHARDS && !buffer; ++i) {
+        FreeList& list = size_class.shards[(first + i) % FREE_LIST_SHARDS];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        if (!list.buffers.empty()) {
+            buffer = list.buffers.back();
+            list.buffers.pop_back();
+        }
+    }
+
+    if (buffer) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        cached_bytes_.fetch_sub(size_class.size, std::memory_order_relaxed);
+        cached_buffers_.fetch_sub(1, std::memory_order_relaxed);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        buffer = new std::vector<uint8_t>(size_class.size);
+    }
+
+    size_t class_index = static_cast<size_t>(index);
+    return std::shared_ptr<std::vector<uint8_t>>(buffer, [class_index](std::vector<uint8_t>* released) {
+        BufferPool::getInstance().release(released, class_index);
+    });
+}
+
+void BufferPool::release(std::vector<uint8_t>* buffer, size_t class_index) {
+    SizeClass& size_class = classes_[class_index];
+    size_t limit = max_cached_bytes_.load(std::memory_order_relaxed);
+    if (cached_bytes_.fetch_add(size_class.size, std::memory_order_relaxed) + size_class.size > limit) {
+        cached_bytes_.fetch_sub(size_class.size, std::memory_order_relaxed);
+        delete buffer;
+        return;
+    }
+
+    FreeList& list = size_class.shards[thread_shard()];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    list.buffers.push_back(buffer);
+    cached_buffers_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t BufferPool::thread_shard() {
+    // Threads take shards round robin, so up to FREE_LIST_SHARDS threads never share one
+    static std::atomic<size_t> next_shard(0);
+    thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % FREE_LIST_SHARDS;
+    return shard;
+}
+
+SharedBuffer BufferPool::copy_of(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return SharedBuffer();
+    }
+    auto storage = acquire(size);
+    std::memcpy(storage->data(), data, size);
+    return SharedBuffer(std::move(storage), 0, size);
+}
+
+bool BufferPool::reserve_size_class(size_t size) {
+    if (size == 0 || size > MAX_CLASS_SIZE) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(reserve_mutex_);
+    int existing = find_class(size);
+    if (existing >= 0 && classes_[existing].size == size) {
+        return true;
+    }
+    size_t reserved = reserved_count_.load(std::memory_order_relaxed);
+    if (reserved == MAX_RESERVED_CLASSES) {
+        return false;
+    }
+    classes_[POWER_CLASS_COUNT + reserved].size = size;
+    reserved_count_.store(reserved + 1, std::memory_order_release);
+    return true;
+}
+
+void BufferPool::set_max_cached_bytes(size_t bytes) {
+    max_cached_bytes_.store(bytes, std::memory_order_relaxed);
+}
+
+BufferPool::Stats BufferPool::get_stats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.cached_buffers = cached_buffers_.load(std::memory_order_relaxed);
+    stats.cached_bytes = cached_bytes_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void BufferPool::clear() {
+    for (auto& size_class : classes_) {
+        for (auto& list : size_class.shards) {
+            std::vector<std::vector<uint8_t>*> buffers;
+            {
+                std::lock_guard<std::mutex> lock(list.mutex);
+                buffers.swap(list.buffers);
+            }
+            for (auto* buffer : buffers) {
+                cached_bytes_.fetch_sub(size_class.size, std::memory_order_relaxed);
+                cached_buffers_.fetch_sub(1, std::memory_order_relaxed);
+                delete buffer;
+            }
+        }
+    }
+}
+
+} // namespace librats
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "buffer.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace librats {
+
+/**
+ * BufferPool - recycles byte buffers by size class.
+ *
+ * Buffers are handed out as shared storage whose deleter puts the vector back on
+ * its class' free list instead of freeing it, so a frame buffer lives on through
+ * SharedBuffer slices and user callbacks and is reused once the last view drops.
+ * Classes are the powers of two from MIN_CLASS_SIZE to MAX_CLASS_SIZE, plus up to
+ * MAX_RESERVED_CLASSES exact sizes registered for hot paths (file transfer chunk
+ * frames), which would otherwise waste almost half of a power-of-two class.
+ *
+ * Each class keeps FREE_LIST_SHARDS free lists. A thread releases to and acquires
+ * from its own list, falling back to the others only when it is empty, so I/O
+ * threads recycling buffers in parallel rarely share a lock or a cache line.
+ *
+ * Requests above the largest class are allocated normally and never cached.
+ * Pooled storage is at least the requested size; views carry the real length.
+ */
+class BufferPool {
+public:
+    static constexpr size_t MIN_CLASS_SIZE = 256;
+    static constexpr size_t MAX_CLASS_SIZE = 1024 * 1024;
+    static constexpr size_t MAX_RESERVED_CLASSES = 8;
+    static constexpr size_t DEFAULT_MAX_CACHED_BYTES = 32 * 1024 * 1024;
+
+    struct Stats {
+        uint64_t hits;          // Acquisitions served from a free list
+        uint64_t misses;        // Acquisitions that allocated
+        size_t cached_buffers;  // Buffers currently on free lists
+        size_t cached_bytes;    // Capacity of the cached buffers
+    };
+
+    /**
+     * Get the process-wide pool. It is never destroyed, so buffers released during
+     * static destruction still have somewhere to go.
+     */
+    static BufferPool& getInstance();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * Get storage for at least size bytes (contents are unspecified)
+     * @param size Number of bytes needed
+     * @return Storage that returns to the pool when its last owner releases it
+     */
+    std::shared_ptr<std::vector<uint8_t>> acquire(size_t size);
+
+    /**
+     * Copy bytes into pooled storage
+     * @param data Bytes to copy
+     * @param size Number of bytes
+     * @return View of exactly size bytes
+     */
+    SharedBuffer copy_of(const uint8_t* data, size_t size);
+
+    /**
+     * Add an exact size class for a buffer size that is requested often
+     * @param size Buffer size in bytes (ignored if it already has an exact class or exceeds MAX_CLASS_SIZE)
+     * @return true if size has an exact class afterwards
+     */
+    bool reserve_size_class(size_t size);
+
+    /**
+     * Limit the total capacity kept on free lists; buffers released above it are freed
+     * @param bytes Maximum cached bytes
+     */
+    void set_max_cached_bytes(size_t bytes);
+
+    Stats get_stats() const;
+
+    /**
+     * Free all cached buffers (buffers in use are unaffected)
+     */
+    void clear();
+
+private:
+    static constexpr size_t POWER_CLASS_COUNT = 13;     // 256 B .. 1 MB
+    static constexpr size_t CLASS_COUNT = POWER_CLASS_COUNT + MAX_RESERVED_CLASSES;
+    static constexpr size_t FREE_LIST_SHARDS = 8;
+
+    struct alignas(64) FreeList {
+        std::mutex mutex;
+        std::vector<std::vector<uint8_t>*> buffers;
+    };
+
+    struct SizeClass {
+        size_t size = 0;
+        std::array<FreeList, FREE_LIST_SHARDS> shards;
+    };
+
+    BufferPool();
+
+    // Smallest class that fits size, or -1 if none does
+    int find_class(size_t size) const;
+    void release(std::vector<uint8_t>* buffer, size_t class_index);
+    // Free list shard of the calling thread
+    static size_t thread_shard();
+
+    std::array<SizeClass, CLASS_COUNT> classes_;
+    std::atomic<size_t> reserved_count_;    // Reserved classes published so far (append only)
+    std::mutex reserve_mutex_;
+    std::atomic<size_t> max_cached_bytes_;
+    std::atomic<size_t> cached_bytes_;
+    std::atomic<size_t> cached_buffers_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+} // namespace librats
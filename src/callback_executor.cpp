@@ -0,0 +1,169 @@
+#include "callback_executor.h"
+#include "logger.h"
+#include <algorithm>
+
+// Callback executor logging macros
+#define LOG_EXECUTOR_DEBUG(message) LOG_DEBUG("executor", message)
+#define LOG_EXECUTOR_INFO(message)  LOG_INFO("executor", message)
+#define LOG_EXECUTOR_WARN(message)  LOG_WARN("executor", message)
+#define LOG_EXECUTOR_ERROR(message) LOG_ERROR("executor", message)
+
+namespace librats {
+
+namespace {
+thread_local const CallbackExecutor* current_executor = nullptr;
+}
+
+CallbackExecutor::CallbackExecutor(const std::string& name)
+    : name_(name), running_(false), max_queued_per_key_(1), queued_count_(0) {}
+
+CallbackExecutor::~CallbackExecutor() {
+    stop();
+}
+
+bool CallbackExecutor::start(size_t thread_count, size_t max_queued_per_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_.load()) {
+        return true;
+    }
+
+    thread_count = std::max<size_t>(thread_count, 1);
+    max_queued_per_key_ = std::max<size_t>(max_queued_per_key, 1);
+    ready_.assign(thread_count, std::deque<std::shared_ptr<Strand>>());
+    running_.store(true);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back(&CallbackExecutor::worker_loop, this, i);
+    }
+
+    LOG_EXECUTOR_INFO("Callback executor '" << name_ << "' started with " << thread_count << " threads");
+    return true;
+}
+
+void CallbackExecutor::stop() {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) {
+            return;
+        }
+        threads.swap(threads_);
+        work_cv_.notify_all();
+        space_cv_.notify_all();
+    }
+
+    // Workers drain the queued tasks before they exit
+    for (auto& thread : threads) {
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();    // Stopped from one of its own callbacks
+        } else if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    LOG_EXECUTOR_INFO("Callback executor '" << name_ << "' stopped");
+}
+
+bool CallbackExecutor::is_running() const {
+    return running_.load();
+}
+
+bool CallbackExecutor::is_executor_thread() const {
+    return current_executor == this;
+}
+
+size_t CallbackExecutor::get_queued_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_count_;
+}
+
+bool CallbackExecutor::post(const std::string& key, Task&& task) {
+    bool may_block = !is_executor_thread();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (!running_.load()) {
+            return false;
+        }
+        auto it = strands_.find(key);
+        if (!may_block || it == strands_.end() || it->second->tasks.size() < max_queued_per_key_) {
+            break;
+        }
+        space_cv_.wait(lock);
+    }
+
+    auto& strand = strands_[key];
+    if (!strand) {
+        strand = std::make_shared<Strand>();
+        strand->key = key;
+    }
+    strand->tasks.push_back(std::move(task));
+    queued_count_++;
+
+    if (!strand->scheduled) {
+        strand->scheduled = true;
+        ready_[std::hash<std::string>()(key) % ready_.size()].push_back(strand);
+        work_cv_.notify_one();
+    }
+    return true;
+}
+
+bool CallbackExecutor::take_strand(size_t index, std::shared_ptr<Strand>& strand) {
+    auto& own = ready_[index];
+    if (!own.empty()) {
+        strand = std::move(own.front());
+        own.pop_front();
+        return true;
+    }
+
+    // Steal the strand that has waited longest on another worker
+    for (size_t offset = 1; offset < ready_.size(); ++offset) {
+        auto& other = ready_[(index + offset) % ready_.size()];
+        if (!other.empty()) {
+            strand = std::move(other.front());
+            other.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void CallbackExecutor::worker_loop(size_t index) {
+    current_executor = this;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        std::shared_ptr<Strand> strand;
+        while (!take_strand(index, strand)) {
+            if (!running_.load()) {
+                return;
+            }
+            work_cv_.wait(lock);
+        }
+
+        Task task = std::move(strand->tasks.front());
+        strand->tasks.pop_front();
+        queued_count_--;
+        space_cv_.notify_all();
+        lock.unlock();
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_EXECUTOR_ERROR("Exception in callback on executor '" << name_ << "': " << e.what());
+        } catch (...) {
+            LOG_EXECUTOR_ERROR("Unknown exception in callback on executor '" << name_ << "'");
+        }
+        task = nullptr;     // Release captured state outside the lock
+
+        lock.lock();
+        if (strand->tasks.empty()) {
+            strand->scheduled = false;
+            strands_.erase(strand->key);
+        } else {
+            // Requeue at the back so that busy keys share the workers fairly
+            ready_[index].push_back(strand);
+        }
+    }
+}
+
+} // namespace librats
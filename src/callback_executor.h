@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace librats {
+
+/**
+ * Where application callbacks run
+ */
+struct CallbackExecutorConfig {
+    size_t threads;                 // Worker threads running callbacks (0 = inline on the I/O thread)
+    size_t max_queued_per_key;      // Callbacks queued per peer or topic before the I/O thread waits
+
+    CallbackExecutorConfig()
+        : threads(2),
+          max_queued_per_key(1024) {}
+};
+
+/**
+ * Thread pool running callbacks off the I/O threads, in order per key.
+ *
+ * Tasks posted under the same key (a peer or a topic) form a strand that runs
+ * one task at a time, in post order. A strand with work is queued on the worker
+ * its key hashes to; a worker whose own queue is empty steals the oldest strand
+ * queued on another worker, so one slow key never stalls the others and idle
+ * threads pick up the load.
+ *
+ * Each strand holds at most max_queued_per_key tasks. post() blocks while the
+ * strand is full, which stops reads on the posting I/O thread and lets the TCP
+ * window push back on the sender. Posts from a worker thread never block, so a
+ * callback can send, disconnect or post more work without deadlocking.
+ */
+class CallbackExecutor {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * Constructor
+     * @param name Name used in log messages
+     */
+    explicit CallbackExecutor(const std::string& name);
+    ~CallbackExecutor();
+
+    CallbackExecutor(const CallbackExecutor&) = delete;
+    CallbackExecutor& operator=(const CallbackExecutor&) = delete;
+
+    /**
+     * Start the worker threads
+     * @param thread_count Number of threads (at least 1)
+     * @param max_queued_per_key Tasks queued per key before post() waits (at least 1)
+     * @return true if started (or already running)
+     */
+    bool start(size_t thread_count, size_t max_queued_per_key);
+
+    /**
+     * Stop accepting tasks, run the tasks already queued and join the workers
+     */
+    void stop();
+
+    /**
+     * Check if the executor is running
+     * @return true if running
+     */
+    bool is_running() const;
+
+    /**
+     * Queue a task behind the earlier tasks of its key
+     * @param key Ordering key (peer ID or topic)
+     * @param task Task to run (left untouched if it is not queued)
+     * @return true if queued, false if the executor is not running
+     */
+    bool post(const std::string& key, Task&& task);
+
+    /**
+     * Get the number of tasks waiting to run
+     * @return Queued task count
+     */
+    size_t get_queued_count() const;
+
+    /**
+     * Check if the calling thread is one of this executor's workers
+     * @return true on a worker thread
+     */
+    bool is_executor_thread() const;
+
+private:
+    struct Strand {
+        std::string key;
+        std::deque<Task> tasks;
+        bool scheduled = false;     // On a ready queue or running
+    };
+
+    void worker_loop(size_t index);
+    bool take_strand(size_t index, std::shared_ptr<Strand>& strand);
+
+    std::string name_;
+    std::atomic<bool> running_;
+    size_t max_queued_per_key_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable space_cv_;
+    std::unordered_map<std::string, std::shared_ptr<Strand>> strands_;     // Keys with queued or running tasks
+    std::vector<std::deque<std::shared_ptr<Strand>>> ready_;               // Per-worker queues of strands with work
+    size_t queued_count_;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace librats
@@ -0,0 +1,207 @@
+#include "chunk_compression.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef LIBRATS_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef LIBRATS_ENABLE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef LIBRATS_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace librats {
+
+namespace {
+
+#ifdef LIBRATS_ENABLE_ZSTD
+// One compression and one decompression context per thread, reused across chunks
+struct ZstdContexts {
+    ZSTD_CCtx* compress = ZSTD_createCCtx();
+    ZSTD_DCtx* decompress = ZSTD_createDCtx();
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(compress);
+        ZSTD_freeDCtx(decompress);
+    }
+};
+
+ZstdContexts& zstd_contexts() {
+    thread_local ZstdContexts contexts;
+    return contexts;
+}
+#endif
+
+} // namespace
+
+const char* compression_type_name(CompressionType type) {
+    switch (type) {
+        case CompressionType::LZ4: return "lz4";
+        case CompressionType::ZSTD: return "zstd";
+        case CompressionType::ZLIB: return "zlib";
+        default: return "none";
+    }
+}
+
+CompressionType compression_type_from_name(const std::string& name) {
+    if (name == "lz4") return CompressionType::LZ4;
+    if (name == "zstd") return CompressionType::ZSTD;
+    if (name == "zlib") return CompressionType::ZLIB;
+    return CompressionType::NONE;
+}
+
+bool is_compression_available(CompressionType type) {
+    switch (type) {
+        case CompressionType::NONE: return true;
+#ifdef LIBRATS_ENABLE_LZ4
+        case CompressionType::LZ4: return true;
+#endif
+#ifdef LIBRATS_ENABLE_ZSTD
+        case CompressionType::ZSTD: return true;
+#endif
+#ifdef LIBRATS_ENABLE_ZLIB
+        case CompressionType::ZLIB: return true;
+#endif
+        default: return false;
+    }
+}
+
+std::vector<CompressionType> available_compression_types() {
+    std::vector<CompressionType> types;
+    for (CompressionType type : {CompressionType::LZ4, CompressionType::ZSTD, CompressionType::ZLIB}) {
+        if (is_compression_available(type)) {
+            types.push_back(type);
+        }
+    }
+    return types;
+}
+
+double estimate_entropy(const uint8_t* data, size_t size, size_t sample_size) {
+    if (!data || size == 0) {
+        return 0.0;
+    }
+
+    // Count bytes from a few slices spread over the buffer, so a compressible
+    // header in front of random data does not decide alone
+    const size_t slices = 4;
+    uint32_t counts[256] = {};
+    size_t counted = 0;
+    if (size <= sample_size) {
+        for (size_t i = 0; i < size; ++i) {
+            counts[data[i]]++;
+        }
+        counted = size;
+    } else {
+        size_t slice_size = (std::max)(sample_size / slices, static_cast<size_t>(1));
+        for (size_t slice = 0; slice < slices; ++slice) {
+            size_t start = (size - slice_size) * slice / (slices - 1);
+            for (size_t i = start; i < start + slice_size; ++i) {
+                counts[data[i]]++;
+            }
+            counted += slice_size;
+        }
+    }
+
+    double entropy = 0.0;
+    for (uint32_t count : counts) {
+        if (count > 0) {
+            double p = static_cast<double>(count) / static_cast<double>(counted);
+            entropy -= p * std::log2(p);
+        }
+    }
+    return entropy;
+}
+
+bool compress_chunk(CompressionType type, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    out.clear();
+    if (!data || size == 0) {
+        return false;
+    }
+
+    switch (type) {
+#ifdef LIBRATS_ENABLE_LZ4
+        case CompressionType::LZ4: {
+            if (size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+                return false;
+            }
+            out.resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(size))));
+            // For LZ4 the level is the acceleration: higher is faster and compresses less
+            int written = LZ4_compress_fast(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(out.data()),
+                                            static_cast<int>(size), static_cast<int>(out.size()), (std::max)(level, 1));
+            if (written <= 0) {
+                out.clear();
+                return false;
+            }
+            out.resize(static_cast<size_t>(written));
+            break;
+        }
+#endif
+#ifdef LIBRATS_ENABLE_ZSTD
+        case CompressionType::ZSTD: {
+            out.resize(ZSTD_compressBound(size));
+            size_t written = ZSTD_compressCCtx(zstd_contexts().compress, out.data(), out.size(), data, size,
+                                               level > 0 ? level : ZSTD_CLEVEL_DEFAULT);
+            if (ZSTD_isError(written)) {
+                out.clear();
+                return false;
+            }
+            out.resize(written);
+            break;
+        }
+#endif
+#ifdef LIBRATS_ENABLE_ZLIB
+        case CompressionType::ZLIB: {
+            uLongf written = compressBound(static_cast<uLong>(size));
+            out.resize(written);
+            if (compress2(out.data(), &written, data, static_cast<uLong>(size),
+                          level > 0 ? level : Z_DEFAULT_COMPRESSION) != Z_OK) {
+                out.clear();
+                return false;
+            }
+            out.resize(written);
+            break;
+        }
+#endif
+        default:
+            (void)level;
+            return false;
+    }
+
+    return out.size() < size;
+}
+
+bool decompress_chunk(CompressionType type, const uint8_t* data, size_t size, uint8_t* out, size_t out_size) {
+    if (!data || !out || out_size > MAX_DECOMPRESSED_CHUNK_SIZE) {
+        return false;
+    }
+
+    switch (type) {
+#ifdef LIBRATS_ENABLE_LZ4
+        case CompressionType::LZ4: {
+            int read = LZ4_decompress_safe(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(out),
+                                           static_cast<int>(size), static_cast<int>(out_size));
+            return read >= 0 && static_cast<size_t>(read) == out_size;
+        }
+#endif
+#ifdef LIBRATS_ENABLE_ZSTD
+        case CompressionType::ZSTD: {
+            size_t read = ZSTD_decompressDCtx(zstd_contexts().decompress, out, out_size, data, size);
+            return !ZSTD_isError(read) && read == out_size;
+        }
+#endif
+#ifdef LIBRATS_ENABLE_ZLIB
+        case CompressionType::ZLIB: {
+            uLongf read = static_cast<uLongf>(out_size);
+            return uncompress(out, &read, data, static_cast<uLong>(size)) == Z_OK && read == out_size;
+        }
+#endif
+        default:
+            (void)size;
+            return false;
+    }
+}
+
+} // namespace librats
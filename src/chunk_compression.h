@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace librats {
+
+/**
+ * Codecs for file transfer chunks. Each backend is an optional dependency
+ * (RATS_ENABLE_LZ4, RATS_ENABLE_ZSTD, RATS_ENABLE_ZLIB); a build without any of
+ * them sends every chunk raw. The value is the codec id in chunk frames.
+ */
+enum class CompressionType : uint8_t {
+    NONE = 0,
+    LZ4 = 1,        // Fast, for LAN links
+    ZSTD = 2,       // Better ratio, for WAN links
+    ZLIB = 3
+};
+
+// Largest chunk a compressed frame may expand to
+constexpr size_t MAX_DECOMPRESSED_CHUNK_SIZE = 64 * 1024 * 1024;
+
+// Name used when peers negotiate a codec ("none", "lz4", "zstd", "zlib")
+const char* compression_type_name(CompressionType type);
+
+// Codec for a negotiated name, NONE if unknown
+CompressionType compression_type_from_name(const std::string& name);
+
+// Whether this build can compress and decompress with type (always true for NONE)
+bool is_compression_available(CompressionType type);
+
+// Codecs this build supports, fastest first
+std::vector<CompressionType> available_compression_types();
+
+/**
+ * Estimate the Shannon entropy of data from a sample of up to sample_size bytes
+ * spread over the buffer
+ * @return Bits per byte, 0 to 8
+ */
+double estimate_entropy(const uint8_t* data, size_t size, size_t sample_size = 4096);
+
+/**
+ * Compress data
+ * @param type Codec, not NONE
+ * @param level Codec level, 0 for the codec's default
+ * @param out Replaced with the compressed bytes
+ * @return true if the data compressed to fewer bytes than size
+ */
+bool compress_chunk(CompressionType type, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+/**
+ * Decompress data that compress_chunk produced from exactly out_size bytes
+ * @return true if the data decoded to out_size bytes
+ */
+bool decompress_chunk(CompressionType type, const uint8_t* data, size_t size, uint8_t* out, size_t out_size);
+
+} // namespace librats
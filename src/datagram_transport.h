@@ -0,0 +1,46 @@
+#pragma once
+
+#include "socket.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace librats {
+
+/**
+ * Datagram I/O for one local endpoint: the seam between a UDP protocol and the network.
+ *
+ * DhtClient owns a UDP socket and its own threads unless it is given a transport. With
+ * one it sends and receives through the transport, reads the time from its clock and
+ * runs its timers on it, so an in-process network such as SimNetwork can drive
+ * thousands of clients from one thread in virtual time.
+ *
+ * The receive handler and timers run on the transport's delivery thread, one at a time.
+ */
+class DatagramTransport {
+public:
+    using Clock = std::chrono::steady_clock;
+    using ReceiveHandler = std::function<void(const uint8_t* data, size_t size, const NetEndpoint& sender)>;
+
+    virtual ~DatagramTransport() = default;
+
+    // Start delivering datagrams to handler
+    virtual bool open(ReceiveHandler handler) = 0;
+
+    // Stop delivery and drop pending timers; neither runs once close() returns
+    virtual void close() = 0;
+
+    // Send a datagram; false if it could not be sent (loss on the way is silent, as with UDP)
+    virtual bool send(const NetEndpoint& destination, const uint8_t* data, size_t size) = 0;
+
+    // The address this endpoint was given (behind a NAT, others see a mapped address)
+    virtual NetEndpoint local_address() const = 0;
+
+    virtual Clock::time_point now() const = 0;
+
+    // Run task once after delay on this transport's clock
+    virtual void schedule(std::chrono::milliseconds delay, std::function<void()> task) = 0;
+};
+
+} // namespace librats
@@ -0,0 +1,207 @@
+#include "delta_sync.h"
+#include "sha1.h"
+#include "sha256.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace librats {
+
+namespace {
+
+// Bytes of the file read at once while matching
+constexpr size_t DELTA_READ_WINDOW = 4 * 1024 * 1024;
+
+// Forward-only view of a file through a buffer that is refilled as the position advances
+class SlidingFileReader {
+public:
+    SlidingFileReader(FileHandle& file, uint64_t file_size, size_t window_size, SHA256* hasher)
+        : file_(file), file_size_(file_size), window_size_(window_size), start_(0), hashed_(0), hasher_(hasher) {}
+
+    // Pointer to [offset, offset + length); offsets never move backwards
+    const uint8_t* at(uint64_t offset, size_t length) {
+        if (offset < start_ || offset + length > start_ + buffer_.size()) {
+            size_t size = static_cast<size_t>((std::min)(static_cast<uint64_t>((std::max)(window_size_, length)),
+                                                          file_size_ - offset));
+            buffer_.resize(size);
+            if (size < length || !file_.read_at(offset, buffer_.data(), size)) {
+                buffer_.clear();
+                return nullptr;
+            }
+            start_ = offset;
+            hash_loaded();
+        }
+        return buffer_.data() + (offset - start_);
+    }
+
+    // Hash the bytes no window has covered, up to the end of the file
+    bool finish() {
+        while (hashed_ < file_size_) {
+            if (!at(hashed_, static_cast<size_t>((std::min)(static_cast<uint64_t>(window_size_), file_size_ - hashed_)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    void hash_loaded() {
+        uint64_t end = start_ + buffer_.size();
+        if (hasher_ && end > hashed_ && hashed_ >= start_) {
+            hasher_->update(buffer_.data() + (hashed_ - start_), static_cast<size_t>(end - hashed_));
+        }
+        hashed_ = (std::max)(hashed_, end);
+    }
+
+    FileHandle& file_;
+    uint64_t file_size_;
+    size_t window_size_;
+    uint64_t start_;
+    uint64_t hashed_;
+    SHA256* hasher_;
+    std::vector<uint8_t> buffer_;
+};
+
+void add_literal(DeltaPlan& plan, uint64_t offset, uint64_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (!plan.literals.empty() && plan.literals.back().offset + plan.literals.back().length == offset) {
+        plan.literals.back().length += length;
+    } else {
+        plan.literals.push_back(DeltaLiteral{offset, length});
+    }
+}
+
+void add_copy(DeltaPlan& plan, uint64_t offset, uint64_t block, uint32_t block_size) {
+    if (!plan.copies.empty()) {
+        DeltaCopy& last = plan.copies.back();
+        if (last.offset + last.count * block_size == offset && last.block + last.count == block) {
+            last.count++;
+            plan.copied_bytes += block_size;
+            return;
+        }
+    }
+    plan.copies.push_back(DeltaCopy{offset, block, 1});
+    plan.copied_bytes += block_size;
+}
+
+} // namespace
+
+void RollingChecksum::reset(const uint8_t* data, size_t length) {
+    a_ = 0;
+    b_ = 0;
+    length_ = length;
+    for (size_t i = 0; i < length; ++i) {
+        a_ += data[i];
+        b_ += static_cast<uint32_t>(length - i) * data[i];
+    }
+}
+
+void RollingChecksum::roll(uint8_t out, uint8_t in) {
+    a_ = a_ - out + in;
+    b_ = b_ - static_cast<uint32_t>(length_) * out + a_;
+}
+
+uint32_t choose_delta_block_size(uint64_t file_size) {
+    // Round to a multiple of 1KB within [MIN, MAX]
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(file_size)));
+    root = (root + 1023) / 1024 * 1024;
+    return static_cast<uint32_t>((std::min)((std::max)(root, static_cast<uint64_t>(MIN_DELTA_BLOCK_SIZE)),
+                                            static_cast<uint64_t>(MAX_DELTA_BLOCK_SIZE)));
+}
+
+uint64_t delta_strong_hash(const uint8_t* data, size_t length) {
+    SHA1 sha1;
+    sha1.update(data, length);
+    uint8_t digest[SHA1::DIGEST_SIZE];
+    sha1.finalize(digest);
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        value = (value << 8) | digest[i];
+    }
+    return value;
+}
+
+bool compute_delta_signatures(FileHandle& file, uint64_t file_size, uint32_t block_size,
+                              std::vector<DeltaBlockSignature>& signatures) {
+    signatures.clear();
+    if (block_size == 0) {
+        return false;
+    }
+    signatures.reserve(static_cast<size_t>(file_size / block_size));
+
+    SlidingFileReader reader(file, file_size, DELTA_READ_WINDOW, nullptr);
+    RollingChecksum rolling;
+    for (uint64_t offset = 0; offset + block_size <= file_size; offset += block_size) {
+        const uint8_t* block = reader.at(offset, block_size);
+        if (!block) {
+            return false;
+        }
+        rolling.reset(block, block_size);
+        signatures.push_back(DeltaBlockSignature{rolling.digest(), delta_strong_hash(block, block_size)});
+    }
+    return true;
+}
+
+bool compute_delta(FileHandle& file, uint64_t file_size, uint32_t block_size,
+                   const std::vector<DeltaBlockSignature>& signatures, DeltaPlan& plan, SHA256* file_hasher) {
+    plan = DeltaPlan();
+    if (block_size == 0) {
+        return false;
+    }
+
+    // Blocks by weak checksum; the first block with a given strong hash wins
+    std::unordered_multimap<uint32_t, uint64_t> blocks_by_weak;
+    blocks_by_weak.reserve(signatures.size());
+    for (uint64_t i = 0; i < signatures.size(); ++i) {
+        blocks_by_weak.emplace(signatures[i].weak, i);
+    }
+
+    SlidingFileReader reader(file, file_size, (std::max)(DELTA_READ_WINDOW, static_cast<size_t>(block_size) * 2),
+                             file_hasher);
+    RollingChecksum rolling;
+    bool rolling_valid = false;
+    uint64_t position = 0;
+    uint64_t literal_start = 0;
+
+    while (!blocks_by_weak.empty() && position + block_size <= file_size) {
+        // The window plus the byte after it, so the checksum can roll
+        size_t needed = block_size + (position + block_size < file_size ? 1 : 0);
+        const uint8_t* window = reader.at(position, needed);
+        if (!window) {
+            return false;
+        }
+        if (!rolling_valid) {
+            rolling.reset(window, block_size);
+            rolling_valid = true;
+        }
+
+        auto range = blocks_by_weak.equal_range(rolling.digest());
+        if (range.first != range.second) {
+            uint64_t strong = delta_strong_hash(window, block_size);
+            auto match = std::find_if(range.first, range.second, [&](const std::pair<const uint32_t, uint64_t>& entry) {
+                return signatures[entry.second].strong == strong;
+            });
+            if (match != range.second) {
+                add_literal(plan, literal_start, position - literal_start);
+                add_copy(plan, position, match->second, block_size);
+                position += block_size;
+                literal_start = position;
+                rolling_valid = false;
+                continue;
+            }
+        }
+
+        if (needed == block_size) {
+            break;  // Last possible window did not match
+        }
+        rolling.roll(window[0], window[block_size]);
+        position++;
+    }
+
+    add_literal(plan, literal_start, file_size - literal_start);
+    return reader.finish();
+}
+
+} // namespace librats
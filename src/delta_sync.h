@@ -0,0 +1,88 @@
+#pragma once
+
+#include "fs.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace librats {
+
+class SHA256;
+
+/**
+ * Delta synchronization (rsync algorithm).
+ *
+ * The receiver of a file it already has an older copy of splits that copy into
+ * fixed-size blocks and sends a weak rolling checksum plus a strong hash of each.
+ * The sender slides a window of the block size over its file one byte at a time;
+ * the rolling checksum is updated in O(1) per byte and only windows whose weak
+ * checksum is known get the strong hash. Matching windows become references to
+ * the receiver's blocks, and the bytes between them are sent literally.
+ *
+ * Only whole blocks are signed, so the tail of the old copy is never matched.
+ */
+
+// Adler-style checksum of a window that rolls forward one byte at a time
+class RollingChecksum {
+public:
+    RollingChecksum() : a_(0), b_(0), length_(0) {}
+
+    // Start over on the window data[0, length)
+    void reset(const uint8_t* data, size_t length);
+
+    // Slide the window one byte: out leaves at the front, in enters at the back
+    void roll(uint8_t out, uint8_t in);
+
+    uint32_t digest() const { return (a_ & 0xffff) | ((b_ & 0xffff) << 16); }
+
+private:
+    uint32_t a_;
+    uint32_t b_;
+    size_t length_;
+};
+
+struct DeltaBlockSignature {
+    uint32_t weak;      // RollingChecksum of the block
+    uint64_t strong;    // First 8 bytes of the block's SHA1
+};
+
+// count consecutive blocks of the old copy, starting at block, land at offset of the new file
+struct DeltaCopy {
+    uint64_t offset;
+    uint64_t block;
+    uint64_t count;
+};
+
+// Byte range of the new file that has to be sent
+struct DeltaLiteral {
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct DeltaPlan {
+    std::vector<DeltaCopy> copies;
+    std::vector<DeltaLiteral> literals;
+    uint64_t copied_bytes = 0;
+};
+
+constexpr uint32_t MIN_DELTA_BLOCK_SIZE = 2048;
+constexpr uint32_t MAX_DELTA_BLOCK_SIZE = 1024 * 1024;
+
+// Block size for a basis file: about the square root of its size, like rsync,
+// so the signature list stays small for very large files
+uint32_t choose_delta_block_size(uint64_t file_size);
+
+// Strong hash of one block
+uint64_t delta_strong_hash(const uint8_t* data, size_t length);
+
+// Signatures of every whole block of file
+bool compute_delta_signatures(FileHandle& file, uint64_t file_size, uint32_t block_size,
+                              std::vector<DeltaBlockSignature>& signatures);
+
+// Match file against the receiver's signatures. Literals are contiguous ranges in
+// file order; file_hasher (optional) is fed the whole file in order.
+bool compute_delta(FileHandle& file, uint64_t file_size, uint32_t block_size,
+                   const std::vector<DeltaBlockSignature>& signatures, DeltaPlan& plan,
+                   SHA256* file_hasher = nullptr);
+
+} // namespace librats
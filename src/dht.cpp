@@ -2,6 +2,10 @@
 #include "network_utils.h"
 #include "logger.h"
 #include "socket.h"
+#include "fs.h"
+#include "sha1.h"
+#include "metrics.h"
+#include "tracing.h"
 #include <random>
 #include <algorithm>
 #include <sstream>
@@ -25,12 +29,280 @@
 
 namespace librats {
 
+namespace {
+
+// Client whose network loop runs on this thread; its sends are flushed after each batch without a wakeup
+thread_local const DhtClient* network_thread_client = nullptr;
+
+struct KrpcMetrics {
+    MetricCounter& queries;
+    MetricCounter& responses;
+    MetricCounter& errors;
+    MetricCounter& invalid;
+    MetricHistogram& handling_time;
+};
+
+KrpcMetrics& krpc_metrics() {
+    static const char* help = "KRPC messages received by the DHT, by kind";
+    static MetricsRegistry& registry = MetricsRegistry::getInstance();
+    static KrpcMetrics metrics{
+        registry.counter("librats_dht_krpc_messages_total", help, "kind=\"query\""),
+        registry.counter("librats_dht_krpc_messages_total", help, "kind=\"response\""),
+        registry.counter("librats_dht_krpc_messages_total", help, "kind=\"error\""),
+        registry.counter("librats_dht_krpc_messages_total", help, "kind=\"invalid\""),
+        registry.histogram("librats_dht_krpc_handling_seconds", "Time to handle one decoded KRPC message")
+    };
+    return metrics;
+}
+
+} // anonymous namespace
+
+//=============================================================================
+// DhtRoutingTable
+//=============================================================================
+
+DhtRoutingTable::DhtRoutingTable(const NodeId& own_id)
+    : own_id_(own_id), buckets_(BUCKET_COUNT), size_(0) {
+}
+
+int DhtRoutingTable::bucket_index(const NodeId& id) const {
+    for (size_t i = 0; i < NODE_ID_SIZE; ++i) {
+        uint8_t diff = own_id_[i] ^ id[i];
+        if (diff != 0) {
+            int bit = 0;
+            while (!(diff & (0x80 >> bit))) {
+                ++bit;
+            }
+            return static_cast<int>(i * 8) + bit;
+        }
+    }
+
+    return static_cast<int>(BUCKET_COUNT) - 1;  // Our own id shares the last bucket
+}
+
+DhtNode* DhtRoutingTable::find(const NodeId& id) {
+    auto& bucket = buckets_[bucket_index(id)];
+    for (auto& node : bucket) {
+        if (node.id == id) {
+            return &node;
+        }
+    }
+    return nullptr;
+}
+
+const DhtNode* DhtRoutingTable::find(const NodeId& id) const {
+    return const_cast<DhtRoutingTable*>(this)->find(id);
+}
+
+bool DhtRoutingTable::insert(const DhtNode& node) {
+    auto& bucket = buckets_[bucket_index(node.id)];
+    if (bucket.size() >= K_BUCKET_SIZE) {
+        return false;
+    }
+    bucket.push_back(node);
+    ++size_;
+    return true;
+}
+
+bool DhtRoutingTable::replace(const NodeId& old_id, const DhtNode& node) {
+    auto& bucket = buckets_[bucket_index(old_id)];
+    for (auto& existing : bucket) {
+        if (existing.id == old_id) {
+            existing = node;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<DhtNode> DhtRoutingTable::find_closest(const NodeId& target, size_t count) const {
+    std::vector<DhtNode> result;
+    if (count == 0 || size_ == 0) {
+        return result;
+    }
+
+    // Buckets rank by XOR distance to target as whole groups. With t the
+    // target's own bucket: bucket t shares the longest prefix with target,
+    // buckets deeper than t all sit one tier further out (in no particular
+    // order among themselves), and buckets t-1, t-2, ... 0 follow strictly
+    // further away each. Gathering whole tiers until count is reached is
+    // therefore enough to hold the exact count closest nodes.
+    const int target_bucket = bucket_index(target);
+    std::vector<const DhtNode*> candidates;
+    candidates.reserve(count + K_BUCKET_SIZE);
+
+    auto gather = [&candidates](const std::vector<DhtNode>& bucket) {
+        for (const auto& node : bucket) {
+            candidates.push_back(&node);
+        }
+    };
+
+    gather(buckets_[target_bucket]);
+    if (candidates.size() < count) {
+        for (size_t i = target_bucket + 1; i < BUCKET_COUNT; ++i) {
+            gather(buckets_[i]);
+        }
+    }
+    for (int i = target_bucket - 1; i >= 0 && candidates.size() < count; --i) {
+        gather(buckets_[i]);
+    }
+
+    auto closer = [&target](const DhtNode* a, const DhtNode* b) {
+        for (size_t i = 0; i < NODE_ID_SIZE; ++i) {
+            uint8_t da = a->id[i] ^ target[i];
+            uint8_t db = b->id[i] ^ target[i];
+            if (da != db) {
+                return da < db;
+            }
+        }
+        return false;
+    };
+
+    size_t n = (std::min)(count, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + n, candidates.end(), closer);
 
-DhtClient::DhtClient(int port) 
-    : port_(port), socket_(INVALID_SOCKET_VALUE), running_(false) {
-    node_id_ = generate_node_id();
-    routing_table_.resize(NODE_ID_SIZE * 8);  // 160 buckets for 160-bit node IDs
+    result.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        result.push_back(*candidates[i]);
+    }
+    return result;
+}
+
+//=============================================================================
+// DhtPeerStore
+//=============================================================================
+
+DhtPeerStore::DhtPeerStore(size_t max_info_hashes, size_t max_peers_per_info_hash, Clock::duration peer_lifetime)
+    : max_info_hashes_((std::max)(max_info_hashes, size_t(1))),
+      max_peers_per_info_hash_((std::max)(max_peers_per_info_hash, size_t(1))),
+      peer_lifetime_(peer_lifetime), peer_count_(0), evictions_(0) {
+}
+
+bool DhtPeerStore::announce(const InfoHash& info_hash, const NetEndpoint& peer, Clock::time_point now) {
+    if (peer.is_unspecified()) {
+        return false;
+    }
     
+    auto it = entries_.find(info_hash);
+    if (it == entries_.end()) {
+        if (entries_.size() >= max_info_hashes_) {
+            erase(entries_.find(lru_.back()));
+        }
+        lru_.push_front(info_hash);
+        it = entries_.emplace(info_hash, Entry{{}, lru_.begin()}).first;
+    } else {
+        lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    }
+    
+    auto& peers = it->second.peers;
+    auto existing = std::find_if(peers.begin(), peers.end(), [&peer](const StoredPeer& p) {
+        return p.peer == peer;
+    });
+    if (existing != peers.end()) {
+        // Refreshed peers move to the back to keep announce order
+        std::rotate(existing, existing + 1, peers.end());
+        peers.back().announced_at = now;
+        return true;
+    }
+    
+    if (peers.size() >= max_peers_per_info_hash_) {
+        peers.erase(peers.begin());
+        --peer_count_;
+        ++evictions_;
+    }
+    peers.push_back(StoredPeer{peer, now});
+    ++peer_count_;
+    return true;
+}
+
+std::vector<NetEndpoint> DhtPeerStore::get_peers(const InfoHash& info_hash, size_t max_peers, Clock::time_point now) const {
+    std::vector<NetEndpoint> result;
+    auto it = entries_.find(info_hash);
+    if (it == entries_.end()) {
+        return result;
+    }
+    
+    const auto& peers = it->second.peers;
+    result.reserve((std::min)(max_peers, peers.size()));
+    for (auto p = peers.rbegin(); p != peers.rend() && result.size() < max_peers; ++p) {
+        if (now - p->announced_at > peer_lifetime_) {
+            break;  // Everything older has expired too
+        }
+        result.push_back(p->peer);
+    }
+    return result;
+}
+
+size_t DhtPeerStore::expire(Clock::time_point now) {
+    size_t removed = 0;
+    for (auto it = entries_.begin(); it != entries_.end(); ) {
+        auto& peers = it->second.peers;
+        auto first_live = std::find_if(peers.begin(), peers.end(), [this, now](const StoredPeer& p) {
+            return now - p.announced_at <= peer_lifetime_;
+        });
+        size_t expired = static_cast<size_t>(first_live - peers.begin());
+        peers.erase(peers.begin(), first_live);
+        peer_count_ -= expired;
+        removed += expired;
+        evictions_ += expired;
+        
+        if (peers.empty()) {
+            lru_.erase(it->second.lru_position);
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+void DhtPeerStore::set_limits(size_t max_info_hashes, size_t max_peers_per_info_hash) {
+    max_info_hashes_ = (std::max)(max_info_hashes, size_t(1));
+    max_peers_per_info_hash_ = (std::max)(max_peers_per_info_hash, size_t(1));
+    
+    while (entries_.size() > max_info_hashes_) {
+        erase(entries_.find(lru_.back()));
+    }
+    for (auto& entry : entries_) {
+        auto& peers = entry.second.peers;
+        if (peers.size() > max_peers_per_info_hash_) {
+            size_t excess = peers.size() - max_peers_per_info_hash_;
+            peers.erase(peers.begin(), peers.begin() + excess);
+            peer_count_ -= excess;
+            evictions_ += excess;
+        }
+    }
+}
+
+size_t DhtPeerStore::memory_usage() const {
+    // Map node and bucket slot, LRU list node, and the peer vectors
+    size_t per_entry = sizeof(std::pair<const InfoHash, Entry>) + 3 * sizeof(void*) +
+                       sizeof(InfoHash) + 2 * sizeof(void*);
+    size_t bytes = entries_.size() * per_entry;
+    for (const auto& entry : entries_) {
+        bytes += entry.second.peers.capacity() * sizeof(StoredPeer);
+    }
+    return bytes;
+}
+
+void DhtPeerStore::erase(std::unordered_map<InfoHash, Entry>::iterator it) {
+    peer_count_ -= it->second.peers.size();
+    evictions_ += it->second.peers.size();
+    lru_.erase(it->second.lru_position);
+    entries_.erase(it);
+}
+
+//=============================================================================
+// DhtClient
+//=============================================================================
+
+DhtClient::DhtClient(int port, size_t worker_threads)
+    : port_(port), node_id_(generate_node_id()), socket_(INVALID_SOCKET_VALUE), socket_family_(AF_INET6),
+      running_(false), waiting_writable_(false), routing_table_(node_id_), searches_active_(false),
+      max_pending_searches_(DHT_MAX_PENDING_SEARCHES), search_evictions_(0),
+      worker_thread_count_(worker_threads) {
+    rotate_token_secret();
+    previous_token_secret_ = token_secret_;
     LOG_DHT_INFO("DHT client created with node ID: " << node_id_to_hex(node_id_));
 }
 
@@ -45,27 +317,65 @@ bool DhtClient::start() {
     
     LOG_DHT_INFO("Starting DHT client on port " << port_);
     
-    // Initialize socket library (safe to call multiple times)
-    if (!init_socket_library()) {
-        LOG_DHT_ERROR("Failed to initialize socket library");
-        return false;
+    if (transport_) {
+        if (!transport_->open([this](const uint8_t* data, size_t size, const NetEndpoint& sender) {
+                dispatch_message(data, size, sender);
+            })) {
+            LOG_DHT_ERROR("Failed to open the DHT transport");
+            return false;
+        }
+    } else {
+        // Initialize socket library (safe to call multiple times)
+        if (!init_socket_library()) {
+            LOG_DHT_ERROR("Failed to initialize socket library");
+            return false;
+        }
+        
+        socket_ = create_udp_socket(port_);
+        if (!is_valid_socket(socket_)) {
+            LOG_DHT_ERROR("Failed to create dual-stack UDP socket");
+            return false;
+        }
+        
+        if (!set_socket_nonblocking(socket_)) {
+            LOG_DHT_WARN("Failed to set socket to non-blocking mode");
+        }
+        
+        sockaddr_storage local;
+        socklen_t local_length = sizeof(local);
+        if (getsockname(socket_, reinterpret_cast<sockaddr*>(&local), &local_length) == 0) {
+            socket_family_ = local.ss_family;
+        }
+        
+        waiting_writable_ = false;
+        if (!poller_.is_valid() || !poller_.add(socket_, IO_EVENT_READ)) {
+            LOG_DHT_ERROR("Failed to watch the DHT socket for readiness");
+            close_socket(socket_);
+            socket_ = INVALID_SOCKET_VALUE;
+            return false;
+        }
     }
     
-    socket_ = create_udp_socket(port_);
-    if (!is_valid_socket(socket_)) {
-        LOG_DHT_ERROR("Failed to create dual-stack UDP socket");
-        return false;
-    }
+    running_ = true;
     
-    if (!set_socket_nonblocking(socket_)) {
-        LOG_DHT_WARN("Failed to set socket to non-blocking mode");
+    // Start KRPC workers, network thread and maintenance jobs
+    for (size_t i = 0; i < worker_thread_count_; ++i) {
+        workers_.emplace_back(new KrpcWorker());
+        workers_.back()->thread = std::thread(&DhtClient::worker_loop, this, workers_.back().get());
     }
+    if (!transport_) {
+        network_thread_ = std::thread(&DhtClient::network_loop, this);
+    }
+    start_maintenance();
     
-    running_ = true;
-    
-    // Start network and maintenance threads
-    network_thread_ = std::thread(&DhtClient::network_loop, this);
-    maintenance_thread_ = std::thread(&DhtClient::maintenance_loop, this);
+    // Warm start: query every saved node at once; the send queue goes out in one batch
+    if (!warm_start_nodes_.empty()) {
+        LOG_DHT_INFO("Querying " << warm_start_nodes_.size() << " saved nodes");
+        for (const auto& node : warm_start_nodes_) {
+            send_find_node(node.peer, node_id_);
+        }
+        warm_start_nodes_.clear();
+    }
     
     LOG_DHT_INFO("DHT client started successfully");
     return true;
@@ -85,12 +395,29 @@ void DhtClient::stop() {
     if (network_thread_.joinable()) {
         network_thread_.join();
     }
-    if (maintenance_thread_.joinable()) {
-        maintenance_thread_.join();
+    stop_maintenance();
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->condition.notify_all();
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    workers_.clear();
+    
+    {
+        std::lock_guard<std::mutex> lock(send_queue_mutex_);
+        send_queue_.clear();
     }
     
     // Close socket
+    if (transport_) {
+        transport_->close();
+    }
     if (is_valid_socket(socket_)) {
+        poller_.remove(socket_);
         close_socket(socket_);
         socket_ = INVALID_SOCKET_VALUE;
     }
@@ -105,6 +432,7 @@ void DhtClient::shutdown_immediate() {
     
     // Notify all waiting threads to wake up immediately
     shutdown_cv_.notify_all();
+    poller_.wakeup();
 }
 
 bool DhtClient::bootstrap(const std::vector<Peer>& bootstrap_nodes) {
@@ -114,23 +442,37 @@ bool DhtClient::bootstrap(const std::vector<Peer>& bootstrap_nodes) {
     }
     
     LOG_DHT_INFO("Bootstrapping DHT with " << bootstrap_nodes.size() << " nodes");
-    LOG_DHT_DEBUG("Bootstrap nodes:");
+    
+    // Bootstrap nodes are the one place hostnames come in; resolve them once here
+    std::vector<NetEndpoint> endpoints;
     for (const auto& peer : bootstrap_nodes) {
-        LOG_DHT_DEBUG("  - " << peer.ip << ":" << peer.port);
+        NetEndpoint endpoint;
+        if (!NetEndpoint::parse(peer.ip, peer.port, endpoint) &&
+            !NetEndpoint::parse(network_utils::resolve_hostname(peer.ip), peer.port, endpoint)) {
+            LOG_DHT_WARN("Cannot resolve bootstrap node " << peer.ip << ":" << peer.port);
+            continue;
+        }
+        LOG_DHT_DEBUG("  - " << peer.ip << ":" << peer.port << " at " << endpoint);
+        endpoints.push_back(endpoint);
     }
     
-
-    
     // Send ping to bootstrap nodes
     LOG_DHT_DEBUG("Sending PING to all bootstrap nodes");
-    for (const auto& peer : bootstrap_nodes) {
-        send_ping(peer);
+    for (const auto& endpoint : endpoints) {
+        send_ping(endpoint);
     }
     
     // Start node discovery by finding our own node
     LOG_DHT_DEBUG("Starting node discovery by finding our own node ID: " << node_id_to_hex(node_id_));
-    for (const auto& peer : bootstrap_nodes) {
-        send_find_node(peer, node_id_);
+    for (const auto& endpoint : endpoints) {
+        send_find_node(endpoint, node_id_);
+    }
+    
+    // Virtual nodes join around their own IDs
+    for (size_t i = 0; i < virtual_nodes_.size(); ++i) {
+        for (const auto& endpoint : endpoints) {
+            send_crawl_query(i, KrpcQueryType::FindNode, endpoint, virtual_nodes_[i]->id());
+        }
     }
     
     LOG_DHT_DEBUG("Bootstrap process initiated");
@@ -145,40 +487,30 @@ bool DhtClient::find_peers(const InfoHash& info_hash, PeerDiscoveryCallback call
     
     LOG_DHT_INFO("Finding peers for info hash: " << node_id_to_hex(info_hash));
     
-    {
-        std::lock_guard<std::mutex> lock(active_searches_mutex_);
-        std::string hash_key = node_id_to_hex(info_hash);
-        active_searches_[hash_key] = callback;
-    }
-    
-    // Start search by querying closest nodes
-    auto closest_nodes = find_closest_nodes(info_hash, ALPHA);
-    std::string hash_key = node_id_to_hex(info_hash);
+    // Start from the closest nodes we know of; the lookup restarts if one is already running
+    auto closest_nodes = find_closest_nodes(info_hash, DHT_SEARCH_CANDIDATES);
     
-    {
-        std::lock_guard<std::mutex> lock(pending_searches_mutex_);
-        // Create or get existing PendingSearch for this info_hash
-        auto search_it = pending_searches_.find(hash_key);
-        if (search_it == pending_searches_.end()) {
-            pending_searches_.emplace(hash_key, PendingSearch(info_hash, iteration_max));
-        }
+    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
+    auto existing = pending_searches_.find(info_hash);
+    if (existing != pending_searches_.end()) {
+        erase_search(existing);
     }
-    
+    if (pending_searches_.size() >= max_pending_searches_) {
+        erase_oldest_search();
+    }
+    auto& search = pending_searches_.emplace(info_hash, PendingSearch(info_hash, std::move(callback),
+                                                                      (std::max)(iteration_max, 1),
+                                                                      current_time())).first->second;
     for (const auto& node : closest_nodes) {
-            // Generate transaction ID and track this as a pending search for KRPC
-            std::string transaction_id = KrpcProtocol::generate_transaction_id();
-            
-            {
-                std::lock_guard<std::mutex> lock(pending_searches_mutex_);
-                transaction_to_search_[transaction_id] = hash_key;
-                auto search_it = pending_searches_.find(hash_key);
-                if (search_it != pending_searches_.end()) {
-                    search_it->second.queried_nodes.insert(node_id_to_hex(node.id));
-                }
-            }
-            
-            auto message = KrpcProtocol::create_get_peers_query(transaction_id, node_id_, info_hash);
-            send_krpc_message(message, node.peer);
+        search.seen_nodes.insert(node.id);
+        search.candidates.emplace_back(node, 0);
+    }
+    
+    if (advance_search(search, current_time())) {
+        LOG_DHT_DEBUG("No nodes to query for info hash " << node_id_to_hex(info_hash));
+        erase_search(pending_searches_.find(info_hash));
+    } else {
+        searches_active_ = true;
     }
     
     return true;
@@ -205,7 +537,7 @@ bool DhtClient::announce_peer(const InfoHash& info_hash, uint16_t port) {
             
             {
                 std::lock_guard<std::mutex> lock(pending_announces_mutex_);
-                pending_announces_.emplace(transaction_id, PendingAnnounce(info_hash, port));
+                pending_announces_.emplace(transaction_id, PendingAnnounce(info_hash, port, current_time()));
             }
             
             auto message = KrpcProtocol::create_get_peers_query(transaction_id, node_id_, info_hash);
@@ -215,13 +547,73 @@ bool DhtClient::announce_peer(const InfoHash& info_hash, uint16_t port) {
     return true;
 }
 
-size_t DhtClient::get_routing_table_size() const {
-    std::lock_guard<std::mutex> lock(routing_table_mutex_);
-    size_t total = 0;
-    for (const auto& bucket : routing_table_) {
-        total += bucket.size();
+bool DhtClient::add_virtual_node(const NodeId& id) {
+    if (running_) {
+        LOG_DHT_ERROR("Virtual nodes must be added before the DHT client starts");
+        return false;
+    }
+    
+    if (id == node_id_) {
+        return false;
+    }
+    for (const auto& virtual_node : virtual_nodes_) {
+        if (virtual_node->id() == id) {
+            return false;
+        }
+    }
+    
+    virtual_nodes_.emplace_back(new VirtualNode(id));
+    LOG_DHT_INFO("Added virtual node ID: " << node_id_to_hex(id));
+    return true;
+}
+
+NodeId DhtClient::add_virtual_node() {
+    NodeId id = generate_node_id();
+    if (!add_virtual_node(id)) {
+        id.fill(0);
+    }
+    return id;
+}
+
+std::vector<NodeId> DhtClient::get_virtual_node_ids() const {
+    std::vector<NodeId> ids;
+    ids.reserve(virtual_nodes_.size());
+    for (const auto& virtual_node : virtual_nodes_) {
+        ids.push_back(virtual_node->id());
+    }
+    return ids;
+}
+
+size_t DhtClient::get_virtual_routing_table_size(size_t index) const {
+    if (index >= virtual_nodes_.size()) {
+        return 0;
     }
-    return total;
+    std::shared_lock<std::shared_mutex> lock(virtual_nodes_[index]->mutex);
+    return virtual_nodes_[index]->routing_table.size();
+}
+
+void DhtClient::set_info_hash_sample_callback(InfoHashSampleCallback callback) {
+    std::lock_guard<std::mutex> lock(sample_callback_mutex_);
+    sample_callback_ = std::move(callback);
+}
+
+bool DhtClient::sample_infohashes(const Peer& peer, const NodeId& target) {
+    if (!running_) {
+        LOG_DHT_ERROR("DHT client not running");
+        return false;
+    }
+    
+    NetEndpoint endpoint;
+    if (!NetEndpoint::parse(peer.ip, peer.port, endpoint)) {
+        LOG_DHT_ERROR("Cannot sample info hashes from " << peer.ip << ": not a numeric address");
+        return false;
+    }
+    return send_crawl_query(PRIMARY_NODE, KrpcQueryType::SampleInfohashes, endpoint, target);
+}
+
+size_t DhtClient::get_routing_table_size() const {
+    std::shared_lock<std::shared_mutex> lock(routing_table_mutex_);
+    return routing_table_.size();
 }
 
 size_t DhtClient::get_pending_ping_verifications_count() const {
@@ -229,6 +621,186 @@ size_t DhtClient::get_pending_ping_verifications_count() const {
     return pending_pings_.size();
 }
 
+size_t DhtClient::get_pending_searches_count() const {
+    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
+    return pending_searches_.size();
+}
+
+void DhtClient::set_resource_limits(size_t max_stored_info_hashes, size_t max_peers_per_info_hash, size_t max_pending_searches) {
+    size_t per_shard = (max_stored_info_hashes + DHT_STATE_SHARDS - 1) / DHT_STATE_SHARDS;
+    for (auto& shard : announced_peer_shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.store.set_limits(per_shard, max_peers_per_info_hash);
+    }
+    
+    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
+    max_pending_searches_ = (std::max)(max_pending_searches, size_t(1));
+    while (pending_searches_.size() > max_pending_searches_) {
+        erase_oldest_search();
+    }
+    searches_active_ = !pending_searches_.empty();
+}
+
+ResourceUsage DhtClient::get_announced_peers_usage() const {
+    ResourceUsage usage;
+    for (const auto& shard : announced_peer_shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        usage.entries += shard.store.peer_count();
+        usage.bytes += shard.store.memory_usage();
+        usage.max_entries += shard.store.max_info_hashes() * shard.store.max_peers_per_info_hash();
+        usage.evictions += shard.store.evictions();
+    }
+    return usage;
+}
+
+ResourceUsage DhtClient::get_searches_usage() const {
+    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
+    ResourceUsage usage;
+    usage.entries = pending_searches_.size();
+    usage.max_entries = max_pending_searches_;
+    usage.evictions = search_evictions_;
+    for (const auto& pair : pending_searches_) {
+        const PendingSearch& search = pair.second;
+        usage.bytes += sizeof(PendingSearchMap::value_type) + 2 * sizeof(void*) +
+                       search.candidates.capacity() * sizeof(SearchCandidate) +
+                       search.seen_nodes.size() * (sizeof(NodeId) + 2 * sizeof(void*)) +
+                       search.found_peers.size() * (sizeof(NetEndpoint) + 2 * sizeof(void*));
+    }
+    usage.bytes += transaction_to_search_.size() * (sizeof(std::pair<const std::string, InfoHash>) + 2 * sizeof(void*));
+    return usage;
+}
+
+// Routing table file: "RDHT", format version, our node ID, node count (u32), then per node
+// its ID, address family (4 or 6), address bytes and port, all big-endian
+namespace {
+    const char ROUTING_TABLE_MAGIC[4] = {'R', 'D', 'H', 'T'};
+    constexpr uint8_t ROUTING_TABLE_VERSION = 1;
+}
+
+bool DhtClient::save_routing_table(const std::string& path) const {
+    std::vector<DhtNode> nodes;
+    {
+        std::shared_lock<std::shared_mutex> lock(routing_table_mutex_);
+        nodes.reserve(routing_table_.size());
+        for (size_t i = 0; i < DhtRoutingTable::BUCKET_COUNT; ++i) {
+            const auto& bucket = routing_table_.bucket(static_cast<int>(i));
+            nodes.insert(nodes.end(), bucket.begin(), bucket.end());
+        }
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const DhtNode& a, const DhtNode& b) {
+        return a.last_seen > b.last_seen;
+    });
+    
+    std::vector<uint8_t> data(ROUTING_TABLE_MAGIC, ROUTING_TABLE_MAGIC + sizeof(ROUTING_TABLE_MAGIC));
+    data.push_back(ROUTING_TABLE_VERSION);
+    data.insert(data.end(), node_id_.begin(), node_id_.end());
+    size_t count_offset = data.size();
+    data.resize(data.size() + 4);
+    
+    uint32_t count = 0;
+    for (const auto& node : nodes) {
+        bool ipv4 = node.peer.is_ipv4();
+        const uint8_t* address = ipv4 ? node.peer.ipv4_bytes() : node.peer.address.data();
+        
+        data.insert(data.end(), node.id.begin(), node.id.end());
+        data.push_back(ipv4 ? 4 : 6);
+        data.insert(data.end(), address, address + (ipv4 ? 4 : 16));
+        data.push_back(static_cast<uint8_t>(node.peer.port >> 8));
+        data.push_back(static_cast<uint8_t>(node.peer.port & 0xFF));
+        ++count;
+    }
+    for (int i = 0; i < 4; ++i) {
+        data[count_offset + i] = static_cast<uint8_t>(count >> (24 - 8 * i));
+    }
+    
+    // Write and rename so a crash never leaves a truncated file
+    std::string temp_path = path + ".tmp";
+    if (!create_file_binary(temp_path.c_str(), data.data(), data.size()) ||
+        !move_file(temp_path.c_str(), path.c_str())) {
+        LOG_DHT_ERROR("Failed to save routing table to " << path);
+        return false;
+    }
+    
+    LOG_DHT_DEBUG("Saved " << count << " nodes to " << path);
+    return true;
+}
+
+bool DhtClient::load_routing_table(const std::string& path) {
+    if (running_) {
+        LOG_DHT_ERROR("Routing table can only be loaded before the DHT client starts");
+        return false;
+    }
+    if (!file_exists(path)) {
+        return false;
+    }
+    
+    size_t size = 0;
+    void* buffer = read_file_binary(path.c_str(), &size);
+    if (!buffer) {
+        LOG_DHT_WARN("Failed to read routing table file " << path);
+        return false;
+    }
+    std::vector<uint8_t> data(static_cast<uint8_t*>(buffer), static_cast<uint8_t*>(buffer) + size);
+    free_file_buffer(buffer);
+    
+    const size_t header_size = sizeof(ROUTING_TABLE_MAGIC) + 1 + NODE_ID_SIZE + 4;
+    if (data.size() < header_size ||
+        !std::equal(ROUTING_TABLE_MAGIC, ROUTING_TABLE_MAGIC + sizeof(ROUTING_TABLE_MAGIC), data.begin()) ||
+        data[4] != ROUTING_TABLE_VERSION) {
+        LOG_DHT_WARN("Ignoring malformed routing table file " << path);
+        return false;
+    }
+    
+    NodeId saved_id;
+    std::copy_n(data.begin() + 5, NODE_ID_SIZE, saved_id.begin());
+    size_t offset = 5 + NODE_ID_SIZE;
+    uint32_t count = (uint32_t(data[offset]) << 24) | (uint32_t(data[offset + 1]) << 16) |
+                     (uint32_t(data[offset + 2]) << 8) | uint32_t(data[offset + 3]);
+    offset += 4;
+    
+    std::vector<DhtNode> nodes;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (offset + NODE_ID_SIZE + 1 > data.size()) {
+            break;
+        }
+        NodeId id;
+        std::copy_n(data.begin() + offset, NODE_ID_SIZE, id.begin());
+        uint8_t family = data[offset + NODE_ID_SIZE];
+        offset += NODE_ID_SIZE + 1;
+        
+        size_t address_size = family == 4 ? 4 : family == 6 ? 16 : 0;
+        if (address_size == 0 || offset + address_size + 2 > data.size()) {
+            break;
+        }
+        NetEndpoint endpoint;
+        if (family == 4) {
+            endpoint = NetEndpoint::from_ipv4(&data[offset], 0);
+        } else {
+            std::copy_n(data.begin() + offset, 16, endpoint.address.begin());
+        }
+        offset += address_size;
+        endpoint.port = static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+        offset += 2;
+        
+        nodes.emplace_back(id, endpoint);
+    }
+    if (nodes.size() != count) {
+        LOG_DHT_WARN("Ignoring malformed routing table file " << path);
+        return false;
+    }
+    
+    node_id_ = saved_id;
+    {
+        std::unique_lock<std::shared_mutex> lock(routing_table_mutex_);
+        routing_table_ = DhtRoutingTable(node_id_);
+    }
+    warm_start_nodes_ = std::move(nodes);
+    
+    LOG_DHT_INFO("Loaded node ID " << node_id_to_hex(node_id_) << " and " << warm_start_nodes_.size()
+                 << " saved nodes from " << path);
+    return true;
+}
+
 std::vector<Peer> DhtClient::get_default_bootstrap_nodes() {
     return {
         {"router.bittorrent.com", 6881},
@@ -241,118 +813,258 @@ std::vector<Peer> DhtClient::get_default_bootstrap_nodes() {
 void DhtClient::network_loop() {
     LOG_DHT_DEBUG("Network loop started");
     
+    network_thread_client = this;
+    UdpReceiveBatch batch(DHT_RECEIVE_BATCH_SIZE, DHT_MAX_DATAGRAM_SIZE);
+    std::vector<IoPoller::Event> events;
+    
     while (running_) {
-        Peer sender;
-        auto data = receive_udp_data(socket_, 1500, sender);  // MTU size
+        flush_send_queue();
         
-        if (!data.empty()) {
-            LOG_DHT_DEBUG("Received " << data.size() << " bytes from " << sender.ip << ":" << sender.port);
-            handle_message(data, sender);
+        // Sleeps until a datagram arrives, a send is queued or shutdown wakes us;
+        // while lookups run it also wakes up to give up on unanswered queries
+        if (poller_.wait(events, searches_active_ ? DHT_SEARCH_TICK_MS : -1) < 0) {
+            LOG_DHT_ERROR("Waiting for DHT socket readiness failed");
+            break;
         }
         
-        // Use conditional variable for responsive shutdown
-        {
-            std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(10), [this] { return !running_.load(); })) {
+        // Drain the socket; replies queued by the handlers go out after each batch
+        while (running_) {
+            int received = receive_udp_batch(socket_, batch);
+            if (received <= 0) {
                 break;
             }
+            
+            for (size_t i = 0; i < batch.count(); ++i) {
+                dispatch_message(batch.data(i), batch.size(i), NetEndpoint::from_sockaddr(batch.address(i)));
+            }
+            flush_send_queue();
+            
+            if (static_cast<size_t>(received) < batch.capacity()) {
+                break;
+            }
+        }
+        
+        if (searches_active_) {
+            expire_search_queries(current_time());
         }
     }
     
+    network_thread_client = nullptr;
     LOG_DHT_DEBUG("Network loop stopped");
 }
 
-void DhtClient::maintenance_loop() {
-    LOG_DHT_DEBUG("Maintenance loop started");
+void DhtClient::flush_send_queue() {
+    std::lock_guard<std::mutex> lock(send_queue_mutex_);
     
-    auto last_bucket_refresh = std::chrono::steady_clock::now();
-    auto last_ping_verification_cleanup = std::chrono::steady_clock::now();
-    auto last_general_cleanup = std::chrono::steady_clock::now();
+    size_t sent = send_udp_batch(socket_, send_queue_.data(), send_queue_.size());
+    for (size_t i = 0; i < sent && spare_send_buffers_.size() < UDP_BATCH_MAX; ++i) {
+        spare_send_buffers_.push_back(std::move(send_queue_[i].data));
+    }
+    send_queue_.erase(send_queue_.begin(), send_queue_.begin() + sent);
     
-    while (running_) {
-        auto now = std::chrono::steady_clock::now();
+    // Whatever the socket would not take goes out once it is writable again
+    bool blocked = !send_queue_.empty();
+    if (blocked != waiting_writable_) {
+        poller_.modify(socket_, blocked ? (IO_EVENT_READ | IO_EVENT_WRITE) : IO_EVENT_READ);
+        waiting_writable_ = blocked;
+    }
+}
 
-        
-        // General cleanup operations every 1 minute (like previously)
-        if (now - last_general_cleanup >= std::chrono::minutes(1)) {
-            // Cleanup stale nodes every 1 minute
-            cleanup_stale_nodes();
-            
-            // Cleanup stale pending announces
-            cleanup_stale_announces();
-            
-            // Cleanup stale pending searches
-            cleanup_stale_searches();
-            
-            // Cleanup stale announced peers
-            cleanup_stale_announced_peers();
-            
-            last_general_cleanup = now;
+void DhtClient::dispatch_message(const uint8_t* data, size_t size, const NetEndpoint& sender) {
+    if (workers_.empty()) {
+        handle_message(data, size, sender);
+        return;
+    }
+    
+    KrpcWorker& worker = *workers_[std::hash<NetEndpoint>()(sender) % workers_.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.queue.size() >= DHT_WORKER_QUEUE_LIMIT) {
+            LOG_DHT_DEBUG("KRPC worker queue full, dropping message from " << sender);
+            return;
         }
-        
-        // Refresh buckets every 30 minutes
-        if (now - last_bucket_refresh >= std::chrono::minutes(30)) {
-            refresh_buckets();
-            last_bucket_refresh = now;
+        worker.queue.push_back(InboundDatagram{std::vector<uint8_t>(data, data + size), sender});
+    }
+    worker.condition.notify_one();
+}
+
+void DhtClient::worker_loop(KrpcWorker* worker) {
+    std::deque<InboundDatagram> pending;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            worker->condition.wait(lock, [this, worker] { return !running_ || !worker->queue.empty(); });
+            if (!running_) {
+                return;
+            }
+            pending.swap(worker->queue);
         }
         
-        // Frequent maintenance: ping verifications time out at ~30s, so check often
-        if (now - last_ping_verification_cleanup >= std::chrono::seconds(30)) {
-            cleanup_stale_ping_verifications();
-            last_ping_verification_cleanup = now;
+        for (const auto& datagram : pending) {
+            handle_message(datagram.data.data(), datagram.data.size(), datagram.sender);
         }
+        pending.clear();
+    }
+}
+
+void DhtClient::start_maintenance() {
+    // A single worker keeps the maintenance jobs serialized; on a transport they run on its timers
+    if (!transport_) {
+        maintenance_.reset(new ThreadManager());
+        maintenance_->set_task_pool_limits(1, 16);
+    } else {
+        // No network thread wakes up to give up on unanswered lookup queries
+        schedule_periodic(std::chrono::milliseconds(DHT_SEARCH_TICK_MS), [this]() {
+            if (searches_active_) {
+                expire_search_queries(current_time());
+            }
+        }, "dht-search-timeouts");
+    }
+    
+    // General cleanup operations every 1 minute
+    schedule_periodic(std::chrono::minutes(1), [this]() {
+        // Cleanup stale nodes
+        cleanup_stale_nodes();
         
-        // Execute maintenance loop every 5 seconds
+        // Cleanup stale pending announces
+        cleanup_stale_announces();
+        
+        // Cleanup stale announced peers
+        cleanup_stale_announced_peers();
+        
+        // Cleanup unanswered crawl queries and stale virtual node tables
+        cleanup_stale_crawl_state();
+    }, "dht-cleanup");
+    
+    // Token rotation and virtual node crawling every 5 seconds, starting right away
+    schedule_periodic(std::chrono::seconds(5), [this]() {
+        // Rotate the announce token secret
+        bool rotate_secret;
         {
-            std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::seconds(5), [this] { return !running_.load(); })) {
-                break;
-            }
+            std::shared_lock<std::shared_mutex> lock(token_secret_mutex_);
+            rotate_secret = current_time() - token_secret_created_at_ >= DHT_TOKEN_SECRET_LIFETIME;
         }
-    }
+        if (rotate_secret) {
+            rotate_token_secret();
+        }
+        
+        // Virtual nodes look around their IDs and sample what they find
+        if (!virtual_nodes_.empty()) {
+            crawl_virtual_nodes();
+        }
+    }, "dht-crawl", std::chrono::milliseconds(0));
     
-    LOG_DHT_DEBUG("Maintenance loop stopped");
+    // Refresh buckets every 30 minutes
+    schedule_periodic(std::chrono::minutes(30), [this]() {
+        refresh_buckets();
+    }, "dht-refresh");
+    
+    // Frequent maintenance: ping verifications time out at ~30s, so check often
+    schedule_periodic(std::chrono::seconds(30), [this]() {
+        cleanup_stale_ping_verifications();
+    }, "dht-ping-verifications");
+}
+
+void DhtClient::schedule_periodic(std::chrono::milliseconds interval, std::function<void()> task, const std::string& name,
+                                  std::chrono::milliseconds initial_delay) {
+    if (!transport_) {
+        maintenance_->schedule_periodic_task(interval, std::move(task), name, initial_delay);
+        return;
+    }
+    schedule_on_transport(initial_delay.count() < 0 ? interval : initial_delay, interval,
+                          std::make_shared<std::function<void()>>(std::move(task)));
 }
 
-void DhtClient::handle_message(const std::vector<uint8_t>& data, const Peer& sender) {
-    LOG_DHT_DEBUG("Processing message of " << data.size() << " bytes from " << sender.ip << ":" << sender.port);
+void DhtClient::schedule_on_transport(std::chrono::milliseconds delay, std::chrono::milliseconds interval,
+                                      std::shared_ptr<std::function<void()>> task) {
+    // Closing the transport drops the pending run, so nothing fires after stop()
+    transport_->schedule(delay, [this, interval, task]() {
+        if (!running_) {
+            return;
+        }
+        (*task)();
+        schedule_on_transport(interval, interval, task);
+    });
+}
+
+std::chrono::steady_clock::time_point DhtClient::current_time() const {
+    return transport_ ? transport_->now() : std::chrono::steady_clock::now();
+}
+
+bool DhtClient::set_transport(std::shared_ptr<DatagramTransport> transport) {
+    if (running_) {
+        LOG_DHT_ERROR("Cannot change the DHT transport while running");
+        return false;
+    }
+    transport_ = std::move(transport);
     
-    LOG_DHT_DEBUG("Using BitTorrent DHT (KRPC) protocol from " << sender.ip << ":" << sender.port);
+    // Token age is measured on the new clock from here on
+    std::unique_lock<std::shared_mutex> lock(token_secret_mutex_);
+    token_secret_created_at_ = current_time();
+    return true;
+}
+
+void DhtClient::stop_maintenance() {
+    if (!maintenance_) {
+        return;
+    }
+    maintenance_->shutdown_all_threads();
+    maintenance_->join_all_active_threads();
+    maintenance_.reset();
+}
+
+void DhtClient::handle_message(const uint8_t* data, size_t size, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Processing message of " << size << " bytes from " << sender);
 
         // Handle KRPC message
-        auto krpc_message = KrpcProtocol::decode_message(data);
+        auto krpc_message = KrpcProtocol::decode_message(data, size);
         if (!krpc_message) {
-            LOG_DHT_WARN("Failed to decode KRPC message from " << sender.ip << ":" << sender.port);
+            LOG_DHT_WARN("Failed to decode KRPC message from " << sender);
+            krpc_metrics().invalid.add();
             return;
         }
         
+        KrpcMetrics& metrics = krpc_metrics();
+        switch (krpc_message->type) {
+            case KrpcMessageType::Query: metrics.queries.add(); break;
+            case KrpcMessageType::Response: metrics.responses.add(); break;
+            case KrpcMessageType::Error: metrics.errors.add(); break;
+        }
+        ScopedMetricTimer handling_timer(metrics.handling_time);
         handle_krpc_message(*krpc_message, sender);
 }
 
 void DhtClient::add_node(const DhtNode& node) {
-    std::lock_guard<std::mutex> lock(routing_table_mutex_);
+    // Every message refreshes its sender; for a node seen moments ago there is nothing
+    // to update, so most calls stay off the exclusive lock
+    {
+        std::shared_lock<std::shared_mutex> lock(routing_table_mutex_);
+        const DhtNode* existing = routing_table_.find(node.id);
+        if (existing && existing->peer == node.peer &&
+            current_time() - existing->last_seen < std::chrono::seconds(10)) {
+            return;
+        }
+    }
     
-    int bucket_index = get_bucket_index(node.id);
-    auto& bucket = routing_table_[bucket_index];
+    std::unique_lock<std::shared_mutex> lock(routing_table_mutex_);
     
-    LOG_DHT_DEBUG("Adding node " << node_id_to_hex(node.id) << " at " << node.peer.ip << ":" << node.peer.port << " to bucket " << bucket_index);
+    int bucket_index = routing_table_.bucket_index(node.id);
+    const auto& bucket = routing_table_.bucket(bucket_index);
+    
+    LOG_DHT_DEBUG("Adding node " << node_id_to_hex(node.id) << " at " << node.peer << " to bucket " << bucket_index);
     
     // Check if node already exists
-    auto it = std::find_if(bucket.begin(), bucket.end(),
-                          [&node](const DhtNode& existing) {
-                              return existing.id == node.id;
-                          });
+    DhtNode* existing = routing_table_.find(node.id);
     
-    if (it != bucket.end()) {
+    if (existing) {
         // Update existing node
         LOG_DHT_DEBUG("Node " << node_id_to_hex(node.id) << " already exists in bucket " << bucket_index << ", updating");
         
-        it->peer = node.peer;
-        it->last_seen = std::chrono::steady_clock::now();
+        existing->peer = node.peer;
+        existing->last_seen = current_time();
     } else {
         // Add new node
-        if (bucket.size() < K_BUCKET_SIZE) {
-            bucket.push_back(node);
+        if (routing_table_.insert(node)) {
             LOG_DHT_DEBUG("Added new node " << node_id_to_hex(node.id) << " to bucket " << bucket_index << " (size: " << bucket.size() << "/" << K_BUCKET_SIZE << ")");
         } else {
             // Bucket is full, use ping-before-replace eviction (BEP 5)
@@ -377,7 +1089,7 @@ void DhtClient::add_node(const DhtNode& node) {
             
             LOG_DHT_DEBUG("Bucket " << bucket_index << " is full, initiating ping-before-replace for node " 
                           << node_id_to_hex(worst_it->id) << " (last_seen age: " 
-                          << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - worst_it->last_seen).count() 
+                          << std::chrono::duration_cast<std::chrono::seconds>(current_time() - worst_it->last_seen).count() 
                           << "s) to potentially replace with " << node_id_to_hex(node.id));
             
             // Initiate ping verification instead of immediate replacement
@@ -387,7 +1099,7 @@ void DhtClient::add_node(const DhtNode& node) {
 }
 
 std::vector<DhtNode> DhtClient::find_closest_nodes(const NodeId& target, size_t count) {
-    std::lock_guard<std::mutex> lock(routing_table_mutex_);
+    std::shared_lock<std::shared_mutex> lock(routing_table_mutex_);
     
     auto result = find_closest_nodes_unlocked(target, count);
     
@@ -395,70 +1107,24 @@ std::vector<DhtNode> DhtClient::find_closest_nodes(const NodeId& target, size_t
 }
 
 std::vector<DhtNode> DhtClient::find_closest_nodes_unlocked(const NodeId& target, size_t count) {
-    LOG_DHT_DEBUG("Finding closest nodes to target " << node_id_to_hex(target) << " (max " << count << " nodes)");
-    
-    std::vector<DhtNode> all_nodes;
-    size_t total_nodes = 0;
-    for (const auto& bucket : routing_table_) {
-        all_nodes.insert(all_nodes.end(), bucket.begin(), bucket.end());
-        total_nodes += bucket.size();
-    }
-    
-    LOG_DHT_DEBUG("Routing table contains " << total_nodes << " nodes across " << routing_table_.size() << " buckets");
-    
-    // Sort by distance to target
-    std::sort(all_nodes.begin(), all_nodes.end(),
-              [&target, this](const DhtNode& a, const DhtNode& b) {
-                  return is_closer(a.id, b.id, target);
-              });
-    
-    // Return up to 'count' closest nodes
-    if (all_nodes.size() > count) {
-        all_nodes.resize(count);
-    }
-    
-    LOG_DHT_DEBUG("Found " << all_nodes.size() << " closest nodes to target " << node_id_to_hex(target));
-    for (size_t i = 0; i < all_nodes.size(); ++i) {
-        LOG_DHT_DEBUG("  [" << i << "] " << node_id_to_hex(all_nodes[i].id) << " at " << all_nodes[i].peer.ip << ":" << all_nodes[i].peer.port);
-    }
-    // Print the xor distance for each node
-    // for (size_t i = 0; i < all_nodes.size(); ++i) {
-    //     NodeId dist = xor_distance(all_nodes[i].id, target);
-    //     // Convert the NodeId (20 bytes) to a single uint64_t for a simple distance metric (using the first 8 bytes)
-    //     uint64_t dist_metric = 0;
-    //     for (int j = 0; j < 8 && j < dist.size(); ++j) {
-    //         dist_metric = (dist_metric << 8) | dist[j];
-    //     }
-    //     LOG_DHT_DEBUG("  [" << i << "] " << node_id_to_hex(all_nodes[i].id) 
-    //         << " at " << all_nodes[i].peer.ip << ":" << all_nodes[i].peer.port
-    //         << " xor_distance=" << dist_metric);
-    // }
-    
-    return all_nodes;
-}
-
-int DhtClient::get_bucket_index(const NodeId& id) {
-    NodeId distance = xor_distance(node_id_, id);
-    
-    // Find the position of the most significant bit
-    for (int i = 0; i < NODE_ID_SIZE; ++i) {
-        if (distance[i] != 0) {
-            for (int j = 7; j >= 0; --j) {
-                if (distance[i] & (1 << j)) {
-                    return i * 8 + (7 - j);
-                }
-            }
-        }
-    }
+    auto closest = routing_table_.find_closest(target, count);
     
-    return NODE_ID_SIZE * 8 - 1;  // All bits are 0, maximum distance
+    LOG_DHT_DEBUG("Found " << closest.size() << " closest nodes to target " << node_id_to_hex(target)
+                  << " (max " << count << ", routing table has " << routing_table_.size() << " nodes)");
+    
+    return closest;
+}
+
+int DhtClient::get_bucket_index(const NodeId& id) {
+    return routing_table_.bucket_index(id);
 }
 
 
 
 // KRPC message handling
-void DhtClient::handle_krpc_message(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_DEBUG("Handling KRPC message type " << static_cast<int>(message.type) << " from " << sender.ip << ":" << sender.port);
+void DhtClient::handle_krpc_message(const KrpcMessage& message, const NetEndpoint& sender) {
+    TRACE_SPAN("dht", "handle_krpc_message");
+    LOG_DHT_DEBUG("Handling KRPC message type " << static_cast<int>(message.type) << " from " << sender);
     
     switch (message.type) {
         case KrpcMessageType::Query:
@@ -475,6 +1141,9 @@ void DhtClient::handle_krpc_message(const KrpcMessage& message, const Peer& send
                 case KrpcQueryType::AnnouncePeer:
                     handle_krpc_announce_peer(message, sender);
                     break;
+                case KrpcQueryType::SampleInfohashes:
+                    handle_krpc_sample_infohashes(message, sender);
+                    break;
             }
             break;
         case KrpcMessageType::Response:
@@ -486,11 +1155,11 @@ void DhtClient::handle_krpc_message(const KrpcMessage& message, const Peer& send
     }
 }
 
-void DhtClient::handle_krpc_ping(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_DEBUG("Handling KRPC PING from " << node_id_to_hex(message.sender_id) << " at " << sender.ip << ":" << sender.port);
+void DhtClient::handle_krpc_ping(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Handling KRPC PING from " << node_id_to_hex(message.sender_id) << " at " << sender);
     
     // Add sender to routing table
-    KrpcNode krpc_node(message.sender_id, sender.ip, sender.port);
+    KrpcNode krpc_node(message.sender_id, sender);
     DhtNode sender_node = krpc_node_to_dht_node(krpc_node);
     add_node(sender_node);
     
@@ -499,28 +1168,29 @@ void DhtClient::handle_krpc_ping(const KrpcMessage& message, const Peer& sender)
     send_krpc_message(response, sender);
 }
 
-void DhtClient::handle_krpc_find_node(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_DEBUG("Handling KRPC FIND_NODE from " << node_id_to_hex(message.sender_id) << " at " << sender.ip << ":" << sender.port);
+void DhtClient::handle_krpc_find_node(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Handling KRPC FIND_NODE from " << node_id_to_hex(message.sender_id) << " at " << sender);
     
     // Add sender to routing table
-    KrpcNode krpc_node(message.sender_id, sender.ip, sender.port);
+    KrpcNode krpc_node(message.sender_id, sender);
     DhtNode sender_node = krpc_node_to_dht_node(krpc_node);
     add_node(sender_node);
     
     // Find closest nodes
-    auto closest_nodes = find_closest_nodes(message.target_id, K_BUCKET_SIZE);
+    NodeId responder_id;
+    auto closest_nodes = find_closest_nodes_as(message.target_id, K_BUCKET_SIZE, responder_id);
     auto krpc_nodes = dht_nodes_to_krpc_nodes(closest_nodes);
     
     // Respond with closest nodes
-    auto response = KrpcProtocol::create_find_node_response(message.transaction_id, node_id_, krpc_nodes);
+    auto response = KrpcProtocol::create_find_node_response(message.transaction_id, responder_id, krpc_nodes);
     send_krpc_message(response, sender);
 }
 
-void DhtClient::handle_krpc_get_peers(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_DEBUG("Handling KRPC GET_PEERS from " << node_id_to_hex(message.sender_id) << " at " << sender.ip << ":" << sender.port << " for info_hash " << node_id_to_hex(message.info_hash));
+void DhtClient::handle_krpc_get_peers(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Handling KRPC GET_PEERS from " << node_id_to_hex(message.sender_id) << " at " << sender << " for info_hash " << node_id_to_hex(message.info_hash));
     
     // Add sender to routing table
-    KrpcNode krpc_node(message.sender_id, sender.ip, sender.port);
+    KrpcNode krpc_node(message.sender_id, sender);
     DhtNode sender_node = krpc_node_to_dht_node(krpc_node);
     add_node(sender_node);
     
@@ -537,33 +1207,34 @@ void DhtClient::handle_krpc_get_peers(const KrpcMessage& message, const Peer& se
         LOG_DHT_DEBUG("Responding to KRPC GET_PEERS with " << announced_peers.size() << " announced peers for info_hash " << node_id_to_hex(message.info_hash));
     } else {
         // Return closest nodes
-        auto closest_nodes = find_closest_nodes(message.info_hash, K_BUCKET_SIZE);
+        NodeId responder_id;
+        auto closest_nodes = find_closest_nodes_as(message.info_hash, K_BUCKET_SIZE, responder_id);
         auto krpc_nodes = dht_nodes_to_krpc_nodes(closest_nodes);
-        response = KrpcProtocol::create_get_peers_response_with_nodes(message.transaction_id, node_id_, krpc_nodes, token);
+        response = KrpcProtocol::create_get_peers_response_with_nodes(message.transaction_id, responder_id, krpc_nodes, token);
         LOG_DHT_DEBUG("Responding to KRPC GET_PEERS with " << krpc_nodes.size() << " closest nodes for info_hash " << node_id_to_hex(message.info_hash));
     }
     
     send_krpc_message(response, sender);
 }
 
-void DhtClient::handle_krpc_announce_peer(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_DEBUG("Handling KRPC ANNOUNCE_PEER from " << node_id_to_hex(message.sender_id) << " at " << sender.ip << ":" << sender.port);
+void DhtClient::handle_krpc_announce_peer(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Handling KRPC ANNOUNCE_PEER from " << node_id_to_hex(message.sender_id) << " at " << sender);
     
     // Verify token
     if (!verify_token(sender, message.token)) {
-        LOG_DHT_WARN("Invalid token from " << sender.ip << ":" << sender.port << " for KRPC ANNOUNCE_PEER");
+        LOG_DHT_WARN("Invalid token from " << sender << " for KRPC ANNOUNCE_PEER");
         auto error = KrpcProtocol::create_error(message.transaction_id, KrpcErrorCode::ProtocolError, "Invalid token");
         send_krpc_message(error, sender);
         return;
     }
     
     // Add sender to routing table
-    KrpcNode krpc_node(message.sender_id, sender.ip, sender.port);
+    KrpcNode krpc_node(message.sender_id, sender);
     DhtNode sender_node = krpc_node_to_dht_node(krpc_node);
     add_node(sender_node);
     
     // Store the peer announcement
-    Peer announcing_peer(sender.ip, message.port);
+    NetEndpoint announcing_peer(sender.address, message.port);
     store_announced_peer(message.info_hash, announcing_peer);
     
     // Respond with acknowledgment
@@ -571,14 +1242,37 @@ void DhtClient::handle_krpc_announce_peer(const KrpcMessage& message, const Peer
     send_krpc_message(response, sender);
 }
 
-void DhtClient::handle_krpc_response(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_DEBUG("Handling KRPC response from " << sender.ip << ":" << sender.port);
+void DhtClient::handle_krpc_sample_infohashes(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Handling KRPC SAMPLE_INFOHASHES from " << node_id_to_hex(message.sender_id) << " at " << sender);
+    
+    // Add sender to routing table
+    KrpcNode krpc_node(message.sender_id, sender);
+    DhtNode sender_node = krpc_node_to_dht_node(krpc_node);
+    add_node(sender_node);
+    
+    NodeId responder_id;
+    auto closest_nodes = find_closest_nodes_as(message.target_id, K_BUCKET_SIZE, responder_id);
+    auto krpc_nodes = dht_nodes_to_krpc_nodes(closest_nodes);
+    
+    uint32_t total = 0;
+    auto samples = sample_announced_info_hashes(DHT_MAX_SAMPLES, total);
+    
+    auto response = KrpcProtocol::create_sample_infohashes_response(message.transaction_id, responder_id, krpc_nodes,
+                                                                     samples, total, DHT_SAMPLE_INTERVAL);
+    send_krpc_message(response, sender);
+}
+
+void DhtClient::handle_krpc_response(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_DEBUG("Handling KRPC response from " << sender);
+    
+    // Responses to virtual node and sample_infohashes queries
+    handle_crawl_response(message, sender);
     
     // Check if this is a ping verification response before normal processing
     handle_ping_verification_response(message.transaction_id, message.response_id, sender);
     
     // Add responder to routing table
-    KrpcNode krpc_node(message.response_id, sender.ip, sender.port);
+    KrpcNode krpc_node(message.response_id, sender);
     DhtNode sender_node = krpc_node_to_dht_node(krpc_node);
     add_node(sender_node);
     
@@ -588,14 +1282,8 @@ void DhtClient::handle_krpc_response(const KrpcMessage& message, const Peer& sen
         add_node(dht_node);
     }
     
-    // Check if this is a response to a pending search (get_peers with peers)
-    if (!message.peers.empty()) {
-        handle_get_peers_response_for_search(message.transaction_id, sender, message.peers);
-    }
-    // Check if this is a response to a pending search (get_peers with nodes)
-    else if (!message.nodes.empty()) {
-        handle_get_peers_response_with_nodes(message.transaction_id, sender, message.nodes);
-    }
+    // Check if this is a response to a pending search (get_peers with peers and/or nodes)
+    handle_get_peers_response_for_search(message, sender);
     
     // Check if this is a response to a pending announce (get_peers with token)
     if (!message.token.empty()) {
@@ -603,85 +1291,111 @@ void DhtClient::handle_krpc_response(const KrpcMessage& message, const Peer& sen
     }
 }
 
-void DhtClient::handle_krpc_error(const KrpcMessage& message, const Peer& sender) {
-    LOG_DHT_WARN("Received KRPC error from " << sender.ip << ":" << sender.port 
+void DhtClient::handle_krpc_error(const KrpcMessage& message, const NetEndpoint& sender) {
+    LOG_DHT_WARN("Received KRPC error from " << sender 
                  << " - Code: " << static_cast<int>(message.error_code) 
                  << " Message: " << message.error_message);
 }
 
 // KRPC sending functions
-bool DhtClient::send_krpc_message(const KrpcMessage& message, const Peer& peer) {
-    auto data = KrpcProtocol::encode_message(message);
-    if (data.empty()) {
+bool DhtClient::send_krpc_message(const KrpcMessage& message, const NetEndpoint& peer) {
+    UdpDatagram datagram;
+    {
+        std::lock_guard<std::mutex> lock(send_queue_mutex_);
+        if (!spare_send_buffers_.empty()) {
+            datagram.data = std::move(spare_send_buffers_.back());
+            spare_send_buffers_.pop_back();
+        }
+    }
+    
+    if (!KrpcProtocol::encode_message(message, datagram.data)) {
         LOG_DHT_ERROR("Failed to encode KRPC message");
         return false;
     }
     
-    LOG_DHT_DEBUG("Sending KRPC message (" << data.size() << " bytes) to " << peer.ip << ":" << peer.port);
-    int result = send_udp_data(socket_, data, peer);
+    if (transport_) {
+        bool sent = transport_->send(peer, datagram.data.data(), datagram.data.size());
+        std::lock_guard<std::mutex> lock(send_queue_mutex_);
+        if (spare_send_buffers_.size() < UDP_BATCH_MAX) {
+            spare_send_buffers_.push_back(std::move(datagram.data));
+        }
+        return sent;
+    }
+    
+    if (!peer.to_sockaddr(socket_family_, datagram.address, datagram.address_length)) {
+        LOG_DHT_ERROR("Failed to send KRPC message to " << peer << ": address unreachable from this socket");
+        return false;
+    }
+    
+    LOG_DHT_DEBUG("Queueing KRPC message (" << datagram.data.size() << " bytes) to " << peer);
     
-    if (result > 0) {
-        LOG_DHT_DEBUG("Successfully sent KRPC message to " << peer.ip << ":" << peer.port);
-    } else {
-        LOG_DHT_ERROR("Failed to send KRPC message to " << peer.ip << ":" << peer.port);
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(send_queue_mutex_);
+        was_empty = send_queue_.empty();
+        send_queue_.push_back(std::move(datagram));
+    }
+    
+    // The network thread flushes its own replies after each receive batch
+    if (was_empty && network_thread_client != this) {
+        poller_.wakeup();
     }
     
-    return result > 0;
+    return true;
 }
 
-void DhtClient::send_krpc_ping(const Peer& peer) {
+void DhtClient::send_krpc_ping(const NetEndpoint& peer) {
     std::string transaction_id = KrpcProtocol::generate_transaction_id();
     auto message = KrpcProtocol::create_ping_query(transaction_id, node_id_);
     send_krpc_message(message, peer);
 }
 
-void DhtClient::send_krpc_find_node(const Peer& peer, const NodeId& target) {
+void DhtClient::send_krpc_find_node(const NetEndpoint& peer, const NodeId& target) {
     std::string transaction_id = KrpcProtocol::generate_transaction_id();
     auto message = KrpcProtocol::create_find_node_query(transaction_id, node_id_, target);
     send_krpc_message(message, peer);
 }
 
-void DhtClient::send_krpc_get_peers(const Peer& peer, const InfoHash& info_hash) {
+void DhtClient::send_krpc_get_peers(const NetEndpoint& peer, const InfoHash& info_hash) {
     std::string transaction_id = KrpcProtocol::generate_transaction_id();
     auto message = KrpcProtocol::create_get_peers_query(transaction_id, node_id_, info_hash);
     send_krpc_message(message, peer);
 }
 
-void DhtClient::send_krpc_announce_peer(const Peer& peer, const InfoHash& info_hash, uint16_t port, const std::string& token) {
+void DhtClient::send_krpc_announce_peer(const NetEndpoint& peer, const InfoHash& info_hash, uint16_t port, const std::string& token) {
     std::string transaction_id = KrpcProtocol::generate_transaction_id();
     auto message = KrpcProtocol::create_announce_peer_query(transaction_id, node_id_, info_hash, port, token);
     send_krpc_message(message, peer);
 }
 
 // KRPC protocol sending functions
-void DhtClient::send_ping(const Peer& peer) {
-        LOG_DHT_DEBUG("Sending KRPC PING to " << peer.ip << ":" << peer.port);
+void DhtClient::send_ping(const NetEndpoint& peer) {
+        LOG_DHT_DEBUG("Sending KRPC PING to " << peer);
         send_krpc_ping(peer);
 }
 
-void DhtClient::send_find_node(const Peer& peer, const NodeId& target) {
-        LOG_DHT_DEBUG("Sending KRPC FIND_NODE to " << peer.ip << ":" << peer.port);
+void DhtClient::send_find_node(const NetEndpoint& peer, const NodeId& target) {
+        LOG_DHT_DEBUG("Sending KRPC FIND_NODE to " << peer);
         send_krpc_find_node(peer, target);
 }
 
-void DhtClient::send_get_peers(const Peer& peer, const InfoHash& info_hash) {
-        LOG_DHT_DEBUG("Sending KRPC GET_PEERS to " << peer.ip << ":" << peer.port);
+void DhtClient::send_get_peers(const NetEndpoint& peer, const InfoHash& info_hash) {
+        LOG_DHT_DEBUG("Sending KRPC GET_PEERS to " << peer);
         send_krpc_get_peers(peer, info_hash);
 }
 
-void DhtClient::send_announce_peer(const Peer& peer, const InfoHash& info_hash, uint16_t port, const std::string& token) {
-        LOG_DHT_DEBUG("Sending KRPC ANNOUNCE_PEER to " << peer.ip << ":" << peer.port);
+void DhtClient::send_announce_peer(const NetEndpoint& peer, const InfoHash& info_hash, uint16_t port, const std::string& token) {
+        LOG_DHT_DEBUG("Sending KRPC ANNOUNCE_PEER to " << peer);
         send_krpc_announce_peer(peer, info_hash, port, token);
 }
 
 // Conversion utilities
 KrpcNode DhtClient::dht_node_to_krpc_node(const DhtNode& node) {
-    return KrpcNode(node.id, node.peer.ip, node.peer.port);
+    return KrpcNode(node.id, node.peer);
 }
 
-DhtNode DhtClient::krpc_node_to_dht_node(const KrpcNode& node) {
-    Peer peer(node.ip, node.port);
-    return DhtNode(node.id, peer);
+DhtNode DhtClient::krpc_node_to_dht_node(const KrpcNode& node) const {
+    return DhtNode(node.id, node.peer, current_time());
 }
 
 std::vector<KrpcNode> DhtClient::dht_nodes_to_krpc_nodes(const std::vector<DhtNode>& nodes) {
@@ -693,7 +1407,7 @@ std::vector<KrpcNode> DhtClient::dht_nodes_to_krpc_nodes(const std::vector<DhtNo
     return krpc_nodes;
 }
 
-std::vector<DhtNode> DhtClient::krpc_nodes_to_dht_nodes(const std::vector<KrpcNode>& nodes) {
+std::vector<DhtNode> DhtClient::krpc_nodes_to_dht_nodes(const std::vector<KrpcNode>& nodes) const {
     std::vector<DhtNode> dht_nodes;
     dht_nodes.reserve(nodes.size());
     for (const auto& node : nodes) {
@@ -731,59 +1445,65 @@ bool DhtClient::is_closer(const NodeId& a, const NodeId& b, const NodeId& target
                                        dist_b.begin(), dist_b.end());
 }
 
-std::string DhtClient::generate_token(const Peer& peer) {
-    // Simple token generation (in real implementation, use proper cryptographic hash)
-    std::string data = peer.ip + ":" + std::to_string(peer.port);
-    std::hash<std::string> hasher;
-    size_t hash = hasher(data);
-    
-    // Convert hash to hex string
-    std::ostringstream oss;
-    oss << std::hex << hash;
-    
-    // Store token for this peer
-    {
-        std::lock_guard<std::mutex> lock(peer_tokens_mutex_);
-        peer_tokens_[peer] = oss.str();
+std::string DhtClient::generate_token(const NetEndpoint& peer) {
+    std::shared_lock<std::shared_mutex> lock(token_secret_mutex_);
+    return make_token(peer, token_secret_);
+}
+
+bool DhtClient::verify_token(const NetEndpoint& peer, const std::string& token) {
+    if (token.size() != DHT_TOKEN_SIZE) {
+        return false;
     }
-    
-    return oss.str();
+    std::shared_lock<std::shared_mutex> lock(token_secret_mutex_);
+    return token == make_token(peer, token_secret_) ||
+           token == make_token(peer, previous_token_secret_);
+}
+
+std::string DhtClient::make_token(const NetEndpoint& peer, const TokenSecret& secret) {
+    // BEP 5: SHA1 of the requester's IP and a secret, so the token only
+    // proves the announcer recently got it at that address
+    SHA1 sha1;
+    sha1.update(peer.address.data(), peer.address.size());
+    sha1.update(secret.data(), secret.size());
+    uint8_t digest[SHA1::DIGEST_SIZE];
+    sha1.finalize(digest);
+    return std::string(reinterpret_cast<const char*>(digest), DHT_TOKEN_SIZE);
 }
 
-bool DhtClient::verify_token(const Peer& peer, const std::string& token) {
-    std::lock_guard<std::mutex> lock(peer_tokens_mutex_);
-    auto it = peer_tokens_.find(peer);
-    if (it != peer_tokens_.end()) {
-        return it->second == token;
+void DhtClient::rotate_token_secret() {
+    std::random_device rd;
+    TokenSecret secret;
+    for (auto& byte : secret) {
+        byte = static_cast<uint8_t>(rd());
     }
-    return false;
+    
+    std::unique_lock<std::shared_mutex> lock(token_secret_mutex_);
+    previous_token_secret_ = token_secret_;
+    token_secret_ = secret;
+    token_secret_created_at_ = current_time();
+}
+
+DhtClient::AnnouncedPeerShard& DhtClient::announced_peer_shard(const InfoHash& info_hash) {
+    // Info hashes are uniformly distributed already
+    return announced_peer_shards_[info_hash[0] % DHT_STATE_SHARDS];
 }
 
 void DhtClient::cleanup_stale_nodes() {
-    std::lock_guard<std::mutex> routing_lock(routing_table_mutex_);
+    std::unique_lock<std::shared_mutex> routing_lock(routing_table_mutex_);
     
-    auto now = std::chrono::steady_clock::now();
+    auto now = current_time();
     auto stale_threshold = std::chrono::minutes(15);
     
-    size_t total_removed = 0;
-    
-    for (auto& bucket : routing_table_) {
-        auto old_size = bucket.size();
+    size_t total_removed = routing_table_.remove_if([now, stale_threshold](const DhtNode& node) {
+        bool should_remove = (now - node.last_seen > stale_threshold);
         
-        bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
-                                   [now, stale_threshold](const DhtNode& node) {
-                                       bool should_remove = (now - node.last_seen > stale_threshold);
-                                       
-                                       if (should_remove) {
-                                           LOG_DHT_DEBUG("Removing stale node " << node_id_to_hex(node.id) 
-                                                       << " at " << node.peer.ip << ":" << node.peer.port);
-                                       }
-                                       
-                                       return should_remove;
-                                   }), bucket.end());
+        if (should_remove) {
+            LOG_DHT_DEBUG("Removing stale node " << node_id_to_hex(node.id) 
+                        << " at " << node.peer);
+        }
         
-        total_removed += (old_size - bucket.size());
-    }
+        return should_remove;
+    });
     
     if (total_removed > 0) {
         LOG_DHT_DEBUG("Cleaned up " << total_removed << " stale/failed nodes from routing table");
@@ -792,10 +1512,10 @@ void DhtClient::cleanup_stale_nodes() {
 
 void DhtClient::refresh_buckets() {
     // Find random nodes in each bucket to refresh
-    std::lock_guard<std::mutex> lock(routing_table_mutex_);
+    std::shared_lock<std::shared_mutex> lock(routing_table_mutex_);
     
-    for (size_t i = 0; i < routing_table_.size(); ++i) {
-        if (routing_table_[i].empty()) {
+    for (size_t i = 0; i < DhtRoutingTable::BUCKET_COUNT; ++i) {
+        if (routing_table_.bucket(static_cast<int>(i)).empty()) {
             // Generate a random node ID in this bucket's range
             NodeId random_id = generate_node_id();
             
@@ -825,7 +1545,7 @@ void DhtClient::refresh_buckets() {
 void DhtClient::cleanup_stale_announces() {
     std::lock_guard<std::mutex> lock(pending_announces_mutex_);
     
-    auto now = std::chrono::steady_clock::now();
+    auto now = current_time();
     auto stale_threshold = std::chrono::minutes(5);  // Remove announces older than 5 minutes
     
     auto it = pending_announces_.begin();
@@ -839,36 +1559,7 @@ void DhtClient::cleanup_stale_announces() {
     }
 }
 
-void DhtClient::cleanup_stale_searches() {
-    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
-    
-    auto now = std::chrono::steady_clock::now();
-    auto stale_threshold = std::chrono::minutes(5);  // Remove searches older than 5 minutes
-    
-    // Clean up stale searches (by info_hash)
-    auto search_it = pending_searches_.begin();
-    while (search_it != pending_searches_.end()) {
-        if (now - search_it->second.created_at > stale_threshold) {
-            LOG_DHT_DEBUG("Removing stale pending search for info_hash " << search_it->first);
-            search_it = pending_searches_.erase(search_it);
-        } else {
-            ++search_it;
-        }
-    }
-    
-    // Clean up stale transaction mappings (remove ones that point to non-existent searches)
-    auto trans_it = transaction_to_search_.begin();
-    while (trans_it != transaction_to_search_.end()) {
-        if (pending_searches_.find(trans_it->second) == pending_searches_.end()) {
-            LOG_DHT_DEBUG("Removing stale transaction mapping " << trans_it->first << " -> " << trans_it->second);
-            trans_it = transaction_to_search_.erase(trans_it);
-        } else {
-            ++trans_it;
-        }
-    }
-}
-
-void DhtClient::handle_get_peers_response_for_announce(const std::string& transaction_id, const Peer& responder, const std::string& token) {
+void DhtClient::handle_get_peers_response_for_announce(const std::string& transaction_id, const NetEndpoint& responder, const std::string& token) {
     std::lock_guard<std::mutex> lock(pending_announces_mutex_);
     
     auto it = pending_announces_.find(transaction_id);
@@ -876,7 +1567,7 @@ void DhtClient::handle_get_peers_response_for_announce(const std::string& transa
         const auto& pending_announce = it->second;
         LOG_DHT_DEBUG("Found pending announce for transaction " << transaction_id 
                       << " - sending announce_peer for info_hash " << node_id_to_hex(pending_announce.info_hash) 
-                      << " to " << responder.ip << ":" << responder.port);
+                      << " to " << responder);
         
         // Send announce_peer with the received token using unified function
         send_announce_peer(responder, pending_announce.info_hash, pending_announce.port, token);
@@ -887,220 +1578,267 @@ void DhtClient::handle_get_peers_response_for_announce(const std::string& transa
 }
 
 
-void DhtClient::handle_get_peers_response_for_search(const std::string& transaction_id, const Peer& responder, const std::vector<Peer>& peers) {
-    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
+void DhtClient::handle_get_peers_response_for_search(const KrpcMessage& message, const NetEndpoint& responder) {
+    auto now = current_time();
     
-    auto trans_it = transaction_to_search_.find(transaction_id);
-    if (trans_it != transaction_to_search_.end()) {
-        std::string hash_key = trans_it->second;
-        auto search_it = pending_searches_.find(hash_key);
-        if (search_it != pending_searches_.end()) {
-            auto& pending_search = search_it->second;
-            LOG_DHT_DEBUG("Found pending search for KRPC transaction " << transaction_id 
-                          << " - received " << peers.size() << " peers for info_hash " << hash_key 
-                          << " from " << responder.ip << ":" << responder.port);
-            
-            if (!peers.empty()) {
-                // We found actual peers - call callback and clean up search
-                {
-                    std::lock_guard<std::mutex> search_lock(active_searches_mutex_);
-                    auto active_it = active_searches_.find(hash_key);
-                    if (active_it != active_searches_.end() && active_it->second) {
-                        active_it->second(peers, pending_search.info_hash);
-                    }
-                    // Remove from active searches since we found peers
-                    active_searches_.erase(hash_key);
-                }
-                // Remove the completed search
-                pending_searches_.erase(search_it);
+    // Nodes we already measured rank by their round trip once they become candidates
+    std::vector<DhtNode> new_nodes;
+    new_nodes.reserve(message.nodes.size());
+    {
+        std::shared_lock<std::shared_mutex> lock(routing_table_mutex_);
+        for (const auto& krpc_node : message.nodes) {
+            DhtNode node = krpc_node_to_dht_node(krpc_node);
+            if (node.id == node_id_) {
+                continue;
             }
+            if (const DhtNode* known = routing_table_.find(node.id)) {
+                node.rtt_ms = known->rtt_ms;
+            }
+            new_nodes.push_back(node);
         }
-        
-        // Remove the transaction mapping since we've handled it
-        transaction_to_search_.erase(trans_it);
     }
-}
-
-
-void DhtClient::handle_get_peers_response_with_nodes(const std::string& transaction_id, const Peer& responder, const std::vector<KrpcNode>& nodes) {
-    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
     
-    auto trans_it = transaction_to_search_.find(transaction_id);
-    if (trans_it != transaction_to_search_.end()) {
-        std::string hash_key = trans_it->second;
-        auto search_it = pending_searches_.find(hash_key);
-        if (search_it != pending_searches_.end()) {
-            auto& pending_search = search_it->second;
-            LOG_DHT_DEBUG("Found pending search for KRPC transaction " << transaction_id 
-                          << " - received " << nodes.size() << " nodes for info_hash " << hash_key 
-                          << " from " << responder.ip << ":" << responder.port);
-
-            // Continue search iteration
-            bool should_remove_search = continue_search_iteration(pending_search);
-            if (should_remove_search) {
-                LOG_DHT_DEBUG("Removing completed search for info_hash " << hash_key);
-                pending_searches_.erase(search_it);
-                
-                // Also clean up the active search callback
-                {
-                    std::lock_guard<std::mutex> search_lock(active_searches_mutex_);
-                    active_searches_.erase(hash_key);
-                }
+    PeerDiscoveryCallback callback;
+    std::vector<NetEndpoint> new_peers;
+    InfoHash info_hash;
+    NodeId responder_id{};
+    uint32_t rtt_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(pending_searches_mutex_);
+        
+        auto trans_it = transaction_to_search_.find(message.transaction_id);
+        if (trans_it == transaction_to_search_.end()) {
+            return;
+        }
+        info_hash = trans_it->second;
+        transaction_to_search_.erase(trans_it);
+        
+        auto search_it = pending_searches_.find(info_hash);
+        if (search_it == pending_searches_.end()) {
+            return;
+        }
+        auto& search = search_it->second;
+        
+        auto candidate = std::find_if(search.candidates.begin(), search.candidates.end(),
+                                      [&message](const SearchCandidate& c) {
+                                          return c.transaction_id == message.transaction_id;
+                                      });
+        if (candidate == search.candidates.end() || candidate->state != SearchCandidate::State::Querying) {
+            return;
+        }
+        candidate->state = SearchCandidate::State::Responded;
+        --search.in_flight;
+        rtt_ms = static_cast<uint32_t>((std::max)(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                      now - candidate->sent_at).count(), std::chrono::milliseconds::rep(1)));
+        responder_id = candidate->node.id;
+        int depth = candidate->depth + 1;
+        
+        LOG_DHT_DEBUG("Search for " << node_id_to_hex(info_hash) << ": " << message.peers.size() << " peers and "
+                      << message.nodes.size() << " nodes from " << responder
+                      << " (" << rtt_ms << " ms)");
+        
+        for (const auto& peer : message.peers) {
+            if (search.found_peers.insert(peer).second) {
+                new_peers.push_back(peer);
             }
         }
         
-        // Remove the transaction mapping since we've handled it
-        transaction_to_search_.erase(trans_it);
+        // Merge the returned nodes, keeping the nearest DHT_SEARCH_CANDIDATES (and any still being queried)
+        bool added = false;
+        for (const auto& node : new_nodes) {
+            if (search.seen_nodes.insert(node.id).second) {
+                search.candidates.emplace_back(node, depth);
+                added = true;
+            }
+        }
+        if (added) {
+            std::stable_sort(search.candidates.begin(), search.candidates.end(),
+                             [this, &info_hash](const SearchCandidate& a, const SearchCandidate& b) {
+                                 return is_closer(a.node.id, b.node.id, info_hash);
+                             });
+            if (search.candidates.size() > DHT_SEARCH_CANDIDATES) {
+                auto keep_end = std::remove_if(search.candidates.begin() + DHT_SEARCH_CANDIDATES, search.candidates.end(),
+                                               [](const SearchCandidate& c) {
+                                                   return c.state != SearchCandidate::State::Querying;
+                                               });
+                search.candidates.erase(keep_end, search.candidates.end());
+            }
+        }
+        
+        if (!new_peers.empty()) {
+            callback = search.callback;
+        }
+        
+        if (advance_search(search, now)) {
+            LOG_DHT_DEBUG("Search for " << node_id_to_hex(info_hash) << " finished with "
+                          << search.found_peers.size() << " peers");
+            erase_search(search_it);
+        }
     }
-}
-
-
-
-bool DhtClient::continue_search_iteration(PendingSearch& search) {
-    std::string hash_key = node_id_to_hex(search.info_hash);
     
-    LOG_DHT_DEBUG("Continuing search iteration for info_hash " << hash_key 
-                  << " with " << search.queried_nodes.size() << " queried nodes, iteration " 
-                  << search.iteration_count << "/" << search.iteration_max);
+    record_rtt(responder_id, rtt_ms);
     
-    // Stop if we've reached max iterations (simple limit)
-    if (search.iteration_count >= search.iteration_max) {
-        LOG_DHT_DEBUG("Stopping search for " << hash_key << " - reached max iterations (" << search.iteration_count << "/" << search.iteration_max << ")");
-        return true;  // Return true to indicate the search should be removed
+    if (callback) {
+        std::vector<Peer> peers;
+        peers.reserve(new_peers.size());
+        for (const auto& peer : new_peers) {
+            peers.push_back(peer.to_peer());
+        }
+        callback(peers, info_hash);
     }
+}
+
+bool DhtClient::advance_search(PendingSearch& search, std::chrono::steady_clock::time_point now) {
+    using State = SearchCandidate::State;
     
-    // Get closest nodes from routing table (already sorted by distance to target)
-    std::vector<DhtNode> closest_nodes = find_closest_nodes(search.info_hash, ALPHA);
+    if (now >= search.deadline) {
+        LOG_DHT_DEBUG("Search for " << node_id_to_hex(search.info_hash) << " reached its deadline");
+        return true;
+    }
     
-    // Query up to ALPHA closest unqueried nodes
-    int nodes_queried = 0;
-    int candidates_found = 0;
-    for (const auto& node : closest_nodes) {
-        if (nodes_queried >= ALPHA) {
-            LOG_DHT_DEBUG("Reached ALPHA limit (" << ALPHA << ") for querying nodes in iteration " << (search.iteration_count + 1) << "/" << search.iteration_max);
+    // Every one of the K nearest nodes that has not failed must answer before the
+    // lookup converges. Which of them goes first only changes how fast it does,
+    // so the free query slots go to the ones with the lowest measured round trip
+    // (unmeasured nodes last); their answers bring in the next closer nodes sooner.
+    while (search.in_flight < ALPHA) {
+        SearchCandidate* next = nullptr;
+        size_t considered = 0;
+        for (auto& candidate : search.candidates) {
+            if (candidate.state == State::Failed) {
+                continue;
+            }
+            if (++considered > K_BUCKET_SIZE) {
+                break;
+            }
+            if (candidate.state != State::Fresh || candidate.depth >= search.max_depth) {
+                continue;
+            }
+            auto rank = [](const SearchCandidate& c) { return c.node.rtt_ms ? c.node.rtt_ms : UINT32_MAX; };
+            if (!next || rank(candidate) < rank(*next)) {
+                next = &candidate;
+            }
+        }
+        if (!next) {
             break;
         }
         
-        std::string node_hex = node_id_to_hex(node.id);
-        candidates_found++;
+        next->state = State::Querying;
+        next->transaction_id = KrpcProtocol::generate_transaction_id();
+        next->sent_at = now;
+        ++search.in_flight;
+        transaction_to_search_[next->transaction_id] = search.info_hash;
         
-        if (search.queried_nodes.find(node_hex) == search.queried_nodes.end()) {
-            LOG_DHT_DEBUG("Querying node " << node_hex << " at " << node.peer.ip << ":" << node.peer.port 
-                          << " (protocol: BitTorrent" 
-                          << ", iteration: " << (search.iteration_count + 1) << ")");
-            
-            // Mark node as queried in the shared search object
-            search.queried_nodes.insert(node_hex);
-            
-            std::string transaction_id = KrpcProtocol::generate_transaction_id();
-            transaction_to_search_[transaction_id] = hash_key;
-            
-            auto message = KrpcProtocol::create_get_peers_query(transaction_id, node_id_, search.info_hash);
-            send_krpc_message(message, node.peer);
-            
-            nodes_queried++;
-        } else {
-            LOG_DHT_DEBUG("Skipping already queried node " << node_hex << " at " << node.peer.ip << ":" << node.peer.port);
-        }
+        LOG_DHT_DEBUG("Querying node " << node_id_to_hex(next->node.id) << " at " << next->node.peer
+                      << " for " << node_id_to_hex(search.info_hash)
+                      << " (hop " << next->depth << ")");
+        auto message = KrpcProtocol::create_get_peers_query(next->transaction_id, node_id_, search.info_hash);
+        send_krpc_message(message, next->node.peer);
     }
     
-    // Update iteration count
-    search.iteration_count++;
-    
-    LOG_DHT_DEBUG("Search iteration summary for " << hash_key << ":");
-    LOG_DHT_DEBUG("  - Candidates evaluated: " << candidates_found);
-    LOG_DHT_DEBUG("  - Nodes queried: " << nodes_queried);
-    LOG_DHT_DEBUG("  - Already queried nodes skipped: " << (candidates_found - nodes_queried));
-    LOG_DHT_DEBUG("  - Current iteration: " << search.iteration_count << "/" << search.iteration_max);
+    // Nothing left to wait for: converged, or out of queryable nodes
+    return search.in_flight == 0;
+}
+
+void DhtClient::expire_search_queries(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(pending_searches_mutex_);
     
-    // If we are not making progress, or if we've hit the limit, stop the search.
-    if (nodes_queried == 0) {
-        LOG_DHT_DEBUG("Stopping search for " << hash_key << " - no new nodes to query");
-        return true; // Signal to remove the search
+    for (auto it = pending_searches_.begin(); it != pending_searches_.end(); ) {
+        auto& search = it->second;
+        for (auto& candidate : search.candidates) {
+            if (candidate.state != SearchCandidate::State::Querying) {
+                continue;
+            }
+            // Nodes we have measured get a few round trips before we move on
+            std::chrono::milliseconds timeout = DHT_SEARCH_QUERY_TIMEOUT;
+            if (candidate.node.rtt_ms) {
+                timeout = (std::min)(timeout, (std::max)(std::chrono::milliseconds(4 * candidate.node.rtt_ms),
+                                                         std::chrono::milliseconds(DHT_SEARCH_MIN_QUERY_TIMEOUT)));
+            }
+            if (now - candidate.sent_at >= timeout) {
+                LOG_DHT_DEBUG("Search query to " << candidate.node.peer
+                              << " for " << node_id_to_hex(search.info_hash) << " timed out");
+                candidate.state = SearchCandidate::State::Failed;
+                transaction_to_search_.erase(candidate.transaction_id);
+                --search.in_flight;
+            }
+        }
+        
+        if (advance_search(search, now)) {
+            LOG_DHT_DEBUG("Search for " << node_id_to_hex(search.info_hash) << " finished with "
+                          << search.found_peers.size() << " peers");
+            it = erase_search(it);
+        } else {
+            ++it;
+        }
     }
     
-    return false;
+    searches_active_ = !pending_searches_.empty();
 }
 
-// Peer announcement storage management
-void DhtClient::store_announced_peer(const InfoHash& info_hash, const Peer& peer) {
-    std::lock_guard<std::mutex> lock(announced_peers_mutex_);
-    
-    std::string hash_key = node_id_to_hex(info_hash);
-    auto& peers = announced_peers_[hash_key];
-    
-    // Check if peer already exists
-    auto it = std::find_if(peers.begin(), peers.end(),
-                          [&peer](const AnnouncedPeer& announced) {
-                              return announced.peer.ip == peer.ip && announced.peer.port == peer.port;
-                          });
-    
-    if (it != peers.end()) {
-        // Update existing peer's timestamp
-        it->announced_at = std::chrono::steady_clock::now();
-        LOG_DHT_DEBUG("Updated existing announced peer " << peer.ip << ":" << peer.port 
-                      << " for info_hash " << hash_key);
-    } else {
-        // Add new peer
-        peers.emplace_back(peer);
-        LOG_DHT_DEBUG("Stored new announced peer " << peer.ip << ":" << peer.port 
-                      << " for info_hash " << hash_key << " (total: " << peers.size() << ")");
+void DhtClient::erase_oldest_search() {
+    auto oldest = std::min_element(pending_searches_.begin(), pending_searches_.end(),
+                                   [](const PendingSearchMap::value_type& a, const PendingSearchMap::value_type& b) {
+                                       return a.second.started_at < b.second.started_at;
+                                   });
+    LOG_DHT_DEBUG("Too many lookups running, ending the one for " << node_id_to_hex(oldest->second.info_hash));
+    erase_search(oldest);
+    ++search_evictions_;
+}
+
+DhtClient::PendingSearchMap::iterator DhtClient::erase_search(PendingSearchMap::iterator it) {
+    // The lookup is asynchronous, so its span is recorded when it ends
+    if (Tracer::getInstance().is_enabled()) {
+        Tracer::getInstance().record("dht", "find_peers", it->second.started_at, current_time());
     }
+    for (const auto& candidate : it->second.candidates) {
+        if (candidate.state == SearchCandidate::State::Querying) {
+            transaction_to_search_.erase(candidate.transaction_id);
+        }
+    }
+    return pending_searches_.erase(it);
 }
 
-std::vector<Peer> DhtClient::get_announced_peers(const InfoHash& info_hash) {
-    std::lock_guard<std::mutex> lock(announced_peers_mutex_);
-    
-    std::string hash_key = node_id_to_hex(info_hash);
-    auto it = announced_peers_.find(hash_key);
+void DhtClient::record_rtt(const NodeId& id, uint32_t rtt_ms) {
+    std::unique_lock<std::shared_mutex> lock(routing_table_mutex_);
+    if (DhtNode* node = routing_table_.find(id)) {
+        node->rtt_ms = node->rtt_ms ? (3 * node->rtt_ms + rtt_ms) / 4 : rtt_ms;
+    }
+}
+
+// Peer announcement storage management
+void DhtClient::store_announced_peer(const InfoHash& info_hash, const NetEndpoint& peer) {
+    auto& shard = announced_peer_shard(info_hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
     
-    std::vector<Peer> peers;
-    if (it != announced_peers_.end()) {
-        peers.reserve(it->second.size());
-        for (const auto& announced : it->second) {
-            peers.push_back(announced.peer);
-        }
-        LOG_DHT_DEBUG("Retrieved " << peers.size() << " announced peers for info_hash " << hash_key);
+    if (shard.store.announce(info_hash, peer, current_time())) {
+        LOG_DHT_DEBUG("Stored announced peer " << peer 
+                      << " for info_hash " << node_id_to_hex(info_hash));
     } else {
-        LOG_DHT_DEBUG("No announced peers found for info_hash " << hash_key);
+        LOG_DHT_DEBUG("Ignoring announced peer with unspecified address " << peer);
     }
+}
+
+std::vector<NetEndpoint> DhtClient::get_announced_peers(const InfoHash& info_hash) {
+    auto& shard = announced_peer_shard(info_hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
     
+    auto peers = shard.store.get_peers(info_hash, DHT_MAX_RETURNED_PEERS, current_time());
+    LOG_DHT_DEBUG("Retrieved " << peers.size() << " announced peers for info_hash " << node_id_to_hex(info_hash));
     return peers;
 }
 
 void DhtClient::cleanup_stale_announced_peers() {
-    std::lock_guard<std::mutex> lock(announced_peers_mutex_);
-    
-    auto now = std::chrono::steady_clock::now();
-    auto stale_threshold = std::chrono::minutes(30);  // BEP 5 standard: 30 minutes
-    
-    size_t total_before = 0;
-    size_t total_after = 0;
+    size_t removed = 0;
+    size_t remaining = 0;
     
-    for (auto it = announced_peers_.begin(); it != announced_peers_.end(); ) {
-        auto& peers = it->second;
-        total_before += peers.size();
-        
-        // Remove stale peers
-        peers.erase(std::remove_if(peers.begin(), peers.end(),
-                                   [now, stale_threshold](const AnnouncedPeer& announced) {
-                                       return now - announced.announced_at > stale_threshold;
-                                   }), peers.end());
-        
-        total_after += peers.size();
-        
-        // Remove empty info_hash entries
-        if (peers.empty()) {
-            LOG_DHT_DEBUG("Removing empty announced peers entry for info_hash " << it->first);
-            it = announced_peers_.erase(it);
-        } else {
-            ++it;
-        }
+    for (auto& shard : announced_peer_shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        removed += shard.store.expire(current_time());
+        remaining += shard.store.peer_count();
     }
     
-    if (total_before > total_after) {
-        LOG_DHT_DEBUG("Cleaned up " << (total_before - total_after) << " stale announced peers "
-                      << "(from " << total_before << " to " << total_after << ")");
+    if (removed > 0) {
+        LOG_DHT_DEBUG("Cleaned up " << removed << " stale announced peers (" << remaining << " remaining)");
     }
 }
 
@@ -1120,7 +1858,7 @@ void DhtClient::initiate_ping_verification(const DhtNode& candidate_node, const
     std::string transaction_id = KrpcProtocol::generate_transaction_id();
     
     LOG_DHT_DEBUG("Initiating ping verification for candidate node " << node_id_to_hex(candidate_node.id) 
-                  << " at " << candidate_node.peer.ip << ":" << candidate_node.peer.port 
+                  << " at " << candidate_node.peer 
                   << " to potentially replace old node " << node_id_to_hex(old_node.id) 
                   << " (transaction: " << transaction_id << ")");
     
@@ -1128,7 +1866,7 @@ void DhtClient::initiate_ping_verification(const DhtNode& candidate_node, const
     {
         std::lock_guard<std::mutex> ping_lock(pending_pings_mutex_);
         std::lock_guard<std::mutex> nodes_lock(nodes_being_replaced_mutex_);
-        pending_pings_.emplace(transaction_id, PingVerification(candidate_node, old_node, bucket_index, transaction_id));
+        pending_pings_.emplace(transaction_id, PingVerification(candidate_node, old_node, bucket_index, transaction_id, current_time()));
         nodes_being_replaced_.insert(old_node.id);
     }
     
@@ -1137,42 +1875,49 @@ void DhtClient::initiate_ping_verification(const DhtNode& candidate_node, const
     send_krpc_message(message, candidate_node.peer);
 }
 
-void DhtClient::handle_ping_verification_response(const std::string& transaction_id, const NodeId& responder_id, const Peer& responder) {
-    std::lock_guard<std::mutex> ping_lock(pending_pings_mutex_);
-    std::lock_guard<std::mutex> nodes_lock(nodes_being_replaced_mutex_);
-    
-    auto it = pending_pings_.find(transaction_id);
-    if (it != pending_pings_.end()) {
-        const auto& verification = it->second;
+void DhtClient::handle_ping_verification_response(const std::string& transaction_id, const NodeId& responder_id, const NetEndpoint& responder) {
+    std::unique_ptr<PingVerification> verification;
+    {
+        std::lock_guard<std::mutex> ping_lock(pending_pings_mutex_);
+        std::lock_guard<std::mutex> nodes_lock(nodes_being_replaced_mutex_);
         
-        // Check if the responder node ID matches the candidate node we pinged
-        if (responder_id == verification.candidate_node.id) {
-            LOG_DHT_DEBUG("Ping verification successful for candidate node " << node_id_to_hex(verification.candidate_node.id) 
-                          << " - proceeding with replacement of old node " << node_id_to_hex(verification.old_node.id));
-            
-            // The candidate node responded and is alive - perform the replacement
-            // Create a copy of the candidate node with updated timestamp
-            DhtNode updated_candidate = verification.candidate_node;
-            updated_candidate.last_seen = std::chrono::steady_clock::now();
-            perform_replacement(updated_candidate, verification.old_node, verification.bucket_index);
-        } else {
-            LOG_DHT_WARN("Ping verification response from unexpected node " << node_id_to_hex(responder_id) 
-                         << " at " << responder.ip << ":" << responder.port 
-                         << " (expected candidate node " << node_id_to_hex(verification.candidate_node.id) << ")");
+        auto it = pending_pings_.find(transaction_id);
+        if (it == pending_pings_.end()) {
+            return;
         }
+        verification.reset(new PingVerification(it->second));
         
         // Remove the old node from nodes_being_replaced set
-        nodes_being_replaced_.erase(verification.old_node.id);
+        nodes_being_replaced_.erase(verification->old_node.id);
         // Remove the pending ping verification
         pending_pings_.erase(it);
     }
+    
+    // The routing table is locked only after the ping state is released: add_node takes
+    // them in the opposite order, and may run on another KRPC worker
+    
+    // Check if the responder node ID matches the candidate node we pinged
+    if (responder_id == verification->candidate_node.id) {
+        LOG_DHT_DEBUG("Ping verification successful for candidate node " << node_id_to_hex(verification->candidate_node.id) 
+                      << " - proceeding with replacement of old node " << node_id_to_hex(verification->old_node.id));
+        
+        // The candidate node responded and is alive - perform the replacement
+        // Create a copy of the candidate node with updated timestamp
+        DhtNode updated_candidate = verification->candidate_node;
+        updated_candidate.last_seen = current_time();
+        perform_replacement(updated_candidate, verification->old_node, verification->bucket_index);
+    } else {
+        LOG_DHT_WARN("Ping verification response from unexpected node " << node_id_to_hex(responder_id) 
+                     << " at " << responder 
+                     << " (expected candidate node " << node_id_to_hex(verification->candidate_node.id) << ")");
+    }
 }
 
 void DhtClient::cleanup_stale_ping_verifications() {
     std::lock_guard<std::mutex> ping_lock(pending_pings_mutex_);
     std::lock_guard<std::mutex> nodes_lock(nodes_being_replaced_mutex_);
     
-    auto now = std::chrono::steady_clock::now();
+    auto now = current_time();
     auto timeout_threshold = std::chrono::seconds(30);  // 30 second timeout for ping responses
     
     auto it = pending_pings_.begin();
@@ -1191,24 +1936,217 @@ void DhtClient::cleanup_stale_ping_verifications() {
 }
 
 void DhtClient::perform_replacement(const DhtNode& candidate_node, const DhtNode& node_to_replace, int bucket_index) {
-    std::lock_guard<std::mutex> lock(routing_table_mutex_);
-    
-    auto& bucket = routing_table_[bucket_index];
-    auto it = std::find_if(bucket.begin(), bucket.end(),
-                          [&node_to_replace](const DhtNode& node) {
-                              return node.id == node_to_replace.id;
-                          });
+    std::unique_lock<std::shared_mutex> lock(routing_table_mutex_);
     
-    if (it != bucket.end()) {
+    if (routing_table_.replace(node_to_replace.id, candidate_node)) {
         LOG_DHT_DEBUG("Replacing old node " << node_id_to_hex(node_to_replace.id) 
                       << " with " << node_id_to_hex(candidate_node.id) << " in bucket " << bucket_index);
-        *it = candidate_node;
     } else {
         LOG_DHT_WARN("Could not find node " << node_id_to_hex(node_to_replace.id) 
                      << " to replace in bucket " << bucket_index);
     }
 }
 
+// Virtual nodes and info hash sampling (BEP 51)
+const NodeId& DhtClient::crawl_node_id(size_t node_index) const {
+    return node_index == PRIMARY_NODE ? node_id_ : virtual_nodes_[node_index]->id();
+}
+
+bool DhtClient::send_crawl_query(size_t node_index, KrpcQueryType query_type, const NetEndpoint& peer, const NodeId& target) {
+    std::string transaction_id = KrpcProtocol::generate_transaction_id();
+    KrpcMessage message = query_type == KrpcQueryType::SampleInfohashes
+        ? KrpcProtocol::create_sample_infohashes_query(transaction_id, crawl_node_id(node_index), target)
+        : KrpcProtocol::create_find_node_query(transaction_id, crawl_node_id(node_index), target);
+    
+    {
+        std::lock_guard<std::mutex> lock(crawl_queries_mutex_);
+        crawl_queries_[transaction_id] = CrawlQuery{node_index, query_type, current_time()};
+    }
+    
+    if (!send_krpc_message(message, peer)) {
+        std::lock_guard<std::mutex> lock(crawl_queries_mutex_);
+        crawl_queries_.erase(transaction_id);
+        return false;
+    }
+    return true;
+}
+
+void DhtClient::handle_crawl_response(const KrpcMessage& message, const NetEndpoint& sender) {
+    CrawlQuery query;
+    {
+        std::lock_guard<std::mutex> lock(crawl_queries_mutex_);
+        auto it = crawl_queries_.find(message.transaction_id);
+        if (it == crawl_queries_.end()) {
+            return;
+        }
+        query = it->second;
+        crawl_queries_.erase(it);
+    }
+    
+    if (query.node_index != PRIMARY_NODE) {
+        VirtualNode& virtual_node = *virtual_nodes_[query.node_index];
+        auto now = current_time();
+        
+        std::unique_lock<std::shared_mutex> lock(virtual_node.mutex);
+        auto learn = [&virtual_node, now](const NodeId& id, const NetEndpoint& peer) {
+            if (id == virtual_node.id()) {
+                return;
+            }
+            if (DhtNode* existing = virtual_node.routing_table.find(id)) {
+                existing->peer = peer;
+                existing->last_seen = now;
+            } else {
+                virtual_node.routing_table.insert(DhtNode(id, peer, now));
+            }
+        };
+        
+        learn(message.response_id, sender);
+        for (const auto& node : message.nodes) {
+            learn(node.id, node.peer);
+        }
+        
+        if (query.query_type == KrpcQueryType::SampleInfohashes) {
+            virtual_node.next_sample_at[message.response_id] = now + std::chrono::seconds(message.interval);
+        }
+    }
+    
+    if (query.query_type == KrpcQueryType::SampleInfohashes && !message.samples.empty()) {
+        InfoHashSampleCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(sample_callback_mutex_);
+            callback = sample_callback_;
+        }
+        
+        LOG_DHT_DEBUG("Received " << message.samples.size() << " of " << message.num << " info hash samples from "
+                      << sender);
+        if (callback) {
+            callback(message.samples, sender.to_peer());
+        }
+    }
+}
+
+std::vector<DhtNode> DhtClient::find_closest_nodes_as(const NodeId& target, size_t count, NodeId& responder_id) {
+    // Answer as whichever of our IDs is closest to the target, from that ID's routing table
+    size_t closest_index = PRIMARY_NODE;
+    for (size_t i = 0; i < virtual_nodes_.size(); ++i) {
+        if (is_closer(virtual_nodes_[i]->id(), crawl_node_id(closest_index), target)) {
+            closest_index = i;
+        }
+    }
+    
+    responder_id = crawl_node_id(closest_index);
+    if (closest_index != PRIMARY_NODE) {
+        VirtualNode& virtual_node = *virtual_nodes_[closest_index];
+        std::shared_lock<std::shared_mutex> lock(virtual_node.mutex);
+        if (!virtual_node.routing_table.empty()) {
+            return virtual_node.routing_table.find_closest(target, count);
+        }
+    }
+    
+    return find_closest_nodes(target, count);
+}
+
+std::vector<InfoHash> DhtClient::sample_announced_info_hashes(size_t max_samples, uint32_t& total) {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    
+    // Reservoir sampling over every shard
+    std::vector<InfoHash> samples;
+    size_t seen = 0;
+    for (auto& shard : announced_peer_shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.store.for_each_info_hash([&](const InfoHash& info_hash) {
+            ++seen;
+            if (samples.size() < max_samples) {
+                samples.push_back(info_hash);
+            } else {
+                size_t slot = std::uniform_int_distribution<size_t>(0, seen - 1)(rng);
+                if (slot < max_samples) {
+                    samples[slot] = info_hash;
+                }
+            }
+        });
+    }
+    
+    total = static_cast<uint32_t>(seen);
+    return samples;
+}
+
+void DhtClient::crawl_virtual_nodes() {
+    bool sampling;
+    {
+        std::lock_guard<std::mutex> lock(sample_callback_mutex_);
+        sampling = static_cast<bool>(sample_callback_);
+    }
+    
+    auto now = current_time();
+    for (size_t i = 0; i < virtual_nodes_.size(); ++i) {
+        VirtualNode& virtual_node = *virtual_nodes_[i];
+        std::vector<DhtNode> neighbours;
+        std::vector<NetEndpoint> sample_targets;
+        {
+            std::unique_lock<std::shared_mutex> lock(virtual_node.mutex);
+            neighbours = virtual_node.routing_table.find_closest(virtual_node.id(), ALPHA);
+            
+            // Nodes that have not asked us to wait, until a reply brings their interval
+            for (size_t b = 0; sampling && b < DhtRoutingTable::BUCKET_COUNT && sample_targets.size() < DHT_SAMPLES_PER_TICK; ++b) {
+                for (const auto& node : virtual_node.routing_table.bucket(static_cast<int>(b))) {
+                    auto& next_sample_at = virtual_node.next_sample_at[node.id];
+                    if (next_sample_at > now) {
+                        continue;
+                    }
+                    next_sample_at = now + std::chrono::minutes(1);
+                    sample_targets.push_back(node.peer);
+                    if (sample_targets.size() >= DHT_SAMPLES_PER_TICK) {
+                        break;
+                    }
+                }
+            }
+        }
+        
+        // Keep looking around our ID, starting from the main table until we know neighbours
+        if (neighbours.empty()) {
+            neighbours = find_closest_nodes(virtual_node.id(), ALPHA);
+        }
+        for (const auto& node : neighbours) {
+            send_crawl_query(i, KrpcQueryType::FindNode, node.peer, virtual_node.id());
+        }
+        
+        for (const auto& peer : sample_targets) {
+            send_crawl_query(i, KrpcQueryType::SampleInfohashes, peer, generate_node_id());
+        }
+    }
+}
+
+void DhtClient::cleanup_stale_crawl_state() {
+    auto now = current_time();
+    
+    {
+        std::lock_guard<std::mutex> lock(crawl_queries_mutex_);
+        for (auto it = crawl_queries_.begin(); it != crawl_queries_.end(); ) {
+            if (now - it->second.sent_at > std::chrono::seconds(30)) {
+                it = crawl_queries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    auto stale_threshold = std::chrono::minutes(15);
+    for (auto& virtual_node : virtual_nodes_) {
+        std::unique_lock<std::shared_mutex> lock(virtual_node->mutex);
+        virtual_node->routing_table.remove_if([now, stale_threshold](const DhtNode& node) {
+            return now - node.last_seen > stale_threshold;
+        });
+        for (auto it = virtual_node->next_sample_at.begin(); it != virtual_node->next_sample_at.end(); ) {
+            if (it->second <= now && !virtual_node->routing_table.find(it->first)) {
+                it = virtual_node->next_sample_at.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
 // Utility functions implementation
 NodeId string_to_node_id(const std::string& str) {
     NodeId id;
@@ -1244,4 +2182,4 @@ std::string node_id_to_hex(const NodeId& id) {
     return oss.str();
 }
 
-} // namespace librats 
\ No newline at end of file
+} // namespace librats 
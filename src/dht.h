@@ -1,30 +1,31 @@
 #pragma once
 
 #include "socket.h"
+#include "datagram_transport.h"
 #include "krpc.h"
+#include "reactor.h"
+#include "threadmanager.h"
+#include "resource_usage.h"
 #include <string>
 #include <vector>
 #include <array>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
 #include <atomic>
 #include <chrono>
 #include <memory>
 #include <condition_variable>
+#include <deque>
+#include <list>
+#include <cstdint>
 
-// Hash specialization for Peer and NodeId (must be defined before use in unordered_map/set)
+// Hash specialization for NodeId (must be defined before use in unordered_map/set)
 namespace std {
-    template<>
-    struct hash<librats::Peer> {
-        std::size_t operator()(const librats::Peer& peer) const noexcept {
-            std::hash<std::string> hasher;
-            return hasher(peer.ip + ":" + std::to_string(peer.port));
-        }
-    };
-    
     template<>
     struct hash<array<uint8_t, 20>> {
         std::size_t operator()(const array<uint8_t, 20>& id) const noexcept {
@@ -45,6 +46,26 @@ constexpr size_t NODE_ID_SIZE = 20;  // 160 bits = 20 bytes
 constexpr size_t K_BUCKET_SIZE = 8;  // Maximum nodes per k-bucket
 constexpr size_t ALPHA = 3;          // Concurrency parameter
 constexpr int DHT_PORT = 6881;       // Standard BitTorrent DHT port
+constexpr size_t DHT_RECEIVE_BATCH_SIZE = 32;    // Datagrams per receive call
+constexpr size_t DHT_MAX_DATAGRAM_SIZE = 1500;   // MTU size
+constexpr size_t DHT_STATE_SHARDS = 16;          // Independently locked slices of per-peer / per-hash state
+constexpr size_t DHT_WORKER_QUEUE_LIMIT = 4096;  // Datagrams waiting per worker before new ones are dropped
+constexpr size_t DHT_MAX_SAMPLES = 20;           // Info hashes per sample_infohashes response (BEP 51), fits one datagram
+constexpr uint32_t DHT_SAMPLE_INTERVAL = 21600;  // Seconds we ask samplers to wait between queries (BEP 51 maximum)
+constexpr size_t DHT_SAMPLES_PER_TICK = 8;       // sample_infohashes queries each virtual node sends per maintenance tick
+constexpr size_t DHT_MAX_STORED_INFO_HASHES = 16384;  // Info hashes we keep announced peers for, across all shards
+constexpr size_t DHT_MAX_PEERS_PER_INFO_HASH = 100;   // Announced peers kept per info hash, oldest dropped first
+constexpr size_t DHT_MAX_RETURNED_PEERS = 50;         // Peers per get_peers response, fits one datagram
+constexpr auto DHT_ANNOUNCED_PEER_LIFETIME = std::chrono::minutes(30);  // BEP 5 standard
+constexpr auto DHT_TOKEN_SECRET_LIFETIME = std::chrono::minutes(5);     // Tokens stay valid for two secrets (BEP 5)
+constexpr size_t DHT_TOKEN_SECRET_SIZE = 16;
+constexpr size_t DHT_TOKEN_SIZE = 8;             // Truncated SHA1(ip + secret)
+constexpr size_t DHT_SEARCH_CANDIDATES = 4 * K_BUCKET_SIZE;  // Nearest nodes a lookup keeps track of
+constexpr auto DHT_SEARCH_QUERY_TIMEOUT = std::chrono::seconds(2);     // Lookup query without an answer is given up
+constexpr auto DHT_SEARCH_MIN_QUERY_TIMEOUT = std::chrono::milliseconds(300);
+constexpr auto DHT_SEARCH_TIMEOUT = std::chrono::seconds(30);          // Whole lookup deadline
+constexpr size_t DHT_MAX_PENDING_SEARCHES = 64;  // Lookups running at once, the oldest is ended to make room
+constexpr int DHT_SEARCH_TICK_MS = 100;          // How often the network thread checks lookup timeouts
 
 using NodeId = std::array<uint8_t, NODE_ID_SIZE>;
 using InfoHash = std::array<uint8_t, NODE_ID_SIZE>;
@@ -54,12 +75,134 @@ using InfoHash = std::array<uint8_t, NODE_ID_SIZE>;
  */
 struct DhtNode {
     NodeId id;
-    Peer peer;
+    NetEndpoint peer;
     std::chrono::steady_clock::time_point last_seen;
+    uint32_t rtt_ms = 0;  // Smoothed query round trip, 0 until measured
     
     DhtNode() : last_seen(std::chrono::steady_clock::now()) {}
-    DhtNode(const NodeId& id, const Peer& peer)
-        : id(id), peer(peer), last_seen(std::chrono::steady_clock::now()) {}
+    DhtNode(const NodeId& id, const NetEndpoint& peer,
+            std::chrono::steady_clock::time_point seen = std::chrono::steady_clock::now())
+        : id(id), peer(peer), last_seen(seen) {}
+};
+
+/**
+ * Kademlia routing table: one k-bucket per shared-prefix length with our own
+ * node id. This is the binary trie split all the way down along our id's
+ * path, so every bucket covers one subtree hanging off that path and the
+ * XOR distance to any target ranks whole buckets against each other.
+ *
+ * Closest-node lookups visit buckets in that order and only partially sort
+ * the few candidates they gather, instead of copying and sorting the table.
+ *
+ * Not thread safe; DhtClient guards it with a shared mutex so lookups run
+ * concurrently.
+ */
+class DhtRoutingTable {
+public:
+    static constexpr size_t BUCKET_COUNT = NODE_ID_SIZE * 8;
+
+    explicit DhtRoutingTable(const NodeId& own_id);
+
+    const NodeId& get_own_id() const { return own_id_; }
+
+    // Bucket for an id: the length of the prefix it shares with our id
+    int bucket_index(const NodeId& id) const;
+    const std::vector<DhtNode>& bucket(int index) const { return buckets_[index]; }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    DhtNode* find(const NodeId& id);
+    const DhtNode* find(const NodeId& id) const;
+
+    // Adds the node if its bucket has room; false when the bucket is full
+    bool insert(const DhtNode& node);
+    // Swaps old_id for node in the bucket old_id lives in; false if old_id is gone
+    bool replace(const NodeId& old_id, const DhtNode& node);
+
+    // Removes every node the predicate matches, returns how many were removed
+    template<typename Predicate>
+    size_t remove_if(Predicate pred) {
+        size_t removed = 0;
+        for (auto& bucket : buckets_) {
+            auto old_size = bucket.size();
+            bucket.erase(std::remove_if(bucket.begin(), bucket.end(), pred), bucket.end());
+            removed += old_size - bucket.size();
+        }
+        size_ -= removed;
+        return removed;
+    }
+
+    // Up to count nodes ordered by XOR distance to target, nearest first
+    std::vector<DhtNode> find_closest(const NodeId& target, size_t count) const;
+
+private:
+    NodeId own_id_;
+    std::vector<std::vector<DhtNode>> buckets_;
+    size_t size_;
+};
+
+/**
+ * Announced peers (BEP 5 announce_peer) with a fixed capacity. Info hashes
+ * sit in a list ordered by their latest announce, so when the store is full
+ * the one announced least recently is evicted, and each info hash keeps at
+ * most max_peers_per_info_hash peers ordered by announce time, oldest
+ * replaced first.
+ *
+ * Not thread safe; DhtClient keeps one per shard under the shard's mutex.
+ */
+class DhtPeerStore {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    DhtPeerStore(size_t max_info_hashes, size_t max_peers_per_info_hash, Clock::duration peer_lifetime);
+
+    // Adds the peer or refreshes its announce time; false if its address is unspecified
+    bool announce(const InfoHash& info_hash, const NetEndpoint& peer, Clock::time_point now = Clock::now());
+
+    // Up to max_peers unexpired peers for the info hash, most recently announced first
+    std::vector<NetEndpoint> get_peers(const InfoHash& info_hash, size_t max_peers, Clock::time_point now = Clock::now()) const;
+
+    // Drops expired peers and info hashes left without any, returns how many peers were dropped
+    size_t expire(Clock::time_point now = Clock::now());
+
+    // Changes the budget, dropping least recently announced info hashes and oldest peers that no longer fit
+    void set_limits(size_t max_info_hashes, size_t max_peers_per_info_hash);
+
+    size_t info_hash_count() const { return entries_.size(); }
+    size_t peer_count() const { return peer_count_; }
+    size_t max_info_hashes() const { return max_info_hashes_; }
+    size_t max_peers_per_info_hash() const { return max_peers_per_info_hash_; }
+    uint64_t evictions() const { return evictions_; }  // Peers dropped by the budget or their lifetime
+    size_t memory_usage() const;                      // Approximate bytes held by the entries
+    bool contains(const InfoHash& info_hash) const { return entries_.count(info_hash) != 0; }
+
+    template<typename Function>
+    void for_each_info_hash(Function fn) const {
+        for (const auto& info_hash : lru_) {
+            fn(info_hash);
+        }
+    }
+
+private:
+    struct StoredPeer {
+        NetEndpoint peer;
+        Clock::time_point announced_at;
+    };
+    struct Entry {
+        std::vector<StoredPeer> peers;  // Oldest announce first
+        std::list<InfoHash>::iterator lru_position;
+    };
+
+    size_t max_info_hashes_;
+    size_t max_peers_per_info_hash_;
+    Clock::duration peer_lifetime_;
+    std::list<InfoHash> lru_;  // Most recently announced first
+    std::unordered_map<InfoHash, Entry> entries_;
+    size_t peer_count_;
+    uint64_t evictions_;
+
+    void erase(std::unordered_map<InfoHash, Entry>::iterator it);
 };
 
 
@@ -69,6 +212,11 @@ struct DhtNode {
  */
 using PeerDiscoveryCallback = std::function<void(const std::vector<Peer>& peers, const InfoHash& info_hash)>;
 
+/**
+ * Info hash sample callback (BEP 51), called with the samples each node returns
+ */
+using InfoHashSampleCallback = std::function<void(const std::vector<InfoHash>& samples, const Peer& source)>;
+
 /**
  * DHT Kademlia implementation
  */
@@ -77,8 +225,10 @@ public:
     /**
      * Constructor
      * @param port The UDP port to bind to (default: 6881)
+     * @param worker_threads Threads decoding and handling KRPC messages in parallel
+     *                       (0: handle them on the network thread)
      */
-    DhtClient(int port = DHT_PORT);
+    DhtClient(int port = DHT_PORT, size_t worker_threads = 0);
     
     /**
      * Destructor
@@ -109,10 +259,13 @@ public:
     bool bootstrap(const std::vector<Peer>& bootstrap_nodes);
     
     /**
-     * Find peers for a specific info hash
+     * Find peers for a specific info hash. The lookup keeps ALPHA get_peers
+     * queries in flight, moving on from a node as soon as its query times out,
+     * and the callback runs for every batch of new peers while the lookup is
+     * still converging, so callers can connect to the first peers right away.
      * @param info_hash The info hash to search for
-     * @param callback Callback to receive discovered peers
-     * @param iteration_max Maximum number of search iterations (default: 1)
+     * @param callback Callback to receive discovered peers (may run several times)
+     * @param iteration_max Maximum number of hops away from our routing table to query (default: 1)
      * @return true if search started successfully, false otherwise
      */
     bool find_peers(const InfoHash& info_hash, PeerDiscoveryCallback callback, int iteration_max = 1);
@@ -125,6 +278,50 @@ public:
      */
     bool announce_peer(const InfoHash& info_hash, uint16_t port = 0);
     
+    /**
+     * Host an additional node ID on this client's socket. Each virtual node keeps its own
+     * routing table around its ID, joins the DHT on bootstrap and, while an info hash sample
+     * callback is set, samples the nodes it knows every maintenance tick. Incoming queries are
+     * answered as whichever of our IDs is closest to the target.
+     * Virtual nodes can only be added before start().
+     * @param id The node ID to host
+     * @return true if added, false if running or the ID is already hosted
+     */
+    bool add_virtual_node(const NodeId& id);
+    
+    /**
+     * Host an additional node ID with a random ID
+     * @return The new node ID, or an all-zero ID if the client is running
+     */
+    NodeId add_virtual_node();
+    
+    /**
+     * Get the IDs of the virtual nodes
+     * @return Virtual node IDs, in the order they were added
+     */
+    std::vector<NodeId> get_virtual_node_ids() const;
+    
+    /**
+     * Get number of nodes in a virtual node's routing table
+     * @param index Position of the virtual node in get_virtual_node_ids()
+     * @return Number of nodes (0 for an unknown index)
+     */
+    size_t get_virtual_routing_table_size(size_t index) const;
+    
+    /**
+     * Set the callback receiving info hash samples (BEP 51); also starts virtual node crawling
+     * @param callback Callback to receive samples (empty to stop crawling)
+     */
+    void set_info_hash_sample_callback(InfoHashSampleCallback callback);
+    
+    /**
+     * Ask one node for a sample of the info hashes it stores (BEP 51)
+     * @param peer The node to query
+     * @param target Target ID for the nodes returned alongside the samples
+     * @return true if the query was sent, false otherwise
+     */
+    bool sample_infohashes(const Peer& peer, const NodeId& target);
+    
     /**
      * Get our node ID
      * @return The node ID
@@ -143,12 +340,66 @@ public:
      */
     size_t get_pending_ping_verifications_count() const;
     
+    /**
+     * Get number of find_peers lookups still running
+     * @return Number of pending searches
+     */
+    size_t get_pending_searches_count() const;
+    
+    /**
+     * Limit the memory held for other nodes' announcements and for running lookups.
+     * State that no longer fits is dropped at once.
+     * @param max_stored_info_hashes Info hashes we keep announced peers for, across all shards
+     * @param max_peers_per_info_hash Announced peers kept per info hash
+     * @param max_pending_searches find_peers lookups running at once
+     */
+    void set_resource_limits(size_t max_stored_info_hashes, size_t max_peers_per_info_hash, size_t max_pending_searches);
+    
+    /**
+     * Get the memory held by peers other nodes announced to us
+     * @return Usage, with one entry per stored peer
+     */
+    ResourceUsage get_announced_peers_usage() const;
+    
+    /**
+     * Get the memory held by running find_peers lookups
+     * @return Usage, with one entry per lookup
+     */
+    ResourceUsage get_searches_usage() const;
+    
     /**
      * Check if DHT is running
      * @return true if running, false otherwise
      */
     bool is_running() const { return running_; }
     
+    /**
+     * Save our node ID and the nodes in the routing table, most recently seen first,
+     * in a compact binary file
+     * @param path File to write (replaced atomically)
+     * @return true if saved, false otherwise
+     */
+    bool save_routing_table(const std::string& path) const;
+    
+    /**
+     * Load a file written by save_routing_table(). We take over the saved node ID, and
+     * start() queries every saved node at once so the table refills within a round trip
+     * instead of growing from the bootstrap nodes. Only possible before start().
+     * @param path File to read
+     * @return true if loaded, false if running, missing or malformed
+     */
+    bool load_routing_table(const std::string& path);
+    
+    /**
+     * Send and receive through a transport instead of a UDP socket. The client then starts
+     * no network or maintenance threads: the transport delivers datagrams, its clock is
+     * the client's clock and its timers run lookup timeouts and maintenance, so clients
+     * on a SimNetwork run in virtual time. Only possible before start().
+     * @param transport Transport to use (nullptr: back to a UDP socket)
+     * @return true if set, false if running
+     */
+    bool set_transport(std::shared_ptr<DatagramTransport> transport);
+    
     /**
      * Get default BitTorrent DHT bootstrap nodes
      * @return Vector of bootstrap nodes
@@ -159,21 +410,37 @@ private:
     int port_;
     NodeId node_id_;
     socket_t socket_;
+    int socket_family_;
     std::atomic<bool> running_;
     
-    // Routing table (k-buckets)
-    std::vector<std::vector<DhtNode>> routing_table_;
-    mutable std::mutex routing_table_mutex_;
+    // Replaces socket_, the network thread and the maintenance threads when set
+    std::shared_ptr<DatagramTransport> transport_;
     
-    // Active searches (use string keys instead of InfoHash to avoid hash conflicts)
-    std::unordered_map<std::string, PeerDiscoveryCallback> active_searches_;
-    std::mutex active_searches_mutex_;
+    // Readiness of the UDP socket; also woken for queued sends and shutdown
+    IoPoller poller_;
     
-    // Tokens for peers (use Peer directly as key for efficiency)
-    std::unordered_map<Peer, std::string> peer_tokens_;
-    std::mutex peer_tokens_mutex_;
+    // Encoded KRPC messages waiting for the network thread, sent in batches. Buffers of sent
+    // messages are kept for encoding the next ones, so replies stop allocating once warm.
+    std::vector<UdpDatagram> send_queue_;
+    std::vector<std::vector<uint8_t>> spare_send_buffers_;
+    std::mutex send_queue_mutex_;
+    bool waiting_writable_;
     
-
+    // Routing table (k-buckets); lookups take the mutex shared
+    DhtRoutingTable routing_table_;
+    mutable std::shared_mutex routing_table_mutex_;
+    
+    // Nodes from load_routing_table(), queried by start(); they enter the table once they answer
+    std::vector<DhtNode> warm_start_nodes_;
+    
+    // Announce tokens are derived from the requester's IP and a secret that
+    // rotates every DHT_TOKEN_SECRET_LIFETIME; the previous secret is still
+    // accepted, so nothing is stored per peer
+    using TokenSecret = std::array<uint8_t, DHT_TOKEN_SECRET_SIZE>;
+    TokenSecret token_secret_{};
+    TokenSecret previous_token_secret_{};
+    std::chrono::steady_clock::time_point token_secret_created_at_;
+    mutable std::shared_mutex token_secret_mutex_;
     
     // Pending announce tracking (for BEP 5 compliance)
     struct PendingAnnounce {
@@ -181,41 +448,58 @@ private:
         uint16_t port;
         std::chrono::steady_clock::time_point created_at;
         
-        PendingAnnounce(const InfoHash& hash, uint16_t p)
-            : info_hash(hash), port(p), created_at(std::chrono::steady_clock::now()) {}
+        PendingAnnounce(const InfoHash& hash, uint16_t p, std::chrono::steady_clock::time_point now)
+            : info_hash(hash), port(p), created_at(now) {}
     };
     std::unordered_map<std::string, PendingAnnounce> pending_announces_;
     std::mutex pending_announces_mutex_;
     
-    // Pending find_peers tracking (to map transaction IDs to info_hash)
-    struct PendingSearch {
-        InfoHash info_hash;
-        std::chrono::steady_clock::time_point created_at;
+    // find_peers lookups: the nearest candidates seen so far, of which up to
+    // ALPHA are being queried at any time
+    struct SearchCandidate {
+        enum class State : uint8_t { Fresh, Querying, Responded, Failed };
         
-        // Iterative search state
-        std::unordered_set<std::string> queried_nodes;  // node_id as hex string
-        int iteration_count;                            // current iteration number
-        int iteration_max;                              // maximum iteration limit
+        DhtNode node;
+        int depth;                  // Hops from our routing table
+        State state;
+        std::string transaction_id;
+        std::chrono::steady_clock::time_point sent_at;
         
-        PendingSearch(const InfoHash& hash, int max_iterations = 1)
-            : info_hash(hash), created_at(std::chrono::steady_clock::now()), 
-              iteration_count(1), iteration_max(max_iterations) {}
+        SearchCandidate(const DhtNode& n, int d) : node(n), depth(d), state(State::Fresh) {}
     };
-    std::unordered_map<std::string, PendingSearch> pending_searches_; // info_hash (hex) -> PendingSearch
-    std::mutex pending_searches_mutex_;
-    std::unordered_map<std::string, std::string> transaction_to_search_; // transaction_id -> info_hash (hex)
-    
-    // Peer announcement storage (BEP 5 compliant)
-    struct AnnouncedPeer {
-        Peer peer;
-        std::chrono::steady_clock::time_point announced_at;
+    struct PendingSearch {
+        InfoHash info_hash;
+        PeerDiscoveryCallback callback;
+        std::chrono::steady_clock::time_point started_at;
+        std::chrono::steady_clock::time_point deadline;
+        int max_depth;
+        std::vector<SearchCandidate> candidates;  // Nearest first
+        std::unordered_set<NodeId> seen_nodes;
+        std::unordered_set<NetEndpoint> found_peers;
+        size_t in_flight;
         
-        AnnouncedPeer(const Peer& p) 
-            : peer(p), announced_at(std::chrono::steady_clock::now()) {}
+        PendingSearch(const InfoHash& hash, PeerDiscoveryCallback cb, int depth, std::chrono::steady_clock::time_point now)
+            : info_hash(hash), callback(std::move(cb)), started_at(now),
+              deadline(started_at + DHT_SEARCH_TIMEOUT),
+              max_depth(depth), in_flight(0) {}
     };
-    // Map from info_hash (as hex string) to list of announced peers
-    std::unordered_map<std::string, std::vector<AnnouncedPeer>> announced_peers_;
-    std::mutex announced_peers_mutex_;
+    using PendingSearchMap = std::unordered_map<InfoHash, PendingSearch>;
+    PendingSearchMap pending_searches_;
+    mutable std::mutex pending_searches_mutex_;
+    std::unordered_map<std::string, InfoHash> transaction_to_search_;  // transaction_id -> info_hash
+    std::atomic<bool> searches_active_;  // Network thread wakes up to time out lookup queries
+    size_t max_pending_searches_;        // Guarded by pending_searches_mutex_
+    uint64_t search_evictions_;          // Lookups ended early to make room for new ones
+    
+    // Peer announcement storage (BEP 5 compliant), sharded by info_hash
+    struct AnnouncedPeerShard {
+        DhtPeerStore store{DHT_MAX_STORED_INFO_HASHES / DHT_STATE_SHARDS, DHT_MAX_PEERS_PER_INFO_HASH,
+                           DHT_ANNOUNCED_PEER_LIFETIME};
+        mutable std::mutex mutex;
+    };
+    std::array<AnnouncedPeerShard, DHT_STATE_SHARDS> announced_peer_shards_;
+    
+    AnnouncedPeerShard& announced_peer_shard(const InfoHash& info_hash);
     
     // Ping-before-replace eviction tracking
     struct PingVerification {
@@ -225,9 +509,10 @@ private:
         std::chrono::steady_clock::time_point ping_sent_at;
         std::string transaction_id;  // Transaction ID of the ping
         
-        PingVerification(const DhtNode& candidate, const DhtNode& old, int bucket_idx, const std::string& trans_id)
+        PingVerification(const DhtNode& candidate, const DhtNode& old, int bucket_idx, const std::string& trans_id,
+                         std::chrono::steady_clock::time_point now)
             : candidate_node(candidate), old_node(old), bucket_index(bucket_idx), 
-              ping_sent_at(std::chrono::steady_clock::now()), transaction_id(trans_id) {}
+              ping_sent_at(now), transaction_id(trans_id) {}
     };
     std::unordered_map<std::string, PingVerification> pending_pings_;  // transaction_id -> PingVerification
     mutable std::mutex pending_pings_mutex_;
@@ -236,9 +521,51 @@ private:
     std::unordered_set<NodeId> nodes_being_replaced_;
     mutable std::mutex nodes_being_replaced_mutex_;
     
+    // Virtual node IDs on the same socket, each with its own routing table.
+    // The list is fixed once running, so only each table needs a lock.
+    struct VirtualNode {
+        DhtRoutingTable routing_table;
+        std::unordered_map<NodeId, std::chrono::steady_clock::time_point> next_sample_at;  // By node, from BEP 51 intervals
+        mutable std::shared_mutex mutex;
+        
+        explicit VirtualNode(const NodeId& id) : routing_table(id) {}
+        const NodeId& id() const { return routing_table.get_own_id(); }
+    };
+    std::vector<std::unique_ptr<VirtualNode>> virtual_nodes_;
+    
+    // Crawl queries (sent by virtual nodes, or sample_infohashes) by transaction id
+    static constexpr size_t PRIMARY_NODE = SIZE_MAX;
+    struct CrawlQuery {
+        size_t node_index;       // Virtual node that sent it, or PRIMARY_NODE
+        KrpcQueryType query_type;
+        std::chrono::steady_clock::time_point sent_at;
+    };
+    std::unordered_map<std::string, CrawlQuery> crawl_queries_;
+    std::mutex crawl_queries_mutex_;
+    
+    InfoHashSampleCallback sample_callback_;
+    std::mutex sample_callback_mutex_;
+    
     // Network thread
     std::thread network_thread_;
-    std::thread maintenance_thread_;
+    
+    // Periodic maintenance jobs; recreated on every start
+    std::unique_ptr<ThreadManager> maintenance_;
+    
+    // KRPC workers; the network thread hands each datagram to the worker its sender hashes to,
+    // so messages from one node stay in order
+    struct InboundDatagram {
+        std::vector<uint8_t> data;
+        NetEndpoint sender;
+    };
+    struct KrpcWorker {
+        std::thread thread;
+        std::deque<InboundDatagram> queue;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+    size_t worker_thread_count_;
+    std::vector<std::unique_ptr<KrpcWorker>> workers_;
     
     // Conditional variables for immediate shutdown
     std::condition_variable shutdown_cv_;
@@ -246,32 +573,42 @@ private:
     
     // Helper functions
     void network_loop();
-    void maintenance_loop();
-    void handle_message(const std::vector<uint8_t>& data, const Peer& sender);
+    void start_maintenance();
+    void stop_maintenance();
+    void schedule_periodic(std::chrono::milliseconds interval, std::function<void()> task, const std::string& name,
+                           std::chrono::milliseconds initial_delay = std::chrono::milliseconds(-1));
+    void schedule_on_transport(std::chrono::milliseconds delay, std::chrono::milliseconds interval,
+                               std::shared_ptr<std::function<void()>> task);
+    std::chrono::steady_clock::time_point current_time() const;
+    void handle_message(const uint8_t* data, size_t size, const NetEndpoint& sender);
+    void flush_send_queue();
+    void dispatch_message(const uint8_t* data, size_t size, const NetEndpoint& sender);
+    void worker_loop(KrpcWorker* worker);
     
 
     
     // KRPC protocol handlers  
-    void handle_krpc_message(const KrpcMessage& message, const Peer& sender);
-    void handle_krpc_ping(const KrpcMessage& message, const Peer& sender);
-    void handle_krpc_find_node(const KrpcMessage& message, const Peer& sender);
-    void handle_krpc_get_peers(const KrpcMessage& message, const Peer& sender);
-    void handle_krpc_announce_peer(const KrpcMessage& message, const Peer& sender);
-    void handle_krpc_response(const KrpcMessage& message, const Peer& sender);
-    void handle_krpc_error(const KrpcMessage& message, const Peer& sender);
+    void handle_krpc_message(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_ping(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_find_node(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_get_peers(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_announce_peer(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_sample_infohashes(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_response(const KrpcMessage& message, const NetEndpoint& sender);
+    void handle_krpc_error(const KrpcMessage& message, const NetEndpoint& sender);
     
     // KRPC protocol sending functions
-    void send_ping(const Peer& peer);
-    void send_find_node(const Peer& peer, const NodeId& target);
-    void send_get_peers(const Peer& peer, const InfoHash& info_hash);
-    void send_announce_peer(const Peer& peer, const InfoHash& info_hash, uint16_t port, const std::string& token);
+    void send_ping(const NetEndpoint& peer);
+    void send_find_node(const NetEndpoint& peer, const NodeId& target);
+    void send_get_peers(const NetEndpoint& peer, const InfoHash& info_hash);
+    void send_announce_peer(const NetEndpoint& peer, const InfoHash& info_hash, uint16_t port, const std::string& token);
     
     // KRPC protocol sending
-    bool send_krpc_message(const KrpcMessage& message, const Peer& peer);
-    void send_krpc_ping(const Peer& peer);
-    void send_krpc_find_node(const Peer& peer, const NodeId& target);
-    void send_krpc_get_peers(const Peer& peer, const InfoHash& info_hash);
-    void send_krpc_announce_peer(const Peer& peer, const InfoHash& info_hash, uint16_t port, const std::string& token);
+    bool send_krpc_message(const KrpcMessage& message, const NetEndpoint& peer);
+    void send_krpc_ping(const NetEndpoint& peer);
+    void send_krpc_find_node(const NetEndpoint& peer, const NodeId& target);
+    void send_krpc_get_peers(const NetEndpoint& peer, const InfoHash& info_hash);
+    void send_krpc_announce_peer(const NetEndpoint& peer, const InfoHash& info_hash, uint16_t port, const std::string& token);
     
     void add_node(const DhtNode& node);
     std::vector<DhtNode> find_closest_nodes(const NodeId& target, size_t count = K_BUCKET_SIZE);
@@ -283,8 +620,10 @@ private:
     bool is_closer(const NodeId& a, const NodeId& b, const NodeId& target);
 
     
-    std::string generate_token(const Peer& peer);
-    bool verify_token(const Peer& peer, const std::string& token);
+    std::string generate_token(const NetEndpoint& peer);
+    bool verify_token(const NetEndpoint& peer, const std::string& token);
+    static std::string make_token(const NetEndpoint& peer, const TokenSecret& secret);
+    void rotate_token_secret();
     
 
     
@@ -293,30 +632,41 @@ private:
     
     // Pending announce management
     void cleanup_stale_announces();
-    void handle_get_peers_response_for_announce(const std::string& transaction_id, const Peer& responder, const std::string& token);
+    void handle_get_peers_response_for_announce(const std::string& transaction_id, const NetEndpoint& responder, const std::string& token);
+    
+    // Virtual nodes and info hash sampling
+    const NodeId& crawl_node_id(size_t node_index) const;
+    bool send_crawl_query(size_t node_index, KrpcQueryType query_type, const NetEndpoint& peer, const NodeId& target);
+    void handle_crawl_response(const KrpcMessage& message, const NetEndpoint& sender);
+    std::vector<DhtNode> find_closest_nodes_as(const NodeId& target, size_t count, NodeId& responder_id);
+    std::vector<InfoHash> sample_announced_info_hashes(size_t max_samples, uint32_t& total);
+    void crawl_virtual_nodes();
+    void cleanup_stale_crawl_state();
     
     // Pending search management
-    void cleanup_stale_searches();
-    void handle_get_peers_response_for_search(const std::string& transaction_id, const Peer& responder, const std::vector<Peer>& peers);
-    void handle_get_peers_response_with_nodes(const std::string& transaction_id, const Peer& responder, const std::vector<KrpcNode>& nodes);
-    bool continue_search_iteration(PendingSearch& search);
+    void handle_get_peers_response_for_search(const KrpcMessage& message, const NetEndpoint& responder);
+    bool advance_search(PendingSearch& search, std::chrono::steady_clock::time_point now);
+    void expire_search_queries(std::chrono::steady_clock::time_point now);
+    PendingSearchMap::iterator erase_search(PendingSearchMap::iterator it);  // Also drops its transactions
+    void erase_oldest_search();  // Ends the longest running lookup, caller holds pending_searches_mutex_
+    void record_rtt(const NodeId& id, uint32_t rtt_ms);
     
     // Peer announcement storage management
-    void store_announced_peer(const InfoHash& info_hash, const Peer& peer);
-    std::vector<Peer> get_announced_peers(const InfoHash& info_hash);
+    void store_announced_peer(const InfoHash& info_hash, const NetEndpoint& peer);
+    std::vector<NetEndpoint> get_announced_peers(const InfoHash& info_hash);
     void cleanup_stale_announced_peers();
     
     // Ping-before-replace eviction management
     void initiate_ping_verification(const DhtNode& candidate_node, const DhtNode& old_node, int bucket_index);
-    void handle_ping_verification_response(const std::string& transaction_id, const NodeId& responder_id, const Peer& responder);
+    void handle_ping_verification_response(const std::string& transaction_id, const NodeId& responder_id, const NetEndpoint& responder);
     void cleanup_stale_ping_verifications();
     void perform_replacement(const DhtNode& candidate_node, const DhtNode& node_to_replace, int bucket_index);
     
     // Conversion utilities
     static KrpcNode dht_node_to_krpc_node(const DhtNode& node);
-    static DhtNode krpc_node_to_dht_node(const KrpcNode& node);
+    DhtNode krpc_node_to_dht_node(const KrpcNode& node) const;
     static std::vector<KrpcNode> dht_nodes_to_krpc_nodes(const std::vector<DhtNode>& nodes);
-    static std::vector<DhtNode> krpc_nodes_to_dht_nodes(const std::vector<KrpcNode>& nodes);
+    std::vector<DhtNode> krpc_nodes_to_dht_nodes(const std::vector<KrpcNode>& nodes) const;
 };
 
 /**
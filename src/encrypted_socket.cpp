@@ -4,6 +4,7 @@
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <cerrno>
 
 #define LOG_ENCRYPT_DEBUG(message) LOG_DEBUG("encrypt", message)
 #define LOG_ENCRYPT_INFO(message)  LOG_INFO("encrypt", message)
@@ -16,6 +17,19 @@ namespace librats {
 constexpr uint32_t NOISE_MESSAGE_MAGIC = 0x4E4F4953; // "NOIS" in little endian
 constexpr uint32_t HANDSHAKE_MESSAGE_MAGIC = 0x48534B48; // "HSKH" in little endian
 constexpr size_t MESSAGE_HEADER_SIZE = 8; // 4 bytes magic + 4 bytes length
+constexpr uint32_t MAX_TRANSPORT_MESSAGE_SIZE = 100 * 1024 * 1024; // Matches the plaintext framing limit
+constexpr size_t TRANSPORT_RECEIVE_CHUNK_SIZE = 64 * 1024;
+
+namespace {
+
+void write_frame_header(uint8_t header[MESSAGE_HEADER_SIZE], uint32_t length) {
+    uint32_t magic_be = htonl(NOISE_MESSAGE_MAGIC);
+    uint32_t length_be = htonl(length);
+    std::memcpy(header, &magic_be, 4);
+    std::memcpy(header + 4, &length_be, 4);
+}
+
+} // anonymous namespace
 
 //=============================================================================
 // EncryptedSocket Implementation
@@ -28,35 +42,61 @@ EncryptedSocket::~EncryptedSocket() {
 }
 
 bool EncryptedSocket::initialize_as_initiator(socket_t socket, const NoiseKey& static_private_key) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    
-    auto session = std::make_unique<SocketSession>(socket);
+    auto session = std::make_shared<SocketSession>(socket);
     if (!session->session->initialize_as_initiator(static_private_key)) {
         LOG_ENCRYPT_ERROR("Failed to initialize noise session as initiator for socket " << socket);
         return false;
     }
     
-    session->is_encrypted = true;
-    sessions_[socket] = std::move(session);
+    add_session(socket, std::move(session), "initiator");
+    return true;
+}
+
+bool EncryptedSocket::initialize_as_initiator(socket_t socket, const NoiseKey& static_private_key, const NoiseKey& remote_static_key) {
+    auto session = std::make_shared<SocketSession>(socket);
+    if (!session->session->initialize_as_initiator(static_private_key, remote_static_key)) {
+        LOG_ENCRYPT_ERROR("Failed to initialize noise IK session as initiator for socket " << socket);
+        return false;
+    }
     
-    LOG_ENCRYPT_INFO("Initialized encrypted socket " << socket << " as initiator");
+    add_session(socket, std::move(session), "initiator (IK)");
     return true;
 }
 
-bool EncryptedSocket::initialize_as_responder(socket_t socket, const NoiseKey& static_private_key) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
+bool EncryptedSocket::initialize_as_resuming_initiator(socket_t socket, const NoiseKey& static_private_key, const NoiseSessionTicket& ticket) {
+    auto session = std::make_shared<SocketSession>(socket);
+    if (!session->session->initialize_as_resuming_initiator(static_private_key, ticket)) {
+        LOG_ENCRYPT_ERROR("Failed to initialize resumed noise session as initiator for socket " << socket);
+        return false;
+    }
     
-    auto session = std::make_unique<SocketSession>(socket);
+    add_session(socket, std::move(session), "initiator (resumed)");
+    return true;
+}
+
+bool EncryptedSocket::initialize_as_responder(socket_t socket, const NoiseKey& static_private_key,
+                                              NoiseHandshake::TicketLookup ticket_lookup) {
+    auto session = std::make_shared<SocketSession>(socket);
     if (!session->session->initialize_as_responder(static_private_key)) {
         LOG_ENCRYPT_ERROR("Failed to initialize noise session as responder for socket " << socket);
         return false;
     }
+    if (ticket_lookup) {
+        session->session->set_ticket_lookup(std::move(ticket_lookup));
+    }
     
+    add_session(socket, std::move(session), "responder");
+    return true;
+}
+
+void EncryptedSocket::add_session(socket_t socket, std::shared_ptr<SocketSession> session, const char* role) {
     session->is_encrypted = true;
-    sessions_[socket] = std::move(session);
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        sessions_[socket] = std::move(session);
+    }
     
-    LOG_ENCRYPT_INFO("Initialized encrypted socket " << socket << " as responder");
-    return true;
+    LOG_ENCRYPT_INFO("Initialized encrypted socket " << socket << " as " << role);
 }
 
 bool EncryptedSocket::is_encrypted(socket_t socket) const {
@@ -68,26 +108,82 @@ bool EncryptedSocket::is_encrypted(socket_t socket) const {
 bool EncryptedSocket::is_handshake_completed(socket_t socket) const {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     const auto* session = get_session(socket);
-    return session && session->session->is_handshake_completed();
+    return session && session->handshake_completed.load();
 }
 
 bool EncryptedSocket::has_handshake_failed(socket_t socket) const {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     const auto* session = get_session(socket);
-    return session && session->session->has_handshake_failed();
+    return session && session->handshake_failed.load();
+}
+
+bool EncryptedSocket::perform_handshake_step(socket_t socket) {
+    auto session = find_session(socket);
+    if (!session) {
+        LOG_ENCRYPT_ERROR("No session found for socket " << socket);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(session->handshake_mutex);
+    NoiseSession& noise = *session->session;
+    bool progressing = true;
+    
+    NoiseHandshakeState state = noise.get_handshake_state();
+    if (noise.get_role() == NoiseRole::INITIATOR && state == NoiseHandshakeState::WRITE_MESSAGE_1) {
+        // Initiator sends the first message as soon as the session is set up
+        LOG_ENCRYPT_DEBUG("Initiator sending initial handshake message on socket " << socket);
+        progressing = send_handshake_message_locked(*session, {});
+    } else if (state == NoiseHandshakeState::READ_MESSAGE_1 ||
+               state == NoiseHandshakeState::READ_MESSAGE_2 ||
+               state == NoiseHandshakeState::READ_MESSAGE_3) {
+        // Otherwise we are waiting for the peer: read its message (the caller only gets here
+        // once the socket is readable) and answer it if it is our turn to write
+        LOG_ENCRYPT_DEBUG("Receiving handshake message on socket " << socket << " (state: " << static_cast<int>(state) << ")");
+        receive_handshake_message_locked(*session);
+        
+        // A readable socket that did not advance the handshake was closed or sent garbage
+        NoiseHandshakeState previous_state = state;
+        state = noise.get_handshake_state();
+        if (noise.has_handshake_failed()) {
+            LOG_ENCRYPT_DEBUG("Handshake failed for socket " << socket);
+            progressing = false;
+        } else if (state == previous_state) {
+            LOG_ENCRYPT_DEBUG("No handshake progress on socket " << socket);
+            progressing = false;
+        } else if (!noise.is_handshake_completed() &&
+                   (state == NoiseHandshakeState::WRITE_MESSAGE_2 || state == NoiseHandshakeState::WRITE_MESSAGE_3)) {
+            LOG_ENCRYPT_DEBUG("Sending handshake response on socket " << socket);
+            progressing = send_handshake_message_locked(*session, {});
+        }
+    }
+    
+    publish_handshake_state(*session);
+    return progressing && !noise.has_handshake_failed();
+}
+
+void EncryptedSocket::publish_handshake_state(SocketSession& session) {
+    session.handshake_completed = session.session->is_handshake_completed();
+    session.handshake_failed = session.session->has_handshake_failed();
 }
 
 bool EncryptedSocket::send_handshake_message(socket_t socket, const std::vector<uint8_t>& payload) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    auto* session = get_session(socket);
+    auto session = find_session(socket);
     if (!session) {
         LOG_ENCRYPT_ERROR("No session found for socket " << socket);
         return false;
     }
     
+    std::lock_guard<std::mutex> lock(session->handshake_mutex);
+    bool sent = send_handshake_message_locked(*session, payload);
+    publish_handshake_state(*session);
+    return sent;
+}
+
+bool EncryptedSocket::send_handshake_message_locked(SocketSession& session, const std::vector<uint8_t>& payload) {
+    socket_t socket = session.socket;
     try {
-        auto handshake_data = session->session->create_handshake_message(payload);
-        if (handshake_data.empty() && !session->session->is_handshake_completed()) {
+        auto handshake_data = session.session->create_handshake_message(payload);
+        if (handshake_data.empty() && !session.session->is_handshake_completed()) {
             LOG_ENCRYPT_ERROR("Failed to create handshake message for socket " << socket);
             return false;
         }
@@ -155,13 +251,20 @@ bool EncryptedSocket::send_handshake_message(socket_t socket, const std::vector<
 }
 
 std::vector<uint8_t> EncryptedSocket::receive_handshake_message(socket_t socket) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    auto* session = get_session(socket);
+    auto session = find_session(socket);
     if (!session) {
         LOG_ENCRYPT_ERROR("No session found for socket " << socket);
         return {};
     }
     
+    std::lock_guard<std::mutex> lock(session->handshake_mutex);
+    auto payload = receive_handshake_message_locked(*session);
+    publish_handshake_state(*session);
+    return payload;
+}
+
+std::vector<uint8_t> EncryptedSocket::receive_handshake_message_locked(SocketSession& session) {
+    socket_t socket = session.socket;
     try {
         // First, read the handshake magic (4 bytes)
         LOG_ENCRYPT_DEBUG("Attempting to receive handshake magic on socket " << socket);
@@ -243,7 +346,7 @@ std::vector<uint8_t> EncryptedSocket::receive_handshake_message(socket_t socket)
         }
         
         // Process handshake message
-        auto payload = session->session->process_handshake_message(handshake_data);
+        auto payload = session.session->process_handshake_message(handshake_data);
         
         LOG_ENCRYPT_DEBUG("Received and processed handshake message (" << handshake_data.size() << " bytes) from socket " << socket);
         
@@ -256,41 +359,43 @@ std::vector<uint8_t> EncryptedSocket::receive_handshake_message(socket_t socket)
 }
 
 bool EncryptedSocket::send_encrypted_data(socket_t socket, const std::vector<uint8_t>& data) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    auto* session = get_session(socket);
+    std::vector<uint8_t> buffer(data);
+    return send_encrypted_data_in_place(socket, buffer.data(), buffer.size());
+}
+
+bool EncryptedSocket::send_encrypted_data_in_place(socket_t socket, uint8_t* data, size_t size) {
+    auto session = get_transport_session(socket);
     if (!session) {
-        LOG_ENCRYPT_ERROR("No session found for socket " << socket);
         return false;
     }
     
-    if (!session->session->is_handshake_completed()) {
-        LOG_ENCRYPT_ERROR("Cannot send encrypted data: handshake not completed for socket " << socket);
+    if (size > MAX_TRANSPORT_MESSAGE_SIZE - NOISE_TAG_SIZE) {
+        LOG_ENCRYPT_ERROR("Encrypted message too large (" << size << " bytes) for socket " << socket);
         return false;
     }
     
-    try {
-        auto encrypted_data = session->session->encrypt_transport_message(data);
-        
-        if (encrypted_data.empty()) {
-            LOG_ENCRYPT_ERROR("Failed to encrypt data for socket " << socket);
-            return false;
-        }
-        
-        auto framed_message = frame_message(encrypted_data);
-        
-        int sent = send_tcp_data(socket, framed_message);
-        if (sent <= 0) {
-            LOG_ENCRYPT_ERROR("Failed to send encrypted data to socket " << socket);
-            return false;
-        }
-        
-        LOG_ENCRYPT_DEBUG("Sent encrypted data (" << data.size() << " bytes plaintext, " << encrypted_data.size() << " bytes encrypted) to socket " << socket);
-        return true;
-        
-    } catch (const std::exception& e) {
-        LOG_ENCRYPT_ERROR("Exception in send_encrypted_data: " << e.what());
+    // Encrypt and write under one lock so frames arrive in nonce order
+    std::lock_guard<std::mutex> lock(session->send_mutex);
+    
+    uint8_t tag[NOISE_TAG_SIZE];
+    if (!session->session->encrypt_transport_message(data, size, tag)) {
+        LOG_ENCRYPT_ERROR("Failed to encrypt data for socket " << socket);
         return false;
     }
+    
+    // [magic, length] header, ciphertext and tag in one vectored write
+    uint8_t header[MESSAGE_HEADER_SIZE];
+    write_frame_header(header, static_cast<uint32_t>(size + NOISE_TAG_SIZE));
+    IoSlice parts[3] = { IoSlice(header, sizeof(header)), IoSlice(data, size), IoSlice(tag, sizeof(tag)) };
+    
+    int sent = send_tcp_data_vectored(socket, parts, 3);
+    if (sent != static_cast<int>(MESSAGE_HEADER_SIZE + size + NOISE_TAG_SIZE)) {
+        LOG_ENCRYPT_ERROR("Failed to send encrypted data to socket " << socket);
+        return false;
+    }
+    
+    LOG_ENCRYPT_DEBUG("Sent encrypted data (" << size << " bytes plaintext) to socket " << socket);
+    return true;
 }
 
 bool EncryptedSocket::send_encrypted_data(socket_t socket, const std::string& data) {
@@ -299,48 +404,83 @@ bool EncryptedSocket::send_encrypted_data(socket_t socket, const std::string& da
 }
 
 std::vector<uint8_t> EncryptedSocket::receive_encrypted_data(socket_t socket) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    auto* session = get_session(socket);
+    auto session = get_transport_session(socket);
     if (!session) {
-        LOG_ENCRYPT_ERROR("No session found for socket " << socket);
         return std::vector<uint8_t>();
     }
     
-    if (!session->session->is_handshake_completed()) {
-        LOG_ENCRYPT_ERROR("Cannot receive encrypted data: handshake not completed for socket " << socket);
-        return std::vector<uint8_t>();
-    }
+    std::lock_guard<std::mutex> lock(session->receive_mutex);
     
-    try {
-        std::vector<uint8_t> raw_data = receive_tcp_data(socket, 4096);
-        if (raw_data.empty()) {
-            return std::vector<uint8_t>();
+    // Read until one complete frame is buffered; anything after it stays for the next call
+    std::vector<uint8_t> message;
+    while (true) {
+        size_t offset = 0;
+        int result = decrypt_buffered_frame(*session, offset, message);
+        if (result > 0) {
+            compact_receive_buffer(*session, offset);
+            LOG_ENCRYPT_DEBUG("Received encrypted data (" << message.size() << " bytes plaintext) from socket " << socket);
+            return message;
         }
-        
-        auto encrypted_data = unframe_message(raw_data);
-        
-        if (encrypted_data.empty()) {
-            LOG_ENCRYPT_ERROR("Failed to unframe encrypted message");
+        if (result < 0) {
             return std::vector<uint8_t>();
         }
         
-        auto decrypted_data = session->session->decrypt_transport_message(encrypted_data);
-        
-        if (decrypted_data.empty()) {
-            LOG_ENCRYPT_ERROR("Failed to decrypt data from socket " << socket);
+        std::vector<uint8_t> chunk = receive_tcp_data(socket, TRANSPORT_RECEIVE_CHUNK_SIZE);
+        if (chunk.empty()) {
             return std::vector<uint8_t>();
         }
-        
-        LOG_ENCRYPT_DEBUG("Received encrypted data (" << encrypted_data.size() << " bytes encrypted, " << decrypted_data.size() << " bytes plaintext) from socket " << socket);
-        
-        return decrypted_data;
-        
-    } catch (const std::exception& e) {
-        LOG_ENCRYPT_ERROR("Exception in receive_encrypted_data: " << e.what());
-        return std::vector<uint8_t>();
+        session->receive_buffer.insert(session->receive_buffer.end(), chunk.begin(), chunk.end());
     }
 }
 
+bool EncryptedSocket::receive_encrypted_messages(socket_t socket, std::vector<std::vector<uint8_t>>& messages) {
+    auto session = get_transport_session(socket);
+    if (!session) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(session->receive_mutex);
+    
+    // Receive into a per-thread scratch buffer; only partial frames are kept per connection
+    thread_local std::vector<uint8_t> scratch(TRANSPORT_RECEIVE_CHUNK_SIZE);
+    
+    int bytes_received = recv(socket, reinterpret_cast<char*>(scratch.data()), static_cast<int>(scratch.size()), 0);
+    if (bytes_received == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return true;
+        }
+        LOG_ENCRYPT_ERROR("Failed to receive encrypted data from socket " << socket << " (error: " << error << ")");
+#else
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+            return true;
+        }
+        LOG_ENCRYPT_ERROR("Failed to receive encrypted data from socket " << socket << " (error: " << strerror(error) << ")");
+#endif
+        return false;
+    }
+    
+    if (bytes_received == 0) {
+        LOG_ENCRYPT_INFO("Connection closed by peer on socket " << socket);
+        return false;
+    }
+    
+    session->receive_buffer.insert(session->receive_buffer.end(), scratch.begin(), scratch.begin() + bytes_received);
+    
+    // Decrypt every complete frame
+    size_t offset = 0;
+    std::vector<uint8_t> message;
+    int result;
+    while ((result = decrypt_buffered_frame(*session, offset, message)) > 0) {
+        messages.push_back(std::move(message));
+    }
+    compact_receive_buffer(*session, offset);
+    
+    return result == 0;
+}
+
 std::string EncryptedSocket::receive_encrypted_data_string(socket_t socket) {
     std::vector<uint8_t> binary_data = receive_encrypted_data(socket);
     if (binary_data.empty()) {
@@ -403,6 +543,24 @@ NoiseRole EncryptedSocket::get_socket_role(socket_t socket) const {
     return NoiseRole::INITIATOR; // Default
 }
 
+NoiseHandshakePattern EncryptedSocket::get_handshake_pattern(socket_t socket) const {
+    auto session = find_session(socket);
+    if (!session) {
+        return NoiseHandshakePattern::XX;
+    }
+    std::lock_guard<std::mutex> lock(session->handshake_mutex);
+    return session->session->get_handshake_pattern();
+}
+
+bool EncryptedSocket::get_session_ticket(socket_t socket, NoiseSessionTicket& ticket) const {
+    auto session = find_session(socket);
+    if (!session) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(session->handshake_mutex);
+    return session->session->get_session_ticket(ticket);
+}
+
 const NoiseKey& EncryptedSocket::get_remote_static_key(socket_t socket) const {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     const auto* session = get_session(socket);
@@ -424,6 +582,83 @@ const EncryptedSocket::SocketSession* EncryptedSocket::get_session(socket_t sock
     return (it != sessions_.end()) ? it->second.get() : nullptr;
 }
 
+std::shared_ptr<EncryptedSocket::SocketSession> EncryptedSocket::find_session(socket_t socket) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = sessions_.find(socket);
+    return (it != sessions_.end()) ? it->second : nullptr;
+}
+
+std::shared_ptr<EncryptedSocket::SocketSession> EncryptedSocket::get_transport_session(socket_t socket) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = sessions_.find(socket);
+    if (it == sessions_.end()) {
+        LOG_ENCRYPT_ERROR("No session found for socket " << socket);
+        return nullptr;
+    }
+    
+    if (!it->second->handshake_completed.load()) {
+        LOG_ENCRYPT_ERROR("Handshake not completed for socket " << socket);
+        return nullptr;
+    }
+    
+    return it->second;
+}
+
+int EncryptedSocket::decrypt_buffered_frame(SocketSession& session, size_t& offset, std::vector<uint8_t>& message) {
+    const std::vector<uint8_t>& buffer = session.receive_buffer;
+    size_t available = buffer.size() - offset;
+    if (available < MESSAGE_HEADER_SIZE) {
+        return 0;
+    }
+    
+    uint32_t magic;
+    uint32_t length;
+    std::memcpy(&magic, buffer.data() + offset, 4);
+    std::memcpy(&length, buffer.data() + offset + 4, 4);
+    magic = ntohl(magic);
+    length = ntohl(length);
+    
+    if (magic != NOISE_MESSAGE_MAGIC) {
+        LOG_ENCRYPT_ERROR("Invalid transport frame magic 0x" << std::hex << magic << " on socket " << std::dec << session.socket);
+        return -1;
+    }
+    
+    if (length < NOISE_TAG_SIZE || length > MAX_TRANSPORT_MESSAGE_SIZE) {
+        LOG_ENCRYPT_ERROR("Invalid transport frame length " << length << " on socket " << session.socket);
+        return -1;
+    }
+    
+    if (available - MESSAGE_HEADER_SIZE < length) {
+        return 0;  // Wait for the rest of the frame
+    }
+    
+    // Decrypt straight into the output buffer
+    const uint8_t* frame = buffer.data() + offset + MESSAGE_HEADER_SIZE;
+    size_t plaintext_size = length - NOISE_TAG_SIZE;
+    message.assign(frame, frame + plaintext_size);
+    if (!session.session->decrypt_transport_message(message.data(), plaintext_size, frame + plaintext_size)) {
+        LOG_ENCRYPT_ERROR("Failed to decrypt data from socket " << session.socket);
+        message.clear();
+        return -1;
+    }
+    
+    offset += MESSAGE_HEADER_SIZE + length;
+    return 1;
+}
+
+void EncryptedSocket::compact_receive_buffer(SocketSession& session, size_t consumed) {
+    if (consumed == 0) {
+        return;
+    }
+    
+    if (consumed >= session.receive_buffer.size()) {
+        // Release the memory of large frames once they are consumed
+        std::vector<uint8_t>().swap(session.receive_buffer);
+    } else {
+        session.receive_buffer.erase(session.receive_buffer.begin(), session.receive_buffer.begin() + consumed);
+    }
+}
+
 std::string EncryptedSocket::receive_exact_bytes(socket_t socket, size_t byte_count) {
     std::string buffer;
     buffer.reserve(byte_count);
@@ -433,15 +668,8 @@ std::string EncryptedSocket::receive_exact_bytes(socket_t socket, size_t byte_co
         std::string chunk = receive_tcp_string(socket, remaining);
         
         if (chunk.empty()) {
-            // Connection closed or error
+            // Connection closed or error; the caller sees the short read and fails the handshake
             LOG_ENCRYPT_DEBUG("Connection closed or error while reading " << remaining << " remaining bytes");
-            
-            // Mark the session as failed if connection is closed during handshake
-            auto* session = get_session(socket);
-            if (session && !session->session->is_handshake_completed()) {
-                LOG_ENCRYPT_DEBUG("Marking handshake as failed due to connection closure");
-                // The session will be cleaned up by the caller
-            }
             break;
         }
         
@@ -521,11 +749,113 @@ bool EncryptedSocket::is_noise_handshake_message(const std::vector<uint8_t>& dat
     return magic == HANDSHAKE_MESSAGE_MAGIC;
 }
 
+//=============================================================================
+// HandshakeWorkerPool Implementation
+//=============================================================================
+
+HandshakeWorkerPool::HandshakeWorkerPool(const std::string& name)
+    : name_(name), running_(false), max_pending_(1) {}
+
+HandshakeWorkerPool::~HandshakeWorkerPool() {
+    stop();
+}
+
+bool HandshakeWorkerPool::start(size_t thread_count, size_t max_pending) {
+    if (running_.exchange(true)) {
+        return true;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        max_pending_ = std::max<size_t>(max_pending, 1);
+    }
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back(&HandshakeWorkerPool::worker_loop, this);
+    }
+    
+    LOG_ENCRYPT_INFO("Handshake worker pool '" << name_ << "' started with " << thread_count << " threads");
+    return true;
+}
+
+void HandshakeWorkerPool::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_cv_.notify_all();
+    }
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+    
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_.clear();
+    }
+    
+    LOG_ENCRYPT_INFO("Handshake worker pool '" << name_ << "' stopped");
+}
+
+bool HandshakeWorkerPool::is_running() const {
+    return running_.load();
+}
+
+bool HandshakeWorkerPool::submit(std::function<void()> job) {
+    if (!running_.load()) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (queue_.size() >= max_pending_) {
+        return false;
+    }
+    queue_.push_back(std::move(job));
+    queue_cv_.notify_one();
+    return true;
+}
+
+bool HandshakeWorkerPool::is_saturated() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size() >= max_pending_;
+}
+
+size_t HandshakeWorkerPool::get_pending_count() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size();
+}
+
+void HandshakeWorkerPool::worker_loop() {
+    while (running_.load()) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this]() { return !running_.load() || !queue_.empty(); });
+            if (!running_.load()) {
+                break;
+            }
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        
+        try {
+            job();
+        } catch (const std::exception& e) {
+            LOG_ENCRYPT_ERROR("Exception in handshake job: " << e.what());
+        }
+    }
+}
+
 //=============================================================================
 // EncryptedSocketManager Implementation
 //=============================================================================
 
-EncryptedSocketManager::EncryptedSocketManager() : encryption_enabled_(true) {
+EncryptedSocketManager::EncryptedSocketManager() : encryption_enabled_(true), next_ticket_sequence_(0) {
     // Generate a default static key
     static_key_ = noise_utils::generate_static_keypair();
     LOG_ENCRYPT_INFO("Generated default static key for encrypted socket manager");
@@ -545,7 +875,198 @@ bool EncryptedSocketManager::initialize_socket_as_initiator(socket_t socket, con
 }
 
 bool EncryptedSocketManager::initialize_socket_as_responder(socket_t socket, const NoiseKey& static_private_key) {
-    return encrypted_socket_.initialize_as_responder(socket, static_private_key);
+    // Tickets this node issued let returning peers resume without static key DH
+    return encrypted_socket_.initialize_as_responder(socket, static_private_key,
+        [this](const NoiseTicketId& id, NoiseSessionTicket& ticket) {
+            return take_issued_ticket(id, ticket);
+        });
+}
+
+bool EncryptedSocketManager::initialize_socket_for_peer(socket_t socket, const std::string& peer_address) {
+    NoiseKey static_key = get_static_key();
+    NoiseHandshakePattern pattern = NoiseHandshakePattern::XX;
+    NoiseKey remote_static_key;
+    NoiseSessionTicket ticket;
+    {
+        std::lock_guard<std::mutex> lock(credentials_mutex_);
+        auto it = known_peers_.find(peer_address);
+        if (handshake_config_.resume_known_peers && it != known_peers_.end() && !it->second.full_handshake_only) {
+            KnownPeer& peer = it->second;
+            auto now = std::chrono::steady_clock::now();
+            if (peer.has_ticket && now - peer.ticket.issued_at < handshake_config_.ticket_lifetime) {
+                ticket = peer.ticket;
+                pattern = NoiseHandshakePattern::NNPSK0;
+            } else {
+                remote_static_key = peer.static_key;
+                pattern = NoiseHandshakePattern::IK;
+            }
+            // Tickets are single use: the responder consumes its copy as well
+            peer.has_ticket = false;
+            peer.ticket.secret.fill(0);
+            peer.last_used = now;
+        }
+        dialled_sockets_[socket] = DialledSocket{peer_address, pattern};
+    }
+    
+    bool success = false;
+    switch (pattern) {
+        case NoiseHandshakePattern::NNPSK0:
+            success = encrypted_socket_.initialize_as_resuming_initiator(socket, static_key, ticket);
+            break;
+        case NoiseHandshakePattern::IK:
+            success = encrypted_socket_.initialize_as_initiator(socket, static_key, remote_static_key);
+            break;
+        default:
+            success = encrypted_socket_.initialize_as_initiator(socket, static_key);
+            break;
+    }
+    ticket.secret.fill(0);
+    
+    if (!success) {
+        std::lock_guard<std::mutex> lock(credentials_mutex_);
+        dialled_sockets_.erase(socket);
+    }
+    return success;
+}
+
+void EncryptedSocketManager::remember_peer_static_key(const std::string& peer_address, const NoiseKey& key) {
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    auto it = known_peers_.find(peer_address);
+    if (it != known_peers_.end()) {
+        if (it->second.static_key != key) {
+            // A different identity: whatever we knew about the address no longer applies
+            it->second.static_key = key;
+            it->second.has_ticket = false;
+            it->second.full_handshake_only = false;
+        }
+        return;
+    }
+    
+    KnownPeer peer;
+    peer.static_key = key;
+    peer.has_ticket = false;
+    peer.full_handshake_only = false;
+    peer.last_used = std::chrono::steady_clock::now();
+    known_peers_.emplace(peer_address, peer);
+    trim_known_peers_locked();
+}
+
+bool EncryptedSocketManager::get_peer_static_key(const std::string& peer_address, NoiseKey& key) const {
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    auto it = known_peers_.find(peer_address);
+    if (it == known_peers_.end()) {
+        return false;
+    }
+    key = it->second.static_key;
+    return true;
+}
+
+size_t EncryptedSocketManager::get_issued_ticket_count() const {
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    return issued_tickets_.size();
+}
+
+void EncryptedSocketManager::set_static_key(const NoiseKey& key) {
+    bool changed = key != static_key_;
+    static_key_ = key;
+    if (!changed) {
+        return;
+    }
+    
+    // Tickets vouch for the previous identity on both ends
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    issued_tickets_.clear();
+    issued_ticket_order_.clear();
+    for (auto& entry : known_peers_) {
+        entry.second.has_ticket = false;
+    }
+}
+
+void EncryptedSocketManager::set_handshake_config(const HandshakeConfig& config) {
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    handshake_config_ = config;
+    handshake_config_.max_session_tickets = std::max<size_t>(handshake_config_.max_session_tickets, 1);
+}
+
+HandshakeConfig EncryptedSocketManager::get_handshake_config() const {
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    return handshake_config_;
+}
+
+void EncryptedSocketManager::record_completed_handshake(socket_t socket) {
+    NoiseSessionTicket ticket;
+    if (!encrypted_socket_.get_session_ticket(socket, ticket)) {
+        return;
+    }
+    NoiseRole role = encrypted_socket_.get_socket_role(socket);
+    
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    if (role == NoiseRole::INITIATOR) {
+        auto it = dialled_sockets_.find(socket);
+        if (it == dialled_sockets_.end() || it->second.peer_address.empty()) {
+            return;
+        }
+        
+        KnownPeer& peer = known_peers_[it->second.peer_address];
+        peer.static_key = ticket.remote_static_key;
+        peer.ticket = ticket;
+        peer.has_ticket = true;
+        peer.full_handshake_only = false;
+        peer.last_used = std::chrono::steady_clock::now();
+        trim_known_peers_locked();
+    } else {
+        std::string key(reinterpret_cast<const char*>(ticket.id.data()), ticket.id.size());
+        uint64_t sequence = next_ticket_sequence_++;
+        auto existing = issued_tickets_.find(key);
+        if (existing != issued_tickets_.end()) {
+            issued_ticket_order_.erase(existing->second.sequence);
+        }
+        issued_tickets_[key] = IssuedTicket{ticket, sequence};
+        issued_ticket_order_[sequence] = key;
+        
+        while (issued_tickets_.size() > handshake_config_.max_session_tickets) {
+            auto oldest = issued_ticket_order_.begin();
+            issued_tickets_.erase(oldest->second);
+            issued_ticket_order_.erase(oldest);
+        }
+    }
+    ticket.secret.fill(0);
+}
+
+bool EncryptedSocketManager::take_issued_ticket(const NoiseTicketId& id, NoiseSessionTicket& ticket) {
+    std::lock_guard<std::mutex> lock(credentials_mutex_);
+    if (!handshake_config_.resume_known_peers) {
+        return false;
+    }
+    
+    std::string key(reinterpret_cast<const char*>(id.data()), id.size());
+    auto it = issued_tickets_.find(key);
+    if (it == issued_tickets_.end()) {
+        return false;
+    }
+    
+    // Consumed whether or not it is still valid: a replayed ticket must not resume a second session
+    ticket = it->second.ticket;
+    issued_ticket_order_.erase(it->second.sequence);
+    issued_tickets_.erase(it);
+    
+    if (std::chrono::steady_clock::now() - ticket.issued_at >= handshake_config_.ticket_lifetime) {
+        ticket.secret.fill(0);
+        return false;
+    }
+    return true;
+}
+
+void EncryptedSocketManager::trim_known_peers_locked() {
+    while (known_peers_.size() > handshake_config_.max_session_tickets) {
+        auto oldest = known_peers_.begin();
+        for (auto it = known_peers_.begin(); it != known_peers_.end(); ++it) {
+            if (it->second.last_used < oldest->second.last_used) {
+                oldest = it;
+            }
+        }
+        known_peers_.erase(oldest);
+    }
 }
 
 bool EncryptedSocketManager::send_data(socket_t socket, const std::vector<uint8_t>& data) {
@@ -561,6 +1082,37 @@ bool EncryptedSocketManager::send_data(socket_t socket, const std::vector<uint8_
     }
 }
 
+bool EncryptedSocketManager::send_data_in_place(socket_t socket, uint8_t* data, size_t size) {
+    if (!encryption_enabled_) {
+        return send_tcp_data(socket, std::vector<uint8_t>(data, data + size)) > 0;
+    }
+    
+    if (encrypted_socket_.is_handshake_completed(socket)) {
+        return encrypted_socket_.send_encrypted_data_in_place(socket, data, size);
+    } else {
+        LOG_ENCRYPT_WARN("Attempting to send binary data on socket " << socket << " before handshake completion");
+        return false;
+    }
+}
+
+bool EncryptedSocketManager::receive_messages(socket_t socket, std::vector<std::vector<uint8_t>>& messages) {
+    if (!encryption_enabled_) {
+        auto data = encrypted_socket_.receive_unencrypted_data(socket);
+        if (data.empty()) {
+            return false;
+        }
+        messages.push_back(std::move(data));
+        return true;
+    }
+    
+    if (encrypted_socket_.is_handshake_completed(socket)) {
+        return encrypted_socket_.receive_encrypted_messages(socket, messages);
+    } else {
+        LOG_ENCRYPT_WARN("Attempting to receive binary data on socket " << socket << " before handshake completion");
+        return false;
+    }
+}
+
 bool EncryptedSocketManager::send_data(socket_t socket, const std::string& data) {
     // Convert string to binary and use primary binary method
     std::vector<uint8_t> binary_data(data.begin(), data.end());
@@ -610,48 +1162,12 @@ bool EncryptedSocketManager::perform_handshake_step(socket_t socket, const std::
     try {
         NoiseRole role = encrypted_socket_.get_socket_role(socket);
         
-                if (received_data.empty()) {
-            // For initiators, only send the initial handshake message if we haven't started yet
-            if (role == NoiseRole::INITIATOR) {
-                auto* session = encrypted_socket_.get_session(socket);
-                if (session && session->session->get_handshake_state() == NoiseHandshakeState::WRITE_MESSAGE_1) {
-                    LOG_ENCRYPT_DEBUG("Initiator sending initial handshake message on socket " << socket);
-                    return encrypted_socket_.send_handshake_message(socket);
-                } else {
-                    LOG_ENCRYPT_DEBUG("Initiator waiting for responder message (state: " << static_cast<int>(session ? session->session->get_handshake_state() : NoiseHandshakeState::FAILED) << ")");
-                    // Initiator should wait for responder's message, not keep sending
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                    return !encrypted_socket_.has_handshake_failed(socket);
-                }
-            } else {
-                // For responders, try to receive and process incoming handshake data
-                auto* session = encrypted_socket_.get_session(socket);
-                if (session && session->session->get_handshake_state() == NoiseHandshakeState::READ_MESSAGE_1) {
-                    LOG_ENCRYPT_DEBUG("Responder trying to receive first handshake message on socket " << socket);
-                    auto payload = encrypted_socket_.receive_handshake_message(socket);
-                    
-                    // If we received a handshake message, we need to send a response
-                    if (!payload.empty()) {
-                        LOG_ENCRYPT_DEBUG("Responder received handshake message (" << payload.size() << " bytes) on socket " << socket);
-                        if (!encrypted_socket_.is_handshake_completed(socket)) {
-                            LOG_ENCRYPT_DEBUG("Responder sending handshake response on socket " << socket);
-                            return encrypted_socket_.send_handshake_message(socket);
-                        }
-                    } else {
-                        LOG_ENCRYPT_DEBUG("Responder received empty handshake message on socket " << socket);
-                        if (encrypted_socket_.has_handshake_failed(socket)) {
-                            LOG_ENCRYPT_DEBUG("Handshake failed for socket " << socket);
-                            return false;
-                        }
-                    }
-                } else {
-                    LOG_ENCRYPT_DEBUG("Responder waiting for initiator or already processed initial message (state: " << static_cast<int>(session ? session->session->get_handshake_state() : NoiseHandshakeState::FAILED) << ")");
-                    // Responder should wait for the next message or handshake completion
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                }
-                
-                return !encrypted_socket_.has_handshake_failed(socket);
+        if (received_data.empty()) {
+            bool progressing = encrypted_socket_.perform_handshake_step(socket);
+            if (progressing && encrypted_socket_.is_handshake_completed(socket)) {
+                record_completed_handshake(socket);
             }
+            return progressing;
         } else {
             // Process received handshake message
             auto payload = encrypted_socket_.receive_handshake_message(socket);
@@ -690,10 +1206,33 @@ bool EncryptedSocketManager::has_handshake_failed(socket_t socket) const {
 }
 
 void EncryptedSocketManager::remove_socket(socket_t socket) {
+    bool failed = encrypted_socket_.has_handshake_failed(socket);
+    NoiseHandshakePattern pattern = encrypted_socket_.get_handshake_pattern(socket);
+    {
+        std::lock_guard<std::mutex> lock(credentials_mutex_);
+        auto it = dialled_sockets_.find(socket);
+        if (it != dialled_sockets_.end()) {
+            // An IK / NNpsk0 attempt that failed without the responder switching to XXfallback
+            // reached a peer that only speaks XX: dial it with XX from now on
+            if (failed && it->second.pattern != NoiseHandshakePattern::XX && pattern == it->second.pattern) {
+                auto peer = known_peers_.find(it->second.peer_address);
+                if (peer != known_peers_.end()) {
+                    LOG_ENCRYPT_INFO("Peer " << it->second.peer_address << " rejected the short handshake, using XX for it from now on");
+                    peer->second.full_handshake_only = true;
+                    peer->second.has_ticket = false;
+                }
+            }
+            dialled_sockets_.erase(it);
+        }
+    }
     encrypted_socket_.remove_socket(socket);
 }
 
 void EncryptedSocketManager::cleanup_all_sockets() {
+    {
+        std::lock_guard<std::mutex> lock(credentials_mutex_);
+        dialled_sockets_.clear();
+    }
     encrypted_socket_.clear_all_sockets();
 }
 
@@ -748,6 +1287,20 @@ int send_tcp_data_encrypted(socket_t socket, const std::string& data) {
     return -1;
 }
 
+int send_tcp_data_encrypted_in_place(socket_t socket, std::vector<uint8_t>& data) {
+    auto& manager = EncryptedSocketManager::getInstance();
+    
+    if (manager.send_data_in_place(socket, data.data(), data.size())) {
+        return static_cast<int>(data.size());
+    }
+    return -1;
+}
+
+bool receive_tcp_messages_encrypted(socket_t socket, std::vector<std::vector<uint8_t>>& messages) {
+    auto& manager = EncryptedSocketManager::getInstance();
+    return manager.receive_messages(socket, messages);
+}
+
 std::vector<uint8_t> receive_tcp_data_encrypted(socket_t socket, size_t buffer_size) {
     auto& manager = EncryptedSocketManager::getInstance();
     return manager.receive_data(socket);
@@ -779,6 +1332,27 @@ bool initialize_outgoing_connection(socket_t socket) {
     return success;
 }
 
+bool initialize_outgoing_connection(socket_t socket, const std::string& peer_address) {
+    auto& manager = EncryptedSocketManager::getInstance();
+    
+    if (!manager.is_encryption_enabled()) {
+        return true; // No initialization needed when encryption is disabled
+    }
+    
+    bool success = manager.initialize_socket_for_peer(socket, peer_address);
+    if (success) {
+        LOG_ENCRYPT_INFO("Initialized outgoing encrypted connection to " << peer_address << " for socket " << socket);
+        
+        // Perform initial handshake step
+        success = manager.perform_handshake_step(socket);
+        if (!success) {
+            LOG_ENCRYPT_ERROR("Failed initial handshake step for outgoing connection on socket " << socket);
+        }
+    }
+    
+    return success;
+}
+
 bool initialize_incoming_connection(socket_t socket) {
     auto& manager = EncryptedSocketManager::getInstance();
     
@@ -812,6 +1386,26 @@ void cleanup_socket(socket_t socket) {
     manager.remove_socket(socket);
 }
 
+void remember_peer_static_key(const std::string& peer_address, const NoiseKey& key) {
+    auto& manager = EncryptedSocketManager::getInstance();
+    manager.remember_peer_static_key(peer_address, key);
+}
+
+bool get_peer_static_key(const std::string& peer_address, NoiseKey& key) {
+    auto& manager = EncryptedSocketManager::getInstance();
+    return manager.get_peer_static_key(peer_address, key);
+}
+
+void set_handshake_config(const HandshakeConfig& config) {
+    auto& manager = EncryptedSocketManager::getInstance();
+    manager.set_handshake_config(config);
+}
+
+HandshakeConfig get_handshake_config() {
+    auto& manager = EncryptedSocketManager::getInstance();
+    return manager.get_handshake_config();
+}
+
 } // namespace encrypted_communication
 
 } // namespace librats 
\ No newline at end of file
@@ -6,10 +6,92 @@
 #include <memory>
 #include <vector>
 #include <mutex>
+#include <map>
 #include <unordered_map>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
 
 namespace librats {
 
+/**
+ * Handshake settings: shortcuts for peers seen before and handshake offload
+ */
+struct HandshakeConfig {
+    bool resume_known_peers;                // Dial known peers with IK, or resume with a session ticket (NNpsk0)
+    size_t max_session_tickets;             // Tickets (and known peer keys) kept, oldest dropped first
+    std::chrono::seconds ticket_lifetime;   // Static keys are proven again with a full handshake after this
+    size_t worker_threads;                  // Threads running incoming handshake steps (0 = on the I/O thread)
+    size_t max_pending_handshakes;          // Queued handshake steps before new connections are refused
+    
+    HandshakeConfig()
+        : resume_known_peers(true),
+          max_session_tickets(4096),
+          ticket_lifetime(std::chrono::hours(1)),
+          worker_threads(2),
+          max_pending_handshakes(256) {}
+};
+
+/**
+ * Bounded pool of threads running handshake steps, so the DH operations of a
+ * reconnect storm do not stall the I/O threads. Admission control: submit()
+ * refuses work once max_pending jobs are queued, and callers drop the connection
+ * rather than queue a handshake that would time out anyway.
+ */
+class HandshakeWorkerPool {
+public:
+    explicit HandshakeWorkerPool(const std::string& name);
+    ~HandshakeWorkerPool();
+    
+    HandshakeWorkerPool(const HandshakeWorkerPool&) = delete;
+    HandshakeWorkerPool& operator=(const HandshakeWorkerPool&) = delete;
+    
+    /**
+     * Start the worker threads
+     * @param thread_count Number of threads (at least 1)
+     * @param max_pending Jobs that may wait for a thread (at least 1)
+     * @return true if started (or already running)
+     */
+    bool start(size_t thread_count, size_t max_pending);
+    
+    /**
+     * Stop the worker threads. Running jobs finish, queued jobs are dropped.
+     */
+    void stop();
+    
+    bool is_running() const;
+    
+    /**
+     * Queue a job
+     * @param job Job to run on a worker thread
+     * @return false if the queue is full or the pool is not running
+     */
+    bool submit(std::function<void()> job);
+    
+    /**
+     * Check whether new work would be refused
+     * @return true if max_pending jobs are queued
+     */
+    bool is_saturated() const;
+    
+    size_t get_pending_count() const;
+    
+private:
+    void worker_loop();
+    
+    std::string name_;
+    std::atomic<bool> running_;
+    size_t max_pending_;
+    
+    mutable std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> threads_;
+};
+
 /**
  * Encrypted socket wrapper that provides Noise Protocol encryption
  * for all socket communications in librats
@@ -21,7 +103,12 @@ public:
     
     // Initialize encryption for a socket
     bool initialize_as_initiator(socket_t socket, const NoiseKey& static_private_key);
-    bool initialize_as_responder(socket_t socket, const NoiseKey& static_private_key);
+    bool initialize_as_responder(socket_t socket, const NoiseKey& static_private_key,
+                                 NoiseHandshake::TicketLookup ticket_lookup = nullptr);
+    
+    // Initialize an initiator for a known peer: IK with its static key, or NNpsk0 with a session ticket
+    bool initialize_as_initiator(socket_t socket, const NoiseKey& static_private_key, const NoiseKey& remote_static_key);
+    bool initialize_as_resuming_initiator(socket_t socket, const NoiseKey& static_private_key, const NoiseSessionTicket& ticket);
     
     // Check encryption status
     bool is_encrypted(socket_t socket) const;
@@ -32,10 +119,37 @@ public:
     bool send_handshake_message(socket_t socket, const std::vector<uint8_t>& payload = {});
     std::vector<uint8_t> receive_handshake_message(socket_t socket);
     
+    /**
+     * Run the next handshake step: send our message if it is our turn, otherwise read
+     * the peer's message (the socket must be readable) and answer it. Steps of different
+     * sockets do not serialize on each other, so they can run on several threads.
+     * @param socket The socket handle
+     * @return false if the handshake failed or the connection was closed
+     */
+    bool perform_handshake_step(socket_t socket);
+    
     // Encrypted communication (available after handshake completion) - binary primary
     bool send_encrypted_data(socket_t socket, const std::vector<uint8_t>& data);
     std::vector<uint8_t> receive_encrypted_data(socket_t socket);
     
+    /**
+     * Encrypt a buffer in place and send it as one transport frame
+     * @param socket The socket handle
+     * @param data Plaintext, overwritten with the ciphertext
+     * @param size Data size
+     * @return true if sent, false otherwise
+     */
+    bool send_encrypted_data_in_place(socket_t socket, uint8_t* data, size_t size);
+    
+    /**
+     * Receive available data once and decrypt every complete transport frame.
+     * Partial frames are kept until the rest arrives.
+     * @param socket The socket handle
+     * @param messages Output vector receiving the decrypted messages
+     * @return false if the connection was closed or a frame failed to authenticate
+     */
+    bool receive_encrypted_messages(socket_t socket, std::vector<std::vector<uint8_t>>& messages);
+    
     // Encrypted communication - string convenience wrappers
     bool send_encrypted_data(socket_t socket, const std::string& data);
     std::string receive_encrypted_data_string(socket_t socket);
@@ -60,6 +174,8 @@ public:
     // Utility functions
     NoiseRole get_socket_role(socket_t socket) const;
     const NoiseKey& get_remote_static_key(socket_t socket) const;
+    NoiseHandshakePattern get_handshake_pattern(socket_t socket) const;
+    bool get_session_ticket(socket_t socket, NoiseSessionTicket& ticket) const;
     
 private:
     struct SocketSession {
@@ -67,12 +183,23 @@ private:
         socket_t socket;
         bool is_encrypted;
         
-        SocketSession(socket_t sock) : socket(sock), is_encrypted(false) {
+        // Handshake steps run under handshake_mutex rather than sessions_mutex_; the flags
+        // publish their outcome to readers that do not take it
+        std::mutex handshake_mutex;
+        std::atomic<bool> handshake_completed;
+        std::atomic<bool> handshake_failed;
+        
+        // Transport traffic runs outside sessions_mutex_ so connections do not serialize on each other
+        std::mutex send_mutex;                  // Keeps nonces in the order frames hit the wire
+        std::mutex receive_mutex;
+        std::vector<uint8_t> receive_buffer;    // Bytes of pending partial transport frames
+        
+        SocketSession(socket_t sock) : socket(sock), is_encrypted(false), handshake_completed(false), handshake_failed(false) {
             session = std::make_unique<NoiseSession>();
         }
     };
     
-    std::unordered_map<socket_t, std::unique_ptr<SocketSession>> sessions_;
+    std::unordered_map<socket_t, std::shared_ptr<SocketSession>> sessions_;
     mutable std::mutex sessions_mutex_;
     
 public:
@@ -81,6 +208,24 @@ public:
     const SocketSession* get_session(socket_t socket) const;
 
 private:
+    // Register an initialized session for a socket
+    void add_session(socket_t socket, std::shared_ptr<SocketSession> session, const char* role);
+    
+    // Look up a session (takes sessions_mutex_)
+    std::shared_ptr<SocketSession> find_session(socket_t socket) const;
+    
+    // Look up a session whose handshake is completed (takes sessions_mutex_)
+    std::shared_ptr<SocketSession> get_transport_session(socket_t socket) const;
+    
+    // Handshake steps; the caller holds the session's handshake_mutex
+    bool send_handshake_message_locked(SocketSession& session, const std::vector<uint8_t>& payload);
+    std::vector<uint8_t> receive_handshake_message_locked(SocketSession& session);
+    static void publish_handshake_state(SocketSession& session);
+    
+    // Decrypt the transport frame at offset in the session receive buffer.
+    // Returns 1 if a message was produced, 0 if the frame is incomplete, -1 on a malformed or forged frame
+    static int decrypt_buffered_frame(SocketSession& session, size_t& offset, std::vector<uint8_t>& message);
+    static void compact_receive_buffer(SocketSession& session, size_t consumed);
     
     // Helper to read exact number of bytes from socket
     std::string receive_exact_bytes(socket_t socket, size_t byte_count);
@@ -102,10 +247,28 @@ public:
     bool initialize_socket_as_initiator(socket_t socket, const NoiseKey& static_private_key);
     bool initialize_socket_as_responder(socket_t socket, const NoiseKey& static_private_key);
     
+    /**
+     * Initialize an outgoing connection with the cheapest handshake the dialled address allows:
+     * NNpsk0 with a session ticket from the last connection, IK with its remembered static key,
+     * or XX for unknown peers
+     * @param socket The socket handle
+     * @param peer_address Dialled address (ip:port) the credentials are kept under
+     * @return true if initialized
+     */
+    bool initialize_socket_for_peer(socket_t socket, const std::string& peer_address);
+    
+    // Known peers (static keys remembered by dialled address)
+    void remember_peer_static_key(const std::string& peer_address, const NoiseKey& key);
+    bool get_peer_static_key(const std::string& peer_address, NoiseKey& key) const;
+    size_t get_issued_ticket_count() const;
+    
     // Communication methods (binary - primary)
     bool send_data(socket_t socket, const std::vector<uint8_t>& data);
     std::vector<uint8_t> receive_data(socket_t socket);
     
+    bool send_data_in_place(socket_t socket, uint8_t* data, size_t size);
+    bool receive_messages(socket_t socket, std::vector<std::vector<uint8_t>>& messages);
+    
     // Communication methods (string - convenience wrappers)
     bool send_data(socket_t socket, const std::string& data);
     std::string receive_data_string(socket_t socket);
@@ -119,13 +282,15 @@ public:
     void remove_socket(socket_t socket);
     void cleanup_all_sockets();
     
-    // Key management
-    void set_static_key(const NoiseKey& key) { static_key_ = key; }
+    // Key management (a new key invalidates all session tickets)
+    void set_static_key(const NoiseKey& key);
     const NoiseKey& get_static_key() const { return static_key_; }
     
     // Configuration
     void set_encryption_enabled(bool enabled) { encryption_enabled_ = enabled; }
     bool is_encryption_enabled() const { return encryption_enabled_; }
+    void set_handshake_config(const HandshakeConfig& config);
+    HandshakeConfig get_handshake_config() const;
     
 private:
     EncryptedSocketManager();
@@ -135,10 +300,42 @@ private:
     EncryptedSocketManager(const EncryptedSocketManager&) = delete;
     EncryptedSocketManager& operator=(const EncryptedSocketManager&) = delete;
     
+    // Credentials of a dialled address
+    struct KnownPeer {
+        NoiseKey static_key;
+        bool has_ticket;
+        NoiseSessionTicket ticket;
+        bool full_handshake_only;               // Failed an IK / NNpsk0 handshake (peer without support)
+        std::chrono::steady_clock::time_point last_used;
+    };
+    
+    // Outgoing handshake of a socket
+    struct DialledSocket {
+        std::string peer_address;
+        NoiseHandshakePattern pattern;          // Pattern the handshake started with
+    };
+    
+    struct IssuedTicket {
+        NoiseSessionTicket ticket;
+        uint64_t sequence;                      // Position in issued_ticket_order_
+    };
+    
+    void record_completed_handshake(socket_t socket);
+    bool take_issued_ticket(const NoiseTicketId& id, NoiseSessionTicket& ticket);
+    void trim_known_peers_locked();
+    
     EncryptedSocket encrypted_socket_;
     NoiseKey static_key_;
     bool encryption_enabled_;
     mutable std::mutex key_mutex_;
+    
+    mutable std::mutex credentials_mutex_;      // Protects the members below (leaf lock)
+    HandshakeConfig handshake_config_;
+    std::unordered_map<std::string, KnownPeer> known_peers_;
+    std::unordered_map<socket_t, DialledSocket> dialled_sockets_;
+    std::unordered_map<std::string, IssuedTicket> issued_tickets_;      // Tickets we issued, by ID
+    std::map<uint64_t, std::string> issued_ticket_order_;              // Oldest first, for eviction
+    uint64_t next_ticket_sequence_;
 };
 
 // High-level encrypted communication functions that replace the standard socket functions
@@ -185,6 +382,22 @@ namespace encrypted_communication {
      */
     int send_tcp_data_encrypted(socket_t socket, const std::string& data);
     
+    /**
+     * Encrypt binary data in place and send it through an encrypted socket
+     * @param socket The socket handle
+     * @param data The binary data to send, overwritten with the ciphertext
+     * @return Number of plaintext bytes sent, or -1 on error
+     */
+    int send_tcp_data_encrypted_in_place(socket_t socket, std::vector<uint8_t>& data);
+    
+    /**
+     * Receive every complete message available on an encrypted socket (one receive call)
+     * @param socket The socket handle
+     * @param messages Output vector receiving the decrypted messages
+     * @return false if the connection was closed or a message failed to decrypt
+     */
+    bool receive_tcp_messages_encrypted(socket_t socket, std::vector<std::vector<uint8_t>>& messages);
+    
     /**
      * Receive binary data from an encrypted socket (primary method)
      * @param socket The socket handle
@@ -208,6 +421,15 @@ namespace encrypted_communication {
      */
     bool initialize_outgoing_connection(socket_t socket);
     
+    /**
+     * Initialize encryption for an outgoing connection to a known address, so peers
+     * seen before are resumed or dialled with IK instead of a full XX handshake
+     * @param socket The socket handle for the outgoing connection
+     * @param peer_address Dialled address (ip:port)
+     * @return true if successful, false otherwise
+     */
+    bool initialize_outgoing_connection(socket_t socket, const std::string& peer_address);
+    
     /**
      * Initialize encryption for an incoming connection
      * @param socket The socket handle for the incoming connection
@@ -234,6 +456,34 @@ namespace encrypted_communication {
      * @param socket The socket handle
      */
     void cleanup_socket(socket_t socket);
+    
+    /**
+     * Remember the static key of a peer address (e.g. from persisted peer info),
+     * so the next connection to it can use the IK handshake
+     * @param peer_address Peer address (ip:port)
+     * @param key Peer's static public key
+     */
+    void remember_peer_static_key(const std::string& peer_address, const NoiseKey& key);
+    
+    /**
+     * Get the static key remembered for a peer address
+     * @param peer_address Peer address (ip:port)
+     * @param key Receives the peer's static public key
+     * @return true if a key is known
+     */
+    bool get_peer_static_key(const std::string& peer_address, NoiseKey& key);
+    
+    /**
+     * Set the handshake settings (applies to all connections)
+     * @param config Handshake settings
+     */
+    void set_handshake_config(const HandshakeConfig& config);
+    
+    /**
+     * Get the handshake settings
+     * @return Handshake settings
+     */
+    HandshakeConfig get_handshake_config();
 }
 
 } // namespace librats 
\ No newline at end of file
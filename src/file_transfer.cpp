@@ -3,6 +3,10 @@
 #include "fs.h"
 #include "logger.h"
 #include "sha1.h"
+#include "sha256.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "buffer_pool.h"
 
 // Define logging module for this file
 #define LOG_FILE_TRANSFER_INFO(message) LOG_INFO("filetransfer", message)
@@ -10,20 +14,15 @@
 #define LOG_FILE_TRANSFER_WARN(message) LOG_WARN("filetransfer", message)
 #define LOG_FILE_TRANSFER_DEBUG(message) LOG_DEBUG("filetransfer", message)
 #include <algorithm>
+#include <set>
+#include <map>
+#include <deque>
 #include <random>
 #include <iomanip>
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
-
-// Optional compression support
-#ifdef LIBRATS_ENABLE_ZLIB
-#include <zlib.h>
-#endif
-
-#ifdef LIBRATS_ENABLE_LZ4
-#include <lz4.h>
-#endif
+#include <cmath>
 
 namespace librats {
 
@@ -91,14 +90,468 @@ void FileTransferProgress::update_transfer_rates(uint64_t new_bytes_transferred)
     last_update = now;
 }
 
+//=============================================================================
+// ChunkFrameHeader Implementation
+//=============================================================================
+
+namespace {
+
+const uint8_t CHUNK_FRAME_MAGIC[4] = {'F', 'T', 'C', 'K'};
+
+// Disk I/O of chunks over all transfers in the process
+struct ChunkIoMetrics {
+    MetricHistogram& read_seconds;
+    MetricHistogram& write_seconds;
+    MetricCounter& read_bytes;
+    MetricCounter& write_bytes;
+};
+
+ChunkIoMetrics& chunk_io_metrics() {
+    static MetricsRegistry& registry = MetricsRegistry::getInstance();
+    static ChunkIoMetrics metrics{
+        registry.histogram("librats_file_chunk_read_seconds", "Time to read a chunk from disk for sending"),
+        registry.histogram("librats_file_chunk_write_seconds", "Time to write a received chunk to its temporary file"),
+        registry.counter("librats_file_chunk_read_bytes_total", "Chunk bytes read from disk for sending"),
+        registry.counter("librats_file_chunk_write_bytes_total", "Received chunk bytes written to disk")
+    };
+    return metrics;
+}
+
+void store_be64(uint8_t* out, uint64_t value) {
+    for (int i = 7; i >= 0; --i) {
+        out[7 - i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+uint64_t load_be64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+void store_be32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t load_be32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | static_cast<uint32_t>(in[3]);
+}
+
+// A chunk of a send: its range, and once prepared the frame to send
+struct PreparedChunk {
+    uint64_t index = 0;
+    uint64_t offset = 0;                // File offset of the data
+    uint32_t size = 0;                  // Data bytes
+    uint64_t total_chunks = 0;          // Chunk count announced in the frame
+    std::vector<uint8_t> frame;         // Raw frame
+    std::vector<uint8_t> compressed;    // Compressed frame, empty to send the raw one
+    bool read = false;
+};
+
+// Reads and compresses the chunks after the one being sent on the client's task
+// pool, so compressing a transfer is not limited to the thread that sends it.
+// The sending thread carves up to depth chunks ahead and takes them in carving
+// order; jobs the pool refuses run on the taking thread.
+class ChunkPrefetcher {
+public:
+    using CarveFunction = std::function<bool(PreparedChunk& chunk)>;
+    using PrepareFunction = std::function<void(PreparedChunk& chunk)>;
+    
+    ChunkPrefetcher(RatsClient& client, size_t depth, CarveFunction carve, PrepareFunction prepare)
+        : client_(client), depth_((std::max)(depth, static_cast<size_t>(1))),
+          carve_(std::move(carve)), prepare_(std::move(prepare)), running_jobs_(0) {}
+    
+    // Outstanding jobs reference the sender's state, so wait for them
+    ~ChunkPrefetcher() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_condition_.wait(lock, [this] { return running_jobs_ == 0; });
+    }
+    
+    // Next chunk in carving order, nullptr once every chunk has been taken
+    std::shared_ptr<PreparedChunk> take_next() {
+        while (queued_.size() < depth_) {
+            auto job = std::make_shared<Job>();
+            if (!carve_(job->chunk)) {
+                break;
+            }
+            queued_.push_back(job);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_jobs_++;
+            }
+            auto run = [this, job]() {
+                prepare_(job->chunk);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    job->ready = true;
+                    running_jobs_--;
+                }
+                done_condition_.notify_all();
+            };
+            if (!client_.submit_task(run, "prepare_chunk")) {
+                run();
+            }
+        }
+        if (queued_.empty()) {
+            return nullptr;
+        }
+        
+        auto job = std::move(queued_.front());
+        queued_.pop_front();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_condition_.wait(lock, [&] { return job->ready; });
+        return std::shared_ptr<PreparedChunk>(job, &job->chunk);
+    }
+    
+private:
+    struct Job {
+        PreparedChunk chunk;
+        bool ready = false;
+    };
+    
+    RatsClient& client_;
+    size_t depth_;
+    CarveFunction carve_;
+    PrepareFunction prepare_;
+    std::deque<std::shared_ptr<Job>> queued_;   // Sending thread only
+    std::mutex mutex_;
+    std::condition_variable done_condition_;
+    size_t running_jobs_;
+};
+
+// Give received chunk frames (message header + chunk header + data) an exact pool size class
+void reserve_chunk_frame_size_class(uint32_t chunk_size) {
+    BufferPool::getInstance().reserve_size_class(MessageHeader::HEADER_SIZE + ChunkFrameHeader::SIZE + chunk_size);
+}
+
+} // namespace
+
+ChunkFrameHeader::ChunkFrameHeader()
+    : transfer_id_hash(0), chunk_index(0), total_chunks(0), file_offset(0),
+      chunk_size(0), has_checksum(false), codec(CompressionType::NONE) {
+    std::memset(checksum, 0, sizeof(checksum));
+}
+
+void ChunkFrameHeader::encode(uint8_t* out) const {
+    std::memcpy(out, CHUNK_FRAME_MAGIC, sizeof(CHUNK_FRAME_MAGIC));
+    out[4] = VERSION;
+    out[5] = has_checksum ? FLAG_HAS_CHECKSUM : 0;
+    out[6] = static_cast<uint8_t>(codec);
+    out[7] = 0;
+    store_be64(out + 8, transfer_id_hash);
+    store_be64(out + 16, chunk_index);
+    store_be64(out + 24, total_chunks);
+    store_be64(out + 32, file_offset);
+    out[40] = static_cast<uint8_t>(chunk_size >> 24);
+    out[41] = static_cast<uint8_t>(chunk_size >> 16);
+    out[42] = static_cast<uint8_t>(chunk_size >> 8);
+    out[43] = static_cast<uint8_t>(chunk_size);
+    std::memcpy(out + 44, checksum, CHECKSUM_SIZE);
+}
+
+bool ChunkFrameHeader::decode(const uint8_t* data, size_t size, ChunkFrameHeader& header) {
+    if (!is_chunk_frame(data, size) || size < SIZE || data[4] != VERSION) {
+        return false;
+    }
+    
+    header.has_checksum = (data[5] & FLAG_HAS_CHECKSUM) != 0;
+    header.codec = static_cast<CompressionType>(data[6]);
+    header.transfer_id_hash = load_be64(data + 8);
+    header.chunk_index = load_be64(data + 16);
+    header.total_chunks = load_be64(data + 24);
+    header.file_offset = load_be64(data + 32);
+    header.chunk_size = (static_cast<uint32_t>(data[40]) << 24) | (static_cast<uint32_t>(data[41]) << 16) |
+                        (static_cast<uint32_t>(data[42]) << 8) | static_cast<uint32_t>(data[43]);
+    std::memcpy(header.checksum, data + 44, CHECKSUM_SIZE);
+    
+    return size - SIZE == header.chunk_size;
+}
+
+bool ChunkFrameHeader::is_chunk_frame(const uint8_t* data, size_t size) {
+    return data && size >= sizeof(CHUNK_FRAME_MAGIC) &&
+           std::memcmp(data, CHUNK_FRAME_MAGIC, sizeof(CHUNK_FRAME_MAGIC)) == 0;
+}
+
+uint64_t ChunkFrameHeader::hash_transfer_id(const std::string& transfer_id) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : transfer_id) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//=============================================================================
+// ChunkSendWindow Implementation
+//=============================================================================
+
+ChunkSendWindow::ChunkSendWindow(uint32_t initial_window, uint32_t max_window)
+    : window_((std::max)(1u, initial_window)),
+      slow_start_threshold_((std::max)(1u, max_window)),
+      max_window_((std::max)((std::max)(1u, initial_window), max_window)),
+      smoothed_rtt_ms_(0.0), rtt_variance_ms_(0.0),
+      has_rtt_sample_(false), closed_(false), ack_count_(0),
+      total_bytes_(0), delivered_bytes_(0), loss_events_(0), completion_taken_(false) {
+}
+
+bool ChunkSendWindow::wait_for_slot(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return slot_condition_.wait_for(lock, timeout, [this] {
+        return closed_ || static_cast<double>(in_flight_.size()) < std::floor(window_);
+    }) && !closed_;
+}
+
+void ChunkSendWindow::wait_for_ack(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t ack_count = ack_count_;
+    slot_condition_.wait_for(lock, timeout, [this, ack_count] { return closed_ || ack_count_ != ack_count; });
+}
+
+void ChunkSendWindow::on_chunk_sent(uint64_t chunk_index, bool retransmission, uint32_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_[chunk_index] = InFlightChunk{std::chrono::steady_clock::now(), retransmission};
+    if (bytes > 0) {
+        unacked_bytes_[chunk_index] = bytes;
+    }
+}
+
+bool ChunkSendWindow::on_chunk_ack(uint64_t chunk_index, bool success) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (success) {
+            auto unacked = unacked_bytes_.find(chunk_index);
+            if (unacked != unacked_bytes_.end()) {
+                delivered_bytes_ += unacked->second;
+                unacked_bytes_.erase(unacked);
+            }
+        }
+        
+        auto it = in_flight_.find(chunk_index);
+        if (it == in_flight_.end()) {
+            return false;
+        }
+        
+        ++ack_count_;
+        auto now = std::chrono::steady_clock::now();
+        if (!it->second.retransmission) {
+            add_rtt_sample_locked(std::chrono::duration<double, std::milli>(now - it->second.sent_at).count());
+        }
+        in_flight_.erase(it);
+        
+        if (success) {
+            if (window_ < slow_start_threshold_) {
+                window_ += 1.0;                 // Slow start
+            } else {
+                window_ += 1.0 / window_;       // Congestion avoidance
+            }
+            window_ = (std::min)(window_, max_window_);
+        } else {
+            retransmissions_.push(chunk_index);
+            decrease_window_locked(now);
+        }
+    }
+    slot_condition_.notify_all();
+    return true;
+}
+
+size_t ChunkSendWindow::expire_timed_out_chunks() {
+    size_t expired = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        auto timeout = retransmission_timeout_locked();
+        for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+            if (now - it->second.sent_at >= timeout) {
+                it = in_flight_.erase(it);
+                ++expired;
+            } else {
+                ++it;
+            }
+        }
+        if (expired > 0) {
+            decrease_window_locked(now);
+        }
+    }
+    if (expired > 0) {
+        slot_condition_.notify_all();
+    }
+    return expired;
+}
+
+bool ChunkSendWindow::pop_retransmission(uint64_t& chunk_index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (retransmissions_.empty()) {
+        return false;
+    }
+    chunk_index = retransmissions_.front();
+    retransmissions_.pop();
+    return true;
+}
+
+void ChunkSendWindow::set_total_bytes(uint64_t total_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    total_bytes_ = total_bytes;
+}
+
+bool ChunkSendWindow::take_completion() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completion_taken_ || total_bytes_ == 0 || delivered_bytes_ < total_bytes_) {
+        return false;
+    }
+    completion_taken_ = true;
+    return true;
+}
+
+void ChunkSendWindow::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    slot_condition_.notify_all();
+}
+
+bool ChunkSendWindow::is_closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+bool ChunkSendWindow::is_idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_.empty() && retransmissions_.empty();
+}
+
+uint32_t ChunkSendWindow::get_window() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<uint32_t>(window_);
+}
+
+size_t ChunkSendWindow::get_in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_.size();
+}
+
+double ChunkSendWindow::get_smoothed_rtt_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return smoothed_rtt_ms_;
+}
+
+std::chrono::milliseconds ChunkSendWindow::get_retransmission_timeout() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retransmission_timeout_locked();
+}
+
+uint64_t ChunkSendWindow::get_delivered_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return delivered_bytes_;
+}
+
+uint64_t ChunkSendWindow::get_loss_events() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loss_events_;
+}
+
+void ChunkSendWindow::decrease_window_locked(std::chrono::steady_clock::time_point now) {
+    // Several losses within one round trip count as a single congestion event
+    auto round_trip = std::chrono::duration<double, std::milli>(smoothed_rtt_ms_);
+    if (has_rtt_sample_ && last_decrease_.time_since_epoch().count() != 0 &&
+        now - last_decrease_ < round_trip) {
+        return;
+    }
+    window_ = (std::max)(1.0, window_ / 2.0);
+    slow_start_threshold_ = (std::max)(2.0, window_);
+    last_decrease_ = now;
+    ++loss_events_;
+}
+
+void ChunkSendWindow::add_rtt_sample_locked(double rtt_ms) {
+    // RFC 6298 smoothing
+    if (!has_rtt_sample_) {
+        smoothed_rtt_ms_ = rtt_ms;
+        rtt_variance_ms_ = rtt_ms / 2.0;
+        has_rtt_sample_ = true;
+    } else {
+        rtt_variance_ms_ = 0.75 * rtt_variance_ms_ + 0.25 * std::fabs(smoothed_rtt_ms_ - rtt_ms);
+        smoothed_rtt_ms_ = 0.875 * smoothed_rtt_ms_ + 0.125 * rtt_ms;
+    }
+}
+
+std::chrono::milliseconds ChunkSendWindow::retransmission_timeout_locked() const {
+    if (!has_rtt_sample_) {
+        return std::chrono::milliseconds(1000);
+    }
+    double timeout_ms = smoothed_rtt_ms_ + (std::max)(10.0, 4.0 * rtt_variance_ms_);
+    timeout_ms = (std::min)((std::max)(timeout_ms, 200.0), 60000.0);
+    return std::chrono::milliseconds(static_cast<int64_t>(timeout_ms));
+}
+
+//=============================================================================
+// ChunkSizer Implementation
+//=============================================================================
+
+ChunkSizer::ChunkSizer(uint32_t initial_size, uint32_t min_size, uint32_t max_size)
+    : min_size_((std::max)(min_size, 1u)), max_size_((std::max)((std::max)(min_size, 1u), max_size)),
+      delivery_rate_bps_(0.0), started_(false), interval_bytes_(0), loss_events_(0) {
+    size_ = clamp_size(initial_size);
+}
+
+uint32_t ChunkSizer::update(uint64_t delivered_bytes, uint64_t loss_events, double smoothed_rtt_ms,
+                            std::chrono::steady_clock::time_point now) {
+    if (!started_ || loss_events > loss_events_) {
+        // A loss also discards the rate measured before it, so only a fresh
+        // measurement can grow the chunks again
+        if (started_) {
+            size_ = clamp_size(size_ / 2.0);
+            delivery_rate_bps_ = 0.0;
+        }
+        started_ = true;
+        loss_events_ = loss_events;
+        interval_bytes_ = delivered_bytes;
+        interval_start_ = now;
+        return size_;
+    }
+    
+    // Measure the delivery rate over at least one round trip
+    double elapsed_ms = std::chrono::duration<double, std::milli>(now - interval_start_).count();
+    if (elapsed_ms < (std::max)(smoothed_rtt_ms, MIN_INTERVAL_MS) || delivered_bytes <= interval_bytes_) {
+        return size_;
+    }
+    double rate = static_cast<double>(delivered_bytes - interval_bytes_) * 1000.0 / elapsed_ms;
+    delivery_rate_bps_ = delivery_rate_bps_ > 0.0 ? 0.75 * delivery_rate_bps_ + 0.25 * rate : rate;
+    interval_bytes_ = delivered_bytes;
+    interval_start_ = now;
+    
+    double target = delivery_rate_bps_ * TARGET_CHUNK_MS / 1000.0;
+    if (target > size_) {
+        size_ = clamp_size((std::min)(target, size_ * 2.0));
+    }
+    return size_;
+}
+
+uint32_t ChunkSizer::clamp_size(double size) const {
+    const uint32_t page = 4096;
+    uint64_t rounded = static_cast<uint64_t>(size) / page * page;
+    return static_cast<uint32_t>((std::min)((std::max)(rounded, static_cast<uint64_t>(min_size_)),
+                                            static_cast<uint64_t>(max_size_)));
+}
+
 //=============================================================================
 // FileTransferManager Implementation
 //=============================================================================
 
 FileTransferManager::FileTransferManager(RatsClient& client, const FileTransferConfig& config)
-    : client_(client), config_(config), running_(true),
+    : client_(client), config_(config),
+      history_max_transfers_(FILE_TRANSFER_MAX_HISTORY),
+      history_lifetime_(std::chrono::duration_cast<std::chrono::seconds>(FILE_TRANSFER_HISTORY_LIFETIME)),
+      history_evictions_(0), running_(true),
       total_bytes_sent_(0), total_bytes_received_(0),
-      total_files_sent_(0), total_files_received_(0) {
+      total_files_sent_(0), total_files_received_(0),
+      compressed_chunks_sent_(0), compression_bytes_saved_(0) {
     
     start_time_ = std::chrono::steady_clock::now();
     initialize();
@@ -111,6 +564,7 @@ FileTransferManager::~FileTransferManager() {
 void FileTransferManager::initialize() {
     // Ensure temp directory exists
     create_directories(config_.temp_directory.c_str());
+    reserve_chunk_frame_size_class(config_.chunk_size);
     
     // Register message handlers with RatsClient
     client_.on("file_transfer_request", [this](const std::string& peer_id, const nlohmann::json& data) {
@@ -121,12 +575,8 @@ void FileTransferManager::initialize() {
         handle_transfer_response(peer_id, data);
     });
     
-    client_.on("file_chunk_metadata", [this](const std::string& peer_id, const nlohmann::json& data) {
-        handle_chunk_metadata_message(peer_id, data);
-    });
-    
-    // Note: Binary chunk data will be handled through the global binary_data_callback_
-    // The FileTransferManager will check for file chunk magic headers in the callback
+    // Note: Binary chunk frames are handled through handle_binary_data, which RatsClient
+    // calls for every binary message before the user's binary data callback
     
     client_.on("file_chunk_ack", [this](const std::string& peer_id, const nlohmann::json& data) {
         handle_chunk_ack_message(peer_id, data);
@@ -144,14 +594,15 @@ void FileTransferManager::initialize() {
         handle_directory_request(peer_id, data);
     });
     
+    client_.on("file_range_request", [this](const std::string& peer_id, const nlohmann::json& data) {
+        handle_range_request(peer_id, data);
+    });
+    
     // Start worker threads
     for (uint32_t i = 0; i < config_.max_concurrent_chunks; ++i) {
         worker_threads_.emplace_back(&FileTransferManager::worker_thread_loop, this);
     }
     
-    // Start cleanup thread for pending chunks timeout
-    worker_threads_.emplace_back(&FileTransferManager::cleanup_thread_loop, this);
-    
     LOG_FILE_TRANSFER_INFO("FileTransferManager initialized with " << worker_threads_.size() << " worker threads");
 }
 
@@ -161,8 +612,13 @@ void FileTransferManager::shutdown() {
     
     // Notify all condition variables to wake up waiting threads immediately
     work_condition_.notify_all();
-    cleanup_condition_.notify_all();
-    throttle_condition_.notify_all();
+    swarm_condition_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(send_windows_mutex_);
+        for (auto& entry : send_windows_) {
+            entry.second->close();
+        }
+    }
     
     // Join all worker threads
     for (auto& thread : worker_threads_) {
@@ -172,19 +628,38 @@ void FileTransferManager::shutdown() {
     }
     
     worker_threads_.clear();
+    
+    {
+        std::lock_guard<std::mutex> lock(open_files_mutex_);
+        open_files_.clear();
+    }
     LOG_FILE_TRANSFER_INFO("FileTransferManager stopped");
 }
 
 void FileTransferManager::worker_thread_loop() {
     while (running_.load()) {
         std::unique_lock<std::mutex> lock(work_mutex_);
-        work_condition_.wait(lock, [this] { return !work_queue_.empty() || !running_.load(); });
+        work_condition_.wait(lock, [this] {
+            return !work_queue_.empty() || !range_queue_.empty() || !delta_queue_.empty() || !running_.load();
+        });
         
         if (!running_.load()) {
             break;
         }
         
-        if (!work_queue_.empty()) {
+        if (!range_queue_.empty()) {
+            RangeRequest request = std::move(range_queue_.front());
+            range_queue_.pop();
+            lock.unlock();
+            
+            serve_range_request(request);
+        } else if (!delta_queue_.empty()) {
+            DeltaApply delta = std::move(delta_queue_.front());
+            delta_queue_.pop();
+            lock.unlock();
+            
+            apply_delta(delta.transfer_id, delta.data);
+        } else if (!work_queue_.empty()) {
             std::string transfer_id = work_queue_.front();
             work_queue_.pop();
             lock.unlock();
@@ -194,53 +669,13 @@ void FileTransferManager::worker_thread_loop() {
     }
 }
 
-void FileTransferManager::cleanup_thread_loop() {
-    const auto cleanup_interval = std::chrono::seconds(5);
-    const auto pending_timeout = std::chrono::seconds(30);
-    
-    while (running_.load()) {
-        // Use condition variable with timeout instead of sleep
-        std::unique_lock<std::mutex> lock(cleanup_mutex_);
-        cleanup_condition_.wait_for(lock, cleanup_interval, [this] { return !running_.load(); });
-        
-        if (!running_.load()) {
-            break;
-        }
-        
-        // Clean up expired pending chunks
-        auto now = std::chrono::steady_clock::now();
-        std::vector<std::string> expired_peers;
-        
-        {
-            std::lock_guard<std::mutex> lock(chunks_mutex_);
-            for (auto it = pending_chunks_.begin(); it != pending_chunks_.end();) {
-                if (now - it->second.created_at > pending_timeout) {
-                    LOG_FILE_TRANSFER_WARN("Pending chunk from peer " << it->first << 
-                                          " timed out (transfer: " << it->second.transfer_id << 
-                                          ", chunk: " << it->second.chunk_index << ")");
-                    expired_peers.push_back(it->first);
-                    it = pending_chunks_.erase(it);
-                } else {
-                    ++it;
-                }
-            }
-        }
-        
-        // Send negative acknowledgments for expired chunks
-        for (const auto& peer_id : expired_peers) {
-            // We don't have direct access to the transfer info here, but the timeout logged above
-            // provides sufficient information for debugging
-            LOG_FILE_TRANSFER_DEBUG("Cleaned up " << expired_peers.size() << " expired pending chunks");
-        }
-    }
-}
-
 void FileTransferManager::set_config(const FileTransferConfig& config) {
     std::lock_guard<std::mutex> lock(transfers_mutex_);
     config_ = config;
     
     // Ensure temp directory exists
     create_directories(config_.temp_directory.c_str());
+    reserve_chunk_frame_size_class(config_.chunk_size);
 }
 
 const FileTransferConfig& FileTransferManager::get_config() const {
@@ -248,14 +683,9 @@ const FileTransferConfig& FileTransferManager::get_config() const {
 }
 
 bool FileTransferManager::handle_binary_data(const std::string& peer_id, const std::vector<uint8_t>& binary_data) {
-    // Check if this is a file chunk binary message
-    const std::string magic = "FTCHUNK";
-    
-    if (binary_data.size() >= magic.length() && 
-        std::memcmp(binary_data.data(), magic.c_str(), magic.length()) == 0) {
-        
-        // This is a file transfer chunk - handle it
-        handle_chunk_binary_message(peer_id, binary_data);
+    // Check if this is a file chunk frame
+    if (ChunkFrameHeader::is_chunk_frame(binary_data.data(), binary_data.size())) {
+        handle_chunk_frame(peer_id, binary_data.data(), binary_data.size());
         return true;
     }
     
@@ -263,6 +693,15 @@ bool FileTransferManager::handle_binary_data(const std::string& peer_id, const s
     return false;
 }
 
+bool FileTransferManager::handle_binary_data(const std::string& peer_id, const SharedBuffer& binary_data) {
+    if (ChunkFrameHeader::is_chunk_frame(binary_data.data(), binary_data.size())) {
+        handle_chunk_frame(peer_id, binary_data.data(), binary_data.size());
+        return true;
+    }
+    
+    return false;
+}
+
 void FileTransferManager::set_progress_callback(FileTransferProgressCallback callback) {
     progress_callback_ = callback;
 }
@@ -295,8 +734,8 @@ std::string FileTransferManager::send_file(const std::string& peer_id, const std
         return "";
     }
     
-    // Get file metadata
-    FileMetadata metadata = get_file_metadata(file_path);
+    // Get file metadata, with the Merkle root the receiver checks the chunks against
+    FileMetadata metadata = get_file_metadata(file_path, config_.verify_checksums);
     if (metadata.file_size == 0) {
         LOG_FILE_TRANSFER_ERROR("Failed to get metadata for file: " << file_path);
         return "";
@@ -359,6 +798,7 @@ std::string FileTransferManager::send_directory(const std::string& peer_id, cons
         dir_metadata.directory_name = remote_directory_name;
     }
     
+    auto plan = plan_directory_transfer(dir_metadata);
     std::string transfer_id = generate_transfer_id();
     
     // Create transfer progress tracking for directory
@@ -381,6 +821,7 @@ std::string FileTransferManager::send_directory(const std::string& peer_id, cons
     {
         std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
         active_directory_transfers_[transfer_id] = dir_metadata;
+        directory_plans_[transfer_id] = plan;
     }
     
     // Create directory transfer request message
@@ -395,9 +836,10 @@ std::string FileTransferManager::send_directory(const std::string& peer_id, cons
     dir_metadata_json["total_size"] = dir_metadata.get_total_size();
     dir_metadata_json["total_files"] = dir_metadata.get_total_file_count();
     
-    // Serialize file metadata
+    // Serialize file metadata of the whole tree, each file with its place in the parts
     nlohmann::json files_json = nlohmann::json::array();
-    for (const auto& file_meta : dir_metadata.files) {
+    for (size_t i = 0; i < plan->files.size(); ++i) {
+        const FileMetadata& file_meta = plan->files[i];
         nlohmann::json file_json;
         file_json["filename"] = file_meta.filename;
         file_json["relative_path"] = file_meta.relative_path;
@@ -405,18 +847,34 @@ std::string FileTransferManager::send_directory(const std::string& peer_id, cons
         file_json["last_modified"] = file_meta.last_modified;
         file_json["mime_type"] = file_meta.mime_type;
         file_json["checksum"] = file_meta.checksum;
+        file_json["offset"] = plan->offsets[i];
         files_json.push_back(file_json);
     }
+    nlohmann::json parts_json = nlohmann::json::array();
+    for (size_t part_index = 0; part_index < plan->parts.size(); ++part_index) {
+        const DirectoryPart& part = plan->parts[part_index];
+        for (size_t file_index : part.files) {
+            files_json[file_index]["part"] = part_index;
+        }
+        nlohmann::json part_json;
+        part_json["size"] = part.size;
+        part_json["packed"] = part.packed;
+        parts_json.push_back(part_json);
+    }
     dir_metadata_json["files"] = files_json;
+    dir_metadata_json["parts"] = parts_json;
     
-    // For now, we'll handle single-level directories (can be extended for nested later)
+    // Files carry paths relative to the directory root, so the tree needs no nesting
     dir_metadata_json["subdirectories"] = nlohmann::json::array();
     
     request_msg["directory_metadata"] = dir_metadata_json;
+    request_msg["delta_sync"] = config_.allow_resume && config_.use_delta_sync;
+    request_msg["compression"] = offered_compression();
     
     client_.send(peer_id, "file_transfer_request", request_msg);
     
-    LOG_FILE_TRANSFER_INFO("Initiated directory transfer request: " << transfer_id << " (" << dir_metadata.directory_name << " -> " << peer_id << ")");
+    LOG_FILE_TRANSFER_INFO("Initiated directory transfer request: " << transfer_id << " (" << dir_metadata.directory_name << " -> " << peer_id 
+                           << ", " << plan->files.size() << " files in " << plan->parts.size() << " parts)");
     return transfer_id;
 }
 
@@ -437,6 +895,97 @@ std::string FileTransferManager::request_file(const std::string& peer_id, const
     return transfer_id;
 }
 
+std::string FileTransferManager::request_file_from_swarm(const std::vector<std::string>& peer_ids,
+                                                        const std::string& remote_file_path,
+                                                        const FileMetadata& metadata, const std::string& local_path) {
+    if (peer_ids.empty() || metadata.file_size == 0) {
+        LOG_FILE_TRANSFER_ERROR("Swarm download of " << remote_file_path << " needs source peers and a non-empty file");
+        return "";
+    }
+    
+    std::string transfer_id = generate_transfer_id();
+    
+    // With a Merkle root, chunks are whole leaves so each one is checked on arrival
+    // and a corrupt one is pinned on the source that sent it
+    uint32_t chunk_size = config_.chunk_size;
+    MerkleTree::Hash merkle_root;
+    bool merkle = config_.verify_checksums && metadata.merkle_leaf_size > 0 &&
+                  metadata.merkle_leaf_size <= MAX_MERKLE_LEAF_SIZE && MerkleTree::from_hex(metadata.merkle_root, merkle_root);
+    if (merkle) {
+        chunk_size = metadata.merkle_leaf_size * (std::max)(config_.chunk_size / metadata.merkle_leaf_size, 1u);
+    }
+    
+    auto progress = std::make_shared<FileTransferProgress>();
+    progress->transfer_id = transfer_id;
+    progress->peer_id = peer_ids.front();
+    progress->direction = FileTransferDirection::RECEIVING;
+    progress->status = FileTransferStatus::STARTING;
+    progress->filename = metadata.filename.empty() ? extract_filename(remote_file_path) : metadata.filename;
+    progress->local_path = local_path;
+    progress->file_size = metadata.file_size;
+    progress->total_bytes = metadata.file_size;
+    progress->total_chunks = (metadata.file_size + chunk_size - 1) / chunk_size;
+    
+    // The temp file must exist before the first range request goes out
+    if (!create_temp_file(transfer_id, metadata.file_size)) {
+        return "";
+    }
+    
+    auto swarm = std::make_shared<SwarmDownload>();
+    swarm->remote_path = remote_file_path;
+    swarm->file_size = metadata.file_size;
+    swarm->chunk_size = chunk_size;
+    swarm->wakeup = false;
+    swarm->needs_merkle = merkle;
+    swarm->chunks.assign(progress->total_chunks, SwarmChunkState::MISSING);
+    swarm->next_missing = 0;
+    swarm->rate_window_start = std::chrono::steady_clock::now();
+    for (const auto& peer_id : peer_ids) {
+        bool duplicate = std::any_of(swarm->sources.begin(), swarm->sources.end(),
+                                     [&](const SwarmSource& source) { return source.peer_id == peer_id; });
+        if (duplicate) {
+            continue;
+        }
+        SwarmSource source;
+        source.peer_id = peer_id;
+        source.pipeline_depth = config_.max_concurrent_chunks;
+        source.window_bytes = 0;
+        source.rate_bps = 0.0;
+        source.failures = 0;
+        source.failed = false;
+        source.merkle_requested = false;
+        swarm->sources.push_back(std::move(source));
+    }
+    
+    if (!metadata.checksum.empty()) {
+        std::lock_guard<std::mutex> lock(file_checksums_mutex_);
+        expected_file_checksums_[transfer_id] = metadata.checksum;
+    }
+    if (merkle) {
+        expect_merkle_root(transfer_id, metadata);
+    }
+    {
+        std::lock_guard<std::mutex> lock(swarm_mutex_);
+        swarm_downloads_[transfer_id] = swarm;
+    }
+    {
+        std::lock_guard<std::mutex> transfers_lock(transfers_mutex_);
+        active_transfers_[transfer_id] = progress;
+        receiving_transfer_ids_[ChunkFrameHeader::hash_transfer_id(transfer_id)] = transfer_id;
+    }
+    
+    // A worker thread schedules the range requests until the file is complete
+    {
+        std::lock_guard<std::mutex> work_lock(work_mutex_);
+        work_queue_.push(transfer_id);
+    }
+    work_condition_.notify_one();
+    
+    LOG_FILE_TRANSFER_INFO("Started swarm download: " << transfer_id << " (" << remote_file_path << " from "
+                           << swarm->sources.size() << " peers -> " << local_path << ")");
+    return transfer_id;
+}
+
 std::string FileTransferManager::request_directory(const std::string& peer_id, const std::string& remote_directory_path,
                                                    const std::string& local_directory_path, bool recursive) {
     std::string transfer_id = generate_transfer_id();
@@ -482,11 +1031,23 @@ bool FileTransferManager::accept_file_transfer(const std::string& transfer_id, c
     {
         std::lock_guard<std::mutex> transfers_lock(transfers_mutex_);
         active_transfers_[transfer_id] = progress;
+        receiving_transfer_ids_[ChunkFrameHeader::hash_transfer_id(transfer_id)] = transfer_id;
     }
+    expect_merkle_root(transfer_id, pending_transfer.metadata);
     
-    // Send acceptance response
+    // With an older copy at the destination the response carries its block signatures,
+    // computed by the worker; otherwise accept right away
     nlohmann::json response_msg = create_transfer_response_message(transfer_id, true);
-    client_.send(pending_transfer.peer_id, "file_transfer_response", response_msg);
+    if (pending_transfer.compression != CompressionType::NONE) {
+        response_msg["compression"] = compression_type_name(pending_transfer.compression);
+    }
+    if (pending_transfer.delta_sync && is_delta_candidate(local_path, pending_transfer.metadata.file_size)) {
+        std::lock_guard<std::mutex> delta_lock(delta_mutex_);
+        delta_receives_[transfer_id].basis_path = local_path;
+        delta_acceptances_[transfer_id] = response_msg;
+    } else {
+        client_.send(pending_transfer.peer_id, "file_transfer_response", response_msg);
+    }
     
     // Add to work queue for processing
     {
@@ -543,19 +1104,49 @@ bool FileTransferManager::accept_directory_transfer(const std::string& transfer_
     progress->file_size = progress->total_bytes;
     progress->total_chunks = 0; // Will be calculated per file
     
+    // Register every part before accepting: the sender starts streaming them right away
+    const auto& plan = pending_transfer.plan;
+    {
+        std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
+        active_directory_transfers_[transfer_id] = pending_transfer.metadata;
+        if (plan) {
+            directory_plans_[transfer_id] = plan;
+            for (size_t i = 0; i < plan->parts.size(); ++i) {
+                directory_part_owners_[get_directory_part_id(transfer_id, i)] = std::make_pair(transfer_id, i);
+            }
+        }
+    }
+    
+    bool delta_parts = false;
     {
         std::lock_guard<std::mutex> transfers_lock(transfers_mutex_);
         active_transfers_[transfer_id] = progress;
+        for (size_t i = 0; plan && i < plan->parts.size(); ++i) {
+            // Packs are unpacked from their temp file; a single file lands at its final path
+            const DirectoryPart& part = plan->parts[i];
+            std::string part_path = part.packed ? "" : combine_paths(local_path, plan->files[part.files.front()].relative_path);
+            auto part_progress = create_directory_part_progress(*progress, *plan, i, part_path);
+            active_transfers_[part_progress->transfer_id] = part_progress;
+            receiving_transfer_ids_[ChunkFrameHeader::hash_transfer_id(part_progress->transfer_id)] = part_progress->transfer_id;
+            
+            if (!part.packed && pending_transfer.delta_sync && is_delta_candidate(part_path, part.size)) {
+                std::lock_guard<std::mutex> delta_lock(delta_mutex_);
+                delta_receives_[part_progress->transfer_id].basis_path = part_path;
+                delta_parts = true;
+            }
+        }
     }
     
-    // Send acceptance response
+    // Large files that exist at the destination are signed by the worker before accepting
     nlohmann::json response_msg = create_transfer_response_message(transfer_id, true);
-    client_.send(pending_transfer.peer_id, "file_transfer_response", response_msg);
-    
-    // Store directory metadata for processing
-    {
-        std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
-        active_directory_transfers_[transfer_id] = pending_transfer.metadata;
+    if (pending_transfer.compression != CompressionType::NONE) {
+        response_msg["compression"] = compression_type_name(pending_transfer.compression);
+    }
+    if (delta_parts) {
+        std::lock_guard<std::mutex> delta_lock(delta_mutex_);
+        delta_acceptances_[transfer_id] = response_msg;
+    } else {
+        client_.send(pending_transfer.peer_id, "file_transfer_response", response_msg);
     }
     
     // Add to work queue for processing
@@ -643,15 +1234,27 @@ bool FileTransferManager::resume_transfer(const std::string& transfer_id) {
 }
 
 bool FileTransferManager::cancel_transfer(const std::string& transfer_id) {
-    std::lock_guard<std::mutex> lock(transfers_mutex_);
+    // A part of a directory transfer is cancelled with its directory
+    std::string directory_id;
+    std::shared_ptr<DirectoryTransfer> plan;
+    size_t part_index = 0;
+    if (find_directory_part(transfer_id, directory_id, plan, part_index)) {
+        return cancel_transfer(directory_id);
+    }
     
-    auto it = active_transfers_.find(transfer_id);
-    if (it == active_transfers_.end()) {
-        return false;
+    std::shared_ptr<FileTransferProgress> progress;
+    {
+        std::lock_guard<std::mutex> lock(transfers_mutex_);
+        auto it = active_transfers_.find(transfer_id);
+        if (it == active_transfers_.end()) {
+            return false;
+        }
+        progress = it->second;
+        progress->status = FileTransferStatus::CANCELLED;
     }
     
-    auto& progress = it->second;
-    progress->status = FileTransferStatus::CANCELLED;
+    close_temp_file_handle(transfer_id);
+    close_send_window(transfer_id);
     
     // Send cancel control message
     nlohmann::json control_msg = create_control_message(transfer_id, "cancel");
@@ -659,6 +1262,7 @@ bool FileTransferManager::cancel_transfer(const std::string& transfer_id) {
     
     // Move to completed transfers
     move_to_completed(transfer_id);
+    cancel_directory_parts(transfer_id);
     
     LOG_FILE_TRANSFER_INFO("Cancelled transfer: " << transfer_id);
     return true;
@@ -757,6 +1361,65 @@ void FileTransferManager::clear_transfer_history() {
     LOG_FILE_TRANSFER_INFO("Cleared transfer history");
 }
 
+void FileTransferManager::set_history_limits(size_t max_transfers, std::chrono::seconds lifetime) {
+    std::lock_guard<std::mutex> lock(transfers_mutex_);
+    history_max_transfers_ = (std::max)(max_transfers, size_t(1));
+    history_lifetime_ = lifetime;
+    trim_transfer_history_locked(std::chrono::steady_clock::now());
+}
+
+size_t FileTransferManager::expire_transfer_history() {
+    std::lock_guard<std::mutex> lock(transfers_mutex_);
+    return trim_transfer_history_locked(std::chrono::steady_clock::now());
+}
+
+ResourceUsage FileTransferManager::get_history_usage() const {
+    std::lock_guard<std::mutex> lock(transfers_mutex_);
+    ResourceUsage usage;
+    usage.entries = completed_transfers_.size();
+    usage.max_entries = history_max_transfers_;
+    usage.evictions = history_evictions_;
+    for (const auto& pair : completed_transfers_) {
+        const FileTransferProgress& progress = *pair.second;
+        usage.bytes += sizeof(pair) + 2 * sizeof(void*) + pair.first.capacity() + sizeof(FileTransferProgress) +
+                       progress.transfer_id.capacity() + progress.peer_id.capacity() + progress.filename.capacity() +
+                       progress.local_path.capacity() + progress.error_message.capacity();
+    }
+    return usage;
+}
+
+size_t FileTransferManager::trim_transfer_history_locked(std::chrono::steady_clock::time_point now) {
+    size_t removed = 0;
+    if (history_lifetime_.count() > 0) {
+        for (auto it = completed_transfers_.begin(); it != completed_transfers_.end(); ) {
+            if (now - it->second->last_update > history_lifetime_) {
+                it = completed_transfers_.erase(it);
+                ++removed;
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    if (completed_transfers_.size() > history_max_transfers_) {
+        // Drop the least recently updated transfers that do not fit
+        std::vector<std::pair<std::chrono::steady_clock::time_point, std::string>> by_update;
+        by_update.reserve(completed_transfers_.size());
+        for (const auto& pair : completed_transfers_) {
+            by_update.emplace_back(pair.second->last_update, pair.first);
+        }
+        size_t excess = completed_transfers_.size() - history_max_transfers_;
+        std::nth_element(by_update.begin(), by_update.begin() + (excess - 1), by_update.end());
+        for (size_t i = 0; i < excess; ++i) {
+            completed_transfers_.erase(by_update[i].second);
+        }
+        removed += excess;
+    }
+    
+    history_evictions_ += removed;
+    return removed;
+}
+
 nlohmann::json FileTransferManager::get_transfer_statistics() const {
     std::lock_guard<std::mutex> stats_lock(stats_mutex_);
     std::lock_guard<std::mutex> transfers_lock(transfers_mutex_);
@@ -770,6 +1433,8 @@ nlohmann::json FileTransferManager::get_transfer_statistics() const {
     stats["total_bytes_received"] = total_bytes_received_;
     stats["total_files_sent"] = total_files_sent_;
     stats["total_files_received"] = total_files_received_;
+    stats["compressed_chunks_sent"] = compressed_chunks_sent_;
+    stats["compression_bytes_saved"] = compression_bytes_saved_;
     stats["active_transfers"] = active_transfers_.size();
     stats["completed_transfers"] = completed_transfers_.size();
     
@@ -801,27 +1466,44 @@ nlohmann::json FileTransferManager::get_transfer_statistics() const {
 
 // Static utility functions
 std::string FileTransferManager::calculate_file_checksum(const std::string& file_path, const std::string& algorithm) {
-    if (algorithm == "sha256") {
-        // Use a simple SHA1 implementation for now (we can extend this)
-        size_t file_size;
-        void* file_data = read_file_binary(file_path.c_str(), &file_size);
-        if (!file_data) {
+    if (algorithm != "sha256" && algorithm != "sha1") {
+        return "";
+    }
+    
+    FileHandle file;
+    if (!file.open(file_path.c_str(), FileOpenMode::READ_ONLY)) {
+        return "";
+    }
+    int64_t file_size = file.size();
+    if (file_size < 0) {
+        return "";
+    }
+    
+    // Hash through a fixed window so memory use does not grow with the file
+    const size_t window_size = 1024 * 1024;
+    std::vector<uint8_t> window(static_cast<size_t>((std::min)(static_cast<uint64_t>(file_size),
+                                                              static_cast<uint64_t>(window_size))));
+    SHA256 sha256;
+    SHA1 sha1;
+    uint64_t offset = 0;
+    while (offset < static_cast<uint64_t>(file_size)) {
+        size_t length = static_cast<size_t>((std::min)(static_cast<uint64_t>(window.size()),
+                                                       static_cast<uint64_t>(file_size) - offset));
+        if (!file.read_at(offset, window.data(), length)) {
             return "";
         }
-        
-        SHA1 sha1;
-        sha1.update(reinterpret_cast<const uint8_t*>(file_data), file_size);
-        std::string result = sha1.finalize();
-        
-        free_file_buffer(file_data);
-        return result;
+        if (algorithm == "sha256") {
+            sha256.update(window.data(), length);
+        } else {
+            sha1.update(window.data(), length);
+        }
+        offset += length;
     }
     
-    // For MD5 or other algorithms, we would need additional implementations
-    return "";
+    return algorithm == "sha256" ? sha256.finalize() : sha1.finalize();
 }
 
-FileMetadata FileTransferManager::get_file_metadata(const std::string& file_path) {
+FileMetadata FileTransferManager::get_file_metadata(const std::string& file_path, bool compute_checksum) {
     FileMetadata metadata;
     
     try {
@@ -838,9 +1520,12 @@ FileMetadata FileTransferManager::get_file_metadata(const std::string& file_path
         // Get last modification time
         metadata.last_modified = get_file_modified_time(file_path.c_str());
         
-        // Calculate checksum (optional, can be expensive for large files)
-        if (metadata.file_size < 100 * 1024 * 1024) { // Only for files < 100MB
-            metadata.checksum = calculate_file_checksum(file_path, "sha256");
+        // Build the Merkle tree (optional, reads the whole file once per size and modification time)
+        if (compute_checksum) {
+            if (auto tree = MerkleTreeCache::getInstance().get(file_path)) {
+                metadata.merkle_root = MerkleTree::to_hex(tree->root());
+                metadata.merkle_leaf_size = tree->leaf_size();
+            }
         }
         
         // Determine MIME type based on extension
@@ -863,7 +1548,7 @@ DirectoryMetadata FileTransferManager::get_directory_metadata(const std::string&
         if (list_directory(directory_path.c_str(), entries)) {
             for (const auto& entry : entries) {
                 if (!entry.is_directory) {
-                    FileMetadata file_meta = get_file_metadata(entry.path);
+                    FileMetadata file_meta = get_file_metadata(entry.path, false);
                     file_meta.relative_path = entry.name;
                     metadata.files.push_back(file_meta);
                 }
@@ -925,7 +1610,15 @@ void FileTransferManager::process_transfer(const std::string& transfer_id) {
         is_directory_transfer = active_directory_transfers_.find(transfer_id) != active_directory_transfers_.end();
     }
     
-    if (is_directory_transfer) {
+    bool is_swarm_download = false;
+    {
+        std::lock_guard<std::mutex> swarm_lock(swarm_mutex_);
+        is_swarm_download = swarm_downloads_.find(transfer_id) != swarm_downloads_.end();
+    }
+    
+    if (is_swarm_download) {
+        run_swarm_download(transfer_id);
+    } else if (is_directory_transfer) {
         if (progress->direction == FileTransferDirection::SENDING) {
             start_directory_send(transfer_id);
         } else {
@@ -949,66 +1642,321 @@ void FileTransferManager::start_file_send(const std::string& transfer_id) {
     progress->status = FileTransferStatus::IN_PROGRESS;
     update_transfer_progress(transfer_id);
     
-    // Read file and create chunks
-    uint64_t chunk_index = 0;
-    uint64_t file_offset = 0;
+    // Keep the source file open (and optionally mapped) for the whole send; zero-copy
+    // sends share it with the outbound queue until their ranges are written
+    auto source_file = std::make_shared<FileHandle>();
+    if (!source_file->open(progress->local_path.c_str(), FileOpenMode::READ_ONLY)) {
+        complete_transfer(transfer_id, false, "Failed to open file for reading");
+        return;
+    }
+    if (config_.use_memory_mapped_reads && !source_file->map_read_only()) {
+        LOG_FILE_TRANSFER_WARN("Failed to map " << progress->local_path << ", using positional reads");
+    }
     
-    while (file_offset < progress->file_size && running_.load()) {
-        // Check if transfer was cancelled or paused
-        auto current_progress = get_transfer_progress(transfer_id);
-        if (!current_progress || current_progress->status == FileTransferStatus::CANCELLED ||
-            current_progress->status == FileTransferStatus::PAUSED) {
+    // A single file is checked by the receiver leaf by leaf against its Merkle tree,
+    // usually cached since the request's metadata was built; directory parts and
+    // files the tree cannot be built for fall back to a whole-file hash, computed
+    // from the chunks as they are read
+    std::shared_ptr<const MerkleTree> merkle_tree;
+    std::string directory_id;
+    std::shared_ptr<DirectoryTransfer> directory_plan;
+    size_t part_index = 0;
+    if (config_.verify_checksums && !find_directory_part(transfer_id, directory_id, directory_plan, part_index)) {
+        merkle_tree = MerkleTreeCache::getInstance().get(progress->local_path);
+        if (merkle_tree) {
+            client_.send(progress->peer_id, "file_transfer_control",
+                         create_control_message(transfer_id, "merkle", create_merkle_data(*merkle_tree)));
+        }
+    }
+    const bool file_checksum = config_.verify_checksums && !merkle_tree;
+    SHA256 file_hasher;
+    
+    // Byte ranges to send: the whole file, or for a receiver with an older copy that
+    // sent block signatures, the literal ranges between the blocks it can copy
+    std::vector<DeltaLiteral> ranges;
+    bool delta = false;
+    if (auto signatures = take_delta_signatures(transfer_id)) {
+        DeltaPlan plan;
+        if (!compute_delta(*source_file, progress->file_size, signatures->block_size, signatures->blocks, plan,
+                           file_checksum ? &file_hasher : nullptr)) {
+            complete_transfer(transfer_id, false, "Failed to read file for delta transfer");
             return;
         }
+        ranges = plan.literals;
+        uint64_t literal_bytes = 0;
+        for (const auto& literal : plan.literals) {
+            literal_bytes += literal.length;
+        }
         
-        uint32_t chunk_size = (std::min)(static_cast<uint64_t>(config_.chunk_size), 
-                                      progress->file_size - file_offset);
+        nlohmann::json copies = nlohmann::json::array();
+        for (const auto& copy : plan.copies) {
+            copies.push_back({copy.offset, copy.block, copy.count});
+        }
+        nlohmann::json delta_data;
+        delta_data["block_size"] = signatures->block_size;
+        delta_data["copies"] = copies;
+        delta_data["literal_bytes"] = literal_bytes;
+        if (file_checksum) {
+            delta_data["checksum"] = file_hasher.finalize();
+        }
+        client_.send(progress->peer_id, "file_transfer_control", create_control_message(transfer_id, "delta", delta_data));
         
-        FileChunk chunk;
-        chunk.transfer_id = transfer_id;
-        chunk.chunk_index = chunk_index;
-        chunk.total_chunks = progress->total_chunks;
-        chunk.chunk_size = chunk_size;
-        chunk.file_offset = file_offset;
-        chunk.data.resize(chunk_size);
+        progress->total_chunks = (literal_bytes + config_.chunk_size - 1) / config_.chunk_size;
+        progress->update_transfer_rates(progress->bytes_transferred + plan.copied_bytes);
+        delta = true;
+        LOG_FILE_TRANSFER_INFO("Delta transfer " << transfer_id << ": " << plan.copied_bytes << " of " << progress->file_size
+                               << " bytes copied by the receiver, " << literal_bytes << " literal bytes");
         
-        // Read chunk data
-        if (!read_file_chunk(progress->local_path.c_str(), file_offset, chunk.data.data(), chunk_size)) {
-            complete_transfer(transfer_id, false, "Failed to read complete chunk from file");
+        if (literal_bytes == 0) {
+            complete_transfer(transfer_id, true);
+            return;
+        }
+    } else {
+        ranges.push_back(DeltaLiteral{0, progress->file_size});
+    }
+    uint64_t bytes_to_send = 0;
+    for (const auto& range : ranges) {
+        bytes_to_send += range.length;
+    }
+    
+    const uint64_t transfer_id_hash = ChunkFrameHeader::hash_transfer_id(transfer_id);
+    auto window = std::make_shared<ChunkSendWindow>(config_.max_concurrent_chunks, config_.max_window_chunks);
+    window->set_total_bytes(bytes_to_send);
+    {
+        std::lock_guard<std::mutex> lock(send_windows_mutex_);
+        send_windows_[transfer_id] = window;
+    }
+    
+    // Unencrypted, uncompressed chunks go from the page cache to the socket without
+    // being read here. Their frames carry no SHA1, so the Merkle leaves, or without a
+    // tree the whole-file SHA256 hashed in one pass up front, are what check the received file.
+    const CompressionType compression = get_send_compression(transfer_id);
+    const bool zero_copy = config_.use_zero_copy_send && compression == CompressionType::NONE &&
+                           !client_.is_encryption_enabled();
+    if (zero_copy && file_checksum && !delta) {
+        std::string checksum = calculate_file_checksum(progress->local_path, "sha256");
+        if (checksum.empty()) {
+            close_send_window(transfer_id);
+            complete_transfer(transfer_id, false, "Failed to read file for checksum");
             return;
         }
+        nlohmann::json checksum_data;
+        checksum_data["algorithm"] = "sha256";
+        checksum_data["checksum"] = checksum;
+        client_.send(progress->peer_id, "file_transfer_control", create_control_message(transfer_id, "checksum", checksum_data));
+    }
+    
+    // New chunks are carved from the ranges in order, as large as the sizer currently
+    // allows; every chunk's range is kept for retransmissions
+    ChunkSizer sizer(config_.chunk_size, config_.min_chunk_size, config_.max_chunk_size);
+    std::unordered_map<uint64_t, DeltaLiteral> chunk_ranges;
+    size_t range_index = 0;
+    uint64_t range_offset = 0;
+    uint64_t bytes_carved = 0;
+    uint64_t chunks_carved = 0;
+    auto carve_chunk = [&](PreparedChunk& chunk) -> bool {
+        while (range_index < ranges.size() && range_offset >= ranges[range_index].length) {
+            range_index++;
+            range_offset = 0;
+        }
+        if (range_index == ranges.size()) {
+            return false;
+        }
+        uint32_t size = config_.adaptive_chunk_size ?
+            sizer.update(window->get_delivered_bytes(), window->get_loss_events(), window->get_smoothed_rtt_ms()) :
+            config_.chunk_size;
+        const DeltaLiteral& range = ranges[range_index];
+        chunk.index = chunks_carved++;
+        chunk.offset = range.offset + range_offset;
+        chunk.size = static_cast<uint32_t>((std::min)(static_cast<uint64_t>(size), range.length - range_offset));
+        range_offset += chunk.size;
+        bytes_carved += chunk.size;
+        chunk_ranges[chunk.index] = DeltaLiteral{chunk.offset, chunk.size};
+        
+        // The chunk count is an estimate at the current size until the last chunk is carved
+        chunk.total_chunks = chunks_carved + (bytes_to_send - bytes_carved + size - 1) / size;
+        progress->total_chunks = static_cast<uint32_t>(chunk.total_chunks);
+        return true;
+    };
+    auto prepare_chunk = [&](PreparedChunk& chunk) {
+        chunk.read = read_chunk_frame(*source_file, transfer_id_hash, chunk.index, chunk.offset, chunk.size,
+                                      chunk.total_chunks, chunk.frame);
+        if (chunk.read) {
+            TRACE_SPAN("file_transfer", "compress_chunk");
+            compress_chunk_frame(compression, chunk.frame, chunk.compressed);
+        }
+    };
+    
+    // Compressed sends prepare the next chunks on the task pool; otherwise one frame
+    // buffer serves the whole send, as read_chunk_frame only resizes it within its capacity
+    PreparedChunk current;
+    std::unique_ptr<ChunkPrefetcher> prefetcher;
+    if (compression != CompressionType::NONE) {
+        size_t depth = (std::min)((std::max)(std::thread::hardware_concurrency(), 2u), 16u);
+        prefetcher.reset(new ChunkPrefetcher(client_, depth, carve_chunk, prepare_chunk));
+        LOG_FILE_TRANSFER_INFO("Compressing chunks of transfer " << transfer_id << " with " << compression_type_name(compression));
+    } else if (zero_copy) {
+        LOG_FILE_TRANSFER_DEBUG("Sending chunks of transfer " << transfer_id << " from the page cache");
+    }
+    uint64_t bytes_taken = 0;
+    auto send_chunk = [&](uint64_t chunk_index, bool retransmission) -> bool {
+        TRACE_SPAN("file_transfer", "send_chunk");
+        std::shared_ptr<PreparedChunk> prefetched;
+        if (retransmission) {
+            const DeltaLiteral& range = chunk_ranges[chunk_index];
+            current.index = chunk_index;
+            current.offset = range.offset;
+            current.size = static_cast<uint32_t>(range.length);
+            current.total_chunks = progress->total_chunks;
+        } else if (prefetcher) {
+            prefetched = prefetcher->take_next();
+        } else if (!carve_chunk(current)) {
+            return true;
+        }
+        if (!retransmission && prefetcher && !prefetched) {
+            return true;
+        }
+        PreparedChunk& chunk = prefetched ? *prefetched : current;
+        if (!prefetched && !zero_copy) {
+            prepare_chunk(chunk);
+        }
+        if (!zero_copy && !chunk.read) {
+            complete_transfer(transfer_id, false, "Failed to read complete chunk from file");
+            return false;
+        }
         
-        // Calculate checksum
-        if (config_.verify_checksums) {
-            chunk.checksum = calculate_chunk_checksum(chunk.data);
+        // New chunks go out in order; announce the file checksum ahead of the last one
+        // so the receiver has it on completion (delta and zero-copy transfers announce it up front)
+        if (file_checksum && !retransmission && !delta && !zero_copy) {
+            file_hasher.update(chunk.frame.data() + ChunkFrameHeader::SIZE, chunk.size);
+            if (chunk.offset + chunk.size == progress->file_size) {
+                nlohmann::json checksum_data;
+                checksum_data["algorithm"] = "sha256";
+                checksum_data["checksum"] = file_hasher.finalize();
+                client_.send(progress->peer_id, "file_transfer_control",
+                             create_control_message(transfer_id, "checksum", checksum_data));
+            }
         }
         
-        // Note: Compression removed as requested - only binary chunks needed
+        window->on_chunk_sent(chunk.index, retransmission, chunk.size);
+        if (zero_copy) {
+            ChunkFrameHeader header;
+            header.transfer_id_hash = transfer_id_hash;
+            header.chunk_index = chunk.index;
+            header.total_chunks = chunk.total_chunks;
+            header.file_offset = chunk.offset;
+            header.chunk_size = chunk.size;
+            chunk.frame.resize(ChunkFrameHeader::SIZE);
+            header.encode(chunk.frame.data());
+            client_.send_file_region_to_peer_id(progress->peer_id, chunk.frame, source_file, chunk.offset, chunk.size,
+                                                SendPriority::BULK);
+        } else if (chunk.compressed.empty()) {
+            client_.send_binary_to_peer_id(progress->peer_id, chunk.frame, MessageDataType::BINARY, SendPriority::BULK);
+        } else {
+            client_.send_binary_to_peer_id(progress->peer_id, chunk.compressed, MessageDataType::BINARY, SendPriority::BULK);
+            std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+            compressed_chunks_sent_++;
+            compression_bytes_saved_ += chunk.frame.size() - chunk.compressed.size();
+        }
         
-        // Send chunk metadata first
-        nlohmann::json metadata_msg = create_chunk_metadata_message(chunk);
-        client_.send(progress->peer_id, "file_chunk_metadata", metadata_msg);
+        if (!retransmission) {
+            bytes_taken += chunk.size;
+            update_transfer_progress(transfer_id, chunk.size);
+        }
+        return true;
+    };
+    
+    // Send chunks as the window opens; ACKs clock out new chunks and negative
+    // ACKs queue retransmissions until every byte is acknowledged
+    std::unordered_map<uint64_t, uint32_t> retry_counts;
+    while (running_.load()) {
+        // Check if transfer was cancelled, paused or completed
+        auto current_progress = get_transfer_progress(transfer_id);
+        if (!current_progress || current_progress->status != FileTransferStatus::IN_PROGRESS ||
+            window->is_closed()) {
+            break;
+        }
         
-        // Send chunk binary data
-        std::vector<uint8_t> binary_msg = create_chunk_binary_message(chunk);
-        client_.send_binary_to_peer_id(progress->peer_id, binary_msg, MessageDataType::BINARY);
+        window->expire_timed_out_chunks();
+        bool has_new_chunks = bytes_taken < bytes_to_send;
+        if (!has_new_chunks && window->is_idle()) {
+            break;
+        }
         
-        chunk_index++;
-        file_offset += chunk_size;
+        if (!window->wait_for_slot(std::chrono::milliseconds(100))) {
+            continue;
+        }
         
-        // Update progress
-        update_transfer_progress(transfer_id, chunk_size);
+        uint64_t chunk_index = 0;
+        bool retransmission = window->pop_retransmission(chunk_index);
+        if (retransmission) {
+            if (++retry_counts[chunk_index] > config_.max_retries) {
+                complete_transfer(transfer_id, false, "Chunk " + std::to_string(chunk_index) + " exceeded retry limit");
+                break;
+            }
+        } else if (!has_new_chunks) {
+            // Everything is sent, wait for the outstanding ACKs
+            window->wait_for_ack(std::chrono::milliseconds(100));
+            continue;
+        }
         
-        // Throttle sending to avoid overwhelming the peer - use condition variable for fast shutdown
-        if (running_.load()) {
-            std::unique_lock<std::mutex> lock(throttle_mutex_);
-            throttle_condition_.wait_for(lock, std::chrono::milliseconds(10), [this] { return !running_.load(); });
+        if (!send_chunk(chunk_index, retransmission)) {
+            break;
         }
     }
     
+    close_send_window(transfer_id);
+    if (config_.adaptive_chunk_size) {
+        LOG_FILE_TRANSFER_DEBUG("Transfer " << transfer_id << " sent " << chunks_carved << " chunks, last size "
+                                << sizer.get_size() << " bytes at " << sizer.get_delivery_rate() << " bytes/s");
+    }
     LOG_FILE_TRANSFER_INFO("Completed sending file chunks for transfer: " << transfer_id);
 }
 
+bool FileTransferManager::read_chunk_frame(FileHandle& file, uint64_t transfer_id_hash, uint64_t chunk_index,
+                                           uint32_t chunk_size, uint64_t file_size, std::vector<uint8_t>& frame) const {
+    uint64_t file_offset = chunk_index * chunk_size;
+    if (file_offset >= file_size) {
+        return false;
+    }
+    uint32_t data_size = static_cast<uint32_t>((std::min)(static_cast<uint64_t>(chunk_size), file_size - file_offset));
+    return read_chunk_frame(file, transfer_id_hash, chunk_index, file_offset, data_size,
+                            (file_size + chunk_size - 1) / chunk_size, frame);
+}
+
+bool FileTransferManager::read_chunk_frame(FileHandle& file, uint64_t transfer_id_hash, uint64_t chunk_index,
+                                           uint64_t file_offset, uint32_t data_size, uint64_t total_chunks,
+                                           std::vector<uint8_t>& frame) const {
+    // Read the chunk straight into its frame, behind the header
+    frame.resize(ChunkFrameHeader::SIZE + data_size);
+    uint8_t* chunk_data = frame.data() + ChunkFrameHeader::SIZE;
+    {
+        TRACE_SPAN("file_transfer", "read_chunk");
+        ScopedMetricTimer timer(chunk_io_metrics().read_seconds);
+        if (!file.read_at(file_offset, chunk_data, data_size)) {
+            return false;
+        }
+    }
+    chunk_io_metrics().read_bytes.add(data_size);
+    
+    ChunkFrameHeader header;
+    header.transfer_id_hash = transfer_id_hash;
+    header.chunk_index = chunk_index;
+    header.total_chunks = total_chunks;
+    header.file_offset = file_offset;
+    header.chunk_size = data_size;
+    
+    // Calculate checksum
+    if (config_.verify_checksums) {
+        SHA1 sha1;
+        sha1.update(chunk_data, data_size);
+        sha1.finalize(header.checksum);
+        header.has_checksum = true;
+    }
+    header.encode(frame.data());
+    return true;
+}
+
 void FileTransferManager::start_file_receive(const std::string& transfer_id) {
     // Exit immediately if shutting down
     if (!running_.load()) {
@@ -1028,6 +1976,23 @@ void FileTransferManager::start_file_receive(const std::string& transfer_id) {
         return;
     }
     
+    nlohmann::json response_msg;
+    {
+        std::lock_guard<std::mutex> delta_lock(delta_mutex_);
+        auto deferred = delta_acceptances_.find(transfer_id);
+        if (deferred != delta_acceptances_.end()) {
+            response_msg = std::move(deferred->second);
+            delta_acceptances_.erase(deferred);
+        }
+    }
+    if (!response_msg.is_null()) {
+        nlohmann::json signatures;
+        if (create_delta_signatures(transfer_id, signatures)) {
+            response_msg["delta"] = signatures;
+        }
+        client_.send(progress->peer_id, "file_transfer_response", response_msg);
+    }
+    
     update_transfer_progress(transfer_id);
     LOG_FILE_TRANSFER_INFO("Started receiving file transfer: " << transfer_id);
 }
@@ -1038,50 +2003,91 @@ void FileTransferManager::start_directory_send(const std::string& transfer_id) {
         return;
     }
     
-    DirectoryMetadata dir_metadata;
+    std::shared_ptr<DirectoryTransfer> plan;
     {
         std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
-        auto it = active_directory_transfers_.find(transfer_id);
-        if (it == active_directory_transfers_.end()) {
-            complete_transfer(transfer_id, false, "Directory metadata not found");
-            return;
+        auto it = directory_plans_.find(transfer_id);
+        if (it != directory_plans_.end()) {
+            plan = it->second;
         }
-        dir_metadata = it->second;
+    }
+    if (!plan) {
+        complete_transfer(transfer_id, false, "Directory metadata not found");
+        return;
     }
     
     progress->status = FileTransferStatus::IN_PROGRESS;
     update_transfer_progress(transfer_id);
     
-    // Send each file in the directory
-    for (const auto& file_metadata : dir_metadata.files) {
-        if (!running_.load()) {
+    if (plan->parts.empty()) {
+        complete_transfer(transfer_id, true);
+        return;
+    }
+    
+    // Parts go out on several pipelines at once; this worker runs one of them.
+    // The directory completes when the last part is acknowledged.
+    size_t pipelines = std::min<size_t>(std::max<uint32_t>(config_.parallel_file_pipelines, 1), plan->parts.size());
+    std::vector<std::thread> extra_pipelines;
+    for (size_t i = 1; i < pipelines; ++i) {
+        extra_pipelines.emplace_back(&FileTransferManager::run_directory_pipeline, this, transfer_id, plan);
+    }
+    run_directory_pipeline(transfer_id, plan);
+    for (auto& pipeline : extra_pipelines) {
+        pipeline.join();
+    }
+    
+    LOG_FILE_TRANSFER_INFO("Finished sending directory parts for transfer: " << transfer_id);
+}
+
+void FileTransferManager::run_directory_pipeline(const std::string& transfer_id,
+                                                 const std::shared_ptr<DirectoryTransfer>& plan) {
+    while (running_.load()) {
+        // Stop taking parts once the directory is paused, cancelled or failed
+        auto progress = get_transfer_progress(transfer_id);
+        if (!progress || progress->status != FileTransferStatus::IN_PROGRESS) {
             return;
         }
         
-        // Check if transfer was cancelled or paused
-        auto current_progress = get_transfer_progress(transfer_id);
-        if (!current_progress || current_progress->status == FileTransferStatus::CANCELLED ||
-            current_progress->status == FileTransferStatus::PAUSED) {
-            return;
+        size_t part_index = 0;
+        std::string part_id;
+        {
+            std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
+            if (plan->finished || plan->next_part >= plan->parts.size()) {
+                return;
+            }
+            part_index = plan->next_part++;
+            part_id = get_directory_part_id(transfer_id, part_index);
+            directory_part_owners_[part_id] = std::make_pair(transfer_id, part_index);
         }
         
-        std::string full_file_path = combine_paths(progress->local_path, file_metadata.relative_path);
+        const DirectoryPart& part = plan->parts[part_index];
+        std::string part_path = part.packed ?
+            combine_paths(config_.temp_directory, part_id + ".pack") :
+            combine_paths(progress->local_path, plan->files[part.files.front()].relative_path);
+        auto part_progress = create_directory_part_progress(*progress, *plan, part_index, part_path);
+        {
+            std::lock_guard<std::mutex> lock(transfers_mutex_);
+            active_transfers_[part_id] = part_progress;
+        }
         
-        // Send individual file using existing file transfer logic
-        std::string file_transfer_id = send_file_with_metadata(progress->peer_id, full_file_path, file_metadata);
+        // Empty parts carry no chunks; the receiver creates their files on its own
+        if (part.size == 0) {
+            complete_transfer(part_id, true);
+            continue;
+        }
         
-        if (file_transfer_id.empty()) {
-            complete_transfer(transfer_id, false, "Failed to send file: " + file_metadata.filename);
+        if (part.packed && !write_directory_pack(*plan, part, progress->local_path, part_path)) {
+            delete_file(part_path.c_str());
+            complete_transfer(part_id, false, "Failed to pack files of " + progress->filename);
             return;
         }
         
-        // Wait for individual file transfer to complete
-        // Note: In a real implementation, we might want to track multiple concurrent file transfers
-        // For now, we'll send files sequentially
+        start_file_send(part_id);
+        
+        if (part.packed) {
+            delete_file(part_path.c_str());
+        }
     }
-    
-    LOG_FILE_TRANSFER_INFO("Completed sending directory transfer: " << transfer_id);
-    complete_transfer(transfer_id, true);
 }
 
 void FileTransferManager::start_directory_receive(const std::string& transfer_id) {
@@ -1091,6 +2097,7 @@ void FileTransferManager::start_directory_receive(const std::string& transfer_id
     }
     
     DirectoryMetadata dir_metadata;
+    std::shared_ptr<DirectoryTransfer> plan;
     {
         std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
         auto it = active_directory_transfers_.find(transfer_id);
@@ -1099,10 +2106,35 @@ void FileTransferManager::start_directory_receive(const std::string& transfer_id
             return;
         }
         dir_metadata = it->second;
+        auto plan_it = directory_plans_.find(transfer_id);
+        if (plan_it != directory_plans_.end()) {
+            plan = plan_it->second;
+        }
     }
     
     progress->status = FileTransferStatus::IN_PROGRESS;
     
+    nlohmann::json response_msg;
+    {
+        std::lock_guard<std::mutex> delta_lock(delta_mutex_);
+        auto deferred = delta_acceptances_.find(transfer_id);
+        if (deferred != delta_acceptances_.end()) {
+            response_msg = std::move(deferred->second);
+            delta_acceptances_.erase(deferred);
+        }
+    }
+    if (!response_msg.is_null()) {
+        nlohmann::json delta_parts = nlohmann::json::object();
+        for (size_t i = 0; plan && i < plan->parts.size(); ++i) {
+            nlohmann::json signatures;
+            if (create_delta_signatures(get_directory_part_id(transfer_id, i), signatures)) {
+                delta_parts[std::to_string(i)] = signatures;
+            }
+        }
+        response_msg["delta_parts"] = delta_parts;
+        client_.send(progress->peer_id, "file_transfer_response", response_msg);
+    }
+    
     // Create directory structure
     std::string base_path = progress->local_path;
     if (!ensure_directory_exists(base_path)) {
@@ -1111,9 +2143,15 @@ void FileTransferManager::start_directory_receive(const std::string& transfer_id
     }
     
     // Create subdirectories if needed
-    for (const auto& file_metadata : dir_metadata.files) {
-        std::string file_dir = combine_paths(base_path, get_parent_directory(file_metadata.relative_path.c_str()));
-        if (!file_dir.empty() && !ensure_directory_exists(file_dir)) {
+    const std::vector<FileMetadata>& files = plan ? plan->files : dir_metadata.files;
+    std::set<std::string> created_directories;
+    for (const auto& file_metadata : files) {
+        std::string parent = get_parent_directory(file_metadata.relative_path.c_str());
+        if (parent.empty() || !created_directories.insert(parent).second) {
+            continue;
+        }
+        std::string file_dir = combine_paths(base_path, parent);
+        if (!ensure_directory_exists(file_dir)) {
             complete_transfer(transfer_id, false, "Failed to create subdirectory: " + file_dir);
             return;
         }
@@ -1122,76 +2160,419 @@ void FileTransferManager::start_directory_receive(const std::string& transfer_id
     update_transfer_progress(transfer_id);
     LOG_FILE_TRANSFER_INFO("Started receiving directory transfer: " << transfer_id);
     
-    // Note: Individual files will be received as separate file transfer requests
-    // The directory transfer completion will be handled when all files are received
-}
-
-bool FileTransferManager::create_temp_file(const std::string& transfer_id, uint64_t file_size) {
-    std::string temp_path = get_temp_file_path(transfer_id, config_.temp_directory);
+    if (!plan) {
+        return;     // Files arrive as separate file transfer requests
+    }
     
-    try {
-        create_directories(config_.temp_directory.c_str());
-        
-        // Create file with pre-allocated size
-        if (!create_file_with_size(temp_path.c_str(), file_size)) {
-            LOG_FILE_TRANSFER_ERROR("Failed to create temp file " << temp_path);
-            return false;
+    // Parts without data never see a chunk, so they complete here
+    for (size_t i = 0; i < plan->parts.size(); ++i) {
+        if (plan->parts[i].size == 0) {
+            std::string part_id = get_directory_part_id(transfer_id, i);
+            if (get_transfer_progress(part_id)) {
+                bool extracted = extract_directory_pack(part_id);
+                complete_transfer(part_id, extracted, extracted ? "" : "Failed to create empty files");
+            }
         }
-        
-        return true;
-    } catch (const std::exception& e) {
-        LOG_FILE_TRANSFER_ERROR("Failed to create temp file " << temp_path << ": " << e.what());
-        return false;
+    }
+    if (plan->parts.empty()) {
+        complete_transfer(transfer_id, true);
     }
 }
 
-std::string FileTransferManager::get_temp_file_path(const std::string& transfer_id, const std::string& temp_dir) {
-    return combine_paths(temp_dir, transfer_id + ".tmp");
+std::shared_ptr<FileTransferManager::DirectoryTransfer> FileTransferManager::plan_directory_transfer(
+        const DirectoryMetadata& metadata) const {
+    auto plan = std::make_shared<DirectoryTransfer>();
+    flatten_directory_files(metadata, "", plan->files);
+    plan->offsets.assign(plan->files.size(), 0);
+    
+    // Small files fill packs up to max_pack_size in listing order; larger files travel alone
+    DirectoryPart pack;
+    pack.packed = true;
+    for (size_t i = 0; i < plan->files.size(); ++i) {
+        uint64_t file_size = plan->files[i].file_size;
+        if (config_.pack_file_threshold == 0 || file_size > config_.pack_file_threshold) {
+            DirectoryPart part;
+            part.size = file_size;
+            part.files.push_back(i);
+            plan->parts.push_back(part);
+            continue;
+        }
+        if (!pack.files.empty() && pack.size + file_size > config_.max_pack_size) {
+            plan->parts.push_back(pack);
+            pack.files.clear();
+            pack.size = 0;
+        }
+        plan->offsets[i] = pack.size;
+        pack.size += file_size;
+        pack.files.push_back(i);
+    }
+    if (!pack.files.empty()) {
+        plan->parts.push_back(pack);
+    }
+    
+    return plan;
 }
 
-bool FileTransferManager::ensure_directory_exists(const std::string& directory_path) {
-    return create_directories(directory_path.c_str());
+std::shared_ptr<FileTransferProgress> FileTransferManager::create_directory_part_progress(
+        const FileTransferProgress& directory, const DirectoryTransfer& plan, size_t part_index,
+        const std::string& local_path) const {
+    const DirectoryPart& part = plan.parts[part_index];
+    auto progress = std::make_shared<FileTransferProgress>();
+    progress->transfer_id = get_directory_part_id(directory.transfer_id, part_index);
+    progress->peer_id = directory.peer_id;
+    progress->direction = directory.direction;
+    progress->status = FileTransferStatus::STARTING;
+    progress->filename = part.packed ? directory.filename : plan.files[part.files.front()].filename;
+    progress->local_path = local_path;
+    progress->file_size = part.size;
+    progress->total_bytes = part.size;
+    progress->total_chunks = (part.size + config_.chunk_size - 1) / config_.chunk_size;
+    return progress;
 }
 
-std::string FileTransferManager::extract_filename(const std::string& file_path) {
-    return get_filename_from_path(file_path);
+bool FileTransferManager::write_directory_pack(const DirectoryTransfer& plan, const DirectoryPart& part,
+                                               const std::string& base_path, const std::string& pack_path) const {
+    FileHandle pack;
+    if (!pack.open(pack_path.c_str(), FileOpenMode::TRUNCATE)) {
+        LOG_FILE_TRANSFER_ERROR("Failed to create pack file " << pack_path);
+        return false;
+    }
+    
+    std::vector<uint8_t> buffer;
+    for (size_t file_index : part.files) {
+        const FileMetadata& file = plan.files[file_index];
+        std::string path = combine_paths(base_path, file.relative_path);
+        
+        // The announced sizes are binding: a file that changed since the listing fails the part
+        FileHandle source;
+        buffer.resize(file.file_size);
+        if (!source.open(path.c_str(), FileOpenMode::READ_ONLY) ||
+            source.size() != static_cast<int64_t>(file.file_size) ||
+            (file.file_size > 0 && (!source.read_at(0, buffer.data(), buffer.size()) ||
+                                    !pack.write_at(plan.offsets[file_index], buffer.data(), buffer.size())))) {
+            LOG_FILE_TRANSFER_ERROR("Failed to pack " << path << " (missing or changed since it was listed)");
+            return false;
+        }
+    }
+    return true;
 }
 
-std::string FileTransferManager::get_mime_type(const std::string& file_path) {
-    std::string extension = get_file_extension(file_path);
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+bool FileTransferManager::extract_directory_pack(const std::string& part_id) {
+    std::string transfer_id;
+    std::shared_ptr<DirectoryTransfer> plan;
+    size_t part_index = 0;
+    if (!find_directory_part(part_id, transfer_id, plan, part_index)) {
+        return false;
+    }
+    auto directory = get_transfer_progress(transfer_id);
+    if (!directory) {
+        return false;
+    }
     
-    // Basic MIME type mapping
-    static const std::unordered_map<std::string, std::string> mime_types = {
-        {".txt", "text/plain"},
-        {".json", "application/json"},
-        {".xml", "application/xml"},
-        {".html", "text/html"},
-        {".css", "text/css"},
-        {".js", "application/javascript"},
-        {".pdf", "application/pdf"},
-        {".png", "image/png"},
-        {".jpg", "image/jpeg"},
-        {".jpeg", "image/jpeg"},
-        {".gif", "image/gif"},
-        {".bmp", "image/bmp"},
-        {".svg", "image/svg+xml"},
-        {".mp3", "audio/mpeg"},
-        {".wav", "audio/wav"},
-        {".mp4", "video/mp4"},
-        {".avi", "video/x-msvideo"},
-        {".zip", "application/zip"},
-        {".tar", "application/x-tar"},
-        {".gz", "application/gzip"}
-    };
+    const DirectoryPart& part = plan->parts[part_index];
+    std::string pack_path = get_temp_file_path(part_id, config_.temp_directory);
+    FileHandle pack;
+    if (part.size > 0) {
+        close_temp_file_handle(part_id);
+        if (!verify_received_file(part_id, pack_path) || !pack.open(pack_path.c_str(), FileOpenMode::READ_ONLY)) {
+            return false;
+        }
+    }
     
-    auto it = mime_types.find(extension);
-    return (it != mime_types.end()) ? it->second : "application/octet-stream";
+    bool extracted = true;
+    std::vector<uint8_t> buffer;
+    for (size_t file_index : part.files) {
+        const FileMetadata& file = plan->files[file_index];
+        std::string path = combine_paths(directory->local_path, file.relative_path);
+        std::string parent = get_parent_directory(path.c_str());
+        if (!parent.empty()) {
+            ensure_directory_exists(parent);
+        }
+        
+        buffer.resize(file.file_size);
+        if ((file.file_size > 0 && !pack.read_at(plan->offsets[file_index], buffer.data(), buffer.size())) ||
+            !create_file_binary(path.c_str(), buffer.data(), buffer.size())) {
+            LOG_FILE_TRANSFER_ERROR("Failed to unpack " << path << " for transfer " << transfer_id);
+            extracted = false;
+            break;
+        }
+    }
+    
+    pack.close();
+    if (part.size > 0) {
+        delete_file(pack_path.c_str());
+    }
+    return extracted;
 }
 
-// Message handling methods
+bool FileTransferManager::find_directory_part(const std::string& part_id, std::string& transfer_id,
+                                              std::shared_ptr<DirectoryTransfer>& plan, size_t& part_index) const {
+    std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
+    auto it = directory_part_owners_.find(part_id);
+    if (it == directory_part_owners_.end()) {
+        return false;
+    }
+    auto plan_it = directory_plans_.find(it->second.first);
+    if (plan_it == directory_plans_.end()) {
+        return false;
+    }
+    transfer_id = it->second.first;
+    plan = plan_it->second;
+    part_index = it->second.second;
+    return true;
+}
 
-void FileTransferManager::handle_transfer_request(const std::string& peer_id, const nlohmann::json& message) {
+void FileTransferManager::on_directory_part_finished(const std::string& transfer_id,
+                                                     const std::shared_ptr<DirectoryTransfer>& plan,
+                                                     size_t part_index, bool success, const std::string& error_message) {
+    std::string current_file;
+    uint64_t files_completed = 0;
+    uint64_t bytes_completed = 0;
+    bool directory_done = false;
+    {
+        std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
+        if (plan->finished) {
+            return;
+        }
+        if (success) {
+            const DirectoryPart& part = plan->parts[part_index];
+            plan->parts_completed++;
+            plan->files_completed += part.files.size();
+            plan->bytes_completed += part.size;
+            current_file = plan->files[part.files.back()].relative_path;
+            directory_done = plan->parts_completed == plan->parts.size();
+        }
+        plan->finished = !success || directory_done;
+        files_completed = plan->files_completed;
+        bytes_completed = plan->bytes_completed;
+    }
+    
+    auto progress = get_transfer_progress(transfer_id);
+    if (!progress) {
+        return;
+    }
+    
+    // The first failed part fails the directory; the peer drops its side of it on the cancel
+    if (!success) {
+        client_.send(progress->peer_id, "file_transfer_control", create_control_message(transfer_id, "cancel"));
+        complete_transfer(transfer_id, false, error_message);
+        return;
+    }
+    
+    progress->update_transfer_rates(bytes_completed);
+    if (directory_progress_callback_) {
+        directory_progress_callback_(transfer_id, current_file, files_completed, plan->files.size(),
+                                     bytes_completed, progress->total_bytes);
+    }
+    
+    if (directory_done) {
+        complete_transfer(transfer_id, true);
+    }
+}
+
+void FileTransferManager::cancel_directory_parts(const std::string& transfer_id) {
+    std::vector<std::string> part_ids;
+    {
+        std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
+        auto it = directory_plans_.find(transfer_id);
+        if (it == directory_plans_.end()) {
+            return;
+        }
+        it->second->finished = true;
+        directory_plans_.erase(it);
+        for (auto owner = directory_part_owners_.begin(); owner != directory_part_owners_.end();) {
+            if (owner->second.first == transfer_id) {
+                part_ids.push_back(owner->first);
+                owner = directory_part_owners_.erase(owner);
+            } else {
+                ++owner;
+            }
+        }
+    }
+    
+    // Unfinished parts are dropped without history entries of their own
+    for (const auto& part_id : part_ids) {
+        {
+            std::lock_guard<std::mutex> lock(transfers_mutex_);
+            auto it = active_transfers_.find(part_id);
+            if (it != active_transfers_.end()) {
+                it->second->status = FileTransferStatus::CANCELLED;
+                active_transfers_.erase(it);
+            }
+            receiving_transfer_ids_.erase(ChunkFrameHeader::hash_transfer_id(part_id));
+        }
+        close_temp_file_handle(part_id);
+        close_send_window(part_id);
+        {
+            std::lock_guard<std::mutex> lock(file_checksums_mutex_);
+            expected_file_checksums_.erase(part_id);
+        }
+        {
+            std::lock_guard<std::mutex> lock(delta_mutex_);
+            delta_signatures_.erase(part_id);
+            delta_receives_.erase(part_id);
+            received_ranges_.erase(part_id);
+        }
+    }
+}
+
+bool FileTransferManager::create_temp_file(const std::string& transfer_id, uint64_t file_size) {
+    std::string temp_path = get_temp_file_path(transfer_id, config_.temp_directory);
+    
+    try {
+        create_directories(config_.temp_directory.c_str());
+        
+        // Create file with pre-allocated size and keep it open for incoming chunks
+        auto file = std::make_shared<FileHandle>();
+        if (!file->open(temp_path.c_str(), FileOpenMode::TRUNCATE) ||
+            (file_size > 0 && !file->preallocate(file_size))) {
+            LOG_FILE_TRANSFER_ERROR("Failed to create temp file " << temp_path);
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lock(open_files_mutex_);
+        open_files_[transfer_id] = file;
+        return true;
+    } catch (const std::exception& e) {
+        LOG_FILE_TRANSFER_ERROR("Failed to create temp file " << temp_path << ": " << e.what());
+        return false;
+    }
+}
+
+std::shared_ptr<FileHandle> FileTransferManager::get_temp_file_handle(const std::string& transfer_id) {
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    
+    auto it = open_files_.find(transfer_id);
+    if (it != open_files_.end()) {
+        return it->second;
+    }
+    
+    // Reopen the temp file of a transfer that was resumed or created elsewhere
+    std::string temp_path = get_temp_file_path(transfer_id, config_.temp_directory);
+    auto file = std::make_shared<FileHandle>();
+    if (!file->open(temp_path.c_str(), FileOpenMode::READ_WRITE)) {
+        return nullptr;
+    }
+    open_files_[transfer_id] = file;
+    return file;
+}
+
+void FileTransferManager::close_temp_file_handle(const std::string& transfer_id) {
+    std::shared_ptr<FileHandle> file;
+    {
+        std::lock_guard<std::mutex> lock(open_files_mutex_);
+        auto it = open_files_.find(transfer_id);
+        if (it == open_files_.end()) {
+            return;
+        }
+        file = std::move(it->second);
+        open_files_.erase(it);
+    }
+    file->close();
+}
+
+std::shared_ptr<ChunkSendWindow> FileTransferManager::get_send_window(const std::string& transfer_id) const {
+    std::lock_guard<std::mutex> lock(send_windows_mutex_);
+    auto it = send_windows_.find(transfer_id);
+    return it != send_windows_.end() ? it->second : nullptr;
+}
+
+void FileTransferManager::close_send_window(const std::string& transfer_id) {
+    std::shared_ptr<ChunkSendWindow> window;
+    {
+        std::lock_guard<std::mutex> lock(send_windows_mutex_);
+        auto it = send_windows_.find(transfer_id);
+        if (it == send_windows_.end()) {
+            return;
+        }
+        window = std::move(it->second);
+        send_windows_.erase(it);
+    }
+    window->close();
+}
+
+std::string FileTransferManager::get_temp_file_path(const std::string& transfer_id, const std::string& temp_dir) {
+    return combine_paths(temp_dir, transfer_id + ".tmp");
+}
+
+std::string FileTransferManager::get_directory_part_id(const std::string& transfer_id, size_t part_index) {
+    return transfer_id + "_part" + std::to_string(part_index);
+}
+
+void FileTransferManager::flatten_directory_files(const DirectoryMetadata& metadata, const std::string& prefix,
+                                                  std::vector<FileMetadata>& files) {
+    for (const auto& file : metadata.files) {
+        files.push_back(file);
+        files.back().relative_path = prefix.empty() ? file.relative_path : prefix + "/" + file.relative_path;
+    }
+    for (const auto& subdir : metadata.subdirectories) {
+        flatten_directory_files(subdir, prefix.empty() ? subdir.relative_path : prefix + "/" + subdir.relative_path, files);
+    }
+}
+
+bool FileTransferManager::is_safe_relative_path(const std::string& relative_path) {
+    // Reject absolute paths, drive letters and any ".." component
+    if (relative_path.empty() || relative_path[0] == '/' || relative_path[0] == '\\' ||
+        relative_path.find(':') != std::string::npos) {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= relative_path.size()) {
+        size_t end = relative_path.find_first_of("/\\", start);
+        if (end == std::string::npos) {
+            end = relative_path.size();
+        }
+        if (relative_path.compare(start, end - start, "..") == 0) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool FileTransferManager::ensure_directory_exists(const std::string& directory_path) {
+    return create_directories(directory_path.c_str());
+}
+
+std::string FileTransferManager::extract_filename(const std::string& file_path) {
+    return get_filename_from_path(file_path);
+}
+
+std::string FileTransferManager::get_mime_type(const std::string& file_path) {
+    std::string extension = get_file_extension(file_path);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    
+    // Basic MIME type mapping
+    static const std::unordered_map<std::string, std::string> mime_types = {
+        {".txt", "text/plain"},
+        {".json", "application/json"},
+        {".xml", "application/xml"},
+        {".html", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".pdf", "application/pdf"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".bmp", "image/bmp"},
+        {".svg", "image/svg+xml"},
+        {".mp3", "audio/mpeg"},
+        {".wav", "audio/wav"},
+        {".mp4", "video/mp4"},
+        {".avi", "video/x-msvideo"},
+        {".zip", "application/zip"},
+        {".tar", "application/x-tar"},
+        {".gz", "application/gzip"}
+    };
+    
+    auto it = mime_types.find(extension);
+    return (it != mime_types.end()) ? it->second : "application/octet-stream";
+}
+
+// Message handling methods
+
+void FileTransferManager::handle_transfer_request(const std::string& peer_id, const nlohmann::json& message) {
     try {
         std::string transfer_id = message["transfer_id"];
         
@@ -1202,7 +2583,8 @@ void FileTransferManager::handle_transfer_request(const std::string& peer_id, co
             dir_metadata.directory_name = dir_info["directory_name"];
             dir_metadata.relative_path = dir_info["relative_path"];
             
-            // Parse files and subdirectories from the metadata
+            // Parse files from the metadata; relative paths span the whole tree
+            bool safe_paths = true;
             if (dir_info.contains("files")) {
                 for (const auto& file_json : dir_info["files"]) {
                     FileMetadata file_meta;
@@ -1212,20 +2594,59 @@ void FileTransferManager::handle_transfer_request(const std::string& peer_id, co
                     file_meta.mime_type = file_json.value("mime_type", "application/octet-stream");
                     file_meta.checksum = file_json.value("checksum", "");
                     file_meta.last_modified = file_json.value("last_modified", 0);
+                    safe_paths = safe_paths && is_safe_relative_path(file_meta.relative_path);
                     dir_metadata.files.push_back(file_meta);
                 }
             }
             
-            // For now, handle as single directory level (can be expanded for nested later)
+            // Parts announced by the sender, checked against the file sizes they claim to hold
+            std::shared_ptr<DirectoryTransfer> plan;
+            if (dir_info.contains("parts")) {
+                plan = std::make_shared<DirectoryTransfer>();
+                plan->files = dir_metadata.files;
+                for (const auto& part_json : dir_info["parts"]) {
+                    DirectoryPart part;
+                    part.size = part_json["size"];
+                    part.packed = part_json.value("packed", false);
+                    plan->parts.push_back(part);
+                }
+                const auto& files_json = dir_info["files"];
+                for (size_t i = 0; i < plan->files.size(); ++i) {
+                    size_t part_index = files_json[i]["part"];
+                    uint64_t offset = files_json[i].value("offset", static_cast<uint64_t>(0));
+                    uint64_t file_size = plan->files[i].file_size;
+                    // Written without the sum, which a crafted plan could overflow
+                    if (part_index >= plan->parts.size() || file_size > plan->parts[part_index].size ||
+                        offset > plan->parts[part_index].size - file_size) {
+                        throw std::runtime_error("file " + plan->files[i].relative_path + " outside of its part");
+                    }
+                    plan->offsets.push_back(offset);
+                    plan->parts[part_index].files.push_back(i);
+                }
+                for (const auto& part : plan->parts) {
+                    if (part.files.empty() || (!part.packed && part.files.size() != 1)) {
+                        throw std::runtime_error("malformed directory part");
+                    }
+                }
+            }
             
             {
                 std::lock_guard<std::mutex> lock(pending_mutex_);
                 PendingDirectoryTransfer pending_transfer;
                 pending_transfer.metadata = dir_metadata;
+                pending_transfer.plan = plan;
                 pending_transfer.peer_id = peer_id;
+                pending_transfer.delta_sync = message.value("delta_sync", false);
+                pending_transfer.compression = choose_compression(message.value("compression", nlohmann::json::array()));
                 pending_directory_transfers_[transfer_id] = pending_transfer;
             }
             
+            if (!safe_paths) {
+                LOG_FILE_TRANSFER_WARN("Directory transfer " << transfer_id << " from " << peer_id << " names files outside of its directory");
+                reject_directory_transfer(transfer_id, "Unsafe file path");
+                return;
+            }
+            
             // Call user callback to approve/reject
             if (request_callback_) {
                 // Create a dummy file metadata for compatibility with existing callback
@@ -1256,12 +2677,16 @@ void FileTransferManager::handle_transfer_request(const std::string& peer_id, co
         metadata.file_size = file_info["file_size"];
         metadata.mime_type = file_info.value("mime_type", "application/octet-stream");
         metadata.checksum = file_info.value("checksum", "");
+        metadata.merkle_root = file_info.value("merkle_root", "");
+        metadata.merkle_leaf_size = file_info.value("merkle_leaf_size", 0u);
         
         {
             std::lock_guard<std::mutex> lock(pending_mutex_);
             PendingFileTransfer pending_transfer;
             pending_transfer.metadata = metadata;
             pending_transfer.peer_id = peer_id;
+            pending_transfer.delta_sync = message.value("delta_sync", false);
+            pending_transfer.compression = choose_compression(message.value("compression", nlohmann::json::array()));
             pending_transfers_[transfer_id] = pending_transfer;
         }
         
@@ -1291,6 +2716,11 @@ void FileTransferManager::handle_transfer_response(const std::string& peer_id, c
         std::string transfer_id = message["transfer_id"];
         bool accepted = message["accepted"];
         
+        // A swarm source declining its ranges only removes that source
+        if (!accepted && fail_swarm_source(transfer_id, peer_id, message.value("reason", "No reason provided"))) {
+            return;
+        }
+        
         auto progress = get_transfer_progress(transfer_id);
         if (!progress) {
             LOG_FILE_TRANSFER_ERROR("Received response for unknown transfer: " << transfer_id);
@@ -1298,6 +2728,20 @@ void FileTransferManager::handle_transfer_response(const std::string& peer_id, c
         }
         
         if (accepted) {
+            CompressionType compression = compression_type_from_name(message.value("compression", "none"));
+            if (compression != CompressionType::NONE && is_compression_available(compression)) {
+                std::lock_guard<std::mutex> lock(compression_mutex_);
+                send_compression_[transfer_id] = compression;
+            }
+            if (message.contains("delta")) {
+                store_delta_signatures(transfer_id, message["delta"]);
+            }
+            if (message.contains("delta_parts")) {
+                for (const auto& part : message["delta_parts"].items()) {
+                    store_delta_signatures(get_directory_part_id(transfer_id, std::stoul(part.key())), part.value());
+                }
+            }
+            
             // Start sending file
             {
                 std::lock_guard<std::mutex> work_lock(work_mutex_);
@@ -1316,103 +2760,84 @@ void FileTransferManager::handle_transfer_response(const std::string& peer_id, c
     }
 }
 
-void FileTransferManager::handle_chunk_metadata_message(const std::string& peer_id, const nlohmann::json& message) {
-    try {
-        PendingChunk pending;
-        pending.transfer_id = message["transfer_id"];
-        pending.chunk_index = message["chunk_index"];
-        pending.total_chunks = message["total_chunks"];
-        pending.chunk_size = message["chunk_size"];
-        pending.file_offset = message["file_offset"];
-        pending.checksum = message.value("checksum", "");
-        pending.created_at = std::chrono::steady_clock::now();
-        
-        // Store pending chunk metadata waiting for binary data
-        {
-            std::lock_guard<std::mutex> lock(chunks_mutex_);
-            pending_chunks_[peer_id] = pending;
-        }
-        
-        LOG_FILE_TRANSFER_DEBUG("Stored chunk metadata for transfer " << pending.transfer_id << 
-                               ", chunk " << pending.chunk_index << " from peer " << peer_id);
-        
-    } catch (const std::exception& e) {
-        LOG_FILE_TRANSFER_ERROR("Error handling chunk metadata message: " << e.what());
+void FileTransferManager::handle_chunk_frame(const std::string& peer_id, const uint8_t* data, size_t size) {
+    TRACE_SPAN("file_transfer", "handle_chunk_frame");
+    ChunkFrameHeader header;
+    if (!ChunkFrameHeader::decode(data, size, header)) {
+        LOG_FILE_TRANSFER_ERROR("Malformed chunk frame (" << size << " bytes) from peer " << peer_id);
+        return;
     }
-}
-
-void FileTransferManager::handle_chunk_binary_message(const std::string& peer_id, const std::vector<uint8_t>& binary_data) {
-    try {
-        // Parse binary chunk header and get the chunk data
-        FileChunk chunk;
-        if (!parse_chunk_binary_header(binary_data, chunk)) {
-            LOG_FILE_TRANSFER_ERROR("Failed to parse chunk binary header from peer " << peer_id);
-            return;
-        }
-        
-        // Get pending chunk metadata
-        PendingChunk pending;
-        bool found_pending = false;
-        {
-            std::lock_guard<std::mutex> lock(chunks_mutex_);
-            auto it = pending_chunks_.find(peer_id);
-            if (it != pending_chunks_.end()) {
-                pending = it->second;
-                pending_chunks_.erase(it);
-                found_pending = true;
-            }
+    
+    std::string transfer_id;
+    {
+        std::lock_guard<std::mutex> lock(transfers_mutex_);
+        auto it = receiving_transfer_ids_.find(header.transfer_id_hash);
+        if (it != receiving_transfer_ids_.end()) {
+            transfer_id = it->second;
         }
-        
-        if (!found_pending) {
-            LOG_FILE_TRANSFER_ERROR("No pending chunk metadata found for peer " << peer_id);
-            return;
+    }
+    if (transfer_id.empty()) {
+        LOG_FILE_TRANSFER_WARN("Chunk " << header.chunk_index << " from peer " << peer_id << " for unknown transfer");
+        return;
+    }
+    
+    const uint8_t* chunk_data = data + ChunkFrameHeader::SIZE;
+    
+    // A compressed chunk is restored first; its checksum covers the original data
+    thread_local std::vector<uint8_t> decompressed;
+    bool valid = true;
+    const char* error = "Checksum mismatch";
+    if (header.codec != CompressionType::NONE) {
+        uint32_t original_size = header.chunk_size >= 4 ? load_be32(chunk_data) : 0;
+        valid = header.chunk_size >= 4 && original_size <= MAX_DECOMPRESSED_CHUNK_SIZE;
+        if (valid) {
+            decompressed.resize(original_size);
+            valid = decompress_chunk(header.codec, chunk_data + 4, header.chunk_size - 4, decompressed.data(), original_size);
         }
-        
-        // Combine metadata with binary data
-        chunk.transfer_id = pending.transfer_id;
-        chunk.chunk_index = pending.chunk_index;
-        chunk.total_chunks = pending.total_chunks;
-        chunk.chunk_size = pending.chunk_size;
-        chunk.file_offset = pending.file_offset;
-        chunk.checksum = pending.checksum;
-        
-        // Verify chunk size matches
-        if (chunk.data.size() != pending.chunk_size) {
-            LOG_FILE_TRANSFER_ERROR("Chunk size mismatch: expected " << pending.chunk_size << 
-                                   ", got " << chunk.data.size() << " for transfer " << pending.transfer_id);
-            
-            // Send negative acknowledgment
-            nlohmann::json ack_msg = create_chunk_ack_message(chunk.transfer_id, chunk.chunk_index, false, "Size mismatch");
-            client_.send(peer_id, "file_chunk_ack", ack_msg);
-            return;
+        if (valid) {
+            chunk_data = decompressed.data();
+            header.chunk_size = original_size;
+        } else {
+            error = "Decompression failed";
+            LOG_FILE_TRANSFER_ERROR("Failed to decompress chunk " << header.chunk_index << " of transfer " << transfer_id
+                                    << " (" << compression_type_name(header.codec) << ")");
         }
-        
-        // Verify checksum if enabled
-        if (config_.verify_checksums && !chunk.checksum.empty()) {
-            if (!verify_chunk_checksum(chunk)) {
-                LOG_FILE_TRANSFER_ERROR("Chunk checksum verification failed for transfer " << chunk.transfer_id << 
-                                       ", chunk " << chunk.chunk_index);
-                
-                // Send negative acknowledgment
-                nlohmann::json ack_msg = create_chunk_ack_message(chunk.transfer_id, chunk.chunk_index, false, "Checksum mismatch");
-                client_.send(peer_id, "file_chunk_ack", ack_msg);
-                return;
-            }
+    }
+    
+    // Verify checksum if enabled
+    if (valid && config_.verify_checksums && header.has_checksum) {
+        SHA1 sha1;
+        sha1.update(chunk_data, header.chunk_size);
+        uint8_t calculated[ChunkFrameHeader::CHECKSUM_SIZE];
+        sha1.finalize(calculated);
+        valid = std::memcmp(calculated, header.checksum, sizeof(calculated)) == 0;
+        if (!valid) {
+            LOG_FILE_TRANSFER_ERROR("Chunk checksum verification failed for transfer " << transfer_id << 
+                                   ", chunk " << header.chunk_index);
         }
-        
-        // Process the received chunk
-        handle_chunk_received(chunk);
-        
-        // Send positive acknowledgment
-        nlohmann::json ack_msg = create_chunk_ack_message(chunk.transfer_id, chunk.chunk_index, true);
+    }
+    
+    // Swarm chunks are pulled, not acknowledged; corrupt ones are requested again
+    if (on_swarm_chunk(transfer_id, peer_id, header, chunk_data, valid)) {
+        return;
+    }
+    
+    if (!valid) {
+        // Send negative acknowledgment
+        nlohmann::json ack_msg = create_chunk_ack_message(transfer_id, header.chunk_index, false, error);
         client_.send(peer_id, "file_chunk_ack", ack_msg);
-        
-        LOG_FILE_TRANSFER_DEBUG("Successfully processed chunk " << chunk.chunk_index << 
-                               " for transfer " << chunk.transfer_id << " from peer " << peer_id);
-        
-    } catch (const std::exception& e) {
-        LOG_FILE_TRANSFER_ERROR("Error handling chunk binary message: " << e.what());
+        return;
     }
+    
+    // Process the received chunk
+    handle_chunk_received(transfer_id, header.file_offset, chunk_data, header.chunk_size);
+    
+    // Send positive acknowledgment
+    nlohmann::json ack_msg = create_chunk_ack_message(transfer_id, header.chunk_index, true);
+    client_.send(peer_id, "file_chunk_ack", ack_msg);
+    
+    LOG_FILE_TRANSFER_DEBUG("Successfully processed chunk " << header.chunk_index << 
+                           " for transfer " << transfer_id << " from peer " << peer_id);
 }
 
 void FileTransferManager::handle_chunk_ack_message(const std::string& peer_id, const nlohmann::json& message) {
@@ -1439,6 +2864,19 @@ void FileTransferManager::handle_transfer_control(const std::string& peer_id, co
             resume_transfer(transfer_id);
         } else if (action == "cancel") {
             cancel_transfer(transfer_id);
+        } else if (action == "delta") {
+            // Copying blocks reads and writes much of the file, so keep it off the message thread
+            std::lock_guard<std::mutex> lock(work_mutex_);
+            delta_queue_.push(DeltaApply{transfer_id, message.value("data", nlohmann::json::object())});
+            work_condition_.notify_one();
+        } else if (action == "merkle") {
+            store_merkle_leaves(transfer_id, message.value("data", nlohmann::json::object()));
+        } else if (action == "checksum") {
+            nlohmann::json data = message.value("data", nlohmann::json::object());
+            if (data.value("algorithm", "") == "sha256") {
+                std::lock_guard<std::mutex> lock(file_checksums_mutex_);
+                expected_file_checksums_[transfer_id] = data.value("checksum", "");
+            }
         }
         
     } catch (const std::exception& e) {
@@ -1459,6 +2897,12 @@ nlohmann::json FileTransferManager::create_transfer_request_message(const FileMe
         {"checksum", metadata.checksum},
         {"last_modified", metadata.last_modified}
     };
+    if (!metadata.merkle_root.empty()) {
+        message["file_metadata"]["merkle_root"] = metadata.merkle_root;
+        message["file_metadata"]["merkle_leaf_size"] = metadata.merkle_leaf_size;
+    }
+    message["delta_sync"] = config_.allow_resume && config_.use_delta_sync;
+    message["compression"] = offered_compression();
     return message;
 }
 
@@ -1472,35 +2916,6 @@ nlohmann::json FileTransferManager::create_transfer_response_message(const std::
     return message;
 }
 
-nlohmann::json FileTransferManager::create_chunk_metadata_message(const FileChunk& chunk) {
-    nlohmann::json message;
-    message["transfer_id"] = chunk.transfer_id;
-    message["chunk_index"] = chunk.chunk_index;
-    message["total_chunks"] = chunk.total_chunks;
-    message["chunk_size"] = chunk.chunk_size;
-    message["file_offset"] = chunk.file_offset;
-    message["checksum"] = chunk.checksum;
-    
-    return message;
-}
-
-std::vector<uint8_t> FileTransferManager::create_chunk_binary_message(const FileChunk& chunk) {
-    // Create binary message with header: "FTCHUNK" + chunk data
-    const std::string magic = "FTCHUNK";
-    std::vector<uint8_t> message;
-    
-    // Reserve space for the entire message
-    message.reserve(magic.length() + chunk.data.size());
-    
-    // Add magic header
-    message.insert(message.end(), magic.begin(), magic.end());
-    
-    // Add chunk data
-    message.insert(message.end(), chunk.data.begin(), chunk.data.end());
-    
-    return message;
-}
-
 nlohmann::json FileTransferManager::create_chunk_ack_message(const std::string& transfer_id, uint64_t chunk_index, bool success, const std::string& error) {
     nlohmann::json message;
     message["transfer_id"] = transfer_id;
@@ -1559,6 +2974,51 @@ void FileTransferManager::complete_transfer(const std::string& transfer_id, bool
     progress->status = success ? FileTransferStatus::COMPLETED : FileTransferStatus::FAILED;
     progress->error_message = error_message;
     
+    close_temp_file_handle(transfer_id);
+    close_send_window(transfer_id);
+    {
+        std::lock_guard<std::mutex> lock(file_checksums_mutex_);
+        expected_file_checksums_.erase(transfer_id);
+    }
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex_);
+        delta_signatures_.erase(transfer_id);
+        delta_receives_.erase(transfer_id);
+        delta_acceptances_.erase(transfer_id);
+        received_ranges_.erase(transfer_id);
+    }
+    {
+        std::lock_guard<std::mutex> lock(merkle_mutex_);
+        merkle_receives_.erase(transfer_id);
+    }
+    {
+        std::lock_guard<std::mutex> lock(compression_mutex_);
+        send_compression_.erase(transfer_id);
+    }
+    
+    // Parts of a directory report through their directory instead of the completion callback
+    std::string directory_id;
+    std::shared_ptr<DirectoryTransfer> plan;
+    size_t part_index = 0;
+    if (find_directory_part(transfer_id, directory_id, plan, part_index)) {
+        bool removed = false;
+        {
+            std::lock_guard<std::mutex> lock(transfers_mutex_);
+            removed = active_transfers_.erase(transfer_id) > 0;
+            receiving_transfer_ids_.erase(ChunkFrameHeader::hash_transfer_id(transfer_id));
+        }
+        {
+            std::lock_guard<std::mutex> dir_lock(directory_transfers_mutex_);
+            directory_part_owners_.erase(transfer_id);
+        }
+        if (removed) {
+            on_directory_part_finished(directory_id, plan, part_index, success, error_message);
+        }
+        return;
+    }
+    // Parts still running when their directory ends are dropped with it
+    cancel_directory_parts(transfer_id);
+    
     // Update statistics
     {
         std::lock_guard<std::mutex> stats_lock(stats_mutex_);
@@ -1587,73 +3047,159 @@ void FileTransferManager::move_to_completed(const std::string& transfer_id) {
     if (it != active_transfers_.end()) {
         completed_transfers_[transfer_id] = it->second;
         active_transfers_.erase(it);
+        trim_transfer_history_locked(std::chrono::steady_clock::now());
     }
+    receiving_transfer_ids_.erase(ChunkFrameHeader::hash_transfer_id(transfer_id));
 }
 
-// Binary chunk transmission implementation (replaces base64 encoding)
-//
-// PERFORMANCE OPTIMIZATIONS:
-// - Replaced JSON + base64 encoding with direct binary transmission
-// - Eliminates 33% encoding overhead from base64 
-// - Reduces CPU usage for encoding/decoding
-// - Minimizes memory allocations for string conversions
-// - Uses two-phase protocol: metadata (JSON) + binary data (raw)
-// - Added cleanup thread for timeout handling of split messages
+// Chunk transmission
 //
-// PROTOCOL CHANGES:
-// 1. Send file_chunk_metadata (JSON) with transfer info
-// 2. Send binary data with "FTCHUNK" magic header + raw file data
-// 3. Receive acknowledgments as before
-//
-// This approach provides maximum performance while maintaining protocol robustness.
+// Every chunk travels as a single binary frame: a fixed 64-byte ChunkFrameHeader
+// (transfer id hash, index, offset, size, SHA1 of the data) followed by the raw
+// chunk data. The receiver parses the header in place and writes the payload
+// straight from the received buffer, then answers with a file_chunk_ack that
+// drives the sender's ChunkSendWindow.
 
-void FileTransferManager::handle_chunk_received(const FileChunk& chunk) {
+void FileTransferManager::handle_chunk_received(const std::string& transfer_id, uint64_t file_offset,
+                                                const uint8_t* data, size_t size) {
     // Write chunk to temporary file
-    std::string temp_path = get_temp_file_path(chunk.transfer_id, config_.temp_directory);
+    auto temp_file = get_temp_file_handle(transfer_id);
+    bool written = false;
+    if (temp_file) {
+        TRACE_SPAN("file_transfer", "write_chunk");
+        ScopedMetricTimer timer(chunk_io_metrics().write_seconds);
+        written = temp_file->write_at(file_offset, data, size);
+    }
     
-    if (!write_file_chunk(temp_path.c_str(), chunk.file_offset, chunk.data.data(), chunk.chunk_size)) {
-        LOG_FILE_TRANSFER_ERROR("Failed to write chunk to temp file: " << temp_path);
+    if (!written) {
+        LOG_FILE_TRANSFER_ERROR("Failed to write chunk to temp file: " 
+                                << get_temp_file_path(transfer_id, config_.temp_directory));
         return;
     }
+    chunk_io_metrics().write_bytes.add(size);
     
-    // Update progress
-    update_transfer_progress(chunk.transfer_id, chunk.chunk_size);
-    
-    // Check if transfer is complete
-    auto progress = get_transfer_progress(chunk.transfer_id);
-    if (progress) {
-        progress->chunks_completed++;
-        if (progress->chunks_completed == progress->total_chunks) {
-            // Transfer complete - move temp file to final location
-            if (finalize_received_file(chunk.transfer_id, progress->local_path)) {
-                complete_transfer(chunk.transfer_id, true);
-            } else {
-                complete_transfer(chunk.transfer_id, false, "Failed to finalize received file");
-            }
+    // Count the chunk's new bytes and check the Merkle leaves it completes, then
+    // check if the transfer is complete. A corrupt leaf fails the transfer right away.
+    auto progress = get_transfer_progress(transfer_id);
+    uint64_t new_bytes = 0;
+    bool complete = progress && count_received_chunk(transfer_id, *progress, file_offset, size, new_bytes);
+    if (!verify_merkle_leaves(transfer_id, file_offset, data, size)) {
+        complete_transfer(transfer_id, false, "Merkle leaf verification failed");
+        if (progress) {
+            client_.send(progress->peer_id, "file_transfer_control", create_control_message(transfer_id, "cancel"));
         }
+        return;
+    }
+    update_transfer_progress(transfer_id, new_bytes);
+    if (complete) {
+        finish_received_file(transfer_id, *progress);
     }
 }
 
-void FileTransferManager::handle_chunk_ack(const std::string& transfer_id, uint64_t chunk_index, bool success) {
-    auto progress = get_transfer_progress(transfer_id);
-    if (!progress) {
-        return;
+uint64_t FileTransferManager::ReceivedRanges::add(uint64_t offset, uint64_t size) {
+    uint64_t start = offset;
+    uint64_t end = offset + size;
+    uint64_t overlap = 0;
+    
+    // Merge with every range that touches [start, end)
+    auto it = ranges.upper_bound(start);
+    if (it != ranges.begin() && std::prev(it)->second >= start) {
+        --it;
     }
-    
-    if (success) {
-        progress->chunks_completed++;
-        if (progress->chunks_completed == progress->total_chunks) {
-            complete_transfer(transfer_id, true);
+    while (it != ranges.end() && it->first <= end) {
+        uint64_t overlap_start = (std::max)(it->first, offset);
+        uint64_t overlap_end = (std::min)(it->second, offset + size);
+        if (overlap_end > overlap_start) {
+            overlap += overlap_end - overlap_start;
         }
-    } else {
-        // Handle chunk failure - could retry or fail the transfer
-        LOG_FILE_TRANSFER_ERROR("Chunk " << chunk_index << " failed for transfer " << transfer_id);
+        start = (std::min)(start, it->first);
+        end = (std::max)(end, it->second);
+        it = ranges.erase(it);
+    }
+    ranges[start] = end;
+    bytes += size - overlap;
+    return size - overlap;
+}
+
+bool FileTransferManager::ReceivedRanges::covers(uint64_t begin, uint64_t end) const {
+    auto it = ranges.upper_bound(begin);
+    return begin >= end || (it != ranges.begin() && std::prev(it)->second >= end);
+}
+
+bool FileTransferManager::count_received_chunk(const std::string& transfer_id, FileTransferProgress& progress,
+                                               uint64_t file_offset, uint64_t size, uint64_t& new_bytes) {
+    std::lock_guard<std::mutex> lock(delta_mutex_);
+    progress.chunks_completed++;
+    if (file_offset + size > progress.file_size) {
+        new_bytes = 0;
+        return false;
+    }
+    
+    // Chunk sizes vary, so completion is by bytes; a chunk received twice counts once
+    ReceivedRanges& received = received_ranges_[transfer_id];
+    new_bytes = received.add(file_offset, size);
+    auto it = delta_receives_.find(transfer_id);
+    if (it == delta_receives_.end()) {
+        return new_bytes > 0 && received.bytes == progress.file_size;
+    }
+    
+    // A delta transfer also needs its copies, which come with the literal byte count
+    if (!it->second.applied || it->second.finalizing || received.bytes < it->second.literal_bytes) {
+        return false;
+    }
+    it->second.finalizing = true;
+    return true;
+}
+
+void FileTransferManager::finish_received_file(const std::string& transfer_id, const FileTransferProgress& progress) {
+    // Move temp file to final location, or unpack a directory pack
+    std::string directory_id;
+    std::shared_ptr<DirectoryTransfer> plan;
+    size_t part_index = 0;
+    bool packed = find_directory_part(transfer_id, directory_id, plan, part_index) && plan->parts[part_index].packed;
+    if (packed ? extract_directory_pack(transfer_id) : finalize_received_file(transfer_id, progress.local_path)) {
+        complete_transfer(transfer_id, true);
+    } else {
+        complete_transfer(transfer_id, false, "Failed to finalize received file");
+    }
+}
+
+void FileTransferManager::handle_chunk_ack(const std::string& transfer_id, uint64_t chunk_index, bool success) {
+    auto progress = get_transfer_progress(transfer_id);
+    if (!progress) {
+        return;
+    }
+    
+    // Feed the send window; a negative ACK queues the chunk for retransmission. The
+    // window knows when every byte is acknowledged; after it is closed, a late ACK can
+    // only complete the transfer by the final chunk count.
+    auto window = get_send_window(transfer_id);
+    bool complete = false;
+    if (window) {
+        window->on_chunk_ack(chunk_index, success);
+        complete = success && window->take_completion();
+    }
+    
+    if (success) {
+        progress->chunks_completed++;
+        if (window ? complete : progress->chunks_completed == progress->total_chunks) {
+            complete_transfer(transfer_id, true);
+        }
+    } else {
+        LOG_FILE_TRANSFER_WARN("Chunk " << chunk_index << " failed for transfer " << transfer_id << ", retransmitting");
     }
 }
 
 bool FileTransferManager::finalize_received_file(const std::string& transfer_id, const std::string& final_path) {
     std::string temp_path = get_temp_file_path(transfer_id, config_.temp_directory);
     
+    // The handle must be released before the file can be renamed on Windows
+    close_temp_file_handle(transfer_id);
+    
+    if (!verify_received_file(transfer_id, temp_path)) {
+        return false;
+    }
+    
     try {
         // Ensure destination directory exists
         std::string dest_dir = get_parent_directory(final_path.c_str());
@@ -1674,44 +3220,29 @@ bool FileTransferManager::finalize_received_file(const std::string& transfer_id,
     }
 }
 
-std::string FileTransferManager::calculate_chunk_checksum(const std::vector<uint8_t>& data) {
-    SHA1 sha1;
-    sha1.update(data.data(), data.size());
-    return sha1.finalize();
-}
-
-bool FileTransferManager::parse_chunk_binary_header(const std::vector<uint8_t>& binary_data, FileChunk& chunk) {
-    const std::string magic = "FTCHUNK";
+bool FileTransferManager::verify_received_file(const std::string& transfer_id, const std::string& temp_path) {
+    std::string expected_checksum;
+    {
+        std::lock_guard<std::mutex> lock(file_checksums_mutex_);
+        auto it = expected_file_checksums_.find(transfer_id);
+        if (it != expected_file_checksums_.end()) {
+            expected_checksum = std::move(it->second);
+            expected_file_checksums_.erase(it);
+        }
+    }
     
-    // Check minimum size (magic header + at least some data)
-    if (binary_data.size() < magic.length()) {
+    if (config_.verify_checksums && !expected_checksum.empty() &&
+        calculate_file_checksum(temp_path, "sha256") != expected_checksum) {
+        LOG_FILE_TRANSFER_ERROR("File checksum mismatch for transfer " << transfer_id);
         return false;
     }
-    
-    // Verify magic header
-    if (std::memcmp(binary_data.data(), magic.c_str(), magic.length()) != 0) {
+    if (config_.verify_checksums && !verify_remaining_merkle_leaves(transfer_id, temp_path)) {
+        LOG_FILE_TRANSFER_ERROR("Merkle tree mismatch for transfer " << transfer_id);
         return false;
     }
-    
-    // Extract chunk data (everything after the magic header)
-    size_t data_start = magic.length();
-    size_t data_size = binary_data.size() - data_start;
-    
-    chunk.data.resize(data_size);
-    std::memcpy(chunk.data.data(), binary_data.data() + data_start, data_size);
-    
     return true;
 }
 
-bool FileTransferManager::verify_chunk_checksum(const FileChunk& chunk) {
-    if (!config_.verify_checksums || chunk.checksum.empty()) {
-        return true;
-    }
-    
-    std::string calculated = calculate_chunk_checksum(chunk.data);
-    return calculated == chunk.checksum;
-}
-
 void FileTransferManager::handle_file_request(const std::string& peer_id, const nlohmann::json& message) {
     try {
         std::string transfer_id = message["transfer_id"];
@@ -1805,4 +3336,808 @@ void FileTransferManager::handle_directory_request(const std::string& peer_id, c
     }
 }
 
+// Delta synchronization
+
+bool FileTransferManager::is_delta_candidate(const std::string& basis_path, uint64_t file_size) const {
+    return config_.allow_resume && config_.use_delta_sync && file_size > 0 && get_file_size(basis_path.c_str()) > 0;
+}
+
+bool FileTransferManager::create_delta_signatures(const std::string& transfer_id, nlohmann::json& signatures) {
+    std::string basis_path;
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex_);
+        auto it = delta_receives_.find(transfer_id);
+        if (it == delta_receives_.end()) {
+            return false;
+        }
+        basis_path = it->second.basis_path;
+    }
+    
+    FileHandle basis;
+    int64_t basis_size = basis.open(basis_path.c_str(), FileOpenMode::READ_ONLY) ? basis.size() : -1;
+    uint32_t block_size = choose_delta_block_size(basis_size > 0 ? static_cast<uint64_t>(basis_size) : 0);
+    std::vector<DeltaBlockSignature> blocks;
+    if (basis_size <= 0 || !compute_delta_signatures(basis, static_cast<uint64_t>(basis_size), block_size, blocks)) {
+        // Receive the whole file instead
+        LOG_FILE_TRANSFER_WARN("Failed to sign " << basis_path << ", receiving it in full");
+        std::lock_guard<std::mutex> lock(delta_mutex_);
+        delta_receives_.erase(transfer_id);
+        return false;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex_);
+        auto it = delta_receives_.find(transfer_id);
+        if (it == delta_receives_.end()) {
+            return false;
+        }
+        it->second.block_size = block_size;
+    }
+    
+    nlohmann::json blocks_json = nlohmann::json::array();
+    for (const auto& block : blocks) {
+        blocks_json.push_back({block.weak, block.strong});
+    }
+    signatures["block_size"] = block_size;
+    signatures["blocks"] = blocks_json;
+    LOG_FILE_TRANSFER_INFO("Signed " << blocks.size() << " blocks of " << basis_path << " for delta transfer " << transfer_id);
+    return true;
+}
+
+void FileTransferManager::store_delta_signatures(const std::string& transfer_id, const nlohmann::json& signatures) {
+    auto delta = std::make_shared<DeltaSignatures>();
+    delta->block_size = signatures.value("block_size", 0u);
+    if (delta->block_size == 0 || delta->block_size > MAX_DELTA_BLOCK_SIZE) {
+        LOG_FILE_TRANSFER_WARN("Ignoring delta signatures with block size " << delta->block_size << " for " << transfer_id);
+        return;
+    }
+    for (const auto& block : signatures.value("blocks", nlohmann::json::array())) {
+        delta->blocks.push_back(DeltaBlockSignature{block.at(0).get<uint32_t>(), block.at(1).get<uint64_t>()});
+    }
+    
+    std::lock_guard<std::mutex> lock(delta_mutex_);
+    delta_signatures_[transfer_id] = delta;
+}
+
+std::shared_ptr<FileTransferManager::DeltaSignatures> FileTransferManager::take_delta_signatures(const std::string& transfer_id) {
+    std::lock_guard<std::mutex> lock(delta_mutex_);
+    auto it = delta_signatures_.find(transfer_id);
+    if (it == delta_signatures_.end()) {
+        return nullptr;
+    }
+    auto signatures = std::move(it->second);
+    delta_signatures_.erase(it);
+    return signatures;
+}
+
+void FileTransferManager::apply_delta(const std::string& transfer_id, const nlohmann::json& data) {
+    std::string basis_path;
+    uint32_t expected_block_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex_);
+        auto it = delta_receives_.find(transfer_id);
+        if (it == delta_receives_.end() || it->second.applied) {
+            return;
+        }
+        basis_path = it->second.basis_path;
+        expected_block_size = it->second.block_size;
+    }
+    auto progress = get_transfer_progress(transfer_id);
+    if (!progress) {
+        return;
+    }
+    
+    // The copies index the blocks we signed, so any other block size is a broken or hostile sender
+    uint32_t block_size = data.value("block_size", 0u);
+    if (block_size == 0 || block_size > MAX_DELTA_BLOCK_SIZE || block_size != expected_block_size) {
+        LOG_FILE_TRANSFER_WARN("Rejecting delta with block size " << block_size << " for " << transfer_id
+                               << ", signed with " << expected_block_size);
+        complete_transfer(transfer_id, false, "Delta does not match the signatures sent");
+        return;
+    }
+    
+    // Copy the referenced blocks of the old copy into the temp file; literal chunks
+    // may already be arriving for the ranges in between
+    auto temp_file = get_temp_file_handle(transfer_id);
+    FileHandle basis;
+    bool copied = temp_file && basis.open(basis_path.c_str(), FileOpenMode::READ_ONLY);
+    uint64_t copied_bytes = 0;
+    std::vector<uint8_t> block(block_size);
+    for (const auto& copy : data.value("copies", nlohmann::json::array())) {
+        if (!copied) {
+            break;
+        }
+        uint64_t offset = copy.at(0);
+        uint64_t first_block = copy.at(1);
+        uint64_t count = copy.at(2);
+        for (uint64_t i = 0; i < count && copied; ++i) {
+            copied = offset + (i + 1) * block_size <= progress->file_size &&
+                     basis.read_at((first_block + i) * block_size, block.data(), block_size) &&
+                     temp_file->write_at(offset + i * block_size, block.data(), block_size);
+            copied_bytes += block_size;
+        }
+    }
+    basis.close();
+    if (!copied) {
+        complete_transfer(transfer_id, false, "Failed to copy blocks of the existing file");
+        return;
+    }
+    
+    if (data.contains("checksum")) {
+        std::lock_guard<std::mutex> lock(file_checksums_mutex_);
+        expected_file_checksums_[transfer_id] = data.value("checksum", "");
+    }
+    
+    bool finish = false;
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex_);
+        auto it = delta_receives_.find(transfer_id);
+        if (it == delta_receives_.end()) {
+            return;
+        }
+        it->second.applied = true;
+        it->second.literal_bytes = data.value("literal_bytes", static_cast<uint64_t>(0));
+        auto received = received_ranges_.find(transfer_id);
+        uint64_t received_bytes = received != received_ranges_.end() ? received->second.bytes : 0;
+        finish = !it->second.finalizing && received_bytes >= it->second.literal_bytes;
+        it->second.finalizing = it->second.finalizing || finish;
+    }
+    progress->update_transfer_rates(progress->bytes_transferred + copied_bytes);
+    LOG_FILE_TRANSFER_INFO("Copied " << copied_bytes << " bytes of " << basis_path << " for delta transfer " << transfer_id);
+    
+    if (finish) {
+        finish_received_file(transfer_id, *progress);
+    }
+}
+
+// Merkle verification
+
+nlohmann::json FileTransferManager::create_merkle_data(const MerkleTree& tree) const {
+    nlohmann::json leaves = nlohmann::json::array();
+    for (const auto& leaf : tree.leaves()) {
+        leaves.push_back(MerkleTree::to_hex(leaf));
+    }
+    nlohmann::json data;
+    data["root"] = MerkleTree::to_hex(tree.root());
+    data["leaf_size"] = tree.leaf_size();
+    data["leaves"] = std::move(leaves);
+    return data;
+}
+
+void FileTransferManager::expect_merkle_root(const std::string& transfer_id, const FileMetadata& metadata) {
+    MerkleReceive merkle;
+    if (!config_.verify_checksums || metadata.merkle_leaf_size == 0 ||
+        !MerkleTree::from_hex(metadata.merkle_root, merkle.root)) {
+        return;
+    }
+    merkle.leaf_size = metadata.merkle_leaf_size;
+    
+    std::lock_guard<std::mutex> lock(merkle_mutex_);
+    merkle_receives_[transfer_id] = std::move(merkle);
+}
+
+void FileTransferManager::store_merkle_leaves(const std::string& transfer_id, const nlohmann::json& data) {
+    auto progress = get_transfer_progress(transfer_id);
+    if (!config_.verify_checksums || !progress || progress->direction != FileTransferDirection::RECEIVING) {
+        return;
+    }
+    
+    MerkleTree::Hash root;
+    uint32_t leaf_size = data.value("leaf_size", 0u);
+    std::vector<MerkleTree::Hash> leaves;
+    bool parsed = MerkleTree::from_hex(data.value("root", ""), root) && leaf_size > 0 &&
+                  leaf_size <= MAX_MERKLE_LEAF_SIZE;
+    for (const auto& leaf : data.value("leaves", nlohmann::json::array())) {
+        leaves.emplace_back();
+        parsed = parsed && leaf.is_string() && MerkleTree::from_hex(leaf.get<std::string>(), leaves.back());
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(merkle_mutex_);
+        auto it = merkle_receives_.find(transfer_id);
+        if (it != merkle_receives_.end() && it->second.tree) {
+            return;
+        }
+        
+        // Without a root from the request the sender's own root is taken, which still
+        // checks every leaf it sent; with one, the layer has to hash to it
+        auto tree = std::make_shared<MerkleTree>();
+        const MerkleTree::Hash& expected_root = it != merkle_receives_.end() ? it->second.root : root;
+        if (!parsed || (it != merkle_receives_.end() && it->second.leaf_size != leaf_size) ||
+            !tree->assign(progress->file_size, leaf_size, std::move(leaves), expected_root)) {
+            LOG_FILE_TRANSFER_WARN("Ignoring Merkle leaves that do not match transfer " << transfer_id);
+            return;
+        }
+        
+        MerkleReceive& merkle = merkle_receives_[transfer_id];
+        merkle.root = tree->root();
+        merkle.leaf_size = leaf_size;
+        merkle.verified.assign(tree->leaf_count(), false);
+        merkle.tree = std::move(tree);
+    }
+    
+    std::lock_guard<std::mutex> swarm_lock(swarm_mutex_);
+    auto swarm = swarm_downloads_.find(transfer_id);
+    if (swarm != swarm_downloads_.end()) {
+        swarm->second->needs_merkle = false;
+    }
+}
+
+bool FileTransferManager::verify_merkle_leaves(const std::string& transfer_id, uint64_t file_offset,
+                                               const uint8_t* data, size_t size) {
+    // Unchecked leaves the chunk touches
+    std::shared_ptr<const MerkleTree> tree;
+    std::vector<size_t> candidates;
+    {
+        std::lock_guard<std::mutex> lock(merkle_mutex_);
+        auto it = merkle_receives_.find(transfer_id);
+        if (it == merkle_receives_.end() || !it->second.tree || size == 0) {
+            return true;
+        }
+        tree = it->second.tree;
+        size_t last = (std::min)(static_cast<size_t>((file_offset + size - 1) / tree->leaf_size()), tree->leaf_count() - 1);
+        for (size_t index = static_cast<size_t>(file_offset / tree->leaf_size()); index <= last; ++index) {
+            if (!it->second.verified[index]) {
+                candidates.push_back(index);
+            }
+        }
+    }
+    
+    // A leaf inside the chunk is checked from memory; one that spans chunks is read
+    // back from the temp file once all of its bytes are there
+    std::vector<size_t> verified;
+    std::shared_ptr<FileHandle> temp_file;
+    std::vector<uint8_t> buffer;
+    bool valid = true;
+    for (size_t index : candidates) {
+        uint64_t leaf_offset = tree->leaf_offset(index);
+        size_t leaf_length = tree->leaf_length(index);
+        if (leaf_offset >= file_offset && leaf_offset + leaf_length <= file_offset + size) {
+            valid = tree->verify_leaf(index, data + (leaf_offset - file_offset), leaf_length);
+        } else if (is_range_received(transfer_id, leaf_offset, leaf_offset + leaf_length)) {
+            if (!temp_file) {
+                temp_file = get_temp_file_handle(transfer_id);
+            }
+            buffer.resize(leaf_length);
+            valid = temp_file && temp_file->read_at(leaf_offset, buffer.data(), leaf_length) &&
+                    tree->verify_leaf(index, buffer.data(), leaf_length);
+        } else {
+            continue;
+        }
+        if (!valid) {
+            LOG_FILE_TRANSFER_ERROR("Merkle leaf " << index << " of transfer " << transfer_id << " does not match");
+            break;
+        }
+        verified.push_back(index);
+    }
+    
+    std::lock_guard<std::mutex> lock(merkle_mutex_);
+    auto it = merkle_receives_.find(transfer_id);
+    if (it != merkle_receives_.end() && it->second.tree == tree) {
+        for (size_t index : verified) {
+            it->second.verified[index] = true;
+        }
+    }
+    return valid;
+}
+
+bool FileTransferManager::verify_remaining_merkle_leaves(const std::string& transfer_id, const std::string& temp_path) {
+    MerkleReceive merkle;
+    {
+        std::lock_guard<std::mutex> lock(merkle_mutex_);
+        auto it = merkle_receives_.find(transfer_id);
+        if (it == merkle_receives_.end()) {
+            return true;
+        }
+        merkle = std::move(it->second);
+        merkle_receives_.erase(it);
+    }
+    
+    FileHandle file;
+    int64_t file_size = -1;
+    if (file.open(temp_path.c_str(), FileOpenMode::READ_ONLY)) {
+        file_size = file.size();
+    }
+    if (file_size < 0) {
+        return false;
+    }
+    
+    // Without the leaf layer the whole file is hashed into a tree and only the root compared
+    if (!merkle.tree) {
+        MerkleTree tree;
+        return tree.build(file, static_cast<uint64_t>(file_size), merkle.leaf_size) && tree.root() == merkle.root;
+    }
+    
+    // Otherwise only the leaves not checked while chunks arrived, such as delta copies
+    std::vector<uint8_t> buffer;
+    for (size_t index = 0; index < merkle.tree->leaf_count(); ++index) {
+        if (merkle.verified[index]) {
+            continue;
+        }
+        buffer.resize(merkle.tree->leaf_length(index));
+        if (!file.read_at(merkle.tree->leaf_offset(index), buffer.data(), buffer.size()) ||
+            !merkle.tree->verify_leaf(index, buffer.data(), buffer.size())) {
+            LOG_FILE_TRANSFER_ERROR("Merkle leaf " << index << " of transfer " << transfer_id << " does not match");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileTransferManager::is_range_received(const std::string& transfer_id, uint64_t begin, uint64_t end) const {
+    std::lock_guard<std::mutex> lock(delta_mutex_);
+    auto it = received_ranges_.find(transfer_id);
+    return it != received_ranges_.end() && it->second.covers(begin, end);
+}
+
+nlohmann::json FileTransferManager::offered_compression() const {
+    nlohmann::json offered = nlohmann::json::array();
+    if (config_.compression == CompressionType::NONE) {
+        return offered;
+    }
+    if (is_compression_available(config_.compression)) {
+        offered.push_back(compression_type_name(config_.compression));
+    }
+    for (CompressionType type : available_compression_types()) {
+        if (type != config_.compression) {
+            offered.push_back(compression_type_name(type));
+        }
+    }
+    return offered;
+}
+
+CompressionType FileTransferManager::choose_compression(const nlohmann::json& offered) {
+    if (!offered.is_array()) {
+        return CompressionType::NONE;
+    }
+    for (const auto& name : offered) {
+        if (!name.is_string()) {
+            continue;
+        }
+        CompressionType type = compression_type_from_name(name.get<std::string>());
+        if (type != CompressionType::NONE && is_compression_available(type)) {
+            return type;
+        }
+    }
+    return CompressionType::NONE;
+}
+
+CompressionType FileTransferManager::get_send_compression(const std::string& transfer_id) const {
+    // Parts of a directory use the codec negotiated for the directory
+    std::string owner_id = transfer_id;
+    std::shared_ptr<DirectoryTransfer> plan;
+    size_t part_index = 0;
+    find_directory_part(transfer_id, owner_id, plan, part_index);
+    
+    std::lock_guard<std::mutex> lock(compression_mutex_);
+    auto it = send_compression_.find(owner_id);
+    return it != send_compression_.end() ? it->second : CompressionType::NONE;
+}
+
+bool FileTransferManager::compress_chunk_frame(CompressionType codec, const std::vector<uint8_t>& frame,
+                                               std::vector<uint8_t>& compressed) const {
+    compressed.clear();
+    const uint8_t* chunk_data = frame.data() + ChunkFrameHeader::SIZE;
+    size_t chunk_size = frame.size() - ChunkFrameHeader::SIZE;
+    
+    // Already compressed or encrypted data looks random: skip it without trying
+    if (codec == CompressionType::NONE || estimate_entropy(chunk_data, chunk_size) > config_.compression_max_entropy) {
+        return false;
+    }
+    
+    std::vector<uint8_t> payload;
+    if (!compress_chunk(codec, config_.compression_level, chunk_data, chunk_size, payload) ||
+        payload.size() + 4 >= chunk_size) {
+        return false;
+    }
+    
+    ChunkFrameHeader header;
+    ChunkFrameHeader::decode(frame.data(), frame.size(), header);
+    header.codec = codec;
+    header.chunk_size = static_cast<uint32_t>(payload.size() + 4);
+    compressed.resize(ChunkFrameHeader::SIZE + header.chunk_size);
+    header.encode(compressed.data());
+    store_be32(compressed.data() + ChunkFrameHeader::SIZE, static_cast<uint32_t>(chunk_size));
+    std::memcpy(compressed.data() + ChunkFrameHeader::SIZE + 4, payload.data(), payload.size());
+    return true;
+}
+
+// Swarm downloads
+//
+// A swarm download pulls one file from several peers. The downloader asks each
+// source for disjoint chunk ranges with file_range_request messages; sources
+// answer with ordinary chunk frames hashed with the downloader's transfer id.
+// Each source keeps a pipeline of outstanding chunks sized to about one second
+// of its measured rate, so faster sources pull more of the file. Chunks that
+// time out go back to the pool, and once every chunk has been handed out the
+// chunks still in flight are duplicated to idle sources (endgame).
+
+void FileTransferManager::run_swarm_download(const std::string& transfer_id) {
+    auto progress = get_transfer_progress(transfer_id);
+    std::shared_ptr<SwarmDownload> swarm;
+    {
+        std::lock_guard<std::mutex> lock(swarm_mutex_);
+        auto it = swarm_downloads_.find(transfer_id);
+        if (it != swarm_downloads_.end()) {
+            swarm = it->second;
+        }
+    }
+    if (!progress || !swarm) {
+        return;
+    }
+    
+    progress->status = FileTransferStatus::IN_PROGRESS;
+    update_transfer_progress(transfer_id);
+    
+    const auto request_timeout = std::chrono::seconds(config_.timeout_seconds);
+    bool all_sources_failed = false;
+    
+    while (running_.load()) {
+        auto current_progress = get_transfer_progress(transfer_id);
+        if (!current_progress || current_progress->status != FileTransferStatus::IN_PROGRESS) {
+            break;
+        }
+        
+        std::vector<std::pair<std::string, nlohmann::json>> requests;
+        {
+            std::lock_guard<std::mutex> lock(swarm_mutex_);
+            auto now = std::chrono::steady_clock::now();
+            
+            // Refresh source rates once per second and size each pipeline to about a second of data
+            auto rate_elapsed = now - swarm->rate_window_start;
+            if (rate_elapsed >= std::chrono::seconds(1)) {
+                double seconds = std::chrono::duration<double>(rate_elapsed).count();
+                for (auto& source : swarm->sources) {
+                    double rate = source.window_bytes / seconds;
+                    source.rate_bps = source.rate_bps == 0.0 ? rate : 0.7 * source.rate_bps + 0.3 * rate;
+                    source.window_bytes = 0;
+                    if (source.rate_bps > 0.0) {
+                        double depth = source.rate_bps / swarm->chunk_size;
+                        source.pipeline_depth = static_cast<uint32_t>((std::max)(
+                            static_cast<double>(config_.max_concurrent_chunks),
+                            (std::min)(depth, static_cast<double>(config_.max_window_chunks))));
+                    }
+                }
+                swarm->rate_window_start = now;
+            }
+            
+            // Requests that outlive the timeout go back to the pool
+            size_t active_sources = 0;
+            for (auto& source : swarm->sources) {
+                if (source.failed) {
+                    continue;
+                }
+                for (auto it = source.outstanding.begin(); it != source.outstanding.end();) {
+                    if (now - it->second < request_timeout) {
+                        ++it;
+                        continue;
+                    }
+                    uint64_t chunk_index = it->first;
+                    it = source.outstanding.erase(it);
+                    release_swarm_chunk_locked(*swarm, chunk_index);
+                    source.failures++;
+                }
+                if (source.failures > config_.max_retries) {
+                    LOG_FILE_TRANSFER_WARN("Dropping swarm source " << source.peer_id << " of transfer " << transfer_id
+                                           << " after " << source.failures << " failed chunks");
+                    source.failed = true;
+                    release_swarm_chunks_locked(*swarm, source);
+                    continue;
+                }
+                active_sources++;
+            }
+            if (active_sources == 0) {
+                all_sources_failed = true;
+                break;
+            }
+            
+            // Fill free pipeline slots with missing chunks, then with endgame duplicates
+            // of chunks that are in flight at only one other source
+            for (auto& source : swarm->sources) {
+                if (source.failed || source.outstanding.size() >= source.pipeline_depth) {
+                    continue;
+                }
+                size_t free_slots = source.pipeline_depth - source.outstanding.size();
+                std::vector<uint64_t> picked;
+                while (picked.size() < free_slots && swarm->next_missing < swarm->chunks.size()) {
+                    if (swarm->chunks[swarm->next_missing] == SwarmChunkState::MISSING) {
+                        swarm->chunks[swarm->next_missing] = SwarmChunkState::REQUESTED;
+                        picked.push_back(swarm->next_missing);
+                    }
+                    swarm->next_missing++;
+                }
+                if (picked.size() < free_slots && active_sources > 1) {
+                    for (uint64_t i = 0; i < swarm->chunks.size() && picked.size() < free_slots; ++i) {
+                        if (swarm->chunks[i] != SwarmChunkState::REQUESTED || source.outstanding.count(i) > 0) {
+                            continue;
+                        }
+                        size_t holders = std::count_if(swarm->sources.begin(), swarm->sources.end(),
+                                                       [i](const SwarmSource& other) { return other.outstanding.count(i) > 0; });
+                        if (holders < 2) {
+                            picked.push_back(i);
+                        }
+                    }
+                }
+                if (picked.empty()) {
+                    continue;
+                }
+                
+                // Consecutive chunks travel as one range
+                std::sort(picked.begin(), picked.end());
+                nlohmann::json ranges = nlohmann::json::array();
+                for (size_t i = 0; i < picked.size();) {
+                    size_t run = 1;
+                    while (i + run < picked.size() && picked[i + run] == picked[i] + run) {
+                        run++;
+                    }
+                    ranges.push_back({picked[i], run});
+                    i += run;
+                }
+                for (uint64_t chunk_index : picked) {
+                    source.outstanding[chunk_index] = now;
+                }
+                
+                nlohmann::json request_msg;
+                request_msg["transfer_id"] = transfer_id;
+                request_msg["remote_path"] = swarm->remote_path;
+                request_msg["file_size"] = swarm->file_size;
+                request_msg["chunk_size"] = swarm->chunk_size;
+                request_msg["ranges"] = std::move(ranges);
+                
+                // Each source is asked once for the leaf layer until one has sent it
+                if (swarm->needs_merkle && !source.merkle_requested) {
+                    request_msg["merkle"] = true;
+                    source.merkle_requested = true;
+                }
+                requests.emplace_back(source.peer_id, std::move(request_msg));
+            }
+        }
+        
+        for (const auto& request : requests) {
+            client_.send(request.first, "file_range_request", request.second);
+        }
+        
+        // Wake up when a pipeline drains, and at least every 100ms for timeouts
+        std::unique_lock<std::mutex> lock(swarm_mutex_);
+        swarm_condition_.wait_for(lock, std::chrono::milliseconds(100), [&] {
+            return swarm->wakeup || !running_.load();
+        });
+        swarm->wakeup = false;
+    }
+    
+    if (all_sources_failed) {
+        complete_transfer(transfer_id, false, "All swarm sources failed");
+    }
+    
+    // A paused download keeps its chunk state until resume_transfer runs it again
+    auto final_progress = get_transfer_progress(transfer_id);
+    if (!final_progress || final_progress->status != FileTransferStatus::PAUSED || !running_.load()) {
+        std::lock_guard<std::mutex> lock(swarm_mutex_);
+        swarm_downloads_.erase(transfer_id);
+    }
+    LOG_FILE_TRANSFER_INFO("Swarm download scheduling finished for transfer: " << transfer_id);
+}
+
+bool FileTransferManager::on_swarm_chunk(const std::string& transfer_id, const std::string& peer_id,
+                                         const ChunkFrameHeader& header, const uint8_t* chunk_data, bool valid) {
+    std::shared_ptr<SwarmDownload> swarm;
+    {
+        std::lock_guard<std::mutex> lock(swarm_mutex_);
+        auto it = swarm_downloads_.find(transfer_id);
+        if (it == swarm_downloads_.end()) {
+            return false;
+        }
+        swarm = it->second;
+    }
+    
+    // Chunks are whole Merkle leaves, checked before they count as received
+    if (valid) {
+        valid = verify_merkle_leaves(transfer_id, header.file_offset, chunk_data, header.chunk_size);
+    }
+    
+    bool write_chunk = false;
+    {
+        std::lock_guard<std::mutex> lock(swarm_mutex_);
+        if (swarm_downloads_.find(transfer_id) == swarm_downloads_.end()) {
+            return true;
+        }
+        
+        auto source = std::find_if(swarm->sources.begin(), swarm->sources.end(),
+                                   [&](const SwarmSource& candidate) { return candidate.peer_id == peer_id; });
+        uint64_t chunk_index = header.chunk_index;
+        uint64_t expected_offset = chunk_index * swarm->chunk_size;
+        if (source == swarm->sources.end() || chunk_index >= swarm->chunks.size() ||
+            header.file_offset != expected_offset ||
+            header.chunk_size != (std::min)(static_cast<uint64_t>(swarm->chunk_size), swarm->file_size - expected_offset)) {
+            LOG_FILE_TRANSFER_WARN("Unexpected swarm chunk " << chunk_index << " from peer " << peer_id
+                                   << " for transfer " << transfer_id);
+            return true;
+        }
+        
+        source->outstanding.erase(chunk_index);
+        if (!valid) {
+            source->failures++;
+            release_swarm_chunk_locked(*swarm, chunk_index);
+        } else if (swarm->chunks[chunk_index] != SwarmChunkState::RECEIVED) {
+            swarm->chunks[chunk_index] = SwarmChunkState::RECEIVED;
+            source->window_bytes += header.chunk_size;
+            
+            // Endgame duplicates of this chunk are no longer needed
+            for (auto& other : swarm->sources) {
+                other.outstanding.erase(chunk_index);
+            }
+            write_chunk = true;
+        }
+        
+        if (!valid || source->outstanding.size() <= source->pipeline_depth / 2) {
+            swarm->wakeup = true;
+            swarm_condition_.notify_all();
+        }
+    }
+    
+    if (write_chunk) {
+        std::lock_guard<std::mutex> receive_lock(swarm->receive_mutex);
+        handle_chunk_received(transfer_id, header.file_offset, chunk_data, header.chunk_size);
+    }
+    return true;
+}
+
+bool FileTransferManager::fail_swarm_source(const std::string& transfer_id, const std::string& peer_id,
+                                            const std::string& reason) {
+    std::lock_guard<std::mutex> lock(swarm_mutex_);
+    auto it = swarm_downloads_.find(transfer_id);
+    if (it == swarm_downloads_.end()) {
+        return false;
+    }
+    
+    SwarmDownload& swarm = *it->second;
+    for (auto& source : swarm.sources) {
+        if (source.peer_id == peer_id && !source.failed) {
+            LOG_FILE_TRANSFER_WARN("Swarm source " << peer_id << " declined transfer " << transfer_id << ": " << reason);
+            source.failed = true;
+            release_swarm_chunks_locked(swarm, source);
+            swarm.wakeup = true;
+            swarm_condition_.notify_all();
+        }
+    }
+    return true;
+}
+
+void FileTransferManager::release_swarm_chunk_locked(SwarmDownload& swarm, uint64_t chunk_index) {
+    if (swarm.chunks[chunk_index] != SwarmChunkState::REQUESTED) {
+        return;
+    }
+    for (const auto& source : swarm.sources) {
+        if (source.outstanding.count(chunk_index) > 0) {
+            return;
+        }
+    }
+    swarm.chunks[chunk_index] = SwarmChunkState::MISSING;
+    swarm.next_missing = (std::min)(swarm.next_missing, chunk_index);
+}
+
+void FileTransferManager::release_swarm_chunks_locked(SwarmDownload& swarm, SwarmSource& source) {
+    auto outstanding = std::move(source.outstanding);
+    source.outstanding.clear();
+    for (const auto& entry : outstanding) {
+        release_swarm_chunk_locked(swarm, entry.first);
+    }
+}
+
+void FileTransferManager::handle_range_request(const std::string& peer_id, const nlohmann::json& message) {
+    // Upper bound on the chunk size a downloader may ask for
+    static constexpr uint32_t MAX_RANGE_CHUNK_SIZE = 16 * 1024 * 1024;
+    
+    try {
+        std::string transfer_id = message["transfer_id"];
+        std::string remote_path = message["remote_path"];
+        uint64_t file_size = message["file_size"];
+        uint32_t chunk_size = message["chunk_size"];
+        
+        auto reject = [&](const std::string& reason) {
+            nlohmann::json response;
+            response["transfer_id"] = transfer_id;
+            response["accepted"] = false;
+            response["reason"] = reason;
+            client_.send(peer_id, "file_transfer_response", response);
+        };
+        
+        if (chunk_size == 0 || chunk_size > MAX_RANGE_CHUNK_SIZE || !is_file(remote_path.c_str()) ||
+            get_file_size(remote_path.c_str()) != static_cast<int64_t>(file_size)) {
+            LOG_FILE_TRANSFER_WARN("Range request denied - file not found or size mismatch: " << remote_path);
+            reject("File not found or not accessible");
+            return;
+        }
+        
+        // The file request callback decides once per downloader and transfer
+        std::string approval_key = peer_id + ":" + transfer_id;
+        bool approved = false;
+        bool decided = false;
+        {
+            std::lock_guard<std::mutex> lock(range_approvals_mutex_);
+            auto it = range_approvals_.find(approval_key);
+            if (it != range_approvals_.end()) {
+                approved = it->second;
+                decided = true;
+            }
+        }
+        if (!decided) {
+            approved = file_request_callback_ && file_request_callback_(peer_id, remote_path, transfer_id);
+            
+            std::lock_guard<std::mutex> lock(range_approvals_mutex_);
+            // Decisions are not tied to transfer lifetimes; forget them all once the map grows large
+            if (range_approvals_.size() >= 4096) {
+                range_approvals_.clear();
+            }
+            range_approvals_[approval_key] = approved;
+            LOG_FILE_TRANSFER_INFO((approved ? "Accepted" : "Rejected") << " swarm file request: " << remote_path
+                                   << " for " << peer_id);
+        }
+        if (!approved) {
+            reject(file_request_callback_ ? "Request rejected by user" : "No file request handler configured");
+            return;
+        }
+        
+        uint64_t total_chunks = (file_size + chunk_size - 1) / chunk_size;
+        bool merkle_queued = false;
+        {
+            std::lock_guard<std::mutex> work_lock(work_mutex_);
+            for (const auto& range : message.value("ranges", nlohmann::json::array())) {
+                uint64_t first_chunk = range.at(0);
+                uint64_t chunk_count = range.at(1);
+                if (first_chunk >= total_chunks || chunk_count == 0) {
+                    continue;
+                }
+                
+                RangeRequest request;
+                request.peer_id = peer_id;
+                request.transfer_id = transfer_id;
+                request.remote_path = remote_path;
+                request.first_chunk = first_chunk;
+                request.chunk_count = (std::min)(chunk_count, total_chunks - first_chunk);
+                request.chunk_size = chunk_size;
+                request.file_size = file_size;
+                request.merkle = message.value("merkle", false) && !merkle_queued;
+                merkle_queued = merkle_queued || request.merkle;
+                range_queue_.push(std::move(request));
+            }
+        }
+        work_condition_.notify_all();
+        
+    } catch (const std::exception& e) {
+        LOG_FILE_TRANSFER_ERROR("Error handling range request: " << e.what());
+    }
+}
+
+void FileTransferManager::serve_range_request(const RangeRequest& request) {
+    FileHandle source_file;
+    if (!source_file.open(request.remote_path.c_str(), FileOpenMode::READ_ONLY)) {
+        LOG_FILE_TRANSFER_ERROR("Failed to open " << request.remote_path << " for range request of " << request.peer_id);
+        return;
+    }
+    
+    // The leaf layer goes ahead of the chunks; building it is a miss only the first time
+    if (request.merkle) {
+        auto tree = MerkleTreeCache::getInstance().get(request.remote_path);
+        if (tree && tree->file_size() == request.file_size) {
+            client_.send(request.peer_id, "file_transfer_control",
+                         create_control_message(request.transfer_id, "merkle", create_merkle_data(*tree)));
+        }
+    }
+    
+    const uint64_t transfer_id_hash = ChunkFrameHeader::hash_transfer_id(request.transfer_id);
+    std::vector<uint8_t> frame;
+    for (uint64_t i = 0; i < request.chunk_count && running_.load(); ++i) {
+        if (!read_chunk_frame(source_file, transfer_id_hash, request.first_chunk + i, request.chunk_size,
+                              request.file_size, frame)) {
+            LOG_FILE_TRANSFER_ERROR("Failed to read chunk " << (request.first_chunk + i) << " of " << request.remote_path);
+            return;
+        }
+        client_.send_binary_to_peer_id(request.peer_id, frame, MessageDataType::BINARY, SendPriority::BULK);
+        
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        total_bytes_sent_ += frame.size() - ChunkFrameHeader::SIZE;
+    }
+}
+
 } // namespace librats
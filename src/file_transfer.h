@@ -1,6 +1,11 @@
 #pragma once
 
 #include "socket.h"
+#include "buffer.h"
+#include "delta_sync.h"
+#include "merkle_tree.h"
+#include "chunk_compression.h"
+#include "resource_usage.h"
 #include "json.hpp"
 #include <string>
 #include <vector>
@@ -8,6 +13,7 @@
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <map>
 #include <atomic>
 #include <chrono>
 #include <thread>
@@ -16,8 +22,12 @@
 
 namespace librats {
 
-// Forward declaration
+// Forward declarations
 class RatsClient;
+class FileHandle;
+
+constexpr size_t FILE_TRANSFER_MAX_HISTORY = 1000;                    // Finished transfers kept, least recently updated dropped first
+constexpr auto FILE_TRANSFER_HISTORY_LIFETIME = std::chrono::hours(24); // Finished transfers are forgotten after this long
 
 /**
  * File transfer status codes
@@ -41,8 +51,6 @@ enum class FileTransferDirection {
     RECEIVING       // We are receiving the file
 };
 
-// Note: Compression removed as requested - only binary chunks needed
-
 /**
  * File transfer chunk information
  */
@@ -68,9 +76,11 @@ struct FileMetadata {
     uint64_t file_size;             // Total file size in bytes
     uint64_t last_modified;         // Last modification timestamp
     std::string mime_type;          // MIME type of the file
-    std::string checksum;           // Full file checksum
+    std::string checksum;           // Full file SHA256 checksum (sent while chunks stream when empty)
+    std::string merkle_root;        // Root of the file's MerkleTree (hex), empty if not computed
+    uint32_t merkle_leaf_size;      // Leaf size of that tree
     
-    FileMetadata() : file_size(0), last_modified(0) {}
+    FileMetadata() : file_size(0), last_modified(0), merkle_leaf_size(0) {}
 };
 
 /**
@@ -150,24 +160,267 @@ struct FileTransferProgress {
  * File transfer configuration
  */
 struct FileTransferConfig {
-    uint32_t chunk_size;            // Size of each chunk (default: 64KB)
-    uint32_t max_concurrent_chunks; // Max chunks in flight (default: 4)
+    uint32_t chunk_size;            // Size of each chunk, the starting size when adaptive (default: 64KB)
+    bool adaptive_chunk_size;       // Size chunks from the measured delivery rate and losses (default: true)
+    uint32_t min_chunk_size;        // Lower bound of adaptive chunk sizes (default: 16KB)
+    uint32_t max_chunk_size;        // Upper bound of adaptive chunk sizes (default: 1MB)
+    uint32_t max_concurrent_chunks; // Initial chunks in flight per transfer, and worker threads (default: 4)
+    uint32_t max_window_chunks;     // Upper bound of the adaptive send window in chunks (default: 512)
     uint32_t max_retries;           // Max retry attempts per chunk (default: 3)
     uint32_t timeout_seconds;       // Timeout per chunk (default: 30)
     bool verify_checksums;          // Verify chunk checksums (default: true)
     bool allow_resume;              // Allow resuming interrupted transfers (default: true)
+    bool use_memory_mapped_reads;   // Serve outgoing chunks from a read-only file mapping (default: false)
+    bool use_zero_copy_send;        // Unencrypted, uncompressed chunks go from the page cache to the socket (default: true)
+    bool use_delta_sync;            // Send only changed blocks to a receiver with an older copy (default: true, needs allow_resume)
+    uint64_t pack_file_threshold;   // Directory files up to this size travel packed together (default: 256KB, 0 disables)
+    uint64_t max_pack_size;         // Upper bound of one pack of small files (default: 16MB)
+    uint32_t parallel_file_pipelines; // Parts of a directory transfer sent at once (default: 4)
+    CompressionType compression;    // Preferred chunk codec, used if the receiver supports it (default: NONE)
+    int compression_level;          // Codec level; LZ4 acceleration, zstd/zlib level (default: 0, the codec's default)
+    double compression_max_entropy; // Chunks whose sampled entropy exceeds this (bits/byte) are sent raw (default: 7.5)
     std::string temp_directory;     // Temporary directory for incomplete files
     
     FileTransferConfig() 
         : chunk_size(65536),        // 64KB chunks
+          adaptive_chunk_size(true),
+          min_chunk_size(16 * 1024),
+          max_chunk_size(1024 * 1024),
           max_concurrent_chunks(4), 
+          max_window_chunks(512),
           max_retries(3),
           timeout_seconds(30),
           verify_checksums(true),
           allow_resume(true),
+          use_memory_mapped_reads(false),
+          use_zero_copy_send(true),
+          use_delta_sync(true),
+          pack_file_threshold(256 * 1024),
+          max_pack_size(16 * 1024 * 1024),
+          parallel_file_pipelines(4),
+          compression(CompressionType::NONE),
+          compression_level(0),
+          compression_max_entropy(7.5),
           temp_directory("./temp_transfers") {}
 };
 
+/**
+ * Fixed-layout header of a binary file chunk frame.
+ * One frame per chunk carries the header followed directly by the chunk data.
+ * All integers are big-endian:
+ *   [magic "FTCK" 4][version 1][flags 1][codec 1][reserved 1][transfer id hash 8]
+ *   [chunk index 8][total chunks 8][file offset 8][chunk size 4][SHA1 of data 20]
+ * A compressed chunk (codec other than NONE) carries [original size 4] followed by
+ * the compressed bytes; chunk size counts both and the SHA1 covers the original data.
+ */
+struct ChunkFrameHeader {
+    static constexpr size_t SIZE = 64;
+    static constexpr size_t CHECKSUM_SIZE = 20;
+    static constexpr uint8_t VERSION = 1;
+    static constexpr uint8_t FLAG_HAS_CHECKSUM = 0x01;
+    
+    uint64_t transfer_id_hash;
+    uint64_t chunk_index;
+    uint64_t total_chunks;
+    uint64_t file_offset;
+    uint32_t chunk_size;
+    bool has_checksum;
+    CompressionType codec;
+    uint8_t checksum[CHECKSUM_SIZE];
+    
+    ChunkFrameHeader();
+    
+    /**
+     * Write the header into out (SIZE bytes)
+     */
+    void encode(uint8_t* out) const;
+    
+    /**
+     * Parse a header from the start of a frame
+     * @param data Frame data
+     * @param size Frame size
+     * @param header Parsed header
+     * @return true if the magic and version match and the frame holds chunk_size data bytes
+     */
+    static bool decode(const uint8_t* data, size_t size, ChunkFrameHeader& header);
+    
+    /**
+     * Check whether data starts with the chunk frame magic
+     */
+    static bool is_chunk_frame(const uint8_t* data, size_t size);
+    
+    /**
+     * 64-bit FNV-1a hash identifying a transfer inside chunk frames
+     */
+    static uint64_t hash_transfer_id(const std::string& transfer_id);
+};
+
+/**
+ * ACK-clocked send window for the chunks of one transfer.
+ * Works like TCP AIMD: slow start grows the window by one chunk per ACK
+ * (doubling every round trip) up to the slow start threshold, congestion
+ * avoidance then adds one chunk per round trip, and a negative ACK or an
+ * ACK timeout halves the window (at most once per round trip).
+ * The retransmission timeout follows RFC 6298 from ACK round-trip samples.
+ */
+class ChunkSendWindow {
+public:
+    /**
+     * Constructor
+     * @param initial_window Chunks allowed in flight before the first ACK
+     * @param max_window Upper bound of the window in chunks
+     */
+    ChunkSendWindow(uint32_t initial_window, uint32_t max_window);
+    
+    /**
+     * Wait until another chunk may be sent
+     * @param timeout Maximum time to wait
+     * @return true if a slot is free, false on timeout or when closed
+     */
+    bool wait_for_slot(std::chrono::milliseconds timeout);
+    
+    /**
+     * Wait until the next ACK arrives or the window is closed
+     * @param timeout Maximum time to wait
+     */
+    void wait_for_ack(std::chrono::milliseconds timeout);
+    
+    /**
+     * Record a chunk as sent and in flight
+     * @param chunk_index Chunk index
+     * @param retransmission Whether the chunk was sent before (excluded from RTT samples)
+     * @param bytes Data bytes the chunk carries, counted once when it is acknowledged
+     */
+    void on_chunk_sent(uint64_t chunk_index, bool retransmission = false, uint32_t bytes = 0);
+    
+    /**
+     * Handle an ACK from the receiver
+     * @param chunk_index Chunk index
+     * @param success false for a negative ACK; the chunk is queued for retransmission
+     * @return true if the chunk was in flight, false for unknown or duplicate ACKs.
+     *         A late ACK of an expired chunk still counts its bytes as delivered.
+     */
+    bool on_chunk_ack(uint64_t chunk_index, bool success);
+    
+    /**
+     * Drop chunks whose ACK is overdue from the flight and shrink the window
+     * @return Number of chunks that timed out
+     */
+    size_t expire_timed_out_chunks();
+    
+    /**
+     * Take the next chunk queued for retransmission
+     * @param chunk_index Receives the chunk index
+     * @return true if a chunk was queued
+     */
+    bool pop_retransmission(uint64_t& chunk_index);
+    
+    /**
+     * Set the data bytes of the whole transfer, for take_completion
+     */
+    void set_total_bytes(uint64_t total_bytes);
+    
+    /**
+     * Check whether every byte of the transfer has been acknowledged
+     * @return true for the first call after the last byte was acknowledged
+     */
+    bool take_completion();
+    
+    /**
+     * Wake up waiting senders and refuse new slots
+     */
+    void close();
+    
+    bool is_closed() const;
+    bool is_idle() const;               // Nothing in flight and nothing to retransmit
+    uint32_t get_window() const;
+    size_t get_in_flight() const;
+    double get_smoothed_rtt_ms() const;
+    std::chrono::milliseconds get_retransmission_timeout() const;
+    uint64_t get_delivered_bytes() const;   // Data bytes of acknowledged chunks, each chunk counted once
+    uint64_t get_loss_events() const;       // Window decreases (negative ACKs and ACK timeouts)
+    
+private:
+    struct InFlightChunk {
+        std::chrono::steady_clock::time_point sent_at;
+        bool retransmission;
+    };
+    
+    mutable std::mutex mutex_;
+    std::condition_variable slot_condition_;
+    std::unordered_map<uint64_t, InFlightChunk> in_flight_;
+    std::unordered_map<uint64_t, uint32_t> unacked_bytes_;  // Sent chunks not yet acknowledged, by index
+    std::queue<uint64_t> retransmissions_;
+    double window_;
+    double slow_start_threshold_;
+    double max_window_;
+    double smoothed_rtt_ms_;
+    double rtt_variance_ms_;
+    bool has_rtt_sample_;
+    bool closed_;
+    uint64_t ack_count_;
+    uint64_t total_bytes_;
+    uint64_t delivered_bytes_;
+    uint64_t loss_events_;
+    bool completion_taken_;
+    std::chrono::steady_clock::time_point last_decrease_;
+    
+    void decrease_window_locked(std::chrono::steady_clock::time_point now);
+    void add_rtt_sample_locked(double rtt_ms);
+    std::chrono::milliseconds retransmission_timeout_locked() const;
+};
+
+/**
+ * Chooses the size of the next chunks a transfer sends.
+ * Chunks grow until one carries about TARGET_CHUNK_MS of the measured delivery rate,
+ * so fast links move large chunks with few ACKs. Every loss event halves the size, so
+ * lossy links keep small chunks and resend little per loss. The rate alone never
+ * shrinks chunks: an ACK-clocked rate is limited by the window, and smaller chunks
+ * would lower it further on long round trips. The size grows at most twofold per
+ * measurement interval (one round trip, at least MIN_INTERVAL_MS), stays within
+ * [min_size, max_size] and is a multiple of 4KB.
+ * Not thread-safe; the sending thread polls it before carving each chunk.
+ */
+class ChunkSizer {
+public:
+    static constexpr double TARGET_CHUNK_MS = 10.0;
+    static constexpr double MIN_INTERVAL_MS = 25.0;
+    
+    /**
+     * Constructor
+     * @param initial_size Size until the first measurement
+     * @param min_size Lower bound
+     * @param max_size Upper bound
+     */
+    ChunkSizer(uint32_t initial_size, uint32_t min_size, uint32_t max_size);
+    
+    /**
+     * Feed the send window's counters and get the size of the next chunk
+     * @param delivered_bytes Bytes acknowledged so far
+     * @param loss_events Loss events so far
+     * @param smoothed_rtt_ms Smoothed round-trip time, 0 before the first sample
+     * @param now Current time
+     * @return Chunk size in bytes
+     */
+    uint32_t update(uint64_t delivered_bytes, uint64_t loss_events, double smoothed_rtt_ms,
+                    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+    
+    uint32_t get_size() const { return size_; }
+    double get_delivery_rate() const { return delivery_rate_bps_; }   // Bytes per second, 0 until measured
+    
+private:
+    uint32_t size_;
+    uint32_t min_size_;
+    uint32_t max_size_;
+    double delivery_rate_bps_;
+    bool started_;
+    uint64_t interval_bytes_;
+    uint64_t loss_events_;
+    std::chrono::steady_clock::time_point interval_start_;
+    
+    uint32_t clamp_size(double size) const;
+};
+
 /**
  * Callback function types for file transfer events
  */
@@ -217,6 +470,14 @@ public:
      */
     bool handle_binary_data(const std::string& peer_id, const std::vector<uint8_t>& binary_data);
     
+    /**
+     * Handle binary data that might be file transfer chunks (zero-copy view)
+     * @param peer_id Source peer ID
+     * @param binary_data View of the binary data received
+     * @return true if this was a file transfer chunk, false otherwise
+     */
+    bool handle_binary_data(const std::string& peer_id, const SharedBuffer& binary_data);
+    
     // Callback registration
     /**
      * Set progress callback for transfer updates
@@ -296,6 +557,19 @@ public:
     std::string request_file(const std::string& peer_id, const std::string& remote_file_path,
                             const std::string& local_path);
     
+    /**
+     * Download a file from several peers at once
+     * Disjoint chunk ranges are requested from every source; faster sources get
+     * deeper request pipelines and stalled chunks move to other sources.
+     * @param peer_ids Peers holding the same file (same FileMetadata::checksum)
+     * @param remote_file_path Path to the file on the source peers
+     * @param metadata File size and optional SHA256 checksum of the file
+     * @param local_path Local path where file should be saved
+     * @return Transfer ID if successful, empty string if failed
+     */
+    std::string request_file_from_swarm(const std::vector<std::string>& peer_ids, const std::string& remote_file_path,
+                                        const FileMetadata& metadata, const std::string& local_path);
+    
     /**
      * Request a directory from a remote peer
      * @param peer_id Target peer ID
@@ -394,6 +668,25 @@ public:
      */
     void clear_transfer_history();
     
+    /**
+     * Limit the finished transfers kept for get_transfer_history() and retry_transfer()
+     * @param max_transfers Transfers kept, the least recently updated dropped first
+     * @param lifetime How long a finished transfer is kept (0 = until it is evicted)
+     */
+    void set_history_limits(size_t max_transfers, std::chrono::seconds lifetime);
+    
+    /**
+     * Forget finished transfers older than the history lifetime
+     * @return Number of transfers dropped
+     */
+    size_t expire_transfer_history();
+    
+    /**
+     * Get the memory held by the transfer history
+     * @return Usage, with one entry per finished transfer
+     */
+    ResourceUsage get_history_usage() const;
+    
     /**
      * Get statistics about transfers
      * @return JSON object with transfer statistics
@@ -402,25 +695,27 @@ public:
     
     // Utility functions
     /**
-     * Calculate file checksum
+     * Calculate file checksum, streaming the file through a fixed-size buffer
      * @param file_path Path to file
-     * @param algorithm Hash algorithm ("md5", "sha256")
-     * @return Checksum string or empty if failed
+     * @param algorithm Hash algorithm ("sha256", "sha1")
+     * @return Hex checksum string or empty if failed
      */
     static std::string calculate_file_checksum(const std::string& file_path, const std::string& algorithm = "sha256");
     
     /**
      * Get file metadata
      * @param file_path Path to file
+     * @param compute_checksum Build the file's Merkle tree (in parallel, cached by size and
+     *                         modification time) into metadata.merkle_root
      * @return File metadata structure
      */
-    static FileMetadata get_file_metadata(const std::string& file_path);
+    static FileMetadata get_file_metadata(const std::string& file_path, bool compute_checksum = true);
     
     /**
      * Get directory metadata
      * @param directory_path Path to directory
      * @param recursive Whether to scan recursively
-     * @return Directory metadata structure
+     * @return Directory metadata structure (file checksums are left empty)
      */
     static DirectoryMetadata get_directory_metadata(const std::string& directory_path, bool recursive = true);
     
@@ -440,16 +735,43 @@ private:
     mutable std::mutex transfers_mutex_;
     std::unordered_map<std::string, std::shared_ptr<FileTransferProgress>> active_transfers_;
     std::unordered_map<std::string, std::shared_ptr<FileTransferProgress>> completed_transfers_;
+    size_t history_max_transfers_;                 // Guarded by transfers_mutex_
+    std::chrono::seconds history_lifetime_;
+    uint64_t history_evictions_;
     
     // Pending transfers (not yet accepted/rejected)
     mutable std::mutex pending_mutex_;
     struct PendingFileTransfer {
         FileMetadata metadata;
         std::string peer_id;
+        bool delta_sync = false;    // Sender takes block signatures of an older copy
+        CompressionType compression = CompressionType::NONE; // Codec picked from the sender's offer
+    };
+    // A directory transfer is split into parts, each sent as its own chunk stream:
+    // a pack concatenates small files (located by their offsets), and every larger
+    // file is a part on its own. All parts are announced with the directory request,
+    // so they need no per-file request round trip.
+    struct DirectoryPart {
+        uint64_t size = 0;
+        bool packed = false;
+        std::vector<size_t> files;          // Indices into DirectoryTransfer::files
+    };
+    struct DirectoryTransfer {
+        std::vector<FileMetadata> files;    // All files, relative_path from the directory root
+        std::vector<uint64_t> offsets;      // Offset of each file within its part
+        std::vector<DirectoryPart> parts;
+        size_t next_part = 0;               // Sender: next part handed to a pipeline
+        size_t parts_completed = 0;
+        size_t files_completed = 0;
+        uint64_t bytes_completed = 0;
+        bool finished = false;
     };
     struct PendingDirectoryTransfer {
         DirectoryMetadata metadata;
+        std::shared_ptr<DirectoryTransfer> plan;
         std::string peer_id;
+        bool delta_sync = false;
+        CompressionType compression = CompressionType::NONE;
     };
     std::unordered_map<std::string, PendingFileTransfer> pending_transfers_;
     std::unordered_map<std::string, PendingDirectoryTransfer> pending_directory_transfers_;
@@ -457,23 +779,72 @@ private:
     // Active directory transfers
     mutable std::mutex directory_transfers_mutex_;
     std::unordered_map<std::string, DirectoryMetadata> active_directory_transfers_;
-    
-    // Chunk management
-    mutable std::mutex chunks_mutex_;
-    std::unordered_map<std::string, std::queue<FileChunk>> outgoing_chunks_;
-    std::unordered_map<std::string, std::unordered_map<uint64_t, FileChunk>> received_chunks_;
-    
-    // Active chunk transfers waiting for binary data
-    struct PendingChunk {
-        std::string transfer_id;
-        uint64_t chunk_index;
-        uint64_t total_chunks;
-        uint64_t chunk_size;
-        uint64_t file_offset;
-        std::string checksum;
-        std::chrono::steady_clock::time_point created_at;
+    std::unordered_map<std::string, std::shared_ptr<DirectoryTransfer>> directory_plans_;
+    std::unordered_map<std::string, std::pair<std::string, size_t>> directory_part_owners_; // Part id -> directory, part
+    
+    // Receiving transfers by ChunkFrameHeader::hash_transfer_id (guarded by transfers_mutex_)
+    std::unordered_map<uint64_t, std::string> receiving_transfer_ids_;
+    
+    // Temp files of receiving transfers, held open until the transfer finishes
+    mutable std::mutex open_files_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<FileHandle>> open_files_;
+    
+    // Full file checksums announced by senders, verified when the file is finalized
+    mutable std::mutex file_checksums_mutex_;
+    std::unordered_map<std::string, std::string> expected_file_checksums_;
+    
+    // Delta synchronization (see delta_sync.h). A receiver with an older copy of a
+    // file answers the request with block signatures; the sender then announces which
+    // blocks to copy and sends only the literal ranges as chunks. Completion waits
+    // for both the copies and the literal chunks, which arrive on different threads.
+    struct DeltaSignatures {
+        uint32_t block_size;
+        std::vector<DeltaBlockSignature> blocks;
+    };
+    struct DeltaReceive {
+        std::string basis_path;     // Older copy that blocks are copied from
+        uint32_t block_size = 0;    // Block size of the signatures we sent; the delta must use it
+        bool applied = false;       // Copies written and literal byte count known
+        bool finalizing = false;
+        uint64_t literal_bytes = 0;
     };
-    std::unordered_map<std::string, PendingChunk> pending_chunks_; // key: peer_id
+    // Merged byte ranges a receiver has written, so chunks of any size (and chunks
+    // received twice) add up to the file exactly once
+    struct ReceivedRanges {
+        std::map<uint64_t, uint64_t> ranges;    // Start -> end
+        uint64_t bytes = 0;
+        
+        // Record [offset, offset + size) and return how many of its bytes were new
+        uint64_t add(uint64_t offset, uint64_t size);
+        
+        // Whether every byte of [begin, end) was recorded
+        bool covers(uint64_t begin, uint64_t end) const;
+    };
+    mutable std::mutex delta_mutex_;    // Also guards received_ranges_
+    std::unordered_map<std::string, std::shared_ptr<DeltaSignatures>> delta_signatures_; // Sending, by transfer
+    std::unordered_map<std::string, DeltaReceive> delta_receives_;                        // Receiving, by transfer
+    std::unordered_map<std::string, ReceivedRanges> received_ranges_;                     // Receiving, by transfer
+    std::unordered_map<std::string, nlohmann::json> delta_acceptances_; // Responses of accepted transfers waiting for signatures
+    
+    // Merkle verification (see merkle_tree.h). The request carries the root of the
+    // file's tree and the sender, or a swarm source, sends the leaf layer. Each leaf is
+    // checked as soon as all of its bytes are written, so corruption fails the transfer
+    // (or, in a swarm, the source) early; leaves not checked by then are checked when
+    // the file completes. Such transfers need no whole-file checksum.
+    struct MerkleReceive {
+        MerkleTree::Hash root{};
+        uint32_t leaf_size = 0;
+        std::shared_ptr<const MerkleTree> tree;     // Leaf layer, once received and matched to root
+        std::vector<bool> verified;
+    };
+    mutable std::mutex merkle_mutex_;
+    std::unordered_map<std::string, MerkleReceive> merkle_receives_;  // Receiving, by transfer
+    
+    // Chunk compression. The sender offers the codecs it has, preferred first, and
+    // the receiver answers with the first one it can decode; each frame then says
+    // whether its chunk is compressed, so chunks that do not shrink go out raw.
+    mutable std::mutex compression_mutex_;
+    std::unordered_map<std::string, CompressionType> send_compression_;  // Sending, by transfer or directory
     
     // Worker threads
     std::vector<std::thread> worker_threads_;
@@ -482,13 +853,65 @@ private:
     std::mutex work_mutex_;
     std::queue<std::string> work_queue_; // Transfer IDs that need processing
     
-    // Cleanup thread synchronization
-    std::condition_variable cleanup_condition_;
-    std::mutex cleanup_mutex_;
+    // Send windows of outgoing file transfers, driven by chunk ACKs
+    mutable std::mutex send_windows_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<ChunkSendWindow>> send_windows_;
     
-    // Throttling synchronization
-    std::condition_variable throttle_condition_;
-    std::mutex throttle_mutex_;
+    // Multi-source downloads, scheduled by the worker thread that runs the transfer
+    enum class SwarmChunkState : uint8_t {
+        MISSING,
+        REQUESTED,
+        RECEIVED
+    };
+    struct SwarmSource {
+        std::string peer_id;
+        std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> outstanding; // Chunk -> request time
+        uint32_t pipeline_depth;    // Chunks this source may have outstanding
+        uint64_t window_bytes;      // Bytes received in the current rate window
+        double rate_bps;            // Smoothed receive rate
+        uint32_t failures;          // Timed out or corrupt chunks
+        bool failed;
+        bool merkle_requested;      // Asked for the leaf layer
+    };
+    struct SwarmDownload {
+        std::string remote_path;
+        uint64_t file_size;
+        uint32_t chunk_size;
+        std::vector<SwarmChunkState> chunks;
+        std::vector<SwarmSource> sources;
+        uint64_t next_missing;      // No MISSING chunk below this index
+        bool needs_merkle;          // Root known, leaf layer not received yet
+        std::chrono::steady_clock::time_point rate_window_start;
+        bool wakeup;                // A pipeline drained or a source failed
+        std::mutex receive_mutex;   // Serializes chunk writes arriving from different sources
+    };
+    mutable std::mutex swarm_mutex_;
+    std::condition_variable swarm_condition_;
+    std::unordered_map<std::string, std::shared_ptr<SwarmDownload>> swarm_downloads_;
+    
+    // Chunk ranges requested by swarm downloaders, served by the worker threads (guarded by work_mutex_)
+    struct RangeRequest {
+        std::string peer_id;
+        std::string transfer_id;
+        std::string remote_path;
+        uint64_t first_chunk;
+        uint64_t chunk_count;
+        uint32_t chunk_size;
+        uint64_t file_size;
+        bool merkle;                // Send the file's leaf layer first
+    };
+    std::queue<RangeRequest> range_queue_;
+    
+    // Block copies announced by delta senders, applied by the worker threads (guarded by work_mutex_)
+    struct DeltaApply {
+        std::string transfer_id;
+        nlohmann::json data;
+    };
+    std::queue<DeltaApply> delta_queue_;
+    
+    // File request callback decisions for swarm downloaders, by peer and transfer
+    std::mutex range_approvals_mutex_;
+    std::unordered_map<std::string, bool> range_approvals_;
     
     // Callbacks
     FileTransferProgressCallback progress_callback_;
@@ -504,13 +927,14 @@ private:
     uint64_t total_bytes_received_;
     uint64_t total_files_sent_;
     uint64_t total_files_received_;
+    uint64_t compressed_chunks_sent_;
+    uint64_t compression_bytes_saved_;
     std::chrono::steady_clock::time_point start_time_;
     
     // Private methods
     void initialize();
     void shutdown();
     void worker_thread_loop();
-    void cleanup_thread_loop();
     void process_transfer(const std::string& transfer_id);
     
     // Transfer management
@@ -519,32 +943,79 @@ private:
     void start_file_receive(const std::string& transfer_id);
     void start_directory_send(const std::string& transfer_id);
     void start_directory_receive(const std::string& transfer_id);
-    void handle_chunk_received(const FileChunk& chunk);
+    std::shared_ptr<DirectoryTransfer> plan_directory_transfer(const DirectoryMetadata& metadata) const;
+    void run_directory_pipeline(const std::string& transfer_id, const std::shared_ptr<DirectoryTransfer>& plan);
+    bool write_directory_pack(const DirectoryTransfer& plan, const DirectoryPart& part, const std::string& base_path,
+                              const std::string& pack_path) const;
+    bool extract_directory_pack(const std::string& part_id);
+    bool find_directory_part(const std::string& part_id, std::string& transfer_id,
+                             std::shared_ptr<DirectoryTransfer>& plan, size_t& part_index) const;
+    std::shared_ptr<FileTransferProgress> create_directory_part_progress(const FileTransferProgress& directory,
+                                                                         const DirectoryTransfer& plan, size_t part_index,
+                                                                         const std::string& local_path) const;
+    void on_directory_part_finished(const std::string& transfer_id, const std::shared_ptr<DirectoryTransfer>& plan,
+                                    size_t part_index, bool success, const std::string& error_message);
+    void cancel_directory_parts(const std::string& transfer_id);
+    
+    // Delta synchronization
+    bool is_delta_candidate(const std::string& basis_path, uint64_t file_size) const;
+    bool create_delta_signatures(const std::string& transfer_id, nlohmann::json& signatures);
+    void store_delta_signatures(const std::string& transfer_id, const nlohmann::json& signatures);
+    std::shared_ptr<DeltaSignatures> take_delta_signatures(const std::string& transfer_id);
+    void apply_delta(const std::string& transfer_id, const nlohmann::json& data);
+    
+    // Merkle verification
+    nlohmann::json create_merkle_data(const MerkleTree& tree) const;
+    void expect_merkle_root(const std::string& transfer_id, const FileMetadata& metadata);
+    void store_merkle_leaves(const std::string& transfer_id, const nlohmann::json& data);
+    bool verify_merkle_leaves(const std::string& transfer_id, uint64_t file_offset, const uint8_t* data, size_t size);
+    bool verify_remaining_merkle_leaves(const std::string& transfer_id, const std::string& temp_path);
+    bool is_range_received(const std::string& transfer_id, uint64_t begin, uint64_t end) const;
+    
+    // Chunk compression
+    nlohmann::json offered_compression() const;
+    static CompressionType choose_compression(const nlohmann::json& offered);
+    CompressionType get_send_compression(const std::string& transfer_id) const;
+    bool compress_chunk_frame(CompressionType codec, const std::vector<uint8_t>& frame, std::vector<uint8_t>& compressed) const;
+    void run_swarm_download(const std::string& transfer_id);
+    void serve_range_request(const RangeRequest& request);
+    bool on_swarm_chunk(const std::string& transfer_id, const std::string& peer_id,
+                        const ChunkFrameHeader& header, const uint8_t* chunk_data, bool valid);
+    bool fail_swarm_source(const std::string& transfer_id, const std::string& peer_id, const std::string& reason);
+    static void release_swarm_chunk_locked(SwarmDownload& swarm, uint64_t chunk_index);
+    static void release_swarm_chunks_locked(SwarmDownload& swarm, SwarmSource& source);
+    bool read_chunk_frame(FileHandle& file, uint64_t transfer_id_hash, uint64_t chunk_index, uint32_t chunk_size,
+                          uint64_t file_size, std::vector<uint8_t>& frame) const;
+    bool read_chunk_frame(FileHandle& file, uint64_t transfer_id_hash, uint64_t chunk_index, uint64_t file_offset,
+                          uint32_t data_size, uint64_t total_chunks, std::vector<uint8_t>& frame) const;
+    void handle_chunk_received(const std::string& transfer_id, uint64_t file_offset, const uint8_t* data, size_t size);
+    bool count_received_chunk(const std::string& transfer_id, FileTransferProgress& progress,
+                              uint64_t file_offset, uint64_t size, uint64_t& new_bytes);
+    void finish_received_file(const std::string& transfer_id, const FileTransferProgress& progress);
     void handle_chunk_ack(const std::string& transfer_id, uint64_t chunk_index, bool success);
     
     // File operations
     bool create_temp_file(const std::string& transfer_id, uint64_t file_size);
     bool finalize_received_file(const std::string& transfer_id, const std::string& final_path);
-    
-    // Checksum validation
-    bool verify_chunk_checksum(const FileChunk& chunk);
-    std::string calculate_chunk_checksum(const std::vector<uint8_t>& data);
+    bool verify_received_file(const std::string& transfer_id, const std::string& temp_path);
+    std::shared_ptr<FileHandle> get_temp_file_handle(const std::string& transfer_id);
+    void close_temp_file_handle(const std::string& transfer_id);
+    std::shared_ptr<ChunkSendWindow> get_send_window(const std::string& transfer_id) const;
+    void close_send_window(const std::string& transfer_id);
     
     // Network message handling
     void handle_transfer_request(const std::string& peer_id, const nlohmann::json& message);
     void handle_transfer_response(const std::string& peer_id, const nlohmann::json& message);
-    void handle_chunk_metadata_message(const std::string& peer_id, const nlohmann::json& message);
-    void handle_chunk_binary_message(const std::string& peer_id, const std::vector<uint8_t>& binary_data);
+    void handle_chunk_frame(const std::string& peer_id, const uint8_t* data, size_t size);
     void handle_chunk_ack_message(const std::string& peer_id, const nlohmann::json& message);
     void handle_transfer_control(const std::string& peer_id, const nlohmann::json& message);
     void handle_file_request(const std::string& peer_id, const nlohmann::json& message);
     void handle_directory_request(const std::string& peer_id, const nlohmann::json& message);
+    void handle_range_request(const std::string& peer_id, const nlohmann::json& message);
     
     // Message creation
     nlohmann::json create_transfer_request_message(const FileMetadata& metadata, const std::string& transfer_id);
     nlohmann::json create_transfer_response_message(const std::string& transfer_id, bool accepted, const std::string& reason = "");
-    std::vector<uint8_t> create_chunk_binary_message(const FileChunk& chunk);
-    nlohmann::json create_chunk_metadata_message(const FileChunk& chunk);
     nlohmann::json create_chunk_ack_message(const std::string& transfer_id, uint64_t chunk_index, bool success, const std::string& error = "");
     nlohmann::json create_control_message(const std::string& transfer_id, const std::string& action, const nlohmann::json& data = nlohmann::json::object());
     
@@ -552,15 +1023,17 @@ private:
     void update_transfer_progress(const std::string& transfer_id, uint64_t bytes_delta = 0);
     void complete_transfer(const std::string& transfer_id, bool success, const std::string& error_message = "");
     void move_to_completed(const std::string& transfer_id);
+    size_t trim_transfer_history_locked(std::chrono::steady_clock::time_point now);  // Caller holds transfers_mutex_
     
     // File system utilities
     static bool ensure_directory_exists(const std::string& directory_path);
     static std::string get_temp_file_path(const std::string& transfer_id, const std::string& temp_dir);
+    static std::string get_directory_part_id(const std::string& transfer_id, size_t part_index);
+    static void flatten_directory_files(const DirectoryMetadata& metadata, const std::string& prefix,
+                                        std::vector<FileMetadata>& files);
+    static bool is_safe_relative_path(const std::string& relative_path);
     static std::string extract_filename(const std::string& file_path);
     static std::string get_mime_type(const std::string& file_path);
-    
-    // Binary chunk transmission helper
-    bool parse_chunk_binary_header(const std::vector<uint8_t>& binary_data, FileChunk& chunk);
 };
 
 } // namespace librats
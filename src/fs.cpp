@@ -2,6 +2,7 @@
 #include "logger.h"
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
 #include <sys/stat.h>
 
 #ifdef _WIN32
@@ -19,6 +20,8 @@
     #include <dirent.h>
     #include <errno.h>
     #include <libgen.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
 #endif
 
 namespace librats {
@@ -407,26 +410,13 @@ std::string get_parent_directory(const char* path) {
 bool write_file_chunk(const char* path, uint64_t offset, const void* data, size_t size) {
     if (!path || !data) return false;
     
-    FILE* file = fopen(path, "r+b");
-    if (!file) {
-        // Try to create the file if it doesn't exist
-        file = fopen(path, "w+b");
-        if (!file) {
-            LOG_ERROR("FS", "Failed to open file for chunk writing: " << path);
-            return false;
-        }
-    }
-    
-    if (fseek(file, offset, SEEK_SET) != 0) {
-        LOG_ERROR("FS", "Failed to seek to offset " << offset << " in file: " << path);
-        fclose(file);
+    FileHandle file;
+    if (!file.open(path, FileOpenMode::READ_WRITE)) {
+        LOG_ERROR("FS", "Failed to open file for chunk writing: " << path);
         return false;
     }
     
-    size_t written = fwrite(data, 1, size, file);
-    fclose(file);
-    
-    if (written != size) {
+    if (!file.write_at(offset, data, size)) {
         LOG_ERROR("FS", "Failed to write complete chunk to file: " << path);
         return false;
     }
@@ -437,22 +427,13 @@ bool write_file_chunk(const char* path, uint64_t offset, const void* data, size_
 bool read_file_chunk(const char* path, uint64_t offset, void* buffer, size_t size) {
     if (!path || !buffer) return false;
     
-    FILE* file = fopen(path, "rb");
-    if (!file) {
+    FileHandle file;
+    if (!file.open(path, FileOpenMode::READ_ONLY)) {
         LOG_ERROR("FS", "Failed to open file for chunk reading: " << path);
         return false;
     }
     
-    if (fseek(file, offset, SEEK_SET) != 0) {
-        LOG_ERROR("FS", "Failed to seek to offset " << offset << " in file: " << path);
-        fclose(file);
-        return false;
-    }
-    
-    size_t bytes_read = fread(buffer, 1, size, file);
-    fclose(file);
-    
-    if (bytes_read != size) {
+    if (!file.read_at(offset, buffer, size)) {
         LOG_ERROR("FS", "Failed to read complete chunk from file: " << path);
         return false;
     }
@@ -464,20 +445,17 @@ bool read_file_chunk(const char* path, uint64_t offset, void* buffer, size_t siz
 bool create_file_with_size(const char* path, uint64_t size) {
     if (!path) return false;
     
-    FILE* file = fopen(path, "wb");
-    if (!file) {
+    FileHandle file;
+    if (!file.open(path, FileOpenMode::TRUNCATE)) {
         LOG_ERROR("FS", "Failed to create file with size: " << path);
         return false;
     }
     
-    if (size > 0) {
-        // Pre-allocate file space by seeking to size-1 and writing a byte
-        if (fseek(file, size - 1, SEEK_SET) == 0) {
-            fputc(0, file);
-        }
+    if (size > 0 && !file.preallocate(size)) {
+        LOG_ERROR("FS", "Failed to pre-allocate " << size << " bytes for file: " << path);
+        return false;
     }
     
-    fclose(file);
     return true;
 }
 
@@ -621,4 +599,248 @@ bool list_directory(const char* path, std::vector<DirectoryEntry>& entries) {
     return true;
 }
 
+//=============================================================================
+// FileHandle Implementation
+//=============================================================================
+
+FileHandle::FileHandle()
+#ifdef _WIN32
+    : handle_(INVALID_HANDLE_VALUE), mapping_handle_(nullptr),
+#else
+    : fd_(-1),
+#endif
+      mapped_data_(nullptr), mapped_size_(0) {
+}
+
+FileHandle::~FileHandle() {
+    close();
+}
+
+bool FileHandle::is_open() const {
+#ifdef _WIN32
+    return handle_ != INVALID_HANDLE_VALUE;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+bool FileHandle::open(const char* path, FileOpenMode mode) {
+    close();
+    if (!path) return false;
+
+#ifdef _WIN32
+    DWORD access_flags = GENERIC_READ;
+    DWORD disposition = OPEN_EXISTING;
+    if (mode == FileOpenMode::READ_WRITE) {
+        access_flags |= GENERIC_WRITE;
+        disposition = OPEN_ALWAYS;
+    } else if (mode == FileOpenMode::TRUNCATE) {
+        access_flags |= GENERIC_WRITE;
+        disposition = CREATE_ALWAYS;
+    }
+    HANDLE handle = CreateFileA(path, access_flags, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    handle_ = handle;
+#else
+    int flags = O_RDONLY;
+    if (mode == FileOpenMode::READ_WRITE) {
+        flags = O_RDWR | O_CREAT;
+    } else if (mode == FileOpenMode::TRUNCATE) {
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+    }
+#ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#endif
+    int fd;
+    do {
+        fd = ::open(path, flags, 0644);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return false;
+    }
+    fd_ = fd;
+#endif
+
+    path_ = path;
+    return true;
+}
+
+void FileHandle::close() {
+#ifdef _WIN32
+    if (mapped_data_) {
+        UnmapViewOfFile(mapped_data_);
+    }
+    if (mapping_handle_) {
+        CloseHandle(mapping_handle_);
+        mapping_handle_ = nullptr;
+    }
+    if (handle_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mapped_data_) {
+        munmap(mapped_data_, static_cast<size_t>(mapped_size_));
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+    mapped_data_ = nullptr;
+    mapped_size_ = 0;
+    path_.clear();
+}
+
+bool FileHandle::read_at(uint64_t offset, void* buffer, size_t size) {
+    if (!is_open() || (!buffer && size > 0)) return false;
+
+    if (mapped_data_) {
+        if (offset > mapped_size_ || size > mapped_size_ - offset) {
+            return false;
+        }
+        memcpy(buffer, mapped_data_ + offset, size);
+        return true;
+    }
+
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD request = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD bytes_read = 0;
+        if (!ReadFile(handle_, out, request, &bytes_read, &overlapped) || bytes_read == 0) {
+            return false;
+        }
+#else
+        ssize_t bytes_read = pread(fd_, out, size, static_cast<off_t>(offset));
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            return false;   // Error or unexpected end of file
+        }
+#endif
+        out += bytes_read;
+        offset += static_cast<uint64_t>(bytes_read);
+        size -= static_cast<size_t>(bytes_read);
+    }
+    return true;
+}
+
+bool FileHandle::write_at(uint64_t offset, const void* data, size_t size) {
+    if (!is_open() || (!data && size > 0)) return false;
+
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+#ifdef _WIN32
+        DWORD request = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD bytes_written = 0;
+        if (!WriteFile(handle_, in, request, &bytes_written, &overlapped) || bytes_written == 0) {
+            return false;
+        }
+#else
+        ssize_t bytes_written = pwrite(fd_, in, size, static_cast<off_t>(offset));
+        if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_written <= 0) {
+            return false;
+        }
+#endif
+        in += bytes_written;
+        offset += static_cast<uint64_t>(bytes_written);
+        size -= static_cast<size_t>(bytes_written);
+    }
+    return true;
+}
+
+bool FileHandle::map_read_only() {
+    if (!is_open()) return false;
+    if (mapped_data_) return true;
+
+    int64_t file_size = size();
+    if (file_size <= 0 || static_cast<uint64_t>(file_size) > SIZE_MAX) {
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+    mapping_handle_ = mapping;
+#else
+    void* view = mmap(nullptr, static_cast<size_t>(file_size), PROT_READ, MAP_SHARED, fd_, 0);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+#ifdef POSIX_MADV_SEQUENTIAL
+    // Chunks are sent front to back, let the kernel read ahead aggressively
+    posix_madvise(view, static_cast<size_t>(file_size), POSIX_MADV_SEQUENTIAL);
+#endif
+#endif
+
+    mapped_data_ = static_cast<uint8_t*>(view);
+    mapped_size_ = static_cast<uint64_t>(file_size);
+    return true;
+}
+
+bool FileHandle::preallocate(uint64_t size) {
+    if (!is_open()) return false;
+
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(handle_, end, nullptr, FILE_BEGIN) || !SetEndOfFile(handle_)) {
+        return false;
+    }
+    // Skips zero-filling of the new range; requires SE_MANAGE_VOLUME_NAME and is
+    // silently skipped without it. Every byte is overwritten by received chunks.
+    SetFileValidData(handle_, static_cast<LONGLONG>(size));
+    return true;
+#else
+#if defined(__linux__) || defined(__FreeBSD__)
+    // Reserve the blocks up front so the file is laid out contiguously; fall back to
+    // a sparse extension on filesystems without fallocate support
+    if (posix_fallocate(fd_, 0, static_cast<off_t>(size)) == 0 &&
+        this->size() == static_cast<int64_t>(size)) {
+        return true;
+    }
+#endif
+    return ftruncate(fd_, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+int64_t FileHandle::size() const {
+    if (!is_open()) return -1;
+
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle_, &file_size)) {
+        return -1;
+    }
+    return static_cast<int64_t>(file_size.QuadPart);
+#else
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(st.st_size);
+#endif
+}
+
 } // namespace librats 
\ No newline at end of file
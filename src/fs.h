@@ -51,6 +51,98 @@ bool read_file_chunk(const char* path, uint64_t offset, void* buffer, size_t siz
 bool create_file_with_size(const char* path, uint64_t size); // Pre-allocate file space
 bool rename_file(const char* old_path, const char* new_path);
 
+// Open modes for FileHandle
+enum class FileOpenMode {
+    READ_ONLY,      // Existing file, reads only
+    READ_WRITE,     // Existing file is opened, missing file is created
+    TRUNCATE        // File is created or truncated to zero length
+};
+
+/**
+ * Persistent file handle for positional chunk I/O.
+ * Keeps a single descriptor open and reads/writes at explicit offsets
+ * (pread/pwrite) so repeated chunk access needs no reopen or seek.
+ * Positional reads and writes may be issued from several threads at once.
+ */
+class RATS_API FileHandle {
+public:
+    FileHandle();
+    ~FileHandle();
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    /**
+     * Open a file, closing any file held before
+     * @param path File path
+     * @param mode Open mode
+     * @return true if opened successfully
+     */
+    bool open(const char* path, FileOpenMode mode);
+
+    /**
+     * Unmap and close the file
+     */
+    void close();
+
+    bool is_open() const;
+    const std::string& path() const { return path_; }
+
+    /**
+     * Read exactly size bytes at offset (served from the mapping when mapped)
+     * @return true if all bytes were read
+     */
+    bool read_at(uint64_t offset, void* buffer, size_t size);
+
+    /**
+     * Write exactly size bytes at offset, extending the file if needed
+     * @return true if all bytes were written
+     */
+    bool write_at(uint64_t offset, const void* data, size_t size);
+
+    /**
+     * Map the whole file read-only; subsequent read_at calls copy from the mapping.
+     * Falls back to positional reads if mapping is not possible.
+     * @return true if the file is mapped
+     */
+    bool map_read_only();
+
+    bool is_mapped() const { return mapped_data_ != nullptr; }
+    const uint8_t* mapped_data() const { return mapped_data_; }
+    uint64_t mapped_size() const { return mapped_size_; }
+
+    /**
+     * Reserve disk space and set the file length to size
+     * (fallocate on POSIX, SetEndOfFile/SetFileValidData on Windows)
+     * @return true if the file has the requested length
+     */
+    bool preallocate(uint64_t size);
+
+    /**
+     * Get the current file length
+     * @return File size in bytes, or -1 on error
+     */
+    int64_t size() const;
+
+    // Descriptor (POSIX) or HANDLE (Windows) of the open file, for kernel copies such as sendfile
+#ifdef _WIN32
+    void* native_handle() const { return handle_; }
+#else
+    int native_handle() const { return fd_; }
+#endif
+
+private:
+#ifdef _WIN32
+    void* handle_;
+    void* mapping_handle_;
+#else
+    int fd_;
+#endif
+    std::string path_;
+    uint8_t* mapped_data_;
+    uint64_t mapped_size_;
+};
+
 // Directory listing
 struct DirectoryEntry {
     std::string name;
@@ -2,9 +2,12 @@
 #include "librats.h"
 #include "logger.h"
 #include "sha1.h"
+#include "metrics.h"
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <cmath>
 
 // GossipSub logging macros
 #define LOG_GOSSIPSUB_DEBUG(message) LOG_DEBUG("gossipsub", message)
@@ -26,6 +29,8 @@ std::string gossipsub_message_type_to_string(GossipSubMessageType type) {
         case GossipSubMessageType::IHAVE: return "ihave";
         case GossipSubMessageType::IWANT: return "iwant";
         case GossipSubMessageType::HEARTBEAT: return "heartbeat";
+        case GossipSubMessageType::IDONTWANT: return "idontwant";
+        case GossipSubMessageType::CHUNK: return "chunk";
         default: return "unknown";
     }
 }
@@ -40,747 +45,2257 @@ GossipSubMessageType string_to_gossipsub_message_type(const std::string& str) {
     if (str == "ihave") return GossipSubMessageType::IHAVE;
     if (str == "iwant") return GossipSubMessageType::IWANT;
     if (str == "heartbeat") return GossipSubMessageType::HEARTBEAT;
+    if (str == "idontwant") return GossipSubMessageType::IDONTWANT;
+    if (str == "chunk") return GossipSubMessageType::CHUNK;
     return GossipSubMessageType::HEARTBEAT; // Default fallback
 }
 
 //=============================================================================
-// PeerScore Implementation
+// GossipSubRecord / GossipSubFrame Implementation
 //=============================================================================
 
-void PeerScore::update_score() {
-    auto now = std::chrono::steady_clock::now();
-    auto time_since_update = std::chrono::duration_cast<std::chrono::seconds>(now - last_updated).count();
-    auto connection_duration = std::chrono::duration_cast<std::chrono::seconds>(now - connected_since).count();
-    
-    // Update topic score based on participation
-    topic_score = (std::min)(10.0, connection_duration / 60.0); // Up to 10 points for long connections
-    
-    // Update delivery score
-    if (messages_delivered > 0) {
-        delivery_score = (std::min)(20.0, static_cast<double>(messages_delivered) / 10.0);
-    }
-    
-    // Update mesh behavior score
-    double graft_prune_ratio = (graft_requests + prune_requests > 0) ? 
-        static_cast<double>(graft_requests) / (graft_requests + prune_requests) : 0.5;
-    mesh_behavior_score = (graft_prune_ratio - 0.5) * 10.0; // -5 to +5 points
-    
-    // Update invalid message penalty
-    if (messages_invalid > 0) {
-        invalid_message_score = -static_cast<double>(messages_invalid) * 5.0; // -5 points per invalid message
-    }
-    
-    // Calculate total score
-    score = topic_score + delivery_score + mesh_behavior_score + invalid_message_score;
-    
-    last_updated = now;
+nlohmann::json GossipSubRecord::to_payload() const {
+    nlohmann::json payload;
+    payload["topic"] = topic;
+    switch (type) {
+        case GossipSubMessageType::PUBLISH:
+            payload["message"] = message;
+            payload["message_id"] = message_id;
+            payload["sender_peer_id"] = sender_peer_id;
+            payload["timestamp"] = timestamp;
+            break;
+        case GossipSubMessageType::CHUNK:
+            payload["message"] = message;
+            payload["message_id"] = message_id;
+            payload["sender_peer_id"] = sender_peer_id;
+            payload["timestamp"] = timestamp;
+            payload["chunk_index"] = chunk_index;
+            payload["chunk_count"] = chunk_count;
+            break;
+        case GossipSubMessageType::IHAVE:
+        case GossipSubMessageType::IWANT:
+        case GossipSubMessageType::IDONTWANT:
+            payload["message_ids"] = message_ids;
+            break;
+        default:
+            break;
+    }
+    return payload;
 }
 
-//=============================================================================
-// GossipSub Implementation
-//=============================================================================
-
-GossipSub::GossipSub(RatsClient& rats_client, const GossipSubConfig& config)
-    : rats_client_(rats_client), config_(config), running_(false), rng_(std::random_device{}()) {
-    
-    // Register message handler for gossipsub messages
-    rats_client_.on("gossipsub", [this](const std::string& peer_id, const nlohmann::json& message) {
-        handle_gossipsub_message(peer_id, message);
-    });
+GossipSubRecord GossipSubRecord::from_payload(GossipSubMessageType type, const nlohmann::json& payload) {
+    GossipSubRecord record(type, payload.value("topic", ""));
+    switch (type) {
+        case GossipSubMessageType::PUBLISH:
+            record.message = payload.value("message", "");
+            record.message_id = payload.value("message_id", "");
+            record.sender_peer_id = payload.value("sender_peer_id", "");
+            record.timestamp = payload.value("timestamp", int64_t(0));
+            break;
+        case GossipSubMessageType::CHUNK:
+            record.message = payload.value("message", "");
+            record.message_id = payload.value("message_id", "");
+            record.sender_peer_id = payload.value("sender_peer_id", "");
+            record.timestamp = payload.value("timestamp", int64_t(0));
+            record.chunk_index = payload.value("chunk_index", uint32_t(0));
+            record.chunk_count = payload.value("chunk_count", uint32_t(0));
+            break;
+        case GossipSubMessageType::IHAVE:
+        case GossipSubMessageType::IWANT:
+        case GossipSubMessageType::IDONTWANT:
+            record.message_ids = payload.value("message_ids", std::vector<std::string>());
+            break;
+        default:
+            break;
+    }
+    return record;
 }
 
-GossipSub::~GossipSub() {
-    stop();
+namespace {
+
+const uint8_t GOSSIPSUB_FRAME_MAGIC[4] = {'G', 'S', 'U', 'B'};
+const uint8_t ID_TAG_SHA1 = 0;
+const uint8_t ID_TAG_STRING = 1;
+const size_t SHA1_HEX_SIZE = 40;
+
+// Message rates over all GossipSub instances in the process
+struct GossipSubMetrics {
+    MetricCounter& published;
+    MetricCounter& publish_sends;
+    MetricCounter& received;
+    MetricCounter& duplicates;
+    MetricCounter& delivered;
+    MetricCounter& forwarded;
+};
+
+GossipSubMetrics& gossipsub_metrics() {
+    static MetricsRegistry& registry = MetricsRegistry::getInstance();
+    static GossipSubMetrics metrics{
+        registry.counter("librats_gossipsub_published_total", "Messages published locally"),
+        registry.counter("librats_gossipsub_publish_sends_total", "Peers a locally published message was sent to"),
+        registry.counter("librats_gossipsub_received_total", "PUBLISH records received from peers"),
+        registry.counter("librats_gossipsub_duplicates_total", "Received PUBLISH records that were already seen"),
+        registry.counter("librats_gossipsub_delivered_total", "Received messages delivered to a subscribed topic"),
+        registry.counter("librats_gossipsub_forwarded_total", "Peers a received message was forwarded to")
+    };
+    return metrics;
 }
 
-bool GossipSub::start() {
-    if (running_.load()) {
-        return false; // Already running
+// Payloads share the data bandwidth, chunks of large messages yield to it, the rest is control
+SendPriority send_priority_for(GossipSubMessageType type) {
+    switch (type) {
+        case GossipSubMessageType::PUBLISH: return SendPriority::DATA;
+        case GossipSubMessageType::CHUNK: return SendPriority::BULK;
+        default: return SendPriority::CONTROL;
     }
-    
-    running_.store(true);
-    
-    // Start heartbeat thread
-    heartbeat_thread_ = std::thread(&GossipSub::heartbeat_loop, this);
-    
-    LOG_GOSSIPSUB_INFO("GossipSub service started");
-    return true;
 }
 
-void GossipSub::stop() {
-    if (!running_.load()) {
-        return; // Already stopped
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
     }
+    out.push_back(static_cast<uint8_t>(value));
+}
 
-    LOG_GOSSIPSUB_INFO("GossipSub service stopping");
+void put_bytes(std::vector<uint8_t>& out, const std::string& value) {
+    put_varint(out, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
 
-    {
-        // Unsubscribe from all topics
-        std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-        for (const auto& topic : subscribed_topics_) {
-            nlohmann::json payload;
-            payload["topic"] = topic;
-            broadcast_gossipsub_message(GossipSubMessageType::UNSUBSCRIBE, payload);
-        }
-        subscribed_topics_.clear();
-    }
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
 
-    running_.store(false);
-    
-    // Notify the heartbeat thread to wake up immediately
-    {
-        std::lock_guard<std::mutex> lock(heartbeat_mutex_);
-        heartbeat_cv_.notify_all();
+void put_id(std::vector<uint8_t>& out, const std::string& id) {
+    bool is_sha1_hex = id.size() == SHA1_HEX_SIZE &&
+        std::all_of(id.begin(), id.end(), [](char c) { return hex_value(c) >= 0; });
+    if (!is_sha1_hex) {
+        out.push_back(ID_TAG_STRING);
+        put_bytes(out, id);
+        return;
     }
     
-    // Join heartbeat thread with timeout to avoid infinite hang
-    if (heartbeat_thread_.joinable()) {
-        heartbeat_thread_.join();
+    out.push_back(ID_TAG_SHA1);
+    for (size_t i = 0; i < SHA1_HEX_SIZE; i += 2) {
+        out.push_back(static_cast<uint8_t>((hex_value(id[i]) << 4) | hex_value(id[i + 1])));
     }
-    
-    LOG_GOSSIPSUB_INFO("GossipSub service stopped");
-}
-
-bool GossipSub::is_running() const {
-    return running_.load();
 }
 
-//=============================================================================
-// Topic Management
-//=============================================================================
-
-bool GossipSub::subscribe(const std::string& topic) {
-    std::lock_guard<std::mutex> lock(topics_mutex_);
+// Bounds-checked reader over a received frame
+class FrameReader {
+public:
+    FrameReader(const uint8_t* data, size_t size) : pos_(data), end_(data + size) {}
     
-    if (subscribed_topics_.count(topic)) {
-        return false; // Already subscribed
-    }
+    bool at_end() const { return pos_ == end_; }
     
-    subscribed_topics_.insert(topic);
+    bool byte(uint8_t& value) {
+        if (pos_ == end_) {
+            return false;
+        }
+        value = *pos_++;
+        return true;
+    }
     
-    // Get or create topic subscription
-    TopicSubscription* topic_sub = get_or_create_topic(topic);
-    if (!topic_sub) {
-        subscribed_topics_.erase(topic);
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b;
+            if (!byte(b)) {
+                return false;
+            }
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
         return false;
     }
     
-    // Broadcast subscription to all peers
-    nlohmann::json payload;
-    payload["topic"] = topic;
-    broadcast_gossipsub_message(GossipSubMessageType::SUBSCRIBE, payload);
-    
-    // Start building mesh for this topic
-    maintain_mesh(topic);
-    
-            LOG_GOSSIPSUB_INFO("Subscribed to topic: " << topic);
-    return true;
-}
-
-bool GossipSub::unsubscribe(const std::string& topic) {
-    std::lock_guard<std::mutex> lock(topics_mutex_);
-    
-    if (!subscribed_topics_.count(topic)) {
-        return false; // Not subscribed
+    bool bytes(std::string& value) {
+        uint64_t length;
+        if (!varint(length) || length > static_cast<uint64_t>(end_ - pos_)) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(pos_), static_cast<size_t>(length));
+        pos_ += length;
+        return true;
     }
     
-    subscribed_topics_.erase(topic);
-    
-    // Broadcast unsubscription to all peers
-    nlohmann::json payload;
-    payload["topic"] = topic;
-    broadcast_gossipsub_message(GossipSubMessageType::UNSUBSCRIBE, payload);
-    
-    // Leave mesh for this topic
-    auto topic_it = topics_.find(topic);
-    if (topic_it != topics_.end()) {
-        TopicSubscription* topic_sub = topic_it->second.get();
-        
-        // Send PRUNE to all mesh peers
-        for (const auto& peer_id : topic_sub->mesh_peers) {
-            nlohmann::json prune_payload;
-            prune_payload["topic"] = topic;
-            send_gossipsub_message(peer_id, GossipSubMessageType::PRUNE, prune_payload);
+    bool id(std::string& value) {
+        uint8_t tag;
+        if (!byte(tag)) {
+            return false;
+        }
+        if (tag == ID_TAG_STRING) {
+            return bytes(value);
+        }
+        if (tag != ID_TAG_SHA1 || end_ - pos_ < static_cast<ptrdiff_t>(SHA1_HEX_SIZE / 2)) {
+            return false;
         }
         
-        topic_sub->mesh_peers.clear();
+        static const char digits[] = "0123456789abcdef";
+        value.resize(SHA1_HEX_SIZE);
+        for (size_t i = 0; i < SHA1_HEX_SIZE / 2; ++i) {
+            value[2 * i] = digits[pos_[i] >> 4];
+            value[2 * i + 1] = digits[pos_[i] & 0x0F];
+        }
+        pos_ += SHA1_HEX_SIZE / 2;
+        return true;
     }
     
-            LOG_GOSSIPSUB_INFO("Unsubscribed from topic: " << topic);
-    return true;
-}
+private:
+    const uint8_t* pos_;
+    const uint8_t* end_;
+};
 
-bool GossipSub::is_subscribed(const std::string& topic) const {
-    std::lock_guard<std::mutex> lock(topics_mutex_);
-    return subscribed_topics_.count(topic) > 0;
-}
+} // anonymous namespace
 
-std::vector<std::string> GossipSub::get_subscribed_topics() const {
-    std::lock_guard<std::mutex> lock(topics_mutex_);
-    return std::vector<std::string>(subscribed_topics_.begin(), subscribed_topics_.end());
+void GossipSubFrame::begin(std::vector<uint8_t>& out) {
+    out.insert(out.end(), GOSSIPSUB_FRAME_MAGIC, GOSSIPSUB_FRAME_MAGIC + sizeof(GOSSIPSUB_FRAME_MAGIC));
+    out.push_back(VERSION);
 }
 
-//=============================================================================
-// Message Publishing
-//=============================================================================
-
-bool GossipSub::publish(const std::string& topic, const std::string& message) {
-    if (!running_.load()) {
-        return false;
+void GossipSubFrame::append(const GossipSubRecord& record, std::vector<uint8_t>& out) {
+    out.push_back(static_cast<uint8_t>(record.type));
+    put_bytes(out, record.topic);
+    
+    switch (record.type) {
+        case GossipSubMessageType::PUBLISH:
+            put_id(out, record.message_id);
+            put_id(out, record.sender_peer_id);
+            put_varint(out, static_cast<uint64_t>((std::max)(record.timestamp, int64_t(0))));
+            put_bytes(out, record.message);
+            break;
+        case GossipSubMessageType::CHUNK:
+            put_id(out, record.message_id);
+            put_id(out, record.sender_peer_id);
+            put_varint(out, static_cast<uint64_t>((std::max)(record.timestamp, int64_t(0))));
+            put_varint(out, record.chunk_index);
+            put_varint(out, record.chunk_count);
+            put_bytes(out, record.message);
+            break;
+        case GossipSubMessageType::IHAVE:
+        case GossipSubMessageType::IWANT:
+        case GossipSubMessageType::IDONTWANT:
+            put_varint(out, record.message_ids.size());
+            for (const auto& id : record.message_ids) {
+                put_id(out, id);
+            }
+            break;
+        default:
+            break;
     }
-    
-    std::string our_peer_id = rats_client_.get_our_peer_id();
-    std::string message_id = generate_message_id(topic, message, our_peer_id);
-    
-    // Check if we've already seen this message
-    if (is_message_seen(message_id)) {
+}
+
+bool GossipSubFrame::decode(const uint8_t* data, size_t size, std::vector<GossipSubRecord>& records) {
+    if (!is_gossipsub_frame(data, size) || size < HEADER_SIZE || data[4] != VERSION) {
         return false;
     }
     
-    // Cache the message
-    cache_message(message_id, topic, message, our_peer_id);
-    
-    // Create publish message
-    nlohmann::json payload;
-    payload["topic"] = topic;
-    payload["message"] = message;
-    payload["message_id"] = message_id;
-    payload["sender_peer_id"] = our_peer_id;
-    payload["timestamp"] = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count();
-    
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-    
-    // If we're subscribed to this topic, send to mesh peers
-    if (subscribed_topics_.count(topic)) {
-        auto topic_it = topics_.find(topic);
-        if (topic_it != topics_.end()) {
-            TopicSubscription* topic_sub = topic_it->second.get();
-            
-            for (const auto& peer_id : topic_sub->mesh_peers) {
-                if (is_peer_score_acceptable(peer_id, config_.score_threshold_publish)) {
-                    send_gossipsub_message(peer_id, GossipSubMessageType::PUBLISH, payload);
+    FrameReader reader(data + HEADER_SIZE, size - HEADER_SIZE);
+    while (!reader.at_end()) {
+        uint8_t type;
+        if (!reader.byte(type) || type > static_cast<uint8_t>(GossipSubMessageType::CHUNK)) {
+            return false;
+        }
+        
+        GossipSubRecord record;
+        record.type = static_cast<GossipSubMessageType>(type);
+        if (!reader.bytes(record.topic)) {
+            return false;
+        }
+        
+        switch (record.type) {
+            case GossipSubMessageType::PUBLISH: {
+                uint64_t timestamp;
+                if (!reader.id(record.message_id) || !reader.id(record.sender_peer_id) ||
+                    !reader.varint(timestamp) || !reader.bytes(record.message)) {
+                    return false;
                 }
+                record.timestamp = static_cast<int64_t>(timestamp);
+                break;
             }
-        }
-    } else {
-        // If not subscribed, use fanout
-        TopicSubscription* topic_sub = get_or_create_topic(topic);
-        if (topic_sub) {
-            // Select fanout peers if we don't have enough
-            if (topic_sub->fanout_peers.size() < static_cast<size_t>(config_.fanout_size)) {
-                std::vector<std::string> candidates = select_peers_for_gossip(topic, 
-                    config_.fanout_size - static_cast<int>(topic_sub->fanout_peers.size()), topic_sub->fanout_peers);
-                for (const auto& peer_id : candidates) {
-                    topic_sub->fanout_peers.insert(peer_id);
+            case GossipSubMessageType::CHUNK: {
+                uint64_t timestamp, chunk_index, chunk_count;
+                if (!reader.id(record.message_id) || !reader.id(record.sender_peer_id) ||
+                    !reader.varint(timestamp) || !reader.varint(chunk_index) || !reader.varint(chunk_count) ||
+                    chunk_index > UINT32_MAX || chunk_count > UINT32_MAX || !reader.bytes(record.message)) {
+                    return false;
                 }
+                record.timestamp = static_cast<int64_t>(timestamp);
+                record.chunk_index = static_cast<uint32_t>(chunk_index);
+                record.chunk_count = static_cast<uint32_t>(chunk_count);
+                break;
             }
-            
-            // Send to fanout peers
-            for (const auto& peer_id : topic_sub->fanout_peers) {
-                if (is_peer_score_acceptable(peer_id, config_.score_threshold_publish)) {
-                    send_gossipsub_message(peer_id, GossipSubMessageType::PUBLISH, payload);
+            case GossipSubMessageType::IHAVE:
+            case GossipSubMessageType::IWANT:
+            case GossipSubMessageType::IDONTWANT: {
+                uint64_t count;
+                if (!reader.varint(count)) {
+                    return false;
+                }
+                // Every id takes at least two bytes, which bounds the reservation by the frame size
+                record.message_ids.reserve(static_cast<size_t>((std::min)(count, static_cast<uint64_t>(size / 2))));
+                for (uint64_t i = 0; i < count; ++i) {
+                    std::string id;
+                    if (!reader.id(id)) {
+                        return false;
+                    }
+                    record.message_ids.push_back(std::move(id));
                 }
+                break;
             }
+            default:
+                break;
         }
+        
+        records.push_back(std::move(record));
     }
     
-    LOG_GOSSIPSUB_DEBUG("Published message to topic: " << topic << " (ID: " << message_id << ")");
     return true;
 }
 
-bool GossipSub::publish(const std::string& topic, const nlohmann::json& message) {
-    return publish(topic, message.dump());
+bool GossipSubFrame::is_gossipsub_frame(const uint8_t* data, size_t size) {
+    return data && size >= sizeof(GOSSIPSUB_FRAME_MAGIC) &&
+           std::memcmp(data, GOSSIPSUB_FRAME_MAGIC, sizeof(GOSSIPSUB_FRAME_MAGIC)) == 0;
 }
 
 //=============================================================================
-// Message Handling
+// PeerScore Implementation
 //=============================================================================
 
-void GossipSub::handle_gossipsub_message(const std::string& peer_id, const nlohmann::json& message) {
-    try {
-        std::string type_str = message.value("type", "");
-        GossipSubMessageType type = string_to_gossipsub_message_type(type_str);
-        nlohmann::json payload = message.value("payload", nlohmann::json::object());
-        
-        LOG_GOSSIPSUB_DEBUG("Received gossipsub " << type_str << " message from " << peer_id);
-        
-        switch (type) {
-            case GossipSubMessageType::SUBSCRIBE:
-                handle_subscribe(peer_id, payload);
-                break;
-            case GossipSubMessageType::UNSUBSCRIBE:
-                handle_unsubscribe(peer_id, payload);
-                break;
-            case GossipSubMessageType::PUBLISH:
-                handle_publish(peer_id, payload);
-                break;
-            case GossipSubMessageType::GOSSIP:
-                handle_gossip(peer_id, payload);
-                break;
-            case GossipSubMessageType::GRAFT:
-                handle_graft(peer_id, payload);
-                break;
-            case GossipSubMessageType::PRUNE:
-                handle_prune(peer_id, payload);
-                break;
-            case GossipSubMessageType::IHAVE:
-                handle_ihave(peer_id, payload);
-                break;
-            case GossipSubMessageType::IWANT:
-                handle_iwant(peer_id, payload);
-                break;
-            case GossipSubMessageType::HEARTBEAT:
-                handle_heartbeat(peer_id, payload);
-                break;
-        }
-        
-    } catch (const std::exception& e) {
-        LOG_GOSSIPSUB_ERROR("Failed to handle gossipsub message from " << peer_id << ": " << e.what());
-        
-        // Update peer score for invalid message
-        std::lock_guard<std::mutex> scores_lock(scores_mutex_);
-        auto score_it = peer_scores_.find(peer_id);
-        if (score_it != peer_scores_.end()) {
-            score_it->second->messages_invalid++;
-            score_it->second->update_score();
-        }
-    }
+void PeerScore::graft(const std::string& topic) {
+    TopicPeerScore& stats = topics[topic];
+    stats.in_mesh = true;
+    stats.grafted_at = std::chrono::steady_clock::now();
+    stats.mesh_time = 0.0;
+    stats.mesh_message_deliveries_active = false;
+    refresh_topic(topic, stats);
 }
 
-void GossipSub::handle_subscribe(const std::string& peer_id, const nlohmann::json& payload) {
-    std::string topic = payload.value("topic", "");
-    if (topic.empty()) {
-        return;
-    }
-    
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-    TopicSubscription* topic_sub = get_or_create_topic(topic);
-    if (!topic_sub) {
+void PeerScore::prune(const std::string& topic) {
+    auto topic_it = topics.find(topic);
+    if (topic_it == topics.end() || !topic_it->second.in_mesh) {
         return;
     }
     
-    // Add peer to subscribers
-    bool was_new = topic_sub->subscribers.insert(peer_id).second;
-    
-    if (was_new) {
-                    LOG_GOSSIPSUB_DEBUG("Peer " << peer_id << " subscribed to topic: " << topic);
-        
-        // Call peer joined handler
-        std::lock_guard<std::mutex> handlers_lock(handlers_mutex_);
-        auto handler_it = peer_joined_handlers_.find(topic);
-        if (handler_it != peer_joined_handlers_.end()) {
-            try {
-                handler_it->second(topic, peer_id);
-            } catch (const std::exception& e) {
-                LOG_GOSSIPSUB_ERROR("Exception in peer joined handler for topic '" << topic << "': " << e.what());
-            }
-        }
-        
-        // If we're subscribed to this topic, consider adding peer to mesh
-        if (subscribed_topics_.count(topic)) {
-            maintain_mesh(topic);
-        }
+    // A delivery deficit at the time the peer leaves the mesh is kept as a sticky penalty (P3b)
+    TopicPeerScore& stats = topic_it->second;
+    const TopicScoreParams& params = params_.topic_params(topic);
+    if (stats.mesh_message_deliveries_active &&
+        stats.mesh_message_deliveries < params.mesh_message_deliveries_threshold) {
+        double deficit = params.mesh_message_deliveries_threshold - stats.mesh_message_deliveries;
+        stats.mesh_failure_penalty += deficit * deficit;
     }
+    stats.in_mesh = false;
+    stats.mesh_time = 0.0;
+    stats.mesh_message_deliveries_active = false;
+    refresh_topic(topic, stats);
 }
 
-void GossipSub::handle_unsubscribe(const std::string& peer_id, const nlohmann::json& payload) {
-    std::string topic = payload.value("topic", "");
-    if (topic.empty()) {
-        return;
-    }
-    
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
-        return;
+void PeerScore::deliver_first_message(const std::string& topic) {
+    TopicPeerScore& stats = topics[topic];
+    const TopicScoreParams& params = params_.topic_params(topic);
+    stats.first_message_deliveries = (std::min)(stats.first_message_deliveries + 1.0,
+                                                params.first_message_deliveries_cap);
+    if (stats.in_mesh) {
+        stats.mesh_message_deliveries = (std::min)(stats.mesh_message_deliveries + 1.0,
+                                                   params.mesh_message_deliveries_cap);
     }
+    refresh_topic(topic, stats);
+}
+
+void PeerScore::reject_message(const std::string& topic) {
+    TopicPeerScore& stats = topics[topic];
+    stats.invalid_message_deliveries += 1.0;
+    refresh_topic(topic, stats);
+}
+
+void PeerScore::add_behaviour_penalty(double count) {
+    behaviour_penalty += count;
+    refresh_score();
+}
+
+void PeerScore::set_application_score(double value) {
+    application_score = value;
+    refresh_score();
+}
+
+void PeerScore::set_ip_colocation_factor(double value) {
+    ip_colocation_factor = value;
+    refresh_score();
+}
+
+void PeerScore::decay() {
+    auto now = std::chrono::steady_clock::now();
+    auto decay_counter = [this](double& value, double factor) {
+        value *= factor;
+        if (value < params_.decay_to_zero) {
+            value = 0.0;
+        }
+    };
     
-    TopicSubscription* topic_sub = topic_it->second.get();
-    
-    // Remove peer from subscribers and mesh
-    bool was_subscribed = topic_sub->subscribers.erase(peer_id) > 0;
-    bool was_in_mesh = topic_sub->mesh_peers.erase(peer_id) > 0;
-    topic_sub->fanout_peers.erase(peer_id);
-    
-    if (was_subscribed) {
-                    LOG_GOSSIPSUB_DEBUG("Peer " << peer_id << " unsubscribed from topic: " << topic);
+    for (auto topic_it = topics.begin(); topic_it != topics.end();) {
+        TopicPeerScore& stats = topic_it->second;
+        const TopicScoreParams& params = params_.topic_params(topic_it->first);
         
-        // Call peer left handler
-        std::lock_guard<std::mutex> handlers_lock(handlers_mutex_);
-        auto handler_it = peer_left_handlers_.find(topic);
-        if (handler_it != peer_left_handlers_.end()) {
-            try {
-                handler_it->second(topic, peer_id);
-            } catch (const std::exception& e) {
-                LOG_GOSSIPSUB_ERROR("Exception in peer left handler for topic '" << topic << "': " << e.what());
+        decay_counter(stats.first_message_deliveries, params.first_message_deliveries_decay);
+        decay_counter(stats.mesh_message_deliveries, params.mesh_message_deliveries_decay);
+        decay_counter(stats.mesh_failure_penalty, params.mesh_failure_penalty_decay);
+        decay_counter(stats.invalid_message_deliveries, params.invalid_message_deliveries_decay);
+        
+        if (stats.in_mesh) {
+            auto in_mesh = now - stats.grafted_at;
+            stats.mesh_time = std::chrono::duration<double>(in_mesh).count();
+            if (in_mesh >= params.mesh_message_deliveries_activation) {
+                stats.mesh_message_deliveries_active = true;
             }
         }
         
-        // If peer was in mesh and we're subscribed, maintain mesh
-        if (was_in_mesh && subscribed_topics_.count(topic)) {
-            maintain_mesh(topic);
+        refresh_topic(topic_it->first, stats);
+        
+        // Forget topics that no longer contribute anything
+        if (!stats.in_mesh && stats.first_message_deliveries == 0.0 && stats.mesh_message_deliveries == 0.0 &&
+            stats.mesh_failure_penalty == 0.0 && stats.invalid_message_deliveries == 0.0) {
+            topic_it = topics.erase(topic_it);
+        } else {
+            ++topic_it;
         }
     }
     
-    // Clean up topic if no subscribers
-    if (topic_sub->subscribers.empty()) {
-        cleanup_topic(topic);
+    // Re-sum once per heartbeat so incremental updates cannot drift
+    topic_total = 0.0;
+    for (const auto& topic_pair : topics) {
+        topic_total += topic_pair.second.contribution;
     }
+    
+    decay_counter(behaviour_penalty, params_.behaviour_penalty_decay);
+    refresh_score();
 }
 
-void GossipSub::handle_publish(const std::string& peer_id, const nlohmann::json& payload) {
-    std::string topic = payload.value("topic", "");
-    std::string message = payload.value("message", "");
-    std::string message_id = payload.value("message_id", "");
-    std::string sender_peer_id = payload.value("sender_peer_id", peer_id);
+void PeerScore::refresh_topic(const std::string& topic, TopicPeerScore& stats) {
+    const TopicScoreParams& params = params_.topic_params(topic);
     
-    if (topic.empty() || message.empty() || message_id.empty()) {
-        return;
+    double p1 = 0.0;
+    if (stats.in_mesh) {
+        double quantum = std::chrono::duration<double>(params.time_in_mesh_quantum).count();
+        p1 = (std::min)(quantum > 0.0 ? stats.mesh_time / quantum : 0.0, params.time_in_mesh_cap);
     }
-    
-    // Check if we've already seen this message
-    if (is_message_seen(message_id)) {
-        return;
+    double p3 = 0.0;
+    if (stats.mesh_message_deliveries_active &&
+        stats.mesh_message_deliveries < params.mesh_message_deliveries_threshold) {
+        double deficit = params.mesh_message_deliveries_threshold - stats.mesh_message_deliveries;
+        p3 = deficit * deficit;
     }
+    double p4 = stats.invalid_message_deliveries * stats.invalid_message_deliveries;
     
-    // Validate message
-    ValidationResult validation = validate_message(topic, message, sender_peer_id);
-    if (validation == ValidationResult::REJECT) {
-        // Update peer score for invalid message
-        std::lock_guard<std::mutex> scores_lock(scores_mutex_);
-        auto score_it = peer_scores_.find(peer_id);
-        if (score_it != peer_scores_.end()) {
-            score_it->second->messages_invalid++;
-            score_it->second->update_score();
-        }
-        return;
-    }
+    double contribution = params.topic_weight * (
+        params.time_in_mesh_weight * p1 +
+        params.first_message_deliveries_weight * stats.first_message_deliveries +
+        params.mesh_message_deliveries_weight * p3 +
+        params.mesh_failure_penalty_weight * stats.mesh_failure_penalty +
+        params.invalid_message_deliveries_weight * p4);
     
-    if (validation == ValidationResult::IGNORE_MSG) {
-        return;
+    topic_total += contribution - stats.contribution;
+    stats.contribution = contribution;
+    refresh_score();
+}
+
+void PeerScore::refresh_score() {
+    double total = topic_total;
+    if (params_.topic_score_cap > 0.0 && total > params_.topic_score_cap) {
+        total = params_.topic_score_cap;
+    }
+    
+    total += params_.app_specific_weight * application_score;
+    total += params_.ip_colocation_factor_weight * ip_colocation_factor;
+    
+    double excess = behaviour_penalty - params_.behaviour_penalty_threshold;
+    if (excess > 0.0) {
+        total += params_.behaviour_penalty_weight * excess * excess;
+    }
+    
+    score = total;
+}
+
+//=============================================================================
+// TopicSubscription Implementation
+//=============================================================================
+
+bool TopicSubscription::add_mesh_peer(const std::string& peer_id) {
+    if (!mesh_peers.insert(peer_id).second) {
+        return false;
+    }
+    refresh_mesh_snapshot();
+    return true;
+}
+
+bool TopicSubscription::remove_mesh_peer(const std::string& peer_id) {
+    if (mesh_peers.erase(peer_id) == 0) {
+        return false;
+    }
+    refresh_mesh_snapshot();
+    return true;
+}
+
+void TopicSubscription::clear_mesh() {
+    mesh_peers.clear();
+    refresh_mesh_snapshot();
+}
+
+void TopicSubscription::refresh_mesh_snapshot() {
+    // Readers holding the previous snapshot keep iterating it; the mesh changes once per heartbeat at most
+    mesh_snapshot = std::make_shared<const std::vector<std::string>>(mesh_peers.begin(), mesh_peers.end());
+}
+
+//=============================================================================
+// MessageCache Implementation
+//=============================================================================
+
+MessageCache::MessageCache(size_t history_length, size_t history_gossip, size_t max_messages, size_t max_bytes)
+    : history_length_((std::max)(history_length, size_t(1))),
+      history_gossip_((std::min)(history_gossip, (std::max)(history_length, size_t(1)))),
+      max_messages_(max_messages), max_bytes_(max_bytes), bytes_(0), evictions_(0) {
+    windows_.emplace_front();
+}
+
+bool MessageCache::put(const std::string& message_id, const std::string& topic, Envelope envelope, size_t size) {
+    if (!envelope || entries_.count(message_id) || size > max_bytes_ || max_messages_ == 0) {
+        return false;
+    }
+    
+    while (!entries_.empty() && (entries_.size() >= max_messages_ || bytes_ + size > max_bytes_)) {
+        evict_oldest();
+    }
+    
+    entries_.emplace(message_id, Entry{topic, std::move(envelope), size});
+    windows_.front().push_back(message_id);
+    bytes_ += size;
+    return true;
+}
+
+MessageCache::Envelope MessageCache::get(const std::string& message_id) const {
+    auto it = entries_.find(message_id);
+    return it != entries_.end() ? it->second.envelope : nullptr;
+}
+
+std::vector<std::string> MessageCache::get_gossip_ids(const std::string& topic, size_t max_ids) const {
+    std::vector<std::string> ids;
+    size_t windows = (std::min)(history_gossip_, windows_.size());
+    
+    for (size_t w = 0; w < windows && ids.size() < max_ids; ++w) {
+        const auto& window = windows_[w];
+        for (auto it = window.rbegin(); it != window.rend() && ids.size() < max_ids; ++it) {
+            auto entry_it = entries_.find(*it);
+            if (entry_it != entries_.end() && entry_it->second.topic == topic) {
+                ids.push_back(*it);
+            }
+        }
+    }
+    
+    return ids;
+}
+
+void MessageCache::shift() {
+    windows_.emplace_front();
+    while (windows_.size() > history_length_) {
+        for (const auto& message_id : windows_.back()) {
+            erase(message_id);
+        }
+        evictions_ += windows_.back().size();
+        windows_.pop_back();
+    }
+}
+
+void MessageCache::erase(const std::string& message_id) {
+    auto it = entries_.find(message_id);
+    if (it != entries_.end()) {
+        bytes_ -= it->second.size;
+        entries_.erase(it);
+    }
+}
+
+void MessageCache::evict_oldest() {
+    for (auto window = windows_.rbegin(); window != windows_.rend(); ++window) {
+        if (!window->empty()) {
+            erase(window->front());
+            window->pop_front();
+            ++evictions_;
+            return;
+        }
+    }
+}
+
+//=============================================================================
+// SeenMessageFilter Implementation
+//=============================================================================
+
+SeenMessageFilter::SeenMessageFilter(std::chrono::milliseconds window, size_t buckets, size_t capacity,
+                                     double false_positive_rate, size_t max_exact_ids)
+    : max_exact_ids_(max_exact_ids), current_(0), current_started_(Clock::now()), expired_(0) {
+    buckets = (std::max)(buckets, size_t(1));
+    bucket_span_ = (std::max)(window / static_cast<std::chrono::milliseconds::rep>(buckets), std::chrono::milliseconds(1));
+    
+    // Standard Bloom sizing for the IDs expected in one bucket: m = -n ln p / ln(2)^2, k = m/n ln 2
+    double per_bucket = static_cast<double>((std::max)(capacity / buckets, size_t(1)));
+    double p = (std::min)((std::max)(false_positive_rate, 1e-12), 0.5);
+    double bits = std::ceil(-per_bucket * std::log(p) / (std::log(2.0) * std::log(2.0)));
+    bit_count_ = ((static_cast<size_t>(bits) + 63) / 64) * 64;
+    hash_count_ = static_cast<size_t>((std::max)(1.0, std::round(bit_count_ / per_bucket * std::log(2.0))));
+    hash_count_ = (std::min)(hash_count_, size_t(32));
+    
+    // One filter more than the window holds, so the oldest live bucket still covers a full window
+    buckets_.resize(buckets + 1);
+    for (auto& bucket : buckets_) {
+        bucket.bits.assign(bit_count_ / 64, 0);
+    }
+}
+
+bool SeenMessageFilter::contains(const std::string& message_id, Clock::time_point now) {
+    expire(now);
+    
+    if (exact_current_.count(message_id) || exact_previous_.count(message_id)) {
+        return true;
+    }
+    
+    uint64_t h1, h2;
+    hash_id(message_id, h1, h2);
+    return filters_contain(h1, h2);
+}
+
+bool SeenMessageFilter::insert(const std::string& message_id, Clock::time_point now) {
+    if (contains(message_id, now)) {
+        return false;
+    }
+    
+    if (exact_current_.size() < max_exact_ids_) {
+        exact_current_.insert(message_id);
+    }
+    
+    uint64_t h1, h2;
+    hash_id(message_id, h1, h2);
+    Bucket& bucket = buckets_[current_];
+    for (size_t i = 0; i < hash_count_; ++i) {
+        size_t bit = static_cast<size_t>((h1 + i * h2) % bit_count_);
+        bucket.bits[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    bucket.count++;
+    return true;
+}
+
+void SeenMessageFilter::expire(Clock::time_point now) {
+    if (now - current_started_ < bucket_span_) {
+        return;
+    }
+    
+    auto steps = static_cast<size_t>((now - current_started_) / bucket_span_);
+    current_started_ += bucket_span_ * static_cast<std::chrono::milliseconds::rep>(steps);
+    
+    for (size_t i = 0; i < (std::min)(steps, buckets_.size()); ++i) {
+        current_ = (current_ + 1) % buckets_.size();
+        std::fill(buckets_[current_].bits.begin(), buckets_[current_].bits.end(), 0);
+        expired_ += buckets_[current_].count;
+        buckets_[current_].count = 0;
+    }
+    
+    if (steps == 1) {
+        exact_previous_.swap(exact_current_);
+        exact_current_.clear();
+    } else {
+        exact_previous_.clear();
+        exact_current_.clear();
+    }
+}
+
+size_t SeenMessageFilter::size() const {
+    size_t total = 0;
+    for (const auto& bucket : buckets_) {
+        total += bucket.count;
+    }
+    return total;
+}
+
+size_t SeenMessageFilter::filter_bytes() const {
+    return buckets_.size() * (bit_count_ / 8);
+}
+
+size_t SeenMessageFilter::memory_usage() const {
+    size_t bytes = filter_bytes();
+    for (const auto* exact : {&exact_current_, &exact_previous_}) {
+        bytes += exact->bucket_count() * sizeof(void*);
+        for (const auto& id : *exact) {
+            bytes += sizeof(id) + 2 * sizeof(void*) + id.capacity();
+        }
+    }
+    return bytes;
+}
+
+bool SeenMessageFilter::filters_contain(uint64_t h1, uint64_t h2) const {
+    for (const auto& bucket : buckets_) {
+        if (bucket.count == 0) {
+            continue;
+        }
+        
+        bool all_set = true;
+        for (size_t i = 0; i < hash_count_ && all_set; ++i) {
+            size_t bit = static_cast<size_t>((h1 + i * h2) % bit_count_);
+            all_set = (bucket.bits[bit / 64] >> (bit % 64)) & 1;
+        }
+        if (all_set) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SeenMessageFilter::hash_id(const std::string& message_id, uint64_t& h1, uint64_t& h2) {
+    // FNV-1a, then a splitmix64 finalizer for the second (odd) hash used by double hashing
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : message_id) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    h1 = hash;
+    
+    uint64_t z = hash + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    h2 = (z ^ (z >> 31)) | 1;
+}
+
+//=============================================================================
+// GossipSub Implementation
+//=============================================================================
+
+GossipSub::GossipSub(RatsClient& rats_client, const GossipSubConfig& config)
+    : rats_client_(rats_client), config_(config), running_(false),
+      publish_received_(0), duplicate_publish_received_(0), messages_delivered_(0), frame_bytes_received_(0),
+      message_cache_(static_cast<size_t>((std::max)(config.history_length, 1)),
+                     static_cast<size_t>((std::max)(config.history_gossip, 0)),
+                     config.message_cache_max_messages, config.message_cache_max_bytes),
+      seen_messages_(config.message_cache_ttl, static_cast<size_t>((std::max)(config.seen_filter_buckets, 1)),
+                     config.seen_filter_capacity, config.seen_filter_false_positive_rate, config.seen_exact_max_ids),
+      chunk_assembly_bytes_(0), rng_(std::random_device{}()) {
+    
+    // Register message handler for gossipsub messages
+    rats_client_.on("gossipsub", [this](const std::string& peer_id, const nlohmann::json& message) {
+        handle_gossipsub_message(peer_id, message);
+    });
+}
+
+GossipSub::~GossipSub() {
+    stop();
+}
+
+bool GossipSub::start() {
+    if (running_.load()) {
+        return false; // Already running
+    }
+    
+    running_.store(true);
+    
+    // Start heartbeat thread and validation workers
+    heartbeat_thread_ = std::thread(&GossipSub::heartbeat_loop, this);
+    for (int i = 0; i < config_.validation_threads; ++i) {
+        validation_threads_.emplace_back(&GossipSub::validation_loop, this);
+    }
+    chunk_thread_ = std::thread(&GossipSub::chunk_sender_loop, this);
+    
+    LOG_GOSSIPSUB_INFO("GossipSub service started");
+    return true;
+}
+
+void GossipSub::stop() {
+    if (!running_.load()) {
+        return; // Already stopped
+    }
+
+    LOG_GOSSIPSUB_INFO("GossipSub service stopping");
+
+    // Unsubscribe from all topics
+    for (auto& shard : topic_shards_) {
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+        for (auto& topic_pair : shard.topics) {
+            if (topic_pair.second->subscribed) {
+                topic_pair.second->subscribed = false;
+                broadcast_record(GossipSubRecord(GossipSubMessageType::UNSUBSCRIBE, topic_pair.first));
+            }
+        }
+    }
+
+    running_.store(false);
+    
+    // Notify the heartbeat thread to wake up immediately
+    {
+        std::lock_guard<std::mutex> lock(heartbeat_mutex_);
+        heartbeat_cv_.notify_all();
+    }
+    
+    // Join heartbeat thread with timeout to avoid infinite hang
+    if (heartbeat_thread_.joinable()) {
+        heartbeat_thread_.join();
+    }
+    
+    // Stop validation workers; messages still waiting for validation are dropped
+    {
+        std::lock_guard<std::mutex> lock(validation_mutex_);
+        validation_cv_.notify_all();
+    }
+    for (auto& worker : validation_threads_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    validation_threads_.clear();
+    {
+        std::lock_guard<std::mutex> lock(validation_mutex_);
+        validation_queue_.clear();
+        pending_validations_.clear();
+    }
+    
+    // Stop the chunk sender; unsent chunks and partial messages are dropped
+    {
+        std::lock_guard<std::mutex> lock(chunk_mutex_);
+        chunk_cv_.notify_all();
+    }
+    if (chunk_thread_.joinable()) {
+        chunk_thread_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(chunk_mutex_);
+        chunk_streams_.clear();
+        chunk_assemblies_.clear();
+        chunk_assembly_bytes_ = 0;
+    }
+    
+    LOG_GOSSIPSUB_INFO("GossipSub service stopped");
+}
+
+bool GossipSub::is_running() const {
+    return running_.load();
+}
+
+bool GossipSub::set_config(const GossipSubConfig& config) {
+    if (running_.load()) {
+        return false;
+    }
+    
+    config_ = config;
+    
+    // The cache and the seen filter are sized from the configuration
+    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+    message_cache_ = MessageCache(static_cast<size_t>((std::max)(config.history_length, 1)),
+                                  static_cast<size_t>((std::max)(config.history_gossip, 0)),
+                                  config.message_cache_max_messages, config.message_cache_max_bytes);
+    seen_messages_ = SeenMessageFilter(config.message_cache_ttl, static_cast<size_t>((std::max)(config.seen_filter_buckets, 1)),
+                                       config.seen_filter_capacity, config.seen_filter_false_positive_rate,
+                                       config.seen_exact_max_ids);
+    return true;
+}
+
+const GossipSubConfig& GossipSub::get_config() const {
+    return config_;
+}
+
+//=============================================================================
+// Topic Management
+//=============================================================================
+
+bool GossipSub::subscribe(const std::string& topic) {
+    TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    // Get or create topic subscription
+    TopicSubscription* topic_sub = get_or_create_topic(shard, topic);
+    if (!topic_sub) {
+        return false;
+    }
+    
+    if (topic_sub->subscribed) {
+        return false; // Already subscribed
+    }
+    
+    topic_sub->subscribed = true;
+    
+    // Broadcast subscription to all peers
+    broadcast_record(GossipSubRecord(GossipSubMessageType::SUBSCRIBE, topic));
+    
+    // Start building mesh for this topic
+    maintain_mesh(*topic_sub);
+    
+            LOG_GOSSIPSUB_INFO("Subscribed to topic: " << topic);
+    return true;
+}
+
+bool GossipSub::unsubscribe(const std::string& topic) {
+    TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it == shard.topics.end() || !topic_it->second->subscribed) {
+        return false; // Not subscribed
+    }
+    
+    TopicSubscription* topic_sub = topic_it->second.get();
+    topic_sub->subscribed = false;
+    
+    // Broadcast unsubscription to all peers
+    broadcast_record(GossipSubRecord(GossipSubMessageType::UNSUBSCRIBE, topic));
+    
+    // Leave mesh for this topic: send PRUNE to all mesh peers
+    for (const auto& peer_id : topic_sub->mesh_peers) {
+        send_control(peer_id, GossipSubRecord(GossipSubMessageType::PRUNE, topic));
+        score_mesh_change(peer_id, topic, false);
+    }
+    topic_sub->clear_mesh();
+    
+    cleanup_topic(shard, topic);
+    
+            LOG_GOSSIPSUB_INFO("Unsubscribed from topic: " << topic);
+    return true;
+}
+
+bool GossipSub::is_subscribed(const std::string& topic) const {
+    const TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto topic_it = shard.topics.find(topic);
+    return topic_it != shard.topics.end() && topic_it->second->subscribed;
+}
+
+std::vector<std::string> GossipSub::get_subscribed_topics() const {
+    std::vector<std::string> topics;
+    for (const auto& shard : topic_shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& topic_pair : shard.topics) {
+            if (topic_pair.second->subscribed) {
+                topics.push_back(topic_pair.first);
+            }
+        }
+    }
+    return topics;
+}
+
+//=============================================================================
+// Message Publishing
+//=============================================================================
+
+bool GossipSub::publish(const std::string& topic, const std::string& message) {
+    if (!running_.load()) {
+        return false;
+    }
+    
+    std::string our_peer_id = rats_client_.get_our_peer_id();
+    std::string message_id = generate_message_id(topic, message, our_peer_id);
+    
+    // Check if we've already seen this message
+    if (is_message_seen(message_id)) {
+        return false;
+    }
+    
+    // Create publish record once; the same record is sent to every peer and kept in the cache
+    auto record = std::make_shared<GossipSubRecord>(GossipSubMessageType::PUBLISH, topic);
+    record->message = message;
+    record->message_id = message_id;
+    record->sender_peer_id = our_peer_id;
+    record->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    MessageCache::Envelope envelope = record;
+    
+    // Cache the message
+    cache_message(message_id, topic, envelope, message.size());
+    
+    // Pick targets, then encode once and queue for all of them without any topic lock held
+    std::vector<std::string> targets = select_publish_targets(topic);
+    send_publish_to_peers(targets, envelope);
+    gossipsub_metrics().published.add();
+    gossipsub_metrics().publish_sends.add(targets.size());
+    
+    LOG_GOSSIPSUB_DEBUG("Published message to topic: " << topic << " (ID: " << message_id << ")");
+    return true;
+}
+
+bool GossipSub::publish(const std::string& topic, const nlohmann::json& message) {
+    return publish(topic, message.dump());
+}
+
+std::vector<std::string> GossipSub::select_publish_targets(const std::string& topic) {
+    std::vector<std::string> targets;
+    std::shared_ptr<const std::vector<std::string>> mesh;
+    
+    {
+        TopicShard& shard = topic_shard(topic);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        
+        auto topic_it = shard.topics.find(topic);
+        if (topic_it != shard.topics.end() && topic_it->second->subscribed) {
+            // If we're subscribed to this topic, send to mesh peers (filtered below, without the lock)
+            mesh = topic_it->second->mesh_snapshot;
+        } else {
+            // If not subscribed, use fanout
+            TopicSubscription* topic_sub = get_or_create_topic(shard, topic);
+            if (!topic_sub) {
+                return targets;
+            }
+            
+            // Select fanout peers if we don't have enough
+            if (topic_sub->fanout_peers.size() < static_cast<size_t>(config_.fanout_size)) {
+                std::vector<std::string> candidates = select_peers_for_gossip(topic, 
+                    config_.fanout_size - static_cast<int>(topic_sub->fanout_peers.size()), topic_sub->fanout_peers);
+                for (const auto& peer_id : candidates) {
+                    topic_sub->fanout_peers.insert(peer_id);
+                }
+            }
+            
+            // Publish to fanout peers
+            for (const auto& peer_id : topic_sub->fanout_peers) {
+                if (is_peer_score_acceptable(peer_id, config_.score_threshold_publish)) {
+                    targets.push_back(peer_id);
+                }
+            }
+            return targets;
+        }
+    }
+    
+    for (const auto& peer_id : *mesh) {
+        if (is_peer_score_acceptable(peer_id, config_.score_threshold_publish)) {
+            targets.push_back(peer_id);
+        }
+    }
+    return targets;
+}
+
+//=============================================================================
+// Message Handling
+//=============================================================================
+
+void GossipSub::handle_gossipsub_message(const std::string& peer_id, const nlohmann::json& message) {
+    try {
+        std::string type_str = message.value("type", "");
+        GossipSubMessageType type = string_to_gossipsub_message_type(type_str);
+        const nlohmann::json& payload = message.contains("payload") ? message["payload"] : nlohmann::json::object();
+        
+        LOG_GOSSIPSUB_DEBUG("Received gossipsub " << type_str << " message from " << peer_id);
+        
+        if (type == GossipSubMessageType::HEARTBEAT) {
+            handle_heartbeat(peer_id, payload);
+        } else {
+            handle_record(peer_id, GossipSubRecord::from_payload(type, payload));
+        }
+        
+    } catch (const std::exception& e) {
+        LOG_GOSSIPSUB_ERROR("Failed to handle gossipsub message from " << peer_id << ": " << e.what());
+        penalize_invalid_message(peer_id);
+    }
+}
+
+bool GossipSub::handle_binary_data(const std::string& peer_id, const uint8_t* data, size_t size) {
+    if (!GossipSubFrame::is_gossipsub_frame(data, size)) {
+        return false;
+    }
+    frame_bytes_received_.fetch_add(size, std::memory_order_relaxed);
+    
+    std::vector<GossipSubRecord> records;
+    if (!GossipSubFrame::decode(data, size, records)) {
+        LOG_GOSSIPSUB_WARN("Received malformed gossipsub frame from " << peer_id);
+        penalize_invalid_message(peer_id);
+        return true;
+    }
+    
+    // A peer sending binary frames understands them as well
+    if (config_.binary_codec) {
+        std::lock_guard<std::mutex> lock(codec_mutex_);
+        binary_codec_peers_.insert(peer_id);
+    }
+    
+    try {
+        for (auto& record : records) {
+            handle_record(peer_id, std::move(record));
+        }
+    } catch (const std::exception& e) {
+        LOG_GOSSIPSUB_ERROR("Failed to handle gossipsub frame from " << peer_id << ": " << e.what());
+    }
+    return true;
+}
+
+void GossipSub::handle_record(const std::string& peer_id, GossipSubRecord record) {
+    switch (record.type) {
+        case GossipSubMessageType::SUBSCRIBE:
+            handle_subscribe(peer_id, record);
+            break;
+        case GossipSubMessageType::UNSUBSCRIBE:
+            handle_unsubscribe(peer_id, record);
+            break;
+        case GossipSubMessageType::PUBLISH:
+            handle_publish(peer_id, std::make_shared<const GossipSubRecord>(std::move(record)));
+            break;
+        case GossipSubMessageType::GOSSIP:
+            handle_gossip(peer_id, record);
+            break;
+        case GossipSubMessageType::GRAFT:
+            handle_graft(peer_id, record);
+            break;
+        case GossipSubMessageType::PRUNE:
+            handle_prune(peer_id, record);
+            break;
+        case GossipSubMessageType::IHAVE:
+            handle_ihave(peer_id, record);
+            break;
+        case GossipSubMessageType::IWANT:
+            handle_iwant(peer_id, record);
+            break;
+        case GossipSubMessageType::IDONTWANT:
+            handle_idontwant(peer_id, record);
+            break;
+        case GossipSubMessageType::CHUNK:
+            handle_chunk(peer_id, record);
+            break;
+        case GossipSubMessageType::HEARTBEAT:
+            break;
+    }
+}
+
+void GossipSub::handle_subscribe(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::string& topic = record.topic;
+    if (topic.empty()) {
+        return;
+    }
+    
+    TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    TopicSubscription* topic_sub = get_or_create_topic(shard, topic);
+    if (!topic_sub) {
+        return;
+    }
+    
+    // Add peer to subscribers
+    bool was_new = topic_sub->subscribers.insert(peer_id).second;
+    
+    if (was_new) {
+                    LOG_GOSSIPSUB_DEBUG("Peer " << peer_id << " subscribed to topic: " << topic);
+        
+        // Call peer joined handler (on the client's callback executor, in order per topic)
+        PeerJoinedHandler handler;
+        {
+            std::lock_guard<std::mutex> handlers_lock(handlers_mutex_);
+            auto handler_it = peer_joined_handlers_.find(topic);
+            if (handler_it != peer_joined_handlers_.end()) {
+                handler = handler_it->second;
+            }
+        }
+        if (handler) {
+            rats_client_.run_callback("topic:" + topic, [handler, topic, peer_id]() {
+                try {
+                    handler(topic, peer_id);
+                } catch (const std::exception& e) {
+                    LOG_GOSSIPSUB_ERROR("Exception in peer joined handler for topic '" << topic << "': " << e.what());
+                }
+            });
+        }
+        
+        // If we're subscribed to this topic, consider adding peer to mesh
+        if (topic_sub->subscribed) {
+            maintain_mesh(*topic_sub);
+        }
+    }
+}
+
+void GossipSub::handle_unsubscribe(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::string& topic = record.topic;
+    if (topic.empty()) {
+        return;
+    }
+    
+    TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it == shard.topics.end()) {
+        return;
+    }
+    
+    TopicSubscription* topic_sub = topic_it->second.get();
+    
+    // Remove peer from subscribers and mesh
+    bool was_subscribed = topic_sub->subscribers.erase(peer_id) > 0;
+    bool was_in_mesh = topic_sub->remove_mesh_peer(peer_id);
+    if (was_in_mesh) {
+        score_mesh_change(peer_id, topic, false);
+    }
+    topic_sub->fanout_peers.erase(peer_id);
+    
+    if (was_subscribed) {
+                    LOG_GOSSIPSUB_DEBUG("Peer " << peer_id << " unsubscribed from topic: " << topic);
+        
+        // Call peer left handler (on the client's callback executor, in order per topic)
+        PeerLeftHandler handler;
+        {
+            std::lock_guard<std::mutex> handlers_lock(handlers_mutex_);
+            auto handler_it = peer_left_handlers_.find(topic);
+            if (handler_it != peer_left_handlers_.end()) {
+                handler = handler_it->second;
+            }
+        }
+        if (handler) {
+            rats_client_.run_callback("topic:" + topic, [handler, topic, peer_id]() {
+                try {
+                    handler(topic, peer_id);
+                } catch (const std::exception& e) {
+                    LOG_GOSSIPSUB_ERROR("Exception in peer left handler for topic '" << topic << "': " << e.what());
+                }
+            });
+        }
+        
+        // If peer was in mesh and we're subscribed, maintain mesh
+        if (was_in_mesh && topic_sub->subscribed) {
+            maintain_mesh(*topic_sub);
+        }
+    }
+    
+    // Clean up topic if no subscribers
+    cleanup_topic(shard, topic);
+}
+
+void GossipSub::handle_publish(const std::string& peer_id, const MessageCache::Envelope& record, bool reassembled) {
+    const std::string& topic = record->topic;
+    const std::string& message = record->message;
+    const std::string& message_id = record->message_id;
+    const std::string& sender_peer_id = record->sender_peer_id.empty() ? peer_id : record->sender_peer_id;
+    
+    if (topic.empty() || message.empty() || message_id.empty()) {
+        return;
+    }
+    publish_received_.fetch_add(1, std::memory_order_relaxed);
+    gossipsub_metrics().received.add();
+    
+    // Mark the message seen up front, so copies from other peers are not validated again while it is pending
+    if (!mark_message_seen(message_id)) {
+        duplicate_publish_received_.fetch_add(1, std::memory_order_relaxed);
+        gossipsub_metrics().duplicates.add();
+        return;
+    }
+    
+    // Large messages: tell the other mesh peers right away, before validation, so they stop pushing copies.
+    // Reassembled messages were announced when their first chunk arrived.
+    if (!reassembled && message.size() >= config_.idontwant_message_size_threshold) {
+        send_idontwant(topic, message_id, peer_id);
+    }
+    
+    // Synchronous validators decide on the receive thread
+    ValidationResult validation = validate_message(topic, message, sender_peer_id);
+    if (validation == ValidationResult::REJECT) {
+        penalize_invalid_message(peer_id, topic);
+        return;
+    }
+    
+    if (validation != ValidationResult::ACCEPT) {
+        return;
+    }
+    
+    // Async and batch validators hold the message until they decide; everything else is delivered now
+    if (!submit_async_validation(peer_id, record)) {
+        deliver_message(peer_id, record);
+    }
+}
+
+void GossipSub::deliver_message(const std::string& peer_id, const MessageCache::Envelope& record) {
+    const std::string& topic = record->topic;
+    const std::string& message = record->message;
+    const std::string& message_id = record->message_id;
+    const std::string& sender_peer_id = record->sender_peer_id.empty() ? peer_id : record->sender_peer_id;
+    
+    // Cache the message, reusing the received record for forwarding and IWANT replies
+    cache_message(message_id, topic, record, message.size());
+    
+    // Update peer score for valid message delivery
+    {
+        std::unique_lock<std::shared_mutex> scores_lock(scores_mutex_);
+        auto score_it = peer_scores_.find(peer_id);
+        if (score_it != peer_scores_.end()) {
+            score_it->second->deliver_first_message(topic);
+        }
+    }
+    
+    // Take the mesh snapshot under the shard lock; filtering runs without it
+    std::shared_ptr<const std::vector<std::string>> mesh;
+    {
+        const TopicShard& shard = topic_shard(topic);
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+        auto topic_it = shard.topics.find(topic);
+        if (topic_it == shard.topics.end() || !topic_it->second->subscribed) {
+            return;
+        }
+        mesh = topic_it->second->mesh_snapshot;
+    }
+    messages_delivered_.fetch_add(1, std::memory_order_relaxed);
+    
+    // Forward targets are mesh peers except the sender
+    std::vector<std::string> targets;
+    for (const auto& forward_peer_id : *mesh) {
+        if (forward_peer_id != peer_id && 
+            is_peer_score_acceptable(forward_peer_id, config_.score_threshold_gossip)) {
+            targets.push_back(forward_peer_id);
+        }
+    }
+    
+    // Forward the received record as is, encoded once for all targets
+    send_publish_to_peers(targets, record);
+    gossipsub_metrics().delivered.add();
+    gossipsub_metrics().forwarded.add(targets.size());
+    
+    // Call local message handler (on the client's callback executor, in order per topic);
+    // the task holds the received record, so the message is not copied
+    MessageHandler handler;
+    {
+        std::lock_guard<std::mutex> handlers_lock(handlers_mutex_);
+        auto handler_it = message_handlers_.find(topic);
+        if (handler_it != message_handlers_.end()) {
+            handler = handler_it->second;
+        }
+    }
+    if (handler) {
+        rats_client_.run_callback("topic:" + topic, [handler, record, sender_peer_id]() {
+            try {
+                handler(record->topic, record->message, sender_peer_id);
+            } catch (const std::exception& e) {
+                LOG_GOSSIPSUB_ERROR("Exception in message handler for topic '" << record->topic << "': " << e.what());
+            }
+        });
+    }
+    
+    LOG_GOSSIPSUB_DEBUG("Processed published message for topic: " << topic << " (ID: " << message_id << ")");
+}
+
+void GossipSub::handle_gossip(const std::string& peer_id, const GossipSubRecord& record) {
+    // Handle gossip messages (IHAVE/IWANT are sent as gossip)
+    LOG_GOSSIPSUB_DEBUG("Received gossip message from " << peer_id);
+}
+
+void GossipSub::handle_graft(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::string& topic = record.topic;
+    if (topic.empty()) {
+        return;
+    }
+    
+    TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    
+    // Only accept graft if we're subscribed and peer score is acceptable
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it != shard.topics.end() && topic_it->second->subscribed && 
+        is_peer_score_acceptable(peer_id, config_.score_threshold_mesh)) {
+        if (topic_it->second->add_mesh_peer(peer_id)) {
+            score_mesh_change(peer_id, topic, true);
+        }
+        LOG_GOSSIPSUB_DEBUG("Added peer " << peer_id << " to mesh for topic: " << topic);
+    } else {
+        // Send PRUNE in response to reject the graft
+        send_control(peer_id, GossipSubRecord(GossipSubMessageType::PRUNE, topic));
+    }
+}
+
+void GossipSub::handle_prune(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::string& topic = record.topic;
+    if (topic.empty()) {
+        return;
     }
     
-    // Cache the message
-    cache_message(message_id, topic, message, sender_peer_id);
+    TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it != shard.topics.end()) {
+        if (topic_it->second->remove_mesh_peer(peer_id)) {
+            score_mesh_change(peer_id, topic, false);
+        }
+        LOG_GOSSIPSUB_DEBUG("Removed peer " << peer_id << " from mesh for topic: " << topic);
+    }
+}
+
+void GossipSub::handle_ihave(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::vector<std::string>& message_ids = record.message_ids;
+    const std::string& topic = record.topic;
     
-    // Update peer score for valid message delivery
+    if (message_ids.empty() || topic.empty()) {
+        return;
+    }
+    
+    // Only pull messages for topics we are subscribed to
+    if (!is_subscribed(topic)) {
+        return;
+    }
+    
+    // Check which messages we want
+    GossipSubRecord iwant(GossipSubMessageType::IWANT, topic);
+    for (const auto& msg_id : message_ids) {
+        if (iwant.message_ids.size() >= static_cast<size_t>(config_.max_iwant_messages)) {
+            break;
+        }
+        if (!is_message_seen(msg_id)) {
+            iwant.message_ids.push_back(msg_id);
+        }
+    }
+    
+    // Send IWANT for messages we don't have
+    if (!iwant.message_ids.empty()) {
+        send_record(peer_id, iwant);
+    }
+}
+
+void GossipSub::handle_iwant(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::vector<std::string>& message_ids = record.message_ids;
+    const std::string& topic = record.topic;
+    
+    if (message_ids.empty() || topic.empty()) {
+        return;
+    }
+    
+    // Collect requested messages that are still in the cache
+    std::vector<MessageCache::Envelope> envelopes;
     {
-        std::lock_guard<std::mutex> scores_lock(scores_mutex_);
-        auto score_it = peer_scores_.find(peer_id);
-        if (score_it != peer_scores_.end()) {
-            score_it->second->messages_delivered++;
-            score_it->second->update_score();
+        std::lock_guard<std::mutex> cache_lock(message_cache_mutex_);
+        for (const auto& msg_id : message_ids) {
+            if (envelopes.size() >= static_cast<size_t>(config_.max_iwant_messages)) {
+                break;
+            }
+            if (auto envelope = message_cache_.get(msg_id)) {
+                envelopes.push_back(std::move(envelope));
+            }
         }
     }
     
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
+    if (envelopes.empty()) {
+        return;
+    }
     
-    // Forward message to mesh peers (except sender)
-    if (subscribed_topics_.count(topic)) {
-        auto topic_it = topics_.find(topic);
-        if (topic_it != topics_.end()) {
-            TopicSubscription* topic_sub = topic_it->second.get();
-            
-            for (const auto& forward_peer_id : topic_sub->mesh_peers) {
-                if (forward_peer_id != peer_id && 
-                    is_peer_score_acceptable(forward_peer_id, config_.score_threshold_gossip)) {
-                    send_gossipsub_message(forward_peer_id, GossipSubMessageType::PUBLISH, payload);
-                }
+    // Send outside the cache lock, as a single frame for binary codec peers
+    if (peer_uses_binary_codec(peer_id)) {
+        std::vector<uint8_t> frame;
+        GossipSubFrame::begin(frame);
+        for (const auto& envelope : envelopes) {
+            GossipSubFrame::append(*envelope, frame);
+        }
+        send_frame(peer_id, std::move(frame), SendPriority::DATA);
+    } else {
+        for (const auto& envelope : envelopes) {
+            send_record(peer_id, *envelope);
+        }
+    }
+}
+
+void GossipSub::handle_heartbeat(const std::string& peer_id, const nlohmann::json& payload) {
+    // Codec negotiation: the peer lists the wire codecs it understands
+    if (config_.binary_codec && payload.contains("codecs") && payload["codecs"].is_array()) {
+        for (const auto& codec : payload["codecs"]) {
+            if (codec.is_string() && codec.get<std::string>() == GossipSubFrame::CODEC_NAME) {
+                std::lock_guard<std::mutex> lock(codec_mutex_);
+                binary_codec_peers_.insert(peer_id);
+                LOG_GOSSIPSUB_DEBUG("Peer " << peer_id << " supports the binary gossipsub codec");
+            }
+        }
+    }
+    
+    if (payload.contains("extensions") && payload["extensions"].is_array()) {
+        std::lock_guard<std::mutex> lock(codec_mutex_);
+        for (const auto& extension : payload["extensions"]) {
+            if (!extension.is_string()) {
+                continue;
+            }
+            const std::string name = extension.get<std::string>();
+            if (name == GossipSubFrame::EXTENSION_IDONTWANT) {
+                idontwant_peers_.insert(peer_id);
+            } else if (name == GossipSubFrame::EXTENSION_CHUNK && config_.binary_codec) {
+                chunk_peers_.insert(peer_id);
+            }
+        }
+    }
+    
+    // Process any control messages in the heartbeat
+    if (payload.contains("graft")) {
+        for (const auto& graft : payload["graft"]) {
+            handle_graft(peer_id, GossipSubRecord::from_payload(GossipSubMessageType::GRAFT, graft));
+        }
+    }
+    
+    if (payload.contains("prune")) {
+        for (const auto& prune : payload["prune"]) {
+            handle_prune(peer_id, GossipSubRecord::from_payload(GossipSubMessageType::PRUNE, prune));
+        }
+    }
+    
+    if (payload.contains("ihave")) {
+        for (const auto& ihave : payload["ihave"]) {
+            handle_ihave(peer_id, GossipSubRecord::from_payload(GossipSubMessageType::IHAVE, ihave));
+        }
+    }
+    
+    if (payload.contains("iwant")) {
+        for (const auto& iwant : payload["iwant"]) {
+            handle_iwant(peer_id, GossipSubRecord::from_payload(GossipSubMessageType::IWANT, iwant));
+        }
+    }
+}
+
+void GossipSub::handle_idontwant(const std::string& peer_id, const GossipSubRecord& record) {
+    if (record.message_ids.empty()) {
+        return;
+    }
+    
+    // Remember the ids for a few heartbeats; copies still in flight are dropped before they are queued
+    auto expiry = std::chrono::steady_clock::now() + config_.heartbeat_interval * 3;
+    std::lock_guard<std::mutex> lock(idontwant_mutex_);
+    auto& ids = dont_want_[peer_id];
+    for (const auto& message_id : record.message_ids) {
+        if (ids.size() >= config_.max_idontwant_messages && ids.find(message_id) == ids.end()) {
+            break;
+        }
+        ids[message_id] = expiry;
+    }
+}
+
+void GossipSub::handle_chunk(const std::string& peer_id, const GossipSubRecord& record) {
+    const std::string& message_id = record.message_id;
+    if (record.topic.empty() || message_id.empty() || record.message.empty() ||
+        record.chunk_count < 2 || record.chunk_index >= record.chunk_count) {
+        penalize_invalid_message(peer_id, record.topic);
+        return;
+    }
+    
+    if (is_message_seen(message_id)) {
+        return;
+    }
+    
+    bool first_chunk = false;
+    MessageCache::Envelope complete;
+    {
+        std::lock_guard<std::mutex> lock(chunk_mutex_);
+        auto assembly_it = chunk_assemblies_.find(message_id);
+        if (assembly_it == chunk_assemblies_.end()) {
+            if (chunk_assembly_bytes_ + record.message.size() > config_.max_chunk_reassembly_bytes) {
+                LOG_GOSSIPSUB_DEBUG("Chunk reassembly budget exhausted, dropping chunk of " << message_id);
+                return;
             }
+            ChunkAssembly assembly;
+            assembly.topic = record.topic;
+            assembly.sender_peer_id = record.sender_peer_id;
+            assembly.timestamp = record.timestamp;
+            assembly.chunk_count = record.chunk_count;
+            assembly.bytes = 0;
+            assembly.started = std::chrono::steady_clock::now();
+            assembly_it = chunk_assemblies_.emplace(message_id, std::move(assembly)).first;
+            first_chunk = true;
         }
         
-        // Call local message handler
-        std::lock_guard<std::mutex> handlers_lock(handlers_mutex_);
-        auto handler_it = message_handlers_.find(topic);
-        if (handler_it != message_handlers_.end()) {
-            try {
-                handler_it->second(topic, message, sender_peer_id);
-            } catch (const std::exception& e) {
-                LOG_GOSSIPSUB_ERROR("Exception in message handler for topic '" << topic << "': " << e.what());
+        ChunkAssembly& assembly = assembly_it->second;
+        if (assembly.chunk_count != record.chunk_count || assembly.topic != record.topic) {
+            return;
+        }
+        
+        // Pieces are kept by index, so memory follows what was received rather than the announced count
+        if (!assembly.pieces.count(record.chunk_index)) {
+            if (chunk_assembly_bytes_ + record.message.size() > config_.max_chunk_reassembly_bytes) {
+                return;
+            }
+            assembly.pieces[record.chunk_index] = record.message;
+            assembly.bytes += record.message.size();
+            chunk_assembly_bytes_ += record.message.size();
+        }
+        
+        if (assembly.pieces.size() == assembly.chunk_count) {
+            auto whole = std::make_shared<GossipSubRecord>(GossipSubMessageType::PUBLISH, assembly.topic);
+            whole->message_id = message_id;
+            whole->sender_peer_id = assembly.sender_peer_id;
+            whole->timestamp = assembly.timestamp;
+            whole->message.reserve(assembly.bytes);
+            for (const auto& part : assembly.pieces) {
+                whole->message += part.second;
             }
+            complete = whole;
+            
+            chunk_assembly_bytes_ -= assembly.bytes;
+            chunk_assemblies_.erase(assembly_it);
         }
     }
     
-    LOG_GOSSIPSUB_DEBUG("Processed published message for topic: " << topic << " (ID: " << message_id << ")");
+    // Mesh peers that have not started sending this message can skip it
+    if (first_chunk) {
+        send_idontwant(record.topic, message_id, peer_id);
+    }
+    
+    if (complete) {
+        handle_publish(peer_id, complete, true);
+    }
 }
 
-void GossipSub::handle_gossip(const std::string& peer_id, const nlohmann::json& payload) {
-    // Handle gossip messages (IHAVE/IWANT are sent as gossip)
-    LOG_GOSSIPSUB_DEBUG("Received gossip message from " << peer_id);
+//=============================================================================
+// Utility Functions
+//=============================================================================
+
+std::string GossipSub::generate_message_id(const std::string& topic, const std::string& message, const std::string& sender_peer_id) {
+    {
+        std::lock_guard<std::mutex> lock(message_id_mutex_);
+        if (message_id_function_) {
+            return message_id_function_(topic, message, sender_peer_id);
+        }
+    }
+    
+    // Content address: SHA1 over the length-prefixed topic and the message, streamed without concatenation
+    uint8_t topic_length[4] = {
+        static_cast<uint8_t>(topic.size() >> 24), static_cast<uint8_t>(topic.size() >> 16),
+        static_cast<uint8_t>(topic.size() >> 8), static_cast<uint8_t>(topic.size())
+    };
+    SHA1 sha1;
+    sha1.update(topic_length, sizeof(topic_length));
+    sha1.update(topic);
+    sha1.update(message);
+    return sha1.finalize();
 }
 
-void GossipSub::handle_graft(const std::string& peer_id, const nlohmann::json& payload) {
-    std::string topic = payload.value("topic", "");
-    if (topic.empty()) {
+bool GossipSub::is_message_seen(const std::string& message_id) {
+    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+    return seen_messages_.contains(message_id);
+}
+
+bool GossipSub::mark_message_seen(const std::string& message_id) {
+    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+    if (seen_messages_.contains(message_id)) {
+        return false;
+    }
+    seen_messages_.insert(message_id);
+    return true;
+}
+
+void GossipSub::cache_message(const std::string& message_id, const std::string& topic, const MessageCache::Envelope& envelope, size_t size) {
+    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+    
+    message_cache_.put(message_id, topic, envelope, size);
+    seen_messages_.insert(message_id);
+}
+
+GossipSub::TopicShard& GossipSub::topic_shard(const std::string& topic) {
+    return topic_shards_[std::hash<std::string>{}(topic) % GOSSIPSUB_TOPIC_SHARDS];
+}
+
+const GossipSub::TopicShard& GossipSub::topic_shard(const std::string& topic) const {
+    return topic_shards_[std::hash<std::string>{}(topic) % GOSSIPSUB_TOPIC_SHARDS];
+}
+
+TopicSubscription* GossipSub::get_or_create_topic(TopicShard& shard, const std::string& topic) {
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it == shard.topics.end()) {
+        auto topic_sub = std::make_unique<TopicSubscription>(topic);
+        TopicSubscription* ptr = topic_sub.get();
+        shard.topics[topic] = std::move(topic_sub);
+        return ptr;
+    }
+    return topic_it->second.get();
+}
+
+void GossipSub::cleanup_topic(TopicShard& shard, const std::string& topic) {
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it != shard.topics.end() && !topic_it->second->subscribed &&
+        topic_it->second->subscribers.empty() && topic_it->second->fanout_peers.empty()) {
+        shard.topics.erase(topic_it);
+    }
+}
+
+bool GossipSub::send_gossipsub_message(const std::string& peer_id, GossipSubMessageType type, const nlohmann::json& payload) {
+    nlohmann::json message;
+    message["type"] = gossipsub_message_type_to_string(type);
+    message["payload"] = payload;
+    
+    return rats_client_.send_to_peers({peer_id}, "gossipsub", message, send_priority_for(type)) > 0;
+}
+
+bool GossipSub::send_record(const std::string& peer_id, const GossipSubRecord& record) {
+    if (peer_uses_binary_codec(peer_id)) {
+        std::vector<uint8_t> frame;
+        GossipSubFrame::begin(frame);
+        GossipSubFrame::append(record, frame);
+        return send_frame(peer_id, std::move(frame), send_priority_for(record.type));
+    }
+    return send_gossipsub_message(peer_id, record.type, record.to_payload());
+}
+
+bool GossipSub::send_frame(const std::string& peer_id, std::vector<uint8_t>&& frame, SendPriority priority) {
+    return rats_client_.send_binary_to_peer_ids({peer_id}, SharedBuffer(std::move(frame)), MessageDataType::BINARY,
+                                                priority) > 0;
+}
+
+void GossipSub::send_record_to_peers(const std::vector<std::string>& peer_ids, const GossipSubRecord& record) {
+    if (peer_ids.empty()) {
+        return;
+    }
+    
+    std::vector<std::string> binary_peers;
+    std::vector<std::string> json_peers;
+    {
+        std::lock_guard<std::mutex> lock(codec_mutex_);
+        for (const auto& peer_id : peer_ids) {
+            (binary_codec_peers_.count(peer_id) ? binary_peers : json_peers).push_back(peer_id);
+        }
+    }
+    
+    // Each wire form is encoded once into a shared buffer that every target queue references
+    if (!binary_peers.empty()) {
+        std::vector<uint8_t> frame;
+        GossipSubFrame::begin(frame);
+        GossipSubFrame::append(record, frame);
+        rats_client_.send_binary_to_peer_ids(binary_peers, SharedBuffer(std::move(frame)), MessageDataType::BINARY,
+                                             send_priority_for(record.type));
+    }
+    
+    if (!json_peers.empty()) {
+        nlohmann::json message;
+        message["type"] = gossipsub_message_type_to_string(record.type);
+        message["payload"] = record.to_payload();
+        rats_client_.send_to_peers(json_peers, "gossipsub", message, send_priority_for(record.type));
+    }
+}
+
+void GossipSub::send_publish_to_peers(const std::vector<std::string>& peer_ids, const MessageCache::Envelope& record) {
+    const std::string& message_id = record->message_id;
+    bool chunked = config_.max_chunk_size > 0 && record->message.size() > config_.max_chunk_size;
+    
+    // Skip peers that already have the message, and stream large messages to peers that reassemble chunks
+    std::vector<std::string> targets;
+    std::vector<std::string> chunk_targets;
+    {
+        std::lock_guard<std::mutex> lock(codec_mutex_);
+        for (const auto& peer_id : peer_ids) {
+            if (chunked && chunk_peers_.count(peer_id) && binary_codec_peers_.count(peer_id)) {
+                chunk_targets.push_back(peer_id);
+            } else {
+                targets.push_back(peer_id);
+            }
+        }
+    }
+    
+    targets.erase(std::remove_if(targets.begin(), targets.end(),
+                                 [this, &message_id](const std::string& peer_id) { return peer_dont_want(peer_id, message_id); }),
+                  targets.end());
+    send_record_to_peers(targets, *record);
+    
+    if (chunk_targets.empty()) {
         return;
     }
     
-    // Update peer score
+    uint32_t chunk_count = static_cast<uint32_t>((record->message.size() + config_.max_chunk_size - 1) / config_.max_chunk_size);
+    {
+        std::lock_guard<std::mutex> lock(chunk_mutex_);
+        for (const auto& peer_id : chunk_targets) {
+            chunk_streams_.push_back(ChunkStream{peer_id, record, 0, chunk_count});
+        }
+    }
+    chunk_cv_.notify_one();
+}
+
+void GossipSub::send_idontwant(const std::string& topic, const std::string& message_id, const std::string& exclude_peer_id) {
+    std::shared_ptr<const std::vector<std::string>> mesh;
+    {
+        const TopicShard& shard = topic_shard(topic);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto topic_it = shard.topics.find(topic);
+        if (topic_it == shard.topics.end() || !topic_it->second->subscribed) {
+            return;
+        }
+        mesh = topic_it->second->mesh_snapshot;
+    }
+    
+    std::vector<std::string> targets;
+    {
+        std::lock_guard<std::mutex> lock(codec_mutex_);
+        for (const auto& peer_id : *mesh) {
+            if (peer_id != exclude_peer_id && idontwant_peers_.count(peer_id)) {
+                targets.push_back(peer_id);
+            }
+        }
+    }
+    
+    GossipSubRecord idontwant(GossipSubMessageType::IDONTWANT, topic);
+    idontwant.message_ids.push_back(message_id);
+    send_record_to_peers(targets, idontwant);
+}
+
+bool GossipSub::peer_dont_want(const std::string& peer_id, const std::string& message_id) const {
+    std::lock_guard<std::mutex> lock(idontwant_mutex_);
+    auto peer_it = dont_want_.find(peer_id);
+    return peer_it != dont_want_.end() && peer_it->second.count(message_id) > 0;
+}
+
+void GossipSub::chunk_sender_loop() {
+    while (running_.load()) {
+        size_t stream_count;
+        {
+            std::unique_lock<std::mutex> lock(chunk_mutex_);
+            chunk_cv_.wait(lock, [this] { return !running_.load() || !chunk_streams_.empty(); });
+            if (!running_.load()) {
+                return;
+            }
+            stream_count = chunk_streams_.size();
+        }
+        
+        // One round: at most one chunk per stream, and only to peers whose outbound queue has drained,
+        // so other traffic to the peer is interleaved between the chunks
+        bool progressed = false;
+        for (size_t i = 0; i < stream_count; ++i) {
+            ChunkStream stream;
+            {
+                std::lock_guard<std::mutex> lock(chunk_mutex_);
+                if (chunk_streams_.empty()) {
+                    break;
+                }
+                stream = std::move(chunk_streams_.front());
+                chunk_streams_.pop_front();
+            }
+            
+            const GossipSubRecord& whole = *stream.record;
+            if (peer_dont_want(stream.peer_id, whole.message_id)) {
+                LOG_GOSSIPSUB_DEBUG("Peer " << stream.peer_id << " no longer wants " << whole.message_id
+                                    << ", skipping " << (stream.chunk_count - stream.next_index) << " chunks");
+                continue;
+            }
+            
+            if (rats_client_.get_peer_send_queue_depth(stream.peer_id) < GOSSIPSUB_CHUNK_QUEUE_DEPTH) {
+                GossipSubRecord chunk(GossipSubMessageType::CHUNK, whole.topic);
+                chunk.message_id = whole.message_id;
+                chunk.sender_peer_id = whole.sender_peer_id;
+                chunk.timestamp = whole.timestamp;
+                chunk.chunk_index = stream.next_index;
+                chunk.chunk_count = stream.chunk_count;
+                chunk.message = whole.message.substr(static_cast<size_t>(stream.next_index) * config_.max_chunk_size,
+                                                     config_.max_chunk_size);
+                if (!send_record(stream.peer_id, chunk)) {
+                    continue; // Peer is gone
+                }
+                progressed = true;
+                stream.next_index++;
+            }
+            
+            if (stream.next_index < stream.chunk_count) {
+                std::lock_guard<std::mutex> lock(chunk_mutex_);
+                chunk_streams_.push_back(std::move(stream));
+            }
+        }
+        
+        if (!progressed) {
+            std::unique_lock<std::mutex> lock(chunk_mutex_);
+            chunk_cv_.wait_for(lock, std::chrono::milliseconds(5), [this] { return !running_.load(); });
+        }
+    }
+}
+
+void GossipSub::cleanup_large_message_state() {
+    auto now = std::chrono::steady_clock::now();
+    
+    {
+        std::lock_guard<std::mutex> lock(idontwant_mutex_);
+        for (auto peer_it = dont_want_.begin(); peer_it != dont_want_.end();) {
+            auto& ids = peer_it->second;
+            for (auto id_it = ids.begin(); id_it != ids.end();) {
+                id_it = id_it->second <= now ? ids.erase(id_it) : std::next(id_it);
+            }
+            peer_it = ids.empty() ? dont_want_.erase(peer_it) : std::next(peer_it);
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(chunk_mutex_);
+    for (auto assembly_it = chunk_assemblies_.begin(); assembly_it != chunk_assemblies_.end();) {
+        if (now - assembly_it->second.started >= config_.chunk_reassembly_timeout) {
+            LOG_GOSSIPSUB_DEBUG("Dropping incomplete chunked message " << assembly_it->first);
+            chunk_assembly_bytes_ -= assembly_it->second.bytes;
+            assembly_it = chunk_assemblies_.erase(assembly_it);
+        } else {
+            ++assembly_it;
+        }
+    }
+}
+
+bool GossipSub::broadcast_record(const GossipSubRecord& record, const std::unordered_set<std::string>& exclude) {
+    // Get all connected peers
+    auto all_peers = rats_client_.get_all_peers();
+    std::vector<std::string> targets;
+    
+    for (const auto& peer : all_peers) {
+        if (exclude.count(peer.peer_id) == 0) {
+            targets.push_back(peer.peer_id);
+        }
+    }
+    
+    send_record_to_peers(targets, record);
+    return !targets.empty();
+}
+
+void GossipSub::send_control(const std::string& peer_id, GossipSubRecord record, ControlBatch* batch) {
+    if (batch) {
+        (*batch)[peer_id].push_back(std::move(record));
+    } else {
+        send_record(peer_id, record);
+    }
+}
+
+void GossipSub::flush_control_batch(const ControlBatch& batch) {
+    for (const auto& peer_batch : batch) {
+        const std::string& peer_id = peer_batch.first;
+        const std::vector<GossipSubRecord>& records = peer_batch.second;
+        
+        if (peer_uses_binary_codec(peer_id)) {
+            std::vector<uint8_t> frame;
+            GossipSubFrame::begin(frame);
+            for (const auto& record : records) {
+                GossipSubFrame::append(record, frame);
+            }
+            send_frame(peer_id, std::move(frame), SendPriority::CONTROL);
+            continue;
+        }
+        
+        // JSON peers get the control messages piggybacked on one heartbeat message
+        nlohmann::json payload = nlohmann::json::object();
+        for (const auto& record : records) {
+            const char* key = nullptr;
+            switch (record.type) {
+                case GossipSubMessageType::GRAFT: key = "graft"; break;
+                case GossipSubMessageType::PRUNE: key = "prune"; break;
+                case GossipSubMessageType::IHAVE: key = "ihave"; break;
+                case GossipSubMessageType::IWANT: key = "iwant"; break;
+                default: break;
+            }
+            if (key) {
+                payload[key].push_back(record.to_payload());
+            } else {
+                send_record(peer_id, record);
+            }
+        }
+        if (!payload.empty()) {
+            send_gossipsub_message(peer_id, GossipSubMessageType::HEARTBEAT, payload);
+        }
+    }
+}
+
+bool GossipSub::peer_uses_binary_codec(const std::string& peer_id) const {
+    std::lock_guard<std::mutex> lock(codec_mutex_);
+    return binary_codec_peers_.count(peer_id) > 0;
+}
+
+ValidationResult GossipSub::validate_message(const std::string& topic, const std::string& message, const std::string& sender_peer_id) {
+    // Check topic-specific validator first, then the global one; run it outside the handlers lock
+    MessageValidator validator;
     {
-        std::lock_guard<std::mutex> scores_lock(scores_mutex_);
-        auto score_it = peer_scores_.find(peer_id);
-        if (score_it != peer_scores_.end()) {
-            score_it->second->graft_requests++;
-            score_it->second->update_score();
-        }
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+        auto validator_it = message_validators_.find(topic);
+        validator = validator_it != message_validators_.end() ? validator_it->second : global_validator_;
     }
     
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
+    // Default: accept all messages
+    if (!validator) {
+        return ValidationResult::ACCEPT;
+    }
     
-    // Only accept graft if we're subscribed and peer score is acceptable
-    if (subscribed_topics_.count(topic) && 
-        is_peer_score_acceptable(peer_id, config_.score_threshold_mesh)) {
-        
-        TopicSubscription* topic_sub = get_or_create_topic(topic);
-        if (topic_sub) {
-            topic_sub->mesh_peers.insert(peer_id);
-            LOG_GOSSIPSUB_DEBUG("Added peer " << peer_id << " to mesh for topic: " << topic);
-        }
-    } else {
-        // Send PRUNE in response to reject the graft
-        nlohmann::json prune_payload;
-        prune_payload["topic"] = topic;
-        send_gossipsub_message(peer_id, GossipSubMessageType::PRUNE, prune_payload);
+    ValidationResult result = validator(topic, message, sender_peer_id);
+    if (result == ValidationResult::PENDING) {
+        LOG_GOSSIPSUB_WARN("Synchronous validator for topic '" << topic << "' returned PENDING, ignoring message");
+        return ValidationResult::IGNORE_MSG;
     }
+    return result;
 }
 
-void GossipSub::handle_prune(const std::string& peer_id, const nlohmann::json& payload) {
-    std::string topic = payload.value("topic", "");
-    if (topic.empty()) {
-        return;
+bool GossipSub::submit_async_validation(const std::string& peer_id, const MessageCache::Envelope& record) {
+    const std::string& topic = record->topic;
+    {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+        if (!batch_validators_.count(topic) && !batch_validators_.count("") &&
+            !async_validators_.count(topic) && !async_validators_.count("")) {
+            return false;
+        }
     }
     
-    // Update peer score
     {
-        std::lock_guard<std::mutex> scores_lock(scores_mutex_);
-        auto score_it = peer_scores_.find(peer_id);
-        if (score_it != peer_scores_.end()) {
-            score_it->second->prune_requests++;
-            score_it->second->update_score();
+        std::lock_guard<std::mutex> lock(validation_mutex_);
+        size_t& pending = pending_validations_[topic];
+        if (pending >= config_.max_pending_validations_per_topic) {
+            LOG_GOSSIPSUB_DEBUG("Validation backlog full for topic: " << topic << ", dropping message " << record->message_id);
+            return true;
+        }
+        pending++;
+        
+        if (config_.validation_threads > 0) {
+            validation_queue_.push_back(PendingValidation{peer_id, record});
         }
     }
     
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-    auto topic_it = topics_.find(topic);
-    if (topic_it != topics_.end()) {
-        TopicSubscription* topic_sub = topic_it->second.get();
-        topic_sub->mesh_peers.erase(peer_id);
-        LOG_GOSSIPSUB_DEBUG("Removed peer " << peer_id << " from mesh for topic: " << topic);
+    if (config_.validation_threads > 0) {
+        validation_cv_.notify_one();
+        return true;
     }
+    
+    // No workers configured: validate on the receive thread
+    std::vector<PendingValidation> batch{PendingValidation{peer_id, record}};
+    run_validations(batch);
+    return true;
 }
 
-void GossipSub::handle_ihave(const std::string& peer_id, const nlohmann::json& payload) {
-    std::vector<std::string> message_ids = payload.value("message_ids", std::vector<std::string>());
-    std::string topic = payload.value("topic", "");
-    
-    if (message_ids.empty() || topic.empty()) {
-        return;
-    }
-    
-    // Check which messages we want
-    std::vector<std::string> wanted_messages;
-    for (const auto& msg_id : message_ids) {
-        if (!is_message_seen(msg_id)) {
-            wanted_messages.push_back(msg_id);
+void GossipSub::validation_loop() {
+    std::vector<PendingValidation> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(validation_mutex_);
+            validation_cv_.wait(lock, [this] { return !running_.load() || !validation_queue_.empty(); });
+            if (!running_.load()) {
+                return;
+            }
+            
+            size_t count = (std::min)(validation_queue_.size(), (std::max)(config_.validation_batch_size, size_t(1)));
+            for (size_t i = 0; i < count; ++i) {
+                batch.push_back(std::move(validation_queue_.front()));
+                validation_queue_.pop_front();
+            }
         }
-    }
-    
-    // Send IWANT for messages we don't have
-    if (!wanted_messages.empty()) {
-        nlohmann::json iwant_payload;
-        iwant_payload["message_ids"] = wanted_messages;
-        iwant_payload["topic"] = topic;
-        send_gossipsub_message(peer_id, GossipSubMessageType::IWANT, iwant_payload);
+        
+        try {
+            run_validations(batch);
+        } catch (const std::exception& e) {
+            LOG_GOSSIPSUB_ERROR("Exception in validation worker: " << e.what());
+        }
+        batch.clear();
     }
 }
 
-void GossipSub::handle_iwant(const std::string& peer_id, const nlohmann::json& payload) {
-    std::vector<std::string> message_ids = payload.value("message_ids", std::vector<std::string>());
-    std::string topic = payload.value("topic", "");
-    
-    if (message_ids.empty() || topic.empty()) {
-        return;
+void GossipSub::run_validations(std::vector<PendingValidation>& batch) {
+    // Group by topic, so a batch validator sees every pending message of its topic at once
+    std::unordered_map<std::string, std::vector<PendingValidation*>> by_topic;
+    for (auto& pending : batch) {
+        by_topic[pending.record->topic].push_back(&pending);
     }
     
-    // Send requested messages that we have
-    std::lock_guard<std::mutex> cache_lock(message_cache_mutex_);
-    for (const auto& msg_id : message_ids) {
-        auto cache_it = message_cache_.find(msg_id);
-        if (cache_it != message_cache_.end()) {
-            MessageMetadata* metadata = cache_it->second.get();
+    for (auto& topic_group : by_topic) {
+        const std::string& topic = topic_group.first;
+        std::vector<PendingValidation*>& group = topic_group.second;
+        
+        BatchMessageValidator batch_validator;
+        AsyncMessageValidator async_validator;
+        {
+            std::lock_guard<std::mutex> lock(handlers_mutex_);
+            auto batch_it = batch_validators_.find(topic);
+            if (batch_it == batch_validators_.end()) {
+                batch_it = batch_validators_.find("");
+            }
+            if (batch_it != batch_validators_.end()) {
+                batch_validator = batch_it->second;
+            }
+            auto async_it = async_validators_.find(topic);
+            if (async_it == async_validators_.end()) {
+                async_it = async_validators_.find("");
+            }
+            if (async_it != async_validators_.end()) {
+                async_validator = async_it->second;
+            }
+        }
+        
+        if (batch_validator) {
+            std::vector<ValidationRequest> requests;
+            requests.reserve(group.size());
+            for (const auto* pending : group) {
+                const auto& record = *pending->record;
+                requests.push_back(ValidationRequest{topic, record.message,
+                                                     record.sender_peer_id.empty() ? pending->peer_id : record.sender_peer_id});
+            }
+            
+            std::vector<ValidationResult> results;
+            try {
+                results = batch_validator(requests);
+            } catch (const std::exception& e) {
+                LOG_GOSSIPSUB_ERROR("Exception in batch validator for topic '" << topic << "': " << e.what());
+            }
+            
+            // Missing results count as IGNORE_MSG
+            for (size_t i = 0; i < group.size(); ++i) {
+                ValidationResult result = i < results.size() ? results[i] : ValidationResult::IGNORE_MSG;
+                finish_validation(group[i]->peer_id, group[i]->record, result);
+            }
+            continue;
+        }
+        
+        for (auto* pending : group) {
+            if (!async_validator) {
+                // Validator removed while the message was queued
+                finish_validation(pending->peer_id, pending->record, ValidationResult::ACCEPT);
+                continue;
+            }
             
-            // TODO: Store actual message content in cache
-            // For now, we'll send a placeholder response
-            nlohmann::json publish_payload;
-            publish_payload["topic"] = metadata->topic;
-            publish_payload["message"] = ""; // Would contain actual message
-            publish_payload["message_id"] = msg_id;
-            publish_payload["sender_peer_id"] = metadata->sender_peer_id;
+            // The completion may run once, from any thread
+            auto completed = std::make_shared<std::atomic<bool>>(false);
+            std::string peer_id = pending->peer_id;
+            MessageCache::Envelope record = pending->record;
+            ValidationCompletion complete = [this, peer_id, record, completed](ValidationResult result) {
+                if (!completed->exchange(true)) {
+                    finish_validation(peer_id, record, result == ValidationResult::PENDING ? ValidationResult::IGNORE_MSG : result);
+                }
+            };
+            
+            ValidationResult result = ValidationResult::IGNORE_MSG;
+            try {
+                const std::string& sender_peer_id = record->sender_peer_id.empty() ? peer_id : record->sender_peer_id;
+                result = async_validator(topic, record->message, sender_peer_id, complete);
+            } catch (const std::exception& e) {
+                LOG_GOSSIPSUB_ERROR("Exception in async validator for topic '" << topic << "': " << e.what());
+            }
             
-            send_gossipsub_message(peer_id, GossipSubMessageType::PUBLISH, publish_payload);
+            if (result != ValidationResult::PENDING) {
+                complete(result);
+            }
         }
     }
 }
 
-void GossipSub::handle_heartbeat(const std::string& peer_id, const nlohmann::json& payload) {
-    // Process any control messages in the heartbeat
-    if (payload.contains("graft")) {
-        auto graft_messages = payload["graft"];
-        for (const auto& graft : graft_messages) {
-            handle_graft(peer_id, graft);
+void GossipSub::finish_validation(const std::string& peer_id, const MessageCache::Envelope& record, ValidationResult result) {
+    {
+        std::lock_guard<std::mutex> lock(validation_mutex_);
+        auto pending_it = pending_validations_.find(record->topic);
+        if (pending_it != pending_validations_.end() && --pending_it->second == 0) {
+            pending_validations_.erase(pending_it);
         }
     }
     
-    if (payload.contains("prune")) {
-        auto prune_messages = payload["prune"];
-        for (const auto& prune : prune_messages) {
-            handle_prune(peer_id, prune);
-        }
+    if (!running_.load()) {
+        return;
     }
     
-    if (payload.contains("ihave")) {
-        auto ihave_messages = payload["ihave"];
-        for (const auto& ihave : ihave_messages) {
-            handle_ihave(peer_id, ihave);
-        }
+    if (result == ValidationResult::REJECT) {
+        penalize_invalid_message(peer_id, record->topic);
+        return;
     }
     
-    if (payload.contains("iwant")) {
-        auto iwant_messages = payload["iwant"];
-        for (const auto& iwant : iwant_messages) {
-            handle_iwant(peer_id, iwant);
-        }
+    if (result == ValidationResult::ACCEPT) {
+        deliver_message(peer_id, record);
     }
 }
 
-//=============================================================================
-// Utility Functions
-//=============================================================================
-
-std::string GossipSub::generate_message_id(const std::string& topic, const std::string& message, const std::string& sender_peer_id) {
-    std::string combined = topic + message + sender_peer_id + std::to_string(
-        std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count());
-    
-    return SHA1::hash(combined);
-}
-
-bool GossipSub::is_message_seen(const std::string& message_id) {
-    std::lock_guard<std::mutex> lock(message_cache_mutex_);
-    return message_cache_.count(message_id) > 0;
+bool GossipSub::is_peer_score_acceptable(const std::string& peer_id, double threshold) {
+    std::shared_lock<std::shared_mutex> lock(scores_mutex_);
+    auto score_it = peer_scores_.find(peer_id);
+    if (score_it == peer_scores_.end()) {
+        return true; // Unknown peer, accept for now
+    }
+    return score_it->second->score >= threshold;
 }
 
-void GossipSub::cache_message(const std::string& message_id, const std::string& topic, const std::string& message, const std::string& sender_peer_id) {
-    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+void GossipSub::handle_peer_connected(const std::string& peer_id, const std::string& ip) {
+    // Initialize peer score
+    {
+        std::unique_lock<std::shared_mutex> lock(scores_mutex_);
+        if (peer_scores_.find(peer_id) == peer_scores_.end()) {
+            auto score = std::make_unique<PeerScore>(peer_id, config_.score_params);
+            score->ip = ip;
+            peer_scores_[peer_id] = std::move(score);
+            if (!ip.empty()) {
+                peers_by_ip_[ip].insert(peer_id);
+                update_ip_colocation(ip);
+            }
+        }
+    }
     
-    auto metadata = std::make_unique<MessageMetadata>(message_id, topic, sender_peer_id);
-    message_cache_[message_id] = std::move(metadata);
-    message_ids_seen_[message_id] = std::chrono::steady_clock::now();
-}
-
-TopicSubscription* GossipSub::get_or_create_topic(const std::string& topic) {
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
-        auto topic_sub = std::make_unique<TopicSubscription>(topic);
-        TopicSubscription* ptr = topic_sub.get();
-        topics_[topic] = std::move(topic_sub);
-        return ptr;
+    // Advertise the binary codec and protocol extensions; peers that do not know the fields ignore them
+    nlohmann::json payload;
+    payload["extensions"] = nlohmann::json::array({GossipSubFrame::EXTENSION_IDONTWANT});
+    if (config_.binary_codec) {
+        payload["codecs"] = nlohmann::json::array({GossipSubFrame::CODEC_NAME});
+        payload["extensions"].push_back(GossipSubFrame::EXTENSION_CHUNK);
     }
-    return topic_it->second.get();
+    send_gossipsub_message(peer_id, GossipSubMessageType::HEARTBEAT, payload);
 }
 
-void GossipSub::cleanup_topic(const std::string& topic) {
-    auto topic_it = topics_.find(topic);
-    if (topic_it != topics_.end() && topic_it->second->subscribers.empty()) {
-        topics_.erase(topic_it);
+void GossipSub::handle_peer_disconnected(const std::string& peer_id) {
+    // Remove peer from all topics
+    for (auto& shard : topic_shards_) {
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+        for (auto& topic_pair : shard.topics) {
+            TopicSubscription* topic_sub = topic_pair.second.get();
+            topic_sub->subscribers.erase(peer_id);
+            topic_sub->remove_mesh_peer(peer_id);
+            topic_sub->fanout_peers.erase(peer_id);
+        }
     }
-}
-
-bool GossipSub::send_gossipsub_message(const std::string& peer_id, GossipSubMessageType type, const nlohmann::json& payload) {
-    nlohmann::json message;
-    message["type"] = gossipsub_message_type_to_string(type);
-    message["payload"] = payload;
     
-    try {
-        rats_client_.send(peer_id, "gossipsub", message);
-        return true;
-    } catch (const std::exception&) {
-        return false;
+    {
+        std::lock_guard<std::mutex> codec_lock(codec_mutex_);
+        binary_codec_peers_.erase(peer_id);
+        idontwant_peers_.erase(peer_id);
+        chunk_peers_.erase(peer_id);
     }
-}
-
-bool GossipSub::broadcast_gossipsub_message(GossipSubMessageType type, const nlohmann::json& payload, const std::unordered_set<std::string>& exclude) {
-    nlohmann::json message;
-    message["type"] = gossipsub_message_type_to_string(type);
-    message["payload"] = payload;
     
-    // Get all connected peers
-    auto all_peers = rats_client_.get_all_peers();
-    bool any_sent = false;
+    {
+        std::lock_guard<std::mutex> idontwant_lock(idontwant_mutex_);
+        dont_want_.erase(peer_id);
+    }
     
-    for (const auto& peer : all_peers) {
-        if (exclude.count(peer.peer_id) == 0) {
-            try {
-                rats_client_.send(peer.peer_id, "gossipsub", message);
-                any_sent = true;
-            } catch (const std::exception&) {
-                // Continue with other peers
+    {
+        std::lock_guard<std::mutex> chunk_lock(chunk_mutex_);
+        chunk_streams_.erase(std::remove_if(chunk_streams_.begin(), chunk_streams_.end(),
+                                            [&peer_id](const ChunkStream& stream) { return stream.peer_id == peer_id; }),
+                             chunk_streams_.end());
+    }
+    
+    // Remove peer score
+    std::unique_lock<std::shared_mutex> scores_lock(scores_mutex_);
+    auto score_it = peer_scores_.find(peer_id);
+    if (score_it != peer_scores_.end()) {
+        std::string ip = score_it->second->ip;
+        peer_scores_.erase(score_it);
+        auto ip_it = peers_by_ip_.find(ip);
+        if (ip_it != peers_by_ip_.end()) {
+            ip_it->second.erase(peer_id);
+            if (ip_it->second.empty()) {
+                peers_by_ip_.erase(ip_it);
+            } else {
+                update_ip_colocation(ip);
             }
         }
     }
-    
-    return any_sent;
 }
 
-ValidationResult GossipSub::validate_message(const std::string& topic, const std::string& message, const std::string& sender_peer_id) {
-    std::lock_guard<std::mutex> lock(handlers_mutex_);
-    
-    // Check topic-specific validator first
-    auto validator_it = message_validators_.find(topic);
-    if (validator_it != message_validators_.end()) {
-        return validator_it->second(topic, message, sender_peer_id);
+void GossipSub::penalize_invalid_message(const std::string& peer_id, const std::string& topic) {
+    std::unique_lock<std::shared_mutex> scores_lock(scores_mutex_);
+    auto score_it = peer_scores_.find(peer_id);
+    if (score_it == peer_scores_.end()) {
+        return;
     }
     
-    // Check global validator
-    if (global_validator_) {
-        return global_validator_(topic, message, sender_peer_id);
+    // Invalid messages count against the topic (P4); undecodable traffic is misbehaviour (P7)
+    if (topic.empty()) {
+        score_it->second->add_behaviour_penalty(1.0);
+    } else {
+        score_it->second->reject_message(topic);
     }
-    
-    // Default: accept all messages
-    return ValidationResult::ACCEPT;
 }
 
-bool GossipSub::is_peer_score_acceptable(const std::string& peer_id, double threshold) {
-    std::lock_guard<std::mutex> lock(scores_mutex_);
+void GossipSub::score_mesh_change(const std::string& peer_id, const std::string& topic, bool grafted) {
+    std::unique_lock<std::shared_mutex> scores_lock(scores_mutex_);
     auto score_it = peer_scores_.find(peer_id);
     if (score_it == peer_scores_.end()) {
-        return true; // Unknown peer, accept for now
+        return;
     }
-    return score_it->second->score >= threshold;
-}
-
-void GossipSub::handle_peer_connected(const std::string& peer_id) {
-    // Initialize peer score
-    std::lock_guard<std::mutex> lock(scores_mutex_);
-    if (peer_scores_.find(peer_id) == peer_scores_.end()) {
-        peer_scores_[peer_id] = std::make_unique<PeerScore>(peer_id);
+    if (grafted) {
+        score_it->second->graft(topic);
+    } else {
+        score_it->second->prune(topic);
     }
 }
 
-void GossipSub::handle_peer_disconnected(const std::string& peer_id) {
-    // Remove peer from all topics
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-    for (auto& topic_pair : topics_) {
-        TopicSubscription* topic_sub = topic_pair.second.get();
-        topic_sub->subscribers.erase(peer_id);
-        topic_sub->mesh_peers.erase(peer_id);
-        topic_sub->fanout_peers.erase(peer_id);
+void GossipSub::update_ip_colocation(const std::string& ip) {
+    // Every peer behind the IP gets the same surplus penalty (caller holds scores_mutex_)
+    auto ip_it = peers_by_ip_.find(ip);
+    if (ip_it == peers_by_ip_.end()) {
+        return;
     }
     
-    // Remove peer score
-    std::lock_guard<std::mutex> scores_lock(scores_mutex_);
-    peer_scores_.erase(peer_id);
+    double surplus = static_cast<double>(ip_it->second.size()) - config_.score_params.ip_colocation_factor_threshold;
+    double factor = surplus > 0.0 ? surplus * surplus : 0.0;
+    for (const auto& colocated_peer_id : ip_it->second) {
+        auto score_it = peer_scores_.find(colocated_peer_id);
+        if (score_it != peer_scores_.end()) {
+            score_it->second->set_ip_colocation_factor(factor);
+        }
+    }
 }
 
 //=============================================================================
@@ -805,20 +2320,24 @@ void GossipSub::heartbeat_loop() {
 
 void GossipSub::process_heartbeat() {
     cleanup_message_cache();
+    cleanup_large_message_state();
     
-    std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-    
-    for (const auto& topic : subscribed_topics_) {
-        maintain_mesh(topic);
-    }
-    
-    // Process fanout cleanup
+    // Walk one shard at a time, so publish and inbound traffic on other shards never wait for the heartbeat.
+    // GRAFT, PRUNE and IHAVE produced by this heartbeat go out as one message per peer after the walk.
+    ControlBatch batch;
     auto now = std::chrono::steady_clock::now();
-    for (auto& topic_pair : topics_) {
-        TopicSubscription* topic_sub = topic_pair.second.get();
-        
-        // Clean up old fanout peers if we're not subscribed
-        if (!subscribed_topics_.count(topic_pair.first)) {
+    for (auto& shard : topic_shards_) {
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+        for (auto& topic_pair : shard.topics) {
+            TopicSubscription* topic_sub = topic_pair.second.get();
+            
+            if (topic_sub->subscribed) {
+                maintain_mesh(*topic_sub, &batch);
+                emit_gossip(*topic_sub, batch);
+                continue;
+            }
+            
+            // Clean up old fanout peers if we're not subscribed
             auto time_since_prune = std::chrono::duration_cast<std::chrono::milliseconds>(
                 now - topic_sub->last_fanout_prune);
             
@@ -828,68 +2347,117 @@ void GossipSub::process_heartbeat() {
             }
         }
     }
+    flush_control_batch(batch);
+    
+    // Advance the message cache window once gossip for this heartbeat has gone out
+    {
+        std::lock_guard<std::mutex> cache_lock(message_cache_mutex_);
+        message_cache_.shift();
+    }
     
     // Update peer scores
-    std::lock_guard<std::mutex> scores_lock(scores_mutex_);
+    // Decay the score counters; between heartbeats scores only change through O(1) event updates
+    std::unique_lock<std::shared_mutex> scores_lock(scores_mutex_);
     for (auto& score_pair : peer_scores_) {
-        score_pair.second->update_score();
+        score_pair.second->decay();
     }
 }
 
-void GossipSub::maintain_mesh(const std::string& topic) {
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
+void GossipSub::emit_gossip(const TopicSubscription& topic_sub, ControlBatch& batch) {
+    const std::string& topic = topic_sub.topic;
+    
+    std::vector<std::string> message_ids;
+    {
+        std::lock_guard<std::mutex> cache_lock(message_cache_mutex_);
+        message_ids = message_cache_.get_gossip_ids(topic, static_cast<size_t>((std::max)(config_.max_ihave_messages, 0)));
+    }
+    if (message_ids.empty()) {
         return;
     }
     
-    TopicSubscription* topic_sub = topic_it->second.get();
-    int current_mesh_size = static_cast<int>(topic_sub->mesh_peers.size());
+    // Gossip to subscribers outside the mesh, they did not receive the messages eagerly
+    std::vector<std::string> candidates;
+    for (const auto& peer_id : topic_sub.subscribers) {
+        if (topic_sub.mesh_peers.count(peer_id) == 0 &&
+            is_peer_score_acceptable(peer_id, config_.score_threshold_gossip)) {
+            candidates.push_back(peer_id);
+        }
+    }
     
-    // Remove low-scoring peers from mesh
-    std::vector<std::string> to_remove;
-    for (const auto& peer_id : topic_sub->mesh_peers) {
-        if (!is_peer_score_acceptable(peer_id, config_.score_threshold_mesh)) {
-            to_remove.push_back(peer_id);
+    std::vector<std::string> targets = random_sample(candidates, config_.gossip_factor);
+    if (targets.empty()) {
+        return;
+    }
+    
+    GossipSubRecord ihave(GossipSubMessageType::IHAVE, topic);
+    ihave.message_ids = std::move(message_ids);
+    
+    for (const auto& peer_id : targets) {
+        send_control(peer_id, ihave, &batch);
+    }
+}
+
+void GossipSub::maintain_mesh(TopicSubscription& topic_sub, ControlBatch* batch) {
+    // Read the cached scores of the mesh under one shared lock
+    std::vector<std::pair<double, std::string>> scored_mesh;
+    {
+        std::shared_lock<std::shared_mutex> scores_lock(scores_mutex_);
+        for (const auto& peer_id : topic_sub.mesh_peers) {
+            auto score_it = peer_scores_.find(peer_id);
+            scored_mesh.emplace_back(score_it != peer_scores_.end() ? score_it->second->score : 0.0, peer_id);
         }
     }
     
-    for (const auto& peer_id : to_remove) {
-        remove_peer_from_mesh(topic, peer_id);
-        current_mesh_size--;
+    // Remove low-scoring peers from mesh
+    auto low_end = std::partition(scored_mesh.begin(), scored_mesh.end(),
+                                  [this](const std::pair<double, std::string>& entry) {
+                                      return entry.first >= config_.score_threshold_mesh;
+                                  });
+    for (auto it = low_end; it != scored_mesh.end(); ++it) {
+        remove_peer_from_mesh(topic_sub, it->second, batch);
     }
+    scored_mesh.erase(low_end, scored_mesh.end());
+    int current_mesh_size = static_cast<int>(scored_mesh.size());
     
     // Add peers if below optimal
     if (current_mesh_size < config_.mesh_optimal) {
         int needed = config_.mesh_optimal - current_mesh_size;
-        std::vector<std::string> candidates = select_peers_for_mesh(topic, needed);
+        std::vector<std::string> candidates = select_peers_for_mesh(topic_sub, needed);
         
         for (const auto& peer_id : candidates) {
-            add_peer_to_mesh(topic, peer_id);
+            add_peer_to_mesh(topic_sub, peer_id, batch);
         }
     }
     
-    // Remove excess peers if above high threshold
+    // Remove excess peers if above high threshold: keep the best mesh_keep_best peers
+    // (partial selection, no full sort) and prune at random among the others
     if (current_mesh_size > config_.mesh_high) {
         int excess = current_mesh_size - config_.mesh_optimal;
-        std::vector<std::string> mesh_peers_vec(topic_sub->mesh_peers.begin(), topic_sub->mesh_peers.end());
-        std::vector<std::string> to_prune = random_sample(mesh_peers_vec, excess);
+        size_t keep_best = static_cast<size_t>((std::max)(0, (std::min)(config_.mesh_keep_best, config_.mesh_optimal)));
+        if (keep_best > 0) {
+            std::nth_element(scored_mesh.begin(), scored_mesh.begin() + (keep_best - 1), scored_mesh.end(),
+                             [](const std::pair<double, std::string>& a, const std::pair<double, std::string>& b) {
+                                 return a.first > b.first;
+                             });
+        }
+        
+        std::vector<std::string> others;
+        for (size_t i = keep_best; i < scored_mesh.size(); ++i) {
+            others.push_back(scored_mesh[i].second);
+        }
+        std::vector<std::string> to_prune = random_sample(others, excess);
         
         for (const auto& peer_id : to_prune) {
-            remove_peer_from_mesh(topic, peer_id);
+            remove_peer_from_mesh(topic_sub, peer_id, batch);
         }
     }
 }
 
-void GossipSub::add_peer_to_mesh(const std::string& topic, const std::string& peer_id) {
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
-        return;
-    }
-    
-    TopicSubscription* topic_sub = topic_it->second.get();
+void GossipSub::add_peer_to_mesh(TopicSubscription& topic_sub, const std::string& peer_id, ControlBatch* batch) {
+    const std::string& topic = topic_sub.topic;
     
     // Check if peer is subscribed to the topic
-    if (topic_sub->subscribers.count(peer_id) == 0) {
+    if (topic_sub.subscribers.count(peer_id) == 0) {
         return;
     }
     
@@ -899,46 +2467,32 @@ void GossipSub::add_peer_to_mesh(const std::string& topic, const std::string& pe
     }
     
     // Add to mesh
-    if (topic_sub->mesh_peers.insert(peer_id).second) {
+    if (topic_sub.add_mesh_peer(peer_id)) {
+        score_mesh_change(peer_id, topic, true);
         // Send GRAFT message
-        nlohmann::json graft_payload;
-        graft_payload["topic"] = topic;
-        send_gossipsub_message(peer_id, GossipSubMessageType::GRAFT, graft_payload);
+        send_control(peer_id, GossipSubRecord(GossipSubMessageType::GRAFT, topic), batch);
         
         LOG_GOSSIPSUB_DEBUG("Added peer " << peer_id << " to mesh for topic: " << topic);
     }
 }
 
-void GossipSub::remove_peer_from_mesh(const std::string& topic, const std::string& peer_id) {
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
-        return;
-    }
-    
-    TopicSubscription* topic_sub = topic_it->second.get();
+void GossipSub::remove_peer_from_mesh(TopicSubscription& topic_sub, const std::string& peer_id, ControlBatch* batch) {
+    const std::string& topic = topic_sub.topic;
     
-    if (topic_sub->mesh_peers.erase(peer_id) > 0) {
+    if (topic_sub.remove_mesh_peer(peer_id)) {
+        score_mesh_change(peer_id, topic, false);
         // Send PRUNE message
-        nlohmann::json prune_payload;
-        prune_payload["topic"] = topic;
-        send_gossipsub_message(peer_id, GossipSubMessageType::PRUNE, prune_payload);
+        send_control(peer_id, GossipSubRecord(GossipSubMessageType::PRUNE, topic), batch);
         
         LOG_GOSSIPSUB_DEBUG("Removed peer " << peer_id << " from mesh for topic: " << topic);
     }
 }
 
-std::vector<std::string> GossipSub::select_peers_for_mesh(const std::string& topic, int count) {
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
-        return {};
-    }
-    
-    TopicSubscription* topic_sub = topic_it->second.get();
-    
+std::vector<std::string> GossipSub::select_peers_for_mesh(const TopicSubscription& topic_sub, int count) {
     // Get candidates (subscribers not in mesh)
     std::vector<std::string> candidates;
-    for (const auto& peer_id : topic_sub->subscribers) {
-        if (topic_sub->mesh_peers.count(peer_id) == 0 && 
+    for (const auto& peer_id : topic_sub.subscribers) {
+        if (topic_sub.mesh_peers.count(peer_id) == 0 && 
             is_peer_score_acceptable(peer_id, config_.score_threshold_mesh)) {
             candidates.push_back(peer_id);
         }
@@ -986,33 +2540,8 @@ std::vector<std::string> GossipSub::random_sample(const std::unordered_set<std::
 void GossipSub::cleanup_message_cache() {
     std::lock_guard<std::mutex> lock(message_cache_mutex_);
     
-    auto now = std::chrono::steady_clock::now();
-    
-    // Clean up old message cache entries
-    auto cache_it = message_cache_.begin();
-    while (cache_it != message_cache_.end()) {
-        auto time_since_first_seen = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - cache_it->second->first_seen);
-        
-        if (time_since_first_seen >= config_.message_cache_ttl) {
-            cache_it = message_cache_.erase(cache_it);
-        } else {
-            ++cache_it;
-        }
-    }
-    
-    // Clean up message IDs seen
-    auto ids_it = message_ids_seen_.begin();
-    while (ids_it != message_ids_seen_.end()) {
-        auto time_since_seen = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - ids_it->second);
-        
-        if (time_since_seen >= config_.message_cache_ttl) {
-            ids_it = message_ids_seen_.erase(ids_it);
-        } else {
-            ++ids_it;
-        }
-    }
+    // Slide the seen-ID window (message bodies age out through MessageCache::shift())
+    seen_messages_.expire();
 }
 
 //=============================================================================
@@ -1028,6 +2557,29 @@ void GossipSub::set_message_validator(const std::string& topic, MessageValidator
     }
 }
 
+void GossipSub::set_async_message_validator(const std::string& topic, AsyncMessageValidator validator) {
+    std::lock_guard<std::mutex> lock(handlers_mutex_);
+    if (validator) {
+        async_validators_[topic] = std::move(validator);
+    } else {
+        async_validators_.erase(topic);
+    }
+}
+
+void GossipSub::set_batch_message_validator(const std::string& topic, BatchMessageValidator validator) {
+    std::lock_guard<std::mutex> lock(handlers_mutex_);
+    if (validator) {
+        batch_validators_[topic] = std::move(validator);
+    } else {
+        batch_validators_.erase(topic);
+    }
+}
+
+void GossipSub::set_message_id_function(MessageIdFunction id_function) {
+    std::lock_guard<std::mutex> lock(message_id_mutex_);
+    message_id_function_ = std::move(id_function);
+}
+
 void GossipSub::set_message_handler(const std::string& topic, MessageHandler handler) {
     std::lock_guard<std::mutex> lock(handlers_mutex_);
     message_handlers_[topic] = handler;
@@ -1044,9 +2596,10 @@ void GossipSub::set_peer_left_handler(const std::string& topic, PeerLeftHandler
 }
 
 std::vector<std::string> GossipSub::get_topic_peers(const std::string& topic) const {
-    std::lock_guard<std::mutex> lock(topics_mutex_);
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
+    const TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it == shard.topics.end()) {
         return {};
     }
     
@@ -1055,18 +2608,18 @@ std::vector<std::string> GossipSub::get_topic_peers(const std::string& topic) co
 }
 
 std::vector<std::string> GossipSub::get_mesh_peers(const std::string& topic) const {
-    std::lock_guard<std::mutex> lock(topics_mutex_);
-    auto topic_it = topics_.find(topic);
-    if (topic_it == topics_.end()) {
+    const TopicShard& shard = topic_shard(topic);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto topic_it = shard.topics.find(topic);
+    if (topic_it == shard.topics.end()) {
         return {};
     }
     
-    const auto& mesh_peers = topic_it->second->mesh_peers;
-    return std::vector<std::string>(mesh_peers.begin(), mesh_peers.end());
+    return *topic_it->second->mesh_snapshot;
 }
 
 double GossipSub::get_peer_score(const std::string& peer_id) const {
-    std::lock_guard<std::mutex> lock(scores_mutex_);
+    std::shared_lock<std::shared_mutex> lock(scores_mutex_);
     auto score_it = peer_scores_.find(peer_id);
     if (score_it == peer_scores_.end()) {
         return 0.0;
@@ -1074,6 +2627,14 @@ double GossipSub::get_peer_score(const std::string& peer_id) const {
     return score_it->second->score;
 }
 
+void GossipSub::set_application_score(const std::string& peer_id, double value) {
+    std::unique_lock<std::shared_mutex> lock(scores_mutex_);
+    auto score_it = peer_scores_.find(peer_id);
+    if (score_it != peer_scores_.end()) {
+        score_it->second->set_application_score(value);
+    }
+}
+
 nlohmann::json GossipSub::get_statistics() const {
     nlohmann::json stats;
     
@@ -1082,25 +2643,46 @@ nlohmann::json GossipSub::get_statistics() const {
     
     // Topic stats
     {
-        std::lock_guard<std::mutex> topics_lock(topics_mutex_);
-        stats["subscribed_topics_count"] = subscribed_topics_.size();
-        stats["total_topics_count"] = topics_.size();
-        
+        size_t subscribed_count = 0;
+        size_t total_count = 0;
         nlohmann::json topics_detail;
-        for (const auto& topic_pair : topics_) {
-            nlohmann::json topic_stats;
-            topic_stats["subscribers_count"] = topic_pair.second->subscribers.size();
-            topic_stats["mesh_peers_count"] = topic_pair.second->mesh_peers.size();
-            topic_stats["fanout_peers_count"] = topic_pair.second->fanout_peers.size();
-            topic_stats["is_subscribed"] = subscribed_topics_.count(topic_pair.first) > 0;
-            topics_detail[topic_pair.first] = topic_stats;
+        for (const auto& shard : topic_shards_) {
+            std::lock_guard<std::mutex> shard_lock(shard.mutex);
+            for (const auto& topic_pair : shard.topics) {
+                nlohmann::json topic_stats;
+                topic_stats["subscribers_count"] = topic_pair.second->subscribers.size();
+                topic_stats["mesh_peers_count"] = topic_pair.second->mesh_peers.size();
+                topic_stats["fanout_peers_count"] = topic_pair.second->fanout_peers.size();
+                topic_stats["is_subscribed"] = topic_pair.second->subscribed;
+                topics_detail[topic_pair.first] = topic_stats;
+                subscribed_count += topic_pair.second->subscribed ? 1 : 0;
+                total_count++;
+            }
         }
+        stats["subscribed_topics_count"] = subscribed_count;
+        stats["total_topics_count"] = total_count;
         stats["topics"] = topics_detail;
     }
     
+    // Validation backlog
+    {
+        std::lock_guard<std::mutex> validation_lock(validation_mutex_);
+        size_t pending = 0;
+        for (const auto& topic_pending : pending_validations_) {
+            pending += topic_pending.second;
+        }
+        stats["pending_validations_count"] = pending;
+        stats["validation_queue_size"] = validation_queue_.size();
+    }
+    
+    stats["publish_received"] = publish_received_.load();
+    stats["duplicate_publish_received"] = duplicate_publish_received_.load();
+    stats["messages_delivered"] = messages_delivered_.load();
+    stats["frame_bytes_received"] = frame_bytes_received_.load();
+    
     // Peer scores
     {
-        std::lock_guard<std::mutex> scores_lock(scores_mutex_);
+        std::shared_lock<std::shared_mutex> scores_lock(scores_mutex_);
         stats["peers_count"] = peer_scores_.size();
         
         double total_score = 0.0;
@@ -1129,9 +2711,40 @@ nlohmann::json GossipSub::get_cache_statistics() const {
     
     nlohmann::json cache_stats;
     cache_stats["cached_messages_count"] = message_cache_.size();
-    cache_stats["seen_message_ids_count"] = message_ids_seen_.size();
+    cache_stats["cached_bytes"] = message_cache_.bytes();
+    cache_stats["seen_message_ids_count"] = seen_messages_.size();
+    cache_stats["seen_exact_ids_count"] = seen_messages_.exact_size();
+    cache_stats["seen_filter_bytes"] = seen_messages_.filter_bytes();
+    
+    {
+        std::lock_guard<std::mutex> chunk_lock(chunk_mutex_);
+        cache_stats["chunk_assemblies_count"] = chunk_assemblies_.size();
+        cache_stats["chunk_assembly_bytes"] = chunk_assembly_bytes_;
+        cache_stats["outgoing_chunk_streams"] = chunk_streams_.size();
+    }
     
     return cache_stats;
 }
 
+ResourceUsage GossipSub::get_message_cache_usage() const {
+    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+    ResourceUsage usage;
+    usage.entries = message_cache_.size();
+    usage.bytes = message_cache_.bytes();
+    usage.max_entries = config_.message_cache_max_messages;
+    usage.max_bytes = config_.message_cache_max_bytes;
+    usage.evictions = message_cache_.evictions();
+    return usage;
+}
+
+ResourceUsage GossipSub::get_seen_messages_usage() const {
+    std::lock_guard<std::mutex> lock(message_cache_mutex_);
+    ResourceUsage usage;
+    usage.entries = seen_messages_.size();
+    usage.bytes = seen_messages_.memory_usage();
+    usage.max_entries = config_.seen_filter_capacity;
+    usage.evictions = seen_messages_.expired();
+    return usage;
+}
+
 } // namespace librats 
\ No newline at end of file
@@ -4,20 +4,27 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <deque>
+#include <map>
+#include <cstdint>
 #include <chrono>
 #include <memory>
 #include <functional>
 #include <mutex>
+#include <shared_mutex>
+#include <array>
 #include <atomic>
 #include <thread>
 #include <condition_variable>
 #include <random>
 #include "json.hpp"
+#include "resource_usage.h"
 
 namespace librats {
 
 // Forward declarations
 class RatsClient;
+enum class SendPriority : uint8_t;
 
 /**
  * GossipSub message types
@@ -31,74 +38,382 @@ enum class GossipSubMessageType {
     PRUNE,              // Leave mesh for a topic
     IHAVE,              // Announce having certain messages
     IWANT,              // Request specific messages
-    HEARTBEAT           // Periodic heartbeat with control information
+    HEARTBEAT,          // Periodic heartbeat with control information
+    IDONTWANT,          // Ask mesh peers not to send messages we already receive (peers with the idontwant extension)
+    CHUNK               // Piece of a large PUBLISH (peers with the chunk extension)
 };
 
 /**
- * Message metadata for tracking and deduplication
+ * Decoded GossipSub message, shared by the JSON and binary wire codecs
  */
-struct MessageMetadata {
-    std::string message_id;
+struct GossipSubRecord {
+    GossipSubMessageType type;
     std::string topic;
-    std::string sender_peer_id;
-    std::chrono::steady_clock::time_point first_seen;
-    std::chrono::steady_clock::time_point last_seen;
-    std::vector<std::string> seen_from_peers;
-    int hop_count;
-    bool validated;
-
-    MessageMetadata(const std::string& id, const std::string& t, const std::string& sender)
-        : message_id(id), topic(t), sender_peer_id(sender),
-          first_seen(std::chrono::steady_clock::now()),
-          last_seen(std::chrono::steady_clock::now()),
-          hop_count(0), validated(false) {}
+    std::string message_id;                 // PUBLISH, CHUNK
+    std::string sender_peer_id;             // PUBLISH, CHUNK
+    std::string message;                    // PUBLISH, CHUNK (the piece)
+    int64_t timestamp;                      // PUBLISH, CHUNK
+    std::vector<std::string> message_ids;   // IHAVE, IWANT, IDONTWANT
+    uint32_t chunk_index;                   // CHUNK
+    uint32_t chunk_count;                   // CHUNK
+
+    GossipSubRecord() : type(GossipSubMessageType::HEARTBEAT), timestamp(0), chunk_index(0), chunk_count(0) {}
+    GossipSubRecord(GossipSubMessageType t, const std::string& topic_name)
+        : type(t), topic(topic_name), timestamp(0), chunk_index(0), chunk_count(0) {}
+
+    /**
+     * Convert to the JSON payload used by the JSON codec
+     */
+    nlohmann::json to_payload() const;
+
+    /**
+     * Parse a JSON codec payload
+     * @param type Message type from the JSON envelope
+     * @param payload JSON payload
+     */
+    static GossipSubRecord from_payload(GossipSubMessageType type, const nlohmann::json& payload);
+};
+
+/**
+ * Binary GossipSub wire codec, used with peers that advertised support for it.
+ * Frame layout: magic "GSUB" (4 bytes), version (1 byte), then records until the end.
+ * Record layout: type (1 byte), topic (varint length + bytes), then for
+ *   PUBLISH:     message id, sender peer id, timestamp (varint), message (varint length + bytes)
+ *   CHUNK:       as PUBLISH, with chunk index and chunk count (varints) before the piece
+ *   IHAVE/IWANT/IDONTWANT: id count (varint) followed by that many ids
+ * An id is a tag byte followed by 20 raw bytes for 40-char lowercase hex (SHA1) ids,
+ * or by a varint length and the bytes for anything else.
+ */
+struct GossipSubFrame {
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 5;
+    static constexpr const char* CODEC_NAME = "binary/1";   // Advertised during codec negotiation
+    static constexpr const char* EXTENSION_IDONTWANT = "idontwant";
+    static constexpr const char* EXTENSION_CHUNK = "chunk";  // Only used together with the binary codec
+
+    /**
+     * Write the frame header to out
+     */
+    static void begin(std::vector<uint8_t>& out);
+
+    /**
+     * Append one record to a frame started with begin()
+     */
+    static void append(const GossipSubRecord& record, std::vector<uint8_t>& out);
+
+    /**
+     * Parse all records of a frame
+     * @return false if the frame is truncated, malformed or of another version
+     */
+    static bool decode(const uint8_t* data, size_t size, std::vector<GossipSubRecord>& records);
+
+    /**
+     * Check whether data starts with the GossipSub frame magic
+     */
+    static bool is_gossipsub_frame(const uint8_t* data, size_t size);
+};
+
+/**
+ * Sliding-window message cache (mcache) used to answer IWANT requests.
+ *
+ * Messages are grouped into heartbeat windows, newest first. IHAVE gossip is
+ * built from the newest few windows and the oldest window is dropped on every
+ * shift(), so a message stays retrievable for history_length heartbeats. The
+ * cached PUBLISH record is the exact object handed to the send path, shared
+ * by reference rather than copied. Entries are additionally bounded by count and
+ * bytes; when either limit is hit the oldest messages are evicted first.
+ *
+ * Not thread safe, callers provide locking.
+ */
+class MessageCache {
+public:
+    using Envelope = std::shared_ptr<const GossipSubRecord>;
+
+    MessageCache(size_t history_length, size_t history_gossip, size_t max_messages, size_t max_bytes);
+
+    /**
+     * Store a message in the newest window
+     * @param message_id Message identifier
+     * @param topic Topic the message was published to
+     * @param envelope PUBLISH record as handed to the send path
+     * @param size Approximate payload size in bytes, used for the byte limit
+     * @return true if stored, false if already cached or larger than the byte limit
+     */
+    bool put(const std::string& message_id, const std::string& topic, Envelope envelope, size_t size);
+
+    /**
+     * Look up a cached message
+     * @param message_id Message identifier
+     * @return Shared envelope, or nullptr if not cached
+     */
+    Envelope get(const std::string& message_id) const;
+
+    /**
+     * Get IDs of messages in the gossip windows for a topic, newest first
+     * @param topic Topic name
+     * @param max_ids Maximum number of IDs to return
+     */
+    std::vector<std::string> get_gossip_ids(const std::string& topic, size_t max_ids) const;
+
+    /**
+     * Open a new window and drop messages from windows older than history_length
+     */
+    void shift();
+
+    bool contains(const std::string& message_id) const { return entries_.count(message_id) > 0; }
+    size_t size() const { return entries_.size(); }
+    size_t bytes() const { return bytes_; }
+    uint64_t evictions() const { return evictions_; }  // Messages dropped by the limits or with their window
+
+private:
+    struct Entry {
+        std::string topic;
+        Envelope envelope;
+        size_t size;
+    };
+
+    size_t history_length_;
+    size_t history_gossip_;
+    size_t max_messages_;
+    size_t max_bytes_;
+    size_t bytes_;
+    uint64_t evictions_;
+
+    std::unordered_map<std::string, Entry> entries_;
+    std::deque<std::deque<std::string>> windows_;  // Front is the current window
+
+    void erase(const std::string& message_id);
+    void evict_oldest();
+};
+
+/**
+ * Fixed-memory set of recently seen message IDs used for deduplication.
+ *
+ * The window is split into time buckets, each with its own Bloom filter sized
+ * for the expected number of messages; the oldest filter is cleared when the
+ * window slides, so memory does not grow with the message rate. IDs from the
+ * current and previous bucket are also kept in an exact set (up to a cap), so
+ * recent duplicates, which are the common case, are answered without relying
+ * on the filters. An ID is remembered for at least the window duration.
+ *
+ * Not thread safe, callers provide locking.
+ */
+class SeenMessageFilter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Constructor
+     * @param window How long IDs are remembered
+     * @param buckets Number of time buckets the window is split into
+     * @param capacity Expected number of distinct IDs per window
+     * @param false_positive_rate Target false positive rate of each bucket filter at capacity
+     * @param max_exact_ids Maximum IDs held in the exact set per bucket
+     */
+    SeenMessageFilter(std::chrono::milliseconds window, size_t buckets, size_t capacity,
+                      double false_positive_rate, size_t max_exact_ids);
+
+    /**
+     * Check whether an ID was (probably) seen within the window
+     */
+    bool contains(const std::string& message_id, Clock::time_point now = Clock::now());
+
+    /**
+     * Record an ID
+     * @return true if the ID was not seen before
+     */
+    bool insert(const std::string& message_id, Clock::time_point now = Clock::now());
+
+    /**
+     * Slide the window, dropping buckets older than it
+     */
+    void expire(Clock::time_point now = Clock::now());
+
+    size_t size() const;                          // IDs inserted into the live buckets
+    size_t exact_size() const { return exact_current_.size() + exact_previous_.size(); }
+    size_t filter_bytes() const;                  // Memory held by the Bloom filters
+    size_t memory_usage() const;                  // Filters plus the exact sets, approximate
+    uint64_t expired() const { return expired_; } // IDs dropped as the window slid
+
+private:
+    struct Bucket {
+        std::vector<uint64_t> bits;
+        size_t count = 0;
+    };
+
+    std::chrono::milliseconds bucket_span_;
+    size_t bit_count_;
+    size_t hash_count_;
+    size_t max_exact_ids_;
+    std::vector<Bucket> buckets_;
+    size_t current_;
+    Clock::time_point current_started_;
+    std::unordered_set<std::string> exact_current_;
+    std::unordered_set<std::string> exact_previous_;
+    uint64_t expired_;
+
+    bool filters_contain(uint64_t h1, uint64_t h2) const;
+    static void hash_id(const std::string& message_id, uint64_t& h1, uint64_t& h2);
+};
+
+/**
+ * Per-topic peer scoring parameters (GossipSub v1.1 P1-P4).
+ * Counters decay multiplicatively once per heartbeat; weights of penalties are negative.
+ */
+struct TopicScoreParams {
+    double topic_weight;                            // Weight of this topic's contribution
+    
+    // P1: time in mesh
+    double time_in_mesh_weight;
+    std::chrono::milliseconds time_in_mesh_quantum; // Mesh time counted in units of this
+    double time_in_mesh_cap;
+    
+    // P2: first message deliveries
+    double first_message_deliveries_weight;
+    double first_message_deliveries_decay;
+    double first_message_deliveries_cap;
+    
+    // P3: mesh message delivery deficit, squared (0 weight disables)
+    double mesh_message_deliveries_weight;
+    double mesh_message_deliveries_decay;
+    double mesh_message_deliveries_cap;
+    double mesh_message_deliveries_threshold;
+    std::chrono::milliseconds mesh_message_deliveries_activation; // Grace period after GRAFT
+    
+    // P3b: deficit carried over when a peer leaves the mesh
+    double mesh_failure_penalty_weight;
+    double mesh_failure_penalty_decay;
+    
+    // P4: invalid messages, squared
+    double invalid_message_deliveries_weight;
+    double invalid_message_deliveries_decay;
+    
+    TopicScoreParams()
+        : topic_weight(1.0),
+          time_in_mesh_weight(1.0), time_in_mesh_quantum(std::chrono::minutes(1)), time_in_mesh_cap(10.0),
+          first_message_deliveries_weight(0.1), first_message_deliveries_decay(0.99),
+          first_message_deliveries_cap(200.0),
+          mesh_message_deliveries_weight(0.0), mesh_message_deliveries_decay(0.97),
+          mesh_message_deliveries_cap(100.0), mesh_message_deliveries_threshold(1.0),
+          mesh_message_deliveries_activation(std::chrono::seconds(30)),
+          mesh_failure_penalty_weight(0.0), mesh_failure_penalty_decay(0.97),
+          invalid_message_deliveries_weight(-5.0), invalid_message_deliveries_decay(0.99) {}
+};
+
+/**
+ * Peer scoring parameters (GossipSub v1.1 P5-P7 and topic defaults)
+ */
+struct PeerScoreParams {
+    std::unordered_map<std::string, TopicScoreParams> topics;  // Per-topic overrides
+    TopicScoreParams default_topic;         // Parameters of topics without an override
+    double topic_score_cap;                 // Upper bound of the summed topic contributions (0 = none)
+    
+    double app_specific_weight;             // P5: application-provided score
+    
+    double ip_colocation_factor_weight;     // P6: peers sharing an IP beyond the threshold, squared (0 disables)
+    int ip_colocation_factor_threshold;
+    
+    double behaviour_penalty_weight;        // P7: protocol misbehaviour (malformed frames), squared excess
+    double behaviour_penalty_threshold;
+    double behaviour_penalty_decay;
+    
+    double decay_to_zero;                   // Decayed counters below this are reset to 0
+    
+    PeerScoreParams()
+        : topic_score_cap(50.0), app_specific_weight(1.0),
+          ip_colocation_factor_weight(0.0), ip_colocation_factor_threshold(10),
+          behaviour_penalty_weight(-5.0), behaviour_penalty_threshold(0.0), behaviour_penalty_decay(0.99),
+          decay_to_zero(0.01) {}
+    
+    const TopicScoreParams& topic_params(const std::string& topic) const {
+        auto it = topics.find(topic);
+        return it != topics.end() ? it->second : default_topic;
+    }
 };
 
 /**
- * Peer scoring metrics for mesh management
+ * Scoring counters of one peer in one topic
+ */
+struct TopicPeerScore {
+    bool in_mesh;
+    std::chrono::steady_clock::time_point grafted_at;
+    double mesh_time;                       // Seconds in the mesh, refreshed every heartbeat
+    double first_message_deliveries;
+    double mesh_message_deliveries;
+    bool mesh_message_deliveries_active;
+    double mesh_failure_penalty;
+    double invalid_message_deliveries;
+    double contribution;                    // Cached weighted topic score
+    
+    TopicPeerScore()
+        : in_mesh(false), mesh_time(0.0), first_message_deliveries(0.0), mesh_message_deliveries(0.0),
+          mesh_message_deliveries_active(false), mesh_failure_penalty(0.0), invalid_message_deliveries(0.0),
+          contribution(0.0) {}
+};
+
+/**
+ * Peer score with decaying counters (GossipSub v1.1 P1-P7).
+ * Each event updates one counter and the cached score in O(1); decay() runs once per
+ * heartbeat. Not thread safe, callers provide locking.
  */
 struct PeerScore {
     std::string peer_id;
-    double score;
+    std::string ip;
+    double score;                           // Cached total, read in O(1)
+    std::unordered_map<std::string, TopicPeerScore> topics;
+    double topic_total;                     // Sum of topic contributions before the cap
+    double application_score;               // P5
+    double ip_colocation_factor;            // P6
+    double behaviour_penalty;               // P7
+    std::chrono::steady_clock::time_point connected_since;
     
-    // Score components
-    double topic_score;           // Score based on topic participation
-    double delivery_score;        // Score based on message delivery
-    double mesh_behavior_score;   // Score based on mesh behavior
-    double invalid_message_score; // Penalty for invalid messages
+    PeerScore(const std::string& id, const PeerScoreParams& params)
+        : peer_id(id), score(0.0), topic_total(0.0), application_score(0.0), ip_colocation_factor(0.0),
+          behaviour_penalty(0.0), connected_since(std::chrono::steady_clock::now()), params_(params) {}
     
-    // Timing metrics
-    std::chrono::steady_clock::time_point last_updated;
-    std::chrono::steady_clock::time_point connected_since;
+    void graft(const std::string& topic);
+    void prune(const std::string& topic);
+    void deliver_first_message(const std::string& topic);
+    void reject_message(const std::string& topic);
+    void add_behaviour_penalty(double count);
+    void set_application_score(double value);
+    void set_ip_colocation_factor(double value);
+    void decay();
     
-    // Behavioral metrics
-    int messages_delivered;
-    int messages_invalid;
-    int graft_requests;
-    int prune_requests;
-    
-    PeerScore(const std::string& id) 
-        : peer_id(id), score(0.0), topic_score(0.0), delivery_score(0.0),
-          mesh_behavior_score(0.0), invalid_message_score(0.0),
-          last_updated(std::chrono::steady_clock::now()),
-          connected_since(std::chrono::steady_clock::now()),
-          messages_delivered(0), messages_invalid(0),
-          graft_requests(0), prune_requests(0) {}
-    
-    void update_score();
+private:
+    const PeerScoreParams& params_;
+    
+    void refresh_topic(const std::string& topic, TopicPeerScore& stats);
+    void refresh_score();
 };
 
+constexpr size_t GOSSIPSUB_TOPIC_SHARDS = 16;   // Independently locked slices of per-topic state
+constexpr size_t GOSSIPSUB_CHUNK_QUEUE_DEPTH = 4; // Outbound queue depth below which a peer gets its next chunk
+
 /**
- * Topic subscription information
+ * Topic subscription information.
+ * mesh_peers is only changed through add_mesh_peer/remove_mesh_peer/clear_mesh, which keep
+ * mesh_snapshot in sync; readers copy the snapshot pointer and iterate it without the shard lock.
  */
 struct TopicSubscription {
     std::string topic;
+    bool subscribed;                                    // We are subscribed to this topic ourselves
     std::unordered_set<std::string> subscribers;        // All peers subscribed to this topic
     std::unordered_set<std::string> mesh_peers;         // Peers in our mesh for this topic
     std::unordered_set<std::string> fanout_peers;       // Peers in fanout (when we're not subscribed)
     std::chrono::steady_clock::time_point last_fanout_prune;
+    std::shared_ptr<const std::vector<std::string>> mesh_snapshot;  // Immutable copy of mesh_peers
+    
+    TopicSubscription(const std::string& t)
+        : topic(t), subscribed(false), last_fanout_prune(std::chrono::steady_clock::now()),
+          mesh_snapshot(std::make_shared<const std::vector<std::string>>()) {}
     
-    TopicSubscription(const std::string& t) : topic(t), last_fanout_prune(std::chrono::steady_clock::now()) {}
+    bool add_mesh_peer(const std::string& peer_id);
+    bool remove_mesh_peer(const std::string& peer_id);
+    void clear_mesh();
+    
+private:
+    void refresh_mesh_snapshot();
 };
 
 /**
@@ -123,25 +438,59 @@ struct GossipSubConfig {
     std::chrono::milliseconds heartbeat_interval; // Heartbeat interval
     
     // Message parameters
-    std::chrono::milliseconds message_cache_ttl; // Message cache time to live
+    std::chrono::milliseconds message_cache_ttl; // How long message IDs are remembered for deduplication
+    int seen_filter_buckets;         // Time buckets of the seen-ID window
+    size_t seen_filter_capacity;     // Expected distinct messages per message_cache_ttl (sizes the filters)
+    double seen_filter_false_positive_rate; // Target false positive rate of the seen-ID filters
+    size_t seen_exact_max_ids;       // Recent IDs per bucket kept in an exact set
+    int history_length;              // Heartbeat windows kept in the message cache
+    int history_gossip;              // Newest windows advertised in IHAVE gossip
+    size_t message_cache_max_messages; // Maximum messages held in the message cache
+    size_t message_cache_max_bytes;  // Maximum payload bytes held in the message cache
     int max_ihave_messages;          // Maximum messages in IHAVE
     int max_iwant_messages;          // Maximum messages in IWANT
     
     // Scoring parameters
+    PeerScoreParams score_params;    // Weights and decay of the score components
+    int mesh_keep_best;              // Highest scoring peers always kept when an oversized mesh is pruned
     double score_threshold_accept;   // Minimum score to accept messages
     double score_threshold_gossip;   // Minimum score to gossip to peer
     double score_threshold_mesh;     // Minimum score to keep in mesh
     double score_threshold_publish;  // Minimum score to accept published messages
     
+    // Wire format
+    bool binary_codec;               // Use the binary codec with peers that support it (JSON otherwise)
+    
+    // Large messages
+    size_t max_chunk_size;           // PUBLISH payloads above this are sent in chunks of this size (0 disables chunking)
+    size_t max_chunk_reassembly_bytes; // Bytes of partially received chunked messages kept at once
+    std::chrono::milliseconds chunk_reassembly_timeout; // Partially received messages are dropped after this
+    size_t idontwant_message_size_threshold; // Messages at least this large trigger IDONTWANT to mesh peers
+    size_t max_idontwant_messages;   // IDONTWANT ids remembered per peer
+    
+    // Asynchronous validation
+    int validation_threads;          // Workers running async and batch validators (0 runs them on the receive thread)
+    size_t validation_batch_size;    // Maximum messages handed to one batch validator call
+    size_t max_pending_validations_per_topic; // Messages of one topic awaiting validation before new ones are dropped
+    
     GossipSubConfig()
-        : mesh_low(4), mesh_high(12), mesh_optimal(6),
+        : mesh_low(4), mesh_high(8), mesh_optimal(6),
           fanout_size(6), fanout_ttl(std::chrono::seconds(60)),
           gossip_factor(3), gossip_lazy(3), gossip_retransmit(std::chrono::seconds(3)),
           heartbeat_interval(std::chrono::seconds(1)),
           message_cache_ttl(std::chrono::minutes(5)),
+          seen_filter_buckets(5), seen_filter_capacity(100000),
+          seen_filter_false_positive_rate(1e-6), seen_exact_max_ids(65536),
+          history_length(5), history_gossip(3),
+          message_cache_max_messages(5000), message_cache_max_bytes(32 * 1024 * 1024),
           max_ihave_messages(5000), max_iwant_messages(5000),
-          score_threshold_accept(-100.0), score_threshold_gossip(-1000.0),
-          score_threshold_mesh(-10.0), score_threshold_publish(-50.0) {}
+          mesh_keep_best(4), score_threshold_accept(-100.0), score_threshold_gossip(-1000.0),
+          score_threshold_mesh(-10.0), score_threshold_publish(-50.0),
+          binary_codec(true),
+          max_chunk_size(64 * 1024), max_chunk_reassembly_bytes(64 * 1024 * 1024),
+          chunk_reassembly_timeout(std::chrono::seconds(30)),
+          idontwant_message_size_threshold(1024), max_idontwant_messages(1024),
+          validation_threads(2), validation_batch_size(64), max_pending_validations_per_topic(1024) {}
 };
 
 /**
@@ -150,7 +499,17 @@ struct GossipSubConfig {
 enum class ValidationResult {
     ACCEPT,
     REJECT,
-    IGNORE_MSG
+    IGNORE_MSG,
+    PENDING         // Async validators only: the result is delivered later through the ValidationCompletion
+};
+
+/**
+ * Message awaiting a batch validator decision
+ */
+struct ValidationRequest {
+    std::string topic;
+    std::string message;
+    std::string sender_peer_id;
 };
 
 /**
@@ -160,6 +519,10 @@ using MessageValidator = std::function<ValidationResult(const std::string& topic
 using MessageHandler = std::function<void(const std::string& topic, const std::string& message, const std::string& sender_peer_id)>;
 using PeerJoinedHandler = std::function<void(const std::string& topic, const std::string& peer_id)>;
 using PeerLeftHandler = std::function<void(const std::string& topic, const std::string& peer_id)>;
+using MessageIdFunction = std::function<std::string(const std::string& topic, const std::string& message, const std::string& sender_peer_id)>;
+using ValidationCompletion = std::function<void(ValidationResult result)>;
+using AsyncMessageValidator = std::function<ValidationResult(const std::string& topic, const std::string& message, const std::string& sender_peer_id, ValidationCompletion complete)>;
+using BatchMessageValidator = std::function<std::vector<ValidationResult>(const std::vector<ValidationRequest>& requests)>;
 
 /**
  * Main GossipSub implementation class
@@ -197,6 +560,20 @@ public:
      */
     bool is_running() const;
     
+    /**
+     * Replace the configuration. Only allowed while the service is stopped
+     * (e.g. between constructing the RatsClient and starting it).
+     * @param config New GossipSub configuration
+     * @return true if applied, false if the service is running
+     */
+    bool set_config(const GossipSubConfig& config);
+    
+    /**
+     * Get the current configuration
+     * @return GossipSub configuration
+     */
+    const GossipSubConfig& get_config() const;
+    
     // Topic management
     /**
      * Subscribe to a topic
@@ -250,6 +627,26 @@ public:
      */
     void set_message_validator(const std::string& topic, MessageValidator validator);
     
+    /**
+     * Set asynchronous message validator for a topic.
+     * Runs on the validation workers after the synchronous validators accepted the message.
+     * Returning PENDING holds the message (no forwarding, no delivery) until complete() is
+     * called, from any thread and before this GossipSub is destroyed; any other result applies at once.
+     * @param topic Topic name (empty for all topics)
+     * @param validator Async validation function (nullptr removes it)
+     */
+    void set_async_message_validator(const std::string& topic, AsyncMessageValidator validator);
+    
+    /**
+     * Set batch message validator for a topic.
+     * Runs on the validation workers with up to validation_batch_size pending messages of the
+     * topic at once and returns one result per request (PENDING counts as IGNORE_MSG).
+     * Takes precedence over an async validator of the same topic.
+     * @param topic Topic name (empty for all topics)
+     * @param validator Batch validation function (nullptr removes it)
+     */
+    void set_batch_message_validator(const std::string& topic, BatchMessageValidator validator);
+    
     /**
      * Set message handler for a topic
      * @param topic Topic name
@@ -257,6 +654,15 @@ public:
      */
     void set_message_handler(const std::string& topic, MessageHandler handler);
     
+    /**
+     * Set the function computing IDs of published messages.
+     * The default is a SHA1 content hash of topic and message, so the same payload
+     * published twice on a topic within message_cache_ttl is delivered once.
+     * All peers of a topic must use the same function.
+     * @param id_function Message ID function (nullptr restores the default)
+     */
+    void set_message_id_function(MessageIdFunction id_function);
+    
     /**
      * Set peer joined handler for a topic
      * @param topic Topic name
@@ -293,6 +699,13 @@ public:
      */
     double get_peer_score(const std::string& peer_id) const;
     
+    /**
+     * Set the application-specific score component (P5) of a peer
+     * @param peer_id Peer ID
+     * @param value Score, scaled by score_params.app_specific_weight
+     */
+    void set_application_score(const std::string& peer_id, double value);
+    
     // Statistics and debugging
     /**
      * Get GossipSub statistics
@@ -305,30 +718,54 @@ public:
      * @return JSON object with cache statistics
      */
     nlohmann::json get_cache_statistics() const;
+    
+    /**
+     * Get the memory held by the message cache, bounded by message_cache_max_messages and message_cache_max_bytes
+     * @return Usage, with one entry per cached message and payload bytes
+     */
+    ResourceUsage get_message_cache_usage() const;
+    
+    /**
+     * Get the memory held by the seen message filter, fixed by its configured capacity
+     * @return Usage, with one entry per ID in the live window
+     */
+    ResourceUsage get_seen_messages_usage() const;
 
 private:
     RatsClient& rats_client_;
     GossipSubConfig config_;
     std::atomic<bool> running_;
     
+    // Traffic counters reported by get_statistics()
+    std::atomic<uint64_t> publish_received_;            // Publish records received, duplicates included
+    std::atomic<uint64_t> duplicate_publish_received_;  // Publish records dropped as already seen
+    std::atomic<uint64_t> messages_delivered_;          // Messages handed to local subscribers
+    std::atomic<uint64_t> frame_bytes_received_;        // Bytes of binary codec frames received
+    
     // Thread management
     std::thread heartbeat_thread_;
     mutable std::mutex heartbeat_mutex_;
     std::condition_variable heartbeat_cv_;
     
-    // Topic management
-    mutable std::mutex topics_mutex_;
-    std::unordered_map<std::string, std::unique_ptr<TopicSubscription>> topics_;
-    std::unordered_set<std::string> subscribed_topics_;
+    // Topic state, sharded by topic name so busy topics and the heartbeat do not contend on one lock
+    struct TopicShard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<TopicSubscription>> topics;
+    };
+    std::array<TopicShard, GOSSIPSUB_TOPIC_SHARDS> topic_shards_;
     
-    // Peer scoring
-    mutable std::mutex scores_mutex_;
+    TopicShard& topic_shard(const std::string& topic);
+    const TopicShard& topic_shard(const std::string& topic) const;
+    
+    // Peer scoring (score checks on the publish path take a shared lock)
+    mutable std::shared_mutex scores_mutex_;
     std::unordered_map<std::string, std::unique_ptr<PeerScore>> peer_scores_;
+    std::unordered_map<std::string, std::unordered_set<std::string>> peers_by_ip_;  // For P6
     
     // Message cache and deduplication
     mutable std::mutex message_cache_mutex_;
-    std::unordered_map<std::string, std::unique_ptr<MessageMetadata>> message_cache_;
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> message_ids_seen_;
+    MessageCache message_cache_;
+    SeenMessageFilter seen_messages_;
     
     // Handlers and validators
     mutable std::mutex handlers_mutex_;
@@ -337,13 +774,59 @@ private:
     std::unordered_map<std::string, PeerJoinedHandler> peer_joined_handlers_; // topic -> handler
     std::unordered_map<std::string, PeerLeftHandler> peer_left_handlers_;   // topic -> handler
     MessageValidator global_validator_;  // Global validator for all topics
-    
-    // Control message queues for heartbeat
-    mutable std::mutex control_queue_mutex_;
-    std::vector<nlohmann::json> pending_grafts_;
-    std::vector<nlohmann::json> pending_prunes_;
-    std::vector<nlohmann::json> pending_ihaves_;
-    std::vector<nlohmann::json> pending_iwants_;
+    std::unordered_map<std::string, AsyncMessageValidator> async_validators_;  // topic -> validator ("" for all)
+    std::unordered_map<std::string, BatchMessageValidator> batch_validators_;  // topic -> validator ("" for all)
+    
+    // Custom message ID function (own mutex, so message handlers may publish)
+    mutable std::mutex message_id_mutex_;
+    MessageIdFunction message_id_function_;
+    
+    // Control messages collected during a heartbeat, sent as one frame per peer once all shards are done
+    using ControlBatch = std::unordered_map<std::string, std::vector<GossipSubRecord>>;
+    
+    // Messages held for async or batch validation, and the workers running the validators
+    struct PendingValidation {
+        std::string peer_id;            // Peer the message came from
+        MessageCache::Envelope record;
+    };
+    mutable std::mutex validation_mutex_;
+    std::condition_variable validation_cv_;
+    std::deque<PendingValidation> validation_queue_;
+    std::unordered_map<std::string, size_t> pending_validations_;  // topic -> queued or awaiting completion
+    std::vector<std::thread> validation_threads_;
+    
+    // Peers that negotiated the binary codec and protocol extensions
+    mutable std::mutex codec_mutex_;
+    std::unordered_set<std::string> binary_codec_peers_;
+    std::unordered_set<std::string> idontwant_peers_;
+    std::unordered_set<std::string> chunk_peers_;
+    
+    // Message ids each peer asked us not to send, with their expiry
+    mutable std::mutex idontwant_mutex_;
+    std::unordered_map<std::string, std::unordered_map<std::string, std::chrono::steady_clock::time_point>> dont_want_;
+    
+    // Large messages: chunked sends paced by chunk_thread_, and partially received messages
+    struct ChunkStream {
+        std::string peer_id;
+        MessageCache::Envelope record;  // Whole PUBLISH record
+        uint32_t next_index;
+        uint32_t chunk_count;
+    };
+    struct ChunkAssembly {
+        std::string topic;
+        std::string sender_peer_id;
+        int64_t timestamp;
+        uint32_t chunk_count;
+        std::map<uint32_t, std::string> pieces;  // chunk index -> piece
+        size_t bytes;
+        std::chrono::steady_clock::time_point started;
+    };
+    mutable std::mutex chunk_mutex_;
+    std::condition_variable chunk_cv_;
+    std::deque<ChunkStream> chunk_streams_;
+    std::unordered_map<std::string, ChunkAssembly> chunk_assemblies_;  // message_id -> assembly
+    size_t chunk_assembly_bytes_;
+    std::thread chunk_thread_;
     
     // Random number generation
     mutable std::mutex rng_mutex_;
@@ -353,47 +836,72 @@ private:
     void heartbeat_loop();
     void process_heartbeat();
     void handle_gossipsub_message(const std::string& peer_id, const nlohmann::json& message);
+    bool handle_binary_data(const std::string& peer_id, const uint8_t* data, size_t size);
+    void handle_record(const std::string& peer_id, GossipSubRecord record);
     
     // Message handling
-    void handle_subscribe(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_unsubscribe(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_publish(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_gossip(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_graft(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_prune(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_ihave(const std::string& peer_id, const nlohmann::json& payload);
-    void handle_iwant(const std::string& peer_id, const nlohmann::json& payload);
+    void handle_subscribe(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_unsubscribe(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_publish(const std::string& peer_id, const MessageCache::Envelope& record, bool reassembled = false);
+    void deliver_message(const std::string& peer_id, const MessageCache::Envelope& record);
+    void handle_gossip(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_graft(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_prune(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_ihave(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_iwant(const std::string& peer_id, const GossipSubRecord& record);
     void handle_heartbeat(const std::string& peer_id, const nlohmann::json& payload);
+    void handle_idontwant(const std::string& peer_id, const GossipSubRecord& record);
+    void handle_chunk(const std::string& peer_id, const GossipSubRecord& record);
     
     // Mesh management
-    void maintain_mesh(const std::string& topic);
-    void add_peer_to_mesh(const std::string& topic, const std::string& peer_id);
-    void remove_peer_from_mesh(const std::string& topic, const std::string& peer_id);
-    std::vector<std::string> select_peers_for_mesh(const std::string& topic, int count);
+    void maintain_mesh(TopicSubscription& topic_sub, ControlBatch* batch = nullptr);
+    void add_peer_to_mesh(TopicSubscription& topic_sub, const std::string& peer_id, ControlBatch* batch = nullptr);
+    void remove_peer_from_mesh(TopicSubscription& topic_sub, const std::string& peer_id, ControlBatch* batch = nullptr);
+    std::vector<std::string> select_peers_for_mesh(const TopicSubscription& topic_sub, int count);
+    std::vector<std::string> select_publish_targets(const std::string& topic);
     std::vector<std::string> select_peers_for_gossip(const std::string& topic, int count, const std::unordered_set<std::string>& exclude = {});
     
     // Message utilities
     std::string generate_message_id(const std::string& topic, const std::string& message, const std::string& sender_peer_id);
     bool is_message_seen(const std::string& message_id);
-    void cache_message(const std::string& message_id, const std::string& topic, const std::string& message, const std::string& sender_peer_id);
+    bool mark_message_seen(const std::string& message_id);
+    void cache_message(const std::string& message_id, const std::string& topic, const MessageCache::Envelope& envelope, size_t size);
     void cleanup_message_cache();
+    void emit_gossip(const TopicSubscription& topic_sub, ControlBatch& batch);
     
     // Peer management
-    void update_peer_score(const std::string& peer_id);
-    void handle_peer_connected(const std::string& peer_id);
+    void penalize_invalid_message(const std::string& peer_id, const std::string& topic = "");
+    void score_mesh_change(const std::string& peer_id, const std::string& topic, bool grafted);
+    void update_ip_colocation(const std::string& ip);
+    void handle_peer_connected(const std::string& peer_id, const std::string& ip = "");
     void handle_peer_disconnected(const std::string& peer_id);
     
     // Message sending utilities
     bool send_gossipsub_message(const std::string& peer_id, GossipSubMessageType type, const nlohmann::json& payload);
-    bool broadcast_gossipsub_message(GossipSubMessageType type, const nlohmann::json& payload, const std::unordered_set<std::string>& exclude = {});
+    bool send_record(const std::string& peer_id, const GossipSubRecord& record);
+    bool send_frame(const std::string& peer_id, std::vector<uint8_t>&& frame, SendPriority priority);
+    void send_record_to_peers(const std::vector<std::string>& peer_ids, const GossipSubRecord& record);
+    void send_publish_to_peers(const std::vector<std::string>& peer_ids, const MessageCache::Envelope& record);
+    bool broadcast_record(const GossipSubRecord& record, const std::unordered_set<std::string>& exclude = {});
+    void send_control(const std::string& peer_id, GossipSubRecord record, ControlBatch* batch = nullptr);
+    void flush_control_batch(const ControlBatch& batch);
+    bool peer_uses_binary_codec(const std::string& peer_id) const;
+    void send_idontwant(const std::string& topic, const std::string& message_id, const std::string& exclude_peer_id);
+    bool peer_dont_want(const std::string& peer_id, const std::string& message_id) const;
+    void chunk_sender_loop();
+    void cleanup_large_message_state();
     
     // Validation
     ValidationResult validate_message(const std::string& topic, const std::string& message, const std::string& sender_peer_id);
+    bool submit_async_validation(const std::string& peer_id, const MessageCache::Envelope& record);
+    void validation_loop();
+    void run_validations(std::vector<PendingValidation>& batch);
+    void finish_validation(const std::string& peer_id, const MessageCache::Envelope& record, ValidationResult result);
     bool is_peer_score_acceptable(const std::string& peer_id, double threshold);
     
     // Topic utilities
-    TopicSubscription* get_or_create_topic(const std::string& topic);
-    void cleanup_topic(const std::string& topic);
+    TopicSubscription* get_or_create_topic(TopicShard& shard, const std::string& topic);
+    void cleanup_topic(TopicShard& shard, const std::string& topic);
     
     // Random selection utilities
     std::vector<std::string> random_sample(const std::vector<std::string>& peers, int count);
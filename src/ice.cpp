@@ -26,6 +26,126 @@
 
 namespace librats {
 
+namespace {
+
+// Value of the first attribute of the given type in a STUN message
+bool find_stun_attribute(const std::vector<uint8_t>& message, uint16_t type, std::vector<uint8_t>& value) {
+    size_t offset = stun::HEADER_SIZE;
+    while (offset + 4 <= message.size()) {
+        uint16_t attr_type = (static_cast<uint16_t>(message[offset]) << 8) | message[offset + 1];
+        uint16_t attr_length = (static_cast<uint16_t>(message[offset + 2]) << 8) | message[offset + 3];
+        offset += 4;
+        if (offset + attr_length > message.size()) {
+            return false;
+        }
+        if (attr_type == type) {
+            value.assign(message.begin() + offset, message.begin() + offset + attr_length);
+            return true;
+        }
+        offset += (attr_length + 3) & ~3;
+    }
+    return false;
+}
+
+bool has_stun_attribute(const std::vector<uint8_t>& message, uint16_t type) {
+    std::vector<uint8_t> value;
+    return find_stun_attribute(message, type, value);
+}
+
+// Big-endian field access for STUN/TURN framing
+uint16_t read_be16(const uint8_t* data) {
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t read_be32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+void write_be16(uint8_t* data, uint16_t value) {
+    data[0] = static_cast<uint8_t>(value >> 8);
+    data[1] = static_cast<uint8_t>(value);
+}
+
+void write_be32(uint8_t* data, uint32_t value) {
+    write_be16(data, static_cast<uint16_t>(value >> 16));
+    write_be16(data + 2, static_cast<uint16_t>(value));
+}
+
+// STUN header with a fresh transaction ID and no attributes yet
+std::vector<uint8_t> make_stun_message(uint16_t type, std::string* transaction_id) {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    std::vector<uint8_t> message(stun::HEADER_SIZE, 0);
+    write_be16(message.data(), type);
+    write_be32(message.data() + 4, stun::MAGIC_COOKIE);
+    for (size_t i = 8; i < stun::HEADER_SIZE; ++i) {
+        message[i] = static_cast<uint8_t>(gen());
+    }
+    if (transaction_id) {
+        transaction_id->assign(reinterpret_cast<const char*>(message.data() + 8), stun::TRANSACTION_ID_SIZE);
+    }
+    return message;
+}
+
+void append_stun_attribute(std::vector<uint8_t>& message, uint16_t type, const uint8_t* value, size_t length) {
+    size_t offset = message.size();
+    message.resize(offset + 4 + ((length + 3) & ~static_cast<size_t>(3)), 0);
+    write_be16(message.data() + offset, type);
+    write_be16(message.data() + offset + 2, static_cast<uint16_t>(length));
+    std::copy(value, value + length, message.begin() + offset + 4);
+    write_be16(message.data() + 2, static_cast<uint16_t>(message.size() - stun::HEADER_SIZE));
+}
+
+// XOR-*-ADDRESS attributes (IPv4, as everywhere else in the ICE code)
+void append_xor_address(std::vector<uint8_t>& message, uint16_t type, const std::string& ip, uint16_t port) {
+    in_addr address{};
+    inet_pton(AF_INET, ip.c_str(), &address);
+    uint8_t value[8] = {0, stun::FAMILY_IPV4};
+    write_be16(value + 2, port ^ static_cast<uint16_t>(stun::MAGIC_COOKIE >> 16));
+    write_be32(value + 4, ntohl(address.s_addr) ^ stun::MAGIC_COOKIE);
+    append_stun_attribute(message, type, value, sizeof(value));
+}
+
+bool parse_xor_address(const std::vector<uint8_t>& value, std::string& ip, uint16_t& port) {
+    if (value.size() < 8 || value[1] != stun::FAMILY_IPV4) {
+        return false;
+    }
+    port = read_be16(value.data() + 2) ^ static_cast<uint16_t>(stun::MAGIC_COOKIE >> 16);
+    in_addr address{};
+    address.s_addr = htonl(read_be32(value.data() + 4) ^ stun::MAGIC_COOKIE);
+    char buffer[INET_ADDRSTRLEN] = {0};
+    if (!inet_ntop(AF_INET, &address, buffer, sizeof(buffer))) {
+        return false;
+    }
+    ip = buffer;
+    return true;
+}
+
+bool split_peer(const std::string& peer, std::string& ip, uint16_t& port) {
+    size_t colon = peer.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    ip = peer.substr(0, colon);
+    port = static_cast<uint16_t>(std::atoi(peer.c_str() + colon + 1));
+    return true;
+}
+
+// Session driven by the single-peer IceAgent API
+const char DEFAULT_SESSION_ID[] = "";
+
+// Our ufrag from the USERNAME ("<receiver ufrag>:<sender ufrag>") of an incoming check
+std::string local_ufrag_of_request(const std::vector<uint8_t>& request) {
+    std::vector<uint8_t> value;
+    if (!find_stun_attribute(request, stun::ATTR_USERNAME, value)) {
+        return "";
+    }
+    std::string username(value.begin(), value.end());
+    return username.substr(0, username.find(':'));
+}
+
+} // anonymous namespace
+
 //=============================================================================
 // IceCandidate Implementation
 //=============================================================================
@@ -123,11 +243,16 @@ IceCandidate IceCandidate::from_json(const nlohmann::json& json) {
 //=============================================================================
 
 IceCandidatePair::IceCandidatePair(const IceCandidate& local, const IceCandidate& remote)
-    : local(local), remote(remote), nominated(false), check_count(0), succeeded(false) {
+    : local(local), remote(remote), nominated(false), check_count(0), succeeded(false),
+      state(IceCandidatePairState::WAITING), triggered(false), use_candidate(false), remote_nominated(false) {
     priority = calculate_priority();
     last_check_time = std::chrono::steady_clock::now();
 }
 
+IceSession::IceSession()
+    : selected_pair(IceCandidate(), IceCandidate()), state(IceConnectionState::NEW) {
+}
+
 uint64_t IceCandidatePair::calculate_priority() const {
     // RFC 8445 - Use the higher priority as the controlling agent priority
     uint32_t controlling = (std::max)(local.priority, remote.priority);
@@ -148,7 +273,11 @@ IceConfig::IceConfig()
       stun_timeout_ms(5000),
       turn_timeout_ms(10000),
       connectivity_check_timeout_ms(30000),
-      max_connectivity_checks(100) {
+      max_connectivity_checks(100),
+      check_pacing_ms(20),
+      check_rto_ms(100),
+      aggressive_nomination(false),
+      candidate_cache_ttl_ms(60000) {
     
     // Default STUN servers
     stun_servers.push_back("stun.l.google.com:19302");
@@ -163,7 +292,8 @@ IceConfig::IceConfig()
 TurnClient::TurnClient(const std::string& server, uint16_t port, 
                       const std::string& username, const std::string& password)
     : server_(server), port_(port), username_(username), password_(password),
-      socket_(INVALID_SOCKET_VALUE), allocated_(false), allocated_port_(0) {
+      socket_(INVALID_SOCKET_VALUE), allocated_(false), allocated_port_(0),
+      lifetime_(stun::DEFAULT_ALLOCATION_LIFETIME), next_channel_(stun::CHANNEL_NUMBER_MIN) {
     
     last_refresh_ = std::chrono::steady_clock::now();
 }
@@ -172,7 +302,7 @@ TurnClient::~TurnClient() {
     deallocate();
 }
 
-bool TurnClient::allocate_relay(std::string& allocated_ip, uint16_t& allocated_port) {
+bool TurnClient::allocate_relay(std::string& allocated_ip, uint16_t& allocated_port, int timeout_ms) {
     LOG_ICE_INFO("Allocating TURN relay on " << server_ << ":" << port_);
     
     // Initialize socket library (safe to call multiple times)
@@ -196,9 +326,7 @@ bool TurnClient::allocate_relay(std::string& allocated_ip, uint16_t& allocated_p
     }
     
     // Wait for response
-    std::vector<uint8_t> response;
-    Peer sender;
-    response = receive_udp_data(socket_, 1500, sender);
+    std::vector<uint8_t> response = receive_udp_data_with_timeout(socket_, 1500, timeout_ms);
     
     if (response.empty()) {
         LOG_ICE_ERROR("No response from TURN server");
@@ -214,11 +342,20 @@ bool TurnClient::allocate_relay(std::string& allocated_ip, uint16_t& allocated_p
         return false;
     }
     
+    // From here on the socket is read by an event loop (see handle_packet)
+    set_socket_nonblocking(socket_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_refresh_ = std::chrono::steady_clock::now();
+        schedule_unlocked(std::chrono::seconds(lifetime_ > stun::REFRESH_MARGIN ? lifetime_ - stun::REFRESH_MARGIN : lifetime_ / 2),
+                          TimerKind::ALLOCATION, "");
+    }
+    
     allocated_ = true;
     allocated_ip = allocated_ip_;
     allocated_port = allocated_port_;
     
-    LOG_ICE_INFO("TURN relay allocated: " << allocated_ip_ << ":" << allocated_port_);
+    LOG_ICE_INFO("TURN relay allocated: " << allocated_ip_ << ":" << allocated_port_ << " (lifetime " << lifetime_ << "s)");
     return true;
 }
 
@@ -228,10 +365,46 @@ bool TurnClient::create_permission(const std::string& peer_ip) {
         return false;
     }
     
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (permissions_.find(peer_ip) != permissions_.end()) {
+        return true; // Kept alive by its refresh timer
+    }
+    
     LOG_ICE_DEBUG("Creating TURN permission for " << peer_ip);
+    if (!send_request(stun::CREATE_PERMISSION_REQUEST, peer_ip, 0, 0, nullptr)) {
+        return false;
+    }
+    permissions_[peer_ip] = std::chrono::steady_clock::now();
+    schedule_unlocked(std::chrono::seconds(stun::PERMISSION_LIFETIME - stun::REFRESH_MARGIN), TimerKind::PERMISSION, peer_ip);
+    return true;
+}
+
+bool TurnClient::bind_channel(const std::string& peer_ip, uint16_t peer_port) {
+    if (!allocated_) {
+        LOG_ICE_ERROR("TURN relay not allocated");
+        return false;
+    }
     
-    // Create permission request - simplified implementation
-    // In a full implementation, this would send a proper TURN CreatePermission request
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string peer = peer_ip + ":" + std::to_string(peer_port);
+    if (channels_by_peer_.find(peer) != channels_by_peer_.end()) {
+        return true;
+    }
+    if (next_channel_ > stun::CHANNEL_NUMBER_MAX) {
+        LOG_ICE_WARN("No TURN channel numbers left for " << peer);
+        return false;
+    }
+    
+    // The channel is usable once the server confirms the bind (see handle_packet)
+    Channel channel{next_channel_++, peer_ip, peer_port, false};
+    std::string transaction_id;
+    if (!send_request(stun::CHANNEL_BIND_REQUEST, peer_ip, peer_port, channel.number, &transaction_id)) {
+        return false;
+    }
+    LOG_ICE_DEBUG("Binding TURN channel 0x" << std::hex << channel.number << std::dec << " to " << peer);
+    channels_by_peer_[peer] = channel;
+    peers_by_channel_[channel.number] = peer;
+    pending_channel_binds_[transaction_id] = peer;
     return true;
 }
 
@@ -241,9 +414,28 @@ bool TurnClient::send_data(const std::vector<uint8_t>& data, const std::string&
         return false;
     }
     
-    // Send data through TURN relay - simplified implementation
-    // In a full implementation, this would use TURN Send indication or ChannelData
-    return send_udp_data_to(socket_, data, peer_ip, peer_port) > 0;
+    // Fast path: 4-byte ChannelData header once a channel to the peer is bound
+    std::vector<uint8_t> packet;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = channels_by_peer_.find(peer_ip + ":" + std::to_string(peer_port));
+        if (it != channels_by_peer_.end() && it->second.bound) {
+            packet.resize(stun::CHANNEL_DATA_HEADER_SIZE + data.size());
+            write_be16(packet.data(), it->second.number);
+            write_be16(packet.data() + 2, static_cast<uint16_t>(data.size()));
+            std::copy(data.begin(), data.end(), packet.begin() + stun::CHANNEL_DATA_HEADER_SIZE);
+        }
+    }
+    
+    if (packet.empty()) {
+        // First packets to a peer go in Send indications while its channel is being bound
+        bind_channel(peer_ip, peer_port);
+        packet = make_stun_message(stun::SEND_INDICATION, nullptr);
+        append_xor_address(packet, stun::ATTR_XOR_PEER_ADDRESS, peer_ip, peer_port);
+        append_stun_attribute(packet, stun::ATTR_DATA, data.data(), data.size());
+    }
+    
+    return send_udp_data_to(socket_, packet, server_, port_) > 0;
 }
 
 std::vector<uint8_t> TurnClient::receive_data(std::string& from_ip, uint16_t& from_port, int timeout_ms) {
@@ -251,30 +443,155 @@ std::vector<uint8_t> TurnClient::receive_data(std::string& from_ip, uint16_t& fr
         return {};
     }
     
-    // Receive data through TURN relay - simplified implementation
-    std::vector<uint8_t> response = receive_udp_data_with_timeout(socket_, 1500, timeout_ms, &from_ip, reinterpret_cast<int*>(&from_port));
-    return response;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if (remaining <= 0) {
+            return {};
+        }
+        std::vector<uint8_t> packet = receive_udp_data_with_timeout(socket_, 2048, remaining);
+        std::vector<uint8_t> payload;
+        if (!packet.empty() && handle_packet(packet, payload, from_ip, from_port)) {
+            return payload;
+        }
+    }
 }
 
-void TurnClient::refresh_allocation() {
-    if (!allocated_) {
-        return;
+bool TurnClient::handle_packet(const std::vector<uint8_t>& packet, std::vector<uint8_t>& payload,
+                               std::string& from_ip, uint16_t& from_port) {
+    if (packet.size() < stun::CHANNEL_DATA_HEADER_SIZE) {
+        return false;
+    }
+    
+    // ChannelData messages start with 0b01, STUN messages with 0b00
+    if ((packet[0] & 0xC0) == 0x40) {
+        uint16_t number = read_be16(packet.data());
+        uint16_t length = read_be16(packet.data() + 2);
+        if (stun::CHANNEL_DATA_HEADER_SIZE + length > packet.size()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = peers_by_channel_.find(number);
+        if (it == peers_by_channel_.end() || !split_peer(it->second, from_ip, from_port)) {
+            return false;
+        }
+        payload.assign(packet.begin() + stun::CHANNEL_DATA_HEADER_SIZE,
+                       packet.begin() + stun::CHANNEL_DATA_HEADER_SIZE + length);
+        return true;
+    }
+    
+    if (packet.size() < stun::HEADER_SIZE || read_be32(packet.data() + 4) != stun::MAGIC_COOKIE) {
+        return false;
     }
+    uint16_t type = read_be16(packet.data());
+    std::string transaction_id(reinterpret_cast<const char*>(packet.data() + 8), stun::TRANSACTION_ID_SIZE);
+    std::vector<uint8_t> value;
     
+    switch (type) {
+        case stun::DATA_INDICATION:
+            if (find_stun_attribute(packet, stun::ATTR_XOR_PEER_ADDRESS, value) &&
+                parse_xor_address(value, from_ip, from_port) &&
+                find_stun_attribute(packet, stun::ATTR_DATA, payload)) {
+                return true;
+            }
+            return false;
+            
+        case stun::CHANNEL_BIND_RESPONSE:
+        case stun::CHANNEL_BIND_ERROR_RESPONSE: {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto pending = pending_channel_binds_.find(transaction_id);
+            if (pending == pending_channel_binds_.end()) {
+                return false;
+            }
+            std::string peer = pending->second;
+            pending_channel_binds_.erase(pending);
+            auto it = channels_by_peer_.find(peer);
+            if (it == channels_by_peer_.end()) {
+                return false;
+            }
+            if (type == stun::CHANNEL_BIND_ERROR_RESPONSE) {
+                // Keep using Send indications for this peer
+                LOG_ICE_WARN("TURN server refused channel bind for " << peer);
+                peers_by_channel_.erase(it->second.number);
+                channels_by_peer_.erase(it);
+            } else if (!it->second.bound) {
+                it->second.bound = true;
+                schedule_unlocked(std::chrono::seconds(stun::CHANNEL_LIFETIME - stun::REFRESH_MARGIN), TimerKind::CHANNEL, peer);
+                LOG_ICE_DEBUG("TURN channel 0x" << std::hex << it->second.number << std::dec << " bound to " << peer);
+            }
+            return false;
+        }
+        
+        case stun::REFRESH_RESPONSE:
+            if (find_stun_attribute(packet, stun::ATTR_LIFETIME, value) && value.size() == 4) {
+                lifetime_ = read_be32(value.data());
+            }
+            return false;
+            
+        default:
+            return false;
+    }
+}
+
+std::chrono::steady_clock::time_point TurnClient::process_timers() {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto now = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::minutes>(now - last_refresh_);
     
-    if (duration.count() >= 5) { // Refresh every 5 minutes
-        send_refresh_request();
-        last_refresh_ = now;
+    while (allocated_ && !timers_.empty() && timers_.begin()->first <= now) {
+        Timer timer = timers_.begin()->second;
+        timers_.erase(timers_.begin());
+        
+        switch (timer.kind) {
+            case TimerKind::ALLOCATION:
+                send_refresh_request(lifetime_);
+                last_refresh_ = now;
+                schedule_unlocked(std::chrono::seconds(lifetime_ > stun::REFRESH_MARGIN ? lifetime_ - stun::REFRESH_MARGIN : lifetime_ / 2),
+                                  TimerKind::ALLOCATION, "");
+                break;
+            case TimerKind::PERMISSION:
+                if (permissions_.find(timer.peer) != permissions_.end()) {
+                    send_request(stun::CREATE_PERMISSION_REQUEST, timer.peer, 0, 0, nullptr);
+                    permissions_[timer.peer] = now;
+                    schedule_unlocked(std::chrono::seconds(stun::PERMISSION_LIFETIME - stun::REFRESH_MARGIN), TimerKind::PERMISSION, timer.peer);
+                }
+                break;
+            case TimerKind::CHANNEL: {
+                // Re-binding refreshes both the channel and the peer's permission
+                auto it = channels_by_peer_.find(timer.peer);
+                if (it != channels_by_peer_.end()) {
+                    send_request(stun::CHANNEL_BIND_REQUEST, it->second.ip, it->second.port, it->second.number, nullptr);
+                    schedule_unlocked(std::chrono::seconds(stun::CHANNEL_LIFETIME - stun::REFRESH_MARGIN), TimerKind::CHANNEL, timer.peer);
+                }
+                break;
+            }
+        }
     }
+    
+    return timers_.empty() ? now + std::chrono::seconds(stun::REFRESH_MARGIN) : timers_.begin()->first;
+}
+
+bool TurnClient::has_channel(const std::string& peer_ip, uint16_t peer_port) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = channels_by_peer_.find(peer_ip + ":" + std::to_string(peer_port));
+    return it != channels_by_peer_.end() && it->second.bound;
+}
+
+void TurnClient::refresh_allocation() {
+    process_timers();
 }
 
 void TurnClient::deallocate() {
     if (allocated_) {
         LOG_ICE_DEBUG("Deallocating TURN relay");
-        // Send deallocate request - simplified implementation
+        std::lock_guard<std::mutex> lock(mutex_);
+        send_refresh_request(0); // A zero lifetime deletes the allocation
         allocated_ = false;
+        timers_.clear();
+        channels_by_peer_.clear();
+        peers_by_channel_.clear();
+        pending_channel_binds_.clear();
+        permissions_.clear();
     }
     
     if (is_valid_socket(socket_)) {
@@ -284,52 +601,70 @@ void TurnClient::deallocate() {
 }
 
 bool TurnClient::send_allocate_request() {
-    // Simplified TURN allocate request
-    // In a full implementation, this would follow RFC 5766
-    std::vector<uint8_t> request(20); // Basic STUN header
+    // Long-term credential authentication is not implemented (see authenticate_with_server)
+    std::vector<uint8_t> request = make_stun_message(stun::ALLOCATE_REQUEST, nullptr);
+    const uint8_t transport[4] = {stun::TRANSPORT_UDP, 0, 0, 0};
+    append_stun_attribute(request, stun::ATTR_REQUESTED_TRANSPORT, transport, sizeof(transport));
     
-    // STUN message type: Allocate Request (0x003)
-    request[0] = 0x00;
-    request[1] = 0x03;
-    
-    // Message length (will be filled)
-    request[2] = 0x00;
-    request[3] = 0x00;
-    
-    // Magic cookie
-    request[4] = 0x21;
-    request[5] = 0x12;
-    request[6] = 0xA4;
-    request[7] = 0x42;
+    return send_udp_data_to(socket_, request, server_, port_) > 0;
+}
+
+bool TurnClient::send_refresh_request(uint32_t lifetime) {
+    std::vector<uint8_t> request = make_stun_message(stun::REFRESH_REQUEST, nullptr);
+    uint8_t value[4];
+    write_be32(value, lifetime);
+    append_stun_attribute(request, stun::ATTR_LIFETIME, value, sizeof(value));
     
-    // Transaction ID (random)
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    for (int i = 8; i < 20; ++i) {
-        request[i] = static_cast<uint8_t>(gen() % 256);
+    return send_udp_data_to(socket_, request, server_, port_) > 0;
+}
+
+bool TurnClient::send_request(uint16_t method, const std::string& peer_ip, uint16_t peer_port,
+                              uint16_t channel, std::string* transaction_id) {
+    std::vector<uint8_t> request = make_stun_message(method, transaction_id);
+    if (channel != 0) {
+        uint8_t value[4] = {0, 0, 0, 0};
+        write_be16(value, channel);
+        append_stun_attribute(request, stun::ATTR_CHANNEL_NUMBER, value, sizeof(value));
     }
+    append_xor_address(request, stun::ATTR_XOR_PEER_ADDRESS, peer_ip, peer_port);
     
     return send_udp_data_to(socket_, request, server_, port_) > 0;
 }
 
-bool TurnClient::send_refresh_request() {
-    // Simplified refresh request
-    return true;
+void TurnClient::schedule_unlocked(std::chrono::seconds delay, TimerKind kind, const std::string& peer) {
+    timers_.emplace(std::chrono::steady_clock::now() + delay, Timer{kind, peer});
 }
 
 bool TurnClient::handle_allocate_response(const std::vector<uint8_t>& response) {
-    if (response.size() < 20) {
+    if (response.size() < stun::HEADER_SIZE) {
         return false;
     }
     
-    // Check if it's a success response (0x0103)
-    if (response[0] == 0x01 && response[1] == 0x03) {
-        // Parse XOR-RELAYED-ADDRESS attribute (simplified)
-        allocated_ip_ = "127.0.0.1"; // Placeholder
-        allocated_port_ = 12345;     // Placeholder
+    std::vector<uint8_t> value;
+    uint16_t type = read_be16(response.data());
+    if (type == stun::ALLOCATE_RESPONSE) {
+        if (!find_stun_attribute(response, stun::ATTR_XOR_RELAYED_ADDRESS, value) ||
+            !parse_xor_address(value, allocated_ip_, allocated_port_)) {
+            return false;
+        }
+        if (find_stun_attribute(response, stun::ATTR_LIFETIME, value) && value.size() == 4) {
+            lifetime_ = read_be32(value.data());
+        }
         return true;
     }
     
+    if (type == stun::ALLOCATE_ERROR_RESPONSE) {
+        if (find_stun_attribute(response, stun::ATTR_REALM, value)) {
+            realm_.assign(value.begin(), value.end());
+        }
+        if (find_stun_attribute(response, stun::ATTR_NONCE, value)) {
+            nonce_.assign(value.begin(), value.end());
+        }
+        if (find_stun_attribute(response, stun::ATTR_ERROR_CODE, value) && value.size() >= 4) {
+            LOG_ICE_WARN("TURN allocate rejected with error " << (value[2] & 0x07) * 100 + value[3]);
+        }
+    }
+    
     return false;
 }
 
@@ -358,31 +693,39 @@ NatType NatTypeDetector::detect_nat_type(const std::vector<std::string>& stun_se
         return NatType::UNKNOWN;
     }
     
-    std::string server1 = stun_servers[0];
-    std::string server2 = stun_servers.size() > 1 ? stun_servers[1] : server1;
+    // Ask every server at once from one socket; the first two answers decide the mapping behaviour
+    StunClient stun_client;
+    std::vector<StunAddress> mapped;
+    for (const auto& result : stun_client.query_binding_parallel(stun_servers, timeout_ms, 2)) {
+        if (result.success) {
+            mapped.push_back(result.mapped_address);
+        }
+    }
     
     // Test 1: Check if UDP is blocked
-    if (test_udp_blocked(server1, timeout_ms)) {
+    if (mapped.empty()) {
         LOG_ICE_INFO("NAT type detected: UDP BLOCKED");
         return NatType::BLOCKED;
     }
     
     // Test 2: Check for open internet (no NAT)
-    if (test_open_internet(server1, timeout_ms)) {
+    if (test_open_internet(mapped[0])) {
         LOG_ICE_INFO("NAT type detected: OPEN INTERNET");
         return NatType::OPEN_INTERNET;
     }
     
-    // Test 3: Check for symmetric NAT
-    if (test_symmetric_nat(server1, server2, timeout_ms)) {
-        LOG_ICE_INFO("NAT type detected: SYMMETRIC NAT");
-        return NatType::SYMMETRIC;
-    }
-    
-    // Test 4: Check for full cone NAT
-    if (test_full_cone(server1, server2, timeout_ms)) {
-        LOG_ICE_INFO("NAT type detected: FULL CONE NAT");
-        return NatType::FULL_CONE;
+    if (mapped.size() >= 2) {
+        // Test 3: Check for symmetric NAT
+        if (test_symmetric_nat(mapped[0], mapped[1])) {
+            LOG_ICE_INFO("NAT type detected: SYMMETRIC NAT");
+            return NatType::SYMMETRIC;
+        }
+        
+        // Test 4: Check for full cone NAT
+        if (test_full_cone(mapped[0], mapped[1])) {
+            LOG_ICE_INFO("NAT type detected: FULL CONE NAT");
+            return NatType::FULL_CONE;
+        }
     }
     
     // Default to port restricted cone NAT
@@ -403,19 +746,7 @@ std::string NatTypeDetector::nat_type_to_string(NatType type) const {
     }
 }
 
-bool NatTypeDetector::test_udp_blocked(const std::string& stun_server, int timeout_ms) {
-    size_t colon_pos = stun_server.find(':');
-    std::string host = stun_server.substr(0, colon_pos);
-    int port = colon_pos != std::string::npos ? std::stoi(stun_server.substr(colon_pos + 1)) : 3478;
-    
-    StunClient stun_client;
-    StunAddress public_address;
-    
-    return !stun_client.get_public_address(host, port, public_address, timeout_ms);
-}
-
-bool NatTypeDetector::test_open_internet(const std::string& stun_server, int timeout_ms) {
-    StunAddress mapped_addr = get_mapped_address(stun_server, timeout_ms);
+bool NatTypeDetector::test_open_internet(const StunAddress& mapped_addr) {
     if (mapped_addr.ip.empty()) {
         return false;
     }
@@ -427,10 +758,7 @@ bool NatTypeDetector::test_open_internet(const std::string& stun_server, int tim
     return std::find(local_addrs.begin(), local_addrs.end(), mapped_addr.ip) != local_addrs.end();
 }
 
-bool NatTypeDetector::test_full_cone(const std::string& stun_server1, const std::string& stun_server2, int timeout_ms) {
-    StunAddress addr1 = get_mapped_address(stun_server1, timeout_ms);
-    StunAddress addr2 = get_mapped_address(stun_server2, timeout_ms);
-    
+bool NatTypeDetector::test_full_cone(const StunAddress& addr1, const StunAddress& addr2) {
     if (addr1.ip.empty() || addr2.ip.empty()) {
         return false;
     }
@@ -439,10 +767,7 @@ bool NatTypeDetector::test_full_cone(const std::string& stun_server1, const std:
     return addr1.ip == addr2.ip && addr1.port == addr2.port;
 }
 
-bool NatTypeDetector::test_symmetric_nat(const std::string& stun_server1, const std::string& stun_server2, int timeout_ms) {
-    StunAddress addr1 = get_mapped_address(stun_server1, timeout_ms);
-    StunAddress addr2 = get_mapped_address(stun_server2, timeout_ms);
-    
+bool NatTypeDetector::test_symmetric_nat(const StunAddress& addr1, const StunAddress& addr2) {
     if (addr1.ip.empty() || addr2.ip.empty()) {
         return false;
     }
@@ -451,34 +776,14 @@ bool NatTypeDetector::test_symmetric_nat(const std::string& stun_server1, const
     return addr1.ip != addr2.ip || addr1.port != addr2.port;
 }
 
-StunAddress NatTypeDetector::get_mapped_address(const std::string& stun_server, int timeout_ms) {
-    size_t colon_pos = stun_server.find(':');
-    std::string host = stun_server.substr(0, colon_pos);
-    int port = colon_pos != std::string::npos ? std::stoi(stun_server.substr(colon_pos + 1)) : 3478;
-    
-    StunClient stun_client;
-    StunAddress public_address;
-    
-    if (stun_client.get_public_address(host, port, public_address, timeout_ms)) {
-        return public_address;
-    }
-    
-    return StunAddress{}; // Empty address on failure
-}
-
-StunAddress NatTypeDetector::get_mapped_address_different_port(const std::string& stun_server, int timeout_ms) {
-    // This would use a different port on the same server for testing
-    return get_mapped_address(stun_server, timeout_ms);
-}
-
 //=============================================================================
 // IceAgent Implementation
 //=============================================================================
 
 IceAgent::IceAgent(IceRole role, const IceConfig& config)
     : role_(role), config_(config), running_(false), state_(IceConnectionState::NEW),
-      udp_socket_(INVALID_SOCKET_VALUE), tcp_socket_(INVALID_SOCKET_VALUE),
-      selected_pair_(IceCandidate(), IceCandidate()) {
+      gathering_(false), checks_running_(false),
+      udp_socket_(INVALID_SOCKET_VALUE), tcp_socket_(INVALID_SOCKET_VALUE) {
     
     // Initialize NAT detector
     nat_detector_ = std::make_unique<NatTypeDetector>();
@@ -487,6 +792,13 @@ IceAgent::IceAgent(IceRole role, const IceConfig& config)
     local_ufrag_ = generate_ufrag();
     local_pwd_ = generate_password();
     
+    IceSession& session = sessions_[DEFAULT_SESSION_ID];
+    session.local_ufrag = local_ufrag_;
+    session.local_pwd = local_pwd_;
+    
+    std::random_device rd;
+    tie_breaker_ = (static_cast<uint64_t>(rd()) << 32) | rd();
+    
     LOG_ICE_INFO("ICE Agent created with role: " << (role_ == IceRole::CONTROLLING ? "CONTROLLING" : "CONTROLLED"));
 }
 
@@ -522,6 +834,10 @@ bool IceAgent::start() {
     
     running_.store(true);
     set_state(IceConnectionState::NEW);
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        checks_running_ = false;
+    }
     
     // Start receive thread
     receive_thread_ = std::thread(&IceAgent::receive_loop, this);
@@ -556,8 +872,11 @@ void IceAgent::stop() {
         gather_thread_.join();
     }
     
-    if (check_thread_.joinable()) {
-        check_thread_.join();
+    {
+        std::lock_guard<std::mutex> lock(check_thread_mutex_);
+        if (check_thread_.joinable()) {
+            check_thread_.join();
+        }
     }
     
     if (receive_thread_.joinable()) {
@@ -565,7 +884,10 @@ void IceAgent::stop() {
     }
     
     // Clean up TURN client
-    turn_client_.reset();
+    {
+        std::lock_guard<std::mutex> lock(turn_mutex_);
+        turn_client_.reset();
+    }
     
     LOG_ICE_INFO("ICE Agent stopped");
 }
@@ -583,13 +905,17 @@ void IceAgent::shutdown_immediate() {
 void IceAgent::set_local_credentials(const std::string& ufrag, const std::string& pwd) {
     local_ufrag_ = ufrag;
     local_pwd_ = pwd;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        IceSession& session = sessions_[DEFAULT_SESSION_ID];
+        session.local_ufrag = ufrag;
+        session.local_pwd = pwd;
+    }
     LOG_ICE_DEBUG("Set local credentials: ufrag=" << ufrag);
 }
 
 void IceAgent::set_remote_credentials(const std::string& ufrag, const std::string& pwd) {
-    remote_ufrag_ = ufrag;
-    remote_pwd_ = pwd;
-    LOG_ICE_DEBUG("Set remote credentials: ufrag=" << ufrag);
+    set_session_remote_credentials(DEFAULT_SESSION_ID, ufrag, pwd);
 }
 
 std::pair<std::string, std::string> IceAgent::get_local_credentials() const {
@@ -602,14 +928,29 @@ void IceAgent::gather_candidates() {
         return;
     }
     
+    // Gathering is per agent, not per peer: reuse candidates from a recent or ongoing round
+    {
+        std::lock_guard<std::mutex> lock(candidates_mutex_);
+        auto age = std::chrono::steady_clock::now() - candidates_gathered_at_;
+        if (gathering_.load() ||
+            (!local_candidates_.empty() && age < std::chrono::milliseconds(config_.candidate_cache_ttl_ms))) {
+            LOG_ICE_DEBUG("Reusing " << local_candidates_.size() << " gathered candidates");
+            return;
+        }
+        local_candidates_.clear();
+        gathering_.store(true);
+    }
+    
     LOG_ICE_INFO("Starting candidate gathering");
     set_state(IceConnectionState::GATHERING);
     
-    // Start gathering in a separate thread
+    // Start gathering in a separate thread (reap a previous gathering round first)
+    if (gather_thread_.joinable()) {
+        gather_thread_.join();
+    }
+    // Candidates are trickled: each one is paired and reported as soon as it is found,
+    // so connectivity checks can start before slower STUN/TURN gathering completes
     gather_thread_ = std::thread([this]() {
-        std::lock_guard<std::mutex> lock(candidates_mutex_);
-        local_candidates_.clear();
-        
         if (config_.enable_host_candidates) {
             gather_host_candidates();
         }
@@ -626,14 +967,13 @@ void IceAgent::gather_candidates() {
             gather_tcp_candidates();
         }
         
-        LOG_ICE_INFO("Candidate gathering completed. Found " << local_candidates_.size() << " candidates");
-        
-        // Notify about gathered candidates
-        if (candidate_callback_) {
-            for (const auto& candidate : local_candidates_) {
-                candidate_callback_(candidate);
-            }
+        {
+            std::lock_guard<std::mutex> lock(candidates_mutex_);
+            candidates_gathered_at_ = std::chrono::steady_clock::now();
+            gathering_.store(false);
         }
+        
+        LOG_ICE_INFO("Candidate gathering completed. Found " << get_local_candidates().size() << " candidates");
     });
 }
 
@@ -643,66 +983,187 @@ std::vector<IceCandidate> IceAgent::get_local_candidates() const {
 }
 
 void IceAgent::add_remote_candidate(const IceCandidate& candidate) {
-    std::lock_guard<std::mutex> lock(candidates_mutex_);
-    remote_candidates_.push_back(candidate);
-    LOG_ICE_DEBUG("Added remote candidate: " << candidate.ip << ":" << candidate.port);
-    
-    // Form new candidate pairs
-    form_candidate_pairs();
+    add_session_remote_candidate(DEFAULT_SESSION_ID, candidate);
 }
 
 void IceAgent::add_remote_candidates(const std::vector<IceCandidate>& candidates) {
-    std::lock_guard<std::mutex> lock(candidates_mutex_);
     for (const auto& candidate : candidates) {
-        remote_candidates_.push_back(candidate);
-        LOG_ICE_DEBUG("Added remote candidate: " << candidate.ip << ":" << candidate.port);
+        add_session_remote_candidate(DEFAULT_SESSION_ID, candidate);
     }
-    
-    // Form new candidate pairs
-    form_candidate_pairs();
 }
 
 void IceAgent::start_connectivity_checks() {
-    if (!running_.load()) {
-        LOG_ICE_ERROR("ICE Agent not running");
-        return;
+    start_session_checks(DEFAULT_SESSION_ID);
+}
+
+void IceAgent::restart_ice() {
+    LOG_ICE_INFO("Restarting ICE");
+    
+    // Generate new credentials
+    local_ufrag_ = generate_ufrag();
+    local_pwd_ = generate_password();
+    
+    // Clear previous state; a restart also drops the cached local candidates
+    {
+        std::lock_guard<std::mutex> candidates_lock(candidates_mutex_);
+        local_candidates_.clear();
+        candidates_gathered_at_ = std::chrono::steady_clock::time_point();
+        
+        std::lock_guard<std::mutex> sessions_lock(sessions_mutex_);
+        IceSession& session = sessions_[DEFAULT_SESSION_ID];
+        session = IceSession();
+        session.local_ufrag = local_ufrag_;
+        session.local_pwd = local_pwd_;
     }
     
-    // Check if connectivity checks are already running
-    if (check_thread_.joinable()) {
-        LOG_ICE_WARN("Connectivity checks already running, skipping duplicate start");
-        return;
+    // Restart gathering
+    set_state(IceConnectionState::NEW);
+    gather_candidates();
+}
+
+bool IceAgent::create_session(const std::string& session_id) {
+    std::lock_guard<std::mutex> candidates_lock(candidates_mutex_);
+    std::lock_guard<std::mutex> sessions_lock(sessions_mutex_);
+    if (sessions_.find(session_id) != sessions_.end()) {
+        return false;
     }
     
-    LOG_ICE_INFO("Starting connectivity checks");
-    set_state(IceConnectionState::CHECKING);
+    // The ufrag is what demultiplexes incoming checks, so it must be unique within the agent
+    IceSession session;
+    bool unique = false;
+    while (!unique) {
+        session.local_ufrag = generate_ufrag();
+        unique = std::none_of(sessions_.begin(), sessions_.end(),
+            [&](const std::pair<const std::string, IceSession>& entry) {
+                return entry.second.local_ufrag == session.local_ufrag;
+            });
+    }
+    session.local_pwd = generate_password();
+    sessions_.emplace(session_id, std::move(session));
     
-    // Start connectivity checks in a separate thread
-    check_thread_ = std::thread(&IceAgent::connectivity_check_loop, this);
+    LOG_ICE_DEBUG("Created ICE session " << session_id << " (" << sessions_.size() << " sessions)");
+    return true;
 }
 
-void IceAgent::restart_ice() {
-    LOG_ICE_INFO("Restarting ICE");
+void IceAgent::close_session(const std::string& session_id) {
+    if (session_id == DEFAULT_SESSION_ID) {
+        return;
+    }
     
-    // Clear previous state
-    {
-        std::lock_guard<std::mutex> lock(candidates_mutex_);
-        local_candidates_.clear();
-        remote_candidates_.clear();
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    if (sessions_.erase(session_id) > 0) {
+        LOG_ICE_DEBUG("Closed ICE session " << session_id);
+    }
+}
+
+bool IceAgent::has_session(const std::string& session_id) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return sessions_.find(session_id) != sessions_.end();
+}
+
+size_t IceAgent::get_session_count() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return sessions_.size();
+}
+
+std::pair<std::string, std::string> IceAgent::get_session_credentials(const std::string& session_id) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end()) {
+        return {"", ""};
+    }
+    return {it->second.local_ufrag, it->second.local_pwd};
+}
+
+void IceAgent::set_session_remote_credentials(const std::string& session_id, const std::string& ufrag, const std::string& pwd) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end()) {
+        LOG_ICE_WARN("Unknown ICE session " << session_id);
+        return;
+    }
+    it->second.remote_ufrag = ufrag;
+    it->second.remote_pwd = pwd;
+    LOG_ICE_DEBUG("Set remote credentials: ufrag=" << ufrag);
+}
+
+void IceAgent::add_session_remote_candidate(const std::string& session_id, const IceCandidate& candidate) {
+    std::lock_guard<std::mutex> candidates_lock(candidates_mutex_);
+    std::lock_guard<std::mutex> sessions_lock(sessions_mutex_);
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end()) {
+        LOG_ICE_WARN("Unknown ICE session " << session_id);
+        return;
     }
+    it->second.remote_candidates.push_back(candidate);
+    LOG_ICE_DEBUG("Added remote candidate: " << candidate.ip << ":" << candidate.port);
     
-    {
-        std::lock_guard<std::mutex> lock(pairs_mutex_);
-        candidate_pairs_.clear();
+    // Form new candidate pairs
+    form_candidate_pairs(it->second);
+}
+
+void IceAgent::start_session_checks(const std::string& session_id) {
+    if (!running_.load()) {
+        LOG_ICE_ERROR("ICE Agent not running");
+        return;
     }
     
-    // Generate new credentials
-    local_ufrag_ = generate_ufrag();
-    local_pwd_ = generate_password();
+    bool start_thread = false;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        auto it = sessions_.find(session_id);
+        if (it == sessions_.end()) {
+            LOG_ICE_WARN("Unknown ICE session " << session_id);
+            return;
+        }
+        IceSession& session = it->second;
+        if (session.state == IceConnectionState::CHECKING || session.selected_pair.succeeded) {
+            LOG_ICE_WARN("Connectivity checks already running, skipping duplicate start");
+            return;
+        }
+        
+        LOG_ICE_INFO("Starting connectivity checks");
+        for (auto& pair : session.candidate_pairs) {
+            if (pair.state == IceCandidatePairState::FAILED) {
+                pair.state = IceCandidatePairState::WAITING;
+            }
+        }
+        session.checks_started = std::chrono::steady_clock::now();
+        set_session_state(session_id, session, IceConnectionState::CHECKING);
+        
+        // One check thread paces the checks of every session
+        start_thread = !checks_running_;
+        checks_running_ = true;
+    }
     
-    // Restart gathering
-    set_state(IceConnectionState::NEW);
-    gather_candidates();
+    if (start_thread) {
+        std::lock_guard<std::mutex> lock(check_thread_mutex_);
+        if (check_thread_.joinable()) {
+            check_thread_.join();
+        }
+        check_thread_ = std::thread(&IceAgent::connectivity_check_loop, this);
+    }
+}
+
+IceConnectionState IceAgent::get_session_state(const std::string& session_id) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = sessions_.find(session_id);
+    return it != sessions_.end() ? it->second.state : IceConnectionState::CLOSED;
+}
+
+IceCandidatePair IceAgent::get_session_selected_pair(const std::string& session_id) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    auto it = sessions_.find(session_id);
+    return it != sessions_.end() ? it->second.selected_pair : IceCandidatePair(IceCandidate(), IceCandidate());
+}
+
+bool IceAgent::send_session_data(const std::string& session_id, const std::vector<uint8_t>& data) {
+    IceCandidatePair selected = get_session_selected_pair(session_id);
+    if (!selected.succeeded) {
+        LOG_ICE_ERROR("ICE session " << session_id << " not connected, cannot send data");
+        return false;
+    }
+    return send_on_pair(selected, data);
 }
 
 bool IceAgent::send_data(const std::vector<uint8_t>& data) {
@@ -712,16 +1173,7 @@ bool IceAgent::send_data(const std::vector<uint8_t>& data) {
     }
     
     // Send using selected pair
-    IceCandidatePair selected = [this]() {
-        std::lock_guard<std::mutex> lock(pairs_mutex_);
-        return selected_pair_;
-    }();
-    
-    if (selected.local.type == IceCandidateType::RELAY && turn_client_) {
-        return turn_client_->send_data(data, selected.remote.ip, selected.remote.port);
-    } else {
-        return send_udp_data_to(udp_socket_, data, selected.remote.ip, selected.remote.port) > 0;
-    }
+    return send_on_pair(get_session_selected_pair(DEFAULT_SESSION_ID), data);
 }
 
 bool IceAgent::send_data_to(const std::vector<uint8_t>& data, const std::string& addr) {
@@ -842,13 +1294,12 @@ nlohmann::json IceAgent::create_connection_answer(const nlohmann::json& offer) c
 }
 
 std::vector<IceCandidatePair> IceAgent::get_candidate_pairs() const {
-    std::lock_guard<std::mutex> lock(pairs_mutex_);
-    return candidate_pairs_;
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return sessions_.at(DEFAULT_SESSION_ID).candidate_pairs;
 }
 
 IceCandidatePair IceAgent::get_selected_pair() const {
-    std::lock_guard<std::mutex> lock(pairs_mutex_);
-    return selected_pair_;
+    return get_session_selected_pair(DEFAULT_SESSION_ID);
 }
 
 nlohmann::json IceAgent::get_statistics() const {
@@ -859,17 +1310,20 @@ nlohmann::json IceAgent::get_statistics() const {
     {
         std::lock_guard<std::mutex> lock(candidates_mutex_);
         stats["local_candidates"] = local_candidates_.size();
-        stats["remote_candidates"] = remote_candidates_.size();
     }
     
     {
-        std::lock_guard<std::mutex> lock(pairs_mutex_);
-        stats["candidate_pairs"] = candidate_pairs_.size();
-        if (selected_pair_.succeeded) {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        const IceSession& session = sessions_.at(DEFAULT_SESSION_ID);
+        stats["remote_candidates"] = session.remote_candidates.size();
+        stats["candidate_pairs"] = session.candidate_pairs.size();
+        stats["sessions"] = sessions_.size();
+        if (session.selected_pair.succeeded) {
+            const IceCandidatePair& selected = session.selected_pair;
             stats["selected_pair"] = {
-                {"local", selected_pair_.local.ip + ":" + std::to_string(selected_pair_.local.port)},
-                {"remote", selected_pair_.remote.ip + ":" + std::to_string(selected_pair_.remote.port)},
-                {"priority", selected_pair_.priority}
+                {"local", selected.local.ip + ":" + std::to_string(selected.local.port)},
+                {"remote", selected.remote.ip + ":" + std::to_string(selected.remote.port)},
+                {"priority", selected.priority}
             };
         }
     }
@@ -891,6 +1345,23 @@ void IceAgent::set_state(IceConnectionState new_state) {
     }
 }
 
+void IceAgent::set_session_state(const std::string& session_id, IceSession& session, IceConnectionState new_state) {
+    if (session.state == new_state) {
+        return;
+    }
+    session.state = new_state;
+    
+    // The default session drives the agent state; other sessions report through their own callback
+    if (session_id == DEFAULT_SESSION_ID) {
+        set_state(new_state);
+    } else {
+        LOG_ICE_INFO("ICE session " << session_id << " state: " << ice_connection_state_to_string(new_state));
+    }
+    if (session_state_callback_) {
+        session_state_callback_(session_id, new_state);
+    }
+}
+
 void IceAgent::gather_host_candidates() {
     LOG_ICE_DEBUG("Gathering host candidates");
     
@@ -928,7 +1399,7 @@ void IceAgent::gather_host_candidates() {
         candidate.ufrag = local_ufrag_;
         candidate.pwd = local_pwd_;
         
-        local_candidates_.push_back(candidate);
+        add_local_candidate(candidate);
         LOG_ICE_DEBUG("Added host candidate: " << candidate.ip << ":" << candidate.port);
     }
 }
@@ -936,15 +1407,11 @@ void IceAgent::gather_host_candidates() {
 void IceAgent::gather_server_reflexive_candidates() {
     LOG_ICE_DEBUG("Gathering server reflexive candidates");
     
-    for (const auto& stun_server : config_.stun_servers) {
-        size_t colon_pos = stun_server.find(':');
-        std::string host = stun_server.substr(0, colon_pos);
-        int port = colon_pos != std::string::npos ? std::stoi(stun_server.substr(colon_pos + 1)) : 3478;
-        
-        StunClient stun_client;
-        StunAddress public_address;
-        
-        if (stun_client.get_public_address(host, port, public_address, config_.stun_timeout_ms)) {
+    // Query all servers at once and take the first answer instead of waiting out each timeout in turn
+    StunClient stun_client;
+    for (const auto& result : stun_client.query_binding_parallel(config_.stun_servers, config_.stun_timeout_ms, 1)) {
+        if (result.success) {
+            const StunAddress& public_address = result.mapped_address;
             IceCandidate candidate;
             candidate.foundation = generate_foundation(candidate);
             candidate.component_id = 1;
@@ -957,12 +1424,15 @@ void IceAgent::gather_server_reflexive_candidates() {
             candidate.pwd = local_pwd_;
             
             // Set related address (base)
-            if (!local_candidates_.empty()) {
-                candidate.related_ip = local_candidates_[0].ip;
-                candidate.related_port = local_candidates_[0].port;
+            {
+                std::lock_guard<std::mutex> lock(candidates_mutex_);
+                if (!local_candidates_.empty()) {
+                    candidate.related_ip = local_candidates_[0].ip;
+                    candidate.related_port = local_candidates_[0].port;
+                }
             }
             
-            local_candidates_.push_back(candidate);
+            add_local_candidate(candidate);
             LOG_ICE_DEBUG("Added server reflexive candidate: " << candidate.ip << ":" << candidate.port);
             break; // Only need one reflexive candidate
         }
@@ -986,12 +1456,25 @@ void IceAgent::gather_relay_candidates() {
     std::string username = config_.turn_usernames.empty() ? "" : config_.turn_usernames[0];
     std::string password = config_.turn_passwords.empty() ? "" : config_.turn_passwords[0];
     
-    turn_client_ = std::make_unique<TurnClient>(host, port, username, password);
-    
+    // A regather keeps the existing allocation (with its channels) instead of allocating again
+    std::shared_ptr<TurnClient> turn_client = get_turn_client();
     std::string allocated_ip;
-    uint16_t allocated_port;
+    uint16_t allocated_port = 0;
+    bool allocated = false;
+    if (turn_client && turn_client->is_allocated()) {
+        allocated_ip = turn_client->get_allocated_ip();
+        allocated_port = turn_client->get_allocated_port();
+        allocated = true;
+    } else {
+        turn_client = std::make_shared<TurnClient>(host, port, username, password);
+        allocated = turn_client->allocate_relay(allocated_ip, allocated_port, config_.turn_timeout_ms);
+        if (allocated) {
+            std::lock_guard<std::mutex> lock(turn_mutex_);
+            turn_client_ = turn_client;
+        }
+    }
     
-    if (turn_client_->allocate_relay(allocated_ip, allocated_port)) {
+    if (allocated) {
         IceCandidate candidate;
         candidate.foundation = generate_foundation(candidate);
         candidate.component_id = 1;
@@ -1009,7 +1492,7 @@ void IceAgent::gather_relay_candidates() {
         candidate.related_ip = host;
         candidate.related_port = port;
         
-        local_candidates_.push_back(candidate);
+        add_local_candidate(candidate);
         LOG_ICE_DEBUG("Added relay candidate: " << candidate.ip << ":" << candidate.port);
     }
 }
@@ -1021,164 +1504,212 @@ void IceAgent::gather_tcp_candidates() {
     // This is more complex and less commonly used
 }
 
+void IceAgent::add_local_candidate(const IceCandidate& candidate) {
+    {
+        std::lock_guard<std::mutex> candidates_lock(candidates_mutex_);
+        local_candidates_.push_back(candidate);
+        
+        // Every session pairs with the shared local candidates
+        std::lock_guard<std::mutex> sessions_lock(sessions_mutex_);
+        for (auto& entry : sessions_) {
+            form_candidate_pairs(entry.second);
+        }
+    }
+    
+    // Trickle the candidate to the application right away
+    if (candidate_callback_) {
+        candidate_callback_(candidate);
+    }
+}
+
 void IceAgent::connectivity_check_loop() {
     LOG_ICE_INFO("Starting connectivity check loop");
     
-    auto start_time = std::chrono::steady_clock::now();
     auto timeout = std::chrono::milliseconds(config_.connectivity_check_timeout_ms);
+    int max_sends = (std::min)(config_.max_connectivity_checks, stun::MAX_REQUEST_SENDS);
+    bool controlling = role_ == IceRole::CONTROLLING;
     
-    while (running_.load() && state_.load() == IceConnectionState::CHECKING) {
+    while (running_.load()) {
         auto now = std::chrono::steady_clock::now();
-        if (now - start_time > timeout) {
-            LOG_ICE_WARN("Connectivity checks timed out");
-            set_state(IceConnectionState::FAILED);
-            break;
-        }
         
-        std::vector<IceCandidatePair> pairs_to_check;
+        // One check per Ta across all sessions: triggered checks first, then the highest priority
+        // waiting pair, then retransmissions of in-progress checks whose RTO has expired.
+        // Sessions are visited round-robin so a peer with many pairs cannot starve the others
+        IceCandidatePair* next = nullptr;
+        IceCandidatePair check{IceCandidate(), IceCandidate()};
+        std::vector<uint8_t> request;
         {
-            std::lock_guard<std::mutex> lock(pairs_mutex_);
-            pairs_to_check = candidate_pairs_;
-        }
-        
-        bool any_succeeded = false;
-        for (auto& pair : pairs_to_check) {
-            if (pair.check_count >= config_.max_connectivity_checks) {
-                continue;
+            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            std::vector<std::pair<const std::string*, IceSession*>> checking;
+            for (auto it = sessions_.upper_bound(last_checked_session_); checking.size() < sessions_.size(); ++it) {
+                if (it == sessions_.end()) {
+                    it = sessions_.begin();
+                }
+                IceSession& session = it->second;
+                if (session.state == IceConnectionState::CHECKING && now - session.checks_started > timeout) {
+                    LOG_ICE_WARN("Connectivity checks timed out");
+                    set_session_state(it->first, session, IceConnectionState::FAILED);
+                }
+                checking.emplace_back(&it->first, &session);
             }
+            checking.erase(std::remove_if(checking.begin(), checking.end(),
+                [](const std::pair<const std::string*, IceSession*>& entry) {
+                    return entry.second->state != IceConnectionState::CHECKING;
+                }), checking.end());
             
-            if (perform_connectivity_check(pair)) {
-                pair.succeeded = true;
-                any_succeeded = true;
-                
-                // Update the pair in the main list
-                {
-                    std::lock_guard<std::mutex> lock(pairs_mutex_);
-                    for (auto& stored_pair : candidate_pairs_) {
-                        if (stored_pair.local.ip == pair.local.ip && 
-                            stored_pair.local.port == pair.local.port &&
-                            stored_pair.remote.ip == pair.remote.ip && 
-                            stored_pair.remote.port == pair.remote.port) {
-                            stored_pair = pair;
-                            break;
+            if (checking.empty()) {
+                checks_running_ = false;
+                break;
+            }
+            
+            const std::string* owner = nullptr;
+            IceSession* session = nullptr;
+            for (int pass = 0; pass < 3 && !next; ++pass) {
+                for (const auto& entry : checking) {
+                    for (auto& pair : entry.second->candidate_pairs) {
+                        if (pass == 0 && !pair.triggered) {
+                            continue;
                         }
-                    }
-                }
-                
-                // Select this pair if it's the first successful one
-                {
-                    std::lock_guard<std::mutex> lock(pairs_mutex_);
-                    if (!selected_pair_.succeeded) {
-                        selected_pair_ = pair;
-                        nominate_pair(pair);
-                        
-                        set_state(IceConnectionState::CONNECTED);
-                        
-                        std::string local_addr = pair.local.ip + ":" + std::to_string(pair.local.port);
-                        std::string remote_addr = pair.remote.ip + ":" + std::to_string(pair.remote.port);
-                        
-                        if (connected_callback_) {
-                            connected_callback_(local_addr, remote_addr);
+                        if (pass == 1 && pair.state != IceCandidatePairState::WAITING) {
+                            continue;
+                        }
+                        if (pass == 2) {
+                            if (pair.state != IceCandidatePairState::IN_PROGRESS) {
+                                continue;
+                            }
+                            auto rto = std::chrono::milliseconds(config_.check_rto_ms << (std::min)(pair.check_count - 1, 4));
+                            if (now - pair.last_check_time < rto) {
+                                continue;
+                            }
+                            if (pair.check_count >= max_sends) {
+                                pair.state = IceCandidatePairState::FAILED;
+                                LOG_ICE_DEBUG("Connectivity check failed: " << pair.remote.ip << ":" << pair.remote.port);
+                                continue;
+                            }
                         }
-                        
-                        LOG_ICE_INFO("ICE connection established using pair: " << local_addr << " <-> " << remote_addr);
-                        return;
+                        next = &pair;
+                        break;
+                    }
+                    if (next) {
+                        owner = entry.first;
+                        session = entry.second;
+                        break;
                     }
                 }
             }
             
-            pair.check_count++;
-            pair.last_check_time = now;
-        }
-        
-        if (!any_succeeded && now - start_time > std::chrono::seconds(10)) {
-            // Try hole punching for remaining pairs
-            for (const auto& pair : pairs_to_check) {
-                if (!pair.succeeded) {
-                    perform_hole_punching(pair.remote.ip, pair.remote.port);
+            if (next) {
+                last_checked_session_ = *owner;
+                
+                // A new transaction for fresh and triggered checks, the same one for retransmissions
+                bool retransmit = next->state == IceCandidatePairState::IN_PROGRESS && !next->triggered;
+                if (!retransmit) {
+                    next->use_candidate = controlling &&
+                        (config_.aggressive_nomination || next->state == IceCandidatePairState::SUCCEEDED);
+                    next->check_count = 0;
+                }
+                next->triggered = false;
+                next->state = IceCandidatePairState::IN_PROGRESS;
+                next->check_count++;
+                next->last_check_time = now;
+                
+                request = StunClient::create_binding_request_ice(
+                    session->remote_ufrag + ":" + session->local_ufrag, session->remote_pwd,
+                    calculate_candidate_priority(IceCandidateType::PEER_REFLEXIVE, 65535, next->local.component_id),
+                    controlling, tie_breaker_, next->use_candidate);
+                if (retransmit && next->transaction_id.size() == stun::TRANSACTION_ID_SIZE) {
+                    std::copy(next->transaction_id.begin(), next->transaction_id.end(), request.begin() + 8);
+                } else {
+                    next->transaction_id.assign(reinterpret_cast<const char*>(request.data() + 8), stun::TRANSACTION_ID_SIZE);
                 }
+                check = *next;
             }
         }
+        if (!request.empty()) {
+            perform_connectivity_check(check, request);
+        }
         
-        // Use conditional variable for responsive shutdown
+        // Pace checks by Ta; responses are handled by the receive thread meanwhile
         {
             std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(100), [this] { return !running_.load(); })) {
+            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(config_.check_pacing_ms), [this] { return !running_.load(); })) {
                 break;
             }
         }
     }
     
-    if (state_.load() == IceConnectionState::CHECKING) {
-        set_state(IceConnectionState::FAILED);
-    }
+    LOG_ICE_DEBUG("Connectivity check loop ended");
 }
 
-bool IceAgent::perform_connectivity_check(IceCandidatePair& pair) {
+bool IceAgent::perform_connectivity_check(const IceCandidatePair& pair, const std::vector<uint8_t>& request) {
     LOG_ICE_DEBUG("Performing connectivity check: " 
                   << pair.local.ip << ":" << pair.local.port << " -> " 
-                  << pair.remote.ip << ":" << pair.remote.port);
-    
-    // Create STUN binding request for connectivity check
-    std::vector<uint8_t> request = StunClient::create_binding_request();
+                  << pair.remote.ip << ":" << pair.remote.port
+                  << (pair.use_candidate ? " (USE-CANDIDATE)" : ""));
     
-    // Send request
-    int sent = 0;
-    if (pair.local.type == IceCandidateType::RELAY && turn_client_) {
-        sent = turn_client_->send_data(request, pair.remote.ip, pair.remote.port) ? request.size() : 0;
-    } else {
-        sent = send_udp_data_to(udp_socket_, request, pair.remote.ip, pair.remote.port);
-    }
-    
-    if (sent <= 0) {
+    // Send request; the response is matched by transaction ID in handle_binding_response()
+    if (!send_on_pair(pair, request)) {
         LOG_ICE_DEBUG("Failed to send connectivity check");
         return false;
     }
-    
-    // Wait for response (simplified)
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    
-    // In a real implementation, we would wait for and validate the STUN response
-    // For now, we'll consider the check successful if we could send the request
     return true;
 }
 
-void IceAgent::form_candidate_pairs() {
-    std::lock_guard<std::mutex> lock(pairs_mutex_);
-    
-    candidate_pairs_.clear();
-    
+bool IceAgent::send_on_pair(const IceCandidatePair& pair, const std::vector<uint8_t>& data) {
+    if (pair.local.type == IceCandidateType::RELAY) {
+        std::shared_ptr<TurnClient> turn_client = get_turn_client();
+        if (turn_client) {
+            return turn_client->send_data(data, pair.remote.ip, pair.remote.port);
+        }
+    }
+    return send_udp_data_to(udp_socket_, data, pair.remote.ip, pair.remote.port) > 0;
+}
+
+void IceAgent::form_candidate_pairs(IceSession& session) {
+    // Pairs are formed incrementally as candidates trickle in; existing pairs keep their check state
+    size_t formed = 0;
     for (const auto& local : local_candidates_) {
-        for (const auto& remote : remote_candidates_) {
+        for (const auto& remote : session.remote_candidates) {
             // Only pair candidates of the same component and transport
-            if (local.component_id == remote.component_id && 
-                local.transport == remote.transport) {
-                candidate_pairs_.emplace_back(local, remote);
+            if (local.component_id != remote.component_id || local.transport != remote.transport) {
+                continue;
+            }
+            bool exists = std::any_of(session.candidate_pairs.begin(), session.candidate_pairs.end(),
+                [&](const IceCandidatePair& pair) {
+                    return pair.local.ip == local.ip && pair.local.port == local.port &&
+                           pair.remote.ip == remote.ip && pair.remote.port == remote.port;
+                });
+            if (!exists) {
+                session.candidate_pairs.emplace_back(local, remote);
+                formed++;
             }
         }
     }
     
     // Sort pairs by priority (highest first)
-    std::sort(candidate_pairs_.begin(), candidate_pairs_.end(),
+    std::sort(session.candidate_pairs.begin(), session.candidate_pairs.end(),
               [](const IceCandidatePair& a, const IceCandidatePair& b) {
                   return a.priority > b.priority;
               });
     
-    LOG_ICE_DEBUG("Formed " << candidate_pairs_.size() << " candidate pairs");
+    LOG_ICE_DEBUG("Formed " << formed << " new candidate pairs (" << session.candidate_pairs.size() << " total)");
 }
 
 void IceAgent::prioritize_candidate_pairs() {
-    std::lock_guard<std::mutex> lock(pairs_mutex_);
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
     
     // Recalculate priorities and sort
-    for (auto& pair : candidate_pairs_) {
-        pair.priority = pair.calculate_priority();
+    for (auto& entry : sessions_) {
+        auto& pairs = entry.second.candidate_pairs;
+        for (auto& pair : pairs) {
+            pair.priority = pair.calculate_priority();
+        }
+        
+        std::sort(pairs.begin(), pairs.end(),
+                  [](const IceCandidatePair& a, const IceCandidatePair& b) {
+                      return a.priority > b.priority;
+                  });
     }
-    
-    std::sort(candidate_pairs_.begin(), candidate_pairs_.end(),
-              [](const IceCandidatePair& a, const IceCandidatePair& b) {
-                  return a.priority > b.priority;
-              });
 }
 
 void IceAgent::nominate_pair(IceCandidatePair& pair) {
@@ -1188,28 +1719,79 @@ void IceAgent::nominate_pair(IceCandidatePair& pair) {
                  << pair.remote.ip << ":" << pair.remote.port);
 }
 
+void IceAgent::select_pair_unlocked(const std::string& session_id, IceSession& session, IceCandidatePair& pair) {
+    if (session.selected_pair.succeeded) {
+        return;
+    }
+    
+    nominate_pair(pair);
+    session.selected_pair = pair;
+    set_session_state(session_id, session, IceConnectionState::CONNECTED);
+    
+    std::string local_addr = pair.local.ip + ":" + std::to_string(pair.local.port);
+    std::string remote_addr = pair.remote.ip + ":" + std::to_string(pair.remote.port);
+    
+    if (session_id == DEFAULT_SESSION_ID && connected_callback_) {
+        connected_callback_(local_addr, remote_addr);
+    }
+    if (session_connected_callback_) {
+        session_connected_callback_(session_id, local_addr, remote_addr);
+    }
+    
+    LOG_ICE_INFO("ICE connection established using pair: " << local_addr << " <-> " << remote_addr);
+}
+
+std::shared_ptr<TurnClient> IceAgent::get_turn_client() const {
+    std::lock_guard<std::mutex> lock(turn_mutex_);
+    return turn_client_;
+}
+
 void IceAgent::receive_loop() {
     LOG_ICE_DEBUG("Starting ICE receive loop");
     
     while (running_.load()) {
-        Peer sender;
-        std::vector<uint8_t> data = receive_udp_data(udp_socket_, 1500, sender);
+        // One wait covers the ICE socket and the TURN socket, so relayed packets are handled
+        // as they arrive; the wait is cut short when a TURN refresh comes due
+        std::shared_ptr<TurnClient> turn_client = get_turn_client();
+        socket_t turn_socket = turn_client && turn_client->is_allocated() ? turn_client->get_socket() : INVALID_SOCKET_VALUE;
+        auto wait = std::chrono::milliseconds(50);
+        if (is_valid_socket(turn_socket)) {
+            auto next_timer = turn_client->process_timers();
+            wait = (std::min)(wait, (std::max)(std::chrono::milliseconds(0),
+                std::chrono::duration_cast<std::chrono::milliseconds>(next_timer - std::chrono::steady_clock::now())));
+        }
         
-        if (!data.empty()) {
-            std::string from_addr = sender.ip + ":" + std::to_string(sender.port);
-            handle_incoming_data(data, from_addr);
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(udp_socket_, &read_fds);
+        socket_t max_socket = udp_socket_;
+        if (is_valid_socket(turn_socket)) {
+            FD_SET(turn_socket, &read_fds);
+            max_socket = (std::max)(max_socket, turn_socket);
+        }
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = static_cast<long>(wait.count() * 1000);
+        if (select(static_cast<int>(max_socket + 1), &read_fds, nullptr, nullptr, &timeout) <= 0) {
+            continue;
         }
         
-        // Refresh TURN allocation if needed
-        if (turn_client_) {
-            turn_client_->refresh_allocation();
+        std::string from_ip;
+        int from_port = 0;
+        if (FD_ISSET(udp_socket_, &read_fds)) {
+            std::vector<uint8_t> data = receive_udp_data_with_timeout(udp_socket_, 1500, 0, &from_ip, &from_port);
+            if (!data.empty()) {
+                handle_incoming_data(data, from_ip + ":" + std::to_string(from_port), false);
+            }
         }
         
-        // Use conditional variable for responsive shutdown
-        {
-            std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(50), [this] { return !running_.load(); })) {
-                break;
+        if (is_valid_socket(turn_socket) && FD_ISSET(turn_socket, &read_fds)) {
+            std::vector<uint8_t> packet = receive_udp_data_with_timeout(turn_socket, 2048, 0);
+            std::vector<uint8_t> payload;
+            std::string peer_ip;
+            uint16_t peer_port = 0;
+            if (!packet.empty() && turn_client->handle_packet(packet, payload, peer_ip, peer_port)) {
+                handle_incoming_data(payload, peer_ip + ":" + std::to_string(peer_port), true);
             }
         }
     }
@@ -1217,9 +1799,9 @@ void IceAgent::receive_loop() {
     LOG_ICE_DEBUG("ICE receive loop ended");
 }
 
-void IceAgent::handle_incoming_data(const std::vector<uint8_t>& data, const std::string& from_addr) {
+void IceAgent::handle_incoming_data(const std::vector<uint8_t>& data, const std::string& from_addr, bool relayed) {
     if (is_stun_message(data)) {
-        handle_stun_message(data, from_addr);
+        handle_stun_message(data, from_addr, relayed);
     } else if (data_callback_) {
         data_callback_(data, from_addr);
     }
@@ -1239,14 +1821,129 @@ bool IceAgent::is_stun_message(const std::vector<uint8_t>& data) {
     return magic_cookie == 0x2112A442;
 }
 
-void IceAgent::handle_stun_message(const std::vector<uint8_t>& data, const std::string& from_addr) {
+void IceAgent::handle_stun_message(const std::vector<uint8_t>& data, const std::string& from_addr, bool relayed) {
     LOG_ICE_DEBUG("Received STUN message from " << from_addr);
     
-    // Parse and handle STUN message
-    // This would include handling binding requests, responses, and ICE-specific attributes
+    size_t colon_pos = from_addr.rfind(':');
+    if (colon_pos == std::string::npos) {
+        return;
+    }
+    std::string from_ip = from_addr.substr(0, colon_pos);
+    uint16_t from_port = static_cast<uint16_t>(std::atoi(from_addr.c_str() + colon_pos + 1));
+    
+    uint16_t message_type = (static_cast<uint16_t>(data[0]) << 8) | data[1];
+    if (message_type == stun::BINDING_REQUEST) {
+        handle_binding_request(data, from_ip, from_port, relayed);
+    } else if (message_type == stun::BINDING_RESPONSE) {
+        handle_binding_response(data, from_ip, from_port);
+    }
+}
+
+void IceAgent::handle_binding_request(const std::vector<uint8_t>& data, const std::string& from_ip, uint16_t from_port, bool relayed) {
+    bool use_candidate = has_stun_attribute(data, stun::ATTR_USE_CANDIDATE);
+    uint32_t remote_priority = 0;
+    std::vector<uint8_t> priority_value;
+    if (find_stun_attribute(data, stun::ATTR_PRIORITY, priority_value) && priority_value.size() == 4) {
+        remote_priority = (static_cast<uint32_t>(priority_value[0]) << 24) | (static_cast<uint32_t>(priority_value[1]) << 16) |
+                          (static_cast<uint32_t>(priority_value[2]) << 8) | priority_value[3];
+    }
+    std::string local_ufrag = local_ufrag_of_request(data);
+    
+    std::lock_guard<std::mutex> candidates_lock(candidates_mutex_);
+    std::lock_guard<std::mutex> sessions_lock(sessions_mutex_);
+    
+    // Demultiplex by the ufrag the sender addressed; checks without USERNAME go to the default session
+    auto session_it = sessions_.find(DEFAULT_SESSION_ID);
+    if (!local_ufrag.empty()) {
+        session_it = std::find_if(sessions_.begin(), sessions_.end(),
+            [&](const std::pair<const std::string, IceSession>& entry) {
+                return entry.second.local_ufrag == local_ufrag;
+            });
+        if (session_it == sessions_.end()) {
+            LOG_ICE_DEBUG("Ignoring check for unknown ufrag " << local_ufrag << " from " << from_ip << ":" << from_port);
+            return;
+        }
+    }
+    const std::string& session_id = session_it->first;
+    IceSession& session = session_it->second;
     
-    // For connectivity checks, we need to handle binding requests and send responses
-    // For now, this is a simplified implementation
+    // Answer with the address we saw the request come from, over the path it arrived on
+    StunAddress mapped(from_ip, from_port);
+    std::vector<uint8_t> response = StunClient::create_binding_response(data.data() + 8, mapped);
+    std::shared_ptr<TurnClient> turn_client = relayed ? get_turn_client() : nullptr;
+    if (turn_client) {
+        turn_client->send_data(response, from_ip, from_port);
+    } else {
+        send_udp_data_to(udp_socket_, response, from_ip, from_port);
+    }
+    
+    // Learn a peer-reflexive candidate for a source we did not know about (RFC 8445 7.3.1.3)
+    bool known = std::any_of(session.remote_candidates.begin(), session.remote_candidates.end(),
+        [&](const IceCandidate& c) { return c.ip == from_ip && c.port == from_port; });
+    if (!known) {
+        IceCandidate candidate;
+        candidate.component_id = 1;
+        candidate.transport = IceTransport::UDP;
+        candidate.type = IceCandidateType::PEER_REFLEXIVE;
+        candidate.priority = remote_priority;
+        candidate.ip = from_ip;
+        candidate.port = from_port;
+        candidate.foundation = generate_foundation(candidate);
+        session.remote_candidates.push_back(candidate);
+        LOG_ICE_DEBUG("Learned peer-reflexive candidate: " << from_ip << ":" << from_port);
+        form_candidate_pairs(session);
+    }
+    
+    // Triggered check (RFC 8445 7.3.1.4): check the reverse direction right away
+    for (auto& pair : session.candidate_pairs) {
+        if (pair.remote.ip != from_ip || pair.remote.port != from_port) {
+            continue;
+        }
+        if (use_candidate) {
+            pair.remote_nominated = true;
+            if (pair.succeeded) {
+                select_pair_unlocked(session_id, session, pair);
+            }
+        }
+        if (pair.state != IceCandidatePairState::SUCCEEDED && pair.state != IceCandidatePairState::IN_PROGRESS) {
+            pair.state = IceCandidatePairState::WAITING;
+            pair.triggered = true;
+        }
+        break;
+    }
+}
+
+void IceAgent::handle_binding_response(const std::vector<uint8_t>& data, const std::string& from_ip, uint16_t from_port) {
+    std::string transaction_id(reinterpret_cast<const char*>(data.data() + 8), stun::TRANSACTION_ID_SIZE);
+    
+    // Transaction IDs are unique across sessions, so they alone find the session of a response
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (auto& entry : sessions_) {
+        IceSession& session = entry.second;
+        for (auto& pair : session.candidate_pairs) {
+            if (pair.state != IceCandidatePairState::IN_PROGRESS || pair.transaction_id != transaction_id) {
+                continue;
+            }
+            // Responses must come back from the address the check was sent to
+            if (pair.remote.ip != from_ip || pair.remote.port != from_port) {
+                LOG_ICE_DEBUG("Ignoring check response from unexpected address " << from_ip << ":" << from_port);
+                return;
+            }
+            
+            pair.state = IceCandidatePairState::SUCCEEDED;
+            pair.succeeded = true;
+            LOG_ICE_DEBUG("Connectivity check succeeded: " << pair.remote.ip << ":" << pair.remote.port
+                          << " after " << pair.check_count << " transmission(s)");
+            
+            if (pair.use_candidate || pair.remote_nominated) {
+                select_pair_unlocked(entry.first, session, pair);
+            } else if (role_ == IceRole::CONTROLLING && !session.selected_pair.succeeded) {
+                // Regular nomination: repeat the check on the first valid pair with USE-CANDIDATE
+                pair.triggered = true;
+            }
+            return;
+        }
+    }
 }
 
 uint32_t IceAgent::calculate_candidate_priority(IceCandidateType type, uint16_t local_pref, uint16_t component_id) {
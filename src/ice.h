@@ -13,6 +13,7 @@
 #include <thread>
 #include <mutex>
 #include <unordered_map>
+#include <map>
 #include <condition_variable>
 
 namespace librats {
@@ -56,6 +57,15 @@ struct IceCandidate {
     static IceCandidate from_json(const nlohmann::json& json);
 };
 
+// ICE Candidate Pair check states (RFC 8445 section 6.1.2.6)
+enum class IceCandidatePairState {
+    FROZEN,
+    WAITING,
+    IN_PROGRESS,
+    SUCCEEDED,
+    FAILED
+};
+
 // ICE Candidate Pair for connectivity checks
 struct IceCandidatePair {
     IceCandidate local;
@@ -65,6 +75,11 @@ struct IceCandidatePair {
     std::chrono::steady_clock::time_point last_check_time;
     int check_count;
     bool succeeded;
+    IceCandidatePairState state;
+    std::string transaction_id;     // Transaction ID of the outstanding check
+    bool triggered;                 // Queued for a triggered check (checked before ordinary ones)
+    bool use_candidate;             // Outstanding check carries USE-CANDIDATE
+    bool remote_nominated;          // Peer sent USE-CANDIDATE on this pair
     
     IceCandidatePair(const IceCandidate& local, const IceCandidate& remote);
     uint64_t calculate_priority() const;
@@ -82,6 +97,23 @@ enum class IceConnectionState {
     CLOSED
 };
 
+// ICE session: checks with one remote agent. Every session of an IceAgent shares its
+// socket, threads and gathered local candidates; incoming checks are demultiplexed by the
+// local ufrag in their USERNAME and responses by transaction ID
+struct IceSession {
+    std::string local_ufrag;
+    std::string local_pwd;
+    std::string remote_ufrag;
+    std::string remote_pwd;
+    std::vector<IceCandidate> remote_candidates;
+    std::vector<IceCandidatePair> candidate_pairs;
+    IceCandidatePair selected_pair;
+    IceConnectionState state;
+    std::chrono::steady_clock::time_point checks_started;
+    
+    IceSession();
+};
+
 // ICE Role
 enum class IceRole {
     CONTROLLING,
@@ -113,6 +145,10 @@ struct IceConfig {
     int turn_timeout_ms;
     int connectivity_check_timeout_ms;
     int max_connectivity_checks;
+    int check_pacing_ms;            // Ta: interval between connectivity checks
+    int check_rto_ms;               // Initial retransmission timeout of a check, doubled per retry
+    bool aggressive_nomination;     // Controlling agent nominates with every check
+    int candidate_cache_ttl_ms;     // Gathered local candidates are reused by later gathers for this long
     
     IceConfig();
 };
@@ -123,42 +159,81 @@ using IceCandidateCallback = std::function<void(const IceCandidate&)>;
 using IceStateChangeCallback = std::function<void(IceConnectionState)>;
 using IceConnectedCallback = std::function<void(const std::string& local_addr, const std::string& remote_addr)>;
 using IceDataCallback = std::function<void(const std::vector<uint8_t>&, const std::string& from_addr)>;
+using IceSessionStateCallback = std::function<void(const std::string& session_id, IceConnectionState)>;
+using IceSessionConnectedCallback = std::function<void(const std::string& session_id, const std::string& local_addr, const std::string& remote_addr)>;
 
-// TURN Client for relay candidates
+// TURN Client for relay candidates (RFC 8656). Relayed data uses 4-byte ChannelData framing once a
+// channel is bound to the peer and Send/Data indications until then. Refreshes of the allocation,
+// permissions and channels are kept on a deadline-ordered timer list serviced by process_timers()
 class TurnClient {
 public:
     TurnClient(const std::string& server, uint16_t port, 
                const std::string& username, const std::string& password);
     ~TurnClient();
     
-    bool allocate_relay(std::string& allocated_ip, uint16_t& allocated_port);
+    bool allocate_relay(std::string& allocated_ip, uint16_t& allocated_port, int timeout_ms = 5000);
     bool create_permission(const std::string& peer_ip);
+    bool bind_channel(const std::string& peer_ip, uint16_t peer_port);
     bool send_data(const std::vector<uint8_t>& data, const std::string& peer_ip, uint16_t peer_port);
     std::vector<uint8_t> receive_data(std::string& from_ip, uint16_t& from_port, int timeout_ms = 1000);
     void refresh_allocation();
     void deallocate();
     
+    // Event-driven receive: feed each datagram read from get_socket(). Returns true with the
+    // payload and peer address for relayed data; server responses are consumed internally
+    bool handle_packet(const std::vector<uint8_t>& packet, std::vector<uint8_t>& payload,
+                       std::string& from_ip, uint16_t& from_port);
+    
+    // Send the refreshes that are due; returns when the next one is
+    std::chrono::steady_clock::time_point process_timers();
+    
     bool is_allocated() const { return allocated_; }
+    bool has_channel(const std::string& peer_ip, uint16_t peer_port) const;
+    socket_t get_socket() const { return socket_; }
     std::string get_allocated_ip() const { return allocated_ip_; }
     uint16_t get_allocated_port() const { return allocated_port_; }
 
 private:
+    enum class TimerKind { ALLOCATION, PERMISSION, CHANNEL };
+    struct Timer {
+        TimerKind kind;
+        std::string peer;               // Peer IP (permissions) or "ip:port" (channels)
+    };
+    struct Channel {
+        uint16_t number;
+        std::string ip;
+        uint16_t port;
+        bool bound;                     // ChannelBind confirmed; ChannelData may be used
+    };
+    
     std::string server_;
     uint16_t port_;
     std::string username_;
     std::string password_;
     socket_t socket_;
-    bool allocated_;
+    std::atomic<bool> allocated_;
     std::string allocated_ip_;
     uint16_t allocated_port_;
+    uint32_t lifetime_;
     std::string realm_;
     std::string nonce_;
     std::chrono::steady_clock::time_point last_refresh_;
     
+    std::unordered_map<std::string, Channel> channels_by_peer_;         // "ip:port" -> channel
+    std::unordered_map<uint16_t, std::string> peers_by_channel_;
+    std::unordered_map<std::string, std::string> pending_channel_binds_; // transaction ID -> "ip:port"
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> permissions_;
+    std::multimap<std::chrono::steady_clock::time_point, Timer> timers_;
+    uint16_t next_channel_;
+    mutable std::mutex mutex_;
+    
     bool send_allocate_request();
-    bool send_refresh_request();
+    bool send_refresh_request(uint32_t lifetime);
     bool handle_allocate_response(const std::vector<uint8_t>& response);
     bool authenticate_with_server();
+    bool send_request(uint16_t method, const std::string& peer_ip, uint16_t peer_port,
+                      uint16_t channel, std::string* transaction_id);
+    void schedule_unlocked(std::chrono::seconds delay, TimerKind kind, const std::string& peer);
 };
 
 // NAT Type Detector
@@ -171,13 +246,10 @@ public:
     std::string nat_type_to_string(NatType type) const;
     
 private:
-    bool test_udp_blocked(const std::string& stun_server, int timeout_ms);
-    bool test_open_internet(const std::string& stun_server, int timeout_ms);
-    bool test_full_cone(const std::string& stun_server1, const std::string& stun_server2, int timeout_ms);
-    bool test_symmetric_nat(const std::string& stun_server1, const std::string& stun_server2, int timeout_ms);
-    
-    StunAddress get_mapped_address(const std::string& stun_server, int timeout_ms);
-    StunAddress get_mapped_address_different_port(const std::string& stun_server, int timeout_ms);
+    // Classification steps over mapped addresses from one parallel query (same local socket)
+    bool test_open_internet(const StunAddress& mapped_addr);
+    bool test_full_cone(const StunAddress& addr1, const StunAddress& addr2);
+    bool test_symmetric_nat(const StunAddress& addr1, const StunAddress& addr2);
 };
 
 // Main ICE Agent
@@ -213,6 +285,20 @@ public:
     void start_connectivity_checks();
     void restart_ice();
     
+    // Sessions: concurrent checks with several peers over this agent's one socket.
+    // The methods above act on the default session (empty id)
+    bool create_session(const std::string& session_id);
+    void close_session(const std::string& session_id);
+    bool has_session(const std::string& session_id) const;
+    size_t get_session_count() const;
+    std::pair<std::string, std::string> get_session_credentials(const std::string& session_id) const;
+    void set_session_remote_credentials(const std::string& session_id, const std::string& ufrag, const std::string& pwd);
+    void add_session_remote_candidate(const std::string& session_id, const IceCandidate& candidate);
+    void start_session_checks(const std::string& session_id);
+    IceConnectionState get_session_state(const std::string& session_id) const;
+    IceCandidatePair get_session_selected_pair(const std::string& session_id) const;
+    bool send_session_data(const std::string& session_id, const std::vector<uint8_t>& data);
+    
     // Data transmission
     bool send_data(const std::vector<uint8_t>& data);
     bool send_data_to(const std::vector<uint8_t>& data, const std::string& addr);
@@ -232,6 +318,8 @@ public:
     void set_state_change_callback(IceStateChangeCallback callback) { state_change_callback_ = callback; }
     void set_connected_callback(IceConnectedCallback callback) { connected_callback_ = callback; }
     void set_data_callback(IceDataCallback callback) { data_callback_ = callback; }
+    void set_session_state_callback(IceSessionStateCallback callback) { session_state_callback_ = callback; }
+    void set_session_connected_callback(IceSessionConnectedCallback callback) { session_connected_callback_ = callback; }
     
     // Signaling support
     nlohmann::json get_local_description() const;
@@ -250,26 +338,29 @@ private:
     std::atomic<bool> running_;
     std::atomic<IceConnectionState> state_;
     
-    // Credentials
+    // Credentials of the default session (also stamped on gathered candidates)
     std::string local_ufrag_;
     std::string local_pwd_;
-    std::string remote_ufrag_;
-    std::string remote_pwd_;
     
-    // Candidates
+    // Local candidates, shared by all sessions and reused while fresh
     std::vector<IceCandidate> local_candidates_;
-    std::vector<IceCandidate> remote_candidates_;
-    mutable std::mutex candidates_mutex_;
-    
-    // Candidate pairs and connectivity checks
-    std::vector<IceCandidatePair> candidate_pairs_;
-    IceCandidatePair selected_pair_;
-    mutable std::mutex pairs_mutex_;
+    std::chrono::steady_clock::time_point candidates_gathered_at_;
+    std::atomic<bool> gathering_;
+    mutable std::mutex candidates_mutex_;   // Taken before sessions_mutex_
+    
+    // Sessions by id, each with its own remote candidates, pairs and selected pair
+    std::map<std::string, IceSession> sessions_;
+    std::string last_checked_session_;      // Round-robin cursor of the check scheduler
+    bool checks_running_;
+    mutable std::mutex sessions_mutex_;
+    std::mutex check_thread_mutex_;
+    uint64_t tie_breaker_;
     
     // Networking
     socket_t udp_socket_;
     socket_t tcp_socket_;
-    std::unique_ptr<TurnClient> turn_client_;
+    std::shared_ptr<TurnClient> turn_client_;    // Published by the gather thread
+    mutable std::mutex turn_mutex_;
     std::unique_ptr<NatTypeDetector> nat_detector_;
     
     // Threading
@@ -286,24 +377,34 @@ private:
     IceStateChangeCallback state_change_callback_;
     IceConnectedCallback connected_callback_;
     IceDataCallback data_callback_;
+    IceSessionStateCallback session_state_callback_;
+    IceSessionConnectedCallback session_connected_callback_;
     
     // Internal methods
     void set_state(IceConnectionState new_state);
+    void set_session_state(const std::string& session_id, IceSession& session, IceConnectionState new_state);
     void gather_host_candidates();
     void gather_server_reflexive_candidates();
     void gather_relay_candidates();
     void gather_tcp_candidates();
     
+    void add_local_candidate(const IceCandidate& candidate);
+    
     void connectivity_check_loop();
-    bool perform_connectivity_check(IceCandidatePair& pair);
-    void form_candidate_pairs();
+    bool perform_connectivity_check(const IceCandidatePair& pair, const std::vector<uint8_t>& request);
+    void form_candidate_pairs(IceSession& session);
     void prioritize_candidate_pairs();
     void nominate_pair(IceCandidatePair& pair);
+    void select_pair_unlocked(const std::string& session_id, IceSession& session, IceCandidatePair& pair);
+    bool send_on_pair(const IceCandidatePair& pair, const std::vector<uint8_t>& data);
+    void handle_binding_request(const std::vector<uint8_t>& data, const std::string& from_ip, uint16_t from_port, bool relayed);
+    void handle_binding_response(const std::vector<uint8_t>& data, const std::string& from_ip, uint16_t from_port);
     
+    std::shared_ptr<TurnClient> get_turn_client() const;
     void receive_loop();
-    void handle_incoming_data(const std::vector<uint8_t>& data, const std::string& from_addr);
+    void handle_incoming_data(const std::vector<uint8_t>& data, const std::string& from_addr, bool relayed);
     bool is_stun_message(const std::vector<uint8_t>& data);
-    void handle_stun_message(const std::vector<uint8_t>& data, const std::string& from_addr);
+    void handle_stun_message(const std::vector<uint8_t>& data, const std::string& from_addr, bool relayed);
     
     uint32_t calculate_candidate_priority(IceCandidateType type, uint16_t local_pref, uint16_t component_id);
     std::string generate_foundation(const IceCandidate& candidate);
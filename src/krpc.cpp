@@ -7,6 +7,7 @@
 #include <iomanip>
 #include <cstring>
 #include <algorithm>
+#include <initializer_list>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -72,6 +73,16 @@ KrpcMessage KrpcProtocol::create_announce_peer_query(const std::string& transact
     return message;
 }
 
+KrpcMessage KrpcProtocol::create_sample_infohashes_query(const std::string& transaction_id, const NodeId& sender_id, const NodeId& target_id) {
+    KrpcMessage message;
+    message.type = KrpcMessageType::Query;
+    message.transaction_id = transaction_id;
+    message.query_type = KrpcQueryType::SampleInfohashes;
+    message.sender_id = sender_id;
+    message.target_id = target_id;
+    return message;
+}
+
 // Create response messages
 KrpcMessage KrpcProtocol::create_ping_response(const std::string& transaction_id, const NodeId& response_id) {
     KrpcMessage message;
@@ -90,7 +101,7 @@ KrpcMessage KrpcProtocol::create_find_node_response(const std::string& transacti
     return message;
 }
 
-KrpcMessage KrpcProtocol::create_get_peers_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<Peer>& peers, const std::string& token) {
+KrpcMessage KrpcProtocol::create_get_peers_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<NetEndpoint>& peers, const std::string& token) {
     KrpcMessage message;
     message.type = KrpcMessageType::Response;
     message.transaction_id = transaction_id;
@@ -118,6 +129,19 @@ KrpcMessage KrpcProtocol::create_announce_peer_response(const std::string& trans
     return message;
 }
 
+KrpcMessage KrpcProtocol::create_sample_infohashes_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<KrpcNode>& nodes,
+                                                             const std::vector<InfoHash>& samples, uint32_t num, uint32_t interval) {
+    KrpcMessage message;
+    message.type = KrpcMessageType::Response;
+    message.transaction_id = transaction_id;
+    message.response_id = response_id;
+    message.nodes = nodes;
+    message.samples = samples;
+    message.num = num;
+    message.interval = interval;
+    return message;
+}
+
 // Create error message
 KrpcMessage KrpcProtocol::create_error(const std::string& transaction_id, KrpcErrorCode error_code, const std::string& error_message) {
     KrpcMessage message;
@@ -129,118 +153,233 @@ KrpcMessage KrpcProtocol::create_error(const std::string& transaction_id, KrpcEr
 }
 
 // Encode messages
+namespace {
+
+// Bencode needs dictionary keys in sorted order; each message writes its keys in the
+// order listed here, checked at compile time
+constexpr std::string_view KEY_A = "a";
+constexpr std::string_view KEY_E = "e";
+constexpr std::string_view KEY_ID = "id";
+constexpr std::string_view KEY_INFO_HASH = "info_hash";
+constexpr std::string_view KEY_INTERVAL = "interval";
+constexpr std::string_view KEY_NODES = "nodes";
+constexpr std::string_view KEY_NUM = "num";
+constexpr std::string_view KEY_PORT = "port";
+constexpr std::string_view KEY_Q = "q";
+constexpr std::string_view KEY_R = "r";
+constexpr std::string_view KEY_SAMPLES = "samples";
+constexpr std::string_view KEY_T = "t";
+constexpr std::string_view KEY_TARGET = "target";
+constexpr std::string_view KEY_TOKEN = "token";
+constexpr std::string_view KEY_VALUES = "values";
+constexpr std::string_view KEY_Y = "y";
+
+constexpr bool keys_sorted(std::initializer_list<std::string_view> keys) {
+    const std::string_view* key = keys.begin();
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (!(key[i - 1] < key[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(keys_sorted({KEY_A, KEY_Q, KEY_T, KEY_Y}), "query keys out of order");
+static_assert(keys_sorted({KEY_ID, KEY_INFO_HASH, KEY_PORT, KEY_TARGET, KEY_TOKEN}), "query argument keys out of order");
+static_assert(keys_sorted({KEY_R, KEY_T, KEY_Y}), "response keys out of order");
+static_assert(keys_sorted({KEY_ID, KEY_INTERVAL, KEY_NODES, KEY_NUM, KEY_SAMPLES, KEY_TOKEN, KEY_VALUES}),
+              "response value keys out of order");
+static_assert(keys_sorted({KEY_E, KEY_T, KEY_Y}), "error keys out of order");
+
+std::string_view id_view(const NodeId& id) {
+    return std::string_view(reinterpret_cast<const char*>(id.data()), id.size());
+}
+
+// Compact IPv4 address and port (6 bytes); IPv6 is written as 0.0.0.0
+void write_compact_address(uint8_t* out, const NetEndpoint& endpoint) {
+    if (endpoint.is_ipv4()) {
+        std::memcpy(out, endpoint.ipv4_bytes(), 4);  // Already network byte order
+    } else {
+        std::memset(out, 0, 4);
+    }
+    out[4] = static_cast<uint8_t>(endpoint.port >> 8);
+    out[5] = static_cast<uint8_t>(endpoint.port & 0xFF);
+}
+
+NetEndpoint read_compact_address(const char* in) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(in);
+    return NetEndpoint::from_ipv4(bytes, static_cast<uint16_t>((bytes[4] << 8) | bytes[5]));
+}
+
+} // namespace
+
 std::vector<uint8_t> KrpcProtocol::encode_message(const KrpcMessage& message) {
-    BencodeValue root;
+    std::vector<uint8_t> buffer;
+    encode_message(message, buffer);
+    return buffer;
+}
+
+bool KrpcProtocol::encode_message(const KrpcMessage& message, std::vector<uint8_t>& buffer) {
+    buffer.clear();
+    BencodeWriter writer(buffer);
     
     switch (message.type) {
         case KrpcMessageType::Query:
-            root = encode_query(message);
-            break;
+            write_query(message, writer);
+            return true;
         case KrpcMessageType::Response:
-            root = encode_response(message);
-            break;
+            write_response(message, writer);
+            return true;
         case KrpcMessageType::Error:
-            root = encode_error(message);
-            break;
+            write_error(message, writer);
+            return true;
         default:
             LOG_KRPC_ERROR("Unknown message type: " << static_cast<int>(message.type));
-            return {};
+            return false;
     }
-    
-    return root.encode();
 }
 
-BencodeValue KrpcProtocol::encode_query(const KrpcMessage& message) {
-    BencodeValue root = BencodeValue::create_dict();
-    
-    // Common fields
-    root["t"] = BencodeValue(message.transaction_id);
-    root["y"] = BencodeValue("q");
-    root["q"] = BencodeValue(query_type_to_string(message.query_type));
+void KrpcProtocol::write_query(const KrpcMessage& message, BencodeWriter& writer) {
+    writer.begin_dict();
     
     // Arguments
-    BencodeValue args = BencodeValue::create_dict();
-    args["id"] = BencodeValue(node_id_to_string(message.sender_id));
+    writer.write_string(KEY_A);
+    writer.begin_dict();
+    writer.write_string(KEY_ID);
+    writer.write_string(id_view(message.sender_id));
     
     switch (message.query_type) {
         case KrpcQueryType::Ping:
             // No additional arguments for ping
             break;
         case KrpcQueryType::FindNode:
-            args["target"] = BencodeValue(node_id_to_string(message.target_id));
+        case KrpcQueryType::SampleInfohashes:
+            writer.write_string(KEY_TARGET);
+            writer.write_string(id_view(message.target_id));
             break;
         case KrpcQueryType::GetPeers:
-            args["info_hash"] = BencodeValue(node_id_to_string(message.info_hash));
+            writer.write_string(KEY_INFO_HASH);
+            writer.write_string(id_view(message.info_hash));
             break;
         case KrpcQueryType::AnnouncePeer:
-            args["info_hash"] = BencodeValue(node_id_to_string(message.info_hash));
-            args["port"] = BencodeValue(static_cast<int64_t>(message.port));
-            args["token"] = BencodeValue(message.token);
+            writer.write_string(KEY_INFO_HASH);
+            writer.write_string(id_view(message.info_hash));
+            writer.write_string(KEY_PORT);
+            writer.write_integer(message.port);
+            writer.write_string(KEY_TOKEN);
+            writer.write_string(message.token);
             break;
     }
+    writer.end();
     
-    root["a"] = args;
-    return root;
+    // Common fields
+    writer.write_string(KEY_Q);
+    writer.write_string(query_type_to_string(message.query_type));
+    writer.write_string(KEY_T);
+    writer.write_string(message.transaction_id);
+    writer.write_string(KEY_Y);
+    writer.write_string("q");
+    
+    writer.end();
 }
 
-BencodeValue KrpcProtocol::encode_response(const KrpcMessage& message) {
-    BencodeValue root = BencodeValue::create_dict();
-    
-    // Common fields
-    root["t"] = BencodeValue(message.transaction_id);
-    root["y"] = BencodeValue("r");
+void KrpcProtocol::write_response(const KrpcMessage& message, BencodeWriter& writer) {
+    writer.begin_dict();
     
     // Response data
-    BencodeValue response = BencodeValue::create_dict();
-    response["id"] = BencodeValue(node_id_to_string(message.response_id));
+    writer.write_string(KEY_R);
+    writer.begin_dict();
+    writer.write_string(KEY_ID);
+    writer.write_string(id_view(message.response_id));
+    
+    // Info hash samples (BEP 51) are sent whenever there is an interval
+    bool has_samples = message.interval > 0;
+    if (has_samples) {
+        writer.write_string(KEY_INTERVAL);
+        writer.write_integer(message.interval);
+    }
     
-    // Add nodes if present
+    // Add nodes if present, written in place
     if (!message.nodes.empty()) {
-        std::string compact_nodes;
+        writer.write_string(KEY_NODES);
+        uint8_t* out = writer.write_string_header(message.nodes.size() * 26);
         for (const auto& node : message.nodes) {
-            compact_nodes += compact_node_info(node);
+            std::copy(node.id.begin(), node.id.end(), out);
+            write_compact_address(out + 20, node.peer);
+            out += 26;
         }
-        response["nodes"] = BencodeValue(compact_nodes);
     }
     
-    // Add peers if present
-    if (!message.peers.empty()) {
-        BencodeValue values = BencodeValue::create_list();
-        for (const auto& peer : message.peers) {
-            values.push_back(BencodeValue(compact_peer_info(peer)));
+    if (has_samples) {
+        writer.write_string(KEY_NUM);
+        writer.write_integer(message.num);
+        writer.write_string(KEY_SAMPLES);
+        uint8_t* out = writer.write_string_header(message.samples.size() * 20);
+        for (const auto& sample : message.samples) {
+            out = std::copy(sample.begin(), sample.end(), out);
         }
-        response["values"] = values;
     }
     
     // Add token if present
     if (!message.token.empty()) {
-        response["token"] = BencodeValue(message.token);
+        writer.write_string(KEY_TOKEN);
+        writer.write_string(message.token);
     }
     
-    root["r"] = response;
-    return root;
-}
-
-BencodeValue KrpcProtocol::encode_error(const KrpcMessage& message) {
-    BencodeValue root = BencodeValue::create_dict();
+    // Add peers if present
+    if (!message.peers.empty()) {
+        writer.write_string(KEY_VALUES);
+        writer.begin_list();
+        for (const auto& peer : message.peers) {
+            write_compact_address(writer.write_string_header(6), peer);
+        }
+        writer.end();
+    }
+    writer.end();
     
     // Common fields
-    root["t"] = BencodeValue(message.transaction_id);
-    root["y"] = BencodeValue("e");
+    writer.write_string(KEY_T);
+    writer.write_string(message.transaction_id);
+    writer.write_string(KEY_Y);
+    writer.write_string("r");
+    
+    writer.end();
+}
+
+void KrpcProtocol::write_error(const KrpcMessage& message, BencodeWriter& writer) {
+    writer.begin_dict();
     
     // Error data
-    BencodeValue error = BencodeValue::create_list();
-    error.push_back(BencodeValue(static_cast<int64_t>(message.error_code)));
-    error.push_back(BencodeValue(message.error_message));
+    writer.write_string(KEY_E);
+    writer.begin_list();
+    writer.write_integer(static_cast<int64_t>(message.error_code));
+    writer.write_string(message.error_message);
+    writer.end();
     
-    root["e"] = error;
-    return root;
+    // Common fields
+    writer.write_string(KEY_T);
+    writer.write_string(message.transaction_id);
+    writer.write_string(KEY_Y);
+    writer.write_string("e");
+    
+    writer.end();
 }
 
 // Decode messages
 std::unique_ptr<KrpcMessage> KrpcProtocol::decode_message(const std::vector<uint8_t>& data) {
+    return decode_message(data.data(), data.size());
+}
+
+std::unique_ptr<KrpcMessage> KrpcProtocol::decode_message(const uint8_t* data, size_t size) {
+    // One arena per thread: decoding allocates nothing but the message itself
+    static thread_local BencodeDocument document;
+    
     try {
-        BencodeValue root = bencode::decode(data);
+        if (!document.parse(data, size)) {
+            LOG_KRPC_ERROR("Malformed bencode");
+            return nullptr;
+        }
+        BencodeView root = document.root();
         
         if (!root.is_dict()) {
             LOG_KRPC_ERROR("Root is not a dictionary");
@@ -252,8 +391,7 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_message(const std::vector<uint
             return nullptr;
         }
         
-        std::string transaction_id = root["t"].as_string();
-        std::string message_type = root["y"].as_string();
+        std::string_view message_type = root["y"].as_string();
         
         if (message_type == "q") {
             return decode_query(root);
@@ -271,7 +409,7 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_message(const std::vector<uint
     }
 }
 
-std::unique_ptr<KrpcMessage> KrpcProtocol::decode_query(const BencodeValue& data) {
+std::unique_ptr<KrpcMessage> KrpcProtocol::decode_query(const BencodeView& data) {
     if (!data.has_key("q") || !data.has_key("a")) {
         LOG_KRPC_ERROR("Missing required query fields 'q' or 'a'");
         return nullptr;
@@ -279,12 +417,12 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_query(const BencodeValue& data
     
     auto message = std::make_unique<KrpcMessage>();
     message->type = KrpcMessageType::Query;
-    message->transaction_id = data["t"].as_string();
+    message->transaction_id = std::string(data["t"].as_string());
     
-    std::string query_method = data["q"].as_string();
+    std::string_view query_method = data["q"].as_string();
     message->query_type = string_to_query_type(query_method);
     
-    const BencodeValue& args = data["a"];
+    BencodeView args = data["a"];
     if (!args.is_dict() || !args.has_key("id")) {
         LOG_KRPC_ERROR("Invalid arguments in query");
         return nullptr;
@@ -314,7 +452,12 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_query(const BencodeValue& data
                 message->port = static_cast<uint16_t>(args["port"].as_integer());
             }
             if (args.has_key("token")) {
-                message->token = args["token"].as_string();
+                message->token = std::string(args["token"].as_string());
+            }
+            break;
+        case KrpcQueryType::SampleInfohashes:
+            if (args.has_key("target")) {
+                message->target_id = string_to_node_id(args["target"].as_string());
             }
             break;
     }
@@ -322,7 +465,7 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_query(const BencodeValue& data
     return message;
 }
 
-std::unique_ptr<KrpcMessage> KrpcProtocol::decode_response(const BencodeValue& data) {
+std::unique_ptr<KrpcMessage> KrpcProtocol::decode_response(const BencodeView& data) {
     if (!data.has_key("r")) {
         LOG_KRPC_ERROR("Missing required response field 'r'");
         return nullptr;
@@ -330,9 +473,9 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_response(const BencodeValue& d
     
     auto message = std::make_unique<KrpcMessage>();
     message->type = KrpcMessageType::Response;
-    message->transaction_id = data["t"].as_string();
+    message->transaction_id = std::string(data["t"].as_string());
     
-    const BencodeValue& response = data["r"];
+    BencodeView response = data["r"];
     if (!response.is_dict() || !response.has_key("id")) {
         LOG_KRPC_ERROR("Invalid response data");
         return nullptr;
@@ -342,31 +485,50 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_response(const BencodeValue& d
     
     // Parse nodes if present
     if (response.has_key("nodes")) {
-        std::string compact_nodes = response["nodes"].as_string();
-        message->nodes = parse_compact_node_info(compact_nodes);
+        message->nodes = parse_compact_node_info(response["nodes"].as_string());
     }
     
     // Parse peers if present
     if (response.has_key("values")) {
-        const BencodeValue& values = response["values"];
+        BencodeView values = response["values"];
         if (values.is_list()) {
+            // Straight into the message, no intermediate vector per value
             for (size_t i = 0; i < values.size(); ++i) {
-                std::string compact_peers = values[i].as_string();
-                auto peers = parse_compact_peer_info(compact_peers);
-                message->peers.insert(message->peers.end(), peers.begin(), peers.end());
+                std::string_view value = values[i].as_string();
+                if (value.size() % 6 != 0) {
+                    LOG_KRPC_WARN("Invalid compact peer info size: " << value.size());
+                    continue;
+                }
+                for (size_t offset = 0; offset < value.size(); offset += 6) {
+                    message->peers.push_back(read_compact_address(value.data() + offset));
+                }
             }
         }
     }
     
     // Parse token if present
     if (response.has_key("token")) {
-        message->token = response["token"].as_string();
+        message->token = std::string(response["token"].as_string());
+    }
+    
+    // Parse info hash samples if present (BEP 51)
+    if (response.has_key("samples")) {
+        std::string_view samples = response["samples"].as_string();
+        for (size_t i = 0; i + 20 <= samples.size(); i += 20) {
+            message->samples.push_back(string_to_node_id(samples.substr(i, 20)));
+        }
+        if (response.has_key("num")) {
+            message->num = static_cast<uint32_t>(response["num"].as_integer());
+        }
+        if (response.has_key("interval")) {
+            message->interval = static_cast<uint32_t>(response["interval"].as_integer());
+        }
     }
     
     return message;
 }
 
-std::unique_ptr<KrpcMessage> KrpcProtocol::decode_error(const BencodeValue& data) {
+std::unique_ptr<KrpcMessage> KrpcProtocol::decode_error(const BencodeView& data) {
     if (!data.has_key("e")) {
         LOG_KRPC_ERROR("Missing required error field 'e'");
         return nullptr;
@@ -374,16 +536,16 @@ std::unique_ptr<KrpcMessage> KrpcProtocol::decode_error(const BencodeValue& data
     
     auto message = std::make_unique<KrpcMessage>();
     message->type = KrpcMessageType::Error;
-    message->transaction_id = data["t"].as_string();
+    message->transaction_id = std::string(data["t"].as_string());
     
-    const BencodeValue& error = data["e"];
+    BencodeView error = data["e"];
     if (!error.is_list() || error.size() < 2) {
         LOG_KRPC_ERROR("Invalid error data");
         return nullptr;
     }
     
     message->error_code = static_cast<KrpcErrorCode>(error[0].as_integer());
-    message->error_message = error[1].as_string();
+    message->error_message = std::string(error[1].as_string());
     
     return message;
 }
@@ -397,7 +559,7 @@ std::string KrpcProtocol::node_id_to_string(const NodeId& id) {
     return std::string(id.begin(), id.end());
 }
 
-NodeId KrpcProtocol::string_to_node_id(const std::string& str) {
+NodeId KrpcProtocol::string_to_node_id(std::string_view str) {
     NodeId id;
     if (str.size() >= 20) {
         std::copy_n(str.begin(), 20, id.begin());
@@ -408,100 +570,36 @@ NodeId KrpcProtocol::string_to_node_id(const std::string& str) {
     return id;
 }
 
-std::string KrpcProtocol::compact_peer_info(const Peer& peer) {
-    std::string result;
-    result.reserve(6);
-    
-    // Convert IP address to 4 bytes
-    if (network_utils::is_valid_ipv4(peer.ip)) {
-        struct in_addr addr;
-        if (inet_pton(AF_INET, peer.ip.c_str(), &addr) == 1) {
-            uint32_t ip = ntohl(addr.s_addr);
-            result += static_cast<char>((ip >> 24) & 0xFF);
-            result += static_cast<char>((ip >> 16) & 0xFF);
-            result += static_cast<char>((ip >> 8) & 0xFF);
-            result += static_cast<char>(ip & 0xFF);
-        } else {
-            // Invalid IP, use 0.0.0.0
-            result += "\x00\x00\x00\x00";
-        }
-    } else {
-        // Not IPv4, use 0.0.0.0
-        result += "\x00\x00\x00\x00";
-    }
-    
-    // Convert port to 2 bytes (network byte order)
-    result += static_cast<char>((peer.port >> 8) & 0xFF);
-    result += static_cast<char>(peer.port & 0xFF);
-    
+std::string KrpcProtocol::compact_peer_info(const NetEndpoint& peer) {
+    std::string result(6, '\0');
+    write_compact_address(reinterpret_cast<uint8_t*>(&result[0]), peer);
     return result;
 }
 
 std::string KrpcProtocol::compact_node_info(const KrpcNode& node) {
-    std::string result;
-    result.reserve(26);
-    
-    // Node ID (20 bytes)
-    result += node_id_to_string(node.id);
-    
-    // IP address (4 bytes)
-    if (network_utils::is_valid_ipv4(node.ip)) {
-        struct in_addr addr;
-        if (inet_pton(AF_INET, node.ip.c_str(), &addr) == 1) {
-            uint32_t ip = ntohl(addr.s_addr);
-            result += static_cast<char>((ip >> 24) & 0xFF);
-            result += static_cast<char>((ip >> 16) & 0xFF);
-            result += static_cast<char>((ip >> 8) & 0xFF);
-            result += static_cast<char>(ip & 0xFF);
-        } else {
-            // Invalid IP, use 0.0.0.0
-            result += "\x00\x00\x00\x00";
-        }
-    } else {
-        // Not IPv4, use 0.0.0.0
-        result += "\x00\x00\x00\x00";
-    }
-    
-    // Port (2 bytes, network byte order)
-    result += static_cast<char>((node.port >> 8) & 0xFF);
-    result += static_cast<char>(node.port & 0xFF);
-    
+    std::string result(26, '\0');
+    std::copy(node.id.begin(), node.id.end(), result.begin());
+    write_compact_address(reinterpret_cast<uint8_t*>(&result[20]), node.peer);
     return result;
 }
 
-std::vector<Peer> KrpcProtocol::parse_compact_peer_info(const std::string& compact_info) {
-    std::vector<Peer> peers;
+std::vector<NetEndpoint> KrpcProtocol::parse_compact_peer_info(std::string_view compact_info) {
+    std::vector<NetEndpoint> peers;
     
     if (compact_info.size() % 6 != 0) {
         LOG_KRPC_WARN("Invalid compact peer info size: " << compact_info.size());
         return peers;
     }
     
+    peers.reserve(compact_info.size() / 6);
     for (size_t i = 0; i < compact_info.size(); i += 6) {
-        // Extract IP address (4 bytes)
-        uint32_t ip = 0;
-        ip |= (static_cast<uint8_t>(compact_info[i]) << 24);
-        ip |= (static_cast<uint8_t>(compact_info[i + 1]) << 16);
-        ip |= (static_cast<uint8_t>(compact_info[i + 2]) << 8);
-        ip |= static_cast<uint8_t>(compact_info[i + 3]);
-        
-        struct in_addr addr;
-        addr.s_addr = htonl(ip);
-        char ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &addr, ip_str, INET_ADDRSTRLEN);
-        
-        // Extract port (2 bytes)
-        uint16_t port = 0;
-        port |= (static_cast<uint8_t>(compact_info[i + 4]) << 8);
-        port |= static_cast<uint8_t>(compact_info[i + 5]);
-        
-        peers.emplace_back(ip_str, port);
+        peers.push_back(read_compact_address(compact_info.data() + i));
     }
     
     return peers;
 }
 
-std::vector<KrpcNode> KrpcProtocol::parse_compact_node_info(const std::string& compact_info) {
+std::vector<KrpcNode> KrpcProtocol::parse_compact_node_info(std::string_view compact_info) {
     std::vector<KrpcNode> nodes;
     
     if (compact_info.size() % 26 != 0) {
@@ -509,48 +607,32 @@ std::vector<KrpcNode> KrpcProtocol::parse_compact_node_info(const std::string& c
         return nodes;
     }
     
+    nodes.reserve(compact_info.size() / 26);
     for (size_t i = 0; i < compact_info.size(); i += 26) {
-        // Extract node ID (20 bytes)
         NodeId node_id;
         std::copy_n(compact_info.begin() + i, 20, node_id.begin());
-        
-        // Extract IP address (4 bytes)
-        uint32_t ip = 0;
-        ip |= (static_cast<uint8_t>(compact_info[i + 20]) << 24);
-        ip |= (static_cast<uint8_t>(compact_info[i + 21]) << 16);
-        ip |= (static_cast<uint8_t>(compact_info[i + 22]) << 8);
-        ip |= static_cast<uint8_t>(compact_info[i + 23]);
-        
-        struct in_addr addr;
-        addr.s_addr = htonl(ip);
-        char ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &addr, ip_str, INET_ADDRSTRLEN);
-        
-        // Extract port (2 bytes)
-        uint16_t port = 0;
-        port |= (static_cast<uint8_t>(compact_info[i + 24]) << 8);
-        port |= static_cast<uint8_t>(compact_info[i + 25]);
-        
-        nodes.emplace_back(node_id, ip_str, port);
+        nodes.emplace_back(node_id, read_compact_address(compact_info.data() + i + 20));
     }
     
     return nodes;
 }
 
-KrpcQueryType KrpcProtocol::string_to_query_type(const std::string& str) {
+KrpcQueryType KrpcProtocol::string_to_query_type(std::string_view str) {
     if (str == "ping") return KrpcQueryType::Ping;
     if (str == "find_node") return KrpcQueryType::FindNode;
     if (str == "get_peers") return KrpcQueryType::GetPeers;
     if (str == "announce_peer") return KrpcQueryType::AnnouncePeer;
+    if (str == "sample_infohashes") return KrpcQueryType::SampleInfohashes;
     return KrpcQueryType::Ping; // Default
 }
 
-std::string KrpcProtocol::query_type_to_string(KrpcQueryType type) {
+std::string_view KrpcProtocol::query_type_to_string(KrpcQueryType type) {
     switch (type) {
         case KrpcQueryType::Ping: return "ping";
         case KrpcQueryType::FindNode: return "find_node";
         case KrpcQueryType::GetPeers: return "get_peers";
         case KrpcQueryType::AnnouncePeer: return "announce_peer";
+        case KrpcQueryType::SampleInfohashes: return "sample_infohashes";
         default: return "ping";
     }
 }
@@ -29,7 +29,8 @@ enum class KrpcQueryType {
     Ping,
     FindNode,
     GetPeers,
-    AnnouncePeer
+    AnnouncePeer,
+    SampleInfohashes    // BEP 51
 };
 
 /**
@@ -47,12 +48,10 @@ enum class KrpcErrorCode {
  */
 struct KrpcNode {
     NodeId id;
-    std::string ip;
-    uint16_t port;
+    NetEndpoint peer;
     
-    KrpcNode() : port(0) {}
-    KrpcNode(const NodeId& node_id, const std::string& ip_addr, uint16_t port_num)
-        : id(node_id), ip(ip_addr), port(port_num) {}
+    KrpcNode() = default;
+    KrpcNode(const NodeId& node_id, const NetEndpoint& endpoint) : id(node_id), peer(endpoint) {}
 };
 
 /**
@@ -73,13 +72,18 @@ struct KrpcMessage {
     // For responses
     NodeId response_id;
     std::vector<KrpcNode> nodes;
-    std::vector<Peer> peers;
+    std::vector<NetEndpoint> peers;
+    
+    // For sample_infohashes responses (BEP 51); sent whenever interval is non-zero
+    std::vector<InfoHash> samples;
+    uint32_t num;         // Info hashes the responder stores in total
+    uint32_t interval;    // Seconds before the responder should be sampled again
     
     // For errors
     KrpcErrorCode error_code;
     std::string error_message;
     
-    KrpcMessage() : type(KrpcMessageType::Query), query_type(KrpcQueryType::Ping), port(0), error_code(KrpcErrorCode::GenericError) {}
+    KrpcMessage() : type(KrpcMessageType::Query), query_type(KrpcQueryType::Ping), port(0), num(0), interval(0), error_code(KrpcErrorCode::GenericError) {}
 };
 
 /**
@@ -97,12 +101,15 @@ public:
     static KrpcMessage create_find_node_query(const std::string& transaction_id, const NodeId& sender_id, const NodeId& target_id);
     static KrpcMessage create_get_peers_query(const std::string& transaction_id, const NodeId& sender_id, const InfoHash& info_hash);
     static KrpcMessage create_announce_peer_query(const std::string& transaction_id, const NodeId& sender_id, const InfoHash& info_hash, uint16_t port, const std::string& token);
+    static KrpcMessage create_sample_infohashes_query(const std::string& transaction_id, const NodeId& sender_id, const NodeId& target_id);
     
     static KrpcMessage create_ping_response(const std::string& transaction_id, const NodeId& response_id);
     static KrpcMessage create_find_node_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<KrpcNode>& nodes);
-    static KrpcMessage create_get_peers_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<Peer>& peers, const std::string& token);
+    static KrpcMessage create_get_peers_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<NetEndpoint>& peers, const std::string& token);
     static KrpcMessage create_get_peers_response_with_nodes(const std::string& transaction_id, const NodeId& response_id, const std::vector<KrpcNode>& nodes, const std::string& token);
     static KrpcMessage create_announce_peer_response(const std::string& transaction_id, const NodeId& response_id);
+    static KrpcMessage create_sample_infohashes_response(const std::string& transaction_id, const NodeId& response_id, const std::vector<KrpcNode>& nodes,
+                                                         const std::vector<InfoHash>& samples, uint32_t num, uint32_t interval);
     
     static KrpcMessage create_error(const std::string& transaction_id, KrpcErrorCode error_code, const std::string& error_message);
     
@@ -110,7 +117,10 @@ public:
      * Encode/decode KRPC messages
      */
     static std::vector<uint8_t> encode_message(const KrpcMessage& message);
+    // Encodes into buffer (cleared first), so a caller reusing one buffer does not allocate
+    static bool encode_message(const KrpcMessage& message, std::vector<uint8_t>& buffer);
     static std::unique_ptr<KrpcMessage> decode_message(const std::vector<uint8_t>& data);
+    static std::unique_ptr<KrpcMessage> decode_message(const uint8_t* data, size_t size);
     
     /**
      * Generate transaction ID
@@ -121,23 +131,24 @@ public:
      * Utility functions
      */
     static std::string node_id_to_string(const NodeId& id);
-    static NodeId string_to_node_id(const std::string& str);
-    static std::string compact_peer_info(const Peer& peer);
+    static NodeId string_to_node_id(std::string_view str);
+    // Compact forms are IPv4 only (BEP 5); IPv6 endpoints are written as 0.0.0.0
+    static std::string compact_peer_info(const NetEndpoint& peer);
     static std::string compact_node_info(const KrpcNode& node);
-    static std::vector<Peer> parse_compact_peer_info(const std::string& compact_info);
-    static std::vector<KrpcNode> parse_compact_node_info(const std::string& compact_info);
+    static std::vector<NetEndpoint> parse_compact_peer_info(std::string_view compact_info);
+    static std::vector<KrpcNode> parse_compact_node_info(std::string_view compact_info);
 
 private:
-    static BencodeValue encode_query(const KrpcMessage& message);
-    static BencodeValue encode_response(const KrpcMessage& message);
-    static BencodeValue encode_error(const KrpcMessage& message);
+    static void write_query(const KrpcMessage& message, BencodeWriter& writer);
+    static void write_response(const KrpcMessage& message, BencodeWriter& writer);
+    static void write_error(const KrpcMessage& message, BencodeWriter& writer);
     
-    static std::unique_ptr<KrpcMessage> decode_query(const BencodeValue& data);
-    static std::unique_ptr<KrpcMessage> decode_response(const BencodeValue& data);
-    static std::unique_ptr<KrpcMessage> decode_error(const BencodeValue& data);
+    static std::unique_ptr<KrpcMessage> decode_query(const BencodeView& data);
+    static std::unique_ptr<KrpcMessage> decode_response(const BencodeView& data);
+    static std::unique_ptr<KrpcMessage> decode_error(const BencodeView& data);
     
-    static KrpcQueryType string_to_query_type(const std::string& str);
-    static std::string query_type_to_string(KrpcQueryType type);
+    static KrpcQueryType string_to_query_type(std::string_view str);
+    static std::string_view query_type_to_string(KrpcQueryType type);
     
     static std::atomic<uint32_t> transaction_counter_;
 };
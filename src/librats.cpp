@@ -6,6 +6,8 @@
 #include "fs.h"
 #include "json.hpp" // nlohmann::json
 #include "version.h"
+#include "metrics.h"
+#include "tracing.h"
 #include <iostream>
 #include <algorithm>
 #include <chrono>
@@ -43,6 +45,70 @@ namespace librats {
 const std::string RatsClient::CONFIG_FILE_NAME = "config.json";
 const std::string RatsClient::PEERS_FILE_NAME = "peers.rats";
 const std::string RatsClient::PEERS_EVER_FILE_NAME = "peers_ever.rats";
+const std::string RatsClient::DHT_STATE_FILE_NAME = "dht_state.dat";
+const std::string RatsClient::STRATEGY_CACHE_FILE_NAME = "strategies.json";
+
+// How long queued messages may take to drain before a disconnect or stop drops them
+static const int DISCONNECT_SEND_FLUSH_TIMEOUT_MS = 1000;
+static const int STOP_SEND_FLUSH_TIMEOUT_MS = 1000;
+
+namespace {
+
+// Message counters per payload type, indexed by the MessageDataType value
+struct MessageTrafficMetrics {
+    std::array<MetricCounter*, 6> messages{};
+    std::array<MetricCounter*, 6> bytes{};
+};
+
+MessageTrafficMetrics register_traffic_metrics(const std::string& direction) {
+    static const std::pair<MessageDataType, const char*> types[] = {
+        {MessageDataType::BINARY, "binary"}, {MessageDataType::STRING, "string"},
+        {MessageDataType::JSON, "json"}, {MessageDataType::STREAM, "stream"},
+        {MessageDataType::RATS, "rats"}
+    };
+    MetricsRegistry& registry = MetricsRegistry::getInstance();
+    MessageTrafficMetrics metrics;
+    for (const auto& type : types) {
+        std::string labels = std::string("type=\"") + type.second + "\"";
+        size_t index = static_cast<size_t>(type.first);
+        metrics.messages[index] = &registry.counter("librats_messages_" + direction + "_total",
+                                                    "Peer messages " + direction + ", by payload type", labels);
+        metrics.bytes[index] = &registry.counter("librats_message_bytes_" + direction + "_total",
+                                                 "Peer message payload bytes " + direction + ", by payload type", labels);
+    }
+    return metrics;
+}
+
+void count_message_traffic(bool sent, MessageDataType type, size_t bytes) {
+    static const MessageTrafficMetrics received_metrics = register_traffic_metrics("received");
+    static const MessageTrafficMetrics sent_metrics = register_traffic_metrics("sent");
+    const MessageTrafficMetrics& metrics = sent ? sent_metrics : received_metrics;
+    size_t index = static_cast<size_t>(type);
+    if (index < metrics.messages.size() && metrics.messages[index]) {
+        metrics.messages[index]->add();
+        metrics.bytes[index]->add(bytes);
+    }
+}
+
+MetricHistogram& message_handling_histogram() {
+    static MetricHistogram& histogram = MetricsRegistry::getInstance().histogram(
+        "librats_message_handling_seconds", "Time to dispatch one received peer message to its handler");
+    return histogram;
+}
+
+MetricHistogram& socket_write_histogram() {
+    static MetricHistogram& histogram = MetricsRegistry::getInstance().histogram(
+        "librats_socket_write_seconds", "Time to write one batch of outbound messages to a peer socket");
+    return histogram;
+}
+
+MetricGauge& validated_peers_gauge() {
+    static MetricGauge& gauge = MetricsRegistry::getInstance().gauge(
+        "librats_peers_validated", "Peers with a completed handshake, over all clients in the process");
+    return gauge;
+}
+
+} // anonymous namespace
 
 // =========================================================================
 // Constructor and Destructor
@@ -59,7 +125,33 @@ RatsClient::RatsClient(int listen_port, int max_peers, const NatTraversalConfig&
       detected_nat_type_(NatType::UNKNOWN),
       data_directory_("."),
       custom_protocol_name_("rats"),
-      custom_protocol_version_("1.0") {
+      custom_protocol_version_("1.0"),
+      payload_codecs_(PayloadCodec::defaults()) {
+    peer_snapshot_ = std::make_shared<PeerTableSnapshot>();
+    next_request_id_ = 1;
+    
+    // Reactor driving all peer connections; its tick enforces handshake and request timeouts
+    reactor_ = std::make_unique<IoReactor>("client");
+    reactor_->set_tick_callback([this]() {
+        check_handshake_timeouts();
+        expire_requests();
+    }, request_deadlines_.get_resolution());
+    
+    // Writer threads draining the per-peer send queues; a failed write shuts the connection down
+    send_writer_ = std::make_unique<SendQueueWriter>("client", [this](socket_t socket, std::vector<OutboundMessage>& batch) {
+        if (!send_outbound_batch(socket, batch)) {
+            shutdown_socket(socket);
+            return false;
+        }
+        return true;
+    });
+    
+    // Handshake workers keep the DH operations of incoming handshakes off the reactor threads
+    handshake_workers_ = std::make_unique<HandshakeWorkerPool>("client");
+    
+    // Callback executor keeps application callbacks off the reactor threads
+    callback_executor_ = std::make_unique<CallbackExecutor>("client");
+    
     // Initialize STUN client
     stun_client_ = std::make_unique<StunClient>();
     
@@ -74,6 +166,7 @@ RatsClient::RatsClient(int listen_port, int max_peers, const NatTraversalConfig&
     
     // Load configuration (this will generate peer ID if needed)
     load_configuration();
+    load_strategy_cache();
     
     // Initialize modules
     initialize_modules();
@@ -104,6 +197,8 @@ void RatsClient::initialize_modules() {
         LOG_CLIENT_INFO("Initializing File Transfer Manager");
         file_transfer_manager_ = std::make_unique<FileTransferManager>(*this);
     }
+    
+    apply_resource_limits();
 }
 
 void RatsClient::destroy_modules() {
@@ -176,13 +271,46 @@ bool RatsClient::start() {
         }
     }
     
+    // Start the I/O threads that drive peer connections
+    IoShardConfig shard_config = get_io_shard_config();
+    std::vector<int> shard_cpus;
+    if (shard_config.shards > 0 && shard_config.pin_threads) {
+        shard_cpus = shard_config.cpus.empty() ? get_available_cpus() : shard_config.cpus;
+    }
+    reactor_->set_thread_count(shard_config.shards);
+    reactor_->set_thread_cpus(shard_cpus);
+    if (!reactor_->start()) {
+        LOG_CLIENT_ERROR("Failed to start connection reactor");
+        close_socket(server_socket_);
+        server_socket_ = INVALID_SOCKET_VALUE;
+        return false;
+    }
+    if (shard_config.shards > 0) {
+        send_writer_->start(shard_config.shards, true, shard_cpus);
+    } else {
+        send_writer_->start(get_send_queue_config().writer_threads);
+    }
+    HandshakeConfig handshake_config = get_handshake_config();
+    if (handshake_config.worker_threads > 0) {
+        handshake_workers_->start(handshake_config.worker_threads, handshake_config.max_pending_handshakes);
+    }
+    CallbackExecutorConfig callback_config = get_callback_executor_config();
+    if (callback_config.threads > 0) {
+        callback_executor_->start(callback_config.threads, callback_config.max_queued_per_key);
+    }
+    
     running_.store(true);
     
     // Start server thread
     server_thread_ = std::thread(&RatsClient::server_loop, this);
     
-    // Start management thread
-    management_thread_ = std::thread(&RatsClient::management_loop, this);
+    // Periodic housekeeping runs on the thread manager's scheduler
+    schedule_periodic_task(std::chrono::seconds(30), [this]() { management_tick(); }, "management");
+    
+    // Accept and open uTP connections on the UDP side of the listen port
+    if (nat_config_.transport == PeerTransport::UTP) {
+        start_utp_transport();
+    }
     
     // Start GossipSub
     if (gossipsub_ && !gossipsub_->start()) {
@@ -191,24 +319,26 @@ bool RatsClient::start() {
     
     LOG_CLIENT_INFO("RatsClient started successfully on port " << listen_port_);
     
-    // Attempt to reconnect to saved peers
-    add_managed_thread(std::thread([this]() {
-        // Give the server some time to fully initialize
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Attempt to reconnect to saved peers once the server has had some time to fully initialize
+    schedule_task(std::chrono::milliseconds(100), [this]() {
         int reconnect_attempts = load_and_reconnect_peers();
         if (reconnect_attempts > 0) {
             LOG_CLIENT_INFO("Attempted to reconnect to " << reconnect_attempts << " saved peers");
         }
         
-        // Also attempt to reconnect to historical peers if not at peer limit
+        // Also attempt to reconnect to historical peers if not at peer limit, giving current peers time to connect
         if (!is_peer_limit_reached()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Give current peers time to connect
-            int historical_attempts = load_and_reconnect_historical_peers();
-            if (historical_attempts > 0) {
-                LOG_CLIENT_INFO("Attempted to reconnect to " << historical_attempts << " historical peers");
-            }
+            schedule_task(std::chrono::milliseconds(500), [this]() {
+                if (!running_.load() || is_peer_limit_reached()) {
+                    return;
+                }
+                int historical_attempts = load_and_reconnect_historical_peers();
+                if (historical_attempts > 0) {
+                    LOG_CLIENT_INFO("Attempted to reconnect to " << historical_attempts << " historical peers");
+                }
+            }, "historical-peer-reconnection");
         }
-    }), "peer-reconnection");
+    }, "peer-reconnection");
     
     return true;
 }
@@ -224,6 +354,9 @@ void RatsClient::stop() {
     if (gossipsub_) {
         gossipsub_->stop();
     }
+    
+    // Give queued messages (including GossipSub's) a chance to reach the peers
+    flush_send_queues(std::chrono::milliseconds(STOP_SEND_FLUSH_TIMEOUT_MS));
 
 
     // Trigger immediate shutdown of all background threads
@@ -244,34 +377,56 @@ void RatsClient::stop() {
         server_socket_ = INVALID_SOCKET_VALUE;
     }
     
-    // Close all peer connections
+    // Close all peer connections (sessions are shut down first so no reactor handler stays blocked on them)
     {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
+        PeersWriteLock lock(*this);
         LOG_CLIENT_INFO("Closing " << peers_.size() << " peer connections");
         for (const auto& pair : peers_) {
             const RatsPeer& peer = pair.second;
-            close_socket(peer.socket, true);
+            if (has_client_session(peer.socket)) {
+                shutdown_socket(peer.socket);
+            } else {
+                close_socket(peer.socket, true);
+            }
         }
         peers_.clear();
         socket_to_peer_id_.clear();
         address_to_peer_id_.clear();
     }
     
-
-    
     // Wait for server thread to finish
     if (server_thread_.joinable()) {
         LOG_CLIENT_DEBUG("Waiting for server thread to finish");
         server_thread_.join();
     }
     
-    // Wait for management thread to finish
-    if (management_thread_.joinable()) {
-        LOG_CLIENT_DEBUG("Waiting for management thread to finish");
-        management_thread_.join();
+    // Close the uTP bridges while the reactor still drives them
+    stop_utp_transport();
+    
+    // Let running handshake steps finish (their sockets are shut down) before sessions are closed
+    handshake_workers_->stop();
+    
+    // Stop the reactor and close the sessions it was still driving
+    reactor_->stop();
+    {
+        std::vector<std::shared_ptr<ClientSession>> sessions;
+        for (const auto& shard : connection_shards_) {
+            std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+            for (const auto& pair : shard.sessions) {
+                sessions.push_back(pair.second);
+            }
+        }
+        for (const auto& session : sessions) {
+            close_client_session(session);
+        }
     }
+    send_writer_->stop();
+    fail_pending_requests("", "Client stopped");
+    
+    // Run the callbacks still queued (including the disconnect callbacks above)
+    callback_executor_->stop();
     
-    // Join all managed threads for graceful cleanup
+    // Join all managed threads, pool workers and the scheduler for graceful cleanup
     join_all_active_threads();
     
     cleanup_socket_library();
@@ -337,411 +492,549 @@ void RatsClient::server_loop() {
             continue;
         }
         
-        std::string normalized_peer_address = normalize_peer_address(ip, port);
-        
-        // Check if peer limit is reached
-        if (is_peer_limit_reached()) {
-            LOG_SERVER_INFO("Peer limit reached (" << max_peers_ << "), rejecting connection from " << normalized_peer_address);
+        accept_incoming_connection(client_socket, ip, port, "TCP");
+    }
+    
+    LOG_SERVER_INFO("Server loop ended");
+}
+
+bool RatsClient::accept_incoming_connection(socket_t client_socket, const std::string& ip, int port,
+                                            const std::string& transport_protocol) {
+    std::string normalized_peer_address = normalize_peer_address(ip, port);
+    
+    // Check if peer limit is reached
+    if (is_peer_limit_reached()) {
+        LOG_SERVER_INFO("Peer limit reached (" << max_peers_ << "), rejecting connection from " << normalized_peer_address);
+        close_socket(client_socket);
+        return false;
+    }
+    
+    // Check if we're already connected to this peer
+    if (is_already_connected_to_address(normalized_peer_address)) {
+        LOG_SERVER_INFO("Already connected to peer " << normalized_peer_address << ", rejecting duplicate connection");
+        close_socket(client_socket);
+        return false;
+    }
+
+    // Initialize encryption for incoming connection
+    if (is_encryption_enabled()) {
+        // Shed load while the handshake workers are backed up: queued steps would only time out
+        if (handshake_workers_->is_running() && handshake_workers_->is_saturated()) {
+            LOG_SERVER_WARN("Handshake queue full (" << handshake_workers_->get_pending_count()
+                            << " pending), rejecting connection from " << normalized_peer_address);
             close_socket(client_socket);
-            continue;
+            return false;
         }
-        
-        // Check if we're already connected to this peer
-        if (is_already_connected_to_address(normalized_peer_address)) {
-            LOG_SERVER_INFO("Already connected to peer " << normalized_peer_address << ", rejecting duplicate connection");
+        if (!encrypted_communication::initialize_incoming_connection(client_socket)) {
+            LOG_SERVER_ERROR("Failed to initialize encryption for incoming connection from " << normalized_peer_address);
             close_socket(client_socket);
-            continue;
+            return false;
         }
+    }
 
-        // Initialize encryption for incoming connection
+    // Generate unique hash ID for this incoming client
+    std::string connection_info = "incoming_from_" + normalized_peer_address;
+    std::string peer_hash_id = generate_peer_hash_id(client_socket, connection_info); // Temporary hash ID (real hash ID will be set after handshake)
+    
+    // Create RatsPeer object for incoming connection
+    {
+        PeersWriteLock lock(*this);
+        RatsPeer new_peer(peer_hash_id, ip, port, client_socket, normalized_peer_address, false); // false = incoming connection
+        new_peer.encryption_enabled = is_encryption_enabled();
+        new_peer.transport_protocol = transport_protocol;
+        add_peer_unlocked(new_peer);
+    }
+    
+    // Hand the connection over to the reactor
+    LOG_SERVER_DEBUG("Starting " << transport_protocol << " session for client " << peer_hash_id << " from " << normalized_peer_address);
+    if (!start_client_session(client_socket, peer_hash_id)) {
+        remove_peer(client_socket);
         if (is_encryption_enabled()) {
-            if (!encrypted_communication::initialize_incoming_connection(client_socket)) {
-                LOG_SERVER_ERROR("Failed to initialize encryption for incoming connection from " << normalized_peer_address);
-                close_socket(client_socket);
-                continue;
-            }
-        }
-
-        // Generate unique hash ID for this incoming client
-        std::string connection_info = "incoming_from_" + peer_address;
-        std::string peer_hash_id = generate_peer_hash_id(client_socket, connection_info); // Temporary hash ID (real hash ID will be set after handshake)
-        
-        // Create RatsPeer object for incoming connection
-        {
-            std::lock_guard<std::mutex> lock(peers_mutex_);
-            RatsPeer new_peer(peer_hash_id, ip, port, client_socket, normalized_peer_address, false); // false = incoming connection
-            new_peer.encryption_enabled = is_encryption_enabled();
-            add_peer_unlocked(new_peer);
+            encrypted_communication::cleanup_socket(client_socket);
         }
-        
-        // Start a thread to handle this client
-        LOG_SERVER_DEBUG("Starting thread for client " << peer_hash_id << " from " << peer_address);
-        add_managed_thread(std::thread(&RatsClient::handle_client, this, client_socket, peer_hash_id), 
-                          "client-handler-" + peer_hash_id.substr(0, 8));
-        
-        // Note: Connection callback will be called after handshake completion in handle_client
+        close_socket(client_socket);
+        return false;
     }
     
-    LOG_SERVER_INFO("Server loop ended");
+    // Note: Connection callback will be called after handshake completion in process_client_message
+    return true;
 }
 
-void RatsClient::management_loop() {
-    LOG_CLIENT_INFO("Management loop started");
+void RatsClient::management_tick() {
+    if (!running_.load()) {
+        return;
+    }
     
-    while (running_.load()) {
-        std::unique_lock<std::mutex> lock(shutdown_mutex_);
-        if (shutdown_cv_.wait_for(lock, std::chrono::seconds(30), [this] { return !running_.load(); })) {
-            break; // Exit if shutdown requested
-        }
-        
-        // Periodically cleanup finished threads
-        try {
-            cleanup_finished_threads();
-            LOG_CLIENT_DEBUG("Periodic thread cleanup completed. Active threads: " << get_active_thread_count());
-        } catch (const std::exception& e) {
-            LOG_CLIENT_ERROR("Exception during thread cleanup: " << e.what());
-        }
+    // Forget finished transfers past their lifetime; the other caches expire on their own threads
+    if (file_transfer_manager_) {
+        file_transfer_manager_->expire_transfer_history();
     }
     
-    LOG_CLIENT_INFO("Management loop ended");
+    // Periodically cleanup finished threads
+    try {
+        cleanup_finished_threads();
+        LOG_CLIENT_DEBUG("Periodic thread cleanup completed. Active threads: " << get_active_thread_count()
+                         << ", pending tasks: " << get_pending_task_count());
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Exception during thread cleanup: " << e.what());
+    }
 }
 
 
-void RatsClient::handle_client(socket_t client_socket, const std::string& peer_hash_id) {
+// =========================================================================
+// Client sessions (driven by reactor readiness events)
+// =========================================================================
+
+bool RatsClient::start_client_session(socket_t client_socket, const std::string& peer_hash_id) {
+    auto session = std::make_shared<ClientSession>(client_socket, peer_hash_id, is_encryption_enabled(), get_send_queue_config());
+    
+    ConnectionShard& shard = connection_shard(client_socket);
+    std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+    if (!running_.load()) {
+        return false;
+    }
+    
+    shard.sessions[client_socket] = session;
+    if (!reactor_->add_socket(client_socket, [this, session](socket_t, uint32_t events) {
+            on_client_socket_event(session, events);
+        })) {
+        LOG_CLIENT_ERROR("Failed to register socket " << client_socket << " with reactor for peer " << peer_hash_id);
+        shard.sessions.erase(client_socket);
+        return false;
+    }
+    
     LOG_CLIENT_INFO("Started handling client: " << peer_hash_id);
+    return true;
+}
+
+bool RatsClient::has_client_session(socket_t socket) const {
+    const ConnectionShard& shard = connection_shard(socket);
+    std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+    return shard.sessions.find(socket) != shard.sessions.end();
+}
+
+void RatsClient::on_client_socket_event(const std::shared_ptr<ClientSession>& session, uint32_t events) {
+    if (session->noise_step_queued.load()) {
+        return; // A handshake worker reads the socket; events resume once its step ran
+    }
     
-    bool handshake_completed = false;
-    bool noise_handshake_completed = false;
-    auto last_timeout_check = std::chrono::steady_clock::now();
+    bool keep_open = running_.load();
+    if (keep_open && session->encryption_enabled && !session->noise_handshake_completed && handshake_workers_->is_running()) {
+        keep_open = queue_noise_handshake_step(session);
+    } else if (keep_open) {
+        keep_open = process_client_readable(*session);
+    }
+    if (!keep_open) {
+        close_client_session(session);
+    }
+}
+
+bool RatsClient::queue_noise_handshake_step(const std::shared_ptr<ClientSession>& session) {
+    socket_t client_socket = session->socket;
     
-    // Check if encryption is enabled for this connection
-    bool encryption_enabled = is_encryption_enabled();
+    // Mute the socket so the reactor does not report the same message again while it waits for a worker
+    session->noise_step_queued = true;
+    reactor_->set_socket_events(client_socket, 0);
     
-    while (running_.load()) {
-        std::string data;
-        
-        // Handle encryption handshake first if enabled
-        LOG_CLIENT_DEBUG("Checking handshake state: encryption_enabled=" << encryption_enabled << ", noise_handshake_completed=" << noise_handshake_completed);
-        if (encryption_enabled && !noise_handshake_completed) {
-            LOG_CLIENT_DEBUG("Entering encryption handshake handling for socket " << client_socket);
-            // Check if noise handshake is completed
-            if (encrypted_communication::is_handshake_completed(client_socket)) {
-                noise_handshake_completed = true;
-                LOG_CLIENT_INFO("Noise handshake completed for peer " << peer_hash_id);
-                // Update peer state
-                {
-                    std::lock_guard<std::mutex> lock(peers_mutex_);
-                    auto it = socket_to_peer_id_.find(client_socket);
-                    if (it != socket_to_peer_id_.end()) {
-                        auto peer_it = peers_.find(it->second);
-                        if (peer_it != peers_.end()) {
-                            peer_it->second.noise_handshake_completed = true;
-                            // For outgoing connections, send application handshake after noise handshake completes
-                            if (peer_it->second.is_outgoing) {
-                                if (!send_handshake_unlocked(client_socket, get_our_peer_id())) {
-                                    LOG_CLIENT_ERROR("Failed to send application handshake after noise completion for peer " << peer_hash_id);
-                                    break;
-                                }
-                            }
-                        }
+    bool queued = handshake_workers_->submit([this, session]() {
+        bool keep_open = running_.load() && process_noise_handshake(*session);
+        session->noise_step_queued = false;
+        if (!keep_open) {
+            close_client_session(session);
+            return;
+        }
+        // A timeout or stop may have closed the session meanwhile and its descriptor been reused;
+        // the socket is only closed after the session is marked under this lock
+        ConnectionShard& shard = connection_shard(session->socket);
+        std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+        if (!session->closed) {
+            reactor_->set_socket_events(session->socket, IO_EVENT_READ);
+        }
+    });
+    if (!queued) {
+        session->noise_step_queued = false;
+        LOG_CLIENT_WARN("Handshake queue full, dropping connection of peer " << session->peer_hash_id);
+        return false;
+    }
+    return true;
+}
+
+bool RatsClient::process_noise_handshake(ClientSession& session) {
+    TRACE_SPAN("handshake", "noise_handshake_step");
+    socket_t client_socket = session.socket;
+    const std::string& peer_hash_id = session.peer_hash_id;
+    
+    LOG_CLIENT_DEBUG("Processing handshake for socket " << client_socket);
+    if (!encrypted_communication::perform_handshake(client_socket)) {
+        LOG_CLIENT_ERROR("Encryption handshake failed for peer " << peer_hash_id);
+        return false;
+    }
+    
+    if (encrypted_communication::is_handshake_completed(client_socket)) {
+        session.noise_handshake_completed = true;
+        LOG_CLIENT_INFO("Noise handshake completed for peer " << peer_hash_id);
+        // Update peer state
+        PeersWriteLock lock(*this);
+        auto it = socket_to_peer_id_.find(client_socket);
+        if (it != socket_to_peer_id_.end()) {
+            auto peer_it = peers_.find(it->second);
+            if (peer_it != peers_.end()) {
+                peer_it->second.noise_handshake_completed = true;
+                // For outgoing connections, send application handshake after noise handshake completes
+                if (peer_it->second.is_outgoing) {
+                    if (!send_handshake_unlocked(client_socket, get_our_peer_id())) {
+                        LOG_CLIENT_ERROR("Failed to send application handshake after noise completion for peer " << peer_hash_id);
+                        return false;
                     }
                 }
-            } else {
-                // For responders and ongoing handshake processing, try to continue the handshake
-                LOG_CLIENT_DEBUG("Attempting to process handshake for socket " << client_socket);
-                if (!encrypted_communication::perform_handshake(client_socket)) {
-                    LOG_CLIENT_ERROR("Encryption handshake failed for peer " << peer_hash_id);
-                    break;
-                }
-                // Continue to check if handshake completed
-                continue;
             }
         }
-        
-        // Receive data (encrypted or unencrypted based on settings)
-        LOG_CLIENT_DEBUG("Receiving data: encryption_enabled=" << encryption_enabled << ", noise_handshake_completed=" << noise_handshake_completed);
-        if (encryption_enabled && noise_handshake_completed) {
-            LOG_CLIENT_DEBUG("Receiving encrypted data from socket " << client_socket);
-            auto binary_data = encrypted_communication::receive_tcp_data_encrypted(client_socket);
-            data = std::string(binary_data.begin(), binary_data.end());
-        } else if (encryption_enabled && !noise_handshake_completed) {
-            LOG_CLIENT_DEBUG("Processing handshake for socket " << client_socket);
-            // During handshake, let the encrypted socket handle data reception and processing
-            // The perform_handshake function will internally call receive_tcp_data and process handshake messages
-            if (!encrypted_communication::perform_handshake(client_socket)) {
-                LOG_CLIENT_ERROR("Encryption handshake failed for peer " << peer_hash_id);
-                break;
-            }
-            // Continue to check if handshake completed
-            continue;
-        } else {
-            LOG_CLIENT_DEBUG("Receiving unencrypted data from socket " << client_socket);
-            // Always use framed message reception for reliable large message handling
-            data = receive_tcp_string_framed(client_socket);
+    }
+    return true;
+}
+
+bool RatsClient::process_client_readable(ClientSession& session) {
+    socket_t client_socket = session.socket;
+    
+    if (session.encryption_enabled) {
+        // Handle encryption handshake first
+        if (!session.noise_handshake_completed) {
+            return process_noise_handshake(session);
         }
         
-        if (data.empty()) {
-            // Check if this is a timeout or actual connection close
-            if (!handshake_completed) {
-                // Check for handshake timeout one more time before giving up
-                auto now = std::chrono::steady_clock::now();
-                if (now - last_timeout_check >= std::chrono::seconds(1)) {
-                    check_handshake_timeouts();
-                    last_timeout_check = now;
-                    
-                    // Check if handshake has failed due to timeout
-                    std::lock_guard<std::mutex> lock(peers_mutex_);
-                    auto it = socket_to_peer_id_.find(client_socket);
-                    if (it != socket_to_peer_id_.end()) {
-                        auto peer_it = peers_.find(it->second);
-                        if (peer_it != peers_.end() && peer_it->second.is_handshake_failed()) {
-                            LOG_CLIENT_ERROR("Handshake failed for peer " << peer_hash_id);
-                            break;
-                        }
-                    }
-                }
+        LOG_CLIENT_DEBUG("Receiving encrypted data from socket " << client_socket);
+        std::vector<std::vector<uint8_t>> messages;
+        bool connection_open;
+        {
+            TRACE_SPAN("message", "receive_decrypt");
+            connection_open = encrypted_communication::receive_tcp_messages_encrypted(client_socket, messages);
+        }
+        for (auto& message : messages) {
+            // Decrypted in place, so the plaintext buffer is handed on without another copy
+            if (!process_client_message(session, SharedBuffer(std::move(message)))) {
+                return false;
             }
-            break; // Connection closed or error
+        }
+        return connection_open; // false: connection closed or a frame failed to authenticate
+    }
+    
+    // Always use framed message reception for reliable large message handling.
+    // Frames land in pooled storage that is shared by header parsing and user delivery;
+    // the list itself is reused by this I/O thread across reads.
+    thread_local std::vector<SharedBuffer> messages;
+    messages.clear();
+    bool connection_open;
+    {
+        TRACE_SPAN("message", "receive");
+        connection_open = receive_tcp_messages_framed(client_socket, session.receive_buffer, messages);
+    }
+    bool processed = true;
+    for (const auto& message : messages) {
+        if (!process_client_message(session, message)) {
+            processed = false;
+            break;
+        }
+    }
+    // Drop the views so the frames go back to the pool now rather than on the next read
+    messages.clear();
+    return processed && connection_open;
+}
+
+bool RatsClient::process_client_message(ClientSession& session, const SharedBuffer& message) {
+    TRACE_SPAN("message", "process_client_message");
+    socket_t client_socket = session.socket;
+    const std::string& peer_hash_id = session.peer_hash_id;
+    
+    LOG_CLIENT_DEBUG("Received " << message.size() << " bytes from " << peer_hash_id);
+    
+    // Check for handshake failure (timeouts are checked by the reactor tick)
+    if (!session.handshake_completed) {
+        auto peer = get_peer_snapshot()->find(client_socket);
+        if (peer && peer->is_handshake_failed()) {
+            LOG_CLIENT_ERROR("Handshake failed for peer " << peer_hash_id);
+            return false;
+        }
+    }
+    
+    // Parse the message header once; payload views share the receive buffer
+    MessageHeader header;
+    SharedBuffer payload;
+    bool has_header = parse_message_with_header(message, header, payload);
+    
+    // Handle handshake messages (always string/JSON typed; other payloads are never copied here)
+    bool is_handshake = has_header &&
+                        (header.type == MessageDataType::STRING || header.type == MessageDataType::JSON) &&
+                        is_handshake_message(payload);
+    if (is_handshake) {
+        if (!handle_handshake_message(client_socket, peer_hash_id, payload)) {
+            LOG_CLIENT_ERROR("Failed to handle handshake message from " << peer_hash_id);
+            return false;
         }
         
-        LOG_CLIENT_DEBUG("Received data from " << peer_hash_id << ": " << data.substr(0, 50) << (data.length() > 50 ? "..." : ""));
-        
-        // Check for handshake timeout and failure
-        if (!handshake_completed) {
-            bool should_exit = false;
+        // Check if handshake just completed and trigger notifications
+        if (!session.handshake_completed) {
+            RatsPeer peer_copy;
+            bool should_notify_connection = false;
             
             {
-                std::lock_guard<std::mutex> lock(peers_mutex_);
-                auto it = socket_to_peer_id_.find(client_socket);
-                if (it != socket_to_peer_id_.end()) {
-                    auto peer_it = peers_.find(it->second);
-                    if (peer_it != peers_.end()) {
-                        const RatsPeer& peer = peer_it->second;
-                        if (peer.is_handshake_failed()) {
-                            LOG_CLIENT_ERROR("Handshake failed for peer " << peer_hash_id);
-                            should_exit = true;
-                        }
-                    }
+                auto peer = get_peer_snapshot()->find(client_socket);
+                if (peer && peer->is_handshake_completed()) {
+                    session.handshake_completed = true;
+                    session.peer_id = peer->peer_id;
+                    should_notify_connection = true;
+                    peer_copy = *peer; // Copy peer data
+                    
+                    LOG_CLIENT_INFO("Handshake completed for peer " << peer_hash_id << " (peer_id: " << peer->peer_id << ")");
                 }
             }
             
-            if (should_exit) {
-                break; // Exit loop to disconnect
-            }
-            
-            // Check for handshake timeout
-            auto now = std::chrono::steady_clock::now();
-            if (now - last_timeout_check >= std::chrono::seconds(1)) {
-                check_handshake_timeouts();
-                last_timeout_check = now;
-            }
-        }
-        
-        // Handle handshake messages
-        if (is_handshake_message(data)) {
-            if (!handle_handshake_message(client_socket, peer_hash_id, data)) {
-                LOG_CLIENT_ERROR("Failed to handle handshake message from " << peer_hash_id);
-                break; // Exit loop to disconnect
-            }
-            
-            // Check if handshake just completed and trigger notifications
-            if (!handshake_completed) {
-                RatsPeer peer_copy;
-                bool should_notify_connection = false;
-                bool should_broadcast_exchange = false;
+            // Call callbacks and methods outside of mutex to avoid deadlock
+            if (should_notify_connection) {
+                if (connection_callback_) {
+                    run_callback(peer_copy.peer_id, [this, client_socket, peer_id = peer_copy.peer_id]() {
+                        connection_callback_(client_socket, peer_id);
+                    });
+                }
+
+                if (gossipsub_) {
+                    gossipsub_->handle_peer_connected(peer_copy.peer_id, peer_copy.ip);
+                }
                 
-                {
-                    std::lock_guard<std::mutex> lock(peers_mutex_);
-                    auto it = socket_to_peer_id_.find(client_socket);
-                    if (it != socket_to_peer_id_.end()) {
-                        auto peer_it = peers_.find(it->second);
-                        if (peer_it != peers_.end()) {
-                            const RatsPeer& peer = peer_it->second;
-                            if (peer.is_handshake_completed()) {
-                                handshake_completed = true;
-                                should_notify_connection = true;
-                                should_broadcast_exchange = true;
-                                peer_copy = peer; // Copy peer data
-                                
-                                LOG_CLIENT_INFO("Handshake completed for peer " << peer_hash_id << " (peer_id: " << peer.peer_id << ")");
-                            }
-                        }
-                    }
+                // Broadcast peer exchange message to other peers
+                broadcast_peer_exchange_message(peer_copy);
+                
+                // Send peers request to the newly connected peer to discover more peers
+                if (peer_copy.is_outgoing) {
+                    send_peers_request(client_socket, peer_copy.peer_id);
                 }
                 
-                // Call callbacks and methods outside of mutex to avoid deadlock
-                if (should_notify_connection) {
-                    if (connection_callback_) {
-                        connection_callback_(client_socket, peer_copy.peer_id);
-                    }
-
-                    if (gossipsub_) {
-                        gossipsub_->handle_peer_connected(peer_copy.peer_id);
-                    }
-                    
-                    // Broadcast peer exchange message to other peers
-                    broadcast_peer_exchange_message(peer_copy);
-                    
-                    // Send peers request to the newly connected peer to discover more peers
-                    if (peer_copy.is_outgoing) {
-                        send_peers_request(client_socket, peer_copy.peer_id);
-                    }
-                    
-                    // Initiate NAT traversal information exchange
-                    send_nat_info_to_peer(client_socket, peer_copy.peer_id);
-                    
-                    // If ICE is enabled and this is an outgoing connection, initiate ICE coordination
-                    if (ice_agent_ && ice_agent_->is_running() && peer_copy.is_outgoing) {
-                        if (should_initiate_ice_coordination(peer_copy.peer_id)) {
-                            mark_ice_coordination_in_progress(peer_copy.peer_id);
-                            
-                            // Start ICE coordination in background thread with proper exception handling
-                            add_managed_thread(std::thread([this, peer_id = peer_copy.peer_id, host = peer_copy.ip, port = peer_copy.port]() {
-                                try {
-                                    // Use conditional variable for responsive shutdown
-                                    {
-                                        std::unique_lock<std::mutex> lock(shutdown_mutex_);
-                                        if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(500), [this] { return !running_.load(); })) {
-                                            // Clean up tracking before exit
-                                            cleanup_ice_coordination_for_peer(peer_id);
-                                            return; // Exit if shutdown requested
-                                        }
-                                    }
-                                    
-                                    // Initiate ICE coordination
+                // Initiate NAT traversal information exchange
+                send_nat_info_to_peer(client_socket, peer_copy.peer_id);
+                
+                // If ICE is enabled and this is an outgoing connection, initiate ICE coordination
+                if (ice_agent_ && ice_agent_->is_running() && peer_copy.is_outgoing) {
+                    if (should_initiate_ice_coordination(peer_copy.peer_id)) {
+                        mark_ice_coordination_in_progress(peer_copy.peer_id);
+                        
+                        // Start ICE coordination on the task pool once the peer has settled
+                        std::string peer_id = peer_copy.peer_id;
+                        uint64_t task_id = schedule_task(std::chrono::milliseconds(500), [this, peer_id, host = peer_copy.ip, port = peer_copy.port]() {
+                            try {
+                                if (running_.load()) {
                                     initiate_ice_with_peer(peer_id, host, port);
-                                    
-                                } catch (const std::exception& e) {
-                                    LOG_CLIENT_ERROR("Exception in ICE coordination thread for peer " << peer_id << ": " << e.what());
-                                } catch (...) {
-                                    LOG_CLIENT_ERROR("Unknown exception in ICE coordination thread for peer " << peer_id);
                                 }
-                                
-                                // Clean up tracking when done
-                                cleanup_ice_coordination_for_peer(peer_id);
-                            }), "ice-coordination-" + peer_copy.peer_id.substr(0, 8));
-                        } else {
-                            LOG_CLIENT_DEBUG("ICE coordination already in progress for peer " << peer_copy.peer_id << " - skipping duplicate attempt");
-                        }
-                    }
-                    
-                    // Save configuration after a new peer connects to keep peer list current
-                    if (running_.load()) {
-                        add_managed_thread(std::thread([this]() {
-                            if (running_.load()) {
-                                save_configuration();
+                            } catch (const std::exception& e) {
+                                LOG_CLIENT_ERROR("Exception in ICE coordination task for peer " << peer_id << ": " << e.what());
+                            } catch (...) {
+                                LOG_CLIENT_ERROR("Unknown exception in ICE coordination task for peer " << peer_id);
                             }
-                        }), "config-save");
+                            
+                            // Clean up tracking when done
+                            cleanup_ice_coordination_for_peer(peer_id);
+                        }, "ice-coordination-" + peer_copy.peer_id.substr(0, 8));
+                        if (task_id == 0) {
+                            cleanup_ice_coordination_for_peer(peer_id);
+                        }
+                    } else {
+                        LOG_CLIENT_DEBUG("ICE coordination already in progress for peer " << peer_copy.peer_id << " - skipping duplicate attempt");
                     }
                 }
+                
+                // Save configuration after a new peer connects to keep peer list current
+                if (running_.load()) {
+                    submit_task([this]() {
+                        if (running_.load()) {
+                            save_configuration();
+                        }
+                    }, "config-save");
+                }
             }
-            
-            continue; // Don't process handshake messages as regular data
         }
         
-        // Only process regular data after handshake is completed (and noise handshake if encryption is enabled)
-        if (handshake_completed && (!encryption_enabled || noise_handshake_completed)) {
-            // Convert string data to binary for header parsing
-            std::vector<uint8_t> received_data(data.begin(), data.end());
+        return true; // Don't process handshake messages as regular data
+    }
+    
+    // Only process regular data after handshake is completed (and noise handshake if encryption is enabled)
+    if (!session.handshake_completed || (session.encryption_enabled && !session.noise_handshake_completed)) {
+        LOG_CLIENT_WARN("Received non-handshake data from " << peer_hash_id << " before handshake completion - ignoring");
+        return true;
+    }
+    
+    if (!has_header) {
+        // No header found
+        LOG_CLIENT_WARN("No header found in message from " << peer_hash_id);
+        return true;
+    }
+    
+    count_message_traffic(false, header.type, payload.size());
+    ScopedMetricTimer handling_timer(message_handling_histogram());
+    
+    // Message has valid header - call appropriate callback based on type
+    std::string peer_id = get_peer_id(client_socket);
+    
+    switch (header.type) {
+        case MessageDataType::BINARY: {
+            LOG_CLIENT_DEBUG("Received BINARY message from " << peer_id << " (payload size: " << payload.size() << ")");
+            // Try to handle as file transfer data first
+            bool handled = false;
+            if (file_transfer_manager_) {
+                handled = file_transfer_manager_->handle_binary_data(peer_id, payload);
+            }
             
-            // Try to parse message header first
-            MessageHeader header;
-            std::vector<uint8_t> payload;
-            if (parse_message_with_header(received_data, header, payload)) {
-                // Message has valid header - call appropriate callback based on type
-                std::string peer_id = get_peer_id(client_socket);
-                
-                switch (header.type) {
-                    case MessageDataType::BINARY: {
-                        LOG_CLIENT_DEBUG("Received BINARY message from " << peer_id << " (payload size: " << payload.size() << ")");
-                        // Try to handle as file transfer data first
-                        bool handled = false;
-                        if (file_transfer_manager_) {
-                            handled = file_transfer_manager_->handle_binary_data(peer_id, payload);
-                        }
-                        
-                        // If not a file transfer chunk, call user's binary callback
-                        if (!handled && binary_data_callback_) {
-                            binary_data_callback_(client_socket, peer_id, payload);
-                        }
-                        break;
-                    }
-                        
-                    case MessageDataType::STRING:
-                        LOG_CLIENT_DEBUG("Received STRING message from " << peer_id << " (payload size: " << payload.size() << ")");
-                        if (string_data_callback_) {
-                            std::string string_data(payload.begin(), payload.end());
-                            string_data_callback_(client_socket, peer_id, string_data);
-                        }
-                        break;
-                        
-                    case MessageDataType::JSON: {
-                        LOG_CLIENT_DEBUG("Received JSON message from " << peer_id << " (payload size: " << payload.size() << ")");
-                        // Parse JSON payload
-                        std::string json_string(payload.begin(), payload.end());
-                        nlohmann::json json_msg;
-                        if (parse_json_message(json_string, json_msg)) {
-                            // Check if it's a rats protocol message
-                            if (json_msg.contains("rats_protocol") && json_msg["rats_protocol"] == true) {
-                                handle_rats_message(client_socket, peer_id, json_msg);
-                            } else {
-                                // Regular JSON data - call JSON callback
-                                if (json_data_callback_) {
-                                    json_data_callback_(client_socket, peer_id, json_msg);
-                                }
-                            }
-                        } else {
-                            LOG_CLIENT_ERROR("Received invalid JSON in JSON message from " << peer_id);
-                        }
-                        break;
+            // Then as a binary gossipsub frame
+            if (!handled && gossipsub_) {
+                handled = gossipsub_->handle_binary_data(peer_id, payload.data(), payload.size());
+            }
+            
+            // If not a file transfer chunk or gossipsub frame, call user's binary callback (the view callback avoids a copy)
+            if (!handled) {
+                if (binary_data_view_callback_) {
+                    run_callback(peer_id, [this, client_socket, peer_id, payload]() {
+                        binary_data_view_callback_(client_socket, peer_id, payload);
+                    });
+                } else if (binary_data_callback_) {
+                    run_callback(peer_id, [this, client_socket, peer_id, payload]() {
+                        binary_data_callback_(client_socket, peer_id, payload.to_vector());
+                    });
+                }
+            }
+            break;
+        }
+            
+        case MessageDataType::STRING:
+            LOG_CLIENT_DEBUG("Received STRING message from " << peer_id << " (payload size: " << payload.size() << ")");
+            if (string_data_callback_) {
+                run_callback(peer_id, [this, client_socket, peer_id, payload]() {
+                    string_data_callback_(client_socket, peer_id, payload.to_string());
+                });
+            }
+            break;
+            
+        case MessageDataType::JSON: {
+            LOG_CLIENT_DEBUG("Received JSON message from " << peer_id << " (payload size: " << payload.size() << ")");
+            // Parse JSON payload
+            std::string json_string = payload.to_string();
+            nlohmann::json json_msg;
+            if (parse_json_message(json_string, json_msg)) {
+                // Check if it's a rats protocol message
+                if (json_msg.contains("rats_protocol") && json_msg["rats_protocol"] == true) {
+                    handle_rats_message(client_socket, peer_id, json_msg);
+                } else {
+                    // Regular JSON data - call JSON callback
+                    if (json_data_callback_) {
+                        run_callback(peer_id, [this, client_socket, peer_id, json_msg = std::move(json_msg)]() {
+                            json_data_callback_(client_socket, peer_id, json_msg);
+                        });
                     }
-                        
-                    default:
-                        LOG_CLIENT_WARN("Received message with unknown data type " << static_cast<int>(header.type) << " from " << peer_id);
-                        break;
                 }
             } else {
-                // No header found
-                LOG_CLIENT_WARN("No header found in message from " << peer_hash_id);
+                LOG_CLIENT_ERROR("Received invalid JSON in JSON message from " << peer_id);
             }
-        } else {
-            LOG_CLIENT_WARN("Received non-handshake data from " << peer_hash_id << " before handshake completion - ignoring");
+            break;
+        }
+            
+        case MessageDataType::RATS: {
+            // Dispatch by the interned type id; the JSON body is parsed only if a handler needs it
+            RatsEnvelope envelope;
+            if (!decode_rats_envelope(payload, envelope)) {
+                LOG_CLIENT_WARN("Dropped malformed rats envelope from " << peer_id << " (payload size: " << payload.size() << ")");
+                break;
+            }
+            std::shared_ptr<const PayloadCodec> codec;
+            if (envelope.encoding != payload_encoding::RAW) {
+                codec = get_receive_codec(envelope.encoding);
+                if (!codec) {
+                    LOG_CLIENT_WARN("Dropped rats message '" << envelope.type() << "' from " << peer_id
+                                    << " with unknown payload encoding " << static_cast<int>(envelope.encoding));
+                    break;
+                }
+            }
+            RatsMessagePayload message_payload(envelope.body, std::move(codec));
+            dispatch_rats_message(client_socket, peer_id, envelope.type_id, envelope.type(), envelope.sender_peer_id, message_payload);
+            break;
+        }
+            
+        case MessageDataType::STREAM: {
+            auto muxer = get_stream_muxer(peer_id, true);
+            if (!muxer || !muxer->handle_frame(payload.data(), payload.size())) {
+                LOG_CLIENT_WARN("Dropped stream frame from " << peer_id << " (payload size: " << payload.size() << ")");
+            }
+            break;
+        }
+            
+        default:
+            LOG_CLIENT_WARN("Received message with unknown data type " << static_cast<int>(header.type) << " from " << peer_id);
+            break;
+    }
+    
+    return true;
+}
+
+void RatsClient::close_client_session(const std::shared_ptr<ClientSession>& session) {
+    socket_t client_socket = session->socket;
+    
+    // Unregister first so the socket is closed exactly once
+    {
+        ConnectionShard& shard = connection_shard(client_socket);
+        std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+        auto it = shard.sessions.find(client_socket);
+        if (it == shard.sessions.end() || it->second != session) {
+            return; // Already closed
         }
+        session->closed = true;
+        shard.sessions.erase(it);
     }
+    reactor_->remove_socket(client_socket);
+    
+    // Discard pending sends; the shutdown unblocks a writer stuck on the socket before it is closed
+    shutdown_socket(client_socket);
+    session->send_queue->close();
     
     // Get current peer ID before cleanup for disconnect callback
     std::string current_peer_id = get_peer_id(client_socket);
+    if (current_peer_id.empty()) {
+        current_peer_id = session->peer_id; // Peer was already removed (disconnect_peer / handshake timeout)
+    }
     
-    // Clean up
+    // Clean up; a writer that raced remove_peer may have recreated the socket's send mutex
     remove_peer(client_socket);
+    cleanup_socket_send_mutex(client_socket);
     
     // Clean up encryption state
-    if (encryption_enabled) {
+    if (session->encryption_enabled) {
         encrypted_communication::cleanup_socket(client_socket);
     }
     
     close_socket(client_socket);
     
     // Notify disconnect callback only if handshake was completed
-    if (handshake_completed && disconnect_callback_) {
-        disconnect_callback_(client_socket, current_peer_id);
+    if (session->handshake_completed && disconnect_callback_) {
+        run_callback(current_peer_id, [this, client_socket, current_peer_id]() {
+            disconnect_callback_(client_socket, current_peer_id);
+        });
     }
 
-    if (handshake_completed && gossipsub_) {
+    if (session->handshake_completed && gossipsub_) {
         gossipsub_->handle_peer_disconnected(current_peer_id);
     }
     
+    // Fail blocked stream writers and report the streams as closed
+    if (!current_peer_id.empty()) {
+        close_peer_streams(current_peer_id);
+        fail_pending_requests(current_peer_id, "Peer disconnected: " + current_peer_id);
+    }
+    
     // Save configuration after a validated peer disconnects to update the saved peer list
-    if (handshake_completed && running_.load()) {
-        // Save configuration in a separate thread to avoid blocking
-        add_managed_thread(std::thread([this]() {
+    if (session->handshake_completed && running_.load()) {
+        // Save configuration on the task pool to avoid blocking
+        submit_task([this]() {
             if (running_.load()) {
                 save_configuration();
             }
-        }), "config-save-disconnect");
+        }, "config-save-disconnect");
     }
     
-    LOG_CLIENT_INFO("Client disconnected: " << peer_hash_id);
+    LOG_CLIENT_INFO("Client disconnected: " << session->peer_hash_id);
 }
 
 // Handshake protocol implementation
@@ -759,6 +1052,15 @@ std::string RatsClient::create_handshake_message(const std::string& message_type
     handshake_msg["peer_id"] = our_peer_id;
     handshake_msg["message_type"] = message_type;
     handshake_msg["timestamp"] = timestamp;
+    handshake_msg["features"] = nlohmann::json::array({"typed_messages"});
+    nlohmann::json codecs = nlohmann::json::array();
+    {
+        std::lock_guard<std::mutex> lock(protocol_config_mutex_);
+        for (const auto& codec : payload_codecs_) {
+            codecs.push_back(codec->name());
+        }
+    }
+    handshake_msg["codecs"] = codecs;
     
     return handshake_msg.dump();
 }
@@ -778,6 +1080,24 @@ bool RatsClient::parse_handshake_message(const std::string& message, HandshakeMe
         out_msg.message_type = json_msg.value("message_type", "");
         // Tolerate missing timestamp to avoid hard dependency on remote system clock
         out_msg.timestamp = json_msg.value("timestamp", static_cast<int64_t>(0));
+        // Peers without the field only understand JSON rats messages
+        out_msg.typed_messages = false;
+        auto features = json_msg.find("features");
+        if (features != json_msg.end() && features->is_array()) {
+            for (const auto& feature : *features) {
+                if (feature.is_string() && feature.get<std::string>() == "typed_messages") {
+                    out_msg.typed_messages = true;
+                }
+            }
+        }
+        auto codecs = json_msg.find("codecs");
+        if (codecs != json_msg.end() && codecs->is_array()) {
+            for (const auto& codec : *codecs) {
+                if (codec.is_string()) {
+                    out_msg.codecs.push_back(codec.get<std::string>());
+                }
+            }
+        }
         
         return true;
         
@@ -839,30 +1159,18 @@ bool RatsClient::validate_handshake_message(const HandshakeMessage& msg) const {
     return true;
 }
 
-bool RatsClient::is_handshake_message(const std::string& message) const {
+bool RatsClient::is_handshake_message(const SharedBuffer& payload) const {
+    // Cheap scan first: most string/JSON traffic is not a handshake and is never parsed here
+    static const char marker[] = "\"handshake\"";
+    const size_t marker_size = sizeof(marker) - 1;
+    const char* text = reinterpret_cast<const char*>(payload.data());
+    if (payload.size() < marker_size ||
+        std::search(text, text + payload.size(), marker, marker + marker_size) == text + payload.size()) {
+        return false;
+    }
+
     try {
-        std::string json_to_parse = message;
-        
-        // Check if message has our message header (starts with "RATS" magic)
-        std::vector<uint8_t> message_data(message.begin(), message.end());
-        MessageHeader header;
-        std::vector<uint8_t> payload;
-        
-        if (parse_message_with_header(message_data, header, payload)) {
-            // Message has valid header - extract the JSON payload
-            if (header.type == MessageDataType::STRING || header.type == MessageDataType::JSON) {
-                json_to_parse = std::string(payload.begin(), payload.end());
-            } else {
-                // Handshake messages should be string/JSON type
-                return false;
-            }
-        } else {
-            // Message has no header
-            return false;
-        }
-        
-        // Parse the JSON message
-        nlohmann::json json_msg = nlohmann::json::parse(json_to_parse);
+        nlohmann::json json_msg = nlohmann::json::parse(payload.begin(), payload.end());
         std::string expected_protocol;
         {
             std::lock_guard<std::mutex> lock(protocol_config_mutex_);
@@ -880,7 +1188,8 @@ bool RatsClient::send_handshake_unlocked(socket_t socket, const std::string& our
     std::string handshake_msg = create_handshake_message("handshake", our_peer_id);
     LOG_CLIENT_DEBUG("Sending handshake to socket " << socket << ": " << handshake_msg);
     
-    if (!send_string_to_peer(socket, handshake_msg)) {
+    std::vector<uint8_t> handshake_data(handshake_msg.begin(), handshake_msg.end());
+    if (!send_binary_to_peer(socket, handshake_data, MessageDataType::STRING, SendPriority::CONTROL)) {
         LOG_CLIENT_ERROR("Failed to send handshake to socket " << socket);
         return false;
     }
@@ -899,29 +1208,13 @@ bool RatsClient::send_handshake_unlocked(socket_t socket, const std::string& our
 }
 
 bool RatsClient::send_handshake(socket_t socket, const std::string& our_peer_id) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     return send_handshake_unlocked(socket, our_peer_id);
 }
 
-bool RatsClient::handle_handshake_message(socket_t socket, const std::string& peer_hash_id, const std::string& message) {
-    // Extract JSON payload from message header if present
-    std::string json_to_parse = message;
-    std::vector<uint8_t> message_data(message.begin(), message.end());
-    MessageHeader header;
-    std::vector<uint8_t> payload;
-    
-    if (parse_message_with_header(message_data, header, payload)) {
-        // Message has valid header - extract the JSON payload
-        if (header.type == MessageDataType::STRING || header.type == MessageDataType::JSON) {
-            json_to_parse = std::string(payload.begin(), payload.end());
-        } else {
-            LOG_CLIENT_ERROR("Invalid message type for handshake: " << static_cast<int>(header.type));
-            return false;
-        }
-    } else {
-        LOG_CLIENT_ERROR("Failed to parse handshake message header from " << peer_hash_id);
-        return false;
-    }
+bool RatsClient::handle_handshake_message(socket_t socket, const std::string& peer_hash_id, const SharedBuffer& payload) {
+    TRACE_SPAN("handshake", "handle_handshake_message");
+    std::string json_to_parse = payload.to_string();
     
     HandshakeMessage handshake_msg;
     if (!parse_handshake_message(json_to_parse, handshake_msg)) {
@@ -942,7 +1235,7 @@ bool RatsClient::handle_handshake_message(socket_t socket, const std::string& pe
     LOG_CLIENT_INFO("Received valid handshake from " << peer_hash_id 
                     << " (peer_id: " << handshake_msg.peer_id << ")");
     
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     auto it = socket_to_peer_id_.find(socket);
     if (it == socket_to_peer_id_.end()) {
         LOG_CLIENT_ERROR("Socket " << socket << " not found in peer mapping");
@@ -989,6 +1282,8 @@ bool RatsClient::handle_handshake_message(socket_t socket, const std::string& pe
 
     // Store remote peer information
     peer.version = handshake_msg.version;
+    peer.typed_messages = handshake_msg.typed_messages;
+    negotiate_payload_codec(peer, handshake_msg.codecs);
     
     // Simplified handshake logic - just one message type
     if (peer.handshake_state == RatsPeer::HandshakeState::PENDING) {
@@ -1021,10 +1316,55 @@ bool RatsClient::handle_handshake_message(socket_t socket, const std::string& pe
     }
 }
 
+void RatsClient::negotiate_payload_codec(RatsPeer& peer, const std::vector<std::string>& remote_codecs) const {
+    peer.send_codec = PayloadCodec::json();
+    peer.send_codec_id = payload_encoding::JSON;
+    
+    std::lock_guard<std::mutex> lock(protocol_config_mutex_);
+    for (const auto& codec : payload_codecs_) {
+        auto remote = std::find(remote_codecs.begin(), remote_codecs.end(), codec->name());
+        if (remote == remote_codecs.end()) {
+            continue;
+        }
+        // Built-in codecs have fixed ids; custom ones are named by their index in the peer's list
+        size_t index = static_cast<size_t>(remote - remote_codecs.begin());
+        int id = codec->builtin_id();
+        if (id < 0 && index >= 0x100u - payload_encoding::CUSTOM_BASE) {
+            continue;
+        }
+        peer.send_codec = codec;
+        peer.send_codec_id = id >= 0 ? static_cast<uint8_t>(id) : static_cast<uint8_t>(payload_encoding::CUSTOM_BASE + index);
+        break;
+    }
+    LOG_CLIENT_DEBUG("Sending " << peer.send_codec->name() << " payloads to peer " << peer.peer_id);
+}
+
+std::shared_ptr<const PayloadCodec> RatsClient::get_receive_codec(uint8_t encoding) const {
+    if (encoding < payload_encoding::CUSTOM_BASE) {
+        return PayloadCodec::builtin(encoding);
+    }
+    // Custom ids index the codec list we advertised
+    std::lock_guard<std::mutex> lock(protocol_config_mutex_);
+    size_t index = encoding - payload_encoding::CUSTOM_BASE;
+    return index < payload_codecs_.size() ? payload_codecs_[index] : nullptr;
+}
+
 void RatsClient::check_handshake_timeouts() {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
     auto now = std::chrono::steady_clock::now();
     
+    // Runs every reactor tick: only take the write lock when some handshake is overdue
+    auto snapshot = get_peer_snapshot();
+    bool any_overdue = std::any_of(snapshot->peers.begin(), snapshot->peers.end(), [&](const std::shared_ptr<const RatsPeer>& peer) {
+        return peer->handshake_state != RatsPeer::HandshakeState::COMPLETED &&
+               peer->handshake_state != RatsPeer::HandshakeState::FAILED &&
+               std::chrono::duration_cast<std::chrono::seconds>(now - peer->handshake_start_time).count() > HANDSHAKE_TIMEOUT_SECONDS;
+    });
+    if (!any_overdue) {
+        return;
+    }
+    
+    PeersWriteLock lock(*this);
+    
     std::vector<std::string> peers_to_remove;
     
     for (auto& pair : peers_) {
@@ -1050,9 +1390,13 @@ void RatsClient::check_handshake_timeouts() {
             socket_t socket = peer_it->second.socket;
             LOG_CLIENT_INFO("Disconnecting peer " << peer_id << " due to handshake timeout");
             
-            // Clean up peer data
+            // Clean up peer data; the session closes the socket once the reactor sees the shutdown
             remove_peer_by_id_unlocked(peer_id);
-            close_socket(socket);
+            if (has_client_session(socket)) {
+                shutdown_socket(socket);
+            } else {
+                close_socket(socket);
+            }
         }
     }
 }
@@ -1142,14 +1486,11 @@ bool RatsClient::connect_to_peer(const std::string& host, int port, ConnectionSt
         std::string peer_id;
         
         {
-            std::lock_guard<std::mutex> lock(peers_mutex_);
-            auto addr_it = address_to_peer_id_.find(peer_address);
-            if (addr_it != address_to_peer_id_.end()) {
-                auto peer_it = peers_.find(addr_it->second);
-                if (peer_it != peers_.end()) {
-                    connected_socket = peer_it->second.socket;
-                    peer_id = peer_it->second.peer_id;
-                }
+            auto snapshot = get_peer_snapshot();
+            auto addr_it = snapshot->by_address.find(peer_address);
+            if (addr_it != snapshot->by_address.end()) {
+                connected_socket = addr_it->second->socket;
+                peer_id = addr_it->second->peer_id;
             }
         }
         
@@ -1162,8 +1503,20 @@ bool RatsClient::connect_to_peer(const std::string& host, int port, ConnectionSt
 }
 
 void RatsClient::disconnect_peer(socket_t socket) {
+    // Let messages queued before the disconnect go out first
+    auto send_queue = get_send_queue(socket);
+    if (send_queue) {
+        send_queue->wait_drained(std::chrono::milliseconds(DISCONNECT_SEND_FLUSH_TIMEOUT_MS));
+    }
+    
     remove_peer(socket);
     
+    // Sessions owned by the reactor are closed (and their encryption state cleaned) on its thread
+    if (send_queue) {
+        shutdown_socket(socket);
+        return;
+    }
+    
     // Clean up encryption state
     if (is_encryption_enabled()) {
         encrypted_communication::cleanup_socket(socket);
@@ -1181,7 +1534,7 @@ void RatsClient::disconnect_peer_by_id(const std::string& peer_id) {
 
 // Helper methods for peer management
 void RatsClient::add_peer(const RatsPeer& peer) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     add_peer_unlocked(peer);
 }
 
@@ -1193,7 +1546,7 @@ void RatsClient::add_peer_unlocked(const RatsPeer& peer) {
 }
 
 void RatsClient::remove_peer(socket_t socket) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     auto it = socket_to_peer_id_.find(socket);
     if (it != socket_to_peer_id_.end()) {
         remove_peer_by_id_unlocked(it->second);
@@ -1201,7 +1554,7 @@ void RatsClient::remove_peer(socket_t socket) {
 }
 
 void RatsClient::remove_peer_by_id(const std::string& peer_id) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     remove_peer_by_id_unlocked(peer_id);
 }
 
@@ -1230,8 +1583,31 @@ void RatsClient::remove_peer_by_id_unlocked(const std::string& peer_id) {
 }
 
 bool RatsClient::is_already_connected_to_address(const std::string& normalized_address) const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    return address_to_peer_id_.find(normalized_address) != address_to_peer_id_.end();
+    auto snapshot = get_peer_snapshot();
+    return snapshot->by_address.find(normalized_address) != snapshot->by_address.end();
+}
+
+std::shared_ptr<const RatsClient::PeerTableSnapshot> RatsClient::get_peer_snapshot() const {
+    return std::atomic_load(&peer_snapshot_);
+}
+
+void RatsClient::publish_peer_snapshot_unlocked() {
+    // Assumes peers_mutex_ is already locked
+    int previous_validated = get_peer_snapshot()->validated_count;
+    auto snapshot = std::make_shared<PeerTableSnapshot>();
+    snapshot->peers.reserve(peers_.size());
+    for (const auto& pair : peers_) {
+        auto peer = std::make_shared<const RatsPeer>(pair.second);
+        snapshot->peers.push_back(peer);
+        snapshot->by_id.emplace(pair.first, peer);
+        snapshot->by_socket.emplace(peer->socket, peer);
+        snapshot->by_address.emplace(peer->normalized_address, peer);
+        if (peer->is_handshake_completed()) {
+            snapshot->validated_count++;
+        }
+    }
+    validated_peers_gauge().add(snapshot->validated_count - previous_validated);
+    std::atomic_store(&peer_snapshot_, std::shared_ptr<const PeerTableSnapshot>(std::move(snapshot)));
 }
 
 void RatsClient::add_ignored_address(const std::string& ip_address) {
@@ -1333,14 +1709,18 @@ bool RatsClient::should_ignore_peer(const std::string& ip, int port) const {
 
 // Helper method to create a message with header
 std::vector<uint8_t> RatsClient::create_message_with_header(const std::vector<uint8_t>& payload, MessageDataType type) {
+    return create_message_with_header(payload.data(), payload.size(), type);
+}
+
+std::vector<uint8_t> RatsClient::create_message_with_header(const uint8_t* payload, size_t payload_size, MessageDataType type) {
     MessageHeader header(type);
-    std::vector<uint8_t> header_bytes = header.serialize();
     
     // Combine header + payload
-    std::vector<uint8_t> message;
-    message.reserve(header_bytes.size() + payload.size());
-    message.insert(message.end(), header_bytes.begin(), header_bytes.end());
-    message.insert(message.end(), payload.begin(), payload.end());
+    std::vector<uint8_t> message(MessageHeader::HEADER_SIZE + payload_size);
+    header.serialize_to(message.data());
+    if (payload_size > 0) {
+        memcpy(message.data() + MessageHeader::HEADER_SIZE, payload, payload_size);
+    }
     
     return message;
 }
@@ -1353,11 +1733,8 @@ bool RatsClient::parse_message_with_header(const std::vector<uint8_t>& message,
         return false;
     }
     
-    // Extract header bytes
-    std::vector<uint8_t> header_bytes(message.begin(), message.begin() + MessageHeader::HEADER_SIZE);
-    
     // Parse header
-    if (!MessageHeader::deserialize(header_bytes, header)) {
+    if (!MessageHeader::deserialize(message.data(), message.size(), header)) {
         LOG_CLIENT_DEBUG("Failed to parse message header - invalid magic number or format");
         return false;
     }
@@ -1375,36 +1752,156 @@ bool RatsClient::parse_message_with_header(const std::vector<uint8_t>& message,
     return true;
 }
 
-bool RatsClient::send_binary_to_peer(socket_t socket, const std::vector<uint8_t>& data, MessageDataType message_type) {
+// Zero-copy variant: the payload is a view into the message storage
+bool RatsClient::parse_message_with_header(const SharedBuffer& message, MessageHeader& header, SharedBuffer& payload) const {
+    if (!MessageHeader::deserialize(message.data(), message.size(), header)) {
+        LOG_CLIENT_DEBUG("Failed to parse message header - too small, invalid magic number or format");
+        return false;
+    }
+    
+    if (!header.is_valid_type()) {
+        LOG_CLIENT_WARN("Invalid message data type: " << static_cast<int>(header.type));
+        return false;
+    }
+    
+    payload = message.slice(MessageHeader::HEADER_SIZE);
+    
+    LOG_CLIENT_DEBUG("Parsed message header: type=" << static_cast<int>(header.type) << ", payload_size=" << payload.size());
+    return true;
+}
+
+bool RatsClient::send_binary_to_peer(socket_t socket, const std::vector<uint8_t>& data, MessageDataType message_type,
+                                     SendPriority priority) {
+    return send_payload_to_peer(socket, SharedBuffer::copy_of(data.data(), data.size()), message_type, priority);
+}
+
+bool RatsClient::send_payload_to_peer(socket_t socket, const SharedBuffer& payload, MessageDataType message_type,
+                                      SendPriority priority) {
     if (!running_.load()) {
         return false;
     }
     
+    // Check if handshake is completed before queueing encrypted data
+    if (is_encryption_enabled() && !encrypted_communication::is_handshake_completed(socket)) {
+        std::string type_name = (message_type == MessageDataType::BINARY) ? "binary" : 
+                               (message_type == MessageDataType::STRING) ? "string" : "JSON";
+        LOG_CLIENT_WARN("Cannot send " << type_name << " data to socket " << socket << " - encryption handshake not completed");
+        return false;
+    }
+    
+    return send_outbound_message(socket, OutboundMessage(static_cast<uint8_t>(message_type), payload, priority));
+}
+
+bool RatsClient::send_outbound_message(socket_t socket, OutboundMessage&& message) {
+    MessageDataType message_type = static_cast<MessageDataType>(message.type);
+    size_t message_size = message.size();
+    
+    // Connections driven by the reactor own an outbound queue drained by the writer threads
+    auto send_queue = get_send_queue(socket);
+    if (send_queue) {
+        if (!send_writer_->enqueue(send_queue, std::move(message))) {
+            LOG_CLIENT_DEBUG("Send queue rejected " << message_size << " bytes for socket " << socket);
+            return false;
+        }
+        count_message_traffic(true, message_type, message_size);
+        return true;
+    }
+    
+    // Not (yet) a registered connection: send on the caller's thread
+    std::vector<OutboundMessage> batch;
+    batch.push_back(std::move(message));
+    if (!send_outbound_batch(socket, batch)) {
+        return false;
+    }
+    count_message_traffic(true, message_type, message_size);
+    return true;
+}
+
+bool RatsClient::send_outbound_batch(socket_t socket, std::vector<OutboundMessage>& batch) {
     // Get socket-specific mutex for thread-safe sending
     // Prevent framed messages corruption (like two-times sending the number of bytes instead number of bytes + message)
     auto socket_mutex = get_socket_send_mutex(socket);
     std::lock_guard<std::mutex> send_lock(*socket_mutex);
+    ScopedMetricTimer write_timer(socket_write_histogram());
+    TRACE_SPAN("message", "send_outbound_batch");
     
-    // Create message with specified header type
-    std::vector<uint8_t> message_with_header = create_message_with_header(data, message_type);
-    
-    // Use encrypted communication if encryption is enabled
     if (is_encryption_enabled()) {
-        // Check if handshake is completed before sending data
-        if (!encrypted_communication::is_handshake_completed(socket)) {
-            std::string type_name = (message_type == MessageDataType::BINARY) ? "binary" : 
-                                   (message_type == MessageDataType::STRING) ? "string" : "JSON";
-            LOG_CLIENT_WARN("Cannot send " << type_name << " data to socket " << socket << " - encryption handshake not completed");
-            return false;
+        // The cipher needs header + payload as one plaintext per message
+        for (const auto& message : batch) {
+            std::vector<uint8_t> message_with_header = create_message_with_header(
+                message.payload.data(), message.payload.size(), static_cast<MessageDataType>(message.type));
+            if (message.file) {
+                // File ranges are read into the plaintext, there is no zero-copy path through the cipher
+                size_t file_start = message_with_header.size();
+                message_with_header.resize(file_start + message.file_size);
+                if (!message.file->read_at(message.file_offset, message_with_header.data() + file_start, message.file_size)) {
+                    LOG_CLIENT_ERROR("Failed to read " << message.file_size << " bytes of " << message.file->path()
+                                     << " for socket " << socket);
+                    return false;
+                }
+            }
+            // The scratch buffer becomes the ciphertext, so encryption needs no further copy
+            if (encrypted_communication::send_tcp_data_encrypted_in_place(socket, message_with_header) <= 0) {
+                return false;
+            }
         }
+        return true;
+    }
+    
+    if (batch.size() == 1 && !batch[0].file) {
+        // Length prefix, header and payload go out in one vectored write without concatenation
+        uint8_t header_bytes[MessageHeader::HEADER_SIZE];
+        MessageHeader(static_cast<MessageDataType>(batch[0].type)).serialize_to(header_bytes);
+        IoSlice parts[2] = { IoSlice(header_bytes, sizeof(header_bytes)), IoSlice(batch[0].payload.data(), batch[0].payload.size()) };
+        return send_tcp_message_framed(socket, parts, 2) > 0;
+    }
+    
+    // Coalesce the whole batch into one vectored write: [prefix, header, payload] per message.
+    // A message with a file range flushes what is gathered so far, then the kernel sends
+    // the range straight from the page cache.
+    struct FramePrefix {
+        uint32_t length;
+        uint8_t header[MessageHeader::HEADER_SIZE];
+    };
+    std::vector<FramePrefix> prefixes(batch.size());
+    std::vector<IoSlice> slices;
+    slices.reserve(batch.size() * 3);
+    size_t gathered_size = 0;
+    size_t total_size = 0;
+    auto flush = [&]() {
+        int sent = slices.empty() ? 0 : send_tcp_data_vectored(socket, slices.data(), slices.size());
+        bool complete = sent == static_cast<int>(gathered_size);
+        slices.clear();
+        gathered_size = 0;
+        return complete;
+    };
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const OutboundMessage& message = batch[i];
+        const SharedBuffer& payload = message.payload;
+        prefixes[i].length = htonl(static_cast<uint32_t>(MessageHeader::HEADER_SIZE + message.size()));
+        MessageHeader(static_cast<MessageDataType>(message.type)).serialize_to(prefixes[i].header);
+        slices.emplace_back(&prefixes[i].length, sizeof(prefixes[i].length));
+        slices.emplace_back(prefixes[i].header, sizeof(prefixes[i].header));
+        slices.emplace_back(payload.data(), payload.size());
+        gathered_size += sizeof(prefixes[i].length) + MessageHeader::HEADER_SIZE + payload.size();
+        total_size += sizeof(prefixes[i].length) + MessageHeader::HEADER_SIZE + message.size();
         
-        int sent = encrypted_communication::send_tcp_data_encrypted(socket, message_with_header);
-        return sent > 0;
-    } else {
-        // Use framed messages for reliable large message handling
-        int sent = send_tcp_message_framed(socket, message_with_header);
-        return sent > 0;
+        if (message.file && (!flush() ||
+                send_tcp_file_data(socket, *message.file, message.file_offset, message.file_size) !=
+                    static_cast<int64_t>(message.file_size))) {
+            LOG_CLIENT_ERROR("Failed to send " << message.file_size << " bytes of " << message.file->path()
+                             << " to socket " << socket);
+            return false;
+        }
+    }
+    
+    if (!flush()) {
+        LOG_CLIENT_ERROR("Failed to send batch of " << batch.size() << " messages to socket " << socket);
+        return false;
     }
+    
+    LOG_CLIENT_DEBUG("Sent batch of " << batch.size() << " messages (" << total_size << " bytes) to socket " << socket);
+    return true;
 }
 
 bool RatsClient::send_string_to_peer(socket_t socket, const std::string& data) {
@@ -1413,26 +1910,45 @@ bool RatsClient::send_string_to_peer(socket_t socket, const std::string& data) {
     return send_binary_to_peer(socket, binary_data, MessageDataType::STRING);
 }
 
-bool RatsClient::send_json_to_peer(socket_t socket, const nlohmann::json& data) {
+bool RatsClient::send_json_to_peer(socket_t socket, const nlohmann::json& data, SendPriority priority) {
     try {
         // Serialize JSON and convert to binary, then use the primary send_binary_to_peer method
         std::string json_string = data.dump();
         std::vector<uint8_t> binary_data(json_string.begin(), json_string.end());
-        return send_binary_to_peer(socket, binary_data, MessageDataType::JSON);
+        return send_binary_to_peer(socket, binary_data, MessageDataType::JSON, priority);
     } catch (const nlohmann::json::exception& e) {
         LOG_CLIENT_ERROR("Failed to serialize JSON message: " << e.what());
         return false;
     }
 }
 
-bool RatsClient::send_binary_to_peer_id(const std::string& peer_hash_id, const std::vector<uint8_t>& data, MessageDataType message_type) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    auto it = peers_.find(peer_hash_id);
-    if (it == peers_.end() || !it->second.is_handshake_completed()) {
+bool RatsClient::send_binary_to_peer_id(const std::string& peer_hash_id, const std::vector<uint8_t>& data, MessageDataType message_type,
+                                        SendPriority priority) {
+    auto peer = get_peer_snapshot()->find(peer_hash_id);
+    if (!peer || !peer->is_handshake_completed()) {
+        return false;
+    }
+    
+    return send_binary_to_peer(peer->socket, data, message_type, priority);
+}
+
+bool RatsClient::send_file_region_to_peer_id(const std::string& peer_hash_id, const std::vector<uint8_t>& data,
+                                             const std::shared_ptr<FileHandle>& file, uint64_t offset, uint32_t size,
+                                             SendPriority priority) {
+    auto peer = get_peer_snapshot()->find(peer_hash_id);
+    if (!peer || !peer->is_handshake_completed() || !file || !running_.load()) {
+        return false;
+    }
+    if (is_encryption_enabled() && !encrypted_communication::is_handshake_completed(peer->socket)) {
+        LOG_CLIENT_WARN("Cannot send file data to socket " << peer->socket << " - encryption handshake not completed");
         return false;
     }
     
-    return send_binary_to_peer(it->second.socket, data, message_type);
+    OutboundMessage message(static_cast<uint8_t>(MessageDataType::BINARY), SharedBuffer::copy_of(data.data(), data.size()), priority);
+    message.file = file;
+    message.file_offset = offset;
+    message.file_size = size;
+    return send_outbound_message(peer->socket, std::move(message));
 }
 
 bool RatsClient::send_string_to_peer_id(const std::string& peer_hash_id, const std::string& data) {
@@ -1453,6 +1969,26 @@ bool RatsClient::send_json_to_peer_id(const std::string& peer_hash_id, const nlo
     }
 }
 
+int RatsClient::send_binary_to_peer_ids(const std::vector<std::string>& peer_ids, const SharedBuffer& data, MessageDataType message_type,
+                                        SendPriority priority) {
+    if (!running_.load()) {
+        return 0;
+    }
+    
+    // Resolve all sockets from one snapshot and queue the shared payload to each
+    auto snapshot = get_peer_snapshot();
+    int sent_count = 0;
+    for (const auto& peer_id : peer_ids) {
+        auto peer = snapshot->find(peer_id);
+        if (peer && peer->is_handshake_completed() &&
+            send_payload_to_peer(peer->socket, data, message_type, priority)) {
+            sent_count++;
+        }
+    }
+    
+    return sent_count;
+}
+
 int RatsClient::broadcast_json_to_peers(const nlohmann::json& data) {
     try {
         // Serialize JSON and convert to binary, then use primary binary method with JSON type
@@ -1465,60 +2001,238 @@ int RatsClient::broadcast_json_to_peers(const nlohmann::json& data) {
     }
 }
 
-int RatsClient::broadcast_binary_to_peers(const std::vector<uint8_t>& data, MessageDataType message_type) {
-    if (!running_.load()) {
-        return 0;
+int RatsClient::broadcast_binary_to_peers(const std::vector<uint8_t>& data, MessageDataType message_type) {
+    if (!running_.load()) {
+        return 0;
+    }
+    
+    // One shared copy of the payload is queued to every peer
+    return broadcast_binary_to_peers(SharedBuffer::copy_of(data.data(), data.size()), message_type);
+}
+
+int RatsClient::broadcast_binary_to_peers(const SharedBuffer& data, MessageDataType message_type) {
+    if (!running_.load()) {
+        return 0;
+    }
+    
+    int sent_count = 0;
+    auto snapshot = get_peer_snapshot();
+    for (const auto& peer : snapshot->peers) {
+        // Only send to peers that have completed handshake
+        if (peer->is_handshake_completed()) {
+            if (send_payload_to_peer(peer->socket, data, message_type)) {
+                sent_count++;
+            }
+        }
+    }
+    
+    return sent_count;
+}
+
+int RatsClient::broadcast_string_to_peers(const std::string& data) {
+    // Convert string to binary and use primary binary method with STRING type
+    std::vector<uint8_t> binary_data(data.begin(), data.end());
+    return broadcast_binary_to_peers(binary_data, MessageDataType::STRING);
+}
+
+bool RatsClient::parse_json_message(const std::string& message, nlohmann::json& out_json) {
+    TRACE_SPAN("message", "parse_json_message");
+    try {
+        out_json = nlohmann::json::parse(message);
+        return true;
+    } catch (const nlohmann::json::exception& e) {
+        LOG_CLIENT_ERROR("Failed to parse JSON message: " << e.what());
+        return false;
+    }
+}
+
+// Helpers
+
+RatsClient::ConnectionShard& RatsClient::connection_shard(socket_t socket) {
+    return connection_shards_[socket_shard(socket, CONNECTION_SHARD_COUNT)];
+}
+
+const RatsClient::ConnectionShard& RatsClient::connection_shard(socket_t socket) const {
+    return connection_shards_[socket_shard(socket, CONNECTION_SHARD_COUNT)];
+}
+
+// Per-socket synchronization helpers
+std::shared_ptr<std::mutex> RatsClient::get_socket_send_mutex(socket_t socket) {
+    ConnectionShard& shard = connection_shard(socket);
+    std::lock_guard<std::mutex> lock(shard.send_mutexes_mutex);
+    auto it = shard.send_mutexes.find(socket);
+    if (it == shard.send_mutexes.end()) {
+        // Create new mutex for this socket
+        shard.send_mutexes[socket] = std::make_shared<std::mutex>();
+        return shard.send_mutexes[socket];
+    }
+    return it->second;
+}
+
+std::shared_ptr<PeerSendQueue> RatsClient::get_send_queue(socket_t socket) const {
+    const ConnectionShard& shard = connection_shard(socket);
+    std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+    auto it = shard.sessions.find(socket);
+    return it != shard.sessions.end() ? it->second->send_queue : nullptr;
+}
+
+void RatsClient::flush_send_queues(std::chrono::milliseconds timeout) {
+    std::vector<std::shared_ptr<PeerSendQueue>> queues;
+    for (const auto& shard : connection_shards_) {
+        std::lock_guard<std::mutex> lock(shard.sessions_mutex);
+        for (const auto& pair : shard.sessions) {
+            queues.push_back(pair.second->send_queue);
+        }
+    }
+    
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (const auto& queue : queues) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            break;
+        }
+        queue->wait_drained(remaining);
+    }
+}
+
+void RatsClient::set_send_queue_config(const SendQueueConfig& config) {
+    std::lock_guard<std::mutex> lock(send_queue_config_mutex_);
+    send_queue_config_ = config;
+}
+
+SendQueueConfig RatsClient::get_send_queue_config() const {
+    std::lock_guard<std::mutex> lock(send_queue_config_mutex_);
+    return send_queue_config_;
+}
+
+void RatsClient::set_callback_executor_config(const CallbackExecutorConfig& config) {
+    std::lock_guard<std::mutex> lock(callback_executor_config_mutex_);
+    callback_executor_config_ = config;
+}
+
+CallbackExecutorConfig RatsClient::get_callback_executor_config() const {
+    std::lock_guard<std::mutex> lock(callback_executor_config_mutex_);
+    return callback_executor_config_;
+}
+
+void RatsClient::set_io_shard_config(const IoShardConfig& config) {
+    std::lock_guard<std::mutex> lock(io_shard_config_mutex_);
+    io_shard_config_ = config;
+}
+
+IoShardConfig RatsClient::get_io_shard_config() const {
+    std::lock_guard<std::mutex> lock(io_shard_config_mutex_);
+    return io_shard_config_;
+}
+
+void RatsClient::set_resource_limits(const ResourceLimits& limits) {
+    {
+        std::lock_guard<std::mutex> lock(resource_limits_mutex_);
+        resource_limits_ = limits;
+    }
+    apply_resource_limits();
+}
+
+ResourceLimits RatsClient::get_resource_limits() const {
+    std::lock_guard<std::mutex> lock(resource_limits_mutex_);
+    return resource_limits_;
+}
+
+void RatsClient::apply_resource_limits() {
+    ResourceLimits limits = get_resource_limits();
+    if (dht_client_) {
+        dht_client_->set_resource_limits(limits.dht_max_stored_info_hashes, limits.dht_max_peers_per_info_hash,
+                                         limits.dht_max_pending_searches);
+    }
+    if (mdns_client_) {
+        mdns_client_->set_max_services(limits.mdns_max_services);
+    }
+    if (file_transfer_manager_) {
+        file_transfer_manager_->set_history_limits(limits.file_transfer_max_history, limits.file_transfer_history_lifetime);
+    }
+}
+
+nlohmann::json RatsClient::get_resource_usage() const {
+    std::map<std::string, ResourceUsage> caches;
+    if (dht_client_) {
+        caches["dht.announced_peers"] = dht_client_->get_announced_peers_usage();
+        caches["dht.searches"] = dht_client_->get_searches_usage();
     }
-    
-    int sent_count = 0;
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    
-    for (const auto& pair : peers_) {
-        const RatsPeer& peer = pair.second;
-        // Only send to peers that have completed handshake
-        if (peer.is_handshake_completed()) {
-            if (send_binary_to_peer(peer.socket, data, message_type)) {
-                sent_count++;
-            }
+    if (mdns_client_) {
+        caches["mdns.services"] = mdns_client_->get_services_usage();
+    }
+    if (gossipsub_) {
+        caches["gossipsub.message_cache"] = gossipsub_->get_message_cache_usage();
+        caches["gossipsub.seen_messages"] = gossipsub_->get_seen_messages_usage();
+    }
+    if (file_transfer_manager_) {
+        caches["file_transfer.history"] = file_transfer_manager_->get_history_usage();
+    }
+    {
+        // One per open connection, so bounded by max_peers rather than a budget of its own.
+        // Each is a map node plus the mutex sharing an allocation with its control block.
+        ResourceUsage& usage = caches["client.socket_send_mutexes"];
+        for (const auto& shard : connection_shards_) {
+            std::lock_guard<std::mutex> lock(shard.send_mutexes_mutex);
+            usage.entries += shard.send_mutexes.size();
         }
+        usage.bytes = usage.entries * (sizeof(std::pair<const socket_t, std::shared_ptr<std::mutex>>) +
+                                       4 * sizeof(void*) + sizeof(std::mutex));
     }
     
-    return sent_count;
+    nlohmann::json report = nlohmann::json::object();
+    size_t total_bytes = 0;
+    for (const auto& pair : caches) {
+        const ResourceUsage& usage = pair.second;
+        report[pair.first] = {
+            {"entries", usage.entries},
+            {"bytes", usage.bytes},
+            {"max_entries", usage.max_entries},
+            {"max_bytes", usage.max_bytes},
+            {"evictions", usage.evictions}
+        };
+        total_bytes += usage.bytes;
+    }
+    report["total_bytes"] = total_bytes;
+    return report;
 }
 
-int RatsClient::broadcast_string_to_peers(const std::string& data) {
-    // Convert string to binary and use primary binary method with STRING type
-    std::vector<uint8_t> binary_data(data.begin(), data.end());
-    return broadcast_binary_to_peers(binary_data, MessageDataType::STRING);
+size_t RatsClient::get_queued_callback_count() const {
+    return callback_executor_->get_queued_count();
 }
 
-bool RatsClient::parse_json_message(const std::string& message, nlohmann::json& out_json) {
+void RatsClient::run_callback(const std::string& key, std::function<void()> task) {
+    if (callback_executor_->is_running() && callback_executor_->post(key, std::move(task))) {
+        return;
+    }
     try {
-        out_json = nlohmann::json::parse(message);
-        return true;
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to parse JSON message: " << e.what());
-        return false;
+        task();
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Exception in callback: " << e.what());
+    } catch (...) {
+        LOG_CLIENT_ERROR("Unknown exception in callback");
     }
 }
 
-// Helpers
+SendQueueStats RatsClient::get_peer_send_queue_stats(const std::string& peer_id) const {
+    auto send_queue = get_send_queue(get_peer_socket_by_id(peer_id));
+    return send_queue ? send_queue->get_stats() : SendQueueStats();
+}
 
-// Per-socket synchronization helpers
-std::shared_ptr<std::mutex> RatsClient::get_socket_send_mutex(socket_t socket) {
-    std::lock_guard<std::mutex> lock(socket_send_mutexes_mutex_);
-    auto it = socket_send_mutexes_.find(socket);
-    if (it == socket_send_mutexes_.end()) {
-        // Create new mutex for this socket
-        socket_send_mutexes_[socket] = std::make_shared<std::mutex>();
-        return socket_send_mutexes_[socket];
-    }
-    return it->second;
+size_t RatsClient::get_peer_send_queue_depth(const std::string& peer_id) const {
+    auto send_queue = get_send_queue(get_peer_socket_by_id(peer_id));
+    return send_queue ? send_queue->get_depth() : 0;
+}
+
+bool RatsClient::flush_peer_send_queue(const std::string& peer_id, std::chrono::milliseconds timeout) {
+    auto send_queue = get_send_queue(get_peer_socket_by_id(peer_id));
+    return send_queue && send_queue->wait_drained(timeout);
 }
 
 void RatsClient::cleanup_socket_send_mutex(socket_t socket) {
-    std::lock_guard<std::mutex> lock(socket_send_mutexes_mutex_);
-    socket_send_mutexes_.erase(socket);
+    ConnectionShard& shard = connection_shard(socket);
+    std::lock_guard<std::mutex> lock(shard.send_mutexes_mutex);
+    shard.send_mutexes.erase(socket);
 }
 
 // =========================================================================
@@ -1541,39 +2255,39 @@ int RatsClient::get_peer_count_unlocked() const {
 }
 
 int RatsClient::get_peer_count() const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    return get_peer_count_unlocked();
+    return get_peer_snapshot()->validated_count;
 }
 
 std::string RatsClient::get_peer_id(socket_t socket) const {
-    const RatsPeer* peer = get_peer_by_socket(socket);
+    auto peer = get_peer_snapshot()->find(socket);
     return peer ? peer->peer_id : "";
 }
 
 socket_t RatsClient::get_peer_socket_by_id(const std::string& peer_id) const {
-    const RatsPeer* peer = get_peer_by_id(peer_id);
+    auto peer = get_peer_snapshot()->find(peer_id);
     return peer ? peer->socket : INVALID_SOCKET_VALUE;
 }
 
 std::vector<RatsPeer> RatsClient::get_all_peers() const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    auto snapshot = get_peer_snapshot();
     std::vector<RatsPeer> result;
-    result.reserve(peers_.size());
+    result.reserve(snapshot->peers.size());
     
-    for (const auto& pair : peers_) {
-        result.push_back(pair.second);
+    for (const auto& peer : snapshot->peers) {
+        result.push_back(*peer);
     }
     
     return result;
 }
 
 std::vector<RatsPeer> RatsClient::get_validated_peers() const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    auto snapshot = get_peer_snapshot();
     std::vector<RatsPeer> result;
+    result.reserve(snapshot->validated_count);
     
-    for (const auto& pair : peers_) {
-        if (pair.second.is_handshake_completed()) {
-            result.push_back(pair.second);
+    for (const auto& peer : snapshot->peers) {
+        if (peer->is_handshake_completed()) {
+            result.push_back(*peer);
         }
     }
     
@@ -1582,15 +2296,13 @@ std::vector<RatsPeer> RatsClient::get_validated_peers() const {
 
 
 std::vector<RatsPeer> RatsClient::get_random_peers(int max_count, const std::string& exclude_peer_id) const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    
     std::vector<RatsPeer> all_validated_peers;
     
     // Get all validated peers excluding the specified peer
-    for (const auto& pair : peers_) {
-        const RatsPeer& peer = pair.second;
-        if (peer.is_handshake_completed() && peer.peer_id != exclude_peer_id) {
-            all_validated_peers.push_back(peer);
+    auto snapshot = get_peer_snapshot();
+    for (const auto& peer : snapshot->peers) {
+        if (peer->is_handshake_completed() && peer->peer_id != exclude_peer_id) {
+            all_validated_peers.push_back(*peer);
         }
     }
     
@@ -1639,9 +2351,8 @@ void RatsClient::set_max_peers(int max_peers) {
 }
 
 bool RatsClient::is_peer_limit_reached() const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
     // Connected peers only enforcement (exclude handshake peers)
-    int connected_peers = get_peer_count_unlocked();
+    int connected_peers = get_peer_count();
     if (connected_peers >= max_peers_) {
         return true;
     }
@@ -1709,6 +2420,10 @@ void RatsClient::set_binary_data_callback(BinaryDataCallback callback) {
     binary_data_callback_ = callback;
 }
 
+void RatsClient::set_binary_data_view_callback(BinaryDataViewCallback callback) {
+    binary_data_view_callback_ = callback;
+}
+
 void RatsClient::set_string_data_callback(StringDataCallback callback) {
     string_data_callback_ = callback;
 }
@@ -1747,6 +2462,13 @@ bool RatsClient::start_dht_discovery(int dht_port) {
     LOG_CLIENT_INFO("Starting DHT discovery on port " << dht_port);
     
     dht_client_ = std::make_unique<DhtClient>(dht_port);
+    apply_resource_limits();
+    
+    // Warm start from the routing table saved by the last run
+    if (dht_client_->load_routing_table(get_dht_state_file_path())) {
+        LOG_CLIENT_INFO("Loaded saved DHT routing table");
+    }
+    
     if (!dht_client_->start()) {
         LOG_CLIENT_ERROR("Failed to start DHT client");
         dht_client_.reset();
@@ -1776,6 +2498,10 @@ void RatsClient::stop_dht_discovery() {
     // Stop automatic peer discovery
     stop_automatic_peer_discovery();
     
+    if (dht_client_->is_running() && dht_client_->get_routing_table_size() > 0) {
+        dht_client_->save_routing_table(get_dht_state_file_path());
+    }
+    
     dht_client_->stop();
     dht_client_.reset();
     LOG_CLIENT_INFO("DHT discovery stopped");
@@ -1868,13 +2594,13 @@ void RatsClient::handle_dht_peer_discovery(const std::vector<Peer>& peers, const
             LOG_CLIENT_DEBUG("Attempting to connect to discovered peer: " << peer.ip << ":" << peer.port);
             
             // Try to connect to the peer (non-blocking)
-            std::thread([this, peer]() {
+            submit_task([this, peer]() {
                 if (connect_to_peer(peer.ip, peer.port)) {
                     LOG_CLIENT_INFO("Successfully connected to DHT discovered peer: " << peer.ip << ":" << peer.port);
                 } else {
                     LOG_CLIENT_DEBUG("Failed to connect to DHT discovered peer: " << peer.ip << ":" << peer.port);
                 }
-            }).detach();
+            }, "dht-connect-" + peer.ip);
         } else {
             LOG_CLIENT_DEBUG("Already connected to discovered peer: " << normalized_peer_address);
         }
@@ -2007,7 +2733,8 @@ void RatsClient::search_rats_peers(int iteration_max) {
     find_peers_by_hash(discovery_hash, [this](const std::vector<std::string>& peers) {
         LOG_CLIENT_INFO("Found " << peers.size() << " peers through DHT discovery");
         // Note: Connection attempts are handled by handle_dht_peer_discovery() which is called
-        // automatically by find_peers_by_hash(), so no need to duplicate connection logic here
+        // automatically by find_peers_by_hash() for every batch, so we connect to the first
+        // peers while the lookup is still running and need no connection logic here
         for (const auto& peer_address : peers) {
             LOG_CLIENT_DEBUG("Discovered peer: " << peer_address);
         }
@@ -2045,6 +2772,22 @@ void RatsClient::set_protocol_version(const std::string& protocol_version) {
     LOG_CLIENT_INFO("Protocol version set to: " << protocol_version);
 }
 
+void RatsClient::set_payload_codecs(std::vector<std::shared_ptr<const PayloadCodec>> codecs) {
+    codecs.erase(std::remove(codecs.begin(), codecs.end(), nullptr), codecs.end());
+    std::string names;
+    for (const auto& codec : codecs) {
+        names += (names.empty() ? "" : ", ") + codec->name();
+    }
+    std::lock_guard<std::mutex> lock(protocol_config_mutex_);
+    payload_codecs_ = std::move(codecs);
+    LOG_CLIENT_INFO("Payload codecs set to: " << (names.empty() ? "(none, JSON only)" : names));
+}
+
+std::vector<std::shared_ptr<const PayloadCodec>> RatsClient::get_payload_codecs() const {
+    std::lock_guard<std::mutex> lock(protocol_config_mutex_);
+    return payload_codecs_;
+}
+
 std::string RatsClient::get_protocol_name() const {
     std::lock_guard<std::mutex> lock(protocol_config_mutex_);
     return custom_protocol_name_;
@@ -2060,26 +2803,143 @@ std::string RatsClient::get_protocol_version() const {
 // =========================================================================
 
 
-void RatsClient::on(const std::string& message_type, MessageCallback callback) {
+void RatsClient::add_message_handler(const std::string& message_type, MessageHandler handler) {
+    uint16_t type_id = rats_message_type::id_of(message_type);
     std::lock_guard<std::mutex> lock(message_handlers_mutex_);
-    message_handlers_[message_type].emplace_back(callback, false); // false = not once
-    LOG_CLIENT_INFO("Registered persistent handler for message type: " << message_type << " (total handlers: " << message_handlers_[message_type].size() << ")");
+    auto current = std::atomic_load(&message_handler_table_);
+    auto table = current ? std::make_shared<MessageHandlerTable>(*current) : std::make_shared<MessageHandlerTable>();
+    
+    auto& entries = (*table)[type_id];
+    auto entry = std::find_if(entries.begin(), entries.end(),
+                              [&](const MessageHandlerEntry& e) { return e.message_type == message_type; });
+    if (entry == entries.end()) {
+        entries.push_back(MessageHandlerEntry{message_type, {}});
+        entry = entries.end() - 1;
+    }
+    entry->handlers.push_back(std::move(handler));
+    LOG_CLIENT_DEBUG("Registered " << (entry->handlers.back().is_once() ? "one-time" : "persistent")
+                     << " handler for message type: " << message_type << " (total handlers: " << entry->handlers.size() << ")");
+    
+    std::atomic_store(&message_handler_table_, std::shared_ptr<const MessageHandlerTable>(std::move(table)));
+}
+
+void RatsClient::on(const std::string& message_type, MessageCallback callback) {
+    add_message_handler(message_type, MessageHandler(std::move(callback), false)); // false = not once
 }
 
 void RatsClient::once(const std::string& message_type, MessageCallback callback) {
-    std::lock_guard<std::mutex> lock(message_handlers_mutex_);
-    message_handlers_[message_type].emplace_back(callback, true); // true = once
-    LOG_CLIENT_DEBUG("Registered one-time handler for message type: " << message_type);
+    add_message_handler(message_type, MessageHandler(std::move(callback), true)); // true = once
+}
+
+void RatsClient::on_payload(const std::string& message_type, PayloadCallback callback) {
+    add_message_handler(message_type, MessageHandler(std::move(callback)));
+}
+
+void RatsClient::on_bytes(const std::string& message_type, BytesCallback callback) {
+    on_payload(message_type, [callback = std::move(callback)](const std::string& peer_id, const RatsMessagePayload& payload) {
+        if (payload.is_parsed() && payload.bytes().empty()) {
+            // Came in a JSON envelope, so there are no payload bytes to hand out
+            std::string text = payload.raw();
+            callback(peer_id, SharedBuffer(std::vector<uint8_t>(text.begin(), text.end())));
+        } else {
+            callback(peer_id, payload.bytes());
+        }
+    });
 }
 
 void RatsClient::off(const std::string& message_type) {
+    uint16_t type_id = rats_message_type::id_of(message_type);
     std::lock_guard<std::mutex> lock(message_handlers_mutex_);
-    auto it = message_handlers_.find(message_type);
-    if (it != message_handlers_.end()) {
-        size_t removed_count = it->second.size();
-        message_handlers_.erase(it);
-        LOG_CLIENT_DEBUG("Removed " << removed_count << " handlers for message type: " << message_type);
+    auto current = std::atomic_load(&message_handler_table_);
+    if (!current) {
+        return;
+    }
+    auto id_it = current->find(type_id);
+    if (id_it == current->end()) {
+        return;
+    }
+    
+    auto table = std::make_shared<MessageHandlerTable>(*current);
+    auto& entries = (*table)[type_id];
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->message_type == message_type) {
+            LOG_CLIENT_DEBUG("Removed " << it->handlers.size() << " handlers for message type: " << message_type);
+            entries.erase(it);
+            break;
+        }
+    }
+    if (entries.empty()) {
+        table->erase(type_id);
+    }
+    std::atomic_store(&message_handler_table_, std::shared_ptr<const MessageHandlerTable>(std::move(table)));
+}
+
+RatsClient::OutgoingRatsMessage::OutgoingRatsMessage(const std::string& type, const nlohmann::json& payload,
+                                                     const std::string& sender_peer_id)
+    : type_(type), payload_(&payload), raw_(nullptr), sender_peer_id_(sender_peer_id),
+      timestamp_(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()) {}
+
+RatsClient::OutgoingRatsMessage::OutgoingRatsMessage(const std::string& type, const std::vector<uint8_t>& raw,
+                                                     const std::string& sender_peer_id)
+    : type_(type), payload_(nullptr), raw_(&raw), sender_peer_id_(sender_peer_id),
+      timestamp_(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()) {}
+
+const SharedBuffer& RatsClient::OutgoingRatsMessage::encoded(const RatsPeer& peer, MessageDataType& out_type) {
+    static const SharedBuffer unsendable;
+    
+    if (peer.typed_messages) {
+        const PayloadCodec* codec = raw_ ? nullptr : peer.send_codec.get();
+        uint8_t encoding = raw_ ? payload_encoding::RAW : peer.send_codec_id;
+        if (!raw_ && !codec) {
+            codec = PayloadCodec::json().get();
+            encoding = payload_encoding::JSON;
+        }
+        auto it = std::find_if(typed_.begin(), typed_.end(), [&](const TypedEnvelope& typed) {
+            return typed.codec == codec && typed.encoding == encoding;
+        });
+        if (it == typed_.end()) {
+            std::vector<uint8_t> body = raw_ ? std::vector<uint8_t>() : codec->encode(*payload_);
+            const std::vector<uint8_t>& bytes = raw_ ? *raw_ : body;
+            std::vector<uint8_t> envelope;
+            typed_.push_back(TypedEnvelope{codec, encoding, SharedBuffer()});
+            if (encode_rats_envelope(type_, sender_peer_id_, timestamp_, encoding, bytes.data(), bytes.size(), envelope)) {
+                typed_.back().bytes = SharedBuffer(std::move(envelope));
+            }
+            it = typed_.end() - 1;
+        }
+        // Types or peer ids too long for the binary envelope go out as JSON
+        if (!it->bytes.empty()) {
+            out_type = MessageDataType::RATS;
+            return it->bytes;
+        }
+    }
+    
+    if (!payload_) {
+        return unsendable;
+    }
+    if (json_.empty()) {
+        nlohmann::json message;
+        message["rats_protocol"] = true;
+        message["type"] = type_;
+        message["payload"] = *payload_;
+        message["sender_peer_id"] = sender_peer_id_;
+        message["timestamp"] = timestamp_;
+        std::string json_string = message.dump();
+        json_ = SharedBuffer(std::vector<uint8_t>(json_string.begin(), json_string.end()));
+    }
+    out_type = MessageDataType::JSON;
+    return json_;
+}
+
+bool RatsClient::send_rats_message_to_peer(const RatsPeer& peer, OutgoingRatsMessage& message, SendPriority priority) {
+    MessageDataType type;
+    const SharedBuffer& payload = message.encoded(peer, type);
+    if (payload.empty()) {
+        return false;
     }
+    return send_payload_to_peer(peer.socket, payload, type, priority);
 }
 
 void RatsClient::send(const std::string& message_type, const nlohmann::json& data, SendCallback callback) {
@@ -2093,11 +2953,20 @@ void RatsClient::send(const std::string& message_type, const nlohmann::json& dat
     
     LOG_CLIENT_INFO("Sending broadcast message type '" << message_type << "' with data: " << data.dump());
     
-    // Create rats message
-    nlohmann::json message = create_rats_message(message_type, data, get_our_peer_id());
-    
-    // Broadcast to all validated peers
-    int sent_count = broadcast_rats_message_to_validated_peers(message);
+    // Broadcast to all validated peers; each encoding is serialized once and shared
+    int sent_count = 0;
+    try {
+        std::string our_peer_id = get_our_peer_id();
+        OutgoingRatsMessage message(message_type, data, our_peer_id);
+        auto snapshot = get_peer_snapshot();
+        for (const auto& peer : snapshot->peers) {
+            if (peer->is_handshake_completed() && send_rats_message_to_peer(*peer, message)) {
+                sent_count++;
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Failed to serialize message payload: " << e.what());
+    }
     
     LOG_CLIENT_INFO("Broadcasted message type '" << message_type << "' to " << sent_count << " peers");
     
@@ -2122,27 +2991,9 @@ void RatsClient::send(const std::string& peer_id, const std::string& message_typ
     
     LOG_CLIENT_INFO("Sending targeted message type '" << message_type << "' to peer " << peer_id << " with data: " << data.dump());
     
-    // Create rats message
-    nlohmann::json message = create_rats_message(message_type, data, get_our_peer_id());
-    
     // Send to specific peer
-    socket_t target_socket = INVALID_SOCKET_VALUE;
-    bool peer_found = false;
-    bool handshake_completed = false;
-    
-    {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
-        auto it = peers_.find(peer_id);
-        if (it != peers_.end()) {
-            peer_found = true;
-            handshake_completed = it->second.is_handshake_completed();
-            if (handshake_completed) {
-                target_socket = it->second.socket;
-            }
-        }
-    }
-    
-    if (!peer_found) {
+    auto peer = get_peer_snapshot()->find(peer_id);
+    if (!peer) {
         LOG_CLIENT_ERROR("Cannot send message '" << message_type << "' - peer not found: " << peer_id);
         if (callback) {
             callback(false, "Peer not found: " + peer_id);
@@ -2150,7 +3001,7 @@ void RatsClient::send(const std::string& peer_id, const std::string& message_typ
         return;
     }
     
-    if (!handshake_completed) {
+    if (!peer->is_handshake_completed()) {
         LOG_CLIENT_ERROR("Cannot send message '" << message_type << "' - peer handshake not completed: " << peer_id);
         if (callback) {
             callback(false, "Peer handshake not completed: " + peer_id);
@@ -2158,7 +3009,14 @@ void RatsClient::send(const std::string& peer_id, const std::string& message_typ
         return;
     }
     
-    bool success = send_json_to_peer(target_socket, message);
+    bool success = false;
+    try {
+        std::string our_peer_id = get_our_peer_id();
+        OutgoingRatsMessage message(message_type, data, our_peer_id);
+        success = send_rats_message_to_peer(*peer, message);
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Failed to serialize message payload: " << e.what());
+    }
     
     LOG_CLIENT_INFO("Sent message type '" << message_type << "' to peer " << peer_id << " - " << (success ? "success" : "failed"));
     
@@ -2171,42 +3029,117 @@ void RatsClient::send(const std::string& peer_id, const std::string& message_typ
     }
 }
 
-// Message exchange system helpers
-void RatsClient::call_message_handlers(const std::string& message_type, const std::string& peer_id, const nlohmann::json& data) {
-    std::vector<MessageHandler> handlers_to_call;
-    std::vector<MessageHandler> remaining_handlers;
+int RatsClient::send_to_peers(const std::vector<std::string>& peer_ids, const std::string& message_type, const nlohmann::json& data,
+                              SendPriority priority) {
+    if (!running_.load() || peer_ids.empty()) {
+        return 0;
+    }
+    
+    try {
+        // Serialize each encoding once; every peer queue shares the resulting bytes
+        std::string our_peer_id = get_our_peer_id();
+        OutgoingRatsMessage message(message_type, data, our_peer_id);
+        auto snapshot = get_peer_snapshot();
+        int sent_count = 0;
+        for (const auto& peer_id : peer_ids) {
+            auto peer = snapshot->find(peer_id);
+            if (peer && peer->is_handshake_completed() && send_rats_message_to_peer(*peer, message, priority)) {
+                sent_count++;
+            }
+        }
+        
+        LOG_CLIENT_DEBUG("Sent message type '" << message_type << "' to " << sent_count << " of " << peer_ids.size() << " peers");
+        return sent_count;
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Failed to serialize message payload: " << e.what());
+        return 0;
+    }
+}
+
+void RatsClient::send_raw(const std::string& peer_id, const std::string& message_type, const std::vector<uint8_t>& data,
+                          SendCallback callback) {
+    auto fail = [&](const std::string& error) {
+        LOG_CLIENT_ERROR("Cannot send raw message '" << message_type << "' to peer " << peer_id << " - " << error);
+        if (callback) {
+            callback(false, error);
+        }
+    };
     
-    LOG_CLIENT_INFO("Calling message handlers for type '" << message_type << "' from peer " << peer_id << " with data: " << data.dump());
+    if (!running_.load()) {
+        fail("Client is not running");
+        return;
+    }
     
-    // Get handlers to call and identify once handlers
-    {
-        std::lock_guard<std::mutex> lock(message_handlers_mutex_);
-        auto it = message_handlers_.find(message_type);
-        if (it != message_handlers_.end()) {
-            handlers_to_call = it->second; // Copy handlers
-            
-            // Keep only non-once handlers for the remaining list
-            for (const auto& handler : it->second) {
-                if (!handler.is_once) {
-                    remaining_handlers.push_back(handler);
+    auto peer = get_peer_snapshot()->find(peer_id);
+    if (!peer) {
+        fail("Peer not found: " + peer_id);
+        return;
+    }
+    if (!peer->is_handshake_completed()) {
+        fail("Peer handshake not completed: " + peer_id);
+        return;
+    }
+    if (!peer->typed_messages) {
+        fail("Peer does not accept binary rats messages: " + peer_id);
+        return;
+    }
+    
+    std::string our_peer_id = get_our_peer_id();
+    OutgoingRatsMessage message(message_type, data, our_peer_id);
+    if (!send_rats_message_to_peer(*peer, message)) {
+        fail("Failed to send message to peer: " + peer_id);
+        return;
+    }
+    
+    LOG_CLIENT_DEBUG("Sent raw message type '" << message_type << "' (" << data.size() << " bytes) to peer " << peer_id);
+    if (callback) {
+        callback(true, "");
+    }
+}
+
+// Message exchange system helpers
+void RatsClient::call_message_handlers(uint16_t type_id, const std::string& message_type, const std::string& peer_id,
+                                       const RatsMessagePayload& payload) {
+    TRACE_SPAN("message", "call_message_handlers");
+    
+    // The published table is immutable, so handlers are called straight from it
+    auto table = std::atomic_load(&message_handler_table_);
+    const MessageHandlerEntry* entry = nullptr;
+    if (table) {
+        auto id_it = table->find(type_id);
+        if (id_it != table->end()) {
+            for (const auto& candidate : id_it->second) {
+                if (candidate.message_type == message_type) {
+                    entry = &candidate;
+                    break;
                 }
             }
-            
-            // Update the handlers list (removes once handlers)
-            it->second = remaining_handlers;
-        } else {
-            LOG_CLIENT_WARN("No handlers registered for message type '" << message_type << "'");
         }
     }
+    if (!entry) {
+        LOG_CLIENT_DEBUG("No handlers registered for message type '" << message_type << "'");
+        return;
+    }
     
-    LOG_CLIENT_INFO("Found " << handlers_to_call.size() << " handlers for message type '" << message_type << "'");
+    LOG_CLIENT_DEBUG("Calling " << entry->handlers.size() << " handlers for message type '" << message_type << "' from peer " << peer_id);
     
-    // Call handlers outside of mutex to avoid deadlock
-    for (const auto& handler : handlers_to_call) {
+    bool once_fired = false;
+    for (const auto& handler : entry->handlers) {
+        // A once handler runs for the first message that claims it, even if dispatches race
+        if (handler.is_once()) {
+            if (handler.fired->exchange(true)) {
+                continue;
+            }
+            once_fired = true;
+        }
         try {
-            LOG_CLIENT_INFO("Calling handler for message type '" << message_type << "'");
-            handler.callback(peer_id, data);
-            LOG_CLIENT_INFO("Handler for message type '" << message_type << "' completed successfully");
+            if (handler.payload_callback) {
+                handler.payload_callback(peer_id, payload);
+            } else {
+                handler.callback(peer_id, payload.json());
+            }
+        } catch (const nlohmann::json::exception& e) {
+            LOG_CLIENT_ERROR("Invalid JSON payload for message type '" << message_type << "' from " << peer_id << ": " << e.what());
         } catch (const std::exception& e) {
             LOG_CLIENT_ERROR("Exception in message handler for type '" << message_type << "': " << e.what());
         } catch (...) {
@@ -2214,25 +3147,38 @@ void RatsClient::call_message_handlers(const std::string& message_type, const st
         }
     }
     
-    if (!handlers_to_call.empty()) {
-        LOG_CLIENT_INFO("Called " << handlers_to_call.size() << " handlers for message type '" << message_type << "'");
+    if (once_fired) {
+        remove_once_handlers(type_id, message_type);
     }
 }
 
-void RatsClient::remove_once_handlers(const std::string& message_type) {
+void RatsClient::remove_once_handlers(uint16_t type_id, const std::string& message_type) {
     std::lock_guard<std::mutex> lock(message_handlers_mutex_);
-    auto it = message_handlers_.find(message_type);
-    if (it != message_handlers_.end()) {
-        auto& handlers = it->second;
-        auto new_end = std::remove_if(handlers.begin(), handlers.end(), 
-                                     [](const MessageHandler& handler) { return handler.is_once; });
-        handlers.erase(new_end, handlers.end());
-        
+    auto current = std::atomic_load(&message_handler_table_);
+    if (!current || current->find(type_id) == current->end()) {
+        return;
+    }
+    
+    auto table = std::make_shared<MessageHandlerTable>(*current);
+    auto& entries = (*table)[type_id];
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->message_type != message_type) {
+            continue;
+        }
+        auto& handlers = it->handlers;
+        handlers.erase(std::remove_if(handlers.begin(), handlers.end(),
+                                      [](const MessageHandler& handler) { return handler.is_once() && handler.fired->load(); }),
+                       handlers.end());
         // Remove the entire entry if no handlers remain
         if (handlers.empty()) {
-            message_handlers_.erase(it);
+            entries.erase(it);
         }
+        break;
+    }
+    if (entries.empty()) {
+        table->erase(type_id);
     }
+    std::atomic_store(&message_handler_table_, std::shared_ptr<const MessageHandlerTable>(std::move(table)));
 }
 
 // =========================================================================
@@ -2251,52 +3197,99 @@ nlohmann::json RatsClient::create_rats_message(const std::string& type, const nl
     return message;
 }
 
+bool RatsClient::send_rats_message(socket_t socket, const std::string& type, const nlohmann::json& payload,
+                                   const std::string& sender_peer_id, SendPriority priority) {
+    // Peers past the handshake get the payload in their negotiated codec
+    auto peer = get_peer_snapshot()->find(socket);
+    if (peer && peer->is_handshake_completed()) {
+        try {
+            OutgoingRatsMessage message(type, payload, sender_peer_id);
+            return send_rats_message_to_peer(*peer, message, priority);
+        } catch (const std::exception& e) {
+            LOG_CLIENT_ERROR("Failed to serialize rats message '" << type << "': " << e.what());
+            return false;
+        }
+    }
+    return send_json_to_peer(socket, create_rats_message(type, payload, sender_peer_id), priority);
+}
+
 void RatsClient::handle_rats_message(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& message) {
     try {
         std::string message_type = message.value("type", "");
-        nlohmann::json payload = message.value("payload", nlohmann::json::object());
         std::string sender_peer_id = message.value("sender_peer_id", "");
+        RatsMessagePayload payload(message.value("payload", nlohmann::json::object()));
         
-        LOG_CLIENT_DEBUG("Received rats message type '" << message_type << "' from " << peer_hash_id);
-        
-        // Call registered message handlers for all message types (including custom ones)
-        call_message_handlers(message_type, sender_peer_id.empty() ? peer_hash_id : sender_peer_id, payload);
-        
-        // Handle built-in message types for internal functionality
-        if (message_type == "peer") {
-            handle_peer_exchange_message(socket, peer_hash_id, payload);
-        } 
-        else if (message_type == "peers_request") {
-            handle_peers_request_message(socket, peer_hash_id, payload);
-        }
-        else if (message_type == "peers_response") {
-            handle_peers_response_message(socket, peer_hash_id, payload);
-        }
-        // ICE coordination messages
-        else if (message_type == "ice_offer") {
-            handle_ice_offer_message(socket, peer_hash_id, payload);
-        }
-        else if (message_type == "ice_answer") {
-            handle_ice_answer_message(socket, peer_hash_id, payload);
-        }
-        else if (message_type == "ice_candidate") {
-            handle_ice_candidate_message(socket, peer_hash_id, payload);
-        }
-        // NAT traversal coordination messages
-        else if (message_type == "hole_punch_coordination") {
-            handle_hole_punch_coordination_message(socket, peer_hash_id, payload);
-        }
-        else if (message_type == "nat_info_exchange") {
-            handle_nat_info_exchange_message(socket, peer_hash_id, payload);
-        }
-        // Custom message types are now handled by registered handlers above
-        // No need for else clause - all message types are valid if they have registered handlers
-        
+        dispatch_rats_message(socket, peer_hash_id, rats_message_type::id_of(message_type), message_type, sender_peer_id, payload);
     } catch (const nlohmann::json::exception& e) {
         LOG_CLIENT_ERROR("Failed to handle rats message: " << e.what());
     }
 }
 
+void RatsClient::dispatch_rats_message(socket_t socket, const std::string& peer_hash_id, uint16_t type_id,
+                                       const std::string& message_type, const std::string& sender_peer_id,
+                                       const RatsMessagePayload& payload) {
+    LOG_CLIENT_DEBUG("Received rats message type '" << message_type << "' from " << peer_hash_id);
+    
+    // Call registered message handlers for all message types (including custom ones), in order per connection
+    auto table = std::atomic_load(&message_handler_table_);
+    if (table && table->find(type_id) != table->end()) {
+        const std::string& handler_peer_id = sender_peer_id.empty() ? peer_hash_id : sender_peer_id;
+        run_callback(peer_hash_id, [this, type_id, message_type, handler_peer_id, payload]() {
+            call_message_handlers(type_id, message_type, handler_peer_id, payload);
+        });
+    }
+    
+    // Handle built-in message types for internal functionality
+    if (type_id & rats_message_type::CUSTOM_FLAG) {
+        return;
+    }
+    try {
+        switch (type_id) {
+            case rats_message_type::PEER:
+                handle_peer_exchange_message(socket, peer_hash_id, payload.json());
+                break;
+            case rats_message_type::PEERS_REQUEST:
+                handle_peers_request_message(socket, peer_hash_id, payload.json());
+                break;
+            case rats_message_type::PEERS_RESPONSE:
+                handle_peers_response_message(socket, peer_hash_id, payload.json());
+                break;
+            // ICE coordination messages
+            case rats_message_type::ICE_OFFER:
+                handle_ice_offer_message(socket, peer_hash_id, payload.json());
+                break;
+            case rats_message_type::ICE_ANSWER:
+                handle_ice_answer_message(socket, peer_hash_id, payload.json());
+                break;
+            case rats_message_type::ICE_CANDIDATE:
+                handle_ice_candidate_message(socket, peer_hash_id, payload.json());
+                break;
+            // NAT traversal coordination messages
+            case rats_message_type::HOLE_PUNCH_COORDINATION:
+                handle_hole_punch_coordination_message(socket, peer_hash_id, payload.json());
+                break;
+            case rats_message_type::NAT_INFO_EXCHANGE:
+                handle_nat_info_exchange_message(socket, peer_hash_id, payload.json());
+                break;
+            // Request/response
+            case rats_message_type::RPC_REQUEST:
+                // The handler is application code; the response goes out from wherever it runs
+                run_callback(peer_hash_id, [this, socket, peer_hash_id, request = payload.json()]() {
+                    handle_rpc_request(socket, peer_hash_id, request);
+                });
+                break;
+            case rats_message_type::RPC_RESPONSE:
+                handle_rpc_response(peer_hash_id, payload.json());
+                break;
+            default:
+                // Other built-in types (hole_punch_response) are consumed by registered handlers only
+                break;
+        }
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Failed to handle rats message '" << message_type << "': " << e.what());
+    }
+}
+
 void RatsClient::handle_peer_exchange_message(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& payload) {
     try {
         std::string peer_ip = payload.value("ip", "");
@@ -2330,13 +3323,13 @@ void RatsClient::handle_peer_exchange_message(socket_t socket, const std::string
         }
         
         // Try to connect to the exchanged peer (non-blocking)
-        add_managed_thread(std::thread([this, peer_ip, peer_port, peer_id]() {
+        submit_task([this, peer_ip, peer_port, peer_id]() {
             if (connect_to_peer(peer_ip, peer_port)) {
                 LOG_CLIENT_INFO("Successfully connected to exchanged peer: " << peer_ip << ":" << peer_port);
             } else {
                 LOG_CLIENT_DEBUG("Failed to connect to exchanged peer: " << peer_ip << ":" << peer_port);
             }
-        }), "peer-exchange-connect-" + peer_id.substr(0, 8));
+        }, "peer-exchange-connect-" + peer_id.substr(0, 8));
         
     } catch (const nlohmann::json::exception& e) {
         LOG_CLIENT_ERROR("Failed to handle peer exchange message: " << e.what());
@@ -2346,54 +3339,46 @@ void RatsClient::handle_peer_exchange_message(socket_t socket, const std::string
 // General broadcasting functions
 int RatsClient::broadcast_rats_message(const nlohmann::json& message, const std::string& exclude_peer_id) {
     int sent_count = 0;
-    {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
-        for (const auto& pair : peers_) {
-            const RatsPeer& peer = pair.second;
-            // Don't send to excluded peer
-            if (!exclude_peer_id.empty() && peer.peer_id == exclude_peer_id) {
-                continue;
-            }
-            
-            if (send_json_to_peer(peer.socket, message)) {
-                sent_count++;
-            }
+    auto snapshot = get_peer_snapshot();
+    for (const auto& peer : snapshot->peers) {
+        // Don't send to excluded peer
+        if (!exclude_peer_id.empty() && peer->peer_id == exclude_peer_id) {
+            continue;
+        }
+        
+        if (send_json_to_peer(peer->socket, message)) {
+            sent_count++;
         }
     }
     return sent_count;
 }
 
-int RatsClient::broadcast_rats_message_to_validated_peers(const nlohmann::json& message, const std::string& exclude_peer_id) {
+int RatsClient::broadcast_rats_message_to_validated_peers(const nlohmann::json& message, const std::string& exclude_peer_id,
+                                                          SendPriority priority) {
     int sent_count = 0;
-    {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
-        for (const auto& pair : peers_) {
-            const RatsPeer& peer = pair.second;
-            // Don't send to excluded peer and only send to peers with completed handshake
-            if ((!exclude_peer_id.empty() && peer.peer_id == exclude_peer_id) || 
-                !peer.is_handshake_completed()) {
-                continue;
-            }
-            
-            if (send_json_to_peer(peer.socket, message)) {
-                sent_count++;
-            }
+    auto snapshot = get_peer_snapshot();
+    for (const auto& peer : snapshot->peers) {
+        // Don't send to excluded peer and only send to peers with completed handshake
+        if ((!exclude_peer_id.empty() && peer->peer_id == exclude_peer_id) || 
+            !peer->is_handshake_completed()) {
+            continue;
+        }
+        
+        if (send_json_to_peer(peer->socket, message, priority)) {
+            sent_count++;
         }
     }
     return sent_count;
 }
 
-// Specific message creation functions
-nlohmann::json RatsClient::create_peer_exchange_message(const RatsPeer& peer) {
-    // Create peer exchange payload
+// Specific message payload creation functions
+nlohmann::json RatsClient::create_peer_exchange_payload(const RatsPeer& peer) {
     nlohmann::json payload;
     payload["ip"] = peer.ip;
     payload["port"] = peer.port;
     payload["peer_id"] = peer.peer_id;
     payload["connection_type"] = peer.is_outgoing ? "outgoing" : "incoming";
-    
-    // Create rats message
-    return create_rats_message("peer", payload, peer.peer_id);
+    return payload;
 }
 
 void RatsClient::broadcast_peer_exchange_message(const RatsPeer& new_peer) {
@@ -2402,29 +3387,42 @@ void RatsClient::broadcast_peer_exchange_message(const RatsPeer& new_peer) {
         return;
     }
     
-    // Create peer exchange message
-    nlohmann::json message = create_peer_exchange_message(new_peer);
+    nlohmann::json payload = create_peer_exchange_payload(new_peer);
     
-    // Broadcast to all validated peers except the new peer
-    int sent_count = broadcast_rats_message_to_validated_peers(message, new_peer.peer_id);
+    // Broadcast to all validated peers except the new peer, encoding once per codec in use
+    int sent_count = 0;
+    try {
+        const std::string type = "peer";
+        OutgoingRatsMessage message(type, payload, new_peer.peer_id);
+        auto snapshot = get_peer_snapshot();
+        for (const auto& peer : snapshot->peers) {
+            if (peer->peer_id == new_peer.peer_id || !peer->is_handshake_completed()) {
+                continue;
+            }
+            if (send_rats_message_to_peer(*peer, message, SendPriority::CONTROL)) {
+                sent_count++;
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_CLIENT_ERROR("Failed to serialize peer exchange message: " << e.what());
+    }
     
     LOG_CLIENT_INFO("Broadcasted peer exchange message for " << new_peer.ip << ":" << new_peer.port 
                     << " to " << sent_count << " peers");
 }
 
 // Peers request/response system implementation
-nlohmann::json RatsClient::create_peers_request_message(const std::string& sender_peer_id) {
+nlohmann::json RatsClient::create_peers_request_payload() {
     nlohmann::json payload;
     payload["max_peers"] = 5;  // Request up to 5 peers
     payload["requester_info"] = {
         {"listen_port", listen_port_},
         {"peer_count", get_peer_count()}
     };
-    
-    return create_rats_message("peers_request", payload, sender_peer_id);
+    return payload;
 }
 
-nlohmann::json RatsClient::create_peers_response_message(const std::vector<RatsPeer>& peers, const std::string& sender_peer_id) {
+nlohmann::json RatsClient::create_peers_response_payload(const std::vector<RatsPeer>& peers) {
     nlohmann::json payload;
     nlohmann::json peers_array = nlohmann::json::array();
     
@@ -2439,8 +3437,7 @@ nlohmann::json RatsClient::create_peers_response_message(const std::vector<RatsP
     
     payload["peers"] = peers_array;
     payload["total_peers"] = get_peer_count();
-    
-    return create_rats_message("peers_response", payload, sender_peer_id);
+    return payload;
 }
 
 
@@ -2456,9 +3453,9 @@ void RatsClient::handle_peers_request_message(socket_t socket, const std::string
         LOG_CLIENT_DEBUG("Sending " << random_peers.size() << " peers to " << peer_hash_id);
         
         // Create and send peers response
-        nlohmann::json response_message = create_peers_response_message(random_peers, peer_hash_id);
+        nlohmann::json response_payload = create_peers_response_payload(random_peers);
         
-        if (!send_json_to_peer(socket, response_message)) {
+        if (!send_rats_message(socket, "peers_response", response_payload, peer_hash_id)) {
             LOG_CLIENT_ERROR("Failed to send peers response to " << peer_hash_id);
         } else {
             LOG_CLIENT_DEBUG("Sent peers response with " << random_peers.size() << " peers to " << peer_hash_id);
@@ -2511,13 +3508,13 @@ void RatsClient::handle_peers_response_message(socket_t socket, const std::strin
             
             // Try to connect to the peer (non-blocking)
             LOG_CLIENT_INFO("Attempting to connect to peer from response: " << peer_ip << ":" << peer_port);
-            add_managed_thread(std::thread([this, peer_ip, peer_port, peer_id]() {
+            submit_task([this, peer_ip, peer_port, peer_id]() {
                 if (connect_to_peer(peer_ip, peer_port)) {
                     LOG_CLIENT_INFO("Successfully connected to peer from response: " << peer_ip << ":" << peer_port);
                 } else {
                     LOG_CLIENT_DEBUG("Failed to connect to peer from response: " << peer_ip << ":" << peer_port);
                 }
-            }), "peer-response-connect-" + peer_id.substr(0, 8));
+            }, "peer-response-connect-" + peer_id.substr(0, 8));
         }
         
     } catch (const nlohmann::json::exception& e) {
@@ -2526,9 +3523,7 @@ void RatsClient::handle_peers_response_message(socket_t socket, const std::strin
 }
 
 void RatsClient::send_peers_request(socket_t socket, const std::string& our_peer_id) {
-    nlohmann::json request_message = create_peers_request_message(our_peer_id);
-    
-    if (send_json_to_peer(socket, request_message)) {
+    if (send_rats_message(socket, "peers_request", create_peers_request_payload(), our_peer_id)) {
         LOG_CLIENT_INFO("Sent peers request to socket " << socket);
     } else {
         LOG_CLIENT_ERROR("Failed to send peers request to socket " << socket);
@@ -2543,9 +3538,9 @@ nlohmann::json RatsClient::get_connection_statistics() const {
     nlohmann::json stats;
     
     {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
-        stats["total_peers"] = peers_.size();
-        stats["validated_peers"] = get_peer_count_unlocked();
+        auto snapshot = get_peer_snapshot();
+        stats["total_peers"] = snapshot->peers.size();
+        stats["validated_peers"] = snapshot->validated_count;
         stats["max_peers"] = max_peers_;
     }
     
@@ -2569,6 +3564,26 @@ nlohmann::json RatsClient::get_connection_statistics() const {
     return stats;
 }
 
+std::string RatsClient::get_metrics_prometheus() const {
+    return MetricsRegistry::getInstance().export_prometheus();
+}
+
+void RatsClient::set_tracing_enabled(bool enabled) {
+    Tracer::getInstance().set_enabled(enabled);
+}
+
+bool RatsClient::is_tracing_enabled() const {
+    return Tracer::getInstance().is_enabled();
+}
+
+std::string RatsClient::export_trace_json() const {
+    return Tracer::getInstance().export_chrome_trace();
+}
+
+bool RatsClient::write_trace_file(const std::string& path) const {
+    return Tracer::getInstance().write_chrome_trace(path);
+}
+
 
 // =========================================================================
 // Helper functions
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "socket.h"
+#include "buffer.h"
+#include "rats_message.h"
 #include "dht.h"
 #include "stun.h"
 #include "mdns.h"
@@ -8,13 +10,21 @@
 #include "logger.h"
 #include "encrypted_socket.h"
 #include "threadmanager.h"
+#include "reactor.h"
+#include "utp.h"
+#include "send_queue.h"
+#include "callback_executor.h"
+#include "timer_wheel.h"
+#include "stream_mux.h"
 #include "gossipsub.h" // For ValidationResult enum and GossipSub types
 #include "file_transfer.h" // File transfer functionality
+#include "peer_store.h"
 #include "json.hpp" // nlohmann::json
 #include <string>
 #include <functional>
 #include <thread>
 #include <vector>
+#include <array>
 #include <mutex>
 #include <atomic>
 #include <unordered_map>
@@ -24,6 +34,7 @@
 #include <unordered_set> // Added for unordered_set
 #include <cstdint>
 #include <cstring>
+#include <future>
 #include "rats_export.h"
 
 namespace librats {
@@ -55,6 +66,9 @@ struct RatsPeer {
     std::string version;                    // Protocol version of remote peer
     int peer_count;                         // Number of peers connected to remote peer
     std::chrono::steady_clock::time_point handshake_start_time; // When handshake started
+    bool typed_messages;                    // Peer accepts rats messages in binary envelopes
+    std::shared_ptr<const PayloadCodec> send_codec; // Codec for payloads we send to the peer (negotiated in handshake)
+    uint8_t send_codec_id;                  // Wire id of send_codec (payload_encoding)
     
     // Encryption-related fields
     bool encryption_enabled;                // Whether encryption is enabled for this peer
@@ -76,7 +90,8 @@ struct RatsPeer {
     std::string transport_protocol;         // UDP, TCP, etc.
     
     RatsPeer() : handshake_state(HandshakeState::PENDING), 
-                 peer_count(0), encryption_enabled(false), noise_handshake_completed(false),
+                 peer_count(0), typed_messages(false), send_codec_id(payload_encoding::JSON),
+                 encryption_enabled(false), noise_handshake_completed(false),
                  ice_enabled(false), ice_state(IceConnectionState::NEW),
                  detected_nat_type(NatType::UNKNOWN), rtt_ms(0), packet_loss_percent(0),
                  transport_protocol("UDP") {
@@ -88,7 +103,8 @@ struct RatsPeer {
              socket_t sock, const std::string& norm_addr, bool outgoing)
         : peer_id(id), ip(peer_ip), port(peer_port), socket(sock), 
           normalized_address(norm_addr), is_outgoing(outgoing),
-          handshake_state(HandshakeState::PENDING), peer_count(0),
+          handshake_state(HandshakeState::PENDING), peer_count(0), typed_messages(false),
+          send_codec_id(payload_encoding::JSON),
           encryption_enabled(false), noise_handshake_completed(false),
           ice_enabled(false), ice_state(IceConnectionState::NEW),
           detected_nat_type(NatType::UNKNOWN), rtt_ms(0), packet_loss_percent(0),
@@ -109,6 +125,12 @@ struct RatsPeer {
     }
 };
 
+// Transport used for peer connections
+enum class PeerTransport {
+    TCP,                // TCP only
+    UTP                 // uTP over UDP on the listen port, falling back to TCP; both are accepted
+};
+
 // NAT Traversal Configuration
 struct NatTraversalConfig {
     bool enable_ice;                        // Enable ICE for NAT traversal
@@ -116,6 +138,8 @@ struct NatTraversalConfig {
     bool enable_hole_punching;              // Enable UDP/TCP hole punching
     bool enable_turn_relay;                 // Enable TURN relay as last resort
     bool prefer_ipv6;                       // Prefer IPv6 connections when available
+    PeerTransport transport;                // Transport for peer connections
+    int utp_connect_timeout_ms;             // Wait for a uTP connection before falling back to TCP
     
     // ICE configuration
     std::vector<std::string> stun_servers;
@@ -137,6 +161,7 @@ struct NatTraversalConfig {
     NatTraversalConfig() 
         : enable_ice(true), enable_upnp(false), enable_hole_punching(true),
           enable_turn_relay(true), prefer_ipv6(false),
+          transport(PeerTransport::TCP), utp_connect_timeout_ms(3000),
           ice_gathering_timeout_ms(10000), ice_connectivity_timeout_ms(30000),
           hole_punch_attempts(5), turn_allocation_timeout_ms(10000),
           host_candidate_priority(65535), server_reflexive_priority(65534),
@@ -149,6 +174,26 @@ struct NatTraversalConfig {
     }
 };
 
+// Budgets of the caches that grow with traffic rather than with connected peers.
+// Changes apply to running subsystems at once, dropping what no longer fits.
+// GossipSub's caches are bounded by GossipSubConfig (message_cache_max_*, seen_filter_capacity).
+struct ResourceLimits {
+    size_t dht_max_stored_info_hashes;      // Info hashes other nodes announced that we keep peers for
+    size_t dht_max_peers_per_info_hash;     // Announced peers kept per info hash, oldest dropped first
+    size_t dht_max_pending_searches;        // DHT lookups running at once, the oldest is ended to make room
+    size_t mdns_max_services;               // Discovered mDNS services, the one closest to expiring dropped first
+    size_t file_transfer_max_history;       // Finished transfers kept, least recently updated dropped first
+    std::chrono::seconds file_transfer_history_lifetime; // Finished transfers are forgotten after this long (0 = never)
+    
+    ResourceLimits()
+        : dht_max_stored_info_hashes(DHT_MAX_STORED_INFO_HASHES),
+          dht_max_peers_per_info_hash(DHT_MAX_PEERS_PER_INFO_HASH),
+          dht_max_pending_searches(DHT_MAX_PENDING_SEARCHES),
+          mdns_max_services(MDNS_MAX_CACHED_SERVICES),
+          file_transfer_max_history(FILE_TRANSFER_MAX_HISTORY),
+          file_transfer_history_lifetime(std::chrono::duration_cast<std::chrono::seconds>(FILE_TRANSFER_HISTORY_LIFETIME)) {}
+};
+
 // Connection establishment strategies
 enum class ConnectionStrategy {
     DIRECT_ONLY,        // Try direct connection only
@@ -169,6 +214,20 @@ struct ConnectionAttemptResult {
     std::vector<IceCandidate> used_candidates;
 };
 
+// Decayed outcome counters of one connection method, learned from past attempts
+struct LearnedStrategyStats {
+    double successes = 0.0;                 // Success count, halved every half-life
+    double failures = 0.0;                  // Failure count, halved every half-life
+    int64_t last_update = 0;                // Unix time (seconds) the counters were last decayed
+};
+
+// Learned connection methods for one peer address or subnet
+struct StrategyCacheEntry {
+    std::unordered_map<std::string, LearnedStrategyStats> methods;  // keyed by method ("direct", "ice", ...)
+    uint32_t selections = 0;                // Times the cache picked a method, drives re-probing
+    int64_t last_update = 0;                // Unix time (seconds) of the last recorded attempt
+};
+
 // Enhanced connection callbacks
 using AdvancedConnectionCallback = std::function<void(socket_t, const std::string&, const ConnectionAttemptResult&)>;
 using NatTraversalProgressCallback = std::function<void(const std::string&, const std::string&)>; // peer_id, status
@@ -180,7 +239,9 @@ using IceCandidateDiscoveredCallback = std::function<void(const std::string&, co
 enum class MessageDataType : uint8_t {
     BINARY = 0x01,      // Raw binary data
     STRING = 0x02,      // UTF-8 string data  
-    JSON = 0x03         // JSON formatted data
+    JSON = 0x03,        // JSON formatted data
+    STREAM = 0x04,      // Multiplexed stream frame (see StreamMuxer)
+    RATS = 0x05         // Rats message in a binary envelope (see RatsEnvelope)
 };
 
 /**
@@ -209,23 +270,33 @@ struct MessageHeader {
     // Serialize header to bytes
     std::vector<uint8_t> serialize() const {
         std::vector<uint8_t> data(HEADER_SIZE);
+        serialize_to(data.data());
+        return data;
+    }
+    
+    // Serialize header into a caller-provided buffer of at least HEADER_SIZE bytes
+    void serialize_to(uint8_t* data) const {
         uint32_t network_magic = htonl(magic);
-        memcpy(data.data(), &network_magic, 4);
+        memcpy(data, &network_magic, 4);
         data[4] = static_cast<uint8_t>(type);
         data[5] = reserved[0];
         data[6] = reserved[1]; 
         data[7] = reserved[2];
-        return data;
     }
     
     // Deserialize header from bytes
     static bool deserialize(const std::vector<uint8_t>& data, MessageHeader& header) {
-        if (data.size() < HEADER_SIZE) {
+        return deserialize(data.data(), data.size(), header);
+    }
+    
+    // Deserialize header from the start of a byte range (no copy)
+    static bool deserialize(const uint8_t* data, size_t size, MessageHeader& header) {
+        if (size < HEADER_SIZE) {
             return false;
         }
         
         uint32_t network_magic;
-        memcpy(&network_magic, data.data(), 4);
+        memcpy(&network_magic, data, 4);
         header.magic = ntohl(network_magic);
         
         if (header.magic != MAGIC_NUMBER) {
@@ -244,7 +315,9 @@ struct MessageHeader {
     bool is_valid_type() const {
         return type == MessageDataType::BINARY || 
                type == MessageDataType::STRING || 
-               type == MessageDataType::JSON;
+               type == MessageDataType::JSON ||
+               type == MessageDataType::STREAM ||
+               type == MessageDataType::RATS;
     }
 };
 
@@ -258,11 +331,19 @@ public:
     // =========================================================================
     using ConnectionCallback = std::function<void(socket_t, const std::string&)>;
     using BinaryDataCallback = std::function<void(socket_t, const std::string&, const std::vector<uint8_t>&)>;
+    using BinaryDataViewCallback = std::function<void(socket_t, const std::string&, const SharedBuffer&)>;
     using StringDataCallback = std::function<void(socket_t, const std::string&, const std::string&)>;
     using JsonDataCallback = std::function<void(socket_t, const std::string&, const nlohmann::json&)>;
     using DisconnectCallback = std::function<void(socket_t, const std::string&)>;
     using MessageCallback = std::function<void(const std::string&, const nlohmann::json&)>;
+    using PayloadCallback = std::function<void(const std::string&, const RatsMessagePayload&)>;       // peer_id, lazily parsed payload
+    using BytesCallback = std::function<void(const std::string&, const SharedBuffer&)>;               // peer_id, payload bytes
     using SendCallback = std::function<void(bool, const std::string&)>;
+    using RequestHandler = std::function<nlohmann::json(const std::string&, const nlohmann::json&)>;           // peer_id, params -> result
+    using ResponseCallback = std::function<void(bool, const nlohmann::json&, const std::string&)>;           // success, result, error
+    using StreamOpenedCallback = std::function<void(const std::string&, uint32_t)>;                       // peer_id, stream_id
+    using StreamDataCallback = std::function<void(const std::string&, uint32_t, const std::vector<uint8_t>&)>; // peer_id, stream_id, data
+    using StreamClosedCallback = std::function<void(const std::string&, uint32_t)>;                       // peer_id, stream_id
 
     // =========================================================================
     // Constructor and Destructor
@@ -373,9 +454,11 @@ public:
      * @param socket Target peer socket
      * @param data Binary data to send
      * @param message_type Type of message data (BINARY, STRING, JSON)
-     * @return true if sent successfully
+     * @param priority Scheduling class on the peer's outbound queue (CONTROL, DATA or BULK)
+     * @return true if sent successfully (queued on the peer's outbound queue for connected peers)
      */
-    bool send_binary_to_peer(socket_t socket, const std::vector<uint8_t>& data, MessageDataType message_type = MessageDataType::BINARY);
+    bool send_binary_to_peer(socket_t socket, const std::vector<uint8_t>& data, MessageDataType message_type = MessageDataType::BINARY,
+                             SendPriority priority = SendPriority::DATA);
 
     /**
      * Send string data to a specific peer
@@ -389,9 +472,10 @@ public:
      * Send JSON data to a specific peer
      * @param socket Target peer socket
      * @param data JSON data to send
+     * @param priority Scheduling class on the peer's outbound queue
      * @return true if sent successfully
      */
-    bool send_json_to_peer(socket_t socket, const nlohmann::json& data);
+    bool send_json_to_peer(socket_t socket, const nlohmann::json& data, SendPriority priority = SendPriority::DATA);
 
     // Send to specific peer by ID
     /**
@@ -399,9 +483,28 @@ public:
      * @param peer_id Target peer ID
      * @param data Binary data to send
      * @param message_type Type of message data (BINARY, STRING, JSON)
+     * @param priority Scheduling class on the peer's outbound queue
      * @return true if sent successfully
      */
-    bool send_binary_to_peer_id(const std::string& peer_id, const std::vector<uint8_t>& data, MessageDataType message_type = MessageDataType::BINARY);
+    bool send_binary_to_peer_id(const std::string& peer_id, const std::vector<uint8_t>& data, MessageDataType message_type = MessageDataType::BINARY,
+                                SendPriority priority = SendPriority::DATA);
+
+    /**
+     * Send a binary message made of data followed by a range of a file.
+     * On unencrypted connections the file bytes go from the page cache to the socket
+     * (sendfile, TransmitFile) without passing through a user-space buffer; with
+     * encryption they are read into the message before it is encrypted.
+     * @param peer_id Target peer ID
+     * @param data Leading bytes of the message, e.g. a frame header
+     * @param file Open file, kept alive until the message is written
+     * @param offset File offset of the first byte
+     * @param size Number of file bytes
+     * @param priority Scheduling class on the peer's outbound queue
+     * @return true if sent successfully
+     */
+    bool send_file_region_to_peer_id(const std::string& peer_id, const std::vector<uint8_t>& data,
+                                     const std::shared_ptr<FileHandle>& file, uint64_t offset, uint32_t size,
+                                     SendPriority priority = SendPriority::BULK);
 
     /**
      * Send string data to a peer by peer_id (preferred)
@@ -419,6 +522,18 @@ public:
      */
     bool send_json_to_peer_id(const std::string& peer_id, const nlohmann::json& data);
 
+    /**
+     * Send the same payload to several peers by peer_id.
+     * The payload is not copied: every peer's outbound queue references the same bytes.
+     * @param peer_ids Target peer IDs (unknown peers and peers without completed handshake are skipped)
+     * @param data Payload to send
+     * @param message_type Type of message data (BINARY, STRING, JSON)
+     * @param priority Scheduling class on the peers' outbound queues
+     * @return Number of peers the payload was queued for
+     */
+    int send_binary_to_peer_ids(const std::vector<std::string>& peer_ids, const SharedBuffer& data, MessageDataType message_type = MessageDataType::BINARY,
+                                SendPriority priority = SendPriority::DATA);
+
     // Broadcast to all peers
     /**
      * Broadcast binary data to all connected peers (primary method)
@@ -428,6 +543,14 @@ public:
      */
     int broadcast_binary_to_peers(const std::vector<uint8_t>& data, MessageDataType message_type = MessageDataType::BINARY);
 
+    /**
+     * Broadcast a shared payload to all connected peers without copying it
+     * @param data Payload to broadcast
+     * @param message_type Type of message data (BINARY, STRING, JSON)
+     * @return Number of peers the data was sent to
+     */
+    int broadcast_binary_to_peers(const SharedBuffer& data, MessageDataType message_type = MessageDataType::BINARY);
+
     /**
      * Broadcast string data to all connected peers
      * @param data String data to broadcast
@@ -442,6 +565,197 @@ public:
      */
     int broadcast_json_to_peers(const nlohmann::json& data);
 
+    // =========================================================================
+    // Outbound Send Queues
+    // =========================================================================
+    
+    /**
+     * Configure the per-peer outbound queues (capacity, coalescing and backpressure policy).
+     * Applies to connections established afterwards; writer_threads takes effect on the next start().
+     * @param config Send queue configuration
+     */
+    void set_send_queue_config(const SendQueueConfig& config);
+
+    /**
+     * Get the per-peer outbound queue configuration
+     * @return Current send queue configuration
+     */
+    SendQueueConfig get_send_queue_config() const;
+
+    /**
+     * Get the outbound queue statistics of a peer
+     * @param peer_id Target peer ID
+     * @return Queue statistics (all zero if the peer is not connected)
+     */
+    SendQueueStats get_peer_send_queue_stats(const std::string& peer_id) const;
+
+    /**
+     * Get the number of messages waiting in a peer's outbound queue
+     * @param peer_id Target peer ID
+     * @return Queue depth (0 if the peer is not connected)
+     */
+    size_t get_peer_send_queue_depth(const std::string& peer_id) const;
+
+    /**
+     * Wait until a peer's outbound queue has been written to the socket
+     * @param peer_id Target peer ID
+     * @param timeout Maximum time to wait
+     * @return true if the queue is empty, false on timeout or if the peer is not connected
+     */
+    bool flush_peer_send_queue(const std::string& peer_id, std::chrono::milliseconds timeout);
+
+    // =========================================================================
+    // Callback Execution
+    // =========================================================================
+    
+    /**
+     * Configure where application callbacks run. With threads > 0, data callbacks, message
+     * and request handlers, connection/disconnect callbacks and GossipSub handlers are handed
+     * off the I/O threads to a worker pool, in order per peer (GossipSub: per topic).
+     * threads = 0 runs them inline on the I/O thread, which has the lowest latency but lets
+     * a slow callback stall reads. Takes effect on the next start().
+     * Stream callbacks and response callbacks always run inline.
+     * @param config Callback executor configuration
+     */
+    void set_callback_executor_config(const CallbackExecutorConfig& config);
+
+    /**
+     * Get the callback executor configuration
+     * @return Current callback executor configuration
+     */
+    CallbackExecutorConfig get_callback_executor_config() const;
+
+    /**
+     * Configure sharded I/O. With shards > 0 the client runs that many reactor threads and
+     * as many send queue writer threads, each writer owning the connections of one socket
+     * shard, and optionally pins both to the same CPUs so a connection is read and written
+     * on one core. Takes effect on the next start().
+     * @param config I/O shard configuration
+     */
+    void set_io_shard_config(const IoShardConfig& config);
+
+    /**
+     * Get the I/O shard configuration
+     * @return Current I/O shard configuration
+     */
+    IoShardConfig get_io_shard_config() const;
+
+    /**
+     * Get the number of callbacks waiting for an executor thread
+     * @return Queued callback count (0 when callbacks run inline)
+     */
+    size_t get_queued_callback_count() const;
+
+    /**
+     * Run an application callback behind the earlier callbacks of the same key
+     * (inline if the callback executor is not running)
+     * @param key Ordering key (a peer ID, or "topic:" + topic for GossipSub)
+     * @param task Callback to run
+     */
+    void run_callback(const std::string& key, std::function<void()> task);
+
+    // =========================================================================
+    // Resource Budgets
+    // =========================================================================
+    
+    /**
+     * Set the budgets of the caches that grow with traffic. Running subsystems are trimmed
+     * at once; DHT and mDNS started later pick the limits up when they start.
+     * @param limits Resource limits
+     */
+    void set_resource_limits(const ResourceLimits& limits);
+
+    /**
+     * Get the resource limits
+     * @return Current resource limits
+     */
+    ResourceLimits get_resource_limits() const;
+
+    /**
+     * Get the memory held by each bounded cache of the running subsystems
+     * @return JSON object keyed by cache ("dht.announced_peers", "mdns.services", ...), each with
+     *         entries, bytes, max_entries, max_bytes and evictions, plus total_bytes over all of them
+     */
+    nlohmann::json get_resource_usage() const;
+
+    // =========================================================================
+    // Multiplexed Streams
+    // =========================================================================
+    
+    /**
+     * Configure stream flow control (window and frame size).
+     * Applies to peers whose first stream is opened afterwards.
+     * @param config Stream configuration
+     */
+    void set_stream_config(const StreamConfig& config);
+
+    /**
+     * Get the stream configuration
+     * @return Current stream configuration
+     */
+    StreamConfig get_stream_config() const;
+
+    /**
+     * Open a logical stream to a connected peer over its existing connection.
+     * Streams have their own flow-control windows, so a bulk transfer on one stream
+     * does not hold back messages or other streams to the same peer.
+     * @param peer_id Target peer ID
+     * @param priority Send queue class of the stream's data (BULK for large transfers)
+     * @return Stream ID, or 0 if the peer is not connected or has too many streams
+     */
+    uint32_t open_stream(const std::string& peer_id, SendPriority priority = SendPriority::DATA);
+
+    /**
+     * Write to a stream, blocking while the peer's receive window is full.
+     * Do not call from a stream or message callback: window updates arrive on that thread.
+     * @param peer_id Target peer ID
+     * @param stream_id Stream ID
+     * @param data Data to write
+     * @return true if all data was queued
+     */
+    bool write_stream(const std::string& peer_id, uint32_t stream_id, const std::vector<uint8_t>& data);
+
+    /**
+     * Half-close a stream: the peer sees the end of data, incoming data is still delivered
+     * @param peer_id Target peer ID
+     * @param stream_id Stream ID
+     * @return true if the close was sent
+     */
+    bool close_stream(const std::string& peer_id, uint32_t stream_id);
+
+    /**
+     * Abort a stream in both directions
+     * @param peer_id Target peer ID
+     * @param stream_id Stream ID
+     * @return true if the stream existed
+     */
+    bool reset_stream(const std::string& peer_id, uint32_t stream_id);
+
+    /**
+     * Get the number of open streams with a peer
+     * @param peer_id Target peer ID
+     * @return Stream count
+     */
+    size_t get_stream_count(const std::string& peer_id) const;
+
+    /**
+     * Set callback for streams opened by peers
+     * @param callback Function called with the peer ID and stream ID
+     */
+    void on_stream_opened(StreamOpenedCallback callback);
+
+    /**
+     * Set callback for stream data, delivered in order per stream
+     * @param callback Function called with the peer ID, stream ID and data
+     */
+    void on_stream_data(StreamDataCallback callback);
+
+    /**
+     * Set callback for streams that ended (closed by both sides, reset, or disconnected)
+     * @param callback Function called with the peer ID and stream ID
+     */
+    void on_stream_closed(StreamClosedCallback callback);
+
     // =========================================================================
     // Peer Information and Management
     // =========================================================================
@@ -539,6 +853,14 @@ public:
      */
     void set_binary_data_callback(BinaryDataCallback callback);
 
+    /**
+     * Set binary data callback receiving the payload without copying it
+     * The SharedBuffer views the receive buffer; keep a copy of it to retain the data.
+     * Takes precedence over the callback set with set_binary_data_callback.
+     * @param callback Function to call when binary data is received
+     */
+    void set_binary_data_view_callback(BinaryDataViewCallback callback);
+
     /**
      * Set string data callback (called when string data is received)
      * @param callback Function to call when string data is received
@@ -589,8 +911,8 @@ public:
     /**
      * Find peers by content hash using DHT
      * @param content_hash Hash to search for (40-character hex string)
-     * @param callback Function to call with discovered peers
-     * @param iteration_max Maximum DHT iterations (default: 1)
+     * @param callback Function to call with discovered peers, once per batch as the lookup finds them
+     * @param iteration_max Maximum DHT hops away from our routing table (default: 1)
      * @return true if search initiated successfully
      */
     bool find_peers_by_hash(const std::string& content_hash, 
@@ -736,6 +1058,16 @@ public:
      * @return JSON object with NAT traversal statistics
      */
     nlohmann::json get_nat_traversal_statistics() const;
+    
+    /**
+     * Get the connection method learned from past attempts to a peer.
+     * The peer's own history is used first, then that of its subnet (/24 for IPv4, /48 for IPv6).
+     * AUTO_ADAPTIVE connections start with this method when it is set.
+     * @param host Peer IP address
+     * @param port Peer port
+     * @return Method name ("direct", "stun", "ice", "turn", "hole_punch"), or empty if nothing is learned
+     */
+    std::string get_learned_connection_strategy(const std::string& host, int port) const;
 
     // =========================================================================
     // Protocol Configuration
@@ -753,6 +1085,20 @@ public:
      */
     void set_protocol_version(const std::string& protocol_version);
 
+    /**
+     * Set the payload codecs offered in handshakes, most preferred first.
+     * Each peer encodes rats message payloads with the first of its codecs the other side offers;
+     * peers that offer none of them exchange JSON. Call before start().
+     * @param codecs Codecs (default: PayloadCodec::defaults(), i.e. MessagePack, CBOR, JSON)
+     */
+    void set_payload_codecs(std::vector<std::shared_ptr<const PayloadCodec>> codecs);
+
+    /**
+     * Get the payload codecs offered in handshakes
+     * @return Codecs, most preferred first
+     */
+    std::vector<std::shared_ptr<const PayloadCodec>> get_payload_codecs() const;
+
     /**
      * Get current protocol name
      * @return Current protocol name
@@ -783,6 +1129,22 @@ public:
      */
     void once(const std::string& message_type, MessageCallback callback);
 
+    /**
+     * Register a persistent message handler that receives the payload unparsed.
+     * The JSON body is only parsed if the handler (or a JSON handler of the same type) asks for it.
+     * @param message_type Type of message to handle
+     * @param callback Function to call when message is received
+     */
+    void on_payload(const std::string& message_type, PayloadCallback callback);
+
+    /**
+     * Register a persistent message handler that receives the payload bytes and never touches JSON.
+     * Meant for messages sent with send_raw(); other payloads arrive in the sender's negotiated encoding.
+     * @param message_type Type of message to handle
+     * @param callback Function to call when message is received
+     */
+    void on_bytes(const std::string& message_type, BytesCallback callback);
+
     /**
      * Remove all handlers for a message type
      * @param message_type Type of message to stop handling
@@ -806,6 +1168,82 @@ public:
      */
     void send(const std::string& peer_id, const std::string& message_type, const nlohmann::json& data, SendCallback callback = nullptr);
 
+    /**
+     * Send a message to several peers, serializing it only once
+     * @param peer_ids Target peer IDs
+     * @param message_type Type of message
+     * @param data Message data
+     * @param priority Scheduling class on the peers' outbound queues
+     * @return Number of peers the message was queued for
+     */
+    int send_to_peers(const std::vector<std::string>& peer_ids, const std::string& message_type, const nlohmann::json& data,
+                      SendPriority priority = SendPriority::DATA);
+
+    /**
+     * Send opaque bytes as a rats message to a specific peer, bypassing the payload codec.
+     * Receivers get them through on_bytes() or RatsMessagePayload::bytes().
+     * Fails for peers that only understand JSON rats messages.
+     * @param peer_id Target peer ID
+     * @param message_type Type of message
+     * @param data Payload bytes
+     * @param callback Optional callback for send result
+     */
+    void send_raw(const std::string& peer_id, const std::string& message_type, const std::vector<uint8_t>& data,
+                  SendCallback callback = nullptr);
+
+    // =========================================================================
+    // Request/Response API
+    // =========================================================================
+    
+    static constexpr int DEFAULT_REQUEST_TIMEOUT_MS = 30000;
+
+    /**
+     * Register the handler for a request method (replaces any previous handler).
+     * The handler runs on the connection's I/O thread; its return value is sent back as the
+     * result and an exception it throws as the error. It must not wait for other requests.
+     * @param method Method name
+     * @param handler Function called with the requesting peer ID and the request parameters
+     */
+    void on_request(const std::string& method, RequestHandler handler);
+
+    /**
+     * Remove the handler for a request method
+     * @param method Method name
+     */
+    void off_request(const std::string& method);
+
+    /**
+     * Send a request to a peer. Any number of requests may be in flight per peer;
+     * responses are matched by a correlation ID, in whatever order they arrive.
+     * The callback runs exactly once: with the result, the peer's error, or a local failure
+     * (peer not connected, disconnected, timed out, client stopped).
+     * @param peer_id Target peer ID
+     * @param method Method name
+     * @param params Request parameters
+     * @param callback Function called with the outcome
+     * @param timeout Time to wait for the response (rounded up to 100 ms)
+     */
+    void request(const std::string& peer_id, const std::string& method, const nlohmann::json& params,
+                 ResponseCallback callback,
+                 std::chrono::milliseconds timeout = std::chrono::milliseconds(DEFAULT_REQUEST_TIMEOUT_MS));
+
+    /**
+     * Send a request to a peer and get the result as a future
+     * @param peer_id Target peer ID
+     * @param method Method name
+     * @param params Request parameters
+     * @param timeout Time to wait for the response (rounded up to 100 ms)
+     * @return Future holding the result, or a std::runtime_error describing the failure
+     */
+    std::future<nlohmann::json> request(const std::string& peer_id, const std::string& method, const nlohmann::json& params,
+                                        std::chrono::milliseconds timeout = std::chrono::milliseconds(DEFAULT_REQUEST_TIMEOUT_MS));
+
+    /**
+     * Get the number of requests waiting for a response
+     * @return Pending request count
+     */
+    size_t get_pending_request_count() const;
+
     /**
      * Parse a JSON message
      * @param message Raw message string
@@ -863,6 +1301,21 @@ public:
      */
     bool is_peer_encrypted(const std::string& peer_id) const;
 
+    /**
+     * Configure Noise handshakes: IK / session ticket shortcuts for known peers and
+     * the worker threads that run incoming handshakes. Session tickets and known peer
+     * keys are shared by all clients of the process; worker_threads and
+     * max_pending_handshakes take effect on the next start().
+     * @param config Handshake configuration
+     */
+    void set_handshake_config(const HandshakeConfig& config);
+
+    /**
+     * Get the handshake configuration
+     * @return Current handshake configuration
+     */
+    HandshakeConfig get_handshake_config() const;
+
     // =========================================================================
     // Configuration Persistence
     // =========================================================================
@@ -931,6 +1384,37 @@ public:
      */
     nlohmann::json get_connection_statistics() const;
 
+    /**
+     * Get the process-wide metrics (message rates, latency histograms, queue depths)
+     * @return Metrics in the Prometheus text exposition format
+     */
+    std::string get_metrics_prometheus() const;
+
+    /**
+     * Enable or disable recording of tracing spans (process-wide, off by default)
+     * @param enabled Whether spans are recorded
+     */
+    void set_tracing_enabled(bool enabled);
+
+    /**
+     * Check if tracing spans are recorded
+     * @return true if tracing is enabled
+     */
+    bool is_tracing_enabled() const;
+
+    /**
+     * Get the recorded tracing spans (connection attempts, handshakes, message handling, chunk I/O, DHT lookups)
+     * @return Chrome trace event JSON, loadable in chrome://tracing or the Perfetto UI
+     */
+    std::string export_trace_json() const;
+
+    /**
+     * Write the recorded tracing spans to a file as Chrome trace event JSON
+     * @param path Output file
+     * @return true on success
+     */
+    bool write_trace_file(const std::string& path) const;
+
     // =========================================================================
     // GossipSub Functionality
     // =========================================================================
@@ -1148,6 +1632,20 @@ public:
      * Clear/reset the current log file
      */
     void clear_log_file();
+    
+    /**
+     * Enable or disable asynchronous logging
+     * When enabled, logging threads only queue messages and a background writer
+     * thread formats and writes them in batches
+     * @param enabled Whether to log asynchronously
+     */
+    void set_async_logging_enabled(bool enabled);
+    
+    /**
+     * Check if asynchronous logging is enabled
+     * @return true if messages are written by the background writer thread
+     */
+    bool is_async_logging_enabled() const;
 
     // =========================================================================
     // File Transfer API
@@ -1197,6 +1695,17 @@ public:
     std::string request_file(const std::string& peer_id, const std::string& remote_file_path,
                             const std::string& local_path);
     
+    /**
+     * Download a file from several peers that hold it, pulling disjoint chunk ranges from each
+     * @param peer_ids Peers holding the same file (same FileMetadata::checksum)
+     * @param remote_file_path Path to file on the remote peers
+     * @param metadata File size and optional SHA256 checksum of the file
+     * @param local_path Local path where file should be saved
+     * @return Transfer ID if successful, empty string if failed
+     */
+    std::string request_file_from_swarm(const std::vector<std::string>& peer_ids, const std::string& remote_file_path,
+                                        const FileMetadata& metadata, const std::string& local_path);
+    
     /**
      * Request a directory from a remote peer
      * @param peer_id Target peer ID
@@ -1348,12 +1857,28 @@ private:
     static const std::string CONFIG_FILE_NAME;             // "config.json"
     static const std::string PEERS_FILE_NAME;              // "peers.rats"
     static const std::string PEERS_EVER_FILE_NAME;         // "peers_ever.rats"
+    static const std::string DHT_STATE_FILE_NAME;          // "dht_state.dat"
+    static const std::string STRATEGY_CACHE_FILE_NAME;     // "strategies.json"
+    
+    // Peer logs, opened on first use and reopened when their path changes
+    mutable std::mutex peer_store_mutex_;
+    mutable std::shared_ptr<PeerStore> peers_store_;        // Peers connected at the last save
+    mutable std::shared_ptr<PeerStore> peers_ever_store_;   // Every peer that completed a handshake
+    static constexpr int64_t MAX_PEER_AGE_SECONDS = 7 * 24 * 60 * 60;         // Skip peers not seen for a week
+    static constexpr int64_t PEER_REFRESH_INTERVAL_SECONDS = 60 * 60;         // Re-record a still connected peer
+    static constexpr size_t RECONNECT_WAVE_SIZE = 8;                           // Reconnects dialled at once
+    static constexpr std::chrono::milliseconds RECONNECT_WAVE_INTERVAL{1000};  // Pause between waves
     
     // Encryption state
     NoiseKey static_encryption_key_;                        // Our static encryption key
     bool encryption_enabled_;                               // Whether encryption is enabled
     mutable std::mutex encryption_mutex_;                   // Protects encryption state
     
+    // uTP transport (NatTraversalConfig::transport == PeerTransport::UTP)
+    std::shared_ptr<UtpManager> utp_manager_;               // Runs on the UDP side of the listen port
+    std::vector<std::weak_ptr<UtpSocketBridge>> utp_bridges_;  // Open bridges, closed on stop()
+    std::mutex utp_mutex_;                                  // Protects utp_manager_ and utp_bridges_
+    
     // ICE and NAT traversal
     std::unique_ptr<IceAgent> ice_agent_;                   // ICE agent for NAT traversal
     std::unique_ptr<AdvancedNatDetector> nat_detector_;     // Advanced NAT type detection
@@ -1367,25 +1892,108 @@ private:
     
     // Connection attempt tracking
     std::unordered_map<std::string, std::vector<ConnectionAttemptResult>> connection_attempts_;
-    mutable std::mutex connection_attempts_mutex_;
+    std::unordered_map<std::string, StrategyCacheEntry> strategy_cache_;   // keyed by "peer:<addr>" / "subnet:<prefix>"
+    mutable std::mutex connection_attempts_mutex_;                          // Protects attempts and strategy cache
+    
+    // Learned strategy cache tuning
+    static constexpr int64_t STRATEGY_CACHE_HALF_LIFE_SECONDS = 24 * 60 * 60;
+    static constexpr uint32_t STRATEGY_REPROBE_INTERVAL = 8;    // Every Nth pick falls back to NAT-based selection
+    static constexpr size_t STRATEGY_CACHE_MAX_ENTRIES = 1024;
     
     // Organized peer management using RatsPeer struct
-    mutable std::mutex peers_mutex_;
+    mutable std::mutex peers_mutex_;                           // Serializes writers; readers use the snapshot
     std::unordered_map<std::string, RatsPeer> peers_;          // keyed by peer_id
     std::unordered_map<socket_t, std::string> socket_to_peer_id_;  // for quick socket->peer_id lookup  
     std::unordered_map<std::string, std::string> address_to_peer_id_;  // for duplicate detection (normalized_address->peer_id)
     
-    // Per-socket synchronization for thread-safe message sending
-    mutable std::mutex socket_send_mutexes_mutex_;
-    std::unordered_map<socket_t, std::shared_ptr<std::mutex>> socket_send_mutexes_;
+    // Immutable copy of the peer table, republished whenever a writer releases peers_mutex_.
+    // Lookups, broadcasts and peer listings read it without taking the mutex (copy-on-write).
+    struct PeerTableSnapshot {
+        std::vector<std::shared_ptr<const RatsPeer>> peers;
+        std::unordered_map<std::string, std::shared_ptr<const RatsPeer>> by_id;
+        std::unordered_map<socket_t, std::shared_ptr<const RatsPeer>> by_socket;
+        std::unordered_map<std::string, std::shared_ptr<const RatsPeer>> by_address;
+        int validated_count = 0;
+        
+        std::shared_ptr<const RatsPeer> find(const std::string& peer_id) const {
+            auto it = by_id.find(peer_id);
+            return it != by_id.end() ? it->second : nullptr;
+        }
+        std::shared_ptr<const RatsPeer> find(socket_t socket) const {
+            auto it = by_socket.find(socket);
+            return it != by_socket.end() ? it->second : nullptr;
+        }
+    };
+    std::shared_ptr<const PeerTableSnapshot> peer_snapshot_;   // Accessed with std::atomic_load / atomic_store
+    
+    // Scoped peers_mutex_ lock for code that modifies the peer table; publishes a new snapshot on release
+    class PeersWriteLock {
+    public:
+        explicit PeersWriteLock(RatsClient& client) : client_(client), lock_(client.peers_mutex_) {}
+        ~PeersWriteLock() { client_.publish_peer_snapshot_unlocked(); }
+        PeersWriteLock(const PeersWriteLock&) = delete;
+        PeersWriteLock& operator=(const PeersWriteLock&) = delete;
+    private:
+        RatsClient& client_;
+        std::lock_guard<std::mutex> lock_;
+    };
+    
+    std::shared_ptr<const PeerTableSnapshot> get_peer_snapshot() const;
+    void publish_peer_snapshot_unlocked();  // Assumes peers_mutex_ is already locked
     
     // Server and client management
     std::thread server_thread_;
-    std::thread management_thread_;
+    
+    // Per-connection state driven by reactor readiness events
+    struct ClientSession {
+        socket_t socket;
+        std::string peer_hash_id;               // Temporary hash ID assigned on connect
+        std::string peer_id;                    // Real peer ID once the handshake completed
+        bool encryption_enabled;
+        bool handshake_completed;
+        bool noise_handshake_completed;
+        bool closed;                            // Unregistered by close_client_session (guarded by the shard's sessions_mutex)
+        std::atomic<bool> noise_step_queued;    // A handshake worker owns the socket until its step ran
+        FramedReceiveBuffer receive_buffer;     // Partial frame carried between readiness events
+        std::shared_ptr<PeerSendQueue> send_queue;  // Outbound messages drained by send_writer_
+        
+        ClientSession(socket_t s, const std::string& hash_id, bool encrypted, const SendQueueConfig& send_config)
+            : socket(s), peer_hash_id(hash_id), encryption_enabled(encrypted),
+              handshake_completed(false), noise_handshake_completed(false), closed(false), noise_step_queued(false),
+              send_queue(std::make_shared<PeerSendQueue>(s, send_config)) {}
+    };
+    
+    // Per-connection tables, split by socket_shard() so I/O and writer threads working on
+    // different connections do not contend on one lock
+    static constexpr size_t CONNECTION_SHARD_COUNT = 16;
+    struct alignas(64) ConnectionShard {
+        mutable std::mutex sessions_mutex;                  // Protects sessions (acquire after peers_mutex_)
+        std::unordered_map<socket_t, std::shared_ptr<ClientSession>> sessions;
+        mutable std::mutex send_mutexes_mutex;              // Protects send_mutexes
+        std::unordered_map<socket_t, std::shared_ptr<std::mutex>> send_mutexes;  // Per-socket synchronization for sending
+    };
+    
+    std::unique_ptr<IoReactor> reactor_;                    // I/O threads shared by all peer connections
+    std::array<ConnectionShard, CONNECTION_SHARD_COUNT> connection_shards_;
+    ConnectionShard& connection_shard(socket_t socket);
+    const ConnectionShard& connection_shard(socket_t socket) const;
+    
+    std::unique_ptr<SendQueueWriter> send_writer_;          // Threads draining the per-session send queues
+    std::unique_ptr<HandshakeWorkerPool> handshake_workers_; // Threads running Noise handshake steps off the reactor
+    mutable std::mutex send_queue_config_mutex_;
+    SendQueueConfig send_queue_config_;
+    std::unique_ptr<CallbackExecutor> callback_executor_;  // Threads running application callbacks off the reactor
+    mutable std::mutex callback_executor_config_mutex_;
+    CallbackExecutorConfig callback_executor_config_;
+    mutable std::mutex io_shard_config_mutex_;
+    IoShardConfig io_shard_config_;
+    mutable std::mutex resource_limits_mutex_;
+    ResourceLimits resource_limits_;
     
     ConnectionCallback connection_callback_;
     AdvancedConnectionCallback advanced_connection_callback_;
     BinaryDataCallback binary_data_callback_;
+    BinaryDataViewCallback binary_data_view_callback_;
     StringDataCallback string_data_callback_;
     JsonDataCallback json_data_callback_;
     DisconnectCallback disconnect_callback_;
@@ -1410,12 +2018,51 @@ private:
     // File transfer manager
     std::unique_ptr<FileTransferManager> file_transfer_manager_;
     
+    // Stream multiplexers by peer ID, created with a peer's first stream
+    std::unordered_map<std::string, std::shared_ptr<StreamMuxer>> stream_muxers_;
+    mutable std::mutex stream_muxers_mutex_;
+    StreamConfig stream_config_;
+    StreamOpenedCallback stream_opened_callback_;
+    StreamDataCallback stream_data_callback_;
+    StreamClosedCallback stream_closed_callback_;
+    
+    std::shared_ptr<StreamMuxer> get_stream_muxer(const std::string& peer_id, bool create);
+    void close_peer_streams(const std::string& peer_id);
+    
+    // Requests awaiting a response, by correlation ID; deadlines live in the timer wheel
+    struct PendingRequest {
+        std::string peer_id;
+        std::string method;
+        ResponseCallback callback;
+    };
+    std::unordered_map<uint64_t, PendingRequest> pending_requests_;
+    TimerWheel request_deadlines_;              // Advanced by the reactor tick
+    uint64_t next_request_id_;
+    mutable std::mutex requests_mutex_;         // Protects pending_requests_, request_deadlines_ and next_request_id_
+    std::unordered_map<std::string, RequestHandler> request_handlers_;
+    std::mutex request_handlers_mutex_;
+    
+    void handle_rpc_request(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& payload);
+    void handle_rpc_response(const std::string& peer_hash_id, const nlohmann::json& payload);
+    bool complete_request(uint64_t id, bool success, const nlohmann::json& result, const std::string& error);
+    void expire_requests();
+    void fail_pending_requests(const std::string& peer_id, const std::string& error);   // Empty peer_id fails all
+    
     void initialize_modules();
     void destroy_modules();
 
     void server_loop();
-    void management_loop();
-    void handle_client(socket_t client_socket, const std::string& peer_hash_id);
+    void management_tick();
+    bool accept_incoming_connection(socket_t client_socket, const std::string& ip, int port,
+                                    const std::string& transport_protocol);
+    bool start_client_session(socket_t client_socket, const std::string& peer_hash_id);
+    void on_client_socket_event(const std::shared_ptr<ClientSession>& session, uint32_t events);
+    bool process_client_readable(ClientSession& session);
+    bool process_noise_handshake(ClientSession& session);
+    bool queue_noise_handshake_step(const std::shared_ptr<ClientSession>& session);
+    bool process_client_message(ClientSession& session, const SharedBuffer& message);
+    void close_client_session(const std::shared_ptr<ClientSession>& session);
+    bool has_client_session(socket_t socket) const;
     void remove_peer(socket_t socket);
     std::string generate_peer_hash_id(socket_t socket, const std::string& connection_info);
     void handle_dht_peer_discovery(const std::vector<Peer>& peers, const InfoHash& info_hash);
@@ -1423,7 +2070,9 @@ private:
     
     // Message header helpers
     std::vector<uint8_t> create_message_with_header(const std::vector<uint8_t>& payload, MessageDataType type);
+    std::vector<uint8_t> create_message_with_header(const uint8_t* payload, size_t payload_size, MessageDataType type);
     bool parse_message_with_header(const std::vector<uint8_t>& message, MessageHeader& header, std::vector<uint8_t>& payload) const;
+    bool parse_message_with_header(const SharedBuffer& message, MessageHeader& header, SharedBuffer& payload) const;
     
     // Enhanced connection establishment
     bool attempt_direct_connection(const std::string& host, int port, ConnectionAttemptResult& result);
@@ -1468,10 +2117,15 @@ private:
     // Handshake protocol
     static constexpr const char* RATS_PROTOCOL_VERSION = "1.0";
     static constexpr int HANDSHAKE_TIMEOUT_SECONDS = 10;
+    
+    // Outgoing TCP connections (addresses are raced with this stagger, RFC 8305)
+    static constexpr int TCP_CONNECT_TIMEOUT_MS = 10000;
+    static constexpr int CONNECTION_ATTEMPT_DELAY_MS = 250;
 
     // Custom protocol configuration
     std::string custom_protocol_name_;          // Custom protocol name (default: "rats")
     std::string custom_protocol_version_;       // Custom protocol version (default: "1.0")
+    std::vector<std::shared_ptr<const PayloadCodec>> payload_codecs_; // Offered in handshakes, most preferred first
     mutable std::mutex protocol_config_mutex_;  // Protects protocol configuration
 
     struct HandshakeMessage {
@@ -1480,18 +2134,22 @@ private:
         std::string peer_id;
         std::string message_type;
         int64_t timestamp;
+        bool typed_messages;    // Advertised the "typed_messages" feature
+        std::vector<std::string> codecs; // Advertised payload codec names, most preferred first
     };
 
     std::string create_handshake_message(const std::string& message_type, const std::string& our_peer_id) const;
     bool parse_handshake_message(const std::string& message, HandshakeMessage& out_msg) const;
     bool validate_handshake_message(const HandshakeMessage& msg) const;
-    bool is_handshake_message(const std::string& message) const;
+    bool is_handshake_message(const SharedBuffer& payload) const;
     bool send_handshake(socket_t socket, const std::string& our_peer_id);
     bool send_handshake_unlocked(socket_t socket, const std::string& our_peer_id);
-    bool handle_handshake_message(socket_t socket, const std::string& peer_hash_id, const std::string& message);
+    bool handle_handshake_message(socket_t socket, const std::string& peer_hash_id, const SharedBuffer& payload);
     void check_handshake_timeouts();
     void log_handshake_completion(const RatsPeer& peer);
     void log_handshake_completion_unlocked(const RatsPeer& peer);
+    void negotiate_payload_codec(RatsPeer& peer, const std::vector<std::string>& remote_codecs) const;
+    std::shared_ptr<const PayloadCodec> get_receive_codec(uint8_t encoding) const;
 
     // Automatic discovery
     std::atomic<bool> auto_discovery_running_;
@@ -1502,6 +2160,8 @@ private:
 
     // Message handling system
     nlohmann::json create_rats_message(const std::string& type, const nlohmann::json& payload, const std::string& sender_peer_id);
+    bool send_rats_message(socket_t socket, const std::string& type, const nlohmann::json& payload,
+                           const std::string& sender_peer_id, SendPriority priority = SendPriority::CONTROL);
     void handle_rats_message(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& message);
 
     // Specific message handlers
@@ -1509,54 +2169,132 @@ private:
     void handle_peers_request_message(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& payload);
     void handle_peers_response_message(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& payload);
 
-    // Message creation and broadcasting
-    nlohmann::json create_peer_exchange_message(const RatsPeer& peer);
+    // Message payload creation and broadcasting
+    nlohmann::json create_peer_exchange_payload(const RatsPeer& peer);
     void broadcast_peer_exchange_message(const RatsPeer& new_peer);
-    nlohmann::json create_peers_request_message(const std::string& sender_peer_id);
-    nlohmann::json create_peers_response_message(const std::vector<RatsPeer>& peers, const std::string& sender_peer_id);
+    nlohmann::json create_peers_request_payload();
+    nlohmann::json create_peers_response_payload(const std::vector<RatsPeer>& peers);
     std::vector<RatsPeer> get_random_peers(int max_count, const std::string& exclude_peer_id = "") const;
     void send_peers_request(socket_t socket, const std::string& our_peer_id);
 
     int broadcast_rats_message(const nlohmann::json& message, const std::string& exclude_peer_id = "");
-    int broadcast_rats_message_to_validated_peers(const nlohmann::json& message, const std::string& exclude_peer_id = "");
+    int broadcast_rats_message_to_validated_peers(const nlohmann::json& message, const std::string& exclude_peer_id = "",
+                                                  SendPriority priority = SendPriority::DATA);
     // Message exchange API implementation
     struct MessageHandler {
-        MessageCallback callback;
-        bool is_once;
+        MessageCallback callback;               // Set for JSON handlers
+        PayloadCallback payload_callback;       // Set for payload handlers
+        std::shared_ptr<std::atomic<bool>> fired; // Set for once handlers; claimed by the first dispatch
+        
+        MessageHandler(MessageCallback cb, bool once)
+            : callback(std::move(cb)), fired(once ? std::make_shared<std::atomic<bool>>(false) : nullptr) {}
+        explicit MessageHandler(PayloadCallback cb) : payload_callback(std::move(cb)) {}
         
-        MessageHandler(MessageCallback cb, bool once) : callback(cb), is_once(once) {}
+        bool is_once() const { return fired != nullptr; }
     };
     
-    std::unordered_map<std::string, std::vector<MessageHandler>> message_handlers_;
-    mutable std::mutex message_handlers_mutex_;
+    // Handlers of one message type name
+    struct MessageHandlerEntry {
+        std::string message_type;
+        std::vector<MessageHandler> handlers;
+    };
     
-    void call_message_handlers(const std::string& message_type, const std::string& peer_id, const nlohmann::json& data);
-    void call_callback_safely(const MessageCallback& callback, const std::string& peer_id, const nlohmann::json& data);
-    void remove_once_handlers(const std::string& message_type);
+    // Handlers by interned type id; ids shared by several names (hash collisions) hold one entry per name
+    using MessageHandlerTable = std::unordered_map<uint16_t, std::vector<MessageHandlerEntry>>;
+    
+    // Read without locks by dispatch; on/once/off copy the table and publish the copy
+    std::shared_ptr<const MessageHandlerTable> message_handler_table_;
+    mutable std::mutex message_handlers_mutex_;     // Serializes table updates
+    
+    void add_message_handler(const std::string& message_type, MessageHandler handler);
+    void dispatch_rats_message(socket_t socket, const std::string& peer_hash_id, uint16_t type_id,
+                               const std::string& message_type, const std::string& sender_peer_id,
+                               const RatsMessagePayload& payload);
+    void call_message_handlers(uint16_t type_id, const std::string& message_type, const std::string& peer_id,
+                               const RatsMessagePayload& payload);
+    void remove_once_handlers(uint16_t type_id, const std::string& message_type);
+    
+    // Encodings of one outgoing rats message, each built on first use
+    class OutgoingRatsMessage {
+    public:
+        OutgoingRatsMessage(const std::string& type, const nlohmann::json& payload, const std::string& sender_peer_id);
+        // Opaque payload; only peers that accept binary envelopes can receive it
+        OutgoingRatsMessage(const std::string& type, const std::vector<uint8_t>& raw, const std::string& sender_peer_id);
+        
+        /**
+         * Binary envelope in the peer's codec for peers that advertised typed messages,
+         * JSON envelope for the others
+         * @return Encoded message, empty if it cannot be sent to the peer
+         */
+        const SharedBuffer& encoded(const RatsPeer& peer, MessageDataType& out_type);
+        
+    private:
+        struct TypedEnvelope {
+            const PayloadCodec* codec;          // nullptr for raw payloads
+            uint8_t encoding;
+            SharedBuffer bytes;
+        };
+        
+        const std::string& type_;
+        const nlohmann::json* payload_;
+        const std::vector<uint8_t>* raw_;
+        const std::string& sender_peer_id_;
+        int64_t timestamp_;
+        std::vector<TypedEnvelope> typed_;      // One per codec and wire id in use
+        SharedBuffer json_;
+    };
+    bool send_rats_message_to_peer(const RatsPeer& peer, OutgoingRatsMessage& message, SendPriority priority = SendPriority::DATA);
 
     // Per-socket synchronization helpers
     std::shared_ptr<std::mutex> get_socket_send_mutex(socket_t socket);
+    std::shared_ptr<PeerSendQueue> get_send_queue(socket_t socket) const;
+    bool send_payload_to_peer(socket_t socket, const SharedBuffer& payload, MessageDataType message_type,
+                              SendPriority priority = SendPriority::DATA);
+    bool send_outbound_message(socket_t socket, OutboundMessage&& message);
+    bool send_outbound_batch(socket_t socket, std::vector<OutboundMessage>& batch);
+    void flush_send_queues(std::chrono::milliseconds timeout);
     void cleanup_socket_send_mutex(socket_t socket);
 
+    // Push the resource limits to the subsystems that are running
+    void apply_resource_limits();
+
     // Configuration persistence helpers
     std::string generate_persistent_peer_id() const;
-    nlohmann::json serialize_peer_for_persistence(const RatsPeer& peer) const;
-    bool deserialize_peer_from_persistence(const nlohmann::json& json, std::string& ip, int& port, std::string& peer_id) const;
+    StoredPeer to_stored_peer(const RatsPeer& peer, int64_t now) const;
+    static int64_t persistence_timestamp();
+    std::shared_ptr<PeerStore> get_peer_store(std::shared_ptr<PeerStore>& slot, const std::string& path) const;
     std::string get_config_file_path() const;
     std::string get_peers_file_path() const;
     std::string get_peers_ever_file_path() const;
+    std::string get_dht_state_file_path() const;
+    std::string get_strategy_cache_file_path() const;
     bool save_peers_to_file();
+    bool load_strategy_cache();
+    bool save_strategy_cache() const;
     bool append_peer_to_historical_file(const RatsPeer& peer);
     int load_and_reconnect_historical_peers();
+    int schedule_peer_reconnects(std::shared_ptr<PeerStore> store, const std::string& label);
+    void reconnect_wave(std::shared_ptr<PeerStore> store, std::shared_ptr<std::vector<StoredPeer>> candidates,
+                        size_t next, const std::string& label);
     
     // NAT traversal helpers
     void initialize_nat_traversal();
     void detect_and_cache_nat_type();
     void update_connection_statistics(const std::string& peer_id, const ConnectionAttemptResult& result);
     std::string select_best_connection_strategy(const std::string& host, int port);
+    std::string select_learned_connection_strategy(const std::string& host, int port);
     NatType map_characteristics_to_nat_type(const NatTypeInfo& characteristics);
     void log_nat_detection_results();
     bool perform_tcp_connection(const std::string& host, int port, ConnectionAttemptResult& result);
+    bool register_outgoing_connection(socket_t peer_socket, const std::string& host, int port,
+                                      const std::string& transport_protocol, ConnectionAttemptResult& result);
+    
+    // uTP transport helpers
+    bool start_utp_transport();
+    void stop_utp_transport();
+    void handle_incoming_utp_connection(std::shared_ptr<UtpSocket> connection);
+    socket_t open_utp_bridge(std::shared_ptr<UtpSocket> connection);
+    bool perform_utp_connection(const std::string& host, int port, ConnectionAttemptResult& result);
     
     // ICE coordination helpers
     void initialize_ice_agent();
@@ -1,14 +1,31 @@
 #include "librats_c.h"
 #include "librats.h"
 #include "logger.h"
+#include "tracing.h"
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <unordered_map>
 
 using namespace librats;
 
+// Storage behind a rats_buffer_t; peer_id and data stay valid until rats_buffer_release
+struct rats_buffer {
+    std::string peer_id;
+    SharedBuffer bytes;                 // Binary payloads: a view of the receive buffer, not a copy
+    std::string text;                   // String and JSON payloads
+    std::vector<std::string> strings;   // Listings such as peer ids
+    std::vector<const char*> pointers;
+    const void* data = nullptr;
+    size_t size = 0;
+};
+
 struct rats_client_wrapper {
     std::unique_ptr<RatsClient> client;
 
@@ -52,8 +69,18 @@ struct rats_client_wrapper {
     std::unordered_map<std::string, std::pair<rats_topic_json_message_cb, void*>> topic_json_message_handlers;
     std::unordered_map<std::string, std::pair<rats_topic_peer_joined_cb, void*>> topic_peer_joined_handlers;
     std::unordered_map<std::string, std::pair<rats_topic_peer_left_cb, void*>> topic_peer_left_handlers;
+
+    // Polled events (rats_enable_event_polling)
+    std::atomic<int> event_mask{0};
+    std::mutex event_mutex;
+    std::condition_variable event_cv;
+    std::deque<rats_event_t> events;
+    size_t max_queued_events = 0;
+    uint64_t dropped_events = 0;
 };
 
+static constexpr size_t RATS_DEFAULT_MAX_QUEUED_EVENTS = 4096;
+
 static char* rats_strdup_owned(const std::string& s) {
     size_t n = s.size();
     char* out = static_cast<char*>(malloc(n + 1));
@@ -63,6 +90,123 @@ static char* rats_strdup_owned(const std::string& s) {
     return out;
 }
 
+static bool rats_event_wanted(rats_client_wrapper* wrap, rats_event_type_t type) {
+    return (wrap->event_mask.load(std::memory_order_relaxed) & type) != 0;
+}
+
+// Queue an event for rats_poll_events. Payload events are dropped while the queue is full;
+// connection events are always kept so pollers never lose track of who is connected.
+static void rats_queue_event(rats_client_wrapper* wrap, rats_event_type_t type, rats_buffer* buffer) {
+    rats_event_t event;
+    event.type = type;
+    event.peer_id = buffer->peer_id.c_str();
+    event.data = buffer->data;
+    event.size = buffer->size;
+    event.buffer = buffer;
+    {
+        std::lock_guard<std::mutex> lock(wrap->event_mutex);
+        bool payload = type != RATS_EVENT_CONNECTED && type != RATS_EVENT_DISCONNECTED;
+        if (payload && wrap->events.size() >= wrap->max_queued_events) {
+            wrap->dropped_events++;
+            delete buffer;
+            return;
+        }
+        wrap->events.push_back(event);
+    }
+    wrap->event_cv.notify_one();
+}
+
+static void rats_queue_peer_event(rats_client_wrapper* wrap, rats_event_type_t type, const std::string& peer_id) {
+    rats_buffer* buffer = new rats_buffer();
+    buffer->peer_id = peer_id;
+    rats_queue_event(wrap, type, buffer);
+}
+
+static void rats_queue_text_event(rats_client_wrapper* wrap, rats_event_type_t type, const std::string& peer_id, std::string text) {
+    rats_buffer* buffer = new rats_buffer();
+    buffer->peer_id = peer_id;
+    buffer->text = std::move(text);
+    buffer->data = buffer->text.c_str();
+    buffer->size = buffer->text.size();
+    rats_queue_event(wrap, type, buffer);
+}
+
+static void rats_clear_events(rats_client_wrapper* wrap) {
+    std::lock_guard<std::mutex> lock(wrap->event_mutex);
+    for (const auto& event : wrap->events) {
+        delete event.buffer;
+    }
+    wrap->events.clear();
+}
+
+// The client holds a single handler per kind; each one feeds both the C callback and the event queue
+
+static void rats_install_connection_handler(rats_client_wrapper* wrap) {
+    wrap->client->set_connection_callback([wrap](socket_t, const std::string& peer_id) {
+        if (wrap->connection_cb) {
+            wrap->connection_cb(wrap->connection_ud, peer_id.c_str());
+        }
+        if (rats_event_wanted(wrap, RATS_EVENT_CONNECTED)) {
+            rats_queue_peer_event(wrap, RATS_EVENT_CONNECTED, peer_id);
+        }
+    });
+}
+
+static void rats_install_disconnect_handler(rats_client_wrapper* wrap) {
+    wrap->client->set_disconnect_callback([wrap](socket_t, const std::string& peer_id) {
+        if (wrap->disconnect_cb) {
+            wrap->disconnect_cb(wrap->disconnect_ud, peer_id.c_str());
+        }
+        if (rats_event_wanted(wrap, RATS_EVENT_DISCONNECTED)) {
+            rats_queue_peer_event(wrap, RATS_EVENT_DISCONNECTED, peer_id);
+        }
+    });
+}
+
+static void rats_install_string_handler(rats_client_wrapper* wrap) {
+    wrap->client->set_string_data_callback([wrap](socket_t, const std::string& peer_id, const std::string& data) {
+        if (wrap->string_cb) {
+            wrap->string_cb(wrap->string_ud, peer_id.c_str(), data.c_str());
+        }
+        if (rats_event_wanted(wrap, RATS_EVENT_STRING)) {
+            rats_queue_text_event(wrap, RATS_EVENT_STRING, peer_id, data);
+        }
+    });
+}
+
+static void rats_install_binary_handler(rats_client_wrapper* wrap) {
+    wrap->client->set_binary_data_view_callback([wrap](socket_t, const std::string& peer_id, const SharedBuffer& data) {
+        if (wrap->binary_cb) {
+            wrap->binary_cb(wrap->binary_ud, peer_id.c_str(), data.data(), data.size());
+        }
+        if (rats_event_wanted(wrap, RATS_EVENT_BINARY)) {
+            // Keep a reference to the receive buffer instead of copying the payload
+            rats_buffer* buffer = new rats_buffer();
+            buffer->peer_id = peer_id;
+            buffer->bytes = data;
+            buffer->data = buffer->bytes.data();
+            buffer->size = buffer->bytes.size();
+            rats_queue_event(wrap, RATS_EVENT_BINARY, buffer);
+        }
+    });
+}
+
+static void rats_install_json_handler(rats_client_wrapper* wrap) {
+    wrap->client->set_json_data_callback([wrap](socket_t, const std::string& peer_id, const nlohmann::json& data) {
+        bool queue = rats_event_wanted(wrap, RATS_EVENT_JSON);
+        if (!wrap->json_cb && !queue) {
+            return;
+        }
+        std::string json_str = data.dump();
+        if (wrap->json_cb) {
+            wrap->json_cb(wrap->json_ud, peer_id.c_str(), json_str.c_str());
+        }
+        if (queue) {
+            rats_queue_text_event(wrap, RATS_EVENT_JSON, peer_id, std::move(json_str));
+        }
+    });
+}
+
 extern "C" {
 
 void rats_string_free(const char* str) {
@@ -100,6 +244,7 @@ void rats_destroy(rats_client_t handle) {
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     // Ensure stopped
     wrap->client->stop();
+    rats_clear_events(wrap);
     delete wrap;
 }
 
@@ -159,6 +304,18 @@ char* rats_get_connection_statistics_json(rats_client_t handle) {
     return rats_strdup_owned(json.dump());
 }
 
+char* rats_get_metrics_prometheus(rats_client_t handle) {
+    if (!handle) return nullptr;
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    return rats_strdup_owned(wrap->client->get_metrics_prometheus());
+}
+
+char* rats_get_resource_usage_json(rats_client_t handle) {
+    if (!handle) return nullptr;
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    return rats_strdup_owned(wrap->client->get_resource_usage().dump());
+}
+
 void rats_set_logging_enabled(int enabled) {
     // Global logger control through any client instance is awkward; use singleton
     Logger::getInstance().set_file_logging_enabled(enabled != 0);
@@ -178,6 +335,19 @@ void rats_set_log_level(const char* level_str) {
     Logger::getInstance().set_log_level(level);
 }
 
+void rats_set_tracing_enabled(int enabled) {
+    Tracer::getInstance().set_enabled(enabled != 0);
+}
+
+char* rats_export_trace_json(void) {
+    return rats_strdup_owned(Tracer::getInstance().export_chrome_trace());
+}
+
+int rats_write_trace_file(const char* file_path) {
+    if (!file_path) return 0;
+    return Tracer::getInstance().write_chrome_trace(file_path) ? 1 : 0;
+}
+
 
 void rats_set_log_file_path(rats_client_t handle, const char* file_path) {
     if (!handle || !file_path) return;
@@ -238,11 +408,7 @@ void rats_set_connection_callback(rats_client_t handle, rats_connection_cb cb, v
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     wrap->connection_cb = cb;
     wrap->connection_ud = user_data;
-    wrap->client->set_connection_callback([wrap](socket_t, const std::string& peer_id) {
-        if (wrap->connection_cb) {
-            wrap->connection_cb(wrap->connection_ud, peer_id.c_str());
-        }
-    });
+    rats_install_connection_handler(wrap);
 }
 
 void rats_set_string_callback(rats_client_t handle, rats_string_cb cb, void* user_data) {
@@ -250,11 +416,7 @@ void rats_set_string_callback(rats_client_t handle, rats_string_cb cb, void* use
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     wrap->string_cb = cb;
     wrap->string_ud = user_data;
-    wrap->client->set_string_data_callback([wrap](socket_t, const std::string& peer_id, const std::string& data) {
-        if (wrap->string_cb) {
-            wrap->string_cb(wrap->string_ud, peer_id.c_str(), data.c_str());
-        }
-    });
+    rats_install_string_handler(wrap);
 }
 
 void rats_set_disconnect_callback(rats_client_t handle, rats_disconnect_cb cb, void* user_data) {
@@ -262,11 +424,7 @@ void rats_set_disconnect_callback(rats_client_t handle, rats_disconnect_cb cb, v
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     wrap->disconnect_cb = cb;
     wrap->disconnect_ud = user_data;
-    wrap->client->set_disconnect_callback([wrap](socket_t, const std::string& peer_id) {
-        if (wrap->disconnect_cb) {
-            wrap->disconnect_cb(wrap->disconnect_ud, peer_id.c_str());
-        }
-    });
+    rats_install_disconnect_handler(wrap);
 }
 
 // ===================== NEW C API IMPLEMENTATIONS =====================
@@ -320,14 +478,14 @@ rats_error_t rats_disconnect_peer_by_id(rats_client_t handle, const char* peer_i
 }
 
 // Binary data operations  
+// The caller's bytes are copied once, straight into the buffer the send queue holds
 rats_error_t rats_send_binary(rats_client_t handle, const char* peer_id, const void* data, size_t size) {
     if (!handle || !peer_id || !data || size == 0) return RATS_ERROR_INVALID_PARAMETER;
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     
-    std::vector<uint8_t> binary_data(static_cast<const uint8_t*>(data), 
-                                     static_cast<const uint8_t*>(data) + size);
+    SharedBuffer payload = SharedBuffer::copy_of(static_cast<const uint8_t*>(data), size);
     
-    return wrap->client->send_binary_to_peer_id(std::string(peer_id), binary_data) ? 
+    return wrap->client->send_binary_to_peer_ids({std::string(peer_id)}, payload) > 0 ? 
            RATS_SUCCESS : RATS_ERROR_OPERATION_FAILED;
 }
 
@@ -335,10 +493,9 @@ int rats_broadcast_binary(rats_client_t handle, const void* data, size_t size) {
     if (!handle || !data || size == 0) return 0;
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     
-    std::vector<uint8_t> binary_data(static_cast<const uint8_t*>(data), 
-                                     static_cast<const uint8_t*>(data) + size);
+    SharedBuffer payload = SharedBuffer::copy_of(static_cast<const uint8_t*>(data), size);
     
-    return wrap->client->broadcast_binary_to_peers(binary_data);
+    return wrap->client->broadcast_binary_to_peers(payload);
 }
 
 // JSON operations
@@ -618,11 +775,7 @@ void rats_set_binary_callback(rats_client_t handle, rats_binary_cb cb, void* use
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     wrap->binary_cb = cb;
     wrap->binary_ud = user_data;
-    wrap->client->set_binary_data_callback([wrap](socket_t, const std::string& peer_id, const std::vector<uint8_t>& data) {
-        if (wrap->binary_cb) {
-            wrap->binary_cb(wrap->binary_ud, peer_id.c_str(), data.data(), data.size());
-        }
-    });
+    rats_install_binary_handler(wrap);
 }
 
 void rats_set_json_callback(rats_client_t handle, rats_json_cb cb, void* user_data) {
@@ -630,12 +783,7 @@ void rats_set_json_callback(rats_client_t handle, rats_json_cb cb, void* user_da
     rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
     wrap->json_cb = cb;
     wrap->json_ud = user_data;
-    wrap->client->set_json_data_callback([wrap](socket_t, const std::string& peer_id, const nlohmann::json& data) {
-        if (wrap->json_cb) {
-            std::string json_str = data.dump();
-            wrap->json_cb(wrap->json_ud, peer_id.c_str(), json_str.c_str());
-        }
-    });
+    rats_install_json_handler(wrap);
 }
 
 void rats_set_peer_discovered_callback(rats_client_t handle, rats_peer_discovered_cb cb, void* user_data) {
@@ -1312,6 +1460,122 @@ char** rats_get_historical_peer_ids(rats_client_t handle, int* count) {
     return peer_ids;
 }
 
-} // extern "C"
+// Lent buffers
+const void* rats_buffer_data(rats_buffer_t buffer) {
+    return buffer ? buffer->data : nullptr;
+}
+
+size_t rats_buffer_size(rats_buffer_t buffer) {
+    return buffer ? buffer->size : 0;
+}
+
+void rats_buffer_release(rats_buffer_t buffer) {
+    delete buffer;
+}
+
+rats_buffer_t rats_get_peer_ids_lent(rats_client_t handle, int* count) {
+    if (!handle || !count) {
+        if (count) *count = 0;
+        return nullptr;
+    }
+    
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    auto peers = wrap->client->get_validated_peers();
+    
+    rats_buffer* buffer = new rats_buffer();
+    buffer->strings.reserve(peers.size());
+    buffer->pointers.reserve(peers.size());
+    for (const auto& peer : peers) {
+        buffer->strings.push_back(peer.peer_id);
+    }
+    for (const auto& peer_id : buffer->strings) {
+        buffer->pointers.push_back(peer_id.c_str());
+    }
+    buffer->data = buffer->pointers.data();
+    buffer->size = buffer->pointers.size() * sizeof(const char*);
+    
+    *count = static_cast<int>(buffer->pointers.size());
+    return buffer;
+}
+
+// Event polling
+rats_error_t rats_enable_event_polling(rats_client_t handle, int event_mask, size_t max_queued_events) {
+    if (!handle) return RATS_ERROR_INVALID_HANDLE;
+    if ((event_mask & ~RATS_EVENT_ALL) != 0) return RATS_ERROR_INVALID_PARAMETER;
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    
+    {
+        std::lock_guard<std::mutex> lock(wrap->event_mutex);
+        wrap->max_queued_events = max_queued_events > 0 ? max_queued_events : RATS_DEFAULT_MAX_QUEUED_EVENTS;
+    }
+    wrap->event_mask.store(event_mask);
+    
+    if (event_mask & RATS_EVENT_CONNECTED) rats_install_connection_handler(wrap);
+    if (event_mask & RATS_EVENT_DISCONNECTED) rats_install_disconnect_handler(wrap);
+    if (event_mask & RATS_EVENT_BINARY) rats_install_binary_handler(wrap);
+    if (event_mask & RATS_EVENT_STRING) rats_install_string_handler(wrap);
+    if (event_mask & RATS_EVENT_JSON) rats_install_json_handler(wrap);
+    
+    // Pollers blocked on a queue that will no longer be fed get to return
+    wrap->event_cv.notify_all();
+    return RATS_SUCCESS;
+}
+
+int rats_poll_events(rats_client_t handle, rats_event_t* events, int max_events, int timeout_ms) {
+    if (!handle) return RATS_ERROR_INVALID_HANDLE;
+    if (!events || max_events <= 0) return RATS_ERROR_INVALID_PARAMETER;
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    
+    std::unique_lock<std::mutex> lock(wrap->event_mutex);
+    if (wrap->events.empty() && timeout_ms != 0) {
+        auto ready = [wrap]() { return !wrap->events.empty() || wrap->event_mask.load() == 0; };
+        if (timeout_ms < 0) {
+            wrap->event_cv.wait(lock, ready);
+        } else {
+            wrap->event_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        }
+    }
+    
+    int written = 0;
+    while (written < max_events && !wrap->events.empty()) {
+        events[written++] = wrap->events.front();
+        wrap->events.pop_front();
+    }
+    return written;
+}
+
+uint64_t rats_get_dropped_event_count(rats_client_t handle) {
+    if (!handle) return 0;
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    std::lock_guard<std::mutex> lock(wrap->event_mutex);
+    return wrap->dropped_events;
+}
 
+// Batched send
+int rats_send_binary_many(rats_client_t handle, const rats_send_item_t* items, int count) {
+    if (!handle || !items || count <= 0) return 0;
+    rats_client_wrapper* wrap = static_cast<rats_client_wrapper*>(handle);
+    
+    int queued = 0;
+    int i = 0;
+    while (i < count) {
+        const rats_send_item_t& first = items[i];
+        if (!first.peer_id || !first.data || first.size == 0) {
+            ++i;
+            continue;
+        }
+        
+        // A run of items sending the same bytes becomes one fan-out over a single copy
+        std::vector<std::string> peer_ids;
+        for (; i < count && items[i].data == first.data && items[i].size == first.size; ++i) {
+            if (items[i].peer_id) {
+                peer_ids.emplace_back(items[i].peer_id);
+            }
+        }
+        SharedBuffer payload = SharedBuffer::copy_of(static_cast<const uint8_t*>(first.data), first.size);
+        queued += wrap->client->send_binary_to_peer_ids(peer_ids, payload);
+    }
+    return queued;
+}
 
+} // extern "C"
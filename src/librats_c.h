@@ -36,6 +36,8 @@ RATS_API int rats_send_string(rats_client_t client, const char* peer_id, const c
 RATS_API int rats_get_peer_count(rats_client_t client);
 RATS_API char* rats_get_our_peer_id(rats_client_t client); // caller must free with rats_string_free
 RATS_API char* rats_get_connection_statistics_json(rats_client_t client); // caller must free with rats_string_free
+RATS_API char* rats_get_metrics_prometheus(rats_client_t client); // caller must free with rats_string_free
+RATS_API char* rats_get_resource_usage_json(rats_client_t client); // caller must free with rats_string_free
 RATS_API char** rats_get_validated_peer_ids(rats_client_t client, int* count); // caller must free array and strings
 RATS_API char** rats_get_peer_ids(rats_client_t client, int* count); // caller must free array and strings
 RATS_API char* rats_get_peer_info_json(rats_client_t client, const char* peer_id); // caller must free
@@ -53,6 +55,11 @@ RATS_API void rats_set_log_rotation_size(rats_client_t client, size_t max_size_b
 RATS_API void rats_set_log_retention_count(rats_client_t client, int count);
 RATS_API void rats_clear_log_file(rats_client_t client);
 
+// Tracing (process-wide; spans are exported as Chrome trace event JSON)
+RATS_API void rats_set_tracing_enabled(int enabled);
+RATS_API char* rats_export_trace_json(void); // caller must free with rats_string_free
+RATS_API int rats_write_trace_file(const char* file_path); // 1 on success
+
 // Error codes
 typedef enum {
     RATS_SUCCESS = 0,
@@ -230,6 +237,46 @@ RATS_API int rats_save_historical_peers(rats_client_t client);
 RATS_API void rats_clear_historical_peers(rats_client_t client);
 RATS_API char** rats_get_historical_peer_ids(rats_client_t client, int* count); // caller must free array and strings
 
+// Lent buffers: bytes owned by the library and lent to the caller until released
+typedef struct rats_buffer* rats_buffer_t;
+RATS_API const void* rats_buffer_data(rats_buffer_t buffer);
+RATS_API size_t rats_buffer_size(rats_buffer_t buffer);
+RATS_API void rats_buffer_release(rats_buffer_t buffer);
+
+// Peer ids in one lent buffer: rats_buffer_data() is an array of *count const char* (no per-id copies)
+RATS_API rats_buffer_t rats_get_peer_ids_lent(rats_client_t client, int* count); // caller must release
+
+// Event polling: events are queued instead of invoking a C callback per message
+typedef enum {
+    RATS_EVENT_CONNECTED = 1,
+    RATS_EVENT_DISCONNECTED = 2,
+    RATS_EVENT_BINARY = 4,
+    RATS_EVENT_STRING = 8,
+    RATS_EVENT_JSON = 16,
+    RATS_EVENT_ALL = 31
+} rats_event_type_t;
+
+typedef struct {
+    rats_event_type_t type;
+    const char* peer_id;    // Valid until buffer is released
+    const void* data;       // Payload (binary bytes, NUL-terminated string or JSON text), NULL for connection events
+    size_t size;            // Payload size in bytes, without the terminating NUL
+    rats_buffer_t buffer;   // Owns peer_id and data, release with rats_buffer_release
+} rats_event_t;
+
+RATS_API rats_error_t rats_enable_event_polling(rats_client_t client, int event_mask, size_t max_queued_events); // mask of rats_event_type_t, 0 disables
+RATS_API int rats_poll_events(rats_client_t client, rats_event_t* events, int max_events, int timeout_ms); // returns events written (or error), timeout_ms < 0 waits indefinitely
+RATS_API uint64_t rats_get_dropped_event_count(rats_client_t client); // payload events dropped while the queue was full
+
+// Batched send: consecutive items with the same data pointer and size share one copy of the payload
+typedef struct {
+    const char* peer_id;
+    const void* data;
+    size_t size;
+} rats_send_item_t;
+
+RATS_API int rats_send_binary_many(rats_client_t client, const rats_send_item_t* items, int count); // returns items queued
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -111,13 +111,17 @@ std::string RatsClient::generate_new_encryption_key() {
     return key_hex;
 }
 
+void RatsClient::set_handshake_config(const HandshakeConfig& config) {
+    encrypted_communication::set_handshake_config(config);
+}
+
+HandshakeConfig RatsClient::get_handshake_config() const {
+    return encrypted_communication::get_handshake_config();
+}
+
 bool RatsClient::is_peer_encrypted(const std::string& peer_id) const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    auto it = peers_.find(peer_id);
-    if (it != peers_.end()) {
-        return it->second.encryption_enabled && it->second.noise_handshake_completed;
-    }
-    return false;
+    auto peer = get_peer_snapshot()->find(peer_id);
+    return peer && peer->encryption_enabled && peer->noise_handshake_completed;
 }
 
 } // namespace librats
@@ -195,6 +195,17 @@ std::string RatsClient::request_file(const std::string& peer_id, const std::stri
     return file_transfer_manager_->request_file(peer_id, remote_file_path, local_path);
 }
 
+std::string RatsClient::request_file_from_swarm(const std::vector<std::string>& peer_ids,
+                                               const std::string& remote_file_path,
+                                               const FileMetadata& metadata, const std::string& local_path) {
+    if (!is_file_transfer_available()) {
+        LOG_CLIENT_ERROR("File transfer manager not available");
+        return "";
+    }
+    
+    return file_transfer_manager_->request_file_from_swarm(peer_ids, remote_file_path, metadata, local_path);
+}
+
 std::string RatsClient::request_directory(const std::string& peer_id, const std::string& remote_directory_path,
                                          const std::string& local_directory_path, bool recursive) {
     if (!is_file_transfer_available()) {
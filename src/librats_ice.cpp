@@ -1,5 +1,6 @@
 #include "librats.h"
 #include "ice.h"
+#include "tracing.h"
 #include <algorithm>
 #include <random>
 
@@ -23,6 +24,7 @@ namespace librats {
 //=============================================================================
 
 bool RatsClient::attempt_ice_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
+    TRACE_SPAN("connection", "attempt_ice_connection");
     LOG_ICE_DEBUG("Attempting ICE connection to " << host << ":" << port);
     
     if (!ice_agent_ || !ice_agent_->is_running()) {
@@ -66,8 +68,9 @@ nlohmann::json RatsClient::create_ice_offer(const std::string& peer_id) {
     offer["target_peer_id"] = peer_id;
     
     if (ice_agent_ && ice_agent_->is_running()) {
-        // Get local credentials
-        auto credentials = ice_agent_->get_local_credentials();
+        // Each peer gets its own session (credentials) on the shared ICE agent
+        ice_agent_->create_session(peer_id);
+        auto credentials = ice_agent_->get_session_credentials(peer_id);
         offer["ice_ufrag"] = credentials.first;
         offer["ice_pwd"] = credentials.second;
         
@@ -112,8 +115,9 @@ bool RatsClient::connect_with_ice(const std::string& peer_id, const nlohmann::js
             return false;
         }
         
-        // Set remote credentials
-        ice_agent_->set_remote_credentials(remote_ufrag, remote_pwd);
+        // Set remote credentials on the peer's session
+        ice_agent_->create_session(peer_id);
+        ice_agent_->set_session_remote_credentials(peer_id, remote_ufrag, remote_pwd);
         
         // Add remote candidates
         if (ice_offer.contains("candidates")) {
@@ -126,14 +130,14 @@ bool RatsClient::connect_with_ice(const std::string& peer_id, const nlohmann::js
                 candidate.foundation = cand_json.value("foundation", "");
                 
                 if (!candidate.ip.empty() && candidate.port > 0) {
-                    ice_agent_->add_remote_candidate(candidate);
+                    ice_agent_->add_session_remote_candidate(peer_id, candidate);
                     LOG_ICE_DEBUG("Added remote ICE candidate: " << candidate.ip << ":" << candidate.port);
                 }
             }
         }
         
         // Start connectivity checks
-        ice_agent_->start_connectivity_checks();
+        ice_agent_->start_session_checks(peer_id);
         
         LOG_ICE_INFO("ICE connectivity checks started for peer " << peer_id);
         return true;
@@ -164,20 +168,18 @@ void RatsClient::initiate_ice_with_peer(const std::string& peer_id, const std::s
     LOG_ICE_INFO("Initiating ICE coordination with peer " << peer_id);
     
     try {
-        // Gather local candidates if not already done
+        // Gather local candidates if not already done (recently gathered ones are reused)
         ice_agent_->gather_candidates();
         
         // Create ICE offer
         nlohmann::json ice_offer = create_ice_offer(peer_id);
         
-        // Send ICE offer via message system
-        nlohmann::json offer_message = create_rats_message("ice_offer", ice_offer, get_our_peer_id());
-        
         // Find peer socket to send offer
         socket_t peer_socket = get_peer_socket_by_id(peer_id);
         
         if (is_valid_socket(peer_socket)) {
-            if (send_json_to_peer(peer_socket, offer_message)) {
+            // Send ICE offer via message system
+            if (send_rats_message(peer_socket, "ice_offer", ice_offer, get_our_peer_id())) {
                 LOG_ICE_INFO("Sent ICE offer to peer " << peer_id);
             } else {
                 LOG_ICE_ERROR("Failed to send ICE offer to peer " << peer_id);
@@ -226,9 +228,7 @@ void RatsClient::handle_ice_offer_message(socket_t socket, const std::string& pe
         ice_answer["target_peer_id"] = offer_peer_id;
         ice_answer["peer_id"] = get_our_peer_id();
         
-        nlohmann::json answer_message = create_rats_message("ice_answer", ice_answer, get_our_peer_id());
-        
-        if (send_json_to_peer(socket, answer_message)) {
+        if (send_rats_message(socket, "ice_answer", ice_answer, get_our_peer_id())) {
             LOG_ICE_INFO("Sent ICE answer to peer " << peer_hash_id);
         } else {
             LOG_ICE_ERROR("Failed to send ICE answer to peer " << peer_hash_id);
@@ -255,7 +255,7 @@ void RatsClient::handle_ice_answer_message(socket_t socket, const std::string& p
         
         // Set ICE state to checking
         {
-            std::lock_guard<std::mutex> lock(peers_mutex_);
+            PeersWriteLock lock(*this);
             auto socket_it = socket_to_peer_id_.find(socket);
             if (socket_it != socket_to_peer_id_.end()) {
                 auto peer_it = peers_.find(socket_it->second);
@@ -292,8 +292,10 @@ void RatsClient::handle_ice_candidate_message(socket_t socket, const std::string
         candidate.component_id = payload.value("component_id", 1);
         
         if (!candidate.ip.empty() && candidate.port > 0) {
-            // Add candidate to ICE agent
-            ice_agent_->add_remote_candidate(candidate);
+            // Add candidate to the peer's ICE session (it may trickle in ahead of the offer)
+            std::string session_id = payload.value("peer_id", peer_hash_id);
+            ice_agent_->create_session(session_id);
+            ice_agent_->add_session_remote_candidate(session_id, candidate);
             
             // Update peer candidate list
             add_candidate_to_peer(socket, candidate);
@@ -314,7 +316,7 @@ void RatsClient::handle_ice_candidate_message(socket_t socket, const std::string
 //=============================================================================
 
 void RatsClient::update_peer_ice_info(socket_t socket, const nlohmann::json& payload) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     auto socket_it = socket_to_peer_id_.find(socket);
     if (socket_it != socket_to_peer_id_.end()) {
         auto peer_it = peers_.find(socket_it->second);
@@ -327,7 +329,7 @@ void RatsClient::update_peer_ice_info(socket_t socket, const nlohmann::json& pay
 }
 
 void RatsClient::add_candidate_to_peer(socket_t socket, const IceCandidate& candidate) {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
+    PeersWriteLock lock(*this);
     auto socket_it = socket_to_peer_id_.find(socket);
     if (socket_it != socket_to_peer_id_.end()) {
         auto peer_it = peers_.find(socket_it->second);
@@ -359,6 +361,9 @@ void RatsClient::remove_ice_coordination_tracking(const std::string& peer_id) {
 void RatsClient::cleanup_ice_coordination_for_peer(const std::string& peer_id) {
     try {
         remove_ice_coordination_tracking(peer_id);
+        if (ice_agent_) {
+            ice_agent_->close_session(peer_id);
+        }
     } catch (...) {
         // Ignore cleanup errors to prevent recursive exceptions
         LOG_ICE_DEBUG("Exception during ICE coordination cleanup for peer " << peer_id);
@@ -394,6 +399,16 @@ void RatsClient::setup_ice_callbacks() {
             nat_progress_callback_("", status); // Empty peer_id for general ICE state
         }
     });
+    
+    // Per-peer sessions share the agent; report their state under the peer's id
+    ice_agent_->set_session_state_callback([this](const std::string& peer_id, IceConnectionState state) {
+        LOG_ICE_INFO("ICE session state changed for peer " << peer_id << ": " << static_cast<int>(state));
+        
+        if (nat_progress_callback_ && !peer_id.empty()) {
+            std::string status = "ICE state: " + std::to_string(static_cast<int>(state));
+            nat_progress_callback_(peer_id, status);
+        }
+    });
 }
 
 void RatsClient::initialize_ice_agent() {
@@ -455,18 +470,15 @@ nlohmann::json RatsClient::get_ice_statistics() const {
         
         // Get peer ICE information
         nlohmann::json ice_peers = nlohmann::json::array();
-        {
-            std::lock_guard<std::mutex> lock(peers_mutex_);
-            for (const auto& pair : peers_) {
-                const RatsPeer& peer = pair.second;
-                if (peer.ice_enabled) {
-                    nlohmann::json peer_ice;
-                    peer_ice["peer_id"] = peer.peer_id;
-                    peer_ice["ice_state"] = static_cast<int>(peer.ice_state);
-                    peer_ice["ufrag"] = peer.ice_ufrag;
-                    peer_ice["candidates_count"] = peer.ice_candidates.size();
-                    ice_peers.push_back(peer_ice);
-                }
+        auto snapshot = get_peer_snapshot();
+        for (const auto& peer : snapshot->peers) {
+            if (peer->ice_enabled) {
+                nlohmann::json peer_ice;
+                peer_ice["peer_id"] = peer->peer_id;
+                peer_ice["ice_state"] = static_cast<int>(peer->ice_state);
+                peer_ice["ufrag"] = peer->ice_ufrag;
+                peer_ice["candidates_count"] = peer->ice_candidates.size();
+                ice_peers.push_back(peer_ice);
             }
         }
         stats["ice_peers"] = ice_peers;
@@ -483,12 +495,8 @@ bool RatsClient::is_ice_enabled() const {
 }
 
 bool RatsClient::is_peer_ice_connected(const std::string& peer_id) const {
-    std::lock_guard<std::mutex> lock(peers_mutex_);
-    auto it = peers_.find(peer_id);
-    if (it != peers_.end()) {
-        return it->second.is_ice_connected();
-    }
-    return false;
+    auto peer = get_peer_snapshot()->find(peer_id);
+    return peer && peer->is_ice_connected();
 }
 
 //=============================================================================
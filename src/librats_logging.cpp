@@ -77,17 +77,7 @@ void RatsClient::set_log_level(const std::string& level_str) {
 }
 
 LogLevel RatsClient::get_log_level() const {
-    // Note: Logger doesn't expose get_log_level method, so we'll use a workaround
-    // by checking which level actually outputs. This is a limitation of the current Logger design.
-    Logger& logger = Logger::getInstance();
-    
-    // Try to determine current level by checking if debug messages would be shown
-    // This is a simple approximation - for a more accurate implementation,
-    // the Logger class would need a get_log_level() method
-    
-    // For now, we'll return INFO as a reasonable default
-    // In a production system, the Logger class should be enhanced to track and return the current level
-    return LogLevel::INFO;
+    return Logger::getInstance().get_log_level();
 }
 
 void RatsClient::set_log_colors_enabled(bool enabled) {
@@ -155,4 +145,13 @@ void RatsClient::clear_log_file() {
     }
 }
 
+void RatsClient::set_async_logging_enabled(bool enabled) {
+    Logger::getInstance().set_async_enabled(enabled);
+    LOG_CLIENT_INFO("Asynchronous logging " << (enabled ? "enabled" : "disabled"));
+}
+
+bool RatsClient::is_async_logging_enabled() const {
+    return Logger::getInstance().is_async_enabled();
+}
+
 }
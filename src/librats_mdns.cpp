@@ -44,6 +44,7 @@ bool RatsClient::start_mdns_discovery(const std::string& service_instance_name,
     
     // Create mDNS client
     mdns_client_ = std::make_unique<MdnsClient>(instance_name, listen_port_);
+    apply_resource_limits();
     
     // Set service discovery callback
     mdns_client_->set_service_callback([this](const MdnsService& service, bool is_new) {
@@ -156,7 +157,7 @@ void RatsClient::handle_mdns_service_discovery(const MdnsService& service, bool
                        << service.ip_address << ":" << service.port);
         
         // Try to connect to the discovered peer (non-blocking)
-        std::thread([this, service]() {
+        submit_task([this, service]() {
             if (connect_to_peer(service.ip_address, service.port)) {
                 LOG_CLIENT_INFO("Successfully connected to mDNS discovered peer: " 
                                << service.ip_address << ":" << service.port);
@@ -164,7 +165,7 @@ void RatsClient::handle_mdns_service_discovery(const MdnsService& service, bool
                 LOG_CLIENT_DEBUG("Failed to connect to mDNS discovered peer: " 
                                 << service.ip_address << ":" << service.port);
             }
-        }).detach();
+        }, "mdns-connect-" + service.ip_address);
     }
 }
 
@@ -1,7 +1,10 @@
 #include "librats.h"
 #include "stun.h"
 #include "network_utils.h"
+#include "tracing.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <random>
 
 // Logging macros for NAT operations
@@ -19,6 +22,73 @@
 
 namespace librats {
 
+namespace {
+
+int64_t unix_time_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Subnet a peer address belongs to (/24 for IPv4, /48 for IPv6), empty for hostnames
+std::string strategy_subnet_of(const std::string& ip) {
+    // IPv4-mapped IPv6 addresses (from dual-stack accepts) belong to their IPv4 subnet
+    if (ip.compare(0, 7, "::ffff:") == 0 && ip.find('.') != std::string::npos) {
+        return strategy_subnet_of(ip.substr(7));
+    }
+    in_addr addr4;
+    if (inet_pton(AF_INET, ip.c_str(), &addr4) == 1) {
+        reinterpret_cast<uint8_t*>(&addr4)[3] = 0;
+        char buffer[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr4, buffer, sizeof(buffer));
+        return std::string(buffer) + "/24";
+    }
+    in6_addr addr6;
+    if (inet_pton(AF_INET6, ip.c_str(), &addr6) == 1) {
+        std::memset(reinterpret_cast<uint8_t*>(&addr6) + 6, 0, 10);
+        char buffer[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, &addr6, buffer, sizeof(buffer));
+        return std::string(buffer) + "/48";
+    }
+    return "";
+}
+
+// Attempt functions report variants like "turn_fallback"; learn them under the strategy that was tried
+std::string base_strategy_method(const std::string& method) {
+    for (const char* base : {"direct", "stun", "ice", "turn", "hole_punch"}) {
+        if (method.compare(0, std::strlen(base), base) == 0) {
+            return base;
+        }
+    }
+    return "";
+}
+
+void decay_strategy_stats(LearnedStrategyStats& stats, int64_t now, int64_t half_life) {
+    if (now > stats.last_update) {
+        double factor = std::pow(0.5, static_cast<double>(now - stats.last_update) / half_life);
+        stats.successes *= factor;
+        stats.failures *= factor;
+        stats.last_update = now;
+    }
+}
+
+// Method with the best smoothed success rate, empty unless it succeeds more often than it fails
+std::string best_learned_method(const StrategyCacheEntry& entry, int64_t now, int64_t half_life) {
+    std::string best;
+    double best_rate = 0.5;
+    for (const auto& pair : entry.methods) {
+        LearnedStrategyStats stats = pair.second;
+        decay_strategy_stats(stats, now, half_life);
+        double rate = (stats.successes + 1.0) / (stats.successes + stats.failures + 2.0);
+        if (stats.successes > 0.0 && rate > best_rate) {
+            best_rate = rate;
+            best = pair.first;
+        }
+    }
+    return best;
+}
+
+} // anonymous namespace
+
 //=============================================================================
 // NAT Traversal Initialization and Detection
 //=============================================================================
@@ -26,10 +96,10 @@ namespace librats {
 void RatsClient::initialize_nat_traversal() {
     LOG_NAT_INFO("Initializing NAT traversal capabilities");
     
-    // Detect and cache NAT type in background thread
-    add_managed_thread(std::thread([this]() {
+    // Detect and cache NAT type on the task pool
+    submit_task([this]() {
         detect_and_cache_nat_type();
-    }), "nat-detection");
+    }, "nat-detection");
     
     // Initialize ICE if enabled
     if (ice_agent_) {
@@ -172,7 +242,55 @@ std::string RatsClient::get_public_ip() const {
 // Connection Strategy Selection
 //=============================================================================
 
+std::string RatsClient::select_learned_connection_strategy(const std::string& host, int port) {
+    int64_t now = unix_time_seconds();
+    std::string subnet = strategy_subnet_of(host);
+    
+    std::lock_guard<std::mutex> lock(connection_attempts_mutex_);
+    for (const std::string& key : {"peer:" + normalize_peer_address(host, port), "subnet:" + subnet}) {
+        auto it = strategy_cache_.find(key);
+        if (it == strategy_cache_.end()) {
+            continue;
+        }
+        std::string method = best_learned_method(it->second, now, STRATEGY_CACHE_HALF_LIFE_SECONDS);
+        if (method.empty()) {
+            continue;
+        }
+        // Periodically fall back to NAT-based selection so a better path can still be discovered
+        if (++it->second.selections % STRATEGY_REPROBE_INTERVAL == 0) {
+            LOG_NAT_DEBUG("Re-probing connection strategy for " << key << " instead of learned '" << method << "'");
+            return "";
+        }
+        LOG_NAT_DEBUG("Using learned connection strategy '" << method << "' for " << key);
+        return method;
+    }
+    return "";
+}
+
+std::string RatsClient::get_learned_connection_strategy(const std::string& host, int port) const {
+    int64_t now = unix_time_seconds();
+    std::string subnet = strategy_subnet_of(host);
+    
+    std::lock_guard<std::mutex> lock(connection_attempts_mutex_);
+    for (const std::string& key : {"peer:" + normalize_peer_address(host, port), "subnet:" + subnet}) {
+        auto it = strategy_cache_.find(key);
+        if (it != strategy_cache_.end()) {
+            std::string method = best_learned_method(it->second, now, STRATEGY_CACHE_HALF_LIFE_SECONDS);
+            if (!method.empty()) {
+                return method;
+            }
+        }
+    }
+    return "";
+}
+
 std::string RatsClient::select_best_connection_strategy(const std::string& host, int port) {
+    // Start with whatever worked for this peer or its subnet before
+    std::string learned = select_learned_connection_strategy(host, port);
+    if (!learned.empty()) {
+        return learned;
+    }
+    
     NatType local_nat = detect_nat_type();
     
     // Strategy selection based on NAT type
@@ -221,6 +339,7 @@ std::string RatsClient::select_best_connection_strategy(const std::string& host,
 //=============================================================================
 
 bool RatsClient::attempt_direct_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
+    TRACE_SPAN("connection", "attempt_direct_connection");
     LOG_NAT_DEBUG("Attempting direct connection to " << host << ":" << port);
     
     // Check if this peer should be ignored (local interface)
@@ -242,10 +361,16 @@ bool RatsClient::attempt_direct_connection(const std::string& host, int port, Co
         return true; // Not really an error
     }
     
+    // The UDP transport is tried first when selected; TCP remains the fallback
+    if (nat_config_.transport == PeerTransport::UTP && perform_utp_connection(host, port, result)) {
+        return true;
+    }
+    
     return perform_tcp_connection(host, port, result);
 }
 
 bool RatsClient::attempt_stun_assisted_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
+    TRACE_SPAN("connection", "attempt_stun_assisted_connection");
     LOG_NAT_DEBUG("Attempting STUN-assisted connection to " << host << ":" << port);
     
     // First ensure we have discovered our public IP
@@ -262,6 +387,7 @@ bool RatsClient::attempt_stun_assisted_connection(const std::string& host, int p
 }
 
 bool RatsClient::attempt_turn_relay_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
+    TRACE_SPAN("connection", "attempt_turn_relay_connection");
     LOG_NAT_DEBUG("Attempting TURN relay connection to " << host << ":" << port);
     
     if (nat_config_.turn_servers.empty()) {
@@ -291,6 +417,7 @@ bool RatsClient::attempt_turn_relay_connection(const std::string& host, int port
 }
 
 bool RatsClient::attempt_hole_punch_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
+    TRACE_SPAN("connection", "attempt_hole_punch_connection");
     LOG_NAT_DEBUG("Attempting hole punch connection to " << host << ":" << port);
     
     if (!nat_config_.enable_hole_punching) {
@@ -321,16 +448,26 @@ bool RatsClient::attempt_hole_punch_connection(const std::string& host, int port
 }
 
 bool RatsClient::perform_tcp_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
-    // Attempt TCP connection with 10-second timeout
-    socket_t peer_socket = create_tcp_client(host, port, 10000); // 10 seconds = 10000ms
+    // Race all addresses of the host, staggered per RFC 8305, within a 10-second budget
+    std::string connected_address;
+    socket_t peer_socket = create_tcp_client_racing(host, port, TCP_CONNECT_TIMEOUT_MS,
+                                                    CONNECTION_ATTEMPT_DELAY_MS, &connected_address);
     if (!is_valid_socket(peer_socket)) {
         result.error_message = "Failed to create TCP connection (connection may have timed out after 10s)";
         return false;
     }
+    LOG_NAT_DEBUG("Connected to " << host << ":" << port << " via " << connected_address);
     
-    // Initialize encryption if enabled
+    return register_outgoing_connection(peer_socket, host, port, "TCP", result);
+}
+
+bool RatsClient::register_outgoing_connection(socket_t peer_socket, const std::string& host, int port,
+                                              const std::string& transport_protocol, ConnectionAttemptResult& result) {
+    std::string peer_address = normalize_peer_address(host, port);
+    
+    // Initialize encryption if enabled (peers seen before at this address get the short handshake)
     if (is_encryption_enabled()) {
-        if (!encrypted_communication::initialize_outgoing_connection(peer_socket)) {
+        if (!encrypted_communication::initialize_outgoing_connection(peer_socket, peer_address)) {
             result.error_message = "Failed to initialize encryption";
             close_socket(peer_socket);
             return false;
@@ -340,19 +477,26 @@ bool RatsClient::perform_tcp_connection(const std::string& host, int port, Conne
     // Create peer and add to management
     std::string connection_info = host + ":" + std::to_string(port);
     std::string peer_hash_id = generate_peer_hash_id(peer_socket, connection_info);
-    std::string peer_address = normalize_peer_address(host, port);
     
     {
-        std::lock_guard<std::mutex> lock(peers_mutex_);
+        PeersWriteLock lock(*this);
         RatsPeer new_peer(peer_hash_id, host, port, peer_socket, peer_address, true);
         new_peer.encryption_enabled = is_encryption_enabled();
         new_peer.connection_method = "direct";
+        new_peer.transport_protocol = transport_protocol;
         add_peer_unlocked(new_peer);
     }
     
     // Start handling this peer
-    add_managed_thread(std::thread(&RatsClient::handle_client, this, peer_socket, peer_hash_id), 
-                      "direct-connect-handler-" + peer_hash_id.substr(0, 8));
+    if (!start_client_session(peer_socket, peer_hash_id)) {
+        result.error_message = "Failed to register connection";
+        remove_peer(peer_socket);
+        if (is_encryption_enabled()) {
+            encrypted_communication::cleanup_socket(peer_socket);
+        }
+        close_socket(peer_socket);
+        return false;
+    }
     
     // Send handshake if not encrypted
     if (!is_encryption_enabled()) {
@@ -415,9 +559,7 @@ void RatsClient::send_nat_info_to_peer(socket_t socket, const std::string& peer_
         nat_info["preserves_port"] = get_nat_characteristics().preserves_port;
         nat_info["hairpin_support"] = get_nat_characteristics().hairpin_support;
         
-        nlohmann::json nat_message = create_rats_message("nat_info_exchange", nat_info, get_our_peer_id());
-        
-        if (send_json_to_peer(socket, nat_message)) {
+        if (send_rats_message(socket, "nat_info_exchange", nat_info, get_our_peer_id())) {
             LOG_NAT_DEBUG("Sent NAT info to peer " << peer_id);
         } else {
             LOG_NAT_ERROR("Failed to send NAT info to peer " << peer_id);
@@ -439,7 +581,7 @@ void RatsClient::handle_nat_info_exchange_message(socket_t socket, const std::st
         
         // Update peer with NAT information
         {
-            std::lock_guard<std::mutex> lock(peers_mutex_);
+            PeersWriteLock lock(*this);
             auto socket_it = socket_to_peer_id_.find(socket);
             if (socket_it != socket_to_peer_id_.end()) {
                 auto peer_it = peers_.find(socket_it->second);
@@ -459,11 +601,9 @@ void RatsClient::handle_nat_info_exchange_message(socket_t socket, const std::st
         our_nat_info["public_ip"] = get_public_ip();
         our_nat_info["response"] = true;
         
-        nlohmann::json nat_message = create_rats_message("nat_info_exchange", our_nat_info, get_our_peer_id());
-        
         // Only send if this wasn't already a response
         if (!payload.value("response", false)) {
-            if (send_json_to_peer(socket, nat_message)) {
+            if (send_rats_message(socket, "nat_info_exchange", our_nat_info, get_our_peer_id())) {
                 LOG_NAT_DEBUG("Sent NAT info to peer " << peer_hash_id);
             } else {
                 LOG_NAT_ERROR("Failed to send NAT info to peer " << peer_hash_id);
@@ -500,9 +640,7 @@ void RatsClient::handle_hole_punch_coordination_message(socket_t socket, const s
         response_payload["timestamp"] = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::high_resolution_clock::now().time_since_epoch()).count();
         
-        nlohmann::json response_message = create_rats_message("hole_punch_response", response_payload, get_our_peer_id());
-        
-        if (send_json_to_peer(socket, response_message)) {
+        if (send_rats_message(socket, "hole_punch_response", response_payload, get_our_peer_id())) {
             LOG_NAT_DEBUG("Sent hole punch coordination response to peer " << peer_hash_id);
         } else {
             LOG_NAT_ERROR("Failed to send hole punch coordination response to peer " << peer_hash_id);
@@ -555,6 +693,11 @@ nlohmann::json RatsClient::get_nat_traversal_statistics() const {
         {"turn_servers", nat_config_.turn_servers}
     };
     
+    {
+        std::lock_guard<std::mutex> lock(connection_attempts_mutex_);
+        stats["learned_strategy_entries"] = strategy_cache_.size();
+    }
+    
     return stats;
 }
 
@@ -566,6 +709,38 @@ void RatsClient::update_connection_statistics(const std::string& peer_id, const
     if (connection_attempts_[peer_id].size() > 10) {
         connection_attempts_[peer_id].erase(connection_attempts_[peer_id].begin());
     }
+    
+    // Learn the outcome for the peer address and its subnet
+    std::string method = base_strategy_method(result.method);
+    if (method.empty()) {
+        return;
+    }
+    std::string ip = peer_id.substr(0, peer_id.rfind(':'));
+    if (ip.size() >= 2 && ip.front() == '[' && ip.back() == ']') {
+        ip = ip.substr(1, ip.size() - 2);
+    }
+    std::string subnet = strategy_subnet_of(ip);
+    
+    int64_t now = unix_time_seconds();
+    std::vector<std::string> keys = {"peer:" + peer_id};
+    if (!subnet.empty()) {
+        keys.push_back("subnet:" + subnet);
+    }
+    for (const auto& key : keys) {
+        StrategyCacheEntry& entry = strategy_cache_[key];
+        LearnedStrategyStats& stats = entry.methods[method];
+        decay_strategy_stats(stats, now, STRATEGY_CACHE_HALF_LIFE_SECONDS);
+        stats.last_update = now;
+        (result.success ? stats.successes : stats.failures) += 1.0;
+        entry.last_update = now;
+    }
+    
+    // Forget the least recently used entries beyond the cap
+    while (strategy_cache_.size() > STRATEGY_CACHE_MAX_ENTRIES) {
+        auto oldest = std::min_element(strategy_cache_.begin(), strategy_cache_.end(),
+            [](const auto& a, const auto& b) { return a.second.last_update < b.second.last_update; });
+        strategy_cache_.erase(oldest);
+    }
 }
 
 } // namespace librats
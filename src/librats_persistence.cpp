@@ -180,8 +180,10 @@ bool RatsClient::save_configuration() {
             return false;
         }
         
-        // Save peers
-        return save_peers_to_file();
+        // Save peers and learned connection strategies
+        bool peers_saved = save_peers_to_file();
+        save_strategy_cache();
+        return peers_saved;
         
     } catch (const nlohmann::json::exception& e) {
         LOG_CLIENT_ERROR("Failed to create configuration JSON: " << e.what());
@@ -195,45 +197,47 @@ bool RatsClient::save_configuration() {
 bool RatsClient::save_peers_to_file() {
     // This method assumes config_mutex_ is already locked by save_configuration()
     
-    LOG_CLIENT_DEBUG("Saving peers to " << get_peers_file_path());
+    auto store = get_peer_store(peers_store_, get_peers_file_path());
+    if (!store) {
+        LOG_CLIENT_ERROR("Failed to open peers file " << get_peers_file_path());
+        return false;
+    }
     
-    try {
-        nlohmann::json peers_json = nlohmann::json::array();
-        
-        // Get validated peers for saving
-        {
-            std::lock_guard<std::mutex> peers_lock(peers_mutex_);
-            for (const auto& pair : peers_) {
-                const RatsPeer& peer = pair.second;
-                // Only save peers that have completed handshake and have valid peer IDs
-                if (peer.is_handshake_completed() && !peer.peer_id.empty()) {
-                    // Don't save ourselves
-                    if (peer.peer_id != our_peer_id_) {
-                        peers_json.push_back(serialize_peer_for_persistence(peer));
-                    }
-                }
-            }
+    // Only the difference to the last save is appended: new or changed peers, and peers that went away
+    int64_t now = persistence_timestamp();
+    std::unordered_map<std::string, StoredPeer> connected;
+    auto snapshot = get_peer_snapshot();
+    for (const auto& peer : snapshot->peers) {
+        // Only save peers that have completed handshake and have valid peer IDs, and not ourselves
+        if (peer->is_handshake_completed() && !peer->peer_id.empty() && peer->peer_id != our_peer_id_) {
+            connected[peer->peer_id] = to_stored_peer(*peer, now);
         }
-        
-        LOG_CLIENT_INFO("Saving " << peers_json.size() << " peers to persistence file");
-        
-        // Save peers file
-        std::string peers_data = peers_json.dump(4);
-        if (create_file(get_peers_file_path(), peers_data)) {
-            LOG_CLIENT_DEBUG("Peers saved successfully");
-            return true;
-        } else {
-            LOG_CLIENT_ERROR("Failed to save peers file");
-            return false;
+    }
+    
+    bool success = true;
+    size_t written = 0;
+    for (const auto& stored : store->peers()) {
+        if (connected.find(stored.peer_id) == connected.end()) {
+            success = store->remove(stored.peer_id) && success;
+            written++;
         }
-        
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to serialize peers: " << e.what());
-        return false;
-    } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to save peers: " << e.what());
-        return false;
     }
+    for (const auto& entry : connected) {
+        StoredPeer stored;
+        if (store->get(entry.first, stored) && stored.address() == entry.second.address() &&
+            stored.version == entry.second.version && stored.noise_static_key == entry.second.noise_static_key &&
+            now - stored.last_seen < PEER_REFRESH_INTERVAL_SECONDS) {
+            continue;
+        }
+        success = store->put(entry.second) && success;
+        written++;
+    }
+    
+    LOG_CLIENT_DEBUG("Saved " << connected.size() << " peers (" << written << " records written) to " << get_peers_file_path());
+    if (!success) {
+        LOG_CLIENT_ERROR("Failed to save peers file");
+    }
+    return success;
 }
 
 int RatsClient::load_and_reconnect_peers() {
@@ -242,97 +246,18 @@ int RatsClient::load_and_reconnect_peers() {
         return 0;
     }
     
-    std::string peers_file_path;
+    std::shared_ptr<PeerStore> store;
     {
         std::lock_guard<std::mutex> lock(config_mutex_);
-        peers_file_path = get_peers_file_path();
+        store = get_peer_store(peers_store_, get_peers_file_path());
     }
-
-    LOG_CLIENT_INFO("Loading saved peers from " << peers_file_path);
-    
-    // Check if peers file exists
-    if (!file_or_directory_exists(peers_file_path)) {
-        LOG_CLIENT_INFO("No saved peers file found");
+    if (!store) {
+        LOG_CLIENT_ERROR("Failed to open saved peers file");
         return 0;
     }
     
-    try {
-        std::string peers_data = read_file_text_cpp(peers_file_path);
-        if (peers_data.empty()) {
-            LOG_CLIENT_INFO("Peers file is empty");
-            return 0;
-        }
-        
-        nlohmann::json peers_json = nlohmann::json::parse(peers_data);
-        
-        if (!peers_json.is_array()) {
-            LOG_CLIENT_ERROR("Invalid peers file format - expected array");
-            return 0;
-        }
-        
-        int reconnect_attempts = 0;
-        
-        for (const auto& peer_json : peers_json) {
-            std::string ip;
-            int port;
-            std::string peer_id;
-            
-            if (!deserialize_peer_from_persistence(peer_json, ip, port, peer_id)) {
-                continue; // Skip invalid or old peers
-            }
-            
-            // Don't connect to ourselves
-            if (peer_id == get_our_peer_id()) {
-                LOG_CLIENT_DEBUG("Skipping connection to ourselves: " << peer_id);
-                continue;
-            }
-            
-            // Check if we should ignore this peer (local interface)
-            if (should_ignore_peer(ip, port)) {
-                LOG_CLIENT_DEBUG("Ignoring saved peer " << ip << ":" << port << " - local interface address");
-                continue;
-            }
-            
-            // Check if we're already connected to this peer
-            std::string normalized_peer_address = normalize_peer_address(ip, port);
-            if (is_already_connected_to_address(normalized_peer_address)) {
-                LOG_CLIENT_DEBUG("Already connected to saved peer " << normalized_peer_address);
-                continue;
-            }
-            
-            // Check if peer limit is reached
-            if (is_peer_limit_reached()) {
-                LOG_CLIENT_DEBUG("Peer limit reached, stopping reconnection attempts");
-                break;
-            }
-            
-            LOG_CLIENT_INFO("Attempting to reconnect to saved peer: " << ip << ":" << port << " (peer_id: " << peer_id << ")");
-            
-            // Attempt to connect (non-blocking)
-            add_managed_thread(std::thread([this, ip, port, peer_id]() {
-                if (connect_to_peer(ip, port)) {
-                    LOG_CLIENT_INFO("Successfully reconnected to saved peer: " << ip << ":" << port);
-                } else {
-                    LOG_CLIENT_DEBUG("Failed to reconnect to saved peer: " << ip << ":" << port);
-                }
-            }), "peer-reconnect-" + peer_id.substr(0, 8));
-            
-            reconnect_attempts++;
-            
-            // Small delay between connection attempts to avoid overwhelming the network
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
-        
-        LOG_CLIENT_INFO("Processed " << peers_json.size() << " saved peers, attempted " << reconnect_attempts << " reconnections");
-        return reconnect_attempts;
-        
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to parse saved peers file: " << e.what());
-        return 0;
-    } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to load saved peers: " << e.what());
-        return 0;
-    }
+    LOG_CLIENT_INFO("Loaded " << store->size() << " saved peers from " << store->path());
+    return schedule_peer_reconnects(store, "saved");
 }
 
 bool RatsClient::append_peer_to_historical_file(const RatsPeer& peer) {
@@ -346,203 +271,152 @@ bool RatsClient::append_peer_to_historical_file(const RatsPeer& peer) {
         return true;
     }
     
-    try {
-        // Create historical peer entry with timestamp
-        nlohmann::json historical_peer = serialize_peer_for_persistence(peer);
-        
-        // Add current timestamp as last_seen
-        auto now = std::chrono::high_resolution_clock::now();
-        auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-        historical_peer["last_seen"] = timestamp;
-        
-        // Check if file exists, if not create it as an empty array
-        std::string file_path = get_peers_ever_file_path();
-        nlohmann::json historical_peers;
-        
-        if (file_or_directory_exists(file_path)) {
-            try {
-                std::string existing_data = read_file_text_cpp(file_path);
-                if (!existing_data.empty()) {
-                    historical_peers = nlohmann::json::parse(existing_data);
-                    if (!historical_peers.is_array()) {
-                        LOG_CLIENT_WARN("Historical peers file format invalid, creating new array");
-                        historical_peers = nlohmann::json::array();
-                    }
-                } else {
-                    historical_peers = nlohmann::json::array();
-                }
-            } catch (const std::exception& e) {
-                LOG_CLIENT_WARN("Failed to read historical peers file, creating new array: " << e.what());
-                historical_peers = nlohmann::json::array();
-            }
-        } else {
-            historical_peers = nlohmann::json::array();
-        }
-        
-        // Check if this peer already exists in historical file
-        std::string peer_address = peer.ip + ":" + std::to_string(peer.port);
-        bool already_exists = false;
-        
-        for (auto& existing_peer : historical_peers) {
-            std::string existing_ip = existing_peer.value("ip", "");
-            int existing_port = existing_peer.value("port", 0);
-            std::string existing_address = existing_ip + ":" + std::to_string(existing_port);
-            
-            if (existing_address == peer_address || existing_peer.value("peer_id", "") == peer.peer_id) {
-                // Update timestamp for existing peer
-                existing_peer["last_seen"] = timestamp;
-                already_exists = true;
-                break;
-            }
-        }
-        
-        // If peer doesn't exist, add it
-        if (!already_exists) {
-            historical_peers.push_back(historical_peer);
-            LOG_CLIENT_DEBUG("Added new peer to historical file: " << peer.ip << ":" << peer.port << " (peer_id: " << peer.peer_id << ")");
-        } else {
-            LOG_CLIENT_DEBUG("Updated timestamp for existing historical peer: " << peer.ip << ":" << peer.port);
-        }
-        
-        // Save updated historical peers file
-        std::string historical_data = historical_peers.dump(4);
-        if (create_file(file_path, historical_data)) {
-            return true;
-        } else {
-            LOG_CLIENT_ERROR("Failed to save historical peers file");
-            return false;
-        }
-        
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to process historical peer: " << e.what());
-        return false;
-    } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to append peer to historical file: " << e.what());
+    // A single appended record, cheap enough to write while the handshake holds the peers lock
+    auto store = get_peer_store(peers_ever_store_, get_peers_ever_file_path());
+    if (!store || !store->put(to_stored_peer(peer, persistence_timestamp()))) {
+        LOG_CLIENT_ERROR("Failed to append peer to historical file: " << peer.ip << ":" << peer.port);
         return false;
     }
+    return true;
 }
 
 bool RatsClient::load_historical_peers() {
-    LOG_CLIENT_INFO("Loading historical peers from " << get_peers_ever_file_path());
+    auto store = get_peer_store(peers_ever_store_, get_peers_ever_file_path());
+    if (!store) {
+        LOG_CLIENT_ERROR("Failed to load historical peers file " << get_peers_ever_file_path());
+        return false;
+    }
+    
+    LOG_CLIENT_INFO("Loaded " << store->size() << " historical peers from " << store->path());
+    return true;
+}
+
+bool RatsClient::save_historical_peers() {
+    // Get current peers and save them to historical file
+    std::vector<RatsPeer> current_peers = get_validated_peers();
+    
+    for (const auto& peer : current_peers) {
+        if (!append_peer_to_historical_file(peer)) {
+            LOG_CLIENT_WARN("Failed to save peer to historical file: " << peer.ip << ":" << peer.port);
+        }
+    }
     
-    // Check if historical peers file exists
-    if (!file_or_directory_exists(get_peers_ever_file_path())) {
-        LOG_CLIENT_INFO("No historical peers file found");
+    LOG_CLIENT_INFO("Saved " << current_peers.size() << " current peers to historical file");
+    return true;
+}
+
+void RatsClient::clear_historical_peers() {
+    auto store = get_peer_store(peers_ever_store_, get_peers_ever_file_path());
+    if (store && store->clear()) {
+        LOG_CLIENT_INFO("Cleared historical peers file");
+    } else {
+        LOG_CLIENT_ERROR("Failed to clear historical peers file");
+    }
+}
+
+bool RatsClient::load_strategy_cache() {
+    if (!file_or_directory_exists(get_strategy_cache_file_path())) {
+        LOG_CLIENT_DEBUG("No strategy cache file found");
         return true; // Not an error
     }
     
     try {
-        std::string historical_data = read_file_text_cpp(get_peers_ever_file_path());
-        if (historical_data.empty()) {
-            LOG_CLIENT_INFO("Historical peers file is empty");
+        std::string cache_data = read_file_text_cpp(get_strategy_cache_file_path());
+        if (cache_data.empty()) {
             return true;
         }
         
-        nlohmann::json historical_peers = nlohmann::json::parse(historical_data);
-        
-        if (!historical_peers.is_array()) {
-            LOG_CLIENT_ERROR("Invalid historical peers file format - expected array");
+        nlohmann::json cache_json = nlohmann::json::parse(cache_data);
+        if (!cache_json.is_object() || !cache_json.contains("entries") || !cache_json["entries"].is_object()) {
+            LOG_CLIENT_ERROR("Invalid strategy cache file format - expected object with entries");
             return false;
         }
         
-        LOG_CLIENT_INFO("Loaded " << historical_peers.size() << " historical peers from file");
+        std::lock_guard<std::mutex> lock(connection_attempts_mutex_);
+        for (const auto& item : cache_json["entries"].items()) {
+            StrategyCacheEntry entry;
+            entry.last_update = item.value().value("last_update", static_cast<int64_t>(0));
+            nlohmann::json methods = item.value().value("methods", nlohmann::json::object());
+            for (const auto& method : methods.items()) {
+                LearnedStrategyStats stats;
+                stats.successes = method.value().value("successes", 0.0);
+                stats.failures = method.value().value("failures", 0.0);
+                stats.last_update = method.value().value("last_update", static_cast<int64_t>(0));
+                entry.methods[method.key()] = stats;
+            }
+            strategy_cache_[item.key()] = std::move(entry);
+        }
+        
+        LOG_CLIENT_INFO("Loaded " << strategy_cache_.size() << " learned connection strategies");
         return true;
         
     } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to parse historical peers file: " << e.what());
+        LOG_CLIENT_ERROR("Failed to parse strategy cache file: " << e.what());
         return false;
     } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to load historical peers file: " << e.what());
+        LOG_CLIENT_ERROR("Failed to load strategy cache file: " << e.what());
         return false;
     }
 }
 
-bool RatsClient::save_historical_peers() {
+bool RatsClient::save_strategy_cache() const {
     try {
-        // Get current peers and save them to historical file
-        std::vector<RatsPeer> current_peers = get_validated_peers();
-        
-        for (const auto& peer : current_peers) {
-            if (!append_peer_to_historical_file(peer)) {
-                LOG_CLIENT_WARN("Failed to save peer to historical file: " << peer.ip << ":" << peer.port);
+        nlohmann::json entries = nlohmann::json::object();
+        {
+            std::lock_guard<std::mutex> lock(connection_attempts_mutex_);
+            if (strategy_cache_.empty()) {
+                return true;
+            }
+            for (const auto& pair : strategy_cache_) {
+                nlohmann::json methods = nlohmann::json::object();
+                for (const auto& method : pair.second.methods) {
+                    methods[method.first] = {
+                        {"successes", method.second.successes},
+                        {"failures", method.second.failures},
+                        {"last_update", method.second.last_update}
+                    };
+                }
+                entries[pair.first] = {
+                    {"last_update", pair.second.last_update},
+                    {"methods", methods}
+                };
             }
         }
         
-        LOG_CLIENT_INFO("Saved " << current_peers.size() << " current peers to historical file");
-        return true;
-        
-    } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to save historical peers: " << e.what());
-        return false;
-    }
-}
-
-void RatsClient::clear_historical_peers() {
-    std::string file_path = get_peers_ever_file_path();
-    
-    try {
-        // Create empty array and save to file
-        nlohmann::json empty_array = nlohmann::json::array();
-        std::string empty_data = empty_array.dump(4);
+        nlohmann::json cache_json;
+        cache_json["version"] = 1;
+        cache_json["entries"] = entries;
         
-        if (create_file(file_path, empty_data)) {
-            LOG_CLIENT_INFO("Cleared historical peers file");
-        } else {
-            LOG_CLIENT_ERROR("Failed to clear historical peers file");
+        if (create_file(get_strategy_cache_file_path(), cache_json.dump(4))) {
+            LOG_CLIENT_DEBUG("Saved " << entries.size() << " learned connection strategies");
+            return true;
         }
+        LOG_CLIENT_ERROR("Failed to save strategy cache file");
+        return false;
         
     } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to clear historical peers: " << e.what());
+        LOG_CLIENT_ERROR("Failed to save strategy cache: " << e.what());
+        return false;
     }
 }
 
 std::vector<RatsPeer> RatsClient::get_historical_peers() const {
     std::vector<RatsPeer> historical_peers;
     
-    // Check if historical peers file exists
-    if (!file_or_directory_exists(get_peers_ever_file_path())) {
-        return historical_peers; // Return empty vector
+    auto store = get_peer_store(peers_ever_store_, get_peers_ever_file_path());
+    if (!store) {
+        return historical_peers;
     }
     
-    try {
-        std::string historical_data = read_file_text_cpp(get_peers_ever_file_path());
-        if (historical_data.empty()) {
-            return historical_peers;
-        }
-        
-        nlohmann::json peers_json = nlohmann::json::parse(historical_data);
-        
-        if (!peers_json.is_array()) {
-            LOG_CLIENT_ERROR("Invalid historical peers file format - expected array");
-            return historical_peers;
-        }
-        
-        for (const auto& peer_json : peers_json) {
-            std::string ip;
-            int port;
-            std::string peer_id;
-            
-            if (deserialize_peer_from_persistence(peer_json, ip, port, peer_id)) {
-                // Create a RatsPeer object for the historical peer
-                // Note: This won't have all the runtime fields populated
-                RatsPeer historical_peer(peer_id, ip, static_cast<uint16_t>(port), 
-                                       INVALID_SOCKET_VALUE, ip + ":" + std::to_string(port), false);
-                
-                // Set additional fields from JSON if available
-                historical_peer.version = peer_json.value("version", "");
-                
-                historical_peers.push_back(historical_peer);
-            }
-        }
-        
-        LOG_CLIENT_DEBUG("Retrieved " << historical_peers.size() << " historical peers");
-        
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to parse historical peers file: " << e.what());
-    } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to read historical peers file: " << e.what());
+    for (const auto& stored : store->reconnect_candidates(persistence_timestamp(), MAX_PEER_AGE_SECONDS)) {
+        // Note: This won't have all the runtime fields populated
+        RatsPeer historical_peer(stored.peer_id, stored.ip, stored.port,
+                                 INVALID_SOCKET_VALUE, stored.address(), false);
+        historical_peer.version = stored.version;
+        historical_peers.push_back(historical_peer);
     }
     
+    LOG_CLIENT_DEBUG("Retrieved " << historical_peers.size() << " historical peers");
     return historical_peers;
 }
 
@@ -552,90 +426,89 @@ int RatsClient::load_and_reconnect_historical_peers() {
         return 0;
     }
     
-    LOG_CLIENT_INFO("Loading historical peers from " << get_peers_ever_file_path());
-    
-    // Check if historical peers file exists
-    if (!file_or_directory_exists(get_peers_ever_file_path())) {
-        LOG_CLIENT_INFO("No historical peers file found");
+    auto store = get_peer_store(peers_ever_store_, get_peers_ever_file_path());
+    if (!store) {
+        LOG_CLIENT_ERROR("Failed to open historical peers file");
         return 0;
     }
     
-    try {
-        std::string historical_data = read_file_text_cpp(get_peers_ever_file_path());
-        if (historical_data.empty()) {
-            LOG_CLIENT_INFO("Historical peers file is empty");
-            return 0;
+    LOG_CLIENT_INFO("Loaded " << store->size() << " historical peers from " << store->path());
+    return schedule_peer_reconnects(store, "historical");
+}
+
+int RatsClient::schedule_peer_reconnects(std::shared_ptr<PeerStore> store, const std::string& label) {
+    auto candidates = std::make_shared<std::vector<StoredPeer>>();
+    for (const auto& stored : store->reconnect_candidates(persistence_timestamp(), MAX_PEER_AGE_SECONDS)) {
+        // Don't connect to ourselves
+        if (stored.peer_id == get_our_peer_id()) {
+            continue;
         }
         
-        nlohmann::json historical_peers = nlohmann::json::parse(historical_data);
+        // Check if we should ignore this peer (local interface)
+        if (should_ignore_peer(stored.ip, stored.port)) {
+            LOG_CLIENT_DEBUG("Ignoring " << label << " peer " << stored.address() << " - local interface address");
+            continue;
+        }
         
-        if (!historical_peers.is_array()) {
-            LOG_CLIENT_ERROR("Invalid historical peers file format - expected array");
-            return 0;
+        // Check if we're already connected to this peer
+        std::string normalized_peer_address = normalize_peer_address(stored.ip, stored.port);
+        if (is_already_connected_to_address(normalized_peer_address)) {
+            continue;
         }
         
-        int reconnect_attempts = 0;
+        // A remembered static key lets the reconnect use the shorter IK handshake
+        if (stored.noise_static_key.size() == NOISE_KEY_SIZE * 2) {
+            encrypted_communication::remember_peer_static_key(normalized_peer_address, EncryptedSocket::string_to_key(stored.noise_static_key));
+        }
         
-        for (const auto& peer_json : historical_peers) {
-            std::string ip;
-            int port;
-            std::string peer_id;
-            
-            if (!deserialize_peer_from_persistence(peer_json, ip, port, peer_id)) {
-                continue; // Skip invalid or old peers
-            }
-            
-            // Don't connect to ourselves
-            if (peer_id == get_our_peer_id()) {
-                LOG_CLIENT_DEBUG("Skipping connection to ourselves: " << peer_id);
-                continue;
-            }
-            
-            // Check if we should ignore this peer (local interface)
-            if (should_ignore_peer(ip, port)) {
-                LOG_CLIENT_DEBUG("Ignoring historical peer " << ip << ":" << port << " - local interface address");
-                continue;
-            }
-            
-            // Check if we're already connected to this peer
-            std::string normalized_peer_address = normalize_peer_address(ip, port);
-            if (is_already_connected_to_address(normalized_peer_address)) {
-                LOG_CLIENT_DEBUG("Already connected to historical peer " << normalized_peer_address);
-                continue;
-            }
-            
-            // Check if peer limit is reached
-            if (is_peer_limit_reached()) {
-                LOG_CLIENT_DEBUG("Peer limit reached, stopping historical reconnection attempts");
-                break;
-            }
-            
-            LOG_CLIENT_INFO("Attempting to reconnect to historical peer: " << ip << ":" << port << " (peer_id: " << peer_id << ")");
-            
-            // Attempt to connect (non-blocking)
-            add_managed_thread(std::thread([this, ip, port, peer_id]() {
-                if (connect_to_peer(ip, port)) {
-                    LOG_CLIENT_INFO("Successfully reconnected to historical peer: " << ip << ":" << port);
-                } else {
-                    LOG_CLIENT_DEBUG("Failed to reconnect to historical peer: " << ip << ":" << port);
-                }
-            }), "historical-reconnect-" + peer_id.substr(0, 8));
-            
-            reconnect_attempts++;
-            
-            // Small delay between connection attempts to avoid overwhelming the network
-            std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        candidates->push_back(stored);
+    }
+    
+    if (!candidates->empty()) {
+        LOG_CLIENT_INFO("Reconnecting to " << candidates->size() << " " << label << " peers, best candidates first");
+        reconnect_wave(store, candidates, 0, label);
+    }
+    return static_cast<int>(candidates->size());
+}
+
+void RatsClient::reconnect_wave(std::shared_ptr<PeerStore> store, std::shared_ptr<std::vector<StoredPeer>> candidates,
+                                size_t next, const std::string& label) {
+    if (!running_.load()) {
+        return;
+    }
+    
+    size_t end = (std::min)(next + RECONNECT_WAVE_SIZE, candidates->size());
+    for (; next < end; ++next) {
+        if (is_peer_limit_reached()) {
+            LOG_CLIENT_DEBUG("Peer limit reached, stopping " << label << " reconnection attempts");
+            return;
         }
         
-        LOG_CLIENT_INFO("Processed " << historical_peers.size() << " historical peers, attempted " << reconnect_attempts << " reconnections");
-        return reconnect_attempts;
+        const StoredPeer& stored = (*candidates)[next];
+        if (is_already_connected_to_address(normalize_peer_address(stored.ip, stored.port))) {
+            continue;
+        }
         
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to parse historical peers file: " << e.what());
-        return 0;
-    } catch (const std::exception& e) {
-        LOG_CLIENT_ERROR("Failed to load historical peers: " << e.what());
-        return 0;
+        // Attempt to connect (non-blocking); the outcome ranks the peer for the next run
+        std::string ip = stored.ip;
+        int port = stored.port;
+        std::string peer_id = stored.peer_id;
+        submit_task([this, store, ip, port, peer_id, label]() {
+            if (connect_to_peer(ip, port)) {
+                store->record_success(peer_id, persistence_timestamp());
+                LOG_CLIENT_INFO("Successfully reconnected to " << label << " peer: " << ip << ":" << port);
+            } else {
+                store->record_failure(peer_id);
+                LOG_CLIENT_DEBUG("Failed to reconnect to " << label << " peer: " << ip << ":" << port);
+            }
+        }, label + "-reconnect-" + peer_id.substr(0, 8));
+    }
+    
+    // Give the wave time to connect before dialling the next, less promising one
+    if (next < candidates->size()) {
+        schedule_task(RECONNECT_WAVE_INTERVAL, [this, store, candidates, next, label]() {
+            reconnect_wave(store, candidates, next, label);
+        }, label + "-reconnect-wave");
     }
 }
 
@@ -670,53 +543,39 @@ std::string RatsClient::generate_persistent_peer_id() const {
     return peer_id;
 }
 
-nlohmann::json RatsClient::serialize_peer_for_persistence(const RatsPeer& peer) const {
-    nlohmann::json peer_json;
-    peer_json["ip"] = peer.ip;
-    peer_json["port"] = peer.port;
-    peer_json["peer_id"] = peer.peer_id;
-    peer_json["normalized_address"] = peer.normalized_address;
-    peer_json["is_outgoing"] = peer.is_outgoing;
-    peer_json["version"] = peer.version;
-    
-    // Add timestamp for cleanup of old peers
-    auto now = std::chrono::high_resolution_clock::now();
-    auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-    peer_json["last_seen"] = timestamp;
+StoredPeer RatsClient::to_stored_peer(const RatsPeer& peer, int64_t now) const {
+    StoredPeer stored;
+    stored.peer_id = peer.peer_id;
+    stored.ip = peer.ip;
+    stored.port = peer.port;
+    stored.version = peer.version;
+    
+    // Static key learnt from the Noise handshake, so the next run can dial the peer with IK
+    NoiseKey static_key;
+    if (encrypted_communication::get_peer_static_key(peer.normalized_address, static_key)) {
+        stored.noise_static_key = EncryptedSocket::key_to_string(static_key);
+    }
     
-    return peer_json;
+    stored.last_seen = now;
+    stored.last_success = now;
+    return stored;
 }
 
-bool RatsClient::deserialize_peer_from_persistence(const nlohmann::json& json, std::string& ip, int& port, std::string& peer_id) const {
-    try {
-        ip = json.value("ip", "");
-        port = json.value("port", 0);
-        peer_id = json.value("peer_id", "");
-        
-        // Validate required fields
-        if (ip.empty() || port <= 0 || port > 65535 || peer_id.empty()) {
-            return false;
-        }
-        
-        // Check if peer data is not too old (optional - remove peers older than 7 days)
-        if (json.contains("last_seen")) {
-            auto now = std::chrono::high_resolution_clock::now();
-            auto current_timestamp = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-            int64_t last_seen = json.value("last_seen", current_timestamp);
-            
-            const int64_t MAX_PEER_AGE_SECONDS = 7 * 24 * 60 * 60; // 7 days
-            if (current_timestamp - last_seen > MAX_PEER_AGE_SECONDS) {
-                LOG_CLIENT_DEBUG("Skipping old peer " << ip << ":" << port << " (last seen " << (current_timestamp - last_seen) << " seconds ago)");
-                return false;
-            }
-        }
-        
-        return true;
-        
-    } catch (const nlohmann::json::exception& e) {
-        LOG_CLIENT_ERROR("Failed to deserialize peer: " << e.what());
-        return false;
+int64_t RatsClient::persistence_timestamp() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::shared_ptr<PeerStore> RatsClient::get_peer_store(std::shared_ptr<PeerStore>& slot, const std::string& path) const {
+    std::lock_guard<std::mutex> lock(peer_store_mutex_);
+    // The path follows the data directory and, in tests, the listen port
+    if (!slot || slot->path() != path) {
+        auto store = std::make_shared<PeerStore>();
+        if (!store->open(path)) {
+            return nullptr;
+        }
+        slot = store;
     }
+    return slot;
 }
 
 std::string RatsClient::get_config_file_path() const {
@@ -740,10 +599,10 @@ std::string RatsClient::get_peers_file_path() const {
         if (listen_port_ == 0) {
             // Generate a unique file path based on object pointer to ensure uniqueness during testing
             std::ostringstream oss;
-            oss << "peers_" << this << ".json";
+            oss << "peers_" << this << ".rats";
             return oss.str();
         }
-        return "peers_" + std::to_string(listen_port_) + ".json";
+        return "peers_" + std::to_string(listen_port_) + ".rats";
     #else
         return data_directory_ + "/" + PEERS_FILE_NAME;
     #endif
@@ -755,15 +614,45 @@ std::string RatsClient::get_peers_ever_file_path() const {
         if (listen_port_ == 0) {
             // Generate a unique file path based on object pointer to ensure uniqueness during testing
             std::ostringstream oss;
-            oss << "peers_ever_" << this << ".json";
+            oss << "peers_ever_" << this << ".rats";
             return oss.str();
         }
-        return "peers_ever_" + std::to_string(listen_port_) + ".json";
+        return "peers_ever_" + std::to_string(listen_port_) + ".rats";
     #else
         return data_directory_ + "/" + PEERS_EVER_FILE_NAME;
     #endif
 }
 
+std::string RatsClient::get_strategy_cache_file_path() const {
+    #ifdef TESTING
+        // For testing with ephemeral ports (port 0), use a unique identifier to avoid conflicts
+        if (listen_port_ == 0) {
+            // Generate a unique file path based on object pointer to ensure uniqueness during testing
+            std::ostringstream oss;
+            oss << "strategies_" << this << ".json";
+            return oss.str();
+        }
+        return "strategies_" + std::to_string(listen_port_) + ".json";
+    #else
+        return data_directory_ + "/" + STRATEGY_CACHE_FILE_NAME;
+    #endif
+}
+
+std::string RatsClient::get_dht_state_file_path() const {
+    #ifdef TESTING
+        // For testing with ephemeral ports (port 0), use a unique identifier to avoid conflicts
+        if (listen_port_ == 0) {
+            // Generate a unique file path based on object pointer to ensure uniqueness during testing
+            std::ostringstream oss;
+            oss << "dht_state_" << this << ".dat";
+            return oss.str();
+        }
+        return "dht_state_" + std::to_string(listen_port_) + ".dat";
+    #else
+        return data_directory_ + "/" + DHT_STATE_FILE_NAME;
+    #endif
+}
+
 // =========================================================================
 // Data directory management
 // =========================================================================
@@ -0,0 +1,225 @@
+#include "librats.h"
+
+// Logging macros for request/response operations
+#ifdef TESTING
+#define LOG_RPC_DEBUG(message) LOG_DEBUG("rpc", "[pointer: " << this << "] " << message)
+#define LOG_RPC_INFO(message)  LOG_INFO("rpc", "[pointer: " << this << "] " << message)
+#define LOG_RPC_WARN(message)  LOG_WARN("rpc", "[pointer: " << this << "] " << message)
+#define LOG_RPC_ERROR(message) LOG_ERROR("rpc", "[pointer: " << this << "] " << message)
+#else
+#define LOG_RPC_DEBUG(message) LOG_DEBUG("rpc", message)
+#define LOG_RPC_INFO(message)  LOG_INFO("rpc", message)
+#define LOG_RPC_WARN(message)  LOG_WARN("rpc", message)
+#define LOG_RPC_ERROR(message) LOG_ERROR("rpc", message)
+#endif
+
+namespace librats {
+
+//=============================================================================
+// Request/Response
+//=============================================================================
+
+void RatsClient::on_request(const std::string& method, RequestHandler handler) {
+    std::lock_guard<std::mutex> lock(request_handlers_mutex_);
+    request_handlers_[method] = std::move(handler);
+    LOG_RPC_DEBUG("Registered request handler for method: " << method);
+}
+
+void RatsClient::off_request(const std::string& method) {
+    std::lock_guard<std::mutex> lock(request_handlers_mutex_);
+    request_handlers_.erase(method);
+}
+
+void RatsClient::request(const std::string& peer_id, const std::string& method, const nlohmann::json& params,
+                         ResponseCallback callback, std::chrono::milliseconds timeout) {
+    auto fail = [&](const std::string& error) {
+        LOG_RPC_WARN("Request '" << method << "' to peer " << peer_id << " failed: " << error);
+        if (callback) {
+            callback(false, nlohmann::json(), error);
+        }
+    };
+
+    if (!running_.load()) {
+        fail("Client is not running");
+        return;
+    }
+    auto peer = get_peer_snapshot()->find(peer_id);
+    if (!peer) {
+        fail("Peer not found: " + peer_id);
+        return;
+    }
+    if (!peer->is_handshake_completed()) {
+        fail("Peer handshake not completed: " + peer_id);
+        return;
+    }
+
+    // Register before sending: the response may arrive before send returns
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        id = next_request_id_++;
+        pending_requests_[id] = PendingRequest{peer_id, method, std::move(callback)};
+        request_deadlines_.schedule(id, std::chrono::steady_clock::now() + timeout);
+    }
+
+    nlohmann::json payload;
+    payload["id"] = id;
+    payload["method"] = method;
+    payload["params"] = params;
+
+    bool sent = false;
+    try {
+        const std::string type = "rpc_request";
+        std::string our_peer_id = get_our_peer_id();
+        OutgoingRatsMessage message(type, payload, our_peer_id);
+        sent = send_rats_message_to_peer(*peer, message);
+    } catch (const std::exception& e) {
+        LOG_RPC_ERROR("Failed to serialize request '" << method << "': " << e.what());
+    }
+
+    if (!sent) {
+        complete_request(id, false, nlohmann::json(), "Failed to send request to peer: " + peer_id);
+        return;
+    }
+    LOG_RPC_DEBUG("Sent request " << id << " '" << method << "' to peer " << peer_id);
+}
+
+std::future<nlohmann::json> RatsClient::request(const std::string& peer_id, const std::string& method,
+                                                const nlohmann::json& params, std::chrono::milliseconds timeout) {
+    auto promise = std::make_shared<std::promise<nlohmann::json>>();
+    std::future<nlohmann::json> future = promise->get_future();
+    request(peer_id, method, params, [promise](bool success, const nlohmann::json& result, const std::string& error) {
+        if (success) {
+            promise->set_value(result);
+        } else {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+        }
+    }, timeout);
+    return future;
+}
+
+size_t RatsClient::get_pending_request_count() const {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    return pending_requests_.size();
+}
+
+void RatsClient::handle_rpc_request(socket_t socket, const std::string& peer_hash_id, const nlohmann::json& payload) {
+    if (!payload.contains("id") || !payload["id"].is_number_unsigned()) {
+        LOG_RPC_WARN("Dropped request without a valid id from " << peer_hash_id);
+        return;
+    }
+    uint64_t id = payload["id"].get<uint64_t>();
+    std::string method = payload.value("method", "");
+
+    RequestHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(request_handlers_mutex_);
+        auto it = request_handlers_.find(method);
+        if (it != request_handlers_.end()) {
+            handler = it->second;
+        }
+    }
+
+    nlohmann::json response;
+    response["id"] = id;
+    if (!handler) {
+        response["error"] = "Unknown method: " + method;
+    } else {
+        try {
+            response["result"] = handler(peer_hash_id, payload.value("params", nlohmann::json()));
+        } catch (const std::exception& e) {
+            response["error"] = e.what();
+        } catch (...) {
+            response["error"] = "Unknown error in request handler";
+        }
+    }
+
+    if (!send_rats_message(socket, "rpc_response", response, get_our_peer_id(), SendPriority::DATA)) {
+        LOG_RPC_ERROR("Failed to send response " << id << " for '" << method << "' to peer " << peer_hash_id);
+    }
+}
+
+void RatsClient::handle_rpc_response(const std::string& peer_hash_id, const nlohmann::json& payload) {
+    if (!payload.contains("id") || !payload["id"].is_number_unsigned()) {
+        LOG_RPC_WARN("Dropped response without a valid id from " << peer_hash_id);
+        return;
+    }
+    uint64_t id = payload["id"].get<uint64_t>();
+
+    // Only the peer a request went to may answer it
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        auto it = pending_requests_.find(id);
+        if (it == pending_requests_.end()) {
+            LOG_RPC_DEBUG("Dropped response " << id << " from " << peer_hash_id << " (timed out or unknown)");
+            return;
+        }
+        if (it->second.peer_id != peer_hash_id) {
+            LOG_RPC_WARN("Dropped response " << id << " from " << peer_hash_id << " - request went to " << it->second.peer_id);
+            return;
+        }
+    }
+
+    auto error = payload.find("error");
+    if (error != payload.end()) {
+        complete_request(id, false, nlohmann::json(), error->is_string() ? error->get<std::string>() : error->dump());
+    } else {
+        complete_request(id, true, payload.value("result", nlohmann::json()), "");
+    }
+}
+
+bool RatsClient::complete_request(uint64_t id, bool success, const nlohmann::json& result, const std::string& error) {
+    PendingRequest request;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        auto it = pending_requests_.find(id);
+        if (it == pending_requests_.end()) {
+            return false;
+        }
+        request = std::move(it->second);
+        pending_requests_.erase(it);
+    }
+
+    if (request.callback) {
+        try {
+            request.callback(success, result, error);
+        } catch (const std::exception& e) {
+            LOG_RPC_ERROR("Exception in response callback for '" << request.method << "': " << e.what());
+        } catch (...) {
+            LOG_RPC_ERROR("Unknown exception in response callback for '" << request.method << "'");
+        }
+    }
+    return true;
+}
+
+void RatsClient::expire_requests() {
+    std::vector<uint64_t> expired;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        expired = request_deadlines_.advance();
+    }
+
+    // Answered requests are not removed from the wheel; complete_request skips them
+    for (uint64_t id : expired) {
+        if (complete_request(id, false, nlohmann::json(), "Request timed out")) {
+            LOG_RPC_DEBUG("Request " << id << " timed out");
+        }
+    }
+}
+
+void RatsClient::fail_pending_requests(const std::string& peer_id, const std::string& error) {
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        for (const auto& pair : pending_requests_) {
+            if (peer_id.empty() || pair.second.peer_id == peer_id) {
+                ids.push_back(pair.first);
+            }
+        }
+    }
+    for (uint64_t id : ids) {
+        complete_request(id, false, nlohmann::json(), error);
+    }
+}
+
+} // namespace librats
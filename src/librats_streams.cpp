@@ -0,0 +1,146 @@
+#include "librats.h"
+
+// Logging macros for stream operations
+#ifdef TESTING
+#define LOG_STREAM_DEBUG(message) LOG_DEBUG("stream", "[pointer: " << this << "] " << message)
+#define LOG_STREAM_INFO(message)  LOG_INFO("stream", "[pointer: " << this << "] " << message)
+#define LOG_STREAM_WARN(message)  LOG_WARN("stream", "[pointer: " << this << "] " << message)
+#define LOG_STREAM_ERROR(message) LOG_ERROR("stream", "[pointer: " << this << "] " << message)
+#else
+#define LOG_STREAM_DEBUG(message) LOG_DEBUG("stream", message)
+#define LOG_STREAM_INFO(message)  LOG_INFO("stream", message)
+#define LOG_STREAM_WARN(message)  LOG_WARN("stream", message)
+#define LOG_STREAM_ERROR(message) LOG_ERROR("stream", message)
+#endif
+
+namespace librats {
+
+//=============================================================================
+// Multiplexed Streams
+//=============================================================================
+
+void RatsClient::set_stream_config(const StreamConfig& config) {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    stream_config_ = config;
+}
+
+StreamConfig RatsClient::get_stream_config() const {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    return stream_config_;
+}
+
+uint32_t RatsClient::open_stream(const std::string& peer_id, SendPriority priority) {
+    auto muxer = get_stream_muxer(peer_id, true);
+    if (!muxer) {
+        LOG_STREAM_WARN("Cannot open stream: peer " << peer_id << " is not connected");
+        return 0;
+    }
+    return muxer->open_stream(priority);
+}
+
+bool RatsClient::write_stream(const std::string& peer_id, uint32_t stream_id, const std::vector<uint8_t>& data) {
+    auto muxer = get_stream_muxer(peer_id, false);
+    return muxer && muxer->write(stream_id, data.data(), data.size());
+}
+
+bool RatsClient::close_stream(const std::string& peer_id, uint32_t stream_id) {
+    auto muxer = get_stream_muxer(peer_id, false);
+    return muxer && muxer->close(stream_id);
+}
+
+bool RatsClient::reset_stream(const std::string& peer_id, uint32_t stream_id) {
+    auto muxer = get_stream_muxer(peer_id, false);
+    return muxer && muxer->reset(stream_id);
+}
+
+size_t RatsClient::get_stream_count(const std::string& peer_id) const {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    auto it = stream_muxers_.find(peer_id);
+    return it != stream_muxers_.end() ? it->second->stream_count() : 0;
+}
+
+void RatsClient::on_stream_opened(StreamOpenedCallback callback) {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    stream_opened_callback_ = std::move(callback);
+}
+
+void RatsClient::on_stream_data(StreamDataCallback callback) {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    stream_data_callback_ = std::move(callback);
+}
+
+void RatsClient::on_stream_closed(StreamClosedCallback callback) {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    stream_closed_callback_ = std::move(callback);
+}
+
+std::shared_ptr<StreamMuxer> RatsClient::get_stream_muxer(const std::string& peer_id, bool create) {
+    std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+    auto it = stream_muxers_.find(peer_id);
+    if (it != stream_muxers_.end()) {
+        return it->second;
+    }
+    if (!create || !is_valid_socket(get_peer_socket_by_id(peer_id))) {
+        return nullptr;
+    }
+
+    // Both sides derive the same split of the ID space, so neither has to ask before opening a stream
+    bool odd_ids = get_our_peer_id() < peer_id;
+    auto muxer = std::make_shared<StreamMuxer>(odd_ids, stream_config_,
+        [this, peer_id](const std::vector<uint8_t>& frame, SendPriority priority) {
+            return send_binary_to_peer_id(peer_id, frame, MessageDataType::STREAM, priority);
+        });
+
+    muxer->set_opened_callback([this, peer_id](uint32_t stream_id) {
+        StreamOpenedCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+            callback = stream_opened_callback_;
+        }
+        LOG_STREAM_DEBUG("Peer " << peer_id << " opened stream " << stream_id);
+        if (callback) {
+            callback(peer_id, stream_id);
+        }
+    });
+    muxer->set_data_callback([this, peer_id](uint32_t stream_id, const uint8_t* data, size_t size) {
+        StreamDataCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+            callback = stream_data_callback_;
+        }
+        if (callback) {
+            callback(peer_id, stream_id, std::vector<uint8_t>(data, data + size));
+        }
+    });
+    muxer->set_closed_callback([this, peer_id](uint32_t stream_id) {
+        StreamClosedCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+            callback = stream_closed_callback_;
+        }
+        if (callback) {
+            callback(peer_id, stream_id);
+        }
+    });
+
+    stream_muxers_[peer_id] = muxer;
+    return muxer;
+}
+
+void RatsClient::close_peer_streams(const std::string& peer_id) {
+    std::shared_ptr<StreamMuxer> muxer;
+    {
+        std::lock_guard<std::mutex> lock(stream_muxers_mutex_);
+        auto it = stream_muxers_.find(peer_id);
+        if (it == stream_muxers_.end()) {
+            return;
+        }
+        muxer = it->second;
+        stream_muxers_.erase(it);
+    }
+
+    LOG_STREAM_DEBUG("Closing " << muxer->stream_count() << " streams of disconnected peer " << peer_id);
+    muxer->shutdown();
+}
+
+} // namespace librats
@@ -0,0 +1,156 @@
+#include "librats.h"
+#include <algorithm>
+
+// Logging macros for the uTP transport
+#ifdef TESTING
+#define LOG_TRANSPORT_DEBUG(message) LOG_DEBUG("transport", "[pointer: " << this << "] " << message)
+#define LOG_TRANSPORT_INFO(message)  LOG_INFO("transport", "[pointer: " << this << "] " << message)
+#define LOG_TRANSPORT_WARN(message)  LOG_WARN("transport", "[pointer: " << this << "] " << message)
+#define LOG_TRANSPORT_ERROR(message) LOG_ERROR("transport", "[pointer: " << this << "] " << message)
+#else
+#define LOG_TRANSPORT_DEBUG(message) LOG_DEBUG("transport", message)
+#define LOG_TRANSPORT_INFO(message)  LOG_INFO("transport", message)
+#define LOG_TRANSPORT_WARN(message)  LOG_WARN("transport", message)
+#define LOG_TRANSPORT_ERROR(message) LOG_ERROR("transport", message)
+#endif
+
+namespace librats {
+
+//=============================================================================
+// uTP Transport
+//
+// uTP connections are bridged to local socket pairs, so the handshake, Noise,
+// framing and send queues treat them exactly like TCP connections.
+//=============================================================================
+
+bool RatsClient::start_utp_transport() {
+    auto manager = std::make_shared<UtpManager>();
+    if (!manager->start(listen_port_)) {
+        LOG_TRANSPORT_WARN("Failed to bind uTP on UDP port " << listen_port_ << " - peers will connect over TCP only");
+        return false;
+    }
+    manager->set_accept_callback([this](std::shared_ptr<UtpSocket> connection) {
+        handle_incoming_utp_connection(std::move(connection));
+    });
+
+    std::lock_guard<std::mutex> lock(utp_mutex_);
+    utp_manager_ = manager;
+    LOG_TRANSPORT_INFO("uTP transport listening on UDP port " << manager->get_port());
+    return true;
+}
+
+void RatsClient::stop_utp_transport() {
+    std::shared_ptr<UtpManager> manager;
+    std::vector<std::weak_ptr<UtpSocketBridge>> bridges;
+    {
+        std::lock_guard<std::mutex> lock(utp_mutex_);
+        manager.swap(utp_manager_);
+        bridges.swap(utp_bridges_);
+    }
+    if (!manager) {
+        return;
+    }
+
+    manager->set_accept_callback(nullptr);
+    for (const auto& weak_bridge : bridges) {
+        if (auto bridge = weak_bridge.lock()) {
+            bridge->close();
+        }
+    }
+    manager->stop();
+    LOG_TRANSPORT_INFO("uTP transport stopped");
+}
+
+void RatsClient::handle_incoming_utp_connection(std::shared_ptr<UtpSocket> connection) {
+    Peer remote = connection->get_remote_peer();
+    if (!running_.load()) {
+        connection->close();
+        return;
+    }
+
+    socket_t bridge_socket = open_utp_bridge(connection);
+    if (!is_valid_socket(bridge_socket)) {
+        LOG_TRANSPORT_ERROR("Failed to bridge incoming uTP connection from " << remote.ip << ":" << remote.port);
+        connection->close();
+        return;
+    }
+
+    LOG_TRANSPORT_DEBUG("Accepted uTP connection from " << remote.ip << ":" << remote.port);
+    accept_incoming_connection(bridge_socket, remote.ip, remote.port, "uTP");
+}
+
+socket_t RatsClient::open_utp_bridge(std::shared_ptr<UtpSocket> connection) {
+    auto bridge = UtpSocketBridge::create(std::move(connection), *reactor_);
+    if (!bridge) {
+        return INVALID_SOCKET_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(utp_mutex_);
+    utp_bridges_.erase(std::remove_if(utp_bridges_.begin(), utp_bridges_.end(),
+                                      [](const std::weak_ptr<UtpSocketBridge>& weak_bridge) { return weak_bridge.expired(); }),
+                       utp_bridges_.end());
+    utp_bridges_.push_back(bridge);
+    return bridge->get_socket();
+}
+
+bool RatsClient::perform_utp_connection(const std::string& host, int port, ConnectionAttemptResult& result) {
+    std::shared_ptr<UtpManager> manager;
+    {
+        std::lock_guard<std::mutex> lock(utp_mutex_);
+        manager = utp_manager_;
+    }
+    if (!manager) {
+        return false;
+    }
+
+    auto connection = manager->connect(host, port);
+    if (!connection) {
+        result.error_message = "Failed to start uTP connection";
+        return false;
+    }
+
+    // The first event of a connecting socket reports the SYN answered (WRITE) or failed (ERROR)
+    struct ConnectWait {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool signaled = false;
+    };
+    auto wait = std::make_shared<ConnectWait>();
+    connection->set_event_handler([wait](uint32_t) {
+        {
+            std::lock_guard<std::mutex> lock(wait->mutex);
+            wait->signaled = true;
+        }
+        wait->cv.notify_all();
+    });
+    {
+        // Events raised before the handler was installed are only delivered with the next ones,
+        // so the state is polled as well
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(nat_config_.utp_connect_timeout_ms);
+        std::unique_lock<std::mutex> lock(wait->mutex);
+        while (!wait->signaled && connection->get_state() == UtpSocket::State::SYN_SENT &&
+               std::chrono::steady_clock::now() < deadline && running_.load()) {
+            wait->cv.wait_for(lock, std::chrono::milliseconds(50));
+        }
+    }
+    connection->set_event_handler(nullptr);
+
+    if (!connection->is_connected()) {
+        connection->close();
+        result.error_message = "uTP connection was not answered within " + std::to_string(nat_config_.utp_connect_timeout_ms) + "ms";
+        LOG_TRANSPORT_DEBUG("uTP connection to " << host << ":" << port << " failed, falling back to TCP");
+        return false;
+    }
+
+    socket_t bridge_socket = open_utp_bridge(connection);
+    if (!is_valid_socket(bridge_socket)) {
+        connection->close();
+        result.error_message = "Failed to bridge uTP connection";
+        return false;
+    }
+
+    LOG_TRANSPORT_DEBUG("Connected to " << host << ":" << port << " over uTP");
+    return register_outgoing_connection(bridge_socket, host, port, "uTP", result);
+}
+
+} // namespace librats
@@ -0,0 +1,499 @@
+#include "logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace librats {
+
+namespace {
+
+// How often the writer thread drains the queues when nobody wakes it
+constexpr auto LOG_WRITER_INTERVAL = std::chrono::milliseconds(20);
+
+// Times a producer retries a full queue (waking the writer in between) before dropping the message
+constexpr int LOG_PUSH_ATTEMPTS = 1000;
+
+} // anonymous namespace
+
+/**
+ * Single-producer single-consumer ring of log records, one per logging thread.
+ * The owning thread pushes without locks; the consumer is whoever holds Logger::mutex_.
+ */
+class LogThreadQueue {
+public:
+    static constexpr size_t CAPACITY = 4096; // Power of two
+
+    LogThreadQueue() : slots_(CAPACITY), head_(0), tail_(0), closed_(false) {}
+
+    bool push(Logger::Record&& record) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        slots_[tail & (CAPACITY - 1)] = std::move(record);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Logger::Record& record) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        record = std::move(slots_[head & (CAPACITY - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    // Set when the owning thread exits; nothing is pushed afterwards
+    void close() { closed_.store(true, std::memory_order_release); }
+    bool is_closed() const { return closed_.load(std::memory_order_acquire); }
+
+private:
+    std::vector<Logger::Record> slots_;
+    alignas(64) std::atomic<size_t> head_;  // Next slot to read (consumer)
+    alignas(64) std::atomic<size_t> tail_;  // Next slot to write (producer)
+    std::atomic<bool> closed_;
+};
+
+namespace {
+
+// Keeps a thread's queue registered with the logger until the thread exits
+struct LogThreadQueueHolder {
+    std::shared_ptr<LogThreadQueue> queue;
+
+    ~LogThreadQueueHolder() {
+        if (queue) {
+            queue->close();
+        }
+    }
+};
+
+} // anonymous namespace
+
+Logger::Logger() : min_level_(LogLevel::INFO), colors_enabled_(true), timestamps_enabled_(true),
+                   file_logging_enabled_(false), max_log_file_size_(10 * 1024 * 1024),
+                   max_log_files_(5), current_file_size_(0), cached_second_(-1),
+                   async_enabled_(false), sequence_(0), dropped_count_(0), writer_running_(false) {
+    // Check if we're outputting to a terminal
+    is_terminal_ = isatty(fileno(stdout));
+
+    // On Windows, enable ANSI color codes
+#ifdef _WIN32
+    if (is_terminal_) {
+        HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD dwMode = 0;
+        GetConsoleMode(hOut, &dwMode);
+        dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+        SetConsoleMode(hOut, dwMode);
+    }
+#endif
+}
+
+Logger::~Logger() {
+    set_async_enabled(false);
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_log_file();
+}
+
+void Logger::set_file_logging_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_logging_enabled_ = enabled;
+    if (enabled && !log_file_path_.empty()) {
+        open_log_file();
+    } else if (!enabled) {
+        close_log_file();
+    }
+}
+
+void Logger::set_log_file_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    log_file_path_ = path;
+    if (file_logging_enabled_) {
+        close_log_file();
+        open_log_file();
+    }
+}
+
+void Logger::set_async_enabled(bool enabled) {
+    if (enabled) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        if (!writer_running_) {
+            writer_running_ = true;
+            writer_thread_ = std::thread(&Logger::writer_loop, this);
+        }
+        async_enabled_.store(true, std::memory_order_release);
+        return;
+    }
+
+    async_enabled_.store(false, std::memory_order_release);
+    std::thread writer;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        writer_running_ = false;
+        writer.swap(writer_thread_);
+    }
+    writer_cv_.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+
+    // Messages pushed while the mode was switching
+    drain_queues();
+}
+
+void Logger::flush() {
+    if (is_async_enabled()) {
+        drain_queues();
+    }
+}
+
+void Logger::log(LogLevel level, const std::string& module, const std::string& message) {
+    if (!should_log(level)) {
+        return;
+    }
+
+    Record record{sequence_.fetch_add(1, std::memory_order_relaxed), std::chrono::system_clock::now(),
+                  level, module, message};
+
+    if (async_enabled_.load(std::memory_order_acquire)) {
+        LogThreadQueue& queue = thread_queue();
+        for (int attempt = 0; attempt < LOG_PUSH_ATTEMPTS; ++attempt) {
+            if (queue.push(std::move(record))) {
+                // Wake the writer early when the queue is filling up
+                if (queue.size() >= LogThreadQueue::CAPACITY / 2) {
+                    writer_cv_.notify_one();
+                }
+                return;
+            }
+            writer_cv_.notify_one();
+            std::this_thread::yield();
+        }
+        dropped_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out;
+    std::string err;
+    write_record_unlocked(record, out, err);
+    if (!out.empty()) {
+        std::cout << out;
+        std::cout.flush();
+    }
+    if (!err.empty()) {
+        std::cerr << err;
+        std::cerr.flush();
+    }
+    if (log_file_.is_open()) {
+        log_file_.flush();
+    }
+}
+
+LogThreadQueue& Logger::thread_queue() {
+    thread_local LogThreadQueueHolder holder;
+    if (!holder.queue) {
+        holder.queue = std::make_shared<LogThreadQueue>();
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        queues_.push_back(holder.queue);
+    }
+    return *holder.queue;
+}
+
+void Logger::writer_loop() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    while (writer_running_) {
+        writer_cv_.wait_for(lock, LOG_WRITER_INTERVAL);
+        lock.unlock();
+        drain_queues();
+        lock.lock();
+    }
+    lock.unlock();
+    drain_queues();
+}
+
+void Logger::drain_queues() {
+    // Holding mutex_ makes the caller the only consumer of every queue
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::shared_ptr<LogThreadQueue>> queues;
+    {
+        std::lock_guard<std::mutex> queues_lock(queues_mutex_);
+        queues = queues_;
+    }
+
+    std::vector<Record> batch;
+    for (const auto& queue : queues) {
+        Record record;
+        while (queue->pop(record)) {
+            batch.push_back(std::move(record));
+        }
+    }
+
+    // Forget queues of exited threads once they are empty
+    {
+        std::lock_guard<std::mutex> queues_lock(queues_mutex_);
+        queues_.erase(std::remove_if(queues_.begin(), queues_.end(),
+                                     [](const std::shared_ptr<LogThreadQueue>& queue) {
+                                         return queue->is_closed() && queue->size() == 0;
+                                     }),
+                      queues_.end());
+    }
+
+    uint64_t dropped = dropped_count_.exchange(0, std::memory_order_relaxed);
+    if (batch.empty() && dropped == 0) {
+        return;
+    }
+
+    // Interleave the threads' messages in the order they were logged
+    std::sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) { return a.sequence < b.sequence; });
+
+    std::string out;
+    std::string err;
+    for (const auto& record : batch) {
+        write_record_unlocked(record, out, err);
+    }
+    if (dropped > 0) {
+        Record notice{0, std::chrono::system_clock::now(), LogLevel::WARN, "logger",
+                      std::to_string(dropped) + " log messages dropped: logging threads outpaced the writer"};
+        write_record_unlocked(notice, out, err);
+    }
+
+    if (!out.empty()) {
+        std::cout << out;
+        std::cout.flush();
+    }
+    if (!err.empty()) {
+        std::cerr << err;
+        std::cerr.flush();
+    }
+    if (log_file_.is_open()) {
+        log_file_.flush();
+    }
+}
+
+void Logger::write_record_unlocked(const Record& record, std::string& out, std::string& err) {
+    // Output to appropriate console stream
+    std::string& console = record.level >= LogLevel::ERROR ? err : out;
+    bool colored = colors_enabled_ && is_terminal_;
+
+    // Add timestamp if enabled
+    if (timestamps_enabled_) {
+        format_timestamp_unlocked(record.time, false, console);
+    }
+
+    // Add colored log level
+    if (colored) {
+        console += get_color_code(record.level) + "[" + get_level_string(record.level) + "]" + get_reset_code();
+    } else {
+        console += "[" + get_level_string(record.level) + "]";
+    }
+
+    // Add colored module tag
+    if (!record.module.empty()) {
+        if (colored) {
+            console += " " + get_module_color(record.module) + "[" + record.module + "]" + get_reset_code();
+        } else {
+            console += " [" + record.module + "]";
+        }
+    }
+
+    console += " ";
+    console += record.message;
+    console += "\n";
+
+    // Also write to file if file logging is enabled (timestamp always included, no colors)
+    if (file_logging_enabled_ && log_file_.is_open()) {
+        std::string line;
+        format_timestamp_unlocked(record.time, true, line);
+        line += "[" + get_level_string(record.level) + "]";
+        if (!record.module.empty()) {
+            line += " [" + record.module + "]";
+        }
+        line += " ";
+        line += record.message;
+        line += "\n";
+        write_to_file_unlocked(line);
+    }
+}
+
+void Logger::format_timestamp_unlocked(std::chrono::system_clock::time_point time, bool with_date, std::string& out) {
+    auto since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    int64_t second = since_epoch / 1000;
+
+    if (second != cached_second_) {
+        std::time_t time_t = static_cast<std::time_t>(second);
+        struct tm local_tm;
+#ifdef _WIN32
+        localtime_s(&local_tm, &time_t);
+#else
+        localtime_r(&time_t, &local_tm);
+#endif
+        char buffer[32];
+        std::strftime(buffer, sizeof(buffer), "%H:%M:%S", &local_tm);
+        cached_time_ = buffer;
+        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d ", &local_tm);
+        cached_date_ = buffer;
+        cached_second_ = second;
+    }
+
+    char millis[8];
+    std::snprintf(millis, sizeof(millis), ".%03d] ", static_cast<int>(since_epoch % 1000));
+    out += "[";
+    if (with_date) {
+        out += cached_date_;
+    }
+    out += cached_time_;
+    out += millis;
+}
+
+std::string Logger::get_level_string(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO:  return "INFO ";
+        case LogLevel::WARN:  return "WARN ";
+        case LogLevel::ERROR: return "ERROR";
+        default: return "UNKNOWN";
+    }
+}
+
+std::string Logger::get_color_code(LogLevel level) {
+    if (!colors_enabled_ || !is_terminal_) return "";
+
+    switch (level) {
+        case LogLevel::DEBUG: return "\033[36m";  // Cyan
+        case LogLevel::INFO:  return "\033[32m";  // Green
+        case LogLevel::WARN:  return "\033[33m";  // Yellow
+        case LogLevel::ERROR: return "\033[31m";  // Red
+        default: return "";
+    }
+}
+
+std::string Logger::get_module_color(const std::string& module) {
+    if (!colors_enabled_ || !is_terminal_) return "";
+
+    // Generate hash for module name
+    uint32_t hash = hash_string(module);
+
+    // Map hash to a predefined set of nice, readable colors
+    const char* colors[] = {
+        "\033[35m",  // Magenta
+        "\033[36m",  // Cyan
+        "\033[94m",  // Bright Blue
+        "\033[95m",  // Bright Magenta
+        "\033[96m",  // Bright Cyan
+        "\033[93m",  // Bright Yellow
+        "\033[91m",  // Bright Red
+        "\033[92m",  // Bright Green
+        "\033[90m",  // Bright Black (Gray)
+        "\033[37m",  // White
+        "\033[34m",  // Blue
+        "\033[33m",  // Yellow
+        "\033[31m",  // Red
+        "\033[32m",  // Green
+        "\033[97m",  // Bright White
+        "\033[38;5;208m", // Orange
+        "\033[38;5;165m", // Pink
+        "\033[38;5;141m", // Purple
+        "\033[38;5;51m",  // Bright Turquoise
+        "\033[38;5;226m", // Bright Yellow
+        "\033[38;5;46m",  // Bright Green
+        "\033[38;5;196m", // Bright Red
+        "\033[38;5;21m",  // Bright Blue
+        "\033[38;5;129m"  // Bright Purple
+    };
+
+    size_t color_count = sizeof(colors) / sizeof(colors[0]);
+    return colors[hash % color_count];
+}
+
+// Simple hash function for strings
+uint32_t Logger::hash_string(const std::string& str) {
+    uint32_t hash = 5381;
+    for (char c : str) {
+        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+    }
+    return hash;
+}
+
+std::string Logger::get_reset_code() {
+    if (!colors_enabled_ || !is_terminal_) return "";
+    return "\033[0m";
+}
+
+void Logger::write_to_file_unlocked(const std::string& line) {
+    if (!log_file_.is_open()) return;
+
+    // Check if rotation is needed
+    if (max_log_file_size_ > 0 && current_file_size_ >= max_log_file_size_) {
+        rotate_log_files();
+        if (!log_file_.is_open()) return;
+    }
+
+    // Flushed by the caller, once per line or once per batch
+    log_file_ << line;
+    current_file_size_ += line.length();
+}
+
+void Logger::open_log_file() {
+    if (log_file_path_.empty()) return;
+
+    close_log_file();
+
+    // Create directory if it doesn't exist
+    size_t last_slash = log_file_path_.find_last_of("/\\");
+    if (last_slash != std::string::npos) {
+        std::string dir_path = log_file_path_.substr(0, last_slash);
+        if (!directory_exists(dir_path.c_str())) {
+            create_directories(dir_path.c_str());
+        }
+    }
+
+    log_file_.open(log_file_path_, std::ios::app);
+    if (log_file_.is_open()) {
+        // Get current file size
+        log_file_.seekp(0, std::ios::end);
+        current_file_size_ = static_cast<size_t>(log_file_.tellp());
+        log_file_.seekp(0, std::ios::end); // Ensure we're at the end for appending
+    }
+}
+
+void Logger::close_log_file() {
+    if (log_file_.is_open()) {
+        log_file_.close();
+    }
+    current_file_size_ = 0;
+}
+
+void Logger::rotate_log_files() {
+    if (log_file_path_.empty() || max_log_files_ <= 0) return;
+
+    close_log_file();
+
+    // Move existing log files
+    for (int i = max_log_files_ - 1; i >= 1; i--) {
+        std::string old_name = log_file_path_ + "." + std::to_string(i);
+        std::string new_name = log_file_path_ + "." + std::to_string(i + 1);
+
+        // Delete the oldest file if it exists
+        if (i == max_log_files_ - 1) {
+            std::remove(new_name.c_str());
+        }
+
+        // Rename old file to new name
+        std::rename(old_name.c_str(), new_name.c_str());
+    }
+
+    // Move current log file to .1
+    std::string backup_name = log_file_path_ + ".1";
+    std::rename(log_file_path_.c_str(), backup_name.c_str());
+
+    // Reopen the log file (new empty file)
+    open_log_file();
+}
+
+} // namespace librats
@@ -8,6 +8,11 @@
 #include <iomanip>
 #include <cstdint>
 #include <fstream>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <condition_variable>
 #include "fs.h"
 
 #ifdef _WIN32
@@ -32,6 +37,18 @@ enum class LogLevel {
     ERROR = 3
 };
 
+class LogThreadQueue;
+
+/**
+ * Process-wide logger.
+ *
+ * The LOG_* macros check the level before the message is formatted, and levels below
+ * LIBRATS_MIN_LOG_LEVEL are compiled out entirely. In synchronous mode (the default)
+ * each line is written and flushed by the calling thread. In asynchronous mode callers
+ * only push the message into a lock-free queue owned by their thread; a writer thread
+ * drains all queues, formats the lines and writes them in batches with one flush per
+ * batch, rotating the log file as needed.
+ */
 class Logger {
 public:
     // Singleton pattern
@@ -46,8 +63,16 @@ public:
     
     // Set the minimum log level
     void set_log_level(LogLevel level) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        min_level_ = level;
+        min_level_.store(level, std::memory_order_relaxed);
+    }
+    
+    LogLevel get_log_level() const {
+        return min_level_.load(std::memory_order_relaxed);
+    }
+    
+    // Whether a message of this level would be written (checked before formatting)
+    bool should_log(LogLevel level) const {
+        return level >= min_level_.load(std::memory_order_relaxed);
     }
     
     // Enable/disable colors
@@ -63,24 +88,8 @@ public:
     }
     
     // File logging configuration
-    void set_file_logging_enabled(bool enabled) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        file_logging_enabled_ = enabled;
-        if (enabled && !log_file_path_.empty()) {
-            open_log_file();
-        } else if (!enabled) {
-            close_log_file();
-        }
-    }
-    
-    void set_log_file_path(const std::string& path) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        log_file_path_ = path;
-        if (file_logging_enabled_) {
-            close_log_file();
-            open_log_file();
-        }
-    }
+    void set_file_logging_enabled(bool enabled);
+    void set_log_file_path(const std::string& path);
     
     void set_log_rotation_size(size_t max_size_bytes) {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -103,268 +112,65 @@ public:
         return log_file_path_;
     }
     
-    // Main logging function
-    void log(LogLevel level, const std::string& module, const std::string& message) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        if (level < min_level_) {
-            return;
-        }
-        
-        // Prepare console output with colors
-        std::ostringstream console_oss;
-        
-        // Add timestamp if enabled
-        if (timestamps_enabled_) {
-            auto now = std::chrono::system_clock::now();
-            auto time_t = std::chrono::system_clock::to_time_t(now);
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now.time_since_epoch()) % 1000;
-            
-            struct tm local_tm;
-#ifdef _WIN32
-            localtime_s(&local_tm, &time_t);
-#else
-            local_tm = *std::localtime(&time_t);
-#endif
-            console_oss << "[" << std::put_time(&local_tm, "%H:%M:%S");
-            console_oss << "." << std::setfill('0') << std::setw(3) << ms.count() << "] ";
-        }
-        
-        // Add colored log level
-        if (colors_enabled_ && is_terminal_) {
-            console_oss << get_color_code(level) << "[" << get_level_string(level) << "]" << get_reset_code();
-        } else {
-            console_oss << "[" << get_level_string(level) << "]";
-        }
-        
-        // Add colored module tag
-        if (!module.empty()) {
-            if (colors_enabled_ && is_terminal_) {
-                console_oss << " " << get_module_color(module) << "[" << module << "]" << get_reset_code();
-            } else {
-                console_oss << " [" << module << "]";
-            }
-        }
-        
-        // Add message
-        console_oss << " " << message << std::endl;
-        
-        // Output to appropriate console stream
-        if (level >= LogLevel::ERROR) {
-            std::cerr << console_oss.str();
-            std::cerr.flush();
-        } else {
-            std::cout << console_oss.str();
-            std::cout.flush();
-        }
-        
-        // Also write to file if file logging is enabled
-        if (file_logging_enabled_ && log_file_.is_open()) {
-            write_to_file(level, module, message);
-        }
-    }
-
-private:
-    Logger() : min_level_(LogLevel::INFO), colors_enabled_(true), timestamps_enabled_(true),
-               file_logging_enabled_(false), max_log_file_size_(10 * 1024 * 1024), 
-               max_log_files_(5), current_file_size_(0) {
-        // Check if we're outputting to a terminal
-        is_terminal_ = isatty(fileno(stdout));
-        
-        // On Windows, enable ANSI color codes
-#ifdef _WIN32
-        if (is_terminal_) {
-            HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-            DWORD dwMode = 0;
-            GetConsoleMode(hOut, &dwMode);
-            dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-            SetConsoleMode(hOut, dwMode);
-        }
-#endif
-    }
-    
-    ~Logger() {
-        close_log_file();
-    }
+    /**
+     * Switch between synchronous writes and the background writer thread.
+     * Disabling waits until everything queued so far has been written.
+     * @param enabled Whether messages are handed to the writer thread
+     */
+    void set_async_enabled(bool enabled);
     
-    std::string get_level_string(LogLevel level) {
-        switch (level) {
-            case LogLevel::DEBUG: return "DEBUG";
-            case LogLevel::INFO:  return "INFO ";
-            case LogLevel::WARN:  return "WARN ";
-            case LogLevel::ERROR: return "ERROR";
-            default: return "UNKNOWN";
-        }
+    bool is_async_enabled() const {
+        return async_enabled_.load(std::memory_order_acquire);
     }
     
-    std::string get_color_code(LogLevel level) {
-        if (!colors_enabled_ || !is_terminal_) return "";
-        
-        switch (level) {
-            case LogLevel::DEBUG: return "\033[36m";  // Cyan
-            case LogLevel::INFO:  return "\033[32m";  // Green
-            case LogLevel::WARN:  return "\033[33m";  // Yellow
-            case LogLevel::ERROR: return "\033[31m";  // Red
-            default: return "";
-        }
-    }
-    
-    std::string get_module_color(const std::string& module) {
-        if (!colors_enabled_ || !is_terminal_) return "";
-        
-        // Generate hash for module name
-        uint32_t hash = hash_string(module);
-        
-        // Map hash to a predefined set of nice, readable colors
-        const char* colors[] = {
-            "\033[35m",  // Magenta
-            "\033[36m",  // Cyan
-            "\033[94m",  // Bright Blue
-            "\033[95m",  // Bright Magenta
-            "\033[96m",  // Bright Cyan
-            "\033[93m",  // Bright Yellow
-            "\033[91m",  // Bright Red
-            "\033[92m",  // Bright Green
-            "\033[90m",  // Bright Black (Gray)
-            "\033[37m",  // White
-            "\033[34m",  // Blue
-            "\033[33m",  // Yellow
-            "\033[31m",  // Red
-            "\033[32m",  // Green
-            "\033[97m",  // Bright White
-            "\033[38;5;208m", // Orange
-            "\033[38;5;165m", // Pink
-            "\033[38;5;141m", // Purple
-            "\033[38;5;51m",  // Bright Turquoise
-            "\033[38;5;226m", // Bright Yellow
-            "\033[38;5;46m",  // Bright Green
-            "\033[38;5;196m", // Bright Red
-            "\033[38;5;21m",  // Bright Blue
-            "\033[38;5;129m"  // Bright Purple
-        };
-        
-        size_t color_count = sizeof(colors) / sizeof(colors[0]);
-        return colors[hash % color_count];
-    }
+    /**
+     * Write out all queued messages before returning (no-op in synchronous mode)
+     */
+    void flush();
     
-    // Simple hash function for strings
-    uint32_t hash_string(const std::string& str) {
-        uint32_t hash = 5381;
-        for (char c : str) {
-            hash = ((hash << 5) + hash) + c; // hash * 33 + c
-        }
-        return hash;
+    /**
+     * Get the number of messages dropped because a thread's queue stayed full
+     * @return Dropped message count
+     */
+    uint64_t get_dropped_count() const {
+        return dropped_count_.load(std::memory_order_relaxed);
     }
     
-    std::string get_reset_code() {
-        if (!colors_enabled_ || !is_terminal_) return "";
-        return "\033[0m";
-    }
+    // Main logging function
+    void log(LogLevel level, const std::string& module, const std::string& message);
+
+private:
+    struct Record {
+        uint64_t sequence;
+        std::chrono::system_clock::time_point time;
+        LogLevel level;
+        std::string module;
+        std::string message;
+    };
+    
+    Logger();
+    ~Logger();
+    
+    LogThreadQueue& thread_queue();
+    void writer_loop();
+    void drain_queues();
+    void write_record_unlocked(const Record& record, std::string& out, std::string& err);
+    void format_timestamp_unlocked(std::chrono::system_clock::time_point time, bool with_date, std::string& out);
+    
+    std::string get_level_string(LogLevel level);
+    std::string get_color_code(LogLevel level);
+    std::string get_module_color(const std::string& module);
+    uint32_t hash_string(const std::string& str);
+    std::string get_reset_code();
     
     // File logging methods
-    void write_to_file(LogLevel level, const std::string& module, const std::string& message) {
-        if (!log_file_.is_open()) return;
-        
-        // Check if rotation is needed
-        if (max_log_file_size_ > 0 && current_file_size_ >= max_log_file_size_) {
-            rotate_log_files();
-        }
-        
-        std::ostringstream file_oss;
-        
-        // Add timestamp (always enabled for file logs)
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now.time_since_epoch()) % 1000;
-        
-        struct tm local_tm;
-#ifdef _WIN32
-        localtime_s(&local_tm, &time_t);
-#else
-        local_tm = *std::localtime(&time_t);
-#endif
-        file_oss << "[" << std::put_time(&local_tm, "%Y-%m-%d %H:%M:%S");
-        file_oss << "." << std::setfill('0') << std::setw(3) << ms.count() << "] ";
-        
-        // Add log level (no colors in file)
-        file_oss << "[" << get_level_string(level) << "]";
-        
-        // Add module tag
-        if (!module.empty()) {
-            file_oss << " [" << module << "]";
-        }
-        
-        // Add message
-        file_oss << " " << message << std::endl;
-        
-        std::string log_line = file_oss.str();
-        log_file_ << log_line;
-        log_file_.flush();
-        
-        current_file_size_ += log_line.length();
-    }
-    
-    void open_log_file() {
-        if (log_file_path_.empty()) return;
-        
-        close_log_file();
-        
-        // Create directory if it doesn't exist
-        size_t last_slash = log_file_path_.find_last_of("/\\");
-        if (last_slash != std::string::npos) {
-            std::string dir_path = log_file_path_.substr(0, last_slash);
-            if (!directory_exists(dir_path.c_str())) {
-                create_directories(dir_path.c_str());
-            }
-        }
-        
-        log_file_.open(log_file_path_, std::ios::app);
-        if (log_file_.is_open()) {
-            // Get current file size
-            log_file_.seekp(0, std::ios::end);
-            current_file_size_ = static_cast<size_t>(log_file_.tellp());
-            log_file_.seekp(0, std::ios::end); // Ensure we're at the end for appending
-        }
-    }
-    
-    void close_log_file() {
-        if (log_file_.is_open()) {
-            log_file_.close();
-        }
-        current_file_size_ = 0;
-    }
-    
-    void rotate_log_files() {
-        if (log_file_path_.empty() || max_log_files_ <= 0) return;
-        
-        close_log_file();
-        
-        // Move existing log files
-        for (int i = max_log_files_ - 1; i >= 1; i--) {
-            std::string old_name = log_file_path_ + "." + std::to_string(i);
-            std::string new_name = log_file_path_ + "." + std::to_string(i + 1);
-            
-            // Delete the oldest file if it exists
-            if (i == max_log_files_ - 1) {
-                std::remove(new_name.c_str());
-            }
-            
-            // Rename old file to new name
-            std::rename(old_name.c_str(), new_name.c_str());
-        }
-        
-        // Move current log file to .1
-        std::string backup_name = log_file_path_ + ".1";
-        std::rename(log_file_path_.c_str(), backup_name.c_str());
-        
-        // Reopen the log file (new empty file)
-        open_log_file();
-    }
+    void write_to_file_unlocked(const std::string& line);
+    void open_log_file();
+    void close_log_file();
+    void rotate_log_files();
     
-    mutable std::mutex mutex_;
-    LogLevel min_level_;
+    mutable std::mutex mutex_;                  // Guards configuration, the file and all output
+    std::atomic<LogLevel> min_level_;
     bool colors_enabled_;
     bool timestamps_enabled_;
     bool is_terminal_;
@@ -376,37 +182,45 @@ private:
     size_t max_log_file_size_;
     int max_log_files_;
     size_t current_file_size_;
+    
+    // Cached local time of the last formatted second, so localtime runs once per second
+    int64_t cached_second_;
+    std::string cached_time_;                   // "HH:MM:SS"
+    std::string cached_date_;                   // "YYYY-MM-DD "
+    
+    // Asynchronous backend
+    friend class LogThreadQueue;
+    std::atomic<bool> async_enabled_;
+    std::atomic<uint64_t> sequence_;
+    std::atomic<uint64_t> dropped_count_;
+    std::mutex queues_mutex_;                   // Guards queues_ (taken once per thread, at registration)
+    std::vector<std::shared_ptr<LogThreadQueue>> queues_;
+    std::mutex writer_mutex_;                   // Guards writer_thread_ and writer_running_
+    std::condition_variable writer_cv_;
+    std::thread writer_thread_;
+    bool writer_running_;
 };
 
 } // namespace librats
 
-// Convenience macros for easy logging
-#define LOG_DEBUG(module, message) \
-    do { \
-        std::ostringstream oss; \
-        oss << message; \
-        librats::Logger::getInstance().log(librats::LogLevel::DEBUG, module, oss.str()); \
-    } while(0)
-
-#define LOG_INFO(module, message) \
-    do { \
-        std::ostringstream oss; \
-        oss << message; \
-        librats::Logger::getInstance().log(librats::LogLevel::INFO, module, oss.str()); \
-    } while(0)
-
-#define LOG_WARN(module, message) \
-    do { \
-        std::ostringstream oss; \
-        oss << message; \
-        librats::Logger::getInstance().log(librats::LogLevel::WARN, module, oss.str()); \
-    } while(0)
+// Messages below this level are removed at compile time (0 = DEBUG, 1 = INFO, 2 = WARN, 3 = ERROR)
+#ifndef LIBRATS_MIN_LOG_LEVEL
+#define LIBRATS_MIN_LOG_LEVEL 0
+#endif
 
-#define LOG_ERROR(module, message) \
+// The level is checked before the message is formatted
+#define LIBRATS_LOG_AT(level, module, message) \
     do { \
-        std::ostringstream oss; \
-        oss << message; \
-        librats::Logger::getInstance().log(librats::LogLevel::ERROR, module, oss.str()); \
+        if (static_cast<int>(level) >= LIBRATS_MIN_LOG_LEVEL && \
+            librats::Logger::getInstance().should_log(level)) { \
+            std::ostringstream oss; \
+            oss << message; \
+            librats::Logger::getInstance().log(level, module, oss.str()); \
+        } \
     } while(0)
 
- 
\ No newline at end of file
+// Convenience macros for easy logging
+#define LOG_DEBUG(module, message) LIBRATS_LOG_AT(librats::LogLevel::DEBUG, module, message)
+#define LOG_INFO(module, message)  LIBRATS_LOG_AT(librats::LogLevel::INFO, module, message)
+#define LOG_WARN(module, message)  LIBRATS_LOG_AT(librats::LogLevel::WARN, module, message)
+#define LOG_ERROR(module, message) LIBRATS_LOG_AT(librats::LogLevel::ERROR, module, message)
@@ -3,6 +3,7 @@
 #include "os.h"
 #include "socket.h"
 #include <algorithm>
+#include <cctype>
 #include <random>
 #include <sstream>
 #include <iomanip>
@@ -16,16 +17,174 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#ifdef RATS_ANDROID_OLD_API
+#include <ifaddrs-android.h>
+#else
 #include <ifaddrs.h>
+#endif
 #include <unistd.h>
 #endif
 
 namespace librats {
 
+namespace {
+
+// Query intervals start here and double up to the configured query interval (RFC 6762 section 5.2)
+const std::chrono::milliseconds MDNS_INITIAL_QUERY_INTERVAL(1000);
+
+// A record is multicast on an interface at most once per second (RFC 6762 section 6)
+const std::chrono::milliseconds MDNS_MIN_RESPONSE_INTERVAL(1000);
+
+// Largest mDNS packet we accept (RFC 6762 section 17)
+const size_t MDNS_MAX_RECEIVE_SIZE = 9000;
+
+std::chrono::milliseconds random_delay(int min_ms, int max_ms) {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<> dis(min_ms, max_ms);
+    return std::chrono::milliseconds(dis(gen));
+}
+
+std::string to_lower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return value;
+}
+
+} // namespace
+
+// =========================================================================
+// MdnsServiceCache
+// =========================================================================
+
+bool MdnsServiceCache::update(const MdnsService& service) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = services_.find(service.service_name);
+    bool is_new = it == services_.end() || it->second.expires_at() <= service.last_seen;
+    if (it == services_.end() && services_.size() >= max_services_) {
+        evict_one();
+    }
+    services_[service.service_name] = service;
+    return is_new;
+}
+
+bool MdnsServiceCache::remove(const std::string& service_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return services_.erase(service_name) > 0;
+}
+
+std::vector<MdnsService> MdnsServiceCache::services(Clock::time_point now, std::chrono::seconds max_age) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<MdnsService> result;
+    for (const auto& pair : services_) {
+        const MdnsService& service = pair.second;
+        if (service.expires_at() > now && std::chrono::duration_cast<std::chrono::seconds>(now - service.last_seen) <= max_age) {
+            result.push_back(service);
+        }
+    }
+    return result;
+}
+
+void MdnsServiceCache::purge(Clock::time_point now, std::chrono::seconds max_age) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = services_.begin(); it != services_.end();) {
+        if (it->second.expires_at() <= now || std::chrono::duration_cast<std::chrono::seconds>(now - it->second.last_seen) > max_age) {
+            LOG_MDNS_DEBUG("Removing expired service: " << it->second.service_name);
+            it = services_.erase(it);
+            ++evictions_;
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<std::pair<std::string, uint32_t>> MdnsServiceCache::known_answers(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::pair<std::string, uint32_t>> answers;
+    for (const auto& pair : services_) {
+        const MdnsService& service = pair.second;
+        auto remaining = std::chrono::duration_cast<std::chrono::seconds>(service.expires_at() - now).count();
+        if (remaining * 2 > static_cast<int64_t>(service.ttl)) {
+            answers.emplace_back(service.service_name, static_cast<uint32_t>(remaining));
+        }
+    }
+    return answers;
+}
+
+bool MdnsServiceCache::is_known_answer(const std::string& service_name, Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = services_.find(service_name);
+    if (it == services_.end()) {
+        return false;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::seconds>(it->second.expires_at() - now).count();
+    return remaining * 2 > static_cast<int64_t>(it->second.ttl);
+}
+
+MdnsServiceCache::Clock::time_point MdnsServiceCache::next_refresh(Clock::time_point after) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point next = Clock::time_point::max();
+    for (const auto& pair : services_) {
+        const MdnsService& service = pair.second;
+        auto refresh_at = service.last_seen + std::chrono::milliseconds(static_cast<int64_t>(service.ttl) * 800);
+        if (refresh_at > after && refresh_at < next) {
+            next = refresh_at;
+        }
+    }
+    return next;
+}
+
+void MdnsServiceCache::set_max_services(size_t max_services) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_services_ = (std::max)(max_services, size_t(1));
+    while (services_.size() > max_services_) {
+        evict_one();
+    }
+}
+
+ResourceUsage MdnsServiceCache::usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ResourceUsage usage;
+    usage.entries = services_.size();
+    usage.max_entries = max_services_;
+    usage.evictions = evictions_;
+    for (const auto& pair : services_) {
+        const MdnsService& service = pair.second;
+        usage.bytes += sizeof(pair) + 4 * sizeof(void*) + pair.first.capacity() +
+                       service.service_name.capacity() + service.host_name.capacity() + service.ip_address.capacity();
+        for (const auto& txt : service.txt_records) {
+            usage.bytes += sizeof(txt) + 4 * sizeof(void*) + txt.first.capacity() + txt.second.capacity();
+        }
+    }
+    return usage;
+}
+
+void MdnsServiceCache::evict_one() {
+    auto victim = std::min_element(services_.begin(), services_.end(),
+                                   [](const std::pair<const std::string, MdnsService>& a,
+                                      const std::pair<const std::string, MdnsService>& b) {
+                                       return a.second.expires_at() < b.second.expires_at();
+                                   });
+    LOG_MDNS_DEBUG("Service cache full, dropping " << victim->first);
+    services_.erase(victim);
+    ++evictions_;
+}
+
+void MdnsServiceCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    services_.clear();
+}
+
+size_t MdnsServiceCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return services_.size();
+}
+
+// =========================================================================
+// MdnsClient
+// =========================================================================
+
 MdnsClient::MdnsClient(const std::string& service_instance_name, uint16_t service_port)
     : service_instance_name_(service_instance_name),
       service_port_(service_port),
-      multicast_socket_(INVALID_SOCKET_VALUE),
       running_(false),
       announcing_(false),
       discovering_(false),
@@ -57,19 +216,12 @@ bool MdnsClient::start() {
         return false;
     }
     
-    // Create and configure multicast socket
-    if (!create_multicast_socket()) {
+    // Create one multicast socket per interface and address family
+    if (!open_interface_sockets()) {
         LOG_MDNS_ERROR("Failed to create multicast socket");
         return false;
     }
     
-    // Join multicast group
-    if (!join_multicast_group()) {
-        LOG_MDNS_ERROR("Failed to join multicast group");
-        close_multicast_socket();
-        return false;
-    }
-    
     running_.store(true);
     
     // Start receiver thread
@@ -85,32 +237,34 @@ void MdnsClient::stop() {
     }
     
     LOG_MDNS_INFO("Stopping mDNS client");
+    bool was_announcing = announcing_.load();
     
     // Trigger immediate shutdown of all background threads
     shutdown_immediate();
     
-    // Close socket to break receiver loop
-    close_multicast_socket();
-    
     // Wait for threads to finish
     if (receiver_thread_.joinable()) {
         receiver_thread_.join();
     }
-
+    
     if (announcer_thread_.joinable()) {
         announcer_thread_.join();
     }
-
+    
     if (querier_thread_.joinable()) {
         querier_thread_.join();
     }
     
-    // Clear discovered services
-    {
-        std::lock_guard<std::mutex> lock(services_mutex_);
-        discovered_services_.clear();
+    // Tell other hosts to drop our records rather than wait for them to expire
+    if (was_announcing) {
+        send_announcement(0);
     }
     
+    close_interface_sockets();
+    
+    // Clear discovered services
+    cache_.clear();
+    
     LOG_MDNS_INFO("mDNS client stopped");
 }
 
@@ -130,7 +284,7 @@ bool MdnsClient::is_running() const {
     return running_.load();
 }
 
-bool MdnsClient::announce_service(const std::string& instance_name, uint16_t port, 
+bool MdnsClient::announce_service(const std::string& instance_name, uint16_t port,
                                  const std::map<std::string, std::string>& txt_records) {
     if (!running_.load()) {
         LOG_MDNS_ERROR("mDNS client is not running");
@@ -162,10 +316,15 @@ void MdnsClient::stop_announcing() {
     
     LOG_MDNS_INFO("Stopping service announcement");
     announcing_.store(false);
+    shutdown_cv_.notify_all();
     
     if (announcer_thread_.joinable()) {
         announcer_thread_.join();
     }
+    
+    if (running_.load()) {
+        send_announcement(0);
+    }
 }
 
 bool MdnsClient::is_announcing() const {
@@ -202,6 +361,7 @@ void MdnsClient::stop_discovery() {
     
     LOG_MDNS_INFO("Stopping service discovery");
     discovering_.store(false);
+    shutdown_cv_.notify_all();
     
     if (querier_thread_.joinable()) {
         querier_thread_.join();
@@ -219,56 +379,27 @@ bool MdnsClient::query_services() {
     }
     
     LOG_MDNS_INFO("Sending mDNS query for librats services");
-    
-    DnsMessage query = create_query_message();
-    std::vector<uint8_t> packet = serialize_dns_message(query);
-    
-    return send_multicast_packet(packet);
+    return send_query();
 }
 
 std::vector<MdnsService> MdnsClient::get_discovered_services() const {
-    std::lock_guard<std::mutex> lock(services_mutex_);
-    std::vector<MdnsService> services;
-    
-    for (const auto& pair : discovered_services_) {
-        services.push_back(pair.second);
-    }
-    
-    return services;
+    return cache_.services(std::chrono::steady_clock::now());
 }
 
 std::vector<MdnsService> MdnsClient::get_recent_services(std::chrono::seconds max_age) const {
-    std::lock_guard<std::mutex> lock(services_mutex_);
-    std::vector<MdnsService> recent_services;
-    auto now = std::chrono::steady_clock::now();
-    
-    for (const auto& pair : discovered_services_) {
-        const MdnsService& service = pair.second;
-        auto age = std::chrono::duration_cast<std::chrono::seconds>(now - service.last_seen);
-        
-        if (age <= max_age) {
-            recent_services.push_back(service);
-        }
-    }
-    
-    return recent_services;
+    return cache_.services(std::chrono::steady_clock::now(), max_age);
 }
 
 void MdnsClient::clear_old_services(std::chrono::seconds max_age) {
-    std::lock_guard<std::mutex> lock(services_mutex_);
-    auto now = std::chrono::steady_clock::now();
-    
-    auto it = discovered_services_.begin();
-    while (it != discovered_services_.end()) {
-        auto age = std::chrono::duration_cast<std::chrono::seconds>(now - it->second.last_seen);
-        
-        if (age > max_age) {
-            LOG_MDNS_DEBUG("Removing old service: " << it->second.service_name);
-            it = discovered_services_.erase(it);
-        } else {
-            ++it;
-        }
-    }
+    cache_.purge(std::chrono::steady_clock::now(), max_age);
+}
+
+void MdnsClient::set_max_services(size_t max_services) {
+    cache_.set_max_services(max_services);
+}
+
+ResourceUsage MdnsClient::get_services_usage() const {
+    return cache_.usage();
 }
 
 void MdnsClient::set_announcement_interval(std::chrono::seconds interval) {
@@ -279,151 +410,313 @@ void MdnsClient::set_query_interval(std::chrono::seconds interval) {
     query_interval_ = interval;
 }
 
-bool MdnsClient::create_multicast_socket() {
-    multicast_socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (!librats::is_valid_socket(multicast_socket_)) {
+std::vector<MdnsClient::MdnsInterface> MdnsClient::enumerate_interfaces() {
+    std::vector<MdnsInterface> interfaces;
+    
+    // First address of each family on every multicast-capable interface that is up
+    auto add_interface = [&interfaces](const std::string& name, uint32_t index, int family, const std::string& address) {
+        for (const auto& existing : interfaces) {
+            if (existing.name == name && existing.family == family) {
+                return;
+            }
+        }
+        MdnsInterface iface;
+        iface.name = name;
+        iface.index = index;
+        iface.family = family;
+        iface.address = address;
+        interfaces.push_back(iface);
+    };
+
 #ifdef _WIN32
-        LOG_MDNS_ERROR("Failed to create UDP socket (error: " << WSAGetLastError() << ")");
-#else
-        LOG_MDNS_ERROR("Failed to create UDP socket (error: " << strerror(errno) << ")");
-#endif
-        return false;
+    ULONG buffer_size = 15000;
+    std::vector<uint8_t> buffer;
+    DWORD result = ERROR_BUFFER_OVERFLOW;
+    for (int attempt = 0; attempt < 3 && result == ERROR_BUFFER_OVERFLOW; ++attempt) {
+        buffer.resize(buffer_size);
+        result = GetAdaptersAddresses(AF_UNSPEC, GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER,
+                                      nullptr, reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()), &buffer_size);
+    }
+    if (result != NO_ERROR) {
+        LOG_MDNS_WARN("GetAdaptersAddresses failed with error: " << result);
+        return interfaces;
     }
     
-    // Set socket options for multicast
-    int reuse = 1;
-    if (setsockopt(multicast_socket_, SOL_SOCKET, SO_REUSEADDR, 
-                   reinterpret_cast<const char*>(&reuse), sizeof(reuse)) < 0) {
-        LOG_MDNS_WARN("Failed to set SO_REUSEADDR on multicast socket");
+    for (auto adapter = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()); adapter; adapter = adapter->Next) {
+        if (adapter->OperStatus != IfOperStatusUp || adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK ||
+            (adapter->Flags & IP_ADAPTER_NO_MULTICAST)) {
+            continue;
+        }
+        for (auto unicast = adapter->FirstUnicastAddress; unicast; unicast = unicast->Next) {
+            int family = unicast->Address.lpSockaddr->sa_family;
+            char ip_str[INET6_ADDRSTRLEN] = {0};
+            if (family == AF_INET) {
+                inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(unicast->Address.lpSockaddr)->sin_addr, ip_str, sizeof(ip_str));
+                add_interface(adapter->AdapterName, adapter->IfIndex, AF_INET, ip_str);
+            } else if (family == AF_INET6) {
+                inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(unicast->Address.lpSockaddr)->sin6_addr, ip_str, sizeof(ip_str));
+                add_interface(adapter->AdapterName, adapter->Ipv6IfIndex, AF_INET6, ip_str);
+            }
+        }
+    }
+#else
+    struct ifaddrs* ifaddr = nullptr;
+    if (getifaddrs(&ifaddr) == -1) {
+        LOG_MDNS_WARN("getifaddrs failed");
+        return interfaces;
     }
     
-#ifdef SO_REUSEPORT
-    if (setsockopt(multicast_socket_, SOL_SOCKET, SO_REUSEPORT, 
-                   reinterpret_cast<const char*>(&reuse), sizeof(reuse)) < 0) {
-        LOG_MDNS_WARN("Failed to set SO_REUSEPORT on multicast socket");
+    for (struct ifaddrs* ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == nullptr || !(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_MULTICAST) ||
+            (ifa->ifa_flags & IFF_LOOPBACK)) {
+            continue;
+        }
+        char ip_str[INET6_ADDRSTRLEN] = {0};
+        if (ifa->ifa_addr->sa_family == AF_INET) {
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(ifa->ifa_addr)->sin_addr, ip_str, sizeof(ip_str));
+            add_interface(ifa->ifa_name, if_nametoindex(ifa->ifa_name), AF_INET, ip_str);
+        } else if (ifa->ifa_addr->sa_family == AF_INET6) {
+            inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(ifa->ifa_addr)->sin6_addr, ip_str, sizeof(ip_str));
+            add_interface(ifa->ifa_name, if_nametoindex(ifa->ifa_name), AF_INET6, ip_str);
+        }
     }
+    
+    freeifaddrs(ifaddr);
 #endif
+
+    return interfaces;
+}
+
+bool MdnsClient::open_interface_sockets() {
+    std::vector<MdnsInterface> candidates = enumerate_interfaces();
     
-    // Bind to mDNS port
-    sockaddr_in bind_addr{};
-    bind_addr.sin_family = AF_INET;
-    bind_addr.sin_addr.s_addr = INADDR_ANY;
-    bind_addr.sin_port = htons(MDNS_PORT);
+    interfaces_.clear();
+    local_addresses_.clear();
+    local_addresses_.insert(local_ip_address_);
+    for (auto& iface : candidates) {
+        local_addresses_.insert(iface.address);
+        if (open_interface_socket(iface)) {
+            interfaces_.push_back(iface);
+        }
+    }
     
-    if (bind(multicast_socket_, reinterpret_cast<sockaddr*>(&bind_addr), sizeof(bind_addr)) < 0) {
-#ifdef _WIN32
-        LOG_MDNS_ERROR("Failed to bind to mDNS port " << MDNS_PORT << " (error: " << WSAGetLastError() << ")");
-#else
-        LOG_MDNS_ERROR("Failed to bind to mDNS port " << MDNS_PORT << " (error: " << strerror(errno) << ")");
-#endif
-        close_socket(multicast_socket_);
-        multicast_socket_ = INVALID_SOCKET_VALUE;
-        return false;
+    // No usable interface found: fall back to one IPv4 socket on the default interface
+    if (interfaces_.empty()) {
+        MdnsInterface fallback;
+        fallback.family = AF_INET;
+        fallback.address = local_ip_address_;
+        if (!open_interface_socket(fallback)) {
+            return false;
+        }
+        interfaces_.push_back(fallback);
     }
     
-    LOG_MDNS_DEBUG("Created and bound multicast socket to port " << MDNS_PORT);
+    LOG_MDNS_DEBUG("Listening for mDNS on " << interfaces_.size() << " interface sockets");
     return true;
 }
 
-bool MdnsClient::join_multicast_group() {
-    if (!is_valid_socket(multicast_socket_)) {
-        return false;
-    }
-    
-    // Join IPv4 multicast group
-    ip_mreq mreq{};
-    inet_pton(AF_INET, MDNS_MULTICAST_IPv4.c_str(), &mreq.imr_multiaddr);
-    mreq.imr_interface.s_addr = INADDR_ANY;
-    
-    if (setsockopt(multicast_socket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, 
-                   reinterpret_cast<const char*>(&mreq), sizeof(mreq)) < 0) {
+bool MdnsClient::open_interface_socket(MdnsInterface& iface) {
+    bool ipv6 = iface.family == AF_INET6;
+    socket_t sock = socket(iface.family, SOCK_DGRAM, IPPROTO_UDP);
+    if (!librats::is_valid_socket(sock)) {
 #ifdef _WIN32
-        LOG_MDNS_ERROR("Failed to join IPv4 multicast group (error: " << WSAGetLastError() << ")");
+        LOG_MDNS_ERROR("Failed to create UDP socket (error: " << WSAGetLastError() << ")");
 #else
-        LOG_MDNS_ERROR("Failed to join IPv4 multicast group (error: " << strerror(errno) << ")");
+        LOG_MDNS_ERROR("Failed to create UDP socket (error: " << strerror(errno) << ")");
 #endif
         return false;
     }
     
-    // Set multicast TTL
-    int ttl = 255;
-    if (setsockopt(multicast_socket_, IPPROTO_IP, IP_MULTICAST_TTL, 
-                   reinterpret_cast<const char*>(&ttl), sizeof(ttl)) < 0) {
-        LOG_MDNS_WARN("Failed to set multicast TTL");
+    // Every interface socket shares the mDNS port
+    int reuse = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+                   reinterpret_cast<const char*>(&reuse), sizeof(reuse)) < 0) {
+        LOG_MDNS_WARN("Failed to set SO_REUSEADDR on multicast socket");
     }
-    
-    // Disable loopback
-    int loopback = 0;
-    if (setsockopt(multicast_socket_, IPPROTO_IP, IP_MULTICAST_LOOP, 
-                   reinterpret_cast<const char*>(&loopback), sizeof(loopback)) < 0) {
-        LOG_MDNS_WARN("Failed to disable multicast loopback");
+
+#ifdef SO_REUSEPORT
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT,
+                   reinterpret_cast<const char*>(&reuse), sizeof(reuse)) < 0) {
+        LOG_MDNS_WARN("Failed to set SO_REUSEPORT on multicast socket");
     }
-    
-    LOG_MDNS_DEBUG("Joined IPv4 multicast group: " << MDNS_MULTICAST_IPv4);
-    return true;
-}
+#endif
 
-bool MdnsClient::leave_multicast_group() {
-    if (!is_valid_socket(multicast_socket_)) {
-        return false;
+    // Only deliver group traffic from the interface this socket joined on (Linux delivers all by default)
+    int multicast_all = 0;
+#ifdef IP_MULTICAST_ALL
+    if (!ipv6 && iface.index != 0) {
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_ALL, reinterpret_cast<const char*>(&multicast_all), sizeof(multicast_all));
+    }
+#endif
+#ifdef IPV6_MULTICAST_ALL
+    if (ipv6) {
+        setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_ALL, reinterpret_cast<const char*>(&multicast_all), sizeof(multicast_all));
     }
+#endif
+    (void)multicast_all;
+    
+    bool ok = true;
+    if (ipv6) {
+        int v6only = 1;
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&v6only), sizeof(v6only));
+    
+        sockaddr_in6 bind_addr{};
+        bind_addr.sin6_family = AF_INET6;
+        bind_addr.sin6_addr = in6addr_any;
+        bind_addr.sin6_port = htons(MDNS_PORT);
+        ok = bind(sock, reinterpret_cast<sockaddr*>(&bind_addr), sizeof(bind_addr)) == 0;
+    
+        ipv6_mreq mreq{};
+        inet_pton(AF_INET6, MDNS_MULTICAST_IPv6.c_str(), &mreq.ipv6mr_multiaddr);
+        mreq.ipv6mr_interface = iface.index;
+        ok = ok && setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, reinterpret_cast<const char*>(&mreq), sizeof(mreq)) == 0;
+    
+        unsigned int index = iface.index;
+        int hops = 255;
+        unsigned int loopback = 0;
+        if (ok) {
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, reinterpret_cast<const char*>(&index), sizeof(index));
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, reinterpret_cast<const char*>(&hops), sizeof(hops));
+            setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, reinterpret_cast<const char*>(&loopback), sizeof(loopback));
+        }
+    } else {
+        sockaddr_in bind_addr{};
+        bind_addr.sin_family = AF_INET;
+        bind_addr.sin_addr.s_addr = INADDR_ANY;
+        bind_addr.sin_port = htons(MDNS_PORT);
+        ok = bind(sock, reinterpret_cast<sockaddr*>(&bind_addr), sizeof(bind_addr)) == 0;
+    
+        ip_mreq mreq{};
+        inet_pton(AF_INET, MDNS_MULTICAST_IPv4.c_str(), &mreq.imr_multiaddr);
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        if (iface.index != 0) {
+            inet_pton(AF_INET, iface.address.c_str(), &mreq.imr_interface);
+        }
+        ok = ok && setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&mreq), sizeof(mreq)) == 0;
     
-    ip_mreq mreq{};
-    inet_pton(AF_INET, MDNS_MULTICAST_IPv4.c_str(), &mreq.imr_multiaddr);
-    mreq.imr_interface.s_addr = INADDR_ANY;
+        int ttl = 255;
+        int loopback = 0;
+        if (ok) {
+            if (iface.index != 0) {
+                setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char*>(&mreq.imr_interface), sizeof(mreq.imr_interface));
+            }
+            if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl)) < 0) {
+                LOG_MDNS_WARN("Failed to set multicast TTL");
+            }
+            if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loopback), sizeof(loopback)) < 0) {
+                LOG_MDNS_WARN("Failed to disable multicast loopback");
+            }
+        }
+    }
     
-    if (setsockopt(multicast_socket_, IPPROTO_IP, IP_DROP_MEMBERSHIP, 
-                   reinterpret_cast<const char*>(&mreq), sizeof(mreq)) < 0) {
-        LOG_MDNS_WARN("Failed to leave IPv4 multicast group");
+    if (!ok) {
+#ifdef _WIN32
+        LOG_MDNS_WARN("Failed to set up mDNS on interface " << (iface.name.empty() ? "default" : iface.name)
+                      << " (" << iface.address << ", error: " << WSAGetLastError() << ")");
+#else
+        LOG_MDNS_WARN("Failed to set up mDNS on interface " << (iface.name.empty() ? "default" : iface.name)
+                      << " (" << iface.address << ", error: " << strerror(errno) << ")");
+#endif
+        close_socket(sock);
         return false;
     }
     
-    LOG_MDNS_DEBUG("Left IPv4 multicast group");
+    iface.socket = sock;
+    LOG_MDNS_DEBUG("Joined " << (ipv6 ? MDNS_MULTICAST_IPv6 : MDNS_MULTICAST_IPv4) << " on interface "
+                   << (iface.name.empty() ? "default" : iface.name) << " (" << iface.address << ")");
     return true;
 }
 
-void MdnsClient::close_multicast_socket() {
-    if (librats::is_valid_socket(multicast_socket_)) {
-        leave_multicast_group();
-        librats::close_socket(multicast_socket_, true);
-        multicast_socket_ = INVALID_SOCKET_VALUE;
+void MdnsClient::close_interface_sockets() {
+    for (auto& iface : interfaces_) {
+        if (!librats::is_valid_socket(iface.socket)) {
+            continue;
+        }
+        if (iface.family == AF_INET6) {
+            ipv6_mreq mreq{};
+            inet_pton(AF_INET6, MDNS_MULTICAST_IPv6.c_str(), &mreq.ipv6mr_multiaddr);
+            mreq.ipv6mr_interface = iface.index;
+            setsockopt(iface.socket, IPPROTO_IPV6, IPV6_LEAVE_GROUP, reinterpret_cast<const char*>(&mreq), sizeof(mreq));
+        } else {
+            ip_mreq mreq{};
+            inet_pton(AF_INET, MDNS_MULTICAST_IPv4.c_str(), &mreq.imr_multiaddr);
+            mreq.imr_interface.s_addr = INADDR_ANY;
+            if (iface.index != 0) {
+                inet_pton(AF_INET, iface.address.c_str(), &mreq.imr_interface);
+            }
+            setsockopt(iface.socket, IPPROTO_IP, IP_DROP_MEMBERSHIP, reinterpret_cast<const char*>(&mreq), sizeof(mreq));
+        }
+        librats::close_socket(iface.socket, true);
+        iface.socket = INVALID_SOCKET_VALUE;
     }
+    interfaces_.clear();
 }
 
 void MdnsClient::receiver_loop() {
     LOG_MDNS_DEBUG("mDNS receiver loop started");
     
-    std::vector<uint8_t> buffer(4096);
-    sockaddr_in sender_addr{};
-    socklen_t addr_len = sizeof(sender_addr);
+    std::vector<uint8_t> buffer(MDNS_MAX_RECEIVE_SIZE);
     
     while (running_.load()) {
-        if (!librats::is_valid_socket(multicast_socket_)) {
-            break;
+        // Wake for the next delayed response, and at least every 100ms to notice shutdown
+        auto wait = std::chrono::milliseconds(100);
+        Clock::time_point next_response = send_pending_responses();
+        if (next_response != Clock::time_point::max()) {
+            wait = (std::min)(wait, (std::max)(std::chrono::milliseconds(0),
+                std::chrono::duration_cast<std::chrono::milliseconds>(next_response - Clock::now())));
         }
-        
-        int received = recvfrom(multicast_socket_, reinterpret_cast<char*>(buffer.data()), 
-                                static_cast<int>(buffer.size()), 0, reinterpret_cast<sockaddr*>(&sender_addr), &addr_len);
-        
-        if (received <= 0) {
-            if (running_.load()) {
-                LOG_MDNS_ERROR("Failed to receive multicast packet");
-            }
-            break;
+    
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        socket_t max_socket = 0;
+        for (const auto& iface : interfaces_) {
+            FD_SET(iface.socket, &read_fds);
+            max_socket = (std::max)(max_socket, iface.socket);
         }
-        
-        // Get sender IP address
-        char sender_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &sender_addr.sin_addr, sender_ip, INET_ADDRSTRLEN);
-        
-        // Ignore packets from ourselves
-        if (std::string(sender_ip) == local_ip_address_) {
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = static_cast<long>(wait.count() * 1000);
+        if (select(static_cast<int>(max_socket + 1), &read_fds, nullptr, nullptr, &timeout) <= 0) {
             continue;
         }
-        
-        // Process the received packet
-        std::vector<uint8_t> packet(buffer.begin(), buffer.begin() + received);
-        handle_received_packet(packet, std::string(sender_ip));
+    
+        for (size_t i = 0; i < interfaces_.size() && running_.load(); ++i) {
+            const MdnsInterface& iface = interfaces_[i];
+            if (!FD_ISSET(iface.socket, &read_fds)) {
+                continue;
+            }
+    
+            sockaddr_storage sender_addr{};
+            socklen_t addr_len = sizeof(sender_addr);
+            int received = recvfrom(iface.socket, reinterpret_cast<char*>(buffer.data()),
+                                    static_cast<int>(buffer.size()), 0, reinterpret_cast<sockaddr*>(&sender_addr), &addr_len);
+            if (received <= 0) {
+                continue;
+            }
+    
+            // Get sender IP address
+            char sender_ip[INET6_ADDRSTRLEN] = {0};
+            if (sender_addr.ss_family == AF_INET6) {
+                inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(&sender_addr)->sin6_addr, sender_ip, sizeof(sender_ip));
+            } else {
+                inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&sender_addr)->sin_addr, sender_ip, sizeof(sender_ip));
+            }
+            std::string sender(sender_ip);
+    
+            // Ignore packets from ourselves
+            if (local_addresses_.count(sender)) {
+                continue;
+            }
+    
+            // A link-local sender is only reachable through the interface it was heard on
+            if (sender_addr.ss_family == AF_INET6 && sender.compare(0, 4, "fe80") == 0 && !iface.name.empty()) {
+                sender += "%" + iface.name;
+            }
+    
+            // Process the received packet
+            std::vector<uint8_t> packet(buffer.begin(), buffer.begin() + received);
+            handle_received_packet(packet, sender, i);
+        }
     }
     
     LOG_MDNS_DEBUG("mDNS receiver loop ended");
@@ -432,34 +725,25 @@ void MdnsClient::receiver_loop() {
 void MdnsClient::announcer_loop() {
     LOG_MDNS_DEBUG("mDNS announcer loop started");
     
-    // Send initial announcement immediately
-    DnsMessage announcement = create_announcement_message();
-    std::vector<uint8_t> packet = serialize_dns_message(announcement);
-    send_multicast_packet(packet);
-    
-    auto last_announcement = std::chrono::steady_clock::now();
+    // Announce right away, then one second later, doubling the gap up to the announcement interval
+    auto interval = std::chrono::milliseconds(1000);
+    auto next_announcement = Clock::now();
     
     while (announcing_.load() && running_.load()) {
-        auto now = std::chrono::steady_clock::now();
-        
-        if (now - last_announcement >= announcement_interval_) {
-            // Send periodic announcement
-            announcement = create_announcement_message();
-            packet = serialize_dns_message(announcement);
-            
-            if (send_multicast_packet(packet)) {
-                LOG_MDNS_DEBUG("Sent service announcement");
-            } else {
-                LOG_MDNS_WARN("Failed to send service announcement");
-            }
-            
-            last_announcement = now;
+        auto now = Clock::now();
+    
+        if (now >= next_announcement) {
+            send_announcement(MDNS_RECORD_TTL);
+            LOG_MDNS_DEBUG("Sent service announcement");
+    
+            next_announcement = now + interval;
+            interval = (std::min)(interval * 2, std::chrono::duration_cast<std::chrono::milliseconds>(announcement_interval_));
         }
-        
+    
         // Use conditional variable for responsive shutdown
         {
             std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(500), [this] { return !announcing_.load() || !running_.load(); })) {
+            if (shutdown_cv_.wait_until(lock, next_announcement, [this] { return !announcing_.load() || !running_.load(); })) {
                 break;
             }
         }
@@ -471,32 +755,45 @@ void MdnsClient::announcer_loop() {
 void MdnsClient::querier_loop() {
     LOG_MDNS_DEBUG("mDNS querier loop started");
     
-    // Send initial query immediately
-    query_services();
-    
-    auto last_query = std::chrono::steady_clock::now();
+    // Query right away, then back off exponentially up to the query interval; cached
+    // services nearing the end of their TTL trigger an earlier refresh query
+    auto interval = MDNS_INITIAL_QUERY_INTERVAL;
+    auto next_query = Clock::now();
+    Clock::time_point last_query;
     
     while (discovering_.load() && running_.load()) {
-        auto now = std::chrono::steady_clock::now();
-        
-        if (now - last_query >= query_interval_) {
-            // Send periodic query
-            if (query_services()) {
+        auto now = Clock::now();
+    
+        if (now >= next_query || now >= cache_.next_refresh(last_query)) {
+            // Another host asking the same question already brought us the answers (RFC 6762 section 7.3)
+            bool duplicate;
+            {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                duplicate = duplicate_query_at_ > last_query;
+            }
+    
+            if (duplicate) {
+                LOG_MDNS_DEBUG("Suppressed service query, another host asked the same question");
+            } else if (send_query()) {
                 LOG_MDNS_DEBUG("Sent service query");
             } else {
                 LOG_MDNS_WARN("Failed to send service query");
             }
-            
+    
             last_query = now;
+            next_query = now + interval;
+            auto max_interval = (std::max)(std::chrono::duration_cast<std::chrono::milliseconds>(query_interval_), MDNS_INITIAL_QUERY_INTERVAL);
+            interval = (std::min)(interval * 2, max_interval);
         }
-        
-        // Clean up old services
+    
+        // Clean up expired and old services
         clear_old_services(std::chrono::seconds(600));
-        
+    
         // Use conditional variable for responsive shutdown
         {
+            auto wake = (std::min)((std::min)(next_query, cache_.next_refresh(last_query)), Clock::now() + std::chrono::seconds(1));
             std::unique_lock<std::mutex> lock(shutdown_mutex_);
-            if (shutdown_cv_.wait_for(lock, std::chrono::milliseconds(1000), [this] { return !discovering_.load() || !running_.load(); })) {
+            if (shutdown_cv_.wait_until(lock, wake, [this] { return !discovering_.load() || !running_.load(); })) {
                 break;
             }
         }
@@ -505,7 +802,7 @@ void MdnsClient::querier_loop() {
     LOG_MDNS_DEBUG("mDNS querier loop ended");
 }
 
-void MdnsClient::handle_received_packet(const std::vector<uint8_t>& packet, const std::string& sender_ip) {
+void MdnsClient::handle_received_packet(const std::vector<uint8_t>& packet, const std::string& sender_ip, size_t iface) {
     LOG_MDNS_DEBUG("Received mDNS packet from " << sender_ip << " (" << packet.size() << " bytes)");
     
     DnsMessage message;
@@ -514,65 +811,187 @@ void MdnsClient::handle_received_packet(const std::vector<uint8_t>& packet, cons
         return;
     }
     
-    process_mdns_message(message, sender_ip);
+    process_mdns_message(message, sender_ip, iface);
 }
 
-void MdnsClient::process_mdns_message(const DnsMessage& message, const std::string& sender_ip) {
+void MdnsClient::process_mdns_message(const DnsMessage& message, const std::string& sender_ip, size_t iface) {
     // Check if this is a query or response
     bool is_response = (message.header.flags & static_cast<uint16_t>(MdnsFlags::RESPONSE)) != 0;
     
     if (is_response) {
-        process_response(message, sender_ip);
+        process_response(message, sender_ip, iface);
     } else {
-        process_query(message, sender_ip);
+        process_query(message, sender_ip, iface);
     }
 }
 
-void MdnsClient::process_query(const DnsMessage& query, const std::string& sender_ip) {
+void MdnsClient::process_query(const DnsMessage& query, const std::string& sender_ip, size_t iface) {
     LOG_MDNS_DEBUG("Processing mDNS query from " << sender_ip);
     
-    // Check if any questions match our announced service
+    auto now = Clock::now();
+    bool truncated = (query.header.flags & MDNS_FLAG_TRUNCATED) != 0;
+    bool asks_service_type = false;
+    for (const auto& question : query.questions) {
+        if (question.type == DnsRecordType::PTR && dns_names_equal(question.name, LIBRATS_SERVICE_TYPE)) {
+            asks_service_type = true;
+        }
+    }
+    
+    // Our own query would ask the same and learn nothing its known answers don't already hold
+    if (discovering_.load() && asks_service_type && !truncated) {
+        bool nothing_new = true;
+        for (const auto& known : query.answers) {
+            size_t offset = 0;
+            if (known.type == DnsRecordType::PTR &&
+                !cache_.is_known_answer(normalize_dns_name(read_dns_name(known.data, offset)), now)) {
+                nothing_new = false;
+                break;
+            }
+        }
+        if (nothing_new) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            duplicate_query_at_ = now;
+        }
+    }
+    
     if (!announcing_.load()) {
         return; // Not announcing anything
     }
     
+    // Known answers: records the querier already holds with at least half their TTL left (RFC 6762 section 7.1)
+    std::string our_service_name = create_service_instance_name(service_instance_name_);
+    DnsResourceRecord our_ptr = create_ptr_record(LIBRATS_SERVICE_TYPE, our_service_name);
+    bool ptr_known = false;
+    bool srv_known = false;
+    for (const auto& known : query.answers) {
+        if (is_known_answer(known, our_ptr)) {
+            ptr_known = true;
+        } else if (known.type == DnsRecordType::SRV && dns_names_equal(known.name, our_service_name) &&
+                   known.ttl >= MDNS_RECORD_TTL / 2) {
+            srv_known = true;
+        }
+    }
+    
+    bool should_respond = false;
     for (const auto& question : query.questions) {
-        bool should_respond = false;
-        
-        // Check if the question is asking for our service type
-        if (question.name == LIBRATS_SERVICE_TYPE && question.type == DnsRecordType::PTR) {
-            should_respond = true;
+        // Check if the question is asking for our service type or our specific service instance
+        if (question.type == DnsRecordType::PTR && dns_names_equal(question.name, LIBRATS_SERVICE_TYPE)) {
+            should_respond = should_respond || !ptr_known;
+        } else if (dns_names_equal(question.name, our_service_name)) {
+            should_respond = should_respond || !srv_known;
         }
-        
-        // Check if the question is asking for our specific service instance
-        std::string our_service_name = create_service_instance_name(service_instance_name_);
-        if (question.name == our_service_name) {
-            should_respond = true;
+    }
+    
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    MdnsInterface& state = interfaces_[iface];
+    
+    if (query.questions.empty()) {
+        // More known answers continuing a truncated query
+        if (ptr_known && state.response_pending && state.askers.erase(sender_ip) && state.askers.empty()) {
+            state.response_pending = false;
+            LOG_MDNS_DEBUG("Dropped pending response, " << sender_ip << " already knows our records");
         }
-        
-        if (should_respond) {
-            LOG_MDNS_DEBUG("Responding to mDNS query for: " << question.name);
-            
-            DnsMessage response = create_response_message(question);
-            std::vector<uint8_t> packet = serialize_dns_message(response);
-            
-            // Add a small random delay to avoid response collisions
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dis(20, 120);
-            std::this_thread::sleep_for(std::chrono::milliseconds(dis(gen)));
-            
-            send_multicast_packet(packet);
+        return;
+    }
+    
+    if (!should_respond) {
+        if (asks_service_type) {
+            LOG_MDNS_DEBUG("Suppressed response to " << sender_ip << ", it already knows our records");
         }
+        return;
+    }
+    
+    // Delay the answer to spread responses from many hosts (longer when more known answers are coming),
+    // never repeat our records within a second on this interface, and fold further queries into one response
+    Clock::time_point respond_at = (std::max)(now + (truncated ? random_delay(400, 500) : random_delay(20, 120)),
+                                              state.last_response + MDNS_MIN_RESPONSE_INTERVAL);
+    if (!state.response_pending) {
+        state.response_pending = true;
+        state.respond_at = respond_at;
+    } else if (truncated) {
+        state.respond_at = (std::max)(state.respond_at, respond_at);
     }
+    state.askers.insert(sender_ip);
+    LOG_MDNS_DEBUG("Scheduled mDNS response for " << sender_ip);
 }
 
-void MdnsClient::process_response(const DnsMessage& response, const std::string& sender_ip) {
+void MdnsClient::process_response(const DnsMessage& response, const std::string& sender_ip, size_t iface) {
     LOG_MDNS_DEBUG("Processing mDNS response from " << sender_ip);
     
+    // Another host just multicast our record: our pending response would only repeat it (RFC 6762 section 7.4)
+    if (announcing_.load()) {
+        DnsResourceRecord our_ptr = create_ptr_record(LIBRATS_SERVICE_TYPE, create_service_instance_name(service_instance_name_));
+        for (const auto& record : response.answers) {
+            if (is_known_answer(record, our_ptr)) {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                if (interfaces_[iface].response_pending) {
+                    interfaces_[iface].response_pending = false;
+                    interfaces_[iface].askers.clear();
+                    LOG_MDNS_DEBUG("Dropped pending response, " << sender_ip << " answered with our records");
+                }
+                break;
+            }
+        }
+    }
+    
     extract_service_from_response(response, sender_ip);
 }
 
+MdnsClient::Clock::time_point MdnsClient::send_pending_responses() {
+    auto now = Clock::now();
+    Clock::time_point next = Clock::time_point::max();
+    std::vector<size_t> due;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        for (size_t i = 0; i < interfaces_.size(); ++i) {
+            MdnsInterface& state = interfaces_[i];
+            if (!state.response_pending) {
+                continue;
+            }
+            if (state.respond_at <= now) {
+                state.response_pending = false;
+                state.askers.clear();
+                state.last_response = now;
+                due.push_back(i);
+            } else {
+                next = (std::min)(next, state.respond_at);
+            }
+        }
+    }
+    
+    // One packet per interface answers every query that arrived during the delay
+    for (size_t i : due) {
+        if (announcing_.load()) {
+            send_on_interface(interfaces_[i], serialize_dns_message(create_announcement_message(interfaces_[i])));
+        }
+    }
+    return next;
+}
+
+bool MdnsClient::send_query() {
+    DnsQuestion question(LIBRATS_SERVICE_TYPE, DnsRecordType::PTR, DnsRecordClass::CLASS_IN);
+    bool sent = true;
+    for (const auto& packet : build_query_packets(question, create_known_answers())) {
+        sent = send_multicast_packet(packet) && sent;
+    }
+    return sent;
+}
+
+void MdnsClient::send_announcement(uint32_t ttl) {
+    auto now = Clock::now();
+    for (auto& iface : interfaces_) {
+        send_on_interface(iface, serialize_dns_message(create_announcement_message(iface, ttl)));
+    }
+    
+    // A query answered by this announcement needs no separate response
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    for (auto& iface : interfaces_) {
+        iface.last_response = now;
+        iface.response_pending = false;
+        iface.askers.clear();
+    }
+}
+
 void MdnsClient::extract_service_from_response(const DnsMessage& response, const std::string& sender_ip) {
     MdnsService service;
     service.ip_address = sender_ip;
@@ -581,13 +1000,15 @@ void MdnsClient::extract_service_from_response(const DnsMessage& response, const
     bool has_ptr = false;
     bool has_srv = false;
     bool has_txt = false;
+    uint32_t ttl = MDNS_RECORD_TTL;
     
     // Process all answer records
     for (const auto& record : response.answers) {
         if (record.type == DnsRecordType::PTR && is_librats_service(record.name)) {
             // Extract service instance name from PTR record data
             size_t offset = 0;
-            service.service_name = read_dns_name(record.data, offset);
+            service.service_name = normalize_dns_name(read_dns_name(record.data, offset));
+            ttl = (std::min)(ttl, record.ttl);
             has_ptr = true;
             LOG_MDNS_DEBUG("Found PTR record: " << service.service_name);
         }
@@ -595,6 +1016,7 @@ void MdnsClient::extract_service_from_response(const DnsMessage& response, const
             // Extract SRV record data
             uint16_t priority, weight;
             if (decode_srv_record(record.data, priority, weight, service.port, service.host_name)) {
+                ttl = (std::min)(ttl, record.ttl);
                 has_srv = true;
                 LOG_MDNS_DEBUG("Found SRV record: " << service.host_name << ":" << service.port);
             }
@@ -607,47 +1029,54 @@ void MdnsClient::extract_service_from_response(const DnsMessage& response, const
         }
     }
     
-    // Process additional records for A records
+    // Process additional records for A and AAAA records; an IPv4 address wins, a
+    // link-local IPv6 address is no better than the sender address we already have
+    bool has_ipv4 = false;
     for (const auto& record : response.additionals) {
-        if (record.type == DnsRecordType::A && record.name == service.host_name) {
-            // Override IP address from A record if available
-            if (record.data.size() == 4) {
-                char ip_str[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, record.data.data(), ip_str, INET_ADDRSTRLEN);
-                service.ip_address = std::string(ip_str);
-                LOG_MDNS_DEBUG("Found A record: " << service.ip_address);
-            }
+        if (!dns_names_equal(record.name, service.host_name)) {
+            continue;
+        }
+        if (record.type == DnsRecordType::A && record.data.size() == 4) {
+            char ip_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, record.data.data(), ip_str, INET_ADDRSTRLEN);
+            service.ip_address = std::string(ip_str);
+            has_ipv4 = true;
+            LOG_MDNS_DEBUG("Found A record: " << service.ip_address);
+        } else if (record.type == DnsRecordType::AAAA && record.data.size() == 16 && !has_ipv4 &&
+                   !(record.data[0] == 0xfe && (record.data[1] & 0xc0) == 0x80)) {
+            char ip_str[INET6_ADDRSTRLEN];
+            inet_ntop(AF_INET6, record.data.data(), ip_str, INET6_ADDRSTRLEN);
+            service.ip_address = std::string(ip_str);
+            LOG_MDNS_DEBUG("Found AAAA record: " << service.ip_address);
         }
     }
     
+    // A goodbye (TTL 0) removes the service right away
+    if (has_ptr && ttl == 0) {
+        if (cache_.remove(service.service_name)) {
+            LOG_MDNS_INFO("librats service said goodbye: " << service.service_name);
+        }
+        return;
+    }
+    
     // Only add service if we have the essential information
     if (has_ptr && has_srv && !service.service_name.empty() && service.port > 0) {
+        service.ttl = ttl;
         add_or_update_service(service);
     }
 }
 
 bool MdnsClient::is_librats_service(const std::string& service_name) const {
-    return service_name == LIBRATS_SERVICE_TYPE;
+    return dns_names_equal(service_name, LIBRATS_SERVICE_TYPE);
 }
 
 void MdnsClient::add_or_update_service(const MdnsService& service) {
-    bool is_new = false;
-    
-    {
-        std::lock_guard<std::mutex> lock(services_mutex_);
-        auto it = discovered_services_.find(service.service_name);
-        
-        if (it == discovered_services_.end()) {
-            // New service
-            discovered_services_[service.service_name] = service;
-            is_new = true;
-            LOG_MDNS_INFO("Discovered new librats service: " << service.service_name 
-                         << " at " << service.ip_address << ":" << service.port);
-        } else {
-            // Update existing service
-            it->second = service;
-            LOG_MDNS_DEBUG("Updated existing librats service: " << service.service_name);
-        }
+    bool is_new = cache_.update(service);
+    if (is_new) {
+        LOG_MDNS_INFO("Discovered new librats service: " << service.service_name
+                     << " at " << service.ip_address << ":" << service.port);
+    } else {
+        LOG_MDNS_DEBUG("Updated existing librats service: " << service.service_name);
     }
     
     // Call callback if registered
@@ -660,22 +1089,16 @@ void MdnsClient::add_or_update_service(const MdnsService& service) {
     }
 }
 
-DnsMessage MdnsClient::create_query_message() {
-    DnsMessage query;
-    
-    // Set header
-    query.header.transaction_id = 0;
-    query.header.flags = static_cast<uint16_t>(MdnsFlags::QUERY);
-    query.header.question_count = 1;
-    
-    // Add question for librats services
-    DnsQuestion question(LIBRATS_SERVICE_TYPE, DnsRecordType::PTR, DnsRecordClass::CLASS_IN);
-    query.questions.push_back(question);
-    
-    return query;
+std::vector<DnsResourceRecord> MdnsClient::create_known_answers() {
+    std::vector<DnsResourceRecord> known_answers;
+    for (const auto& answer : cache_.known_answers(Clock::now())) {
+        DnsResourceRecord record = create_ptr_record(LIBRATS_SERVICE_TYPE, answer.first, answer.second);
+        known_answers.push_back(record);
+    }
+    return known_answers;
 }
 
-DnsMessage MdnsClient::create_announcement_message() {
+DnsMessage MdnsClient::create_announcement_message(const MdnsInterface& iface, uint32_t ttl) {
     DnsMessage announcement;
     
     // Set header
@@ -688,21 +1111,30 @@ DnsMessage MdnsClient::create_announcement_message() {
         our_hostname += ".local.";
     }
     
-    // Create PTR record
-    DnsResourceRecord ptr_record = create_ptr_record(LIBRATS_SERVICE_TYPE, our_service_name);
-    announcement.answers.push_back(ptr_record);
+    // Create PTR, SRV and TXT records
+    announcement.answers.push_back(create_ptr_record(LIBRATS_SERVICE_TYPE, our_service_name, ttl));
+    announcement.answers.push_back(create_srv_record(our_service_name, our_hostname, service_port_, ttl));
+    announcement.answers.push_back(create_txt_record(our_service_name, txt_records_, ttl));
     
-    // Create SRV record
-    DnsResourceRecord srv_record = create_srv_record(our_service_name, our_hostname, service_port_);
-    announcement.answers.push_back(srv_record);
-    
-    // Create TXT record
-    DnsResourceRecord txt_record = create_txt_record(our_service_name, txt_records_);
-    announcement.answers.push_back(txt_record);
-    
-    // Create A record
-    DnsResourceRecord a_record = create_a_record(our_hostname, local_ip_address_);
-    announcement.additionals.push_back(a_record);
+    // Address records: our addresses on the interface the packet goes out on
+    if (iface.name.empty()) {
+        if (local_ip_address_.find(':') == std::string::npos) {
+            announcement.additionals.push_back(create_a_record(our_hostname, local_ip_address_, ttl));
+        } else {
+            announcement.additionals.push_back(create_aaaa_record(our_hostname, local_ip_address_, ttl));
+        }
+    } else {
+        for (const auto& other : interfaces_) {
+            if (other.name != iface.name) {
+                continue;
+            }
+            if (other.family == AF_INET) {
+                announcement.additionals.push_back(create_a_record(our_hostname, other.address, ttl));
+            } else {
+                announcement.additionals.push_back(create_aaaa_record(our_hostname, other.address, ttl));
+            }
+        }
+    }
     
     // Update header counts
     announcement.header.answer_count = static_cast<uint16_t>(announcement.answers.size());
@@ -711,12 +1143,9 @@ DnsMessage MdnsClient::create_announcement_message() {
     return announcement;
 }
 
-DnsMessage MdnsClient::create_response_message(const DnsQuestion& question) {
-    return create_announcement_message(); // Same as announcement for simplicity
-}
-
 DnsResourceRecord MdnsClient::create_ptr_record(const std::string& service_type, const std::string& instance_name, uint32_t ttl) {
-    DnsResourceRecord record(service_type, DnsRecordType::PTR, DnsRecordClass::CLASS_IN_FLUSH, ttl);
+    // PTR records are shared between hosts, so they never carry the cache flush bit
+    DnsResourceRecord record(service_type, DnsRecordType::PTR, DnsRecordClass::CLASS_IN, ttl);
     
     // PTR record data is the instance name
     std::vector<uint8_t> data;
@@ -756,8 +1185,23 @@ DnsResourceRecord MdnsClient::create_a_record(const std::string& hostname, const
     return record;
 }
 
-std::vector<uint8_t> MdnsClient::serialize_dns_message(const DnsMessage& message) {
+DnsResourceRecord MdnsClient::create_aaaa_record(const std::string& hostname, const std::string& ip_address, uint32_t ttl) {
+    DnsResourceRecord record(hostname, DnsRecordType::AAAA, DnsRecordClass::CLASS_IN_FLUSH, ttl);
+    
+    // AAAA record data is 16 bytes of IPv6 address
+    sockaddr_in6 addr{};
+    inet_pton(AF_INET6, ip_address.c_str(), &addr.sin6_addr);
+    
+    record.data.resize(16);
+    std::memcpy(record.data.data(), &addr.sin6_addr, 16);
+    
+    return record;
+}
+
+    std::vector<uint8_t> MdnsClient::serialize_dns_message(const DnsMessage& message) {
     std::vector<uint8_t> buffer;
+    buffer.reserve(MDNS_MAX_PACKET_SIZE);
+    std::unordered_map<std::string, uint16_t> compression;
     
     // Write header
     write_uint16(buffer, message.header.transaction_id);
@@ -769,42 +1213,83 @@ std::vector<uint8_t> MdnsClient::serialize_dns_message(const DnsMessage& message
     
     // Write questions
     for (const auto& question : message.questions) {
-        write_dns_name(buffer, question.name);
+        write_dns_name(buffer, question.name, &compression);
         write_uint16(buffer, static_cast<uint16_t>(question.type));
         write_uint16(buffer, static_cast<uint16_t>(question.record_class));
     }
     
-    // Write answers
-    for (const auto& record : message.answers) {
-        write_dns_name(buffer, record.name);
-        write_uint16(buffer, static_cast<uint16_t>(record.type));
-        write_uint16(buffer, static_cast<uint16_t>(record.record_class));
-        write_uint32(buffer, record.ttl);
-        write_uint16(buffer, static_cast<uint16_t>(record.data.size()));
-        buffer.insert(buffer.end(), record.data.begin(), record.data.end());
+    // Write answers, authorities and additionals; owner names point back at earlier copies
+    for (const auto* section : {&message.answers, &message.authorities, &message.additionals}) {
+        for (const auto& record : *section) {
+            write_dns_name(buffer, record.name, &compression);
+            write_uint16(buffer, static_cast<uint16_t>(record.type));
+            write_uint16(buffer, static_cast<uint16_t>(record.record_class));
+            write_uint32(buffer, record.ttl);
+            write_uint16(buffer, static_cast<uint16_t>(record.data.size()));
+            buffer.insert(buffer.end(), record.data.begin(), record.data.end());
+        }
     }
     
-    // Write authorities (same format as answers)
-    for (const auto& record : message.authorities) {
-        write_dns_name(buffer, record.name);
-        write_uint16(buffer, static_cast<uint16_t>(record.type));
-        write_uint16(buffer, static_cast<uint16_t>(record.record_class));
-        write_uint32(buffer, record.ttl);
-        write_uint16(buffer, static_cast<uint16_t>(record.data.size()));
-        buffer.insert(buffer.end(), record.data.begin(), record.data.end());
+    return buffer;
+}
+
+std::vector<std::vector<uint8_t>> MdnsClient::build_query_packets(const DnsQuestion& question,
+                                                                  const std::vector<DnsResourceRecord>& known_answers,
+                                                                  size_t max_packet_size) {
+    const size_t header_size = 12;
+    const size_t record_fixed_size = 10;    // Type, class, TTL, data length
+    
+    std::vector<std::vector<uint8_t>> packets;
+    DnsMessage message;
+    message.header.flags = static_cast<uint16_t>(MdnsFlags::QUERY);
+    message.questions.push_back(question);
+    size_t size = header_size + dns_name_wire_size(question.name) + 4;
+    
+    // Sizes are counted without compression, so a packet can only come out smaller
+    auto flush = [&](bool more) {
+        message.header.question_count = static_cast<uint16_t>(message.questions.size());
+        message.header.answer_count = static_cast<uint16_t>(message.answers.size());
+        if (more) {
+            message.header.flags |= MDNS_FLAG_TRUNCATED;
+        }
+        packets.push_back(serialize_dns_message(message));
+        message = DnsMessage();
+        message.header.flags = static_cast<uint16_t>(MdnsFlags::QUERY);
+        size = header_size;
+    };
+    
+    for (const auto& record : known_answers) {
+        size_t record_size = dns_name_wire_size(record.name) + record_fixed_size + record.data.size();
+        if (size + record_size > max_packet_size && !message.answers.empty()) {
+            flush(true);
+        }
+        message.answers.push_back(record);
+        size += record_size;
     }
+    flush(false);
     
-    // Write additionals (same format as answers)
-    for (const auto& record : message.additionals) {
-        write_dns_name(buffer, record.name);
-        write_uint16(buffer, static_cast<uint16_t>(record.type));
-        write_uint16(buffer, static_cast<uint16_t>(record.record_class));
-        write_uint32(buffer, record.ttl);
-        write_uint16(buffer, static_cast<uint16_t>(record.data.size()));
-        buffer.insert(buffer.end(), record.data.begin(), record.data.end());
+    return packets;
+}
+
+bool MdnsClient::is_known_answer(const DnsResourceRecord& known, const DnsResourceRecord& ours) {
+    if (known.type != ours.type || known.ttl < ours.ttl / 2 || !dns_names_equal(known.name, ours.name)) {
+        return false;
+    }
+    if (known.data == ours.data) {
+        return true;
     }
     
-    return buffer;
+    // PTR data is a name, which other hosts may write in a different case
+    if (known.type != DnsRecordType::PTR) {
+        return false;
+    }
+    size_t known_offset = 0;
+    size_t our_offset = 0;
+    return dns_names_equal(read_dns_name(known.data, known_offset), read_dns_name(ours.data, our_offset));
+}
+
+bool MdnsClient::dns_names_equal(const std::string& a, const std::string& b) {
+    return to_lower(normalize_dns_name(a)) == to_lower(normalize_dns_name(b));
 }
 
 bool MdnsClient::deserialize_dns_message(const std::vector<uint8_t>& data, DnsMessage& message) {
@@ -891,9 +1376,11 @@ bool MdnsClient::deserialize_dns_message(const std::vector<uint8_t>& data, DnsMe
     }
 }
 
-void MdnsClient::write_dns_name(std::vector<uint8_t>& buffer, const std::string& name) {
+void MdnsClient::write_dns_name(std::vector<uint8_t>& buffer, const std::string& name,
+                                std::unordered_map<std::string, uint16_t>* compression) {
     std::string normalized = normalize_dns_name(name);
     
+    std::vector<std::string> labels;
     std::istringstream iss(normalized);
     std::string label;
     
@@ -904,14 +1391,39 @@ void MdnsClient::write_dns_name(std::vector<uint8_t>& buffer, const std::string&
             LOG_MDNS_WARN("DNS label too long, truncating: " << label);
             label = label.substr(0, 63);
         }
+        labels.push_back(label);
+    }
+    
+    for (size_t i = 0; i < labels.size(); ++i) {
+        if (compression) {
+            // Point at an earlier copy of the rest of the name (RFC 1035 section 4.1.4)
+            std::string suffix;
+            for (size_t j = i; j < labels.size(); ++j) {
+                suffix += to_lower(labels[j]) + ".";
+            }
+            auto it = compression->find(suffix);
+            if (it != compression->end()) {
+                write_uint16(buffer, static_cast<uint16_t>(0xC000 | it->second));
+                return;
+            }
+            if (buffer.size() < 0x3FFF) {
+                (*compression)[suffix] = static_cast<uint16_t>(buffer.size());
+            }
+        }
         
-        buffer.push_back(static_cast<uint8_t>(label.length()));
-        buffer.insert(buffer.end(), label.begin(), label.end());
+        buffer.push_back(static_cast<uint8_t>(labels[i].length()));
+        buffer.insert(buffer.end(), labels[i].begin(), labels[i].end());
     }
     
     buffer.push_back(0); // Root label
 }
 
+size_t MdnsClient::dns_name_wire_size(const std::string& name) {
+    std::vector<uint8_t> buffer;
+    write_dns_name(buffer, name);
+    return buffer.size();
+}
+
 std::string MdnsClient::read_dns_name(const std::vector<uint8_t>& buffer, size_t& offset) {
     std::string name;
     bool jumped = false;
@@ -1132,23 +1644,41 @@ std::string MdnsClient::extract_instance_name_from_service(const std::string& se
 }
 
 bool MdnsClient::send_multicast_packet(const std::vector<uint8_t>& packet) {
-    if (!librats::is_valid_socket(multicast_socket_)) {
+    bool sent = false;
+    for (const auto& iface : interfaces_) {
+        sent = send_on_interface(iface, packet) || sent;
+    }
+    return sent;
+}
+
+bool MdnsClient::send_on_interface(const MdnsInterface& iface, const std::vector<uint8_t>& packet) {
+    if (!librats::is_valid_socket(iface.socket)) {
         return false;
     }
     
-    sockaddr_in dest_addr{};
-    dest_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, MDNS_MULTICAST_IPv4.c_str(), &dest_addr.sin_addr);
-    dest_addr.sin_port = htons(MDNS_PORT);
-    
-    int sent = sendto(multicast_socket_, reinterpret_cast<const char*>(packet.data()), 
+    int sent;
+    if (iface.family == AF_INET6) {
+        sockaddr_in6 dest_addr{};
+        dest_addr.sin6_family = AF_INET6;
+        inet_pton(AF_INET6, MDNS_MULTICAST_IPv6.c_str(), &dest_addr.sin6_addr);
+        dest_addr.sin6_port = htons(MDNS_PORT);
+        dest_addr.sin6_scope_id = iface.index;
+        sent = sendto(iface.socket, reinterpret_cast<const char*>(packet.data()),
                       static_cast<int>(packet.size()), 0, reinterpret_cast<sockaddr*>(&dest_addr), sizeof(dest_addr));
+    } else {
+        sockaddr_in dest_addr{};
+        dest_addr.sin_family = AF_INET;
+        inet_pton(AF_INET, MDNS_MULTICAST_IPv4.c_str(), &dest_addr.sin_addr);
+        dest_addr.sin_port = htons(MDNS_PORT);
+        sent = sendto(iface.socket, reinterpret_cast<const char*>(packet.data()),
+                      static_cast<int>(packet.size()), 0, reinterpret_cast<sockaddr*>(&dest_addr), sizeof(dest_addr));
+    }
     
     if (sent < 0 || static_cast<size_t>(sent) != packet.size()) {
 #ifdef _WIN32
-        LOG_MDNS_ERROR("Failed to send multicast packet (error: " << WSAGetLastError() << ")");
+        LOG_MDNS_ERROR("Failed to send multicast packet on " << iface.address << " (error: " << WSAGetLastError() << ")");
 #else
-        LOG_MDNS_ERROR("Failed to send multicast packet (error: " << strerror(errno) << ")");
+        LOG_MDNS_ERROR("Failed to send multicast packet on " << iface.address << " (error: " << strerror(errno) << ")");
 #endif
         return false;
     }
@@ -1164,7 +1694,7 @@ bool MdnsClient::is_valid_dns_name(const std::string& name) const {
     return true; // Simplified validation
 }
 
-std::string MdnsClient::normalize_dns_name(const std::string& name) const {
+std::string MdnsClient::normalize_dns_name(const std::string& name) {
     std::string normalized = name;
     
     // Ensure name ends with dot if not empty
@@ -2,6 +2,7 @@
 
 #include "socket.h"
 #include "logger.h"
+#include "resource_usage.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -11,6 +12,8 @@
 #include <mutex>
 #include <chrono>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <cstdint>
 #include <condition_variable>
 
@@ -27,6 +30,10 @@ const std::string MDNS_MULTICAST_IPv4 = "224.0.0.251";
 const std::string MDNS_MULTICAST_IPv6 = "ff02::fb";
 const std::string LIBRATS_SERVICE_TYPE = "_librats._tcp.local.";
 const std::string LIBRATS_SERVICE_INSTANCE_SUFFIX = ".local.";
+const uint32_t MDNS_RECORD_TTL = 120;                // Seconds our records stay in other hosts' caches
+const size_t MDNS_MAX_PACKET_SIZE = 1400;           // Packets we build stay within an Ethernet MTU
+const uint16_t MDNS_FLAG_TRUNCATED = 0x0200;        // TC: more known answers follow in the next packet
+const size_t MDNS_MAX_CACHED_SERVICES = 256;       // Discovered services kept, the one closest to expiring dropped first
 
 // DNS record types
 enum class DnsRecordType : uint16_t {
@@ -58,13 +65,16 @@ struct MdnsService {
     uint16_t port;                 // Service port
     std::map<std::string, std::string> txt_records;  // TXT record key-value pairs
     std::chrono::steady_clock::time_point last_seen;
+    uint32_t ttl;                  // Seconds the records stay valid after last_seen
     
-    MdnsService() : port(0) {}
+    MdnsService() : port(0), ttl(MDNS_RECORD_TTL) {}
     
     MdnsService(const std::string& name, const std::string& host, 
                 const std::string& ip, uint16_t p)
         : service_name(name), host_name(host), ip_address(ip), port(p), 
-          last_seen(std::chrono::steady_clock::now()) {}
+          last_seen(std::chrono::steady_clock::now()), ttl(MDNS_RECORD_TTL) {}
+    
+    std::chrono::steady_clock::time_point expires_at() const { return last_seen + std::chrono::seconds(ttl); }
 };
 
 // DNS message header
@@ -115,6 +125,51 @@ struct DnsMessage {
     DnsMessage() = default;
 };
 
+/**
+ * Discovered services, each expiring with the TTL of its records (RFC 6762 section 10).
+ * Also answers what the querier needs from its cache: the known answers to list in a
+ * query (section 7.1) and when a record is due for a refresh query (section 5.2).
+ * Thread-safe.
+ */
+class MdnsServiceCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Add or refresh a service; returns true if it was not cached. A full cache drops the service closest to expiring
+    bool update(const MdnsService& service);
+
+    // Forget a service, e.g. on a goodbye record (TTL 0)
+    bool remove(const std::string& service_name);
+
+    // Unexpired services seen within max_age
+    std::vector<MdnsService> services(Clock::time_point now, std::chrono::seconds max_age = std::chrono::seconds::max()) const;
+
+    // Drop expired services and services not seen within max_age
+    void purge(Clock::time_point now, std::chrono::seconds max_age);
+
+    // Services with more than half of their TTL left, with the TTL remaining in seconds
+    std::vector<std::pair<std::string, uint32_t>> known_answers(Clock::time_point now) const;
+    bool is_known_answer(const std::string& service_name, Clock::time_point now) const;
+
+    // Earliest point after `after` at which a service reaches 80% of its TTL, Clock::time_point::max() if none
+    Clock::time_point next_refresh(Clock::time_point after) const;
+
+    // Change the number of services kept, dropping those closest to expiring that no longer fit
+    void set_max_services(size_t max_services);
+    ResourceUsage usage() const;
+
+    void clear();
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, MdnsService> services_;
+    size_t max_services_ = MDNS_MAX_CACHED_SERVICES;
+    uint64_t evictions_ = 0;
+
+    void evict_one();  // Caller holds mutex_
+};
+
 // mDNS service discovery callback
 using MdnsServiceCallback = std::function<void(const MdnsService& service, bool is_new)>;
 
@@ -148,19 +203,60 @@ public:
     std::vector<MdnsService> get_discovered_services() const;
     std::vector<MdnsService> get_recent_services(std::chrono::seconds max_age = std::chrono::seconds(300)) const;
     void clear_old_services(std::chrono::seconds max_age = std::chrono::seconds(600));
+    void set_max_services(size_t max_services);
+    ResourceUsage get_services_usage() const;
     
     // Configuration
     void set_announcement_interval(std::chrono::seconds interval);
     void set_query_interval(std::chrono::seconds interval);
     
+    // DNS wire format
+    static std::vector<uint8_t> serialize_dns_message(const DnsMessage& message);
+    static bool deserialize_dns_message(const std::vector<uint8_t>& data, DnsMessage& message);
+    
+    /**
+     * Query packets for question listing known_answers, split so each packet stays within
+     * max_packet_size; every packet but the last has the TC bit set (RFC 6762 section 7.2)
+     */
+    static std::vector<std::vector<uint8_t>> build_query_packets(const DnsQuestion& question,
+                                                                 const std::vector<DnsResourceRecord>& known_answers,
+                                                                 size_t max_packet_size = MDNS_MAX_PACKET_SIZE);
+    
+    // Whether a querier listing `known` already holds `ours`: same record with at least half its TTL left
+    static bool is_known_answer(const DnsResourceRecord& known, const DnsResourceRecord& ours);
+    
+    // DNS names compare case-insensitively and with or without the trailing dot
+    static bool dns_names_equal(const std::string& a, const std::string& b);
+    
 private:
+    using Clock = std::chrono::steady_clock;
+    
+    // One multicast socket per interface and address family
+    struct MdnsInterface {
+        std::string name;                   // Empty for the default interface
+        uint32_t index;                     // Interface index, 0 for the default interface
+        int family;                         // AF_INET or AF_INET6
+        std::string address;                // Our address on the interface
+        socket_t socket;
+        
+        // Responder state, guarded by state_mutex_
+        bool response_pending;
+        Clock::time_point respond_at;
+        Clock::time_point last_response;    // Our records were last multicast here
+        std::set<std::string> askers;       // Queriers still waiting for the pending response
+        
+        MdnsInterface() : index(0), family(0), socket(INVALID_SOCKET_VALUE), response_pending(false) {}
+    };
+    
+
     // Core properties
     std::string service_instance_name_;
     uint16_t service_port_;
     std::map<std::string, std::string> txt_records_;
     
     // Network properties
-    socket_t multicast_socket_;
+    std::vector<MdnsInterface> interfaces_;     // Fixed while running
+    std::set<std::string> local_addresses_;
     std::string local_hostname_;
     std::string local_ip_address_;
     
@@ -177,19 +273,22 @@ private:
     std::mutex shutdown_mutex_;
     
     // Discovery state
-    mutable std::mutex services_mutex_;
-    std::map<std::string, MdnsService> discovered_services_;
+    MdnsServiceCache cache_;
     MdnsServiceCallback service_callback_;
     
+    // Responder and duplicate question state
+    std::mutex state_mutex_;
+    Clock::time_point duplicate_query_at_;      // Another host last asked our question with no news for us
+    
     // Timing configuration
     std::chrono::seconds announcement_interval_;
     std::chrono::seconds query_interval_;
     
     // Socket operations
-    bool create_multicast_socket();
-    bool join_multicast_group();
-    bool leave_multicast_group();
-    void close_multicast_socket();
+    static std::vector<MdnsInterface> enumerate_interfaces();
+    bool open_interface_sockets();
+    bool open_interface_socket(MdnsInterface& iface);
+    void close_interface_sockets();
     
     // Message handling threads
     void receiver_loop();
@@ -197,10 +296,15 @@ private:
     void querier_loop();
     
     // Packet processing
-    void handle_received_packet(const std::vector<uint8_t>& packet, const std::string& sender_ip);
-    void process_mdns_message(const DnsMessage& message, const std::string& sender_ip);
-    void process_query(const DnsMessage& query, const std::string& sender_ip);
-    void process_response(const DnsMessage& response, const std::string& sender_ip);
+    void handle_received_packet(const std::vector<uint8_t>& packet, const std::string& sender_ip, size_t iface);
+    void process_mdns_message(const DnsMessage& message, const std::string& sender_ip, size_t iface);
+    void process_query(const DnsMessage& query, const std::string& sender_ip, size_t iface);
+    void process_response(const DnsMessage& response, const std::string& sender_ip, size_t iface);
+    
+    // Send responses whose delay has passed; returns when the next one is due
+    Clock::time_point send_pending_responses();
+    bool send_query();
+    void send_announcement(uint32_t ttl);
     
     // Service processing
     void extract_service_from_response(const DnsMessage& response, const std::string& sender_ip);
@@ -208,35 +312,33 @@ private:
     void add_or_update_service(const MdnsService& service);
     
     // Message creation
-    DnsMessage create_query_message();
-    DnsMessage create_announcement_message();
-    DnsMessage create_response_message(const DnsQuestion& question);
+    std::vector<DnsResourceRecord> create_known_answers();
+    DnsMessage create_announcement_message(const MdnsInterface& iface, uint32_t ttl = MDNS_RECORD_TTL);
     
     // DNS record creation
-    DnsResourceRecord create_ptr_record(const std::string& service_type, const std::string& instance_name, uint32_t ttl = 120);
-    DnsResourceRecord create_srv_record(const std::string& instance_name, const std::string& hostname, uint16_t port, uint32_t ttl = 120);
-    DnsResourceRecord create_txt_record(const std::string& instance_name, const std::map<std::string, std::string>& txt_data, uint32_t ttl = 120);
-    DnsResourceRecord create_a_record(const std::string& hostname, const std::string& ip_address, uint32_t ttl = 120);
-    
-    // DNS serialization/deserialization
-    std::vector<uint8_t> serialize_dns_message(const DnsMessage& message);
-    bool deserialize_dns_message(const std::vector<uint8_t>& data, DnsMessage& message);
-    
-    // DNS name compression helpers
-    void write_dns_name(std::vector<uint8_t>& buffer, const std::string& name);
-    std::string read_dns_name(const std::vector<uint8_t>& buffer, size_t& offset);
-    void write_uint16(std::vector<uint8_t>& buffer, uint16_t value);
-    void write_uint32(std::vector<uint8_t>& buffer, uint32_t value);
-    uint16_t read_uint16(const std::vector<uint8_t>& buffer, size_t& offset);
-    uint32_t read_uint32(const std::vector<uint8_t>& buffer, size_t& offset);
+    static DnsResourceRecord create_ptr_record(const std::string& service_type, const std::string& instance_name, uint32_t ttl = MDNS_RECORD_TTL);
+    static DnsResourceRecord create_srv_record(const std::string& instance_name, const std::string& hostname, uint16_t port, uint32_t ttl = MDNS_RECORD_TTL);
+    static DnsResourceRecord create_txt_record(const std::string& instance_name, const std::map<std::string, std::string>& txt_data, uint32_t ttl = MDNS_RECORD_TTL);
+    static DnsResourceRecord create_a_record(const std::string& hostname, const std::string& ip_address, uint32_t ttl = MDNS_RECORD_TTL);
+    static DnsResourceRecord create_aaaa_record(const std::string& hostname, const std::string& ip_address, uint32_t ttl = MDNS_RECORD_TTL);
+    
+    // DNS name helpers; names written with a compression table point back at earlier suffixes
+    static void write_dns_name(std::vector<uint8_t>& buffer, const std::string& name,
+                               std::unordered_map<std::string, uint16_t>* compression = nullptr);
+    static size_t dns_name_wire_size(const std::string& name);
+    static std::string read_dns_name(const std::vector<uint8_t>& buffer, size_t& offset);
+    static void write_uint16(std::vector<uint8_t>& buffer, uint16_t value);
+    static void write_uint32(std::vector<uint8_t>& buffer, uint32_t value);
+    static uint16_t read_uint16(const std::vector<uint8_t>& buffer, size_t& offset);
+    static uint32_t read_uint32(const std::vector<uint8_t>& buffer, size_t& offset);
     
     // TXT record helpers
-    std::vector<uint8_t> encode_txt_record(const std::map<std::string, std::string>& txt_data);
-    std::map<std::string, std::string> decode_txt_record(const std::vector<uint8_t>& txt_data);
+    static std::vector<uint8_t> encode_txt_record(const std::map<std::string, std::string>& txt_data);
+    static std::map<std::string, std::string> decode_txt_record(const std::vector<uint8_t>& txt_data);
     
     // SRV record helpers
-    std::vector<uint8_t> encode_srv_record(uint16_t priority, uint16_t weight, uint16_t port, const std::string& target);
-    bool decode_srv_record(const std::vector<uint8_t>& srv_data, uint16_t& priority, uint16_t& weight, uint16_t& port, std::string& target);
+    static std::vector<uint8_t> encode_srv_record(uint16_t priority, uint16_t weight, uint16_t port, const std::string& target);
+    static bool decode_srv_record(const std::vector<uint8_t>& srv_data, uint16_t& priority, uint16_t& weight, uint16_t& port, std::string& target);
     
     // Utility functions
     std::string get_local_hostname();
@@ -244,10 +346,11 @@ private:
     std::string create_service_instance_name(const std::string& instance_name);
     std::string extract_instance_name_from_service(const std::string& service_name);
     bool send_multicast_packet(const std::vector<uint8_t>& packet);
+    bool send_on_interface(const MdnsInterface& iface, const std::vector<uint8_t>& packet);
     
     // Name validation
     bool is_valid_dns_name(const std::string& name) const;
-    std::string normalize_dns_name(const std::string& name) const;
+    static std::string normalize_dns_name(const std::string& name);
 };
 
 } // namespace librats 
\ No newline at end of file
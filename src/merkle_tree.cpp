@@ -0,0 +1,231 @@
+#include "merkle_tree.h"
+#include "sha256.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace librats {
+
+namespace {
+
+// Bytes of a leaf read at once while hashing, so large leaves do not need a buffer of their own size
+constexpr size_t MERKLE_READ_WINDOW = 1024 * 1024;
+
+constexpr uint64_t TARGET_MERKLE_LEAVES = 4096;
+
+constexpr uint8_t LEAF_PREFIX = 0x00;
+constexpr uint8_t NODE_PREFIX = 0x01;
+
+} // namespace
+
+uint32_t choose_merkle_leaf_size(uint64_t file_size) {
+    uint32_t leaf_size = MIN_MERKLE_LEAF_SIZE;
+    while (leaf_size < MAX_MERKLE_LEAF_SIZE && file_size > static_cast<uint64_t>(leaf_size) * TARGET_MERKLE_LEAVES) {
+        leaf_size *= 2;
+    }
+    return leaf_size;
+}
+
+size_t MerkleTree::leaf_count_for(uint64_t file_size, uint32_t leaf_size) {
+    // An empty file still has one (empty) leaf
+    return leaf_size == 0 ? 0 : static_cast<size_t>((std::max)((file_size + leaf_size - 1) / leaf_size, static_cast<uint64_t>(1)));
+}
+
+size_t MerkleTree::leaf_length(size_t index) const {
+    uint64_t offset = leaf_offset(index);
+    if (index >= leaves_.size() || offset >= file_size_) {
+        return 0;
+    }
+    return static_cast<size_t>((std::min)(static_cast<uint64_t>(leaf_size_), file_size_ - offset));
+}
+
+MerkleTree::Hash MerkleTree::hash_leaf(const uint8_t* data, size_t size) {
+    SHA256 sha256;
+    sha256.update(&LEAF_PREFIX, 1);
+    sha256.update(data, size);
+    Hash hash;
+    sha256.finalize(hash.data());
+    return hash;
+}
+
+MerkleTree::Hash MerkleTree::compute_root(const std::vector<Hash>& leaves) {
+    if (leaves.empty()) {
+        return Hash{};
+    }
+
+    std::vector<Hash> level = leaves;
+    while (level.size() > 1) {
+        std::vector<Hash> parents;
+        parents.reserve((level.size() + 1) / 2);
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            SHA256 sha256;
+            sha256.update(&NODE_PREFIX, 1);
+            sha256.update(level[i].data(), level[i].size());
+            sha256.update(level[i + 1].data(), level[i + 1].size());
+            Hash parent;
+            sha256.finalize(parent.data());
+            parents.push_back(parent);
+        }
+        if (level.size() % 2 == 1) {
+            parents.push_back(level.back());
+        }
+        level = std::move(parents);
+    }
+    return level.front();
+}
+
+bool MerkleTree::build(FileHandle& file, uint64_t file_size, uint32_t leaf_size, unsigned threads) {
+    if (leaf_size == 0) {
+        return false;
+    }
+    file_size_ = file_size;
+    leaf_size_ = leaf_size;
+    leaves_.assign(leaf_count_for(file_size, leaf_size), Hash{});
+
+    if (threads == 0) {
+        threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = static_cast<unsigned>((std::min)(static_cast<size_t>(threads), leaves_.size()));
+
+    // Each thread hashes a contiguous run of leaves, so reads stay sequential per thread
+    std::atomic<bool> failed(false);
+    auto hash_leaves = [&](size_t first, size_t last) {
+        std::vector<uint8_t> window((std::min)(static_cast<size_t>(leaf_size), MERKLE_READ_WINDOW));
+        for (size_t index = first; index < last && !failed.load(); ++index) {
+            uint64_t offset = leaf_offset(index);
+            size_t length = leaf_length(index);
+            SHA256 sha256;
+            sha256.update(&LEAF_PREFIX, 1);
+            for (size_t done = 0; done < length;) {
+                size_t part = (std::min)(window.size(), length - done);
+                if (!file.read_at(offset + done, window.data(), part)) {
+                    failed = true;
+                    return;
+                }
+                sha256.update(window.data(), part);
+                done += part;
+            }
+            sha256.finalize(leaves_[index].data());
+        }
+    };
+
+    size_t per_thread = (leaves_.size() + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; ++t) {
+        size_t first = t * per_thread;
+        if (first < leaves_.size()) {
+            workers.emplace_back(hash_leaves, first, (std::min)(first + per_thread, leaves_.size()));
+        }
+    }
+    hash_leaves(0, (std::min)(per_thread, leaves_.size()));
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (failed.load()) {
+        leaves_.clear();
+        return false;
+    }
+
+    root_ = compute_root(leaves_);
+    return true;
+}
+
+bool MerkleTree::assign(uint64_t file_size, uint32_t leaf_size, std::vector<Hash> leaves, const Hash& expected_root) {
+    if (leaf_size == 0 || leaves.size() != leaf_count_for(file_size, leaf_size) || compute_root(leaves) != expected_root) {
+        return false;
+    }
+    file_size_ = file_size;
+    leaf_size_ = leaf_size;
+    leaves_ = std::move(leaves);
+    root_ = expected_root;
+    return true;
+}
+
+bool MerkleTree::verify_leaf(size_t index, const uint8_t* data, size_t size) const {
+    return index < leaves_.size() && size == leaf_length(index) && hash_leaf(data, size) == leaves_[index];
+}
+
+std::string MerkleTree::to_hex(const Hash& hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(hash.size() * 2);
+    for (uint8_t byte : hash) {
+        hex.push_back(digits[byte >> 4]);
+        hex.push_back(digits[byte & 0x0f]);
+    }
+    return hex;
+}
+
+bool MerkleTree::from_hex(const std::string& hex, Hash& hash) {
+    if (hex.size() != hash.size() * 2) {
+        return false;
+    }
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < hash.size(); ++i) {
+        int high = nibble(hex[2 * i]);
+        int low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        hash[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+MerkleTreeCache& MerkleTreeCache::getInstance() {
+    static MerkleTreeCache instance;
+    return instance;
+}
+
+std::shared_ptr<const MerkleTree> MerkleTreeCache::get(const std::string& path) {
+    int64_t file_size = get_file_size(path.c_str());
+    if (file_size < 0) {
+        return nullptr;
+    }
+    uint64_t modified = get_file_modified_time(path.c_str());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && it->second.file_size == static_cast<uint64_t>(file_size) &&
+            it->second.modified == modified) {
+            it->second.last_used = ++clock_;
+            return it->second.tree;
+        }
+    }
+
+    // Build outside the lock; two threads missing on the same file both build it
+    FileHandle file;
+    auto tree = std::make_shared<MerkleTree>();
+    if (!file.open(path.c_str(), FileOpenMode::READ_ONLY) ||
+        !tree->build(file, static_cast<uint64_t>(file_size), choose_merkle_leaf_size(static_cast<uint64_t>(file_size)))) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= MAX_ENTRIES && entries_.find(path) == entries_.end()) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+            return a.second.last_used < b.second.last_used;
+        });
+        entries_.erase(oldest);
+    }
+    entries_[path] = Entry{static_cast<uint64_t>(file_size), modified, ++clock_, tree};
+    return tree;
+}
+
+void MerkleTreeCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+size_t MerkleTreeCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+} // namespace librats
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "fs.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace librats {
+
+/**
+ * Merkle tree over the contents of a file.
+ *
+ * The file is split into leaves of a power-of-two size; each leaf is hashed with
+ * SHA-256 and pairs of hashes are hashed again up to a single root. Leaf and inner
+ * hashes are domain-separated (prefix 0x00 and 0x01), and an odd hash at the end
+ * of a level moves up unchanged. A receiver that trusts the root and holds the
+ * leaf layer can verify any leaf on its own, in any order and from any source.
+ */
+
+constexpr uint32_t MIN_MERKLE_LEAF_SIZE = 64 * 1024;
+constexpr uint32_t MAX_MERKLE_LEAF_SIZE = 16 * 1024 * 1024;
+
+// Leaf size for a file: the smallest power of two that keeps the leaf layer
+// at about 4096 hashes, so it fits into one control message
+uint32_t choose_merkle_leaf_size(uint64_t file_size);
+
+class MerkleTree {
+public:
+    using Hash = std::array<uint8_t, 32>;
+
+    MerkleTree() : file_size_(0), leaf_size_(MIN_MERKLE_LEAF_SIZE) {}
+
+    /**
+     * Hash every leaf of file
+     * @param threads Threads reading and hashing leaves in parallel, 0 for one per core
+     * @return false if the file could not be read
+     */
+    bool build(FileHandle& file, uint64_t file_size, uint32_t leaf_size, unsigned threads = 0);
+
+    /**
+     * Take a leaf layer received from a peer
+     * @return false if the layer does not fit the file size or does not hash to expected_root
+     */
+    bool assign(uint64_t file_size, uint32_t leaf_size, std::vector<Hash> leaves, const Hash& expected_root);
+
+    const Hash& root() const { return root_; }
+    uint64_t file_size() const { return file_size_; }
+    uint32_t leaf_size() const { return leaf_size_; }
+    size_t leaf_count() const { return leaves_.size(); }
+    const std::vector<Hash>& leaves() const { return leaves_; }
+
+    // Byte range of a leaf
+    uint64_t leaf_offset(size_t index) const { return static_cast<uint64_t>(index) * leaf_size_; }
+    size_t leaf_length(size_t index) const;
+
+    // Whether data is the content of leaf index
+    bool verify_leaf(size_t index, const uint8_t* data, size_t size) const;
+
+    static size_t leaf_count_for(uint64_t file_size, uint32_t leaf_size);
+    static Hash hash_leaf(const uint8_t* data, size_t size);
+    static Hash compute_root(const std::vector<Hash>& leaves);
+
+    static std::string to_hex(const Hash& hash);
+    static bool from_hex(const std::string& hex, Hash& hash);
+
+private:
+    uint64_t file_size_;
+    uint32_t leaf_size_;
+    std::vector<Hash> leaves_;
+    Hash root_{};
+};
+
+/**
+ * Process-wide cache of file trees, so a file sent again is not hashed again.
+ * An entry is rebuilt when the file's size or modification time changes; a change
+ * that keeps both makes the receiver reject the transfer rather than accept stale data.
+ */
+class MerkleTreeCache {
+public:
+    static MerkleTreeCache& getInstance();
+
+    // Tree of the file at path, built in parallel on a miss; nullptr if the file cannot be read
+    std::shared_ptr<const MerkleTree> get(const std::string& path);
+
+    void clear();
+    size_t size() const;
+
+private:
+    MerkleTreeCache() : clock_(0) {}
+
+    struct Entry {
+        uint64_t file_size;
+        uint64_t modified;
+        uint64_t last_used;
+        std::shared_ptr<const MerkleTree> tree;
+    };
+
+    static constexpr size_t MAX_ENTRIES = 256;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    uint64_t clock_;
+};
+
+} // namespace librats
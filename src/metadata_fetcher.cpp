@@ -0,0 +1,596 @@
+#include "metadata_fetcher.h"
+#include "sha1.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#define LOG_META_DEBUG(message) LOG_DEBUG("metadata", message)
+#define LOG_META_INFO(message)  LOG_INFO("metadata", message)
+#define LOG_META_WARN(message)  LOG_WARN("metadata", message)
+#define LOG_META_ERROR(message) LOG_ERROR("metadata", message)
+
+namespace librats {
+
+namespace {
+
+constexpr size_t METADATA_READ_SIZE = 32 * 1024;
+
+uint32_t read_uint32_be(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+bool get_integer(const BencodeValue& dict, const std::string& key, int64_t& value) {
+    if (!dict.has_key(key) || !dict[key].is_integer()) {
+        return false;
+    }
+    value = dict[key].as_integer();
+    return true;
+}
+
+} // anonymous namespace
+
+MetadataFetcher::MetadataFetcher(const InfoHash& info_hash, std::shared_ptr<IoReactor> reactor, CompletionCallback callback)
+    : info_hash_(info_hash), reactor_(std::move(reactor)), callback_(std::move(callback)),
+      started_at_(std::chrono::steady_clock::now()), next_connection_id_(1),
+      metadata_size_(0), pieces_received_(0), finished_(false), succeeded_(false) {
+}
+
+MetadataFetcher::~MetadataFetcher() {
+    // Only sockets of a stopped reactor can be left, their handlers held us alive otherwise
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    auto connections = connections_;
+    for (const auto& connection : connections) {
+        close_connection_locked(*connection);
+    }
+}
+
+void MetadataFetcher::add_peers(const std::vector<Peer>& peers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_) {
+        return;
+    }
+
+    for (const auto& peer : peers) {
+        if (known_peers_.insert(peer.ip + ":" + std::to_string(peer.port)).second) {
+            candidates_.push_back(peer);
+        }
+    }
+    connect_candidates_locked();
+}
+
+void MetadataFetcher::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_ = nullptr;
+    if (!finished_) {
+        finish_locked(false);
+    }
+}
+
+void MetadataFetcher::on_tick(std::chrono::steady_clock::time_point now) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+
+        if (now - started_at_ > std::chrono::milliseconds(METADATA_FETCH_TIMEOUT_MS)) {
+            LOG_META_WARN("Metadata fetch for " << info_hash_to_hex(info_hash_) << " timed out");
+            finish_locked(false);
+        } else {
+            // Peers that never got as far as the extended handshake, or sit on a request
+            auto timeout = std::chrono::milliseconds(METADATA_REQUEST_TIMEOUT_MS);
+            auto connections = connections_;
+            for (const auto& connection : connections) {
+                bool stalled = connection->ut_metadata_id == 0 && now - connection->started_at > timeout;
+                for (const auto& request : connection->requests) {
+                    stalled = stalled || now - request.second > timeout;
+                }
+                if (stalled) {
+                    LOG_META_DEBUG("Dropping stalled metadata peer " << connection->peer.ip << ":" << connection->peer.port);
+                    close_connection_locked(*connection);
+                }
+            }
+            connect_candidates_locked();
+        }
+    }
+    deliver_result();
+}
+
+bool MetadataFetcher::is_finished() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_;
+}
+
+size_t MetadataFetcher::get_connection_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_.size();
+}
+
+size_t MetadataFetcher::get_metadata_size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metadata_size_;
+}
+
+size_t MetadataFetcher::get_pieces_received() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pieces_received_;
+}
+
+void MetadataFetcher::connect_candidates_locked() {
+    while (!finished_ && connections_.size() < MAX_METADATA_PEERS && !candidates_.empty()) {
+        Peer peer = candidates_.front();
+        candidates_.pop_front();
+
+        socket_t socket = start_tcp_connect(peer.ip, peer.port);
+        if (!is_valid_socket(socket)) {
+            LOG_META_DEBUG("Failed to connect to metadata peer " << peer.ip << ":" << peer.port);
+            continue;
+        }
+
+        auto connection = std::make_shared<Connection>();
+        connection->id = next_connection_id_++;
+        connection->peer = peer;
+        connection->socket = socket;
+        connection->started_at = std::chrono::steady_clock::now();
+
+        // Both handshakes go out as soon as the connect completes
+        PeerID peer_id = generate_peer_id();
+        connection->send_buffer = create_handshake_message(info_hash_, peer_id);
+        auto extensions = BencodeValue::create_dict();
+        extensions["ut_metadata"] = BencodeValue(static_cast<int64_t>(UT_METADATA_ID));
+        auto handshake = BencodeValue::create_dict();
+        handshake["m"] = extensions;
+        handshake["v"] = BencodeValue(std::string("librats"));
+        std::vector<uint8_t> extended = PeerMessage::create_extended(EXTENDED_HANDSHAKE_ID, handshake).serialize();
+        connection->send_buffer.insert(connection->send_buffer.end(), extended.begin(), extended.end());
+
+        std::weak_ptr<MetadataFetcher> weak_self = shared_from_this();
+        connections_.push_back(connection);
+        if (!reactor_->add_socket(socket, [weak_self, connection](socket_t, uint32_t events) {
+                if (auto self = weak_self.lock()) {
+                    self->on_socket_event(connection, events);
+                }
+            }, IO_EVENT_WRITE)) {
+            LOG_META_WARN("Failed to register metadata peer connection");
+            close_connection_locked(*connection);
+            continue;
+        }
+        LOG_META_DEBUG("Connecting to metadata peer " << peer.ip << ":" << peer.port);
+    }
+}
+
+void MetadataFetcher::on_socket_event(const std::shared_ptr<Connection>& connection, uint32_t events) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (connection->closed || finished_) {
+            return;
+        }
+
+        bool ok = true;
+        if (!connection->connected) {
+            ok = on_connect_complete_locked(*connection);
+        } else {
+            if (events & IO_EVENT_WRITE) {
+                ok = flush_locked(*connection);
+            }
+            if (ok && (events & (IO_EVENT_READ | IO_EVENT_ERROR))) {
+                ok = on_readable_locked(*connection);
+            }
+        }
+
+        if (!ok && !connection->closed) {
+            close_connection_locked(*connection);
+            connect_candidates_locked();
+        }
+    }
+    deliver_result();
+}
+
+bool MetadataFetcher::on_connect_complete_locked(Connection& connection) {
+    int error = get_socket_error(connection.socket);
+    if (error != 0) {
+        LOG_META_DEBUG("Failed to connect to metadata peer " << connection.peer.ip << ":" << connection.peer.port
+                       << " (error " << error << ")");
+        return false;
+    }
+    connection.connected = true;
+    return flush_locked(connection);
+}
+
+bool MetadataFetcher::flush_locked(Connection& connection) {
+    while (!connection.send_buffer.empty()) {
+        int sent = send_tcp_nonblocking(connection.socket, connection.send_buffer.data(), connection.send_buffer.size());
+        if (sent < 0) {
+            return false;
+        }
+        if (sent == 0) {
+            break;
+        }
+        connection.send_buffer.erase(connection.send_buffer.begin(), connection.send_buffer.begin() + sent);
+    }
+
+    uint32_t events = IO_EVENT_READ | (connection.send_buffer.empty() ? 0 : IO_EVENT_WRITE);
+    if (events != connection.events) {
+        if (!reactor_->set_socket_events(connection.socket, events)) {
+            return false;
+        }
+        connection.events = events;
+    }
+    return true;
+}
+
+bool MetadataFetcher::on_readable_locked(Connection& connection) {
+    // Level-triggered, so one read per event will do
+    std::vector<uint8_t>& buffer = connection.receive_buffer;
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + METADATA_READ_SIZE);
+    int received = receive_tcp_nonblocking(connection.socket, buffer.data() + old_size, METADATA_READ_SIZE);
+    buffer.resize(old_size + (received > 0 ? static_cast<size_t>(received) : 0));
+    if (received < 0) {
+        LOG_META_DEBUG("Metadata peer " << connection.peer.ip << ":" << connection.peer.port << " closed the connection");
+        return false;
+    }
+
+    size_t position = 0;
+    if (!connection.handshake_received) {
+        if (buffer.size() < HANDSHAKE_SIZE) {
+            return true;
+        }
+        std::vector<uint8_t> handshake(buffer.begin(), buffer.begin() + HANDSHAKE_SIZE);
+        InfoHash info_hash;
+        PeerID peer_id;
+        if (!parse_handshake_message(handshake, info_hash, peer_id) || info_hash != info_hash_) {
+            LOG_META_DEBUG("Bad handshake from metadata peer " << connection.peer.ip << ":" << connection.peer.port);
+            return false;
+        }
+        if (!handshake_supports_extensions(handshake)) {
+            LOG_META_DEBUG("Metadata peer " << connection.peer.ip << ":" << connection.peer.port << " lacks the extension protocol");
+            return false;
+        }
+        connection.handshake_received = true;
+        position = HANDSHAKE_SIZE;
+    }
+
+    while (buffer.size() - position >= 4) {
+        uint32_t length = read_uint32_be(buffer.data() + position);
+        if (length > MAX_METADATA_MESSAGE_SIZE) {
+            return false;
+        }
+        if (buffer.size() - position < 4 + static_cast<size_t>(length)) {
+            break;
+        }
+        if (length > 0 && !handle_message_locked(connection, buffer.data() + position + 4, length)) {
+            return false;
+        }
+        if (connection.closed) {
+            return true;  // Finished, or dropped after a bad hash
+        }
+        position += 4 + static_cast<size_t>(length);
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + position);
+    return true;
+}
+
+bool MetadataFetcher::handle_message_locked(Connection& connection, const uint8_t* message, size_t size) {
+    // Everything but extended messages (bitfields, haves, ...) is of no use here
+    if (static_cast<MessageType>(message[0]) != MessageType::EXTENDED) {
+        return true;
+    }
+    if (size < 3) {
+        return false;
+    }
+
+    BencodeValue dict;
+    size_t consumed = 0;
+    try {
+        dict = BencodeDecoder::decode(message + 2, size - 2, consumed);
+    } catch (const std::exception&) {
+        LOG_META_DEBUG("Invalid extended message from metadata peer " << connection.peer.ip << ":" << connection.peer.port);
+        return false;
+    }
+    if (!dict.is_dict()) {
+        return false;
+    }
+
+    if (message[1] == EXTENDED_HANDSHAKE_ID) {
+        return handle_extended_handshake_locked(connection, dict);
+    }
+    if (message[1] == UT_METADATA_ID) {
+        return handle_metadata_message_locked(connection, dict, message + 2 + consumed, size - 2 - consumed);
+    }
+    return true;
+}
+
+bool MetadataFetcher::handle_extended_handshake_locked(Connection& connection, const BencodeValue& message) {
+    int64_t id = 0;
+    if (!message.has_key("m") || !message["m"].is_dict() || !get_integer(message["m"], "ut_metadata", id) ||
+        id <= 0 || id > 255) {
+        LOG_META_DEBUG("Metadata peer " << connection.peer.ip << ":" << connection.peer.port << " does not serve metadata");
+        return false;
+    }
+
+    int64_t size = 0;
+    if (!get_integer(message, "metadata_size", size) || size <= 0 || static_cast<uint64_t>(size) > MAX_METADATA_SIZE) {
+        LOG_META_DEBUG("Metadata peer " << connection.peer.ip << ":" << connection.peer.port << " reported no usable metadata size");
+        return false;
+    }
+
+    connection.ut_metadata_id = static_cast<uint8_t>(id);
+    connection.metadata_size = static_cast<size_t>(size);
+
+    // The size is voted on once no connected peer backs the current one (at first, or after the
+    // hash check dropped its peers). Peers claiming another size meanwhile are kept in reserve,
+    // so a liar that connected first only costs a failed hash check
+    if (metadata_size_ == 0 || !metadata_size_backed_locked()) {
+        choose_metadata_size_locked();
+        return flush_locked(connection);
+    }
+    if (connection.metadata_size != metadata_size_) {
+        LOG_META_DEBUG("Metadata peer " << connection.peer.ip << ":" << connection.peer.port << " disagrees on the metadata size ("
+                       << connection.metadata_size << " instead of " << metadata_size_ << ")");
+        return true;
+    }
+    request_pieces_locked(connection);
+    return flush_locked(connection);
+}
+
+bool MetadataFetcher::handle_metadata_message_locked(Connection& connection, const BencodeValue& message,
+                                                     const uint8_t* data, size_t size) {
+    int64_t type = 0;
+    int64_t piece = 0;
+    if (!get_integer(message, "msg_type", type) || !get_integer(message, "piece", piece)) {
+        return false;
+    }
+    if (type == 0) {
+        // Asking us for the metadata we are still looking for
+        auto reject = BencodeValue::create_dict();
+        reject["msg_type"] = BencodeValue(static_cast<int64_t>(2));
+        reject["piece"] = BencodeValue(piece);
+        std::vector<uint8_t> data = PeerMessage::create_extended(connection.ut_metadata_id, reject).serialize();
+        connection.send_buffer.insert(connection.send_buffer.end(), data.begin(), data.end());
+        return flush_locked(connection);
+    }
+    if (piece < 0 || static_cast<uint64_t>(piece) >= pieces_.size()) {
+        return false;
+    }
+    uint32_t index = static_cast<uint32_t>(piece);
+
+    auto request = std::find_if(connection.requests.begin(), connection.requests.end(),
+                                [index](const std::pair<uint32_t, std::chrono::steady_clock::time_point>& r) { return r.first == index; });
+    if (request == connection.requests.end()) {
+        return true;  // Not asked for, we may have given up on it already
+    }
+
+    if (type != 1) {
+        LOG_META_DEBUG("Metadata peer " << connection.peer.ip << ":" << connection.peer.port << " rejected piece " << index);
+        return false;
+    }
+
+    int64_t total_size = 0;
+    size_t offset = static_cast<size_t>(index) * METADATA_PIECE_SIZE;
+    size_t expected = (std::min)(METADATA_PIECE_SIZE, metadata_size_ - offset);
+    if (!get_integer(message, "total_size", total_size) || static_cast<uint64_t>(total_size) != metadata_size_ || size != expected) {
+        LOG_META_DEBUG("Malformed metadata piece " << index << " from " << connection.peer.ip << ":" << connection.peer.port);
+        return false;
+    }
+
+    connection.requests.erase(request);
+    if (pieces_[index] != PieceState::RECEIVED) {
+        std::memcpy(metadata_.data() + offset, data, size);
+        pieces_[index] = PieceState::RECEIVED;
+        piece_sources_[index] = connection.id;
+        ++pieces_received_;
+        if (pieces_received_ == pieces_.size()) {
+            check_metadata_locked();
+            if (finished_ || connection.closed) {
+                return true;
+            }
+        }
+    }
+
+    request_pieces_locked(connection);
+    return flush_locked(connection);
+}
+
+void MetadataFetcher::request_pieces_locked(Connection& connection) {
+    if (connection.ut_metadata_id == 0 || connection.metadata_size != metadata_size_ || pieces_.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    while (connection.requests.size() < METADATA_REQUESTS_PER_PEER) {
+        auto requested_here = [&connection](uint32_t index) {
+            return std::any_of(connection.requests.begin(), connection.requests.end(),
+                               [index](const std::pair<uint32_t, std::chrono::steady_clock::time_point>& r) { return r.first == index; });
+        };
+
+        // Missing pieces first; then pieces in flight elsewhere, so one slow peer does not hold up the end
+        uint32_t chosen = static_cast<uint32_t>(pieces_.size());
+        for (uint32_t i = 0; i < pieces_.size() && chosen == pieces_.size(); ++i) {
+            if (pieces_[i] == PieceState::MISSING) {
+                chosen = i;
+            }
+        }
+        for (uint32_t i = 0; i < pieces_.size() && chosen == pieces_.size(); ++i) {
+            if (pieces_[i] == PieceState::REQUESTED && !requested_here(i)) {
+                chosen = i;
+            }
+        }
+        if (chosen == pieces_.size()) {
+            break;
+        }
+
+        pieces_[chosen] = PieceState::REQUESTED;
+        connection.requests.emplace_back(chosen, now);
+
+        auto request = BencodeValue::create_dict();
+        request["msg_type"] = BencodeValue(static_cast<int64_t>(0));
+        request["piece"] = BencodeValue(static_cast<int64_t>(chosen));
+        std::vector<uint8_t> data = PeerMessage::create_extended(connection.ut_metadata_id, request).serialize();
+        connection.send_buffer.insert(connection.send_buffer.end(), data.begin(), data.end());
+    }
+}
+
+void MetadataFetcher::close_connection_locked(Connection& connection) {
+    if (connection.closed) {
+        return;
+    }
+    connection.closed = true;
+    reactor_->remove_socket(connection.socket);
+    close_socket(connection.socket);
+
+    connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+                                      [&connection](const std::shared_ptr<Connection>& c) { return c.get() == &connection; }),
+                       connections_.end());
+
+    // Pieces nobody else is fetching go back to the pool, for the peers still connected
+    for (const auto& request : connection.requests) {
+        uint32_t index = request.first;
+        if (index >= pieces_.size() || pieces_[index] != PieceState::REQUESTED) {
+            continue;
+        }
+        bool elsewhere = std::any_of(connections_.begin(), connections_.end(), [index](const std::shared_ptr<Connection>& c) {
+            return std::any_of(c->requests.begin(), c->requests.end(),
+                               [index](const std::pair<uint32_t, std::chrono::steady_clock::time_point>& r) { return r.first == index; });
+        });
+        if (!elsewhere) {
+            pieces_[index] = PieceState::MISSING;
+        }
+    }
+    connection.requests.clear();
+
+    if (finished_) {
+        return;
+    }
+    // The last peer backing the size is gone; the peers held in reserve decide it again
+    bool reserve = std::any_of(connections_.begin(), connections_.end(), [this](const std::shared_ptr<Connection>& c) {
+        return c->ut_metadata_id != 0 && c->metadata_size != metadata_size_;
+    });
+    if (reserve && !metadata_size_backed_locked()) {
+        choose_metadata_size_locked();
+    } else {
+        for (const auto& other : connections_) {
+            if (other->ut_metadata_id != 0) {
+                request_pieces_locked(*other);
+                flush_locked(*other);   // A failure shows up as an error event on that socket
+            }
+        }
+    }
+}
+
+void MetadataFetcher::check_metadata_locked() {
+    uint8_t digest[20];
+    SHA1 sha1;
+    sha1.update(metadata_.data(), metadata_.size());
+    sha1.finalize(digest);
+
+    if (std::equal(digest, digest + 20, info_hash_.begin())) {
+        TorrentInfo torrent_info;
+        if (torrent_info.load_from_metadata(metadata_) && torrent_info.is_valid()) {
+            LOG_META_INFO("Fetched metadata for " << info_hash_to_hex(info_hash_) << " (" << torrent_info.get_name() << ")");
+            result_ = std::move(torrent_info);
+            finish_locked(true);
+        } else {
+            LOG_META_ERROR("Metadata for " << info_hash_to_hex(info_hash_) << " matches its hash but is not a valid torrent");
+            finish_locked(false);
+        }
+        return;
+    }
+
+    // Some piece was wrong; drop every peer that contributed and start over with the rest
+    LOG_META_WARN("Metadata for " << info_hash_to_hex(info_hash_) << " failed the hash check");
+    std::set<uint64_t> sources(piece_sources_.begin(), piece_sources_.end());
+    std::fill(pieces_.begin(), pieces_.end(), PieceState::MISSING);
+    std::fill(piece_sources_.begin(), piece_sources_.end(), 0);
+    pieces_received_ = 0;
+    auto connections = connections_;
+    for (const auto& connection : connections) {
+        if (sources.count(connection->id)) {
+            close_connection_locked(*connection);
+        } else {
+            for (const auto& request : connection->requests) {
+                pieces_[request.first] = PieceState::REQUESTED;
+            }
+        }
+    }
+    for (const auto& connection : connections_) {
+        request_pieces_locked(*connection);
+        flush_locked(*connection);
+    }
+    connect_candidates_locked();
+}
+
+bool MetadataFetcher::metadata_size_backed_locked() const {
+    return std::any_of(connections_.begin(), connections_.end(), [this](const std::shared_ptr<Connection>& c) {
+        return c->ut_metadata_id != 0 && c->metadata_size == metadata_size_;
+    });
+}
+
+void MetadataFetcher::choose_metadata_size_locked() {
+    // The size most connected peers claim; on a tie the one counted first
+    std::map<size_t, size_t> votes;
+    size_t chosen = 0;
+    size_t best = 0;
+    for (const auto& connection : connections_) {
+        if (connection->ut_metadata_id == 0) {
+            continue;
+        }
+        size_t count = ++votes[connection->metadata_size];
+        if (count > best) {
+            best = count;
+            chosen = connection->metadata_size;
+        }
+    }
+
+    // Pieces of another size are useless, and so are the requests for them
+    metadata_size_ = chosen;
+    size_t num_pieces = (metadata_size_ + METADATA_PIECE_SIZE - 1) / METADATA_PIECE_SIZE;
+    metadata_.assign(metadata_size_, 0);
+    pieces_.assign(num_pieces, PieceState::MISSING);
+    piece_sources_.assign(num_pieces, 0);
+    pieces_received_ = 0;
+    for (const auto& connection : connections_) {
+        connection->requests.clear();
+    }
+    if (metadata_size_ == 0) {
+        return;
+    }
+
+    LOG_META_DEBUG("Metadata of " << info_hash_to_hex(info_hash_) << " is " << metadata_size_ << " bytes in "
+                   << num_pieces << " pieces, as claimed by " << best << " peers");
+    for (const auto& connection : connections_) {
+        request_pieces_locked(*connection);
+        flush_locked(*connection);   // A failure shows up as an error event on that socket
+    }
+}
+
+void MetadataFetcher::finish_locked(bool success) {
+    finished_ = true;
+    succeeded_ = success;
+    candidates_.clear();
+    auto connections = connections_;
+    for (const auto& connection : connections) {
+        close_connection_locked(*connection);
+    }
+}
+
+void MetadataFetcher::deliver_result() {
+    CompletionCallback callback;
+    TorrentInfo torrent_info;
+    bool success = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!finished_ || !callback_) {
+            return;
+        }
+        callback = std::move(callback_);
+        callback_ = nullptr;
+        torrent_info = result_;
+        success = succeeded_;
+    }
+    callback(torrent_info, success);
+}
+
+} // namespace librats
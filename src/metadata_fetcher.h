@@ -0,0 +1,115 @@
+#pragma once
+
+#include "bittorrent.h"
+#include "reactor.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace librats {
+
+constexpr size_t MAX_METADATA_PEERS = 8;                // Connections a fetch keeps open at once
+constexpr size_t METADATA_REQUESTS_PER_PEER = 3;        // Pieces requested from one peer at a time
+constexpr size_t METADATA_REQUEST_TIMEOUT_MS = 15000;   // A peer this slow is dropped and its pieces asked elsewhere
+constexpr size_t METADATA_FETCH_TIMEOUT_MS = 120000;
+constexpr size_t MAX_METADATA_MESSAGE_SIZE = MAX_PEER_MESSAGE_SIZE;
+
+// Downloads the info dictionary of a torrent known only by its info hash, with
+// ut_metadata (BEP 9) over the extension protocol (BEP 10). Up to
+// MAX_METADATA_PEERS connections run on the reactor at once, each with a few
+// 16 KiB pieces requested, so a large dictionary arrives from several peers in
+// parallel; once every piece is in flight, idle peers duplicate the requests
+// still outstanding. The assembled bytes must hash to the info hash, otherwise
+// the peers that sent them are dropped and the pieces fetched again.
+//
+// The completion callback runs once, on a reactor thread, unless cancel() was
+// called first. on_tick() has to be called periodically for the timeouts.
+class MetadataFetcher : public std::enable_shared_from_this<MetadataFetcher> {
+public:
+    using CompletionCallback = std::function<void(const TorrentInfo& torrent_info, bool success)>;
+
+    MetadataFetcher(const InfoHash& info_hash, std::shared_ptr<IoReactor> reactor, CompletionCallback callback);
+    ~MetadataFetcher();
+
+    MetadataFetcher(const MetadataFetcher&) = delete;
+    MetadataFetcher& operator=(const MetadataFetcher&) = delete;
+
+    // Peers to try; ones seen before are skipped, the rest connect as slots free up
+    void add_peers(const std::vector<Peer>& peers);
+
+    void cancel();
+    void on_tick(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    const InfoHash& get_info_hash() const { return info_hash_; }
+    bool is_finished() const;
+    size_t get_connection_count() const;
+    size_t get_metadata_size() const;        // 0 until a peer reported it
+    size_t get_pieces_received() const;
+
+private:
+    enum class PieceState : uint8_t {
+        MISSING,
+        REQUESTED,
+        RECEIVED
+    };
+
+    struct Connection {
+        uint64_t id = 0;
+        Peer peer;
+        socket_t socket = INVALID_SOCKET_VALUE;
+        bool connected = false;          // TCP connect completed, our handshakes sent
+        bool handshake_received = false;
+        bool closed = false;             // Removed from the reactor; a handler still running ignores it
+        uint32_t events = IO_EVENT_WRITE;  // Interest set registered with the reactor
+        uint8_t ut_metadata_id = 0;      // Peer's id for ut_metadata, 0 until its extended handshake
+        size_t metadata_size = 0;        // Size claimed in its extended handshake; only peers agreeing with metadata_size_ are asked
+        std::vector<uint8_t> receive_buffer;
+        std::vector<uint8_t> send_buffer;
+        std::vector<std::pair<uint32_t, std::chrono::steady_clock::time_point>> requests;  // Pieces in flight
+        std::chrono::steady_clock::time_point started_at;
+    };
+
+    InfoHash info_hash_;
+    std::shared_ptr<IoReactor> reactor_;
+    CompletionCallback callback_;
+    std::chrono::steady_clock::time_point started_at_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<Connection>> connections_;
+    std::deque<Peer> candidates_;
+    std::set<std::string> known_peers_;      // ip:port of every peer added
+    uint64_t next_connection_id_;
+
+    size_t metadata_size_;                   // Size claimed by most connected peers, 0 while none has claimed one
+    std::vector<uint8_t> metadata_;
+    std::vector<PieceState> pieces_;
+    std::vector<uint64_t> piece_sources_;    // Connection id that sent each received piece
+    size_t pieces_received_;
+
+    bool finished_;
+    bool succeeded_;
+    TorrentInfo result_;
+
+    void connect_candidates_locked();
+    void on_socket_event(const std::shared_ptr<Connection>& connection, uint32_t events);
+    bool on_connect_complete_locked(Connection& connection);
+    bool on_readable_locked(Connection& connection);
+    bool handle_message_locked(Connection& connection, const uint8_t* message, size_t size);
+    bool handle_extended_handshake_locked(Connection& connection, const BencodeValue& message);
+    bool handle_metadata_message_locked(Connection& connection, const BencodeValue& message, const uint8_t* data, size_t size);
+    void request_pieces_locked(Connection& connection);
+    bool flush_locked(Connection& connection);
+    void close_connection_locked(Connection& connection);
+    void check_metadata_locked();
+    bool metadata_size_backed_locked() const;
+    void choose_metadata_size_locked();
+    void finish_locked(bool success);
+    void deliver_result();
+};
+
+} // namespace librats
@@ -0,0 +1,219 @@
+#include "metrics.h"
+#include "logger.h"
+#include <algorithm>
+#include <sstream>
+
+// Metrics module logging macros
+#define LOG_METRICS_DEBUG(message) LOG_DEBUG("metrics", message)
+#define LOG_METRICS_INFO(message)  LOG_INFO("metrics", message)
+#define LOG_METRICS_WARN(message)  LOG_WARN("metrics", message)
+#define LOG_METRICS_ERROR(message) LOG_ERROR("metrics", message)
+
+namespace librats {
+
+namespace {
+
+// Exported histogram bounds: powers of two from 1us to 2^26us (~67s)
+constexpr int EXPORT_BUCKET_MAX_EXPONENT = 26;
+
+std::atomic<size_t> next_metric_shard{0};
+
+int highest_bit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        bit++;
+    }
+    return bit;
+}
+
+std::string join_labels(const std::string& labels, const std::string& extra) {
+    if (labels.empty()) {
+        return "{" + extra + "}";
+    }
+    return "{" + labels + "," + extra + "}";
+}
+
+std::string format_labels(const std::string& labels) {
+    return labels.empty() ? "" : "{" + labels + "}";
+}
+
+} // anonymous namespace
+
+size_t metric_shard_index() {
+    thread_local size_t shard = next_metric_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARD_COUNT;
+    return shard;
+}
+
+//=============================================================================
+// MetricCounter
+//=============================================================================
+
+uint64_t MetricCounter::value() const {
+    uint64_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+//=============================================================================
+// MetricHistogram
+//=============================================================================
+
+MetricHistogram::MetricHistogram() : count_(0), sum_(0) {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t MetricHistogram::bucket_index(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = highest_bit(value);
+    size_t sub_bucket = static_cast<size_t>((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1));
+    return static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t MetricHistogram::bucket_lower_bound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    int exponent = static_cast<int>(index / SUB_BUCKET_COUNT) + SUB_BUCKET_BITS - 1;
+    uint64_t sub_bucket = index % SUB_BUCKET_COUNT;
+    return (SUB_BUCKET_COUNT + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+}
+
+void MetricHistogram::record(uint64_t microseconds) {
+    buckets_[bucket_index(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(microseconds, std::memory_order_relaxed);
+}
+
+uint64_t MetricHistogram::percentile(double percentile) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    double clamped = percentile < 0.0 ? 0.0 : (percentile > 100.0 ? 100.0 : percentile);
+    uint64_t rank = static_cast<uint64_t>(clamped / 100.0 * static_cast<double>(total));
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return i + 1 < BUCKET_COUNT ? bucket_lower_bound(i + 1) - 1 : UINT64_MAX;
+        }
+    }
+    // Buckets and count are updated separately; a concurrent record may not be visible yet
+    return bucket_lower_bound(BUCKET_COUNT - 1);
+}
+
+uint64_t MetricHistogram::count_below(uint64_t microseconds) const {
+    uint64_t total = 0;
+    size_t end = bucket_index(microseconds);
+    for (size_t i = 0; i < end; ++i) {
+        total += buckets_[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+//=============================================================================
+// MetricsRegistry
+//=============================================================================
+
+MetricsRegistry::Family& MetricsRegistry::get_family_locked(const std::string& name, const std::string& help,
+                                                           MetricType type) {
+    auto it = families_.find(name);
+    if (it == families_.end()) {
+        Family family;
+        family.type = type;
+        family.help = help;
+        it = families_.emplace(name, std::move(family)).first;
+    } else if (it->second.type != type) {
+        LOG_METRICS_ERROR("Metric " << name << " is registered with another type");
+    }
+    return it->second;
+}
+
+MetricCounter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = get_family_locked(name, help, MetricType::COUNTER).counters[labels];
+    if (!slot) {
+        slot = std::make_unique<MetricCounter>();
+    }
+    return *slot;
+}
+
+MetricGauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = get_family_locked(name, help, MetricType::GAUGE).gauges[labels];
+    if (!slot) {
+        slot = std::make_unique<MetricGauge>();
+    }
+    return *slot;
+}
+
+MetricHistogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = get_family_locked(name, help, MetricType::HISTOGRAM).histograms[labels];
+    if (!slot) {
+        slot = std::make_unique<MetricHistogram>();
+    }
+    return *slot;
+}
+
+std::string MetricsRegistry::export_prometheus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+
+    for (const auto& entry : families_) {
+        const std::string& name = entry.first;
+        const Family& family = entry.second;
+
+        out << "# HELP " << name << " " << family.help << "\n";
+        switch (family.type) {
+            case MetricType::COUNTER:
+                out << "# TYPE " << name << " counter\n";
+                for (const auto& metric : family.counters) {
+                    out << name << format_labels(metric.first) << " " << metric.second->value() << "\n";
+                }
+                break;
+
+            case MetricType::GAUGE:
+                out << "# TYPE " << name << " gauge\n";
+                for (const auto& metric : family.gauges) {
+                    out << name << format_labels(metric.first) << " " << metric.second->value() << "\n";
+                }
+                break;
+
+            case MetricType::HISTOGRAM:
+                out << "# TYPE " << name << " histogram\n";
+                for (const auto& metric : family.histograms) {
+                    const MetricHistogram& histogram = *metric.second;
+                    // Read the count first so the cumulative buckets never exceed it
+                    uint64_t count = histogram.count();
+                    for (int exponent = 0; exponent <= EXPORT_BUCKET_MAX_EXPONENT; ++exponent) {
+                        uint64_t bound = uint64_t(1) << exponent;
+                        uint64_t below = std::min(histogram.count_below(bound), count);
+                        std::ostringstream le;
+                        le << "le=\"" << static_cast<double>(bound) / 1e6 << "\"";
+                        out << name << "_bucket" << join_labels(metric.first, le.str()) << " " << below << "\n";
+                    }
+                    out << name << "_bucket" << join_labels(metric.first, "le=\"+Inf\"") << " " << count << "\n";
+                    out << name << "_sum" << format_labels(metric.first) << " "
+                        << static_cast<double>(histogram.sum()) / 1e6 << "\n";
+                    out << name << "_count" << format_labels(metric.first) << " " << count << "\n";
+                }
+                break;
+        }
+    }
+
+    return out.str();
+}
+
+} // namespace librats
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace librats {
+
+// Number of cache-line sized slots a counter is spread over
+constexpr size_t METRIC_SHARD_COUNT = 16;
+
+/**
+ * Get the counter shard of the calling thread (threads are assigned round robin)
+ * @return Shard index in [0, METRIC_SHARD_COUNT)
+ */
+size_t metric_shard_index();
+
+/**
+ * Monotonic counter. Increments go to the calling thread's shard, so threads
+ * counting the same event do not bounce one cache line between them.
+ */
+class MetricCounter {
+public:
+    MetricCounter() = default;
+    MetricCounter(const MetricCounter&) = delete;
+    MetricCounter& operator=(const MetricCounter&) = delete;
+
+    void add(uint64_t value = 1) {
+        shards_[metric_shard_index()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // Sum over all shards
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Shard, METRIC_SHARD_COUNT> shards_;
+};
+
+/**
+ * Value that goes up and down (queue depth, connected peers)
+ */
+class MetricGauge {
+public:
+    MetricGauge() : value_(0) {}
+    MetricGauge(const MetricGauge&) = delete;
+    MetricGauge& operator=(const MetricGauge&) = delete;
+
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    void sub(int64_t delta) { value_.fetch_sub(delta, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_;
+};
+
+/**
+ * Latency histogram with HDR-style log-linear buckets over microseconds.
+ *
+ * Values below 8us get a bucket each; above that every power of two is split into
+ * 8 sub-buckets, so a bucket's width is at most 1/8 of its lower bound and
+ * percentiles are accurate to 12.5% over the whole 64-bit range. Recording is one
+ * relaxed increment per bucket, count and sum.
+ */
+class MetricHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    MetricHistogram();
+    MetricHistogram(const MetricHistogram&) = delete;
+    MetricHistogram& operator=(const MetricHistogram&) = delete;
+
+    void record(uint64_t microseconds);
+
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> duration) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record(static_cast<uint64_t>(micros > 0 ? micros : 0));
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    /**
+     * Get an upper bound of the given percentile
+     * @param percentile Percentile in [0, 100]
+     * @return Upper bound of the bucket holding the percentile in microseconds (0 if empty)
+     */
+    uint64_t percentile(double percentile) const;
+
+    /**
+     * Get the number of recorded values below a bound
+     * @param microseconds Bound; exact for powers of two
+     * @return Values recorded in buckets that end at or below the bound
+     */
+    uint64_t count_below(uint64_t microseconds) const;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_lower_bound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+};
+
+/**
+ * Records the lifetime of the scope into a histogram
+ */
+class ScopedMetricTimer {
+public:
+    explicit ScopedMetricTimer(MetricHistogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedMetricTimer() { histogram_.record(std::chrono::steady_clock::now() - start_); }
+
+    ScopedMetricTimer(const ScopedMetricTimer&) = delete;
+    ScopedMetricTimer& operator=(const ScopedMetricTimer&) = delete;
+
+private:
+    MetricHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Process-wide registry of named metrics.
+ *
+ * Registration takes a lock and returns a reference that stays valid for the life of
+ * the process, so instrumented code registers once (typically into a function-local
+ * static) and updates the metric without touching the registry again. Names follow
+ * Prometheus conventions; labels are given preformatted, e.g. `type="binary"`.
+ * Histograms record microseconds and are exported in seconds.
+ */
+class MetricsRegistry {
+public:
+    static MetricsRegistry& getInstance() {
+        static MetricsRegistry instance;
+        return instance;
+    }
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    MetricCounter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    MetricGauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    MetricHistogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /**
+     * Render all metrics in the Prometheus text exposition format
+     * @return Exposition text
+     */
+    std::string export_prometheus() const;
+
+private:
+    enum class MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Family {
+        MetricType type;
+        std::string help;
+        std::map<std::string, std::unique_ptr<MetricCounter>> counters;     // By labels
+        std::map<std::string, std::unique_ptr<MetricGauge>> gauges;
+        std::map<std::string, std::unique_ptr<MetricHistogram>> histograms;
+    };
+
+    MetricsRegistry() = default;
+
+    Family& get_family_locked(const std::string& name, const std::string& help, MetricType type);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+} // namespace librats
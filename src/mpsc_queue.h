@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace librats {
+
+// Unbounded lock-free multi-producer single-consumer FIFO (Vyukov's linked
+// list queue). push() is one atomic exchange plus a store, so producers on
+// different cores never wait for each other or for the consumer; pop() is
+// only called by the owning thread.
+//
+// A push is visible to the consumer once it links its node, which is a few
+// instructions after the exchange; a pop() in that window reports the queue
+// as empty and the consumer simply polls again.
+template<typename T>
+class MpscQueue {
+public:
+    MpscQueue() {
+        Node* stub = new Node();
+        head_.store(stub, std::memory_order_relaxed);
+        tail_ = stub;
+    }
+
+    ~MpscQueue() {
+        T discarded;
+        while (pop(discarded)) {
+        }
+        delete tail_;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_seq_cst);
+    }
+
+    // Consumer thread only
+    bool pop(T& value) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        next->value = T();
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+    // Consumer thread only; pairs with the seq_cst link in push() for sleep/wake handshakes
+    bool empty() const {
+        return tail_->next.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+
+        Node() = default;
+        explicit Node(T v) : value(std::move(v)) {}
+    };
+
+    alignas(64) std::atomic<Node*> head_;  // Producers
+    alignas(64) Node* tail_;               // Consumer; the node before the first element
+};
+
+} // namespace librats
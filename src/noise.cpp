@@ -1,10 +1,13 @@
 #include "noise.h"
+#include "sha256.h"
 #include "logger.h"
 #include <cstring>
 #include <random>
 #include <iomanip>
 #include <sstream>
 #include <stdexcept>
+#include <atomic>
+#include <algorithm>
 
 // Include platform-specific headers for cryptographic operations
 #ifdef _WIN32
@@ -19,6 +22,29 @@
 #endif
 #endif
 
+// SIMD kernels for ChaCha20 (selected at runtime)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define RATS_NOISE_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)) && \
+    (defined(_M_ARM64) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__))
+    #define RATS_NOISE_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#if defined(RATS_NOISE_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define RATS_TARGET_SSE2 __attribute__((target("sse2")))
+    #define RATS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define RATS_TARGET_SSE2
+    #define RATS_TARGET_AVX2
+#endif
+
 #define LOG_NOISE_DEBUG(message) LOG_DEBUG("noise", message)
 #define LOG_NOISE_INFO(message)  LOG_INFO("noise", message)
 #define LOG_NOISE_WARN(message)  LOG_WARN("noise", message)
@@ -28,16 +54,68 @@ namespace librats {
 
 // Noise Protocol constants
 constexpr char NOISE_PROTOCOL_NAME[] = "Noise_XX_25519_ChaChaPoly_SHA256";
+constexpr char NOISE_IK_PROTOCOL_NAME[] = "Noise_IK_25519_ChaChaPoly_SHA256";
+constexpr char NOISE_NNPSK0_PROTOCOL_NAME[] = "Noise_NNpsk0_25519_ChaChaPoly_SHA256";
+constexpr char NOISE_XX_FALLBACK_PROTOCOL_NAME[] = "Noise_XXfallback_25519_ChaChaPoly_SHA256";
+
+// First byte of IK / NNpsk0 first messages (an XX first message is the bare ephemeral key)
+constexpr uint8_t NOISE_PATTERN_MARKER_IK = 0x01;
+constexpr uint8_t NOISE_PATTERN_MARKER_NNPSK0 = 0x02;
+
+// First byte of the response to an IK / NNpsk0 first message
+constexpr uint8_t NOISE_REPLY_ACCEPTED = 0x00;
+constexpr uint8_t NOISE_REPLY_FALLBACK = 0x01;
 
-// Simple implementation of cryptographic primitives
-// NOTE: This is a basic implementation for demonstration purposes.
-// In production, you should use a well-tested cryptographic library like libsodium.
+// HKDF input separating ticket derivation from split()
+constexpr char NOISE_TICKET_LABEL[] = "librats session ticket";
 
 namespace {
 
-// Simple ChaCha20 implementation
+uint32_t load32_le(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void store32_le(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v);
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+uint64_t load64_le(const uint8_t* p) {
+    return (uint64_t)load32_le(p) | ((uint64_t)load32_le(p + 4) << 32);
+}
+
+void store64_le(uint8_t* p, uint64_t v) {
+    store32_le(p, (uint32_t)v);
+    store32_le(p + 4, (uint32_t)(v >> 32));
+}
+
+//=============================================================================
+// ChaCha20 (RFC 8439)
+//=============================================================================
+
+// XORs `blocks` whole 64-byte keystream blocks into data and advances the block counter (state[12])
+using ChaCha20BlocksFn = void (*)(uint32_t state[16], uint8_t* data, size_t blocks);
+
 class ChaCha20 {
 public:
+    static void init_state(uint32_t state[16], const NoiseKey& key, uint64_t nonce) {
+        // "expand 32-byte k"
+        state[0] = 0x61707865;
+        state[1] = 0x3320646e;
+        state[2] = 0x79622d32;
+        state[3] = 0x6b206574;
+        for (int i = 0; i < 8; ++i) {
+            state[4 + i] = load32_le(key.data() + i * 4);
+        }
+        // Noise nonce layout: 32 bits of zeros followed by the little-endian 64-bit counter
+        state[12] = 0;
+        state[13] = 0;
+        state[14] = (uint32_t)nonce;
+        state[15] = (uint32_t)(nonce >> 32);
+    }
+
     static void chacha20_block(uint32_t out[16], const uint32_t in[16]) {
         uint32_t x[16];
         for (int i = 0; i < 16; ++i) x[i] = in[i];
@@ -58,6 +136,36 @@ public:
         for (int i = 0; i < 16; ++i) out[i] = x[i] + in[i];
     }
 
+    static void xor_blocks_scalar(uint32_t state[16], uint8_t* data, size_t blocks) {
+        uint32_t keystream[16];
+        for (size_t b = 0; b < blocks; ++b, data += 64) {
+            chacha20_block(keystream, state);
+            state[12]++;
+            for (int i = 0; i < 16; ++i) {
+                store32_le(data + i * 4, load32_le(data + i * 4) ^ keystream[i]);
+            }
+        }
+        NoiseCrypto::secure_memzero(keystream, sizeof(keystream));
+    }
+
+    // Encrypts or decrypts data in place, starting at the block counter in state[12]
+    static void xor_stream(ChaCha20BlocksFn kernel, uint32_t state[16], uint8_t* data, size_t size) {
+        size_t full_blocks = size / 64;
+        if (full_blocks > 0) {
+            kernel(state, data, full_blocks);
+            data += full_blocks * 64;
+            size -= full_blocks * 64;
+        }
+
+        if (size > 0) {
+            uint8_t tail[64] = {0};
+            std::memcpy(tail, data, size);
+            xor_blocks_scalar(state, tail, 1);
+            std::memcpy(data, tail, size);
+            NoiseCrypto::secure_memzero(tail, sizeof(tail));
+        }
+    }
+
 private:
     static uint32_t rotl(uint32_t x, int n) {
         return (x << n) | (x >> (32 - n));
@@ -71,71 +179,501 @@ private:
     }
 };
 
-// Simple Poly1305 implementation
+// The SIMD kernels compute several blocks at once with one state word per register
+// ("vertical" layout, one block per lane), then transpose the results back into blocks.
+
+#ifdef RATS_NOISE_X86
+
+#define CHACHA_SSE2_ROTL(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+#define CHACHA_SSE2_QR(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_SSE2_ROTL(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_SSE2_ROTL(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_SSE2_ROTL(d, 8);  \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_SSE2_ROTL(b, 7);
+
+// 4 blocks per iteration
+RATS_TARGET_SSE2
+void chacha20_xor_blocks_sse2(uint32_t state[16], uint8_t* data, size_t blocks) {
+    while (blocks >= 4) {
+        __m128i x[16];
+        __m128i in[16];
+        for (int i = 0; i < 16; ++i) {
+            in[i] = _mm_set1_epi32((int)state[i]);
+        }
+        in[12] = _mm_add_epi32(in[12], _mm_setr_epi32(0, 1, 2, 3));
+        for (int i = 0; i < 16; ++i) {
+            x[i] = in[i];
+        }
+
+        for (int round = 0; round < 10; ++round) {
+            CHACHA_SSE2_QR(x[0], x[4], x[8], x[12]);
+            CHACHA_SSE2_QR(x[1], x[5], x[9], x[13]);
+            CHACHA_SSE2_QR(x[2], x[6], x[10], x[14]);
+            CHACHA_SSE2_QR(x[3], x[7], x[11], x[15]);
+            CHACHA_SSE2_QR(x[0], x[5], x[10], x[15]);
+            CHACHA_SSE2_QR(x[1], x[6], x[11], x[12]);
+            CHACHA_SSE2_QR(x[2], x[7], x[8], x[13]);
+            CHACHA_SSE2_QR(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            x[i] = _mm_add_epi32(x[i], in[i]);
+        }
+
+        // Transpose each group of 4 words into 16-byte rows of the 4 blocks
+        for (int g = 0; g < 4; ++g) {
+            __m128i t0 = _mm_unpacklo_epi32(x[g * 4 + 0], x[g * 4 + 1]);
+            __m128i t1 = _mm_unpacklo_epi32(x[g * 4 + 2], x[g * 4 + 3]);
+            __m128i t2 = _mm_unpackhi_epi32(x[g * 4 + 0], x[g * 4 + 1]);
+            __m128i t3 = _mm_unpackhi_epi32(x[g * 4 + 2], x[g * 4 + 3]);
+            __m128i rows[4] = {
+                _mm_unpacklo_epi64(t0, t1),
+                _mm_unpackhi_epi64(t0, t1),
+                _mm_unpacklo_epi64(t2, t3),
+                _mm_unpackhi_epi64(t2, t3)
+            };
+            for (int b = 0; b < 4; ++b) {
+                __m128i* p = reinterpret_cast<__m128i*>(data + b * 64 + g * 16);
+                _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), rows[b]));
+            }
+        }
+
+        state[12] += 4;
+        data += 4 * 64;
+        blocks -= 4;
+    }
+
+    ChaCha20::xor_blocks_scalar(state, data, blocks);
+}
+
+#define CHACHA_AVX2_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+#define CHACHA_AVX2_QR(a, b, c, d) \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot16); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CHACHA_AVX2_ROTL(b, 12);      \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot8);  \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CHACHA_AVX2_ROTL(b, 7);
+
+// 8 blocks per iteration
+RATS_TARGET_AVX2
+void chacha20_xor_blocks_avx2(uint32_t state[16], uint8_t* data, size_t blocks) {
+    // Byte shuffles for the 16- and 8-bit rotations
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+
+    while (blocks >= 8) {
+        __m256i x[16];
+        __m256i in[16];
+        for (int i = 0; i < 16; ++i) {
+            in[i] = _mm256_set1_epi32((int)state[i]);
+        }
+        in[12] = _mm256_add_epi32(in[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (int i = 0; i < 16; ++i) {
+            x[i] = in[i];
+        }
+
+        for (int round = 0; round < 10; ++round) {
+            CHACHA_AVX2_QR(x[0], x[4], x[8], x[12]);
+            CHACHA_AVX2_QR(x[1], x[5], x[9], x[13]);
+            CHACHA_AVX2_QR(x[2], x[6], x[10], x[14]);
+            CHACHA_AVX2_QR(x[3], x[7], x[11], x[15]);
+            CHACHA_AVX2_QR(x[0], x[5], x[10], x[15]);
+            CHACHA_AVX2_QR(x[1], x[6], x[11], x[12]);
+            CHACHA_AVX2_QR(x[2], x[7], x[8], x[13]);
+            CHACHA_AVX2_QR(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            x[i] = _mm256_add_epi32(x[i], in[i]);
+        }
+
+        // Per 128-bit lane transpose: rows[g][b] holds words 4g..4g+3 of block b (low lane)
+        // and of block b + 4 (high lane)
+        __m256i rows[4][4];
+        for (int g = 0; g < 4; ++g) {
+            __m256i t0 = _mm256_unpacklo_epi32(x[g * 4 + 0], x[g * 4 + 1]);
+            __m256i t1 = _mm256_unpacklo_epi32(x[g * 4 + 2], x[g * 4 + 3]);
+            __m256i t2 = _mm256_unpackhi_epi32(x[g * 4 + 0], x[g * 4 + 1]);
+            __m256i t3 = _mm256_unpackhi_epi32(x[g * 4 + 2], x[g * 4 + 3]);
+            rows[g][0] = _mm256_unpacklo_epi64(t0, t1);
+            rows[g][1] = _mm256_unpackhi_epi64(t0, t1);
+            rows[g][2] = _mm256_unpacklo_epi64(t2, t3);
+            rows[g][3] = _mm256_unpackhi_epi64(t2, t3);
+        }
+
+        for (int b = 0; b < 4; ++b) {
+            // Join 16-byte rows into 32-byte halves of blocks b and b + 4
+            __m256i halves[4] = {
+                _mm256_permute2x128_si256(rows[0][b], rows[1][b], 0x20),   // block b, bytes 0..31
+                _mm256_permute2x128_si256(rows[2][b], rows[3][b], 0x20),   // block b, bytes 32..63
+                _mm256_permute2x128_si256(rows[0][b], rows[1][b], 0x31),   // block b + 4, bytes 0..31
+                _mm256_permute2x128_si256(rows[2][b], rows[3][b], 0x31)    // block b + 4, bytes 32..63
+            };
+            uint8_t* offsets[4] = {
+                data + b * 64, data + b * 64 + 32, data + (b + 4) * 64, data + (b + 4) * 64 + 32
+            };
+            for (int h = 0; h < 4; ++h) {
+                __m256i* p = reinterpret_cast<__m256i*>(offsets[h]);
+                _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), halves[h]));
+            }
+        }
+
+        state[12] += 8;
+        data += 8 * 64;
+        blocks -= 8;
+    }
+
+    chacha20_xor_blocks_sse2(state, data, blocks);
+}
+
+bool cpu_supports_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpu_supports_sse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;  // Part of the x86-64 baseline
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif // RATS_NOISE_X86
+
+#ifdef RATS_NOISE_NEON
+
+#define CHACHA_NEON_ROTL(x, n) vsriq_n_u32(vshlq_n_u32((x), (n)), (x), 32 - (n))
+#define CHACHA_NEON_ROTL16(x) vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(x)))
+#define CHACHA_NEON_QR(a, b, c, d) \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = CHACHA_NEON_ROTL16(d);    \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = CHACHA_NEON_ROTL(b, 12);  \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = CHACHA_NEON_ROTL(d, 8);   \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = CHACHA_NEON_ROTL(b, 7);
+
+// 4 blocks per iteration
+void chacha20_xor_blocks_neon(uint32_t state[16], uint8_t* data, size_t blocks) {
+    static const uint32_t lane_counters[4] = {0, 1, 2, 3};
+
+    while (blocks >= 4) {
+        uint32x4_t x[16];
+        uint32x4_t in[16];
+        for (int i = 0; i < 16; ++i) {
+            in[i] = vdupq_n_u32(state[i]);
+        }
+        in[12] = vaddq_u32(in[12], vld1q_u32(lane_counters));
+        for (int i = 0; i < 16; ++i) {
+            x[i] = in[i];
+        }
+
+        for (int round = 0; round < 10; ++round) {
+            CHACHA_NEON_QR(x[0], x[4], x[8], x[12]);
+            CHACHA_NEON_QR(x[1], x[5], x[9], x[13]);
+            CHACHA_NEON_QR(x[2], x[6], x[10], x[14]);
+            CHACHA_NEON_QR(x[3], x[7], x[11], x[15]);
+            CHACHA_NEON_QR(x[0], x[5], x[10], x[15]);
+            CHACHA_NEON_QR(x[1], x[6], x[11], x[12]);
+            CHACHA_NEON_QR(x[2], x[7], x[8], x[13]);
+            CHACHA_NEON_QR(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            x[i] = vaddq_u32(x[i], in[i]);
+        }
+
+        for (int g = 0; g < 4; ++g) {
+            uint32x4x2_t ab = vtrnq_u32(x[g * 4 + 0], x[g * 4 + 1]);
+            uint32x4x2_t cd = vtrnq_u32(x[g * 4 + 2], x[g * 4 + 3]);
+            uint32x4_t rows[4] = {
+                vcombine_u32(vget_low_u32(ab.val[0]), vget_low_u32(cd.val[0])),
+                vcombine_u32(vget_low_u32(ab.val[1]), vget_low_u32(cd.val[1])),
+                vcombine_u32(vget_high_u32(ab.val[0]), vget_high_u32(cd.val[0])),
+                vcombine_u32(vget_high_u32(ab.val[1]), vget_high_u32(cd.val[1]))
+            };
+            for (int b = 0; b < 4; ++b) {
+                uint8_t* p = data + b * 64 + g * 16;
+                vst1q_u8(p, veorq_u8(vld1q_u8(p), vreinterpretq_u8_u32(rows[b])));
+            }
+        }
+
+        state[12] += 4;
+        data += 4 * 64;
+        blocks -= 4;
+    }
+
+    ChaCha20::xor_blocks_scalar(state, data, blocks);
+}
+
+#endif // RATS_NOISE_NEON
+
+ChaCha20BlocksFn chacha20_kernel(NoiseCipherBackend backend) {
+    switch (backend) {
+#ifdef RATS_NOISE_X86
+        case NoiseCipherBackend::SSE2: return chacha20_xor_blocks_sse2;
+        case NoiseCipherBackend::AVX2: return chacha20_xor_blocks_avx2;
+#endif
+#ifdef RATS_NOISE_NEON
+        case NoiseCipherBackend::NEON: return chacha20_xor_blocks_neon;
+#endif
+        default: return ChaCha20::xor_blocks_scalar;
+    }
+}
+
+NoiseCipherBackend detect_cipher_backend() {
+#ifdef RATS_NOISE_X86
+    if (cpu_supports_avx2()) {
+        return NoiseCipherBackend::AVX2;
+    }
+    if (cpu_supports_sse2()) {
+        return NoiseCipherBackend::SSE2;
+    }
+#endif
+#ifdef RATS_NOISE_NEON
+    return NoiseCipherBackend::NEON;
+#endif
+    return NoiseCipherBackend::SCALAR;
+}
+
+std::atomic<NoiseCipherBackend>& active_cipher_backend() {
+    static std::atomic<NoiseCipherBackend> backend(detect_cipher_backend());
+    return backend;
+}
+
+//=============================================================================
+// Poly1305 (RFC 8439)
+//=============================================================================
+
+#if defined(__SIZEOF_INT128__)
+
+// 44/44/42-bit limbs with 128-bit products
 class Poly1305 {
 public:
-    static void poly1305_mac(uint8_t out[16], const uint8_t* m, size_t inlen, const uint8_t key[32]) {
-        uint32_t r0, r1, r2, r3, r4;
-        uint32_t s1, s2, s3, s4;
-        uint32_t h0, h1, h2, h3, h4;
-        uint64_t d0, d1, d2, d3, d4;
-        uint32_t c;
+    explicit Poly1305(const uint8_t key[32]) : leftover_(0) {
+        uint64_t t0 = load64_le(key);
+        uint64_t t1 = load64_le(key + 8);
 
         // r &= 0xffffffc0ffffffc0ffffffc0fffffff
-        r0 = (get_u32le(key + 0)) & 0x3ffffff;
-        r1 = (get_u32le(key + 3) >> 2) & 0x3ffff03;
-        r2 = (get_u32le(key + 6) >> 4) & 0x3ffc0ff;
-        r3 = (get_u32le(key + 9) >> 6) & 0x3f03fff;
-        r4 = (get_u32le(key + 12) >> 8) & 0x00fffff;
+        r_[0] = t0 & 0xffc0fffffff;
+        r_[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+        r_[2] = (t1 >> 24) & 0x00ffffffc0f;
 
-        s1 = r1 * 5;
-        s2 = r2 * 5;
-        s3 = r3 * 5;
-        s4 = r4 * 5;
+        h_[0] = h_[1] = h_[2] = 0;
+        pad_[0] = load64_le(key + 16);
+        pad_[1] = load64_le(key + 24);
+    }
 
-        h0 = h1 = h2 = h3 = h4 = 0;
+    ~Poly1305() {
+        NoiseCrypto::secure_memzero(r_, sizeof(r_));
+        NoiseCrypto::secure_memzero(pad_, sizeof(pad_));
+    }
 
-        while (inlen > 0) {
-            // h += m[i]
-            if (inlen >= 16) {
-                h0 += (get_u32le(m + 0)) & 0x3ffffff;
-                h1 += (get_u32le(m + 3) >> 2) & 0x3ffffff;
-                h2 += (get_u32le(m + 6) >> 4) & 0x3ffffff;
-                h3 += (get_u32le(m + 9) >> 6) & 0x3ffffff;
-                h4 += (get_u32le(m + 12) >> 8) | (1 << 24);
-                m += 16;
-                inlen -= 16;
-            } else {
-                uint8_t mp[16];
-                size_t i;
-                for (i = 0; i < inlen; i++) mp[i] = m[i];
-                mp[i++] = 1;
-                for (; i < 16; i++) mp[i] = 0;
-                inlen = 0;
-                h0 += (get_u32le(mp + 0)) & 0x3ffffff;
-                h1 += (get_u32le(mp + 3) >> 2) & 0x3ffffff;
-                h2 += (get_u32le(mp + 6) >> 4) & 0x3ffffff;
-                h3 += (get_u32le(mp + 9) >> 6) & 0x3ffffff;
-                h4 += (get_u32le(mp + 12) >> 8);
+    void update(const uint8_t* m, size_t bytes) {
+        if (leftover_ > 0) {
+            size_t want = (std::min)(size_t(16) - leftover_, bytes);
+            std::memcpy(buffer_ + leftover_, m, want);
+            leftover_ += want;
+            m += want;
+            bytes -= want;
+            if (leftover_ < 16) {
+                return;
             }
+            blocks(buffer_, 16, (uint64_t)1 << 40);
+            leftover_ = 0;
+        }
+
+        size_t full = bytes & ~size_t(15);
+        if (full > 0) {
+            blocks(m, full, (uint64_t)1 << 40);
+            m += full;
+            bytes -= full;
+        }
+
+        if (bytes > 0) {
+            std::memcpy(buffer_, m, bytes);
+            leftover_ = bytes;
+        }
+    }
+
+    void finish(uint8_t mac[16]) {
+        const uint64_t mask44 = 0xfffffffffff;
+        const uint64_t mask42 = 0x3ffffffffff;
+
+        // Final partial block: append 1 and pad with zeros, without the 2^128 bit
+        if (leftover_ > 0) {
+            buffer_[leftover_] = 1;
+            std::memset(buffer_ + leftover_ + 1, 0, 16 - leftover_ - 1);
+            blocks(buffer_, 16, 0);
+        }
+
+        // fully carry h
+        uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2];
+        uint64_t c;
+        c = (h1 >> 44); h1 &= mask44;
+        h2 += c; c = (h2 >> 42); h2 &= mask42;
+        h0 += c * 5; c = (h0 >> 44); h0 &= mask44;
+        h1 += c; c = (h1 >> 44); h1 &= mask44;
+        h2 += c; c = (h2 >> 42); h2 &= mask42;
+        h0 += c * 5; c = (h0 >> 44); h0 &= mask44;
+        h1 += c;
+
+        // compute h + -p
+        uint64_t g0 = h0 + 5; c = (g0 >> 44); g0 &= mask44;
+        uint64_t g1 = h1 + c; c = (g1 >> 44); g1 &= mask44;
+        uint64_t g2 = h2 + c - ((uint64_t)1 << 42);
+
+        // select h if h < p, or h + -p if h >= p
+        c = (g2 >> 63) - 1;
+        g0 &= c;
+        g1 &= c;
+        g2 &= c;
+        c = ~c;
+        h0 = (h0 & c) | g0;
+        h1 = (h1 & c) | g1;
+        h2 = (h2 & c) | g2;
+
+        // mac = (h + pad) % (2^128)
+        uint64_t t0 = pad_[0];
+        uint64_t t1 = pad_[1];
+        h0 += (t0 & mask44); c = (h0 >> 44); h0 &= mask44;
+        h1 += (((t0 >> 44) | (t1 << 20)) & mask44) + c; c = (h1 >> 44); h1 &= mask44;
+        h2 += (((t1 >> 24)) & mask42) + c; h2 &= mask42;
+
+        h0 = ((h0) | (h1 << 44));
+        h1 = ((h1 >> 20) | (h2 << 24));
+
+        store64_le(mac, h0);
+        store64_le(mac + 8, h1);
+    }
+
+private:
+    void blocks(const uint8_t* m, size_t bytes, uint64_t hibit) {
+        using u128 = unsigned __int128;
+        const uint64_t mask44 = 0xfffffffffff;
+        const uint64_t mask42 = 0x3ffffffffff;
+
+        uint64_t r0 = r_[0], r1 = r_[1], r2 = r_[2];
+        uint64_t s1 = r1 * (5 << 2);
+        uint64_t s2 = r2 * (5 << 2);
+        uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2];
+
+        while (bytes >= 16) {
+            // h += m[i]
+            uint64_t t0 = load64_le(m);
+            uint64_t t1 = load64_le(m + 8);
+            h0 += t0 & mask44;
+            h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+            h2 += (((t1 >> 24)) & mask42) | hibit;
 
             // h *= r
-            d0 = ((uint64_t)h0 * r0) + ((uint64_t)h1 * s4) + ((uint64_t)h2 * s3) + ((uint64_t)h3 * s2) + ((uint64_t)h4 * s1);
-            d1 = ((uint64_t)h0 * r1) + ((uint64_t)h1 * r0) + ((uint64_t)h2 * s4) + ((uint64_t)h3 * s3) + ((uint64_t)h4 * s2);
-            d2 = ((uint64_t)h0 * r2) + ((uint64_t)h1 * r1) + ((uint64_t)h2 * r0) + ((uint64_t)h3 * s4) + ((uint64_t)h4 * s3);
-            d3 = ((uint64_t)h0 * r3) + ((uint64_t)h1 * r2) + ((uint64_t)h2 * r1) + ((uint64_t)h3 * r0) + ((uint64_t)h4 * s4);
-            d4 = ((uint64_t)h0 * r4) + ((uint64_t)h1 * r3) + ((uint64_t)h2 * r2) + ((uint64_t)h3 * r1) + ((uint64_t)h4 * r0);
+            u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+            u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+            u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
 
             // (partial) h %= p
-            c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
-            d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
-            d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
-            d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
-            d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
-            h0 += c * 5; c = h0 >> 26; h0 = h0 & 0x3ffffff;
+            uint64_t c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & mask44;
+            d1 += c; c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & mask44;
+            d2 += c; c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & mask42;
+            h0 += c * 5; c = (h0 >> 44); h0 &= mask44;
             h1 += c;
+
+            m += 16;
+            bytes -= 16;
         }
 
+        h_[0] = h0;
+        h_[1] = h1;
+        h_[2] = h2;
+    }
+
+    uint64_t r_[3];
+    uint64_t h_[3];
+    uint64_t pad_[2];
+    uint8_t buffer_[16];
+    size_t leftover_;
+};
+
+#else
+
+// 26-bit limbs with 64-bit products (targets without a 128-bit integer type)
+class Poly1305 {
+public:
+    explicit Poly1305(const uint8_t key[32]) : leftover_(0) {
+        // r &= 0xffffffc0ffffffc0ffffffc0fffffff
+        r_[0] = (load32_le(key + 0)) & 0x3ffffff;
+        r_[1] = (load32_le(key + 3) >> 2) & 0x3ffff03;
+        r_[2] = (load32_le(key + 6) >> 4) & 0x3ffc0ff;
+        r_[3] = (load32_le(key + 9) >> 6) & 0x3f03fff;
+        r_[4] = (load32_le(key + 12) >> 8) & 0x00fffff;
+
+        for (int i = 0; i < 5; ++i) h_[i] = 0;
+        for (int i = 0; i < 4; ++i) pad_[i] = load32_le(key + 16 + i * 4);
+    }
+
+    ~Poly1305() {
+        NoiseCrypto::secure_memzero(r_, sizeof(r_));
+        NoiseCrypto::secure_memzero(pad_, sizeof(pad_));
+    }
+
+    void update(const uint8_t* m, size_t bytes) {
+        if (leftover_ > 0) {
+            size_t want = (std::min)(size_t(16) - leftover_, bytes);
+            std::memcpy(buffer_ + leftover_, m, want);
+            leftover_ += want;
+            m += want;
+            bytes -= want;
+            if (leftover_ < 16) {
+                return;
+            }
+            blocks(buffer_, 16, 1 << 24);
+            leftover_ = 0;
+        }
+
+        size_t full = bytes & ~size_t(15);
+        if (full > 0) {
+            blocks(m, full, 1 << 24);
+            m += full;
+            bytes -= full;
+        }
+
+        if (bytes > 0) {
+            std::memcpy(buffer_, m, bytes);
+            leftover_ = bytes;
+        }
+    }
+
+    void finish(uint8_t mac[16]) {
+        // Final partial block: append 1 and pad with zeros, without the 2^128 bit
+        if (leftover_ > 0) {
+            buffer_[leftover_] = 1;
+            std::memset(buffer_ + leftover_ + 1, 0, 16 - leftover_ - 1);
+            blocks(buffer_, 16, 0);
+        }
+
+        uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+        uint32_t c;
+
         // fully carry h
         c = h1 >> 26; h1 = h1 & 0x3ffffff;
         h2 += c; c = h2 >> 26; h2 = h2 & 0x3ffffff;
@@ -171,59 +709,268 @@ public:
         h2 = ((h2 >> 12) | (h3 << 14)) & 0xffffffff;
         h3 = ((h3 >> 18) | (h4 << 8)) & 0xffffffff;
 
-        // mac = (h + s) % (2^128)
-        d0 = (uint64_t)h0 + get_u32le(key + 16); h0 = (uint32_t)d0;
-        d1 = (uint64_t)h1 + get_u32le(key + 20) + (d0 >> 32); h1 = (uint32_t)d1;
-        d2 = (uint64_t)h2 + get_u32le(key + 24) + (d1 >> 32); h2 = (uint32_t)d2;
-        d3 = (uint64_t)h3 + get_u32le(key + 28) + (d2 >> 32); h3 = (uint32_t)d3;
-
-        put_u32le(out + 0, h0);
-        put_u32le(out + 4, h1);
-        put_u32le(out + 8, h2);
-        put_u32le(out + 12, h3);
+        // mac = (h + pad) % (2^128)
+        uint64_t f;
+        f = (uint64_t)h0 + pad_[0]; h0 = (uint32_t)f;
+        f = (uint64_t)h1 + pad_[1] + (f >> 32); h1 = (uint32_t)f;
+        f = (uint64_t)h2 + pad_[2] + (f >> 32); h2 = (uint32_t)f;
+        f = (uint64_t)h3 + pad_[3] + (f >> 32); h3 = (uint32_t)f;
+
+        store32_le(mac + 0, h0);
+        store32_le(mac + 4, h1);
+        store32_le(mac + 8, h2);
+        store32_le(mac + 12, h3);
     }
 
 private:
-    static uint32_t get_u32le(const uint8_t* p) {
-        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
-    }
+    void blocks(const uint8_t* m, size_t bytes, uint32_t hibit) {
+        uint32_t r0 = r_[0], r1 = r_[1], r2 = r_[2], r3 = r_[3], r4 = r_[4];
+        uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+        uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+        while (bytes >= 16) {
+            // h += m[i]
+            h0 += (load32_le(m + 0)) & 0x3ffffff;
+            h1 += (load32_le(m + 3) >> 2) & 0x3ffffff;
+            h2 += (load32_le(m + 6) >> 4) & 0x3ffffff;
+            h3 += (load32_le(m + 9) >> 6) & 0x3ffffff;
+            h4 += (load32_le(m + 12) >> 8) | hibit;
+
+            // h *= r
+            uint64_t d0 = ((uint64_t)h0 * r0) + ((uint64_t)h1 * s4) + ((uint64_t)h2 * s3) + ((uint64_t)h3 * s2) + ((uint64_t)h4 * s1);
+            uint64_t d1 = ((uint64_t)h0 * r1) + ((uint64_t)h1 * r0) + ((uint64_t)h2 * s4) + ((uint64_t)h3 * s3) + ((uint64_t)h4 * s2);
+            uint64_t d2 = ((uint64_t)h0 * r2) + ((uint64_t)h1 * r1) + ((uint64_t)h2 * r0) + ((uint64_t)h3 * s4) + ((uint64_t)h4 * s3);
+            uint64_t d3 = ((uint64_t)h0 * r3) + ((uint64_t)h1 * r2) + ((uint64_t)h2 * r1) + ((uint64_t)h3 * r0) + ((uint64_t)h4 * s4);
+            uint64_t d4 = ((uint64_t)h0 * r4) + ((uint64_t)h1 * r3) + ((uint64_t)h2 * r2) + ((uint64_t)h3 * r1) + ((uint64_t)h4 * r0);
+
+            // (partial) h %= p
+            uint32_t c;
+            c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+            d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+            d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+            d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+            d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+            h0 += c * 5; c = h0 >> 26; h0 = h0 & 0x3ffffff;
+            h1 += c;
+
+            m += 16;
+            bytes -= 16;
+        }
 
-    static void put_u32le(uint8_t* p, uint32_t v) {
-        p[0] = (uint8_t)(v);
-        p[1] = (uint8_t)(v >> 8);
-        p[2] = (uint8_t)(v >> 16);
-        p[3] = (uint8_t)(v >> 24);
+        h_[0] = h0; h_[1] = h1; h_[2] = h2; h_[3] = h3; h_[4] = h4;
     }
+
+    uint32_t r_[5];
+    uint32_t h_[5];
+    uint32_t pad_[4];
+    uint8_t buffer_[16];
+    size_t leftover_;
 };
 
-// Simple Curve25519 implementation
+#endif // __SIZEOF_INT128__
+
+//=============================================================================
+// ChaCha20-Poly1305 AEAD (RFC 8439)
+//=============================================================================
+
+void compute_aead_tag(const uint8_t poly_key[32], const uint8_t* ad, size_t ad_size,
+                      const uint8_t* ciphertext, size_t ciphertext_size, uint8_t tag[16]) {
+    static const uint8_t zeros[16] = {0};
+
+    Poly1305 mac(poly_key);
+    if (ad_size > 0) {
+        mac.update(ad, ad_size);
+        mac.update(zeros, (16 - ad_size % 16) % 16);
+    }
+    if (ciphertext_size > 0) {
+        mac.update(ciphertext, ciphertext_size);
+        mac.update(zeros, (16 - ciphertext_size % 16) % 16);
+    }
+
+    uint8_t lengths[16];
+    store64_le(lengths, ad_size);
+    store64_le(lengths + 8, ciphertext_size);
+    mac.update(lengths, sizeof(lengths));
+    mac.finish(tag);
+}
+
+// Derives the one-time Poly1305 key from block 0 and leaves the state at block 1
+void derive_poly_key(uint32_t state[16], const NoiseKey& key, uint64_t nonce, uint8_t poly_key[32]) {
+    ChaCha20::init_state(state, key, nonce);
+
+    uint32_t block[16];
+    ChaCha20::chacha20_block(block, state);
+    for (int i = 0; i < 8; ++i) {
+        store32_le(poly_key + i * 4, block[i]);
+    }
+    NoiseCrypto::secure_memzero(block, sizeof(block));
+
+    state[12] = 1;
+}
+
+bool constant_time_equal(const uint8_t* a, const uint8_t* b, size_t size) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < size; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+//=============================================================================
+// X25519 (RFC 7748)
+//=============================================================================
+
+// Constant-time Montgomery ladder over GF(2^255 - 19) with 16 limbs of 16 bits (after TweetNaCl)
 class Curve25519 {
 public:
     static void scalarmult(uint8_t out[32], const uint8_t scalar[32], const uint8_t point[32]) {
-        // This is a simplified implementation for demonstration
-        // In production, use a proper curve25519 implementation
-        std::memcpy(out, point, 32);
-        for (int i = 0; i < 32; ++i) {
-            out[i] ^= scalar[i];  // Simplified operation - NOT cryptographically secure
+        uint8_t z[32];
+        std::memcpy(z, scalar, 32);
+        z[31] = (z[31] & 127) | 64;
+        z[0] &= 248;
+
+        gf x, a, b, c, d, e, f;
+        unpack(x, point);
+        for (int i = 0; i < 16; ++i) {
+            b[i] = x[i];
+            a[i] = c[i] = d[i] = 0;
+        }
+        a[0] = d[0] = 1;
+
+        for (int i = 254; i >= 0; --i) {
+            int64_t bit = (z[i >> 3] >> (i & 7)) & 1;
+            select(a, b, bit);
+            select(c, d, bit);
+            add(e, a, c);
+            sub(a, a, c);
+            add(c, b, d);
+            sub(b, b, d);
+            mul(d, e, e);
+            mul(f, a, a);
+            mul(a, c, a);
+            mul(c, b, e);
+            add(e, a, c);
+            sub(a, a, c);
+            mul(b, a, a);
+            sub(c, d, f);
+            mul(a, c, K121665);
+            add(a, a, d);
+            mul(c, c, a);
+            mul(a, d, f);
+            mul(d, b, x);
+            mul(b, e, e);
+            select(a, b, bit);
+            select(c, d, bit);
         }
+
+        invert(c, c);
+        mul(a, a, c);
+        pack(out, a);
+
+        NoiseCrypto::secure_memzero(z, sizeof(z));
+        NoiseCrypto::secure_memzero(a, sizeof(gf));
+        NoiseCrypto::secure_memzero(b, sizeof(gf));
+        NoiseCrypto::secure_memzero(c, sizeof(gf));
+        NoiseCrypto::secure_memzero(d, sizeof(gf));
     }
 
     static void scalarmult_base(uint8_t out[32], const uint8_t scalar[32]) {
         uint8_t basepoint[32] = {9};  // Standard base point
         scalarmult(out, scalar, basepoint);
     }
-};
 
-// Simple SHA256 implementation
-class SHA256 {
-public:
-    static void hash(uint8_t out[32], const uint8_t* data, size_t len) {
-        // This is a placeholder implementation
-        // In production, use a proper SHA256 implementation
-        std::memset(out, 0, 32);
-        for (size_t i = 0; i < len && i < 32; ++i) {
-            out[i] = data[i] ^ (uint8_t)(len & 0xFF);
+private:
+    using gf = int64_t[16];
+    static constexpr gf K121665 = {0xDB41, 1};
+
+    static void carry(gf o) {
+        for (int i = 0; i < 16; ++i) {
+            o[i] += (int64_t)1 << 16;
+            int64_t c = o[i] >> 16;
+            if (i < 15) {
+                o[i + 1] += c - 1;
+            } else {
+                o[0] += 38 * (c - 1);
+            }
+            o[i] -= c * 65536;
+        }
+    }
+
+    // Swaps p and q if b == 1, without branching on b
+    static void select(gf p, gf q, int64_t b) {
+        int64_t mask = ~(b - 1);
+        for (int i = 0; i < 16; ++i) {
+            int64_t t = mask & (p[i] ^ q[i]);
+            p[i] ^= t;
+            q[i] ^= t;
+        }
+    }
+
+    static void pack(uint8_t out[32], const gf n) {
+        gf m, t;
+        for (int i = 0; i < 16; ++i) t[i] = n[i];
+        carry(t);
+        carry(t);
+        carry(t);
+        for (int j = 0; j < 2; ++j) {
+            m[0] = t[0] - 0xffed;
+            for (int i = 1; i < 15; ++i) {
+                m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+                m[i - 1] &= 0xffff;
+            }
+            m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+            int64_t borrow = (m[15] >> 16) & 1;
+            m[14] &= 0xffff;
+            select(t, m, 1 - borrow);
+        }
+        for (int i = 0; i < 16; ++i) {
+            out[2 * i] = (uint8_t)(t[i] & 0xff);
+            out[2 * i + 1] = (uint8_t)(t[i] >> 8);
+        }
+    }
+
+    static void unpack(gf o, const uint8_t n[32]) {
+        for (int i = 0; i < 16; ++i) {
+            o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+        }
+        o[15] &= 0x7fff;
+    }
+
+    static void add(gf o, const gf a, const gf b) {
+        for (int i = 0; i < 16; ++i) o[i] = a[i] + b[i];
+    }
+
+    static void sub(gf o, const gf a, const gf b) {
+        for (int i = 0; i < 16; ++i) o[i] = a[i] - b[i];
+    }
+
+    static void mul(gf o, const gf a, const gf b) {
+        int64_t t[31];
+        for (int i = 0; i < 31; ++i) t[i] = 0;
+        for (int i = 0; i < 16; ++i) {
+            for (int j = 0; j < 16; ++j) {
+                t[i + j] += a[i] * b[j];
+            }
+        }
+        for (int i = 0; i < 15; ++i) {
+            t[i] += 38 * t[i + 16];
+        }
+        for (int i = 0; i < 16; ++i) o[i] = t[i];
+        carry(o);
+        carry(o);
+    }
+
+    // o = i^(p - 2)
+    static void invert(gf o, const gf i) {
+        gf c;
+        for (int a = 0; a < 16; ++a) c[a] = i[a];
+        for (int a = 253; a >= 0; --a) {
+            mul(c, c, c);
+            if (a != 2 && a != 4) {
+                mul(c, c, i);
+            }
         }
+        for (int a = 0; a < 16; ++a) o[a] = c[a];
     }
 };
 
@@ -235,10 +982,12 @@ public:
 
 NoiseKey NoiseCrypto::generate_keypair(NoiseKey& private_key) {
     random_bytes(private_key.data(), NOISE_KEY_SIZE);
-    
+    return public_key(private_key);
+}
+
+NoiseKey NoiseCrypto::public_key(const NoiseKey& private_key) {
     NoiseKey public_key;
     Curve25519::scalarmult_base(public_key.data(), private_key.data());
-    
     return public_key;
 }
 
@@ -248,48 +997,48 @@ NoiseKey NoiseCrypto::dh(const NoiseKey& private_key, const NoiseKey& public_key
     return shared_secret;
 }
 
-std::vector<uint8_t> NoiseCrypto::encrypt(const NoiseKey& key, uint64_t nonce, 
+void NoiseCrypto::encrypt_in_place(const NoiseKey& key, uint64_t nonce, const uint8_t* ad, size_t ad_size,
+                                   uint8_t* data, size_t size, uint8_t tag[NOISE_TAG_SIZE]) {
+    uint32_t state[16];
+    uint8_t poly_key[32];
+    derive_poly_key(state, key, nonce, poly_key);
+
+    ChaCha20::xor_stream(chacha20_kernel(active_cipher_backend().load()), state, data, size);
+    compute_aead_tag(poly_key, ad, ad_size, data, size, tag);
+
+    secure_memzero(state, sizeof(state));
+    secure_memzero(poly_key, sizeof(poly_key));
+}
+
+bool NoiseCrypto::decrypt_in_place(const NoiseKey& key, uint64_t nonce, const uint8_t* ad, size_t ad_size,
+                                   uint8_t* data, size_t size, const uint8_t tag[NOISE_TAG_SIZE]) {
+    uint32_t state[16];
+    uint8_t poly_key[32];
+    derive_poly_key(state, key, nonce, poly_key);
+
+    // Authenticate before decrypting anything
+    uint8_t computed_tag[NOISE_TAG_SIZE];
+    compute_aead_tag(poly_key, ad, ad_size, data, size, computed_tag);
+    secure_memzero(poly_key, sizeof(poly_key));
+
+    if (!constant_time_equal(computed_tag, tag, NOISE_TAG_SIZE)) {
+        secure_memzero(state, sizeof(state));
+        return false;  // MAC verification failed
+    }
+
+    ChaCha20::xor_stream(chacha20_kernel(active_cipher_backend().load()), state, data, size);
+    secure_memzero(state, sizeof(state));
+    return true;
+}
+
+std::vector<uint8_t> NoiseCrypto::encrypt(const NoiseKey& key, uint64_t nonce,
                                          const std::vector<uint8_t>& plaintext,
                                          const std::vector<uint8_t>& ad) {
     std::vector<uint8_t> ciphertext(plaintext.size() + NOISE_TAG_SIZE);
-    
-    // Setup ChaCha20 state
-    uint32_t state[16];
-    std::memcpy(state, "expand 32-byte k", 16);
-    std::memcpy(state + 4, key.data(), 32);
-    state[12] = 0;  // Counter
-    state[13] = (uint32_t)nonce;
-    state[14] = (uint32_t)(nonce >> 32);
-    state[15] = 0;
-    
-    // Generate Poly1305 key (use counter 0)
-    uint32_t poly_key[16];
-    ChaCha20::chacha20_block(poly_key, state);
-    
-    // Generate keystream and encrypt (start from counter 1)
-    state[12] = 1;
-    for (size_t i = 0; i < plaintext.size(); i += 64) {
-        uint32_t keystream[16];
-        ChaCha20::chacha20_block(keystream, state);
-        state[12]++;
-        
-        size_t chunk_size = (std::min)(size_t(64), plaintext.size() - i);
-        for (size_t j = 0; j < chunk_size; ++j) {
-            ciphertext[i + j] = plaintext[i + j] ^ ((uint8_t*)keystream)[j];
-        }
-    }
-    
-    // Calculate MAC
-    std::vector<uint8_t> mac_data;
-    mac_data.insert(mac_data.end(), ad.begin(), ad.end());
-    mac_data.insert(mac_data.end(), ciphertext.begin(), ciphertext.begin() + plaintext.size());
-    
-    uint8_t mac[16];
-    Poly1305::poly1305_mac(mac, mac_data.data(), mac_data.size(), (uint8_t*)poly_key);
-    
-    // Append MAC
-    std::memcpy(ciphertext.data() + plaintext.size(), mac, 16);
-    
+    std::copy(plaintext.begin(), plaintext.end(), ciphertext.begin());
+
+    encrypt_in_place(key, nonce, ad.data(), ad.size(), ciphertext.data(), plaintext.size(),
+                     ciphertext.data() + plaintext.size());
     return ciphertext;
 }
 
@@ -299,75 +1048,101 @@ std::vector<uint8_t> NoiseCrypto::decrypt(const NoiseKey& key, uint64_t nonce,
     if (ciphertext.size() < NOISE_TAG_SIZE) {
         return {};
     }
-    
+
     size_t plaintext_size = ciphertext.size() - NOISE_TAG_SIZE;
-    
-    // Setup ChaCha20 state
-    uint32_t state[16];
-    std::memcpy(state, "expand 32-byte k", 16);
-    std::memcpy(state + 4, key.data(), 32);
-    state[12] = 0;
-    state[13] = (uint32_t)nonce;
-    state[14] = (uint32_t)(nonce >> 32);
-    state[15] = 0;
-    
-    // Generate Poly1305 key and verify MAC
-    uint32_t poly_state[16];
-    std::memcpy(poly_state, state, sizeof(state));
-    poly_state[12] = 0;
-    uint32_t poly_key[16];
-    ChaCha20::chacha20_block(poly_key, poly_state);
-    
-    std::vector<uint8_t> mac_data;
-    mac_data.insert(mac_data.end(), ad.begin(), ad.end());
-    mac_data.insert(mac_data.end(), ciphertext.begin(), ciphertext.begin() + plaintext_size);
-    
-    uint8_t computed_mac[16];
-    Poly1305::poly1305_mac(computed_mac, mac_data.data(), mac_data.size(), (uint8_t*)poly_key);
-    
-    // Verify MAC
-    if (std::memcmp(computed_mac, ciphertext.data() + plaintext_size, 16) != 0) {
-        return {};  // MAC verification failed
-    }
-    
-    // Decrypt
-    std::vector<uint8_t> plaintext(plaintext_size);
-    state[12] = 1;  // Start from counter 1 (0 was used for Poly1305 key)
-    
-    for (size_t i = 0; i < plaintext_size; i += 64) {
-        uint32_t keystream[16];
-        ChaCha20::chacha20_block(keystream, state);
-        state[12]++;
-        
-        size_t chunk_size = (std::min)(size_t(64), plaintext_size - i);
-        for (size_t j = 0; j < chunk_size; ++j) {
-            plaintext[i + j] = ciphertext[i + j] ^ ((uint8_t*)keystream)[j];
-        }
+    std::vector<uint8_t> plaintext(ciphertext.begin(), ciphertext.begin() + plaintext_size);
+
+    if (!decrypt_in_place(key, nonce, ad.data(), ad.size(), plaintext.data(), plaintext_size,
+                          ciphertext.data() + plaintext_size)) {
+        return {};
     }
-    
     return plaintext;
 }
 
+NoiseCipherBackend NoiseCrypto::get_cipher_backend() {
+    return active_cipher_backend().load();
+}
+
+bool NoiseCrypto::set_cipher_backend(NoiseCipherBackend backend) {
+    if (!is_cipher_backend_supported(backend)) {
+        return false;
+    }
+    active_cipher_backend().store(backend);
+    LOG_NOISE_INFO("ChaCha20 backend set to " << cipher_backend_name(backend));
+    return true;
+}
+
+bool NoiseCrypto::is_cipher_backend_supported(NoiseCipherBackend backend) {
+    switch (backend) {
+        case NoiseCipherBackend::SCALAR:
+            return true;
+#ifdef RATS_NOISE_X86
+        case NoiseCipherBackend::SSE2:
+            return cpu_supports_sse2();
+        case NoiseCipherBackend::AVX2:
+            return cpu_supports_avx2();
+#endif
+#ifdef RATS_NOISE_NEON
+        case NoiseCipherBackend::NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+std::string NoiseCrypto::cipher_backend_name(NoiseCipherBackend backend) {
+    switch (backend) {
+        case NoiseCipherBackend::SCALAR: return "scalar";
+        case NoiseCipherBackend::SSE2: return "sse2";
+        case NoiseCipherBackend::AVX2: return "avx2";
+        case NoiseCipherBackend::NEON: return "neon";
+        default: return "unknown";
+    }
+}
+
 NoiseHash NoiseCrypto::hash(const std::vector<uint8_t>& data) {
     NoiseHash result;
-    SHA256::hash(result.data(), data.data(), data.size());
+    SHA256::digest(data.data(), data.size(), result.data());
     return result;
 }
 
 void NoiseCrypto::hkdf(const std::vector<uint8_t>& salt, const std::vector<uint8_t>& ikm,
                       const std::vector<uint8_t>& info, uint8_t* okm, size_t okm_len) {
-    // Simplified HKDF implementation
-    std::vector<uint8_t> prk_data = salt;
-    prk_data.insert(prk_data.end(), ikm.begin(), ikm.end());
-    NoiseHash prk = hash(prk_data);
-    
-    std::vector<uint8_t> okm_data = info;
-    okm_data.insert(okm_data.end(), prk.begin(), prk.end());
-    NoiseHash result = hash(okm_data);
-    
-    std::memcpy(okm, result.data(), (std::min)(okm_len, size_t(NOISE_HASH_SIZE)));
+    // HKDF-SHA256 (RFC 5869), as used by the Noise HKDF() function with empty info
+    if (okm_len > 255 * NOISE_HASH_SIZE) {
+        okm_len = 255 * NOISE_HASH_SIZE;
+    }
+
+    // Extract
+    uint8_t prk[NOISE_HASH_SIZE];
+    SHA256::hmac(salt.data(), salt.size(), ikm.data(), ikm.size(), prk);
+
+    // Expand: T(i) = HMAC(PRK, T(i-1) || info || i)
+    std::vector<uint8_t> block_input;
+    block_input.reserve(NOISE_HASH_SIZE + info.size() + 1);
+    uint8_t t[NOISE_HASH_SIZE];
+    size_t produced = 0;
+    for (uint8_t counter = 1; produced < okm_len; ++counter) {
+        block_input.clear();
+        if (counter > 1) {
+            block_input.insert(block_input.end(), t, t + NOISE_HASH_SIZE);
+        }
+        block_input.insert(block_input.end(), info.begin(), info.end());
+        block_input.push_back(counter);
+        SHA256::hmac(prk, sizeof(prk), block_input.data(), block_input.size(), t);
+
+        size_t take = (std::min)(okm_len - produced, size_t(NOISE_HASH_SIZE));
+        std::memcpy(okm + produced, t, take);
+        produced += take;
+    }
+
+    secure_memzero(prk, sizeof(prk));
+    secure_memzero(t, sizeof(t));
+    secure_memzero(block_input.data(), block_input.size());
 }
 
+
 void NoiseCrypto::secure_memzero(void* ptr, size_t size) {
     volatile uint8_t* p = static_cast<volatile uint8_t*>(ptr);
     for (size_t i = 0; i < size; ++i) {
@@ -431,22 +1206,70 @@ std::vector<uint8_t> NoiseCipherState::encrypt_with_ad(const std::vector<uint8_t
         return plaintext;  // No encryption if no key
     }
     
-    auto result = NoiseCrypto::encrypt(key_, nonce_, plaintext, ad);
-    nonce_++;
-    return result;
+    std::vector<uint8_t> ciphertext(plaintext.size() + NOISE_TAG_SIZE);
+    std::copy(plaintext.begin(), plaintext.end(), ciphertext.begin());
+    if (!encrypt_in_place(ciphertext.data(), plaintext.size(), ciphertext.data() + plaintext.size(),
+                          ad.data(), ad.size())) {
+        return {};
+    }
+    return ciphertext;
 }
 
 std::vector<uint8_t> NoiseCipherState::decrypt_with_ad(const std::vector<uint8_t>& ciphertext,
                                                       const std::vector<uint8_t>& ad) {
+    std::vector<uint8_t> plaintext;
+    if (!decrypt_with_ad(ciphertext, ad, plaintext)) {
+        return {};
+    }
+    return plaintext;
+}
+
+bool NoiseCipherState::decrypt_with_ad(const std::vector<uint8_t>& ciphertext,
+                                       const std::vector<uint8_t>& ad,
+                                       std::vector<uint8_t>& plaintext) {
     if (!has_key_) {
-        return ciphertext;  // No decryption if no key
+        plaintext = ciphertext;  // No decryption if no key
+        return true;
     }
     
-    auto result = NoiseCrypto::decrypt(key_, nonce_, ciphertext, ad);
-    if (!result.empty()) {
-        nonce_++;
+    if (ciphertext.size() < NOISE_TAG_SIZE) {
+        return false;
     }
-    return result;
+    
+    size_t plaintext_size = ciphertext.size() - NOISE_TAG_SIZE;
+    plaintext.assign(ciphertext.begin(), ciphertext.begin() + plaintext_size);
+    if (!decrypt_in_place(plaintext.data(), plaintext_size, ciphertext.data() + plaintext_size,
+                          ad.data(), ad.size())) {
+        plaintext.clear();
+        return false;
+    }
+    return true;
+}
+
+bool NoiseCipherState::encrypt_in_place(uint8_t* data, size_t size, uint8_t* tag,
+                                        const uint8_t* ad, size_t ad_size) {
+    // The maximum nonce value is reserved by the Noise specification
+    if (!has_key_ || nonce_ == UINT64_MAX) {
+        return false;
+    }
+    
+    NoiseCrypto::encrypt_in_place(key_, nonce_, ad, ad_size, data, size, tag);
+    nonce_++;
+    return true;
+}
+
+bool NoiseCipherState::decrypt_in_place(uint8_t* data, size_t size, const uint8_t* tag,
+                                        const uint8_t* ad, size_t ad_size) {
+    if (!has_key_ || nonce_ == UINT64_MAX) {
+        return false;
+    }
+    
+    // The nonce only advances for messages that authenticate
+    if (!NoiseCrypto::decrypt_in_place(key_, nonce_, ad, ad_size, data, size, tag)) {
+        return false;
+    }
+    nonce_++;
+    return true;
 }
 
 //=============================================================================
@@ -474,42 +1297,48 @@ void NoiseSymmetricState::initialize(const std::string& protocol_name) {
 }
 
 void NoiseSymmetricState::mix_key(const std::vector<uint8_t>& input_key_material) {
-    std::vector<uint8_t> temp_k(NOISE_KEY_SIZE);
+    // ck, temp_k = HKDF(ck, input_key_material, 2)
+    uint8_t output[2 * NOISE_HASH_SIZE];
     std::vector<uint8_t> salt(ck_.begin(), ck_.end());
-    
-    NoiseCrypto::hkdf(salt, input_key_material, {}, temp_k.data(), NOISE_KEY_SIZE);
-    NoiseCrypto::hkdf(salt, input_key_material, {1}, ck_.data(), NOISE_KEY_SIZE);
+    NoiseCrypto::hkdf(salt, input_key_material, {}, output, sizeof(output));
     
     NoiseKey key;
-    std::memcpy(key.data(), temp_k.data(), NOISE_KEY_SIZE);
+    std::memcpy(ck_.data(), output, NOISE_HASH_SIZE);
+    std::memcpy(key.data(), output + NOISE_HASH_SIZE, NOISE_KEY_SIZE);
     cipher_state_.initialize_key(key);
     
-    NoiseCrypto::secure_memzero(temp_k.data(), temp_k.size());
+    NoiseCrypto::secure_memzero(output, sizeof(output));
+    NoiseCrypto::secure_memzero(salt.data(), salt.size());
+    NoiseCrypto::secure_memzero(key.data(), key.size());
 }
 
 void NoiseSymmetricState::mix_hash(const std::vector<uint8_t>& data) {
-    std::vector<uint8_t> hash_input(h_.begin(), h_.end());
-    hash_input.insert(hash_input.end(), data.begin(), data.end());
-    h_ = NoiseCrypto::hash(hash_input);
+    mix_hash(data.data(), data.size());
+}
+
+void NoiseSymmetricState::mix_hash(const uint8_t* data, size_t size) {
+    SHA256 hasher;
+    hasher.update(h_.data(), h_.size());
+    hasher.update(data, size);
+    hasher.finalize(h_.data());
 }
 
 void NoiseSymmetricState::mix_key_and_hash(const std::vector<uint8_t>& input_key_material) {
-    std::vector<uint8_t> temp_h(NOISE_HASH_SIZE);
-    std::vector<uint8_t> temp_k(NOISE_KEY_SIZE);
+    // ck, temp_h, temp_k = HKDF(ck, input_key_material, 3)
+    uint8_t output[3 * NOISE_HASH_SIZE];
     std::vector<uint8_t> salt(ck_.begin(), ck_.end());
+    NoiseCrypto::hkdf(salt, input_key_material, {}, output, sizeof(output));
     
-    NoiseCrypto::hkdf(salt, input_key_material, {}, temp_h.data(), NOISE_HASH_SIZE);
-    NoiseCrypto::hkdf(salt, input_key_material, {1}, temp_k.data(), NOISE_KEY_SIZE);
-    NoiseCrypto::hkdf(salt, input_key_material, {2}, ck_.data(), NOISE_KEY_SIZE);
-    
-    std::memcpy(h_.data(), temp_h.data(), NOISE_HASH_SIZE);
+    std::memcpy(ck_.data(), output, NOISE_HASH_SIZE);
+    mix_hash(output + NOISE_HASH_SIZE, NOISE_HASH_SIZE);
     
     NoiseKey key;
-    std::memcpy(key.data(), temp_k.data(), NOISE_KEY_SIZE);
+    std::memcpy(key.data(), output + 2 * NOISE_HASH_SIZE, NOISE_KEY_SIZE);
     cipher_state_.initialize_key(key);
     
-    NoiseCrypto::secure_memzero(temp_h.data(), temp_h.size());
-    NoiseCrypto::secure_memzero(temp_k.data(), temp_k.size());
+    NoiseCrypto::secure_memzero(output, sizeof(output));
+    NoiseCrypto::secure_memzero(salt.data(), salt.size());
+    NoiseCrypto::secure_memzero(key.data(), key.size());
 }
 
 std::vector<uint8_t> NoiseSymmetricState::encrypt_and_hash(const std::vector<uint8_t>& plaintext) {
@@ -519,60 +1348,88 @@ std::vector<uint8_t> NoiseSymmetricState::encrypt_and_hash(const std::vector<uin
 }
 
 std::vector<uint8_t> NoiseSymmetricState::decrypt_and_hash(const std::vector<uint8_t>& ciphertext) {
-    auto plaintext = cipher_state_.decrypt_with_ad(ciphertext, std::vector<uint8_t>(h_.begin(), h_.end()));
-    if (!plaintext.empty()) {
-        mix_hash(ciphertext);
+    std::vector<uint8_t> plaintext;
+    if (!decrypt_and_hash(ciphertext, plaintext)) {
+        return {};
     }
     return plaintext;
 }
 
+bool NoiseSymmetricState::decrypt_and_hash(const std::vector<uint8_t>& ciphertext, std::vector<uint8_t>& plaintext) {
+    if (!cipher_state_.decrypt_with_ad(ciphertext, std::vector<uint8_t>(h_.begin(), h_.end()), plaintext)) {
+        return false;
+    }
+    mix_hash(ciphertext);
+    return true;
+}
+
 std::pair<NoiseCipherState, NoiseCipherState> NoiseSymmetricState::split() {
-    std::vector<uint8_t> temp_k1(NOISE_KEY_SIZE);
-    std::vector<uint8_t> temp_k2(NOISE_KEY_SIZE);
+    // temp_k1, temp_k2 = HKDF(ck, zerolen, 2)
+    uint8_t output[2 * NOISE_HASH_SIZE];
     std::vector<uint8_t> salt(ck_.begin(), ck_.end());
-    
-    NoiseCrypto::hkdf(salt, {}, {}, temp_k1.data(), NOISE_KEY_SIZE);
-    NoiseCrypto::hkdf(salt, {}, {1}, temp_k2.data(), NOISE_KEY_SIZE);
+    NoiseCrypto::hkdf(salt, {}, {}, output, sizeof(output));
     
     NoiseCipherState c1, c2;
     NoiseKey key1, key2;
-    std::memcpy(key1.data(), temp_k1.data(), NOISE_KEY_SIZE);
-    std::memcpy(key2.data(), temp_k2.data(), NOISE_KEY_SIZE);
+    std::memcpy(key1.data(), output, NOISE_KEY_SIZE);
+    std::memcpy(key2.data(), output + NOISE_HASH_SIZE, NOISE_KEY_SIZE);
     
     c1.initialize_key(key1);
     c2.initialize_key(key2);
     
-    NoiseCrypto::secure_memzero(temp_k1.data(), temp_k1.size());
-    NoiseCrypto::secure_memzero(temp_k2.data(), temp_k2.size());
+    NoiseCrypto::secure_memzero(output, sizeof(output));
+    NoiseCrypto::secure_memzero(key1.data(), key1.size());
+    NoiseCrypto::secure_memzero(key2.data(), key2.size());
     
     return std::make_pair(std::move(c1), std::move(c2));
 }
 
+void NoiseSymmetricState::derive_ticket(NoiseTicketId& id, NoiseKey& secret) const {
+    // id, secret = HKDF(ck, label, 2): other input key material than split(), so the
+    // ticket reveals nothing about the transport keys
+    uint8_t output[2 * NOISE_HASH_SIZE];
+    std::vector<uint8_t> salt(ck_.begin(), ck_.end());
+    std::vector<uint8_t> label(NOISE_TICKET_LABEL, NOISE_TICKET_LABEL + sizeof(NOISE_TICKET_LABEL) - 1);
+    NoiseCrypto::hkdf(salt, label, {}, output, sizeof(output));
+    
+    std::memcpy(id.data(), output, NOISE_TICKET_ID_SIZE);
+    std::memcpy(secret.data(), output + NOISE_HASH_SIZE, NOISE_KEY_SIZE);
+    
+    NoiseCrypto::secure_memzero(output, sizeof(output));
+    NoiseCrypto::secure_memzero(salt.data(), salt.size());
+}
+
 //=============================================================================
 // NoiseHandshake Implementation
 //=============================================================================
 
-NoiseHandshake::NoiseHandshake() : role_(NoiseRole::INITIATOR), state_(NoiseHandshakeState::UNINITIALIZED) {
+NoiseHandshake::NoiseHandshake()
+    : role_(NoiseRole::INITIATOR), state_(NoiseHandshakeState::UNINITIALIZED), pattern_(NoiseHandshakePattern::XX) {
     s_.fill(0);
     e_.fill(0);
     rs_.fill(0);
     re_.fill(0);
+    ticket_.id.fill(0);
+    ticket_.secret.fill(0);
+    ticket_.remote_static_key.fill(0);
 }
 
 NoiseHandshake::~NoiseHandshake() {
     NoiseCrypto::secure_memzero(s_.data(), s_.size());
     NoiseCrypto::secure_memzero(e_.data(), e_.size());
+    NoiseCrypto::secure_memzero(ticket_.secret.data(), ticket_.secret.size());
 }
 
 bool NoiseHandshake::initialize(NoiseRole role, const NoiseKey& static_private_key) {
     role_ = role;
     s_ = static_private_key;
-    
-    symmetric_state_.initialize(NOISE_PROTOCOL_NAME);
+    pattern_ = NoiseHandshakePattern::XX;
     
     if (role == NoiseRole::INITIATOR) {
+        initialize_symmetric_state(NoiseHandshakePattern::XX, nullptr, 0);  // Empty prologue
         state_ = NoiseHandshakeState::WRITE_MESSAGE_1;
     } else {
+        // The pattern, and with it the protocol name, is known once the first message arrives
         state_ = NoiseHandshakeState::READ_MESSAGE_1;
     }
     
@@ -580,63 +1437,63 @@ bool NoiseHandshake::initialize(NoiseRole role, const NoiseKey& static_private_k
     return true;
 }
 
+bool NoiseHandshake::initialize_with_remote_key(const NoiseKey& static_private_key, const NoiseKey& remote_static_public_key) {
+    role_ = NoiseRole::INITIATOR;
+    s_ = static_private_key;
+    rs_ = remote_static_public_key;
+    pattern_ = NoiseHandshakePattern::IK;
+    
+    initialize_symmetric_state(NoiseHandshakePattern::IK, nullptr, 0);
+    symmetric_state_.mix_hash(rs_.data(), rs_.size());  // <- s (pre-message)
+    state_ = NoiseHandshakeState::WRITE_MESSAGE_1;
+    
+    LOG_NOISE_INFO("Initialized Noise IK handshake as initiator");
+    return true;
+}
+
+bool NoiseHandshake::initialize_with_ticket(const NoiseKey& static_private_key, const NoiseSessionTicket& ticket) {
+    role_ = NoiseRole::INITIATOR;
+    s_ = static_private_key;
+    ticket_ = ticket;
+    rs_ = ticket.remote_static_key;
+    pattern_ = NoiseHandshakePattern::NNPSK0;
+    
+    // The ticket ID travels in clear; as the prologue it cannot be swapped undetected
+    initialize_symmetric_state(NoiseHandshakePattern::NNPSK0, ticket_.id.data(), ticket_.id.size());
+    state_ = NoiseHandshakeState::WRITE_MESSAGE_1;
+    
+    LOG_NOISE_INFO("Initialized Noise NNpsk0 handshake as initiator (session resumption)");
+    return true;
+}
+
 std::vector<uint8_t> NoiseHandshake::write_message(const std::vector<uint8_t>& payload) {
     std::vector<uint8_t> message;
     
     try {
         switch (state_) {
-            case NoiseHandshakeState::WRITE_MESSAGE_1: {
-                // -> e
-                NoiseKey e_public = NoiseCrypto::generate_keypair(e_);
-                message.insert(message.end(), e_public.begin(), e_public.end());
-                symmetric_state_.mix_hash(std::vector<uint8_t>(e_public.begin(), e_public.end()));
+            case NoiseHandshakeState::WRITE_MESSAGE_1:
+                write_message_1(message);
                 break;
-            }
-            
-            case NoiseHandshakeState::WRITE_MESSAGE_2: {
-                // <- e, ee, s, es
-                NoiseKey e_public = NoiseCrypto::generate_keypair(e_);
-                message.insert(message.end(), e_public.begin(), e_public.end());
-                symmetric_state_.mix_hash(std::vector<uint8_t>(e_public.begin(), e_public.end()));
-                
-                // ee
-                NoiseKey ee = NoiseCrypto::dh(e_, re_);
-                symmetric_state_.mix_key(std::vector<uint8_t>(ee.begin(), ee.end()));
-                
-                // s
-                NoiseKey s_public = NoiseCrypto::generate_keypair(s_);  // Get public from private
-                auto encrypted_s = symmetric_state_.encrypt_and_hash(std::vector<uint8_t>(s_public.begin(), s_public.end()));
-                message.insert(message.end(), encrypted_s.begin(), encrypted_s.end());
-                
-                // es
-                NoiseKey es = NoiseCrypto::dh(s_, re_);
-                symmetric_state_.mix_key(std::vector<uint8_t>(es.begin(), es.end()));
+            case NoiseHandshakeState::WRITE_MESSAGE_2:
+                write_message_2(message);
                 break;
-            }
-            
-            case NoiseHandshakeState::WRITE_MESSAGE_3: {
-                // -> s, se
-                NoiseKey s_public = NoiseCrypto::generate_keypair(s_);  // Get public from private
-                auto encrypted_s = symmetric_state_.encrypt_and_hash(std::vector<uint8_t>(s_public.begin(), s_public.end()));
-                message.insert(message.end(), encrypted_s.begin(), encrypted_s.end());
-                
-                // se
-                NoiseKey se = NoiseCrypto::dh(s_, re_);
-                symmetric_state_.mix_key(std::vector<uint8_t>(se.begin(), se.end()));
+            case NoiseHandshakeState::WRITE_MESSAGE_3:
+                write_message_3(message);
                 break;
-            }
-            
             default:
                 LOG_NOISE_ERROR("Invalid state for write_message: " << static_cast<int>(state_));
                 fail_handshake();
                 return {};
         }
         
-        // Encrypt payload
-        if (!payload.empty()) {
-            auto encrypted_payload = symmetric_state_.encrypt_and_hash(payload);
-            message.insert(message.end(), encrypted_payload.begin(), encrypted_payload.end());
+        // Encrypt payload (always, so that an empty payload still carries a tag once a key is set)
+        auto encrypted_payload = symmetric_state_.encrypt_and_hash(payload);
+        if (encrypted_payload.size() < payload.size()) {
+            LOG_NOISE_ERROR("Failed to encrypt handshake payload");
+            fail_handshake();
+            return {};
         }
+        message.insert(message.end(), encrypted_payload.begin(), encrypted_payload.end());
         
         advance_state();
         LOG_NOISE_DEBUG("Wrote handshake message, new state: " << static_cast<int>(state_));
@@ -652,106 +1509,28 @@ std::vector<uint8_t> NoiseHandshake::write_message(const std::vector<uint8_t>& p
 
 std::vector<uint8_t> NoiseHandshake::read_message(const std::vector<uint8_t>& message) {
     std::vector<uint8_t> payload;
-    size_t offset = 0;
     
     try {
+        bool success = false;
         switch (state_) {
-            case NoiseHandshakeState::READ_MESSAGE_1: {
-                // -> e
-                if (message.size() < NOISE_KEY_SIZE) {
-                    LOG_NOISE_ERROR("Message too short for e");
-                    fail_handshake();
-                    return {};
-                }
-                
-                std::memcpy(re_.data(), message.data() + offset, NOISE_KEY_SIZE);
-                offset += NOISE_KEY_SIZE;
-                symmetric_state_.mix_hash(std::vector<uint8_t>(re_.begin(), re_.end()));
+            case NoiseHandshakeState::READ_MESSAGE_1:
+                success = read_message_1(message, payload);
                 break;
-            }
-            
-            case NoiseHandshakeState::READ_MESSAGE_2: {
-                // <- e, ee, s, es
-                if (message.size() < NOISE_KEY_SIZE) {
-                    LOG_NOISE_ERROR("Message too short for e");
-                    fail_handshake();
-                    return {};
-                }
-                
-                std::memcpy(re_.data(), message.data() + offset, NOISE_KEY_SIZE);
-                offset += NOISE_KEY_SIZE;
-                symmetric_state_.mix_hash(std::vector<uint8_t>(re_.begin(), re_.end()));
-                
-                // ee
-                NoiseKey ee = NoiseCrypto::dh(e_, re_);
-                symmetric_state_.mix_key(std::vector<uint8_t>(ee.begin(), ee.end()));
-                
-                // s
-                size_t s_encrypted_size = NOISE_KEY_SIZE + NOISE_TAG_SIZE;
-                if (message.size() < offset + s_encrypted_size) {
-                    LOG_NOISE_ERROR("Message too short for encrypted s");
-                    fail_handshake();
-                    return {};
-                }
-                
-                std::vector<uint8_t> encrypted_s(message.begin() + offset, message.begin() + offset + s_encrypted_size);
-                offset += s_encrypted_size;
-                
-                auto decrypted_s = symmetric_state_.decrypt_and_hash(encrypted_s);
-                if (decrypted_s.size() != NOISE_KEY_SIZE) {
-                    LOG_NOISE_ERROR("Failed to decrypt s");
-                    fail_handshake();
-                    return {};
-                }
-                std::memcpy(rs_.data(), decrypted_s.data(), NOISE_KEY_SIZE);
-                
-                // es
-                NoiseKey es = NoiseCrypto::dh(e_, rs_);
-                symmetric_state_.mix_key(std::vector<uint8_t>(es.begin(), es.end()));
+            case NoiseHandshakeState::READ_MESSAGE_2:
+                success = read_message_2(message, payload);
                 break;
-            }
-            
-            case NoiseHandshakeState::READ_MESSAGE_3: {
-                // -> s, se
-                size_t s_encrypted_size = NOISE_KEY_SIZE + NOISE_TAG_SIZE;
-                if (message.size() < s_encrypted_size) {
-                    LOG_NOISE_ERROR("Message too short for encrypted s");
-                    fail_handshake();
-                    return {};
-                }
-                
-                std::vector<uint8_t> encrypted_s(message.begin() + offset, message.begin() + offset + s_encrypted_size);
-                offset += s_encrypted_size;
-                
-                auto decrypted_s = symmetric_state_.decrypt_and_hash(encrypted_s);
-                if (decrypted_s.size() != NOISE_KEY_SIZE) {
-                    LOG_NOISE_ERROR("Failed to decrypt s");
-                    fail_handshake();
-                    return {};
-                }
-                std::memcpy(rs_.data(), decrypted_s.data(), NOISE_KEY_SIZE);
-                
-                // se
-                NoiseKey se = NoiseCrypto::dh(e_, rs_);
-                symmetric_state_.mix_key(std::vector<uint8_t>(se.begin(), se.end()));
+            case NoiseHandshakeState::READ_MESSAGE_3:
+                success = read_message_3(message, payload);
                 break;
-            }
-            
             default:
                 LOG_NOISE_ERROR("Invalid state for read_message: " << static_cast<int>(state_));
                 fail_handshake();
                 return {};
         }
         
-        // Decrypt payload
-        if (offset < message.size()) {
-            std::vector<uint8_t> encrypted_payload(message.begin() + offset, message.end());
-            payload = symmetric_state_.decrypt_and_hash(encrypted_payload);
-            if (payload.empty() && !encrypted_payload.empty()) {
-                LOG_NOISE_ERROR("Failed to decrypt payload");
-                fail_handshake();
-                return {};
-            }
+        if (!success) {
+            fail_handshake();
+            return {};
         }
         
         advance_state();
@@ -766,6 +1545,302 @@ std::vector<uint8_t> NoiseHandshake::read_message(const std::vector<uint8_t>& me
     return payload;
 }
 
+void NoiseHandshake::write_message_1(std::vector<uint8_t>& message) {
+    if (pattern_ == NoiseHandshakePattern::IK) {
+        message.push_back(NOISE_PATTERN_MARKER_IK);
+    } else if (pattern_ == NoiseHandshakePattern::NNPSK0) {
+        message.push_back(NOISE_PATTERN_MARKER_NNPSK0);
+        message.insert(message.end(), ticket_.id.begin(), ticket_.id.end());
+        
+        // psk
+        symmetric_state_.mix_key_and_hash(std::vector<uint8_t>(ticket_.secret.begin(), ticket_.secret.end()));
+    }
+    
+    // -> e
+    NoiseKey e_public = NoiseCrypto::generate_keypair(e_);
+    message.insert(message.end(), e_public.begin(), e_public.end());
+    symmetric_state_.mix_hash(e_public.data(), e_public.size());
+    if (pattern_ == NoiseHandshakePattern::NNPSK0) {
+        // With a PSK, ephemeral keys are mixed into the cipher key as well
+        symmetric_state_.mix_key(std::vector<uint8_t>(e_public.begin(), e_public.end()));
+    }
+    
+    if (pattern_ == NoiseHandshakePattern::IK) {
+        // es
+        NoiseKey es = NoiseCrypto::dh(e_, rs_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(es.begin(), es.end()));
+        
+        // s
+        NoiseKey s_public = NoiseCrypto::public_key(s_);
+        auto encrypted_s = symmetric_state_.encrypt_and_hash(std::vector<uint8_t>(s_public.begin(), s_public.end()));
+        message.insert(message.end(), encrypted_s.begin(), encrypted_s.end());
+        
+        // ss
+        NoiseKey ss = NoiseCrypto::dh(s_, rs_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(ss.begin(), ss.end()));
+    }
+}
+
+void NoiseHandshake::write_message_2(std::vector<uint8_t>& message) {
+    if (pattern_ != NoiseHandshakePattern::XX) {
+        message.push_back(pattern_ == NoiseHandshakePattern::XX_FALLBACK ? NOISE_REPLY_FALLBACK : NOISE_REPLY_ACCEPTED);
+    }
+    
+    // <- e
+    NoiseKey e_public = NoiseCrypto::generate_keypair(e_);
+    message.insert(message.end(), e_public.begin(), e_public.end());
+    symmetric_state_.mix_hash(e_public.data(), e_public.size());
+    if (pattern_ == NoiseHandshakePattern::NNPSK0) {
+        symmetric_state_.mix_key(std::vector<uint8_t>(e_public.begin(), e_public.end()));
+    }
+    
+    // ee
+    NoiseKey ee = NoiseCrypto::dh(e_, re_);
+    symmetric_state_.mix_key(std::vector<uint8_t>(ee.begin(), ee.end()));
+    
+    if (pattern_ == NoiseHandshakePattern::IK) {
+        // se
+        NoiseKey se = NoiseCrypto::dh(e_, rs_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(se.begin(), se.end()));
+    } else if (pattern_ != NoiseHandshakePattern::NNPSK0) {
+        // s
+        NoiseKey s_public = NoiseCrypto::public_key(s_);
+        auto encrypted_s = symmetric_state_.encrypt_and_hash(std::vector<uint8_t>(s_public.begin(), s_public.end()));
+        message.insert(message.end(), encrypted_s.begin(), encrypted_s.end());
+        
+        // es
+        NoiseKey es = NoiseCrypto::dh(s_, re_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(es.begin(), es.end()));
+    }
+}
+
+void NoiseHandshake::write_message_3(std::vector<uint8_t>& message) {
+    // -> s
+    NoiseKey s_public = NoiseCrypto::public_key(s_);
+    auto encrypted_s = symmetric_state_.encrypt_and_hash(std::vector<uint8_t>(s_public.begin(), s_public.end()));
+    message.insert(message.end(), encrypted_s.begin(), encrypted_s.end());
+    
+    // se
+    NoiseKey se = NoiseCrypto::dh(s_, re_);
+    symmetric_state_.mix_key(std::vector<uint8_t>(se.begin(), se.end()));
+}
+
+bool NoiseHandshake::read_message_1(const std::vector<uint8_t>& message, std::vector<uint8_t>& payload) {
+    size_t offset = 0;
+    bool have_ticket = false;
+    
+    if (message.size() == NOISE_KEY_SIZE) {
+        pattern_ = NoiseHandshakePattern::XX;
+        initialize_symmetric_state(NoiseHandshakePattern::XX, nullptr, 0);
+    } else if (!message.empty() && message[0] == NOISE_PATTERN_MARKER_IK) {
+        pattern_ = NoiseHandshakePattern::IK;
+        offset = 1;
+        initialize_symmetric_state(NoiseHandshakePattern::IK, nullptr, 0);
+        NoiseKey s_public = NoiseCrypto::public_key(s_);
+        symmetric_state_.mix_hash(s_public.data(), s_public.size());  // <- s (pre-message)
+    } else if (!message.empty() && message[0] == NOISE_PATTERN_MARKER_NNPSK0) {
+        pattern_ = NoiseHandshakePattern::NNPSK0;
+        offset = 1;
+        if (message.size() < offset + NOISE_TICKET_ID_SIZE) {
+            LOG_NOISE_ERROR("Message too short for ticket ID");
+            return false;
+        }
+        NoiseTicketId ticket_id;
+        std::memcpy(ticket_id.data(), message.data() + offset, NOISE_TICKET_ID_SIZE);
+        offset += NOISE_TICKET_ID_SIZE;
+        
+        initialize_symmetric_state(NoiseHandshakePattern::NNPSK0, ticket_id.data(), ticket_id.size());
+        have_ticket = ticket_lookup_ && ticket_lookup_(ticket_id, ticket_);
+        if (have_ticket) {
+            // psk
+            symmetric_state_.mix_key_and_hash(std::vector<uint8_t>(ticket_.secret.begin(), ticket_.secret.end()));
+            rs_ = ticket_.remote_static_key;
+        }
+    } else {
+        LOG_NOISE_ERROR("Unknown handshake pattern in first message");
+        return false;
+    }
+    
+    // -> e
+    if (message.size() < offset + NOISE_KEY_SIZE) {
+        LOG_NOISE_ERROR("Message too short for e");
+        return false;
+    }
+    std::memcpy(re_.data(), message.data() + offset, NOISE_KEY_SIZE);
+    offset += NOISE_KEY_SIZE;
+    
+    if (pattern_ == NoiseHandshakePattern::NNPSK0 && !have_ticket) {
+        LOG_NOISE_DEBUG("Unknown or expired session ticket, falling back to XX");
+        begin_fallback();
+        return true;
+    }
+    
+    symmetric_state_.mix_hash(re_.data(), re_.size());
+    if (pattern_ == NoiseHandshakePattern::NNPSK0) {
+        symmetric_state_.mix_key(std::vector<uint8_t>(re_.begin(), re_.end()));
+    }
+    
+    if (pattern_ == NoiseHandshakePattern::IK) {
+        // es
+        NoiseKey es = NoiseCrypto::dh(s_, re_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(es.begin(), es.end()));
+        
+        // s (does not decrypt if the initiator used a static key of ours that is no longer current)
+        if (message.size() < offset + NOISE_KEY_SIZE + NOISE_TAG_SIZE) {
+            LOG_NOISE_ERROR("Message too short for encrypted s");
+            return false;
+        }
+        if (!read_remote_static(message, offset)) {
+            LOG_NOISE_DEBUG("IK message not encrypted to our static key, falling back to XX");
+            begin_fallback();
+            return true;
+        }
+        
+        // ss
+        NoiseKey ss = NoiseCrypto::dh(s_, rs_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(ss.begin(), ss.end()));
+    }
+    
+    if (pattern_ == NoiseHandshakePattern::NNPSK0) {
+        // The payload tag is the only proof of the ticket secret
+        std::vector<uint8_t> encrypted_payload(message.begin() + offset, message.end());
+        if (!symmetric_state_.decrypt_and_hash(encrypted_payload, payload)) {
+            LOG_NOISE_DEBUG("Session ticket secret did not match, falling back to XX");
+            payload.clear();
+            begin_fallback();
+        }
+        return true;
+    }
+    
+    return read_payload(message, offset, payload);
+}
+
+bool NoiseHandshake::read_message_2(const std::vector<uint8_t>& message, std::vector<uint8_t>& payload) {
+    size_t offset = 0;
+    
+    if (pattern_ != NoiseHandshakePattern::XX) {
+        if (message.empty()) {
+            LOG_NOISE_ERROR("Empty handshake response");
+            return false;
+        }
+        uint8_t reply = message[offset++];
+        if (reply == NOISE_REPLY_FALLBACK) {
+            LOG_NOISE_INFO("Responder could not use our " << (pattern_ == NoiseHandshakePattern::IK ? "IK" : "NNpsk0")
+                           << " message, continuing with XXfallback");
+            begin_fallback();
+        } else if (reply != NOISE_REPLY_ACCEPTED) {
+            LOG_NOISE_ERROR("Unexpected handshake response type " << static_cast<int>(reply));
+            return false;
+        }
+    }
+    
+    // <- e
+    if (message.size() < offset + NOISE_KEY_SIZE) {
+        LOG_NOISE_ERROR("Message too short for e");
+        return false;
+    }
+    std::memcpy(re_.data(), message.data() + offset, NOISE_KEY_SIZE);
+    offset += NOISE_KEY_SIZE;
+    symmetric_state_.mix_hash(re_.data(), re_.size());
+    if (pattern_ == NoiseHandshakePattern::NNPSK0) {
+        symmetric_state_.mix_key(std::vector<uint8_t>(re_.begin(), re_.end()));
+    }
+    
+    // ee
+    NoiseKey ee = NoiseCrypto::dh(e_, re_);
+    symmetric_state_.mix_key(std::vector<uint8_t>(ee.begin(), ee.end()));
+    
+    if (pattern_ == NoiseHandshakePattern::IK) {
+        // se
+        NoiseKey se = NoiseCrypto::dh(s_, re_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(se.begin(), se.end()));
+    } else if (pattern_ != NoiseHandshakePattern::NNPSK0) {
+        // s
+        if (!read_remote_static(message, offset)) {
+            LOG_NOISE_ERROR("Failed to decrypt s");
+            return false;
+        }
+        
+        // es
+        NoiseKey es = NoiseCrypto::dh(e_, rs_);
+        symmetric_state_.mix_key(std::vector<uint8_t>(es.begin(), es.end()));
+    }
+    
+    return read_payload(message, offset, payload);
+}
+
+bool NoiseHandshake::read_message_3(const std::vector<uint8_t>& message, std::vector<uint8_t>& payload) {
+    size_t offset = 0;
+    
+    // -> s
+    if (!read_remote_static(message, offset)) {
+        LOG_NOISE_ERROR("Failed to decrypt s");
+        return false;
+    }
+    
+    // se
+    NoiseKey se = NoiseCrypto::dh(e_, rs_);
+    symmetric_state_.mix_key(std::vector<uint8_t>(se.begin(), se.end()));
+    
+    return read_payload(message, offset, payload);
+}
+
+bool NoiseHandshake::read_remote_static(const std::vector<uint8_t>& message, size_t& offset) {
+    size_t s_encrypted_size = NOISE_KEY_SIZE + NOISE_TAG_SIZE;
+    if (message.size() < offset + s_encrypted_size) {
+        return false;
+    }
+    
+    std::vector<uint8_t> encrypted_s(message.begin() + offset, message.begin() + offset + s_encrypted_size);
+    std::vector<uint8_t> decrypted_s;
+    if (!symmetric_state_.decrypt_and_hash(encrypted_s, decrypted_s) || decrypted_s.size() != NOISE_KEY_SIZE) {
+        return false;
+    }
+    
+    std::memcpy(rs_.data(), decrypted_s.data(), NOISE_KEY_SIZE);
+    offset += s_encrypted_size;
+    return true;
+}
+
+bool NoiseHandshake::read_payload(const std::vector<uint8_t>& message, size_t offset, std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> encrypted_payload(message.begin() + offset, message.end());
+    if (!symmetric_state_.decrypt_and_hash(encrypted_payload, payload)) {
+        LOG_NOISE_ERROR("Failed to decrypt payload");
+        return false;
+    }
+    return true;
+}
+
+void NoiseHandshake::initialize_symmetric_state(NoiseHandshakePattern pattern, const uint8_t* prologue, size_t prologue_size) {
+    switch (pattern) {
+        case NoiseHandshakePattern::IK:
+            symmetric_state_.initialize(NOISE_IK_PROTOCOL_NAME);
+            break;
+        case NoiseHandshakePattern::NNPSK0:
+            symmetric_state_.initialize(NOISE_NNPSK0_PROTOCOL_NAME);
+            break;
+        case NoiseHandshakePattern::XX_FALLBACK:
+            symmetric_state_.initialize(NOISE_XX_FALLBACK_PROTOCOL_NAME);
+            break;
+        default:
+            symmetric_state_.initialize(NOISE_PROTOCOL_NAME);
+            break;
+    }
+    symmetric_state_.mix_hash(prologue, prologue_size);
+}
+
+void NoiseHandshake::begin_fallback() {
+    // XXfallback restarts the transcript with the initiator's first ephemeral key as a pre-message
+    NoiseKey initiator_ephemeral = (role_ == NoiseRole::INITIATOR) ? NoiseCrypto::public_key(e_) : re_;
+    
+    pattern_ = NoiseHandshakePattern::XX_FALLBACK;
+    rs_.fill(0);
+    NoiseCrypto::secure_memzero(ticket_.secret.data(), ticket_.secret.size());
+    
+    initialize_symmetric_state(NoiseHandshakePattern::XX_FALLBACK, nullptr, 0);
+    symmetric_state_.mix_hash(initiator_ephemeral.data(), initiator_ephemeral.size());
+}
+
 std::pair<NoiseCipherState, NoiseCipherState> NoiseHandshake::get_cipher_states() {
     if (state_ != NoiseHandshakeState::COMPLETED) {
         return std::make_pair(NoiseCipherState(), NoiseCipherState());
@@ -774,7 +1849,23 @@ std::pair<NoiseCipherState, NoiseCipherState> NoiseHandshake::get_cipher_states(
     return symmetric_state_.split();
 }
 
+bool NoiseHandshake::get_session_ticket(NoiseSessionTicket& ticket) const {
+    if (state_ != NoiseHandshakeState::COMPLETED) {
+        return false;
+    }
+    
+    symmetric_state_.derive_ticket(ticket.id, ticket.secret);
+    ticket.remote_static_key = rs_;
+    
+    // A resumed session keeps the start of its chain, so static keys are proven again once the ticket lifetime ends
+    ticket.issued_at = (pattern_ == NoiseHandshakePattern::NNPSK0) ? ticket_.issued_at : std::chrono::steady_clock::now();
+    return true;
+}
+
 void NoiseHandshake::advance_state() {
+    // IK and NNpsk0 complete after two messages; XX and XXfallback take three
+    bool two_messages = (pattern_ == NoiseHandshakePattern::IK || pattern_ == NoiseHandshakePattern::NNPSK0);
+    
     switch (state_) {
         case NoiseHandshakeState::WRITE_MESSAGE_1:
             state_ = NoiseHandshakeState::READ_MESSAGE_2;
@@ -783,19 +1874,22 @@ void NoiseHandshake::advance_state() {
             state_ = NoiseHandshakeState::WRITE_MESSAGE_2;
             break;
         case NoiseHandshakeState::WRITE_MESSAGE_2:
-            state_ = NoiseHandshakeState::READ_MESSAGE_3;
+            state_ = two_messages ? NoiseHandshakeState::COMPLETED : NoiseHandshakeState::READ_MESSAGE_3;
             break;
         case NoiseHandshakeState::READ_MESSAGE_2:
-            state_ = NoiseHandshakeState::WRITE_MESSAGE_3;
+            state_ = two_messages ? NoiseHandshakeState::COMPLETED : NoiseHandshakeState::WRITE_MESSAGE_3;
             break;
         case NoiseHandshakeState::WRITE_MESSAGE_3:
         case NoiseHandshakeState::READ_MESSAGE_3:
             state_ = NoiseHandshakeState::COMPLETED;
-            LOG_NOISE_INFO("Noise handshake completed successfully");
             break;
         default:
             break;
     }
+    
+    if (state_ == NoiseHandshakeState::COMPLETED) {
+        LOG_NOISE_INFO("Noise handshake completed successfully");
+    }
 }
 
 void NoiseHandshake::fail_handshake() {
@@ -821,6 +1915,18 @@ bool NoiseSession::initialize_as_responder(const NoiseKey& static_private_key) {
     return handshake_state_->initialize(NoiseRole::RESPONDER, static_private_key);
 }
 
+bool NoiseSession::initialize_as_initiator(const NoiseKey& static_private_key, const NoiseKey& remote_static_public_key) {
+    return handshake_state_->initialize_with_remote_key(static_private_key, remote_static_public_key);
+}
+
+bool NoiseSession::initialize_as_resuming_initiator(const NoiseKey& static_private_key, const NoiseSessionTicket& ticket) {
+    return handshake_state_->initialize_with_ticket(static_private_key, ticket);
+}
+
+void NoiseSession::set_ticket_lookup(NoiseHandshake::TicketLookup lookup) {
+    handshake_state_->set_ticket_lookup(std::move(lookup));
+}
+
 bool NoiseSession::is_handshake_completed() const {
     return handshake_completed_;
 }
@@ -886,21 +1992,43 @@ std::vector<uint8_t> NoiseSession::process_handshake_message(const std::vector<u
 }
 
 std::vector<uint8_t> NoiseSession::encrypt_transport_message(const std::vector<uint8_t>& plaintext) {
+    std::vector<uint8_t> ciphertext(plaintext.size() + NOISE_TAG_SIZE);
+    std::copy(plaintext.begin(), plaintext.end(), ciphertext.begin());
+    if (!encrypt_transport_message(ciphertext.data(), plaintext.size(), ciphertext.data() + plaintext.size())) {
+        return {};
+    }
+    return ciphertext;
+}
+
+std::vector<uint8_t> NoiseSession::decrypt_transport_message(const std::vector<uint8_t>& ciphertext) {
+    if (ciphertext.size() < NOISE_TAG_SIZE) {
+        return {};
+    }
+    
+    size_t plaintext_size = ciphertext.size() - NOISE_TAG_SIZE;
+    std::vector<uint8_t> plaintext(ciphertext.begin(), ciphertext.begin() + plaintext_size);
+    if (!decrypt_transport_message(plaintext.data(), plaintext_size, ciphertext.data() + plaintext_size)) {
+        return {};
+    }
+    return plaintext;
+}
+
+bool NoiseSession::encrypt_transport_message(uint8_t* data, size_t size, uint8_t* tag) {
     if (!handshake_completed_ || !send_cipher_) {
         LOG_NOISE_ERROR("Cannot encrypt: handshake not completed");
-        return {};
+        return false;
     }
     
-    return send_cipher_->encrypt_with_ad(plaintext);
+    return send_cipher_->encrypt_in_place(data, size, tag);
 }
 
-std::vector<uint8_t> NoiseSession::decrypt_transport_message(const std::vector<uint8_t>& ciphertext) {
+bool NoiseSession::decrypt_transport_message(uint8_t* data, size_t size, const uint8_t* tag) {
     if (!handshake_completed_ || !receive_cipher_) {
         LOG_NOISE_ERROR("Cannot decrypt: handshake not completed");
-        return {};
+        return false;
     }
     
-    return receive_cipher_->decrypt_with_ad(ciphertext);
+    return receive_cipher_->decrypt_in_place(data, size, tag);
 }
 
 NoiseRole NoiseSession::get_role() const {
@@ -911,10 +2039,18 @@ NoiseHandshakeState NoiseSession::get_handshake_state() const {
     return handshake_state_->get_state();
 }
 
+NoiseHandshakePattern NoiseSession::get_handshake_pattern() const {
+    return handshake_state_->get_pattern();
+}
+
 const NoiseKey& NoiseSession::get_remote_static_public_key() const {
     return handshake_state_->get_remote_static_public_key();
 }
 
+bool NoiseSession::get_session_ticket(NoiseSessionTicket& ticket) const {
+    return handshake_state_->get_session_ticket(ticket);
+}
+
 //=============================================================================
 // Utility Functions Implementation
 //=============================================================================
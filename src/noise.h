@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
+#include <chrono>
 #include <cstdint>
 
 namespace librats {
@@ -13,10 +15,12 @@ constexpr size_t NOISE_KEY_SIZE = 32;      // 32 bytes for Curve25519 keys
 constexpr size_t NOISE_HASH_SIZE = 32;     // 32 bytes for SHA256
 constexpr size_t NOISE_TAG_SIZE = 16;      // 16 bytes for ChaCha20-Poly1305 tag
 constexpr size_t NOISE_MAX_MESSAGE_SIZE = 65535; // Maximum noise message size
+constexpr size_t NOISE_TICKET_ID_SIZE = 16; // Session ticket identifier
 
 // Noise key types
 using NoiseKey = std::array<uint8_t, NOISE_KEY_SIZE>;
 using NoiseHash = std::array<uint8_t, NOISE_HASH_SIZE>;
+using NoiseTicketId = std::array<uint8_t, NOISE_TICKET_ID_SIZE>;
 
 /**
  * Noise Protocol handshake state enumeration
@@ -41,16 +45,50 @@ enum class NoiseRole {
     RESPONDER           // The peer that responds to the handshake
 };
 
+/**
+ * Noise handshake pattern of a session
+ */
+enum class NoiseHandshakePattern {
+    XX,                 // Full handshake, static keys sent encrypted (3 messages)
+    IK,                 // Initiator already knows the responder's static key (2 messages)
+    NNPSK0,             // Resumption: a session ticket secret as PSK, ephemeral DH only (2 messages)
+    XX_FALLBACK         // Responder could not use an IK/NNpsk0 first message and continued as XX
+};
+
+/**
+ * Resumption ticket derived by both sides from a completed handshake.
+ * A later NNpsk0 handshake proves knowledge of the secret instead of
+ * running the static key DH operations again.
+ */
+struct NoiseSessionTicket {
+    NoiseTicketId id;
+    NoiseKey secret;                                    // PSK of the resumption handshake
+    NoiseKey remote_static_key;                         // Peer identity authenticated when the chain started
+    std::chrono::steady_clock::time_point issued_at;    // Time of the last full handshake in the chain
+};
+
+/**
+ * ChaCha20 implementation used by the AEAD cipher.
+ * The fastest one supported by the CPU is selected at startup.
+ */
+enum class NoiseCipherBackend {
+    SCALAR,             // Portable, one block at a time
+    SSE2,               // x86, 4 blocks in parallel
+    AVX2,               // x86, 8 blocks in parallel
+    NEON                // ARM, 4 blocks in parallel
+};
+
 /**
  * Cryptographic functions interface for Noise Protocol
  */
 class NoiseCrypto {
 public:
-    // ECDH operations using Curve25519
+    // ECDH operations using X25519 (RFC 7748)
     static NoiseKey generate_keypair(NoiseKey& private_key);
+    static NoiseKey public_key(const NoiseKey& private_key);
     static NoiseKey dh(const NoiseKey& private_key, const NoiseKey& public_key);
     
-    // AEAD encryption/decryption using ChaCha20-Poly1305
+    // AEAD encryption/decryption using ChaCha20-Poly1305 (RFC 8439)
     static std::vector<uint8_t> encrypt(const NoiseKey& key, uint64_t nonce, 
                                        const std::vector<uint8_t>& plaintext,
                                        const std::vector<uint8_t>& ad = {});
@@ -58,6 +96,39 @@ public:
                                        const std::vector<uint8_t>& ciphertext,
                                        const std::vector<uint8_t>& ad = {});
     
+    /**
+     * Encrypt a buffer in place
+     * @param key Cipher key
+     * @param nonce Message nonce
+     * @param ad Associated data (may be nullptr if ad_size is 0)
+     * @param ad_size Associated data size
+     * @param data Plaintext, replaced by the ciphertext
+     * @param size Data size
+     * @param tag Receives the NOISE_TAG_SIZE byte authentication tag
+     */
+    static void encrypt_in_place(const NoiseKey& key, uint64_t nonce, const uint8_t* ad, size_t ad_size,
+                                 uint8_t* data, size_t size, uint8_t tag[NOISE_TAG_SIZE]);
+    
+    /**
+     * Authenticate and decrypt a buffer in place
+     * @param key Cipher key
+     * @param nonce Message nonce
+     * @param ad Associated data (may be nullptr if ad_size is 0)
+     * @param ad_size Associated data size
+     * @param data Ciphertext, replaced by the plaintext on success (left untouched on failure)
+     * @param size Data size
+     * @param tag Authentication tag of the message
+     * @return true if the tag is valid, false otherwise
+     */
+    static bool decrypt_in_place(const NoiseKey& key, uint64_t nonce, const uint8_t* ad, size_t ad_size,
+                                 uint8_t* data, size_t size, const uint8_t tag[NOISE_TAG_SIZE]);
+    
+    // ChaCha20 backend selection (process-wide)
+    static NoiseCipherBackend get_cipher_backend();
+    static bool set_cipher_backend(NoiseCipherBackend backend);   // false if not supported by this CPU/build
+    static bool is_cipher_backend_supported(NoiseCipherBackend backend);
+    static std::string cipher_backend_name(NoiseCipherBackend backend);
+    
     // Hash functions using SHA256
     static NoiseHash hash(const std::vector<uint8_t>& data);
     static void hkdf(const std::vector<uint8_t>& salt, const std::vector<uint8_t>& ikm,
@@ -84,6 +155,16 @@ public:
     std::vector<uint8_t> decrypt_with_ad(const std::vector<uint8_t>& ciphertext,
                                         const std::vector<uint8_t>& ad = {});
     
+    // Unambiguous variant: an empty plaintext is a valid result
+    bool decrypt_with_ad(const std::vector<uint8_t>& ciphertext, const std::vector<uint8_t>& ad,
+                         std::vector<uint8_t>& plaintext);
+    
+    // In-place variants; require a key and advance the nonce on success
+    bool encrypt_in_place(uint8_t* data, size_t size, uint8_t* tag,
+                          const uint8_t* ad = nullptr, size_t ad_size = 0);
+    bool decrypt_in_place(uint8_t* data, size_t size, const uint8_t* tag,
+                          const uint8_t* ad = nullptr, size_t ad_size = 0);
+    
     void set_nonce(uint64_t nonce) { nonce_ = nonce; }
     uint64_t get_nonce() const { return nonce_; }
     
@@ -104,13 +185,18 @@ public:
     void initialize(const std::string& protocol_name);
     void mix_key(const std::vector<uint8_t>& input_key_material);
     void mix_hash(const std::vector<uint8_t>& data);
+    void mix_hash(const uint8_t* data, size_t size);
     void mix_key_and_hash(const std::vector<uint8_t>& input_key_material);
     
     std::vector<uint8_t> encrypt_and_hash(const std::vector<uint8_t>& plaintext);
     std::vector<uint8_t> decrypt_and_hash(const std::vector<uint8_t>& ciphertext);
+    bool decrypt_and_hash(const std::vector<uint8_t>& ciphertext, std::vector<uint8_t>& plaintext);
     
     std::pair<NoiseCipherState, NoiseCipherState> split();
     
+    // Derive a session ticket ID and secret from the final chaining key
+    void derive_ticket(NoiseTicketId& id, NoiseKey& secret) const;
+    
     const NoiseHash& get_handshake_hash() const { return h_; }
     
 private:
@@ -120,16 +206,35 @@ private:
 };
 
 /**
- * Noise Protocol handshake state for Noise_XX pattern
+ * Noise Protocol handshake state.
+ *
+ * Initiators run XX, or IK / NNpsk0 when they know the responder from an earlier
+ * session. Responders accept all three: an XX first message is the bare ephemeral
+ * key, the others start with a pattern byte. When an IK or NNpsk0 first message
+ * cannot be used (stale static key, unknown ticket) the responder continues with
+ * XXfallback on the initiator's ephemeral key, so the connection still completes
+ * with one extra message instead of failing.
  */
 class NoiseHandshake {
 public:
+    // Finds (and consumes) a ticket this node issued; returns false if unknown or expired
+    using TicketLookup = std::function<bool(const NoiseTicketId& id, NoiseSessionTicket& ticket)>;
+    
     NoiseHandshake();
     ~NoiseHandshake();
     
-    // Initialize for either initiator or responder role
+    // Initialize for either initiator or responder role (initiators run XX)
     bool initialize(NoiseRole role, const NoiseKey& static_private_key);
     
+    // Initialize as an IK initiator for a responder whose static public key is known
+    bool initialize_with_remote_key(const NoiseKey& static_private_key, const NoiseKey& remote_static_public_key);
+    
+    // Initialize as an NNpsk0 initiator resuming from a session ticket
+    bool initialize_with_ticket(const NoiseKey& static_private_key, const NoiseSessionTicket& ticket);
+    
+    // Ticket lookup used by responders for resumption attempts (none: always fall back)
+    void set_ticket_lookup(TicketLookup lookup) { ticket_lookup_ = std::move(lookup); }
+    
     // Handshake message processing
     std::vector<uint8_t> write_message(const std::vector<uint8_t>& payload = {});
     std::vector<uint8_t> read_message(const std::vector<uint8_t>& message);
@@ -137,18 +242,23 @@ public:
     // State queries
     NoiseHandshakeState get_state() const { return state_; }
     NoiseRole get_role() const { return role_; }
+    NoiseHandshakePattern get_pattern() const { return pattern_; }
     bool is_completed() const { return state_ == NoiseHandshakeState::COMPLETED; }
     bool has_failed() const { return state_ == NoiseHandshakeState::FAILED; }
     
     // Get cipher states after handshake completion
     std::pair<NoiseCipherState, NoiseCipherState> get_cipher_states();
     
+    // Derive the ticket for the next resumption (after completion; both sides get the same ticket)
+    bool get_session_ticket(NoiseSessionTicket& ticket) const;
+    
     // Get remote static public key (available after handshake)
     const NoiseKey& get_remote_static_public_key() const { return rs_; }
     
 private:
     NoiseRole role_;
     NoiseHandshakeState state_;
+    NoiseHandshakePattern pattern_;
     NoiseSymmetricState symmetric_state_;
     
     // Local keys
@@ -159,6 +269,22 @@ private:
     NoiseKey rs_;  // Remote static public key
     NoiseKey re_;  // Remote ephemeral public key
     
+    // Resumption
+    NoiseSessionTicket ticket_;         // Ticket being resumed (NNpsk0)
+    TicketLookup ticket_lookup_;
+    
+    void initialize_symmetric_state(NoiseHandshakePattern pattern, const uint8_t* prologue, size_t prologue_size);
+    void begin_fallback();
+    
+    // Message tokens of each step (the payload is handled by write_message / read_payload)
+    void write_message_1(std::vector<uint8_t>& message);
+    void write_message_2(std::vector<uint8_t>& message);
+    void write_message_3(std::vector<uint8_t>& message);
+    bool read_message_1(const std::vector<uint8_t>& message, std::vector<uint8_t>& payload);
+    bool read_message_2(const std::vector<uint8_t>& message, std::vector<uint8_t>& payload);
+    bool read_message_3(const std::vector<uint8_t>& message, std::vector<uint8_t>& payload);
+    bool read_remote_static(const std::vector<uint8_t>& message, size_t& offset);
+    bool read_payload(const std::vector<uint8_t>& message, size_t offset, std::vector<uint8_t>& payload);
     void advance_state();
     void fail_handshake();
 };
@@ -175,6 +301,11 @@ public:
     bool initialize_as_initiator(const NoiseKey& static_private_key);
     bool initialize_as_responder(const NoiseKey& static_private_key);
     
+    // Initialize as initiator for a known peer: IK with its static key, or NNpsk0 with a ticket
+    bool initialize_as_initiator(const NoiseKey& static_private_key, const NoiseKey& remote_static_public_key);
+    bool initialize_as_resuming_initiator(const NoiseKey& static_private_key, const NoiseSessionTicket& ticket);
+    void set_ticket_lookup(NoiseHandshake::TicketLookup lookup);
+    
     // Handshake operations
     bool is_handshake_completed() const;
     bool has_handshake_failed() const;
@@ -186,10 +317,30 @@ public:
     std::vector<uint8_t> encrypt_transport_message(const std::vector<uint8_t>& plaintext);
     std::vector<uint8_t> decrypt_transport_message(const std::vector<uint8_t>& ciphertext);
     
+    /**
+     * Encrypt a transport message in place
+     * @param data Plaintext, replaced by the ciphertext
+     * @param size Data size
+     * @param tag Receives the NOISE_TAG_SIZE byte authentication tag
+     * @return true on success, false if the handshake is not completed
+     */
+    bool encrypt_transport_message(uint8_t* data, size_t size, uint8_t* tag);
+    
+    /**
+     * Decrypt a transport message in place
+     * @param data Ciphertext, replaced by the plaintext on success
+     * @param size Data size
+     * @param tag Authentication tag of the message
+     * @return true on success, false if authentication failed or the handshake is not completed
+     */
+    bool decrypt_transport_message(uint8_t* data, size_t size, const uint8_t* tag);
+    
     // Utility functions
     NoiseRole get_role() const;
     NoiseHandshakeState get_handshake_state() const;
+    NoiseHandshakePattern get_handshake_pattern() const;
     const NoiseKey& get_remote_static_public_key() const;
+    bool get_session_ticket(NoiseSessionTicket& ticket) const;
     
 private:
     std::unique_ptr<NoiseHandshake> handshake_state_;
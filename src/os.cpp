@@ -25,6 +25,7 @@
     #include <sys/utsname.h>
     #include <sys/sysinfo.h>
     #include <unistd.h>
+    #include <sched.h>
     #include <fstream>
     #include <regex>
 #endif
@@ -331,6 +332,73 @@ SystemInfo get_system_info() {
     return info;
 }
 
+#ifdef _WIN32
+
+std::vector<int> get_available_cpus() {
+    std::vector<int> cpus;
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); ++cpu) {
+            if (process_mask & (static_cast<DWORD_PTR>(1) << cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+bool set_current_thread_cpu(int cpu) {
+    if (cpu < 0 || cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+}
+
+#elif __APPLE__
+
+std::vector<int> get_available_cpus() {
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < get_cpu_logical_cores(); ++cpu) {
+        cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool set_current_thread_cpu(int cpu) {
+    // Thread affinity on macOS is only a placement hint between threads, never a binding to a CPU
+    (void)cpu;
+    return false;
+}
+
+#else
+
+std::vector<int> get_available_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+bool set_current_thread_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // pid 0 is the calling thread; unlike pthread_setaffinity_np this also exists on Android
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+#endif
+
 void print_system_info() {
     SystemInfo info = get_system_info();
     
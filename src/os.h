@@ -2,6 +2,7 @@
 
 #include <string>
 #include <cstdint>
+#include <vector>
 
 namespace librats {
 
@@ -31,6 +32,12 @@ int get_cpu_logical_cores();
 uint64_t get_total_memory_mb();
 uint64_t get_available_memory_mb();
 
+// Logical CPUs this process may run on, in ascending order
+std::vector<int> get_available_cpus();
+
+// Pin the calling thread to one logical CPU; false if the platform has no binding affinity or the CPU is unavailable
+bool set_current_thread_cpu(int cpu);
+
 // Unicode support detection
 bool supports_unicode();
 
@@ -0,0 +1,83 @@
+#include "payload_codec.h"
+
+namespace librats {
+
+namespace {
+
+class JsonPayloadCodec : public PayloadCodec {
+public:
+    std::string name() const override { return "json"; }
+    int builtin_id() const override { return payload_encoding::JSON; }
+
+    std::vector<uint8_t> encode(const nlohmann::json& value) const override {
+        std::string text = value.dump();
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+
+    nlohmann::json decode(const uint8_t* data, size_t size) const override {
+        if (size == 0) {
+            return nlohmann::json::object();
+        }
+        return nlohmann::json::parse(data, data + size);
+    }
+};
+
+class CborPayloadCodec : public PayloadCodec {
+public:
+    std::string name() const override { return "cbor"; }
+    int builtin_id() const override { return payload_encoding::CBOR; }
+
+    std::vector<uint8_t> encode(const nlohmann::json& value) const override {
+        return nlohmann::json::to_cbor(value);
+    }
+
+    nlohmann::json decode(const uint8_t* data, size_t size) const override {
+        return nlohmann::json::from_cbor(data, data + size);
+    }
+};
+
+class MsgpackPayloadCodec : public PayloadCodec {
+public:
+    std::string name() const override { return "msgpack"; }
+    int builtin_id() const override { return payload_encoding::MSGPACK; }
+
+    std::vector<uint8_t> encode(const nlohmann::json& value) const override {
+        return nlohmann::json::to_msgpack(value);
+    }
+
+    nlohmann::json decode(const uint8_t* data, size_t size) const override {
+        return nlohmann::json::from_msgpack(data, data + size);
+    }
+};
+
+} // anonymous namespace
+
+std::shared_ptr<const PayloadCodec> PayloadCodec::json() {
+    static const std::shared_ptr<const PayloadCodec> codec = std::make_shared<JsonPayloadCodec>();
+    return codec;
+}
+
+std::shared_ptr<const PayloadCodec> PayloadCodec::cbor() {
+    static const std::shared_ptr<const PayloadCodec> codec = std::make_shared<CborPayloadCodec>();
+    return codec;
+}
+
+std::shared_ptr<const PayloadCodec> PayloadCodec::msgpack() {
+    static const std::shared_ptr<const PayloadCodec> codec = std::make_shared<MsgpackPayloadCodec>();
+    return codec;
+}
+
+std::shared_ptr<const PayloadCodec> PayloadCodec::builtin(uint8_t id) {
+    switch (id) {
+        case payload_encoding::JSON: return json();
+        case payload_encoding::CBOR: return cbor();
+        case payload_encoding::MSGPACK: return msgpack();
+        default: return nullptr;
+    }
+}
+
+std::vector<std::shared_ptr<const PayloadCodec>> PayloadCodec::defaults() {
+    return {msgpack(), cbor(), json()};
+}
+
+} // namespace librats
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "json.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace librats {
+
+/**
+ * Wire ids of rats message body encodings. Ids from CUSTOM_BASE up select the
+ * receiver's custom codec at (id - CUSTOM_BASE) in the list it advertised.
+ */
+namespace payload_encoding {
+constexpr uint8_t JSON = 0;
+constexpr uint8_t CBOR = 1;
+constexpr uint8_t MSGPACK = 2;
+constexpr uint8_t RAW = 3;          // Opaque bytes, never decoded
+constexpr uint8_t CUSTOM_BASE = 0x80;
+} // namespace payload_encoding
+
+/**
+ * Serializes rats message payloads. Peers advertise the names of their codecs in
+ * the handshake; each side encodes with the first of its own codecs that the
+ * other side advertised.
+ */
+class PayloadCodec {
+public:
+    virtual ~PayloadCodec() = default;
+
+    // Name advertised in the handshake; peers match codecs by name
+    virtual std::string name() const = 0;
+
+    virtual std::vector<uint8_t> encode(const nlohmann::json& value) const = 0;
+
+    /**
+     * Decode a payload
+     * @throws std::exception if the bytes are not a valid encoding
+     */
+    virtual nlohmann::json decode(const uint8_t* data, size_t size) const = 0;
+
+    // Built-in wire id, or -1 for custom codecs
+    virtual int builtin_id() const { return -1; }
+
+    static std::shared_ptr<const PayloadCodec> json();
+    static std::shared_ptr<const PayloadCodec> cbor();
+    static std::shared_ptr<const PayloadCodec> msgpack();
+
+    /**
+     * Get a built-in codec by wire id
+     * @param id Wire id
+     * @return Codec, or nullptr if the id is not a built-in codec (RAW included)
+     */
+    static std::shared_ptr<const PayloadCodec> builtin(uint8_t id);
+
+    // Default preference order: MessagePack, CBOR, JSON
+    static std::vector<std::shared_ptr<const PayloadCodec>> defaults();
+};
+
+} // namespace librats
@@ -0,0 +1,520 @@
+#include "peer_store.h"
+#include "fs.h"
+#include "logger.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cctype>
+
+#define LOG_PEER_STORE_DEBUG(message) LOG_DEBUG("peerstore", message)
+#define LOG_PEER_STORE_WARN(message) LOG_WARN("peerstore", message)
+#define LOG_PEER_STORE_ERROR(message) LOG_ERROR("peerstore", message)
+
+namespace librats {
+
+namespace {
+
+const uint8_t PEER_LOG_MAGIC[4] = {'R', 'P', 'L', 'G'};
+constexpr uint8_t PEER_LOG_VERSION = 1;
+constexpr size_t PEER_LOG_HEADER_SIZE = sizeof(PEER_LOG_MAGIC) + 1;
+constexpr size_t RECORD_HEADER_SIZE = 8;    // Payload length, CRC-32 of the payload
+constexpr uint32_t MAX_RECORD_SIZE = 4096;
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+    static const auto table = [] {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void put_u16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void put_i64(std::vector<uint8_t>& out, int64_t value) {
+    uint64_t bits = static_cast<uint64_t>(value);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(bits >> shift));
+    }
+}
+
+void put_string(std::vector<uint8_t>& out, const std::string& value) {
+    out.push_back(static_cast<uint8_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+// Bounds-checked reader over one record payload
+class RecordReader {
+public:
+    RecordReader(const uint8_t* data, size_t size) : data_(data), size_(size), pos_(0), ok_(true) {}
+
+    uint8_t u8() { return ok_ && need(1) ? data_[pos_++] : 0; }
+
+    uint16_t u16() {
+        if (!ok_ || !need(2)) return 0;
+        uint16_t value = static_cast<uint16_t>((data_[pos_] << 8) | data_[pos_ + 1]);
+        pos_ += 2;
+        return value;
+    }
+
+    uint32_t u32() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4 && ok_ && need(1); ++i) {
+            value = (value << 8) | data_[pos_++];
+        }
+        return value;
+    }
+
+    int64_t i64() {
+        uint64_t value = 0;
+        for (int i = 0; i < 8 && ok_ && need(1); ++i) {
+            value = (value << 8) | data_[pos_++];
+        }
+        return static_cast<int64_t>(value);
+    }
+
+    std::string string() {
+        size_t length = u8();
+        if (!ok_ || !need(length)) return "";
+        std::string value(reinterpret_cast<const char*>(data_ + pos_), length);
+        pos_ += length;
+        return value;
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    bool need(size_t count) {
+        if (size_ - pos_ < count) {
+            ok_ = false;
+        }
+        return ok_;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+    bool ok_;
+};
+
+bool fits_record(const StoredPeer& peer) {
+    const size_t max_string = 255;
+    return !peer.peer_id.empty() && peer.peer_id.size() <= max_string && peer.ip.size() <= max_string &&
+           peer.version.size() <= max_string && peer.noise_static_key.size() <= max_string;
+}
+
+} // namespace
+
+PeerStore::PeerStore() : end_offset_(0), log_records_(0) {}
+
+PeerStore::~PeerStore() {
+    close();
+}
+
+bool PeerStore::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) {
+        file_->close();
+        file_.reset();
+    }
+    path_ = path;
+    peers_.clear();
+    address_owners_.clear();
+    log_records_ = 0;
+    end_offset_ = 0;
+
+    bool rewrite = true;
+    if (file_exists(path)) {
+        FileHandle existing;
+        int64_t size = -1;
+        if (existing.open(path.c_str(), FileOpenMode::READ_ONLY)) {
+            size = existing.size();
+        }
+        if (size < 0) {
+            LOG_PEER_STORE_ERROR("Failed to open peer log " << path);
+            return false;
+        }
+
+        // Replay straight from the mapping; positional reads only if it cannot be mapped
+        std::vector<uint8_t> buffer;
+        const uint8_t* data = nullptr;
+        if (size > 0 && existing.map_read_only()) {
+            data = existing.mapped_data();
+        } else {
+            buffer.resize(static_cast<size_t>(size));
+            if (size > 0 && !existing.read_at(0, buffer.data(), buffer.size())) {
+                LOG_PEER_STORE_ERROR("Failed to read peer log " << path);
+                return false;
+            }
+            data = buffer.data();
+        }
+
+        size_t valid_size = 0;
+        size_t first = 0;
+        while (first < static_cast<size_t>(size) && std::isspace(data[first])) {
+            first++;
+        }
+        if (first < static_cast<size_t>(size) && data[first] == '[') {
+            import_json(std::string(reinterpret_cast<const char*>(data), static_cast<size_t>(size)));
+        } else if (replay(data, static_cast<size_t>(size), valid_size)) {
+            rewrite = valid_size < static_cast<size_t>(size);
+            if (rewrite) {
+                LOG_PEER_STORE_WARN("Dropping " << (static_cast<size_t>(size) - valid_size)
+                                    << " bytes of torn or corrupt records from " << path);
+            }
+        } else if (size > 0) {
+            LOG_PEER_STORE_WARN("Ignoring unrecognized peer log " << path);
+        }
+    }
+
+    if (rewrite) {
+        return rewrite_locked();
+    }
+
+    file_.reset(new FileHandle());
+    if (!file_->open(path.c_str(), FileOpenMode::READ_WRITE)) {
+        file_.reset();
+        LOG_PEER_STORE_ERROR("Failed to open peer log " << path << " for appending");
+        return false;
+    }
+    end_offset_ = static_cast<uint64_t>((std::max)(file_->size(), static_cast<int64_t>(0)));
+    maybe_compact_locked();
+    LOG_PEER_STORE_DEBUG("Loaded " << peers_.size() << " peers from " << log_records_ << " records in " << path);
+    return true;
+}
+
+void PeerStore::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) {
+        file_->close();
+        file_.reset();
+    }
+}
+
+bool PeerStore::is_open() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_ != nullptr;
+}
+
+std::string PeerStore::path() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return path_;
+}
+
+bool PeerStore::put(const StoredPeer& peer) {
+    if (!fits_record(peer)) {
+        return false;
+    }
+    std::vector<uint8_t> payload;
+    encode_put(peer, payload);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply_put(peer);
+    return append_locked(payload);
+}
+
+bool PeerStore::remove(const std::string& peer_id) {
+    std::vector<uint8_t> payload;
+    encode_remove(peer_id, payload);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (peers_.find(peer_id) == peers_.end()) {
+        return true;
+    }
+    apply_remove(peer_id);
+    return append_locked(payload);
+}
+
+bool PeerStore::record_success(const std::string& peer_id, int64_t now) {
+    StoredPeer peer;
+    if (!get(peer_id, peer)) {
+        return false;
+    }
+    peer.last_seen = now;
+    peer.last_success = now;
+    peer.failures = 0;
+    return put(peer);
+}
+
+bool PeerStore::record_failure(const std::string& peer_id) {
+    StoredPeer peer;
+    if (!get(peer_id, peer)) {
+        return false;
+    }
+    peer.failures++;
+    return put(peer);
+}
+
+bool PeerStore::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_.clear();
+    address_owners_.clear();
+    return rewrite_locked();
+}
+
+bool PeerStore::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rewrite_locked();
+}
+
+bool PeerStore::get(const std::string& peer_id, StoredPeer& peer) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(peer_id);
+    if (it == peers_.end()) {
+        return false;
+    }
+    peer = it->second;
+    return true;
+}
+
+std::vector<StoredPeer> PeerStore::peers() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<StoredPeer> result;
+    result.reserve(peers_.size());
+    for (const auto& entry : peers_) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+size_t PeerStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peers_.size();
+}
+
+uint64_t PeerStore::log_records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return log_records_;
+}
+
+std::vector<StoredPeer> PeerStore::reconnect_candidates(int64_t now, int64_t max_age_seconds) const {
+    const int64_t FAILURE_PENALTY_SECONDS = 60 * 60;
+
+    std::vector<std::pair<int64_t, StoredPeer>> scored;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : peers_) {
+            const StoredPeer& peer = entry.second;
+            if (now - peer.last_seen <= max_age_seconds) {
+                scored.emplace_back(peer.last_success - static_cast<int64_t>(peer.failures) * FAILURE_PENALTY_SECONDS, peer);
+            }
+        }
+    }
+    std::stable_sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second.last_seen > b.second.last_seen;
+    });
+
+    std::vector<StoredPeer> candidates;
+    candidates.reserve(scored.size());
+    for (auto& entry : scored) {
+        candidates.push_back(std::move(entry.second));
+    }
+    return candidates;
+}
+
+bool PeerStore::replay(const uint8_t* data, size_t size, size_t& valid_size) {
+    valid_size = 0;
+    if (size < PEER_LOG_HEADER_SIZE || !std::equal(PEER_LOG_MAGIC, PEER_LOG_MAGIC + sizeof(PEER_LOG_MAGIC), data) ||
+        data[sizeof(PEER_LOG_MAGIC)] != PEER_LOG_VERSION) {
+        return false;
+    }
+
+    size_t offset = PEER_LOG_HEADER_SIZE;
+    while (size - offset >= RECORD_HEADER_SIZE) {
+        RecordReader header(data + offset, RECORD_HEADER_SIZE);
+        uint32_t length = header.u32();
+        uint32_t checksum = header.u32();
+        if (length == 0 || length > MAX_RECORD_SIZE || length > size - offset - RECORD_HEADER_SIZE) {
+            break;
+        }
+        const uint8_t* payload = data + offset + RECORD_HEADER_SIZE;
+        if (crc32(payload, length) != checksum) {
+            break;
+        }
+
+        RecordReader reader(payload, length);
+        RecordType type = static_cast<RecordType>(reader.u8());
+        if (type == RecordType::PUT) {
+            StoredPeer peer;
+            peer.peer_id = reader.string();
+            peer.ip = reader.string();
+            peer.port = reader.u16();
+            peer.version = reader.string();
+            peer.noise_static_key = reader.string();
+            peer.last_seen = reader.i64();
+            peer.last_success = reader.i64();
+            peer.failures = reader.u32();
+            if (!reader.ok() || peer.peer_id.empty()) {
+                break;
+            }
+            apply_put(peer);
+        } else if (type == RecordType::REMOVE) {
+            std::string peer_id = reader.string();
+            if (!reader.ok()) {
+                break;
+            }
+            apply_remove(peer_id);
+        } else {
+            break;
+        }
+        offset += RECORD_HEADER_SIZE + length;
+        log_records_++;
+    }
+
+    valid_size = offset;
+    return true;
+}
+
+bool PeerStore::import_json(const std::string& text) {
+    try {
+        nlohmann::json peers_json = nlohmann::json::parse(text);
+        if (!peers_json.is_array()) {
+            return false;
+        }
+        for (const auto& peer_json : peers_json) {
+            StoredPeer peer;
+            peer.peer_id = peer_json.value("peer_id", "");
+            peer.ip = peer_json.value("ip", "");
+            int port = peer_json.value("port", 0);
+            peer.version = peer_json.value("version", "");
+            peer.noise_static_key = peer_json.value("noise_static_key", "");
+            peer.last_seen = peer_json.value("last_seen", static_cast<int64_t>(0));
+            peer.last_success = peer.last_seen;
+            if (port > 0 && port <= 65535 && !peer.ip.empty() && fits_record(peer)) {
+                peer.port = static_cast<uint16_t>(port);
+                apply_put(peer);
+            }
+        }
+        LOG_PEER_STORE_DEBUG("Imported " << peers_.size() << " peers from JSON file " << path_);
+        return true;
+    } catch (const nlohmann::json::exception& e) {
+        LOG_PEER_STORE_WARN("Failed to import JSON peer file " << path_ << ": " << e.what());
+        return false;
+    }
+}
+
+void PeerStore::apply_put(const StoredPeer& peer) {
+    std::string address = peer.address();
+
+    // Another peer now reachable at this address replaces the one that was there
+    auto owner = address_owners_.find(address);
+    if (owner != address_owners_.end() && owner->second != peer.peer_id) {
+        peers_.erase(owner->second);
+    }
+    auto existing = peers_.find(peer.peer_id);
+    if (existing != peers_.end() && existing->second.address() != address) {
+        address_owners_.erase(existing->second.address());
+    }
+    peers_[peer.peer_id] = peer;
+    address_owners_[address] = peer.peer_id;
+}
+
+void PeerStore::apply_remove(const std::string& peer_id) {
+    auto it = peers_.find(peer_id);
+    if (it != peers_.end()) {
+        address_owners_.erase(it->second.address());
+        peers_.erase(it);
+    }
+}
+
+bool PeerStore::append_locked(const std::vector<uint8_t>& payload) {
+    if (!file_) {
+        return false;
+    }
+    std::vector<uint8_t> record;
+    record.reserve(RECORD_HEADER_SIZE + payload.size());
+    put_u32(record, static_cast<uint32_t>(payload.size()));
+    put_u32(record, crc32(payload.data(), payload.size()));
+    record.insert(record.end(), payload.begin(), payload.end());
+
+    if (!file_->write_at(end_offset_, record.data(), record.size())) {
+        LOG_PEER_STORE_ERROR("Failed to append to peer log " << path_);
+        return false;
+    }
+    end_offset_ += record.size();
+    log_records_++;
+    maybe_compact_locked();
+    return true;
+}
+
+bool PeerStore::rewrite_locked() {
+    std::vector<uint8_t> data(PEER_LOG_MAGIC, PEER_LOG_MAGIC + sizeof(PEER_LOG_MAGIC));
+    data.push_back(PEER_LOG_VERSION);
+    std::vector<uint8_t> payload;
+    for (const auto& entry : peers_) {
+        payload.clear();
+        encode_put(entry.second, payload);
+        put_u32(data, static_cast<uint32_t>(payload.size()));
+        put_u32(data, crc32(payload.data(), payload.size()));
+        data.insert(data.end(), payload.begin(), payload.end());
+    }
+
+    // Write and rename so a crash never leaves a truncated file; the handle must be
+    // released before the file can be replaced on Windows
+    if (file_) {
+        file_->close();
+        file_.reset();
+    }
+    std::string temp_path = path_ + ".tmp";
+    if (!create_file_binary(temp_path.c_str(), data.data(), data.size()) ||
+        !move_file(temp_path.c_str(), path_.c_str())) {
+        LOG_PEER_STORE_ERROR("Failed to write peer log " << path_);
+        return false;
+    }
+
+    file_.reset(new FileHandle());
+    if (!file_->open(path_.c_str(), FileOpenMode::READ_WRITE)) {
+        file_.reset();
+        LOG_PEER_STORE_ERROR("Failed to open peer log " << path_ << " for appending");
+        return false;
+    }
+    end_offset_ = data.size();
+    log_records_ = peers_.size();
+    LOG_PEER_STORE_DEBUG("Wrote " << peers_.size() << " peers to " << path_);
+    return true;
+}
+
+void PeerStore::maybe_compact_locked() {
+    uint64_t garbage = log_records_ - peers_.size();
+    if (garbage > COMPACTION_MIN_GARBAGE && garbage > peers_.size()) {
+        rewrite_locked();
+    }
+}
+
+void PeerStore::encode_put(const StoredPeer& peer, std::vector<uint8_t>& payload) {
+    payload.push_back(static_cast<uint8_t>(RecordType::PUT));
+    put_string(payload, peer.peer_id);
+    put_string(payload, peer.ip);
+    put_u16(payload, peer.port);
+    put_string(payload, peer.version);
+    put_string(payload, peer.noise_static_key);
+    put_i64(payload, peer.last_seen);
+    put_i64(payload, peer.last_success);
+    put_u32(payload, peer.failures);
+}
+
+void PeerStore::encode_remove(const std::string& peer_id, std::vector<uint8_t>& payload) {
+    payload.push_back(static_cast<uint8_t>(RecordType::REMOVE));
+    put_string(payload, peer_id.substr(0, 255));
+}
+
+} // namespace librats
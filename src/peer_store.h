@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace librats {
+
+class FileHandle;
+
+/**
+ * A peer remembered across runs
+ */
+struct StoredPeer {
+    std::string peer_id;
+    std::string ip;
+    uint16_t port = 0;
+    std::string version;
+    std::string noise_static_key;   // Hex static key from the Noise handshake, empty if unknown
+    int64_t last_seen = 0;          // Unix seconds
+    int64_t last_success = 0;       // Last completed handshake, 0 if never
+    uint32_t failures = 0;          // Failed reconnects since the last success
+
+    std::string address() const { return ip + ":" + std::to_string(port); }
+};
+
+/**
+ * Append-only binary log of peers.
+ *
+ * Every change appends one checksummed record (length, CRC-32, payload) instead of
+ * rewriting the whole file. Opening maps the file and replays the records; a torn
+ * or corrupt record ends the replay, so a crash in the middle of an append loses
+ * only that record. Once superseded records outnumber live peers the log is
+ * compacted: the live peers are written to a new file that replaces the old one.
+ *
+ * Peers are keyed by peer id; a peer showing up at an address another peer had
+ * replaces that entry. A file holding a JSON array of peers from an older version
+ * is imported on open. Thread-safe.
+ */
+class PeerStore {
+public:
+    PeerStore();
+    ~PeerStore();
+
+    PeerStore(const PeerStore&) = delete;
+    PeerStore& operator=(const PeerStore&) = delete;
+
+    // Open (or create) the log at path and load its peers
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const;
+    std::string path() const;
+
+    // Add or replace a peer
+    bool put(const StoredPeer& peer);
+
+    // Forget a peer
+    bool remove(const std::string& peer_id);
+
+    // Record the outcome of a reconnect attempt
+    bool record_success(const std::string& peer_id, int64_t now);
+    bool record_failure(const std::string& peer_id);
+
+    // Forget every peer and truncate the log
+    bool clear();
+
+    // Rewrite the log with one record per live peer
+    bool compact();
+
+    bool get(const std::string& peer_id, StoredPeer& peer) const;
+    std::vector<StoredPeer> peers() const;
+    size_t size() const;
+
+    // Records in the log, live or superseded
+    uint64_t log_records() const;
+
+    /**
+     * Peers seen within max_age_seconds, best reconnect candidates first: the most
+     * recent success leads, and every failure since then costs an hour of recency
+     */
+    std::vector<StoredPeer> reconnect_candidates(int64_t now, int64_t max_age_seconds) const;
+
+private:
+    enum class RecordType : uint8_t {
+        PUT = 1,
+        REMOVE = 2
+    };
+
+    // Compact once superseded records exceed both this and the live peer count
+    static constexpr uint64_t COMPACTION_MIN_GARBAGE = 1024;
+
+    bool replay(const uint8_t* data, size_t size, size_t& valid_size);
+    bool import_json(const std::string& text);
+    void apply_put(const StoredPeer& peer);
+    void apply_remove(const std::string& peer_id);
+    bool append_locked(const std::vector<uint8_t>& payload);
+    bool rewrite_locked();
+    void maybe_compact_locked();
+
+    static void encode_put(const StoredPeer& peer, std::vector<uint8_t>& payload);
+    static void encode_remove(const std::string& peer_id, std::vector<uint8_t>& payload);
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::unique_ptr<FileHandle> file_;
+    uint64_t end_offset_;
+    uint64_t log_records_;
+    std::map<std::string, StoredPeer> peers_;                       // By peer id
+    std::unordered_map<std::string, std::string> address_owners_;   // Address -> peer id
+};
+
+} // namespace librats
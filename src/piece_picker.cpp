@@ -0,0 +1,177 @@
+#include "piece_picker.h"
+
+namespace librats {
+
+PiecePicker::PiecePicker(uint32_t num_pieces)
+    : pieces_(num_pieces), pickable_(num_pieces), downloading_(num_pieces),
+      pickable_count_(0), sequential_(false) {
+    for (PieceIndex i = 0; i < num_pieces; ++i) {
+        add_to_bucket(i);
+    }
+}
+
+void PiecePicker::inc_availability(PieceIndex piece_index) {
+    PieceState& state = pieces_[piece_index];
+    if (!is_pickable(state)) {
+        ++state.availability;
+        return;
+    }
+    remove_from_bucket(piece_index);
+    ++state.availability;
+    add_to_bucket(piece_index);
+}
+
+void PiecePicker::inc_availability(const Bitfield& peer_bitfield) {
+    peer_bitfield.for_each_set([this](size_t i) {
+        if (i < pieces_.size()) {
+            inc_availability(static_cast<PieceIndex>(i));
+        }
+    });
+}
+
+void PiecePicker::dec_availability(const Bitfield& peer_bitfield) {
+    peer_bitfield.for_each_set([this](size_t i) {
+        if (i >= pieces_.size() || pieces_[i].availability == 0) {
+            return;
+        }
+        PieceState& state = pieces_[i];
+        if (!is_pickable(state)) {
+            --state.availability;
+            return;
+        }
+        remove_from_bucket(static_cast<PieceIndex>(i));
+        --state.availability;
+        add_to_bucket(static_cast<PieceIndex>(i));
+    });
+}
+
+void PiecePicker::mark_have(PieceIndex piece_index) {
+    PieceState& state = pieces_[piece_index];
+    if (state.have) {
+        return;
+    }
+    if (is_pickable(state)) {
+        remove_from_bucket(piece_index);
+    }
+    state.have = true;
+    state.downloading = false;
+    downloading_.clear(piece_index);
+}
+
+void PiecePicker::mark_downloading(PieceIndex piece_index) {
+    PieceState& state = pieces_[piece_index];
+    if (state.have || state.downloading) {
+        return;
+    }
+    if (is_pickable(state)) {
+        remove_from_bucket(piece_index);
+    }
+    state.downloading = true;
+    downloading_.set(piece_index);
+}
+
+void PiecePicker::mark_missing(PieceIndex piece_index) {
+    PieceState& state = pieces_[piece_index];
+    if (is_pickable(state)) {
+        return;
+    }
+    state.have = false;
+    state.downloading = false;
+    downloading_.clear(piece_index);
+    if (is_pickable(state)) {
+        add_to_bucket(piece_index);
+    }
+}
+
+void PiecePicker::set_piece_priority(PieceIndex piece_index, uint8_t priority) {
+    if (priority > PRIORITY_TOP) {
+        priority = PRIORITY_TOP;
+    }
+    PieceState& state = pieces_[piece_index];
+    if (state.priority == priority) {
+        return;
+    }
+    if (is_pickable(state)) {
+        remove_from_bucket(piece_index);
+    }
+    state.priority = priority;
+    if (is_pickable(state)) {
+        add_to_bucket(piece_index);
+    }
+}
+
+std::vector<PieceIndex> PiecePicker::pick_pieces(const Bitfield& peer_bitfield, size_t max_pieces) const {
+    std::vector<PieceIndex> picked;
+    if (max_pieces == 0) {
+        return picked;
+    }
+
+    if (sequential_) {
+        // Lowest index first, one pass over the candidates per priority level in use
+        Bitfield candidates(pieces_.size());
+        candidates |= peer_bitfield;
+        candidates &= pickable_;
+        for (int priority = PRIORITY_TOP; priority > PRIORITY_SKIP && picked.size() < max_pieces; --priority) {
+            for (size_t i = candidates.find_first_set(); i != Bitfield::npos && picked.size() < max_pieces;
+                 i = candidates.find_first_set(i + 1)) {
+                if (pieces_[i].priority == priority) {
+                    picked.push_back(static_cast<PieceIndex>(i));
+                }
+            }
+        }
+    } else {
+        // Availability 0 holds the pieces no connected peer has, nothing to pick there
+        for (int priority = PRIORITY_TOP; priority > PRIORITY_SKIP && picked.size() < max_pieces; --priority) {
+            const auto& buckets = buckets_[priority - 1];
+            for (size_t availability = 1; availability < buckets.size() && picked.size() < max_pieces; ++availability) {
+                for (PieceIndex piece_index : buckets[availability]) {
+                    if (peer_bitfield.get(piece_index)) {
+                        picked.push_back(piece_index);
+                        if (picked.size() == max_pieces) {
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (picked.empty() && is_endgame()) {
+        for (size_t i = downloading_.find_first_set(); i != Bitfield::npos && picked.size() < max_pieces;
+             i = downloading_.find_first_set(i + 1)) {
+            if (peer_bitfield.get(i)) {
+                picked.push_back(static_cast<PieceIndex>(i));
+            }
+        }
+    }
+
+    return picked;
+}
+
+void PiecePicker::add_to_bucket(PieceIndex piece_index) {
+    PieceState& state = pieces_[piece_index];
+    auto& buckets = buckets_[state.priority - 1];
+    if (buckets.size() <= state.availability) {
+        buckets.resize(state.availability + 1);
+    }
+    auto& bucket = buckets[state.availability];
+    state.bucket_position = static_cast<uint32_t>(bucket.size());
+    bucket.push_back(piece_index);
+    pickable_.set(piece_index);
+    ++pickable_count_;
+}
+
+void PiecePicker::remove_from_bucket(PieceIndex piece_index) {
+    PieceState& state = pieces_[piece_index];
+    auto& bucket = buckets_[state.priority - 1][state.availability];
+
+    // Swap with the last entry so removal is O(1)
+    PieceIndex last = bucket.back();
+    bucket[state.bucket_position] = last;
+    pieces_[last].bucket_position = state.bucket_position;
+    bucket.pop_back();
+    pickable_.clear(piece_index);
+    --pickable_count_;
+}
+
+} // namespace librats
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "bitfield.h"
+#include <vector>
+#include <cstdint>
+
+namespace librats {
+
+using PieceIndex = uint32_t;
+
+// Rarest-first piece selection for a TorrentDownload. Availability counts are
+// maintained incrementally from peer HAVE/BITFIELD messages and disconnects,
+// and every piece still to be requested sits in a bucket keyed by
+// (priority, availability), so picking walks the buckets from the most wanted
+// end instead of counting over every peer's bitfield.
+//
+// Not thread safe; TorrentDownload guards it with its pieces mutex.
+class PiecePicker {
+public:
+    static constexpr uint8_t PRIORITY_SKIP = 0;     // Never picked
+    static constexpr uint8_t PRIORITY_LOW = 1;
+    static constexpr uint8_t PRIORITY_NORMAL = 4;
+    static constexpr uint8_t PRIORITY_TOP = 7;
+
+    explicit PiecePicker(uint32_t num_pieces);
+
+    uint32_t get_num_pieces() const { return static_cast<uint32_t>(pieces_.size()); }
+
+    // Availability (number of connected peers that have a piece)
+    void inc_availability(PieceIndex piece_index);
+    void inc_availability(const Bitfield& peer_bitfield);
+    void dec_availability(const Bitfield& peer_bitfield);
+    uint32_t get_availability(PieceIndex piece_index) const { return pieces_[piece_index].availability; }
+
+    // Piece state transitions
+    void mark_have(PieceIndex piece_index);
+    void mark_downloading(PieceIndex piece_index);
+    void mark_missing(PieceIndex piece_index);   // Download aborted or hash check failed
+    bool has_piece(PieceIndex piece_index) const { return pieces_[piece_index].have; }
+
+    // Priorities (PRIORITY_SKIP..PRIORITY_TOP); higher priorities are always picked first
+    void set_piece_priority(PieceIndex piece_index, uint8_t priority);
+    uint8_t get_piece_priority(PieceIndex piece_index) const { return pieces_[piece_index].priority; }
+
+    // Sequential mode picks in piece order within each priority, for streaming
+    void set_sequential(bool sequential) { sequential_ = sequential; }
+    bool is_sequential() const { return sequential_; }
+
+    // Endgame: nothing left to pick but pieces already being downloaded, which
+    // are then handed out again so the last blocks can come from several peers
+    bool is_endgame() const { return pickable_count_ == 0 && downloading_.any(); }
+
+    // Up to max_pieces pieces the peer has, most wanted first
+    std::vector<PieceIndex> pick_pieces(const Bitfield& peer_bitfield, size_t max_pieces) const;
+
+private:
+    struct PieceState {
+        uint32_t availability = 0;
+        uint32_t bucket_position = 0;
+        uint8_t priority = PRIORITY_NORMAL;
+        bool have = false;
+        bool downloading = false;
+    };
+
+    std::vector<PieceState> pieces_;
+
+    // buckets_[priority - 1][availability]: pieces neither had, downloading nor skipped
+    std::vector<std::vector<PieceIndex>> buckets_[PRIORITY_TOP];
+    Bitfield pickable_;        // Same pieces as the buckets, by index
+    Bitfield downloading_;
+    size_t pickable_count_;
+    bool sequential_;
+
+    bool is_pickable(const PieceState& state) const {
+        return !state.have && !state.downloading && state.priority != PRIORITY_SKIP;
+    }
+    void add_to_bucket(PieceIndex piece_index);
+    void remove_from_bucket(PieceIndex piece_index);
+};
+
+} // namespace librats
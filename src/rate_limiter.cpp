@@ -0,0 +1,62 @@
+#include "rate_limiter.h"
+#include <algorithm>
+
+namespace librats {
+
+namespace {
+
+uint64_t default_burst(uint64_t rate) {
+    return (std::max)(rate / 4, TokenBucket::MIN_BURST);
+}
+
+} // namespace
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst)
+    : rate_(rate), burst_(burst > 0 ? burst : default_burst(rate)),
+      tokens_(static_cast<double>(burst_)), last_refill_(std::chrono::steady_clock::now()) {
+}
+
+void TokenBucket::set_rate(uint64_t rate, uint64_t burst) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refill_locked(std::chrono::steady_clock::now());
+    rate_ = rate;
+    burst_ = burst > 0 ? burst : default_burst(rate);
+    tokens_ = (std::min)(tokens_, static_cast<double>(burst_));
+}
+
+uint64_t TokenBucket::get_burst() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return burst_;
+}
+
+size_t TokenBucket::available(size_t max_bytes, std::chrono::steady_clock::time_point now) {
+    if (rate_ == 0) {
+        return max_bytes;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    refill_locked(now);
+    if (tokens_ < 1.0) {
+        return 0;
+    }
+    return static_cast<size_t>((std::min)(tokens_, static_cast<double>(max_bytes)));
+}
+
+void TokenBucket::consume(size_t bytes, std::chrono::steady_clock::time_point now) {
+    if (rate_ == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    refill_locked(now);
+    tokens_ -= static_cast<double>(bytes);
+}
+
+void TokenBucket::refill_locked(std::chrono::steady_clock::time_point now) {
+    if (now <= last_refill_) {
+        return;
+    }
+    double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+    last_refill_ = now;
+    tokens_ = (std::min)(tokens_ + elapsed * static_cast<double>(rate_.load()), static_cast<double>(burst_));
+}
+
+} // namespace librats
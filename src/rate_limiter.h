@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+
+namespace librats {
+
+// Token bucket bandwidth limiter. Tokens are bytes; they refill continuously
+// at the configured rate up to the burst size, and transfers take what is
+// available instead of waiting. Consuming more than is available (a read
+// that returned more than its quota) leaves the bucket in debt, so the
+// average rate still holds. A rate of 0 means unlimited.
+//
+// Thread safe: one bucket is typically shared by every connection it limits.
+class TokenBucket {
+public:
+    // burst 0 picks a quarter second of traffic, at least MIN_BURST bytes
+    explicit TokenBucket(uint64_t rate = 0, uint64_t burst = 0);
+
+    static constexpr uint64_t MIN_BURST = 16 * 1024;
+
+    void set_rate(uint64_t rate, uint64_t burst = 0);
+    uint64_t get_rate() const { return rate_; }
+    uint64_t get_burst() const;
+    bool is_unlimited() const { return rate_ == 0; }
+
+    // Bytes that may be transferred now, at most max_bytes
+    size_t available(size_t max_bytes, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    // Account for bytes actually transferred
+    void consume(size_t bytes, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+private:
+    mutable std::mutex mutex_;
+    std::atomic<uint64_t> rate_;     // Bytes per second, read without the lock for the unlimited case
+    uint64_t burst_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_refill_;
+
+    void refill_locked(std::chrono::steady_clock::time_point now);
+};
+
+} // namespace librats
@@ -0,0 +1,562 @@
+#pragma once
+
+/**
+ * Coroutine API for RatsClient (optional, C++20).
+ *
+ * Awaitable versions of the RatsClient operations that either block the caller
+ * or report through callbacks, so a peer workflow can be written top to bottom
+ * and suspended while it waits on the network instead of holding a thread:
+ *
+ *     librats::async::Task<void> ping_all(librats::RatsClient& client) {
+ *         for (const auto& peer : client.get_validated_peers()) {
+ *             nlohmann::json reply = co_await librats::async::request(client, peer.peer_id, "ping", {});
+ *             co_await librats::async::sleep_for(client, std::chrono::milliseconds(500));
+ *         }
+ *     }
+ *
+ *     librats::async::spawn(ping_all(client));
+ *
+ * A Task starts when it is awaited, spawned or passed to sync_wait. After a
+ * suspension the coroutine continues on the thread that completed the
+ * operation: a ThreadManager pool worker for sleeps, timeouts and blocking
+ * calls, the connection's I/O thread for request responses. request(),
+ * sleep_for(), find_peers() and request_file() hold no thread while they wait.
+ * connect_to_peer(), detect_nat_type() and discover_and_ignore_public_ip() wrap
+ * blocking calls and occupy a pool worker for their duration.
+ *
+ * Coroutines suspended when the client stops are not resumed.
+ *
+ * The library itself builds as C++17; this header declares nothing unless the
+ * including translation unit is compiled with coroutine support, and then
+ * defines RATS_HAS_COROUTINES.
+ */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define RATS_HAS_COROUTINES 1
+
+#include "librats.h"
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+namespace librats {
+namespace async {
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { exception = std::current_exception(); }
+};
+
+template<typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+    T result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+// Fire-and-forget coroutine: runs eagerly and frees itself when it finishes
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// Completion handshake between await_suspend and a callback that may fire on
+// another thread, even before await_suspend returns: whichever side arrives
+// second resumes the coroutine (await_suspend does so by returning false)
+class Handoff {
+public:
+    // Called once by the completing side
+    void complete(std::coroutine_handle<> handle) {
+        if (arrived_.exchange(true)) {
+            handle.resume();
+        }
+    }
+
+    // Called at the end of await_suspend; its result is await_suspend's
+    bool suspend() { return !arrived_.exchange(true); }
+
+private:
+    std::atomic<bool> arrived_{false};
+};
+
+} // namespace detail
+
+/**
+ * Lazily started coroutine producing a T. Awaiting a Task starts it and
+ * resumes the awaiting coroutine when it finishes, rethrowing its exception.
+ */
+template<typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+inline Detached run_detached(Task<void> task) {
+    try {
+        co_await task;
+    } catch (const std::exception& e) {
+        LOG_ERROR("async", "Exception in spawned coroutine: " << e.what());
+    } catch (...) {
+        LOG_ERROR("async", "Unknown exception in spawned coroutine");
+    }
+}
+
+template<typename T>
+Detached run_and_fulfil(Task<T> task, std::promise<T> promise) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await task;
+            promise.set_value();
+        } else {
+            promise.set_value(co_await task);
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+/**
+ * Start a task without waiting for it; an exception it throws is logged
+ * @param task Task to run
+ */
+inline void spawn(Task<void> task) {
+    detail::run_detached(std::move(task));
+}
+
+/**
+ * Run a task and block the calling thread until it finishes. Do not call it
+ * from a thread the task needs to make progress (a pool worker or I/O thread).
+ * @param task Task to run
+ * @return The task's result (its exception is rethrown)
+ */
+template<typename T>
+T sync_wait(Task<T> task) {
+    std::promise<T> promise;
+    std::future<T> future = promise.get_future();
+    detail::run_and_fulfil(std::move(task), std::move(promise));
+    return future.get();
+}
+
+/**
+ * Continue on a ThreadManager pool worker (inline if the pool refuses the task)
+ */
+class ScheduleAwaiter {
+public:
+    explicit ScheduleAwaiter(RatsClient& client) : client_(client) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return client_.submit_task([handle]() { handle.resume(); }, "coroutine");
+    }
+    void await_resume() const noexcept {}
+
+private:
+    RatsClient& client_;
+};
+
+inline ScheduleAwaiter schedule(RatsClient& client) {
+    return ScheduleAwaiter(client);
+}
+
+/**
+ * Suspend for a delay on the client's timer wheel (resolution 100 ms)
+ */
+class SleepAwaiter {
+public:
+    SleepAwaiter(RatsClient& client, std::chrono::milliseconds delay) : client_(client), delay_(delay) {}
+
+    bool await_ready() const noexcept { return delay_.count() <= 0; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return client_.schedule_task(delay_, [handle]() { handle.resume(); }, "coroutine-sleep") != 0;
+    }
+    void await_resume() const noexcept {}
+
+private:
+    RatsClient& client_;
+    std::chrono::milliseconds delay_;
+};
+
+inline SleepAwaiter sleep_for(RatsClient& client, std::chrono::milliseconds delay) {
+    return SleepAwaiter(client, delay);
+}
+
+/**
+ * Run a blocking function on a pool worker and continue there with its result.
+ * If the pool refuses the task the function runs inline.
+ */
+template<typename Function>
+class OffloadAwaiter {
+public:
+    using Result = std::invoke_result_t<Function&>;
+
+    OffloadAwaiter(RatsClient& client, Function function, std::string name)
+        : client_(client), function_(std::move(function)), name_(std::move(name)) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        if (client_.submit_task([this, handle]() { run(); handle.resume(); }, name_)) {
+            return true;
+        }
+        run();
+        return false;
+    }
+    Result await_resume() {
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*result_);
+        }
+    }
+
+private:
+    struct Empty {};
+
+    void run() {
+        try {
+            if constexpr (std::is_void_v<Result>) {
+                function_();
+            } else {
+                result_.emplace(function_());
+            }
+        } catch (...) {
+            exception_ = std::current_exception();
+        }
+    }
+
+    RatsClient& client_;
+    Function function_;
+    std::string name_;
+    std::optional<std::conditional_t<std::is_void_v<Result>, Empty, Result>> result_;
+    std::exception_ptr exception_;
+};
+
+template<typename Function>
+OffloadAwaiter<Function> offload(RatsClient& client, Function function, std::string name = "coroutine-offload") {
+    return OffloadAwaiter<Function>(client, std::move(function), std::move(name));
+}
+
+/**
+ * Connect to a peer (RatsClient::connect_to_peer on a pool worker)
+ * @return true if the connection was initiated
+ */
+inline auto connect_to_peer(RatsClient& client, std::string host, int port,
+                            ConnectionStrategy strategy = ConnectionStrategy::AUTO_ADAPTIVE) {
+    return offload(client, [&client, host = std::move(host), port, strategy]() {
+        return client.connect_to_peer(host, port, strategy);
+    }, "coroutine-connect");
+}
+
+/**
+ * Detect the NAT type (RatsClient::detect_nat_type on a pool worker)
+ */
+inline auto detect_nat_type(RatsClient& client) {
+    return offload(client, [&client]() { return client.detect_nat_type(); }, "coroutine-nat-detection");
+}
+
+/**
+ * Discover the public IP via STUN and ignore it (RatsClient::discover_and_ignore_public_ip on a pool worker)
+ */
+inline auto discover_and_ignore_public_ip(RatsClient& client, std::string stun_server = "stun.l.google.com",
+                                          int stun_port = 19302) {
+    return offload(client, [&client, stun_server = std::move(stun_server), stun_port]() {
+        return client.discover_and_ignore_public_ip(stun_server, stun_port);
+    }, "coroutine-stun");
+}
+
+/**
+ * Send a request to a peer and suspend until the outcome arrives. Resumes
+ * with the result, or throws std::runtime_error on the peer's error or a local
+ * failure, like the future overload of RatsClient::request.
+ */
+class RequestAwaiter {
+public:
+    RequestAwaiter(RatsClient& client, std::string peer_id, std::string method, nlohmann::json params,
+                   std::chrono::milliseconds timeout)
+        : client_(client), peer_id_(std::move(peer_id)), method_(std::move(method)), params_(std::move(params)),
+          timeout_(timeout), success_(false) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        client_.request(peer_id_, method_, params_,
+                        [this, handle](bool success, const nlohmann::json& result, const std::string& error) {
+            success_ = success;
+            result_ = result;
+            error_ = error;
+            handoff_.complete(handle);
+        }, timeout_);
+        return handoff_.suspend();
+    }
+    nlohmann::json await_resume() {
+        if (!success_) {
+            throw std::runtime_error(error_);
+        }
+        return std::move(result_);
+    }
+
+private:
+    RatsClient& client_;
+    std::string peer_id_;
+    std::string method_;
+    nlohmann::json params_;
+    std::chrono::milliseconds timeout_;
+    bool success_;
+    nlohmann::json result_;
+    std::string error_;
+    detail::Handoff handoff_;
+};
+
+inline RequestAwaiter request(RatsClient& client, std::string peer_id, std::string method, nlohmann::json params,
+                              std::chrono::milliseconds timeout =
+                                  std::chrono::milliseconds(RatsClient::DEFAULT_REQUEST_TIMEOUT_MS)) {
+    return RequestAwaiter(client, std::move(peer_id), std::move(method), std::move(params), timeout);
+}
+
+/**
+ * Look up peers for a content hash on the DHT and collect the addresses found
+ * until `wait` has passed or `enough` distinct peers are known. Resumes with
+ * an empty list if the lookup could not start.
+ */
+class FindPeersAwaiter {
+public:
+    FindPeersAwaiter(RatsClient& client, std::string content_hash, std::chrono::milliseconds wait, size_t enough,
+                     int iteration_max)
+        : client_(client), content_hash_(std::move(content_hash)), wait_(wait), iteration_max_(iteration_max),
+          state_(std::make_shared<State>()) {
+        state_->enough = enough;
+    }
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        state_->handle = handle;
+        std::shared_ptr<State> state = state_;
+
+        bool started = client_.find_peers_by_hash(content_hash_, [state](const std::vector<std::string>& peers) {
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->finished) {
+                    return;
+                }
+                for (const auto& peer : peers) {
+                    if (state->seen.insert(peer).second) {
+                        state->peers.push_back(peer);
+                    }
+                }
+                done = state->peers.size() >= state->enough;
+            }
+            if (done) {
+                finish(state);
+            }
+        }, iteration_max_);
+
+        if (!started || client_.schedule_task(wait_, [state]() { finish(state); }, "coroutine-find-peers") == 0) {
+            finish(state);
+        }
+        return state->handoff.suspend();
+    }
+    std::vector<std::string> await_resume() {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return std::move(state_->peers);
+    }
+
+private:
+    // Shared with the DHT callback and the timeout, which may outlive the awaiter
+    struct State {
+        std::mutex mutex;
+        std::vector<std::string> peers;
+        std::unordered_set<std::string> seen;
+        size_t enough = 0;
+        bool finished = false;
+        std::coroutine_handle<> handle;
+        detail::Handoff handoff;
+    };
+
+    static void finish(const std::shared_ptr<State>& state) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->finished) {
+                return;
+            }
+            state->finished = true;
+        }
+        state->handoff.complete(state->handle);
+    }
+
+    RatsClient& client_;
+    std::string content_hash_;
+    std::chrono::milliseconds wait_;
+    int iteration_max_;
+    std::shared_ptr<State> state_;
+};
+
+inline FindPeersAwaiter find_peers(RatsClient& client, std::string content_hash,
+                                   std::chrono::milliseconds wait = std::chrono::seconds(10),
+                                   size_t enough = SIZE_MAX, int iteration_max = 1) {
+    return FindPeersAwaiter(client, std::move(content_hash), wait, enough, iteration_max);
+}
+
+/**
+ * Request a file and suspend until the transfer completes, fails or is
+ * cancelled; the transfer state is checked every poll_interval on the timer
+ * wheel. Resumes with the final progress, or nullptr if the request could not
+ * be sent.
+ */
+class RequestFileAwaiter {
+public:
+    RequestFileAwaiter(RatsClient& client, std::string peer_id, std::string remote_path, std::string local_path,
+                       std::chrono::milliseconds poll_interval)
+        : client_(client), peer_id_(std::move(peer_id)), remote_path_(std::move(remote_path)),
+          local_path_(std::move(local_path)), poll_interval_(poll_interval) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        transfer_id_ = client_.request_file(peer_id_, remote_path_, local_path_);
+        if (transfer_id_.empty()) {
+            return false;
+        }
+        handle_ = handle;
+        if (!poll()) {
+            result_ = client_.get_file_transfer_progress(transfer_id_);
+            return false;
+        }
+        return true;
+    }
+    std::shared_ptr<FileTransferProgress> await_resume() { return std::move(result_); }
+
+private:
+    static bool is_finished(const std::shared_ptr<FileTransferProgress>& progress) {
+        return !progress || progress->status == FileTransferStatus::COMPLETED ||
+               progress->status == FileTransferStatus::FAILED || progress->status == FileTransferStatus::CANCELLED;
+    }
+
+    // Check again after poll_interval; false if the client refused the timer
+    bool poll() {
+        return client_.schedule_task(poll_interval_, [this]() {
+            auto progress = client_.get_file_transfer_progress(transfer_id_);
+            if (is_finished(progress) || !poll()) {
+                result_ = std::move(progress);
+                handle_.resume();
+            }
+        }, "coroutine-file-transfer") != 0;
+    }
+
+    RatsClient& client_;
+    std::string peer_id_;
+    std::string remote_path_;
+    std::string local_path_;
+    std::chrono::milliseconds poll_interval_;
+    std::string transfer_id_;
+    std::coroutine_handle<> handle_;
+    std::shared_ptr<FileTransferProgress> result_;
+};
+
+inline RequestFileAwaiter request_file(RatsClient& client, std::string peer_id, std::string remote_path,
+                                       std::string local_path,
+                                       std::chrono::milliseconds poll_interval = std::chrono::milliseconds(100)) {
+    return RequestFileAwaiter(client, std::move(peer_id), std::move(remote_path), std::move(local_path),
+                              poll_interval);
+}
+
+} // namespace async
+} // namespace librats
+
+#endif // __cpp_impl_coroutine
@@ -0,0 +1,152 @@
+#include "rats_message.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace librats {
+
+namespace {
+
+const char* const BUILTIN_TYPE_NAMES[] = {
+    nullptr,
+    "peer",
+    "peers_request",
+    "peers_response",
+    "ice_offer",
+    "ice_answer",
+    "ice_candidate",
+    "hole_punch_coordination",
+    "nat_info_exchange",
+    "hole_punch_response",
+    "rpc_request",
+    "rpc_response"
+};
+constexpr size_t BUILTIN_TYPE_COUNT = sizeof(BUILTIN_TYPE_NAMES) / sizeof(BUILTIN_TYPE_NAMES[0]);
+
+uint16_t hash_type_name(const std::string& name) {
+    // FNV-1a, folded to 15 bits
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return static_cast<uint16_t>((hash ^ (hash >> 15)) & 0x7FFF);
+}
+
+} // anonymous namespace
+
+namespace rats_message_type {
+
+uint16_t id_of(const std::string& name) {
+    if (name.empty()) {
+        return UNKNOWN;
+    }
+    for (size_t id = 1; id < BUILTIN_TYPE_COUNT; ++id) {
+        if (name == BUILTIN_TYPE_NAMES[id]) {
+            return static_cast<uint16_t>(id);
+        }
+    }
+    return CUSTOM_FLAG | hash_type_name(name);
+}
+
+const char* builtin_name(uint16_t id) {
+    return id < BUILTIN_TYPE_COUNT ? BUILTIN_TYPE_NAMES[id] : nullptr;
+}
+
+} // namespace rats_message_type
+
+bool encode_rats_envelope(const std::string& type, const std::string& sender_peer_id, int64_t timestamp,
+                          uint8_t encoding, const uint8_t* body, size_t body_size, std::vector<uint8_t>& out) {
+    uint16_t type_id = rats_message_type::id_of(type);
+    bool custom = (type_id & rats_message_type::CUSTOM_FLAG) != 0;
+    if (type_id == rats_message_type::UNKNOWN || type.size() > 255 || sender_peer_id.size() > 255) {
+        return false;
+    }
+
+    out.clear();
+    out.reserve(2 + 1 + 1 + (custom ? type.size() : 0) + 1 + sender_peer_id.size() + 8 + body_size);
+    out.push_back(static_cast<uint8_t>(type_id >> 8));
+    out.push_back(static_cast<uint8_t>(type_id));
+    out.push_back(encoding);
+    if (custom) {
+        out.push_back(static_cast<uint8_t>(type.size()));
+        out.insert(out.end(), type.begin(), type.end());
+    } else {
+        out.push_back(0);
+    }
+    out.push_back(static_cast<uint8_t>(sender_peer_id.size()));
+    out.insert(out.end(), sender_peer_id.begin(), sender_peer_id.end());
+    uint64_t time = static_cast<uint64_t>(timestamp);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(time >> shift));
+    }
+    out.insert(out.end(), body, body + body_size);
+    return true;
+}
+
+bool decode_rats_envelope(const SharedBuffer& data, RatsEnvelope& out) {
+    const uint8_t* bytes = data.data();
+    size_t size = data.size();
+    size_t offset = 0;
+
+    if (size < 4) {
+        return false;
+    }
+    out.type_id = static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+    out.encoding = bytes[2];
+    size_t name_size = bytes[3];
+    offset = 4;
+
+    if (out.type_id & rats_message_type::CUSTOM_FLAG) {
+        if (name_size == 0 || size < offset + name_size) {
+            return false;
+        }
+        out.type_name = reinterpret_cast<const char*>(bytes + offset);
+        out.type_name_size = name_size;
+        offset += name_size;
+    } else {
+        const char* name = rats_message_type::builtin_name(out.type_id);
+        if (!name || name_size != 0) {
+            return false;
+        }
+        out.type_name = name;
+        out.type_name_size = std::strlen(name);
+    }
+
+    if (size < offset + 1) {
+        return false;
+    }
+    size_t sender_size = bytes[offset++];
+    if (size < offset + sender_size + 8) {
+        return false;
+    }
+    out.sender_peer_id.assign(reinterpret_cast<const char*>(bytes + offset), sender_size);
+    offset += sender_size;
+
+    uint64_t time = 0;
+    for (int i = 0; i < 8; ++i) {
+        time = (time << 8) | bytes[offset++];
+    }
+    out.timestamp = static_cast<int64_t>(time);
+    out.body = data.slice(offset);
+    return true;
+}
+
+const nlohmann::json& RatsMessagePayload::json() const {
+    if (!parsed_) {
+        if (!codec_) {
+            throw std::runtime_error("Payload is raw bytes");
+        }
+        json_ = codec_->decode(body_.data(), body_.size());
+        parsed_ = true;
+    }
+    return json_;
+}
+
+std::string RatsMessagePayload::raw() const {
+    if (is_raw() || (codec_ && codec_->builtin_id() == payload_encoding::JSON)) {
+        return body_.to_string();
+    }
+    return json().dump();
+}
+
+} // namespace librats
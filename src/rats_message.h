@@ -0,0 +1,148 @@
+#pragma once
+
+#include "buffer.h"
+#include "payload_codec.h"
+#include "json.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace librats {
+
+/**
+ * Interned ids of rats message types.
+ *
+ * Built-in types have fixed ids below CUSTOM_FLAG. Any other type name maps to
+ * CUSTOM_FLAG | 15-bit hash of the name; envelopes of custom types carry the name
+ * as well, so the receiver can tell colliding names apart.
+ */
+namespace rats_message_type {
+constexpr uint16_t UNKNOWN = 0;
+constexpr uint16_t PEER = 1;
+constexpr uint16_t PEERS_REQUEST = 2;
+constexpr uint16_t PEERS_RESPONSE = 3;
+constexpr uint16_t ICE_OFFER = 4;
+constexpr uint16_t ICE_ANSWER = 5;
+constexpr uint16_t ICE_CANDIDATE = 6;
+constexpr uint16_t HOLE_PUNCH_COORDINATION = 7;
+constexpr uint16_t NAT_INFO_EXCHANGE = 8;
+constexpr uint16_t HOLE_PUNCH_RESPONSE = 9;
+constexpr uint16_t RPC_REQUEST = 10;
+constexpr uint16_t RPC_RESPONSE = 11;
+constexpr uint16_t CUSTOM_FLAG = 0x8000;
+
+/**
+ * Get the interned id of a message type name
+ * @param name Message type name
+ * @return Built-in id, or CUSTOM_FLAG | hash for other names (UNKNOWN for an empty name)
+ */
+uint16_t id_of(const std::string& name);
+
+/**
+ * Get the name of a built-in message type
+ * @param id Message type id
+ * @return Name, or nullptr if the id is not a built-in type
+ */
+const char* builtin_name(uint16_t id);
+} // namespace rats_message_type
+
+/**
+ * Decoded binary rats envelope (MessageDataType::RATS).
+ *
+ * Wire format (integers big endian):
+ *   [0-1]  type id
+ *   [2]    body encoding (payload_encoding)
+ *   [3]    type name length N (0 for built-in types)
+ *   [..N]  type name
+ *   [1]    sender peer id length S
+ *   [..S]  sender peer id
+ *   [8]    timestamp, milliseconds since the epoch
+ *   [...]  payload body
+ *
+ * The type and body are views into the received buffer.
+ */
+struct RatsEnvelope {
+    uint16_t type_id = rats_message_type::UNKNOWN;
+    uint8_t encoding = payload_encoding::JSON;
+    const char* type_name = nullptr;        // Not null terminated for custom types
+    size_t type_name_size = 0;
+    std::string sender_peer_id;
+    int64_t timestamp = 0;
+    SharedBuffer body;
+
+    std::string type() const { return std::string(type_name, type_name_size); }
+};
+
+/**
+ * Encode a rats message into a binary envelope
+ * @param type Message type name (at most 255 bytes)
+ * @param sender_peer_id Sender peer id (at most 255 bytes)
+ * @param timestamp Milliseconds since the epoch
+ * @param encoding Body encoding (payload_encoding)
+ * @param body Serialized payload
+ * @param body_size Size of the payload
+ * @param out Encoded envelope
+ * @return false if the type or sender does not fit
+ */
+bool encode_rats_envelope(const std::string& type, const std::string& sender_peer_id, int64_t timestamp,
+                          uint8_t encoding, const uint8_t* body, size_t body_size, std::vector<uint8_t>& out);
+
+/**
+ * Decode a binary envelope without copying its body
+ * @param data Envelope bytes (must outlive the type name view)
+ * @param out Decoded envelope
+ * @return false if the envelope is malformed
+ */
+bool decode_rats_envelope(const SharedBuffer& data, RatsEnvelope& out);
+
+/**
+ * Payload of a received rats message. Messages in binary envelopes are decoded
+ * only when a handler first asks for the JSON; the encoded body stays available.
+ * Handlers of one message run on one thread, so the decode cache is unsynchronized.
+ */
+class RatsMessagePayload {
+public:
+    /**
+     * Body received in a binary envelope
+     * @param body Encoded body
+     * @param codec Codec of the body, or nullptr for raw bytes
+     */
+    RatsMessagePayload(SharedBuffer body, std::shared_ptr<const PayloadCodec> codec)
+        : body_(std::move(body)), codec_(std::move(codec)), parsed_(false) {}
+
+    // Body already parsed from a JSON envelope
+    explicit RatsMessagePayload(nlohmann::json json) : json_(std::move(json)), parsed_(true) {}
+
+    /**
+     * Get the payload as JSON, decoding it on first use
+     * @return Decoded payload
+     * @throws std::exception if the body is raw bytes or not a valid encoding
+     */
+    const nlohmann::json& json() const;
+
+    /**
+     * Get the encoded body (empty for payloads of JSON envelopes)
+     * @return Body bytes as sent
+     */
+    const SharedBuffer& bytes() const { return body_; }
+
+    /**
+     * Get the payload as JSON text
+     * @return JSON text, or the body bytes as is for raw payloads
+     */
+    std::string raw() const;
+
+    bool is_parsed() const { return parsed_; }
+    bool is_raw() const { return !parsed_ && !codec_; }
+
+    // Codec of the body (nullptr for raw bytes and JSON envelopes)
+    const std::shared_ptr<const PayloadCodec>& codec() const { return codec_; }
+
+private:
+    SharedBuffer body_;
+    std::shared_ptr<const PayloadCodec> codec_;
+    mutable nlohmann::json json_;
+    mutable bool parsed_;
+};
+
+} // namespace librats
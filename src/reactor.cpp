@@ -0,0 +1,707 @@
+#include "reactor.h"
+#include "logger.h"
+#include "os.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(RATS_REACTOR_EPOLL)
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <errno.h>
+#elif defined(RATS_REACTOR_KQUEUE)
+    #include <sys/types.h>
+    #include <sys/event.h>
+    #include <sys/time.h>
+    #include <fcntl.h>
+    #include <errno.h>
+#else
+    #ifndef _WIN32
+        #include <poll.h>
+        #include <fcntl.h>
+        #include <errno.h>
+    #endif
+#endif
+
+// Reactor module logging macros
+#define LOG_REACTOR_DEBUG(message) LOG_DEBUG("reactor", message)
+#define LOG_REACTOR_INFO(message)  LOG_INFO("reactor", message)
+#define LOG_REACTOR_WARN(message)  LOG_WARN("reactor", message)
+#define LOG_REACTOR_ERROR(message) LOG_ERROR("reactor", message)
+
+namespace librats {
+
+// Upper bound for a single wait so that pollers without a wakeup primitive stay responsive
+static const int POLL_FALLBACK_MAX_WAIT_MS = 50;
+static const size_t MAX_EVENTS_PER_WAIT = 256;
+
+// =========================================================================
+// IoPoller
+// =========================================================================
+
+#if defined(RATS_REACTOR_EPOLL)
+
+IoPoller::IoPoller() : epoll_fd_(-1), wakeup_fd_(-1) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_REACTOR_ERROR("Failed to create epoll instance: " << strerror(errno));
+        return;
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        LOG_REACTOR_ERROR("Failed to create eventfd: " << strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeup_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev) != 0) {
+        LOG_REACTOR_ERROR("Failed to register eventfd with epoll: " << strerror(errno));
+    }
+}
+
+IoPoller::~IoPoller() {
+    if (wakeup_fd_ >= 0) {
+        close(wakeup_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
+
+bool IoPoller::is_valid() const {
+    return epoll_fd_ >= 0 && wakeup_fd_ >= 0;
+}
+
+bool IoPoller::add(socket_t socket, uint32_t events) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLRDHUP;
+    if (events & IO_EVENT_READ) ev.events |= EPOLLIN;
+    if (events & IO_EVENT_WRITE) ev.events |= EPOLLOUT;
+    ev.data.fd = socket;
+
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &ev) != 0) {
+        LOG_REACTOR_ERROR("Failed to add socket " << socket << " to epoll: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool IoPoller::modify(socket_t socket, uint32_t events) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLRDHUP;
+    if (events & IO_EVENT_READ) ev.events |= EPOLLIN;
+    if (events & IO_EVENT_WRITE) ev.events |= EPOLLOUT;
+    ev.data.fd = socket;
+
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, socket, &ev) != 0) {
+        LOG_REACTOR_ERROR("Failed to modify socket " << socket << " in epoll: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool IoPoller::remove(socket_t socket) {
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket, nullptr) == 0;
+}
+
+int IoPoller::wait(std::vector<Event>& events, int timeout_ms) {
+    events.clear();
+
+    struct epoll_event ready[MAX_EVENTS_PER_WAIT];
+    int count = epoll_wait(epoll_fd_, ready, static_cast<int>(MAX_EVENTS_PER_WAIT), timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        LOG_REACTOR_ERROR("epoll_wait failed: " << strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (ready[i].data.fd == wakeup_fd_) {
+            uint64_t value;
+            while (read(wakeup_fd_, &value, sizeof(value)) > 0) {}
+            continue;
+        }
+
+        uint32_t flags = 0;
+        if (ready[i].events & EPOLLIN) flags |= IO_EVENT_READ;
+        if (ready[i].events & EPOLLOUT) flags |= IO_EVENT_WRITE;
+        if (ready[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) flags |= IO_EVENT_ERROR | IO_EVENT_READ;
+        events.push_back({ready[i].data.fd, flags});
+    }
+
+    return static_cast<int>(events.size());
+}
+
+void IoPoller::wakeup() {
+    uint64_t value = 1;
+    ssize_t written = write(wakeup_fd_, &value, sizeof(value));
+    (void)written;
+}
+
+const char* IoPoller::backend_name() {
+    return "epoll";
+}
+
+#elif defined(RATS_REACTOR_KQUEUE)
+
+IoPoller::IoPoller() : kqueue_fd_(-1) {
+    wakeup_pipe_[0] = -1;
+    wakeup_pipe_[1] = -1;
+
+    kqueue_fd_ = kqueue();
+    if (kqueue_fd_ < 0) {
+        LOG_REACTOR_ERROR("Failed to create kqueue instance: " << strerror(errno));
+        return;
+    }
+
+    if (pipe(wakeup_pipe_) != 0) {
+        LOG_REACTOR_ERROR("Failed to create wakeup pipe: " << strerror(errno));
+        wakeup_pipe_[0] = -1;
+        wakeup_pipe_[1] = -1;
+        return;
+    }
+    fcntl(wakeup_pipe_[0], F_SETFL, fcntl(wakeup_pipe_[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(wakeup_pipe_[1], F_SETFL, fcntl(wakeup_pipe_[1], F_GETFL, 0) | O_NONBLOCK);
+
+    struct kevent change;
+    EV_SET(&change, wakeup_pipe_[0], EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    if (kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr) != 0) {
+        LOG_REACTOR_ERROR("Failed to register wakeup pipe with kqueue: " << strerror(errno));
+    }
+}
+
+IoPoller::~IoPoller() {
+    if (wakeup_pipe_[0] >= 0) close(wakeup_pipe_[0]);
+    if (wakeup_pipe_[1] >= 0) close(wakeup_pipe_[1]);
+    if (kqueue_fd_ >= 0) close(kqueue_fd_);
+}
+
+bool IoPoller::is_valid() const {
+    return kqueue_fd_ >= 0 && wakeup_pipe_[0] >= 0;
+}
+
+bool IoPoller::add(socket_t socket, uint32_t events) {
+    struct kevent changes[2];
+    int count = 0;
+    if (events & IO_EVENT_READ) {
+        EV_SET(&changes[count++], socket, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    }
+    if (events & IO_EVENT_WRITE) {
+        EV_SET(&changes[count++], socket, EVFILT_WRITE, EV_ADD, 0, 0, nullptr);
+    }
+
+    if (kevent(kqueue_fd_, changes, count, nullptr, 0, nullptr) != 0) {
+        LOG_REACTOR_ERROR("Failed to add socket " << socket << " to kqueue: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool IoPoller::modify(socket_t socket, uint32_t events) {
+    struct kevent changes[2];
+    EV_SET(&changes[0], socket, EVFILT_READ, (events & IO_EVENT_READ) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+    EV_SET(&changes[1], socket, EVFILT_WRITE, (events & IO_EVENT_WRITE) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+
+    // Apply individually; deleting a filter that is not registered fails harmlessly
+    bool success = true;
+    for (auto& change : changes) {
+        if (kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr) != 0 && (change.flags & EV_ADD)) {
+            LOG_REACTOR_ERROR("Failed to modify socket " << socket << " in kqueue: " << strerror(errno));
+            success = false;
+        }
+    }
+    return success;
+}
+
+bool IoPoller::remove(socket_t socket) {
+    // Delete both filters individually; one of them may not be registered
+    struct kevent change;
+    EV_SET(&change, socket, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    bool removed = kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr) == 0;
+    EV_SET(&change, socket, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    removed = (kevent(kqueue_fd_, &change, 1, nullptr, 0, nullptr) == 0) || removed;
+    return removed;
+}
+
+int IoPoller::wait(std::vector<Event>& events, int timeout_ms) {
+    events.clear();
+
+    struct timespec timeout;
+    struct timespec* timeout_ptr = nullptr;
+    if (timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        timeout_ptr = &timeout;
+    }
+
+    struct kevent ready[MAX_EVENTS_PER_WAIT];
+    int count = kevent(kqueue_fd_, nullptr, 0, ready, static_cast<int>(MAX_EVENTS_PER_WAIT), timeout_ptr);
+    if (count < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        LOG_REACTOR_ERROR("kevent wait failed: " << strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        socket_t socket = static_cast<socket_t>(ready[i].ident);
+        if (socket == wakeup_pipe_[0]) {
+            char buffer[64];
+            while (read(wakeup_pipe_[0], buffer, sizeof(buffer)) > 0) {}
+            continue;
+        }
+
+        uint32_t flags = 0;
+        if (ready[i].filter == EVFILT_READ) flags |= IO_EVENT_READ;
+        if (ready[i].filter == EVFILT_WRITE) flags |= IO_EVENT_WRITE;
+        if (ready[i].flags & (EV_EOF | EV_ERROR)) flags |= IO_EVENT_ERROR | IO_EVENT_READ;
+        events.push_back({socket, flags});
+    }
+
+    return static_cast<int>(events.size());
+}
+
+void IoPoller::wakeup() {
+    char value = 1;
+    ssize_t written = write(wakeup_pipe_[1], &value, 1);
+    (void)written;
+}
+
+const char* IoPoller::backend_name() {
+    return "kqueue";
+}
+
+#else // RATS_REACTOR_POLL
+
+#ifdef _WIN32
+typedef WSAPOLLFD rats_pollfd;
+#define rats_poll WSAPoll
+#else
+typedef struct pollfd rats_pollfd;
+#define rats_poll poll
+#endif
+
+IoPoller::IoPoller() {
+#ifndef _WIN32
+    wakeup_pipe_[0] = -1;
+    wakeup_pipe_[1] = -1;
+    if (pipe(wakeup_pipe_) != 0) {
+        LOG_REACTOR_ERROR("Failed to create wakeup pipe: " << strerror(errno));
+        wakeup_pipe_[0] = -1;
+        wakeup_pipe_[1] = -1;
+        return;
+    }
+    fcntl(wakeup_pipe_[0], F_SETFL, fcntl(wakeup_pipe_[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(wakeup_pipe_[1], F_SETFL, fcntl(wakeup_pipe_[1], F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+IoPoller::~IoPoller() {
+#ifndef _WIN32
+    if (wakeup_pipe_[0] >= 0) close(wakeup_pipe_[0]);
+    if (wakeup_pipe_[1] >= 0) close(wakeup_pipe_[1]);
+#endif
+}
+
+bool IoPoller::is_valid() const {
+#ifdef _WIN32
+    return true;
+#else
+    return wakeup_pipe_[0] >= 0;
+#endif
+}
+
+bool IoPoller::add(socket_t socket, uint32_t events) {
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+    sockets_[socket] = events;
+    return true;
+}
+
+bool IoPoller::modify(socket_t socket, uint32_t events) {
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+    auto it = sockets_.find(socket);
+    if (it == sockets_.end()) {
+        return false;
+    }
+    it->second = events;
+    return true;
+}
+
+bool IoPoller::remove(socket_t socket) {
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+    return sockets_.erase(socket) > 0;
+}
+
+int IoPoller::wait(std::vector<Event>& events, int timeout_ms) {
+    events.clear();
+
+    // Snapshot the interest set; sockets added meanwhile are picked up on the next wait
+    std::vector<rats_pollfd> fds;
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex_);
+        fds.reserve(sockets_.size() + 1);
+        for (const auto& pair : sockets_) {
+            rats_pollfd pfd;
+            pfd.fd = pair.first;
+            pfd.events = 0;
+            if (pair.second & IO_EVENT_READ) pfd.events |= POLLIN;
+            if (pair.second & IO_EVENT_WRITE) pfd.events |= POLLOUT;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+        }
+    }
+
+#ifdef _WIN32
+    // No wakeup primitive: bound the wait instead
+    if (timeout_ms < 0 || timeout_ms > POLL_FALLBACK_MAX_WAIT_MS) {
+        timeout_ms = POLL_FALLBACK_MAX_WAIT_MS;
+    }
+    if (fds.empty()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return 0;
+    }
+#else
+    rats_pollfd wakeup_pfd;
+    wakeup_pfd.fd = wakeup_pipe_[0];
+    wakeup_pfd.events = POLLIN;
+    wakeup_pfd.revents = 0;
+    fds.push_back(wakeup_pfd);
+#endif
+
+    int count = rats_poll(fds.data(), static_cast<unsigned long>(fds.size()), timeout_ms);
+    if (count < 0) {
+#ifndef _WIN32
+        if (errno == EINTR) {
+            return 0;
+        }
+#endif
+        LOG_REACTOR_ERROR("poll failed");
+        return -1;
+    }
+
+    for (const auto& pfd : fds) {
+        if (pfd.revents == 0) {
+            continue;
+        }
+#ifndef _WIN32
+        if (pfd.fd == wakeup_pipe_[0]) {
+            char buffer[64];
+            while (read(wakeup_pipe_[0], buffer, sizeof(buffer)) > 0) {}
+            continue;
+        }
+#endif
+        uint32_t flags = 0;
+        if (pfd.revents & POLLIN) flags |= IO_EVENT_READ;
+        if (pfd.revents & POLLOUT) flags |= IO_EVENT_WRITE;
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) flags |= IO_EVENT_ERROR | IO_EVENT_READ;
+        events.push_back({static_cast<socket_t>(pfd.fd), flags});
+    }
+
+    return static_cast<int>(events.size());
+}
+
+void IoPoller::wakeup() {
+#ifndef _WIN32
+    char value = 1;
+    ssize_t written = write(wakeup_pipe_[1], &value, 1);
+    (void)written;
+#endif
+}
+
+const char* IoPoller::backend_name() {
+    return "poll";
+}
+
+#endif
+
+// =========================================================================
+// IoReactor
+// =========================================================================
+
+namespace {
+
+size_t default_thread_count() {
+    size_t cores = std::thread::hardware_concurrency();
+    return std::min<size_t>(std::max<size_t>(cores, 2), 16);
+}
+
+} // namespace
+
+IoReactor::IoReactor(const std::string& name, size_t thread_count)
+    : name_(name),
+      thread_count_(thread_count > 0 ? thread_count : default_thread_count()),
+      running_(false),
+      tick_interval_(std::chrono::milliseconds(1000)) {
+}
+
+IoReactor::~IoReactor() {
+    stop();
+}
+
+bool IoReactor::start() {
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    if (running_.load()) {
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Worker>> workers;
+    for (size_t i = 0; i < thread_count_; ++i) {
+        auto worker = std::make_shared<Worker>();
+        if (!worker->poller.is_valid()) {
+            LOG_REACTOR_ERROR("[" << name_ << "] Failed to create " << IoPoller::backend_name() << " poller");
+            return false;
+        }
+        workers.push_back(worker);
+    }
+
+    running_.store(true);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        int cpu = thread_cpus_.empty() ? -1 : thread_cpus_[i % thread_cpus_.size()];
+        workers[i]->thread = std::thread(&IoReactor::worker_loop, this, workers[i], i == 0, cpu);
+    }
+    workers_ = std::move(workers);
+
+    LOG_REACTOR_INFO("[" << name_ << "] Started " << thread_count_ << " I/O threads using " << IoPoller::backend_name());
+    return true;
+}
+
+void IoReactor::stop() {
+    std::vector<std::shared_ptr<Worker>> workers;
+    {
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        if (!running_.load()) {
+            return;
+        }
+        running_.store(false);
+        workers = std::move(workers_);
+        workers_.clear();
+    }
+
+    for (auto& worker : workers) {
+        worker->poller.wakeup();
+    }
+
+    for (auto& worker : workers) {
+        if (!worker->thread.joinable()) {
+            continue;
+        }
+        if (worker->thread.get_id() == std::this_thread::get_id()) {
+            // Stopped from one of our own handlers; the loop exits once the handler returns
+            worker->thread.detach();
+        } else {
+            worker->thread.join();
+        }
+    }
+
+    LOG_REACTOR_INFO("[" << name_ << "] Stopped");
+}
+
+bool IoReactor::is_running() const {
+    return running_.load();
+}
+
+bool IoReactor::add_socket(socket_t socket, IoEventHandler handler, uint32_t events) {
+    auto worker = worker_for_socket(socket);
+    if (!worker) {
+        LOG_REACTOR_WARN("[" << name_ << "] Cannot add socket " << socket << " - reactor is not running");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker->handlers_mutex);
+        if (worker->handlers.find(socket) != worker->handlers.end()) {
+            LOG_REACTOR_WARN("[" << name_ << "] Socket " << socket << " is already registered");
+            return false;
+        }
+        worker->handlers[socket] = std::make_shared<IoEventHandler>(std::move(handler));
+    }
+
+    if (!worker->poller.add(socket, events)) {
+        std::lock_guard<std::mutex> lock(worker->handlers_mutex);
+        worker->handlers.erase(socket);
+        return false;
+    }
+
+    // Let a poll() based worker pick up the new socket immediately
+    worker->poller.wakeup();
+
+    LOG_REACTOR_DEBUG("[" << name_ << "] Registered socket " << socket);
+    return true;
+}
+
+bool IoReactor::remove_socket(socket_t socket) {
+    auto worker = worker_for_socket(socket);
+    if (!worker) {
+        return false;
+    }
+
+    bool removed = false;
+    {
+        std::lock_guard<std::mutex> lock(worker->handlers_mutex);
+        removed = worker->handlers.erase(socket) > 0;
+        worker->removed_in_batch.insert(socket);
+    }
+
+    worker->poller.remove(socket);
+
+    if (removed) {
+        LOG_REACTOR_DEBUG("[" << name_ << "] Unregistered socket " << socket);
+    }
+    return removed;
+}
+
+bool IoReactor::set_socket_events(socket_t socket, uint32_t events) {
+    auto worker = worker_for_socket(socket);
+    if (!worker) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker->handlers_mutex);
+        if (worker->handlers.find(socket) == worker->handlers.end()) {
+            return false;
+        }
+    }
+
+    if (!worker->poller.modify(socket, events)) {
+        return false;
+    }
+
+#if defined(RATS_REACTOR_POLL)
+    // A poll() based worker only sees the new interest set on its next wait
+    worker->poller.wakeup();
+#endif
+    return true;
+}
+
+void IoReactor::set_tick_callback(std::function<void()> callback, std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(tick_mutex_);
+    tick_callback_ = std::move(callback);
+    tick_interval_ = interval.count() > 0 ? interval : std::chrono::milliseconds(1000);
+}
+
+void IoReactor::set_thread_count(size_t thread_count) {
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    thread_count_ = thread_count > 0 ? thread_count : default_thread_count();
+}
+
+void IoReactor::set_thread_cpus(const std::vector<int>& cpus) {
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    thread_cpus_ = cpus;
+}
+
+size_t IoReactor::get_thread_count() const {
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    return thread_count_;
+}
+
+size_t IoReactor::get_socket_count() const {
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    size_t count = 0;
+    for (const auto& worker : workers_) {
+        std::lock_guard<std::mutex> handlers_lock(worker->handlers_mutex);
+        count += worker->handlers.size();
+    }
+    return count;
+}
+
+std::shared_ptr<IoReactor::Worker> IoReactor::worker_for_socket(socket_t socket) const {
+    std::lock_guard<std::mutex> lock(workers_mutex_);
+    if (workers_.empty()) {
+        return nullptr;
+    }
+    return workers_[socket_shard(socket, workers_.size())];
+}
+
+void IoReactor::worker_loop(std::shared_ptr<Worker> worker, bool run_ticks, int cpu) {
+    if (cpu >= 0 && !set_current_thread_cpu(cpu)) {
+        LOG_REACTOR_WARN("[" << name_ << "] Could not pin I/O thread to CPU " << cpu);
+    }
+
+    std::vector<IoPoller::Event> events;
+    events.reserve(MAX_EVENTS_PER_WAIT);
+
+    auto next_tick = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(tick_mutex_);
+        next_tick += tick_interval_;
+    }
+
+    while (running_.load()) {
+        int timeout_ms = 1000;
+        if (run_ticks) {
+            auto until_tick = std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - std::chrono::steady_clock::now());
+            timeout_ms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(until_tick.count(), timeout_ms)));
+        }
+
+        // Removals from now on invalidate events of the coming batch
+        {
+            std::lock_guard<std::mutex> lock(worker->handlers_mutex);
+            worker->removed_in_batch.clear();
+        }
+
+        int count = worker->poller.wait(events, timeout_ms);
+        if (!running_.load()) {
+            break;
+        }
+        if (count < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        for (const auto& event : events) {
+            std::shared_ptr<IoEventHandler> handler;
+            {
+                std::lock_guard<std::mutex> lock(worker->handlers_mutex);
+                if (worker->removed_in_batch.count(event.socket) > 0) {
+                    continue;
+                }
+                auto it = worker->handlers.find(event.socket);
+                if (it == worker->handlers.end()) {
+                    continue;
+                }
+                handler = it->second;
+            }
+
+            try {
+                (*handler)(event.socket, event.events);
+            } catch (const std::exception& e) {
+                LOG_REACTOR_ERROR("[" << name_ << "] Exception in handler for socket " << event.socket << ": " << e.what());
+            } catch (...) {
+                LOG_REACTOR_ERROR("[" << name_ << "] Unknown exception in handler for socket " << event.socket);
+            }
+
+            if (!running_.load()) {
+                break;
+            }
+        }
+
+        if (run_ticks && running_.load() && std::chrono::steady_clock::now() >= next_tick) {
+            std::function<void()> tick;
+            std::chrono::milliseconds interval;
+            {
+                std::lock_guard<std::mutex> lock(tick_mutex_);
+                tick = tick_callback_;
+                interval = tick_interval_;
+            }
+            if (tick) {
+                try {
+                    tick();
+                } catch (const std::exception& e) {
+                    LOG_REACTOR_ERROR("[" << name_ << "] Exception in tick callback: " << e.what());
+                }
+            }
+            next_tick = std::chrono::steady_clock::now() + interval;
+        }
+    }
+}
+
+} // namespace librats
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "socket.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+// Readiness backend selection
+#if defined(__linux__)
+    #define RATS_REACTOR_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+    #define RATS_REACTOR_KQUEUE
+#else
+    #define RATS_REACTOR_POLL
+#endif
+
+namespace librats {
+
+/**
+ * Readiness flags reported to socket handlers
+ */
+enum IoEventFlags : uint32_t {
+    IO_EVENT_READ  = 0x01,   // Data (or EOF) is available for reading
+    IO_EVENT_WRITE = 0x02,   // Socket send buffer has space
+    IO_EVENT_ERROR = 0x04    // Error or hang-up; a read will report the condition
+};
+
+/**
+ * Shard a socket belongs to. The reactor and the send queue writer use the same
+ * mapping, so with equal thread counts a connection is read and written by the
+ * threads of one shard.
+ * @param socket The socket handle
+ * @param shard_count Number of shards (at least 1)
+ * @return Shard index in [0, shard_count)
+ */
+inline size_t socket_shard(socket_t socket, size_t shard_count) {
+    return std::hash<socket_t>()(socket) % shard_count;
+}
+
+/**
+ * How connection I/O is spread over threads and cores
+ */
+struct IoShardConfig {
+    size_t shards;              // Reactor and writer threads, one writer per socket shard (0 = unsharded defaults)
+    bool pin_threads;           // Pin the threads of shard i to cpus[i % cpus.size()]
+    std::vector<int> cpus;      // CPUs to pin to (empty = every CPU the process may run on)
+
+    IoShardConfig()
+        : shards(0),
+          pin_threads(false) {}
+};
+
+/**
+ * Handler invoked by the reactor when a registered socket becomes ready
+ * @param socket The ready socket
+ * @param events Combination of IoEventFlags
+ */
+using IoEventHandler = std::function<void(socket_t socket, uint32_t events)>;
+
+/**
+ * Level-triggered readiness poller for a set of sockets.
+ * Uses epoll on Linux, kqueue on macOS/BSD and poll()/WSAPoll() elsewhere.
+ * add/remove may be called from any thread; wait() is called by a single owner thread.
+ */
+class IoPoller {
+public:
+    struct Event {
+        socket_t socket;
+        uint32_t events;
+    };
+
+    IoPoller();
+    ~IoPoller();
+
+    IoPoller(const IoPoller&) = delete;
+    IoPoller& operator=(const IoPoller&) = delete;
+
+    /**
+     * Check if the backend was created successfully
+     * @return true if the poller can be used
+     */
+    bool is_valid() const;
+
+    /**
+     * Start watching a socket
+     * @param socket The socket handle
+     * @param events Interest set (IoEventFlags, IO_EVENT_READ by default)
+     * @return true if successful, false otherwise
+     */
+    bool add(socket_t socket, uint32_t events = IO_EVENT_READ);
+
+    /**
+     * Change the interest set of a watched socket
+     * @param socket The socket handle
+     * @param events New interest set (IoEventFlags)
+     * @return true if successful, false otherwise
+     */
+    bool modify(socket_t socket, uint32_t events);
+
+    /**
+     * Stop watching a socket (must be called before the socket is closed)
+     * @param socket The socket handle
+     * @return true if the socket was being watched
+     */
+    bool remove(socket_t socket);
+
+    /**
+     * Wait for ready sockets
+     * @param events Output vector receiving ready sockets (cleared first)
+     * @param timeout_ms Timeout in milliseconds (-1 to wait indefinitely)
+     * @return Number of ready sockets, 0 on timeout or wakeup, -1 on error
+     */
+    int wait(std::vector<Event>& events, int timeout_ms);
+
+    /**
+     * Interrupt a concurrent wait() call
+     */
+    void wakeup();
+
+    /**
+     * Get the name of the compiled-in backend
+     * @return "epoll", "kqueue" or "poll"
+     */
+    static const char* backend_name();
+
+private:
+#if defined(RATS_REACTOR_EPOLL)
+    int epoll_fd_;
+    int wakeup_fd_;
+#elif defined(RATS_REACTOR_KQUEUE)
+    int kqueue_fd_;
+    int wakeup_pipe_[2];
+#else
+    mutable std::mutex sockets_mutex_;
+    std::unordered_map<socket_t, uint32_t> sockets_;
+#ifndef _WIN32
+    int wakeup_pipe_[2];
+#endif
+#endif
+};
+
+/**
+ * IoReactor - pool of I/O threads dispatching socket readiness to handlers.
+ *
+ * Each socket is pinned to one I/O thread, so the handlers of a given socket never
+ * run concurrently. Handlers run on the I/O thread and should not block for long.
+ */
+class IoReactor {
+public:
+    /**
+     * Constructor
+     * @param name Name used in log messages
+     * @param thread_count Number of I/O threads (0 = one per CPU core, clamped to [2, 16])
+     */
+    explicit IoReactor(const std::string& name = "reactor", size_t thread_count = 0);
+    ~IoReactor();
+
+    IoReactor(const IoReactor&) = delete;
+    IoReactor& operator=(const IoReactor&) = delete;
+
+    /**
+     * Start the I/O threads
+     * @return true if started (or already running), false on error
+     */
+    bool start();
+
+    /**
+     * Stop the I/O threads and forget all registered sockets.
+     * Registered sockets are not closed.
+     */
+    void stop();
+
+    /**
+     * Check if the reactor is running
+     * @return true if running
+     */
+    bool is_running() const;
+
+    /**
+     * Register a socket for readiness events
+     * @param socket The socket handle
+     * @param handler Handler invoked on the socket's I/O thread
+     * @param events Interest set (IoEventFlags, IO_EVENT_READ by default)
+     * @return true if registered, false if not running or on error
+     */
+    bool add_socket(socket_t socket, IoEventHandler handler, uint32_t events = IO_EVENT_READ);
+
+    /**
+     * Change the events a registered socket is watched for, e.g. to wait for
+     * write readiness while a send buffer drains. May be called from any thread.
+     * @param socket The socket handle
+     * @param events New interest set (IoEventFlags)
+     * @return true if the socket is registered and the change was applied
+     */
+    bool set_socket_events(socket_t socket, uint32_t events);
+
+    /**
+     * Unregister a socket. No new events are dispatched for it once this returns;
+     * it is safe to call from the socket's own handler. Call before closing the socket.
+     * @param socket The socket handle
+     * @return true if the socket was registered
+     */
+    bool remove_socket(socket_t socket);
+
+    /**
+     * Set a callback run periodically on the first I/O thread
+     * @param callback Callback to run (empty to disable)
+     * @param interval Tick interval
+     */
+    void set_tick_callback(std::function<void()> callback, std::chrono::milliseconds interval);
+
+    /**
+     * Set the number of I/O threads. Takes effect on the next start().
+     * @param thread_count Number of threads (0 for one per core, between 2 and 16)
+     */
+    void set_thread_count(size_t thread_count);
+
+    /**
+     * Pin the I/O threads to CPUs, thread i to cpus[i % cpus.size()]. Takes effect on the next start().
+     * @param cpus Logical CPU numbers (empty to leave the threads unpinned)
+     */
+    void set_thread_cpus(const std::vector<int>& cpus);
+
+    /**
+     * Get the number of I/O threads
+     * @return Configured number of threads
+     */
+    size_t get_thread_count() const;
+
+    /**
+     * Get the number of registered sockets
+     * @return Number of sockets currently registered
+     */
+    size_t get_socket_count() const;
+
+private:
+    struct Worker {
+        IoPoller poller;
+        std::mutex handlers_mutex;
+        std::unordered_map<socket_t, std::shared_ptr<IoEventHandler>> handlers;
+        std::unordered_set<socket_t> removed_in_batch;  // Sockets removed while a batch is dispatched
+        std::thread thread;
+    };
+
+    void worker_loop(std::shared_ptr<Worker> worker, bool run_ticks, int cpu);
+    std::shared_ptr<Worker> worker_for_socket(socket_t socket) const;
+
+    std::string name_;
+    size_t thread_count_;
+    std::atomic<bool> running_;
+
+    mutable std::mutex workers_mutex_;
+    std::vector<std::shared_ptr<Worker>> workers_;
+    std::vector<int> thread_cpus_;  // Guarded by workers_mutex_
+
+    mutable std::mutex tick_mutex_;
+    std::function<void()> tick_callback_;
+    std::chrono::milliseconds tick_interval_;
+};
+
+} // namespace librats
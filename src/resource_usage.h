@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace librats {
+
+/**
+ * Memory held by one bounded cache, reported against its budget.
+ * Byte counts are estimates from entry sizes and container overhead, not allocator statistics.
+ */
+struct ResourceUsage {
+    size_t entries = 0;       // Live entries
+    size_t bytes = 0;         // Approximate memory held by the entries
+    size_t max_entries = 0;   // Entry budget (0 = unbounded)
+    size_t max_bytes = 0;     // Byte budget (0 = none, bounded by max_entries)
+    uint64_t evictions = 0;   // Entries dropped to stay within the budget or past their lifetime
+};
+
+} // namespace librats
@@ -0,0 +1,105 @@
+#include "ring_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace librats {
+
+namespace {
+
+size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+RingBuffer::RingBuffer(size_t capacity) : head_(0), size_(0) {
+    if (capacity > 0) {
+        buffer_.resize(round_up_pow2(capacity));
+    }
+}
+
+uint8_t* RingBuffer::prepare(size_t min_space, size_t& available) {
+    if (capacity() - size_ < min_space) {
+        grow(size_ + min_space);
+    }
+
+    size_t tail = (head_ + size_) & mask();
+    if (size_ == 0) {
+        head_ = 0;
+        tail = 0;
+    }
+    available = tail >= head_ ? capacity() - tail : head_ - tail;
+    if (size_ > 0 && tail == head_) {
+        available = 0;
+    }
+
+    // Enough room in total but split across the end: move the data to the front
+    if (available < min_space) {
+        std::rotate(buffer_.begin(), buffer_.begin() + head_, buffer_.end());
+        head_ = 0;
+        tail = size_;
+        available = capacity() - size_;
+    }
+    return buffer_.data() + tail;
+}
+
+void RingBuffer::commit(size_t bytes) {
+    size_ += bytes;
+}
+
+void RingBuffer::append(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t available = 0;
+        uint8_t* destination = prepare(1, available);
+        size_t chunk = (std::min)(available, size);
+        std::memcpy(destination, data, chunk);
+        commit(chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+const uint8_t* RingBuffer::front(size_t& available) const {
+    if (size_ == 0) {
+        available = 0;
+        return nullptr;
+    }
+    available = (std::min)(size_, capacity() - head_);
+    return buffer_.data() + head_;
+}
+
+void RingBuffer::peek(size_t offset, uint8_t* out, size_t count) const {
+    size_t position = (head_ + offset) & mask();
+    size_t first = (std::min)(count, capacity() - position);
+    std::memcpy(out, buffer_.data() + position, first);
+    std::memcpy(out + first, buffer_.data(), count - first);
+}
+
+const uint8_t* RingBuffer::linearize(size_t count) {
+    if (head_ + count > capacity()) {
+        std::rotate(buffer_.begin(), buffer_.begin() + head_, buffer_.end());
+        head_ = 0;
+    }
+    return buffer_.data() + head_;
+}
+
+void RingBuffer::consume(size_t count) {
+    count = (std::min)(count, size_);
+    size_ -= count;
+    head_ = size_ == 0 ? 0 : (head_ + count) & mask();
+}
+
+void RingBuffer::grow(size_t min_capacity) {
+    std::vector<uint8_t> grown(round_up_pow2((std::max)(min_capacity, static_cast<size_t>(64))));
+    if (size_ > 0) {
+        peek(0, grown.data(), size_);
+    }
+    buffer_.swap(grown);
+    head_ = 0;
+}
+
+} // namespace librats
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace librats {
+
+// Growable byte FIFO over a power-of-two circular buffer, for per-connection
+// receive and send queues. Sockets read straight into the free space returned
+// by prepare() and write straight from front(); a message that wraps around the
+// end is made contiguous in place by linearize() instead of being copied out.
+//
+// Not thread safe.
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity = 0);
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return buffer_.size(); }
+    void clear() { head_ = 0; size_ = 0; }
+
+    // Contiguous free space at the write position, at least min_space bytes
+    // (the buffer grows if needed); commit() the bytes actually written
+    uint8_t* prepare(size_t min_space, size_t& available);
+    void commit(size_t bytes);
+    void append(const uint8_t* data, size_t size);
+
+    // Contiguous readable bytes at the read position
+    const uint8_t* front(size_t& available) const;
+
+    // Copy bytes out without consuming them
+    void peek(size_t offset, uint8_t* out, size_t count) const;
+    uint8_t operator[](size_t offset) const { return buffer_[(head_ + offset) & mask()]; }
+
+    // Pointer to the first `count` bytes as one contiguous range, valid until the next modification
+    const uint8_t* linearize(size_t count);
+
+    void consume(size_t count);
+
+private:
+    std::vector<uint8_t> buffer_;
+    size_t head_;
+    size_t size_;
+
+    size_t mask() const { return buffer_.size() - 1; }
+    void grow(size_t min_capacity);
+};
+
+} // namespace librats
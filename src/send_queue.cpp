@@ -0,0 +1,443 @@
+#include "send_queue.h"
+#include "logger.h"
+#include "metrics.h"
+#include "reactor.h"
+#include "os.h"
+#include <algorithm>
+
+// Send queue module logging macros
+#define LOG_SEND_QUEUE_DEBUG(message) LOG_DEBUG("send_queue", message)
+#define LOG_SEND_QUEUE_INFO(message)  LOG_INFO("send_queue", message)
+#define LOG_SEND_QUEUE_WARN(message)  LOG_WARN("send_queue", message)
+#define LOG_SEND_QUEUE_ERROR(message) LOG_ERROR("send_queue", message)
+
+namespace librats {
+
+namespace {
+
+MetricGauge& queued_bytes_gauge() {
+    static MetricGauge& gauge = MetricsRegistry::getInstance().gauge(
+        "librats_send_queue_bytes", "Payload bytes waiting in peer send queues");
+    return gauge;
+}
+
+} // anonymous namespace
+
+// =========================================================================
+// PeerSendQueue
+// =========================================================================
+
+PeerSendQueue::PeerSendQueue(socket_t socket, const SendQueueConfig& config)
+    : socket_(socket),
+      config_(config),
+      drr_class_(static_cast<size_t>(SendPriority::DATA)),
+      drr_credited_(false),
+      queued_bytes_(0),
+      in_flight_messages_(0),
+      scheduled_(false),
+      closed_(false) {
+    config_.max_batch_messages = std::max<size_t>(config_.max_batch_messages, 1);
+    config_.fair_queue_quantum = std::max<size_t>(config_.fair_queue_quantum, 1);
+    config_.data_weight = std::max<uint32_t>(config_.data_weight, 1);
+    config_.bulk_weight = std::max<uint32_t>(config_.bulk_weight, 1);
+    class_bytes_.fill(0);
+    deficits_.fill(0);
+}
+
+bool PeerSendQueue::has_room(SendPriority priority, size_t size) const {
+    // CONTROL has a budget of its own; a message larger than the capacity is still accepted
+    // when nothing of its kind is queued
+    if (priority == SendPriority::CONTROL) {
+        const size_t control = static_cast<size_t>(SendPriority::CONTROL);
+        return queues_[control].empty() || class_bytes_[control] + size <= config_.max_queued_bytes;
+    }
+    size_t data_bytes = queued_bytes_ - class_bytes_[static_cast<size_t>(SendPriority::CONTROL)];
+    return data_bytes == 0 || queued_bytes_ + size <= config_.max_queued_bytes;
+}
+
+bool PeerSendQueue::evict_for(SendPriority priority) {
+    // Drop the oldest message of the least important class that is not above the new one
+    for (size_t c = SEND_PRIORITY_COUNT; c-- > static_cast<size_t>(priority);) {
+        if (priority == SendPriority::CONTROL && c != static_cast<size_t>(SendPriority::CONTROL)) {
+            continue;  // Data does not count against the CONTROL budget
+        }
+        if (!queues_[c].empty()) {
+            size_t size = queues_[c].front().size();
+            class_bytes_[c] -= size;
+            queued_bytes_ -= size;
+            queued_bytes_gauge().sub(static_cast<int64_t>(size));
+            queues_[c].pop_front();
+            stats_.dropped_messages++;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t PeerSendQueue::next_class() {
+    const size_t control = static_cast<size_t>(SendPriority::CONTROL);
+    if (!queues_[control].empty()) {
+        return control;
+    }
+
+    // Deficit round robin over DATA and BULK: a visited class is credited its quantum once
+    // and sends while its credit covers the next message (caller ensures one is non-empty)
+    for (;;) {
+        auto& queue = queues_[drr_class_];
+        if (queue.empty()) {
+            deficits_[drr_class_] = 0;
+        } else if (deficits_[drr_class_] >= queue.front().size()) {
+            return drr_class_;
+        } else if (!drr_credited_) {
+            uint32_t weight = drr_class_ == static_cast<size_t>(SendPriority::DATA) ? config_.data_weight
+                                                                                     : config_.bulk_weight;
+            deficits_[drr_class_] += config_.fair_queue_quantum * weight;
+            drr_credited_ = true;
+            continue;
+        }
+        drr_class_ = drr_class_ == static_cast<size_t>(SendPriority::DATA) ? static_cast<size_t>(SendPriority::BULK)
+                                                                             : static_cast<size_t>(SendPriority::DATA);
+        drr_credited_ = false;
+    }
+}
+
+size_t PeerSendQueue::queued_count() const {
+    size_t count = 0;
+    for (const auto& queue : queues_) {
+        count += queue.size();
+    }
+    return count;
+}
+
+void PeerSendQueue::clear_queues() {
+    for (auto& queue : queues_) {
+        queue.clear();
+    }
+    class_bytes_.fill(0);
+    deficits_.fill(0);
+    queued_bytes_gauge().sub(static_cast<int64_t>(queued_bytes_));
+    queued_bytes_ = 0;
+}
+
+bool PeerSendQueue::push(OutboundMessage&& message, bool& needs_schedule) {
+    needs_schedule = false;
+    size_t size = message.size();
+    SendPriority priority = message.priority;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_) {
+        stats_.rejected_messages++;
+        return false;
+    }
+
+    if (!has_room(priority, size)) {
+        switch (config_.policy) {
+            case SendBackpressurePolicy::FAIL:
+                stats_.rejected_messages++;
+                LOG_SEND_QUEUE_DEBUG("Queue full for socket " << socket_ << ", rejecting " << size << " bytes");
+                return false;
+
+            case SendBackpressurePolicy::DROP_OLDEST:
+                while (!has_room(priority, size)) {
+                    if (!evict_for(priority)) {
+                        // Only more important messages are queued
+                        stats_.rejected_messages++;
+                        return false;
+                    }
+                }
+                break;
+
+            case SendBackpressurePolicy::BLOCK: {
+                auto ready = [&]() { return closed_ || has_room(priority, size); };
+                if (config_.block_timeout.count() == 0) {
+                    space_cv_.wait(lock, ready);
+                } else if (!space_cv_.wait_for(lock, config_.block_timeout, ready)) {
+                    stats_.rejected_messages++;
+                    LOG_SEND_QUEUE_WARN("Timed out waiting for queue space on socket " << socket_);
+                    return false;
+                }
+                if (closed_) {
+                    stats_.rejected_messages++;
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+    size_t index = static_cast<size_t>(priority);
+    queues_[index].push_back(std::move(message));
+    class_bytes_[index] += size;
+    queued_bytes_ += size;
+    queued_bytes_gauge().add(static_cast<int64_t>(size));
+    stats_.peak_queued_bytes = std::max(stats_.peak_queued_bytes, queued_bytes_);
+
+    if (!scheduled_) {
+        scheduled_ = true;
+        needs_schedule = true;
+    }
+    return true;
+}
+
+bool PeerSendQueue::pop_batch(std::vector<OutboundMessage>& batch) {
+    batch.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || queued_count() == 0) {
+        scheduled_ = false;
+        idle_cv_.notify_all();
+        return false;
+    }
+
+    // Coalesce small messages in scheduling order, but always take at least one
+    size_t batch_bytes = 0;
+    while (queued_count() > 0 && batch.size() < config_.max_batch_messages) {
+        size_t index = next_class();
+        size_t size = queues_[index].front().size();
+        if (!batch.empty() && batch_bytes + size > config_.max_batch_bytes) {
+            break;
+        }
+        if (index != static_cast<size_t>(SendPriority::CONTROL)) {
+            deficits_[index] -= size;
+        }
+        batch_bytes += size;
+        class_bytes_[index] -= size;
+        queued_bytes_ -= size;
+        batch.push_back(std::move(queues_[index].front()));
+        queues_[index].pop_front();
+    }
+
+    queued_bytes_gauge().sub(static_cast<int64_t>(batch_bytes));
+    in_flight_messages_ = batch.size();
+    space_cv_.notify_all();
+    return true;
+}
+
+bool PeerSendQueue::finish_batch(bool success) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (success) {
+        stats_.sent_messages += in_flight_messages_;
+        stats_.batches_written++;
+    } else {
+        // The connection is broken; nothing else will be written
+        closed_ = true;
+        clear_queues();
+        space_cv_.notify_all();
+    }
+    in_flight_messages_ = 0;
+
+    bool more = !closed_ && queued_count() > 0;
+    if (!more) {
+        scheduled_ = false;
+    }
+    idle_cv_.notify_all();
+    return more;
+}
+
+void PeerSendQueue::close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    closed_ = true;
+    clear_queues();
+    space_cv_.notify_all();
+    idle_cv_.wait(lock, [this]() { return in_flight_messages_ == 0; });
+}
+
+bool PeerSendQueue::is_closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+bool PeerSendQueue::wait_drained(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait_for(lock, timeout, [this]() {
+        return closed_ || (queued_count() == 0 && in_flight_messages_ == 0);
+    });
+    return !closed_ && queued_count() == 0 && in_flight_messages_ == 0;
+}
+
+size_t PeerSendQueue::get_depth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_count();
+}
+
+SendQueueStats PeerSendQueue::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SendQueueStats stats = stats_;
+    stats.queued_messages = queued_count();
+    stats.queued_bytes = queued_bytes_;
+    return stats;
+}
+
+// =========================================================================
+// SendQueueWriter
+// =========================================================================
+
+SendQueueWriter::SendQueueWriter(const std::string& name, BatchSender sender)
+    : name_(name), sender_(std::move(sender)), running_(false) {}
+
+SendQueueWriter::~SendQueueWriter() {
+    stop();
+}
+
+bool SendQueueWriter::start(size_t thread_count, bool sharded, const std::vector<int>& cpus) {
+    if (running_.exchange(true)) {
+        return true;
+    }
+
+    thread_count = std::max<size_t>(thread_count, 1);
+    shards_.clear();
+    if (sharded) {
+        for (size_t i = 0; i < thread_count; ++i) {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        if (sharded) {
+            threads_.emplace_back(&SendQueueWriter::shard_loop, this, std::ref(*shards_[i]), cpu);
+        } else {
+            threads_.emplace_back(&SendQueueWriter::writer_loop, this, cpu);
+        }
+    }
+
+    LOG_SEND_QUEUE_INFO("Send queue writer '" << name_ << "' started with " << thread_count
+                        << (sharded ? " sharded" : "") << " threads");
+    return true;
+}
+
+void SendQueueWriter::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        ready_cv_.notify_all();
+    }
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->sleep_mutex);
+        shard->sleep_cv.notify_one();
+    }
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        ready_.clear();
+    }
+    // The shard threads are gone, so this thread may act as their consumer
+    for (auto& shard : shards_) {
+        std::shared_ptr<PeerSendQueue> queue;
+        while (shard->ready.pop(queue)) {
+        }
+    }
+
+    LOG_SEND_QUEUE_INFO("Send queue writer '" << name_ << "' stopped");
+}
+
+bool SendQueueWriter::is_running() const {
+    return running_.load();
+}
+
+bool SendQueueWriter::enqueue(const std::shared_ptr<PeerSendQueue>& queue, OutboundMessage&& message) {
+    if (!running_.load()) {
+        return false;
+    }
+
+    bool needs_schedule = false;
+    if (!queue->push(std::move(message), needs_schedule)) {
+        return false;
+    }
+    if (needs_schedule) {
+        schedule(queue);
+    }
+    return true;
+}
+
+void SendQueueWriter::schedule(const std::shared_ptr<PeerSendQueue>& queue) {
+    if (!shards_.empty()) {
+        Shard& shard = *shards_[socket_shard(queue->get_socket(), shards_.size())];
+        shard.ready.push(queue);
+        // Pairs with the owner publishing `sleeping` before its last emptiness check
+        if (shard.sleeping.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(shard.sleep_mutex);
+            shard.sleep_cv.notify_one();
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    ready_.push_back(queue);
+    ready_cv_.notify_one();
+}
+
+void SendQueueWriter::writer_loop(int cpu) {
+    if (cpu >= 0 && !set_current_thread_cpu(cpu)) {
+        LOG_SEND_QUEUE_WARN("Could not pin writer thread of '" << name_ << "' to CPU " << cpu);
+    }
+
+    std::vector<OutboundMessage> batch;
+
+    while (running_.load()) {
+        std::shared_ptr<PeerSendQueue> queue;
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex_);
+            ready_cv_.wait(lock, [this]() { return !running_.load() || !ready_.empty(); });
+            if (!running_.load()) {
+                break;
+            }
+            queue = std::move(ready_.front());
+            ready_.pop_front();
+        }
+
+        write_batch(queue, batch);
+    }
+}
+
+void SendQueueWriter::shard_loop(Shard& shard, int cpu) {
+    if (cpu >= 0 && !set_current_thread_cpu(cpu)) {
+        LOG_SEND_QUEUE_WARN("Could not pin writer thread of '" << name_ << "' to CPU " << cpu);
+    }
+
+    std::vector<OutboundMessage> batch;
+    std::shared_ptr<PeerSendQueue> queue;
+
+    while (running_.load()) {
+        if (shard.ready.pop(queue)) {
+            write_batch(queue, batch);
+            queue.reset();
+            continue;
+        }
+
+        // Announce the sleep before the last check, so a producer either sees the flag or we see its queue
+        std::unique_lock<std::mutex> lock(shard.sleep_mutex);
+        shard.sleeping.store(true, std::memory_order_seq_cst);
+        if (shard.ready.empty() && running_.load()) {
+            shard.sleep_cv.wait(lock);
+        }
+        shard.sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void SendQueueWriter::write_batch(const std::shared_ptr<PeerSendQueue>& queue, std::vector<OutboundMessage>& batch) {
+    if (!queue->pop_batch(batch)) {
+        return;
+    }
+
+    bool success = sender_(queue->get_socket(), batch);
+    if (!success) {
+        LOG_SEND_QUEUE_DEBUG("Failed to write " << batch.size() << " messages to socket " << queue->get_socket());
+    }
+    batch.clear();
+
+    // Requeue at the back so that busy peers share the writers fairly
+    if (queue->finish_batch(success)) {
+        schedule(queue);
+    }
+}
+
+} // namespace librats
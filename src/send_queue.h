@@ -0,0 +1,298 @@
+#pragma once
+
+#include "socket.h"
+#include "buffer.h"
+#include "mpsc_queue.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <array>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+namespace librats {
+
+class FileHandle;
+
+/**
+ * What a sender does when a peer's outbound queue is full
+ */
+enum class SendBackpressurePolicy {
+    BLOCK,          // Wait for space (up to block_timeout)
+    DROP_OLDEST,    // Discard the oldest queued messages to make room
+    FAIL            // Reject the new message immediately
+};
+
+/**
+ * Scheduling class of an outbound message.
+ * CONTROL is always sent first; DATA and BULK share the remaining bandwidth by weight.
+ */
+enum class SendPriority : uint8_t {
+    CONTROL = 0,    // Handshakes, peer exchange, ICE/NAT signalling, GossipSub control
+    DATA = 1,       // Application and pub/sub messages (default)
+    BULK = 2        // File chunks and other large transfers
+};
+
+constexpr size_t SEND_PRIORITY_COUNT = 3;
+
+/**
+ * Outbound queue configuration, applied to each peer connection
+ */
+struct SendQueueConfig {
+    size_t max_queued_bytes;                    // Queue capacity in payload bytes
+    size_t max_batch_bytes;                     // Upper bound of payload bytes coalesced into one write
+    size_t max_batch_messages;                  // Upper bound of messages coalesced into one write
+    SendBackpressurePolicy policy;              // Behaviour when the queue is full
+    std::chrono::milliseconds block_timeout;    // BLOCK policy: give up after this long (0 = wait indefinitely)
+    size_t writer_threads;                      // Number of threads draining the queues
+    uint32_t data_weight;                       // DATA share of the bandwidth left by CONTROL
+    uint32_t bulk_weight;                       // BULK share of the bandwidth left by CONTROL
+    size_t fair_queue_quantum;                  // Bytes credited per weight unit each round between DATA and BULK
+
+    SendQueueConfig()
+        : max_queued_bytes(16 * 1024 * 1024),
+          max_batch_bytes(256 * 1024),
+          max_batch_messages(64),
+          policy(SendBackpressurePolicy::BLOCK),
+          block_timeout(std::chrono::seconds(30)),
+          writer_threads(2),
+          data_weight(4),
+          bulk_weight(1),
+          fair_queue_quantum(16 * 1024) {}
+};
+
+/**
+ * Per-peer outbound queue statistics
+ */
+struct SendQueueStats {
+    size_t queued_messages;         // Current queue depth
+    size_t queued_bytes;            // Payload bytes currently queued
+    size_t peak_queued_bytes;       // Highest queued_bytes observed
+    uint64_t sent_messages;         // Messages handed to the socket
+    uint64_t batches_written;       // Writes performed (sent_messages / batches_written = coalescing factor)
+    uint64_t dropped_messages;      // Messages discarded by DROP_OLDEST
+    uint64_t rejected_messages;     // Messages refused (FAIL policy, BLOCK timeout or closed queue)
+
+    SendQueueStats()
+        : queued_messages(0), queued_bytes(0), peak_queued_bytes(0), sent_messages(0),
+          batches_written(0), dropped_messages(0), rejected_messages(0) {}
+};
+
+/**
+ * A message waiting in an outbound queue
+ */
+struct OutboundMessage {
+    uint8_t type;               // Frame type tag, interpreted by the batch sender
+    SharedBuffer payload;       // Payload bytes (shared, so broadcasts queue one copy)
+    SendPriority priority;      // Scheduling class
+    
+    // Optional file range sent after the payload as part of the same message, copied by
+    // the kernel (see send_tcp_file_data) instead of being read into the payload
+    std::shared_ptr<FileHandle> file;
+    uint64_t file_offset;
+    uint32_t file_size;
+
+    OutboundMessage() : type(0), priority(SendPriority::DATA), file_offset(0), file_size(0) {}
+    OutboundMessage(uint8_t t, const SharedBuffer& p, SendPriority prio = SendPriority::DATA)
+        : type(t), payload(p), priority(prio), file_offset(0), file_size(0) {}
+
+    // Message bytes after the header, file range included
+    size_t size() const { return payload.size() + file_size; }
+};
+
+/**
+ * Bounded outbound message queue of one connection.
+ * Producers push from any thread; a SendQueueWriter drains it, never from more than one
+ * thread at a time. Each priority class is FIFO. CONTROL messages go out before anything
+ * else, DATA and BULK are interleaved by deficit round robin on their weights, so a file
+ * transfer cannot hold back keepalives or gossip. CONTROL has its own byte budget and is
+ * never blocked or dropped because of queued data.
+ */
+class PeerSendQueue {
+public:
+    /**
+     * Constructor
+     * @param socket The connection socket
+     * @param config Capacity, coalescing and backpressure settings
+     */
+    PeerSendQueue(socket_t socket, const SendQueueConfig& config);
+
+    PeerSendQueue(const PeerSendQueue&) = delete;
+    PeerSendQueue& operator=(const PeerSendQueue&) = delete;
+
+    /**
+     * Get the connection socket
+     * @return Socket handle
+     */
+    socket_t get_socket() const { return socket_; }
+
+    /**
+     * Append a message, applying the backpressure policy when the queue is full
+     * @param message Message to queue
+     * @param needs_schedule Set to true if the caller must hand the queue to a writer
+     * @return true if queued, false if rejected or the queue is closed
+     */
+    bool push(OutboundMessage&& message, bool& needs_schedule);
+
+    /**
+     * Take the next batch of messages for writing (writer side)
+     * @param batch Output vector receiving the messages (cleared first)
+     * @return true if a batch was taken, false if the queue is empty or closed
+     */
+    bool pop_batch(std::vector<OutboundMessage>& batch);
+
+    /**
+     * Report the result of writing the last batch (writer side)
+     * @param success false closes the queue
+     * @return true if more messages are pending and the queue stays scheduled
+     */
+    bool finish_batch(bool success);
+
+    /**
+     * Close the queue: pending messages are discarded and blocked producers released.
+     * Waits until a batch being written has finished, so the socket can be closed afterwards.
+     */
+    void close();
+
+    /**
+     * Check if the queue was closed
+     * @return true if closed
+     */
+    bool is_closed() const;
+
+    /**
+     * Wait until all queued messages have been written
+     * @param timeout Maximum time to wait
+     * @return true if drained, false on timeout or if the queue was closed
+     */
+    bool wait_drained(std::chrono::milliseconds timeout);
+
+    /**
+     * Get the current number of queued messages
+     * @return Queue depth
+     */
+    size_t get_depth() const;
+
+    /**
+     * Get queue statistics
+     * @return Snapshot of the statistics
+     */
+    SendQueueStats get_stats() const;
+
+private:
+    socket_t socket_;
+    SendQueueConfig config_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable space_cv_;      // Producers waiting for room (BLOCK)
+    std::condition_variable idle_cv_;       // Waiters for drain / end of in-flight batch
+    std::array<std::deque<OutboundMessage>, SEND_PRIORITY_COUNT> queues_;
+    std::array<size_t, SEND_PRIORITY_COUNT> class_bytes_;   // Queued payload bytes per class
+    std::array<size_t, SEND_PRIORITY_COUNT> deficits_;      // Deficit round robin credit (data classes)
+    size_t drr_class_;                      // Data class the round robin is visiting
+    bool drr_credited_;                     // drr_class_ got its quantum on this visit
+    size_t queued_bytes_;
+    size_t in_flight_messages_;             // Size of the batch being written right now
+    bool scheduled_;                        // Handed to a writer (queued or being written)
+    bool closed_;
+    SendQueueStats stats_;
+
+    bool has_room(SendPriority priority, size_t size) const;
+    bool evict_for(SendPriority priority);
+    size_t next_class();
+    size_t queued_count() const;
+    void clear_queues();
+};
+
+/**
+ * SendQueueWriter - pool of threads draining PeerSendQueues.
+ *
+ * A queue with pending messages is handed to one writer thread at a time, which takes a
+ * batch and passes it to the batch sender, so a stalled peer only occupies one thread and
+ * never blocks the producers.
+ *
+ * By default all threads take ready queues from one shared list. Sharded, each thread owns
+ * the queues whose socket falls into its shard (socket_shard()) and producers hand them
+ * over through the thread's lock-free queue, so broadcasting threads do not contend on a
+ * common lock; the price is that a stalled peer delays the other peers of its shard.
+ */
+class SendQueueWriter {
+public:
+    /**
+     * Writes one batch to a socket
+     * @param socket The connection socket
+     * @param batch Messages in send order
+     * @return true on success, false if the connection failed
+     */
+    using BatchSender = std::function<bool(socket_t socket, std::vector<OutboundMessage>& batch)>;
+
+    /**
+     * Constructor
+     * @param name Name used in log messages
+     * @param sender Function writing a batch to a socket
+     */
+    SendQueueWriter(const std::string& name, BatchSender sender);
+    ~SendQueueWriter();
+
+    SendQueueWriter(const SendQueueWriter&) = delete;
+    SendQueueWriter& operator=(const SendQueueWriter&) = delete;
+
+    /**
+     * Start the writer threads
+     * @param thread_count Number of threads (at least 1)
+     * @param sharded Give each thread the queues of its socket shard instead of sharing one ready list
+     * @param cpus CPUs to pin the threads to, thread i to cpus[i % cpus.size()] (empty to leave them unpinned)
+     * @return true if started (or already running)
+     */
+    bool start(size_t thread_count, bool sharded = false, const std::vector<int>& cpus = {});
+
+    /**
+     * Stop the writer threads. Messages still queued are left in their queues.
+     */
+    void stop();
+
+    /**
+     * Check if the writer is running
+     * @return true if running
+     */
+    bool is_running() const;
+
+    /**
+     * Queue a message on a peer queue and schedule the queue for writing
+     * @param queue Target queue
+     * @param message Message to send
+     * @return true if queued, false if rejected by the backpressure policy or not running
+     */
+    bool enqueue(const std::shared_ptr<PeerSendQueue>& queue, OutboundMessage&& message);
+
+private:
+    struct Shard {
+        MpscQueue<std::shared_ptr<PeerSendQueue>> ready;
+        std::atomic<bool> sleeping{false};  // The owner found the queue empty and waits on sleep_cv
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_cv;
+    };
+
+    void writer_loop(int cpu);
+    void shard_loop(Shard& shard, int cpu);
+    void write_batch(const std::shared_ptr<PeerSendQueue>& queue, std::vector<OutboundMessage>& batch);
+    void schedule(const std::shared_ptr<PeerSendQueue>& queue);
+
+    std::string name_;
+    BatchSender sender_;
+    std::atomic<bool> running_;
+
+    std::mutex ready_mutex_;
+    std::condition_variable ready_cv_;
+    std::deque<std::shared_ptr<PeerSendQueue>> ready_;
+    std::vector<std::unique_ptr<Shard>> shards_;  // Sharded mode, one per thread; kept until the next start()
+    std::vector<std::thread> threads_;
+};
+
+} // namespace librats
@@ -2,115 +2,404 @@
 #include <iomanip>
 #include <sstream>
 #include <cstring>
+#include <atomic>
+#include <algorithm>
+
+// Platform SIMD support
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define RATS_SHA1_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+#if defined(_M_ARM64) || (defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2)))
+    #define RATS_SHA1_ARM_CRYPTO 1
+    #include <arm_neon.h>
+    #if defined(__linux__)
+        #include <sys/auxv.h>
+        #include <asm/hwcap.h>
+    #endif
+#endif
+
+#if defined(RATS_SHA1_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define RATS_TARGET_SHA __attribute__((target("sha,sse4.1,ssse3")))
+#else
+    #define RATS_TARGET_SHA
+#endif
 
 namespace librats {
 
+namespace {
+
 // SHA1 constants
-static const uint32_t K[] = {
+const uint32_t K[] = {
     0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6
 };
 
+const uint32_t INITIAL_STATE[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
 // Left rotate function
-static uint32_t left_rotate(uint32_t value, int amount) {
+inline uint32_t left_rotate(uint32_t value, int amount) {
     return (value << amount) | (value >> (32 - amount));
 }
 
+// Compresses whole 64-byte blocks into the state
+using SHA1BlocksFn = void (*)(uint32_t state[5], const uint8_t* data, size_t blocks);
+
+void sha1_blocks_scalar(uint32_t state[5], const uint8_t* data, size_t blocks) {
+    uint32_t w[80];
+
+    for (; blocks > 0; --blocks, data += 64) {
+        // Break chunk into sixteen 32-bit big-endian words
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<uint32_t>(data[i * 4]) << 24) |
+                   (static_cast<uint32_t>(data[i * 4 + 1]) << 16) |
+                   (static_cast<uint32_t>(data[i * 4 + 2]) << 8) |
+                   (static_cast<uint32_t>(data[i * 4 + 3]));
+        }
+
+        // Extend the sixteen 32-bit words into eighty 32-bit words
+        for (int i = 16; i < 80; i++) {
+            w[i] = left_rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        // Initialize hash value for this chunk
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+
+        // Main loop
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = K[0];
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = K[1];
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = K[2];
+            } else {
+                f = b ^ c ^ d;
+                k = K[3];
+            }
+
+            uint32_t temp = left_rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = left_rotate(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        // Add this chunk's hash to result so far
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+// The accelerated kernels run the 80 rounds as 20 groups of four. Group g consumes
+// message words W[4g..4g+3] (w[g % 4], a ring of four registers) and, while g < 16,
+// computes the words of group g + 4 into the slot it has just consumed.
+
+#ifdef RATS_SHA1_X86
+
+// Group g of one lane: e holds E + W for this group, prev the ABCD the next E derives from
+#define SHA1_NI_GROUP(g, abcd, e, prev, w)                                                        \
+    prev = abcd;                                                                                  \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, (g) / 5);                                                 \
+    if ((g) < 19) e = _mm_sha1nexte_epu32(prev, w[((g) + 1) % 4]);                                \
+    if ((g) < 16) w[(g) % 4] = _mm_sha1msg2_epu32(                                                \
+        _mm_xor_si128(_mm_sha1msg1_epu32(w[(g) % 4], w[((g) + 1) % 4]), w[((g) + 2) % 4]),        \
+        w[((g) + 3) % 4]);
+
+#define SHA1_NI_ROUNDS(G)                                                                         \
+    G(0)  G(1)  G(2)  G(3)  G(4)  G(5)  G(6)  G(7)  G(8)  G(9)                                    \
+    G(10) G(11) G(12) G(13) G(14) G(15) G(16) G(17) G(18) G(19)
+
+RATS_TARGET_SHA
+void sha1_blocks_sha_ni(uint32_t state[5], const uint8_t* data, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        const __m128i abcd_save = abcd;
+        const __m128i e0_save = e0;
+        __m128i w[4], e, prev;
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)), mask);
+        }
+        e = _mm_add_epi32(e0, w[0]);
+
+#define SHA1_NI_ONE(g) SHA1_NI_GROUP(g, abcd, e, prev, w)
+        SHA1_NI_ROUNDS(SHA1_NI_ONE)
+#undef SHA1_NI_ONE
+
+        e0 = _mm_sha1nexte_epu32(prev, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+// Two independent messages in lockstep; interleaving hides the latency of the round instructions
+RATS_TARGET_SHA
+void sha1_blocks_sha_ni_x2(uint32_t state_a[5], const uint8_t* data_a,
+                           uint32_t state_b[5], const uint8_t* data_b, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd_a = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state_a)), 0x1B);
+    __m128i abcd_b = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state_b)), 0x1B);
+    __m128i e0_a = _mm_set_epi32(static_cast<int>(state_a[4]), 0, 0, 0);
+    __m128i e0_b = _mm_set_epi32(static_cast<int>(state_b[4]), 0, 0, 0);
+
+    for (; blocks > 0; --blocks, data_a += 64, data_b += 64) {
+        const __m128i abcd_save_a = abcd_a, abcd_save_b = abcd_b;
+        const __m128i e0_save_a = e0_a, e0_save_b = e0_b;
+        __m128i w_a[4], w_b[4], e_a, e_b, prev_a, prev_b;
+
+        for (int i = 0; i < 4; i++) {
+            w_a[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data_a + i * 16)), mask);
+            w_b[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data_b + i * 16)), mask);
+        }
+        e_a = _mm_add_epi32(e0_a, w_a[0]);
+        e_b = _mm_add_epi32(e0_b, w_b[0]);
+
+#define SHA1_NI_TWO(g) SHA1_NI_GROUP(g, abcd_a, e_a, prev_a, w_a) SHA1_NI_GROUP(g, abcd_b, e_b, prev_b, w_b)
+        SHA1_NI_ROUNDS(SHA1_NI_TWO)
+#undef SHA1_NI_TWO
+
+        e0_a = _mm_sha1nexte_epu32(prev_a, e0_save_a);
+        e0_b = _mm_sha1nexte_epu32(prev_b, e0_save_b);
+        abcd_a = _mm_add_epi32(abcd_a, abcd_save_a);
+        abcd_b = _mm_add_epi32(abcd_b, abcd_save_b);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state_a), _mm_shuffle_epi32(abcd_a, 0x1B));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state_b), _mm_shuffle_epi32(abcd_b, 0x1B));
+    state_a[4] = static_cast<uint32_t>(_mm_extract_epi32(e0_a, 3));
+    state_b[4] = static_cast<uint32_t>(_mm_extract_epi32(e0_b, 3));
+}
+
+#undef SHA1_NI_ROUNDS
+#undef SHA1_NI_GROUP
+
+bool cpu_supports_sha_ni() {
+    // SHA (leaf 7 EBX bit 29) plus the SSSE3 and SSE4.1 shuffles/extracts used around it
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool ssse3 = (info[2] & (1 << 9)) != 0;
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    __cpuidex(info, 7, 0);
+    return ssse3 && sse41 && (info[1] & (1 << 29)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool ssse3 = (ecx & (1u << 9)) != 0;
+    bool sse41 = (ecx & (1u << 19)) != 0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return ssse3 && sse41 && (ebx & (1u << 29)) != 0;
+#endif
+}
+
+#endif // RATS_SHA1_X86
+
+#ifdef RATS_SHA1_ARM_CRYPTO
+
+void sha1_blocks_arm_crypto(uint32_t state[5], const uint8_t* data, size_t blocks) {
+    const uint32x4_t k[4] = {
+        vdupq_n_u32(K[0]), vdupq_n_u32(K[1]), vdupq_n_u32(K[2]), vdupq_n_u32(K[3])
+    };
+
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+
+    for (; blocks > 0; --blocks, data += 64) {
+        const uint32x4_t abcd_save = abcd;
+        const uint32_t e0_save = e0;
+        uint32x4_t w[4];
+        uint32_t e = e0;
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+
+        for (int g = 0; g < 20; g++) {
+            uint32x4_t wk = vaddq_u32(w[g % 4], k[g / 5]);
+            uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (g < 5) {
+                abcd = vsha1cq_u32(abcd, e, wk);
+            } else if (g >= 10 && g < 15) {
+                abcd = vsha1mq_u32(abcd, e, wk);
+            } else {
+                abcd = vsha1pq_u32(abcd, e, wk);
+            }
+            e = e_next;
+            if (g < 16) {
+                w[g % 4] = vsha1su1q_u32(vsha1su0q_u32(w[g % 4], w[(g + 1) % 4], w[(g + 2) % 4]), w[(g + 3) % 4]);
+            }
+        }
+
+        e0 = e + e0_save;
+        abcd = vaddq_u32(abcd, abcd_save);
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+bool cpu_supports_arm_crypto() {
+#if defined(__linux__) && defined(HWCAP_SHA1)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#else
+    return true;  // Built for a target that has the extension
+#endif
+}
+
+#endif // RATS_SHA1_ARM_CRYPTO
+
+SHA1BlocksFn sha1_kernel(SHA1Backend backend) {
+    switch (backend) {
+#ifdef RATS_SHA1_X86
+        case SHA1Backend::SHA_NI: return sha1_blocks_sha_ni;
+#endif
+#ifdef RATS_SHA1_ARM_CRYPTO
+        case SHA1Backend::ARM_CRYPTO: return sha1_blocks_arm_crypto;
+#endif
+        default: return sha1_blocks_scalar;
+    }
+}
+
+SHA1Backend detect_backend() {
+#ifdef RATS_SHA1_X86
+    if (cpu_supports_sha_ni()) {
+        return SHA1Backend::SHA_NI;
+    }
+#endif
+#ifdef RATS_SHA1_ARM_CRYPTO
+    if (cpu_supports_arm_crypto()) {
+        return SHA1Backend::ARM_CRYPTO;
+    }
+#endif
+    return SHA1Backend::SCALAR;
+}
+
+std::atomic<SHA1Backend>& active_backend() {
+    static std::atomic<SHA1Backend> backend(detect_backend());
+    return backend;
+}
+
+} // namespace
+
 SHA1::SHA1() {
     reset();
 }
 
 void SHA1::reset() {
     // SHA1 initialization constants
-    h0 = 0x67452301;
-    h1 = 0xEFCDAB89;
-    h2 = 0x98BADCFE;
-    h3 = 0x10325476;
-    h4 = 0xC3D2E1F0;
-    
+    std::memcpy(h, INITIAL_STATE, sizeof(h));
+
     buffer_length = 0;
     total_length = 0;
     finalized = false;
 }
 
 void SHA1::update(uint8_t byte) {
-    if (finalized) {
+    update(&byte, 1);
+}
+
+void SHA1::update(const uint8_t* data, size_t length) {
+    if (finalized || length == 0) {
         return;
     }
-    
-    buffer[buffer_length++] = byte;
-    total_length++;
-    
-    if (buffer_length == 64) {
-        process_block();
+
+    total_length += length;
+
+    // Complete a partially filled block first
+    if (buffer_length > 0) {
+        size_t take = (std::min)(length, sizeof(buffer) - buffer_length);
+        std::memcpy(buffer + buffer_length, data, take);
+        buffer_length += take;
+        data += take;
+        length -= take;
+        if (buffer_length < sizeof(buffer)) {
+            return;
+        }
+        process_blocks(buffer, 1);
         buffer_length = 0;
     }
-}
 
-void SHA1::update(const uint8_t* data, size_t length) {
-    for (size_t i = 0; i < length; i++) {
-        update(data[i]);
+    // Whole blocks are compressed straight from the input
+    size_t blocks = length / 64;
+    if (blocks > 0) {
+        process_blocks(data, blocks);
+        data += blocks * 64;
+        length -= blocks * 64;
     }
+
+    std::memcpy(buffer, data, length);
+    buffer_length = length;
 }
 
 void SHA1::update(const std::string& str) {
     update(reinterpret_cast<const uint8_t*>(str.c_str()), str.length());
 }
 
-void SHA1::process_block() {
-    uint32_t w[80];
-    
-    // Break chunk into sixteen 32-bit big-endian words
-    for (int i = 0; i < 16; i++) {
-        w[i] = (buffer[i * 4] << 24) | 
-               (buffer[i * 4 + 1] << 16) | 
-               (buffer[i * 4 + 2] << 8) | 
-               (buffer[i * 4 + 3]);
-    }
-    
-    // Extend the sixteen 32-bit words into eighty 32-bit words
-    for (int i = 16; i < 80; i++) {
-        w[i] = left_rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
-    }
-    
-    // Initialize hash value for this chunk
-    uint32_t a = h0;
-    uint32_t b = h1;
-    uint32_t c = h2;
-    uint32_t d = h3;
-    uint32_t e = h4;
-    
-    // Main loop
-    for (int i = 0; i < 80; i++) {
-        uint32_t f, k;
-        
-        if (i < 20) {
-            f = (b & c) | (~b & d);
-            k = K[0];
-        } else if (i < 40) {
-            f = b ^ c ^ d;
-            k = K[1];
-        } else if (i < 60) {
-            f = (b & c) | (b & d) | (c & d);
-            k = K[2];
-        } else {
-            f = b ^ c ^ d;
-            k = K[3];
-        }
-        
-        uint32_t temp = left_rotate(a, 5) + f + e + k + w[i];
-        e = d;
-        d = c;
-        c = left_rotate(b, 30);
-        b = a;
-        a = temp;
-    }
-    
-    // Add this chunk's hash to result so far
-    h0 += a;
-    h1 += b;
-    h2 += c;
-    h3 += d;
-    h4 += e;
+void SHA1::process_blocks(const uint8_t* data, size_t blocks) {
+    sha1_kernel(active_backend().load(std::memory_order_relaxed))(h, data, blocks);
+}
+
+void SHA1::finalize(uint8_t digest[DIGEST_SIZE]) {
+    if (finalized) {
+        std::memset(digest, 0, DIGEST_SIZE);
+        return;
+    }
+
+    // Pre-processing: the '1' bit, zeros until message length ≡ 448 (mod 512),
+    // then the length in bits as 64-bit big-endian integer
+    uint64_t bit_length = total_length * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padding_length = (buffer_length < 56 ? 56 : 120) - buffer_length;
+    for (int i = 0; i < 8; i++) {
+        padding[padding_length + i] = static_cast<uint8_t>(bit_length >> ((7 - i) * 8));
+    }
+    update(padding, padding_length + 8);
+
+    // Produce the final hash value as a 160-bit big-endian number
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+    }
+
+    finalized = true;
 }
 
 std::string SHA1::finalize() {
@@ -118,33 +407,16 @@ std::string SHA1::finalize() {
         // Return empty string for subsequent calls
         return "";
     }
-    
-    // Pre-processing: adding padding bits
-    uint64_t bit_length = total_length * 8;
-    
-    // Append the '1' bit
-    update(0x80);
-    
-    // Append zeros until message length ≡ 448 (mod 512)
-    while (buffer_length != 56) {
-        update(0x00);
-    }
-    
-    // Append length in bits as 64-bit big-endian integer
-    for (int i = 7; i >= 0; i--) {
-        update(static_cast<uint8_t>(bit_length >> (i * 8)));
-    }
-    
-    // Produce the final hash value as a 160-bit number (hex string)
+
+    uint8_t digest[DIGEST_SIZE];
+    finalize(digest);
+
+    // Produce the final hash value as a hex string
     std::ostringstream result;
     result << std::hex << std::setfill('0');
-    result << std::setw(8) << h0;
-    result << std::setw(8) << h1;
-    result << std::setw(8) << h2;
-    result << std::setw(8) << h3;
-    result << std::setw(8) << h4;
-    
-    finalized = true;
+    for (size_t i = 0; i < DIGEST_SIZE; i++) {
+        result << std::setw(2) << static_cast<int>(digest[i]);
+    }
     return result.str();
 }
 
@@ -160,4 +432,72 @@ std::string SHA1::hash_bytes(const std::vector<uint8_t>& input) {
     return hasher.finalize();
 }
 
-} // namespace librats 
\ No newline at end of file
+void SHA1::hash_many(const SHA1Input* inputs, size_t count, uint8_t (*digests)[DIGEST_SIZE]) {
+    size_t i = 0;
+
+#ifdef RATS_SHA1_X86
+    if (active_backend().load(std::memory_order_relaxed) == SHA1Backend::SHA_NI) {
+        // Pairs share the blocks both inputs have; the remainders are finished one at a time
+        for (; i + 1 < count; i += 2) {
+            const SHA1Input& a = inputs[i];
+            const SHA1Input& b = inputs[i + 1];
+            size_t common_blocks = (std::min)(a.length, b.length) / 64;
+
+            SHA1 hasher_a, hasher_b;
+            sha1_blocks_sha_ni_x2(hasher_a.h, a.data, hasher_b.h, b.data, common_blocks);
+            hasher_a.total_length = hasher_b.total_length = common_blocks * 64;
+
+            hasher_a.update(a.data + common_blocks * 64, a.length - common_blocks * 64);
+            hasher_b.update(b.data + common_blocks * 64, b.length - common_blocks * 64);
+            hasher_a.finalize(digests[i]);
+            hasher_b.finalize(digests[i + 1]);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        SHA1 hasher;
+        hasher.update(inputs[i].data, inputs[i].length);
+        hasher.finalize(digests[i]);
+    }
+}
+
+SHA1Backend SHA1::get_backend() {
+    return active_backend().load();
+}
+
+bool SHA1::set_backend(SHA1Backend backend) {
+    if (!is_backend_supported(backend)) {
+        return false;
+    }
+    active_backend().store(backend);
+    return true;
+}
+
+bool SHA1::is_backend_supported(SHA1Backend backend) {
+    switch (backend) {
+        case SHA1Backend::SCALAR:
+            return true;
+#ifdef RATS_SHA1_X86
+        case SHA1Backend::SHA_NI:
+            return cpu_supports_sha_ni();
+#endif
+#ifdef RATS_SHA1_ARM_CRYPTO
+        case SHA1Backend::ARM_CRYPTO:
+            return cpu_supports_arm_crypto();
+#endif
+        default:
+            return false;
+    }
+}
+
+std::string SHA1::backend_name(SHA1Backend backend) {
+    switch (backend) {
+        case SHA1Backend::SCALAR: return "scalar";
+        case SHA1Backend::SHA_NI: return "sha-ni";
+        case SHA1Backend::ARM_CRYPTO: return "arm-crypto";
+        default: return "unknown";
+    }
+}
+
+} // namespace librats
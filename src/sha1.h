@@ -6,37 +6,64 @@
 
 namespace librats {
 
+// SHA1 compression backends (selected at runtime)
+enum class SHA1Backend {
+    SCALAR,             // Portable
+    SHA_NI,             // x86 SHA extensions
+    ARM_CRYPTO          // ARMv8 cryptography extensions
+};
+
+// One buffer of a SHA1::hash_many batch
+struct SHA1Input {
+    const uint8_t* data;
+    size_t length;
+};
+
 class SHA1 {
 public:
+    static constexpr size_t DIGEST_SIZE = 20;
+
     SHA1();
-    
+
     // Process a single byte
     void update(uint8_t byte);
-    
+
     // Process a buffer
     void update(const uint8_t* data, size_t length);
-    
+
     // Process a string
     void update(const std::string& str);
-    
+
     // Get the final hash as a hex string
     std::string finalize();
-    
+
+    // Get the final hash as raw bytes (zeros for subsequent calls)
+    void finalize(uint8_t digest[DIGEST_SIZE]);
+
     // Convenience function to hash a string directly
     static std::string hash(const std::string& input);
-    
+
     // Convenience function to hash a vector of bytes directly
     static std::string hash_bytes(const std::vector<uint8_t>& input);
 
+    // Hash several independent buffers; with SHA_NI two buffers are compressed in lockstep
+    static void hash_many(const SHA1Input* inputs, size_t count, uint8_t (*digests)[DIGEST_SIZE]);
+
+    // Backend selection (process-wide)
+    static SHA1Backend get_backend();
+    static bool set_backend(SHA1Backend backend);   // false if not supported by this CPU/build
+    static bool is_backend_supported(SHA1Backend backend);
+    static std::string backend_name(SHA1Backend backend);
+
 private:
-    void process_block();
+    void process_blocks(const uint8_t* data, size_t blocks);
     void reset();
-    
-    uint32_t h0, h1, h2, h3, h4;
+
+    uint32_t h[5];
     uint8_t buffer[64];
     size_t buffer_length;
     uint64_t total_length;
     bool finalized;
 };
 
-} // namespace librats 
\ No newline at end of file
+} // namespace librats
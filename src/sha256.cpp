@@ -0,0 +1,246 @@
+#include "sha256.h"
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+
+namespace librats {
+
+// SHA256 round constants
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Right rotate function
+static uint32_t right_rotate(uint32_t value, int amount) {
+    return (value >> amount) | (value << (32 - amount));
+}
+
+SHA256::SHA256() {
+    reset();
+}
+
+void SHA256::reset() {
+    // SHA256 initialization constants
+    state[0] = 0x6a09e667;
+    state[1] = 0xbb67ae85;
+    state[2] = 0x3c6ef372;
+    state[3] = 0xa54ff53a;
+    state[4] = 0x510e527f;
+    state[5] = 0x9b05688c;
+    state[6] = 0x1f83d9ab;
+    state[7] = 0x5be0cd19;
+
+    buffer_length = 0;
+    total_length = 0;
+    finalized = false;
+}
+
+void SHA256::update(const uint8_t* data, size_t length) {
+    if (finalized || length == 0) {
+        return;
+    }
+
+    total_length += length;
+
+    // Complete a partially filled block first
+    if (buffer_length > 0) {
+        size_t take = BLOCK_SIZE - buffer_length;
+        if (take > length) {
+            take = length;
+        }
+        std::memcpy(buffer + buffer_length, data, take);
+        buffer_length += take;
+        data += take;
+        length -= take;
+
+        if (buffer_length < BLOCK_SIZE) {
+            return;
+        }
+        process_blocks(buffer, 1);
+        buffer_length = 0;
+    }
+
+    // Hash whole blocks straight from the input
+    size_t block_count = length / BLOCK_SIZE;
+    if (block_count > 0) {
+        process_blocks(data, block_count);
+        data += block_count * BLOCK_SIZE;
+        length -= block_count * BLOCK_SIZE;
+    }
+
+    if (length > 0) {
+        std::memcpy(buffer, data, length);
+        buffer_length = length;
+    }
+}
+
+void SHA256::update(const std::string& str) {
+    update(reinterpret_cast<const uint8_t*>(str.data()), str.length());
+}
+
+void SHA256::process_blocks(const uint8_t* data, size_t block_count) {
+    for (size_t block = 0; block < block_count; ++block, data += BLOCK_SIZE) {
+        uint32_t w[64];
+
+        // Break chunk into sixteen 32-bit big-endian words
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<uint32_t>(data[i * 4]) << 24) |
+                   (static_cast<uint32_t>(data[i * 4 + 1]) << 16) |
+                   (static_cast<uint32_t>(data[i * 4 + 2]) << 8) |
+                   (static_cast<uint32_t>(data[i * 4 + 3]));
+        }
+
+        // Extend the sixteen 32-bit words into sixty-four 32-bit words
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = right_rotate(w[i - 15], 7) ^ right_rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = right_rotate(w[i - 2], 17) ^ right_rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        // Initialize working variables for this chunk
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+        uint32_t f = state[5];
+        uint32_t g = state[6];
+        uint32_t h = state[7];
+
+        // Main loop
+        for (int i = 0; i < 64; i++) {
+            uint32_t S1 = right_rotate(e, 6) ^ right_rotate(e, 11) ^ right_rotate(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t temp1 = h + S1 + ch + K[i] + w[i];
+            uint32_t S0 = right_rotate(a, 2) ^ right_rotate(a, 13) ^ right_rotate(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = S0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+
+        // Add this chunk's hash to result so far
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+void SHA256::finalize(uint8_t digest[DIGEST_SIZE]) {
+    if (finalized) {
+        std::memset(digest, 0, DIGEST_SIZE);
+        return;
+    }
+
+    // Pre-processing: append the '1' bit, pad with zeros to 56 mod 64, then the bit length
+    uint64_t bit_length = total_length * 8;
+    uint8_t padding[BLOCK_SIZE * 2] = {0x80};
+    size_t padding_length = (buffer_length < 56) ? (56 - buffer_length) : (120 - buffer_length);
+    for (int i = 0; i < 8; i++) {
+        padding[padding_length + i] = static_cast<uint8_t>(bit_length >> ((7 - i) * 8));
+    }
+    update(padding, padding_length + 8);
+
+    // Produce the final hash value as a 256-bit big-endian number
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+
+    finalized = true;
+}
+
+std::string SHA256::finalize() {
+    if (finalized) {
+        // Return empty string for subsequent calls
+        return "";
+    }
+
+    uint8_t digest[DIGEST_SIZE];
+    finalize(digest);
+
+    std::ostringstream result;
+    result << std::hex << std::setfill('0');
+    for (size_t i = 0; i < DIGEST_SIZE; i++) {
+        result << std::setw(2) << static_cast<int>(digest[i]);
+    }
+    return result.str();
+}
+
+std::string SHA256::hash(const std::string& input) {
+    SHA256 hasher;
+    hasher.update(input);
+    return hasher.finalize();
+}
+
+std::string SHA256::hash_bytes(const std::vector<uint8_t>& input) {
+    SHA256 hasher;
+    hasher.update(input.data(), input.size());
+    return hasher.finalize();
+}
+
+void SHA256::digest(const uint8_t* data, size_t length, uint8_t out[DIGEST_SIZE]) {
+    SHA256 hasher;
+    hasher.update(data, length);
+    hasher.finalize(out);
+}
+
+void SHA256::hmac(const uint8_t* key, size_t key_length, const uint8_t* data, size_t length, uint8_t out[DIGEST_SIZE]) {
+    // Keys longer than the block size are hashed first
+    uint8_t key_block[BLOCK_SIZE] = {0};
+    if (key_length > BLOCK_SIZE) {
+        digest(key, key_length, key_block);
+    } else if (key_length > 0) {
+        std::memcpy(key_block, key, key_length);
+    }
+
+    uint8_t pad[BLOCK_SIZE];
+    uint8_t inner_digest[DIGEST_SIZE];
+
+    // inner = H((K ^ ipad) || data)
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        pad[i] = key_block[i] ^ 0x36;
+    }
+    SHA256 inner;
+    inner.update(pad, BLOCK_SIZE);
+    inner.update(data, length);
+    inner.finalize(inner_digest);
+
+    // outer = H((K ^ opad) || inner)
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        pad[i] = key_block[i] ^ 0x5c;
+    }
+    SHA256 outer;
+    outer.update(pad, BLOCK_SIZE);
+    outer.update(inner_digest, DIGEST_SIZE);
+    outer.finalize(out);
+
+    // Do not leave key material on the stack
+    volatile uint8_t* wipe = key_block;
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        wipe[i] = 0;
+    }
+}
+
+} // namespace librats
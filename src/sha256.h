@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace librats {
+
+class SHA256 {
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    SHA256();
+
+    // Process a buffer
+    void update(const uint8_t* data, size_t length);
+
+    // Process a string
+    void update(const std::string& str);
+
+    // Write the final 32-byte digest
+    void finalize(uint8_t digest[DIGEST_SIZE]);
+
+    // Get the final hash as a hex string
+    std::string finalize();
+
+    // Convenience function to hash a string directly (hex result)
+    static std::string hash(const std::string& input);
+
+    // Convenience function to hash a vector of bytes directly (hex result)
+    static std::string hash_bytes(const std::vector<uint8_t>& input);
+
+    // Hash a buffer into a 32-byte digest
+    static void digest(const uint8_t* data, size_t length, uint8_t out[DIGEST_SIZE]);
+
+    // HMAC-SHA256 (RFC 2104) into a 32-byte tag
+    static void hmac(const uint8_t* key, size_t key_length, const uint8_t* data, size_t length, uint8_t out[DIGEST_SIZE]);
+
+private:
+    void process_blocks(const uint8_t* data, size_t block_count);
+    void reset();
+
+    uint32_t state[8];
+    uint8_t buffer[BLOCK_SIZE];
+    size_t buffer_length;
+    uint64_t total_length;
+    bool finalized;
+};
+
+} // namespace librats
@@ -0,0 +1,330 @@
+#include "sim_network.h"
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace librats {
+
+namespace {
+
+const uint16_t SIM_ENDPOINT_PORT = 6881;
+const uint16_t SIM_FIRST_MAPPED_PORT = 40000;
+
+// Virtual time starts here rather than at the clock's epoch, so "long ago" stays representable
+const auto SIM_START_TIME = std::chrono::hours(24);
+
+// first.x.y.z where host supplies x.y.z
+NetEndpoint make_address(uint8_t first, uint32_t host, uint16_t port) {
+    const uint8_t bytes[4] = {first, static_cast<uint8_t>(host >> 16), static_cast<uint8_t>(host >> 8),
+                              static_cast<uint8_t>(host)};
+    return NetEndpoint::from_ipv4(bytes, port);
+}
+
+// The address alone, for address-restricted NAT permissions
+NetEndpoint without_port(NetEndpoint endpoint) {
+    endpoint.port = 0;
+    return endpoint;
+}
+
+} // namespace
+
+struct SimNetwork::Core {
+    struct Event {
+        Clock::time_point time;
+        uint64_t sequence;
+        size_t endpoint;
+        uint64_t generation;
+        std::vector<uint8_t> data;
+        NetEndpoint sender;
+        std::function<void()> task;     // Set for timers
+    };
+
+    struct EndpointState {
+        SimLinkConfig config;
+        NetEndpoint address;
+        NetEndpoint public_address;                             // The NAT's address (port unused), if any
+        bool open = false;
+        uint64_t generation = 0;                                // Bumped by close(), orphaning queued events
+        DatagramTransport::ReceiveHandler handler;
+        Clock::time_point uplink_free_at;
+        std::unordered_map<NetEndpoint, uint16_t> mappings;     // Destination (unspecified unless symmetric) -> public port
+        std::unordered_set<NetEndpoint> permissions;            // Addresses (port 0) or endpoints we sent to
+        uint16_t next_mapped_port = SIM_FIRST_MAPPED_PORT;
+    };
+
+    struct Route {
+        size_t endpoint;
+        NetEndpoint mapping;            // Mapping key of a NAT, unspecified for a public address
+    };
+
+    mutable std::mutex mutex;
+    std::mt19937_64 rng;
+    Clock::time_point now;
+    uint64_t next_sequence = 0;
+    std::vector<Event> events;          // Min-heap on (time, sequence)
+    std::vector<EndpointState> endpoints;
+    std::unordered_map<NetEndpoint, Route> routes;
+    uint32_t next_public_host = 1;
+    uint32_t next_nat_host = 1;
+    uint32_t next_private_host = 1;
+    Statistics statistics;
+
+    explicit Core(uint64_t seed) : rng(seed), now(Clock::time_point(SIM_START_TIME)) {}
+
+    static bool later(const Event& a, const Event& b) {
+        return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+    }
+
+    void push(Event event) {
+        event.sequence = next_sequence++;
+        events.push_back(std::move(event));
+        std::push_heap(events.begin(), events.end(), later);
+    }
+
+    // Address the destination sees, opening the NAT on the way out
+    NetEndpoint outbound_address(EndpointState& source, const NetEndpoint& destination, size_t index) {
+        if (source.config.nat == SimNatType::NONE) {
+            return source.address;
+        }
+
+        NetEndpoint mapping = source.config.nat == SimNatType::SYMMETRIC ? destination : NetEndpoint();
+        auto it = source.mappings.find(mapping);
+        if (it == source.mappings.end()) {
+            NetEndpoint mapped(source.public_address.address, source.next_mapped_port++);
+            it = source.mappings.emplace(mapping, mapped.port).first;
+            routes[mapped] = Route{index, mapping};
+        }
+        source.permissions.insert(source.config.nat == SimNatType::ADDRESS_RESTRICTED ? without_port(destination) : destination);
+        return NetEndpoint(source.public_address.address, it->second);
+    }
+
+    static bool inbound_allowed(const EndpointState& destination, const Route& route, const NetEndpoint& source) {
+        switch (destination.config.nat) {
+            case SimNatType::NONE:
+            case SimNatType::FULL_CONE:
+                return true;
+            case SimNatType::ADDRESS_RESTRICTED:
+                return destination.permissions.count(without_port(source)) > 0;
+            case SimNatType::PORT_RESTRICTED:
+                return destination.permissions.count(source) > 0;
+            case SimNatType::SYMMETRIC:
+                return route.mapping == source;
+        }
+        return false;
+    }
+
+    std::chrono::microseconds jitter(const SimLinkConfig& config) {
+        if (config.jitter.count() <= 0) {
+            return std::chrono::microseconds(0);
+        }
+        return std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, config.jitter.count())(rng));
+    }
+
+    bool send(size_t index, const NetEndpoint& destination, const uint8_t* data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        EndpointState& source = endpoints[index];
+        if (!source.open) {
+            return false;
+        }
+        ++statistics.sent;
+
+        NetEndpoint sender = outbound_address(source, destination, index);
+        auto route = routes.find(destination);
+        if (route == routes.end()) {
+            ++statistics.unroutable;
+            return true;
+        }
+        EndpointState& target = endpoints[route->second.endpoint];
+        if (!inbound_allowed(target, route->second, sender)) {
+            ++statistics.filtered;
+            return true;
+        }
+
+        // The uplink sends one datagram at a time, so a busy link queues the next one
+        Clock::time_point start = std::max(now, source.uplink_free_at);
+        auto transmission = std::chrono::microseconds(0);
+        if (source.config.bandwidth > 0) {
+            transmission = std::chrono::microseconds(size * 1000000 / source.config.bandwidth);
+        }
+        source.uplink_free_at = start + transmission;
+
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        if ((source.config.loss > 0 && chance(rng) < source.config.loss) ||
+            (target.config.loss > 0 && chance(rng) < target.config.loss)) {
+            ++statistics.lost;
+            return true;
+        }
+
+        Event event;
+        event.time = source.uplink_free_at + source.config.latency + target.config.latency + jitter(source.config) +
+                     jitter(target.config);
+        event.endpoint = route->second.endpoint;
+        event.generation = target.generation;
+        event.data.assign(data, data + size);
+        event.sender = sender;
+        push(std::move(event));
+        return true;
+    }
+
+    // Run the next event due by deadline; false if there is none
+    bool step(Clock::time_point deadline) {
+        Event event;
+        DatagramTransport::ReceiveHandler handler;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (true) {
+                if (events.empty() || events.front().time > deadline) {
+                    return false;
+                }
+                std::pop_heap(events.begin(), events.end(), later);
+                event = std::move(events.back());
+                events.pop_back();
+                now = std::max(now, event.time);
+
+                const EndpointState& endpoint = endpoints[event.endpoint];
+                if (!endpoint.open || endpoint.generation != event.generation) {
+                    if (!event.task) {
+                        ++statistics.unroutable;
+                    }
+                    continue;
+                }
+                if (event.task) {
+                    ++statistics.timers;
+                } else {
+                    ++statistics.delivered;
+                    statistics.bytes_delivered += event.data.size();
+                    handler = endpoint.handler;
+                }
+                break;
+            }
+        }
+
+        if (event.task) {
+            event.task();
+        } else if (handler) {
+            handler(event.data.data(), event.data.size(), event.sender);
+        }
+        return true;
+    }
+};
+
+class SimNetwork::Endpoint : public DatagramTransport {
+public:
+    Endpoint(std::shared_ptr<Core> core, size_t index) : core_(std::move(core)), index_(index) {}
+
+    ~Endpoint() override {
+        close();
+    }
+
+    bool open(ReceiveHandler handler) override {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        Core::EndpointState& endpoint = core_->endpoints[index_];
+        endpoint.open = true;
+        endpoint.handler = std::move(handler);
+        return true;
+    }
+
+    void close() override {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        Core::EndpointState& endpoint = core_->endpoints[index_];
+        endpoint.open = false;
+        endpoint.handler = nullptr;
+        ++endpoint.generation;
+    }
+
+    bool send(const NetEndpoint& destination, const uint8_t* data, size_t size) override {
+        return core_->send(index_, destination, data, size);
+    }
+
+    NetEndpoint local_address() const override {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        return core_->endpoints[index_].address;
+    }
+
+    Clock::time_point now() const override {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        return core_->now;
+    }
+
+    void schedule(std::chrono::milliseconds delay, std::function<void()> task) override {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        Core::Event event;
+        event.time = core_->now + delay;
+        event.endpoint = index_;
+        event.generation = core_->endpoints[index_].generation;
+        event.task = std::move(task);
+        core_->push(std::move(event));
+    }
+
+private:
+    std::shared_ptr<Core> core_;
+    size_t index_;
+};
+
+SimNetwork::SimNetwork(uint64_t seed) : core_(std::make_shared<Core>(seed)) {}
+
+SimNetwork::~SimNetwork() {
+    // Queued timers may hold on to their clients; endpoints outliving us keep the core alive
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    core_->events.clear();
+}
+
+std::shared_ptr<DatagramTransport> SimNetwork::add_endpoint(const SimLinkConfig& config) {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    size_t index = core_->endpoints.size();
+    Core::EndpointState endpoint;
+    endpoint.config = config;
+    endpoint.uplink_free_at = core_->now;
+    if (config.nat == SimNatType::NONE) {
+        endpoint.address = make_address(10, core_->next_public_host++, SIM_ENDPOINT_PORT);
+        core_->routes[endpoint.address] = Core::Route{index, NetEndpoint()};
+    } else {
+        endpoint.address = make_address(172, (16u << 16) + core_->next_private_host++, SIM_ENDPOINT_PORT);
+        endpoint.public_address = make_address(100, (64u << 16) + core_->next_nat_host++, 0);
+    }
+    core_->endpoints.push_back(std::move(endpoint));
+    return std::make_shared<Endpoint>(core_, index);
+}
+
+SimNetwork::Clock::time_point SimNetwork::now() const {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    return core_->now;
+}
+
+size_t SimNetwork::run_for(std::chrono::milliseconds duration) {
+    Clock::time_point deadline = now() + duration;
+    size_t processed = 0;
+    while (core_->step(deadline)) {
+        ++processed;
+    }
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    core_->now = std::max(core_->now, deadline);
+    return processed;
+}
+
+bool SimNetwork::run_until(const std::function<bool()>& condition, std::chrono::milliseconds timeout) {
+    Clock::time_point deadline = now() + timeout;
+    while (!condition()) {
+        if (!core_->step(deadline)) {
+            std::lock_guard<std::mutex> lock(core_->mutex);
+            core_->now = std::max(core_->now, deadline);
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t SimNetwork::pending_events() const {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    return core_->events.size();
+}
+
+SimNetwork::Statistics SimNetwork::get_statistics() const {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    return core_->statistics;
+}
+
+} // namespace librats
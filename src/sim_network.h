@@ -0,0 +1,96 @@
+#pragma once
+
+#include "datagram_transport.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace librats {
+
+/**
+ * NAT in front of a simulated endpoint. Each NATed endpoint sits behind its own NAT
+ * with its own public address; mappings never expire.
+ */
+enum class SimNatType {
+    NONE,                   // Publicly reachable
+    FULL_CONE,              // One mapping, anyone may send to it
+    ADDRESS_RESTRICTED,     // One mapping, open to IPs the endpoint has sent to
+    PORT_RESTRICTED,        // One mapping, open to IP:ports the endpoint has sent to
+    SYMMETRIC               // One mapping per destination, open only to that destination
+};
+
+/**
+ * Link between a simulated endpoint and the network core. A datagram's delay is the
+ * sender's queueing and transmission time on its uplink plus both ends' latency and jitter.
+ */
+struct SimLinkConfig {
+    std::chrono::microseconds latency{std::chrono::milliseconds(10)};  // One way, endpoint to core
+    std::chrono::microseconds jitter{0};    // Uniformly random extra delay, up to this much
+    uint64_t bandwidth = 0;                 // Uplink bytes per second, 0 = unlimited
+    double loss = 0.0;                      // Probability a datagram is lost on this link
+    SimNatType nat = SimNatType::NONE;
+};
+
+/**
+ * In-process datagram network running on a virtual clock.
+ *
+ * Endpoints are DatagramTransports with made-up addresses. Nothing happens on its own:
+ * run_for() and run_until() process deliveries and timers in time order on the calling
+ * thread, advancing the virtual clock from event to event, so seconds of network time
+ * between thousands of endpoints pass in milliseconds. Latency, jitter, loss and
+ * bandwidth are applied per link; jitter and loss are drawn from a generator seeded at
+ * construction, and events due at the same time run in the order they were queued, so
+ * the same sends replay the same way.
+ *
+ * Sending and scheduling are thread-safe, but handlers only ever run inside run_for()
+ * and run_until(), so close endpoints (stop their clients) on the thread running the
+ * network or while it is idle. Endpoints stay valid after the network is destroyed;
+ * they just stop delivering.
+ */
+class SimNetwork {
+public:
+    using Clock = DatagramTransport::Clock;
+
+    struct Statistics {
+        uint64_t sent = 0;          // Datagrams handed to send()
+        uint64_t delivered = 0;     // Datagrams passed to a receive handler
+        uint64_t lost = 0;          // Dropped by link loss
+        uint64_t filtered = 0;      // Dropped by a NAT
+        uint64_t unroutable = 0;    // Sent to an address nobody has, or to a closed endpoint
+        uint64_t bytes_delivered = 0;
+        uint64_t timers = 0;        // Timers that ran
+    };
+
+    explicit SimNetwork(uint64_t seed = 1);
+    ~SimNetwork();
+
+    SimNetwork(const SimNetwork&) = delete;
+    SimNetwork& operator=(const SimNetwork&) = delete;
+
+    // Add an endpoint with a fresh address
+    std::shared_ptr<DatagramTransport> add_endpoint(const SimLinkConfig& config = SimLinkConfig());
+
+    // Virtual time; starts at a fixed point and only moves inside run_for() and run_until()
+    Clock::time_point now() const;
+
+    // Process events due within duration, then advance the clock by duration; returns events processed
+    size_t run_for(std::chrono::milliseconds duration);
+
+    // Process events until condition holds (checked before each event) or timeout passes
+    bool run_until(const std::function<bool()>& condition, std::chrono::milliseconds timeout);
+
+    // Queued deliveries and timers
+    size_t pending_events() const;
+
+    Statistics get_statistics() const;
+
+private:
+    struct Core;
+    class Endpoint;
+
+    std::shared_ptr<Core> core_;
+};
+
+} // namespace librats
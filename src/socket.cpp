@@ -1,14 +1,33 @@
 #include "socket.h"
 #include "network_utils.h"
 #include "logger.h"
+#include "buffer_pool.h"
+#include "fs.h"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 #include <mutex>
 #include <thread>
 #include <chrono>
 #ifndef _WIN32
     #include <fcntl.h>    // for O_NONBLOCK
     #include <errno.h>    // for errno
+    #include <sys/uio.h>  // for iovec
+    #include <limits.h>   // for IOV_MAX
+#endif
+
+// Batched datagram system calls
+#if defined(__linux__)
+    #define RATS_HAVE_MMSG
+#endif
+
+// Kernel file-to-socket copies
+#if defined(__linux__)
+    #include <sys/sendfile.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+    #include <sys/types.h>
+#elif defined(_WIN32)
+    #include <mswsock.h>
 #endif
 
 // Socket module logging macros
@@ -19,6 +38,24 @@
 
 namespace librats {
 
+// Largest accepted length-prefixed message
+static const uint32_t MAX_FRAMED_MESSAGE_SIZE = 100 * 1024 * 1024; // 100MB limit
+
+// Maximum number of buffers passed to one vectored send call
+#if !defined(_WIN32) && defined(IOV_MAX)
+static const size_t MAX_SEND_SLICES = IOV_MAX;
+#else
+static const size_t MAX_SEND_SLICES = 64;
+#endif
+
+// Bytes requested per recv() call by the incremental framed reader
+static const size_t FRAMED_RECEIVE_CHUNK_SIZE = 64 * 1024;
+
+// Largest file range handed to one sendfile/TransmitFile call, and the block size
+// of the buffered fallback
+static const uint64_t MAX_FILE_SEND_BLOCK = 1024 * 1024 * 1024;
+static const size_t FILE_SEND_BUFFER_SIZE = 256 * 1024;
+
 // Static flag to track socket library initialization
 static bool socket_library_initialized = false;
 static std::mutex socket_init_mutex;
@@ -314,6 +351,189 @@ socket_t create_tcp_client_v6(const std::string& host, int port, int timeout_ms)
     return client_socket;
 }
 
+socket_t start_tcp_connect(const std::string& host, int port) {
+    if (port < 0 || port > 65535) {
+        LOG_SOCKET_ERROR("Invalid port number: " << port << " (must be 0-65535)");
+        return INVALID_SOCKET_VALUE;
+    }
+    
+    // Literal addresses pick the family, hostnames are resolved to IPv4
+    sockaddr_storage server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    socklen_t addr_len = 0;
+    sockaddr_in6* addr6 = reinterpret_cast<sockaddr_in6*>(&server_addr);
+    sockaddr_in* addr4 = reinterpret_cast<sockaddr_in*>(&server_addr);
+    if (inet_pton(AF_INET6, host.c_str(), &addr6->sin6_addr) == 1) {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        addr_len = sizeof(sockaddr_in6);
+    } else {
+        std::string resolved_ip = network_utils::resolve_hostname(host);
+        if (resolved_ip.empty() || inet_pton(AF_INET, resolved_ip.c_str(), &addr4->sin_addr) != 1) {
+            LOG_SOCKET_ERROR("Failed to resolve hostname: " << host);
+            return INVALID_SOCKET_VALUE;
+        }
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        addr_len = sizeof(sockaddr_in);
+    }
+    
+    socket_t client_socket = socket(server_addr.ss_family, SOCK_STREAM, 0);
+    if (client_socket == INVALID_SOCKET_VALUE) {
+        LOG_SOCKET_ERROR("Failed to create client socket");
+        return INVALID_SOCKET_VALUE;
+    }
+    if (!set_socket_nonblocking(client_socket)) {
+        close_socket(client_socket);
+        return INVALID_SOCKET_VALUE;
+    }
+    
+    if (connect(client_socket, reinterpret_cast<sockaddr*>(&server_addr), addr_len) != 0) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        bool in_progress = error == WSAEWOULDBLOCK;
+#else
+        int error = errno;
+        bool in_progress = error == EINPROGRESS;
+#endif
+        if (!in_progress) {
+            LOG_SOCKET_ERROR("Connect to " << host << ":" << port << " failed immediately with error: " << error);
+            close_socket(client_socket);
+            return INVALID_SOCKET_VALUE;
+        }
+    }
+    
+    LOG_SOCKET_DEBUG("Started non-blocking connect to " << host << ":" << port << " on socket " << client_socket);
+    return client_socket;
+}
+
+socket_t create_tcp_client_racing(const std::string& host, int port, int timeout_ms,
+                                  int attempt_delay_ms, std::string* connected_address) {
+    // Interleave families so a broken IPv6 path costs at most one attempt delay
+    std::vector<std::string> ipv6_addresses;
+    std::vector<std::string> ipv4_addresses;
+    for (const auto& address : network_utils::resolve_all_addresses_dual(host)) {
+        auto& family = address.find(':') != std::string::npos ? ipv6_addresses : ipv4_addresses;
+        if (std::find(family.begin(), family.end(), address) == family.end()) {
+            family.push_back(address);
+        }
+    }
+    std::vector<std::string> candidates;
+    for (size_t i = 0; i < std::max(ipv6_addresses.size(), ipv4_addresses.size()); ++i) {
+        if (i < ipv6_addresses.size()) candidates.push_back(ipv6_addresses[i]);
+        if (i < ipv4_addresses.size()) candidates.push_back(ipv4_addresses[i]);
+    }
+    if (candidates.empty()) {
+        LOG_SOCKET_ERROR("Failed to resolve any address for " << host);
+        return INVALID_SOCKET_VALUE;
+    }
+    
+    LOG_SOCKET_DEBUG("Racing " << candidates.size() << " addresses for " << host << ":" << port
+                     << " (timeout " << timeout_ms << "ms, attempt delay " << attempt_delay_ms << "ms)");
+    
+    struct Attempt {
+        socket_t socket;
+        std::string address;
+    };
+    std::vector<Attempt> pending;
+    size_t next_candidate = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    auto next_start = std::chrono::steady_clock::now();
+    socket_t winner = INVALID_SOCKET_VALUE;
+    
+    while (winner == INVALID_SOCKET_VALUE) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            LOG_SOCKET_ERROR("Connection to " << host << ":" << port << " timed out after " << timeout_ms << "ms");
+            break;
+        }
+        
+        // Start the next attempt when its turn comes or when nothing else is in flight
+        if (next_candidate < candidates.size() && (now >= next_start || pending.empty())) {
+            const std::string& address = candidates[next_candidate++];
+            socket_t s = start_tcp_connect(address, port);
+            if (is_valid_socket(s)) {
+                pending.push_back({s, address});
+            }
+            next_start = now + std::chrono::milliseconds(attempt_delay_ms);
+            continue;
+        }
+        if (pending.empty()) {
+            LOG_SOCKET_ERROR("All " << candidates.size() << " addresses of " << host << ":" << port << " failed");
+            break;
+        }
+        
+        auto wait_until = deadline;
+        if (next_candidate < candidates.size()) {
+            wait_until = std::min(wait_until, next_start);
+        }
+        auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(wait_until - now).count();
+        
+        fd_set write_fds, error_fds;
+        FD_ZERO(&write_fds);
+        FD_ZERO(&error_fds);
+        socket_t max_fd = 0;
+        for (const auto& attempt : pending) {
+            FD_SET(attempt.socket, &write_fds);
+            FD_SET(attempt.socket, &error_fds);
+            max_fd = std::max(max_fd, attempt.socket);
+        }
+        struct timeval timeout;
+        timeout.tv_sec = static_cast<long>(wait_us / 1000000);
+        timeout.tv_usec = static_cast<long>(wait_us % 1000000);
+        
+        int select_result = select(static_cast<int>(max_fd + 1), nullptr, &write_fds, &error_fds, &timeout);
+        if (select_result < 0) {
+            LOG_SOCKET_ERROR("Select failed while racing connections to " << host << ":" << port);
+            break;
+        }
+        
+        bool attempt_failed = false;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (!FD_ISSET(it->socket, &write_fds) && !FD_ISSET(it->socket, &error_fds)) {
+                ++it;
+                continue;
+            }
+            int error = get_socket_error(it->socket);
+            if (error == 0 && winner == INVALID_SOCKET_VALUE) {
+                winner = it->socket;
+                if (connected_address) {
+                    *connected_address = it->address;
+                }
+                LOG_SOCKET_INFO("Connected to " << it->address << ":" << port << " (won race for " << host << ")");
+            } else {
+                LOG_SOCKET_DEBUG("Connection attempt to " << it->address << ":" << port << " failed with error: " << error);
+                close_socket(it->socket);
+                attempt_failed = true;
+            }
+            it = pending.erase(it);
+        }
+        
+        // A failed attempt hands its turn straight to the next address
+        if (attempt_failed) {
+            next_start = std::chrono::steady_clock::now();
+        }
+    }
+    
+    for (const auto& attempt : pending) {
+        close_socket(attempt.socket);
+    }
+    return winner;
+}
+
+int get_socket_error(socket_t socket) {
+    int sock_error = 0;
+    socklen_t len = sizeof(sock_error);
+    if (getsockopt(socket, SOL_SOCKET, SO_ERROR, (char*)&sock_error, &len) < 0) {
+#ifdef _WIN32
+        return WSAGetLastError();
+#else
+        return errno;
+#endif
+    }
+    return sock_error;
+}
+
 socket_t create_tcp_server(int port, int backlog) {
     LOG_SOCKET_DEBUG("Creating TCP server socket (dual stack) on port " << port);
     
@@ -618,30 +838,309 @@ std::vector<uint8_t> receive_tcp_data(socket_t socket, size_t buffer_size) {
     return buffer;
 }
 
+int send_tcp_data_vectored(socket_t socket, const IoSlice* slices, size_t count) {
+#ifdef _WIN32
+    typedef WSABUF native_slice;
+#else
+    typedef struct iovec native_slice;
+#endif
+    
+    // Build the native descriptor array, skipping empty slices
+    std::vector<native_slice> native;
+    native.reserve(count);
+    size_t total_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (slices[i].size == 0) {
+            continue;
+        }
+        native_slice slice;
+#ifdef _WIN32
+        slice.buf = const_cast<char*>(static_cast<const char*>(slices[i].data));
+        slice.len = static_cast<ULONG>(slices[i].size);
+#else
+        slice.iov_base = const_cast<void*>(slices[i].data);
+        slice.iov_len = slices[i].size;
+#endif
+        native.push_back(slice);
+        total_size += slices[i].size;
+    }
+    
+    LOG_SOCKET_DEBUG("Sending " << total_size << " bytes in " << native.size() << " slices to TCP socket " << socket);
+    
+    size_t index = 0;
+    size_t total_sent = 0;
+    while (index < native.size()) {
+        size_t batch = std::min(native.size() - index, MAX_SEND_SLICES);
+#ifdef _WIN32
+        DWORD bytes_sent = 0;
+        int result = WSASend(socket, native.data() + index, static_cast<DWORD>(batch), &bytes_sent, 0, nullptr, nullptr);
+        if (result == SOCKET_ERROR) {
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK) {
+                // Non-blocking socket would block, try again
+                continue;
+            }
+            LOG_SOCKET_ERROR("Failed to send TCP data to socket " << socket << " (error: " << error << ")");
+            return -1;
+        }
+        size_t sent = bytes_sent;
+#else
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = native.data() + index;
+        msg.msg_iovlen = batch;
+        // Use MSG_NOSIGNAL to prevent SIGPIPE on broken connections
+        ssize_t result = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        if (result < 0) {
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+                // Non-blocking socket would block, try again
+                continue;
+            }
+            if (error == EPIPE || error == ECONNRESET || error == ENOTCONN) {
+                // Connection closed by peer - this is expected during shutdown
+                LOG_SOCKET_DEBUG("Connection closed during send to socket " << socket << " (error: " << strerror(error) << ")");
+                return -1;
+            }
+            LOG_SOCKET_ERROR("Failed to send TCP data to socket " << socket << " (error: " << error << ")");
+            return -1;
+        }
+        size_t sent = static_cast<size_t>(result);
+#endif
+        if (sent == 0) {
+            LOG_SOCKET_ERROR("Connection closed by peer during send on socket " << socket);
+            return -1;
+        }
+        total_sent += sent;
+        
+        // Advance past fully written slices and trim a partially written one
+        while (sent > 0 && index < native.size()) {
+#ifdef _WIN32
+            size_t slice_size = native[index].len;
+#else
+            size_t slice_size = native[index].iov_len;
+#endif
+            if (sent >= slice_size) {
+                sent -= slice_size;
+                ++index;
+            } else {
+#ifdef _WIN32
+                native[index].buf += sent;
+                native[index].len -= static_cast<ULONG>(sent);
+#else
+                native[index].iov_base = static_cast<char*>(native[index].iov_base) + sent;
+                native[index].iov_len -= sent;
+#endif
+                sent = 0;
+            }
+        }
+    }
+    
+    return static_cast<int>(total_sent);
+}
+
+// Send a file range from user space: straight from the mapping when the file is mapped,
+// otherwise read through a bounded buffer
+static int64_t send_file_data_buffered(socket_t socket, FileHandle& file, uint64_t offset, uint64_t size) {
+    const uint8_t* mapped = file.is_mapped() && offset + size <= file.mapped_size() ? file.mapped_data() + offset : nullptr;
+    std::vector<uint8_t> buffer;
+    if (!mapped) {
+        buffer.resize(static_cast<size_t>((std::min)(size, static_cast<uint64_t>(FILE_SEND_BUFFER_SIZE))));
+    }
+    
+    uint64_t sent = 0;
+    while (sent < size) {
+        size_t block = static_cast<size_t>((std::min)(size - sent, mapped ? MAX_FILE_SEND_BLOCK : buffer.size()));
+        const void* data = mapped ? mapped + sent : buffer.data();
+        if (!mapped && !file.read_at(offset + sent, buffer.data(), block)) {
+            LOG_SOCKET_ERROR("Failed to read " << block << " bytes of " << file.path() << " at offset " << (offset + sent));
+            return -1;
+        }
+        IoSlice slice(data, block);
+        if (send_tcp_data_vectored(socket, &slice, 1) != static_cast<int>(block)) {
+            return -1;
+        }
+        sent += block;
+    }
+    return static_cast<int64_t>(sent);
+}
+
+#ifdef _WIN32
+// TransmitFile lives in mswsock; resolving it through the provider avoids linking that library
+static LPFN_TRANSMITFILE get_transmit_file(socket_t socket) {
+    LPFN_TRANSMITFILE transmit_file = nullptr;
+    GUID guid = WSAID_TRANSMITFILE;
+    DWORD bytes = 0;
+    if (WSAIoctl(socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid),
+                 &transmit_file, sizeof(transmit_file), &bytes, nullptr, nullptr) == SOCKET_ERROR) {
+        return nullptr;
+    }
+    return transmit_file;
+}
+#endif
+
+int64_t send_tcp_file_data(socket_t socket, FileHandle& file, uint64_t offset, uint64_t size) {
+    if (!file.is_open()) {
+        LOG_SOCKET_ERROR("Cannot send from a closed file to socket " << socket);
+        return -1;
+    }
+    LOG_SOCKET_DEBUG("Sending " << size << " bytes of " << file.path() << " at offset " << offset << " to TCP socket " << socket);
+    
+    // The kernel copies from the page cache to the socket; the loops resume partial
+    // sends and stop early only if the file cannot be sent this way, leaving the rest
+    // to the buffered path
+    uint64_t sent = 0;
+#if defined(__linux__)
+    while (sent < size) {
+        off_t file_offset = static_cast<off_t>(offset + sent);
+        size_t block = static_cast<size_t>((std::min)(size - sent, MAX_FILE_SEND_BLOCK));
+        ssize_t result = sendfile(socket, file.native_handle(), &file_offset, block);
+        if (result < 0) {
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+                // Non-blocking socket would block, try again
+                continue;
+            }
+            if (error == EINVAL || error == ENOSYS || error == EOVERFLOW) {
+                // File system or socket type without sendfile support
+                LOG_SOCKET_DEBUG("sendfile unavailable for " << file.path() << " (error: " << strerror(error) << ")");
+                break;
+            }
+            if (error == EPIPE || error == ECONNRESET || error == ENOTCONN) {
+                LOG_SOCKET_DEBUG("Connection closed during file send to socket " << socket << " (error: " << strerror(error) << ")");
+                return -1;
+            }
+            LOG_SOCKET_ERROR("Failed to send file data to socket " << socket << " (error: " << strerror(error) << ")");
+            return -1;
+        }
+        if (result == 0) {
+            LOG_SOCKET_ERROR("File " << file.path() << " ended before offset " << (offset + size));
+            return -1;
+        }
+        sent += static_cast<uint64_t>(result);
+    }
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+    while (sent < size) {
+        off_t written = 0;
+#if defined(__APPLE__)
+        written = static_cast<off_t>((std::min)(size - sent, MAX_FILE_SEND_BLOCK));
+        int result = sendfile(file.native_handle(), socket, static_cast<off_t>(offset + sent), &written, nullptr, 0);
+#else
+        size_t block = static_cast<size_t>((std::min)(size - sent, MAX_FILE_SEND_BLOCK));
+        int result = sendfile(file.native_handle(), socket, static_cast<off_t>(offset + sent), block, nullptr, &written, 0);
+#endif
+        // Bytes written before an interruption are reported too
+        sent += static_cast<uint64_t>(written);
+        if (result < 0) {
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR || error == EBUSY) {
+                continue;
+            }
+            if (error == ENOTSUP || error == EOPNOTSUPP || error == ENOTSOCK || error == EINVAL) {
+                LOG_SOCKET_DEBUG("sendfile unavailable for " << file.path() << " (error: " << strerror(error) << ")");
+                break;
+            }
+            if (error == EPIPE || error == ECONNRESET || error == ENOTCONN) {
+                LOG_SOCKET_DEBUG("Connection closed during file send to socket " << socket << " (error: " << strerror(error) << ")");
+                return -1;
+            }
+            LOG_SOCKET_ERROR("Failed to send file data to socket " << socket << " (error: " << strerror(error) << ")");
+            return -1;
+        }
+        if (written == 0) {
+            LOG_SOCKET_ERROR("File " << file.path() << " ended before offset " << (offset + size));
+            return -1;
+        }
+    }
+#elif defined(_WIN32)
+    LPFN_TRANSMITFILE transmit_file = get_transmit_file(socket);
+    WSAEVENT event = transmit_file ? WSACreateEvent() : WSA_INVALID_EVENT;
+    while (event != WSA_INVALID_EVENT && sent < size) {
+        // TransmitFile takes the file offset from the OVERLAPPED structure
+        uint64_t file_offset = offset + sent;
+        OVERLAPPED overlapped;
+        std::memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = static_cast<DWORD>(file_offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(file_offset >> 32);
+        overlapped.hEvent = event;
+        DWORD block = static_cast<DWORD>((std::min)(size - sent, MAX_FILE_SEND_BLOCK));
+        if (!transmit_file(socket, static_cast<HANDLE>(file.native_handle()), block, 0, &overlapped, nullptr, 0)) {
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK) {
+                continue;
+            }
+            if (error != WSA_IO_PENDING && error != ERROR_IO_PENDING) {
+                WSACloseEvent(event);
+                LOG_SOCKET_ERROR("Failed to send file data to socket " << socket << " (error: " << error << ")");
+                return -1;
+            }
+        }
+        DWORD transferred = 0;
+        DWORD flags = 0;
+        if (!WSAGetOverlappedResult(socket, &overlapped, &transferred, TRUE, &flags) || transferred == 0) {
+            WSACloseEvent(event);
+            LOG_SOCKET_ERROR("Failed to send file data to socket " << socket << " (error: " << WSAGetLastError() << ")");
+            return -1;
+        }
+        WSAResetEvent(event);
+        sent += transferred;
+    }
+    if (event != WSA_INVALID_EVENT) {
+        WSACloseEvent(event);
+    }
+#endif
+    
+    if (sent < size) {
+        int64_t rest = send_file_data_buffered(socket, file, offset + sent, size - sent);
+        if (rest < 0) {
+            return -1;
+        }
+        sent += static_cast<uint64_t>(rest);
+    }
+    return static_cast<int64_t>(sent);
+}
+
 // Large message handling with length-prefixed framing
 int send_tcp_message_framed(socket_t socket, const std::vector<uint8_t>& message) {
-    // Create length prefix (4 bytes, network byte order)
-    uint32_t message_length = static_cast<uint32_t>(message.size());
-    uint32_t length_prefix = htonl(message_length);
-    
-    // Send length prefix first
-    std::vector<uint8_t> prefix_data(reinterpret_cast<const uint8_t*>(&length_prefix), 
-                                     reinterpret_cast<const uint8_t*>(&length_prefix) + 4);
-    int prefix_sent = send_tcp_data(socket, prefix_data);
-    if (prefix_sent != 4) {
-        LOG_SOCKET_ERROR("Failed to send message length prefix to socket " << socket);
+    IoSlice part(message);
+    return send_tcp_message_framed(socket, &part, 1);
+}
+
+int send_tcp_message_framed(socket_t socket, const IoSlice* parts, size_t count) {
+    size_t message_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        message_size += parts[i].size;
+    }
+    
+    if (message_size > MAX_FRAMED_MESSAGE_SIZE) {
+        LOG_SOCKET_ERROR("Message too large to frame: " << message_size << " bytes for socket " << socket);
         return -1;
     }
     
-    // Send the actual message
-    int message_sent = send_tcp_data(socket, message);
-    if (message_sent != static_cast<int>(message.size())) {
-        LOG_SOCKET_ERROR("Failed to send complete message to socket " << socket);
+    // Create length prefix (4 bytes, network byte order)
+    uint32_t length_prefix = htonl(static_cast<uint32_t>(message_size));
+    
+    // Length prefix and all parts go out in one vectored write
+    IoSlice local_slices[8];
+    std::vector<IoSlice> heap_slices;
+    IoSlice* slices = local_slices;
+    if (count + 1 > sizeof(local_slices) / sizeof(local_slices[0])) {
+        heap_slices.resize(count + 1);
+        slices = heap_slices.data();
+    }
+    slices[0] = IoSlice(&length_prefix, 4);
+    for (size_t i = 0; i < count; ++i) {
+        slices[i + 1] = parts[i];
+    }
+    
+    int sent = send_tcp_data_vectored(socket, slices, count + 1);
+    if (sent != static_cast<int>(message_size + 4)) {
+        LOG_SOCKET_ERROR("Failed to send complete framed message to socket " << socket);
         return -1;
     }
     
-    LOG_SOCKET_DEBUG("Successfully sent framed message (" << message.size() << " bytes) to socket " << socket);
-    return prefix_sent + message_sent;
+    LOG_SOCKET_DEBUG("Successfully sent framed message (" << message_size << " bytes) to socket " << socket);
+    return sent;
 }
 
 std::vector<uint8_t> receive_exact_bytes(socket_t socket, size_t num_bytes) {
@@ -708,7 +1207,7 @@ std::vector<uint8_t> receive_tcp_message_framed(socket_t socket) {
         return std::vector<uint8_t>();
     }
     
-    if (message_length > 100 * 1024 * 1024) { // 100MB limit
+    if (message_length > MAX_FRAMED_MESSAGE_SIZE) {
         LOG_SOCKET_ERROR("Message length too large: " << message_length << " bytes from socket " << socket);
         return std::vector<uint8_t>();
     }
@@ -724,6 +1223,136 @@ std::vector<uint8_t> receive_tcp_message_framed(socket_t socket) {
     return message;
 }
 
+bool receive_tcp_messages_framed(socket_t socket, FramedReceiveBuffer& buffer, std::vector<SharedBuffer>& messages) {
+    // Receive into a per-thread scratch buffer so idle connections only hold their partial frame
+    thread_local std::vector<uint8_t> scratch(FRAMED_RECEIVE_CHUNK_SIZE);
+
+    int bytes_received = recv(socket, reinterpret_cast<char*>(scratch.data()), scratch.size(), 0);
+    if (bytes_received == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return true;
+        }
+        LOG_SOCKET_ERROR("Failed to receive TCP data from socket " << socket << " (error: " << error << ")");
+#else
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+            return true;
+        }
+        LOG_SOCKET_ERROR("Failed to receive TCP data from socket " << socket << " (error: " << strerror(error) << ")");
+#endif
+        return false;
+    }
+
+    if (bytes_received == 0) {
+        LOG_SOCKET_INFO("Connection closed by peer on socket " << socket);
+        return false;
+    }
+
+    // Parse straight from the scratch buffer unless a partial frame is pending
+    const uint8_t* data = scratch.data();
+    size_t size = static_cast<size_t>(bytes_received);
+    bool has_pending = !buffer.data.empty();
+    if (has_pending) {
+        buffer.data.insert(buffer.data.end(), scratch.begin(), scratch.begin() + bytes_received);
+        data = buffer.data.data();
+        size = buffer.data.size();
+    }
+
+    // Extract every complete frame
+    size_t offset = 0;
+    while (size - offset >= 4) {
+        uint32_t length_prefix;
+        memcpy(&length_prefix, data + offset, 4);
+        uint32_t message_length = ntohl(length_prefix);
+
+        if (message_length > MAX_FRAMED_MESSAGE_SIZE) {
+            LOG_SOCKET_ERROR("Message length too large: " << message_length << " bytes from socket " << socket);
+            return false;
+        }
+
+        if (size - offset - 4 < message_length) {
+            break; // Wait for the rest of the frame
+        }
+
+        if (message_length == 0) {
+            LOG_SOCKET_DEBUG("Received keep-alive message (length 0) from socket " << socket);
+        } else {
+            messages.push_back(BufferPool::getInstance().copy_of(data + offset + 4, message_length));
+        }
+        offset += 4 + message_length;
+    }
+
+    // Keep only the pending partial frame
+    if (has_pending) {
+        if (offset == size) {
+            std::vector<uint8_t>().swap(buffer.data);
+        } else if (offset > 0) {
+            buffer.data.erase(buffer.data.begin(), buffer.data.begin() + offset);
+        }
+    } else if (offset < size) {
+        buffer.data.assign(data + offset, data + size);
+    }
+
+    return true;
+}
+
+int send_tcp_nonblocking(socket_t socket, const uint8_t* data, size_t size) {
+#ifdef _WIN32
+    int bytes_sent = send(socket, reinterpret_cast<const char*>(data), static_cast<int>(size), 0);
+#else
+    // Use MSG_NOSIGNAL to prevent SIGPIPE on broken connections
+    int bytes_sent = static_cast<int>(send(socket, reinterpret_cast<const char*>(data), size, MSG_NOSIGNAL));
+#endif
+    if (bytes_sent == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return 0;
+        }
+#else
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+            return 0;
+        }
+        if (error == EPIPE || error == ECONNRESET || error == ENOTCONN) {
+            LOG_SOCKET_DEBUG("Connection closed during send to socket " << socket << " (error: " << strerror(error) << ")");
+            return -1;
+        }
+#endif
+        LOG_SOCKET_ERROR("Failed to send TCP data to socket " << socket << " (error: " << error << ")");
+        return -1;
+    }
+    return bytes_sent;
+}
+
+int receive_tcp_nonblocking(socket_t socket, uint8_t* buffer, size_t size) {
+    int bytes_received = recv(socket, reinterpret_cast<char*>(buffer), static_cast<int>(size), 0);
+    if (bytes_received == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to receive TCP data from socket " << socket << " (error: " << error << ")");
+#else
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to receive TCP data from socket " << socket << " (error: " << strerror(error) << ")");
+#endif
+        return -1;
+    }
+    
+    if (bytes_received == 0) {
+        LOG_SOCKET_DEBUG("Connection closed by peer on socket " << socket);
+        return -1;
+    }
+    return bytes_received;
+}
+
 // Convenience functions for string compatibility
 int send_tcp_string(socket_t socket, const std::string& data) {
     std::vector<uint8_t> binary_data(data.begin(), data.end());
@@ -1234,6 +1863,324 @@ std::vector<uint8_t> receive_udp_data_with_timeout(socket_t socket, size_t buffe
     return buffer;
 }
 
+int send_udp_nonblocking(socket_t socket, const sockaddr_storage& address, socklen_t address_length,
+                         const uint8_t* data, size_t size) {
+    int bytes_sent = sendto(socket, reinterpret_cast<const char*>(data), static_cast<int>(size), 0,
+                            reinterpret_cast<const sockaddr*>(&address), address_length);
+    if (bytes_sent == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to send UDP datagram on socket " << socket << " (error: " << error << ")");
+#else
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR || error == ENOBUFS) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to send UDP datagram on socket " << socket << " (error: " << strerror(error) << ")");
+#endif
+        return -1;
+    }
+    return bytes_sent;
+}
+
+int receive_udp_nonblocking(socket_t socket, uint8_t* buffer, size_t size,
+                            sockaddr_storage& sender_address, socklen_t& sender_address_length) {
+    sender_address_length = sizeof(sender_address);
+    int bytes_received = recvfrom(socket, reinterpret_cast<char*>(buffer), static_cast<int>(size), 0,
+                                  reinterpret_cast<sockaddr*>(&sender_address), &sender_address_length);
+    if (bytes_received == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to receive UDP datagram on socket " << socket << " (error: " << error << ")");
+#else
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to receive UDP datagram on socket " << socket << " (error: " << strerror(error) << ")");
+#endif
+        return -1;
+    }
+    return bytes_received;
+}
+
+NetEndpoint NetEndpoint::from_ipv4(const uint8_t* bytes, uint16_t port) {
+    NetEndpoint endpoint;
+    endpoint.address[10] = 0xff;
+    endpoint.address[11] = 0xff;
+    memcpy(endpoint.address.data() + 12, bytes, 4);
+    endpoint.port = port;
+    return endpoint;
+}
+
+bool NetEndpoint::parse(const std::string& ip, uint16_t port, NetEndpoint& endpoint) {
+    in_addr addr4;
+    if (inet_pton(AF_INET, ip.c_str(), &addr4) == 1) {
+        endpoint = from_ipv4(reinterpret_cast<const uint8_t*>(&addr4), port);
+        return true;
+    }
+    if (inet_pton(AF_INET6, ip.c_str(), endpoint.address.data()) == 1) {
+        endpoint.port = port;
+        return true;
+    }
+    endpoint = NetEndpoint();
+    return false;
+}
+
+NetEndpoint NetEndpoint::from_sockaddr(const sockaddr_storage& address) {
+    if (address.ss_family == AF_INET) {
+        const sockaddr_in* addr = reinterpret_cast<const sockaddr_in*>(&address);
+        return from_ipv4(reinterpret_cast<const uint8_t*>(&addr->sin_addr), ntohs(addr->sin_port));
+    }
+    const sockaddr_in6* addr = reinterpret_cast<const sockaddr_in6*>(&address);
+    NetEndpoint endpoint;
+    memcpy(endpoint.address.data(), &addr->sin6_addr, 16);
+    endpoint.port = ntohs(addr->sin6_port);
+    return endpoint;
+}
+
+bool NetEndpoint::is_ipv4() const {
+    static const uint8_t prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    return memcmp(address.data(), prefix, sizeof(prefix)) == 0;
+}
+
+bool NetEndpoint::is_unspecified() const {
+    for (uint8_t byte : address) {
+        if (byte != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string NetEndpoint::ip() const {
+    char text[INET6_ADDRSTRLEN] = {0};
+    if (is_ipv4()) {
+        inet_ntop(AF_INET, ipv4_bytes(), text, sizeof(text));
+    } else {
+        inet_ntop(AF_INET6, address.data(), text, sizeof(text));
+    }
+    return text;
+}
+
+std::string NetEndpoint::to_string() const {
+    if (is_ipv4()) {
+        return ip() + ":" + std::to_string(port);
+    }
+    return "[" + ip() + "]:" + std::to_string(port);
+}
+
+bool NetEndpoint::to_sockaddr(int family, sockaddr_storage& out, socklen_t& out_length) const {
+    memset(&out, 0, sizeof(out));
+    if (family == AF_INET) {
+        if (!is_ipv4()) {
+            return false;
+        }
+        sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(&out);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        memcpy(&addr->sin_addr, ipv4_bytes(), 4);
+        out_length = sizeof(sockaddr_in);
+        return true;
+    }
+
+    sockaddr_in6* addr = reinterpret_cast<sockaddr_in6*>(&out);
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(port);
+    memcpy(&addr->sin6_addr, address.data(), 16);
+    out_length = sizeof(sockaddr_in6);
+    return true;
+}
+
+std::ostream& operator<<(std::ostream& out, const NetEndpoint& endpoint) {
+    return out << endpoint.to_string();
+}
+
+bool make_udp_address(int family, const std::string& ip, int port, sockaddr_storage& address, socklen_t& address_length) {
+    NetEndpoint endpoint;
+    if (!NetEndpoint::parse(ip, static_cast<uint16_t>(port), endpoint)) {
+        memset(&address, 0, sizeof(address));
+        return false;
+    }
+    return endpoint.to_sockaddr(family, address, address_length);
+}
+
+Peer udp_address_to_peer(const sockaddr_storage& address) {
+    return NetEndpoint::from_sockaddr(address).to_peer();
+}
+
+UdpReceiveBatch::UdpReceiveBatch(size_t capacity, size_t datagram_size)
+    : datagram_size_(datagram_size), count_(0) {
+    capacity = (std::max)(size_t(1), (std::min)(capacity, UDP_BATCH_MAX));
+    buffer_.resize(capacity * datagram_size_);
+    sizes_.resize(capacity);
+    addresses_.resize(capacity);
+    address_lengths_.resize(capacity);
+}
+
+int receive_udp_batch(socket_t socket, UdpReceiveBatch& batch) {
+    batch.count_ = 0;
+    const size_t capacity = batch.capacity();
+
+#if defined(RATS_HAVE_MMSG)
+    mmsghdr headers[UDP_BATCH_MAX];
+    iovec slices[UDP_BATCH_MAX];
+    memset(headers, 0, sizeof(mmsghdr) * capacity);
+    for (size_t i = 0; i < capacity; ++i) {
+        slices[i].iov_base = batch.buffer_.data() + i * batch.datagram_size_;
+        slices[i].iov_len = batch.datagram_size_;
+        headers[i].msg_hdr.msg_iov = &slices[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_name = &batch.addresses_[i];
+        headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    }
+
+    int received;
+    do {
+        received = recvmmsg(socket, headers, static_cast<unsigned int>(capacity), MSG_DONTWAIT, nullptr);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return 0;
+        }
+        LOG_SOCKET_DEBUG("Failed to receive UDP datagrams on socket " << socket << " (error: " << strerror(error) << ")");
+        return -1;
+    }
+
+    for (int i = 0; i < received; ++i) {
+        batch.sizes_[i] = headers[i].msg_len;
+        batch.address_lengths_[i] = headers[i].msg_hdr.msg_namelen;
+    }
+    batch.count_ = static_cast<size_t>(received);
+#else
+    while (batch.count_ < capacity) {
+        size_t index = batch.count_;
+        int received = receive_udp_nonblocking(socket, batch.buffer_.data() + index * batch.datagram_size_,
+                                               batch.datagram_size_, batch.addresses_[index],
+                                               batch.address_lengths_[index]);
+        if (received < 0) {
+            return batch.count_ > 0 ? static_cast<int>(batch.count_) : -1;
+        }
+        if (received == 0) {
+            break;
+        }
+        batch.sizes_[index] = static_cast<size_t>(received);
+        ++batch.count_;
+    }
+#endif
+
+    return static_cast<int>(batch.count_);
+}
+
+size_t send_udp_batch(socket_t socket, const UdpDatagram* datagrams, size_t count) {
+    size_t sent = 0;
+
+#if defined(RATS_HAVE_MMSG)
+    mmsghdr headers[UDP_BATCH_MAX];
+    iovec slices[UDP_BATCH_MAX];
+    while (sent < count) {
+        size_t chunk = (std::min)(count - sent, UDP_BATCH_MAX);
+        memset(headers, 0, sizeof(mmsghdr) * chunk);
+        for (size_t i = 0; i < chunk; ++i) {
+            const UdpDatagram& datagram = datagrams[sent + i];
+            slices[i].iov_base = const_cast<uint8_t*>(datagram.data.data());
+            slices[i].iov_len = datagram.data.size();
+            headers[i].msg_hdr.msg_iov = &slices[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_name = const_cast<sockaddr_storage*>(&datagram.address);
+            headers[i].msg_hdr.msg_namelen = datagram.address_length;
+        }
+
+        int result = sendmmsg(socket, headers, static_cast<unsigned int>(chunk), MSG_DONTWAIT);
+        if (result > 0) {
+            sent += static_cast<size_t>(result);
+            continue;
+        }
+
+        int error = errno;
+        if (error == EINTR) {
+            continue;
+        }
+        if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS) {
+            break;
+        }
+        // sendmmsg stops at the first datagram it cannot send; drop that one
+        LOG_SOCKET_DEBUG("Dropping UDP datagram on socket " << socket << " (error: " << strerror(error) << ")");
+        ++sent;
+    }
+#else
+    while (sent < count) {
+        const UdpDatagram& datagram = datagrams[sent];
+        int result = send_udp_nonblocking(socket, datagram.address, datagram.address_length,
+                                          datagram.data.data(), datagram.data.size());
+        if (result == 0 && !datagram.data.empty()) {
+            break;
+        }
+        ++sent;
+    }
+#endif
+
+    return sent;
+}
+
+bool create_socket_pair(socket_t sockets[2]) {
+    sockets[0] = sockets[1] = INVALID_SOCKET_VALUE;
+#ifdef _WIN32
+    // No AF_UNIX socketpair(): accept a loopback connection from ourselves
+    socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (!is_valid_socket(listener)) {
+        LOG_SOCKET_ERROR("Failed to create socket pair listener");
+        return false;
+    }
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t address_length = sizeof(address);
+    bool ok = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+              listen(listener, 1) == 0 &&
+              getsockname(listener, reinterpret_cast<sockaddr*>(&address), &address_length) == 0;
+    if (ok) {
+        sockets[0] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        ok = is_valid_socket(sockets[0]) &&
+             connect(sockets[0], reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+    if (ok) {
+        sockets[1] = accept(listener, nullptr, nullptr);
+        ok = is_valid_socket(sockets[1]);
+    }
+    closesocket(listener);
+    if (!ok) {
+        LOG_SOCKET_ERROR("Failed to create loopback socket pair");
+        close_socket(sockets[0]);
+        sockets[0] = INVALID_SOCKET_VALUE;
+        return false;
+    }
+    int nodelay = 1;
+    setsockopt(sockets[0], IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+    setsockopt(sockets[1], IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+    return true;
+#else
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        LOG_SOCKET_ERROR("Failed to create socket pair: " << strerror(errno));
+        return false;
+    }
+    sockets[0] = fds[0];
+    sockets[1] = fds[1];
+    return true;
+#endif
+}
+
 // Helper function to determine if a socket is TCP
 bool is_tcp_socket(socket_t socket) {
     if (!is_valid_socket(socket)) {
@@ -1269,6 +2216,17 @@ void close_socket(socket_t socket, bool force) {
     }
 }
 
+void shutdown_socket(socket_t socket) {
+    if (is_valid_socket(socket)) {
+        LOG_SOCKET_DEBUG("Shutting down socket " << socket);
+#ifdef _WIN32
+        shutdown(socket, SD_BOTH);
+#else
+        shutdown(socket, SHUT_RDWR);
+#endif
+    }
+}
+
 bool is_valid_socket(socket_t socket) {
     return socket != INVALID_SOCKET_VALUE;
 }
@@ -3,7 +3,11 @@
 #include <string>
 #include <functional>
 #include <vector>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include "buffer.h"
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -25,6 +29,8 @@
 
 namespace librats {
 
+class FileHandle;
+
 /**
  * UDP peer information
  */
@@ -44,6 +50,69 @@ struct Peer {
     }
 };
 
+/**
+ * Numeric IPv4 or IPv6 address and port in 18 bytes: the address in IPv6 form, IPv4 as
+ * ::ffff:a.b.c.d, then the port in host order. Copying, comparing and hashing one never
+ * touches the heap, so protocol state keyed by address (DHT nodes, tokens, stored peers)
+ * uses it; Peer stays the text form for public APIs, logs and hostnames.
+ */
+struct NetEndpoint {
+    std::array<uint8_t, 16> address{};
+    uint16_t port = 0;
+
+    NetEndpoint() = default;
+    NetEndpoint(const std::array<uint8_t, 16>& address, uint16_t port) : address(address), port(port) {}
+    // Numeric address; anything else (a hostname) leaves the address unspecified
+    NetEndpoint(const std::string& ip, uint16_t port) { parse(ip, port, *this); }
+
+    // From 4 IPv4 address bytes in network order
+    static NetEndpoint from_ipv4(const uint8_t* bytes, uint16_t port);
+
+    // From a numeric IPv4 or IPv6 address; false for hostnames and garbage
+    static bool parse(const std::string& ip, uint16_t port, NetEndpoint& endpoint);
+
+    // From a socket address; IPv4-mapped IPv6 addresses and plain IPv4 compare equal
+    static NetEndpoint from_sockaddr(const sockaddr_storage& address);
+
+    bool is_ipv4() const;
+    bool is_unspecified() const;   // All-zero address, also what a failed parse leaves
+    const uint8_t* ipv4_bytes() const { return address.data() + 12; }
+
+    // Numeric text: dotted IPv4 for IPv4 (mapped or not), RFC 5952 IPv6 otherwise
+    std::string ip() const;
+    // ip:port, or [ip]:port for IPv6
+    std::string to_string() const;
+    Peer to_peer() const { return Peer(ip(), port); }
+
+    /**
+     * Destination address for a socket of the given family
+     * @return false if an IPv6 endpoint cannot be reached from an AF_INET socket
+     */
+    bool to_sockaddr(int family, sockaddr_storage& out, socklen_t& out_length) const;
+
+    bool operator==(const NetEndpoint& other) const { return port == other.port && address == other.address; }
+    bool operator!=(const NetEndpoint& other) const { return !(*this == other); }
+    bool operator<(const NetEndpoint& other) const {
+        return address != other.address ? address < other.address : port < other.port;
+    }
+};
+
+static_assert(sizeof(NetEndpoint) == 18, "NetEndpoint must stay 18 bytes");
+
+std::ostream& operator<<(std::ostream& out, const NetEndpoint& endpoint);
+
+/**
+ * Non-owning reference to a contiguous byte range, used for vectored (scatter-gather) sends
+ */
+struct IoSlice {
+    const void* data;
+    size_t size;
+    
+    IoSlice() : data(nullptr), size(0) {}
+    IoSlice(const void* d, size_t s) : data(d), size(s) {}
+    IoSlice(const std::vector<uint8_t>& v) : data(v.data()), size(v.size()) {}
+};
+
 // Socket Library Initialization
 /**
  * Initialize the socket library
@@ -84,6 +153,38 @@ socket_t create_tcp_client_v4(const std::string& host, int port, int timeout_ms
  */
 socket_t create_tcp_client_v6(const std::string& host, int port, int timeout_ms = 0);
 
+/**
+ * Start a non-blocking TCP connection without waiting for it to complete.
+ * The socket becomes writable once the connection is established or has failed;
+ * get_socket_error() then tells which.
+ * @param host The hostname or IP address to connect to (hostnames are resolved synchronously)
+ * @param port The port number to connect to
+ * @return Non-blocking socket handle, or INVALID_SOCKET_VALUE if the connection failed immediately
+ */
+socket_t start_tcp_connect(const std::string& host, int port);
+
+/**
+ * Connect to a host by racing its addresses (RFC 8305 "Happy Eyeballs").
+ * All IPv6 and IPv4 addresses of the host are tried with interleaved families, IPv6 first.
+ * A new attempt starts every attempt_delay_ms, or immediately when the previous one fails.
+ * The first connection to complete wins and the remaining attempts are closed.
+ * @param host The hostname or IP address to connect to
+ * @param port The port number to connect to
+ * @param timeout_ms Overall connection timeout in milliseconds
+ * @param attempt_delay_ms Delay before starting the next address while earlier attempts are pending
+ * @param connected_address Optional output for the address that won the race
+ * @return Non-blocking connected socket handle, or INVALID_SOCKET_VALUE on error
+ */
+socket_t create_tcp_client_racing(const std::string& host, int port, int timeout_ms,
+                                  int attempt_delay_ms = 250, std::string* connected_address = nullptr);
+
+/**
+ * Get and clear the pending error of a socket (SO_ERROR), e.g. the result of a non-blocking connect
+ * @param socket The socket handle
+ * @return 0 if there is no error, otherwise the error code
+ */
+int get_socket_error(socket_t socket);
+
 /**
  * Create a TCP server socket and bind to a port using dual stack (IPv6 with IPv4 support)
  * @param port The port number to bind to
@@ -130,6 +231,28 @@ std::string get_peer_address(socket_t socket);
  */
 int send_tcp_data(socket_t socket, const std::vector<uint8_t>& data);
 
+/**
+ * Send several buffers through a TCP socket with vectored writes (writev/WSASend)
+ * No concatenation buffer is built; partial writes are resumed until everything is sent.
+ * @param socket The socket handle
+ * @param slices Array of buffers to send in order
+ * @param count Number of buffers
+ * @return Total number of bytes sent, or -1 on error
+ */
+int send_tcp_data_vectored(socket_t socket, const IoSlice* slices, size_t count);
+
+/**
+ * Send a range of a file through a TCP socket without copying it through user space:
+ * sendfile on Linux, macOS and FreeBSD, TransmitFile on Windows. Elsewhere, or when the
+ * kernel refuses the file, the range is sent from the file's mapping or read in blocks.
+ * @param socket The socket handle
+ * @param file Open file to send from
+ * @param offset File offset of the first byte
+ * @param size Number of bytes to send
+ * @return Number of bytes sent, or -1 on error
+ */
+int64_t send_tcp_file_data(socket_t socket, FileHandle& file, uint64_t offset, uint64_t size);
+
 /**
  * Receive data from a TCP socket
  * @param socket The socket handle
@@ -146,6 +269,16 @@ std::vector<uint8_t> receive_tcp_data(socket_t socket, size_t buffer_size = 1024
  */
 int send_tcp_message_framed(socket_t socket, const std::vector<uint8_t>& message);
 
+/**
+ * Send a framed message made of several parts; the length prefix covers all parts and
+ * prefix plus parts go out through one vectored write
+ * @param socket The socket handle
+ * @param parts Array of message parts, sent back to back
+ * @param count Number of parts
+ * @return Total bytes sent (including length prefix), or -1 on error
+ */
+int send_tcp_message_framed(socket_t socket, const IoSlice* parts, size_t count);
+
 /**
  * Receive exact number of bytes from a TCP socket (blocking until complete)
  * @param socket The socket handle
@@ -193,6 +326,44 @@ int send_tcp_string_framed(socket_t socket, const std::string& message);
  */
 std::string receive_tcp_string_framed(socket_t socket);
 
+/**
+ * Incremental receive state for length-prefixed (framed) TCP messages.
+ * Kept per connection by event-driven readers that must not block on partial frames.
+ */
+struct FramedReceiveBuffer {
+    std::vector<uint8_t> data;      // Bytes of the pending partial frame
+};
+
+/**
+ * Read the bytes currently available on a readable TCP socket and extract complete framed messages.
+ * Performs a single recv() call, so it does not block when the socket was reported readable.
+ * Zero-length keep-alive frames are consumed silently. Each message is copied once into
+ * storage from the BufferPool, which is recycled when the last view of it is dropped.
+ * @param socket The socket handle
+ * @param buffer Per-connection receive state preserved between calls
+ * @param messages Output vector that complete messages are appended to
+ * @return false if the connection was closed, failed or announced an oversized frame
+ */
+bool receive_tcp_messages_framed(socket_t socket, FramedReceiveBuffer& buffer, std::vector<SharedBuffer>& messages);
+
+/**
+ * Send as much of a buffer as a non-blocking TCP socket accepts right now
+ * @param socket The socket handle
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @return Number of bytes sent, 0 if the socket would block, or -1 on error
+ */
+int send_tcp_nonblocking(socket_t socket, const uint8_t* data, size_t size);
+
+/**
+ * Receive the bytes currently available on a non-blocking TCP socket
+ * @param socket The socket handle
+ * @param buffer Destination buffer
+ * @param size Capacity of the buffer
+ * @return Number of bytes received, 0 if no data is available, or -1 if the connection was closed or failed
+ */
+int receive_tcp_nonblocking(socket_t socket, uint8_t* buffer, size_t size);
+
 // UDP Socket Functions
 /**
  * Create a UDP socket with dual stack support (IPv6 with IPv4 support)
@@ -255,6 +426,115 @@ std::vector<uint8_t> receive_udp_data(socket_t socket, size_t buffer_size, Peer&
 std::vector<uint8_t> receive_udp_data_with_timeout(socket_t socket, size_t buffer_size, int timeout_ms, 
                                                    std::string* sender_ip = nullptr, int* sender_port = nullptr);
 
+/**
+ * Send one datagram to an already resolved address, without blocking, for per-packet protocols
+ * @param socket The UDP socket handle
+ * @param address Destination address, in the socket's address family
+ * @param address_length Size of the address
+ * @param data Datagram bytes
+ * @param size Number of bytes
+ * @return Number of bytes sent, 0 if the socket would block, or -1 on error
+ */
+int send_udp_nonblocking(socket_t socket, const sockaddr_storage& address, socklen_t address_length,
+                         const uint8_t* data, size_t size);
+
+/**
+ * Receive one datagram from a non-blocking UDP socket into a caller-provided buffer
+ * @param socket The UDP socket handle
+ * @param buffer Destination buffer; longer datagrams are truncated
+ * @param size Buffer size
+ * @param sender_address Output: address of the sender
+ * @param sender_address_length Output: size of the sender address
+ * @return Datagram size, 0 if nothing is queued, or -1 on error
+ */
+int receive_udp_nonblocking(socket_t socket, uint8_t* buffer, size_t size,
+                            sockaddr_storage& sender_address, socklen_t& sender_address_length);
+
+/**
+ * Build the destination address for a numeric IP on a UDP socket of the given family
+ * @param family Address family of the sending socket (AF_INET or AF_INET6)
+ * @param ip Numeric IPv4 or IPv6 address; IPv4 becomes IPv4-mapped on AF_INET6 sockets
+ * @param port Destination port
+ * @param address Output: the destination address
+ * @param address_length Output: size of the address
+ * @return true if successful, false if ip is not numeric or cannot be reached from the family
+ */
+bool make_udp_address(int family, const std::string& ip, int port, sockaddr_storage& address, socklen_t& address_length);
+
+/**
+ * Convert a datagram sender address to a Peer
+ * @param address Sender address; IPv4-mapped IPv6 addresses are reported as plain IPv4
+ * @return The sender's ip and port
+ */
+Peer udp_address_to_peer(const sockaddr_storage& address);
+
+/**
+ * Most datagrams moved by one receive_udp_batch() or send_udp_batch() system call
+ */
+constexpr size_t UDP_BATCH_MAX = 64;
+
+/**
+ * Preallocated receive slots for receive_udp_batch(). Keep one per receiving
+ * thread and reuse it, so draining a busy socket allocates nothing per datagram.
+ */
+class UdpReceiveBatch {
+public:
+    /**
+     * @param capacity Datagrams received per call (at most UDP_BATCH_MAX)
+     * @param datagram_size Size of each slot; longer datagrams are truncated
+     */
+    explicit UdpReceiveBatch(size_t capacity = 32, size_t datagram_size = 1500);
+
+    size_t capacity() const { return sizes_.size(); }
+    size_t datagram_size() const { return datagram_size_; }
+
+    // Datagrams filled by the last receive_udp_batch() call, index < count()
+    size_t count() const { return count_; }
+    const uint8_t* data(size_t index) const { return buffer_.data() + index * datagram_size_; }
+    size_t size(size_t index) const { return sizes_[index]; }
+    const sockaddr_storage& address(size_t index) const { return addresses_[index]; }
+    socklen_t address_length(size_t index) const { return address_lengths_[index]; }
+
+private:
+    friend int receive_udp_batch(socket_t socket, UdpReceiveBatch& batch);
+
+    size_t datagram_size_;
+    std::vector<uint8_t> buffer_;
+    std::vector<size_t> sizes_;
+    std::vector<sockaddr_storage> addresses_;
+    std::vector<socklen_t> address_lengths_;
+    size_t count_;
+};
+
+/**
+ * Outgoing datagram for send_udp_batch()
+ */
+struct UdpDatagram {
+    sockaddr_storage address;
+    socklen_t address_length;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * Receive the datagrams queued on a non-blocking UDP socket, up to the batch capacity,
+ * with one recvmmsg() call on Linux and a recvfrom() loop elsewhere
+ * @param socket The UDP socket handle
+ * @param batch Receive slots; count() and the slot accessors describe the result
+ * @return Number of datagrams received, 0 if nothing is queued, or -1 on error
+ */
+int receive_udp_batch(socket_t socket, UdpReceiveBatch& batch);
+
+/**
+ * Send datagrams on a non-blocking UDP socket with as few system calls as possible
+ * (sendmmsg() on Linux, a sendto() loop elsewhere). A datagram the kernel rejects,
+ * e.g. for an unreachable destination, is dropped and sending goes on with the next.
+ * @param socket The UDP socket handle
+ * @param datagrams Datagrams to send, in order
+ * @param count Number of datagrams
+ * @return Number of datagrams consumed from the front; fewer than count only if the socket would block
+ */
+size_t send_udp_batch(socket_t socket, const UdpDatagram* datagrams, size_t count);
+
 // Common Socket Functions
 /**
  * Close a socket
@@ -262,6 +542,13 @@ std::vector<uint8_t> receive_udp_data_with_timeout(socket_t socket, size_t buffe
  */
 void close_socket(socket_t socket, bool force = false);
 
+/**
+ * Shut down both directions of a socket without releasing the handle.
+ * Wakes up any thread blocked on the socket; the owner still has to call close_socket().
+ * @param socket The socket handle
+ */
+void shutdown_socket(socket_t socket);
+
 /**
  * Check if a socket is valid
  * @param socket The socket handle to check
@@ -276,6 +563,13 @@ bool is_valid_socket(socket_t socket);
  */
 bool set_socket_nonblocking(socket_t socket);
 
+/**
+ * Create a connected pair of local stream sockets (a loopback TCP pair on Windows)
+ * @param sockets Receives the two ends; both are blocking and owned by the caller
+ * @return true if successful, false otherwise
+ */
+bool create_socket_pair(socket_t sockets[2]);
+
 /**
  * Check if a socket is a TCP socket
  * @param socket The socket handle to check
@@ -300,4 +594,19 @@ bool connect_with_timeout(socket_t socket, struct sockaddr* addr, socklen_t addr
  */
 int get_ephemeral_port(socket_t socket);
 
-} // namespace librats 
\ No newline at end of file
+} // namespace librats
+
+namespace std {
+    template<>
+    struct hash<librats::NetEndpoint> {
+        std::size_t operator()(const librats::NetEndpoint& endpoint) const noexcept {
+            // Two word loads and a multiply; an IPv4 address lives entirely in the low word
+            uint64_t high, low;
+            std::memcpy(&high, endpoint.address.data(), 8);
+            std::memcpy(&low, endpoint.address.data() + 8, 8);
+            uint64_t h = (low ^ (high * 0x9e3779b97f4a7c15ULL) ^ (static_cast<uint64_t>(endpoint.port) << 48)) *
+                         0xbf58476d1ce4e5b9ULL;
+            return static_cast<std::size_t>(h ^ (h >> 31));
+        }
+    };
+}
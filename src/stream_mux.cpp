@@ -0,0 +1,360 @@
+#include "stream_mux.h"
+#include "logger.h"
+#include <algorithm>
+
+// Stream mux module logging macros
+#define LOG_STREAM_DEBUG(message) LOG_DEBUG("stream", message)
+#define LOG_STREAM_INFO(message)  LOG_INFO("stream", message)
+#define LOG_STREAM_WARN(message)  LOG_WARN("stream", message)
+#define LOG_STREAM_ERROR(message) LOG_ERROR("stream", message)
+
+namespace librats {
+
+namespace {
+
+uint32_t read_u32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+void write_u32(uint8_t* data, uint32_t value) {
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >> 8);
+    data[3] = static_cast<uint8_t>(value);
+}
+
+} // anonymous namespace
+
+StreamMuxer::StreamMuxer(bool odd_ids, const StreamConfig& config, FrameSender sender)
+    : odd_ids_(odd_ids),
+      config_(config),
+      sender_(std::move(sender)),
+      next_stream_id_(odd_ids ? 1 : 2),
+      shut_down_(false) {
+    config_.initial_window = std::max<uint32_t>(config_.initial_window, 1);
+    config_.max_frame_size = std::max<size_t>(config_.max_frame_size, 1);
+}
+
+uint32_t StreamMuxer::open_stream(SendPriority priority) {
+    uint32_t stream_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shut_down_ || streams_.size() >= config_.max_streams) {
+            return 0;
+        }
+        stream_id = next_stream_id_;
+        next_stream_id_ += 2;
+        streams_[stream_id] = Stream{priority, config_.initial_window, config_.initial_window, 0, false, false};
+    }
+
+    // SYN goes out as CONTROL, which is always written before the stream's data
+    if (!send_frame(StreamFrameType::WINDOW_UPDATE, stream_flags::SYN, stream_id, 0, SendPriority::CONTROL)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streams_.erase(stream_id);
+        return 0;
+    }
+
+    LOG_STREAM_DEBUG("Opened stream " << stream_id);
+    return stream_id;
+}
+
+bool StreamMuxer::write(uint32_t stream_id, const uint8_t* data, size_t size) {
+    size_t offset = 0;
+    do {
+        std::vector<uint8_t> frame;
+        SendPriority priority;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = streams_.end();
+            bool ready = window_cv_.wait_for(lock, config_.write_timeout, [&] {
+                it = streams_.find(stream_id);
+                return shut_down_ || it == streams_.end() || it->second.local_closed || it->second.send_window > 0;
+            });
+            if (!ready) {
+                LOG_STREAM_WARN("Write to stream " << stream_id << " timed out waiting for window");
+                return false;
+            }
+            if (shut_down_ || it == streams_.end() || it->second.local_closed) {
+                return false;
+            }
+
+            size_t chunk = std::min<size_t>({size - offset, it->second.send_window, config_.max_frame_size});
+            it->second.send_window -= static_cast<uint32_t>(chunk);
+            priority = it->second.priority;
+            frame = encode_frame(StreamFrameType::DATA, 0, stream_id, static_cast<uint32_t>(chunk), data + offset);
+            offset += chunk;
+        }
+        if (!sender_(frame, priority)) {
+            return false;
+        }
+    } while (offset < size);
+
+    return true;
+}
+
+bool StreamMuxer::close(uint32_t stream_id) {
+    SendPriority priority;
+    bool finished = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = streams_.find(stream_id);
+        if (it == streams_.end() || it->second.local_closed) {
+            return false;
+        }
+        it->second.local_closed = true;
+        priority = it->second.priority;
+        finished = it->second.remote_closed;
+        if (finished) {
+            streams_.erase(it);
+        }
+    }
+    window_cv_.notify_all();
+
+    // FIN travels with the stream's priority so it cannot overtake queued data
+    bool sent = send_frame(StreamFrameType::DATA, stream_flags::FIN, stream_id, 0, priority);
+    if (finished) {
+        notify_closed(stream_id);
+    }
+    return sent;
+}
+
+bool StreamMuxer::reset(uint32_t stream_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (streams_.erase(stream_id) == 0) {
+            return false;
+        }
+    }
+    window_cv_.notify_all();
+
+    send_frame(StreamFrameType::WINDOW_UPDATE, stream_flags::RST, stream_id, 0, SendPriority::CONTROL);
+    notify_closed(stream_id);
+    return true;
+}
+
+bool StreamMuxer::handle_frame(const uint8_t* data, size_t size) {
+    if (size < FRAME_HEADER_SIZE) {
+        return false;
+    }
+    StreamFrameType type = static_cast<StreamFrameType>(data[0]);
+    uint8_t flags = data[1];
+    uint32_t stream_id = read_u32(data + 2);
+    uint32_t length = read_u32(data + 6);
+    if (type == StreamFrameType::DATA) {
+        if (size - FRAME_HEADER_SIZE != length) {
+            return false;
+        }
+    } else if (type != StreamFrameType::WINDOW_UPDATE || size != FRAME_HEADER_SIZE) {
+        return false;
+    }
+
+    bool opened = false;
+    bool rejected = false;
+    bool violated = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shut_down_) {
+            return true;
+        }
+        auto it = streams_.find(stream_id);
+
+        if (flags & stream_flags::RST) {
+            if (it == streams_.end()) {
+                return true;
+            }
+            streams_.erase(it);
+            window_cv_.notify_all();
+        } else {
+            if (it == streams_.end()) {
+                // Frames for streams that are already gone are dropped; new ones need SYN and a remote ID
+                if (!(flags & stream_flags::SYN) || is_local_id(stream_id)) {
+                    return true;
+                }
+                if (streams_.size() >= config_.max_streams) {
+                    rejected = true;
+                } else {
+                    it = streams_.emplace(stream_id, Stream{SendPriority::DATA, config_.initial_window,
+                                                            config_.initial_window, 0, false, false}).first;
+                    opened = true;
+                }
+            }
+
+            if (!rejected) {
+                Stream& stream = it->second;
+                if (type == StreamFrameType::WINDOW_UPDATE && length > UINT32_MAX - stream.send_window) {
+                    // Credit past what a window can hold is a protocol error, as in yamux
+                    streams_.erase(it);
+                    window_cv_.notify_all();
+                    violated = true;
+                } else if (type == StreamFrameType::WINDOW_UPDATE) {
+                    stream.send_window += length;
+                    window_cv_.notify_all();
+                } else if (length > stream.recv_window) {
+                    // The peer ignored our window
+                    streams_.erase(it);
+                    window_cv_.notify_all();
+                    violated = true;
+                } else {
+                    stream.recv_window -= length;
+                }
+            }
+        }
+    }
+
+    if (flags & stream_flags::RST) {
+        LOG_STREAM_DEBUG("Stream " << stream_id << " reset by peer");
+        notify_closed(stream_id);
+        return true;
+    }
+    if (rejected || violated) {
+        LOG_STREAM_WARN("Resetting stream " << stream_id << (rejected ? ": too many streams" : type == StreamFrameType::WINDOW_UPDATE ? ": window overflow" : ": window exceeded"));
+        send_frame(StreamFrameType::WINDOW_UPDATE, stream_flags::RST, stream_id, 0, SendPriority::CONTROL);
+        if (violated) {
+            notify_closed(stream_id);
+        }
+        return true;
+    }
+
+    if (opened) {
+        StreamOpenedCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(callback_mutex_);
+            callback = opened_callback_;
+        }
+        if (callback) {
+            callback(stream_id);
+        }
+    }
+
+    if (type == StreamFrameType::DATA && length > 0) {
+        StreamDataCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(callback_mutex_);
+            callback = data_callback_;
+        }
+        if (callback) {
+            callback(stream_id, data + FRAME_HEADER_SIZE, length);
+        }
+
+        // The callback has consumed the bytes; credit the window back in batches of half a window
+        uint32_t credit = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = streams_.find(stream_id);
+            if (it != streams_.end()) {
+                it->second.recv_consumed += length;
+                if (it->second.recv_consumed >= config_.initial_window / 2) {
+                    credit = it->second.recv_consumed;
+                    it->second.recv_window += credit;
+                    it->second.recv_consumed = 0;
+                }
+            }
+        }
+        if (credit > 0) {
+            send_frame(StreamFrameType::WINDOW_UPDATE, 0, stream_id, credit, SendPriority::CONTROL);
+        }
+    }
+
+    if (flags & stream_flags::FIN) {
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = streams_.find(stream_id);
+            if (it != streams_.end()) {
+                it->second.remote_closed = true;
+                finished = it->second.local_closed;
+                if (finished) {
+                    streams_.erase(it);
+                }
+            }
+        }
+        if (finished) {
+            notify_closed(stream_id);
+        }
+    }
+
+    return true;
+}
+
+void StreamMuxer::shutdown() {
+    std::vector<uint32_t> closed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shut_down_) {
+            return;
+        }
+        shut_down_ = true;
+        for (const auto& entry : streams_) {
+            closed.push_back(entry.first);
+        }
+        streams_.clear();
+    }
+    window_cv_.notify_all();
+
+    for (uint32_t stream_id : closed) {
+        notify_closed(stream_id);
+    }
+}
+
+void StreamMuxer::set_opened_callback(StreamOpenedCallback callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    opened_callback_ = std::move(callback);
+}
+
+void StreamMuxer::set_data_callback(StreamDataCallback callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    data_callback_ = std::move(callback);
+}
+
+void StreamMuxer::set_closed_callback(StreamClosedCallback callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    closed_callback_ = std::move(callback);
+}
+
+size_t StreamMuxer::stream_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.size();
+}
+
+uint32_t StreamMuxer::get_send_window(uint32_t stream_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = streams_.find(stream_id);
+    return it != streams_.end() ? it->second.send_window : 0;
+}
+
+std::vector<uint8_t> StreamMuxer::encode_frame(StreamFrameType type, uint8_t flags, uint32_t stream_id,
+                                               uint32_t length, const uint8_t* data) {
+    size_t data_size = (type == StreamFrameType::DATA) ? length : 0;
+    std::vector<uint8_t> frame(FRAME_HEADER_SIZE + data_size);
+    frame[0] = static_cast<uint8_t>(type);
+    frame[1] = flags;
+    write_u32(frame.data() + 2, stream_id);
+    write_u32(frame.data() + 6, length);
+    if (data_size > 0) {
+        std::copy(data, data + data_size, frame.begin() + FRAME_HEADER_SIZE);
+    }
+    return frame;
+}
+
+bool StreamMuxer::is_local_id(uint32_t stream_id) const {
+    return ((stream_id & 1) == 1) == odd_ids_;
+}
+
+bool StreamMuxer::send_frame(StreamFrameType type, uint8_t flags, uint32_t stream_id, uint32_t length,
+                             SendPriority priority, const uint8_t* data) {
+    return sender_(encode_frame(type, flags, stream_id, length, data), priority);
+}
+
+void StreamMuxer::notify_closed(uint32_t stream_id) {
+    StreamClosedCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(callback_mutex_);
+        callback = closed_callback_;
+    }
+    if (callback) {
+        callback(stream_id);
+    }
+}
+
+} // namespace librats
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "send_queue.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+namespace librats {
+
+/**
+ * Frame types of the stream multiplexing protocol
+ */
+enum class StreamFrameType : uint8_t {
+    DATA = 0,           // Stream payload
+    WINDOW_UPDATE = 1   // Receive window credit (length field holds the delta)
+};
+
+/**
+ * Stream frame flags (combinable)
+ */
+namespace stream_flags {
+    constexpr uint8_t SYN = 0x01;   // First frame of a new stream
+    constexpr uint8_t FIN = 0x04;   // Sender half-closes the stream
+    constexpr uint8_t RST = 0x08;   // Stream aborted in both directions
+}
+
+/**
+ * Stream multiplexing configuration, applied to each peer connection
+ */
+struct StreamConfig {
+    uint32_t initial_window;                    // Bytes a sender may have in flight per stream
+    size_t max_frame_size;                      // Largest DATA payload per frame, so streams interleave
+    size_t max_streams;                         // Open streams per peer; further SYNs are reset
+    std::chrono::milliseconds write_timeout;    // Writers give up after waiting this long for window
+
+    StreamConfig()
+        : initial_window(256 * 1024),
+          max_frame_size(16 * 1024),
+          max_streams(256),
+          write_timeout(std::chrono::seconds(30)) {}
+};
+
+/**
+ * Logical streams over one peer connection, in the style of yamux.
+ *
+ * Frame layout (big endian), carried as the payload of a STREAM message:
+ * [0]: frame type, [1]: flags, [2-5]: stream ID, [6-9]: length, then `length` data bytes
+ * (DATA) or nothing (WINDOW_UPDATE, where length is the window delta).
+ *
+ * Each side allocates its own stream IDs (odd or even, agreed from the peer IDs), so
+ * opening a stream needs no round trip. Every stream has a flow-control window: a writer
+ * blocks once it has initial_window bytes unacknowledged, and the receiver returns credit
+ * after the data callback has consumed the bytes. Frames are queued with the stream's
+ * priority, so a BULK stream shares the connection with DATA streams by the send queue's
+ * weights instead of holding them back.
+ */
+class StreamMuxer {
+public:
+    using FrameSender = std::function<bool(const std::vector<uint8_t>& frame, SendPriority priority)>;
+    using StreamOpenedCallback = std::function<void(uint32_t stream_id)>;
+    using StreamDataCallback = std::function<void(uint32_t stream_id, const uint8_t* data, size_t size)>;
+    using StreamClosedCallback = std::function<void(uint32_t stream_id)>;
+
+    static constexpr size_t FRAME_HEADER_SIZE = 10;
+
+    /**
+     * Constructor
+     * @param odd_ids Whether streams opened locally get odd IDs (the other side uses even ones)
+     * @param config Window and frame size settings
+     * @param sender Queues an encoded frame on the connection
+     */
+    StreamMuxer(bool odd_ids, const StreamConfig& config, FrameSender sender);
+
+    StreamMuxer(const StreamMuxer&) = delete;
+    StreamMuxer& operator=(const StreamMuxer&) = delete;
+
+    /**
+     * Open a stream to the peer
+     * @param priority Send queue class of the stream's frames
+     * @return Stream ID, or 0 if the stream limit is reached or the muxer is shut down
+     */
+    uint32_t open_stream(SendPriority priority = SendPriority::DATA);
+
+    /**
+     * Write data to a stream, blocking while the peer's window is exhausted.
+     * Must not be called from the thread that delivers incoming frames.
+     * @param stream_id Stream ID
+     * @param data Data to write
+     * @param size Number of bytes
+     * @return true if all data was queued, false if the stream is closed, reset or the write timed out
+     */
+    bool write(uint32_t stream_id, const uint8_t* data, size_t size);
+
+    /**
+     * Half-close a stream: no more data will be written, incoming data is still delivered
+     * @param stream_id Stream ID
+     * @return true if the FIN was queued
+     */
+    bool close(uint32_t stream_id);
+
+    /**
+     * Abort a stream in both directions
+     * @param stream_id Stream ID
+     * @return true if the stream existed
+     */
+    bool reset(uint32_t stream_id);
+
+    /**
+     * Process an incoming frame (the payload of a STREAM message)
+     * @param data Frame bytes
+     * @param size Frame size
+     * @return false if the frame is malformed
+     */
+    bool handle_frame(const uint8_t* data, size_t size);
+
+    /**
+     * Tear down all streams because the connection is gone; blocked writers fail
+     */
+    void shutdown();
+
+    void set_opened_callback(StreamOpenedCallback callback);
+    void set_data_callback(StreamDataCallback callback);
+    void set_closed_callback(StreamClosedCallback callback);
+
+    /**
+     * Get the number of open streams
+     * @return Stream count
+     */
+    size_t stream_count() const;
+
+    /**
+     * Get the bytes a stream may still send before waiting for window credit
+     * @param stream_id Stream ID
+     * @return Send window (0 if the stream does not exist)
+     */
+    uint32_t get_send_window(uint32_t stream_id) const;
+
+private:
+    struct Stream {
+        SendPriority priority;
+        uint32_t send_window;       // Bytes we may still send
+        uint32_t recv_window;       // Bytes the peer may still send
+        uint32_t recv_consumed;     // Delivered bytes not yet credited back
+        bool local_closed;          // We sent FIN
+        bool remote_closed;         // Peer sent FIN
+    };
+
+    bool odd_ids_;
+    StreamConfig config_;
+    FrameSender sender_;
+    uint32_t next_stream_id_;
+    bool shut_down_;
+
+    std::unordered_map<uint32_t, Stream> streams_;
+    mutable std::mutex mutex_;
+    std::condition_variable window_cv_;
+
+    StreamOpenedCallback opened_callback_;
+    StreamDataCallback data_callback_;
+    StreamClosedCallback closed_callback_;
+    std::mutex callback_mutex_;
+
+    static std::vector<uint8_t> encode_frame(StreamFrameType type, uint8_t flags, uint32_t stream_id,
+                                             uint32_t length, const uint8_t* data = nullptr);
+    bool is_local_id(uint32_t stream_id) const;
+    bool send_frame(StreamFrameType type, uint8_t flags, uint32_t stream_id, uint32_t length,
+                    SendPriority priority, const uint8_t* data = nullptr);
+    void notify_closed(uint32_t stream_id);
+};
+
+} // namespace librats
@@ -5,6 +5,9 @@
 #include <random>
 #include <cstring>
 #include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -89,6 +92,131 @@ bool StunClient::get_public_address(const std::string& stun_server,
     return true;
 }
 
+std::vector<StunBindingResult> StunClient::query_binding_parallel(const std::vector<std::string>& stun_servers,
+                                                                  int timeout_ms,
+                                                                  size_t stop_after,
+                                                                  int initial_rto_ms) {
+    using Clock = std::chrono::steady_clock;
+    
+    struct Transaction {
+        std::string ip;
+        int port = 0;
+        std::vector<uint8_t> request;
+        Clock::time_point first_sent;
+        Clock::time_point next_send;
+        int rto_ms = 0;
+        bool done = false;
+    };
+    
+    std::vector<StunBindingResult> results(stun_servers.size());
+    std::vector<Transaction> transactions(stun_servers.size());
+    std::unordered_map<std::string, size_t> by_transaction_id;
+    
+    if (!init_socket_library()) {
+        LOG_STUN_ERROR("Failed to initialize socket library");
+        return results;
+    }
+    
+    auto start = Clock::now();
+    size_t pending = 0;
+    for (size_t i = 0; i < stun_servers.size(); ++i) {
+        results[i].server = stun_servers[i];
+        Transaction& t = transactions[i];
+        t.done = true;
+        
+        size_t colon_pos = stun_servers[i].find(':');
+        std::string host = stun_servers[i].substr(0, colon_pos);
+        t.port = colon_pos != std::string::npos ? std::atoi(stun_servers[i].c_str() + colon_pos + 1) : 3478;
+        t.ip = network_utils::resolve_hostname(host);
+        if (t.ip.empty() || t.port <= 0 || t.port > 65535) {
+            LOG_STUN_WARN("Skipping unusable STUN server: " << stun_servers[i]);
+            continue;
+        }
+        
+        t.request = create_binding_request();
+        std::string id(reinterpret_cast<const char*>(t.request.data() + 8), stun::TRANSACTION_ID_SIZE);
+        by_transaction_id[id] = i;
+        t.first_sent = start;
+        t.next_send = start;
+        t.rto_ms = initial_rto_ms;
+        t.done = false;
+        ++pending;
+    }
+    if (pending == 0) {
+        return results;
+    }
+    
+    socket_t stun_socket = create_udp_socket_v4(0);
+    if (!is_valid_socket(stun_socket)) {
+        LOG_STUN_ERROR("Failed to create UDP socket for STUN");
+        return results;
+    }
+    
+    LOG_STUN_DEBUG("Querying " << pending << " STUN servers in parallel (timeout " << timeout_ms << "ms)");
+    
+    auto deadline = start + std::chrono::milliseconds(timeout_ms);
+    size_t answered = 0;
+    while (pending > 0 && (stop_after == 0 || answered < stop_after)) {
+        auto now = Clock::now();
+        if (now >= deadline) {
+            break;
+        }
+        
+        // (Re)transmit every request whose timer has expired
+        auto wake = deadline;
+        for (size_t i = 0; i < transactions.size(); ++i) {
+            Transaction& t = transactions[i];
+            if (t.done) {
+                continue;
+            }
+            if (now >= t.next_send) {
+                if (results[i].requests_sent < stun::MAX_REQUEST_SENDS) {
+                    send_stun_request(stun_socket, t.ip, t.port, t.request);
+                    results[i].requests_sent++;
+                    t.next_send = now + std::chrono::milliseconds(t.rto_ms);
+                    t.rto_ms *= 2;
+                } else {
+                    t.next_send = deadline;
+                }
+            }
+            wake = std::min(wake, t.next_send);
+        }
+        
+        int wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count());
+        std::string sender_ip;
+        int sender_port = 0;
+        std::vector<uint8_t> response = receive_udp_data_with_timeout(stun_socket, 1024, std::max(wait_ms, 1),
+                                                                      &sender_ip, &sender_port);
+        if (response.size() < stun::HEADER_SIZE) {
+            continue;
+        }
+        
+        // Match the response to its transaction; late or foreign packets are ignored
+        std::string id(reinterpret_cast<const char*>(response.data() + 8), stun::TRANSACTION_ID_SIZE);
+        auto it = by_transaction_id.find(id);
+        if (it == by_transaction_id.end() || transactions[it->second].done) {
+            continue;
+        }
+        size_t index = it->second;
+        if (!parse_binding_response(response, results[index].mapped_address)) {
+            continue;
+        }
+        
+        transactions[index].done = true;
+        results[index].success = true;
+        results[index].rtt_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            Clock::now() - transactions[index].first_sent).count());
+        --pending;
+        ++answered;
+        LOG_STUN_DEBUG("STUN server " << results[index].server << " mapped us to " << results[index].mapped_address.ip
+                      << ":" << results[index].mapped_address.port << " in " << results[index].rtt_ms << "ms");
+    }
+    
+    close_socket(stun_socket);
+    LOG_STUN_INFO("Parallel STUN query: " << answered << "/" << stun_servers.size() << " servers answered");
+    return results;
+}
+
 std::vector<uint8_t> StunClient::create_binding_request() {
     std::vector<uint8_t> request(stun::HEADER_SIZE);
     
@@ -114,6 +242,30 @@ std::vector<uint8_t> StunClient::create_binding_request() {
     return request;
 }
 
+std::vector<uint8_t> StunClient::create_binding_response(const uint8_t* transaction_id,
+                                                        const StunAddress& mapped_addr) {
+    std::vector<uint8_t> response(stun::HEADER_SIZE);
+    write_uint16(response.data(), stun::BINDING_RESPONSE);
+    write_uint32(response.data() + 4, stun::MAGIC_COOKIE);
+    std::memcpy(response.data() + 8, transaction_id, stun::TRANSACTION_ID_SIZE);
+    
+    // XOR-MAPPED-ADDRESS (IPv4 only, like parse_binding_response)
+    struct in_addr addr;
+    if (inet_pton(AF_INET, mapped_addr.ip.c_str(), &addr) == 1) {
+        uint8_t attr[12];
+        write_uint16(attr, stun::ATTR_XOR_MAPPED_ADDRESS);
+        write_uint16(attr + 2, 8);
+        attr[4] = 0;
+        attr[5] = stun::FAMILY_IPV4;
+        write_uint16(attr + 6, mapped_addr.port ^ static_cast<uint16_t>(stun::MAGIC_COOKIE >> 16));
+        write_uint32(attr + 8, ntohl(addr.s_addr) ^ stun::MAGIC_COOKIE);
+        response.insert(response.end(), attr, attr + sizeof(attr));
+    }
+    
+    write_uint16(response.data() + 2, static_cast<uint16_t>(response.size() - stun::HEADER_SIZE));
+    return response;
+}
+
 bool StunClient::parse_binding_response(const std::vector<uint8_t>& response, 
                                        StunAddress& mapped_address) {
     if (response.size() < stun::HEADER_SIZE) {
@@ -434,14 +586,22 @@ NatTypeInfo AdvancedNatDetector::detect_nat_characteristics(const std::vector<st
         return info;
     }
     
-    // Basic implementation - test if we can reach STUN server
-    StunAddress public_address;
+    // Query all servers at once; two answers are enough to compare mappings
+    std::vector<StunAddress> mapped;
+    for (const auto& result : stun_client_->query_binding_parallel(stun_servers, timeout_ms, 2)) {
+        if (result.success) {
+            mapped.push_back(result.mapped_address);
+        }
+    }
     
-    if (stun_client_->get_public_address(stun_servers[0], 3478, public_address, timeout_ms)) {
+    if (!mapped.empty()) {
         // Simple NAT type detection - this is a minimal implementation
+        bool consistent = mapped.size() < 2 ||
+                          (mapped[0].ip == mapped[1].ip && mapped[0].port == mapped[1].port);
         info.has_nat = true; // Assume NAT for now
         info.filtering_behavior = NatBehavior::ENDPOINT_INDEPENDENT;
-        info.mapping_behavior = NatBehavior::ENDPOINT_INDEPENDENT;
+        info.mapping_behavior = consistent ? NatBehavior::ENDPOINT_INDEPENDENT
+                                           : NatBehavior::ADDRESS_PORT_DEPENDENT;
         info.preserves_port = false;
         info.hairpin_support = false;
         info.description = "NAT detected via STUN";
@@ -29,6 +29,19 @@ namespace stun {
     const uint16_t CREATE_PERMISSION_RESPONSE = 0x0108;
     const uint16_t CHANNEL_BIND_REQUEST = 0x0009;
     const uint16_t CHANNEL_BIND_RESPONSE = 0x0109;
+    const uint16_t CHANNEL_BIND_ERROR_RESPONSE = 0x0119;
+    
+    // TURN ChannelData (RFC 8656 section 12): 2-byte channel number, 2-byte length, data
+    const size_t CHANNEL_DATA_HEADER_SIZE = 4;
+    const uint16_t CHANNEL_NUMBER_MIN = 0x4000;
+    const uint16_t CHANNEL_NUMBER_MAX = 0x4FFF;
+    
+    // TURN lifetimes in seconds; refreshes are sent a minute before expiry
+    const uint32_t DEFAULT_ALLOCATION_LIFETIME = 600;
+    const uint32_t PERMISSION_LIFETIME = 300;
+    const uint32_t CHANNEL_LIFETIME = 600;
+    const uint32_t REFRESH_MARGIN = 60;
+    const uint8_t TRANSPORT_UDP = 17;
     
     // STUN Magic Cookie (RFC 5389)
     const uint32_t MAGIC_COOKIE = 0x2112A442;
@@ -77,6 +90,10 @@ namespace stun {
     // Transaction ID size
     const size_t TRANSACTION_ID_SIZE = 12;
     
+    // Request retransmission over UDP (RFC 5389 section 7.2.1)
+    const int INITIAL_RTO_MS = 500;
+    const int MAX_REQUEST_SENDS = 7;    // Rc
+    
     // Error codes
     const uint16_t ERROR_TRY_ALTERNATE = 300;
     const uint16_t ERROR_BAD_REQUEST = 400;
@@ -157,6 +174,15 @@ struct StunMessage {
     void clear();
 };
 
+// Outcome of one server in a parallel binding query
+struct StunBindingResult {
+    std::string server;                     // Server as given ("host" or "host:port")
+    bool success = false;
+    StunAddress mapped_address;
+    int rtt_ms = 0;                         // Time from the first request to the response
+    int requests_sent = 0;                  // Including retransmissions
+};
+
 // STUN Client Class with enhanced capabilities
 class StunClient {
 public:
@@ -173,6 +199,21 @@ public:
     bool get_public_address_from_google(StunAddress& public_address, 
                                        int timeout_ms = 5000);
     
+    /**
+     * Send binding requests to several STUN servers at once from one socket.
+     * Every server gets its own transaction ID; unanswered requests are retransmitted
+     * with a doubling RTO (RFC 5389) until they are answered or timeout_ms elapses.
+     * @param stun_servers Servers as "host" or "host:port" (default port 3478)
+     * @param timeout_ms Overall timeout for the whole query
+     * @param stop_after Return once this many servers have answered (0 waits for all)
+     * @param initial_rto_ms Initial retransmission timeout
+     * @return One result per server, in the order given
+     */
+    std::vector<StunBindingResult> query_binding_parallel(const std::vector<std::string>& stun_servers,
+                                                          int timeout_ms = 5000,
+                                                          size_t stop_after = 0,
+                                                          int initial_rto_ms = stun::INITIAL_RTO_MS);
+    
     // Advanced STUN functionality for NAT detection
     bool test_stun_binding(const std::string& stun_server, int stun_port,
                           StunAddress& mapped_addr, StunAddress& source_addr,
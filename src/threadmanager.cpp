@@ -1,4 +1,5 @@
 #include "threadmanager.h"
+#include <algorithm>
 
 // ThreadManager module logging macros
 #define LOG_THREAD_DEBUG(message) LOG_DEBUG("thread", message)
@@ -8,12 +9,19 @@
 
 namespace librats {
 
-ThreadManager::ThreadManager() {
+ThreadManager::ThreadManager()
+    : task_worker_count_(DEFAULT_TASK_WORKERS),
+      max_pending_tasks_(DEFAULT_MAX_PENDING_TASKS),
+      pending_tasks_(0),
+      next_task_queue_(0),
+      next_scheduled_id_(1) {
     LOG_THREAD_DEBUG("ThreadManager initialized");
 }
 
 ThreadManager::~ThreadManager() {
     // Ensure all threads are properly cleaned up
+    shutdown_requested_.store(true);
+    stop_task_pool();
     join_all_active_threads();
     LOG_THREAD_DEBUG("ThreadManager destroyed");
 }
@@ -28,9 +36,9 @@ void ThreadManager::add_managed_thread(std::thread&& t, const std::string& name)
         }
         return;
     }
-    
+
     std::lock_guard<std::mutex> lock(active_threads_mutex_);
-    
+
     // Double-check after acquiring lock
     if (shutdown_requested_.load()) {
         LOG_THREAD_WARN("Ignoring thread detach during shutdown (double-check): " << name);
@@ -40,44 +48,67 @@ void ThreadManager::add_managed_thread(std::thread&& t, const std::string& name)
         }
         return;
     }
-    
+
     active_threads_.emplace_back(std::move(t));
     LOG_THREAD_DEBUG("Added managed thread: " << name << " (total: " << active_threads_.size() << ")");
 }
 
 void ThreadManager::cleanup_finished_threads() {
     // we wait until all threads are finished thus mean cleanup is done
-    join_all_active_threads();
+    std::vector<std::thread> threads_to_join;
+    {
+        std::lock_guard<std::mutex> lock(active_threads_mutex_);
+        threads_to_join = std::move(active_threads_);
+        active_threads_.clear();
+    }
+    for (auto& t : threads_to_join) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
 }
 
 void ThreadManager::shutdown_all_threads() {
     LOG_THREAD_INFO("Initiating shutdown of all background threads");
-    
+
     // Set shutdown flag first
     shutdown_requested_.store(true);
-    
+
     // Notify all waiting threads to wake up immediately
     notify_shutdown();
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        tasks_cv_.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mutex_);
+        scheduler_cv_.notify_all();
+    }
 }
 
 void ThreadManager::join_all_active_threads() {
+    // After shutdown the pool is stopped too; queued tasks that have not started are dropped
+    if (shutdown_requested_.load()) {
+        stop_task_pool();
+    }
+
     std::vector<std::thread> threads_to_join;
-    
+
     // Move threads out of the container while holding the lock
     {
         std::lock_guard<std::mutex> lock(active_threads_mutex_);
         LOG_THREAD_INFO("Waiting for " << active_threads_.size() << " managed threads to finish");
-        
+
         if (active_threads_.empty()) {
             LOG_THREAD_INFO("No active threads to join");
             return;
         }
-        
+
         // Move all threads to local vector to avoid holding lock during join
         threads_to_join = std::move(active_threads_);
         active_threads_.clear();
     }
-    
+
     // Join threads without holding the mutex
     for (auto& t : threads_to_join) {
         if (t.joinable()) {
@@ -88,7 +119,7 @@ void ThreadManager::join_all_active_threads() {
             }
         }
     }
-    
+
     LOG_THREAD_INFO("All managed threads have been cleaned up");
 }
 
@@ -101,5 +132,211 @@ void ThreadManager::notify_shutdown() {
     shutdown_cv_.notify_all();
 }
 
-} // namespace librats
+//=============================================================================
+// Worker pool
+//=============================================================================
+
+void ThreadManager::set_task_pool_limits(size_t worker_count, size_t max_pending_tasks) {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    if (!task_workers_.empty()) {
+        LOG_THREAD_WARN("Task pool already running, limits apply to the next start");
+    }
+    task_worker_count_ = std::max<size_t>(worker_count, 1);
+    max_pending_tasks_ = std::max<size_t>(max_pending_tasks, 1);
+}
+
+size_t ThreadManager::get_pending_task_count() const {
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    return pending_tasks_;
+}
+
+void ThreadManager::start_task_pool_locked() {
+    task_queues_.assign(task_worker_count_, std::deque<PooledTask>());
+    for (size_t i = 0; i < task_worker_count_; ++i) {
+        task_workers_.emplace_back(&ThreadManager::task_worker_loop, this, i);
+    }
+    LOG_THREAD_DEBUG("Started task pool with " << task_worker_count_ << " workers");
+}
+
+bool ThreadManager::submit_task(Task task, const std::string& name) {
+    if (shutdown_requested_.load()) {
+        LOG_THREAD_DEBUG("Ignoring task during shutdown: " << name);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(tasks_mutex_);
+    if (shutdown_requested_.load()) {
+        return false;
+    }
+    if (pending_tasks_ >= max_pending_tasks_) {
+        LOG_THREAD_WARN("Task pool full (" << pending_tasks_ << " pending), dropping task: " << name);
+        return false;
+    }
+    if (task_workers_.empty()) {
+        start_task_pool_locked();
+    }
+
+    // Spread over the worker queues; idle workers steal whatever lands elsewhere
+    task_queues_[next_task_queue_++ % task_queues_.size()].push_back(PooledTask{std::move(task), name});
+    pending_tasks_++;
+    tasks_cv_.notify_one();
+    return true;
+}
+
+bool ThreadManager::take_task_locked(size_t index, PooledTask& out) {
+    for (size_t offset = 0; offset < task_queues_.size(); ++offset) {
+        auto& queue = task_queues_[(index + offset) % task_queues_.size()];
+        if (!queue.empty()) {
+            out = std::move(queue.front());
+            queue.pop_front();
+            pending_tasks_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadManager::task_worker_loop(size_t index) {
+    std::unique_lock<std::mutex> lock(tasks_mutex_);
+    while (true) {
+        PooledTask pooled;
+        while (!take_task_locked(index, pooled)) {
+            if (shutdown_requested_.load()) {
+                return;
+            }
+            tasks_cv_.wait(lock);
+        }
+        if (shutdown_requested_.load()) {
+            continue;   // Drop tasks that had not started before shutdown
+        }
+        lock.unlock();
+
+        try {
+            pooled.task();
+        } catch (const std::exception& e) {
+            LOG_THREAD_ERROR("Exception in task '" << pooled.name << "': " << e.what());
+        } catch (...) {
+            LOG_THREAD_ERROR("Unknown exception in task '" << pooled.name << "'");
+        }
+        pooled.task = nullptr;
+
+        lock.lock();
+    }
+}
+
+void ThreadManager::stop_task_pool() {
+    std::vector<std::thread> workers;
+    std::thread scheduler;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        workers.swap(task_workers_);
+        tasks_cv_.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mutex_);
+        scheduler.swap(scheduler_thread_);
+        scheduled_tasks_.clear();
+        scheduler_cv_.notify_all();
+    }
+
+    auto join = [](std::thread& thread) {
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();    // Shutdown started from a task
+        } else if (thread.joinable()) {
+            thread.join();
+        }
+    };
+    join(scheduler);
+    for (auto& worker : workers) {
+        join(worker);
+    }
+}
+
+//=============================================================================
+// Delayed and periodic tasks
+//=============================================================================
+
+uint64_t ThreadManager::schedule_task(std::chrono::milliseconds delay, Task task, const std::string& name) {
+    return add_scheduled_task(delay, std::chrono::milliseconds(0), std::move(task), name);
+}
+
+uint64_t ThreadManager::schedule_periodic_task(std::chrono::milliseconds interval, Task task, const std::string& name,
+                                               std::chrono::milliseconds initial_delay) {
+    interval = std::max(interval, std::chrono::milliseconds(1));
+    return add_scheduled_task(initial_delay.count() < 0 ? interval : initial_delay, interval, std::move(task), name);
+}
+
+uint64_t ThreadManager::add_scheduled_task(std::chrono::milliseconds delay, std::chrono::milliseconds interval,
+                                           Task task, const std::string& name) {
+    if (shutdown_requested_.load()) {
+        return 0;
+    }
 
+    std::lock_guard<std::mutex> lock(scheduler_mutex_);
+    if (shutdown_requested_.load()) {
+        return 0;
+    }
+    if (!scheduler_thread_.joinable()) {
+        scheduler_thread_ = std::thread(&ThreadManager::scheduler_loop, this);
+    }
+
+    uint64_t id = next_scheduled_id_++;
+    // The interval goes in with the task, so the scheduler never sees a periodic task as one-shot
+    scheduled_tasks_[id] = ScheduledTask{std::make_shared<Task>(std::move(task)), name, interval};
+    scheduler_wheel_.schedule(id, TimerWheel::Clock::now() + delay);
+    scheduler_cv_.notify_one();
+    return id;
+}
+
+bool ThreadManager::cancel_scheduled_task(uint64_t id) {
+    std::lock_guard<std::mutex> lock(scheduler_mutex_);
+    return scheduled_tasks_.erase(id) > 0;
+}
+
+void ThreadManager::scheduler_loop() {
+    std::unique_lock<std::mutex> lock(scheduler_mutex_);
+    while (!shutdown_requested_.load()) {
+        if (scheduler_wheel_.size() == 0) {
+            scheduler_cv_.wait(lock);
+            continue;
+        }
+        scheduler_cv_.wait_for(lock, scheduler_wheel_.get_resolution());
+        if (shutdown_requested_.load()) {
+            break;
+        }
+
+        for (uint64_t id : scheduler_wheel_.advance()) {
+            auto it = scheduled_tasks_.find(id);
+            if (it == scheduled_tasks_.end()) {
+                continue;   // Cancelled
+            }
+            ScheduledTask scheduled = it->second;
+            if (scheduled.interval.count() == 0) {
+                scheduled_tasks_.erase(it);
+            }
+
+            // Periodic tasks are put back on the wheel once their run has finished
+            auto run = [this, id, scheduled]() {
+                (*scheduled.task)();
+                if (scheduled.interval.count() > 0) {
+                    std::lock_guard<std::mutex> reschedule_lock(scheduler_mutex_);
+                    if (!shutdown_requested_.load() && scheduled_tasks_.count(id) > 0) {
+                        scheduler_wheel_.schedule(id, TimerWheel::Clock::now() + scheduled.interval);
+                        scheduler_cv_.notify_one();
+                    }
+                }
+            };
+
+            lock.unlock();
+            bool submitted = submit_task(run, scheduled.name);
+            lock.lock();
+            if (!submitted && !shutdown_requested_.load()) {
+                // Pool full: try again on the next tick
+                scheduled_tasks_.emplace(id, scheduled);
+                scheduler_wheel_.schedule(id, TimerWheel::Clock::now());
+            }
+        }
+    }
+}
+
+} // namespace librats
@@ -3,18 +3,37 @@
 
 #include <thread>
 #include <vector>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include "logger.h"
+#include "timer_wheel.h"
 
 namespace librats {
 
 /**
  * ThreadManager - Manages background threads with graceful shutdown
+ *
+ * Short-lived jobs go to a bounded work-stealing pool instead of a thread each:
+ * workers take tasks from their own queue and steal from the others when it runs
+ * dry, and submit_task() refuses work once max_pending_tasks are queued, so a
+ * reconnect storm is shed instead of spawning hundreds of threads. Delayed and
+ * periodic jobs sit on a timer wheel and are handed to the pool when due.
+ * Pool and scheduler threads are started on first use.
  */
 class ThreadManager {
 public:
+    using Task = std::function<void()>;
+
+    static constexpr size_t DEFAULT_TASK_WORKERS = 4;
+    static constexpr size_t DEFAULT_MAX_PENDING_TASKS = 1024;
+
     ThreadManager();
     virtual ~ThreadManager();
 
@@ -33,6 +52,25 @@ public:
     // Get count of active threads
     size_t get_active_thread_count() const;
 
+    // Run a short-lived job on the worker pool; false if the pool is full or shutting down
+    bool submit_task(Task task, const std::string& name = "unnamed");
+
+    // Run a job on the pool once delay has passed; returns an id for cancel_scheduled_task (0 during shutdown)
+    uint64_t schedule_task(std::chrono::milliseconds delay, Task task, const std::string& name = "unnamed");
+
+    // Run a job every interval, first after initial_delay (default: one interval); the next run is timed from the end of the previous one
+    uint64_t schedule_periodic_task(std::chrono::milliseconds interval, Task task, const std::string& name = "unnamed",
+                                    std::chrono::milliseconds initial_delay = std::chrono::milliseconds(-1));
+
+    // Cancel a delayed or periodic job (a run already in progress completes)
+    bool cancel_scheduled_task(uint64_t id);
+
+    // Size the worker pool; takes effect if called before the first task
+    void set_task_pool_limits(size_t worker_count, size_t max_pending_tasks);
+
+    // Get count of tasks queued on the pool and not yet started
+    size_t get_pending_task_count() const;
+
 protected:
     // Notify waiting threads of shutdown
     void notify_shutdown();
@@ -42,12 +80,48 @@ protected:
     std::mutex shutdown_mutex_;
 
 private:
+    struct PooledTask {
+        Task task;
+        std::string name;
+    };
+
+    struct ScheduledTask {
+        std::shared_ptr<Task> task;
+        std::string name;
+        std::chrono::milliseconds interval;     // Zero for one-shot tasks
+    };
+
+    void start_task_pool_locked();
+    void task_worker_loop(size_t index);
+    bool take_task_locked(size_t index, PooledTask& out);
+    uint64_t add_scheduled_task(std::chrono::milliseconds delay, std::chrono::milliseconds interval,
+                                Task task, const std::string& name);
+    void scheduler_loop();
+    void stop_task_pool();
+
     mutable std::mutex active_threads_mutex_;
     std::vector<std::thread> active_threads_;
     std::atomic<bool> shutdown_requested_{false};
+
+    // Worker pool (one queue per worker; idle workers steal)
+    mutable std::mutex tasks_mutex_;
+    std::condition_variable tasks_cv_;
+    std::vector<std::deque<PooledTask>> task_queues_;
+    std::vector<std::thread> task_workers_;
+    size_t task_worker_count_;
+    size_t max_pending_tasks_;
+    size_t pending_tasks_;
+    size_t next_task_queue_;
+
+    // Delayed and periodic tasks; cancelled ids are skipped when the wheel reports them
+    std::mutex scheduler_mutex_;
+    std::condition_variable scheduler_cv_;
+    TimerWheel scheduler_wheel_;
+    std::unordered_map<uint64_t, ScheduledTask> scheduled_tasks_;
+    uint64_t next_scheduled_id_;
+    std::thread scheduler_thread_;
 };
 
 } // namespace librats
 
 #endif // THREADMANAGER_H
-
@@ -0,0 +1,64 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+namespace librats {
+
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution, size_t slot_count, Clock::time_point start)
+    : resolution_((std::max)(resolution, std::chrono::milliseconds(1))),
+      start_(start),
+      current_tick_(0),
+      slots_((std::max)(slot_count, size_t(1))),
+      size_(0) {}
+
+uint64_t TimerWheel::tick_of(Clock::time_point time, bool round_up) const {
+    if (time <= start_) {
+        return 0;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(time - start_).count();
+    auto step = std::chrono::duration_cast<std::chrono::microseconds>(resolution_).count();
+    uint64_t tick = static_cast<uint64_t>(elapsed / step);
+    if (round_up && elapsed % step != 0) {
+        tick++;
+    }
+    return tick;
+}
+
+void TimerWheel::schedule(uint64_t id, Clock::time_point deadline) {
+    uint64_t tick = tick_of(deadline, true);
+    if (tick < current_tick_) {
+        // That tick has already been processed; report on the next advance
+        overdue_.push_back(id);
+    } else {
+        slots_[tick % slots_.size()].push_back(Timer{id, tick});
+    }
+    size_++;
+}
+
+std::vector<uint64_t> TimerWheel::advance(Clock::time_point now) {
+    std::vector<uint64_t> expired;
+    expired.swap(overdue_);
+    size_ -= expired.size();
+    uint64_t target = tick_of(now, false);
+
+    while (current_tick_ <= target && size_ > 0) {
+        auto& slot = slots_[current_tick_ % slots_.size()];
+        for (size_t i = 0; i < slot.size();) {
+            if (slot[i].tick <= current_tick_) {
+                expired.push_back(slot[i].id);
+                slot[i] = slot.back();
+                slot.pop_back();
+                size_--;
+            } else {
+                ++i;
+            }
+        }
+        current_tick_++;
+    }
+    // Nothing pending: skip the idle ticks in one step
+    if (size_ == 0 && current_tick_ <= target) {
+        current_tick_ = target + 1;
+    }
+    return expired;
+}
+
+} // namespace librats
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace librats {
+
+// Hashed timer wheel for many concurrent deadlines. Deadlines are rounded up
+// to the tick resolution and hashed into a slot by their tick; advancing the
+// wheel only visits the slots of elapsed ticks, so scheduling and expiring are
+// O(1) no matter how many timers are pending. Timers that are more than one
+// revolution away stay in their slot until their round comes up.
+//
+// Timers are identified by caller-chosen ids and are cancelled lazily: the
+// wheel still reports a cancelled id when its deadline passes, and the caller
+// ignores ids it no longer tracks.
+//
+// Not thread safe; the owner serializes access.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(100), size_t slot_count = 512,
+                        Clock::time_point start = Clock::now());
+
+    // Schedule id to expire at the first tick at or after deadline
+    void schedule(uint64_t id, Clock::time_point deadline);
+
+    // Ids whose deadline is at or before now, in deadline order (by tick)
+    std::vector<uint64_t> advance(Clock::time_point now = Clock::now());
+
+    // Timers scheduled and not yet reported
+    size_t size() const { return size_; }
+    std::chrono::milliseconds get_resolution() const { return resolution_; }
+
+private:
+    struct Timer {
+        uint64_t id;
+        uint64_t tick;      // Absolute tick the timer expires on
+    };
+
+    std::chrono::milliseconds resolution_;
+    Clock::time_point start_;
+    uint64_t current_tick_;     // Next tick to process
+    std::vector<std::vector<Timer>> slots_;
+    std::vector<uint64_t> overdue_;     // Scheduled for a tick already processed
+    size_t size_;
+
+    uint64_t tick_of(Clock::time_point time, bool round_up) const;
+};
+
+} // namespace librats
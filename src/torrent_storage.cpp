@@ -0,0 +1,358 @@
+#include "torrent_storage.h"
+#include "bittorrent.h"
+#include "sha1.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstring>
+
+#define LOG_BT_DEBUG(message) LOG_DEBUG("bittorrent", message)
+#define LOG_BT_INFO(message)  LOG_INFO("bittorrent", message)
+#define LOG_BT_WARN(message)  LOG_WARN("bittorrent", message)
+#define LOG_BT_ERROR(message) LOG_ERROR("bittorrent", message)
+
+namespace librats {
+
+//=============================================================================
+// BlockCacheBudget Implementation
+//=============================================================================
+
+BlockCacheBudget::BlockCacheBudget(size_t limit_bytes) : limit_(limit_bytes), used_(0) {}
+
+bool BlockCacheBudget::try_reserve(size_t bytes) {
+    size_t used = used_.load();
+    do {
+        if (used + bytes > limit_.load()) {
+            return false;
+        }
+    } while (!used_.compare_exchange_weak(used, used + bytes));
+    return true;
+}
+
+void BlockCacheBudget::release(size_t bytes) {
+    used_.fetch_sub(bytes);
+}
+
+//=============================================================================
+// BlockBufferPool Implementation
+//=============================================================================
+
+BlockBufferPool::BlockBufferPool(size_t buffer_size, size_t max_free)
+    : buffer_size_(buffer_size), max_free_(max_free) {}
+
+std::vector<uint8_t> BlockBufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            std::vector<uint8_t> buffer = std::move(free_.back());
+            free_.pop_back();
+            return buffer;
+        }
+    }
+    std::vector<uint8_t> buffer;
+    buffer.reserve(buffer_size_);
+    return buffer;
+}
+
+void BlockBufferPool::release(std::vector<uint8_t>&& buffer) {
+    if (buffer.capacity() < buffer_size_) {
+        return;
+    }
+    buffer.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < max_free_) {
+        free_.push_back(std::move(buffer));
+    }
+}
+
+void BlockBufferPool::reserve(size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count = (std::min)(count, max_free_);
+    while (free_.size() < count) {
+        std::vector<uint8_t> buffer;
+        buffer.reserve(buffer_size_);
+        free_.push_back(std::move(buffer));
+    }
+}
+
+size_t BlockBufferPool::get_free_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
+
+//=============================================================================
+// PieceHashPool Implementation
+//=============================================================================
+
+PieceHashPool::PieceHashPool(size_t num_threads) : stopping_(false) {
+    if (num_threads == 0) {
+        num_threads = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&PieceHashPool::worker_loop, this);
+    }
+    LOG_BT_DEBUG("Piece hash pool started with " << num_threads << " threads");
+}
+
+PieceHashPool::~PieceHashPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void PieceHashPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    condition_.notify_one();
+}
+
+void PieceHashPool::worker_loop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+    }
+}
+
+//=============================================================================
+// DiskTorrentStorage Implementation
+//=============================================================================
+
+DiskTorrentStorage::DiskTorrentStorage(const std::string& download_path, const std::vector<FileInfo>& files,
+                                       uint32_t piece_length, std::shared_ptr<BlockCacheBudget> cache_budget)
+    : download_path_(download_path), piece_length_(piece_length),
+      cache_budget_(std::move(cache_budget)), buffer_pool_(BLOCK_SIZE, BLOCK_BUFFER_POOL_SIZE), cached_bytes_(0) {
+    files_.reserve(files.size());
+    for (const auto& file_info : files) {
+        StorageFile file;
+        file.path = download_path_ + "/" + file_info.path;
+        file.offset = file_info.offset;
+        file.length = file_info.length;
+        files_.push_back(std::move(file));
+    }
+}
+
+DiskTorrentStorage::~DiskTorrentStorage() {
+    close();
+}
+
+bool DiskTorrentStorage::open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& file : files_) {
+        file.handle = std::make_unique<FileHandle>();
+
+        // Existing data is kept so a restarted download finds its pieces again
+        if (!file.handle->open(file.path.c_str(), FileOpenMode::READ_WRITE) ||
+            (file.length > 0 && file.handle->size() != static_cast<int64_t>(file.length) &&
+             !file.handle->preallocate(file.length))) {
+            LOG_BT_ERROR("Failed to open file: " << file.path);
+            file.handle.reset();
+            return false;
+        }
+        LOG_BT_DEBUG("Opened file: " << file.path << " (size: " << file.length << ")");
+    }
+
+    buffer_pool_.reserve(BLOCK_BUFFER_POOL_SIZE);
+    return true;
+}
+
+void DiskTorrentStorage::close() {
+    flush();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& file : files_) {
+        file.handle.reset();
+    }
+}
+
+bool DiskTorrentStorage::write_block(PieceIndex piece_index, uint32_t offset, const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t key = block_key(piece_index, offset);
+    auto existing = cache_.find(key);
+    if (existing != cache_.end()) {
+        erase_locked(existing);
+    }
+
+    // Make room in the shared budget by writing out our oldest blocks
+    while (!cache_budget_ || !cache_budget_->try_reserve(size)) {
+        if (!cache_budget_ || lru_.empty()) {
+            // Nothing of ours left to write out, bypass the cache
+            return write_span(torrent_offset(piece_index, offset), data, size);
+        }
+        auto oldest = cache_.find(lru_.front());
+        if (!write_out_locked(oldest)) {
+            return false;
+        }
+    }
+
+    CachedBlock block;
+    block.piece_index = piece_index;
+    block.offset = offset;
+    block.data = size <= buffer_pool_.get_buffer_size() ? buffer_pool_.acquire() : std::vector<uint8_t>();
+    block.data.assign(data, data + size);
+    block.lru_position = lru_.insert(lru_.end(), key);
+    cache_.emplace(key, std::move(block));
+    cached_bytes_ += size;
+    return true;
+}
+
+bool DiskTorrentStorage::read_block(PieceIndex piece_index, uint32_t offset, uint8_t* buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!read_span(torrent_offset(piece_index, offset), buffer, size)) {
+        return false;
+    }
+
+    // Cached blocks are newer than the disk contents
+    uint64_t read_end = static_cast<uint64_t>(offset) + size;
+    auto it = cache_.lower_bound(block_key(piece_index, 0));
+    auto end = cache_.lower_bound(block_key(piece_index + 1, 0));
+    for (; it != end; ++it) {
+        const CachedBlock& block = it->second;
+        uint64_t block_end = static_cast<uint64_t>(block.offset) + block.data.size();
+        uint64_t overlap_start = (std::max)(static_cast<uint64_t>(offset), static_cast<uint64_t>(block.offset));
+        uint64_t overlap_end = (std::min)(read_end, block_end);
+        if (overlap_start < overlap_end) {
+            std::memcpy(buffer + (overlap_start - offset), block.data.data() + (overlap_start - block.offset),
+                        static_cast<size_t>(overlap_end - overlap_start));
+        }
+    }
+    return true;
+}
+
+bool DiskTorrentStorage::hash_piece(PieceIndex piece_index, uint32_t piece_length, uint8_t digest[20]) {
+    constexpr uint32_t HASH_READ_SIZE = 256 * 1024;
+    std::vector<uint8_t> buffer((std::min)(piece_length, HASH_READ_SIZE));
+
+    SHA1 sha1;
+    for (uint32_t offset = 0; offset < piece_length;) {
+        uint32_t size = (std::min)(piece_length - offset, HASH_READ_SIZE);
+        if (!read_block(piece_index, offset, buffer.data(), size)) {
+            return false;
+        }
+        sha1.update(buffer.data(), size);
+        offset += size;
+    }
+    sha1.finalize(digest);
+    return true;
+}
+
+bool DiskTorrentStorage::flush_piece(PieceIndex piece_index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bool success = true;
+    auto it = cache_.lower_bound(block_key(piece_index, 0));
+    while (it != cache_.end() && it->second.piece_index == piece_index) {
+        auto next = std::next(it);
+        success = write_out_locked(it) && success;
+        it = next;
+    }
+    return success;
+}
+
+void DiskTorrentStorage::discard_piece(PieceIndex piece_index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = cache_.lower_bound(block_key(piece_index, 0));
+    while (it != cache_.end() && it->second.piece_index == piece_index) {
+        auto next = std::next(it);
+        erase_locked(it);
+        it = next;
+    }
+}
+
+bool DiskTorrentStorage::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bool success = true;
+    while (!cache_.empty()) {
+        success = write_out_locked(cache_.begin()) && success;
+    }
+    return success;
+}
+
+size_t DiskTorrentStorage::get_cached_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cached_bytes_;
+}
+
+bool DiskTorrentStorage::write_span(uint64_t position, const uint8_t* data, size_t size) {
+    // First file that ends after the offset
+    auto it = std::upper_bound(files_.begin(), files_.end(), position,
+                               [](uint64_t offset, const StorageFile& file) { return offset < file.offset + file.length; });
+
+    while (size > 0 && it != files_.end()) {
+        uint64_t file_offset = position - it->offset;
+        size_t length = static_cast<size_t>((std::min)(static_cast<uint64_t>(size), it->length - file_offset));
+        if (length > 0) {
+            if (!it->handle || !it->handle->write_at(file_offset, data, length)) {
+                LOG_BT_ERROR("Failed to write data to file: " << it->path);
+                return false;
+            }
+            LOG_BT_DEBUG("Wrote " << length << " bytes to file " << it->path << " at offset " << file_offset);
+        }
+        position += length;
+        data += length;
+        size -= length;
+        ++it;
+    }
+    return size == 0;
+}
+
+bool DiskTorrentStorage::read_span(uint64_t position, uint8_t* buffer, size_t size) {
+    auto it = std::upper_bound(files_.begin(), files_.end(), position,
+                               [](uint64_t offset, const StorageFile& file) { return offset < file.offset + file.length; });
+
+    while (size > 0 && it != files_.end()) {
+        uint64_t file_offset = position - it->offset;
+        size_t length = static_cast<size_t>((std::min)(static_cast<uint64_t>(size), it->length - file_offset));
+        if (length > 0 && (!it->handle || !it->handle->read_at(file_offset, buffer, length))) {
+            LOG_BT_ERROR("Failed to read data from file: " << it->path);
+            return false;
+        }
+        position += length;
+        buffer += length;
+        size -= length;
+        ++it;
+    }
+    return size == 0;
+}
+
+bool DiskTorrentStorage::write_out_locked(std::map<uint64_t, CachedBlock>::iterator it) {
+    const CachedBlock& block = it->second;
+    bool success = write_span(torrent_offset(block.piece_index, block.offset), block.data.data(), block.data.size());
+    erase_locked(it);
+    return success;
+}
+
+void DiskTorrentStorage::erase_locked(std::map<uint64_t, CachedBlock>::iterator it) {
+    size_t size = it->second.data.size();
+    lru_.erase(it->second.lru_position);
+    buffer_pool_.release(std::move(it->second.data));
+    cache_.erase(it);
+    cached_bytes_ -= size;
+    if (cache_budget_) {
+        cache_budget_->release(size);
+    }
+}
+
+} // namespace librats
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "fs.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+namespace librats {
+
+struct FileInfo;
+using PieceIndex = uint32_t;
+
+// Memory budget for cached piece blocks, shared by every torrent of a BitTorrentClient
+class BlockCacheBudget {
+public:
+    explicit BlockCacheBudget(size_t limit_bytes);
+
+    // Reserve bytes for a cached block; false if the budget is exhausted
+    bool try_reserve(size_t bytes);
+    void release(size_t bytes);
+
+    void set_limit(size_t limit_bytes) { limit_.store(limit_bytes); }
+    size_t get_limit() const { return limit_.load(); }
+    size_t get_used() const { return used_.load(); }
+
+private:
+    std::atomic<size_t> limit_;
+    std::atomic<size_t> used_;
+};
+
+// Recycled block buffers, so blocks received from peers do not each allocate.
+// Released buffers keep their capacity; at most max_free are kept around.
+class BlockBufferPool {
+public:
+    BlockBufferPool(size_t buffer_size, size_t max_free);
+
+    // An empty buffer with capacity for buffer_size bytes
+    std::vector<uint8_t> acquire();
+    void release(std::vector<uint8_t>&& buffer);
+
+    // Preallocate buffers up to count free ones
+    void reserve(size_t count);
+
+    size_t get_buffer_size() const { return buffer_size_; }
+    size_t get_free_count() const;
+
+private:
+    size_t buffer_size_;
+    size_t max_free_;
+    std::vector<std::vector<uint8_t>> free_;
+    mutable std::mutex mutex_;
+};
+
+// Worker threads that hash completed pieces off the peer I/O threads, shared by
+// every torrent of a BitTorrentClient. Jobs still queued at destruction are run.
+class PieceHashPool {
+public:
+    explicit PieceHashPool(size_t num_threads = 0);  // 0: one per hardware thread
+    ~PieceHashPool();
+
+    void submit(std::function<void()> job);
+    size_t get_thread_count() const { return workers_.size(); }
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_;
+
+    void worker_loop();
+};
+
+// Storage backend of a TorrentDownload. Blocks of pieces being downloaded are
+// written as they arrive; a piece is hashed once all its blocks are stored and
+// either flushed (hash matched) or discarded (hash mismatch).
+class TorrentStorage {
+public:
+    virtual ~TorrentStorage() = default;
+
+    // Open (and create) the files of the torrent
+    virtual bool open() = 0;
+    virtual void close() = 0;
+
+    // Store a block of a piece
+    virtual bool write_block(PieceIndex piece_index, uint32_t offset, const uint8_t* data, size_t size) = 0;
+
+    // Read a block of a piece, from the cache or from disk
+    virtual bool read_block(PieceIndex piece_index, uint32_t offset, uint8_t* buffer, size_t size) = 0;
+
+    // Calculate the SHA1 of a stored piece
+    virtual bool hash_piece(PieceIndex piece_index, uint32_t piece_length, uint8_t digest[20]) = 0;
+
+    // Write the cached blocks of a verified piece to disk
+    virtual bool flush_piece(PieceIndex piece_index) = 0;
+
+    // Drop the cached blocks of a piece that failed verification
+    virtual void discard_piece(PieceIndex piece_index) = 0;
+
+    // Write all cached blocks to disk
+    virtual bool flush() = 0;
+};
+
+// Default storage: the torrent's files held open for positional I/O, with a
+// write-back cache of received blocks bounded by a shared BlockCacheBudget.
+// When the budget is exhausted the oldest cached blocks of this torrent are
+// written out; with nothing left to write out, blocks go straight to disk.
+class DiskTorrentStorage : public TorrentStorage {
+public:
+    DiskTorrentStorage(const std::string& download_path, const std::vector<FileInfo>& files,
+                       uint32_t piece_length, std::shared_ptr<BlockCacheBudget> cache_budget);
+    ~DiskTorrentStorage() override;
+
+    bool open() override;
+    void close() override;
+    bool write_block(PieceIndex piece_index, uint32_t offset, const uint8_t* data, size_t size) override;
+    bool read_block(PieceIndex piece_index, uint32_t offset, uint8_t* buffer, size_t size) override;
+    bool hash_piece(PieceIndex piece_index, uint32_t piece_length, uint8_t digest[20]) override;
+    bool flush_piece(PieceIndex piece_index) override;
+    void discard_piece(PieceIndex piece_index) override;
+    bool flush() override;
+
+    size_t get_cached_bytes() const;
+
+private:
+    struct StorageFile {
+        std::string path;
+        uint64_t offset;    // Offset within the torrent
+        uint64_t length;
+        std::unique_ptr<FileHandle> handle;
+    };
+    struct CachedBlock {
+        PieceIndex piece_index;
+        uint32_t offset;
+        std::vector<uint8_t> data;
+        std::list<uint64_t>::iterator lru_position;
+    };
+
+    std::string download_path_;
+    uint32_t piece_length_;
+    std::vector<StorageFile> files_;
+    std::shared_ptr<BlockCacheBudget> cache_budget_;
+    BlockBufferPool buffer_pool_;
+
+    // Cached blocks by (piece << 32 | offset), oldest first in lru_
+    mutable std::mutex mutex_;
+    std::map<uint64_t, CachedBlock> cache_;
+    std::list<uint64_t> lru_;
+    size_t cached_bytes_;
+
+    static uint64_t block_key(PieceIndex piece_index, uint32_t offset) {
+        return (static_cast<uint64_t>(piece_index) << 32) | offset;
+    }
+    uint64_t torrent_offset(PieceIndex piece_index, uint32_t offset) const {
+        return static_cast<uint64_t>(piece_index) * piece_length_ + offset;
+    }
+
+    bool write_span(uint64_t position, const uint8_t* data, size_t size);
+    bool read_span(uint64_t position, uint8_t* buffer, size_t size);
+    bool write_out_locked(std::map<uint64_t, CachedBlock>::iterator it);
+    void erase_locked(std::map<uint64_t, CachedBlock>::iterator it);
+};
+
+} // namespace librats
@@ -0,0 +1,182 @@
+#include "tracing.h"
+#include "logger.h"
+#include "json.hpp"
+#include <algorithm>
+#include <fstream>
+
+// Tracing module logging macros
+#define LOG_TRACING_DEBUG(message) LOG_DEBUG("tracing", message)
+#define LOG_TRACING_INFO(message)  LOG_INFO("tracing", message)
+#define LOG_TRACING_WARN(message)  LOG_WARN("tracing", message)
+#define LOG_TRACING_ERROR(message) LOG_ERROR("tracing", message)
+
+namespace librats {
+
+namespace {
+
+constexpr size_t DEFAULT_TRACE_BUFFER_CAPACITY = 16384;
+
+} // anonymous namespace
+
+/**
+ * Ring of the spans recorded by one thread. The mutex is only contended while
+ * the spans are collected or cleared.
+ */
+class TraceThreadBuffer {
+public:
+    TraceThreadBuffer(uint32_t thread_index, size_t capacity)
+        : thread_index_(thread_index), capacity_((std::max)(capacity, size_t(1))), next_(0), closed_(false) {
+        events_.reserve(capacity_);
+    }
+
+    void push(const TraceEvent& event) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (events_.size() < capacity_) {
+            events_.push_back(event);
+        } else {
+            events_[next_] = event;
+            next_ = (next_ + 1) % capacity_;
+        }
+    }
+
+    void copy_to(std::vector<std::pair<uint32_t, TraceEvent>>& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& event : events_) {
+            out.emplace_back(thread_index_, event);
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+        next_ = 0;
+    }
+
+    // Set when the owning thread exits; its spans stay until cleared
+    void close() { closed_.store(true, std::memory_order_release); }
+    bool is_closed() const { return closed_.load(std::memory_order_acquire); }
+
+private:
+    mutable std::mutex mutex_;
+    uint32_t thread_index_;
+    size_t capacity_;
+    std::vector<TraceEvent> events_;
+    size_t next_;                   // Oldest span once the ring is full
+    std::atomic<bool> closed_;
+};
+
+namespace {
+
+// Marks a thread's buffer closed when the thread exits
+struct TraceThreadBufferHolder {
+    std::shared_ptr<TraceThreadBuffer> buffer;
+
+    ~TraceThreadBufferHolder() {
+        if (buffer) {
+            buffer->close();
+        }
+    }
+};
+
+} // anonymous namespace
+
+Tracer::Tracer() : enabled_(false), buffer_capacity_(DEFAULT_TRACE_BUFFER_CAPACITY),
+                   epoch_(std::chrono::steady_clock::now()), next_thread_index_(1) {}
+
+void Tracer::set_thread_buffer_capacity(size_t events) {
+    buffer_capacity_.store((std::max)(events, size_t(1)), std::memory_order_relaxed);
+}
+
+TraceThreadBuffer& Tracer::thread_buffer() {
+    thread_local TraceThreadBufferHolder holder;
+    if (!holder.buffer) {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        holder.buffer = std::make_shared<TraceThreadBuffer>(next_thread_index_++, get_thread_buffer_capacity());
+        buffers_.push_back(holder.buffer);
+    }
+    return *holder.buffer;
+}
+
+void Tracer::record(const char* category, const char* name,
+                    std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    if (start < epoch_) {
+        start = epoch_;
+    }
+    if (end < start) {
+        end = start;
+    }
+
+    TraceEvent event;
+    event.category = category;
+    event.name = name;
+    event.start_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(start - epoch_).count());
+    event.duration_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    thread_buffer().push(event);
+}
+
+std::vector<std::pair<uint32_t, TraceEvent>> Tracer::collect() const {
+    std::vector<std::shared_ptr<TraceThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        buffers = buffers_;
+    }
+
+    std::vector<std::pair<uint32_t, TraceEvent>> events;
+    for (const auto& buffer : buffers) {
+        buffer->copy_to(events);
+    }
+    std::sort(events.begin(), events.end(),
+              [](const std::pair<uint32_t, TraceEvent>& a, const std::pair<uint32_t, TraceEvent>& b) {
+                  return a.second.start_us < b.second.start_us;
+              });
+    return events;
+}
+
+std::string Tracer::export_chrome_trace() const {
+    nlohmann::json trace_events = nlohmann::json::array();
+    for (const auto& entry : collect()) {
+        const TraceEvent& event = entry.second;
+        trace_events.push_back({
+            {"name", event.name},
+            {"cat", event.category},
+            {"ph", "X"},
+            {"ts", event.start_us},
+            {"dur", event.duration_us},
+            {"pid", 1},
+            {"tid", entry.first}
+        });
+    }
+
+    nlohmann::json trace;
+    trace["traceEvents"] = std::move(trace_events);
+    trace["displayTimeUnit"] = "ms";
+    return trace.dump();
+}
+
+bool Tracer::write_chrome_trace(const std::string& path) const {
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_TRACING_ERROR("Failed to open trace file: " << path);
+        return false;
+    }
+    file << export_chrome_trace();
+    if (!file.good()) {
+        LOG_TRACING_ERROR("Failed to write trace file: " << path);
+        return false;
+    }
+    LOG_TRACING_INFO("Wrote trace to " << path);
+    return true;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    for (const auto& buffer : buffers_) {
+        buffer->clear();
+    }
+    // Forget the buffers of exited threads
+    buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                  [](const std::shared_ptr<TraceThreadBuffer>& buffer) { return buffer->is_closed(); }),
+                   buffers_.end());
+}
+
+} // namespace librats
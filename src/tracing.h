@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace librats {
+
+class TraceThreadBuffer;
+
+/**
+ * One completed span
+ */
+struct TraceEvent {
+    const char* category;       // String literal
+    const char* name;           // String literal
+    uint64_t start_us;          // Since the tracer epoch
+    uint64_t duration_us;
+};
+
+/**
+ * Process-wide span recorder.
+ *
+ * Tracing is off by default; a disabled span costs one relaxed atomic load. Enabled
+ * spans are appended to a ring owned by the recording thread, so threads never
+ * contend with each other; when a ring is full its oldest spans are overwritten.
+ * The collected spans are exported as Chrome trace event JSON, which chrome://tracing
+ * and the Perfetto UI open directly.
+ */
+class Tracer {
+public:
+    static Tracer& getInstance() {
+        static Tracer instance;
+        return instance;
+    }
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool is_enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+     * Set how many spans each thread keeps (applies to threads that record their first span afterwards)
+     * @param events Spans per thread
+     */
+    void set_thread_buffer_capacity(size_t events);
+    size_t get_thread_buffer_capacity() const { return buffer_capacity_.load(std::memory_order_relaxed); }
+
+    /**
+     * Record a span that ran between two points in time (used for spans that outlive a scope)
+     * @param category Category literal, e.g. "connection"
+     * @param name Span name literal
+     */
+    void record(const char* category, const char* name,
+                std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    /**
+     * Get the recorded spans of all threads
+     * @return Spans with the thread index they were recorded on, ordered by start time
+     */
+    std::vector<std::pair<uint32_t, TraceEvent>> collect() const;
+
+    /**
+     * Render the recorded spans as Chrome trace event JSON
+     * @return JSON text
+     */
+    std::string export_chrome_trace() const;
+
+    /**
+     * Write the recorded spans to a file as Chrome trace event JSON
+     * @param path Output file
+     * @return true on success
+     */
+    bool write_chrome_trace(const std::string& path) const;
+
+    // Discard all recorded spans
+    void clear();
+
+private:
+    Tracer();
+
+    TraceThreadBuffer& thread_buffer();
+
+    std::atomic<bool> enabled_;
+    std::atomic<size_t> buffer_capacity_;
+    std::chrono::steady_clock::time_point epoch_;
+    mutable std::mutex buffers_mutex_;          // Guards buffers_ (taken once per thread, at registration)
+    std::vector<std::shared_ptr<TraceThreadBuffer>> buffers_;
+    uint32_t next_thread_index_;
+};
+
+/**
+ * Records the lifetime of the scope as a span if tracing was enabled when it started
+ */
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const char* name)
+        : category_(category), name_(name), active_(Tracer::getInstance().is_enabled()) {
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (active_) {
+            Tracer::getInstance().record(category_, name_, start_, std::chrono::steady_clock::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace librats
+
+#define LIBRATS_TRACE_CONCAT_INNER(a, b) a##b
+#define LIBRATS_TRACE_CONCAT(a, b) LIBRATS_TRACE_CONCAT_INNER(a, b)
+
+// Trace the rest of the enclosing scope
+#define TRACE_SPAN(category, name) \
+    ::librats::TraceSpan LIBRATS_TRACE_CONCAT(librats_trace_span_, __LINE__)(category, name)
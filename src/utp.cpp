@@ -0,0 +1,1184 @@
+#include "utp.h"
+#include "network_utils.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#define LOG_UTP_DEBUG(message) LOG_DEBUG("utp", message)
+#define LOG_UTP_INFO(message)  LOG_INFO("utp", message)
+#define LOG_UTP_WARN(message)  LOG_WARN("utp", message)
+#define LOG_UTP_ERROR(message) LOG_ERROR("utp", message)
+
+namespace librats {
+
+namespace {
+
+constexpr uint8_t UTP_VERSION = 1;
+constexpr uint32_t STUN_MAGIC_COOKIE = 0x2112A442;     // Shares the first byte values with uTP DATA/FIN
+constexpr size_t UTP_DATAGRAM_BUFFER_SIZE = 64 * 1024;
+constexpr size_t UTP_REORDER_LIMIT = 1024;             // Packets accepted ahead of a hole
+constexpr size_t UTP_INITIAL_RTO_MS = 1000;
+constexpr int UTP_DUPLICATE_ACK_THRESHOLD = 3;
+constexpr auto BASE_DELAY_ROTATION = std::chrono::seconds(60);
+constexpr size_t BASE_DELAY_HISTORY = 2;               // Minutes of history for the base delay
+
+uint16_t read_uint16_be(const uint8_t* data) {
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t read_uint32_be(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+void write_uint16_be(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+void write_uint32_be(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+// Sequence numbers wrap at 16 bits; a <= b if b is less than half the space ahead
+bool seq_less_equal(uint16_t a, uint16_t b) {
+    return static_cast<uint16_t>(b - a) < 0x8000;
+}
+
+uint32_t timestamp_us(std::chrono::steady_clock::time_point now) {
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count());
+}
+
+// Packed address bytes (IPv4-mapped IPv6 folded to IPv4) followed by a connection id
+std::string connection_key(const sockaddr_storage& address, uint16_t connection_id) {
+    std::string key;
+    if (address.ss_family == AF_INET) {
+        const sockaddr_in* addr = reinterpret_cast<const sockaddr_in*>(&address);
+        key.append(reinterpret_cast<const char*>(&addr->sin_addr), 4);
+        key.append(reinterpret_cast<const char*>(&addr->sin_port), 2);
+    } else if (address.ss_family == AF_INET6) {
+        const sockaddr_in6* addr = reinterpret_cast<const sockaddr_in6*>(&address);
+        if (IN6_IS_ADDR_V4MAPPED(&addr->sin6_addr)) {
+            key.append(reinterpret_cast<const char*>(&addr->sin6_addr) + 12, 4);
+        } else {
+            key.append(reinterpret_cast<const char*>(&addr->sin6_addr), 16);
+        }
+        key.append(reinterpret_cast<const char*>(&addr->sin6_port), 2);
+    }
+    key.push_back(static_cast<char>(connection_id >> 8));
+    key.push_back(static_cast<char>(connection_id));
+    return key;
+}
+
+uint16_t random_uint16() {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    return static_cast<uint16_t>(rng());
+}
+
+} // anonymous namespace
+
+//=============================================================================
+// UtpHeader
+//=============================================================================
+
+void UtpHeader::write(uint8_t* out) const {
+    out[0] = static_cast<uint8_t>((static_cast<uint8_t>(type) << 4) | UTP_VERSION);
+    out[1] = 0;  // No extensions are sent
+    write_uint16_be(out + 2, connection_id);
+    write_uint32_be(out + 4, timestamp_us);
+    write_uint32_be(out + 8, timestamp_difference_us);
+    write_uint32_be(out + 12, window_size);
+    write_uint16_be(out + 16, seq_nr);
+    write_uint16_be(out + 18, ack_nr);
+}
+
+size_t UtpHeader::parse(const uint8_t* data, size_t size, UtpHeader& header) {
+    if (size < UTP_HEADER_SIZE) {
+        return 0;
+    }
+    uint8_t type = data[0] >> 4;
+    if ((data[0] & 0x0f) != UTP_VERSION || type > static_cast<uint8_t>(UtpPacketType::SYN)) {
+        return 0;
+    }
+    if (read_uint32_be(data + 4) == STUN_MAGIC_COOKIE) {
+        return 0;
+    }
+
+    header.type = static_cast<UtpPacketType>(type);
+    header.extension = data[1];
+    header.connection_id = read_uint16_be(data + 2);
+    header.timestamp_us = read_uint32_be(data + 4);
+    header.timestamp_difference_us = read_uint32_be(data + 8);
+    header.window_size = read_uint32_be(data + 12);
+    header.seq_nr = read_uint16_be(data + 16);
+    header.ack_nr = read_uint16_be(data + 18);
+
+    // Extension chain: (next extension, length, data) until next is 0
+    size_t offset = UTP_HEADER_SIZE;
+    uint8_t extension = header.extension;
+    while (extension != 0) {
+        if (offset + 2 > size) {
+            return 0;
+        }
+        extension = data[offset];
+        size_t length = data[offset + 1];
+        offset += 2 + length;
+        if (offset > size) {
+            return 0;
+        }
+    }
+    return offset;
+}
+
+//=============================================================================
+// LedbatController
+//=============================================================================
+
+LedbatController::LedbatController()
+    : window_(static_cast<double>(MIN_WINDOW)), current_delay_us_(0), has_delay_(false),
+      history_rotated_at_(std::chrono::steady_clock::now()) {}
+
+void LedbatController::on_delay_sample(uint32_t delay_us, std::chrono::steady_clock::time_point now) {
+    current_delay_us_ = delay_us;
+    has_delay_ = true;
+
+    // The clocks of the two hosts are unrelated, so delays are only meaningful
+    // relative to each other and compared with wrap-around
+    if (base_delay_history_.empty() || now - history_rotated_at_ >= BASE_DELAY_ROTATION) {
+        base_delay_history_.push_back(delay_us);
+        if (base_delay_history_.size() > BASE_DELAY_HISTORY) {
+            base_delay_history_.pop_front();
+        }
+        history_rotated_at_ = now;
+        return;
+    }
+    uint32_t& minimum = base_delay_history_.back();
+    if (static_cast<int32_t>(delay_us - minimum) < 0) {
+        minimum = delay_us;
+    }
+}
+
+uint32_t LedbatController::get_base_delay_us() const {
+    if (base_delay_history_.empty()) {
+        return 0;
+    }
+    uint32_t base = base_delay_history_.front();
+    for (uint32_t delay : base_delay_history_) {
+        if (static_cast<int32_t>(delay - base) < 0) {
+            base = delay;
+        }
+    }
+    return base;
+}
+
+uint32_t LedbatController::get_queuing_delay_us() const {
+    if (!has_delay_) {
+        return 0;
+    }
+    int32_t queuing = static_cast<int32_t>(current_delay_us_ - get_base_delay_us());
+    return queuing > 0 ? static_cast<uint32_t>(queuing) : 0;
+}
+
+void LedbatController::on_ack(size_t bytes_acked, size_t bytes_in_flight) {
+    if (bytes_acked == 0) {
+        return;
+    }
+    double off_target = (static_cast<double>(UTP_TARGET_DELAY_US) - get_queuing_delay_us()) / UTP_TARGET_DELAY_US;
+    off_target = std::max(off_target, -1.0);
+
+    // Only a sender that used its window has shown it can use a larger one
+    if (off_target > 0 && bytes_in_flight + UTP_MAX_PAYLOAD < window_) {
+        return;
+    }
+    window_ += MAX_INCREASE_PER_RTT * off_target * static_cast<double>(bytes_acked) / window_;
+    window_ = std::min(std::max(window_, static_cast<double>(MIN_WINDOW)), static_cast<double>(MAX_WINDOW));
+}
+
+void LedbatController::on_loss() {
+    window_ = std::max(window_ / 2, static_cast<double>(MIN_WINDOW));
+}
+
+void LedbatController::on_timeout() {
+    window_ = static_cast<double>(MIN_WINDOW);
+}
+
+//=============================================================================
+// UtpSocket
+//=============================================================================
+
+UtpSocket::UtpSocket(UtpManager* manager, const Peer& remote_peer, const sockaddr_storage& address,
+                     socklen_t address_length, uint16_t recv_id, uint16_t send_id)
+    : manager_(manager), remote_peer_(remote_peer), address_(address), address_length_(address_length),
+      recv_id_(recv_id), send_id_(send_id), state_(State::SYN_SENT), pending_events_(0),
+      seq_nr_(1), bytes_in_flight_(0), peer_window_(UTP_RECEIVE_BUFFER_SIZE), last_ack_nr_(0),
+      duplicate_acks_(0), write_blocked_(false), fin_pending_(false), reply_micro_(0),
+      srtt_ms_(0), rttvar_ms_(0), has_rtt_(false), rto_ms_(UTP_INITIAL_RTO_MS), timeouts_(0), retransmits_(0),
+      in_recovery_(false), recovery_seq_nr_(0), ack_nr_(0), reorder_bytes_(0), got_fin_(false), fin_seq_nr_(0),
+      eof_(false), ack_pending_(false), advertised_window_(UTP_RECEIVE_BUFFER_SIZE) {}
+
+UtpSocket::~UtpSocket() = default;
+
+// read(), write() and close() are called from event handlers, so the events
+// they raise are left for the manager threads to deliver
+
+int UtpSocket::read(uint8_t* buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!receive_buffer_.empty() && state_ != State::FIN_SENT) {
+        size_t count = std::min(size, receive_buffer_.size());
+        receive_buffer_.peek(0, buffer, count);
+        receive_buffer_.consume(count);
+
+        // The peer stops at a closed window; reopen it without waiting for more data to ack
+        if (state_ == State::CONNECTED && advertised_window_ < UTP_RECEIVE_BUFFER_SIZE / 4 &&
+            receive_window_locked() >= UTP_RECEIVE_BUFFER_SIZE / 2) {
+            send_state_locked();
+        }
+        return static_cast<int>(count);
+    }
+    if (eof_ || state_ == State::FIN_SENT || state_ == State::CLOSED || state_ == State::ERROR) {
+        return -1;
+    }
+    return 0;
+}
+
+int UtpSocket::write(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::SYN_SENT) {
+        write_blocked_ = true;
+        return 0;
+    }
+    if (state_ != State::CONNECTED) {
+        return -1;
+    }
+    size_t count = std::min(size, UTP_SEND_BUFFER_SIZE - send_buffer_.size());
+    if (count > 0) {
+        send_buffer_.append(data, count);
+    }
+    if (count < size) {
+        write_blocked_ = true;
+    }
+    flush_locked();
+    return static_cast<int>(count);
+}
+
+void UtpSocket::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::CONNECTED) {
+        state_ = State::FIN_SENT;
+        fin_pending_ = true;
+        receive_buffer_.clear();
+        flush_locked();
+    } else if (state_ == State::SYN_SENT) {
+        state_ = State::CLOSED;
+        outgoing_.clear();
+        bytes_in_flight_ = 0;
+    }
+}
+
+void UtpSocket::set_event_handler(std::function<void(uint32_t events)> handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    event_handler_ = std::move(handler);
+}
+
+UtpSocket::State UtpSocket::get_state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+size_t UtpSocket::get_congestion_window() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ledbat_.get_window();
+}
+
+size_t UtpSocket::get_bytes_in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_in_flight_;
+}
+
+uint32_t UtpSocket::get_rtt_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<uint32_t>(srtt_ms_);
+}
+
+uint64_t UtpSocket::get_retransmits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retransmits_;
+}
+
+void UtpSocket::start_connect() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<uint8_t> packet(UTP_HEADER_SIZE);
+    queue_packet_locked(UtpPacketType::SYN, std::move(packet), 0);
+}
+
+void UtpSocket::accept_syn(const UtpHeader& syn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = State::CONNECTED;
+    seq_nr_ = random_uint16();
+    ack_nr_ = syn.seq_nr;
+    last_ack_nr_ = static_cast<uint16_t>(seq_nr_ - 1);
+    peer_window_ = syn.window_size;
+    reply_micro_ = timestamp_us(std::chrono::steady_clock::now()) - syn.timestamp_us;
+    send_state_locked();
+}
+
+void UtpSocket::on_packet(const UtpHeader& header, const uint8_t* payload, size_t payload_size) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::ERROR) {
+        return;
+    }
+    reply_micro_ = timestamp_us(now) - header.timestamp_us;
+
+    if (header.type == UtpPacketType::RESET) {
+        LOG_UTP_DEBUG("Connection to " << remote_peer_.ip << ":" << remote_peer_.port << " reset by peer");
+        fail_locked();
+        return;
+    }
+    if (header.type == UtpPacketType::SYN) {
+        // Our STATE was lost and the initiator tried again
+        send_state_locked();
+        return;
+    }
+
+    if (state_ == State::SYN_SENT) {
+        if (header.type != UtpPacketType::STATE || header.ack_nr != static_cast<uint16_t>(seq_nr_ - 1)) {
+            return;
+        }
+        state_ = State::CONNECTED;
+        ack_nr_ = static_cast<uint16_t>(header.seq_nr - 1);
+        pending_events_ |= IO_EVENT_WRITE;
+        write_blocked_ = false;
+    }
+
+    handle_ack_locked(header, now);
+    if (header.type == UtpPacketType::DATA || header.type == UtpPacketType::FIN) {
+        handle_data_locked(header, payload, payload_size);
+    }
+    if (state_ == State::CONNECTED || state_ == State::FIN_SENT) {
+        flush_locked();
+    }
+}
+
+void UtpSocket::end_batch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ack_pending_ && state_ != State::CLOSED && state_ != State::ERROR) {
+            send_state_locked();
+        }
+        ack_pending_ = false;
+    }
+    dispatch_events();
+}
+
+void UtpSocket::on_tick(std::chrono::steady_clock::time_point now) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool active = state_ != State::CLOSED && state_ != State::ERROR && !outgoing_.empty();
+        if (active && now - outgoing_.front().sent_at >= std::chrono::milliseconds(rto_ms_)) {
+            // Probes into a closed receive window are expected to go unanswered
+            if (peer_window_ >= UTP_MAX_PAYLOAD || state_ == State::SYN_SENT) {
+                ++timeouts_;
+            }
+            if (timeouts_ > UTP_MAX_TIMEOUTS) {
+                LOG_UTP_DEBUG("Connection to " << remote_peer_.ip << ":" << remote_peer_.port << " timed out");
+                fail_locked();
+            } else {
+                rto_ms_ = std::min(rto_ms_ * 2, UTP_MAX_RTO_MS);
+                ledbat_.on_timeout();
+                enter_recovery_locked();
+                retransmit_locked(outgoing_.front(), now);
+            }
+        }
+    }
+
+    // Also delivers events raised by read()/write() or before a handler was set
+    dispatch_events();
+}
+
+void UtpSocket::detach() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        manager_ = nullptr;
+        if (state_ != State::CLOSED && state_ != State::ERROR) {
+            fail_locked();
+        }
+    }
+    dispatch_events();
+}
+
+bool UtpSocket::release_if_finished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != State::CLOSED && state_ != State::ERROR) {
+        return false;
+    }
+    manager_ = nullptr;
+    return true;
+}
+
+void UtpSocket::handle_ack_locked(const UtpHeader& header, std::chrono::steady_clock::time_point now) {
+    peer_window_ = header.window_size;
+    if (header.timestamp_difference_us != 0) {
+        ledbat_.on_delay_sample(header.timestamp_difference_us, now);
+    }
+
+    size_t in_flight_before = bytes_in_flight_;
+    size_t bytes_acked = 0;
+    while (!outgoing_.empty() && seq_less_equal(outgoing_.front().seq_nr, header.ack_nr)) {
+        OutgoingPacket& packet = outgoing_.front();
+
+        // Only the packet that moved the ack gives a clean sample: the ones
+        // before it may have waited behind a hole, and the ack of a retransmitted
+        // packet could belong to any of its copies (Karn)
+        if (packet.seq_nr == header.ack_nr && packet.transmissions == 1) {
+            double rtt_ms = std::chrono::duration<double, std::milli>(now - packet.sent_at).count();
+            if (!has_rtt_) {
+                srtt_ms_ = rtt_ms;
+                rttvar_ms_ = rtt_ms / 2;
+                has_rtt_ = true;
+            } else {
+                rttvar_ms_ = 0.75 * rttvar_ms_ + 0.25 * std::fabs(srtt_ms_ - rtt_ms);
+                srtt_ms_ = 0.875 * srtt_ms_ + 0.125 * rtt_ms;
+            }
+            rto_ms_ = std::min(std::max(static_cast<size_t>(srtt_ms_ + 4 * rttvar_ms_), UTP_MIN_RTO_MS), UTP_MAX_RTO_MS);
+        }
+        bytes_acked += packet.payload_size;
+        bytes_in_flight_ -= packet.payload_size;
+        outgoing_.pop_front();
+    }
+
+    if (bytes_acked > 0 || (header.ack_nr != last_ack_nr_ && seq_less_equal(last_ack_nr_, header.ack_nr))) {
+        last_ack_nr_ = header.ack_nr;
+        duplicate_acks_ = 0;
+        timeouts_ = 0;
+        ledbat_.on_ack(bytes_acked, in_flight_before);
+
+        if (in_recovery_) {
+            if (seq_less_equal(recovery_seq_nr_, header.ack_nr) || outgoing_.empty()) {
+                in_recovery_ = false;
+            } else {
+                // Partial ack: the next hole was lost too, resend it without waiting for the timer
+                retransmit_locked(outgoing_.front(), now);
+            }
+        }
+    } else if (header.type == UtpPacketType::STATE && header.ack_nr == last_ack_nr_ && !outgoing_.empty()) {
+        if (++duplicate_acks_ % UTP_DUPLICATE_ACK_THRESHOLD == 0) {
+            OutgoingPacket& front = outgoing_.front();
+            if (!in_recovery_) {
+                ledbat_.on_loss();
+                enter_recovery_locked();
+                retransmit_locked(front, now);
+            } else if (has_rtt_ && std::chrono::duration<double, std::milli>(now - front.sent_at).count() > 1.5 * srtt_ms_) {
+                // Still duplicates a round trip after the resend: the resent copy was lost as well
+                retransmit_locked(front, now);
+            }
+        }
+    }
+
+    if (state_ == State::FIN_SENT && !fin_pending_ && outgoing_.empty()) {
+        state_ = State::CLOSED;
+    }
+}
+
+void UtpSocket::handle_data_locked(const UtpHeader& header, const uint8_t* payload, size_t payload_size) {
+    uint16_t seq_nr = header.seq_nr;
+    bool is_fin = header.type == UtpPacketType::FIN;
+
+    if (seq_less_equal(seq_nr, ack_nr_)) {
+        // Already have it; our ack was probably lost
+        send_state_locked();
+        return;
+    }
+
+    if (seq_nr != static_cast<uint16_t>(ack_nr_ + 1)) {
+        // Out of order: keep it for later and ack right away, the duplicate acks tell the sender about the hole
+        if (static_cast<uint16_t>(seq_nr - ack_nr_) <= UTP_REORDER_LIMIT) {
+            if (is_fin) {
+                got_fin_ = true;
+                fin_seq_nr_ = seq_nr;
+            } else if (reorder_buffer_.find(seq_nr) == reorder_buffer_.end() &&
+                       receive_buffer_.size() + reorder_bytes_ + payload_size <= UTP_RECEIVE_BUFFER_SIZE) {
+                reorder_buffer_.emplace(seq_nr, std::vector<uint8_t>(payload, payload + payload_size));
+                reorder_bytes_ += payload_size;
+            }
+        }
+        send_state_locked();
+        return;
+    }
+
+    bool discard = state_ == State::FIN_SENT || state_ == State::CLOSED;  // We closed; the data has no reader
+    if (is_fin) {
+        got_fin_ = true;
+        fin_seq_nr_ = seq_nr;
+    } else {
+        if (!discard && receive_buffer_.size() + payload_size > UTP_RECEIVE_BUFFER_SIZE) {
+            // Sender ignored the window (or probed a closed one); report it again
+            send_state_locked();
+            return;
+        }
+        if (!discard && payload_size > 0) {
+            receive_buffer_.append(payload, payload_size);
+            pending_events_ |= IO_EVENT_READ;
+        }
+        ack_nr_ = seq_nr;
+    }
+
+    // Anything buffered behind the hole that just closed
+    for (auto it = reorder_buffer_.find(static_cast<uint16_t>(ack_nr_ + 1)); it != reorder_buffer_.end();
+         it = reorder_buffer_.find(static_cast<uint16_t>(ack_nr_ + 1))) {
+        if (!discard) {
+            receive_buffer_.append(it->second.data(), it->second.size());
+            pending_events_ |= IO_EVENT_READ;
+        }
+        reorder_bytes_ -= it->second.size();
+        ack_nr_ = it->first;
+        reorder_buffer_.erase(it);
+    }
+
+    if (got_fin_ && !eof_ && fin_seq_nr_ == static_cast<uint16_t>(ack_nr_ + 1)) {
+        ack_nr_ = fin_seq_nr_;
+        eof_ = true;
+        pending_events_ |= IO_EVENT_READ;
+        reorder_buffer_.clear();
+        reorder_bytes_ = 0;
+        send_state_locked();
+        return;
+    }
+    ack_pending_ = true;
+}
+
+void UtpSocket::queue_packet_locked(UtpPacketType type, std::vector<uint8_t> packet, size_t payload_size) {
+    auto now = std::chrono::steady_clock::now();
+    UtpHeader header;
+    header.type = type;
+    header.connection_id = type == UtpPacketType::SYN ? recv_id_ : send_id_;
+    header.seq_nr = seq_nr_++;
+    header.write(packet.data());
+
+    OutgoingPacket outgoing;
+    outgoing.seq_nr = header.seq_nr;
+    outgoing.packet = std::move(packet);
+    outgoing.payload_size = payload_size;
+    outgoing.sent_at = now;
+    outgoing.transmissions = 1;
+    transmit_locked(outgoing.packet.data(), outgoing.packet.size(), now);
+
+    bytes_in_flight_ += payload_size;
+    outgoing_.push_back(std::move(outgoing));
+}
+
+void UtpSocket::send_state_locked() {
+    uint8_t packet[UTP_HEADER_SIZE];
+    UtpHeader header;
+    header.type = UtpPacketType::STATE;
+    header.connection_id = send_id_;
+    header.seq_nr = seq_nr_;   // STATE does not take a sequence number
+    header.write(packet);
+    transmit_locked(packet, sizeof(packet), std::chrono::steady_clock::now());
+    ack_pending_ = false;
+}
+
+void UtpSocket::retransmit_locked(OutgoingPacket& packet, std::chrono::steady_clock::time_point now) {
+    ++packet.transmissions;
+    ++retransmits_;
+    packet.sent_at = now;
+    transmit_locked(packet.packet.data(), packet.packet.size(), now);
+}
+
+void UtpSocket::transmit_locked(uint8_t* packet, size_t size, std::chrono::steady_clock::time_point now) {
+    // Fields that change between copies of the same packet
+    advertised_window_ = receive_window_locked();
+    write_uint32_be(packet + 4, timestamp_us(now));
+    write_uint32_be(packet + 8, reply_micro_);
+    write_uint32_be(packet + 12, static_cast<uint32_t>(advertised_window_));
+    write_uint16_be(packet + 18, ack_nr_);
+    if (manager_) {
+        manager_->send_datagram(address_, address_length_, packet, size);
+    }
+}
+
+void UtpSocket::enter_recovery_locked() {
+    in_recovery_ = true;
+    recovery_seq_nr_ = static_cast<uint16_t>(seq_nr_ - 1);
+}
+
+void UtpSocket::flush_locked() {
+    if (state_ != State::CONNECTED && state_ != State::FIN_SENT) {
+        return;
+    }
+
+    while (!send_buffer_.empty()) {
+        size_t window = std::min(ledbat_.get_window(), static_cast<size_t>(peer_window_));
+        size_t chunk = std::min(UTP_MAX_PAYLOAD, send_buffer_.size());
+
+        // With nothing in flight one packet always goes out, as a probe if the peer's window is closed
+        if (bytes_in_flight_ > 0 && bytes_in_flight_ + chunk > window) {
+            break;
+        }
+        std::vector<uint8_t> packet(UTP_HEADER_SIZE + chunk);
+        send_buffer_.peek(0, packet.data() + UTP_HEADER_SIZE, chunk);
+        send_buffer_.consume(chunk);
+        queue_packet_locked(UtpPacketType::DATA, std::move(packet), chunk);
+    }
+
+    if (fin_pending_ && send_buffer_.empty()) {
+        fin_pending_ = false;
+        queue_packet_locked(UtpPacketType::FIN, std::vector<uint8_t>(UTP_HEADER_SIZE), 0);
+    }
+
+    if (write_blocked_ && state_ == State::CONNECTED && send_buffer_.size() <= UTP_SEND_BUFFER_SIZE / 2) {
+        write_blocked_ = false;
+        pending_events_ |= IO_EVENT_WRITE;
+    }
+}
+
+void UtpSocket::fail_locked() {
+    state_ = State::ERROR;
+    outgoing_.clear();
+    bytes_in_flight_ = 0;
+    send_buffer_.clear();
+    pending_events_ |= IO_EVENT_READ | IO_EVENT_ERROR;
+}
+
+size_t UtpSocket::receive_window_locked() const {
+    size_t used = receive_buffer_.size() + reorder_bytes_;
+    return used < UTP_RECEIVE_BUFFER_SIZE ? UTP_RECEIVE_BUFFER_SIZE - used : 0;
+}
+
+void UtpSocket::dispatch_events() {
+    uint32_t events;
+    std::function<void(uint32_t)> handler;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Without a handler yet, the events wait for one
+        if (pending_events_ == 0 || !event_handler_) {
+            return;
+        }
+        events = pending_events_;
+        pending_events_ = 0;
+        handler = event_handler_;
+    }
+    handler(events);
+}
+
+//=============================================================================
+// UtpManager
+//=============================================================================
+
+UtpManager::UtpManager(std::shared_ptr<IoReactor> reactor)
+    : reactor_(std::move(reactor)), owns_reactor_(false), socket_(INVALID_SOCKET_VALUE),
+      owns_socket_(false), family_(AF_INET6), running_(false), receive_buffer_(UTP_DATAGRAM_BUFFER_SIZE) {
+    if (!reactor_) {
+        reactor_ = std::make_shared<IoReactor>("utp", 1);
+        owns_reactor_ = true;
+    }
+}
+
+UtpManager::~UtpManager() {
+    stop();
+}
+
+bool UtpManager::start(int port) {
+    if (running_) {
+        return true;
+    }
+    socket_t udp_socket = create_udp_socket(port);
+    if (!is_valid_socket(udp_socket)) {
+        LOG_UTP_ERROR("Failed to create UDP socket on port " << port);
+        return false;
+    }
+    socket_ = udp_socket;
+    owns_socket_ = true;
+
+    // Room for a full window arriving in one burst
+    int buffer_size = static_cast<int>(UTP_RECEIVE_BUFFER_SIZE);
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&buffer_size), sizeof(buffer_size));
+    setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&buffer_size), sizeof(buffer_size));
+    if (!start_locked()) {
+        close_socket(socket_);
+        socket_ = INVALID_SOCKET_VALUE;
+        return false;
+    }
+    return true;
+}
+
+bool UtpManager::start_on_socket(socket_t udp_socket) {
+    if (running_ || !is_valid_socket(udp_socket)) {
+        return running_;
+    }
+    socket_ = udp_socket;
+    owns_socket_ = false;
+    if (!start_locked()) {
+        socket_ = INVALID_SOCKET_VALUE;
+        return false;
+    }
+    return true;
+}
+
+bool UtpManager::start_locked() {
+    sockaddr_storage local;
+    socklen_t local_length = sizeof(local);
+    if (getsockname(socket_, reinterpret_cast<sockaddr*>(&local), &local_length) != 0) {
+        LOG_UTP_ERROR("Failed to query the UDP socket address");
+        return false;
+    }
+    family_ = local.ss_family;
+    set_socket_nonblocking(socket_);
+
+    if (owns_reactor_ && !reactor_->start()) {
+        LOG_UTP_ERROR("Failed to start the uTP reactor");
+        return false;
+    }
+    running_ = true;
+    if (!reactor_->add_socket(socket_, [this](socket_t, uint32_t) { on_readable(); })) {
+        LOG_UTP_ERROR("Failed to register the UDP socket with the reactor");
+        running_ = false;
+        return false;
+    }
+    timer_thread_ = std::thread(&UtpManager::timer_loop, this);
+    LOG_UTP_INFO("uTP running on port " << get_port());
+    return true;
+}
+
+void UtpManager::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    reactor_->remove_socket(socket_);
+    {
+        // A handler already dispatched may still be running
+        std::lock_guard<std::mutex> lock(receive_mutex_);
+    }
+    timer_cv_.notify_all();
+    if (timer_thread_.joinable()) {
+        timer_thread_.join();
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<UtpSocket>> connections;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections.swap(connections_);
+    }
+    for (auto& entry : connections) {
+        entry.second->detach();
+    }
+
+    if (owns_socket_) {
+        close_socket(socket_);
+    }
+    socket_ = INVALID_SOCKET_VALUE;
+    if (owns_reactor_) {
+        reactor_->stop();
+    }
+    LOG_UTP_INFO("uTP stopped");
+}
+
+int UtpManager::get_port() const {
+    return is_valid_socket(socket_) ? get_ephemeral_port(socket_) : 0;
+}
+
+std::shared_ptr<UtpSocket> UtpManager::connect(const std::string& host, int port) {
+    if (!running_) {
+        return nullptr;
+    }
+    std::string ip = host;
+    in6_addr probe;
+    if (inet_pton(AF_INET, host.c_str(), &probe) != 1 && inet_pton(AF_INET6, host.c_str(), &probe) != 1) {
+        ip = network_utils::resolve_hostname(host);
+    }
+    sockaddr_storage address;
+    socklen_t address_length;
+    if (ip.empty() || !make_udp_address(family_, ip, port, address, address_length)) {
+        LOG_UTP_WARN("Cannot reach " << host << ":" << port << " over uTP from this socket");
+        return nullptr;
+    }
+
+    std::shared_ptr<UtpSocket> connection;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        uint16_t recv_id;
+        std::string key;
+        do {
+            recv_id = random_uint16();
+            key = connection_key(address, recv_id);
+        } while (connections_.count(key) != 0);
+        connection.reset(new UtpSocket(this, Peer(ip, static_cast<uint16_t>(port)), address, address_length,
+                                       recv_id, static_cast<uint16_t>(recv_id + 1)));
+        connections_[key] = connection;
+    }
+    connection->start_connect();
+    LOG_UTP_DEBUG("Connecting to " << ip << ":" << port);
+    return connection;
+}
+
+void UtpManager::set_accept_callback(std::function<void(std::shared_ptr<UtpSocket>)> callback) {
+    std::lock_guard<std::mutex> lock(callbacks_mutex_);
+    accept_callback_ = std::move(callback);
+}
+
+void UtpManager::set_datagram_callback(std::function<void(const uint8_t*, size_t, const Peer&)> callback) {
+    std::lock_guard<std::mutex> lock(callbacks_mutex_);
+    datagram_callback_ = std::move(callback);
+}
+
+size_t UtpManager::get_connection_count() const {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    return connections_.size();
+}
+
+void UtpManager::on_readable() {
+    std::lock_guard<std::mutex> lock(receive_mutex_);
+    if (!running_) {
+        return;
+    }
+
+    // Acks for in-order data and event delivery wait until the socket is drained
+    std::vector<std::shared_ptr<UtpSocket>> touched;
+    while (true) {
+        sockaddr_storage address;
+        socklen_t address_length;
+        int received = receive_udp_nonblocking(socket_, receive_buffer_.data(), receive_buffer_.size(),
+                                               address, address_length);
+        if (received <= 0) {
+            break;
+        }
+
+        UtpHeader header;
+        size_t payload_offset = UtpHeader::parse(receive_buffer_.data(), static_cast<size_t>(received), header);
+        if (payload_offset == 0) {
+            std::function<void(const uint8_t*, size_t, const Peer&)> callback;
+            {
+                std::lock_guard<std::mutex> callbacks_lock(callbacks_mutex_);
+                callback = datagram_callback_;
+            }
+            if (callback) {
+                callback(receive_buffer_.data(), static_cast<size_t>(received), udp_address_to_peer(address));
+            }
+            continue;
+        }
+
+        std::shared_ptr<UtpSocket> connection = find_connection(header, address);
+
+        if (!connection) {
+            if (header.type == UtpPacketType::SYN) {
+                handle_syn(header, address, address_length);
+            } else if (header.type != UtpPacketType::STATE && header.type != UtpPacketType::RESET) {
+                // Data for a connection we do not know; tell the sender to give up
+                UtpHeader reset;
+                reset.type = UtpPacketType::RESET;
+                reset.connection_id = header.connection_id;
+                reset.ack_nr = header.seq_nr;
+                uint8_t packet[UTP_HEADER_SIZE];
+                reset.write(packet);
+                send_datagram(address, address_length, packet, sizeof(packet));
+            }
+            continue;
+        }
+
+        connection->on_packet(header, receive_buffer_.data() + payload_offset,
+                              static_cast<size_t>(received) - payload_offset);
+        if (std::find(touched.begin(), touched.end(), connection) == touched.end()) {
+            touched.push_back(connection);
+        }
+    }
+
+    for (auto& connection : touched) {
+        connection->end_batch();
+    }
+}
+
+std::shared_ptr<UtpSocket> UtpManager::find_connection(const UtpHeader& header, const sockaddr_storage& address) {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (header.type == UtpPacketType::SYN) {
+        auto it = connections_.find(connection_key(address, static_cast<uint16_t>(header.connection_id + 1)));
+        return it != connections_.end() ? it->second : nullptr;
+    }
+    if (header.type != UtpPacketType::RESET) {
+        auto it = connections_.find(connection_key(address, header.connection_id));
+        return it != connections_.end() ? it->second : nullptr;
+    }
+
+    // A RESET answers a packet the peer did not know, so it carries our send id;
+    // that is one off our receive id, in either direction depending on who connected
+    for (int offset : {-1, 1}) {
+        auto it = connections_.find(connection_key(address, static_cast<uint16_t>(header.connection_id + offset)));
+        if (it != connections_.end() && it->second->send_id_ == header.connection_id) {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+void UtpManager::handle_syn(const UtpHeader& header, const sockaddr_storage& address, socklen_t address_length) {
+    std::function<void(std::shared_ptr<UtpSocket>)> callback;
+    {
+        std::lock_guard<std::mutex> lock(callbacks_mutex_);
+        callback = accept_callback_;
+    }
+    if (!callback) {
+        return;
+    }
+
+    uint16_t recv_id = static_cast<uint16_t>(header.connection_id + 1);
+    std::shared_ptr<UtpSocket> connection(new UtpSocket(this, udp_address_to_peer(address), address, address_length,
+                                                        recv_id, header.connection_id));
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections_[connection_key(address, recv_id)] = connection;
+    }
+    connection->accept_syn(header);
+    LOG_UTP_DEBUG("Accepted uTP connection from " << connection->get_remote_peer().ip << ":"
+                  << connection->get_remote_peer().port);
+    callback(connection);
+}
+
+void UtpManager::timer_loop() {
+    while (running_) {
+        {
+            std::unique_lock<std::mutex> lock(timer_mutex_);
+            timer_cv_.wait_for(lock, std::chrono::milliseconds(UTP_TICK_MS), [this] { return !running_; });
+        }
+        if (!running_) {
+            break;
+        }
+
+        std::vector<std::shared_ptr<UtpSocket>> connections;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            connections.reserve(connections_.size());
+            for (auto& entry : connections_) {
+                connections.push_back(entry.second);
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (auto& connection : connections) {
+            connection->on_tick(now);
+        }
+
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            if (it->second->release_if_finished()) {
+                it = connections_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+bool UtpManager::send_datagram(const sockaddr_storage& address, socklen_t address_length, const uint8_t* data, size_t size) {
+    // A full socket buffer drops the datagram, which the retransmit timer recovers like any other loss
+    return send_udp_nonblocking(socket_, address, address_length, data, size) > 0;
+}
+
+//=============================================================================
+// UtpSocketBridge
+//=============================================================================
+
+namespace {
+constexpr size_t BRIDGE_CHUNK_SIZE = 64 * 1024;
+}
+
+std::shared_ptr<UtpSocketBridge> UtpSocketBridge::create(std::shared_ptr<UtpSocket> connection, IoReactor& reactor) {
+    socket_t sockets[2];
+    if (!connection || !create_socket_pair(sockets)) {
+        return nullptr;
+    }
+    if (!set_socket_nonblocking(sockets[0]) || !set_socket_nonblocking(sockets[1])) {
+        close_socket(sockets[0]);
+        close_socket(sockets[1]);
+        return nullptr;
+    }
+
+    std::shared_ptr<UtpSocketBridge> bridge(new UtpSocketBridge(std::move(connection), reactor));
+    bridge->socket_ = sockets[0];
+    bridge->local_ = sockets[1];
+
+    // The handlers hold the bridge, so it lives until close_locked() drops them
+    {
+        std::lock_guard<std::mutex> lock(bridge->mutex_);
+        if (!bridge->watch_local_locked()) {
+            LOG_UTP_ERROR("Failed to register bridge socket with reactor");
+            bridge->close_locked();
+            close_socket(bridge->socket_);
+            return nullptr;
+        }
+    }
+    bridge->connection_->set_event_handler([bridge](uint32_t events) {
+        bridge->on_utp_event(events);
+    });
+
+    // Data that arrived before the handler was set raised its event already
+    bridge->on_utp_event(IO_EVENT_READ | IO_EVENT_WRITE);
+    return bridge;
+}
+
+UtpSocketBridge::UtpSocketBridge(std::shared_ptr<UtpSocket> connection, IoReactor& reactor)
+    : connection_(std::move(connection)), reactor_(reactor), socket_(INVALID_SOCKET_VALUE),
+      local_(INVALID_SOCKET_VALUE), to_utp_offset_(0), to_local_offset_(0), watching_(false),
+      local_events_(IO_EVENT_READ), utp_finished_(false), closed_(false) {}
+
+UtpSocketBridge::~UtpSocketBridge() {
+    close();
+}
+
+void UtpSocketBridge::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_locked();
+}
+
+bool UtpSocketBridge::is_closed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+void UtpSocketBridge::on_local_event(uint32_t events) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    if (events & IO_EVENT_WRITE) {
+        pump_to_local_locked();
+    }
+    if (!closed_ && (events & IO_EVENT_READ)) {
+        if (to_utp_offset_ < to_utp_.size()) {
+            // A hang-up is reported whatever the interest set; stop watching until uTP takes
+            // the buffered bytes, then read the rest from the uTP side
+            reactor_.remove_socket(local_);
+            watching_ = false;
+            return;
+        }
+        pump_to_utp_locked();
+    }
+    update_local_events_locked();
+}
+
+void UtpSocketBridge::on_utp_event(uint32_t events) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    if (events & IO_EVENT_ERROR) {
+        utp_finished_ = true;
+    }
+    pump_to_utp_locked();
+    if (!closed_ && !watching_ && to_utp_offset_ == to_utp_.size() && !watch_local_locked()) {
+        close_locked();
+        return;
+    }
+    pump_to_local_locked();
+    update_local_events_locked();
+}
+
+bool UtpSocketBridge::watch_local_locked() {
+    auto self = shared_from_this();
+    watching_ = reactor_.add_socket(local_, [self](socket_t, uint32_t events) {
+        self->on_local_event(events);
+    });
+    local_events_ = IO_EVENT_READ;
+    return watching_;
+}
+
+void UtpSocketBridge::pump_to_utp_locked() {
+    while (!closed_) {
+        if (to_utp_offset_ == to_utp_.size()) {
+            to_utp_.resize(BRIDGE_CHUNK_SIZE);
+            to_utp_offset_ = 0;
+            int received = receive_tcp_nonblocking(local_, to_utp_.data(), to_utp_.size());
+            if (received <= 0) {
+                to_utp_.clear();
+                if (received < 0) {
+                    close_locked(); // The owner closed its end
+                }
+                return;
+            }
+            to_utp_.resize(static_cast<size_t>(received));
+        }
+
+        int written = connection_->write(to_utp_.data() + to_utp_offset_, to_utp_.size() - to_utp_offset_);
+        if (written < 0) {
+            close_locked();
+            return;
+        }
+        to_utp_offset_ += static_cast<size_t>(written);
+        if (to_utp_offset_ < to_utp_.size()) {
+            return; // Send buffer full, resumed on IO_EVENT_WRITE
+        }
+    }
+}
+
+void UtpSocketBridge::pump_to_local_locked() {
+    while (!closed_) {
+        if (to_local_offset_ == to_local_.size()) {
+            if (utp_finished_) {
+                close_locked(); // Everything received is handed over; the owner sees EOF
+                return;
+            }
+            to_local_.resize(BRIDGE_CHUNK_SIZE);
+            to_local_offset_ = 0;
+            int received = connection_->read(to_local_.data(), to_local_.size());
+            if (received <= 0) {
+                to_local_.clear();
+                if (received < 0) {
+                    utp_finished_ = true;
+                    continue;
+                }
+                return;
+            }
+            to_local_.resize(static_cast<size_t>(received));
+        }
+
+        int sent = send_tcp_nonblocking(local_, to_local_.data() + to_local_offset_, to_local_.size() - to_local_offset_);
+        if (sent < 0) {
+            close_locked();
+            return;
+        }
+        to_local_offset_ += static_cast<size_t>(sent);
+        if (to_local_offset_ < to_local_.size()) {
+            return; // Owner is not reading, resumed on IO_EVENT_WRITE of local_
+        }
+    }
+}
+
+void UtpSocketBridge::update_local_events_locked() {
+    if (closed_ || !watching_) {
+        return;
+    }
+    uint32_t events = 0;
+    if (to_utp_offset_ == to_utp_.size()) {
+        events |= IO_EVENT_READ;
+    }
+    if (to_local_offset_ < to_local_.size()) {
+        events |= IO_EVENT_WRITE;
+    }
+    if (events != local_events_ && reactor_.set_socket_events(local_, events)) {
+        local_events_ = events;
+    }
+}
+
+void UtpSocketBridge::close_locked() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    if (watching_) {
+        reactor_.remove_socket(local_);
+        watching_ = false;
+    }
+    close_socket(local_);
+    local_ = INVALID_SOCKET_VALUE;
+    to_utp_.clear();
+    to_local_.clear();
+    to_utp_offset_ = to_local_offset_ = 0;
+
+    connection_->set_event_handler(nullptr);
+    connection_->close();
+}
+
+} // namespace librats
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "socket.h"
+#include "reactor.h"
+#include "ring_buffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace librats {
+
+// uTP (BEP 29): reliable, ordered byte streams over UDP. Congestion control is
+// LEDBAT, which keeps the one-way queuing delay near a target and backs off as
+// soon as other traffic builds a queue, so bulk transfers run at background
+// priority. Because it is plain UDP, a manager can also run on a socket that
+// was already hole punched for a peer behind NAT.
+
+constexpr size_t UTP_HEADER_SIZE = 20;
+constexpr size_t UTP_MAX_PAYLOAD = 1200;                 // Fits the minimum IPv6 MTU with room for tunnels
+constexpr uint32_t UTP_TARGET_DELAY_US = 100000;         // LEDBAT queuing delay target
+constexpr size_t UTP_RECEIVE_BUFFER_SIZE = 1024 * 1024;  // Advertised receive window
+constexpr size_t UTP_SEND_BUFFER_SIZE = 1024 * 1024;     // Bytes write() accepts before it would block
+constexpr size_t UTP_MIN_RTO_MS = 500;
+constexpr size_t UTP_MAX_RTO_MS = 30000;
+constexpr int UTP_MAX_TIMEOUTS = 5;                      // Consecutive retransmit timeouts before the connection fails
+constexpr size_t UTP_TICK_MS = 50;                       // Retransmit timer resolution
+
+enum class UtpPacketType : uint8_t {
+    DATA = 0,
+    FIN = 1,
+    STATE = 2,
+    RESET = 3,
+    SYN = 4
+};
+
+// 20 byte packet header, all fields big endian on the wire
+struct UtpHeader {
+    UtpPacketType type = UtpPacketType::DATA;
+    uint8_t extension = 0;
+    uint16_t connection_id = 0;
+    uint32_t timestamp_us = 0;
+    uint32_t timestamp_difference_us = 0;
+    uint32_t window_size = 0;
+    uint16_t seq_nr = 0;
+    uint16_t ack_nr = 0;
+
+    void write(uint8_t* out) const;
+
+    // Parses a packet, skipping extension headers; returns the payload offset, 0 if it is not uTP
+    static size_t parse(const uint8_t* data, size_t size, UtpHeader& header);
+};
+
+// LEDBAT congestion window (RFC 6817). The delay samples are the one-way
+// delays the peer measured for our packets; the lowest one seen over the last
+// couple of minutes is taken as the propagation delay, anything above it as
+// queuing. The window grows while the queuing delay is below the target and
+// shrinks proportionally once it is above.
+//
+// Not thread safe; each UtpSocket guards its own.
+class LedbatController {
+public:
+    LedbatController();
+
+    static constexpr size_t MIN_WINDOW = 2 * UTP_MAX_PAYLOAD;
+    static constexpr size_t MAX_WINDOW = UTP_RECEIVE_BUFFER_SIZE;
+    static constexpr double MAX_INCREASE_PER_RTT = 3000.0;   // Bytes the window grows per round trip at zero queuing delay
+
+    void on_delay_sample(uint32_t delay_us, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    // bytes_in_flight is measured before the ack, so an application-limited sender does not inflate the window
+    void on_ack(size_t bytes_acked, size_t bytes_in_flight);
+    void on_loss();      // Fast retransmit: halve the window
+    void on_timeout();   // Retransmit timeout: back to the minimum
+
+    size_t get_window() const { return static_cast<size_t>(window_); }
+    uint32_t get_base_delay_us() const;
+    uint32_t get_queuing_delay_us() const;
+
+private:
+    double window_;
+    uint32_t current_delay_us_;
+    bool has_delay_;
+
+    // Minimum delay per minute, the newest last
+    std::deque<uint32_t> base_delay_history_;
+    std::chrono::steady_clock::time_point history_rotated_at_;
+};
+
+class UtpManager;
+
+// One uTP connection, created by UtpManager::connect() or handed to the accept
+// callback. The interface follows a non-blocking socket driven by a reactor:
+// read() and write() return the bytes transferred, 0 when they would block and
+// -1 once the connection is closed or failed, and the event handler reports
+// IO_EVENT_READ when data arrived, IO_EVENT_WRITE when a connect completed or
+// send buffer space was freed after a short write, and IO_EVENT_ERROR on
+// failure. Handlers run on the manager threads with no uTP locks held, and
+// must not stop the manager.
+//
+// The manager keeps the connection alive until close() finishes it or it fails.
+class UtpSocket : public std::enable_shared_from_this<UtpSocket> {
+public:
+    enum class State {
+        SYN_SENT,
+        CONNECTED,
+        FIN_SENT,     // close() called; data and FIN still being delivered
+        CLOSED,
+        ERROR
+    };
+
+    ~UtpSocket();
+
+    int read(uint8_t* buffer, size_t size);
+    int write(const uint8_t* data, size_t size);
+
+    // Graceful close: buffered data is still delivered, then a FIN. Further reads return -1.
+    void close();
+
+    void set_event_handler(std::function<void(uint32_t events)> handler);
+
+    State get_state() const;
+    bool is_connected() const { return get_state() == State::CONNECTED; }
+    const Peer& get_remote_peer() const { return remote_peer_; }
+
+    // Statistics
+    size_t get_congestion_window() const;
+    size_t get_bytes_in_flight() const;
+    uint32_t get_rtt_ms() const;
+    uint64_t get_retransmits() const;
+
+private:
+    friend class UtpManager;
+
+    struct OutgoingPacket {
+        uint16_t seq_nr;
+        std::vector<uint8_t> packet;      // Header and payload; the header is rewritten on resend
+        size_t payload_size;
+        std::chrono::steady_clock::time_point sent_at;
+        int transmissions;
+    };
+
+    UtpSocket(UtpManager* manager, const Peer& remote_peer, const sockaddr_storage& address, socklen_t address_length,
+              uint16_t recv_id, uint16_t send_id);
+
+    UtpManager* manager_;                 // Cleared when the manager stops
+    Peer remote_peer_;
+    sockaddr_storage address_;
+    socklen_t address_length_;
+    uint16_t recv_id_;
+    uint16_t send_id_;
+
+    mutable std::mutex mutex_;
+    State state_;
+    std::function<void(uint32_t)> event_handler_;
+    uint32_t pending_events_;             // Collected under the lock, delivered after it is released
+
+    // Sending
+    uint16_t seq_nr_;                     // Next sequence number
+    RingBuffer send_buffer_;              // Written but not yet packetized
+    std::deque<OutgoingPacket> outgoing_; // Sent and not yet acked, in sequence order
+    size_t bytes_in_flight_;
+    uint32_t peer_window_;
+    uint16_t last_ack_nr_;
+    int duplicate_acks_;
+    bool write_blocked_;                  // A short write() is waiting for IO_EVENT_WRITE
+    bool fin_pending_;
+    LedbatController ledbat_;
+    uint32_t reply_micro_;                // Delay of the last packet received, echoed to the peer
+
+    // Retransmission
+    double srtt_ms_;
+    double rttvar_ms_;
+    bool has_rtt_;
+    size_t rto_ms_;
+    int timeouts_;
+    uint64_t retransmits_;
+    bool in_recovery_;                    // Resending holes until everything sent before the loss is acked
+    uint16_t recovery_seq_nr_;
+
+    // Receiving
+    uint16_t ack_nr_;                     // Last sequence number received in order
+    RingBuffer receive_buffer_;
+    std::map<uint16_t, std::vector<uint8_t>> reorder_buffer_;
+    size_t reorder_bytes_;
+    bool got_fin_;
+    uint16_t fin_seq_nr_;
+    bool eof_;
+    bool ack_pending_;                    // In-order data acked once per batch of datagrams
+    size_t advertised_window_;
+
+    // Manager side, called without the socket lock
+    void start_connect();
+    void accept_syn(const UtpHeader& syn);
+    void on_packet(const UtpHeader& header, const uint8_t* payload, size_t payload_size);
+    void end_batch();                     // Sends the delayed ack and delivers events after a run of datagrams
+    void on_tick(std::chrono::steady_clock::time_point now);
+    void detach();                        // Manager stopping
+    bool release_if_finished();           // Closed or failed: forget the manager so it can drop us
+
+    // Locked helpers
+    void handle_ack_locked(const UtpHeader& header, std::chrono::steady_clock::time_point now);
+    void handle_data_locked(const UtpHeader& header, const uint8_t* payload, size_t payload_size);
+    void queue_packet_locked(UtpPacketType type, std::vector<uint8_t> packet, size_t payload_size);
+    void send_state_locked();
+    void retransmit_locked(OutgoingPacket& packet, std::chrono::steady_clock::time_point now);
+    void transmit_locked(uint8_t* packet, size_t size, std::chrono::steady_clock::time_point now);
+    void enter_recovery_locked();
+    void flush_locked();
+    void fail_locked();
+    size_t receive_window_locked() const;
+    void dispatch_events();
+};
+
+// Runs uTP over one UDP socket: demultiplexes datagrams to connections by
+// address and connection id, accepts incoming SYNs and drives the retransmit
+// timers. The socket is registered on the reactor (a private one unless one
+// is shared); datagrams that are not uTP, e.g. STUN on a hole-punched socket,
+// go to the datagram callback.
+class UtpManager {
+public:
+    explicit UtpManager(std::shared_ptr<IoReactor> reactor = nullptr);
+    ~UtpManager();
+
+    UtpManager(const UtpManager&) = delete;
+    UtpManager& operator=(const UtpManager&) = delete;
+
+    /**
+     * Bind a dual-stack UDP socket and start
+     * @param port Local port, 0 for an ephemeral one
+     * @return true on success
+     */
+    bool start(int port = 0);
+
+    /**
+     * Start on an existing bound UDP socket, e.g. one already hole punched
+     * @param udp_socket Socket to run on; it is not closed by stop()
+     * @return true on success
+     */
+    bool start_on_socket(socket_t udp_socket);
+
+    void stop();
+    bool is_running() const { return running_.load(); }
+    int get_port() const;
+
+    /**
+     * Open a connection; it completes asynchronously (IO_EVENT_WRITE, or IO_EVENT_ERROR on failure)
+     * @param host Remote address
+     * @param port Remote port
+     * @return The connection, nullptr if not running or the address is invalid
+     */
+    std::shared_ptr<UtpSocket> connect(const std::string& host, int port);
+
+    void set_accept_callback(std::function<void(std::shared_ptr<UtpSocket>)> callback);
+    void set_datagram_callback(std::function<void(const uint8_t* data, size_t size, const Peer& sender)> callback);
+
+    size_t get_connection_count() const;
+
+private:
+    friend class UtpSocket;
+
+    std::shared_ptr<IoReactor> reactor_;
+    bool owns_reactor_;
+    socket_t socket_;
+    bool owns_socket_;
+    int family_;
+    std::atomic<bool> running_;
+
+    // Keyed by the packed remote address and our receive connection id
+    std::unordered_map<std::string, std::shared_ptr<UtpSocket>> connections_;
+    mutable std::mutex connections_mutex_;
+
+    std::function<void(std::shared_ptr<UtpSocket>)> accept_callback_;
+    std::function<void(const uint8_t*, size_t, const Peer&)> datagram_callback_;
+    std::mutex callbacks_mutex_;
+
+    std::mutex receive_mutex_;            // Held by the reactor handler, so stop() can wait it out
+    std::vector<uint8_t> receive_buffer_;
+
+    std::thread timer_thread_;
+    std::mutex timer_mutex_;
+    std::condition_variable timer_cv_;
+
+    bool start_locked();
+    void on_readable();
+    std::shared_ptr<UtpSocket> find_connection(const UtpHeader& header, const sockaddr_storage& address);
+    void handle_syn(const UtpHeader& header, const sockaddr_storage& address, socklen_t address_length);
+    void timer_loop();
+    bool send_datagram(const sockaddr_storage& address, socklen_t address_length, const uint8_t* data, size_t size);
+};
+
+// Joins a uTP connection to one end of a local socket pair, so code written
+// against stream sockets (framing, Noise, send queues, the reactor) runs over
+// uTP unchanged. The caller owns the other end and closes it like any TCP
+// socket; that closes the uTP connection once the bytes already handed over
+// are delivered. A uTP connection that finishes or fails shows up as EOF on
+// the caller's end. One buffer per direction is pumped on the reactor and uTP
+// threads, so a slow reader pushes back on the writer instead of queueing.
+// The bridge keeps itself alive until it closes.
+class UtpSocketBridge : public std::enable_shared_from_this<UtpSocketBridge> {
+public:
+    /**
+     * Bridge an open uTP connection
+     * @param connection Connected (or accepted) uTP connection
+     * @param reactor Reactor that watches the bridge's end of the pair; must outlive the bridge
+     * @return The bridge, nullptr if no socket pair could be created
+     */
+    static std::shared_ptr<UtpSocketBridge> create(std::shared_ptr<UtpSocket> connection, IoReactor& reactor);
+
+    ~UtpSocketBridge();
+
+    UtpSocketBridge(const UtpSocketBridge&) = delete;
+    UtpSocketBridge& operator=(const UtpSocketBridge&) = delete;
+
+    // The caller's end (non-blocking); the caller closes it
+    socket_t get_socket() const { return socket_; }
+    const std::shared_ptr<UtpSocket>& get_connection() const { return connection_; }
+
+    // Stop pumping now and close the uTP connection; does not close get_socket()
+    void close();
+    bool is_closed();
+
+private:
+    UtpSocketBridge(std::shared_ptr<UtpSocket> connection, IoReactor& reactor);
+
+    void on_local_event(uint32_t events);
+    void on_utp_event(uint32_t events);
+    bool watch_local_locked();
+    void pump_to_utp_locked();
+    void pump_to_local_locked();
+    void update_local_events_locked();
+    void close_locked();
+
+    std::shared_ptr<UtpSocket> connection_;
+    IoReactor& reactor_;
+    socket_t socket_;                     // Caller's end
+    socket_t local_;                      // Our end, watched by the reactor
+    std::vector<uint8_t> to_utp_;         // Read from local_, not yet accepted by uTP
+    size_t to_utp_offset_;
+    std::vector<uint8_t> to_local_;       // Read from uTP, not yet accepted by local_
+    size_t to_local_offset_;
+    bool watching_;                       // local_ registered with the reactor
+    uint32_t local_events_;               // Current interest set of local_
+    bool utp_finished_;                   // uTP has no more data; close once to_local_ is flushed
+    bool closed_;
+    std::mutex mutex_;
+};
+
+} // namespace librats
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "../src/rats_async.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#ifdef RATS_HAS_COROUTINES
+
+using namespace librats;
+
+namespace {
+
+async::Task<int> add_after(RatsClient& client, int value, std::chrono::milliseconds delay) {
+    co_await async::sleep_for(client, delay);
+    co_return value + 1;
+}
+
+async::Task<void> throw_after_offload(RatsClient& client) {
+    co_await async::offload(client, []() {});
+    throw std::runtime_error("failed in coroutine");
+}
+
+// Spawned coroutines take their state as parameters: a lambda's captures die with the lambda
+async::Task<void> request_sum(RatsClient& client, std::string peer_id, int value, std::atomic<int>& correct,
+                              std::atomic<int>& finished) {
+    nlohmann::json params = {{"a", value}, {"b", 1}};
+    nlohmann::json result = co_await async::request(client, peer_id, "add", params);
+    if (result.value("sum", -1) == value + 1) {
+        ++correct;
+    }
+    ++finished;
+}
+
+} // namespace
+
+// Test that tasks compose, suspend on the timer wheel and resume on pool workers
+TEST(AsyncTest, TasksSleepAndOffload) {
+    RatsClient client(59042, 5);
+    ASSERT_TRUE(client.start());
+
+    auto main_thread = std::this_thread::get_id();
+    auto start = std::chrono::steady_clock::now();
+    std::thread::id resumed_on;
+    int result = async::sync_wait([&]() -> async::Task<int> {
+        int value = co_await async::offload(client, []() { return 40; });
+        value = co_await add_after(client, value, std::chrono::milliseconds(200));
+        resumed_on = std::this_thread::get_id();
+        co_return value + 1;
+    }());
+    EXPECT_EQ(result, 42);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(200));
+    EXPECT_NE(resumed_on, main_thread);
+
+    EXPECT_THROW(async::sync_wait(throw_after_offload(client)), std::runtime_error);
+
+    // Without DHT the lookup cannot start and resumes right away with nothing
+    auto peers = async::sync_wait([&]() -> async::Task<std::vector<std::string>> {
+        co_return co_await async::find_peers(client, std::string(40, 'a'), std::chrono::seconds(5));
+    }());
+    EXPECT_TRUE(peers.empty());
+
+    client.stop();
+}
+
+// Test a connect-then-request workflow and many concurrent requests in flight
+TEST(AsyncTest, ConnectAndRequest) {
+    RatsClient server(59043, 5);
+    RatsClient client(59044, 5);
+    ASSERT_TRUE(server.start());
+    ASSERT_TRUE(client.start());
+    server.on_request("add", [](const std::string&, const nlohmann::json& params) {
+        return nlohmann::json{{"sum", params.value("a", 0) + params.value("b", 0)}};
+    });
+
+    std::string peer_id = async::sync_wait([&]() -> async::Task<std::string> {
+        bool connected = co_await async::connect_to_peer(client, "127.0.0.1", 59043);
+        if (!connected) {
+            co_return std::string();
+        }
+        for (int i = 0; i < 50 && client.get_validated_peers().empty(); ++i) {
+            co_await async::sleep_for(client, std::chrono::milliseconds(100));
+        }
+        auto peers = client.get_validated_peers();
+        co_return peers.empty() ? std::string() : peers[0].peer_id;
+    }());
+    ASSERT_FALSE(peer_id.empty());
+
+    nlohmann::json reply = async::sync_wait([&]() -> async::Task<nlohmann::json> {
+        nlohmann::json params = {{"a", 2}, {"b", 3}};
+        co_return co_await async::request(client, peer_id, "add", params);
+    }());
+    EXPECT_EQ(reply.value("sum", -1), 5);
+
+    EXPECT_THROW(async::sync_wait([&]() -> async::Task<nlohmann::json> {
+        co_return co_await async::request(client, peer_id, "missing", nlohmann::json::object());
+    }()), std::runtime_error);
+
+    // Suspended coroutines hold no threads, so far more of them than workers can wait at once
+    const int count = 200;
+    std::atomic<int> correct{0};
+    std::atomic<int> finished{0};
+    for (int i = 0; i < count; ++i) {
+        async::spawn(request_sum(client, peer_id, i, correct, finished));
+    }
+    for (int i = 0; i < 500 && finished.load() < count; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(finished.load(), count);
+    EXPECT_EQ(correct.load(), count);
+
+    client.stop();
+    server.stop();
+}
+
+#endif // RATS_HAS_COROUTINES
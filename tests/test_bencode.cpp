@@ -628,4 +628,123 @@ TEST_F(BencodeTest, LeadingZerosTest) {
     BencodeValue decoded_zero = bencode::decode("i00e");
     EXPECT_TRUE(decoded_zero.is_integer());
     EXPECT_EQ(decoded_zero.as_integer(), 0);
-} 
\ No newline at end of file
+} 
+// Test in-place parsing into a BencodeDocument
+TEST_F(BencodeTest, DocumentParseTest) {
+    std::string data = "d4:infod6:lengthi42e4:name4:file5:piece3:xyze4:listli-7e3:abcee";
+    BencodeDocument document;
+    ASSERT_TRUE(document.parse(data));
+
+    BencodeView root = document.root();
+    ASSERT_TRUE(root.is_dict());
+    EXPECT_EQ(root.size(), 2u);
+    EXPECT_TRUE(root.has_key("info"));
+    EXPECT_FALSE(root.has_key("missing"));
+    EXPECT_FALSE(root.find("missing").is_valid());
+    EXPECT_THROW(root["missing"], std::runtime_error);
+
+    BencodeView info = root["info"];
+    EXPECT_EQ(info["length"].as_integer(), 42);
+    EXPECT_EQ(info["name"].as_string(), "file");
+    EXPECT_EQ(info.raw(), "d6:lengthi42e4:name4:file5:piece3:xyze");
+
+    // Strings point into the parsed buffer
+    EXPECT_EQ(info["name"].as_string().data(), data.data() + data.find("file"));
+
+    BencodeView list = root["list"];
+    ASSERT_TRUE(list.is_list());
+    ASSERT_EQ(list.size(), 2u);
+    EXPECT_EQ(list[0].as_integer(), -7);
+    EXPECT_EQ(list[1].as_string(), "abc");
+    EXPECT_THROW(list[2], std::runtime_error);
+    EXPECT_THROW(list[0].as_string(), std::runtime_error);
+
+    // Deep copy matches the owning decoder
+    EXPECT_EQ(root.to_value().encode_string(), bencode::decode(data).encode_string());
+}
+
+// Test that non-canonical key order is still found
+TEST_F(BencodeTest, DocumentUnsortedDictTest) {
+    std::string data = "d1:ci3e1:ai1e1:bi2ee";
+    BencodeDocument document;
+    ASSERT_TRUE(document.parse(data));
+    BencodeView root = document.root();
+    EXPECT_EQ(root["a"].as_integer(), 1);
+    EXPECT_EQ(root["b"].as_integer(), 2);
+    EXPECT_EQ(root["c"].as_integer(), 3);
+    EXPECT_EQ(root.key_at(0), "a");
+    EXPECT_EQ(root.value_at(2).as_integer(), 3);
+}
+
+// Test malformed input and reuse of one document
+TEST_F(BencodeTest, DocumentErrorsTest) {
+    BencodeDocument document;
+    for (const char* malformed : {"", "i-e", "ie", "5:abc", "li1ei", "d3:keye", "di1ei2ee", "x",
+                                  "i99999999999999999999e"}) {
+        EXPECT_FALSE(document.parse(std::string(malformed))) << malformed;
+        EXPECT_FALSE(document.root().is_valid());
+    }
+
+    std::string deep(BencodeDocument::MAX_DEPTH + 2, 'l');
+    deep += std::string(BencodeDocument::MAX_DEPTH + 2, 'e');
+    EXPECT_FALSE(document.parse(deep));
+
+    // Trailing data is left for the caller
+    size_t consumed = 0;
+    std::string data = "i5eextra";
+    ASSERT_TRUE(document.parse(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &consumed));
+    EXPECT_EQ(consumed, 3u);
+    EXPECT_EQ(document.root().as_integer(), 5);
+}
+
+// Test streaming events
+TEST_F(BencodeTest, ParseEventsTest) {
+    struct Recorder : BencodeHandler {
+        std::string events;
+        bool on_integer(int64_t value) override { events += "i" + std::to_string(value) + " "; return true; }
+        bool on_string(std::string_view value) override { events += "s" + std::string(value) + " "; return true; }
+        bool on_list_begin() override { events += "[ "; return true; }
+        bool on_list_end() override { events += "] "; return true; }
+        bool on_dict_begin() override { events += "{ "; return true; }
+        bool on_dict_key(std::string_view key) override { events += "k" + std::string(key) + " "; return true; }
+        bool on_dict_end() override { events += "} "; return true; }
+    };
+
+    std::string data = "d1:ali1e2:bce1:bi-2ee";
+    Recorder recorder;
+    size_t consumed = 0;
+    ASSERT_TRUE(bencode::parse_events(reinterpret_cast<const uint8_t*>(data.data()), data.size(), recorder, &consumed));
+    EXPECT_EQ(recorder.events, "{ ka [ i1 sbc ] kb i-2 } ");
+    EXPECT_EQ(consumed, data.size());
+
+    // A handler can stop early
+    struct Stopper : BencodeHandler {
+        bool on_string(std::string_view) override { return false; }
+    } stopper;
+    EXPECT_FALSE(bencode::parse_events(reinterpret_cast<const uint8_t*>(data.data()), data.size(), stopper));
+}
+
+// Test writing bencode directly into a buffer
+TEST_F(BencodeTest, WriterTest) {
+    std::vector<uint8_t> buffer;
+    BencodeWriter writer(buffer);
+    writer.begin_dict();
+    writer.write_string("a");
+    writer.begin_list();
+    writer.write_integer(0);
+    writer.write_integer(-42);
+    writer.write_integer(std::numeric_limits<int64_t>::min());
+    writer.end();
+    writer.write_string("b");
+    uint8_t* bytes = writer.write_string_header(3);
+    bytes[0] = 'x';
+    bytes[1] = 0;
+    bytes[2] = 'y';
+    writer.end();
+
+    std::string expected = "d1:ali0ei-42ei-9223372036854775808ee1:b3:x";
+    expected += '\0';
+    expected += "ye";
+    EXPECT_EQ(std::string(buffer.begin(), buffer.end()), expected);
+    EXPECT_EQ(bencode::decode(buffer).encode(), buffer);
+}
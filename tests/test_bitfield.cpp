@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include "bitfield.h"
+#include <vector>
+
+using namespace librats;
+
+// Test single bit access, counting and the zeroed tail
+TEST(BitfieldTest, SetClearAndCount) {
+    Bitfield bits(130);
+    EXPECT_EQ(bits.size(), 130u);
+    EXPECT_TRUE(bits.none());
+    EXPECT_FALSE(bits.all());
+
+    bits.set(0);
+    bits.set(63);
+    bits.set(64);
+    bits.set(129);
+    EXPECT_TRUE(bits[0] && bits[63] && bits[64] && bits[129]);
+    EXPECT_FALSE(bits[1]);
+    EXPECT_FALSE(bits.get(130));  // Out of range reads as clear
+    EXPECT_EQ(bits.count(), 4u);
+
+    bits.clear(63);
+    EXPECT_FALSE(bits[63]);
+    EXPECT_EQ(bits.count(), 3u);
+
+    bits.set_all();
+    EXPECT_TRUE(bits.all());
+    EXPECT_EQ(bits.count(), 130u);
+
+    // Growing with ones fills the old partial word too
+    Bitfield grown(70, true);
+    grown.resize(200, true);
+    EXPECT_EQ(grown.count(), 200u);
+    grown.resize(65);
+    EXPECT_EQ(grown.count(), 65u);
+    grown.resize(130, false);
+    EXPECT_EQ(grown.count(), 65u);
+    EXPECT_EQ(grown.find_first_clear(), 65u);
+}
+
+// Test set/clear scans across word boundaries
+TEST(BitfieldTest, FindFirst) {
+    Bitfield bits(300);
+    EXPECT_EQ(bits.find_first_set(), Bitfield::npos);
+    EXPECT_EQ(bits.find_first_clear(), 0u);
+
+    bits.set(5);
+    bits.set(128);
+    bits.set(299);
+    EXPECT_EQ(bits.find_first_set(), 5u);
+    EXPECT_EQ(bits.find_first_set(6), 128u);
+    EXPECT_EQ(bits.find_first_set(129), 299u);
+    EXPECT_EQ(bits.find_first_set(300), Bitfield::npos);
+
+    std::vector<size_t> visited;
+    bits.for_each_set([&](size_t index) { visited.push_back(index); });
+    EXPECT_EQ(visited, (std::vector<size_t>{5, 128, 299}));
+
+    bits.set_all();
+    bits.clear(200);
+    EXPECT_EQ(bits.find_first_clear(), 200u);
+    EXPECT_EQ(bits.find_first_clear(201), Bitfield::npos);
+}
+
+// Test the word-wise combinations used to find needed pieces
+TEST(BitfieldTest, Combinations) {
+    Bitfield peer(100);
+    Bitfield completed(100);
+    Bitfield downloading(100);
+    for (size_t i = 0; i < 100; i += 2) {
+        peer.set(i);
+    }
+    completed.set(0);
+    completed.set(1);
+    downloading.set(98);
+
+    Bitfield needed(100);
+    needed |= peer;
+    needed.and_not(completed).and_not(downloading);
+    EXPECT_EQ(needed.count(), 48u);
+    EXPECT_EQ(needed.find_first_set(), 2u);
+    EXPECT_FALSE(needed[98]);
+
+    // A shorter operand reads as zero past its end
+    Bitfield shorter(10, true);
+    needed &= shorter;
+    EXPECT_EQ(needed.count(), 4u);  // 2, 4, 6, 8
+}
+
+// Test conversion to and from the BitTorrent wire format
+TEST(BitfieldTest, WireFormat) {
+    const std::vector<uint8_t> wire = {0x80, 0x01, 0xFF, 0xC0};
+    Bitfield bits = Bitfield::from_bytes(wire.data(), wire.size(), 26);
+    EXPECT_TRUE(bits[0]);
+    EXPECT_FALSE(bits[1]);
+    EXPECT_TRUE(bits[15]);
+    EXPECT_TRUE(bits[16] && bits[23]);
+    EXPECT_TRUE(bits[24] && bits[25]);
+    EXPECT_EQ(bits.count(), 12u);
+    EXPECT_EQ(bits.to_bytes(), wire);
+
+    // Spare bits beyond the size are dropped, short input reads as zero
+    const std::vector<uint8_t> padded = {0xFF, 0xFF};
+    Bitfield truncated = Bitfield::from_bytes(padded.data(), padded.size(), 12);
+    EXPECT_EQ(truncated.count(), 12u);
+    EXPECT_EQ(truncated.to_bytes(), (std::vector<uint8_t>{0xFF, 0xF0}));
+    Bitfield extended = Bitfield::from_bytes(padded.data(), 1, 100);
+    EXPECT_EQ(extended.count(), 8u);
+    EXPECT_EQ(extended.to_bytes().size(), 13u);
+}
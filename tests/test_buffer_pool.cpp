@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include "buffer_pool.h"
+#include <cstring>
+#include <string>
+
+using namespace librats;
+
+// Test that released storage is handed out again for requests of the same class
+TEST(BufferPoolTest, ReusesReleasedBuffers) {
+    BufferPool& pool = BufferPool::getInstance();
+
+    const uint8_t* first_data;
+    {
+        auto storage = pool.acquire(1000);
+        ASSERT_GE(storage->size(), 1000u);
+        EXPECT_EQ(storage->size(), 1024u);    // Next power of two
+        first_data = storage->data();
+    }
+
+    auto before = pool.get_stats();
+    auto storage = pool.acquire(700);
+    EXPECT_EQ(storage->data(), first_data);
+    EXPECT_EQ(pool.get_stats().hits, before.hits + 1);
+
+    // Above the largest class is a plain allocation
+    auto large = pool.acquire(BufferPool::MAX_CLASS_SIZE + 1);
+    EXPECT_EQ(large->size(), BufferPool::MAX_CLASS_SIZE + 1);
+}
+
+// Test that views keep pooled storage alive and return it when the last one drops
+TEST(BufferPoolTest, SlicesKeepStorageUntilLastViewDrops) {
+    BufferPool& pool = BufferPool::getInstance();
+    const std::string text = "pooled frame payload";
+
+    SharedBuffer tail;
+    const uint8_t* storage_data;
+    {
+        SharedBuffer frame = pool.copy_of(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+        EXPECT_EQ(frame.size(), text.size());
+        EXPECT_EQ(frame.to_string(), text);
+        storage_data = frame.storage()->data();
+        tail = frame.slice(7);
+    }
+
+    // The slice still owns the storage, so a new buffer must not reuse it
+    auto other = pool.acquire(text.size());
+    EXPECT_NE(other->data(), storage_data);
+    EXPECT_EQ(tail.to_string(), "frame payload");
+
+    tail = SharedBuffer();
+    other.reset();
+    EXPECT_TRUE(pool.copy_of(nullptr, 0).empty());
+}
+
+// Test exact reserved classes and the cache limit
+TEST(BufferPoolTest, ReservedClassesAndCacheLimit) {
+    BufferPool& pool = BufferPool::getInstance();
+
+    const size_t frame_size = 65536 + 100;
+    ASSERT_TRUE(pool.reserve_size_class(frame_size));
+    EXPECT_TRUE(pool.reserve_size_class(frame_size));  // Already reserved
+    EXPECT_FALSE(pool.reserve_size_class(BufferPool::MAX_CLASS_SIZE + 1));
+    EXPECT_EQ(pool.acquire(frame_size)->size(), frame_size);
+    EXPECT_EQ(pool.acquire(frame_size - 50)->size(), frame_size);
+
+    // With no room in the cache, released buffers are freed
+    pool.clear();
+    pool.set_max_cached_bytes(0);
+    pool.acquire(4096).reset();
+    EXPECT_EQ(pool.get_stats().cached_buffers, 0u);
+    EXPECT_EQ(pool.get_stats().cached_bytes, 0u);
+
+    pool.set_max_cached_bytes(BufferPool::DEFAULT_MAX_CACHED_BYTES);
+    pool.acquire(4096).reset();
+    EXPECT_EQ(pool.get_stats().cached_bytes, 4096u);
+    pool.clear();
+    EXPECT_EQ(pool.get_stats().cached_buffers, 0u);
+}
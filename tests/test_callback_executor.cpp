@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "callback_executor.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+bool wait_until(const std::function<bool()>& condition, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // namespace
+
+// Test that tasks of one key run in post order while keys run in parallel
+TEST(CallbackExecutorTest, PreservesOrderPerKey) {
+    CallbackExecutor executor("test");
+    ASSERT_TRUE(executor.start(4, 1024));
+
+    std::mutex mutex;
+    std::map<std::string, std::vector<int>> seen;
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    const int per_key = 200;
+    for (int i = 0; i < per_key; ++i) {
+        for (const char* key : {"a", "b", "c", "d"}) {
+            std::string name = key;
+            ASSERT_TRUE(executor.post(name, [&, name, i]() {
+                int now = ++running;
+                int previous = max_running.load();
+                while (now > previous && !max_running.compare_exchange_weak(previous, now)) {}
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    seen[name].push_back(i);
+                }
+                --running;
+            }));
+        }
+    }
+
+    executor.stop();
+    EXPECT_EQ(executor.get_queued_count(), 0u);
+    ASSERT_EQ(seen.size(), 4u);
+    for (const auto& pair : seen) {
+        ASSERT_EQ(pair.second.size(), static_cast<size_t>(per_key)) << pair.first;
+        for (int i = 0; i < per_key; ++i) {
+            EXPECT_EQ(pair.second[i], i) << pair.first;
+        }
+    }
+    EXPECT_GE(max_running.load(), 1);
+
+    // Stopped executors refuse work and leave the task with the caller
+    std::function<void()> task = []() {};
+    EXPECT_FALSE(executor.post("a", std::move(task)));
+    EXPECT_TRUE(static_cast<bool>(task));
+}
+
+// Test that a blocked key does not hold up other keys, even ones hashed to the same worker
+TEST(CallbackExecutorTest, IdleWorkersStealFromBusyOnes) {
+    CallbackExecutor executor("test");
+    ASSERT_TRUE(executor.start(2, 1024));
+
+    std::atomic<bool> release{false};
+    std::atomic<int> done{0};
+    ASSERT_TRUE(executor.post("slow", [&]() {
+        wait_until([&]() { return release.load(); }, std::chrono::seconds(5));
+    }));
+    for (int i = 0; i < 32; ++i) {
+        ASSERT_TRUE(executor.post("key-" + std::to_string(i), [&]() { ++done; }));
+    }
+
+    EXPECT_TRUE(wait_until([&]() { return done.load() == 32; }, std::chrono::seconds(2)));
+    release = true;
+    executor.stop();
+}
+
+// Test that a full key blocks the poster until a task of that key completes
+TEST(CallbackExecutorTest, FullKeyBlocksPoster) {
+    CallbackExecutor executor("test");
+    ASSERT_TRUE(executor.start(2, 2));
+
+    std::atomic<bool> release{false};
+    std::atomic<int> done{0};
+    auto slow = [&]() {
+        wait_until([&]() { return release.load(); }, std::chrono::seconds(5));
+        ++done;
+    };
+    ASSERT_TRUE(executor.post("peer", slow));                      // Running
+    ASSERT_TRUE(wait_until([&]() { return executor.get_queued_count() == 0; }, std::chrono::seconds(1)));
+    ASSERT_TRUE(executor.post("peer", slow));                      // Queued
+    ASSERT_TRUE(executor.post("peer", slow));                      // Queued, key full
+
+    std::atomic<bool> posted{false};
+    std::thread poster([&]() {
+        executor.post("peer", [&]() { ++done; });
+        posted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(posted.load());
+
+    // Other keys are not affected
+    std::atomic<bool> other_ran{false};
+    ASSERT_TRUE(executor.post("other", [&]() { other_ran = true; }));
+    EXPECT_TRUE(wait_until([&]() { return other_ran.load(); }, std::chrono::seconds(1)));
+
+    release = true;
+    poster.join();
+    EXPECT_TRUE(posted.load());
+    executor.stop();
+    EXPECT_EQ(done.load(), 4);
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include "chunk_compression.h"
+#include "file_transfer.h"
+#include <random>
+#include <string>
+
+using namespace librats;
+
+namespace {
+
+std::vector<uint8_t> log_text(size_t size) {
+    std::string text;
+    for (int i = 0; text.size() < size; ++i) {
+        text += "peer " + std::to_string(i % 97) + " sent chunk " + std::to_string(i) + " of transfer abc\n";
+    }
+    text.resize(size);
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+std::vector<uint8_t> random_bytes(size_t size) {
+    std::mt19937 gen(11);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(gen());
+    }
+    return data;
+}
+
+} // namespace
+
+// Test that codec names round-trip and NONE is always available
+TEST(ChunkCompressionTest, CodecNames) {
+    for (CompressionType type : {CompressionType::NONE, CompressionType::LZ4, CompressionType::ZSTD, CompressionType::ZLIB}) {
+        EXPECT_EQ(compression_type_from_name(compression_type_name(type)), type);
+    }
+    EXPECT_EQ(compression_type_from_name("brotli"), CompressionType::NONE);
+    EXPECT_TRUE(is_compression_available(CompressionType::NONE));
+    for (CompressionType type : available_compression_types()) {
+        EXPECT_NE(type, CompressionType::NONE);
+        EXPECT_TRUE(is_compression_available(type));
+    }
+}
+
+// Test that the entropy estimate separates text from random data
+TEST(ChunkCompressionTest, EntropyEstimate) {
+    std::vector<uint8_t> zeros(65536, 0);
+    EXPECT_DOUBLE_EQ(estimate_entropy(zeros.data(), zeros.size()), 0.0);
+
+    auto text = log_text(65536);
+    EXPECT_LT(estimate_entropy(text.data(), text.size()), 5.0);
+
+    auto random = random_bytes(65536);
+    EXPECT_GT(estimate_entropy(random.data(), random.size()), 7.5);
+
+    // A compressible prefix does not hide the random data behind it
+    std::vector<uint8_t> mixed(zeros.begin(), zeros.begin() + 1024);
+    mixed.insert(mixed.end(), random.begin(), random.end());
+    EXPECT_GT(estimate_entropy(mixed.data(), mixed.size()), 6.0);
+
+    EXPECT_DOUBLE_EQ(estimate_entropy(nullptr, 0), 0.0);
+}
+
+// Test that every codec in the build restores text and refuses data that does not shrink
+TEST(ChunkCompressionTest, RoundTripAvailableCodecs) {
+    auto text = log_text(65536);
+    auto random = random_bytes(65536);
+    for (CompressionType type : available_compression_types()) {
+        SCOPED_TRACE(compression_type_name(type));
+        std::vector<uint8_t> compressed;
+        ASSERT_TRUE(compress_chunk(type, 0, text.data(), text.size(), compressed));
+        EXPECT_LT(compressed.size(), text.size() / 3);
+
+        std::vector<uint8_t> restored(text.size());
+        ASSERT_TRUE(decompress_chunk(type, compressed.data(), compressed.size(), restored.data(), restored.size()));
+        EXPECT_EQ(restored, text);
+
+        // A wrong original size or corrupt data fails instead of producing garbage
+        std::vector<uint8_t> short_output(text.size() - 1);
+        EXPECT_FALSE(decompress_chunk(type, compressed.data(), compressed.size(), short_output.data(), short_output.size()));
+        compressed.resize(compressed.size() / 2);
+        EXPECT_FALSE(decompress_chunk(type, compressed.data(), compressed.size(), restored.data(), restored.size()));
+
+        EXPECT_FALSE(compress_chunk(type, 0, random.data(), random.size(), compressed));
+    }
+
+    std::vector<uint8_t> out;
+    EXPECT_FALSE(compress_chunk(CompressionType::NONE, 0, text.data(), text.size(), out));
+}
+
+// Test that the codec travels in the chunk frame header
+TEST(ChunkCompressionTest, FrameHeaderCarriesCodec) {
+    ChunkFrameHeader header;
+    header.transfer_id_hash = ChunkFrameHeader::hash_transfer_id("compressed");
+    header.chunk_size = 8;
+    header.codec = CompressionType::ZSTD;
+    std::vector<uint8_t> frame(ChunkFrameHeader::SIZE + header.chunk_size);
+    header.encode(frame.data());
+
+    ChunkFrameHeader decoded;
+    ASSERT_TRUE(ChunkFrameHeader::decode(frame.data(), frame.size(), decoded));
+    EXPECT_EQ(decoded.codec, CompressionType::ZSTD);
+    EXPECT_EQ(decoded.chunk_size, 8u);
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "delta_sync.h"
+#include "sha256.h"
+#include "fs.h"
+#include <algorithm>
+#include <random>
+
+using namespace librats;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(size_t size, uint32_t seed) {
+    std::mt19937 gen(seed);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(gen());
+    }
+    return data;
+}
+
+bool open_file(FileHandle& file, const std::string& path, const std::vector<uint8_t>& content) {
+    return create_file_binary(path.c_str(), content.data(), content.size()) &&
+           file.open(path.c_str(), FileOpenMode::READ_ONLY);
+}
+
+} // namespace
+
+// Test that rolling the checksum matches computing it from scratch at every offset
+TEST(DeltaSyncTest, RollingChecksumMatchesFullChecksum) {
+    auto data = random_bytes(4096, 1);
+    const size_t window = 700;
+
+    RollingChecksum rolling;
+    rolling.reset(data.data(), window);
+    for (size_t offset = 1; offset + window <= data.size(); ++offset) {
+        rolling.roll(data[offset - 1], data[offset + window - 1]);
+        RollingChecksum fresh;
+        fresh.reset(data.data() + offset, window);
+        ASSERT_EQ(rolling.digest(), fresh.digest()) << offset;
+    }
+}
+
+// Test that an edited file is rebuilt from copied blocks plus literals
+TEST(DeltaSyncTest, EditedFileReusesUnchangedBlocks) {
+    const std::string old_path = "delta_test_old.bin";
+    const std::string new_path = "delta_test_new.bin";
+    auto old_content = random_bytes(300000, 2);
+
+    // Insert bytes near the start, overwrite some in the middle and append a tail
+    auto new_content = old_content;
+    auto inserted = random_bytes(123, 3);
+    new_content.insert(new_content.begin() + 40000, inserted.begin(), inserted.end());
+    for (size_t i = 150000; i < 150500; ++i) {
+        new_content[i] ^= 0x5a;
+    }
+    auto tail = random_bytes(5000, 4);
+    new_content.insert(new_content.end(), tail.begin(), tail.end());
+
+    FileHandle old_file;
+    FileHandle new_file;
+    ASSERT_TRUE(open_file(old_file, old_path, old_content));
+    ASSERT_TRUE(open_file(new_file, new_path, new_content));
+
+    uint32_t block_size = choose_delta_block_size(old_content.size());
+    EXPECT_GE(block_size, MIN_DELTA_BLOCK_SIZE);
+    std::vector<DeltaBlockSignature> signatures;
+    ASSERT_TRUE(compute_delta_signatures(old_file, old_content.size(), block_size, signatures));
+    EXPECT_EQ(signatures.size(), old_content.size() / block_size);
+
+    DeltaPlan plan;
+    SHA256 hasher;
+    ASSERT_TRUE(compute_delta(new_file, new_content.size(), block_size, signatures, plan, &hasher));
+    EXPECT_EQ(hasher.finalize(), SHA256::hash_bytes(new_content));
+
+    // Rebuild the new file the way the receiver does
+    std::vector<uint8_t> rebuilt(new_content.size());
+    std::vector<bool> covered(new_content.size(), false);
+    for (const auto& copy : plan.copies) {
+        for (uint64_t i = 0; i < copy.count * block_size; ++i) {
+            rebuilt[copy.offset + i] = old_content[copy.block * block_size + i];
+            covered[copy.offset + i] = true;
+        }
+    }
+    uint64_t literal_bytes = 0;
+    for (const auto& literal : plan.literals) {
+        for (uint64_t i = 0; i < literal.length; ++i) {
+            rebuilt[literal.offset + i] = new_content[literal.offset + i];
+            covered[literal.offset + i] = true;
+        }
+        literal_bytes += literal.length;
+    }
+    EXPECT_TRUE(std::all_of(covered.begin(), covered.end(), [](bool value) { return value; }));
+    EXPECT_EQ(rebuilt, new_content);
+    EXPECT_EQ(plan.copied_bytes + literal_bytes, new_content.size());
+
+    // Only the blocks around the edits and the tail are sent
+    EXPECT_LT(literal_bytes, 5000 + 4 * block_size);
+
+    old_file.close();
+    new_file.close();
+    delete_file(old_path.c_str());
+    delete_file(new_path.c_str());
+}
+
+// Test that without usable signatures the whole file is one literal
+TEST(DeltaSyncTest, NoSignaturesSendsWholeFile) {
+    const std::string path = "delta_test_whole.bin";
+    auto content = random_bytes(10000, 5);
+    FileHandle file;
+    ASSERT_TRUE(open_file(file, path, content));
+
+    DeltaPlan plan;
+    SHA256 hasher;
+    ASSERT_TRUE(compute_delta(file, content.size(), MIN_DELTA_BLOCK_SIZE, {}, plan, &hasher));
+    EXPECT_TRUE(plan.copies.empty());
+    ASSERT_EQ(plan.literals.size(), 1u);
+    EXPECT_EQ(plan.literals[0].offset, 0u);
+    EXPECT_EQ(plan.literals[0].length, content.size());
+    EXPECT_EQ(hasher.finalize(), SHA256::hash_bytes(content));
+
+    file.close();
+    delete_file(path.c_str());
+}
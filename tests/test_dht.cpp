@@ -2,10 +2,14 @@
 #include <gmock/gmock.h>
 #include "dht.h"
 #include "socket.h"
+#include "fs.h"
+#include "sim_network.h"
 #include <thread>
 #include <chrono>
 #include <vector>
 #include <string>
+#include <random>
+#include <algorithm>
 
 using namespace librats;
 
@@ -63,12 +67,12 @@ TEST_F(DhtTest, NodeIdInfoHashTest) {
 // Test DhtNode structure
 TEST_F(DhtTest, DhtNodeTest) {
     NodeId id = create_test_node_id(0x12);
-    Peer peer("127.0.0.1", 8080);
+    NetEndpoint peer("127.0.0.1", 8080);
     
     DhtNode node(id, peer);
     
     EXPECT_EQ(node.id, id);
-    EXPECT_EQ(node.peer.ip, "127.0.0.1");
+    EXPECT_EQ(node.peer.ip(), "127.0.0.1");
     EXPECT_EQ(node.peer.port, 8080);
     
     // Test that last_seen is set to current time (approximately)
@@ -203,6 +207,235 @@ TEST_F(DhtTest, RoutingTableTest) {
     client.stop();
 }
 
+// Test routing table bucket placement and size accounting
+TEST_F(DhtTest, RoutingTableBucketsTest) {
+    NodeId own_id = create_test_node_id(0x00);
+    DhtRoutingTable table(own_id);
+
+    NodeId far_id = create_test_node_id(0x00);
+    far_id[0] = 0x80;                      // Differs in the first bit
+    NodeId near_id = create_test_node_id(0x00);
+    near_id[19] = 0x01;                    // Differs only in the last bit
+
+    EXPECT_EQ(table.bucket_index(far_id), 0);
+    EXPECT_EQ(table.bucket_index(near_id), 159);
+    EXPECT_EQ(table.bucket_index(own_id), 159);
+
+    EXPECT_TRUE(table.insert(DhtNode(far_id, NetEndpoint("10.0.0.1", 6881))));
+    EXPECT_TRUE(table.insert(DhtNode(near_id, NetEndpoint("10.0.0.2", 6881))));
+    EXPECT_EQ(table.size(), 2);
+    ASSERT_NE(table.find(near_id), nullptr);
+    EXPECT_EQ(table.find(near_id)->peer.ip(), "10.0.0.2");
+
+    // A full bucket refuses new nodes until one is replaced
+    for (uint8_t i = 1; i < K_BUCKET_SIZE; ++i) {
+        NodeId id = far_id;
+        id[19] = i;
+        EXPECT_TRUE(table.insert(DhtNode(id, NetEndpoint("10.0.1.1", i))));
+    }
+    NodeId extra_id = far_id;
+    extra_id[19] = 0xFF;
+    EXPECT_FALSE(table.insert(DhtNode(extra_id, NetEndpoint("10.0.2.1", 6881))));
+    EXPECT_TRUE(table.replace(far_id, DhtNode(extra_id, NetEndpoint("10.0.2.1", 6881))));
+    EXPECT_EQ(table.find(far_id), nullptr);
+    EXPECT_NE(table.find(extra_id), nullptr);
+    EXPECT_EQ(table.size(), K_BUCKET_SIZE + 1);
+
+    size_t removed = table.remove_if([](const DhtNode& node) { return node.peer.ip() == "10.0.1.1"; });
+    EXPECT_EQ(removed, K_BUCKET_SIZE - 1);
+    EXPECT_EQ(table.size(), 2);
+}
+
+// Test that closest-node lookups match a full sort of the table
+TEST_F(DhtTest, RoutingTableClosestNodesTest) {
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+    auto random_id = [&]() {
+        NodeId id;
+        for (auto& byte : id) {
+            byte = static_cast<uint8_t>(byte_dist(gen));
+        }
+        return id;
+    };
+
+    NodeId own_id = random_id();
+    DhtRoutingTable table(own_id);
+    std::vector<NodeId> all_ids;
+
+    // Random ids mostly land in the first buckets; ids sharing our prefix fill deeper ones
+    for (int i = 0; i < 2000; ++i) {
+        NodeId id = random_id();
+        int shared_bits = i % 24;
+        for (int bit = 0; bit < shared_bits; ++bit) {
+            uint8_t mask = static_cast<uint8_t>(0x80 >> (bit % 8));
+            id[bit / 8] = static_cast<uint8_t>((id[bit / 8] & ~mask) | (own_id[bit / 8] & mask));
+        }
+        if (table.insert(DhtNode(id, NetEndpoint("10.0.0.1", 6881)))) {
+            all_ids.push_back(id);
+        }
+    }
+    ASSERT_EQ(table.size(), all_ids.size());
+
+    auto distance_less = [](const NodeId& a, const NodeId& b, const NodeId& target) {
+        for (size_t i = 0; i < NODE_ID_SIZE; ++i) {
+            uint8_t da = a[i] ^ target[i];
+            uint8_t db = b[i] ^ target[i];
+            if (da != db) {
+                return da < db;
+            }
+        }
+        return false;
+    };
+
+    std::vector<NodeId> targets = {own_id, all_ids.front(), all_ids.back()};
+    for (int i = 0; i < 50; ++i) {
+        targets.push_back(random_id());
+    }
+
+    for (const auto& target : targets) {
+        for (size_t count : {size_t(1), K_BUCKET_SIZE, size_t(50)}) {
+            std::vector<NodeId> expected = all_ids;
+            std::sort(expected.begin(), expected.end(), [&](const NodeId& a, const NodeId& b) {
+                return distance_less(a, b, target);
+            });
+            expected.resize((std::min)(count, expected.size()));
+
+            auto closest = table.find_closest(target, count);
+            ASSERT_EQ(closest.size(), expected.size());
+            for (size_t i = 0; i < closest.size(); ++i) {
+                EXPECT_EQ(closest[i].id, expected[i]);
+            }
+        }
+    }
+
+    EXPECT_TRUE(table.find_closest(own_id, 0).empty());
+    EXPECT_TRUE(DhtRoutingTable(own_id).find_closest(own_id, K_BUCKET_SIZE).empty());
+}
+
+// Test the bounded announced-peer store: capacity, LRU eviction and expiry
+TEST_F(DhtTest, PeerStoreTest) {
+    using Clock = DhtPeerStore::Clock;
+    auto start = Clock::now();
+    auto hash_of = [](uint8_t value) {
+        InfoHash hash{};
+        hash[0] = value;
+        return hash;
+    };
+
+    DhtPeerStore store(2, 3, std::chrono::minutes(30));
+    EXPECT_TRUE(store.announce(hash_of(1), NetEndpoint("10.0.0.1", 1000), start));
+    EXPECT_TRUE(store.announce(hash_of(1), NetEndpoint("2001:db8::1", 1001), start));
+    EXPECT_FALSE(store.announce(hash_of(1), NetEndpoint("not-an-address", 1002), start));
+    EXPECT_EQ(store.peer_count(), 2u);
+
+    // Re-announcing refreshes the peer instead of adding it again
+    EXPECT_TRUE(store.announce(hash_of(1), NetEndpoint("10.0.0.1", 1000), start + std::chrono::minutes(1)));
+    auto peers = store.get_peers(hash_of(1), 10, start + std::chrono::minutes(1));
+    ASSERT_EQ(peers.size(), 2u);
+    EXPECT_EQ(peers[0], NetEndpoint("10.0.0.1", 1000));
+    EXPECT_EQ(peers[1], NetEndpoint("2001:db8::1", 1001));
+    EXPECT_EQ(store.get_peers(hash_of(1), 1, start).size(), 1u);
+
+    // A full info hash drops its oldest peer
+    store.announce(hash_of(1), NetEndpoint("10.0.0.2", 1000), start + std::chrono::minutes(2));
+    store.announce(hash_of(1), NetEndpoint("10.0.0.3", 1000), start + std::chrono::minutes(3));
+    peers = store.get_peers(hash_of(1), 10, start + std::chrono::minutes(3));
+    ASSERT_EQ(peers.size(), 3u);
+    EXPECT_EQ(std::count(peers.begin(), peers.end(), NetEndpoint("2001:db8::1", 1001)), 0);
+
+    // A full store evicts the info hash announced least recently
+    store.announce(hash_of(2), NetEndpoint("10.0.0.4", 1000), start + std::chrono::minutes(4));
+    store.announce(hash_of(1), NetEndpoint("10.0.0.3", 1000), start + std::chrono::minutes(5));
+    store.announce(hash_of(3), NetEndpoint("10.0.0.5", 1000), start + std::chrono::minutes(6));
+    EXPECT_EQ(store.info_hash_count(), 2u);
+    EXPECT_TRUE(store.contains(hash_of(1)));
+    EXPECT_FALSE(store.contains(hash_of(2)));
+    EXPECT_TRUE(store.contains(hash_of(3)));
+    EXPECT_EQ(store.peer_count(), 4u);
+
+    // Expired peers are hidden from lookups and dropped by expire()
+    auto later = start + std::chrono::minutes(33);
+    peers = store.get_peers(hash_of(1), 10, later);
+    ASSERT_EQ(peers.size(), 1u);
+    EXPECT_EQ(peers[0], NetEndpoint("10.0.0.3", 1000));
+    EXPECT_EQ(store.expire(later), 2u);
+    EXPECT_EQ(store.peer_count(), 2u);
+    EXPECT_EQ(store.expire(start + std::chrono::minutes(40)), 2u);
+    EXPECT_EQ(store.info_hash_count(), 0u);
+    EXPECT_TRUE(store.get_peers(hash_of(1), 10, later).empty());
+}
+
+// Test that lowering the peer store budget trims it at once and counts what it dropped
+TEST_F(DhtTest, PeerStoreLimitsTest) {
+    auto start = DhtPeerStore::Clock::now();
+    DhtPeerStore store(8, 8, std::chrono::minutes(30));
+    for (uint8_t h = 1; h <= 4; ++h) {
+        InfoHash hash{};
+        hash[0] = h;
+        for (uint8_t p = 1; p <= 4; ++p) {
+            store.announce(hash, NetEndpoint("10.0." + std::to_string(h) + "." + std::to_string(p), 1000),
+                           start + std::chrono::seconds(h * 10 + p));
+        }
+    }
+    EXPECT_EQ(store.peer_count(), 16u);
+    EXPECT_EQ(store.evictions(), 0u);
+    size_t full_bytes = store.memory_usage();
+    EXPECT_GT(full_bytes, 16 * sizeof(NetEndpoint));
+
+    store.set_limits(2, 3);
+    EXPECT_EQ(store.info_hash_count(), 2u);
+    EXPECT_EQ(store.peer_count(), 6u);
+    EXPECT_EQ(store.evictions(), 10u);
+    EXPECT_LT(store.memory_usage(), full_bytes);
+
+    // The most recently announced info hashes stay, each with its newest peers
+    InfoHash newest{};
+    newest[0] = 4;
+    auto peers = store.get_peers(newest, 10, start + std::chrono::minutes(1));
+    ASSERT_EQ(peers.size(), 3u);
+    EXPECT_EQ(peers[0], NetEndpoint("10.0.4.4", 1000));
+    EXPECT_EQ(peers[2], NetEndpoint("10.0.4.2", 1000));
+
+    EXPECT_EQ(store.expire(start + std::chrono::hours(1)), 6u);
+    EXPECT_EQ(store.evictions(), 16u);
+}
+
+// Test that a full set of running lookups ends the oldest to make room
+TEST_F(DhtTest, PendingSearchLimitTest) {
+    SimNetwork network(7);
+    SimLinkConfig link;
+    link.latency = std::chrono::milliseconds(200);
+    DhtClient searcher;
+    DhtClient responder;
+    ASSERT_TRUE(searcher.set_transport(network.add_endpoint(link)));
+    ASSERT_TRUE(responder.set_transport(network.add_endpoint(link)));
+    ASSERT_TRUE(searcher.start());
+    ASSERT_TRUE(responder.start());
+    searcher.bootstrap({Peer("10.0.0.2", 6881)});
+    network.run_for(std::chrono::seconds(5));
+    ASSERT_GE(searcher.get_routing_table_size(), 1u);
+
+    searcher.set_resource_limits(DHT_MAX_STORED_INFO_HASHES, DHT_MAX_PEERS_PER_INFO_HASH, 2);
+    for (uint8_t i = 1; i <= 3; ++i) {
+        InfoHash hash{};
+        hash.fill(i);
+        ASSERT_TRUE(searcher.find_peers(hash, [](const std::vector<Peer>&, const InfoHash&) {}));
+    }
+    EXPECT_EQ(searcher.get_pending_searches_count(), 2u);
+    auto usage = searcher.get_searches_usage();
+    EXPECT_EQ(usage.entries, 2u);
+    EXPECT_EQ(usage.max_entries, 2u);
+    EXPECT_EQ(usage.evictions, 1u);
+    EXPECT_GT(usage.bytes, 0u);
+
+    searcher.set_resource_limits(DHT_MAX_STORED_INFO_HASHES, DHT_MAX_PEERS_PER_INFO_HASH, 1);
+    EXPECT_EQ(searcher.get_pending_searches_count(), 1u);
+    EXPECT_EQ(searcher.get_searches_usage().evictions, 2u);
+
+    searcher.stop();
+    responder.stop();
+}
+
 // Test multiple DHT clients communication
 TEST_F(DhtTest, MultipleClientsTest) {
     DhtClient client1(0);
@@ -225,6 +458,253 @@ TEST_F(DhtTest, MultipleClientsTest) {
     client2.stop();
 }
 
+// Test that two local clients learn about each other through a bootstrap exchange
+TEST_F(DhtTest, LocalBootstrapExchangeTest) {
+    DhtClient client1(59120);
+    DhtClient client2(59121);
+    ASSERT_TRUE(client1.start());
+    ASSERT_TRUE(client2.start());
+
+    EXPECT_TRUE(client2.bootstrap({Peer("127.0.0.1", 59120)}));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while ((client1.get_routing_table_size() == 0 || client2.get_routing_table_size() == 0) &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(client1.get_routing_table_size(), 1);
+    EXPECT_GE(client2.get_routing_table_size(), 1);
+
+    client1.stop();
+    client2.stop();
+}
+
+TEST_F(DhtTest, WorkerPoolBootstrapExchangeTest) {
+    DhtClient client1(59122, 4);
+    DhtClient client2(59123, 4);
+    ASSERT_TRUE(client1.start());
+    ASSERT_TRUE(client2.start());
+
+    EXPECT_TRUE(client2.bootstrap({Peer("127.0.0.1", 59122)}));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while ((client1.get_routing_table_size() == 0 || client2.get_routing_table_size() == 0) &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(client1.get_routing_table_size(), 1);
+    EXPECT_GE(client2.get_routing_table_size(), 1);
+
+    client1.stop();
+    client2.stop();
+    EXPECT_FALSE(client1.is_running());
+}
+
+// Test that a lookup streams announced peers back and then converges
+TEST_F(DhtTest, IterativeLookupTest) {
+    DhtClient storer(59131);
+    DhtClient announcer(59132);
+    DhtClient searcher(59133);
+    ASSERT_TRUE(storer.start());
+    ASSERT_TRUE(announcer.start());
+    ASSERT_TRUE(searcher.start());
+
+    auto wait_until = [](std::function<bool()> condition, std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!condition() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return condition();
+    };
+
+    EXPECT_TRUE(announcer.bootstrap({Peer("127.0.0.1", 59131)}));
+    EXPECT_TRUE(searcher.bootstrap({Peer("127.0.0.1", 59131)}));
+    ASSERT_TRUE(wait_until([&] { return announcer.get_routing_table_size() > 0 && searcher.get_routing_table_size() > 0; },
+                           std::chrono::seconds(2)));
+
+    InfoHash hash = create_test_info_hash(0xC3);
+    EXPECT_TRUE(announcer.announce_peer(hash, 7777));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::mutex found_mutex;
+    std::vector<Peer> found;
+    EXPECT_TRUE(searcher.find_peers(hash, [&](const std::vector<Peer>& peers, const InfoHash& info_hash) {
+        EXPECT_EQ(info_hash, hash);
+        std::lock_guard<std::mutex> lock(found_mutex);
+        found.insert(found.end(), peers.begin(), peers.end());
+    }, 3));
+
+    EXPECT_TRUE(wait_until([&] {
+        std::lock_guard<std::mutex> lock(found_mutex);
+        return !found.empty();
+    }, std::chrono::seconds(2)));
+    EXPECT_TRUE(wait_until([&] { return searcher.get_pending_searches_count() == 0; }, std::chrono::seconds(5)));
+
+    std::lock_guard<std::mutex> lock(found_mutex);
+    ASSERT_EQ(found.size(), 1u);
+    EXPECT_EQ(found[0].port, 7777);
+
+    searcher.stop();
+    announcer.stop();
+    storer.stop();
+}
+
+TEST_F(DhtTest, SampleInfohashesMessageTest) {
+    std::vector<KrpcNode> nodes = {KrpcNode(create_test_node_id(0x11), NetEndpoint("10.0.0.1", 6881))};
+    std::vector<InfoHash> samples = {create_test_info_hash(0x22), create_test_info_hash(0x33)};
+    auto response = KrpcProtocol::create_sample_infohashes_response("t1", create_test_node_id(0x44), nodes, samples, 7, 60);
+
+    auto decoded = KrpcProtocol::decode_message(KrpcProtocol::encode_message(response));
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_EQ(decoded->type, KrpcMessageType::Response);
+    EXPECT_EQ(decoded->samples, samples);
+    EXPECT_EQ(decoded->num, 7u);
+    EXPECT_EQ(decoded->interval, 60u);
+    ASSERT_EQ(decoded->nodes.size(), 1u);
+    EXPECT_EQ(decoded->nodes[0].peer.ip(), "10.0.0.1");
+
+    auto query = KrpcProtocol::create_sample_infohashes_query("t2", create_test_node_id(0x55), create_test_node_id(0x66));
+    decoded = KrpcProtocol::decode_message(KrpcProtocol::encode_message(query));
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_EQ(decoded->query_type, KrpcQueryType::SampleInfohashes);
+    EXPECT_EQ(decoded->target_id, create_test_node_id(0x66));
+}
+
+TEST_F(DhtTest, KrpcEncodingTest) {
+    NodeId id = create_test_node_id('A');
+    auto ping = KrpcProtocol::create_ping_query("aa", id);
+    auto encoded = KrpcProtocol::encode_message(ping);
+    EXPECT_EQ(std::string(encoded.begin(), encoded.end()),
+              "d1:ad2:id20:" + std::string(20, 'A') + "e1:q4:ping1:t2:aa1:y1:qe");
+
+    // Encoding into a reused buffer replaces its contents
+    std::vector<uint8_t> buffer(100, 'x');
+    auto error = KrpcProtocol::create_error("bb", KrpcErrorCode::ProtocolError, "Invalid token");
+    ASSERT_TRUE(KrpcProtocol::encode_message(error, buffer));
+    EXPECT_EQ(std::string(buffer.begin(), buffer.end()), "d1:eli203e13:Invalid tokene1:t2:bb1:y1:ee");
+
+    std::vector<NetEndpoint> peers = {NetEndpoint("1.2.3.4", 6881), NetEndpoint("::1", 80)};
+    auto response = KrpcProtocol::create_get_peers_response("cc", id, peers, "tok");
+    ASSERT_TRUE(KrpcProtocol::encode_message(response, buffer));
+    auto decoded = KrpcProtocol::decode_message(buffer);
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_EQ(decoded->response_id, id);
+    EXPECT_EQ(decoded->token, "tok");
+    ASSERT_EQ(decoded->peers.size(), 2u);
+    EXPECT_EQ(decoded->peers[0], NetEndpoint("1.2.3.4", 6881));
+    EXPECT_EQ(decoded->peers[1], NetEndpoint("0.0.0.0", 80));  // Compact peers are IPv4 only
+
+    // Same bytes as the BencodeValue encoder, which sorts keys itself
+    BencodeValue decoded_tree = bencode::decode(buffer);
+    EXPECT_EQ(decoded_tree.encode(), buffer);
+
+    auto announce = KrpcProtocol::create_announce_peer_query("dd", id, create_test_info_hash(0x01), 6000, "tok");
+    ASSERT_TRUE(KrpcProtocol::encode_message(announce, buffer));
+    EXPECT_EQ(bencode::decode(buffer).encode(), buffer);
+    decoded = KrpcProtocol::decode_message(buffer);
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_EQ(decoded->query_type, KrpcQueryType::AnnouncePeer);
+    EXPECT_EQ(decoded->port, 6000);
+}
+
+TEST_F(DhtTest, VirtualNodesAndSamplingTest) {
+    DhtClient server(59124);
+    DhtClient announcer(59125);
+    DhtClient crawler(59126);
+
+    NodeId virtual_id = crawler.add_virtual_node();
+    EXPECT_NE(virtual_id, NodeId{});
+    EXPECT_FALSE(crawler.add_virtual_node(virtual_id));
+    EXPECT_FALSE(crawler.add_virtual_node(crawler.get_node_id()));
+    ASSERT_EQ(crawler.get_virtual_node_ids().size(), 1u);
+
+    ASSERT_TRUE(server.start());
+    ASSERT_TRUE(announcer.start());
+    ASSERT_TRUE(crawler.start());
+    EXPECT_FALSE(crawler.add_virtual_node(create_test_node_id(0x77)));
+
+    // The virtual node learns the server into its own table
+    EXPECT_TRUE(announcer.bootstrap({Peer("127.0.0.1", 59124)}));
+    EXPECT_TRUE(crawler.bootstrap({Peer("127.0.0.1", 59124)}));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while ((crawler.get_virtual_routing_table_size(0) == 0 || announcer.get_routing_table_size() == 0) &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(crawler.get_virtual_routing_table_size(0), 1u);
+
+    InfoHash info_hash = create_test_info_hash(0xAB);
+    EXPECT_TRUE(announcer.announce_peer(info_hash, 6000));
+
+    std::mutex mutex;
+    std::vector<InfoHash> sampled;
+    crawler.set_info_hash_sample_callback([&](const std::vector<InfoHash>& samples, const Peer&) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sampled.insert(sampled.end(), samples.begin(), samples.end());
+    });
+
+    // Sample until the announce has been stored
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!sampled.empty()) {
+                break;
+            }
+        }
+        crawler.sample_infohashes(Peer("127.0.0.1", 59124), create_test_node_id(0x01));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_FALSE(sampled.empty());
+        EXPECT_EQ(sampled[0], info_hash);
+    }
+
+    crawler.stop();
+    announcer.stop();
+    server.stop();
+}
+
+TEST_F(DhtTest, RoutingTablePersistenceTest) {
+    const std::string path = "dht_state_test.dat";
+    DhtClient server(59127);
+    DhtClient client(59128);
+    ASSERT_TRUE(server.start());
+    ASSERT_TRUE(client.start());
+
+    EXPECT_TRUE(client.bootstrap({Peer("127.0.0.1", 59127)}));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (client.get_routing_table_size() == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_GE(client.get_routing_table_size(), 1u);
+    ASSERT_TRUE(client.save_routing_table(path));
+    EXPECT_FALSE(client.load_routing_table(path));  // Running
+    client.stop();
+
+    // A restarted client keeps its node ID and refills from the saved nodes without bootstrapping
+    DhtClient restarted(59129);
+    ASSERT_TRUE(restarted.load_routing_table(path));
+    EXPECT_EQ(restarted.get_node_id(), client.get_node_id());
+    EXPECT_EQ(restarted.get_routing_table_size(), 0u);
+    ASSERT_TRUE(restarted.start());
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (restarted.get_routing_table_size() == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(restarted.get_routing_table_size(), 1u);
+    restarted.stop();
+    server.stop();
+
+    ASSERT_TRUE(create_file(path, "not a routing table"));
+    DhtClient other(59130);
+    EXPECT_FALSE(other.load_routing_table(path));
+    EXPECT_FALSE(other.load_routing_table("missing_dht_state.dat"));
+    delete_file(path.c_str());
+}
+
 // Test node ID uniqueness
 TEST_F(DhtTest, NodeIdUniquenessTest) {
     std::vector<NodeId> node_ids;
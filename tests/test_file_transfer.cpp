@@ -3,10 +3,13 @@
 #include "file_transfer.h"
 #include "librats.h"
 #include "fs.h"
+#include "sha1.h"
+#include "sha256.h"
 #include <thread>
 #include <chrono>
 #include <fstream>
 #include <vector>
+#include <cstring>
 #include <string>
 #include <mutex>
 #include <condition_variable>
@@ -312,6 +315,24 @@ TEST_F(FileTransferTest, ChecksumCalculation) {
     // Same file should produce same checksum
     std::string checksum2 = FileTransferManager::calculate_file_checksum("test_data/small_file.txt", "sha256");
     EXPECT_EQ(checksum, checksum2);
+    EXPECT_EQ(checksum.size(), 64u);
+    
+    // Files larger than the hashing window stream to the same digest as a one-shot hash
+    std::vector<uint8_t> content(3 * 1024 * 1024 + 123);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>((i * 7) ^ (i >> 11));
+    }
+    ASSERT_TRUE(create_file_binary("test_data/checksum_file.bin", content.data(), content.size()));
+    EXPECT_EQ(FileTransferManager::calculate_file_checksum("test_data/checksum_file.bin", "sha256"),
+              SHA256::hash_bytes(content));
+    
+    SHA1 sha1;
+    sha1.update(content.data(), content.size());
+    EXPECT_EQ(FileTransferManager::calculate_file_checksum("test_data/checksum_file.bin", "sha1"), sha1.finalize());
+    
+    EXPECT_EQ(FileTransferManager::calculate_file_checksum("test_data/checksum_file.bin", "md5"), "");
+    EXPECT_EQ(FileTransferManager::calculate_file_checksum("non_existent_file.txt", "sha256"), "");
+    delete_file("test_data/checksum_file.bin");
 }
 
 TEST_F(FileTransferTest, TransferProgressTracking) {
@@ -358,11 +379,38 @@ TEST_F(FileTransferTest, TransferStatistics) {
 }
 
 TEST_F(FileTransferTest, BinaryDataHandling) {
-    // Test file transfer chunk detection
-    std::vector<uint8_t> valid_chunk_data = {
-        'F', 'T', 'C', 'H', 'U', 'N', 'K',  // Magic header
-        0x01, 0x02, 0x03, 0x04              // Sample data
-    };
+    // Build a chunk frame: fixed header followed by the chunk data
+    const std::vector<uint8_t> payload = {0x01, 0x02, 0x03, 0x04};
+    ChunkFrameHeader header;
+    header.transfer_id_hash = ChunkFrameHeader::hash_transfer_id("unknown_transfer");
+    header.chunk_index = 7;
+    header.total_chunks = 9;
+    header.file_offset = 7 * 1024;
+    header.chunk_size = static_cast<uint32_t>(payload.size());
+    header.has_checksum = true;
+    SHA1 sha1;
+    sha1.update(payload.data(), payload.size());
+    sha1.finalize(header.checksum);
+    
+    std::vector<uint8_t> valid_chunk_data(ChunkFrameHeader::SIZE);
+    header.encode(valid_chunk_data.data());
+    valid_chunk_data.insert(valid_chunk_data.end(), payload.begin(), payload.end());
+    
+    // The header round-trips through decode
+    ChunkFrameHeader decoded;
+    ASSERT_TRUE(ChunkFrameHeader::decode(valid_chunk_data.data(), valid_chunk_data.size(), decoded));
+    EXPECT_EQ(decoded.transfer_id_hash, header.transfer_id_hash);
+    EXPECT_EQ(decoded.chunk_index, 7u);
+    EXPECT_EQ(decoded.total_chunks, 9u);
+    EXPECT_EQ(decoded.file_offset, 7u * 1024);
+    EXPECT_EQ(decoded.chunk_size, payload.size());
+    EXPECT_TRUE(decoded.has_checksum);
+    EXPECT_EQ(decoded.codec, CompressionType::NONE);
+    EXPECT_EQ(std::memcmp(decoded.checksum, header.checksum, ChunkFrameHeader::CHECKSUM_SIZE), 0);
+    
+    // A frame whose payload does not match the declared size is rejected
+    std::vector<uint8_t> truncated(valid_chunk_data.begin(), valid_chunk_data.end() - 1);
+    EXPECT_FALSE(ChunkFrameHeader::decode(truncated.data(), truncated.size(), decoded));
     
     std::vector<uint8_t> invalid_chunk_data = {
         'I', 'N', 'V', 'A', 'L', 'I', 'D',  // Wrong header
@@ -371,10 +419,8 @@ TEST_F(FileTransferTest, BinaryDataHandling) {
     
     std::string peer_id = "test_peer";
     
-    // Valid chunk should be handled
-    bool handled_valid = transfer_manager1_->handle_binary_data(peer_id, valid_chunk_data);
-    // Note: This will return false since we don't have a pending chunk metadata,
-    // but it tests the magic header detection
+    // Chunk frames are claimed by the manager even for unknown transfers
+    EXPECT_TRUE(transfer_manager1_->handle_binary_data(peer_id, valid_chunk_data));
     
     // Invalid chunk should not be handled
     bool handled_invalid = transfer_manager1_->handle_binary_data(peer_id, invalid_chunk_data);
@@ -514,3 +560,142 @@ TEST_F(FileTransferTest, DirectoryTransferAcceptReject) {
     // Test rejecting non-existent directory transfer
     EXPECT_FALSE(transfer_manager1_->reject_directory_transfer("non_existent", "test reason"));
 }
+
+TEST(ChunkSendWindowTest, AimdWindowGrowthAndBackoff) {
+    ChunkSendWindow window(4, 16);
+    EXPECT_EQ(window.get_window(), 4u);
+    
+    // The initial window limits chunks in flight
+    for (uint64_t i = 0; i < 4; ++i) {
+        ASSERT_TRUE(window.wait_for_slot(std::chrono::milliseconds(10)));
+        window.on_chunk_sent(i);
+    }
+    EXPECT_FALSE(window.wait_for_slot(std::chrono::milliseconds(10)));
+    EXPECT_EQ(window.get_in_flight(), 4u);
+    
+    // Slow start grows the window by one chunk per ACK
+    for (uint64_t i = 0; i < 4; ++i) {
+        EXPECT_TRUE(window.on_chunk_ack(i, true));
+    }
+    EXPECT_EQ(window.get_window(), 8u);
+    EXPECT_TRUE(window.is_idle());
+    EXPECT_FALSE(window.on_chunk_ack(0, true)) << "Duplicate ACKs are ignored";
+    
+    // A negative ACK halves the window and queues the chunk for retransmission
+    window.on_chunk_sent(4);
+    window.on_chunk_sent(5);
+    EXPECT_TRUE(window.on_chunk_ack(4, false));
+    EXPECT_EQ(window.get_window(), 4u);
+    uint64_t retransmit_index = 0;
+    EXPECT_TRUE(window.pop_retransmission(retransmit_index));
+    EXPECT_EQ(retransmit_index, 4u);
+    EXPECT_FALSE(window.pop_retransmission(retransmit_index));
+    
+    // Congestion avoidance grows by about one chunk per window of ACKs
+    window.on_chunk_sent(4, true);
+    EXPECT_TRUE(window.on_chunk_ack(4, true));
+    EXPECT_TRUE(window.on_chunk_ack(5, true));
+    EXPECT_EQ(window.get_window(), 4u);
+    for (uint64_t i = 6; i < 10; ++i) {
+        window.on_chunk_sent(i);
+        window.on_chunk_ack(i, true);
+    }
+    EXPECT_EQ(window.get_window(), 5u);
+    
+    // The window never exceeds its maximum
+    for (uint64_t i = 10; i < 200; ++i) {
+        window.on_chunk_sent(i);
+        window.on_chunk_ack(i, true);
+    }
+    EXPECT_EQ(window.get_window(), 16u);
+    
+    window.close();
+    EXPECT_TRUE(window.is_closed());
+    EXPECT_FALSE(window.wait_for_slot(std::chrono::milliseconds(10)));
+}
+
+TEST(ChunkSendWindowTest, AckTimeoutShrinksWindow) {
+    ChunkSendWindow window(8, 64);
+    
+    // A fast ACK gives an RTT sample, so the timeout drops to its 200ms floor
+    window.on_chunk_sent(0);
+    window.on_chunk_ack(0, true);
+    EXPECT_EQ(window.get_retransmission_timeout(), std::chrono::milliseconds(200));
+    uint32_t window_before = window.get_window();
+    
+    window.on_chunk_sent(1);
+    window.on_chunk_sent(2);
+    EXPECT_EQ(window.expire_timed_out_chunks(), 0u);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    EXPECT_EQ(window.expire_timed_out_chunks(), 2u);
+    EXPECT_EQ(window.get_in_flight(), 0u);
+    EXPECT_EQ(window.get_window(), window_before / 2);
+    
+    // A late ACK for an expired chunk is not counted again
+    EXPECT_FALSE(window.on_chunk_ack(1, true));
+}
+
+TEST(ChunkSendWindowTest, CountsDeliveredBytesOnce) {
+    ChunkSendWindow window(8, 64);
+    window.set_total_bytes(3000);
+    
+    window.on_chunk_sent(0, false, 1000);
+    window.on_chunk_sent(1, false, 1000);
+    window.on_chunk_sent(2, false, 1000);
+    EXPECT_TRUE(window.on_chunk_ack(0, true));
+    EXPECT_FALSE(window.on_chunk_ack(0, true));
+    EXPECT_EQ(window.get_delivered_bytes(), 1000u) << "Duplicate ACKs do not count twice";
+    
+    // A negative ACK delivers nothing and counts as a loss; the retransmission's ACK does
+    EXPECT_TRUE(window.on_chunk_ack(1, false));
+    EXPECT_EQ(window.get_loss_events(), 1u);
+    window.on_chunk_sent(1, true, 1000);
+    EXPECT_TRUE(window.on_chunk_ack(1, true));
+    EXPECT_EQ(window.get_delivered_bytes(), 2000u);
+    EXPECT_FALSE(window.take_completion());
+    
+    // A late ACK of an expired chunk still completes the transfer, once
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    EXPECT_EQ(window.expire_timed_out_chunks(), 1u);
+    EXPECT_FALSE(window.on_chunk_ack(2, true));
+    EXPECT_EQ(window.get_delivered_bytes(), 3000u);
+    EXPECT_TRUE(window.take_completion());
+    EXPECT_FALSE(window.take_completion());
+}
+
+TEST(ChunkSizerTest, GrowsWithRateAndHalvesOnLoss) {
+    ChunkSizer sizer(64 * 1024, 16 * 1024, 1024 * 1024);
+    auto now = std::chrono::steady_clock::now();
+    EXPECT_EQ(sizer.update(0, 0, 0.0, now), 64u * 1024);
+    
+    // 100MB/s aims at 1MB chunks; the size at most doubles per interval
+    uint64_t delivered = 0;
+    uint32_t previous = sizer.get_size();
+    for (int i = 1; i <= 6; ++i) {
+        delivered += 5 * 1024 * 1024;
+        now += std::chrono::milliseconds(50);
+        uint32_t size = sizer.update(delivered, 0, 1.0, now);
+        EXPECT_LE(size, previous * 2);
+        EXPECT_EQ(size % 4096, 0u);
+        previous = size;
+    }
+    EXPECT_EQ(sizer.get_size(), 1024u * 1024) << "Capped at the maximum";
+    EXPECT_NEAR(sizer.get_delivery_rate(), 100.0 * 1024 * 1024, 1.0);
+    
+    // No new interval before a round trip has passed
+    EXPECT_EQ(sizer.update(delivered + 1024, 0, 200.0, now + std::chrono::milliseconds(100)), 1024u * 1024);
+    
+    // Each loss event halves the size down to the minimum
+    for (uint64_t loss = 1; loss <= 8; ++loss) {
+        sizer.update(delivered, loss, 1.0, now);
+    }
+    EXPECT_EQ(sizer.get_size(), 16u * 1024);
+    
+    // A slow link does not shrink chunks further, it only stops them growing
+    for (int i = 0; i < 4; ++i) {
+        delivered += 1024;
+        now += std::chrono::milliseconds(100);
+        EXPECT_EQ(sizer.update(delivered, 8, 1.0, now), 16u * 1024);
+    }
+}
@@ -2,6 +2,8 @@
 #include "fs.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 using namespace librats;
 
@@ -19,6 +21,7 @@ protected:
         delete_file("test_metadata.txt");
         delete_file("test_chunks.bin");
         delete_file("test_sized.bin");
+        delete_file("test_file_handle.bin");
         delete_file("validation_test.txt");
         delete_file("test_copy.txt");
         delete_file("test_file_exists.txt");
@@ -54,6 +57,7 @@ protected:
         delete_file("test_metadata.txt");
         delete_file("test_chunks.bin");
         delete_file("test_sized.bin");
+        delete_file("test_file_handle.bin");
         delete_file("validation_test.txt");
         delete_file("test_copy.txt");
         delete_file("test_file_exists.txt");
@@ -387,6 +391,50 @@ TEST_F(FSTest, CreateFileWithSize) {
     std::cout << "✓ Create file with size operation passed" << std::endl;
 }
 
+TEST_F(FSTest, FileHandlePositionalIO) {
+    const char* handle_file = "test_file_handle.bin";
+    const uint64_t file_size = 256 * 1024;
+    
+    // Create and preallocate, then write chunks out of order through one handle
+    FileHandle writer;
+    ASSERT_TRUE(writer.open(handle_file, FileOpenMode::TRUNCATE));
+    EXPECT_TRUE(writer.preallocate(file_size));
+    EXPECT_EQ(writer.size(), (int64_t)file_size);
+    
+    std::vector<uint8_t> chunk(64 * 1024);
+    for (int index = 3; index >= 0; --index) {
+        std::fill(chunk.begin(), chunk.end(), static_cast<uint8_t>(index + 1));
+        EXPECT_TRUE(writer.write_at(index * chunk.size(), chunk.data(), chunk.size()));
+    }
+    writer.close();
+    EXPECT_FALSE(writer.is_open());
+    EXPECT_EQ(get_file_size(handle_file), (int64_t)file_size);
+    
+    // Positional reads
+    FileHandle reader;
+    ASSERT_TRUE(reader.open(handle_file, FileOpenMode::READ_ONLY));
+    uint8_t buffer[16];
+    EXPECT_TRUE(reader.read_at(2 * chunk.size() + 100, buffer, sizeof(buffer)));
+    EXPECT_EQ(buffer[0], 3);
+    EXPECT_EQ(buffer[15], 3);
+    EXPECT_FALSE(reader.read_at(file_size - 8, buffer, sizeof(buffer))) << "Reading past the end should fail";
+    
+    // Mapped reads serve the same bytes
+    ASSERT_TRUE(reader.map_read_only());
+    EXPECT_TRUE(reader.is_mapped());
+    EXPECT_EQ(reader.mapped_size(), file_size);
+    EXPECT_EQ(reader.mapped_data()[chunk.size()], 2);
+    EXPECT_TRUE(reader.read_at(3 * chunk.size(), buffer, sizeof(buffer)));
+    EXPECT_EQ(buffer[0], 4);
+    EXPECT_FALSE(reader.read_at(file_size - 8, buffer, sizeof(buffer)));
+    reader.close();
+    
+    // Opening a missing file read-only fails
+    EXPECT_FALSE(reader.open("missing_file_handle.bin", FileOpenMode::READ_ONLY));
+    
+    delete_file(handle_file);
+}
+
 TEST_F(FSTest, DirectoryListingOperations) {
     const char* test_dir = "test_listing";
     const char* sub_dir = "test_listing/subdir";
@@ -209,6 +209,141 @@ TEST_F(GossipSubTest, MessageValidation) {
     EXPECT_EQ(messages_received.load(), 1); // Should still be 1, bad message rejected
 }
 
+TEST_F(GossipSubTest, LargeMessagesAreChunked) {
+    auto& gossipsub1 = client1_->get_gossipsub();
+    auto& gossipsub2 = client2_->get_gossipsub();
+
+    std::string topic = "large-topic";
+    ASSERT_TRUE(gossipsub1.subscribe(topic));
+    ASSERT_TRUE(gossipsub2.subscribe(topic));
+
+    // Wait for mesh to stabilize
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::mutex received_mutex;
+    std::vector<std::string> received;
+    gossipsub2.set_message_handler(topic, [&](const std::string& topic, const std::string& message, const std::string& sender) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received.push_back(message);
+    });
+
+    // A megabyte of arbitrary bytes spans many chunks, the last one partial
+    std::string large(1024 * 1024 + 123, '\0');
+    for (size_t i = 0; i < large.size(); ++i) {
+        large[i] = static_cast<char>((i * 131) & 0xFF);
+    }
+    ASSERT_TRUE(gossipsub1.publish(topic, large));
+
+    // Small messages are not stuck behind the large one
+    ASSERT_TRUE(gossipsub1.publish(topic, std::string("small")));
+
+    for (int i = 0; i < 50; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(received_mutex);
+            if (received.size() == 2) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::lock_guard<std::mutex> lock(received_mutex);
+    ASSERT_EQ(received.size(), 2u);
+    EXPECT_EQ(received[0], "small");
+    EXPECT_EQ(received[1], large);
+
+    EXPECT_EQ(gossipsub1.get_cache_statistics()["outgoing_chunk_streams"], 0);
+    EXPECT_EQ(gossipsub2.get_cache_statistics()["chunk_assemblies_count"], 0);
+}
+
+TEST_F(GossipSubTest, AsyncMessageValidation) {
+    auto& gossipsub1 = client1_->get_gossipsub();
+    auto& gossipsub2 = client2_->get_gossipsub();
+
+    std::string topic = "async-validation-topic";
+    ASSERT_TRUE(gossipsub1.subscribe(topic));
+    ASSERT_TRUE(gossipsub2.subscribe(topic));
+
+    // Hold every message until the test completes it
+    std::mutex pending_mutex;
+    std::vector<std::pair<std::string, ValidationCompletion>> pending;
+    gossipsub2.set_async_message_validator(topic, [&](const std::string& topic, const std::string& message,
+                                                      const std::string& sender, ValidationCompletion complete) {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.emplace_back(message, std::move(complete));
+        return ValidationResult::PENDING;
+    });
+
+    // Wait for mesh to stabilize
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::atomic<int> messages_received{0};
+    gossipsub2.set_message_handler(topic, [&](const std::string& topic, const std::string& message, const std::string& sender) {
+        messages_received++;
+    });
+
+    ASSERT_TRUE(gossipsub1.publish(topic, std::string("good message")));
+    ASSERT_TRUE(gossipsub1.publish(topic, std::string("bad message")));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // Nothing is delivered while validation is pending
+    EXPECT_EQ(messages_received.load(), 0);
+    EXPECT_EQ(gossipsub2.get_statistics()["pending_validations_count"], 2);
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        ASSERT_EQ(pending.size(), 2u);
+        for (auto& entry : pending) {
+            bool bad = entry.first.find("bad") != std::string::npos;
+            std::thread([complete = entry.second, bad]() {
+                complete(bad ? ValidationResult::REJECT : ValidationResult::ACCEPT);
+            }).join();
+        }
+    }
+
+    EXPECT_EQ(messages_received.load(), 1);
+    EXPECT_EQ(gossipsub2.get_statistics()["pending_validations_count"], 0);
+}
+
+TEST_F(GossipSubTest, BatchMessageValidation) {
+    auto& gossipsub1 = client1_->get_gossipsub();
+    auto& gossipsub2 = client2_->get_gossipsub();
+
+    std::string topic = "batch-validation-topic";
+    ASSERT_TRUE(gossipsub1.subscribe(topic));
+    ASSERT_TRUE(gossipsub2.subscribe(topic));
+
+    std::atomic<int> validated{0};
+    gossipsub2.set_batch_message_validator(topic, [&](const std::vector<ValidationRequest>& requests) {
+        std::vector<ValidationResult> results;
+        for (const auto& request : requests) {
+            EXPECT_EQ(request.topic, "batch-validation-topic");
+            results.push_back(request.message.find("bad") != std::string::npos ? ValidationResult::REJECT
+                                                                                : ValidationResult::ACCEPT);
+        }
+        validated += static_cast<int>(requests.size());
+        return results;
+    });
+
+    // Wait for mesh to stabilize
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::atomic<int> messages_received{0};
+    gossipsub2.set_message_handler(topic, [&](const std::string& topic, const std::string& message, const std::string& sender) {
+        messages_received++;
+    });
+
+    const int num_messages = 20;
+    for (int i = 0; i < num_messages; i++) {
+        std::string message = (i % 4 == 0 ? "bad " : "good ") + std::to_string(i);
+        ASSERT_TRUE(gossipsub1.publish(topic, message));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    EXPECT_EQ(validated.load(), num_messages);
+    EXPECT_EQ(messages_received.load(), num_messages - num_messages / 4);
+}
+
 TEST_F(GossipSubTest, Unsubscription) {
     auto& gossipsub1 = client1_->get_gossipsub();
     auto& gossipsub2 = client2_->get_gossipsub();
@@ -302,6 +437,58 @@ TEST_F(GossipSubTest, Statistics) {
     EXPECT_TRUE(cache_stats.contains("seen_message_ids_count"));
 }
 
+TEST_F(GossipSubTest, TrafficCountersAndConfig) {
+    auto& gossipsub1 = client1_->get_gossipsub();
+    auto& gossipsub2 = client2_->get_gossipsub();
+
+    // The configuration is fixed while running
+    GossipSubConfig config = gossipsub1.get_config();
+    config.mesh_optimal = 3;
+    EXPECT_FALSE(gossipsub1.set_config(config));
+    EXPECT_EQ(gossipsub1.get_config().mesh_optimal, 6);
+
+    ASSERT_TRUE(gossipsub1.subscribe("traffic-topic"));
+    ASSERT_TRUE(gossipsub2.subscribe("traffic-topic"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TRUE(gossipsub1.publish("traffic-topic", "traffic " + std::to_string(i)));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    auto stats = gossipsub2.get_statistics();
+    EXPECT_EQ(stats["messages_delivered"], 5);
+    EXPECT_EQ(stats["publish_received"], 5);
+    EXPECT_EQ(stats["duplicate_publish_received"], 0);
+    EXPECT_GT(stats["frame_bytes_received"].get<uint64_t>(), 0u);
+
+    // A stopped instance accepts a new configuration
+    RatsClient stopped(8085);
+    EXPECT_TRUE(stopped.get_gossipsub().set_config(config));
+    EXPECT_EQ(stopped.get_gossipsub().get_config().mesh_optimal, 3);
+}
+
+TEST_F(GossipSubTest, ContentAddressedMessageIds) {
+    auto& gossipsub1 = client1_->get_gossipsub();
+    ASSERT_TRUE(gossipsub1.subscribe("dedup-topic"));
+    
+    // Same payload on the same topic is one message; other topics are distinct
+    EXPECT_TRUE(gossipsub1.publish("dedup-topic", std::string("payload")));
+    EXPECT_FALSE(gossipsub1.publish("dedup-topic", std::string("payload")));
+    EXPECT_TRUE(gossipsub1.publish("other-topic", std::string("payload")));
+    
+    // A custom ID function can make repeated payloads distinct again
+    std::atomic<int> sequence(0);
+    gossipsub1.set_message_id_function([&](const std::string& topic, const std::string& message, const std::string& sender) {
+        return topic + "/" + sender + "/" + std::to_string(sequence++);
+    });
+    EXPECT_TRUE(gossipsub1.publish("dedup-topic", std::string("payload")));
+    EXPECT_TRUE(gossipsub1.publish("dedup-topic", std::string("payload")));
+    
+    gossipsub1.set_message_id_function(nullptr);
+    EXPECT_FALSE(gossipsub1.publish("dedup-topic", std::string("payload")));
+}
+
 // Performance test for high-frequency publishing
 TEST_F(GossipSubTest, HighFrequencyPublishing) {
     auto& gossipsub1 = client1_->get_gossipsub();
@@ -334,4 +521,338 @@ TEST_F(GossipSubTest, HighFrequencyPublishing) {
     EXPECT_GE(messages_received.load(), num_messages * 0.8); // At least 80% delivery rate
 }
 
- 
\ No newline at end of file
+// Topics live in independently locked shards; publishing on many topics from several
+// threads while the heartbeat runs must keep every topic's mesh and delivery intact
+TEST_F(GossipSubTest, ConcurrentPublishingAcrossTopics) {
+    auto& gossipsub1 = client1_->get_gossipsub();
+    auto& gossipsub2 = client2_->get_gossipsub();
+
+    const int num_topics = 8;
+    const int messages_per_topic = 20;
+    std::atomic<int> messages_received{0};
+    for (int t = 0; t < num_topics; t++) {
+        std::string topic = "sharded-topic-" + std::to_string(t);
+        ASSERT_TRUE(gossipsub1.subscribe(topic));
+        ASSERT_TRUE(gossipsub2.subscribe(topic));
+        gossipsub2.set_message_handler(topic, [&](const std::string&, const std::string&, const std::string&) {
+            messages_received++;
+        });
+    }
+    EXPECT_EQ(gossipsub1.get_subscribed_topics().size(), static_cast<size_t>(num_topics));
+
+    // Wait for mesh to stabilize
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::vector<std::thread> publishers;
+    for (int t = 0; t < num_topics; t++) {
+        publishers.emplace_back([&, t]() {
+            std::string topic = "sharded-topic-" + std::to_string(t);
+            for (int i = 0; i < messages_per_topic; i++) {
+                gossipsub1.publish(topic, "Message " + std::to_string(i));
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+    }
+    for (auto& publisher : publishers) {
+        publisher.join();
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+
+    EXPECT_GE(messages_received.load(), num_topics * messages_per_topic * 0.8);
+    for (int t = 0; t < num_topics; t++) {
+        EXPECT_EQ(gossipsub1.get_mesh_peers("sharded-topic-" + std::to_string(t)).size(), 1u);
+    }
+
+    // Unsubscribing keeps the other shards' topics
+    ASSERT_TRUE(gossipsub1.unsubscribe("sharded-topic-0"));
+    EXPECT_FALSE(gossipsub1.is_subscribed("sharded-topic-0"));
+    EXPECT_TRUE(gossipsub1.is_subscribed("sharded-topic-1"));
+    EXPECT_EQ(gossipsub1.get_statistics()["subscribed_topics_count"], num_topics - 1);
+}
+
+ 
+namespace {
+
+MessageCache::Envelope make_envelope(const std::string& body) {
+    auto record = std::make_shared<GossipSubRecord>(GossipSubMessageType::PUBLISH, "topic");
+    record->message = body;
+    return record;
+}
+
+} // namespace
+
+TEST(MessageCacheTest, ServesSharedEnvelopeAndSlidesWindows) {
+    MessageCache cache(3, 2, 100, 1024);
+    
+    auto envelope = make_envelope("hello");
+    EXPECT_TRUE(cache.put("m1", "topic", envelope, 5));
+    EXPECT_FALSE(cache.put("m1", "topic", envelope, 5));
+    
+    // The cached body is the same object the send path holds, not a copy
+    EXPECT_EQ(cache.get("m1").get(), envelope.get());
+    EXPECT_EQ(cache.get("m1")->message, "hello");
+    EXPECT_EQ(cache.get("missing"), nullptr);
+    
+    cache.put("other", "different-topic", make_envelope("x"), 1);
+    EXPECT_EQ(cache.get_gossip_ids("topic", 10), std::vector<std::string>{"m1"});
+    
+    // After history_gossip shifts the message is no longer advertised but can still be served
+    cache.shift();
+    cache.shift();
+    EXPECT_TRUE(cache.get_gossip_ids("topic", 10).empty());
+    EXPECT_NE(cache.get("m1"), nullptr);
+    
+    // After history_length shifts it is dropped
+    cache.shift();
+    EXPECT_EQ(cache.get("m1"), nullptr);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.bytes(), 0u);
+}
+
+TEST(MessageCacheTest, EvictsOldestWhenOverLimits) {
+    MessageCache count_limited(5, 3, 2, 1024);
+    count_limited.put("a", "t", make_envelope("a"), 1);
+    count_limited.shift();
+    count_limited.put("b", "t", make_envelope("b"), 1);
+    count_limited.put("c", "t", make_envelope("c"), 1);
+    EXPECT_FALSE(count_limited.contains("a"));
+    EXPECT_TRUE(count_limited.contains("b"));
+    EXPECT_TRUE(count_limited.contains("c"));
+    EXPECT_EQ(count_limited.get_gossip_ids("t", 10), (std::vector<std::string>{"c", "b"}));
+    EXPECT_EQ(count_limited.get_gossip_ids("t", 1), std::vector<std::string>{"c"});
+    
+    MessageCache byte_limited(5, 3, 100, 10);
+    byte_limited.put("a", "t", make_envelope("a"), 6);
+    byte_limited.put("b", "t", make_envelope("b"), 6);
+    EXPECT_FALSE(byte_limited.contains("a"));
+    EXPECT_TRUE(byte_limited.contains("b"));
+    EXPECT_EQ(byte_limited.bytes(), 6u);
+    EXPECT_FALSE(byte_limited.put("huge", "t", make_envelope("huge"), 11));
+}
+
+TEST(GossipSubFrameTest, RoundTripsRecords) {
+    const std::string sha1_id = "0123456789abcdef0123456789abcdef01234567";
+    
+    GossipSubRecord publish(GossipSubMessageType::PUBLISH, "chat");
+    publish.message_id = sha1_id;
+    publish.sender_peer_id = "not-a-sha1-peer-id";
+    publish.timestamp = 1234567890123;
+    publish.message = std::string("binary\0payload", 14);
+    
+    GossipSubRecord ihave(GossipSubMessageType::IHAVE, "chat");
+    ihave.message_ids = {sha1_id, "short-id"};
+    
+    GossipSubRecord graft(GossipSubMessageType::GRAFT, "chat");
+    
+    std::vector<uint8_t> frame;
+    GossipSubFrame::begin(frame);
+    GossipSubFrame::append(publish, frame);
+    GossipSubFrame::append(ihave, frame);
+    GossipSubFrame::append(graft, frame);
+    ASSERT_TRUE(GossipSubFrame::is_gossipsub_frame(frame.data(), frame.size()));
+    
+    std::vector<GossipSubRecord> records;
+    ASSERT_TRUE(GossipSubFrame::decode(frame.data(), frame.size(), records));
+    ASSERT_EQ(records.size(), 3u);
+    
+    EXPECT_EQ(records[0].type, GossipSubMessageType::PUBLISH);
+    EXPECT_EQ(records[0].topic, "chat");
+    EXPECT_EQ(records[0].message_id, sha1_id);
+    EXPECT_EQ(records[0].sender_peer_id, "not-a-sha1-peer-id");
+    EXPECT_EQ(records[0].timestamp, 1234567890123);
+    EXPECT_EQ(records[0].message, publish.message);
+    
+    EXPECT_EQ(records[1].type, GossipSubMessageType::IHAVE);
+    EXPECT_EQ(records[1].message_ids, ihave.message_ids);
+    
+    EXPECT_EQ(records[2].type, GossipSubMessageType::GRAFT);
+    EXPECT_EQ(records[2].topic, "chat");
+    
+    // SHA1 ids travel as 20 raw bytes rather than 40 hex characters
+    std::vector<uint8_t> id_only;
+    GossipSubRecord iwant(GossipSubMessageType::IWANT, "");
+    iwant.message_ids = {sha1_id};
+    GossipSubFrame::append(iwant, id_only);
+    EXPECT_EQ(id_only.size(), 1u + 1u + 1u + 1u + 20u);
+}
+
+TEST(GossipSubFrameTest, RoundTripsChunkAndIdontwant) {
+    const std::string sha1_id = "0123456789abcdef0123456789abcdef01234567";
+    
+    GossipSubRecord chunk(GossipSubMessageType::CHUNK, "files");
+    chunk.message_id = sha1_id;
+    chunk.sender_peer_id = "sender";
+    chunk.timestamp = 42;
+    chunk.chunk_index = 3;
+    chunk.chunk_count = 17;
+    chunk.message = std::string("piece\0of\0data", 14);
+    
+    GossipSubRecord idontwant(GossipSubMessageType::IDONTWANT, "files");
+    idontwant.message_ids = {sha1_id};
+    
+    std::vector<uint8_t> frame;
+    GossipSubFrame::begin(frame);
+    GossipSubFrame::append(chunk, frame);
+    GossipSubFrame::append(idontwant, frame);
+    
+    std::vector<GossipSubRecord> records;
+    ASSERT_TRUE(GossipSubFrame::decode(frame.data(), frame.size(), records));
+    ASSERT_EQ(records.size(), 2u);
+    
+    EXPECT_EQ(records[0].type, GossipSubMessageType::CHUNK);
+    EXPECT_EQ(records[0].message_id, sha1_id);
+    EXPECT_EQ(records[0].sender_peer_id, "sender");
+    EXPECT_EQ(records[0].timestamp, 42);
+    EXPECT_EQ(records[0].chunk_index, 3u);
+    EXPECT_EQ(records[0].chunk_count, 17u);
+    EXPECT_EQ(records[0].message, chunk.message);
+    
+    EXPECT_EQ(records[1].type, GossipSubMessageType::IDONTWANT);
+    EXPECT_EQ(records[1].message_ids, idontwant.message_ids);
+    
+    // The JSON codec carries the same fields
+    GossipSubRecord parsed = GossipSubRecord::from_payload(GossipSubMessageType::CHUNK, chunk.to_payload());
+    EXPECT_EQ(parsed.chunk_index, 3u);
+    EXPECT_EQ(parsed.chunk_count, 17u);
+    EXPECT_EQ(parsed.message_id, sha1_id);
+}
+
+TEST(GossipSubFrameTest, RejectsMalformedFrames) {
+    GossipSubRecord publish(GossipSubMessageType::PUBLISH, "chat");
+    publish.message_id = "id";
+    publish.message = "hello";
+    
+    std::vector<uint8_t> frame;
+    GossipSubFrame::begin(frame);
+    GossipSubFrame::append(publish, frame);
+    
+    std::vector<GossipSubRecord> records;
+    for (size_t size = GossipSubFrame::HEADER_SIZE + 1; size < frame.size(); ++size) {
+        records.clear();
+        EXPECT_FALSE(GossipSubFrame::decode(frame.data(), size, records)) << "truncated at " << size;
+    }
+    
+    std::vector<uint8_t> wrong_version = frame;
+    wrong_version[4] = GossipSubFrame::VERSION + 1;
+    EXPECT_FALSE(GossipSubFrame::decode(wrong_version.data(), wrong_version.size(), records));
+    
+    // A huge id count must fail on the missing bytes instead of allocating for it
+    std::vector<uint8_t> huge_count;
+    GossipSubFrame::begin(huge_count);
+    huge_count.insert(huge_count.end(), {static_cast<uint8_t>(GossipSubMessageType::IWANT), 0,
+                                         0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F});
+    records.clear();
+    EXPECT_FALSE(GossipSubFrame::decode(huge_count.data(), huge_count.size(), records));
+    
+    const uint8_t not_gossipsub[] = {'F', 'T', 'C', 'K', 1};
+    EXPECT_FALSE(GossipSubFrame::is_gossipsub_frame(not_gossipsub, sizeof(not_gossipsub)));
+}
+
+TEST(SeenMessageFilterTest, RemembersIdsForTheWindow) {
+    using Clock = SeenMessageFilter::Clock;
+    SeenMessageFilter filter(std::chrono::seconds(10), 5, 1000, 1e-6, 100);
+    auto start = Clock::now();
+    
+    EXPECT_TRUE(filter.insert("a", start));
+    EXPECT_FALSE(filter.insert("a", start));
+    EXPECT_TRUE(filter.contains("a", start + std::chrono::seconds(3)));
+    EXPECT_FALSE(filter.contains("b", start));
+    
+    // Still remembered at the end of the window (from the Bloom filters once the exact set rotated)
+    EXPECT_TRUE(filter.contains("a", start + std::chrono::milliseconds(9900)));
+    EXPECT_EQ(filter.exact_size(), 0u);
+    
+    // Forgotten once the window has passed
+    EXPECT_FALSE(filter.contains("a", start + std::chrono::seconds(13)));
+    EXPECT_EQ(filter.size(), 0u);
+}
+
+TEST(SeenMessageFilterTest, MemoryStaysFlatUnderLoad) {
+    using Clock = SeenMessageFilter::Clock;
+    SeenMessageFilter filter(std::chrono::seconds(5), 5, 10000, 1e-4, 256);
+    size_t bytes = filter.filter_bytes();
+    auto now = Clock::now();
+    
+    // 100k distinct ids over 10 seconds, ten times the configured capacity per window
+    for (int i = 0; i < 100000; ++i) {
+        filter.insert("message-" + std::to_string(i), now + std::chrono::microseconds(i * 100));
+    }
+    
+    EXPECT_EQ(filter.filter_bytes(), bytes);
+    EXPECT_LE(filter.exact_size(), 512u);
+    EXPECT_TRUE(filter.contains("message-99999", now + std::chrono::seconds(10)));
+    
+    // At the configured rate (capacity spread over the window) false positives stay rare
+    SeenMessageFilter sized(std::chrono::seconds(5), 5, 10000, 1e-4, 0);
+    for (int i = 0; i < 10000; ++i) {
+        sized.insert("seen-" + std::to_string(i), now + std::chrono::microseconds(i * 450));
+    }
+    auto check_time = now + std::chrono::milliseconds(4500);
+    int false_positives = 0;
+    for (int i = 0; i < 10000; ++i) {
+        false_positives += sized.contains("unseen-" + std::to_string(i), check_time) ? 1 : 0;
+    }
+    EXPECT_TRUE(sized.contains("seen-0", check_time));
+    EXPECT_LT(false_positives, 20);
+}
+
+TEST(PeerScoreTest, CountersUpdateAndDecay) {
+    PeerScoreParams params;
+    params.topic_score_cap = 5.0;
+    PeerScore score("peer", params);
+    EXPECT_DOUBLE_EQ(score.score, 0.0);
+    
+    // P2 is capped by the topic score cap
+    for (int i = 0; i < 100; ++i) {
+        score.deliver_first_message("topic");
+    }
+    EXPECT_DOUBLE_EQ(score.score, 5.0);
+    
+    // P4 is squared: two invalid messages cost 4x the weight
+    PeerScore invalid("invalid", params);
+    invalid.reject_message("topic");
+    EXPECT_DOUBLE_EQ(invalid.score, -5.0);
+    invalid.reject_message("topic");
+    EXPECT_DOUBLE_EQ(invalid.score, -20.0);
+    
+    // Counters decay every heartbeat and the topic is forgotten once they reach zero
+    for (int i = 0; i < 1000; ++i) {
+        invalid.decay();
+    }
+    EXPECT_DOUBLE_EQ(invalid.score, 0.0);
+    EXPECT_TRUE(invalid.topics.empty());
+    
+    // P5 and P7 apply outside the topic cap
+    PeerScore app("app", params);
+    app.set_application_score(-3.0);
+    app.add_behaviour_penalty(2.0);
+    EXPECT_DOUBLE_EQ(app.score, -3.0 - 5.0 * 4.0);
+}
+
+TEST(PeerScoreTest, MeshMembershipScoring) {
+    PeerScoreParams params;
+    TopicScoreParams strict;
+    strict.time_in_mesh_weight = 0.0;
+    strict.mesh_message_deliveries_weight = -1.0;
+    strict.mesh_message_deliveries_threshold = 4.0;
+    strict.mesh_message_deliveries_activation = std::chrono::milliseconds(0);
+    strict.mesh_failure_penalty_weight = -1.0;
+    params.topics["strict"] = strict;
+    
+    PeerScore score("peer", params);
+    score.graft("strict");
+    EXPECT_DOUBLE_EQ(score.score, 0.0);
+    
+    // After activation a mesh peer that delivers nothing is penalized by the squared deficit (P3)
+    score.decay();
+    EXPECT_DOUBLE_EQ(score.score, -16.0);
+    score.deliver_first_message("strict");
+    score.deliver_first_message("strict");
+    EXPECT_NEAR(score.score, 2 * strict.first_message_deliveries_weight - 4.0, 1e-9);
+    
+    // Leaving the mesh with a deficit keeps a sticky penalty (P3b)
+    score.prune("strict");
+    EXPECT_NEAR(score.score, 2 * strict.first_message_deliveries_weight - 4.0, 1e-9);
+    EXPECT_FALSE(score.topics["strict"].in_mesh);
+}
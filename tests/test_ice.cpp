@@ -4,6 +4,9 @@
 #include "stun.h"
 #include <thread>
 #include <chrono>
+#include <functional>
+#include <atomic>
+#include <mutex>
 
 class IceTest : public ::testing::Test {
 protected:
@@ -270,4 +273,334 @@ TEST_F(IceTest, NatTraversalConfigTest) {
     EXPECT_EQ(config.host_candidate_priority, 65535);
     EXPECT_EQ(config.server_reflexive_priority, 65534);
     EXPECT_EQ(config.relay_candidate_priority, 65533);
-} 
\ No newline at end of file
+} 
+namespace {
+
+// Run two agents against each other on this host, trickling candidates between them
+bool connect_agents(librats::IceAgent& a, librats::IceAgent& b, int timeout_ms) {
+    a.set_candidate_callback([&b](const librats::IceCandidate& candidate) { b.add_remote_candidate(candidate); });
+    b.set_candidate_callback([&a](const librats::IceCandidate& candidate) { a.add_remote_candidate(candidate); });
+    
+    auto a_credentials = a.get_local_credentials();
+    auto b_credentials = b.get_local_credentials();
+    a.set_remote_credentials(b_credentials.first, b_credentials.second);
+    b.set_remote_credentials(a_credentials.first, a_credentials.second);
+    
+    a.gather_candidates();
+    b.gather_candidates();
+    a.start_connectivity_checks();
+    b.start_connectivity_checks();
+    
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (a.is_connected() && b.is_connected()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+librats::IceConfig local_only_config() {
+    librats::IceConfig config;
+    config.enable_server_reflexive_candidates = false;
+    config.enable_relay_candidates = false;
+    config.connectivity_check_timeout_ms = 5000;
+    return config;
+}
+
+} // namespace
+
+TEST_F(IceTest, ConnectivityChecksWithTrickleAndRegularNomination) {
+    librats::IceAgent controlling(librats::IceRole::CONTROLLING, local_only_config());
+    librats::IceAgent controlled(librats::IceRole::CONTROLLED, local_only_config());
+    ASSERT_TRUE(controlling.start());
+    ASSERT_TRUE(controlled.start());
+    
+    auto start = std::chrono::steady_clock::now();
+    bool connected = connect_agents(controlling, controlled, 3000);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (controlling.get_local_candidates().empty()) {
+        GTEST_SKIP() << "No non-loopback interface available for host candidates";
+    }
+    
+    ASSERT_TRUE(connected);
+    EXPECT_LT(elapsed.count(), 1000);
+    
+    // The controlling agent nominated a pair that both sides validated
+    auto selected = controlling.get_selected_pair();
+    EXPECT_TRUE(selected.succeeded);
+    EXPECT_TRUE(selected.nominated);
+    EXPECT_TRUE(selected.use_candidate);
+    EXPECT_TRUE(controlled.get_selected_pair().remote_nominated);
+    
+    controlling.stop();
+    controlled.stop();
+}
+
+TEST_F(IceTest, AggressiveNominationSelectsFirstValidPair) {
+    librats::IceConfig config = local_only_config();
+    config.aggressive_nomination = true;
+    librats::IceAgent controlling(librats::IceRole::CONTROLLING, config);
+    librats::IceAgent controlled(librats::IceRole::CONTROLLED, config);
+    ASSERT_TRUE(controlling.start());
+    ASSERT_TRUE(controlled.start());
+    
+    bool connected = connect_agents(controlling, controlled, 3000);
+    if (controlling.get_local_candidates().empty()) {
+        GTEST_SKIP() << "No non-loopback interface available for host candidates";
+    }
+    ASSERT_TRUE(connected);
+    
+    // Every check carried USE-CANDIDATE, so the first response completed nomination
+    auto selected = controlling.get_selected_pair();
+    EXPECT_TRUE(selected.use_candidate);
+    EXPECT_EQ(selected.check_count, 1);
+    
+    controlling.stop();
+    controlled.stop();
+}
+
+TEST_F(IceTest, SessionsShareOneAgentAcrossPeers) {
+    librats::IceAgent hub(librats::IceRole::CONTROLLING, local_only_config());
+    librats::IceAgent peer_b(librats::IceRole::CONTROLLED, local_only_config());
+    librats::IceAgent peer_c(librats::IceRole::CONTROLLED, local_only_config());
+    ASSERT_TRUE(hub.start());
+    ASSERT_TRUE(peer_b.start());
+    ASSERT_TRUE(peer_c.start());
+    
+    auto wait_for = [](const std::function<bool()>& condition) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(3000);
+        while (!condition() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return condition();
+    };
+    
+    hub.gather_candidates();
+    peer_b.gather_candidates();
+    peer_c.gather_candidates();
+    if (!wait_for([&] { return !hub.get_local_candidates().empty(); })) {
+        GTEST_SKIP() << "No non-loopback interface available for host candidates";
+    }
+    ASSERT_TRUE(wait_for([&] {
+        return !peer_b.get_local_candidates().empty() && !peer_c.get_local_candidates().empty();
+    }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));  // Let host gathering finish
+    
+    // Gathering again for the next peer reuses the cached candidates
+    auto gathered = hub.get_local_candidates();
+    hub.gather_candidates();
+    EXPECT_EQ(hub.get_local_candidates().size(), gathered.size());
+    
+    std::vector<std::pair<std::string, librats::IceAgent*>> peers = {{"peer_b", &peer_b}, {"peer_c", &peer_c}};
+    for (const auto& entry : peers) {
+        const std::string& session_id = entry.first;
+        librats::IceAgent& peer = *entry.second;
+        ASSERT_TRUE(hub.create_session(session_id));
+        
+        auto hub_credentials = hub.get_session_credentials(session_id);
+        auto peer_credentials = peer.get_local_credentials();
+        peer.set_remote_credentials(hub_credentials.first, hub_credentials.second);
+        hub.set_session_remote_credentials(session_id, peer_credentials.first, peer_credentials.second);
+        peer.add_remote_candidates(gathered);
+        for (const auto& candidate : peer.get_local_candidates()) {
+            hub.add_session_remote_candidate(session_id, candidate);
+        }
+        
+        hub.start_session_checks(session_id);
+        peer.start_connectivity_checks();
+    }
+    EXPECT_EQ(hub.get_session_count(), 3u);
+    EXPECT_NE(hub.get_session_credentials("peer_b").first, hub.get_session_credentials("peer_c").first);
+    
+    ASSERT_TRUE(wait_for([&] {
+        return hub.get_session_state("peer_b") == librats::IceConnectionState::CONNECTED &&
+               hub.get_session_state("peer_c") == librats::IceConnectionState::CONNECTED &&
+               peer_b.is_connected() && peer_c.is_connected();
+    }));
+    
+    // Both sessions run over the hub's one socket and each selected its own peer
+    auto to_b = hub.get_session_selected_pair("peer_b");
+    auto to_c = hub.get_session_selected_pair("peer_c");
+    EXPECT_EQ(to_b.local.port, to_c.local.port);
+    EXPECT_EQ(to_b.remote.port, peer_b.get_local_candidates().front().port);
+    EXPECT_EQ(to_c.remote.port, peer_c.get_local_candidates().front().port);
+    
+    hub.close_session("peer_b");
+    EXPECT_FALSE(hub.has_session("peer_b"));
+    EXPECT_EQ(hub.get_session_count(), 2u);
+    
+    hub.stop();
+    peer_b.stop();
+    peer_c.stop();
+}
+
+namespace {
+
+// Minimal TURN server: answers Allocate and ChannelBind, counts relayed packets by framing
+class FakeTurnServer {
+public:
+    FakeTurnServer() {
+        socket_ = librats::create_udp_socket_v4(0);
+        sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        getsockname(socket_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+        port_ = ntohs(addr.sin_port);
+        thread_ = std::thread([this]() { run(); });
+    }
+    
+    ~FakeTurnServer() {
+        running_ = false;
+        thread_.join();
+        librats::close_socket(socket_);
+    }
+    
+    uint16_t port() const { return port_; }
+    int send_indications() const { return send_indications_.load(); }
+    int channel_data() const { return channel_data_.load(); }
+    int deallocations() const { return deallocations_.load(); }
+    uint16_t bound_channel() const { return bound_channel_.load(); }
+    
+    // Relay data from a peer to the client, framed as ChannelData or as a Data indication
+    void relay_channel_data(uint16_t channel, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> packet = {static_cast<uint8_t>(channel >> 8), static_cast<uint8_t>(channel),
+                                       0, static_cast<uint8_t>(data.size())};
+        packet.insert(packet.end(), data.begin(), data.end());
+        send_to_client(packet);
+    }
+    
+    void relay_data_indication(uint32_t peer_ip, uint16_t peer_port, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> packet = {0x00, 0x17, 0x00, 0x00, 0x21, 0x12, 0xA4, 0x42};
+        packet.resize(20, 0x5A);
+        append_xor_address(packet, 0x0012, peer_ip, peer_port);
+        std::vector<uint8_t> attr = {0x00, 0x13, 0x00, static_cast<uint8_t>(data.size())};
+        attr.insert(attr.end(), data.begin(), data.end());
+        attr.resize(4 + ((data.size() + 3) & ~size_t(3)), 0);
+        packet.insert(packet.end(), attr.begin(), attr.end());
+        packet[3] = static_cast<uint8_t>(packet.size() - 20);
+        send_to_client(packet);
+    }
+    
+private:
+    static void append_xor_address(std::vector<uint8_t>& packet, uint16_t type, uint32_t ip, uint16_t port) {
+        uint16_t xport = port ^ 0x2112;
+        uint32_t xip = ip ^ 0x2112A442;
+        std::vector<uint8_t> attr = {static_cast<uint8_t>(type >> 8), static_cast<uint8_t>(type), 0x00, 0x08, 0x00, 0x01,
+                                     static_cast<uint8_t>(xport >> 8), static_cast<uint8_t>(xport),
+                                     static_cast<uint8_t>(xip >> 24), static_cast<uint8_t>(xip >> 16),
+                                     static_cast<uint8_t>(xip >> 8), static_cast<uint8_t>(xip)};
+        packet.insert(packet.end(), attr.begin(), attr.end());
+    }
+    
+    void send_to_client(const std::vector<uint8_t>& packet) {
+        std::lock_guard<std::mutex> lock(client_mutex_);
+        librats::send_udp_data_to(socket_, packet, client_ip_, client_port_);
+    }
+    
+    void respond(const std::vector<uint8_t>& request, uint16_t type, const std::vector<uint8_t>& attributes) {
+        std::vector<uint8_t> response = {static_cast<uint8_t>(type >> 8), static_cast<uint8_t>(type),
+                                         0x00, static_cast<uint8_t>(attributes.size()), 0x21, 0x12, 0xA4, 0x42};
+        response.insert(response.end(), request.begin() + 8, request.begin() + 20);
+        response.insert(response.end(), attributes.begin(), attributes.end());
+        send_to_client(response);
+    }
+    
+    void run() {
+        while (running_) {
+            std::string ip;
+            int port = 0;
+            auto request = librats::receive_udp_data_with_timeout(socket_, 2048, 50, &ip, &port);
+            if (request.size() < 4) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                client_ip_ = ip;
+                client_port_ = port;
+            }
+            if ((request[0] & 0xC0) == 0x40) {
+                channel_data_++;
+                continue;
+            }
+            uint16_t type = (static_cast<uint16_t>(request[0]) << 8) | request[1];
+            if (type == 0x0003) {           // Allocate: relayed address 127.0.0.1:40000, lifetime 600s
+                std::vector<uint8_t> attributes;
+                append_xor_address(attributes, 0x0016, 0x7F000001, 40000);
+                std::vector<uint8_t> lifetime = {0x00, 0x0D, 0x00, 0x04, 0x00, 0x00, 0x02, 0x58};
+                attributes.insert(attributes.end(), lifetime.begin(), lifetime.end());
+                respond(request, 0x0103, attributes);
+            } else if (type == 0x0009) {    // ChannelBind: CHANNEL-NUMBER is the first attribute
+                bound_channel_ = (static_cast<uint16_t>(request[24]) << 8) | request[25];
+                respond(request, 0x0109, {});
+            } else if (type == 0x0016) {
+                send_indications_++;
+            } else if (type == 0x0004 && request.size() >= 28 && request[24] == 0 && request[25] == 0 &&
+                       request[26] == 0 && request[27] == 0) {
+                deallocations_++;
+            }
+        }
+    }
+    
+    socket_t socket_;
+    uint16_t port_ = 0;
+    std::mutex client_mutex_;
+    std::string client_ip_;
+    int client_port_ = 0;
+    std::atomic<int> send_indications_{0};
+    std::atomic<int> channel_data_{0};
+    std::atomic<int> deallocations_{0};
+    std::atomic<uint16_t> bound_channel_{0};
+    std::atomic<bool> running_{true};
+    std::thread thread_;
+};
+
+bool wait_until(const std::function<bool()>& condition, int timeout_ms = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!condition() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return condition();
+}
+
+} // namespace
+
+TEST_F(IceTest, TurnChannelBindingFastPath) {
+    FakeTurnServer server;
+    librats::TurnClient client("127.0.0.1", server.port(), "", "");
+    
+    std::string relayed_ip;
+    uint16_t relayed_port = 0;
+    ASSERT_TRUE(client.allocate_relay(relayed_ip, relayed_port, 2000));
+    EXPECT_EQ(relayed_ip, "127.0.0.1");
+    EXPECT_EQ(relayed_port, 40000);
+    
+    // The first packet to a peer goes in a Send indication and starts a channel bind
+    EXPECT_TRUE(client.send_data({1, 2, 3}, "10.0.0.5", 7000));
+    ASSERT_TRUE(wait_until([&] { return server.send_indications() == 1; }));
+    EXPECT_FALSE(client.has_channel("10.0.0.5", 7000));
+    
+    // Feeding the ChannelBind success response switches the peer to ChannelData
+    std::string from_ip;
+    uint16_t from_port = 0;
+    EXPECT_TRUE(client.receive_data(from_ip, from_port, 200).empty());
+    ASSERT_TRUE(client.has_channel("10.0.0.5", 7000));
+    EXPECT_TRUE(client.send_data({4, 5, 6}, "10.0.0.5", 7000));
+    ASSERT_TRUE(wait_until([&] { return server.channel_data() == 1; }));
+    EXPECT_EQ(server.send_indications(), 1);
+    
+    // Relayed data comes back attributed to the peer, in either framing
+    server.relay_channel_data(server.bound_channel(), {7, 8});
+    EXPECT_EQ(client.receive_data(from_ip, from_port, 1000), std::vector<uint8_t>({7, 8}));
+    EXPECT_EQ(from_ip, "10.0.0.5");
+    EXPECT_EQ(from_port, 7000);
+    
+    server.relay_data_indication(0x0A000006, 7001, {9});
+    EXPECT_EQ(client.receive_data(from_ip, from_port, 1000), std::vector<uint8_t>({9}));
+    EXPECT_EQ(from_ip, "10.0.0.6");
+    EXPECT_EQ(from_port, 7001);
+    
+    // Deallocation is a Refresh with a zero lifetime
+    client.deallocate();
+    EXPECT_TRUE(wait_until([&] { return server.deallocations() == 1; }));
+}
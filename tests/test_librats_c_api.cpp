@@ -846,4 +846,118 @@ TEST_F(RatsCApiTest, FileTransferInvalidControl) {
 
     rats_destroy(client1);
     client1 = nullptr;
-}
\ No newline at end of file
+}
+// Polling interface: argument checks and waking a blocked poller
+TEST_F(RatsCApiTest, EventPollingApis) {
+    client1 = rats_create(0);
+    ASSERT_NE(client1, nullptr);
+
+    rats_event_t events[4];
+    EXPECT_EQ(rats_poll_events(nullptr, events, 4, 0), RATS_ERROR_INVALID_HANDLE);
+    EXPECT_EQ(rats_poll_events(client1, nullptr, 4, 0), RATS_ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(rats_enable_event_polling(client1, 1 << 10, 0), RATS_ERROR_INVALID_PARAMETER);
+    EXPECT_EQ(rats_send_binary_many(client1, nullptr, 3), 0);
+    EXPECT_EQ(rats_buffer_data(nullptr), nullptr);
+    EXPECT_EQ(rats_buffer_size(nullptr), 0u);
+    rats_buffer_release(nullptr);
+
+    ASSERT_EQ(rats_enable_event_polling(client1, RATS_EVENT_ALL, 16), RATS_SUCCESS);
+    EXPECT_EQ(rats_poll_events(client1, events, 4, 10), 0);
+
+    // Disabling polling releases a poller waiting without a timeout
+    std::thread poller([this]() {
+        rats_event_t polled[1];
+        EXPECT_EQ(rats_poll_events(client1, polled, 1, -1), 0);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(rats_enable_event_polling(client1, 0, 0), RATS_SUCCESS);
+    poller.join();
+
+    int count = -1;
+    rats_buffer_t ids = rats_get_peer_ids_lent(client1, &count);
+    ASSERT_NE(ids, nullptr);
+    EXPECT_EQ(count, 0);
+    rats_buffer_release(ids);
+}
+
+// Lent receive buffers, batched events and batched sends between two clients
+TEST_F(RatsCApiTest, EventPollingAndBatchedSend) {
+    const int server_port = 59051;
+    const int client_port = 59052;
+
+    client1 = rats_create(server_port);
+    client2 = rats_create(client_port);
+    ASSERT_NE(client1, nullptr);
+    ASSERT_NE(client2, nullptr);
+
+    ASSERT_EQ(rats_enable_event_polling(client1, RATS_EVENT_ALL, 0), RATS_SUCCESS);
+    ASSERT_EQ(rats_start(client1), RATS_SUCCESS);
+    ASSERT_EQ(rats_start(client2), RATS_SUCCESS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(rats_connect_with_strategy(client2, "127.0.0.1", server_port, RATS_STRATEGY_DIRECT_ONLY), RATS_SUCCESS);
+
+    rats_event_t events[16];
+    int polled = rats_poll_events(client1, events, 16, 2000);
+    ASSERT_GE(polled, 1);
+    EXPECT_EQ(events[0].type, RATS_EVENT_CONNECTED);
+    EXPECT_EQ(events[0].data, nullptr);
+    std::string client2_id = events[0].peer_id;
+    for (int i = 0; i < polled; ++i) {
+        rats_buffer_release(events[i].buffer);
+    }
+
+    // The server side may see the connection before the handshake completes on the client side
+    int count = 0;
+    rats_buffer_t ids = nullptr;
+    for (int attempt = 0; attempt < 50 && count == 0; ++attempt) {
+        rats_buffer_release(ids);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ids = rats_get_peer_ids_lent(client2, &count);
+    }
+    ASSERT_EQ(count, 1);
+    const char* const* peer_ids = static_cast<const char* const*>(rats_buffer_data(ids));
+    std::string server_id = peer_ids[0];
+    EXPECT_EQ(rats_buffer_size(ids), sizeof(const char*));
+    rats_buffer_release(ids);
+
+    const uint8_t first[] = {0x00, 0x01, 0x02, 0xFF};
+    const uint8_t second[] = {0x10, 0x20};
+    rats_send_item_t items[] = {
+        {server_id.c_str(), first, sizeof(first)},
+        {"unknown-peer", first, sizeof(first)},
+        {server_id.c_str(), second, sizeof(second)},
+    };
+    EXPECT_EQ(rats_send_binary_many(client2, items, 3), 2);
+    EXPECT_EQ(rats_send_string(client2, server_id.c_str(), "hello"), RATS_SUCCESS);
+
+    std::vector<rats_event_t> received;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (received.size() < 3 && std::chrono::steady_clock::now() < deadline) {
+        int n = rats_poll_events(client1, events, 16, 100);
+        ASSERT_GE(n, 0);
+        received.insert(received.end(), events, events + n);
+    }
+    ASSERT_EQ(received.size(), 3u);
+
+    EXPECT_EQ(received[0].type, RATS_EVENT_BINARY);
+    EXPECT_EQ(client2_id, received[0].peer_id);
+    ASSERT_EQ(received[0].size, sizeof(first));
+    EXPECT_EQ(memcmp(received[0].data, first, sizeof(first)), 0);
+    EXPECT_EQ(rats_buffer_data(received[0].buffer), received[0].data);
+
+    EXPECT_EQ(received[1].type, RATS_EVENT_BINARY);
+    ASSERT_EQ(received[1].size, sizeof(second));
+    EXPECT_EQ(memcmp(received[1].data, second, sizeof(second)), 0);
+
+    EXPECT_EQ(received[2].type, RATS_EVENT_STRING);
+    EXPECT_STREQ(static_cast<const char*>(received[2].data), "hello");
+    EXPECT_EQ(received[2].size, 5u);
+
+    for (const auto& event : received) {
+        rats_buffer_release(event.buffer);
+    }
+    EXPECT_EQ(rats_get_dropped_event_count(client1), 0u);
+
+    rats_stop(client1);
+    rats_stop(client2);
+}
@@ -348,3 +348,90 @@ TEST_F(LoggingApiTest, StatePersistence) {
     EXPECT_EQ(client_->get_log_file_path(), "persistent_test.log")
         << "Log file path should still persist after other operations";
 }
+
+// Test that the log level getter reports the level that was set
+TEST_F(LoggingApiTest, LogLevelGetterReflectsSetLevel) {
+    LogLevel previous = client_->get_log_level();
+    
+    client_->set_log_level(LogLevel::WARN);
+    EXPECT_EQ(client_->get_log_level(), LogLevel::WARN);
+    client_->set_log_level("DEBUG");
+    EXPECT_EQ(client_->get_log_level(), LogLevel::DEBUG);
+    
+    client_->set_log_level(previous);
+}
+
+namespace {
+// Counts how often it is formatted into a log message
+struct FormatCounter {
+    int count = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, FormatCounter& counter) {
+    counter.count++;
+    return os << "formatted";
+}
+} // anonymous namespace
+
+// Test that messages below the current level are never formatted
+TEST_F(LoggingApiTest, FilteredMessagesAreNotFormatted) {
+    Logger& logger = Logger::getInstance();
+    LogLevel previous = logger.get_log_level();
+    logger.set_log_level(LogLevel::WARN);
+    
+    FormatCounter counter;
+    LOG_DEBUG("test", "debug " << counter);
+    LOG_INFO("test", "info " << counter);
+    EXPECT_EQ(counter.count, 0);
+    
+    LOG_WARN("test", "warn " << counter);
+    EXPECT_EQ(counter.count, 1);
+    
+    logger.set_log_level(previous);
+}
+
+// Test that asynchronous logging writes every message, in order per thread
+TEST_F(LoggingApiTest, AsyncLoggingWritesAllMessages) {
+    const std::string log_path = "test_logging.log";
+    const int thread_count = 4;
+    const int messages_per_thread = 100;
+    Logger& logger = Logger::getInstance();
+    LogLevel previous = logger.get_log_level();
+    logger.set_log_level(LogLevel::INFO);
+    
+    client_->set_log_file_path(log_path);
+    client_->set_logging_enabled(true);
+    client_->set_async_logging_enabled(true);
+    EXPECT_TRUE(client_->is_async_logging_enabled());
+    
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([t, messages_per_thread]() {
+            for (int i = 0; i < messages_per_thread; ++i) {
+                LOG_INFO("async", "async-message-" << t << "-" << i << ";");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    logger.flush();
+    client_->set_async_logging_enabled(false);
+    EXPECT_FALSE(client_->is_async_logging_enabled());
+    client_->set_logging_enabled(false);
+    logger.set_log_level(previous);
+    
+    std::string content = read_file_content(log_path);
+    EXPECT_EQ(logger.get_dropped_count(), 0u);
+    for (int t = 0; t < thread_count; ++t) {
+        size_t last_position = 0;
+        for (int i = 0; i < messages_per_thread; ++i) {
+            std::string expected = "async-message-" + std::to_string(t) + "-" + std::to_string(i) + ";";
+            size_t position = content.find(expected);
+            ASSERT_NE(position, std::string::npos) << "missing " << expected;
+            EXPECT_GE(position, last_position) << expected << " written out of order";
+            last_position = position;
+        }
+    }
+}
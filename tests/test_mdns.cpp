@@ -228,3 +228,121 @@ TEST_F(MdnsTest, MdnsTxtRecords) {
     
     std::cout << "=== mDNS TXT Records Test Completed ===" << std::endl << std::endl;
 }
+
+// Test that cached services expire with their TTL and are only listed as known answers while fresh
+TEST_F(MdnsTest, ServiceCacheHonoursTtl) {
+    MdnsServiceCache cache;
+    auto now = std::chrono::steady_clock::now();
+    
+    MdnsService service("node-a._librats._tcp.local.", "host-a.local.", "192.168.1.10", 8080);
+    service.last_seen = now;
+    service.ttl = 10;
+    EXPECT_TRUE(cache.update(service));
+    EXPECT_FALSE(cache.update(service));
+    
+    EXPECT_EQ(cache.services(now).size(), 1u);
+    EXPECT_TRUE(cache.services(now + std::chrono::seconds(11)).empty());
+    
+    auto known = cache.known_answers(now + std::chrono::seconds(2));
+    ASSERT_EQ(known.size(), 1u);
+    EXPECT_EQ(known[0].first, service.service_name);
+    EXPECT_EQ(known[0].second, 8u);
+    EXPECT_TRUE(cache.known_answers(now + std::chrono::seconds(6)).empty());
+    EXPECT_FALSE(cache.is_known_answer(service.service_name, now + std::chrono::seconds(6)));
+    
+    EXPECT_EQ(cache.next_refresh(now), now + std::chrono::seconds(8));
+    EXPECT_EQ(cache.next_refresh(now + std::chrono::seconds(8)), std::chrono::steady_clock::time_point::max());
+    
+    cache.purge(now + std::chrono::seconds(11), std::chrono::seconds(600));
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+// Test that a full cache drops the service closest to expiring and reports its usage
+TEST_F(MdnsTest, ServiceCacheEvictsWhenFull) {
+    MdnsServiceCache cache;
+    cache.set_max_services(3);
+    auto now = std::chrono::steady_clock::now();
+    
+    for (int i = 0; i < 3; ++i) {
+        MdnsService service("node-" + std::to_string(i) + "._librats._tcp.local.", "host.local.", "192.168.1.10", 8080);
+        service.last_seen = now + std::chrono::seconds(i);
+        EXPECT_TRUE(cache.update(service));
+    }
+    
+    // Refreshing a cached service does not evict anything
+    MdnsService refreshed("node-0._librats._tcp.local.", "host.local.", "192.168.1.10", 8080);
+    refreshed.last_seen = now + std::chrono::seconds(5);
+    cache.update(refreshed);
+    EXPECT_EQ(cache.size(), 3u);
+    
+    MdnsService newcomer("node-3._librats._tcp.local.", "host.local.", "192.168.1.11", 8080);
+    newcomer.last_seen = now + std::chrono::seconds(6);
+    EXPECT_TRUE(cache.update(newcomer));
+    EXPECT_EQ(cache.size(), 3u);
+    auto names = cache.services(now + std::chrono::seconds(6));
+    EXPECT_TRUE(std::none_of(names.begin(), names.end(), [](const MdnsService& service) {
+        return service.service_name == "node-1._librats._tcp.local.";
+    }));
+    
+    auto usage = cache.usage();
+    EXPECT_EQ(usage.entries, 3u);
+    EXPECT_EQ(usage.max_entries, 3u);
+    EXPECT_EQ(usage.evictions, 1u);
+    EXPECT_GT(usage.bytes, 3 * sizeof(MdnsService));
+    
+    cache.set_max_services(1);
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_EQ(cache.services(now + std::chrono::seconds(6))[0].service_name, "node-3._librats._tcp.local.");
+    EXPECT_EQ(cache.usage().evictions, 3u);
+}
+
+// Test that a long known-answer list is split into MTU-sized packets flagged as truncated
+TEST_F(MdnsTest, KnownAnswersSplitIntoTruncatedPackets) {
+    std::vector<DnsResourceRecord> known_answers;
+    for (int i = 0; i < 200; ++i) {
+        DnsResourceRecord record(LIBRATS_SERVICE_TYPE, DnsRecordType::PTR, DnsRecordClass::CLASS_IN, 100);
+        std::string instance = "node-" + std::to_string(i);
+        record.data.push_back(static_cast<uint8_t>(instance.size()));
+        record.data.insert(record.data.end(), instance.begin(), instance.end());
+        record.data.push_back(0);
+        known_answers.push_back(record);
+    }
+    
+    DnsQuestion question(LIBRATS_SERVICE_TYPE, DnsRecordType::PTR, DnsRecordClass::CLASS_IN);
+    auto packets = MdnsClient::build_query_packets(question, known_answers);
+    ASSERT_GT(packets.size(), 1u);
+    
+    size_t answers = 0;
+    for (size_t i = 0; i < packets.size(); ++i) {
+        EXPECT_LE(packets[i].size(), MDNS_MAX_PACKET_SIZE);
+        DnsMessage message;
+        ASSERT_TRUE(MdnsClient::deserialize_dns_message(packets[i], message));
+        EXPECT_EQ(message.questions.size(), i == 0 ? 1u : 0u);
+        EXPECT_EQ((message.header.flags & MDNS_FLAG_TRUNCATED) != 0, i + 1 < packets.size());
+        for (const auto& record : message.answers) {
+            EXPECT_TRUE(MdnsClient::dns_names_equal(record.name, LIBRATS_SERVICE_TYPE));
+            EXPECT_TRUE(MdnsClient::is_known_answer(record, known_answers[answers]));
+            answers++;
+        }
+    }
+    EXPECT_EQ(answers, known_answers.size());
+}
+
+// Test the known-answer rule: same record with at least half of its TTL left
+TEST_F(MdnsTest, KnownAnswerMatching) {
+    DnsResourceRecord ours(LIBRATS_SERVICE_TYPE, DnsRecordType::PTR, DnsRecordClass::CLASS_IN, 120);
+    ours.data = {4, 'n', 'o', 'd', 'e', 0};
+    
+    DnsResourceRecord known = ours;
+    known.name = "_LIBRATS._tcp.local";
+    known.ttl = 60;
+    known.data = {4, 'N', 'O', 'D', 'E', 0};
+    EXPECT_TRUE(MdnsClient::is_known_answer(known, ours));
+    
+    known.ttl = 59;
+    EXPECT_FALSE(MdnsClient::is_known_answer(known, ours));
+    
+    known.ttl = 120;
+    known.data = {5, 'o', 't', 'h', 'e', 'r', 0};
+    EXPECT_FALSE(MdnsClient::is_known_answer(known, ours));
+}
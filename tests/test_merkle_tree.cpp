@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include "merkle_tree.h"
+#include "fs.h"
+#include <random>
+#include <thread>
+
+using namespace librats;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(size_t size, uint32_t seed) {
+    std::mt19937 gen(seed);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(gen());
+    }
+    return data;
+}
+
+} // namespace
+
+// Test that the leaf size grows with the file and stays a power of two within bounds
+TEST(MerkleTreeTest, LeafSizeForFileSize) {
+    EXPECT_EQ(choose_merkle_leaf_size(0), MIN_MERKLE_LEAF_SIZE);
+    EXPECT_EQ(choose_merkle_leaf_size(100 * 1024 * 1024), MIN_MERKLE_LEAF_SIZE);
+
+    uint64_t large = 20ULL * 1024 * 1024 * 1024;
+    uint32_t leaf_size = choose_merkle_leaf_size(large);
+    EXPECT_EQ(leaf_size & (leaf_size - 1), 0u);
+    EXPECT_LE(MerkleTree::leaf_count_for(large, leaf_size), 4096u);
+    EXPECT_EQ(choose_merkle_leaf_size(UINT64_MAX / 2), MAX_MERKLE_LEAF_SIZE);
+}
+
+// Test that a tree built in parallel matches one built on one thread, and verifies its leaves
+TEST(MerkleTreeTest, ParallelBuildVerifiesLeaves) {
+    const std::string path = "merkle_test_file.bin";
+    const uint32_t leaf_size = MIN_MERKLE_LEAF_SIZE;
+    auto content = random_bytes(leaf_size * 9 + 1234, 1);
+    ASSERT_TRUE(create_file_binary(path.c_str(), content.data(), content.size()));
+
+    FileHandle file;
+    ASSERT_TRUE(file.open(path.c_str(), FileOpenMode::READ_ONLY));
+    MerkleTree serial;
+    MerkleTree parallel;
+    ASSERT_TRUE(serial.build(file, content.size(), leaf_size, 1));
+    ASSERT_TRUE(parallel.build(file, content.size(), leaf_size, 4));
+    EXPECT_EQ(serial.root(), parallel.root());
+    EXPECT_EQ(parallel.leaves(), serial.leaves());
+    ASSERT_EQ(parallel.leaf_count(), 10u);
+    EXPECT_EQ(parallel.leaf_length(9), 1234u);
+    EXPECT_EQ(parallel.root(), MerkleTree::compute_root(parallel.leaves()));
+
+    // Every leaf checks on its own, in any order; a flipped byte does not
+    for (size_t index = parallel.leaf_count(); index-- > 0;) {
+        const uint8_t* leaf = content.data() + parallel.leaf_offset(index);
+        EXPECT_TRUE(parallel.verify_leaf(index, leaf, parallel.leaf_length(index))) << index;
+    }
+    content[leaf_size * 3 + 7] ^= 0x01;
+    EXPECT_FALSE(parallel.verify_leaf(3, content.data() + leaf_size * 3, leaf_size));
+    EXPECT_FALSE(parallel.verify_leaf(2, content.data() + leaf_size * 3, leaf_size));
+
+    file.close();
+    delete_file(path.c_str());
+}
+
+// Test that a received leaf layer is only taken if it hashes to the expected root
+TEST(MerkleTreeTest, AssignChecksRoot) {
+    std::vector<MerkleTree::Hash> leaves;
+    for (uint8_t i = 0; i < 5; ++i) {
+        uint8_t byte = i;
+        leaves.push_back(MerkleTree::hash_leaf(&byte, 1));
+    }
+    MerkleTree::Hash root = MerkleTree::compute_root(leaves);
+    const uint64_t file_size = MIN_MERKLE_LEAF_SIZE * 4ULL + 1;
+
+    MerkleTree::Hash parsed;
+    ASSERT_TRUE(MerkleTree::from_hex(MerkleTree::to_hex(root), parsed));
+    EXPECT_EQ(parsed, root);
+    EXPECT_FALSE(MerkleTree::from_hex("zz", parsed));
+
+    MerkleTree tree;
+    auto tampered = leaves;
+    tampered[4][0] ^= 0x01;
+    EXPECT_FALSE(tree.assign(file_size, MIN_MERKLE_LEAF_SIZE, tampered, root));
+    EXPECT_FALSE(tree.assign(file_size + MIN_MERKLE_LEAF_SIZE, MIN_MERKLE_LEAF_SIZE, leaves, root));
+    ASSERT_TRUE(tree.assign(file_size, MIN_MERKLE_LEAF_SIZE, leaves, root));
+    EXPECT_EQ(tree.root(), root);
+    EXPECT_EQ(tree.leaf_length(4), 1u);
+}
+
+// Test that the cache returns the same tree until the file changes
+TEST(MerkleTreeTest, CacheRebuildsChangedFiles) {
+    const std::string path = "merkle_test_cached.bin";
+    auto content = random_bytes(200000, 2);
+    ASSERT_TRUE(create_file_binary(path.c_str(), content.data(), content.size()));
+
+    MerkleTreeCache& cache = MerkleTreeCache::getInstance();
+    auto first = cache.get(path);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(cache.get(path), first);
+
+    content.push_back(0x42);
+    ASSERT_TRUE(create_file_binary(path.c_str(), content.data(), content.size()));
+    auto second = cache.get(path);
+    ASSERT_NE(second, nullptr);
+    EXPECT_NE(second, first);
+    EXPECT_NE(second->root(), first->root());
+    EXPECT_EQ(second->file_size(), content.size());
+
+    EXPECT_EQ(cache.get("merkle_test_missing.bin"), nullptr);
+    delete_file(path.c_str());
+}
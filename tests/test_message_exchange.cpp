@@ -414,3 +414,337 @@ TEST_F(MessageExchangeTest, LargeMessageIntegrity) {
     SUCCEED() << "Large message (" << serialized_message.size() 
               << " bytes) sent and received with full integrity preservation";
 }
+
+TEST_F(MessageExchangeTest, PayloadHandlerParsesLazily) {
+    std::atomic<int> raw_count{0};
+    std::atomic<bool> parsed_before{true};
+    std::string raw_body;
+    client1->on_payload("lazy_test", [&](const std::string& peer_id, const RatsMessagePayload& payload) {
+        parsed_before = payload.is_parsed();
+        raw_body = payload.raw();
+        raw_count++;
+    });
+    
+    std::atomic<int> json_count{0};
+    std::atomic<int> value{0};
+    client1->on_payload("lazy_json_test", [&](const std::string& peer_id, const RatsMessagePayload& payload) {
+        value = payload.json().value("value", 0);
+        json_count++;
+    });
+    
+    nlohmann::json data;
+    data["value"] = 42;
+    client2->send("lazy_test", data);
+    client2->send("lazy_json_test", data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    
+    EXPECT_EQ(raw_count.load(), 1);
+    EXPECT_FALSE(parsed_before.load()) << "Body of a binary envelope should not be parsed before the handler asks";
+    EXPECT_EQ(nlohmann::json::parse(raw_body), data);
+    EXPECT_EQ(json_count.load(), 1);
+    EXPECT_EQ(value.load(), 42);
+}
+
+TEST_F(MessageExchangeTest, JsonEnvelopeIsStillDispatched) {
+    // Peers that predate binary envelopes send rats messages as JSON
+    std::atomic<int> count{0};
+    client1->on("legacy_test", [&](const std::string& peer_id, const nlohmann::json& data) {
+        if (data.value("legacy", false)) {
+            count++;
+        }
+    });
+    
+    auto peers = client2->get_validated_peers();
+    ASSERT_FALSE(peers.empty());
+    nlohmann::json message;
+    message["rats_protocol"] = true;
+    message["type"] = "legacy_test";
+    message["payload"] = {{"legacy", true}};
+    message["sender_peer_id"] = client2->get_our_peer_id();
+    message["timestamp"] = 0;
+    EXPECT_TRUE(client2->send_json_to_peer(peers[0].socket, message));
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_EQ(count.load(), 1);
+}
+
+TEST(RatsEnvelopeTest, EncodeDecodeRoundTrip) {
+    EXPECT_EQ(rats_message_type::id_of("peers_request"), rats_message_type::PEERS_REQUEST);
+    EXPECT_STREQ(rats_message_type::builtin_name(rats_message_type::ICE_OFFER), "ice_offer");
+    EXPECT_EQ(rats_message_type::builtin_name(rats_message_type::CUSTOM_FLAG | 1), nullptr);
+    uint16_t custom_id = rats_message_type::id_of("chat_message");
+    EXPECT_TRUE(custom_id & rats_message_type::CUSTOM_FLAG);
+    EXPECT_EQ(custom_id, rats_message_type::id_of("chat_message"));
+    EXPECT_EQ(rats_message_type::id_of(""), rats_message_type::UNKNOWN);
+    
+    const std::string body = "{\"a\":1}";
+    const uint8_t* body_bytes = reinterpret_cast<const uint8_t*>(body.data());
+    std::vector<uint8_t> bytes;
+    ASSERT_TRUE(encode_rats_envelope("chat_message", "sender-id", 1234567890123LL, payload_encoding::JSON,
+                                     body_bytes, body.size(), bytes));
+    RatsEnvelope envelope;
+    ASSERT_TRUE(decode_rats_envelope(SharedBuffer(std::vector<uint8_t>(bytes)), envelope));
+    EXPECT_EQ(envelope.type_id, custom_id);
+    EXPECT_EQ(envelope.encoding, payload_encoding::JSON);
+    EXPECT_EQ(envelope.type(), "chat_message");
+    EXPECT_EQ(envelope.sender_peer_id, "sender-id");
+    EXPECT_EQ(envelope.timestamp, 1234567890123LL);
+    EXPECT_EQ(envelope.body.to_string(), body);
+    
+    // Built-in types carry no name
+    ASSERT_TRUE(encode_rats_envelope("peer", "", 0, payload_encoding::MSGPACK, body_bytes, body.size(), bytes));
+    EXPECT_EQ(bytes[2], payload_encoding::MSGPACK);
+    EXPECT_EQ(bytes[3], 0);
+    ASSERT_TRUE(decode_rats_envelope(SharedBuffer(std::vector<uint8_t>(bytes)), envelope));
+    EXPECT_EQ(envelope.type_id, rats_message_type::PEER);
+    EXPECT_EQ(envelope.encoding, payload_encoding::MSGPACK);
+    EXPECT_EQ(envelope.type(), "peer");
+    
+    // Truncated envelopes and unknown built-in ids are rejected
+    EXPECT_FALSE(decode_rats_envelope(SharedBuffer(std::vector<uint8_t>(bytes.begin(), bytes.begin() + 5)), envelope));
+    std::vector<uint8_t> unknown = {0x00, 0x7F, 0x00, 0x00, 0x00, 0, 0, 0, 0, 0, 0, 0, 0};
+    EXPECT_FALSE(decode_rats_envelope(SharedBuffer(std::move(unknown)), envelope));
+    EXPECT_FALSE(encode_rats_envelope(std::string(300, 'x'), "", 0, payload_encoding::JSON, body_bytes, body.size(), bytes));
+    
+    RatsMessagePayload invalid(SharedBuffer::copy_of(reinterpret_cast<const uint8_t*>("{oops"), 5), PayloadCodec::json());
+    EXPECT_THROW(invalid.json(), nlohmann::json::parse_error);
+    RatsMessagePayload raw(SharedBuffer::copy_of(body_bytes, body.size()), nullptr);
+    EXPECT_TRUE(raw.is_raw());
+    EXPECT_EQ(raw.raw(), body);
+    EXPECT_THROW(raw.json(), std::runtime_error);
+}
+
+TEST(PayloadCodecTest, BuiltinCodecsRoundTrip) {
+    nlohmann::json value = {{"ip", "192.168.1.10"}, {"port", 8080}, {"peers", {1, 2, 3}}, {"ok", true}};
+    for (const auto& codec : PayloadCodec::defaults()) {
+        std::vector<uint8_t> encoded = codec->encode(value);
+        EXPECT_EQ(codec->decode(encoded.data(), encoded.size()), value) << codec->name();
+        ASSERT_GE(codec->builtin_id(), 0);
+        EXPECT_EQ(PayloadCodec::builtin(static_cast<uint8_t>(codec->builtin_id())), codec);
+    }
+    EXPECT_EQ(PayloadCodec::defaults().front()->name(), "msgpack");
+    EXPECT_LT(PayloadCodec::msgpack()->encode(value).size(), PayloadCodec::json()->encode(value).size());
+    EXPECT_EQ(PayloadCodec::builtin(payload_encoding::RAW), nullptr);
+    
+    std::vector<uint8_t> garbage = {0xC1};
+    EXPECT_THROW(PayloadCodec::msgpack()->decode(garbage.data(), garbage.size()), std::exception);
+}
+
+TEST_F(MessageExchangeTest, PayloadsUseNegotiatedCodec) {
+    std::atomic<int> count{0};
+    std::string codec_name;
+    nlohmann::json received;
+    client1->on_payload("codec_test", [&](const std::string& peer_id, const RatsMessagePayload& payload) {
+        codec_name = payload.codec() ? payload.codec()->name() : "";
+        received = payload.json();
+        count++;
+    });
+    
+    nlohmann::json data = {{"text", "hello"}, {"values", {1, 2, 3}}};
+    client2->send(client1->get_our_peer_id(), "codec_test", data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    
+    ASSERT_EQ(count.load(), 1);
+    EXPECT_EQ(codec_name, "msgpack");
+    EXPECT_EQ(received, data);
+}
+
+TEST_F(MessageExchangeTest, RawBytesBypassCodec) {
+    std::atomic<int> count{0};
+    std::vector<uint8_t> received;
+    client1->on_bytes("raw_test", [&](const std::string& peer_id, const SharedBuffer& bytes) {
+        received.assign(bytes.data(), bytes.data() + bytes.size());
+        count++;
+    });
+    
+    std::vector<uint8_t> data = {0x00, 0xFF, 0xC1, 0x7B, 0x01};
+    std::atomic<bool> sent{false};
+    client2->send_raw(client1->get_our_peer_id(), "raw_test", data, [&](bool success, const std::string&) { sent = success; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    
+    EXPECT_TRUE(sent.load());
+    ASSERT_EQ(count.load(), 1);
+    EXPECT_EQ(received, data);
+    
+    std::atomic<bool> unknown_peer_failed{false};
+    client2->send_raw("unknown-peer", "raw_test", data, [&](bool success, const std::string&) { unknown_peer_failed = !success; });
+    EXPECT_TRUE(unknown_peer_failed.load());
+}
+
+namespace {
+
+// Custom codec that tags MessagePack bodies, so the test can tell it was used
+class TaggedMsgpackCodec : public PayloadCodec {
+public:
+    std::string name() const override { return "tagged-msgpack"; }
+    
+    std::vector<uint8_t> encode(const nlohmann::json& value) const override {
+        std::vector<uint8_t> bytes = nlohmann::json::to_msgpack(value);
+        bytes.insert(bytes.begin(), 0xAB);
+        encode_count++;
+        return bytes;
+    }
+    
+    nlohmann::json decode(const uint8_t* data, size_t size) const override {
+        if (size == 0 || data[0] != 0xAB) {
+            throw std::runtime_error("Missing tag");
+        }
+        return nlohmann::json::from_msgpack(data + 1, data + size);
+    }
+    
+    mutable std::atomic<int> encode_count{0};
+};
+
+} // anonymous namespace
+
+TEST(PayloadCodecNegotiationTest, CustomCodecIsSelectedByName) {
+    auto codec = std::make_shared<TaggedMsgpackCodec>();
+    RatsClient client1(59040, 5);
+    RatsClient client2(59041, 5);
+    client1.set_payload_codecs({codec, PayloadCodec::json()});
+    client2.set_payload_codecs({PayloadCodec::cbor(), codec});
+    ASSERT_EQ(client2.get_payload_codecs().size(), 2u);
+    ASSERT_TRUE(client1.start());
+    ASSERT_TRUE(client2.start());
+    
+    std::atomic<int> count1{0};
+    std::atomic<int> count2{0};
+    std::string codec1;
+    std::string codec2;
+    client1.on_payload("custom_codec_test", [&](const std::string&, const RatsMessagePayload& payload) {
+        codec1 = payload.codec() ? payload.codec()->name() : "";
+        if (payload.json().value("n", 0) == 2) {
+            count1++;
+        }
+    });
+    client2.on_payload("custom_codec_test", [&](const std::string&, const RatsMessagePayload& payload) {
+        codec2 = payload.codec() ? payload.codec()->name() : "";
+        if (payload.json().value("n", 0) == 1) {
+            count2++;
+        }
+    });
+    
+    ASSERT_TRUE(client2.connect_to_peer("127.0.0.1", 59040));
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ASSERT_EQ(client1.get_peer_count(), 1);
+    
+    client1.send("custom_codec_test", nlohmann::json{{"n", 1}});
+    client2.send("custom_codec_test", nlohmann::json{{"n", 2}});
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    
+    // Each side encodes with its first codec the other side offers
+    EXPECT_EQ(count1.load(), 1);
+    EXPECT_EQ(count2.load(), 1);
+    EXPECT_EQ(codec1, "tagged-msgpack");
+    EXPECT_EQ(codec2, "tagged-msgpack");
+    EXPECT_GE(codec->encode_count.load(), 2);
+    
+    client2.stop();
+    client1.stop();
+}
+
+TEST_F(MessageExchangeTest, RequestResponsePipelined) {
+    client1->on_request("add", [](const std::string& peer_id, const nlohmann::json& params) {
+        return nlohmann::json{{"sum", params.value("a", 0) + params.value("b", 0)}};
+    });
+    client1->on_request("fail", [](const std::string& peer_id, const nlohmann::json& params) -> nlohmann::json {
+        throw std::runtime_error("handler refused");
+    });
+    std::string peer1 = client1->get_our_peer_id();
+    
+    // Many requests in flight at once, each matched to its own response
+    std::vector<std::future<nlohmann::json>> futures;
+    for (int i = 0; i < 50; ++i) {
+        futures.push_back(client2->request(peer1, "add", nlohmann::json{{"a", i}, {"b", 1000}}, std::chrono::seconds(5)));
+    }
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_EQ(futures[i].wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_EQ(futures[i].get().value("sum", -1), i + 1000);
+    }
+    
+    // Handler errors and unknown methods come back as errors
+    auto failed = client2->request(peer1, "fail", nlohmann::json::object());
+    ASSERT_EQ(failed.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    try {
+        failed.get();
+        FAIL() << "Expected the request to fail";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "handler refused");
+    }
+    
+    std::atomic<bool> done{false};
+    std::string error;
+    client2->request(peer1, "missing", nlohmann::json::object(),
+                     [&](bool success, const nlohmann::json&, const std::string& err) {
+                         EXPECT_FALSE(success);
+                         error = err;
+                         done = true;
+                     });
+    for (int i = 0; i < 500 && !done.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(done.load());
+    EXPECT_EQ(error, "Unknown method: missing");
+    EXPECT_EQ(client2->get_pending_request_count(), 0u);
+}
+
+TEST_F(MessageExchangeTest, RequestTimesOutAndFailsOnDisconnect) {
+    client1->on_request("slow", [](const std::string&, const nlohmann::json&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        return nlohmann::json("late");
+    });
+    std::string peer1 = client1->get_our_peer_id();
+    
+    auto start = std::chrono::steady_clock::now();
+    auto timed_out = client2->request(peer1, "slow", nlohmann::json::object(), std::chrono::milliseconds(300));
+    ASSERT_EQ(timed_out.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(300));
+    EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+    EXPECT_THROW(timed_out.get(), std::runtime_error);
+    
+    // Requests to unknown peers fail right away
+    auto unknown = client2->request("unknown-peer", "slow", nlohmann::json::object());
+    ASSERT_EQ(unknown.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+    EXPECT_THROW(unknown.get(), std::runtime_error);
+    
+    // Pending requests fail when the peer goes away
+    auto pending = client2->request(peer1, "slow", nlohmann::json::object(), std::chrono::seconds(30));
+    EXPECT_EQ(client2->get_pending_request_count(), 1u);
+    client2->disconnect_peer_by_id(peer1);
+    ASSERT_EQ(pending.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_THROW(pending.get(), std::runtime_error);
+    EXPECT_EQ(client2->get_pending_request_count(), 0u);
+}
+
+TEST_F(MessageExchangeTest, SlowHandlerDoesNotStallReads) {
+    // A handler blocked on the callback executor must not stop the I/O thread reading from its peer
+    std::atomic<bool> release{false};
+    std::atomic<bool> blocked_handler_ran{false};
+    client1->on("block", [&](const std::string&, const nlohmann::json&) {
+        for (int i = 0; i < 300 && !release.load(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        blocked_handler_ran = true;
+    });
+    client2->on_request("ping", [](const std::string&, const nlohmann::json&) {
+        return nlohmann::json("pong");
+    });
+    std::string peer1 = client1->get_our_peer_id();
+    std::string peer2 = client2->get_our_peer_id();
+    
+    client2->send(peer1, "block", nlohmann::json::object());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    // The response is read from the same connection while the handler still blocks
+    auto response = client1->request(peer2, "ping", nlohmann::json::object(), std::chrono::seconds(2));
+    ASSERT_EQ(response.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    EXPECT_EQ(response.get(), nlohmann::json("pong"));
+    EXPECT_FALSE(blocked_handler_ran.load());
+    
+    release = true;
+    for (int i = 0; i < 200 && !blocked_handler_ran.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(blocked_handler_ran.load());
+}
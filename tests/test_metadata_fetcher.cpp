@@ -0,0 +1,264 @@
+#include <gtest/gtest.h>
+#include "metadata_fetcher.h"
+#include "bittorrent.h"
+#include "socket.h"
+#include "fs.h"
+#include "bencode.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace librats;
+
+class MetadataFetcherTest : public ::testing::Test {
+protected:
+    const std::string seed_path = "test_metadata_seed";
+    TorrentInfo torrent_info;
+
+    void SetUp() override {
+        ASSERT_TRUE(init_socket_library());
+        ASSERT_TRUE(create_directories(seed_path.c_str()));
+
+        // Padding makes the info dictionary span three metadata pieces
+        auto info = BencodeValue::create_dict();
+        info["name"] = BencodeValue(std::string("meta.bin"));
+        info["piece length"] = BencodeValue(static_cast<int64_t>(BLOCK_SIZE));
+        info["length"] = BencodeValue(static_cast<int64_t>(BLOCK_SIZE));
+        info["pieces"] = BencodeValue(std::string(20, '\x5a'));
+        info["x-padding"] = BencodeValue(std::string(2 * METADATA_PIECE_SIZE + 1000, 'p'));
+        auto torrent = BencodeValue::create_dict();
+        torrent["info"] = info;
+        ASSERT_TRUE(torrent_info.load_from_bencode(torrent));
+        ASSERT_GT(torrent_info.get_metadata().size(), 2 * METADATA_PIECE_SIZE);
+    }
+
+    void TearDown() override {
+        delete_file((seed_path + "/meta.bin").c_str());
+        delete_file((seed_path + "/" + info_hash_to_hex(torrent_info.get_info_hash()) + ".resume").c_str());
+        delete_directory(seed_path.c_str());
+        cleanup_socket_library();
+    }
+
+    static bool wait_for(const std::function<bool()>& condition) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+};
+
+// Test parsing magnet links with hex and base32 info hashes
+TEST(MagnetLinkTest, ParsesHashNameTrackersAndPeers) {
+    MagnetLink magnet;
+    ASSERT_TRUE(parse_magnet_link("magnet:?xt=urn:btih:c12fe1c06bba254a9dc9f519b335aa7c1367a88a&dn=Some+File%20v2"
+                                  "&tr=udp%3A%2F%2Ftracker.example%3A80&x.pe=10.0.0.1:6881&x.pe=[::1]:51413", magnet));
+    EXPECT_EQ(info_hash_to_hex(magnet.info_hash), "c12fe1c06bba254a9dc9f519b335aa7c1367a88a");
+    EXPECT_EQ(magnet.name, "Some File v2");
+    ASSERT_EQ(magnet.trackers.size(), 1u);
+    EXPECT_EQ(magnet.trackers[0], "udp://tracker.example:80");
+    ASSERT_EQ(magnet.peers.size(), 2u);
+    EXPECT_EQ(magnet.peers[0], Peer("10.0.0.1", 6881));
+    EXPECT_EQ(magnet.peers[1], Peer("::1", 51413));
+
+    // Base32 of the same hash
+    MagnetLink base32;
+    ASSERT_TRUE(parse_magnet_link("magnet:?xt=urn:btih:YEX6DQDLXISUVHOJ6UM3GNNKPQJWPKEK", base32));
+    EXPECT_EQ(base32.info_hash, magnet.info_hash);
+
+    EXPECT_FALSE(parse_magnet_link("magnet:?dn=no-hash", magnet));
+    EXPECT_FALSE(parse_magnet_link("http://example.com/?xt=urn:btih:c12fe1c06bba254a9dc9f519b335aa7c1367a88a", magnet));
+    EXPECT_FALSE(parse_magnet_link("magnet:?xt=urn:btih:c12fe1", magnet));
+}
+
+// Test that the bencoded info dictionary survives a round trip and keeps its hash
+TEST_F(MetadataFetcherTest, TorrentInfoFromMetadata) {
+    TorrentInfo fetched;
+    ASSERT_TRUE(fetched.load_from_metadata(torrent_info.get_metadata()));
+    EXPECT_EQ(fetched.get_info_hash(), torrent_info.get_info_hash());
+    EXPECT_EQ(fetched.get_name(), "meta.bin");
+    EXPECT_EQ(fetched.get_metadata(), torrent_info.get_metadata());
+
+    std::vector<uint8_t> garbage = {'d', '4', ':', 'n'};
+    EXPECT_FALSE(TorrentInfo().load_from_metadata(garbage));
+
+    // Our handshake announces the extension protocol
+    EXPECT_TRUE(handshake_supports_extensions(create_handshake_message(torrent_info.get_info_hash(), generate_peer_id())));
+}
+
+// Test fetching from two seeders in parallel, with a dead peer in the list
+TEST_F(MetadataFetcherTest, FetchesFromSeedingPeers) {
+    BitTorrentClient seed1;
+    BitTorrentClient seed2;
+    ASSERT_TRUE(seed1.start(58891));
+    ASSERT_TRUE(seed2.start(58892));
+    ASSERT_NE(seed1.add_torrent(torrent_info, seed_path), nullptr);
+    ASSERT_NE(seed2.add_torrent(torrent_info, seed_path), nullptr);
+
+    auto reactor = std::make_shared<IoReactor>("metadata-test", 1);
+    ASSERT_TRUE(reactor->start());
+
+    std::mutex result_mutex;
+    std::atomic<int> calls(0);
+    bool success = false;
+    TorrentInfo result;
+    auto fetcher = std::make_shared<MetadataFetcher>(torrent_info.get_info_hash(), reactor,
+        [&](const TorrentInfo& info, bool ok) {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            result = info;
+            success = ok;
+            ++calls;
+        });
+    fetcher->add_peers({Peer("127.0.0.1", 58893), Peer("127.0.0.1", 58891), Peer("127.0.0.1", 58892), Peer("127.0.0.1", 58891)});
+
+    ASSERT_TRUE(wait_for([&] { return calls.load() > 0; }));
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        EXPECT_TRUE(success);
+        EXPECT_EQ(result.get_info_hash(), torrent_info.get_info_hash());
+        EXPECT_EQ(result.get_num_pieces(), 1u);
+        EXPECT_EQ(result.get_metadata(), torrent_info.get_metadata());
+    }
+    EXPECT_TRUE(fetcher->is_finished());
+    EXPECT_EQ(fetcher->get_pieces_received(), 3u);
+    EXPECT_EQ(fetcher->get_connection_count(), 0u);
+
+    // Finished fetches ignore further peers and never call back twice
+    fetcher->add_peers({Peer("127.0.0.1", 58892)});
+    fetcher->on_tick(std::chrono::steady_clock::now() + std::chrono::hours(1));
+    EXPECT_EQ(calls.load(), 1);
+
+    reactor->stop();
+    seed1.stop();
+    seed2.stop();
+}
+
+// Test that a peer lying about the metadata size does not lock out the honest peers behind it
+TEST_F(MetadataFetcherTest, RecoversFromLyingFirstPeer) {
+    const InfoHash& info_hash = torrent_info.get_info_hash();
+    const size_t lie = torrent_info.get_metadata().size() + METADATA_PIECE_SIZE;
+
+    // The liar claims one piece too many and answers every request with garbage
+    socket_t liar_server = create_tcp_server(58896);
+    ASSERT_TRUE(is_valid_socket(liar_server));
+    std::thread liar([&]() {
+        socket_t socket = accept_client(liar_server);
+        if (!is_valid_socket(socket)) {
+            return;
+        }
+        receive_exact_bytes(socket, 68);
+        send_tcp_data(socket, create_handshake_message(info_hash, generate_peer_id()));
+        auto handshake = BencodeValue::create_dict();
+        auto m = BencodeValue::create_dict();
+        m["ut_metadata"] = BencodeValue(static_cast<int64_t>(3));
+        handshake["m"] = m;
+        handshake["metadata_size"] = BencodeValue(static_cast<int64_t>(lie));
+        send_tcp_data(socket, PeerMessage::create_extended(EXTENDED_HANDSHAKE_ID, handshake).serialize());
+
+        while (true) {
+            std::vector<uint8_t> header = receive_exact_bytes(socket, 4);
+            if (header.size() != 4) {
+                break;
+            }
+            size_t length = (static_cast<size_t>(header[0]) << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+            std::vector<uint8_t> body = length > 0 ? receive_exact_bytes(socket, length) : std::vector<uint8_t>();
+            if (body.size() != length) {
+                break;
+            }
+            if (length < 3 || body[0] != static_cast<uint8_t>(MessageType::EXTENDED) || body[1] != 3) {
+                continue;
+            }
+            BencodeValue request = BencodeDecoder::decode(std::vector<uint8_t>(body.begin() + 2, body.end()));
+            int64_t piece = request["piece"].as_integer();
+            size_t offset = static_cast<size_t>(piece) * METADATA_PIECE_SIZE;
+            auto reply = BencodeValue::create_dict();
+            reply["msg_type"] = BencodeValue(static_cast<int64_t>(1));
+            reply["piece"] = BencodeValue(piece);
+            reply["total_size"] = BencodeValue(static_cast<int64_t>(lie));
+            std::vector<uint8_t> garbage((std::min)(METADATA_PIECE_SIZE, lie - offset), 0xee);
+            send_tcp_data(socket, PeerMessage::create_extended(UT_METADATA_ID, reply, garbage).serialize());
+        }
+        close_socket(socket);
+    });
+
+    BitTorrentClient seed;
+    ASSERT_TRUE(seed.start(58897));
+    ASSERT_NE(seed.add_torrent(torrent_info, seed_path), nullptr);
+
+    auto reactor = std::make_shared<IoReactor>("metadata-test", 1);
+    ASSERT_TRUE(reactor->start());
+    std::atomic<int> calls(0);
+    std::atomic<bool> success(false);
+    auto fetcher = std::make_shared<MetadataFetcher>(info_hash, reactor, [&](const TorrentInfo& info, bool ok) {
+        success = ok && info.get_metadata() == torrent_info.get_metadata();
+        ++calls;
+    });
+
+    // The liar's size is taken first, then the honest seed connects
+    fetcher->add_peers({Peer("127.0.0.1", 58896)});
+    EXPECT_TRUE(wait_for([&] { return fetcher->get_metadata_size() == lie; }));
+    fetcher->add_peers({Peer("127.0.0.1", 58897)});
+
+    EXPECT_TRUE(wait_for([&] { return calls.load() > 0; }));
+    EXPECT_TRUE(success.load());
+    EXPECT_EQ(fetcher->get_metadata_size(), torrent_info.get_metadata().size());
+
+    // Closing the connections and the listener ends the liar either way
+    fetcher->cancel();
+    reactor->stop();
+    seed.stop();
+    shutdown_socket(liar_server);
+    close_socket(liar_server);
+    liar.join();
+}
+
+// Test that BitTorrentClient caches fetched metadata and fails fetches on stop
+TEST_F(MetadataFetcherTest, ClientCachesMetadata) {
+    BitTorrentClient seed;
+    ASSERT_TRUE(seed.start(58894));
+    ASSERT_NE(seed.add_torrent(torrent_info, seed_path), nullptr);
+
+    BitTorrentClient client;
+    ASSERT_TRUE(client.start(58895));
+    const InfoHash& info_hash = torrent_info.get_info_hash();
+    TorrentInfo cached;
+    EXPECT_FALSE(client.get_cached_metadata(info_hash, cached));
+
+    std::atomic<int> calls(0);
+    std::atomic<bool> success(false);
+    auto callback = [&](const TorrentInfo& info, bool ok) {
+        success = ok && info.get_info_hash() == info_hash;
+        ++calls;
+    };
+    ASSERT_TRUE(client.fetch_metadata(info_hash, callback, {Peer("127.0.0.1", 58894)}));
+    ASSERT_TRUE(client.fetch_metadata(info_hash, callback));  // Joins the running fetch
+    EXPECT_EQ(client.get_metadata_fetch_count(), 1u);
+    ASSERT_TRUE(wait_for([&] { return calls.load() == 2; }));
+    EXPECT_TRUE(success.load());
+    EXPECT_EQ(client.get_metadata_fetch_count(), 0u);
+
+    // Cached now: answered inline, without any peer
+    seed.stop();
+    ASSERT_TRUE(client.get_cached_metadata(info_hash, cached));
+    EXPECT_EQ(cached.get_name(), "meta.bin");
+    ASSERT_TRUE(client.fetch_metadata(info_hash, callback));
+    EXPECT_EQ(calls.load(), 3);
+
+    // A fetch nobody can serve fails when the client stops
+    InfoHash unknown;
+    unknown.fill(0x77);
+    ASSERT_TRUE(client.fetch_metadata(unknown, callback, {Peer("127.0.0.1", 58894)}));
+    client.stop();
+    EXPECT_EQ(calls.load(), 4);
+    EXPECT_FALSE(success.load());
+    EXPECT_FALSE(client.fetch_metadata(unknown, callback));
+}
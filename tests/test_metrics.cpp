@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include "metrics.h"
+#include "../src/librats.h"
+#include <thread>
+#include <chrono>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+template<typename Predicate>
+bool wait_until(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (predicate()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return predicate();
+}
+
+} // anonymous namespace
+
+TEST(MetricsTest, CounterSumsShardsAcrossThreads) {
+    MetricCounter counter;
+    const int thread_count = 8;
+    const int increments = 10000;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&counter] {
+            for (int j = 0; j < increments; ++j) {
+                counter.add();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    counter.add(5);
+
+    EXPECT_EQ(counter.value(), static_cast<uint64_t>(thread_count * increments + 5));
+}
+
+TEST(MetricsTest, HistogramBucketsCoverValuesInOrder) {
+    // Small values are exact, larger ones fall into log-linear buckets
+    for (uint64_t value = 0; value < MetricHistogram::SUB_BUCKET_COUNT; ++value) {
+        EXPECT_EQ(MetricHistogram::bucket_index(value), value);
+    }
+    EXPECT_EQ(MetricHistogram::bucket_index(UINT64_MAX), MetricHistogram::BUCKET_COUNT - 1);
+
+    for (uint64_t value : {8ull, 9ull, 15ull, 16ull, 100ull, 1000ull, 123456ull, 1ull << 40}) {
+        size_t index = MetricHistogram::bucket_index(value);
+        uint64_t lower = MetricHistogram::bucket_lower_bound(index);
+        uint64_t next = MetricHistogram::bucket_lower_bound(index + 1);
+        EXPECT_LE(lower, value);
+        EXPECT_LT(value, next);
+        EXPECT_LE(next - lower, lower / MetricHistogram::SUB_BUCKET_COUNT + 1); // 12.5% relative width
+    }
+}
+
+TEST(MetricsTest, HistogramPercentiles) {
+    MetricHistogram histogram;
+    EXPECT_EQ(histogram.percentile(50), 0u);
+
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.record(value);
+    }
+    histogram.record(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(histogram.count(), 1001u);
+    EXPECT_EQ(histogram.sum(), 500500u + 50000u);
+
+    uint64_t p50 = histogram.percentile(50);
+    EXPECT_GE(p50, 500u);
+    EXPECT_LE(p50, 500u + 500u / 8);
+    uint64_t p99 = histogram.percentile(99);
+    EXPECT_GE(p99, 990u);
+    EXPECT_LE(p99, 1000u + 1000u / 8);
+    uint64_t max = histogram.percentile(100);
+    EXPECT_GE(max, 50000u);
+    EXPECT_LE(max, 50000u + 50000u / 8);
+
+    EXPECT_EQ(histogram.count_below(1024), 1000u);
+    EXPECT_EQ(histogram.count_below(1), 0u);
+}
+
+TEST(MetricsTest, RegistryExportsPrometheusText) {
+    MetricsRegistry& registry = MetricsRegistry::getInstance();
+    MetricCounter& counter = registry.counter("librats_test_events_total", "Test events", "kind=\"a\"");
+    EXPECT_EQ(&counter, &registry.counter("librats_test_events_total", "Test events", "kind=\"a\""));
+    counter.add(3);
+    registry.gauge("librats_test_depth", "Test depth").set(-2);
+    MetricHistogram& histogram = registry.histogram("librats_test_latency_seconds", "Test latency");
+    histogram.record(3);
+    histogram.record(1500);
+
+    std::string text = registry.export_prometheus();
+    EXPECT_NE(text.find("# HELP librats_test_events_total Test events\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE librats_test_events_total counter\n"), std::string::npos);
+    EXPECT_NE(text.find("librats_test_events_total{kind=\"a\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE librats_test_depth gauge\n"), std::string::npos);
+    EXPECT_NE(text.find("librats_test_depth -2\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE librats_test_latency_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("librats_test_latency_seconds_bucket{le=\"4e-06\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("librats_test_latency_seconds_bucket{le=\"0.002048\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("librats_test_latency_seconds_bucket{le=\"+Inf\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("librats_test_latency_seconds_count 2\n"), std::string::npos);
+}
+
+TEST(MetricsTest, ClientTrafficIsCounted) {
+    MetricsRegistry& registry = MetricsRegistry::getInstance();
+    MetricCounter& sent = registry.counter("librats_messages_sent_total", "Peer messages sent, by payload type", "type=\"rats\"");
+    MetricCounter& received = registry.counter("librats_messages_received_total", "Peer messages received, by payload type", "type=\"rats\"");
+    uint64_t sent_before = sent.value();
+    uint64_t received_before = received.value();
+
+    RatsClient client1(59036, 5);
+    RatsClient client2(59037, 5);
+    ASSERT_TRUE(client1.start());
+    ASSERT_TRUE(client2.start());
+    std::atomic<int> messages{0};
+    client1.on("metrics-test", [&](const std::string&, const nlohmann::json&) { messages++; });
+
+    ASSERT_TRUE(client2.connect_to_peer("127.0.0.1", 59036));
+    ASSERT_TRUE(wait_until([&] { return client1.get_peer_count() == 1 && client2.get_peer_count() == 1; }));
+
+    const int message_count = 5;
+    for (int i = 0; i < message_count; ++i) {
+        client2.send(client1.get_our_peer_id(), "metrics-test", nlohmann::json{{"index", i}});
+    }
+    EXPECT_TRUE(wait_until([&] { return messages.load() == message_count; }));
+
+    EXPECT_GE(sent.value() - sent_before, static_cast<uint64_t>(message_count));
+    EXPECT_GE(received.value() - received_before, static_cast<uint64_t>(message_count));
+
+    std::string text = client1.get_metrics_prometheus();
+    EXPECT_NE(text.find("librats_message_handling_seconds_count"), std::string::npos);
+    EXPECT_NE(text.find("librats_peers_validated"), std::string::npos);
+
+    client2.stop();
+    client1.stop();
+}
@@ -2,11 +2,16 @@
 #include <gmock/gmock.h>
 #include "noise.h"
 #include "encrypted_socket.h"
+#include "sha256.h"
 #include <string>
 #include <vector>
 #include <iomanip>
 #include <sstream>
 #include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 using namespace librats;
 
@@ -225,7 +230,6 @@ TEST_F(NoiseTest, Curve25519KeyExchangeProperties) {
 // Test SHA256 hashing properties
 TEST_F(NoiseTest, SHA256HashingProperties) {
     // Test deterministic property with non-empty input
-    // Note: The current implementation is a placeholder, so we test basic properties
     std::vector<uint8_t> test_input = {0x01, 0x02, 0x03, 0x04, 0x05};
     NoiseHash hash1 = NoiseCrypto::hash(test_input);
     NoiseHash hash2 = NoiseCrypto::hash(test_input);
@@ -246,18 +250,9 @@ TEST_F(NoiseTest, SHA256HashingProperties) {
     NoiseHash hash3 = NoiseCrypto::hash(different_input);
     EXPECT_NE(hash1, hash3);
     
-    // Test with empty input (placeholder implementation returns zeros)
-    std::vector<uint8_t> empty_input;
-    NoiseHash empty_hash = NoiseCrypto::hash(empty_input);
-    // With placeholder implementation, empty input produces all zeros
-    bool all_zeros = true;
-    for (uint8_t byte : empty_hash) {
-        if (byte != 0) {
-            all_zeros = false;
-            break;
-        }
-    }
-    EXPECT_TRUE(all_zeros); // This is expected behavior for the placeholder
+    // Known digests
+    EXPECT_EQ(array_to_hex(NoiseCrypto::hash({})), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(array_to_hex(NoiseCrypto::hash({'a', 'b', 'c'})), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
 }
 
 // Test HKDF key derivation
@@ -519,4 +514,304 @@ TEST_F(NoiseTest, ProtocolUtilitiesTest) {
     // Test error strings
     EXPECT_EQ(noise_utils::noise_error_to_string(noise_utils::NoiseError::SUCCESS), "Success");
     EXPECT_EQ(noise_utils::noise_error_to_string(noise_utils::NoiseError::HANDSHAKE_FAILED), "Handshake failed");
-} 
\ No newline at end of file
+}
+
+// Test X25519 against the RFC 7748 vectors
+TEST_F(NoiseTest, X25519KnownVectors) {
+    NoiseKey scalar = noise_utils::hex_to_key("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4");
+    NoiseKey point = noise_utils::hex_to_key("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c");
+    EXPECT_EQ(noise_utils::key_to_hex(NoiseCrypto::dh(scalar, point)),
+              "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552");
+    
+    NoiseKey alice_private = noise_utils::hex_to_key("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a");
+    NoiseKey bob_private = noise_utils::hex_to_key("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb");
+    NoiseKey alice_public = NoiseCrypto::public_key(alice_private);
+    NoiseKey bob_public = NoiseCrypto::public_key(bob_private);
+    EXPECT_EQ(noise_utils::key_to_hex(alice_public), "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a");
+    EXPECT_EQ(noise_utils::key_to_hex(bob_public), "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f");
+    
+    std::string shared = "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742";
+    EXPECT_EQ(noise_utils::key_to_hex(NoiseCrypto::dh(alice_private, bob_public)), shared);
+    EXPECT_EQ(noise_utils::key_to_hex(NoiseCrypto::dh(bob_private, alice_public)), shared);
+}
+
+// Test ChaCha20-Poly1305 against reference output (RFC 8439 construction, Noise nonce layout)
+TEST_F(NoiseTest, ChaChaPolyKnownVectors) {
+    NoiseKey key;
+    for (size_t i = 0; i < key.size(); ++i) {
+        key[i] = static_cast<uint8_t>(i);
+    }
+    
+    std::string hello = "Hello, Noise!";
+    auto ciphertext = NoiseCrypto::encrypt(key, 1, std::vector<uint8_t>(hello.begin(), hello.end()));
+    EXPECT_EQ(bytes_to_hex(ciphertext), "d7329f33da068f5646dfdd3973e854240ae0f6e1a2be1a77dd4d621868");
+    
+    EXPECT_EQ(bytes_to_hex(NoiseCrypto::encrypt(key, 0, {})), "10324f800a160bd9a1794255be7ec29d");
+    
+    // Multi-block message with associated data
+    std::vector<uint8_t> plaintext(600);
+    for (size_t i = 0; i < plaintext.size(); ++i) {
+        plaintext[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    std::vector<uint8_t> ad = {'l', 'i', 'b', 'r', 'a', 't', 's'};
+    ciphertext = NoiseCrypto::encrypt(key, 7, plaintext, ad);
+    ASSERT_EQ(ciphertext.size(), plaintext.size() + NOISE_TAG_SIZE);
+    EXPECT_EQ(bytes_to_hex(std::vector<uint8_t>(ciphertext.end() - NOISE_TAG_SIZE, ciphertext.end())),
+              "232e3cfa80448b096cb810805b2c9426");
+    EXPECT_EQ(SHA256::hash_bytes(std::vector<uint8_t>(ciphertext.begin(), ciphertext.end() - NOISE_TAG_SIZE)),
+              "889de58885baa567a4fbccc642d36afefc8342921657d6be1d56c18c38b8a0bb");
+    
+    // Wrong associated data is rejected
+    EXPECT_TRUE(NoiseCrypto::decrypt(key, 7, ciphertext, {}).empty());
+    EXPECT_EQ(NoiseCrypto::decrypt(key, 7, ciphertext, ad), plaintext);
+}
+
+// Test that every SIMD backend available on this machine matches the scalar implementation
+TEST_F(NoiseTest, CipherBackendsMatchScalar) {
+    NoiseCipherBackend original = NoiseCrypto::get_cipher_backend();
+    EXPECT_TRUE(NoiseCrypto::is_cipher_backend_supported(original));
+    EXPECT_TRUE(NoiseCrypto::is_cipher_backend_supported(NoiseCipherBackend::SCALAR));
+    
+    NoiseKey key = noise_utils::generate_static_keypair();
+    std::vector<std::vector<uint8_t>> plaintexts;
+    for (size_t size : {0, 1, 63, 64, 65, 255, 256, 257, 511, 512, 513, 1000, 4096, 4097}) {
+        std::vector<uint8_t> plaintext(size);
+        NoiseCrypto::random_bytes(plaintext.data(), plaintext.size());
+        plaintexts.push_back(plaintext);
+    }
+    
+    ASSERT_TRUE(NoiseCrypto::set_cipher_backend(NoiseCipherBackend::SCALAR));
+    std::vector<std::vector<uint8_t>> expected;
+    for (const auto& plaintext : plaintexts) {
+        expected.push_back(NoiseCrypto::encrypt(key, 42, plaintext));
+    }
+    
+    for (auto backend : {NoiseCipherBackend::SSE2, NoiseCipherBackend::AVX2, NoiseCipherBackend::NEON}) {
+        if (!NoiseCrypto::set_cipher_backend(backend)) {
+            continue;
+        }
+        for (size_t i = 0; i < plaintexts.size(); ++i) {
+            EXPECT_EQ(NoiseCrypto::encrypt(key, 42, plaintexts[i]), expected[i])
+                << NoiseCrypto::cipher_backend_name(backend) << ", size " << plaintexts[i].size();
+            EXPECT_EQ(NoiseCrypto::decrypt(key, 42, expected[i]), plaintexts[i])
+                << NoiseCrypto::cipher_backend_name(backend) << ", size " << plaintexts[i].size();
+        }
+    }
+    
+    EXPECT_TRUE(NoiseCrypto::set_cipher_backend(original));
+}
+
+// Test in-place transport encryption and rejection of tampered or replayed messages
+TEST_F(NoiseTest, InPlaceTransportMessages) {
+    NoiseSession initiator_session;
+    NoiseSession responder_session;
+    ASSERT_TRUE(initiator_session.initialize_as_initiator(noise_utils::generate_static_keypair()));
+    ASSERT_TRUE(responder_session.initialize_as_responder(noise_utils::generate_static_keypair()));
+    
+    responder_session.process_handshake_message(initiator_session.create_handshake_message());
+    initiator_session.process_handshake_message(responder_session.create_handshake_message());
+    responder_session.process_handshake_message(initiator_session.create_handshake_message());
+    ASSERT_TRUE(initiator_session.is_handshake_completed());
+    ASSERT_TRUE(responder_session.is_handshake_completed());
+    
+    std::vector<uint8_t> plaintext(100000);
+    for (size_t i = 0; i < plaintext.size(); ++i) {
+        plaintext[i] = static_cast<uint8_t>(i);
+    }
+    std::vector<uint8_t> buffer = plaintext;
+    uint8_t tag[NOISE_TAG_SIZE];
+    ASSERT_TRUE(initiator_session.encrypt_transport_message(buffer.data(), buffer.size(), tag));
+    EXPECT_NE(buffer, plaintext);
+    
+    // A flipped bit fails authentication and leaves the buffer untouched
+    std::vector<uint8_t> tampered = buffer;
+    tampered[5000] ^= 0x01;
+    std::vector<uint8_t> tampered_copy = tampered;
+    EXPECT_FALSE(responder_session.decrypt_transport_message(tampered.data(), tampered.size(), tag));
+    EXPECT_EQ(tampered, tampered_copy);
+    
+    // The failed attempt did not consume the nonce
+    std::vector<uint8_t> replay = buffer;
+    ASSERT_TRUE(responder_session.decrypt_transport_message(buffer.data(), buffer.size(), tag));
+    EXPECT_EQ(buffer, plaintext);
+    EXPECT_FALSE(responder_session.decrypt_transport_message(replay.data(), replay.size(), tag));
+    
+    // Empty messages still carry a tag
+    ASSERT_TRUE(responder_session.encrypt_transport_message(nullptr, 0, tag));
+    EXPECT_TRUE(initiator_session.decrypt_transport_message(nullptr, 0, tag));
+}
+
+namespace {
+
+// Exchange handshake messages until both sides are done (or one fails); returns the message count
+int run_handshake(NoiseSession& initiator, NoiseSession& responder) {
+    NoiseSession* writer = &initiator;
+    NoiseSession* reader = &responder;
+    int messages = 0;
+    while (messages < 4 && !(initiator.is_handshake_completed() && responder.is_handshake_completed())) {
+        auto message = writer->create_handshake_message();
+        if (message.empty()) {
+            return -1;
+        }
+        reader->process_handshake_message(message);
+        if (reader->has_handshake_failed()) {
+            return -1;
+        }
+        ++messages;
+        std::swap(writer, reader);
+    }
+    return messages;
+}
+
+bool transport_works(NoiseSession& a, NoiseSession& b) {
+    std::vector<uint8_t> plaintext = {1, 2, 3, 4, 5};
+    return b.decrypt_transport_message(a.encrypt_transport_message(plaintext)) == plaintext &&
+           a.decrypt_transport_message(b.encrypt_transport_message(plaintext)) == plaintext;
+}
+
+} // anonymous namespace
+
+// Test the IK handshake and ticket resumption (NNpsk0) for peers seen before
+TEST_F(NoiseTest, ShortHandshakesForKnownPeers) {
+    NoiseKey initiator_key = noise_utils::generate_static_keypair();
+    NoiseKey responder_key = noise_utils::generate_static_keypair();
+    NoiseKey responder_public = NoiseCrypto::public_key(responder_key);
+    
+    // A first contact uses XX; both sides derive the same ticket from it
+    NoiseSession xx_initiator;
+    NoiseSession xx_responder;
+    ASSERT_TRUE(xx_initiator.initialize_as_initiator(initiator_key));
+    ASSERT_TRUE(xx_responder.initialize_as_responder(responder_key));
+    ASSERT_EQ(run_handshake(xx_initiator, xx_responder), 3);
+    NoiseSessionTicket initiator_ticket;
+    NoiseSessionTicket responder_ticket;
+    ASSERT_TRUE(xx_initiator.get_session_ticket(initiator_ticket));
+    ASSERT_TRUE(xx_responder.get_session_ticket(responder_ticket));
+    EXPECT_EQ(initiator_ticket.id, responder_ticket.id);
+    EXPECT_EQ(initiator_ticket.secret, responder_ticket.secret);
+    EXPECT_EQ(initiator_ticket.remote_static_key, responder_public);
+    EXPECT_EQ(responder_ticket.remote_static_key, NoiseCrypto::public_key(initiator_key));
+    
+    // IK: the initiator knows the responder's key and finishes in one round trip
+    NoiseSession ik_initiator;
+    NoiseSession ik_responder;
+    ASSERT_TRUE(ik_initiator.initialize_as_initiator(initiator_key, responder_public));
+    ASSERT_TRUE(ik_responder.initialize_as_responder(responder_key));
+    ASSERT_EQ(run_handshake(ik_initiator, ik_responder), 2);
+    EXPECT_EQ(ik_initiator.get_handshake_pattern(), NoiseHandshakePattern::IK);
+    EXPECT_EQ(ik_responder.get_handshake_pattern(), NoiseHandshakePattern::IK);
+    EXPECT_EQ(ik_responder.get_remote_static_public_key(), NoiseCrypto::public_key(initiator_key));
+    EXPECT_TRUE(transport_works(ik_initiator, ik_responder));
+    
+    // NNpsk0: the ticket replaces static key DH; identities carry over from the ticket
+    int lookups = 0;
+    NoiseSession resumed_initiator;
+    NoiseSession resumed_responder;
+    ASSERT_TRUE(resumed_initiator.initialize_as_resuming_initiator(initiator_key, initiator_ticket));
+    ASSERT_TRUE(resumed_responder.initialize_as_responder(responder_key));
+    resumed_responder.set_ticket_lookup([&](const NoiseTicketId& id, NoiseSessionTicket& ticket) {
+        ++lookups;
+        if (id != responder_ticket.id) {
+            return false;
+        }
+        ticket = responder_ticket;
+        return true;
+    });
+    ASSERT_EQ(run_handshake(resumed_initiator, resumed_responder), 2);
+    EXPECT_EQ(lookups, 1);
+    EXPECT_EQ(resumed_initiator.get_handshake_pattern(), NoiseHandshakePattern::NNPSK0);
+    EXPECT_EQ(resumed_responder.get_handshake_pattern(), NoiseHandshakePattern::NNPSK0);
+    EXPECT_EQ(resumed_initiator.get_remote_static_public_key(), responder_public);
+    EXPECT_EQ(resumed_responder.get_remote_static_public_key(), NoiseCrypto::public_key(initiator_key));
+    EXPECT_TRUE(transport_works(resumed_initiator, resumed_responder));
+    
+    // The resumed session issues a fresh ticket
+    NoiseSessionTicket next_ticket;
+    ASSERT_TRUE(resumed_initiator.get_session_ticket(next_ticket));
+    EXPECT_NE(next_ticket.id, initiator_ticket.id);
+}
+
+// Test that stale keys and unknown tickets fall back to a full handshake on the same connection
+TEST_F(NoiseTest, ShortHandshakeFallsBackToXX) {
+    NoiseKey initiator_key = noise_utils::generate_static_keypair();
+    NoiseKey responder_key = noise_utils::generate_static_keypair();
+    NoiseKey initiator_public = NoiseCrypto::public_key(initiator_key);
+    NoiseKey responder_public = NoiseCrypto::public_key(responder_key);
+    
+    // IK with a key the responder no longer has
+    NoiseSession ik_initiator;
+    NoiseSession ik_responder;
+    ASSERT_TRUE(ik_initiator.initialize_as_initiator(initiator_key, noise_utils::generate_static_keypair()));
+    ASSERT_TRUE(ik_responder.initialize_as_responder(responder_key));
+    ASSERT_EQ(run_handshake(ik_initiator, ik_responder), 3);
+    EXPECT_EQ(ik_initiator.get_handshake_pattern(), NoiseHandshakePattern::XX_FALLBACK);
+    EXPECT_EQ(ik_responder.get_handshake_pattern(), NoiseHandshakePattern::XX_FALLBACK);
+    EXPECT_EQ(ik_initiator.get_remote_static_public_key(), responder_public);
+    EXPECT_EQ(ik_responder.get_remote_static_public_key(), initiator_public);
+    EXPECT_TRUE(transport_works(ik_initiator, ik_responder));
+    
+    // A ticket the responder does not know (expired, evicted or already used)
+    NoiseSessionTicket ticket;
+    ASSERT_TRUE(ik_initiator.get_session_ticket(ticket));
+    NoiseSession resumed_initiator;
+    NoiseSession resumed_responder;
+    ASSERT_TRUE(resumed_initiator.initialize_as_resuming_initiator(initiator_key, ticket));
+    ASSERT_TRUE(resumed_responder.initialize_as_responder(responder_key));
+    resumed_responder.set_ticket_lookup([](const NoiseTicketId&, NoiseSessionTicket&) { return false; });
+    ASSERT_EQ(run_handshake(resumed_initiator, resumed_responder), 3);
+    EXPECT_EQ(resumed_initiator.get_handshake_pattern(), NoiseHandshakePattern::XX_FALLBACK);
+    EXPECT_EQ(resumed_initiator.get_remote_static_public_key(), responder_public);
+    EXPECT_EQ(resumed_responder.get_remote_static_public_key(), initiator_public);
+    EXPECT_TRUE(transport_works(resumed_initiator, resumed_responder));
+    
+    // An IK first message cannot be mistaken for the bare ephemeral key XX starts with
+    NoiseSession probe;
+    ASSERT_TRUE(probe.initialize_as_initiator(initiator_key, responder_public));
+    auto message = probe.create_handshake_message();
+    ASSERT_FALSE(message.empty());
+    EXPECT_NE(message.size(), NOISE_KEY_SIZE);
+}
+
+// Test that the handshake worker pool refuses work beyond its queue limit
+TEST_F(NoiseTest, HandshakeWorkerPoolAdmission) {
+    HandshakeWorkerPool pool("test");
+    EXPECT_FALSE(pool.submit([]() {}));
+    ASSERT_TRUE(pool.start(1, 2));
+    
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool release = false;
+    std::atomic<int> started{0};
+    std::atomic<int> finished{0};
+    auto job = [&]() {
+        started++;
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return release; });
+        finished++;
+    };
+    
+    // One job occupies the only thread, two more fill the queue
+    ASSERT_TRUE(pool.submit(job));
+    for (int i = 0; i < 200 && started.load() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(started.load(), 1);
+    EXPECT_TRUE(pool.submit(job));
+    EXPECT_TRUE(pool.submit(job));
+    EXPECT_TRUE(pool.is_saturated());
+    EXPECT_FALSE(pool.submit(job));
+    EXPECT_EQ(pool.get_pending_count(), 2u);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+    for (int i = 0; i < 200 && finished.load() < 3; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(finished.load(), 3);
+    EXPECT_FALSE(pool.is_saturated());
+    pool.stop();
+    EXPECT_FALSE(pool.is_running());
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "os.h"
 #include <iostream>
+#include <thread>
+#include <vector>
 
 using namespace librats;
 
@@ -132,4 +134,23 @@ TEST_F(OSTest, LogicalCoresGreaterThanOrEqualToPhysicalCores) {
     
     // Logical cores should be >= physical cores (hyperthreading)
     EXPECT_GE(logical_cores, physical_cores);
-} 
\ No newline at end of file
+} 
+TEST_F(OSTest, ThreadAffinity) {
+    std::vector<int> cpus = get_available_cpus();
+    ASSERT_FALSE(cpus.empty());
+    EXPECT_LE(cpus.size(), static_cast<size_t>(get_cpu_logical_cores()));
+    for (int cpu : cpus) {
+        EXPECT_GE(cpu, 0);
+    }
+    
+    // Pinning is not supported on every platform, but a CPU we may not run on is always refused
+    std::thread worker([&cpus]() {
+        bool pinned = set_current_thread_cpu(cpus.back());
+#ifdef __linux__
+        EXPECT_TRUE(pinned);
+#endif
+        (void)pinned;
+        EXPECT_FALSE(set_current_thread_cpu(-1));
+    });
+    worker.join();
+}
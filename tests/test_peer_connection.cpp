@@ -0,0 +1,389 @@
+#include <gtest/gtest.h>
+#include "bittorrent.h"
+#include "socket.h"
+#include "utp.h"
+#include "fs.h"
+#include "sha1.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+using namespace librats;
+
+class PeerConnectionTest : public ::testing::Test {
+protected:
+    const std::string download_path = "test_peer_connection";
+    const uint32_t piece_length = 2 * BLOCK_SIZE;
+    std::vector<uint8_t> content;
+    TorrentInfo torrent_info;
+
+    void SetUp() override {
+        ASSERT_TRUE(init_socket_library());
+        ASSERT_TRUE(create_directories(download_path.c_str()));
+
+        content.resize(2 * piece_length);
+        for (size_t i = 0; i < content.size(); ++i) {
+            content[i] = static_cast<uint8_t>((i * 13) ^ (i >> 9));
+        }
+
+        // Single-file torrent over the content
+        std::string pieces;
+        for (size_t offset = 0; offset < content.size(); offset += piece_length) {
+            uint8_t digest[20];
+            SHA1 sha1;
+            sha1.update(content.data() + offset, piece_length);
+            sha1.finalize(digest);
+            pieces.append(reinterpret_cast<const char*>(digest), sizeof(digest));
+        }
+        auto info = BencodeValue::create_dict();
+        info["name"] = BencodeValue(std::string("peer.bin"));
+        info["piece length"] = BencodeValue(static_cast<int64_t>(piece_length));
+        info["length"] = BencodeValue(static_cast<int64_t>(content.size()));
+        info["pieces"] = BencodeValue(pieces);
+        auto torrent = BencodeValue::create_dict();
+        torrent["info"] = info;
+        ASSERT_TRUE(torrent_info.load_from_bencode(torrent));
+    }
+
+    void TearDown() override {
+        delete_file((download_path + "/peer.bin").c_str());
+        delete_directory(download_path.c_str());
+        cleanup_socket_library();
+    }
+
+    // Listening loopback socket and the port it is bound to
+    socket_t create_server(int& port) {
+        socket_t server = create_tcp_server_v4(0);
+        port = is_valid_socket(server) ? get_ephemeral_port(server) : 0;
+        return server;
+    }
+
+    static bool send_bytes(socket_t socket, const std::vector<uint8_t>& data) {
+        return send_tcp_string(socket, std::string(data.begin(), data.end())) > 0;
+    }
+
+    // Up to count bytes, less if the connection closes or nothing arrives for 5 seconds
+    static std::vector<uint8_t> receive_bytes(socket_t socket, size_t count) {
+        std::vector<uint8_t> data(count);
+        size_t received = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (received < count && std::chrono::steady_clock::now() < deadline) {
+            int result = receive_tcp_nonblocking(socket, data.data() + received, count - received);
+            if (result < 0) {
+                break;
+            }
+            if (result == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            received += static_cast<size_t>(result);
+        }
+        data.resize(received);
+        return data;
+    }
+
+    static bool wait_for(const std::function<bool()>& condition) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+};
+
+// Test that an accepted connection reassembles messages split across arbitrary reads
+TEST_F(PeerConnectionTest, IncomingPeerParsesFragmentedMessages) {
+    int port = 0;
+    socket_t server = create_server(port);
+    ASSERT_TRUE(is_valid_socket(server));
+    ASSERT_GT(port, 0);
+    socket_t remote = create_tcp_client("127.0.0.1", port, 5000);
+    ASSERT_TRUE(is_valid_socket(remote));
+    socket_t accepted = accept_client(server);
+    ASSERT_TRUE(is_valid_socket(accepted));
+    close_socket(server);
+
+    {
+        TorrentDownload download(torrent_info, download_path);
+        ASSERT_TRUE(download.get_storage()->open());
+
+        PeerID peer_id;
+        peer_id.fill(0x42);
+        ASSERT_TRUE(download.add_incoming_peer(accepted, Peer("127.0.0.1", 50001), peer_id));
+        EXPECT_EQ(download.get_connected_peers().size(), 1u);
+        EXPECT_FALSE(download.add_incoming_peer(INVALID_SOCKET_VALUE, Peer("127.0.0.1", 50001), peer_id));
+
+        // Bitfield, keep-alive, unchoke and the two blocks of piece 0 in one stream
+        std::vector<uint8_t> stream = PeerMessage::create_bitfield(Bitfield(2, true)).serialize();
+        stream.insert(stream.end(), 4, 0);
+        auto append = [&stream](const std::vector<uint8_t>& message) {
+            stream.insert(stream.end(), message.begin(), message.end());
+        };
+        append(PeerMessage::create_unchoke().serialize());
+        for (uint32_t offset = 0; offset < piece_length; offset += BLOCK_SIZE) {
+            std::vector<uint8_t> block(content.begin() + offset, content.begin() + offset + BLOCK_SIZE);
+            append(PeerMessage::create_piece(0, offset, block).serialize());
+        }
+
+        // Odd fragment sizes split headers and payloads alike
+        const size_t fragments[] = {1, 3, 5, 2, 7, 1000, 9000, 13};
+        size_t position = 0;
+        for (size_t i = 0; position < stream.size(); ++i) {
+            size_t size = (std::min)(fragments[i % (sizeof(fragments) / sizeof(fragments[0]))], stream.size() - position);
+            ASSERT_TRUE(send_bytes(remote, std::vector<uint8_t>(stream.begin() + position, stream.begin() + position + size)));
+            position += size;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        EXPECT_TRUE(wait_for([&] { return download.is_piece_complete(0); }));
+        EXPECT_FALSE(download.is_piece_complete(1));
+
+        // The remote closing the connection is noticed without any polling thread
+        close_socket(remote);
+        EXPECT_TRUE(wait_for([&] { return download.get_connected_peers().empty(); }));
+    }
+}
+
+// Test the non-blocking outgoing connect, the handshake and the message size limit
+TEST_F(PeerConnectionTest, OutgoingPeerHandshake) {
+    int port = 0;
+    socket_t server = create_server(port);
+    ASSERT_TRUE(is_valid_socket(server));
+    ASSERT_GT(port, 0);
+
+    {
+        TorrentDownload download(torrent_info, download_path);
+        ASSERT_TRUE(download.add_peer(Peer("127.0.0.1", static_cast<uint16_t>(port))));
+        EXPECT_EQ(download.get_peer_count(), 1u);
+        EXPECT_TRUE(download.get_connected_peers().empty());
+
+        socket_t remote = accept_client(server);
+        ASSERT_TRUE(is_valid_socket(remote));
+
+        // Our handshake is sent as soon as the connection is established
+        InfoHash info_hash;
+        PeerID peer_id;
+        ASSERT_TRUE(parse_handshake_message(receive_bytes(remote, HANDSHAKE_SIZE), info_hash, peer_id));
+        EXPECT_EQ(info_hash, torrent_info.get_info_hash());
+        EXPECT_FALSE(download.get_connected_peers().size() > 0);
+
+        PeerID remote_id;
+        remote_id.fill(0x17);
+        ASSERT_TRUE(send_bytes(remote, create_handshake_message(info_hash, remote_id)));
+        EXPECT_TRUE(wait_for([&] { return download.get_connected_peers().size() == 1; }));
+
+        // Both sides announced the extension protocol, so our extended handshake follows
+        std::vector<uint8_t> header = receive_bytes(remote, 6);
+        ASSERT_EQ(header.size(), 6u);
+        EXPECT_EQ(header[4], static_cast<uint8_t>(MessageType::EXTENDED));
+        EXPECT_EQ(header[5], EXTENDED_HANDSHAKE_ID);
+        size_t length = (static_cast<size_t>(header[0]) << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        EXPECT_EQ(receive_bytes(remote, length - 2).size(), length - 2);
+
+        // A length prefix over the limit drops the connection
+        ASSERT_TRUE(send_bytes(remote, {0x7F, 0xFF, 0xFF, 0xFF}));
+        EXPECT_TRUE(wait_for([&] { return download.get_connected_peers().empty(); }));
+        EXPECT_TRUE(receive_bytes(remote, 1).empty());
+
+        close_socket(remote);
+    }
+    close_socket(server);
+}
+
+// Test that requests are served from storage once unchoked, within the upload limit
+TEST_F(PeerConnectionTest, ServesRequestsWithinUploadLimit) {
+    int port = 0;
+    socket_t server = create_server(port);
+    ASSERT_TRUE(is_valid_socket(server));
+    ASSERT_GT(port, 0);
+    socket_t remote = create_tcp_client("127.0.0.1", port, 5000);
+    ASSERT_TRUE(is_valid_socket(remote));
+    socket_t accepted = accept_client(server);
+    ASSERT_TRUE(is_valid_socket(accepted));
+    close_socket(server);
+
+    TorrentDownload download(torrent_info, download_path);
+    ASSERT_TRUE(download.get_storage()->open());
+    for (uint32_t offset = 0; offset < piece_length; offset += BLOCK_SIZE) {
+        std::vector<uint8_t> block(content.begin() + offset, content.begin() + offset + BLOCK_SIZE);
+        ASSERT_TRUE(download.store_piece_block(0, offset, block));
+    }
+    ASSERT_TRUE(download.is_piece_complete(0));
+    download.set_upload_rate_limit(20000);  // Burst of TokenBucket::MIN_BURST
+
+    ASSERT_TRUE(download.get_reactor()->start());
+    auto peer = std::make_shared<PeerConnection>(&download, Peer("127.0.0.1", 50002), accepted);
+    PeerID peer_id;
+    peer_id.fill(0x33);
+    ASSERT_TRUE(peer->accept(peer_id));
+
+    // Normally driven by the torrent's peer management thread
+    std::atomic<bool> ticking(true);
+    std::thread ticker([&] {
+        while (ticking) {
+            peer->on_bandwidth_tick();
+            std::this_thread::sleep_for(std::chrono::milliseconds(BANDWIDTH_TICK_MS));
+        }
+    });
+
+    // Our bitfield goes out first, then the unchoke
+    std::vector<uint8_t> bitfield = PeerMessage::create_bitfield(download.get_piece_bitfield()).serialize();
+    EXPECT_EQ(receive_bytes(remote, bitfield.size()), bitfield);
+    peer->set_choke(false);
+    EXPECT_EQ(receive_bytes(remote, 5), PeerMessage::create_unchoke().serialize());
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> requests = PeerMessage::create_request(0, 0, BLOCK_SIZE).serialize();
+    std::vector<uint8_t> second = PeerMessage::create_request(0, BLOCK_SIZE, BLOCK_SIZE).serialize();
+    requests.insert(requests.end(), second.begin(), second.end());
+    ASSERT_TRUE(send_bytes(remote, requests));
+
+    for (uint32_t offset = 0; offset < piece_length; offset += BLOCK_SIZE) {
+        std::vector<uint8_t> block(content.begin() + offset, content.begin() + offset + BLOCK_SIZE);
+        EXPECT_EQ(receive_bytes(remote, 13 + BLOCK_SIZE), PeerMessage::create_piece(0, offset, block).serialize());
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // 32 KiB at 20000 B/s after what is left of the 16 KiB burst takes most of a second
+    EXPECT_GE(elapsed, std::chrono::milliseconds(500));
+    EXPECT_EQ(peer->get_uploaded(), piece_length);
+    EXPECT_EQ(download.get_uploaded_bytes(), piece_length);
+
+    ticking = false;
+    ticker.join();
+    peer->disconnect();
+    close_socket(remote);
+}
+
+// Test an outgoing connection over uTP: the handshake, then data buffered right behind it
+TEST_F(PeerConnectionTest, OutgoingUtpPeerDownloads) {
+    UtpManager remote_manager;
+    std::mutex accepted_mutex;
+    std::shared_ptr<UtpSocket> remote;
+    remote_manager.set_accept_callback([&](std::shared_ptr<UtpSocket> socket) {
+        std::lock_guard<std::mutex> lock(accepted_mutex);
+        remote = std::move(socket);
+    });
+    ASSERT_TRUE(remote_manager.start(0));
+    auto accepted = [&] {
+        std::lock_guard<std::mutex> lock(accepted_mutex);
+        return remote;
+    };
+
+    {
+        TorrentDownload download(torrent_info, download_path);
+        ASSERT_TRUE(download.get_storage()->open());
+        ASSERT_TRUE(download.add_utp_peer(Peer("127.0.0.1", static_cast<uint16_t>(remote_manager.get_port()))));
+        EXPECT_EQ(download.get_peer_count(), 1u);
+        EXPECT_FALSE(download.add_utp_peer(Peer("127.0.0.1", static_cast<uint16_t>(remote_manager.get_port()))));
+
+        ASSERT_TRUE(wait_for([&] { return accepted() != nullptr; }));
+        auto socket = accepted();
+
+        std::vector<uint8_t> handshake;
+        ASSERT_TRUE(wait_for([&] {
+            uint8_t buffer[HANDSHAKE_SIZE];
+            int received = socket->read(buffer, HANDSHAKE_SIZE - handshake.size());
+            if (received > 0) {
+                handshake.insert(handshake.end(), buffer, buffer + received);
+            }
+            return handshake.size() == HANDSHAKE_SIZE;
+        }));
+        InfoHash info_hash;
+        PeerID peer_id;
+        ASSERT_TRUE(parse_handshake_message(handshake, info_hash, peer_id));
+        EXPECT_EQ(info_hash, torrent_info.get_info_hash());
+
+        // Handshake, bitfield, unchoke and piece 0 in one write
+        PeerID remote_id;
+        remote_id.fill(0x29);
+        std::vector<uint8_t> stream = create_handshake_message(info_hash, remote_id);
+        auto append = [&stream](const std::vector<uint8_t>& message) {
+            stream.insert(stream.end(), message.begin(), message.end());
+        };
+        append(PeerMessage::create_bitfield(Bitfield(2, true)).serialize());
+        append(PeerMessage::create_unchoke().serialize());
+        for (uint32_t offset = 0; offset < piece_length; offset += BLOCK_SIZE) {
+            std::vector<uint8_t> block(content.begin() + offset, content.begin() + offset + BLOCK_SIZE);
+            append(PeerMessage::create_piece(0, offset, block).serialize());
+        }
+        ASSERT_EQ(socket->write(stream.data(), stream.size()), static_cast<int>(stream.size()));
+
+        EXPECT_TRUE(wait_for([&] { return download.get_connected_peers().size() == 1; }));
+        EXPECT_TRUE(wait_for([&] { return download.is_piece_complete(0); }));
+
+        // The remote closing is noticed like a TCP disconnect
+        socket->close();
+        EXPECT_TRUE(wait_for([&] { return download.get_connected_peers().empty(); }));
+    }
+    remote_manager.stop();
+}
+
+// Test that the choker reciprocates with the best sources and rotates the optimistic unchoke
+TEST(ChokerTest, ReciprocatesWhileDownloading) {
+    Choker choker(2, 2);
+    std::vector<Choker::Candidate> candidates = {
+        {1, true, 1000, 0}, {2, true, 5000, 0}, {3, false, 9000, 0}, {4, true, 3000, 0}, {5, true, 0, 0}, {6, true, 0, 0},
+    };
+
+    std::vector<uint64_t> unchoked = choker.run_round(candidates, false);
+    ASSERT_EQ(unchoked.size(), 3u);
+    EXPECT_EQ(unchoked[0], 2u);
+    EXPECT_EQ(unchoked[1], 4u);
+    uint64_t optimistic = choker.get_optimistic_unchoke();
+    EXPECT_EQ(unchoked[2], optimistic);
+    EXPECT_TRUE(optimistic == 1 || optimistic == 5 || optimistic == 6);
+
+    // Rates are per round: peer 1 now sent the most, the uninterested peer 3 never qualifies
+    candidates[0].downloaded += 8000;
+    candidates[1].downloaded += 100;
+    candidates[2].downloaded += 50000;
+    candidates[3].downloaded += 4000;
+    unchoked = choker.run_round(candidates, false);
+    ASSERT_GE(unchoked.size(), 2u);
+    EXPECT_EQ(unchoked[0], 1u);
+    EXPECT_EQ(unchoked[1], 4u);
+    EXPECT_EQ(std::count(unchoked.begin(), unchoked.end(), 3u), 0);
+
+    // The optimistic slot only goes to interested peers outside the regular slots
+    uint64_t second_optimistic = choker.get_optimistic_unchoke();
+    EXPECT_NE(second_optimistic, 1u);
+    EXPECT_NE(second_optimistic, 4u);
+    EXPECT_NE(second_optimistic, 3u);
+}
+
+// Test that seeding rotates the slots round robin
+TEST(ChokerTest, SeedRoundRobin) {
+    Choker choker(2, 1000);
+    std::vector<Choker::Candidate> candidates;
+    for (uint64_t id = 1; id <= 5; ++id) {
+        candidates.push_back({id, true, 0, 0});
+    }
+
+    auto regular = [&choker](std::vector<uint64_t> unchoked) {
+        unchoked.erase(std::remove(unchoked.begin(), unchoked.end(), choker.get_optimistic_unchoke()), unchoked.end());
+        std::sort(unchoked.begin(), unchoked.end());
+        return unchoked;
+    };
+
+    std::vector<uint64_t> first = regular(choker.run_round(candidates, true));
+    ASSERT_EQ(first.size(), 2u);
+    for (size_t round = 1; round < SEED_UNCHOKE_ROUNDS; ++round) {
+        EXPECT_EQ(regular(choker.run_round(candidates, true)), first);
+    }
+
+    // Their turn is over, peers that have been waiting take the slots
+    std::vector<uint64_t> next = regular(choker.run_round(candidates, true));
+    ASSERT_EQ(next.size(), 2u);
+    for (uint64_t id : next) {
+        EXPECT_EQ(std::count(first.begin(), first.end(), id), 0);
+    }
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include "peer_store.h"
+#include "fs.h"
+
+using namespace librats;
+
+namespace {
+
+StoredPeer make_peer(const std::string& id, const std::string& ip, uint16_t port, int64_t last_success) {
+    StoredPeer peer;
+    peer.peer_id = id;
+    peer.ip = ip;
+    peer.port = port;
+    peer.version = "1.0";
+    peer.last_seen = last_success;
+    peer.last_success = last_success;
+    return peer;
+}
+
+} // namespace
+
+class PeerStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        delete_file(path.c_str());
+    }
+
+    void TearDown() override {
+        delete_file(path.c_str());
+    }
+
+    const std::string path = "peer_store_test.rats";
+};
+
+// Test that puts and removes survive reopening the log
+TEST_F(PeerStoreTest, ReplaysAppendedRecords) {
+    {
+        PeerStore store;
+        ASSERT_TRUE(store.open(path));
+        EXPECT_EQ(store.size(), 0u);
+        EXPECT_TRUE(store.put(make_peer("a", "10.0.0.1", 1000, 100)));
+        EXPECT_TRUE(store.put(make_peer("b", "10.0.0.2", 1000, 200)));
+        EXPECT_TRUE(store.put(make_peer("c", "10.0.0.3", 1000, 300)));
+        EXPECT_TRUE(store.remove("b"));
+        EXPECT_TRUE(store.record_failure("c"));
+        EXPECT_EQ(store.log_records(), 5u);
+    }
+
+    PeerStore store;
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(store.size(), 2u);
+    StoredPeer peer;
+    ASSERT_TRUE(store.get("c", peer));
+    EXPECT_EQ(peer.ip, "10.0.0.3");
+    EXPECT_EQ(peer.port, 1000);
+    EXPECT_EQ(peer.version, "1.0");
+    EXPECT_EQ(peer.last_success, 300);
+    EXPECT_EQ(peer.failures, 1u);
+    EXPECT_FALSE(store.get("b", peer));
+}
+
+// Test that a half-written record at the end is dropped and the rest is kept
+TEST_F(PeerStoreTest, TornTailIsDropped) {
+    {
+        PeerStore store;
+        ASSERT_TRUE(store.open(path));
+        store.put(make_peer("a", "10.0.0.1", 1000, 100));
+        store.put(make_peer("b", "10.0.0.2", 1000, 200));
+    }
+    int64_t size = get_file_size(path.c_str());
+    ASSERT_GT(size, 0);
+    {
+        FileHandle file;
+        ASSERT_TRUE(file.open(path.c_str(), FileOpenMode::READ_WRITE));
+        const uint8_t partial[] = {0x00, 0x00, 0x00, 0x40, 0x12, 0x34};
+        ASSERT_TRUE(file.write_at(static_cast<uint64_t>(size), partial, sizeof(partial)));
+    }
+
+    PeerStore store;
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(store.size(), 2u);
+    EXPECT_EQ(get_file_size(path.c_str()), size);
+    EXPECT_TRUE(store.put(make_peer("c", "10.0.0.3", 1000, 300)));
+
+    PeerStore reopened;
+    ASSERT_TRUE(reopened.open(path));
+    EXPECT_EQ(reopened.size(), 3u);
+}
+
+// Test that a peer taking over an address replaces the previous one, and that compaction keeps live peers
+TEST_F(PeerStoreTest, AddressTakeoverAndCompaction) {
+    PeerStore store;
+    ASSERT_TRUE(store.open(path));
+    store.put(make_peer("old", "10.0.0.1", 1000, 100));
+    store.put(make_peer("new", "10.0.0.1", 1000, 200));
+    StoredPeer peer;
+    EXPECT_FALSE(store.get("old", peer));
+    EXPECT_TRUE(store.get("new", peer));
+
+    for (int i = 0; i < 3000; ++i) {
+        store.record_success("new", 1000 + i);
+    }
+    EXPECT_LT(store.log_records(), 1100u);
+    ASSERT_TRUE(store.compact());
+    EXPECT_EQ(store.log_records(), 1u);
+
+    PeerStore reopened;
+    ASSERT_TRUE(reopened.open(path));
+    ASSERT_TRUE(reopened.get("new", peer));
+    EXPECT_EQ(peer.last_success, 3999);
+}
+
+// Test that reconnect candidates are ordered by recent success and penalized for failures
+TEST_F(PeerStoreTest, ReconnectCandidatesOrder) {
+    PeerStore store;
+    ASSERT_TRUE(store.open(path));
+    const int64_t now = 1000000;
+    store.put(make_peer("recent", "10.0.0.1", 1000, now - 60));
+    store.put(make_peer("older", "10.0.0.2", 1000, now - 1800));
+    store.put(make_peer("stale", "10.0.0.3", 1000, now - 8 * 24 * 3600));
+    store.put(make_peer("flaky", "10.0.0.4", 1000, now - 10));
+    store.record_failure("flaky");
+
+    auto candidates = store.reconnect_candidates(now, 7 * 24 * 3600);
+    ASSERT_EQ(candidates.size(), 3u);
+    EXPECT_EQ(candidates[0].peer_id, "recent");
+    EXPECT_EQ(candidates[1].peer_id, "older");
+    EXPECT_EQ(candidates[2].peer_id, "flaky");
+}
+
+// Test that a JSON peer file from an older version is imported and rewritten
+TEST_F(PeerStoreTest, ImportsLegacyJson) {
+    const std::string json = R"([{"ip":"10.0.0.1","port":1000,"peer_id":"a","version":"1.0","last_seen":500},)"
+                             R"({"ip":"10.0.0.2","port":0,"peer_id":"bad"}])";
+    ASSERT_TRUE(create_file(path.c_str(), json.c_str()));
+
+    PeerStore store;
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(store.size(), 1u);
+    StoredPeer peer;
+    ASSERT_TRUE(store.get("a", peer));
+    EXPECT_EQ(peer.last_success, 500);
+
+    PeerStore reopened;
+    ASSERT_TRUE(reopened.open(path));
+    EXPECT_EQ(reopened.size(), 1u);
+}
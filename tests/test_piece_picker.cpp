@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "piece_picker.h"
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+Bitfield make_bitfield(size_t size, const std::vector<size_t>& set_bits) {
+    Bitfield bitfield(size);
+    for (size_t i : set_bits) {
+        bitfield.set(i);
+    }
+    return bitfield;
+}
+
+} // namespace
+
+// Test that the rarest pieces are picked first and availability tracks peers
+TEST(PiecePickerTest, RarestFirst) {
+    PiecePicker picker(8);
+    Bitfield seed(8, true);
+    Bitfield partial = make_bitfield(8, {0, 1, 2, 3});
+
+    picker.inc_availability(seed);
+    picker.inc_availability(partial);
+    picker.inc_availability(5);
+    EXPECT_EQ(picker.get_availability(0), 2u);
+    EXPECT_EQ(picker.get_availability(5), 2u);
+    EXPECT_EQ(picker.get_availability(7), 1u);
+
+    // Pieces only the seed has come first
+    std::vector<PieceIndex> picked = picker.pick_pieces(seed, 3);
+    ASSERT_EQ(picked.size(), 3u);
+    for (PieceIndex piece_index : picked) {
+        EXPECT_EQ(picker.get_availability(piece_index), 1u) << piece_index;
+    }
+
+    // The partial peer can only be asked for what it has
+    picked = picker.pick_pieces(partial, 10);
+    EXPECT_EQ(picked.size(), 4u);
+    for (PieceIndex piece_index : picked) {
+        EXPECT_TRUE(partial.get(piece_index));
+    }
+
+    // After the seed leaves, pieces 4, 6 and 7 have no source
+    picker.dec_availability(seed);
+    EXPECT_EQ(picker.get_availability(7), 0u);
+    EXPECT_EQ(picker.pick_pieces(seed, 10).size(), 5u);  // 0-3 and 5 still have a source
+}
+
+// Test state transitions, priorities and sequential mode
+TEST(PiecePickerTest, PrioritiesAndSequential) {
+    PiecePicker picker(6);
+    Bitfield seed(6, true);
+    picker.inc_availability(seed);
+
+    picker.mark_have(0);
+    picker.mark_downloading(1);
+    picker.set_piece_priority(2, PiecePicker::PRIORITY_SKIP);
+    picker.set_piece_priority(5, PiecePicker::PRIORITY_TOP);
+
+    std::vector<PieceIndex> picked = picker.pick_pieces(seed, 10);
+    ASSERT_EQ(picked.size(), 3u);
+    EXPECT_EQ(picked[0], 5u);  // Top priority wins regardless of rarity
+
+    picker.set_sequential(true);
+    picked = picker.pick_pieces(seed, 10);
+    EXPECT_EQ(picked, (std::vector<PieceIndex>{5, 3, 4}));
+
+    // A failed piece becomes pickable again
+    picker.mark_missing(1);
+    picked = picker.pick_pieces(seed, 10);
+    EXPECT_EQ(picked, (std::vector<PieceIndex>{5, 1, 3, 4}));
+    EXPECT_TRUE(picker.has_piece(0));
+}
+
+// Test that endgame hands out pieces already being downloaded
+TEST(PiecePickerTest, Endgame) {
+    PiecePicker picker(3);
+    Bitfield seed(3, true);
+    picker.inc_availability(seed);
+
+    picker.mark_have(0);
+    picker.mark_downloading(1);
+    EXPECT_FALSE(picker.is_endgame());
+    EXPECT_EQ(picker.pick_pieces(seed, 10), (std::vector<PieceIndex>{2}));
+
+    picker.mark_downloading(2);
+    EXPECT_TRUE(picker.is_endgame());
+    EXPECT_EQ(picker.pick_pieces(seed, 10), (std::vector<PieceIndex>{1, 2}));
+    EXPECT_TRUE(picker.pick_pieces(make_bitfield(3, {0}), 10).empty());
+
+    picker.mark_have(1);
+    picker.mark_have(2);
+    EXPECT_FALSE(picker.is_endgame());
+    EXPECT_TRUE(picker.pick_pieces(seed, 10).empty());
+}
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include "rate_limiter.h"
+
+using namespace librats;
+
+// Test refill at the configured rate, the burst cap and debt
+TEST(RateLimiterTest, TokenBucketRefillAndDebt) {
+    auto start = std::chrono::steady_clock::now();
+    TokenBucket bucket(100000, 50000);
+    EXPECT_FALSE(bucket.is_unlimited());
+    EXPECT_EQ(bucket.get_burst(), 50000u);
+
+    // Starts full, never beyond the burst
+    EXPECT_EQ(bucket.available(1000000, start), 50000u);
+    EXPECT_EQ(bucket.available(100, start), 100u);
+    bucket.consume(50000, start);
+    EXPECT_EQ(bucket.available(1000000, start), 0u);
+
+    // 100 ms refills 10000 bytes
+    auto later = start + std::chrono::milliseconds(100);
+    EXPECT_NEAR(static_cast<double>(bucket.available(1000000, later)), 10000.0, 1.0);
+    EXPECT_EQ(bucket.available(1000000, later + std::chrono::seconds(10)), 50000u);
+
+    // Overshooting leaves a debt that has to be paid back first
+    auto now = later + std::chrono::seconds(10);
+    bucket.consume(70000, now);
+    EXPECT_EQ(bucket.available(1000000, now + std::chrono::milliseconds(150)), 0u);
+    EXPECT_NEAR(static_cast<double>(bucket.available(1000000, now + std::chrono::milliseconds(300))), 10000.0, 1.0);
+}
+
+// Test the unlimited default and changing the rate
+TEST(RateLimiterTest, TokenBucketUnlimitedAndReconfigure) {
+    TokenBucket bucket;
+    EXPECT_TRUE(bucket.is_unlimited());
+    bucket.consume(1 << 30);
+    EXPECT_EQ(bucket.available(123456), 123456u);
+
+    // Default burst is a quarter second of traffic, with a floor
+    bucket.set_rate(1000000);
+    EXPECT_EQ(bucket.get_rate(), 1000000u);
+    EXPECT_EQ(bucket.get_burst(), 250000u);
+    EXPECT_LE(bucket.available(1 << 30), 250000u);
+    bucket.set_rate(1000);
+    EXPECT_EQ(bucket.get_burst(), TokenBucket::MIN_BURST);
+
+    bucket.set_rate(0);
+    EXPECT_EQ(bucket.available(1 << 30), static_cast<size_t>(1 << 30));
+}
@@ -10,6 +10,11 @@
 #include <string>
 #include <atomic>
 #include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <map>
+#include <memory>
 
 using namespace librats;
 
@@ -59,6 +64,28 @@ TEST_F(RatsClientTest, BasicCreationTest) {
     EXPECT_FALSE(client.is_running());
 }
 
+// Test that resource limits reach the subsystems and usage is reported per cache
+TEST_F(RatsClientTest, ResourceLimitsTest) {
+    RatsClient client(0);
+    
+    auto usage = client.get_resource_usage();
+    ASSERT_TRUE(usage.contains("gossipsub.message_cache"));
+    ASSERT_TRUE(usage.contains("gossipsub.seen_messages"));
+    ASSERT_TRUE(usage.contains("file_transfer.history"));
+    ASSERT_TRUE(usage.contains("client.socket_send_mutexes"));
+    EXPECT_FALSE(usage.contains("dht.announced_peers"));  // DHT not started
+    EXPECT_EQ(usage["file_transfer.history"]["max_entries"], FILE_TRANSFER_MAX_HISTORY);
+    EXPECT_GT(usage["gossipsub.seen_messages"]["bytes"].get<size_t>(), 0u);
+    EXPECT_GE(usage["total_bytes"].get<size_t>(), usage["gossipsub.seen_messages"]["bytes"].get<size_t>());
+    
+    ResourceLimits limits;
+    limits.file_transfer_max_history = 10;
+    limits.mdns_max_services = 4;
+    client.set_resource_limits(limits);
+    EXPECT_EQ(client.get_resource_limits().mdns_max_services, 4u);
+    EXPECT_EQ(client.get_resource_usage()["file_transfer.history"]["max_entries"], 10u);
+}
+
 // Test RatsClient start and stop multiple times
 TEST_F(RatsClientTest, StartStopMultipleTest) {
     RatsClient client(0);
@@ -959,6 +986,70 @@ TEST_F(RatsClientTest, BinaryDataBroadcastTest) {
     client2.stop();
 }
 
+// Test sending one shared payload to a subset of peers
+TEST_F(RatsClientTest, MultiPeerSendTest) {
+    const int server_port = 59024;
+    const int client_ports[3] = {59025, 59026, 59027};
+    
+    RatsClient server(server_port);
+    std::vector<std::unique_ptr<RatsClient>> clients;
+    for (int port : client_ports) {
+        clients.push_back(std::make_unique<RatsClient>(port));
+    }
+    
+    std::atomic<int> binary_received[3] = {{0}, {0}, {0}};
+    std::atomic<int> json_received[3] = {{0}, {0}, {0}};
+    std::vector<uint8_t> payload = {0x00, 0x01, 0xFE, 0xFF, 0x42};
+    std::mutex data_mutex;
+    std::vector<uint8_t> last_payload;
+    
+    for (int i = 0; i < 3; ++i) {
+        clients[i]->set_binary_data_callback([&, i](socket_t, const std::string&, const std::vector<uint8_t>& data) {
+            std::lock_guard<std::mutex> lock(data_mutex);
+            last_payload = data;
+            binary_received[i]++;
+        });
+        clients[i]->on("fanout", [&, i](const std::string&, const nlohmann::json& data) {
+            if (data.value("value", 0) == 7) {
+                json_received[i]++;
+            }
+        });
+    }
+    
+    EXPECT_TRUE(server.start());
+    for (auto& client : clients) {
+        EXPECT_TRUE(client->start());
+        EXPECT_TRUE(client->connect_to_peer("127.0.0.1", server_port));
+    }
+    
+    ASSERT_TRUE(wait_for_condition([&]() { return server.get_peer_count() >= 3; }, 3000));
+    
+    // Only the first two clients are targeted; unknown peer ids are skipped
+    std::vector<std::string> targets = {
+        clients[0]->get_our_peer_id(), clients[1]->get_our_peer_id(), "unknown-peer"
+    };
+    EXPECT_EQ(server.send_binary_to_peer_ids(targets, SharedBuffer::copy_of(payload.data(), payload.size())), 2);
+    EXPECT_EQ(server.send_to_peers(targets, "fanout", nlohmann::json{{"value", 7}}), 2);
+    
+    EXPECT_TRUE(wait_for_condition([&]() {
+        return binary_received[0] == 1 && binary_received[1] == 1 &&
+               json_received[0] == 1 && json_received[1] == 1;
+    }, 2000));
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(binary_received[2].load(), 0);
+    EXPECT_EQ(json_received[2].load(), 0);
+    {
+        std::lock_guard<std::mutex> lock(data_mutex);
+        EXPECT_EQ(last_payload, payload);
+    }
+    
+    for (auto& client : clients) {
+        client->stop();
+    }
+    server.stop();
+}
+
 // Test large binary data transfer
 TEST_F(RatsClientTest, LargeBinaryDataTransferTest) {
     const int server_port = 59007;
@@ -1023,6 +1114,71 @@ TEST_F(RatsClientTest, LargeBinaryDataTransferTest) {
     client.stop();
 }
 
+// Test zero-copy binary delivery through the view callback
+TEST_F(RatsClientTest, BinaryDataViewCallbackTest) {
+    const int server_port = 59013;
+    const int client_port = 59014;
+    
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+    
+    std::vector<uint8_t> test_data(256 * 1024);
+    for (size_t i = 0; i < test_data.size(); ++i) {
+        test_data[i] = static_cast<uint8_t>(i * 13);
+    }
+    
+    std::atomic<bool> view_received(false);
+    std::atomic<bool> legacy_called(false);
+    SharedBuffer received_view;
+    std::mutex view_mutex;
+    
+    // The view callback takes precedence over the copying callback
+    server.set_binary_data_callback([&](socket_t, const std::string&, const std::vector<uint8_t>&) {
+        legacy_called = true;
+    });
+    server.set_binary_data_view_callback([&](socket_t, const std::string&, const SharedBuffer& data) {
+        std::lock_guard<std::mutex> lock(view_mutex);
+        received_view = data; // Retaining the view keeps the bytes alive
+        view_received = true;
+    });
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+    
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 2000);
+    EXPECT_TRUE(connected);
+    
+    auto peers = client.get_validated_peers();
+    EXPECT_GT(peers.size(), 0);
+    
+    if (peers.size() > 0) {
+        EXPECT_TRUE(client.send_binary_to_peer(peers[0].socket, test_data));
+        
+        EXPECT_TRUE(wait_for_condition([&]() {
+            return view_received.load();
+        }, 5000));
+    }
+    
+    server.stop();
+    client.stop();
+    
+    // The retained view outlives the connection and the receive path
+    std::lock_guard<std::mutex> lock(view_mutex);
+    EXPECT_FALSE(legacy_called.load());
+    ASSERT_EQ(received_view.size(), test_data.size());
+    EXPECT_EQ(received_view.to_vector(), test_data);
+    SharedBuffer tail = received_view.slice(test_data.size() - 16);
+    EXPECT_EQ(tail.size(), 16u);
+    EXPECT_EQ(tail.storage(), received_view.storage());
+    EXPECT_EQ(tail[0], test_data[test_data.size() - 16]);
+}
+
 // Test mixed binary and text data callbacks
 TEST_F(RatsClientTest, MixedBinaryTextCallbacksTest) {
     const int server_port = 59009;
@@ -1171,4 +1327,836 @@ TEST_F(RatsClientTest, BinaryDataEdgeCasesTest) {
     
     server.stop();
     client.stop();
-} 
\ No newline at end of file
+} 
+// Test that messages go through the per-peer send queue in order and are counted
+TEST_F(RatsClientTest, SendQueueDeliversInOrderTest) {
+    const int server_port = 59015;
+    const int client_port = 59016;
+    
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+    
+    SendQueueConfig config;
+    config.policy = SendBackpressurePolicy::FAIL;
+    client.set_send_queue_config(config);
+    EXPECT_EQ(client.get_send_queue_config().policy, SendBackpressurePolicy::FAIL);
+    
+    const int message_count = 200;
+    std::vector<std::string> received;
+    std::mutex received_mutex;
+    server.set_string_data_callback([&](socket_t, const std::string&, const std::string& data) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received.push_back(data);
+    });
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+    
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 2000);
+    EXPECT_TRUE(connected);
+    
+    auto peers = client.get_validated_peers();
+    ASSERT_GT(peers.size(), 0);
+    
+    for (int i = 0; i < message_count; ++i) {
+        EXPECT_TRUE(client.send_string_to_peer_id(peers[0].peer_id, "message " + std::to_string(i)));
+    }
+    EXPECT_TRUE(client.flush_peer_send_queue(peers[0].peer_id, std::chrono::seconds(5)));
+    EXPECT_EQ(client.get_peer_send_queue_depth(peers[0].peer_id), 0u);
+    
+    SendQueueStats stats = client.get_peer_send_queue_stats(peers[0].peer_id);
+    EXPECT_GE(stats.sent_messages, static_cast<uint64_t>(message_count));
+    EXPECT_GT(stats.batches_written, 0u);
+    EXPECT_EQ(stats.rejected_messages, 0u);
+    
+    EXPECT_TRUE(wait_for_condition([&]() {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        return received.size() >= static_cast<size_t>(message_count);
+    }, 5000));
+    
+    {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        ASSERT_EQ(received.size(), static_cast<size_t>(message_count));
+        for (int i = 0; i < message_count; ++i) {
+            EXPECT_EQ(received[i], "message " + std::to_string(i));
+        }
+    }
+    
+    EXPECT_EQ(client.get_peer_send_queue_depth("unknown-peer"), 0u);
+    
+    server.stop();
+    client.stop();
+}
+
+// Test that encrypted connections deliver messages larger than one receive chunk intact and in order
+TEST_F(RatsClientTest, EncryptedLargeMessageTest) {
+    const int server_port = 59017;
+    const int client_port = 59018;
+    
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+    
+    ASSERT_TRUE(server.initialize_encryption(true));
+    ASSERT_TRUE(client.initialize_encryption(true));
+    
+    std::vector<std::vector<uint8_t>> received;
+    std::mutex received_mutex;
+    server.set_binary_data_callback([&](socket_t, const std::string&, const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received.push_back(data);
+    });
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+    
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+    
+    auto peers = client.get_validated_peers();
+    ASSERT_GT(peers.size(), 0);
+    
+    std::vector<std::vector<uint8_t>> sent;
+    for (size_t size : {200000, 10, 70000}) {
+        std::vector<uint8_t> payload(size);
+        for (size_t i = 0; i < size; ++i) {
+            payload[i] = static_cast<uint8_t>((i * 13 + size) & 0xFF);
+        }
+        EXPECT_TRUE(client.send_binary_to_peer_id(peers[0].peer_id, payload));
+        sent.push_back(payload);
+    }
+    
+    EXPECT_TRUE(wait_for_condition([&]() {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        return received.size() >= sent.size();
+    }, 5000));
+    
+    {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        ASSERT_EQ(received.size(), sent.size());
+        for (size_t i = 0; i < sent.size(); ++i) {
+            EXPECT_EQ(received[i], sent[i]) << "message " << i;
+        }
+    }
+    
+    server.stop();
+    client.stop();
+    server.initialize_encryption(false);
+    client.initialize_encryption(false);
+}
+
+// Test a complete file transfer between two connected clients
+TEST_F(RatsClientTest, FileTransferEndToEndTest) {
+    const int server_port = 59019;
+    const int client_port = 59020;
+    const std::string source_path = "ft_e2e_source.bin";
+    const std::string received_path = "./ft_e2e_received.bin";
+    
+    std::vector<uint8_t> content(300000);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>((i * 31) ^ (i >> 9));
+    }
+    ASSERT_TRUE(create_file_binary(source_path.c_str(), content.data(), content.size()));
+    delete_file(received_path.c_str());
+    
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+    
+    std::atomic<bool> completed(false);
+    std::atomic<bool> succeeded(false);
+    server.on_file_transfer_request([](const std::string&, const FileMetadata&, const std::string&) {
+        return true;
+    });
+    server.on_file_transfer_completed([&](const std::string&, bool success, const std::string&) {
+        succeeded = success;
+        completed = true;
+    });
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+    
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+    
+    auto peers = client.get_validated_peers();
+    ASSERT_GT(peers.size(), 0);
+    
+    std::string transfer_id = client.send_file(peers[0].peer_id, source_path, "ft_e2e_received.bin");
+    EXPECT_FALSE(transfer_id.empty());
+    
+    EXPECT_TRUE(wait_for_condition([&]() { return completed.load(); }, 10000));
+    EXPECT_TRUE(succeeded.load());
+    
+    size_t received_size = 0;
+    void* received = read_file_binary(received_path.c_str(), &received_size);
+    ASSERT_NE(received, nullptr);
+    EXPECT_EQ(received_size, content.size());
+    EXPECT_EQ(std::memcmp(received, content.data(), (std::min)(received_size, content.size())), 0);
+    free_file_buffer(received);
+    
+    server.stop();
+    client.stop();
+    delete_file(source_path.c_str());
+    delete_file(received_path.c_str());
+}
+
+TEST_F(RatsClientTest, DirectoryTransferEndToEndTest) {
+    const int server_port = 59045;
+    const int client_port = 59046;
+    const std::string source_dir = "ft_dir_source";
+    const std::string received_dir = "./ft_dir_received";
+
+    // Many small files in nested directories, an empty file and one file too large to pack
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> files;
+    for (int i = 0; i < 40; ++i) {
+        std::string relative = (i % 4 == 0 ? "sub/deeper/" : (i % 2 == 0 ? "sub/" : "")) + ("small_" + std::to_string(i) + ".txt");
+        std::vector<uint8_t> content(3000 + i * 97);
+        for (size_t j = 0; j < content.size(); ++j) {
+            content[j] = static_cast<uint8_t>((j * 7 + i) ^ (j >> 5));
+        }
+        files.emplace_back(relative, content);
+    }
+    files.emplace_back("empty.txt", std::vector<uint8_t>());
+    std::vector<uint8_t> large(400000);
+    for (size_t j = 0; j < large.size(); ++j) {
+        large[j] = static_cast<uint8_t>((j * 13) ^ (j >> 10));
+    }
+    files.emplace_back("sub/large.bin", large);
+
+    ASSERT_TRUE(create_directories((source_dir + "/sub/deeper").c_str()));
+    for (const auto& file : files) {
+        ASSERT_TRUE(create_file_binary(combine_paths(source_dir, file.first).c_str(), file.second.data(), file.second.size()));
+    }
+
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+
+    std::atomic<bool> completed(false);
+    std::atomic<bool> succeeded(false);
+    std::atomic<uint64_t> progress_updates(0);
+    std::atomic<uint64_t> files_reported(0);
+    server.on_file_transfer_request([](const std::string&, const FileMetadata&, const std::string&) {
+        return true;
+    });
+    server.on_file_transfer_completed([&](const std::string&, bool success, const std::string&) {
+        succeeded = success;
+        completed = true;
+    });
+    server.on_directory_transfer_progress([&](const std::string&, const std::string&, uint64_t files_completed,
+                                              uint64_t, uint64_t, uint64_t) {
+        progress_updates++;
+        files_reported = files_completed;
+    });
+
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+
+    // Small packs so the small files spread over several of them
+    FileTransferConfig config = client.get_file_transfer_config();
+    config.pack_file_threshold = 16 * 1024;
+    config.max_pack_size = 32 * 1024;
+    client.set_file_transfer_config(config);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+
+    auto peers = client.get_validated_peers();
+    ASSERT_GT(peers.size(), 0);
+
+    std::string transfer_id = client.send_directory(peers[0].peer_id, source_dir, "ft_dir_received");
+    EXPECT_FALSE(transfer_id.empty());
+
+    EXPECT_TRUE(wait_for_condition([&]() { return completed.load(); }, 15000));
+    EXPECT_TRUE(succeeded.load());
+    EXPECT_GT(progress_updates.load(), 1u);
+    EXPECT_EQ(files_reported.load(), files.size());
+
+    for (const auto& file : files) {
+        std::string path = combine_paths(received_dir, file.first);
+        size_t received_size = 0;
+        void* received = read_file_binary(path.c_str(), &received_size);
+        ASSERT_TRUE(received != nullptr || (file.second.empty() && file_exists(path))) << path;
+        EXPECT_EQ(received_size, file.second.size()) << path;
+        if (received) {
+            EXPECT_EQ(std::memcmp(received, file.second.data(), (std::min)(received_size, file.second.size())), 0) << path;
+            free_file_buffer(received);
+        }
+    }
+
+    // The sender completes once the last chunks are acknowledged
+    auto progress = client.get_file_transfer_progress(transfer_id);
+    ASSERT_NE(progress, nullptr);
+    EXPECT_TRUE(wait_for_condition([&]() { return progress->status == FileTransferStatus::COMPLETED; }, 5000));
+    EXPECT_EQ(progress->bytes_transferred, progress->total_bytes);
+
+    // Sending an edited tree again updates the large file from the copy already there
+    auto& large_file = files.back().second;
+    for (size_t j = 100000; j < 100100; ++j) {
+        large_file[j] = 0;
+    }
+    ASSERT_TRUE(create_file_binary(combine_paths(source_dir, files.back().first).c_str(), large_file.data(), large_file.size()));
+    completed = false;
+    succeeded = false;
+    uint64_t sent_before = client.get_file_transfer_manager().get_transfer_statistics()["total_bytes_sent"];
+    EXPECT_FALSE(client.send_directory(peers[0].peer_id, source_dir, "ft_dir_received").empty());
+    EXPECT_TRUE(wait_for_condition([&]() { return completed.load(); }, 15000));
+    EXPECT_TRUE(succeeded.load());
+    uint64_t sent_after = client.get_file_transfer_manager().get_transfer_statistics()["total_bytes_sent"];
+    EXPECT_LT(sent_after - sent_before, 300000u);
+
+    size_t large_size = 0;
+    void* large_received = read_file_binary(combine_paths(received_dir, files.back().first).c_str(), &large_size);
+    ASSERT_NE(large_received, nullptr);
+    EXPECT_EQ(large_size, large_file.size());
+    EXPECT_EQ(std::memcmp(large_received, large_file.data(), (std::min)(large_size, large_file.size())), 0);
+    free_file_buffer(large_received);
+
+    server.stop();
+    client.stop();
+    for (const auto& root : {source_dir, std::string(received_dir)}) {
+        for (const auto& file : files) {
+            delete_file(combine_paths(root, file.first).c_str());
+        }
+        delete_directory(combine_paths(root, "sub/deeper").c_str());
+        delete_directory(combine_paths(root, "sub").c_str());
+        delete_directory(root.c_str());
+    }
+}
+
+TEST_F(RatsClientTest, DeltaFileTransferTest) {
+    const int server_port = 59047;
+    const int client_port = 59048;
+    const std::string source_path = "ft_delta_source.bin";
+    const std::string received_path = "./ft_delta_received.bin";
+
+    // The receiver holds an older version; the new one has an edit and a longer tail
+    std::vector<uint8_t> old_content(2000000);
+    for (size_t i = 0; i < old_content.size(); ++i) {
+        old_content[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+    }
+    std::vector<uint8_t> content = old_content;
+    for (size_t i = 700000; i < 700300; ++i) {
+        content[i] = static_cast<uint8_t>(i);
+    }
+    content.insert(content.begin() + 1200000, 77, 0xab);
+    content.resize(content.size() + 30000, 0x11);
+    ASSERT_TRUE(create_file_binary(source_path.c_str(), content.data(), content.size()));
+    ASSERT_TRUE(create_file_binary(received_path.c_str(), old_content.data(), old_content.size()));
+
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+
+    std::atomic<bool> completed(false);
+    std::atomic<bool> succeeded(false);
+    server.on_file_transfer_request([](const std::string&, const FileMetadata&, const std::string&) {
+        return true;
+    });
+    server.on_file_transfer_completed([&](const std::string&, bool success, const std::string&) {
+        succeeded = success;
+        completed = true;
+    });
+
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+
+    auto peers = client.get_validated_peers();
+    ASSERT_GT(peers.size(), 0);
+
+    std::string transfer_id = client.send_file(peers[0].peer_id, source_path, "ft_delta_received.bin");
+    EXPECT_FALSE(transfer_id.empty());
+
+    EXPECT_TRUE(wait_for_condition([&]() { return completed.load(); }, 10000));
+    EXPECT_TRUE(succeeded.load());
+
+    size_t received_size = 0;
+    void* received = read_file_binary(received_path.c_str(), &received_size);
+    ASSERT_NE(received, nullptr);
+    EXPECT_EQ(received_size, content.size());
+    EXPECT_EQ(std::memcmp(received, content.data(), (std::min)(received_size, content.size())), 0);
+    free_file_buffer(received);
+
+    // Only the changed blocks crossed the wire
+    uint64_t bytes_sent = client.get_file_transfer_manager().get_transfer_statistics()["total_bytes_sent"];
+    EXPECT_LT(bytes_sent, content.size() / 10);
+
+    server.stop();
+    client.stop();
+    delete_file(source_path.c_str());
+    delete_file(received_path.c_str());
+}
+
+TEST_F(RatsClientTest, CompressedFileTransferTest) {
+    const int server_port = 59049;
+    const int client_port = 59050;
+    const std::string source_path = "ft_compressed_source.txt";
+    const std::string received_path = "./ft_compressed_received.txt";
+
+    // Log-like text that compresses well, followed by random bytes that do not
+    std::string text;
+    for (int i = 0; text.size() < 600000; ++i) {
+        text += "2026-01-01 12:00:" + std::to_string(i % 60) + " INFO request " + std::to_string(i) + " served in 3ms\n";
+    }
+    std::vector<uint8_t> content(text.begin(), text.end());
+    std::mt19937 gen(7);
+    for (int i = 0; i < 200000; ++i) {
+        content.push_back(static_cast<uint8_t>(gen()));
+    }
+    ASSERT_TRUE(create_file_binary(source_path.c_str(), content.data(), content.size()));
+    delete_file(received_path.c_str());
+
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+
+    std::atomic<bool> completed(false);
+    std::atomic<bool> succeeded(false);
+    server.on_file_transfer_request([](const std::string&, const FileMetadata&, const std::string&) {
+        return true;
+    });
+    server.on_file_transfer_completed([&](const std::string&, bool success, const std::string&) {
+        succeeded = success;
+        completed = true;
+    });
+
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+
+    // Prefer zstd; a build without codecs negotiates none and sends raw chunks
+    auto codecs = available_compression_types();
+    FileTransferConfig config = client.get_file_transfer_config();
+    config.compression = CompressionType::ZSTD;
+    config.adaptive_chunk_size = false;     // Fixed chunks, so the chunk counts below hold
+    client.set_file_transfer_config(config);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+
+    auto peers = client.get_validated_peers();
+    ASSERT_GT(peers.size(), 0);
+
+    std::string transfer_id = client.send_file(peers[0].peer_id, source_path, "ft_compressed_received.txt");
+    EXPECT_FALSE(transfer_id.empty());
+
+    EXPECT_TRUE(wait_for_condition([&]() { return completed.load(); }, 10000));
+    EXPECT_TRUE(succeeded.load());
+
+    size_t received_size = 0;
+    void* received = read_file_binary(received_path.c_str(), &received_size);
+    ASSERT_NE(received, nullptr);
+    EXPECT_EQ(received_size, content.size());
+    EXPECT_EQ(std::memcmp(received, content.data(), (std::min)(received_size, content.size())), 0);
+    free_file_buffer(received);
+
+    // The text chunks shrank; the random ones went out raw
+    auto stats = client.get_file_transfer_manager().get_transfer_statistics();
+    uint64_t compressed_chunks = stats["compressed_chunks_sent"];
+    uint64_t bytes_saved = stats["compression_bytes_saved"];
+    uint64_t total_chunks = (content.size() + config.chunk_size - 1) / config.chunk_size;
+    if (codecs.empty()) {
+        EXPECT_EQ(compressed_chunks, 0u);
+    } else {
+        EXPECT_GE(compressed_chunks, text.size() / config.chunk_size);
+        EXPECT_LT(compressed_chunks, total_chunks);
+        EXPECT_GT(bytes_saved, text.size() / 2);
+    }
+
+    server.stop();
+    client.stop();
+    delete_file(source_path.c_str());
+    delete_file(received_path.c_str());
+}
+
+TEST_F(RatsClientTest, SwarmFileDownloadTest) {
+    const int source_a_port = 59021;
+    const int source_b_port = 59022;
+    const int downloader_port = 59023;
+    const std::string source_path = "ft_swarm_source.bin";
+    const std::string received_path = "./ft_swarm_received.bin";
+    
+    std::vector<uint8_t> content(1000000);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>((i * 17) ^ (i >> 11));
+    }
+    ASSERT_TRUE(create_file_binary(source_path.c_str(), content.data(), content.size()));
+    delete_file(received_path.c_str());
+    
+    RatsClient source_a(source_a_port);
+    RatsClient source_b(source_b_port);
+    RatsClient downloader(downloader_port);
+    
+    auto approve = [](const std::string&, const std::string&, const std::string&) { return true; };
+    source_a.on_file_request(approve);
+    source_b.on_file_request(approve);
+    
+    std::atomic<bool> completed(false);
+    std::atomic<bool> succeeded(false);
+    downloader.on_file_transfer_completed([&](const std::string&, bool success, const std::string&) {
+        succeeded = success;
+        completed = true;
+    });
+    
+    EXPECT_TRUE(source_a.start());
+    EXPECT_TRUE(source_b.start());
+    EXPECT_TRUE(downloader.start());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    EXPECT_TRUE(downloader.connect_to_peer("127.0.0.1", source_a_port));
+    EXPECT_TRUE(downloader.connect_to_peer("127.0.0.1", source_b_port));
+    
+    bool connected = wait_for_condition([&]() {
+        return downloader.get_peer_count() >= 2 && source_a.get_peer_count() > 0 && source_b.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+    
+    std::vector<std::string> peer_ids;
+    for (const auto& peer : downloader.get_validated_peers()) {
+        peer_ids.push_back(peer.peer_id);
+    }
+    ASSERT_EQ(peer_ids.size(), 2u);
+    
+    FileMetadata metadata = FileTransferManager::get_file_metadata(source_path);
+    std::string transfer_id = downloader.request_file_from_swarm(peer_ids, source_path, metadata, received_path);
+    EXPECT_FALSE(transfer_id.empty());
+    
+    EXPECT_TRUE(wait_for_condition([&]() { return completed.load(); }, 10000));
+    EXPECT_TRUE(succeeded.load());
+    
+    // Both sources served part of the file
+    EXPECT_GT(source_a.get_file_transfer_statistics()["total_bytes_sent"].get<uint64_t>(), 0u);
+    EXPECT_GT(source_b.get_file_transfer_statistics()["total_bytes_sent"].get<uint64_t>(), 0u);
+    
+    size_t received_size = 0;
+    void* received = read_file_binary(received_path.c_str(), &received_size);
+    ASSERT_NE(received, nullptr);
+    EXPECT_EQ(received_size, content.size());
+    EXPECT_EQ(std::memcmp(received, content.data(), (std::min)(received_size, content.size())), 0);
+    free_file_buffer(received);
+    
+    source_a.stop();
+    source_b.stop();
+    downloader.stop();
+    delete_file(source_path.c_str());
+    delete_file(received_path.c_str());
+}
+
+// Test peers connected over the uTP transport, with Noise on top, and the TCP fallback
+TEST_F(RatsClientTest, UtpTransportTest) {
+    const int server_port = 59028;
+    const int client_port = 59029;
+    const int tcp_only_port = 59030;
+    
+    NatTraversalConfig utp_config;
+    utp_config.transport = PeerTransport::UTP;
+    utp_config.utp_connect_timeout_ms = 500;
+    RatsClient server(server_port, 10, utp_config);
+    RatsClient client(client_port, 10, utp_config);
+    RatsClient tcp_only(tcp_only_port);
+    
+    ASSERT_TRUE(server.initialize_encryption(true));
+    ASSERT_TRUE(client.initialize_encryption(true));
+    ASSERT_TRUE(tcp_only.initialize_encryption(true));
+    
+    std::vector<std::vector<uint8_t>> received;
+    std::mutex received_mutex;
+    server.set_binary_data_callback([&](socket_t, const std::string&, const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received.push_back(data);
+    });
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+    EXPECT_TRUE(tcp_only.start());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+    
+    bool connected = wait_for_condition([&]() {
+        return server.get_peer_count() > 0 && client.get_peer_count() > 0;
+    }, 5000);
+    ASSERT_TRUE(connected);
+    
+    auto peers = client.get_validated_peers();
+    ASSERT_EQ(peers.size(), 1u);
+    EXPECT_EQ(peers[0].transport_protocol, "uTP");
+    auto server_peers = server.get_validated_peers();
+    ASSERT_EQ(server_peers.size(), 1u);
+    EXPECT_EQ(server_peers[0].transport_protocol, "uTP");
+    
+    std::vector<std::vector<uint8_t>> sent;
+    for (size_t size : {1000000, 10, 70000}) {
+        std::vector<uint8_t> payload(size);
+        for (size_t i = 0; i < size; ++i) {
+            payload[i] = static_cast<uint8_t>((i * 7 + size) & 0xFF);
+        }
+        EXPECT_TRUE(client.send_binary_to_peer_id(peers[0].peer_id, payload));
+        sent.push_back(payload);
+    }
+    
+    EXPECT_TRUE(wait_for_condition([&]() {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        return received.size() >= sent.size();
+    }, 10000));
+    
+    {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        ASSERT_EQ(received.size(), sent.size());
+        for (size_t i = 0; i < sent.size(); ++i) {
+            EXPECT_EQ(received[i], sent[i]) << "message " << i;
+        }
+    }
+    
+    // A disconnect closes the uTP connection underneath, and the other side notices
+    client.disconnect_peer_by_id(peers[0].peer_id);
+    EXPECT_TRUE(wait_for_condition([&]() { return server.get_peer_count() == 0; }, 5000));
+    
+    // A peer without the uTP transport is reached over TCP
+    EXPECT_TRUE(client.connect_to_peer("127.0.0.1", tcp_only_port));
+    std::string tcp_transport;
+    ASSERT_TRUE(wait_for_condition([&]() {
+        for (const auto& peer : client.get_validated_peers()) {
+            if (peer.peer_id == tcp_only.get_our_peer_id()) {
+                tcp_transport = peer.transport_protocol;
+            }
+        }
+        return !tcp_transport.empty();
+    }, 5000));
+    EXPECT_EQ(tcp_transport, "TCP");
+    
+    server.stop();
+    client.stop();
+    tcp_only.stop();
+    server.initialize_encryption(false);
+    client.initialize_encryption(false);
+    tcp_only.initialize_encryption(false);
+}
+
+// Test that reconnecting to a known peer resumes with a session ticket instead of a full handshake
+TEST_F(RatsClientTest, EncryptedReconnectResumesSessionTest) {
+    const int server_port = 59031;
+    const int client_port = 59032;
+    
+    RatsClient server(server_port);
+    RatsClient client(client_port);
+    
+    ASSERT_TRUE(server.initialize_encryption(true));
+    ASSERT_TRUE(client.initialize_encryption(true));
+    
+    std::atomic<int> received{0};
+    server.set_binary_data_callback([&](socket_t, const std::string&, const std::vector<uint8_t>&) { received++; });
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(client.start());
+    std::string server_peer_id = server.get_our_peer_id();
+    std::string server_address = "127.0.0.1:" + std::to_string(server_port);
+    auto& manager = EncryptedSocketManager::getInstance();
+    
+    for (int round = 0; round < 2; ++round) {
+        EXPECT_TRUE(client.connect_to_peer("127.0.0.1", server_port));
+        ASSERT_TRUE(wait_for_condition([&]() {
+            auto peers = client.get_validated_peers();
+            bool validated = std::any_of(peers.begin(), peers.end(),
+                                         [&](const RatsPeer& peer) { return peer.peer_id == server_peer_id; });
+            return validated && server.get_peer_count() > 0;
+        }, 5000)) << "round " << round;
+        
+        // The server keeps one ticket per client: a resumed session consumes the old one
+        EXPECT_EQ(manager.get_issued_ticket_count(), 1u) << "round " << round;
+        NoiseKey server_key;
+        EXPECT_TRUE(encrypted_communication::get_peer_static_key(server_address, server_key));
+        
+        EXPECT_TRUE(client.send_binary_to_peer_id(server_peer_id, std::vector<uint8_t>(100, 0x42)));
+        EXPECT_TRUE(wait_for_condition([&]() { return received.load() == round + 1; }, 5000));
+        
+        client.disconnect_peer_by_id(server_peer_id);
+        ASSERT_TRUE(wait_for_condition([&]() { return server.get_peer_count() == 0; }, 5000));
+    }
+    
+    server.stop();
+    client.stop();
+    server.initialize_encryption(false);
+    client.initialize_encryption(false);
+}
+
+// Test that lookups and broadcasts from other threads stay consistent while peers connect and disconnect
+TEST_F(RatsClientTest, ConcurrentPeerTableAccessTest) {
+    const int server_port = 59033;
+    const int stable_port = 59034;
+    const int churn_port = 59035;
+    
+    RatsClient server(server_port);
+    RatsClient stable(stable_port);
+    
+    EXPECT_TRUE(server.start());
+    EXPECT_TRUE(stable.start());
+    
+    EXPECT_TRUE(stable.connect_to_peer("127.0.0.1", server_port));
+    ASSERT_TRUE(wait_for_condition([&]() { return server.get_peer_count() == 1; }, 5000));
+    std::string stable_peer_id = stable.get_our_peer_id();
+    
+    std::atomic<bool> done{false};
+    std::atomic<int> lookup_failures{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            while (!done.load()) {
+                // The stable peer is always present, whatever the churning peer is doing
+                if (!is_valid_socket(server.get_peer_socket_by_id(stable_peer_id))) {
+                    lookup_failures++;
+                }
+                auto peers = server.get_all_peers();
+                if (peers.empty() || server.get_peer_count() < 1) {
+                    lookup_failures++;
+                }
+                server.broadcast_binary_to_peers(std::vector<uint8_t>(16, 0x17));
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+    
+    // A fresh client per round, so it does not reconnect on its own after leaving.
+    // Readers must be joined before the test can bail out, so failures here only stop the churn.
+    for (int round = 0; round < 3; ++round) {
+        RatsClient churn(churn_port);
+        EXPECT_TRUE(churn.start());
+        std::string churn_peer_id = churn.get_our_peer_id();
+        churn.connect_to_peer("127.0.0.1", server_port);
+        bool connected = wait_for_condition([&]() {
+            return server.get_peer_count() == 2 && is_valid_socket(server.get_peer_socket_by_id(churn_peer_id));
+        }, 10000);
+        EXPECT_TRUE(connected) << "round " << round;
+        
+        churn.stop();
+        bool disconnected = wait_for_condition([&]() {
+            return server.get_peer_count() == 1 && !is_valid_socket(server.get_peer_socket_by_id(churn_peer_id));
+        }, 10000);
+        EXPECT_TRUE(disconnected) << "round " << round;
+        if (!connected || !disconnected) {
+            break;
+        }
+    }
+    
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(lookup_failures.load(), 0);
+    
+    server.stop();
+    stable.stop();
+}
+
+// Test that sharded, pinned I/O delivers messages from several peers in order
+TEST_F(RatsClientTest, ShardedIoMessagingTest) {
+    const int server_port = 59134;
+    const int first_client_port = 59135;
+    const int client_count = 3;
+    const int message_count = 100;
+    
+    IoShardConfig shard_config;
+    shard_config.shards = 4;
+    shard_config.pin_threads = true;
+    
+    RatsClient server(server_port);
+    server.set_io_shard_config(shard_config);
+    EXPECT_EQ(server.get_io_shard_config().shards, 4u);
+    EXPECT_TRUE(server.get_io_shard_config().pin_threads);
+    
+    std::mutex received_mutex;
+    std::map<std::string, std::vector<std::string>> received;
+    server.set_string_data_callback([&](socket_t, const std::string& peer_id, const std::string& data) {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        received[peer_id].push_back(data);
+    });
+    EXPECT_TRUE(server.start());
+    
+    std::vector<std::unique_ptr<RatsClient>> clients;
+    for (int i = 0; i < client_count; ++i) {
+        clients.emplace_back(new RatsClient(first_client_port + i));
+        clients.back()->set_io_shard_config(shard_config);
+        EXPECT_TRUE(clients.back()->start());
+        EXPECT_TRUE(clients.back()->connect_to_peer("127.0.0.1", server_port));
+    }
+    ASSERT_TRUE(wait_for_condition([&]() {
+        return server.get_peer_count() == static_cast<size_t>(client_count);
+    }, 5000));
+    
+    // Every client sends from its own thread, so the server's shards read concurrently
+    std::vector<std::thread> senders;
+    for (auto& client : clients) {
+        senders.emplace_back([&client]() {
+            auto peers = client->get_validated_peers();
+            ASSERT_EQ(peers.size(), 1u);
+            for (int i = 0; i < message_count; ++i) {
+                EXPECT_TRUE(client->send_string_to_peer_id(peers[0].peer_id, "message " + std::to_string(i)));
+            }
+            EXPECT_TRUE(client->flush_peer_send_queue(peers[0].peer_id, std::chrono::seconds(5)));
+        });
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    
+    EXPECT_TRUE(wait_for_condition([&]() {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        size_t total = 0;
+        for (const auto& pair : received) {
+            total += pair.second.size();
+        }
+        return total >= static_cast<size_t>(client_count * message_count);
+    }, 5000));
+    
+    {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        ASSERT_EQ(received.size(), static_cast<size_t>(client_count));
+        for (const auto& pair : received) {
+            ASSERT_EQ(pair.second.size(), static_cast<size_t>(message_count));
+            for (int i = 0; i < message_count; ++i) {
+                EXPECT_EQ(pair.second[i], "message " + std::to_string(i));
+            }
+        }
+    }
+    
+    for (auto& client : clients) {
+        client->stop();
+    }
+    server.stop();
+}
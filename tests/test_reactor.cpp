@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include "reactor.h"
+#include "socket.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+using namespace librats;
+
+class ReactorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(init_socket_library());
+    }
+
+    void TearDown() override {
+        cleanup_socket_library();
+    }
+
+    // Create a connected TCP socket pair over loopback
+    void create_socket_pair(socket_t& client, socket_t& accepted) {
+        socket_t server = create_tcp_server_v4(0);
+        ASSERT_TRUE(is_valid_socket(server));
+        int port = get_ephemeral_port(server);
+        if (port == 0) {
+            sockaddr_in addr;
+            socklen_t addr_len = sizeof(addr);
+            ASSERT_EQ(getsockname(server, (sockaddr*)&addr, &addr_len), 0);
+            port = ntohs(addr.sin_port);
+        }
+        ASSERT_GT(port, 0);
+
+        client = create_tcp_client("127.0.0.1", port, 5000);
+        ASSERT_TRUE(is_valid_socket(client));
+        accepted = accept_client(server);
+        ASSERT_TRUE(is_valid_socket(accepted));
+        close_socket(server);
+    }
+};
+
+// Test that readiness is dispatched to the registered handler
+TEST_F(ReactorTest, DispatchesReadEvents) {
+    socket_t client = INVALID_SOCKET_VALUE;
+    socket_t accepted = INVALID_SOCKET_VALUE;
+    create_socket_pair(client, accepted);
+
+    IoReactor reactor("test", 2);
+    ASSERT_TRUE(reactor.start());
+    EXPECT_TRUE(reactor.is_running());
+    EXPECT_EQ(reactor.get_thread_count(), 2u);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string received;
+
+    ASSERT_TRUE(reactor.add_socket(accepted, [&](socket_t socket, uint32_t events) {
+        EXPECT_TRUE(events & IO_EVENT_READ);
+        std::string chunk = receive_tcp_string(socket);
+        std::lock_guard<std::mutex> lock(mutex);
+        received += chunk;
+        cv.notify_all();
+    }));
+    EXPECT_EQ(reactor.get_socket_count(), 1u);
+    EXPECT_FALSE(reactor.add_socket(accepted, [](socket_t, uint32_t) {}));
+
+    EXPECT_GT(send_tcp_string(client, "ping"), 0);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] { return received == "ping"; }));
+    }
+
+    EXPECT_TRUE(reactor.remove_socket(accepted));
+    EXPECT_EQ(reactor.get_socket_count(), 0u);
+
+    reactor.stop();
+    EXPECT_FALSE(reactor.is_running());
+    EXPECT_FALSE(reactor.add_socket(accepted, [](socket_t, uint32_t) {}));
+
+    close_socket(client);
+    close_socket(accepted);
+}
+
+// Test that a removed socket no longer receives events and the tick keeps running
+TEST_F(ReactorTest, RemoveSocketAndTick) {
+    socket_t client = INVALID_SOCKET_VALUE;
+    socket_t accepted = INVALID_SOCKET_VALUE;
+    create_socket_pair(client, accepted);
+
+    IoReactor reactor("test", 1);
+    std::atomic<int> ticks{0};
+    reactor.set_tick_callback([&]() { ticks++; }, std::chrono::milliseconds(20));
+    ASSERT_TRUE(reactor.start());
+
+    std::atomic<int> calls{0};
+    ASSERT_TRUE(reactor.add_socket(accepted, [&](socket_t, uint32_t) { calls++; }));
+    ASSERT_TRUE(reactor.remove_socket(accepted));
+    EXPECT_FALSE(reactor.remove_socket(accepted));
+
+    EXPECT_GT(send_tcp_string(client, "ignored"), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    EXPECT_EQ(calls.load(), 0);
+    EXPECT_GT(ticks.load(), 0);
+
+    reactor.stop();
+    close_socket(client);
+    close_socket(accepted);
+}
+
+// Test incremental framed receive with frames split across reads and keep-alives
+TEST_F(ReactorTest, FramedReceiveBufferReassemblesFrames) {
+    socket_t client = INVALID_SOCKET_VALUE;
+    socket_t accepted = INVALID_SOCKET_VALUE;
+    create_socket_pair(client, accepted);
+
+    // Keep-alive, a complete frame and the first half of another frame
+    std::vector<uint8_t> wire = {0, 0, 0, 0,  0, 0, 0, 3, 'a', 'b', 'c',  0, 0, 0, 5, 'h', 'e'};
+    ASSERT_EQ(send_tcp_data(client, wire), static_cast<int>(wire.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    FramedReceiveBuffer buffer;
+    std::vector<SharedBuffer> messages;
+    ASSERT_TRUE(receive_tcp_messages_framed(accepted, buffer, messages));
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].to_string(), "abc");
+    EXPECT_EQ(buffer.data.size(), 6u);
+
+    std::vector<uint8_t> rest = {'l', 'l', 'o'};
+    ASSERT_EQ(send_tcp_data(client, rest), 3);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    messages.clear();
+    ASSERT_TRUE(receive_tcp_messages_framed(accepted, buffer, messages));
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].to_string(), "hello");
+    EXPECT_TRUE(buffer.data.empty());
+
+    // Orderly close is reported as end of connection
+    shutdown_socket(client);
+    messages.clear();
+    EXPECT_FALSE(receive_tcp_messages_framed(accepted, buffer, messages));
+    EXPECT_TRUE(messages.empty());
+
+    close_socket(client);
+    close_socket(accepted);
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include "ring_buffer.h"
+#include <vector>
+#include <cstring>
+
+using namespace librats;
+
+// Test FIFO order, wrap-around and growth
+TEST(RingBufferTest, AppendConsumeAndWrap) {
+    RingBuffer buffer(16);
+    EXPECT_EQ(buffer.capacity(), 16u);
+    EXPECT_TRUE(buffer.empty());
+
+    std::vector<uint8_t> data(40);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+
+    buffer.append(data.data(), 12);
+    buffer.consume(10);
+    buffer.append(data.data() + 12, 10);  // Wraps around the end
+    EXPECT_EQ(buffer.size(), 12u);
+    EXPECT_EQ(buffer.capacity(), 16u);
+    EXPECT_EQ(buffer[0], 10);
+    EXPECT_EQ(buffer[11], 21);
+
+    uint8_t out[12];
+    buffer.peek(0, out, sizeof(out));
+    EXPECT_EQ(std::memcmp(out, data.data() + 10, sizeof(out)), 0);
+
+    // Growing keeps the order
+    buffer.append(data.data() + 22, 18);
+    EXPECT_EQ(buffer.size(), 30u);
+    EXPECT_GE(buffer.capacity(), 32u);
+    const uint8_t* contiguous = buffer.linearize(buffer.size());
+    EXPECT_EQ(std::memcmp(contiguous, data.data() + 10, 30), 0);
+
+    buffer.consume(30);
+    EXPECT_TRUE(buffer.empty());
+}
+
+// Test direct writes into prepared space and contiguous views of wrapped data
+TEST(RingBufferTest, PrepareAndLinearize) {
+    RingBuffer buffer(16);
+    size_t available = 0;
+    uint8_t* space = buffer.prepare(4, available);
+    ASSERT_GE(available, 4u);
+    std::memset(space, 0xAA, 10);
+    buffer.commit(10);
+    buffer.consume(8);
+
+    // 2 bytes left at the end of the buffer; 10 bytes of space only fit after a move
+    space = buffer.prepare(10, available);
+    ASSERT_GE(available, 10u);
+    EXPECT_EQ(buffer.capacity(), 16u);
+    for (uint8_t i = 0; i < 10; ++i) {
+        space[i] = i;
+    }
+    buffer.commit(10);
+    EXPECT_EQ(buffer.size(), 12u);
+    EXPECT_EQ(buffer[0], 0xAA);
+    EXPECT_EQ(buffer[2], 0);
+
+    // Fill until the content wraps, then ask for it in one piece
+    buffer.consume(6);
+    std::vector<uint8_t> tail = {10, 11, 12, 13, 14, 15, 16, 17};
+    buffer.append(tail.data(), tail.size());
+    size_t front_size = 0;
+    buffer.front(front_size);
+    EXPECT_LT(front_size, buffer.size());
+    const uint8_t* message = buffer.linearize(buffer.size());
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        EXPECT_EQ(message[i], i + 4);
+    }
+}
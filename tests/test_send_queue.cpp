@@ -0,0 +1,332 @@
+#include <gtest/gtest.h>
+#include "send_queue.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <set>
+
+using namespace librats;
+
+namespace {
+
+OutboundMessage make_message(uint8_t tag, size_t size, SendPriority priority = SendPriority::DATA) {
+    return OutboundMessage(tag, SharedBuffer(std::vector<uint8_t>(size, tag)), priority);
+}
+
+SendQueueConfig make_config(SendBackpressurePolicy policy, size_t max_queued_bytes) {
+    SendQueueConfig config;
+    config.policy = policy;
+    config.max_queued_bytes = max_queued_bytes;
+    config.block_timeout = std::chrono::milliseconds(100);
+    return config;
+}
+
+} // namespace
+
+// Test that the FAIL policy rejects messages once the queue is full
+TEST(SendQueueTest, FailPolicyRejectsWhenFull) {
+    PeerSendQueue queue(INVALID_SOCKET_VALUE, make_config(SendBackpressurePolicy::FAIL, 10));
+
+    bool needs_schedule = false;
+    EXPECT_TRUE(queue.push(make_message(1, 6), needs_schedule));
+    EXPECT_TRUE(needs_schedule);
+    EXPECT_FALSE(queue.push(make_message(2, 6), needs_schedule));
+    EXPECT_TRUE(queue.push(make_message(3, 4), needs_schedule));
+    EXPECT_FALSE(needs_schedule);  // Already scheduled
+
+    SendQueueStats stats = queue.get_stats();
+    EXPECT_EQ(stats.queued_messages, 2u);
+    EXPECT_EQ(stats.queued_bytes, 10u);
+    EXPECT_EQ(stats.rejected_messages, 1u);
+    EXPECT_EQ(queue.get_depth(), 2u);
+}
+
+// Test that DROP_OLDEST evicts the oldest messages to make room
+TEST(SendQueueTest, DropOldestPolicyEvictsOldest) {
+    PeerSendQueue queue(INVALID_SOCKET_VALUE, make_config(SendBackpressurePolicy::DROP_OLDEST, 10));
+
+    bool needs_schedule = false;
+    EXPECT_TRUE(queue.push(make_message(1, 4), needs_schedule));
+    EXPECT_TRUE(queue.push(make_message(2, 4), needs_schedule));
+    EXPECT_TRUE(queue.push(make_message(3, 6), needs_schedule));
+
+    std::vector<OutboundMessage> batch;
+    ASSERT_TRUE(queue.pop_batch(batch));
+    ASSERT_EQ(batch.size(), 2u);
+    EXPECT_EQ(batch[0].type, 2);
+    EXPECT_EQ(batch[1].type, 3);
+    EXPECT_EQ(queue.get_stats().dropped_messages, 1u);
+    EXPECT_FALSE(queue.finish_batch(true));
+}
+
+// Test that BLOCK waits for the writer to make room and times out otherwise
+TEST(SendQueueTest, BlockPolicyWaitsForSpace) {
+    SendQueueConfig config = make_config(SendBackpressurePolicy::BLOCK, 10);
+    config.block_timeout = std::chrono::seconds(5);
+    PeerSendQueue queue(INVALID_SOCKET_VALUE, config);
+
+    bool needs_schedule = false;
+    ASSERT_TRUE(queue.push(make_message(1, 8), needs_schedule));
+
+    std::atomic<bool> pushed{false};
+    std::thread producer([&]() {
+        bool schedule = false;
+        pushed = queue.push(make_message(2, 8), schedule);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(pushed.load());
+
+    std::vector<OutboundMessage> batch;
+    ASSERT_TRUE(queue.pop_batch(batch));
+    producer.join();
+    EXPECT_TRUE(pushed.load());
+    EXPECT_TRUE(queue.finish_batch(true));
+
+    PeerSendQueue short_queue(INVALID_SOCKET_VALUE, make_config(SendBackpressurePolicy::BLOCK, 10));
+    ASSERT_TRUE(short_queue.push(make_message(1, 8), needs_schedule));
+    EXPECT_FALSE(short_queue.push(make_message(2, 8), needs_schedule));
+    EXPECT_EQ(short_queue.get_stats().rejected_messages, 1u);
+}
+
+// Test that the writer coalesces pending messages and keeps FIFO order
+TEST(SendQueueTest, WriterCoalescesMessages) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool release_first = false;
+    std::vector<uint8_t> order;
+    size_t batches = 0;
+
+    SendQueueWriter writer("test", [&](socket_t, std::vector<OutboundMessage>& batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Hold the first write so the remaining messages pile up behind it
+        cv.wait(lock, [&]() { return release_first; });
+        for (const auto& message : batch) {
+            order.push_back(message.type);
+        }
+        batches++;
+        cv.notify_all();
+        return true;
+    });
+    ASSERT_TRUE(writer.start(2));
+
+    SendQueueConfig config;
+    auto queue = std::make_shared<PeerSendQueue>(INVALID_SOCKET_VALUE, config);
+    for (uint8_t i = 0; i < 20; ++i) {
+        ASSERT_TRUE(writer.enqueue(queue, make_message(i, 16)));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release_first = true;
+        cv.notify_all();
+    }
+    EXPECT_TRUE(queue->wait_drained(std::chrono::seconds(5)));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(order.size(), 20u);
+        for (uint8_t i = 0; i < 20; ++i) {
+            EXPECT_EQ(order[i], i);
+        }
+        EXPECT_LT(batches, 20u);
+    }
+
+    SendQueueStats stats = queue->get_stats();
+    EXPECT_EQ(stats.sent_messages, 20u);
+    EXPECT_EQ(stats.batches_written, batches);
+
+    writer.stop();
+    EXPECT_FALSE(writer.enqueue(queue, make_message(0, 1)));
+}
+
+// Test that a failed write closes the queue and rejects further messages
+TEST(SendQueueTest, FailedWriteClosesQueue) {
+    SendQueueWriter writer("test", [](socket_t, std::vector<OutboundMessage>&) { return false; });
+    ASSERT_TRUE(writer.start(1));
+
+    auto queue = std::make_shared<PeerSendQueue>(INVALID_SOCKET_VALUE, SendQueueConfig());
+    ASSERT_TRUE(writer.enqueue(queue, make_message(1, 4)));
+
+    for (int i = 0; i < 100 && !queue->is_closed(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(queue->is_closed());
+    EXPECT_FALSE(writer.enqueue(queue, make_message(2, 4)));
+    EXPECT_FALSE(queue->wait_drained(std::chrono::milliseconds(10)));
+
+    writer.stop();
+}
+
+// Test that CONTROL goes out first and DATA/BULK keep FIFO order within their class
+TEST(SendQueueTest, ControlMessagesGoFirst) {
+    PeerSendQueue queue(INVALID_SOCKET_VALUE, SendQueueConfig());
+
+    bool needs_schedule = false;
+    ASSERT_TRUE(queue.push(make_message(1, 8, SendPriority::BULK), needs_schedule));
+    ASSERT_TRUE(queue.push(make_message(2, 8, SendPriority::DATA), needs_schedule));
+    ASSERT_TRUE(queue.push(make_message(3, 8, SendPriority::BULK), needs_schedule));
+    ASSERT_TRUE(queue.push(make_message(4, 8, SendPriority::CONTROL), needs_schedule));
+    ASSERT_TRUE(queue.push(make_message(5, 8, SendPriority::CONTROL), needs_schedule));
+
+    std::vector<OutboundMessage> batch;
+    ASSERT_TRUE(queue.pop_batch(batch));
+    ASSERT_EQ(batch.size(), 5u);
+    EXPECT_EQ(batch[0].type, 4);
+    EXPECT_EQ(batch[1].type, 5);
+    EXPECT_EQ(batch[2].type, 2);
+    EXPECT_EQ(batch[3].type, 1);
+    EXPECT_EQ(batch[4].type, 3);
+    EXPECT_FALSE(queue.finish_batch(true));
+}
+
+// Test that DATA and BULK share the bandwidth by weight
+TEST(SendQueueTest, DataAndBulkShareByWeight) {
+    SendQueueConfig config;
+    config.max_batch_messages = 1;
+    config.fair_queue_quantum = 1000;
+    config.data_weight = 3;
+    config.bulk_weight = 1;
+    PeerSendQueue queue(INVALID_SOCKET_VALUE, config);
+
+    bool needs_schedule = false;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(queue.push(make_message(1, 1000, SendPriority::BULK), needs_schedule));
+        ASSERT_TRUE(queue.push(make_message(2, 1000, SendPriority::DATA), needs_schedule));
+    }
+
+    size_t data = 0;
+    size_t bulk = 0;
+    std::vector<OutboundMessage> batch;
+    for (int i = 0; i < 40; ++i) {
+        ASSERT_TRUE(queue.pop_batch(batch));
+        ASSERT_EQ(batch.size(), 1u);
+        (batch[0].priority == SendPriority::DATA ? data : bulk)++;
+        EXPECT_TRUE(queue.finish_batch(true));
+    }
+    EXPECT_EQ(data, 30u);
+    EXPECT_EQ(bulk, 10u);
+}
+
+// Test that queued data neither blocks nor evicts CONTROL, and DROP_OLDEST evicts BULK first
+TEST(SendQueueTest, ControlHasItsOwnBudget) {
+    PeerSendQueue queue(INVALID_SOCKET_VALUE, make_config(SendBackpressurePolicy::FAIL, 10));
+
+    bool needs_schedule = false;
+    ASSERT_TRUE(queue.push(make_message(1, 10, SendPriority::BULK), needs_schedule));
+    EXPECT_FALSE(queue.push(make_message(2, 1, SendPriority::DATA), needs_schedule));
+    EXPECT_TRUE(queue.push(make_message(3, 6, SendPriority::CONTROL), needs_schedule));
+    EXPECT_FALSE(queue.push(make_message(4, 6, SendPriority::CONTROL), needs_schedule));
+
+    PeerSendQueue dropping(INVALID_SOCKET_VALUE, make_config(SendBackpressurePolicy::DROP_OLDEST, 10));
+    ASSERT_TRUE(dropping.push(make_message(1, 4, SendPriority::DATA), needs_schedule));
+    ASSERT_TRUE(dropping.push(make_message(2, 4, SendPriority::BULK), needs_schedule));
+    ASSERT_TRUE(dropping.push(make_message(3, 4, SendPriority::DATA), needs_schedule));
+    EXPECT_FALSE(dropping.push(make_message(4, 4, SendPriority::BULK), needs_schedule));
+
+    std::vector<OutboundMessage> batch;
+    ASSERT_TRUE(dropping.pop_batch(batch));
+    ASSERT_EQ(batch.size(), 2u);
+    EXPECT_EQ(batch[0].type, 1);
+    EXPECT_EQ(batch[1].type, 3);
+    EXPECT_EQ(dropping.get_stats().dropped_messages, 1u);
+}
+
+// Test that the MPSC queue keeps each producer's order and loses nothing
+TEST(SendQueueTest, MpscQueueKeepsProducerOrder) {
+    const int producer_count = 4;
+    const int per_producer = 10000;
+    MpscQueue<std::pair<int, int>> queue;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producer_count; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < per_producer; ++i) {
+                queue.push(std::make_pair(p, i));
+            }
+        });
+    }
+
+    std::vector<int> next(producer_count, 0);
+    int received = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (received < producer_count * per_producer && std::chrono::steady_clock::now() < deadline) {
+        std::pair<int, int> item;
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(item.second, next[item.first]);
+        next[item.first]++;
+        received++;
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    EXPECT_EQ(received, producer_count * per_producer);
+    EXPECT_TRUE(queue.empty());
+}
+
+// Test that a sharded writer gives each socket to one thread and keeps per-queue order
+TEST(SendQueueTest, ShardedWriterOwnsSockets) {
+    const size_t shard_count = 3;
+    const int queue_count = 8;
+    const int per_queue = 200;
+
+    std::mutex mutex;
+    std::map<socket_t, std::vector<uint8_t>> written;
+    std::map<socket_t, std::set<std::thread::id>> writers;
+    SendQueueWriter writer("test", [&](socket_t socket, std::vector<OutboundMessage>& batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& message : batch) {
+            written[socket].push_back(message.type);
+        }
+        writers[socket].insert(std::this_thread::get_id());
+        return true;
+    });
+    ASSERT_TRUE(writer.start(shard_count, true));
+
+    std::vector<std::shared_ptr<PeerSendQueue>> queues;
+    for (int i = 0; i < queue_count; ++i) {
+        queues.push_back(std::make_shared<PeerSendQueue>(static_cast<socket_t>(i + 1), SendQueueConfig()));
+    }
+
+    // Producers feed two queues each, so the shards are handed work from several threads
+    std::vector<std::thread> producers;
+    for (int p = 0; p < queue_count / 2; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < per_queue; ++i) {
+                EXPECT_TRUE(writer.enqueue(queues[p * 2], make_message(static_cast<uint8_t>(i), 8)));
+                EXPECT_TRUE(writer.enqueue(queues[p * 2 + 1], make_message(static_cast<uint8_t>(i), 8)));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    for (const auto& queue : queues) {
+        EXPECT_TRUE(queue->wait_drained(std::chrono::seconds(5)));
+    }
+
+    std::set<std::thread::id> all_writers;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& queue : queues) {
+            const auto& messages = written[queue->get_socket()];
+            ASSERT_EQ(messages.size(), static_cast<size_t>(per_queue));
+            for (int i = 0; i < per_queue; ++i) {
+                EXPECT_EQ(messages[i], static_cast<uint8_t>(i));
+            }
+            EXPECT_EQ(writers[queue->get_socket()].size(), 1u);
+            all_writers.insert(writers[queue->get_socket()].begin(), writers[queue->get_socket()].end());
+        }
+    }
+    EXPECT_LE(all_writers.size(), shard_count);
+
+    writer.stop();
+    EXPECT_FALSE(writer.enqueue(queues[0], make_message(0, 1)));
+}
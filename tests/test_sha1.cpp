@@ -3,6 +3,7 @@
 #include "sha1.h"
 #include <string>
 #include <vector>
+#include <cstdio>
 
 using namespace librats;
 
@@ -306,4 +307,86 @@ TEST_F(SHA1Test, KnownVectorsTest) {
     // Another test vector
     std::string result2 = SHA1::hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
     EXPECT_EQ(result2, "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
-} 
\ No newline at end of file
+} 
+// Test that every supported backend matches the scalar implementation
+TEST_F(SHA1Test, BackendsMatchScalarTest) {
+    const SHA1Backend original = SHA1::get_backend();
+    EXPECT_TRUE(SHA1::is_backend_supported(original));
+    EXPECT_TRUE(SHA1::is_backend_supported(SHA1Backend::SCALAR));
+
+    std::vector<uint8_t> data(70000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>((i * 131) ^ (i >> 7));
+    }
+    const size_t lengths[] = {0, 1, 55, 56, 63, 64, 65, 119, 128, 1000, 16384, 70000};
+
+    ASSERT_TRUE(SHA1::set_backend(SHA1Backend::SCALAR));
+    std::vector<std::string> expected;
+    for (size_t length : lengths) {
+        SHA1 sha1;
+        sha1.update(data.data(), length);
+        expected.push_back(sha1.finalize());
+    }
+
+    for (SHA1Backend backend : {SHA1Backend::SHA_NI, SHA1Backend::ARM_CRYPTO}) {
+        if (!SHA1::set_backend(backend)) {
+            EXPECT_FALSE(SHA1::is_backend_supported(backend));
+            continue;
+        }
+        EXPECT_EQ(SHA1::get_backend(), backend);
+        EXPECT_EQ(SHA1::hash("abc"), "a9993e364706816aba3e25717850c26c9cd0d89d")
+            << SHA1::backend_name(backend);
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            // Split updates so partial blocks are carried between calls
+            SHA1 sha1;
+            size_t split = lengths[i] / 3;
+            sha1.update(data.data(), split);
+            sha1.update(data.data() + split, lengths[i] - split);
+            EXPECT_EQ(sha1.finalize(), expected[i]) << SHA1::backend_name(backend) << " length " << lengths[i];
+        }
+    }
+
+    SHA1::set_backend(original);
+}
+
+// Test batch hashing against individual hashes on every supported backend
+TEST_F(SHA1Test, HashManyTest) {
+    const SHA1Backend original = SHA1::get_backend();
+
+    std::vector<std::vector<uint8_t>> buffers;
+    for (size_t length : {0, 3, 64, 200, 4096, 4100, 16384, 777}) {
+        std::vector<uint8_t> buffer(length);
+        for (size_t i = 0; i < length; i++) {
+            buffer[i] = static_cast<uint8_t>(i * 7 + length);
+        }
+        buffers.push_back(std::move(buffer));
+    }
+
+    std::vector<SHA1Input> inputs;
+    std::vector<std::string> expected;
+    for (const auto& buffer : buffers) {
+        inputs.push_back({buffer.data(), buffer.size()});
+        expected.push_back(SHA1::hash_bytes(buffer));
+    }
+
+    for (SHA1Backend backend : {SHA1Backend::SCALAR, SHA1Backend::SHA_NI, SHA1Backend::ARM_CRYPTO}) {
+        if (!SHA1::set_backend(backend)) {
+            continue;
+        }
+        // Odd count leaves one input outside the pairs
+        std::vector<uint8_t> digests(inputs.size() * SHA1::DIGEST_SIZE);
+        auto* out = reinterpret_cast<uint8_t (*)[SHA1::DIGEST_SIZE]>(digests.data());
+        SHA1::hash_many(inputs.data(), inputs.size() - 1, out);
+        SHA1::hash_many(&inputs.back(), 1, out + inputs.size() - 1);
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            char hex[SHA1::DIGEST_SIZE * 2 + 1];
+            for (size_t j = 0; j < SHA1::DIGEST_SIZE; j++) {
+                snprintf(hex + j * 2, 3, "%02x", out[i][j]);
+            }
+            EXPECT_EQ(std::string(hex), expected[i]) << SHA1::backend_name(backend) << " input " << i;
+        }
+    }
+
+    SHA1::set_backend(original);
+}
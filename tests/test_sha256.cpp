@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "sha256.h"
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+using namespace librats;
+
+namespace {
+
+std::string digest_to_hex(const uint8_t* digest, size_t size) {
+    std::ostringstream hex_stream;
+    for (size_t i = 0; i < size; ++i) {
+        hex_stream << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(digest[i]);
+    }
+    return hex_stream.str();
+}
+
+} // namespace
+
+// Test the FIPS 180-2 example messages
+TEST(SHA256Test, KnownVectors) {
+    EXPECT_EQ(SHA256::hash(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(SHA256::hash("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(SHA256::hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+// Test that incremental updates of any size give the same digest as one update
+TEST(SHA256Test, IncrementalUpdates) {
+    SHA256 hasher;
+    std::string chunk(1000, 'a');
+    for (int i = 0; i < 1000; ++i) {
+        hasher.update(chunk);
+    }
+    EXPECT_EQ(hasher.finalize(), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    std::vector<uint8_t> data(300);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 31);
+    }
+    SHA256 pieces;
+    size_t offset = 0;
+    for (size_t step = 1; offset < data.size(); ++step) {
+        size_t take = std::min(step, data.size() - offset);
+        pieces.update(data.data() + offset, take);
+        offset += take;
+    }
+    EXPECT_EQ(pieces.finalize(), SHA256::hash_bytes(data));
+
+    // Subsequent finalize calls return an empty string
+    EXPECT_EQ(pieces.finalize(), "");
+}
+
+// Test HMAC-SHA256 against RFC 4231
+TEST(SHA256Test, HmacVectors) {
+    uint8_t tag[SHA256::DIGEST_SIZE];
+
+    std::vector<uint8_t> key1(20, 0x0b);
+    std::string data1 = "Hi There";
+    SHA256::hmac(key1.data(), key1.size(), reinterpret_cast<const uint8_t*>(data1.data()), data1.size(), tag);
+    EXPECT_EQ(digest_to_hex(tag, sizeof(tag)), "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+
+    // Key longer than the block size is hashed first
+    std::vector<uint8_t> key6(131, 0xaa);
+    std::string data6 = "Test Using Larger Than Block-Size Key - Hash Key First";
+    SHA256::hmac(key6.data(), key6.size(), reinterpret_cast<const uint8_t*>(data6.data()), data6.size(), tag);
+    EXPECT_EQ(digest_to_hex(tag, sizeof(tag)), "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+}
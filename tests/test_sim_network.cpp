@@ -0,0 +1,241 @@
+#include <gtest/gtest.h>
+#include "sim_network.h"
+#include "dht.h"
+#include "logger.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+struct Inbox {
+    std::vector<std::string> messages;
+    std::vector<NetEndpoint> senders;
+    std::vector<SimNetwork::Clock::time_point> times;
+};
+
+void open_inbox(SimNetwork& network, DatagramTransport& endpoint, Inbox& inbox) {
+    endpoint.open([&network, &inbox](const uint8_t* data, size_t size, const NetEndpoint& sender) {
+        inbox.messages.emplace_back(reinterpret_cast<const char*>(data), size);
+        inbox.senders.push_back(sender);
+        inbox.times.push_back(network.now());
+    });
+}
+
+bool send_text(DatagramTransport& endpoint, const NetEndpoint& destination, const std::string& text) {
+    return endpoint.send(destination, reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+} // namespace
+
+// Test that delivery time is uplink queueing plus both ends' latency
+TEST(SimNetworkTest, LatencyAndBandwidth) {
+    SimNetwork network;
+    SimLinkConfig slow;
+    slow.latency = std::chrono::milliseconds(5);
+    slow.bandwidth = 1000;
+    SimLinkConfig fast;
+    fast.latency = std::chrono::milliseconds(15);
+
+    auto a = network.add_endpoint(slow);
+    auto b = network.add_endpoint(fast);
+    Inbox inbox;
+    a->open(nullptr);
+    open_inbox(network, *b, inbox);
+
+    auto start = network.now();
+    EXPECT_TRUE(send_text(*a, b->local_address(), std::string(100, 'x')));
+    EXPECT_TRUE(send_text(*a, b->local_address(), std::string(100, 'y')));
+    EXPECT_EQ(network.pending_events(), 2u);
+
+    network.run_for(std::chrono::seconds(1));
+    ASSERT_EQ(inbox.messages.size(), 2u);
+    EXPECT_EQ(inbox.senders[0], a->local_address());
+    // 100 bytes at 1000 B/s take 100ms each; the second waits for the first
+    EXPECT_EQ(inbox.times[0] - start, std::chrono::milliseconds(120));
+    EXPECT_EQ(inbox.times[1] - start, std::chrono::milliseconds(220));
+    EXPECT_EQ(network.now() - start, std::chrono::seconds(1));
+}
+
+// Test that loss follows the seed, so a run replays exactly
+TEST(SimNetworkTest, SeededLossReplays) {
+    auto run = [](uint64_t seed) {
+        SimNetwork network(seed);
+        SimLinkConfig lossy;
+        lossy.loss = 0.5;
+        lossy.jitter = std::chrono::milliseconds(3);
+        auto a = network.add_endpoint(lossy);
+        auto b = network.add_endpoint();
+        Inbox inbox;
+        a->open(nullptr);
+        open_inbox(network, *b, inbox);
+        for (int i = 0; i < 200; ++i) {
+            send_text(*a, b->local_address(), std::to_string(i));
+        }
+        network.run_for(std::chrono::seconds(1));
+        EXPECT_EQ(network.get_statistics().lost + inbox.messages.size(), 200u);
+        return inbox.messages;
+    };
+
+    auto first = run(7);
+    EXPECT_GT(first.size(), 50u);
+    EXPECT_LT(first.size(), 150u);
+    EXPECT_EQ(run(7), first);
+    EXPECT_NE(run(8), first);
+}
+
+// Test that restricted NATs only let in replies and symmetric NATs map per destination
+TEST(SimNetworkTest, NatBehaviour) {
+    SimNetwork network;
+    SimLinkConfig restricted;
+    restricted.nat = SimNatType::PORT_RESTRICTED;
+    SimLinkConfig symmetric;
+    symmetric.nat = SimNatType::SYMMETRIC;
+
+    auto server = network.add_endpoint();
+    auto other = network.add_endpoint();
+    auto natted = network.add_endpoint(restricted);
+    auto sym = network.add_endpoint(symmetric);
+    Inbox server_inbox, other_inbox, natted_inbox, sym_inbox;
+    open_inbox(network, *server, server_inbox);
+    open_inbox(network, *other, other_inbox);
+    open_inbox(network, *natted, natted_inbox);
+    open_inbox(network, *sym, sym_inbox);
+
+    // Private addresses are not reachable from outside
+    send_text(*server, natted->local_address(), "unsolicited");
+    network.run_for(std::chrono::milliseconds(100));
+    EXPECT_TRUE(natted_inbox.messages.empty());
+    EXPECT_EQ(network.get_statistics().unroutable, 1u);
+
+    send_text(*natted, server->local_address(), "hello");
+    network.run_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(server_inbox.messages.size(), 1u);
+    NetEndpoint mapped = server_inbox.senders[0];
+    EXPECT_NE(mapped, natted->local_address());
+
+    send_text(*server, mapped, "reply");
+    send_text(*other, mapped, "stranger");
+    network.run_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(natted_inbox.messages.size(), 1u);
+    EXPECT_EQ(natted_inbox.messages[0], "reply");
+    EXPECT_EQ(network.get_statistics().filtered, 1u);
+
+    send_text(*sym, server->local_address(), "to server");
+    send_text(*sym, other->local_address(), "to other");
+    network.run_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(server_inbox.messages.size(), 2u);
+    ASSERT_EQ(other_inbox.messages.size(), 1u);
+    EXPECT_EQ(server_inbox.senders[1].address, other_inbox.senders[0].address);
+    EXPECT_NE(server_inbox.senders[1].port, other_inbox.senders[0].port);
+
+    // The mapping opened towards the server is closed to the other endpoint
+    send_text(*other, server_inbox.senders[1], "wrong mapping");
+    network.run_for(std::chrono::milliseconds(100));
+    EXPECT_TRUE(sym_inbox.messages.empty());
+}
+
+// Test that timers run in virtual time and die with the endpoint
+TEST(SimNetworkTest, TimersStopOnClose) {
+    SimNetwork network;
+    auto endpoint = network.add_endpoint();
+    endpoint->open(nullptr);
+
+    int fired = 0;
+    auto start = network.now();
+    SimNetwork::Clock::time_point fired_at;
+    endpoint->schedule(std::chrono::hours(1), [&] {
+        ++fired;
+        fired_at = network.now();
+    });
+    endpoint->schedule(std::chrono::hours(2), [&] { ++fired; });
+
+    EXPECT_TRUE(network.run_until([&] { return fired == 1; }, std::chrono::hours(3)));
+    EXPECT_EQ(fired_at - start, std::chrono::hours(1));
+    endpoint->close();
+    network.run_for(std::chrono::hours(3));
+    EXPECT_EQ(fired, 1);
+    EXPECT_EQ(network.pending_events(), 0u);
+}
+
+// Test that a thousand DHT nodes bootstrap and find an announced peer in virtual time
+TEST(SimNetworkTest, DhtLookupAtScale) {
+    const size_t node_count = 1000;
+    LogLevel previous_level = Logger::getInstance().get_log_level();
+    Logger::getInstance().set_log_level(LogLevel::ERROR);
+
+    SimNetwork network(42);
+    SimLinkConfig link;
+    link.latency = std::chrono::milliseconds(20);
+    link.jitter = std::chrono::milliseconds(10);
+    link.loss = 0.01;
+
+    std::vector<std::unique_ptr<DhtClient>> nodes;
+    for (size_t i = 0; i < node_count; ++i) {
+        nodes.emplace_back(new DhtClient());
+        ASSERT_TRUE(nodes.back()->set_transport(network.add_endpoint(link)));
+        ASSERT_TRUE(nodes.back()->start());
+    }
+
+    // Nodes join a few at a time, each through the first node and a few that joined before it
+    std::vector<Peer> addresses;
+    for (size_t i = 0; i < node_count; ++i) {
+        addresses.push_back(Peer("10.0." + std::to_string((i + 1) / 256) + "." + std::to_string((i + 1) % 256), 6881));
+    }
+    for (size_t i = 1; i < node_count; ++i) {
+        std::vector<Peer> bootstrap_peers = {addresses[0]};
+        for (size_t j = 1; j <= 3 && j < i; ++j) {
+            bootstrap_peers.push_back(addresses[(i * 7919 + j * 104729) % i]);
+        }
+        nodes[i]->bootstrap(bootstrap_peers);
+        if (i % 50 == 0) {
+            network.run_for(std::chrono::milliseconds(500));
+        }
+    }
+    network.run_for(std::chrono::seconds(30));
+
+    // Every node learned more of the network than the bootstrap node
+    size_t isolated = 0;
+    size_t total_routing = 0;
+    for (const auto& node : nodes) {
+        isolated += node->get_routing_table_size() <= 1 ? 1 : 0;
+        total_routing += node->get_routing_table_size();
+    }
+    EXPECT_EQ(isolated, 0u);
+    EXPECT_GE(total_routing / node_count, 20u);
+
+    InfoHash hash;
+    hash.fill(0x5a);
+    // A small swarm announces; announce_peer() only reaches the closest nodes each member
+    // knows, so they walk towards the hash first
+    for (size_t i = 0; i < 5; ++i) {
+        nodes[100 + i * 150]->find_peers(hash, [](const std::vector<Peer>&, const InfoHash&) {}, 8);
+    }
+    network.run_for(std::chrono::seconds(10));
+    for (size_t i = 0; i < 5; ++i) {
+        ASSERT_TRUE(nodes[100 + i * 150]->announce_peer(hash, 7000));
+    }
+    network.run_for(std::chrono::seconds(10));
+
+    std::vector<Peer> found;
+    DhtClient& searcher = *nodes[node_count - 1];
+    auto started = network.now();
+    ASSERT_TRUE(searcher.find_peers(hash, [&](const std::vector<Peer>& peers, const InfoHash&) {
+        found.insert(found.end(), peers.begin(), peers.end());
+    }, 8));
+    EXPECT_TRUE(network.run_until([&] { return !found.empty(); }, std::chrono::seconds(30)));
+    auto lookup_time = network.now() - started;
+
+    ASSERT_FALSE(found.empty());
+    for (const auto& peer : found) {
+        EXPECT_EQ(peer.port, 7000);
+    }
+    EXPECT_LT(lookup_time, std::chrono::seconds(5));
+
+    for (auto& node : nodes) {
+        node->stop();
+    }
+    Logger::getInstance().set_log_level(previous_level);
+}
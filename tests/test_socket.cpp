@@ -1,8 +1,10 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include "socket.h"
+#include "fs.h"
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 using namespace librats;
 
@@ -36,6 +38,50 @@ TEST_F(SocketTest, PeerTest) {
     EXPECT_NE(peer1, peer3);
 }
 
+// Test the binary endpoint: parsing, text forms and socket address round trips
+TEST_F(SocketTest, NetEndpointTest) {
+    NetEndpoint v4("192.168.1.20", 6881);
+    EXPECT_TRUE(v4.is_ipv4());
+    EXPECT_FALSE(v4.is_unspecified());
+    EXPECT_EQ(v4.ip(), "192.168.1.20");
+    EXPECT_EQ(v4.to_string(), "192.168.1.20:6881");
+    EXPECT_EQ(v4.to_peer(), Peer("192.168.1.20", 6881));
+    const uint8_t bytes[4] = {192, 168, 1, 20};
+    EXPECT_EQ(NetEndpoint::from_ipv4(bytes, 6881), v4);
+
+    // IPv4-mapped text is the same endpoint as plain IPv4
+    EXPECT_EQ(NetEndpoint("::ffff:192.168.1.20", 6881), v4);
+    EXPECT_NE(NetEndpoint("192.168.1.20", 6882), v4);
+
+    NetEndpoint v6("2001:db8::1", 443);
+    EXPECT_FALSE(v6.is_ipv4());
+    EXPECT_EQ(v6.ip(), "2001:db8::1");
+    EXPECT_EQ(v6.to_string(), "[2001:db8::1]:443");
+
+    NetEndpoint parsed;
+    EXPECT_FALSE(NetEndpoint::parse("example.com", 80, parsed));
+    EXPECT_TRUE(parsed.is_unspecified());
+    EXPECT_TRUE(NetEndpoint("example.com", 80).is_unspecified());
+
+    // Socket addresses: IPv4 goes out of AF_INET sockets plain and of AF_INET6 sockets mapped
+    sockaddr_storage address;
+    socklen_t address_length = 0;
+    ASSERT_TRUE(v4.to_sockaddr(AF_INET, address, address_length));
+    EXPECT_EQ(address_length, sizeof(sockaddr_in));
+    EXPECT_EQ(NetEndpoint::from_sockaddr(address), v4);
+    ASSERT_TRUE(v4.to_sockaddr(AF_INET6, address, address_length));
+    EXPECT_EQ(address_length, sizeof(sockaddr_in6));
+    EXPECT_EQ(NetEndpoint::from_sockaddr(address), v4);
+    EXPECT_FALSE(v6.to_sockaddr(AF_INET, address, address_length));
+    ASSERT_TRUE(v6.to_sockaddr(AF_INET6, address, address_length));
+    EXPECT_EQ(NetEndpoint::from_sockaddr(address), v6);
+
+    std::hash<NetEndpoint> hasher;
+    EXPECT_EQ(hasher(v4), hasher(NetEndpoint("192.168.1.20", 6881)));
+    EXPECT_NE(hasher(v4), hasher(NetEndpoint("192.168.1.21", 6881)));
+    EXPECT_NE(hasher(v4), hasher(NetEndpoint("192.168.1.20", 6882)));
+}
+
 // Test socket validity check
 TEST_F(SocketTest, SocketValidityTest) {
     socket_t valid_socket = create_tcp_server(0);  // Use port 0 for automatic port assignment
@@ -228,4 +274,151 @@ TEST_F(SocketTest, EdgeCasesTest) {
     // Test creating client with invalid port
     socket_t client2 = create_tcp_client("127.0.0.1", -1);
     EXPECT_FALSE(is_valid_socket(client2));
-} 
\ No newline at end of file
+} 
+// Test vectored framed send is received as one concatenated frame
+TEST_F(SocketTest, VectoredFramedSendTest) {
+    socket_t server = create_tcp_server_v4(0);
+    ASSERT_TRUE(is_valid_socket(server));
+    
+    sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(getsockname(server, (sockaddr*)&addr, &addr_len), 0);
+    int port = ntohs(addr.sin_port);
+    
+    socket_t client = create_tcp_client("127.0.0.1", port);
+    ASSERT_TRUE(is_valid_socket(client));
+    socket_t accepted = accept_client(server);
+    ASSERT_TRUE(is_valid_socket(accepted));
+    
+    std::string header = "HEAD";
+    std::vector<uint8_t> payload(200000);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<uint8_t>(i % 251);
+    }
+    IoSlice parts[3] = { IoSlice(header.data(), header.size()), IoSlice(), IoSlice(payload) };
+    
+    std::vector<uint8_t> received;
+    std::thread receiver([&]() {
+        received = receive_tcp_message_framed(accepted);
+    });
+    
+    int sent = send_tcp_message_framed(client, parts, 3);
+    receiver.join();
+    EXPECT_EQ(sent, static_cast<int>(4 + header.size() + payload.size()));
+    
+    ASSERT_EQ(received.size(), header.size() + payload.size());
+    EXPECT_EQ(std::string(received.begin(), received.begin() + header.size()), header);
+    EXPECT_TRUE(std::equal(payload.begin(), payload.end(), received.begin() + header.size()));
+    
+    close_socket(client);
+    close_socket(accepted);
+    close_socket(server);
+}
+
+// Test that a file range sent by the kernel arrives intact
+TEST_F(SocketTest, FileRangeSendTest) {
+    const std::string path = "socket_test_file_range.bin";
+    std::vector<uint8_t> content(300000);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>((i * 7) % 253);
+    }
+    ASSERT_TRUE(create_file_binary(path.c_str(), content.data(), content.size()));
+    FileHandle file;
+    ASSERT_TRUE(file.open(path.c_str(), FileOpenMode::READ_ONLY));
+    
+    socket_t sockets[2];
+    ASSERT_TRUE(create_socket_pair(sockets));
+    
+    const uint64_t offset = 1000;
+    const uint64_t size = 250000;
+    std::vector<uint8_t> received;
+    std::thread receiver([&]() {
+        received = receive_exact_bytes(sockets[1], static_cast<size_t>(size));
+    });
+    int64_t sent = send_tcp_file_data(sockets[0], file, offset, size);
+    receiver.join();
+    
+    EXPECT_EQ(sent, static_cast<int64_t>(size));
+    ASSERT_EQ(received.size(), size);
+    EXPECT_TRUE(std::equal(received.begin(), received.end(), content.begin() + offset));
+    
+    // A range past the end of the file fails instead of sending short
+    EXPECT_EQ(send_tcp_file_data(sockets[0], file, content.size() - 10, 20), -1);
+    
+    close_socket(sockets[0]);
+    close_socket(sockets[1]);
+    file.close();
+    delete_file(path.c_str());
+}
+
+// Test batched datagram send and receive on a dual-stack UDP socket
+TEST_F(SocketTest, UdpBatchSendReceiveTest) {
+    socket_t receiver = create_udp_socket(0);
+    socket_t sender = create_udp_socket(0);
+    ASSERT_TRUE(is_valid_socket(receiver));
+    ASSERT_TRUE(is_valid_socket(sender));
+    ASSERT_TRUE(set_socket_nonblocking(receiver));
+    ASSERT_TRUE(set_socket_nonblocking(sender));
+    int port = get_ephemeral_port(receiver);
+    ASSERT_GT(port, 0);
+    
+    UdpReceiveBatch batch(8, 256);
+    EXPECT_EQ(batch.capacity(), 8u);
+    EXPECT_EQ(receive_udp_batch(receiver, batch), 0);  // Nothing queued yet
+    
+    std::vector<UdpDatagram> datagrams(12);
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        ASSERT_TRUE(make_udp_address(AF_INET6, "127.0.0.1", port, datagrams[i].address, datagrams[i].address_length));
+        datagrams[i].data.assign(10 + i, static_cast<uint8_t>(i));
+    }
+    EXPECT_EQ(send_udp_batch(sender, datagrams.data(), datagrams.size()), datagrams.size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    
+    // Twelve datagrams arrive in order over two batches of at most eight
+    size_t next = 0;
+    for (int round = 0; round < 2; ++round) {
+        int received = receive_udp_batch(receiver, batch);
+        ASSERT_GT(received, 0);
+        for (size_t i = 0; i < batch.count(); ++i, ++next) {
+            ASSERT_EQ(batch.size(i), datagrams[next].data.size());
+            EXPECT_TRUE(std::equal(datagrams[next].data.begin(), datagrams[next].data.end(), batch.data(i)));
+            Peer from = udp_address_to_peer(batch.address(i));
+            EXPECT_EQ(from.ip, "127.0.0.1");  // IPv4-mapped sender reported as IPv4
+            EXPECT_EQ(from.port, get_ephemeral_port(sender));
+        }
+    }
+    EXPECT_EQ(next, datagrams.size());
+    EXPECT_EQ(receive_udp_batch(receiver, batch), 0);
+    
+    close_socket(sender);
+    close_socket(receiver);
+}
+
+// Test address racing: refused addresses hand over to the next one without waiting out the stagger
+TEST_F(SocketTest, RacingConnectTest) {
+    socket_t server = create_tcp_server_v4(0);
+    ASSERT_TRUE(is_valid_socket(server));
+    
+    sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(getsockname(server, (sockaddr*)&addr, &addr_len), 0);
+    int port = ntohs(addr.sin_port);
+    
+    // "localhost" may also resolve to ::1, which the IPv4-only server refuses
+    std::string connected_address;
+    auto start = std::chrono::steady_clock::now();
+    socket_t client = create_tcp_client_racing("localhost", port, 5000, 2000, &connected_address);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(is_valid_socket(client));
+    EXPECT_EQ(connected_address, "127.0.0.1");
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 1500);
+    
+    socket_t accepted = accept_client(server);
+    ASSERT_TRUE(is_valid_socket(accepted));
+    close_socket(accepted);
+    close_socket(client);
+    close_socket(server);
+    
+    // Nothing listens on the port any more
+    EXPECT_FALSE(is_valid_socket(create_tcp_client_racing("127.0.0.1", port, 1000)));
+}
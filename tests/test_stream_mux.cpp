@@ -0,0 +1,276 @@
+#include <gtest/gtest.h>
+#include "stream_mux.h"
+#include "../src/librats.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <map>
+
+using namespace librats;
+
+namespace {
+
+// Two muxers joined back to back; frames are held until pumped so tests control delivery
+class MuxPair {
+public:
+    explicit MuxPair(const StreamConfig& config = StreamConfig())
+        : a(true, config, [this](const std::vector<uint8_t>& frame, SendPriority) { return enqueue(to_b_, frame); }),
+          b(false, config, [this](const std::vector<uint8_t>& frame, SendPriority) { return enqueue(to_a_, frame); }) {}
+
+    // Deliver queued frames in both directions until none are left
+    void pump() {
+        while (deliver(to_b_, b) | deliver(to_a_, a)) {}
+    }
+
+    size_t pending_to_b() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return to_b_.size();
+    }
+
+    StreamMuxer a;
+    StreamMuxer b;
+
+private:
+    bool enqueue(std::deque<std::vector<uint8_t>>& queue, const std::vector<uint8_t>& frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue.push_back(frame);
+        return true;
+    }
+
+    bool deliver(std::deque<std::vector<uint8_t>>& queue, StreamMuxer& target) {
+        bool delivered = false;
+        while (true) {
+            std::vector<uint8_t> frame;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (queue.empty()) {
+                    return delivered;
+                }
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+            EXPECT_TRUE(target.handle_frame(frame.data(), frame.size()));
+            delivered = true;
+        }
+    }
+
+    std::mutex mutex_;
+    std::deque<std::vector<uint8_t>> to_a_;
+    std::deque<std::vector<uint8_t>> to_b_;
+};
+
+template<typename Predicate>
+bool wait_until(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (predicate()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return predicate();
+}
+
+} // anonymous namespace
+
+TEST(StreamMuxTest, OpenWriteAndCloseStream) {
+    MuxPair pair;
+    std::vector<uint32_t> opened;
+    std::vector<uint32_t> closed_a;
+    std::vector<uint32_t> closed_b;
+    std::string received;
+    pair.b.set_opened_callback([&](uint32_t id) { opened.push_back(id); });
+    pair.b.set_data_callback([&](uint32_t, const uint8_t* data, size_t size) {
+        received.append(reinterpret_cast<const char*>(data), size);
+    });
+    pair.a.set_closed_callback([&](uint32_t id) { closed_a.push_back(id); });
+    pair.b.set_closed_callback([&](uint32_t id) { closed_b.push_back(id); });
+
+    uint32_t id = pair.a.open_stream();
+    EXPECT_EQ(id % 2, 1u);
+    std::string text = "hello stream";
+    EXPECT_TRUE(pair.a.write(id, reinterpret_cast<const uint8_t*>(text.data()), text.size()));
+    EXPECT_TRUE(pair.a.close(id));
+    pair.pump();
+
+    ASSERT_EQ(opened.size(), 1u);
+    EXPECT_EQ(opened[0], id);
+    EXPECT_EQ(received, text);
+    EXPECT_TRUE(closed_b.empty()); // Only half closed until b closes too
+    EXPECT_FALSE(pair.a.write(id, reinterpret_cast<const uint8_t*>(text.data()), text.size()));
+
+    EXPECT_TRUE(pair.b.close(id));
+    pair.pump();
+    EXPECT_EQ(closed_a, std::vector<uint32_t>{id});
+    EXPECT_EQ(closed_b, std::vector<uint32_t>{id});
+    EXPECT_EQ(pair.a.stream_count(), 0u);
+    EXPECT_EQ(pair.b.stream_count(), 0u);
+
+    // The other side opens from its own half of the ID space
+    uint32_t reverse_id = pair.b.open_stream();
+    EXPECT_EQ(reverse_id % 2, 0u);
+}
+
+TEST(StreamMuxTest, WriterBlocksUntilWindowCredit) {
+    StreamConfig config;
+    config.initial_window = 1024;
+    config.max_frame_size = 256;
+    MuxPair pair(config);
+    std::atomic<size_t> received{0};
+    pair.b.set_data_callback([&](uint32_t, const uint8_t*, size_t size) { received += size; });
+
+    uint32_t id = pair.a.open_stream();
+    std::vector<uint8_t> data(4096, 0x5A);
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        EXPECT_TRUE(pair.a.write(id, data.data(), data.size()));
+        done = true;
+    });
+
+    // One window's worth of frames is sent, then the writer waits
+    ASSERT_TRUE(wait_until([&] { return pair.a.get_send_window(id) == 0; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(done.load());
+    EXPECT_EQ(pair.pending_to_b(), 1u + 1024 / 256); // SYN plus four DATA frames
+
+    ASSERT_TRUE(wait_until([&] {
+        pair.pump();
+        return done.load();
+    }));
+    writer.join();
+    pair.pump();
+    EXPECT_EQ(received.load(), data.size());
+}
+
+TEST(StreamMuxTest, ResetAndShutdownFailBlockedWriters) {
+    StreamConfig config;
+    config.initial_window = 64;
+    MuxPair pair(config);
+    std::vector<uint32_t> closed_b;
+    pair.b.set_closed_callback([&](uint32_t id) { closed_b.push_back(id); });
+
+    uint32_t id = pair.a.open_stream();
+    std::vector<uint8_t> data(256, 1);
+    std::thread writer([&] { EXPECT_FALSE(pair.a.write(id, data.data(), data.size())); });
+    ASSERT_TRUE(wait_until([&] { return pair.a.get_send_window(id) == 0; }));
+    EXPECT_TRUE(pair.a.reset(id));
+    writer.join();
+    pair.pump();
+    EXPECT_EQ(closed_b, std::vector<uint32_t>{id});
+    EXPECT_EQ(pair.b.stream_count(), 0u);
+
+    uint32_t second = pair.a.open_stream();
+    std::thread second_writer([&] { EXPECT_FALSE(pair.a.write(second, data.data(), data.size())); });
+    ASSERT_TRUE(wait_until([&] { return pair.a.get_send_window(second) == 0; }));
+    pair.a.shutdown();
+    second_writer.join();
+    EXPECT_EQ(pair.a.open_stream(), 0u);
+}
+
+TEST(StreamMuxTest, RejectsStreamsOverLimitAndWindowViolations) {
+    StreamConfig config;
+    config.max_streams = 1;
+    config.initial_window = 16;
+    MuxPair pair(config);
+
+    StreamMuxer& sender = pair.a;
+    uint32_t first = sender.open_stream();
+    EXPECT_EQ(sender.open_stream(), 0u);
+
+    // A SYN over the receiver's limit is reset
+    std::vector<uint8_t> syn(StreamMuxer::FRAME_HEADER_SIZE, 0);
+    syn[0] = static_cast<uint8_t>(StreamFrameType::WINDOW_UPDATE);
+    syn[1] = stream_flags::SYN;
+    syn[5] = 2;
+    EXPECT_TRUE(sender.handle_frame(syn.data(), syn.size()));
+    EXPECT_EQ(sender.stream_count(), 1u);
+    pair.pump();
+    EXPECT_EQ(pair.b.stream_count(), 1u);
+
+    // A hand-built DATA frame larger than the window resets the stream
+    std::vector<uint8_t> frame(StreamMuxer::FRAME_HEADER_SIZE + 32, 0);
+    frame[0] = static_cast<uint8_t>(StreamFrameType::DATA);
+    frame[5] = static_cast<uint8_t>(first);
+    frame[9] = 32;
+    EXPECT_TRUE(pair.b.handle_frame(frame.data(), frame.size()));
+    EXPECT_EQ(pair.b.stream_count(), 0u);
+    pair.pump();
+    EXPECT_EQ(sender.stream_count(), 0u);
+
+    // Malformed frames are reported to the caller
+    EXPECT_FALSE(pair.b.handle_frame(frame.data(), 4));
+    frame[9] = 31;
+    EXPECT_FALSE(pair.b.handle_frame(frame.data(), frame.size()));
+
+    // Window credit that would wrap the send window resets the stream
+    uint32_t second = sender.open_stream();
+    ASSERT_NE(second, 0u);
+    pair.pump();
+    std::vector<uint8_t> update(StreamMuxer::FRAME_HEADER_SIZE, 0);
+    update[0] = static_cast<uint8_t>(StreamFrameType::WINDOW_UPDATE);
+    update[5] = static_cast<uint8_t>(second);
+    update[6] = update[7] = update[8] = update[9] = 0xff;
+    EXPECT_TRUE(sender.handle_frame(update.data(), update.size()));
+    EXPECT_EQ(sender.stream_count(), 0u);
+    pair.pump();
+    EXPECT_EQ(pair.b.stream_count(), 0u);
+}
+
+TEST(StreamMuxTest, StreamsBetweenRatsClients) {
+    RatsClient client1(58470, 5);
+    RatsClient client2(58471, 5);
+    ASSERT_TRUE(client1.start());
+    ASSERT_TRUE(client2.start());
+
+    std::mutex mutex;
+    std::map<uint32_t, std::vector<uint8_t>> received;
+    std::atomic<int> opened{0};
+    std::atomic<int> closed{0};
+    client1.on_stream_opened([&](const std::string&, uint32_t) { opened++; });
+    client1.on_stream_data([&](const std::string&, uint32_t id, const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& buffer = received[id];
+        buffer.insert(buffer.end(), data.begin(), data.end());
+    });
+    client1.on_stream_closed([&](const std::string&, uint32_t) { closed++; });
+
+    ASSERT_TRUE(client2.connect_to_peer("127.0.0.1", 58470));
+    ASSERT_TRUE(wait_until([&] { return client1.get_peer_count() == 1 && client2.get_peer_count() == 1; }));
+    std::string peer_id = client1.get_our_peer_id();
+
+    EXPECT_EQ(client2.open_stream("unknown-peer"), 0u);
+
+    // A bulk stream larger than the window and a small stream share the connection
+    uint32_t bulk = client2.open_stream(peer_id, SendPriority::BULK);
+    uint32_t small = client2.open_stream(peer_id);
+    ASSERT_NE(bulk, 0u);
+    ASSERT_NE(small, 0u);
+    std::vector<uint8_t> bulk_data(client2.get_stream_config().initial_window * 3);
+    for (size_t i = 0; i < bulk_data.size(); ++i) {
+        bulk_data[i] = static_cast<uint8_t>(i * 7);
+    }
+    std::vector<uint8_t> small_data(100, 0x42);
+    std::thread bulk_writer([&] { EXPECT_TRUE(client2.write_stream(peer_id, bulk, bulk_data)); });
+    EXPECT_TRUE(client2.write_stream(peer_id, small, small_data));
+    bulk_writer.join();
+    EXPECT_TRUE(client2.close_stream(peer_id, bulk));
+
+    ASSERT_TRUE(wait_until([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received[bulk].size() == bulk_data.size() && received[small].size() == small_data.size();
+    }));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(received[bulk], bulk_data);
+        EXPECT_EQ(received[small], small_data);
+    }
+    EXPECT_EQ(opened.load(), 2);
+    EXPECT_EQ(client1.get_stream_count(client2.get_our_peer_id()), 2u);
+
+    // Disconnecting closes the remaining streams on both sides
+    client2.stop();
+    EXPECT_TRUE(wait_until([&] { return closed.load() == 2; }));
+    client1.stop();
+}
@@ -3,6 +3,9 @@
 #include "../src/socket.h"
 #include "../src/librats.h"
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 using namespace librats;
 
@@ -19,6 +22,64 @@ protected:
     }
 };
 
+namespace {
+
+// Minimal local STUN server answering binding requests with a fixed XOR-MAPPED-ADDRESS
+class FakeStunServer {
+public:
+    FakeStunServer(uint32_t mapped_ip, uint16_t mapped_port, int drop_first = 0)
+        : mapped_ip_(mapped_ip), mapped_port_(mapped_port), drop_first_(drop_first) {
+        socket_ = create_udp_socket_v4(0);
+        sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        getsockname(socket_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+        port_ = ntohs(addr.sin_port);
+        thread_ = std::thread([this]() { run(); });
+    }
+    
+    ~FakeStunServer() {
+        running_ = false;
+        thread_.join();
+        close_socket(socket_);
+    }
+    
+    std::string address() const { return "127.0.0.1:" + std::to_string(port_); }
+    int requests() const { return requests_.load(); }
+    
+private:
+    void run() {
+        while (running_) {
+            std::string ip;
+            int port = 0;
+            auto request = receive_udp_data_with_timeout(socket_, 1024, 50, &ip, &port);
+            if (request.size() < 20 || ++requests_ <= drop_first_) {
+                continue;
+            }
+            std::vector<uint8_t> response = {0x01, 0x01, 0x00, 0x0C, 0x21, 0x12, 0xA4, 0x42};
+            response.insert(response.end(), request.begin() + 8, request.begin() + 20);
+            uint16_t xport = mapped_port_ ^ 0x2112;
+            uint32_t xip = mapped_ip_ ^ 0x2112A442;
+            std::vector<uint8_t> attr = {0x00, 0x20, 0x00, 0x08, 0x00, 0x01,
+                                         static_cast<uint8_t>(xport >> 8), static_cast<uint8_t>(xport),
+                                         static_cast<uint8_t>(xip >> 24), static_cast<uint8_t>(xip >> 16),
+                                         static_cast<uint8_t>(xip >> 8), static_cast<uint8_t>(xip)};
+            response.insert(response.end(), attr.begin(), attr.end());
+            send_udp_data_to(socket_, response, ip, port);
+        }
+    }
+    
+    socket_t socket_;
+    int port_ = 0;
+    uint32_t mapped_ip_;
+    uint16_t mapped_port_;
+    int drop_first_;
+    std::atomic<int> requests_{0};
+    std::atomic<bool> running_{true};
+    std::thread thread_;
+};
+
+} // namespace
+
 TEST_F(StunTest, CreateStunClient) {
     StunClient client;
     // Test that we can create a STUN client without errors
@@ -165,4 +226,34 @@ TEST_F(StunTest, RatsClientStunIntegration) {
         std::cout << "RatsClient STUN discovery failed (this is normal if no internet connection)" << std::endl;
         GTEST_SKIP() << "Skipping RatsClient STUN test due to network connectivity issues";
     }
-} 
\ No newline at end of file
+} 
+TEST_F(StunTest, ParallelBindingQuery) {
+    FakeStunServer fast(0xCB007107, 40000);             // 203.0.113.7:40000
+    FakeStunServer lossy(0xCB007108, 40001, 1);         // drops the first request
+    
+    // A server that never answers must not hold up the others
+    socket_t closed = create_udp_socket_v4(0);
+    sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    getsockname(closed, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    std::string silent = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    close_socket(closed);
+    
+    StunClient client;
+    auto start = std::chrono::steady_clock::now();
+    auto results = client.query_binding_parallel({fast.address(), silent, lossy.address()}, 3000, 2, 100);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_TRUE(results[0].success);
+    EXPECT_EQ(results[0].mapped_address.ip, "203.0.113.7");
+    EXPECT_EQ(results[0].mapped_address.port, 40000);
+    EXPECT_FALSE(results[1].success);
+    EXPECT_TRUE(results[2].success);
+    EXPECT_EQ(results[2].mapped_address.ip, "203.0.113.8");
+    EXPECT_GE(results[2].requests_sent, 2);     // answered only after a retransmission
+    EXPECT_GE(lossy.requests(), 2);
+    
+    // Finished once two servers answered, long before the overall timeout
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 2000);
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "threadmanager.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+bool wait_until(const std::function<bool()>& condition, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // namespace
+
+// Test that submitted tasks share a fixed set of worker threads and a full pool sheds work
+TEST(ThreadManagerTest, PoolReusesWorkersAndSheds) {
+    ThreadManager manager;
+    manager.set_task_pool_limits(2, 8);
+
+    std::mutex mutex;
+    std::set<std::thread::id> workers;
+    std::atomic<int> done{0};
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 4; ++i) {
+            ASSERT_TRUE(manager.submit_task([&]() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    workers.insert(std::this_thread::get_id());
+                }
+                ++done;
+            }));
+        }
+        ASSERT_TRUE(wait_until([&]() { return done.load() == (round + 1) * 4; }, std::chrono::seconds(2)));
+    }
+    EXPECT_LE(workers.size(), 2u);
+
+    // Block both workers, then fill the queue
+    std::atomic<bool> release{false};
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(manager.submit_task([&]() {
+            wait_until([&]() { return release.load(); }, std::chrono::seconds(5));
+        }));
+    }
+    ASSERT_TRUE(wait_until([&]() { return manager.get_pending_task_count() == 0; }, std::chrono::seconds(1)));
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_TRUE(manager.submit_task([&]() { ++done; }));
+    }
+    EXPECT_FALSE(manager.submit_task([&]() { ++done; }));
+    EXPECT_EQ(manager.get_pending_task_count(), 8u);
+
+    release = true;
+    EXPECT_TRUE(wait_until([&]() { return done.load() == 48; }, std::chrono::seconds(2)));
+    EXPECT_EQ(manager.get_active_thread_count(), 0u);
+}
+
+// Test delayed, periodic and cancelled jobs
+TEST(ThreadManagerTest, SchedulesDelayedAndPeriodicTasks) {
+    ThreadManager manager;
+
+    auto scheduled_at = std::chrono::steady_clock::now();
+    std::atomic<bool> delayed_ran{false};
+    std::atomic<long long> delayed_after_ms{0};
+    ASSERT_NE(manager.schedule_task(std::chrono::milliseconds(200), [&]() {
+        delayed_after_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - scheduled_at).count();
+        delayed_ran = true;
+    }), 0u);
+
+    std::atomic<int> periodic_runs{0};
+    uint64_t periodic = manager.schedule_periodic_task(std::chrono::milliseconds(100), [&]() { ++periodic_runs; },
+                                                      "periodic", std::chrono::milliseconds(0));
+    ASSERT_NE(periodic, 0u);
+
+    std::atomic<bool> cancelled_ran{false};
+    uint64_t cancelled = manager.schedule_task(std::chrono::milliseconds(300), [&]() { cancelled_ran = true; });
+    EXPECT_TRUE(manager.cancel_scheduled_task(cancelled));
+    EXPECT_FALSE(manager.cancel_scheduled_task(cancelled));
+
+    ASSERT_TRUE(wait_until([&]() { return delayed_ran.load(); }, std::chrono::seconds(2)));
+    EXPECT_GE(delayed_after_ms.load(), 200);
+    ASSERT_TRUE(wait_until([&]() { return periodic_runs.load() >= 3; }, std::chrono::seconds(2)));
+
+    EXPECT_TRUE(manager.cancel_scheduled_task(periodic));
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    int runs_after_cancel = periodic_runs.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(periodic_runs.load(), runs_after_cancel);
+    EXPECT_FALSE(cancelled_ran.load());
+}
+
+// Test that periodic jobs due at once keep repeating while the scheduler is already running
+TEST(ThreadManagerTest, ImmediatePeriodicTasksRepeat) {
+    ThreadManager manager;
+    ASSERT_NE(manager.schedule_task(std::chrono::milliseconds(0), []() {}), 0u);
+
+    const int task_count = 50;
+    std::vector<std::atomic<int>> runs(task_count);
+    for (int i = 0; i < task_count; ++i) {
+        ASSERT_NE(manager.schedule_periodic_task(std::chrono::milliseconds(10), [&runs, i]() { ++runs[i]; },
+                                                 "immediate", std::chrono::milliseconds(0)), 0u);
+    }
+    EXPECT_TRUE(wait_until([&]() {
+        for (const auto& count : runs) {
+            if (count.load() < 3) {
+                return false;
+            }
+        }
+        return true;
+    }, std::chrono::seconds(5)));
+}
+
+// Test that shutdown stops the pool and refuses new work
+TEST(ThreadManagerTest, ShutdownStopsPoolAndScheduler) {
+    ThreadManager manager;
+
+    std::atomic<int> runs{0};
+    ASSERT_NE(manager.schedule_periodic_task(std::chrono::milliseconds(50), [&]() { ++runs; }, "tick",
+                                             std::chrono::milliseconds(0)), 0u);
+    ASSERT_TRUE(wait_until([&]() { return runs.load() >= 1; }, std::chrono::seconds(2)));
+
+    manager.shutdown_all_threads();
+    manager.join_all_active_threads();
+    int runs_at_shutdown = runs.load();
+
+    EXPECT_FALSE(manager.submit_task([&]() { ++runs; }));
+    EXPECT_EQ(manager.schedule_task(std::chrono::milliseconds(0), [&]() { ++runs; }), 0u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(runs.load(), runs_at_shutdown);
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "timer_wheel.h"
+#include <algorithm>
+
+using namespace librats;
+
+namespace {
+using ms = std::chrono::milliseconds;
+}
+
+// Test that timers expire on the first tick at or after their deadline
+TEST(TimerWheelTest, ExpiresAtDeadlineTick) {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel wheel(ms(100), 8, start);
+
+    wheel.schedule(1, start + ms(250));
+    wheel.schedule(2, start + ms(100));
+    wheel.schedule(3, start);
+    EXPECT_EQ(wheel.size(), 3u);
+
+    EXPECT_EQ(wheel.advance(start), std::vector<uint64_t>{3});
+    EXPECT_TRUE(wheel.advance(start + ms(99)).empty());
+    EXPECT_EQ(wheel.advance(start + ms(100)), std::vector<uint64_t>{2});
+    // 250 ms rounds up to the 300 ms tick
+    EXPECT_TRUE(wheel.advance(start + ms(299)).empty());
+    EXPECT_EQ(wheel.advance(start + ms(300)), std::vector<uint64_t>{1});
+    EXPECT_EQ(wheel.size(), 0u);
+
+    // Deadlines in the past expire on the next advance
+    wheel.schedule(4, start);
+    EXPECT_EQ(wheel.advance(start + ms(300)), std::vector<uint64_t>{4});
+}
+
+// Test deadlines more than one revolution away and large jumps in time
+TEST(TimerWheelTest, LongDeadlinesWaitForTheirRound) {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel wheel(ms(10), 4, start);   // One revolution is 40 ms
+
+    wheel.schedule(1, start + ms(20));
+    wheel.schedule(2, start + ms(60));    // Same slot as id 1, next round
+    wheel.schedule(3, start + ms(1000));
+
+    EXPECT_EQ(wheel.advance(start + ms(20)), std::vector<uint64_t>{1});
+    EXPECT_TRUE(wheel.advance(start + ms(59)).empty());
+    EXPECT_EQ(wheel.advance(start + ms(60)), std::vector<uint64_t>{2});
+
+    // Skipping many revolutions at once still reports everything that is due
+    for (uint64_t id = 10; id < 20; ++id) {
+        wheel.schedule(id, start + ms(100 + id * 7));
+    }
+    std::vector<uint64_t> expired = wheel.advance(start + ms(5000));
+    EXPECT_EQ(expired.size(), 11u);
+    EXPECT_NE(std::find(expired.begin(), expired.end(), 3u), expired.end());
+    EXPECT_EQ(wheel.size(), 0u);
+}
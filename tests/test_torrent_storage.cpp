@@ -0,0 +1,264 @@
+#include <gtest/gtest.h>
+#include "torrent_storage.h"
+#include "bittorrent.h"
+#include "fs.h"
+#include "sha1.h"
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+// Single-file torrent over the given content
+static bool build_torrent_info(const std::vector<uint8_t>& content, uint32_t piece_length,
+                               const std::string& name, librats::TorrentInfo& torrent_info) {
+    std::string pieces;
+    for (size_t offset = 0; offset < content.size(); offset += piece_length) {
+        uint8_t digest[20];
+        librats::SHA1 sha1;
+        sha1.update(content.data() + offset, (std::min)(content.size() - offset, static_cast<size_t>(piece_length)));
+        sha1.finalize(digest);
+        pieces.append(reinterpret_cast<const char*>(digest), sizeof(digest));
+    }
+    
+    auto info = librats::BencodeValue::create_dict();
+    info["name"] = librats::BencodeValue(name);
+    info["piece length"] = librats::BencodeValue(static_cast<int64_t>(piece_length));
+    info["length"] = librats::BencodeValue(static_cast<int64_t>(content.size()));
+    info["pieces"] = librats::BencodeValue(pieces);
+    auto torrent = librats::BencodeValue::create_dict();
+    torrent["info"] = info;
+    return torrent_info.load_from_bencode(torrent);
+}
+
+// Test the disk storage write-back cache against a shared budget
+TEST(TorrentStorageTest, DiskStorageWriteBackCache) {
+    const std::string download_path = "test_torrent_storage";
+    ASSERT_TRUE(librats::create_directories(download_path.c_str()));
+    
+    // Two files, the first piece spans the file boundary
+    std::vector<librats::FileInfo> files;
+    files.emplace_back("a.bin", 30000, 0);
+    files.emplace_back("b.bin", 20000, 30000);
+    const uint32_t piece_length = 32768;
+    
+    std::vector<uint8_t> content(50000);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>((i * 7) ^ (i >> 8));
+    }
+    
+    auto budget = std::make_shared<librats::BlockCacheBudget>(20000);
+    librats::DiskTorrentStorage storage(download_path, files, piece_length, budget);
+    ASSERT_TRUE(storage.open());
+    
+    // Blocks arrive out of order; the second one forces the first out to disk
+    EXPECT_TRUE(storage.write_block(0, 16384, content.data() + 16384, 16384));
+    EXPECT_EQ(budget->get_used(), 16384u);
+    EXPECT_TRUE(storage.write_block(0, 0, content.data(), 16384));
+    EXPECT_LE(budget->get_used(), budget->get_limit());
+    EXPECT_EQ(storage.get_cached_bytes(), 16384u);
+    
+    uint8_t expected[20];
+    uint8_t digest[20];
+    librats::SHA1 sha1;
+    sha1.update(content.data(), piece_length);
+    sha1.finalize(expected);
+    ASSERT_TRUE(storage.hash_piece(0, piece_length, digest));
+    EXPECT_EQ(std::memcmp(digest, expected, sizeof(digest)), 0);
+    
+    // A discarded piece leaves nothing cached
+    std::vector<uint8_t> garbage(16384, 0xEE);
+    EXPECT_TRUE(storage.write_block(1, 0, garbage.data(), garbage.size()));
+    storage.discard_piece(1);
+    
+    const uint32_t last_piece_length = static_cast<uint32_t>(content.size() - piece_length);
+    EXPECT_TRUE(storage.write_block(1, 0, content.data() + piece_length, 16384));
+    EXPECT_TRUE(storage.write_block(1, 16384, content.data() + piece_length + 16384, last_piece_length - 16384));
+    EXPECT_TRUE(storage.flush_piece(0));
+    EXPECT_TRUE(storage.flush_piece(1));
+    EXPECT_EQ(storage.get_cached_bytes(), 0u);
+    EXPECT_EQ(budget->get_used(), 0u);
+    storage.close();
+    
+    size_t size_a = 0;
+    size_t size_b = 0;
+    void* data_a = librats::read_file_binary((download_path + "/a.bin").c_str(), &size_a);
+    void* data_b = librats::read_file_binary((download_path + "/b.bin").c_str(), &size_b);
+    ASSERT_NE(data_a, nullptr);
+    ASSERT_NE(data_b, nullptr);
+    ASSERT_EQ(size_a, 30000u);
+    ASSERT_EQ(size_b, 20000u);
+    EXPECT_EQ(std::memcmp(data_a, content.data(), size_a), 0);
+    EXPECT_EQ(std::memcmp(data_b, content.data() + 30000, size_b), 0);
+    librats::free_file_buffer(data_a);
+    librats::free_file_buffer(data_b);
+    
+    librats::delete_file((download_path + "/a.bin").c_str());
+    librats::delete_file((download_path + "/b.bin").c_str());
+    librats::delete_directory(download_path.c_str());
+}
+
+// Test that completed pieces are verified on the hash pool
+TEST(TorrentStorageTest, AsyncPieceVerification) {
+    const std::string download_path = "test_torrent_verify";
+    ASSERT_TRUE(librats::create_directories(download_path.c_str()));
+    
+    const uint32_t piece_length = 32768;
+    std::vector<uint8_t> content(2 * piece_length);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>(i * 13);
+    }
+    
+    librats::TorrentInfo torrent_info;
+    ASSERT_TRUE(build_torrent_info(content, piece_length, "verify.bin", torrent_info));
+    
+    auto pool = std::make_shared<librats::PieceHashPool>(2);
+    EXPECT_EQ(pool->get_thread_count(), 2u);
+    {
+        librats::TorrentDownload download(torrent_info, download_path, nullptr, pool);
+        ASSERT_TRUE(download.get_storage()->open());
+        
+        // Piece 0 is intact, the second block of piece 1 is corrupted
+        for (uint32_t offset = 0; offset < piece_length; offset += librats::BLOCK_SIZE) {
+            std::vector<uint8_t> block(content.begin() + offset, content.begin() + offset + librats::BLOCK_SIZE);
+            EXPECT_TRUE(download.store_piece_block(0, offset, block));
+            
+            std::vector<uint8_t> other(content.begin() + piece_length + offset,
+                                       content.begin() + piece_length + offset + librats::BLOCK_SIZE);
+            if (offset > 0) {
+                other[0] ^= 0xFF;
+            }
+            EXPECT_TRUE(download.store_piece_block(1, offset, other));
+        }
+        
+        download.wait_for_verification();
+        EXPECT_TRUE(download.is_piece_complete(0));
+        EXPECT_FALSE(download.is_piece_complete(1));
+        EXPECT_EQ(download.get_completed_pieces(), 1u);
+        EXPECT_EQ(download.get_downloaded_bytes(), piece_length);
+    }
+    
+    librats::delete_file((download_path + "/verify.bin").c_str());
+    librats::delete_directory(download_path.c_str());
+}
+
+// Test resume data round trip and the recheck fallback
+TEST(TorrentStorageTest, FastResumeAndRecheck) {
+    const std::string download_path = "test_torrent_resume";
+    ASSERT_TRUE(librats::create_directories(download_path.c_str()));
+    
+    const uint32_t piece_length = 32768;
+    std::vector<uint8_t> content(3 * piece_length);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>((i * 29) ^ (i >> 10));
+    }
+    librats::TorrentInfo torrent_info;
+    ASSERT_TRUE(build_torrent_info(content, piece_length, "resume.bin", torrent_info));
+    auto block = [&](uint32_t piece, uint32_t offset) {
+        auto begin = content.begin() + piece * piece_length + offset;
+        return std::vector<uint8_t>(begin, begin + librats::BLOCK_SIZE);
+    };
+    
+    // Piece 0 complete, first block of piece 2 downloaded
+    std::string resume_path;
+    {
+        librats::TorrentDownload download(torrent_info, download_path);
+        resume_path = download.get_resume_file_path();
+        ASSERT_TRUE(download.get_storage()->open());
+        EXPECT_TRUE(download.store_piece_block(0, 0, block(0, 0)));
+        EXPECT_TRUE(download.store_piece_block(0, librats::BLOCK_SIZE, block(0, librats::BLOCK_SIZE)));
+        EXPECT_TRUE(download.store_piece_block(2, 0, block(2, 0)));
+        download.get_storage()->close();
+        ASSERT_TRUE(download.save_resume_data());
+    }
+    EXPECT_TRUE(librats::file_exists(resume_path));
+    
+    // The partial piece completes with its missing block only
+    {
+        librats::TorrentDownload download(torrent_info, download_path);
+        ASSERT_TRUE(download.load_resume_data());
+        EXPECT_TRUE(download.is_piece_complete(0));
+        EXPECT_FALSE(download.is_piece_complete(2));
+        EXPECT_EQ(download.get_downloaded_bytes(), piece_length);
+        
+        ASSERT_TRUE(download.get_storage()->open());
+        EXPECT_TRUE(download.store_piece_block(2, librats::BLOCK_SIZE, block(2, librats::BLOCK_SIZE)));
+        EXPECT_TRUE(download.is_piece_complete(2));
+        download.get_storage()->close();
+    }
+    
+    // Without resume data the pieces on disk are found by hashing
+    librats::delete_file(resume_path.c_str());
+    {
+        librats::TorrentDownload download(torrent_info, download_path, nullptr,
+                                          std::make_shared<librats::PieceHashPool>(3));
+        EXPECT_FALSE(download.load_resume_data());
+        ASSERT_TRUE(download.get_storage()->open());
+        EXPECT_EQ(download.recheck(), 2u);
+        EXPECT_FALSE(download.is_checking());
+        EXPECT_TRUE(download.is_piece_complete(0));
+        EXPECT_FALSE(download.is_piece_complete(1));
+        EXPECT_TRUE(download.is_piece_complete(2));
+        download.get_storage()->close();
+    }
+    
+    librats::delete_file(resume_path.c_str());
+    librats::delete_file((download_path + "/resume.bin").c_str());
+    librats::delete_directory(download_path.c_str());
+}
+
+// Test that released block buffers are handed out again
+TEST(TorrentStorageTest, BlockBufferPool) {
+    librats::BlockBufferPool pool(librats::BLOCK_SIZE, 2);
+    pool.reserve(8);
+    EXPECT_EQ(pool.get_free_count(), 2u);  // Capped at max_free
+    
+    std::vector<uint8_t> buffer = pool.acquire();
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_GE(buffer.capacity(), librats::BLOCK_SIZE);
+    buffer.assign(librats::BLOCK_SIZE, 0xAB);
+    const uint8_t* storage = buffer.data();
+    
+    pool.release(std::move(buffer));
+    EXPECT_EQ(pool.get_free_count(), 2u);
+    std::vector<uint8_t> again = pool.acquire();
+    EXPECT_TRUE(again.empty());
+    EXPECT_EQ(again.data(), storage);
+    
+    // Buffers too small for a block are not kept
+    pool.release(std::vector<uint8_t>(16));
+    EXPECT_EQ(pool.get_free_count(), 1u);
+}
+
+// Test that the request queue depth follows download rate x round-trip time
+TEST(TorrentStorageTest, RequestQueueDepth) {
+    using namespace std::chrono;
+    
+    // Feed blocks at a constant rate with a constant latency for a few seconds
+    auto simulate = [](librats::RequestQueueDepth& queue, double bytes_per_second,
+                       milliseconds latency, seconds length) {
+        auto start = steady_clock::now();
+        auto interval = duration_cast<steady_clock::duration>(
+            duration<double>(librats::BLOCK_SIZE / bytes_per_second));
+        queue.on_pipeline_started(start);
+        for (auto t = start + interval; t < start + length; t += interval) {
+            queue.on_block_received(librats::BLOCK_SIZE, latency, t);
+        }
+    };
+    
+    librats::RequestQueueDepth fast;
+    EXPECT_EQ(fast.get_depth(), librats::MAX_REQUESTS_PER_PEER);
+    simulate(fast, 1000000.0, milliseconds(200), seconds(4));
+    EXPECT_NEAR(fast.get_download_rate(), 1000000.0, 50000.0);
+    EXPECT_DOUBLE_EQ(fast.get_rtt_ms(), 200.0);
+    // 2 x 1 MB/s x 200 ms is about 25 blocks, plus the slack
+    EXPECT_GE(fast.get_depth(), 26u);
+    EXPECT_LE(fast.get_depth(), 33u);
+    
+    librats::RequestQueueDepth slow;
+    simulate(slow, 32768.0, milliseconds(30), seconds(5));
+    EXPECT_EQ(slow.get_depth(), 1 + librats::REQUEST_QUEUE_SLACK);
+    
+    librats::RequestQueueDepth saturated;
+    simulate(saturated, 100000000.0, milliseconds(500), seconds(2));
+    EXPECT_EQ(saturated.get_depth(), librats::MAX_REQUEST_QUEUE_DEPTH);
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include "tracing.h"
+#include "json.hpp"
+#include "../src/librats.h"
+#include <thread>
+#include <chrono>
+#include <set>
+#include <string>
+
+using namespace librats;
+
+namespace {
+
+template<typename Predicate>
+bool wait_until(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (predicate()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return predicate();
+}
+
+size_t count_spans(const std::string& name) {
+    size_t count = 0;
+    for (const auto& entry : Tracer::getInstance().collect()) {
+        if (name == entry.second.name) {
+            count++;
+        }
+    }
+    return count;
+}
+
+class TracingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Tracer::getInstance().set_enabled(false);
+        Tracer::getInstance().clear();
+    }
+
+    void TearDown() override {
+        Tracer::getInstance().set_enabled(false);
+        Tracer::getInstance().clear();
+    }
+};
+
+} // anonymous namespace
+
+TEST_F(TracingTest, SpansAreOnlyRecordedWhileEnabled) {
+    {
+        TRACE_SPAN("test", "disabled_span");
+    }
+    EXPECT_EQ(count_spans("disabled_span"), 0u);
+
+    Tracer::getInstance().set_enabled(true);
+    {
+        TRACE_SPAN("test", "outer_span");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        TRACE_SPAN("test", "inner_span");
+    }
+    Tracer::getInstance().set_enabled(false);
+
+    auto events = Tracer::getInstance().collect();
+    ASSERT_EQ(events.size(), 2u);
+    // Ordered by start time, and the outer span encloses the inner one
+    EXPECT_STREQ(events[0].second.name, "outer_span");
+    EXPECT_STREQ(events[1].second.name, "inner_span");
+    EXPECT_GE(events[0].second.duration_us, 2000u);
+    EXPECT_LE(events[0].second.start_us, events[1].second.start_us);
+    EXPECT_GE(events[0].second.start_us + events[0].second.duration_us,
+              events[1].second.start_us + events[1].second.duration_us);
+    EXPECT_EQ(events[0].first, events[1].first);
+}
+
+TEST_F(TracingTest, ThreadBufferKeepsNewestSpans) {
+    Tracer& tracer = Tracer::getInstance();
+    size_t capacity = tracer.get_thread_buffer_capacity();
+    tracer.set_thread_buffer_capacity(4);
+    tracer.set_enabled(true);
+
+    // A new thread picks up the smaller capacity
+    std::thread recorder([&] {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10; ++i) {
+            tracer.record("test", "ring_span", start + std::chrono::microseconds(i),
+                          start + std::chrono::microseconds(i + 1));
+        }
+    });
+    recorder.join();
+    tracer.set_thread_buffer_capacity(capacity);
+
+    auto events = tracer.collect();
+    ASSERT_EQ(events.size(), 4u);
+    for (size_t i = 1; i < events.size(); ++i) {
+        EXPECT_EQ(events[i].second.start_us, events[i - 1].second.start_us + 1);
+    }
+}
+
+TEST_F(TracingTest, ExportsChromeTraceJson) {
+    Tracer::getInstance().set_enabled(true);
+    {
+        TRACE_SPAN("test", "main_thread_span");
+    }
+    std::thread other([] { TRACE_SPAN("test", "other_thread_span"); });
+    other.join();
+
+    auto trace = nlohmann::json::parse(Tracer::getInstance().export_chrome_trace());
+    ASSERT_TRUE(trace["traceEvents"].is_array());
+    ASSERT_EQ(trace["traceEvents"].size(), 2u);
+    std::set<uint32_t> threads;
+    for (const auto& event : trace["traceEvents"]) {
+        EXPECT_EQ(event["ph"], "X");
+        EXPECT_EQ(event["cat"], "test");
+        EXPECT_TRUE(event["ts"].is_number_unsigned());
+        EXPECT_TRUE(event["dur"].is_number_unsigned());
+        threads.insert(event["tid"].get<uint32_t>());
+    }
+    EXPECT_EQ(threads.size(), 2u);
+
+    Tracer::getInstance().clear();
+    EXPECT_TRUE(Tracer::getInstance().collect().empty());
+}
+
+TEST_F(TracingTest, ClientRecordsConnectionAndMessageSpans) {
+    RatsClient client1(59038, 5);
+    RatsClient client2(59039, 5);
+    ASSERT_TRUE(client1.start());
+    ASSERT_TRUE(client2.start());
+    client1.set_tracing_enabled(true);
+    EXPECT_TRUE(client2.is_tracing_enabled());
+
+    std::atomic<int> messages{0};
+    client1.on("tracing-test", [&](const std::string&, const nlohmann::json&) { messages++; });
+    ASSERT_TRUE(client2.connect_to_peer("127.0.0.1", 59038));
+    ASSERT_TRUE(wait_until([&] { return client1.get_peer_count() == 1 && client2.get_peer_count() == 1; }));
+    client2.send(client1.get_our_peer_id(), "tracing-test", nlohmann::json{{"value", 1}});
+    EXPECT_TRUE(wait_until([&] { return messages.load() == 1; }));
+
+    client1.set_tracing_enabled(false);
+    EXPECT_GE(count_spans("attempt_direct_connection"), 1u);
+    EXPECT_GE(count_spans("handle_handshake_message"), 2u);
+    EXPECT_GE(count_spans("process_client_message"), 1u);
+    EXPECT_GE(count_spans("call_message_handlers"), 1u);
+    EXPECT_NE(client1.export_trace_json().find("\"call_message_handlers\""), std::string::npos);
+
+    client2.stop();
+    client1.stop();
+}
@@ -0,0 +1,417 @@
+#include <gtest/gtest.h>
+#include "utp.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace librats;
+
+namespace {
+
+std::vector<uint8_t> make_pattern(size_t size, uint8_t seed) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(i * 31 + seed + (i >> 10));
+    }
+    return data;
+}
+
+// Pumps data both ways until everything arrived or the deadline passed
+bool exchange(UtpSocket& a, UtpSocket& b, const std::vector<uint8_t>& a_to_b, const std::vector<uint8_t>& b_to_a,
+              std::vector<uint8_t>& received_by_a, std::vector<uint8_t>& received_by_b, int timeout_ms = 15000) {
+    size_t a_sent = 0;
+    size_t b_sent = 0;
+    uint8_t buffer[16384];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (received_by_b.size() < a_to_b.size() || received_by_a.size() < b_to_a.size()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        bool progress = false;
+        if (a_sent < a_to_b.size()) {
+            int n = a.write(a_to_b.data() + a_sent, a_to_b.size() - a_sent);
+            if (n < 0) return false;
+            a_sent += n;
+            progress |= n > 0;
+        }
+        if (b_sent < b_to_a.size()) {
+            int n = b.write(b_to_a.data() + b_sent, b_to_a.size() - b_sent);
+            if (n < 0) return false;
+            b_sent += n;
+            progress |= n > 0;
+        }
+        int n;
+        while ((n = b.read(buffer, sizeof(buffer))) > 0) {
+            received_by_b.insert(received_by_b.end(), buffer, buffer + n);
+            progress = true;
+        }
+        while ((n = a.read(buffer, sizeof(buffer))) > 0) {
+            received_by_a.insert(received_by_a.end(), buffer, buffer + n);
+            progress = true;
+        }
+        if (!progress) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    return true;
+}
+
+template <typename Predicate>
+bool wait_for(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+sockaddr_storage loopback_address(int port) {
+    sockaddr_storage address;
+    std::memset(&address, 0, sizeof(address));
+    sockaddr_in6* addr = reinterpret_cast<sockaddr_in6*>(&address);
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(static_cast<uint16_t>(port));
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&addr->sin6_addr);
+    bytes[10] = 0xff;
+    bytes[11] = 0xff;
+    bytes[12] = 127;
+    bytes[15] = 1;
+    return address;
+}
+
+int address_port(const sockaddr_storage& address) {
+    return ntohs(reinterpret_cast<const sockaddr_in6*>(&address)->sin6_port);
+}
+
+} // namespace
+
+class UtpConnectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(server_.start(0));
+        ASSERT_TRUE(client_.start(0));
+        server_.set_accept_callback([this](std::shared_ptr<UtpSocket> socket) {
+            std::lock_guard<std::mutex> lock(accepted_mutex_);
+            accepted_ = socket;
+        });
+    }
+
+    void TearDown() override {
+        client_.stop();
+        server_.stop();
+    }
+
+    std::shared_ptr<UtpSocket> get_accepted() {
+        std::lock_guard<std::mutex> lock(accepted_mutex_);
+        return accepted_;
+    }
+
+    UtpManager server_;
+    UtpManager client_;
+    std::mutex accepted_mutex_;
+    std::shared_ptr<UtpSocket> accepted_;
+};
+
+// Test header serialization and rejection of non-uTP datagrams
+TEST(UtpTest, HeaderRoundTrip) {
+    UtpHeader header;
+    header.type = UtpPacketType::DATA;
+    header.connection_id = 0xBEEF;
+    header.timestamp_us = 123456789;
+    header.timestamp_difference_us = 4321;
+    header.window_size = 65536;
+    header.seq_nr = 65535;
+    header.ack_nr = 7;
+
+    uint8_t packet[UTP_HEADER_SIZE + 4];
+    header.write(packet);
+    std::memcpy(packet + UTP_HEADER_SIZE, "data", 4);
+    EXPECT_EQ(packet[0], 0x01);
+
+    UtpHeader parsed;
+    ASSERT_EQ(UtpHeader::parse(packet, sizeof(packet), parsed), UTP_HEADER_SIZE);
+    EXPECT_EQ(parsed.type, UtpPacketType::DATA);
+    EXPECT_EQ(parsed.connection_id, 0xBEEF);
+    EXPECT_EQ(parsed.timestamp_us, 123456789u);
+    EXPECT_EQ(parsed.timestamp_difference_us, 4321u);
+    EXPECT_EQ(parsed.window_size, 65536u);
+    EXPECT_EQ(parsed.seq_nr, 65535);
+    EXPECT_EQ(parsed.ack_nr, 7);
+
+    // An extension (selective ack) is skipped over
+    uint8_t extended[UTP_HEADER_SIZE + 6 + 2];
+    header.write(extended);
+    extended[1] = 1;
+    extended[UTP_HEADER_SIZE] = 0;
+    extended[UTP_HEADER_SIZE + 1] = 4;
+    EXPECT_EQ(UtpHeader::parse(extended, sizeof(extended), parsed), UTP_HEADER_SIZE + 6);
+    EXPECT_EQ(UtpHeader::parse(extended, UTP_HEADER_SIZE + 4, parsed), 0u);
+
+    // STUN and bencoded DHT messages on a shared socket are not uTP
+    uint8_t stun[UTP_HEADER_SIZE] = {0x01, 0x01, 0x00, 0x00, 0x21, 0x12, 0xA4, 0x42};
+    EXPECT_EQ(UtpHeader::parse(stun, sizeof(stun), parsed), 0u);
+    const char dht[] = "d1:ad2:id20:abcdefghij0123456789e1:q4:ping1:t2:aa1:y1:qe";
+    EXPECT_EQ(UtpHeader::parse(reinterpret_cast<const uint8_t*>(dht), sizeof(dht) - 1, parsed), 0u);
+    EXPECT_EQ(UtpHeader::parse(packet, UTP_HEADER_SIZE - 1, parsed), 0u);
+}
+
+// Test that the LEDBAT window follows the queuing delay
+TEST(UtpTest, LedbatWindow) {
+    auto now = std::chrono::steady_clock::now();
+    LedbatController ledbat;
+    EXPECT_EQ(ledbat.get_window(), LedbatController::MIN_WINDOW);
+
+    // Empty queue: the window grows while it is used
+    ledbat.on_delay_sample(50000, now);
+    for (int i = 0; i < 2000; ++i) {
+        ledbat.on_ack(UTP_MAX_PAYLOAD, ledbat.get_window());
+    }
+    size_t grown = ledbat.get_window();
+    EXPECT_GT(grown, 100000u);
+    EXPECT_EQ(ledbat.get_queuing_delay_us(), 0u);
+
+    // An application-limited sender keeps its window
+    ledbat.on_ack(UTP_MAX_PAYLOAD, 0);
+    EXPECT_EQ(ledbat.get_window(), grown);
+
+    // Queuing delay above the target shrinks it
+    ledbat.on_delay_sample(50000 + 2 * UTP_TARGET_DELAY_US, now);
+    EXPECT_EQ(ledbat.get_base_delay_us(), 50000u);
+    EXPECT_EQ(ledbat.get_queuing_delay_us(), 2 * UTP_TARGET_DELAY_US);
+    for (int i = 0; i < 50; ++i) {
+        ledbat.on_ack(UTP_MAX_PAYLOAD, ledbat.get_window());
+    }
+    EXPECT_LT(ledbat.get_window(), grown);
+
+    // Base delay compares with wrap-around, the clocks of the hosts are unrelated
+    LedbatController wrapped;
+    wrapped.on_delay_sample(0xFFFFFF00u, now);
+    wrapped.on_delay_sample(0x00000100u, now);
+    EXPECT_EQ(wrapped.get_base_delay_us(), 0xFFFFFF00u);
+    EXPECT_EQ(wrapped.get_queuing_delay_us(), 0x200u);
+
+    size_t before_loss = ledbat.get_window();
+    ledbat.on_loss();
+    EXPECT_EQ(ledbat.get_window(), std::max(before_loss / 2, LedbatController::MIN_WINDOW));
+    ledbat.on_timeout();
+    EXPECT_EQ(ledbat.get_window(), LedbatController::MIN_WINDOW);
+}
+
+// Test connecting, a bulk transfer both ways and a graceful close
+TEST_F(UtpConnectionTest, LoopbackTransfer) {
+    auto client = client_.connect("127.0.0.1", server_.get_port());
+    ASSERT_NE(client, nullptr);
+    ASSERT_TRUE(wait_for([&] { return client->is_connected() && get_accepted() != nullptr; }));
+    auto server = get_accepted();
+    EXPECT_EQ(server->get_remote_peer().port, client_.get_port());
+
+    std::vector<uint8_t> upload = make_pattern(2 * 1024 * 1024 + 17, 1);
+    std::vector<uint8_t> download = make_pattern(300 * 1024, 2);
+    std::vector<uint8_t> received_by_client, received_by_server;
+    ASSERT_TRUE(exchange(*client, *server, upload, download, received_by_client, received_by_server));
+    EXPECT_EQ(received_by_server, upload);
+    EXPECT_EQ(received_by_client, download);
+    EXPECT_GT(client->get_congestion_window(), LedbatController::MIN_WINDOW);
+
+    // FIN: the other side reads end of stream, and both connections are dropped once done
+    client->close();
+    uint8_t buffer[64];
+    EXPECT_TRUE(wait_for([&] { return server->read(buffer, sizeof(buffer)) < 0; }));
+    server->close();
+    EXPECT_TRUE(wait_for([&] { return client_.get_connection_count() == 0 && server_.get_connection_count() == 0; }));
+    EXPECT_EQ(client->get_state(), UtpSocket::State::CLOSED);
+}
+
+// Test that events drive readers: connect completion, data and end of stream
+TEST_F(UtpConnectionTest, EventHandlers) {
+    std::atomic<uint32_t> client_events{0};
+    auto client = client_.connect("127.0.0.1", server_.get_port());
+    ASSERT_NE(client, nullptr);
+    client->set_event_handler([&](uint32_t events) { client_events |= events; });
+    ASSERT_TRUE(wait_for([&] { return (client_events & IO_EVENT_WRITE) != 0 && get_accepted() != nullptr; }));
+
+    auto server = get_accepted();
+    std::mutex received_mutex;
+    std::vector<uint8_t> received;
+    std::atomic<bool> eof{false};
+    server->set_event_handler([&](uint32_t) {
+        uint8_t buffer[4096];
+        int n;
+        while ((n = server->read(buffer, sizeof(buffer))) > 0) {
+            std::lock_guard<std::mutex> lock(received_mutex);
+            received.insert(received.end(), buffer, buffer + n);
+        }
+        if (n < 0) {
+            eof = true;
+        }
+    });
+
+    std::vector<uint8_t> message = make_pattern(50000, 3);
+    ASSERT_EQ(client->write(message.data(), message.size()), static_cast<int>(message.size()));
+    client->close();
+    ASSERT_TRUE(wait_for([&] { return eof.load(); }));
+    {
+        std::lock_guard<std::mutex> lock(received_mutex);
+        EXPECT_EQ(received, message);
+    }
+
+    // The handlers refer to locals; stopping fails the connections once more
+    client_.stop();
+    server_.stop();
+}
+
+// Test that data for a connection the other side does not know is reset, and
+// that stopping a manager fails its connections
+TEST_F(UtpConnectionTest, ResetAndStop) {
+    auto client = client_.connect("127.0.0.1", server_.get_port());
+    ASSERT_TRUE(wait_for([&] { return client->is_connected() && get_accepted() != nullptr; }));
+    std::atomic<uint32_t> events{0};
+    client->set_event_handler([&](uint32_t e) { events |= e; });
+
+    // A fresh manager on the same port has never heard of the connection
+    int port = server_.get_port();
+    server_.stop();
+    EXPECT_EQ(get_accepted()->get_state(), UtpSocket::State::ERROR);
+    UtpManager replacement;
+    ASSERT_TRUE(replacement.start(port));
+
+    uint8_t byte = 1;
+    EXPECT_EQ(client->write(&byte, 1), 1);
+    ASSERT_TRUE(wait_for([&] { return client->get_state() == UtpSocket::State::ERROR; }));
+    EXPECT_TRUE(wait_for([&] { return (events & IO_EVENT_ERROR) != 0; }));
+    uint8_t buffer[1];
+    EXPECT_EQ(client->read(buffer, 1), -1);
+    EXPECT_EQ(client->write(&byte, 1), -1);
+
+    // Without an accept callback SYNs go unanswered
+    auto pending = client_.connect("127.0.0.1", port);
+    ASSERT_NE(pending, nullptr);
+    EXPECT_EQ(pending->write(&byte, 1), 0);
+    client_.stop();
+    EXPECT_EQ(pending->get_state(), UtpSocket::State::ERROR);
+    EXPECT_EQ(client_.connect("127.0.0.1", port), nullptr);
+}
+
+// Test recovery from lost packets through a relay that drops some datagrams
+TEST_F(UtpConnectionTest, RecoversFromLoss) {
+    socket_t relay = create_udp_socket(0);
+    ASSERT_TRUE(is_valid_socket(relay));
+    set_socket_nonblocking(relay);
+    int relay_port = get_ephemeral_port(relay);
+    sockaddr_storage server_address = loopback_address(server_.get_port());
+
+    std::atomic<bool> running{true};
+    std::atomic<int> dropped{0};
+    std::thread relay_thread([&] {
+        sockaddr_storage client_address;
+        bool have_client = false;
+        uint8_t buffer[2048];
+        uint32_t counter = 0;
+        while (running) {
+            sockaddr_storage from;
+            socklen_t from_length;
+            int n = receive_udp_nonblocking(relay, buffer, sizeof(buffer), from, from_length);
+            if (n <= 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            // Lose every 29th datagram after the handshake, in both directions
+            if (++counter > 4 && counter % 29 == 0) {
+                ++dropped;
+                continue;
+            }
+            if (address_port(from) == server_.get_port()) {
+                if (have_client) {
+                    send_udp_nonblocking(relay, client_address, sizeof(sockaddr_in6), buffer, n);
+                }
+            } else {
+                client_address = from;
+                have_client = true;
+                send_udp_nonblocking(relay, server_address, sizeof(sockaddr_in6), buffer, n);
+            }
+        }
+    });
+
+    auto client = client_.connect("127.0.0.1", relay_port);
+    ASSERT_NE(client, nullptr);
+    bool connected = wait_for([&] { return client->is_connected() && get_accepted() != nullptr; });
+    std::vector<uint8_t> upload = make_pattern(384 * 1024, 4);
+    std::vector<uint8_t> download = make_pattern(64 * 1024, 5);
+    std::vector<uint8_t> received_by_client, received_by_server;
+    bool complete = connected && exchange(*client, *get_accepted(), upload, download,
+                                          received_by_client, received_by_server, 30000);
+
+    running = false;
+    relay_thread.join();
+    close_socket(relay);
+
+    ASSERT_TRUE(connected);
+    ASSERT_TRUE(complete);
+    EXPECT_EQ(received_by_server, upload);
+    EXPECT_EQ(received_by_client, download);
+    EXPECT_GT(dropped.load(), 10);
+    EXPECT_GT(client->get_retransmits(), 0u);
+}
+
+// Test that a bridged connection behaves like a stream socket pair: bytes flow
+// both ways under backpressure, and closing one end reaches the other as EOF
+TEST_F(UtpConnectionTest, SocketBridge) {
+    IoReactor reactor("bridge", 1);
+    ASSERT_TRUE(reactor.start());
+
+    auto client = client_.connect("127.0.0.1", server_.get_port());
+    ASSERT_NE(client, nullptr);
+    ASSERT_TRUE(wait_for([&] { return client->is_connected() && get_accepted() != nullptr; }));
+    auto client_bridge = UtpSocketBridge::create(client, reactor);
+    auto server_bridge = UtpSocketBridge::create(get_accepted(), reactor);
+    ASSERT_NE(client_bridge, nullptr);
+    ASSERT_NE(server_bridge, nullptr);
+    socket_t a = client_bridge->get_socket();
+    socket_t b = server_bridge->get_socket();
+
+    // More than the socket pair and uTP buffers hold, so both directions stall and resume
+    std::vector<uint8_t> upload = make_pattern(3 * 1024 * 1024, 6);
+    std::vector<uint8_t> download = make_pattern(200 * 1024, 7);
+    std::vector<uint8_t> received_by_a, received_by_b;
+    size_t a_sent = 0;
+    size_t b_sent = 0;
+    uint8_t buffer[16384];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    while ((received_by_b.size() < upload.size() || received_by_a.size() < download.size()) &&
+           std::chrono::steady_clock::now() < deadline) {
+        if (a_sent < upload.size()) {
+            int n = send_tcp_nonblocking(a, upload.data() + a_sent, upload.size() - a_sent);
+            ASSERT_GE(n, 0);
+            a_sent += n;
+        }
+        if (b_sent < download.size()) {
+            int n = send_tcp_nonblocking(b, download.data() + b_sent, download.size() - b_sent);
+            ASSERT_GE(n, 0);
+            b_sent += n;
+        }
+        int n;
+        while ((n = receive_tcp_nonblocking(b, buffer, sizeof(buffer))) > 0) {
+            received_by_b.insert(received_by_b.end(), buffer, buffer + n);
+        }
+        while ((n = receive_tcp_nonblocking(a, buffer, sizeof(buffer))) > 0) {
+            received_by_a.insert(received_by_a.end(), buffer, buffer + n);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(received_by_b, upload);
+    EXPECT_EQ(received_by_a, download);
+
+    // Closing our end finishes the uTP connection; the other side reads EOF and its bridge closes
+    close_socket(a);
+    EXPECT_TRUE(wait_for([&] { return receive_tcp_nonblocking(b, buffer, sizeof(buffer)) < 0; }));
+    EXPECT_TRUE(wait_for([&] { return client_bridge->is_closed() && server_bridge->is_closed(); }));
+    close_socket(b);
+    EXPECT_TRUE(wait_for([&] { return client_.get_connection_count() == 0 && server_.get_connection_count() == 0; }));
+
+    reactor.stop();
+}